@@ -23,9 +23,11 @@
 #include "loss.hpp"
 #include "decay_type.hpp"
 #include "sparsity_method.hpp"
+#include "noise_type.hpp"
 #include "bias_mode.hpp"
 #include "initializer.hpp"
 #include "output.hpp"
+#include "util/shape_dispatch.hpp"
 
 namespace dll {
 
@@ -106,10 +108,13 @@ struct copy_id;
 struct elastic_id;
 struct batch_size_id;
 struct big_batch_size_id;
+struct augmentation_workers_id;
+struct compact_storage_id;
 struct visible_id;
 struct hidden_id;
 struct pooling_id;
 struct activation_id;
+struct activation_precision_id;
 struct loss_id;
 struct output_policy_id;
 struct initializer_id;
@@ -136,19 +141,37 @@ struct init_weights_id;
 struct clip_gradients_id;
 struct weight_type_id;
 struct free_energy_id;
+struct monitor_every_id;
+struct sparse_input_id;
+struct static_shapes_id;
 struct no_epoch_error_id;
+struct full_epoch_error_id;
+struct overlapped_validation_id;
 struct random_crop_id;
 struct batch_mode_id;
+struct pretrain_cache_id;
+struct blocked_inference_id;
+struct shared_errors_id;
+struct recompute_activations_id;
+struct unfused_updates_id;
+struct gpu_resident_id;
 struct dbn_only_id;
 struct last_only_id;
+struct time_major_input_id;
+struct time_major_output_id;
 struct horizontal_mirroring_id;
 struct vertical_mirroring_id;
 struct categorical_id;
 struct threaded_id;
 struct nop_id;
 struct no_bias_id;
+struct packed_weights_id;
+struct column_shards_id;
+struct negative_samples_id;
+struct negative_sampler_id;
 struct elastic_distortion_id;
 struct noise_id;
+struct noise_model_id;
 struct scale_pre_id;
 struct normalize_pre_id;
 struct binarize_pre_id;
@@ -157,6 +180,14 @@ struct updater_id;
 struct early_stopping_id;
 struct early_training_id;
 struct truncate_id;
+struct data_parallel_id;
+struct hogwild_id;
+struct pipeline_parallel_id;
+struct micro_batches_id;
+struct gradient_accumulation_id;
+struct frozen_prefix_id;
+struct stride_id;
+struct dilation_id;
 
 /*!
  * \brief Sets the minibatch size
@@ -175,6 +206,29 @@ struct batch_size : value_conf_elt<batch_size_id, size_t, B> {};
 template <size_t B>
 struct big_batch_size : value_conf_elt<big_batch_size_id, size_t, B> {};
 
+/*!
+ * \brief Sets the number of threads augmenting the batches of a generator.
+ *
+ * Each thread fills its own batches of the big batch, with its own copy of
+ * the augmenters.
+ *
+ * \tparam W The number of augmentation threads
+ */
+template <size_t W>
+struct augmentation_workers : value_conf_elt<augmentation_workers_id, size_t, W> {};
+
+/*!
+ * \brief Sets the type used to store the samples of an in-memory
+ * generator.
+ *
+ * The samples are converted to the type of the network and preprocessed
+ * when the batches are filled.
+ *
+ * \tparam T The storage type (uint8_t for instance)
+ */
+template <typename T>
+struct compact_storage : type_conf_elt<compact_storage_id, T> {};
+
 /*!
  * \brief Sets the updater type
  * \tparam UT The updater type
@@ -223,6 +277,17 @@ struct pooling : value_conf_elt<pooling_id, unit_type, PT> {};
 template <function FT>
 struct activation : value_conf_elt<activation_id, function, FT> {};
 
+/*!
+ * \brief Sets the precision of the activation functions.
+ *
+ * With function_precision::FAST, sigmoid, tanh and softmax are computed
+ * with vectorized approximations, trading a small accuracy loss for speed.
+ *
+ * \tparam P The precision
+ */
+template <function_precision P>
+struct activation_precision : value_conf_elt<activation_precision_id, function_precision, P> {};
+
 /*!
  * \brief Sets the loss function
  * \tparam FT The loss function type
@@ -398,6 +463,13 @@ struct elastic_distortion : value_conf_elt<elastic_distortion_id, size_t, K> {};
 template <size_t N>
 struct noise : value_conf_elt<noise_id, size_t, N> {};
 
+/*!
+ * \brief Sets how the noise corrupts the inputs
+ * \tparam T The type of noise
+ */
+template <noise_type T>
+struct noise_model : value_conf_elt<noise_model_id, noise_type, T> {};
+
 /*!
  * \brief Sets the prescaling factor
  * \tparam S The scaling factor
@@ -433,8 +505,65 @@ struct init_weights : basic_conf_elt<init_weights_id> {};
 struct shuffle : basic_conf_elt<shuffle_id> {};
 
 /*!
- * \brief dbn: Shuffle the inputs before each pretraining epoch.
- * This implies that the inputs will be copied in memory!
+ * \brief Run the convolutional layers of the inference plans in the
+ * channel-blocked NCHWc layout.
+ */
+struct blocked_inference : basic_conf_elt<blocked_inference_id> {};
+
+/*!
+ * \brief Share the memory of the errors of the non-adjacent layers during
+ * SGD training.
+ *
+ * The gradients of each layer are then computed as soon as it has
+ * backpropagated its errors. Only the errors of the dense and convolutional
+ * layers of the network itself are shared.
+ */
+struct shared_errors : basic_conf_elt<shared_errors_id> {};
+
+/*!
+ * \brief Recompute the activations during SGD training instead of keeping
+ * them for the whole batch.
+ *
+ * Only the activations of one layer every K layers (the checkpoints) are
+ * kept. The inputs and outputs of the dense and convolutional layers between
+ * two checkpoints are views on a pool shared by all the segments. Before a
+ * segment is backpropagated, it is forwarded again from its checkpoint, and
+ * the gradients of each layer are computed as soon as it has
+ * backpropagated its errors.
+ *
+ * This is only supported by the serial trainer without frozen layers and
+ * the recomputed layers must be dense, convolutional, pooling or activation
+ * layers. The health monitor does not sample the activations of the
+ * recomputed layers.
+ *
+ * \tparam K The number of layers of each segment, ended by its checkpoint
+ */
+template <size_t K>
+struct recompute_activations : value_conf_elt<recompute_activations_id, size_t, K> {};
+
+/*!
+ * \brief Update the weights of the SGD training with one ETL expression per
+ * step of the updater instead of a single fused pass over memory.
+ *
+ * The results are the same up to rounding, this is mostly useful to check
+ * the fused updates.
+ */
+struct unfused_updates : basic_conf_elt<unfused_updates_id> {};
+
+/*!
+ * \brief Keep the SGD training resident on the GPU, in ETL_GPU builds.
+ *
+ * The weights, the contexts and the updater states then stay on the device
+ * and the updates and the errors of the last layer are computed with ETL
+ * expressions. Without this option, the training keeps its fused passes on
+ * the CPU. This has no effect without ETL_GPU.
+ */
+struct gpu_resident : basic_conf_elt<gpu_resident_id> {};
+
+/*!
+ * \brief dbn: Shuffle the inputs before each pretraining epoch, in batch
+ * mode. The blocks of big_batch_size batches are read in a random order,
+ * the samples being shuffled inside each block.
  */
 struct shuffle_pre : basic_conf_elt<shuffle_pre_id> {};
 
@@ -443,11 +572,62 @@ struct shuffle_pre : basic_conf_elt<shuffle_pre_id> {};
  */
 struct free_energy : basic_conf_elt<free_energy_id> {};
 
+/*!
+ * \brief RBM: Compute the monitoring metrics (reconstruction error and free
+ * energy) only on one batch out of N during pretraining.
+ *
+ * The error and the free energy of the epoch are then the means over the
+ * monitored batches.
+ *
+ * \tparam N The number of batches between two monitored batches
+ */
+template <size_t N>
+struct monitor_every : value_conf_elt<monitor_every_id, size_t, N> {};
+
+/*!
+ * \brief The inputs are sparse (bag-of-words counts or rectified
+ * activations for instance).
+ *
+ * RBM: The positive phase of Contrastive Divergence then works on a CSR
+ * copy of each batch, for the hidden activations and for the gradients of
+ * the weights. The reconstructions are dense and use the normal path.
+ *
+ * Dense layer: The density of each batch is measured and the sparse enough
+ * batches are gathered in a CSC copy, used for the forward pass and for the
+ * gradients of the weights, instead of the dense products.
+ */
+struct sparse_input : basic_conf_elt<sparse_input_id> {};
+
+/*!
+ * \brief Dynamic convolutional RBM: the common shapes for which the
+ * convolutions are instantiated with static dimensions.
+ *
+ * Each shape is a static_shape<NC, NV1, NV2, K, NW1, NW2>. The shape of
+ * the layer is looked up in init_layer; the layers of any other shape use
+ * the dynamic convolutions.
+ */
+template <typename... Shapes>
+struct static_shapes : type_conf_elt<static_shapes_id, static_shape_list<Shapes...>> {};
+
 /*!
  * \brief Disable error calculation on epoch.
  */
 struct no_epoch_error : basic_conf_elt<no_epoch_error_id> {};
 
+/*!
+ * \brief Compute the training error of each epoch with a complete pass
+ * over the training set instead of accumulating the metrics of the batches
+ * during training.
+ */
+struct full_epoch_error : basic_conf_elt<full_epoch_error_id> {};
+
+/*!
+ * \brief Evaluate the validation set on a snapshot of the weights,
+ * concurrently with the next training epoch. The early stopping decisions
+ * are taken one epoch late.
+ */
+struct overlapped_validation : basic_conf_elt<overlapped_validation_id> {};
+
 /*!
  * \brief Enable gradient clipping.
  */
@@ -467,6 +647,24 @@ struct dbn_only : basic_conf_elt<dbn_only_id> {};
  */
 struct last_only : basic_conf_elt<last_only_id> {};
 
+/*!
+ * \brief Indicates that the input of a recurrent layer is time-major.
+ *
+ * The input must be the output of a recurrent layer with time_major_output
+ * and the same lengths of sequences.
+ */
+struct time_major_input : basic_conf_elt<time_major_input_id> {};
+
+/*!
+ * \brief Indicates that the output of a recurrent layer is time-major.
+ *
+ * The output keeps its shape, but its memory holds the time steps one
+ * after the other, each with the samples sorted by decreasing length. It
+ * can only be consumed by a recurrent layer or a recurrent last layer with
+ * time_major_input.
+ */
+struct time_major_output : basic_conf_elt<time_major_output_id> {};
+
 /*!
  * \brief Do nothing (for TMP)
  */
@@ -477,11 +675,55 @@ struct nop : basic_conf_elt<nop_id> {};
  */
 struct no_bias : basic_conf_elt<no_bias_id> {};
 
+/*!
+ * \brief Keep the weights of a dense layer packed in the GEMM panels
+ * between batches (only with MKL)
+ */
+struct packed_weights : basic_conf_elt<packed_weights_id> {};
+
+/*!
+ * \brief Split the output columns of a dense layer into S shards computed
+ * in parallel (forward, backward, gradients and softmax)
+ */
+template <size_t S>
+struct column_shards : value_conf_elt<column_shards_id, size_t, S> {};
+
+/*!
+ * \brief Sets the number of negative classes sampled at each training step
+ * of a sampled softmax layer
+ */
+template <size_t S>
+struct negative_samples : value_conf_elt<negative_samples_id, size_t, S> {};
+
+/*!
+ * \brief Sets the sampler of the negative classes of a sampled softmax layer
+ * \tparam S The sampler type (uniform_sampler or log_uniform_sampler)
+ */
+template <typename S>
+struct negative_sampler : type_conf_elt<negative_sampler_id, S> {};
+
 /*!
  * \brief Use batch mode in DBN (Do not process the complete dataset at once)
  */
 struct batch_mode : basic_conf_elt<batch_mode_id> {};
 
+/*!
+ * \brief Batch mode: keep the inputs of the first N batches of the layer
+ * being pretrained in memory, instead of forwarding them through the
+ * previous layers at each epoch.
+ *
+ * The batches are always visited in the same order, so the first batches
+ * are kept rather than the most recent ones, which would never be reused
+ * before being evicted. The augmentations of the generator are only
+ * applied once to the cached batches, which is why the denoising
+ * pretraining does not use the cache, its noise being drawn again for
+ * each epoch.
+ *
+ * \tparam N The maximum number of cached batches
+ */
+template <size_t N>
+struct pretrain_cache : value_conf_elt<pretrain_cache_id, size_t, N> {};
+
 /*!
  * \brief Sets the BPTT steps to truncate
  * \tparam T The truncate steps
@@ -489,6 +731,102 @@ struct batch_mode : basic_conf_elt<batch_mode_id> {};
 template <size_t T>
 struct truncate : value_conf_elt<truncate_id, size_t, T> {};
 
+/*!
+ * \brief Train the network with data-parallel SGD.
+ *
+ * Each mini-batch is split into S shards of the same size, processed
+ * concurrently on the thread pool of the network and the gradients are
+ * reduced before being applied.
+ *
+ * On a static RBM, each shard runs its own Gibbs chains of Contrastive
+ * Divergence into private buffers, on the thread pool of the trainer.
+ *
+ * \tparam S The number of shards
+ */
+template <size_t S>
+struct data_parallel : value_conf_elt<data_parallel_id, size_t, S> {};
+
+/*!
+ * \brief Train the network with asynchronous (Hogwild) data-parallel SGD.
+ *
+ * Each shard of data_parallel applies its own updates directly to the
+ * shared weights, as soon as its gradients are computed, without reduction
+ * nor locks. The updater states (the momentum) are private to each shard.
+ * This is only supported for the SGD and MOMENTUM updaters.
+ */
+struct hogwild : basic_conf_elt<hogwild_id> {};
+
+/*!
+ * \brief Train the network with pipeline-parallel SGD.
+ *
+ * The layers are split into S stages of contiguous layers and each
+ * mini-batch into micro-batches (see micro_batches). The stages run
+ * concurrently on the thread pool of the network, with a 1F1B schedule,
+ * each stage holding the activations of its layers for the micro-batches in
+ * flight. The gradients of each stage are accumulated over the
+ * micro-batches before being applied.
+ *
+ * A layer and the activation layer fused into it (or an upsampling layer
+ * and the convolution of a sub-pixel convolution) are never split between
+ * two stages. This cannot be combined with data_parallel.
+ *
+ * \tparam S The number of stages
+ */
+template <size_t S>
+struct pipeline_parallel : value_conf_elt<pipeline_parallel_id, size_t, S> {};
+
+/*!
+ * \brief Sets the number of micro-batches of each mini-batch in
+ * pipeline-parallel training (by default, the number of stages).
+ *
+ * \tparam M The number of micro-batches
+ */
+template <size_t M>
+struct micro_batches : value_conf_elt<micro_batches_id, size_t, M> {};
+
+/*!
+ * \brief Accumulate the gradients over several mini-batches before
+ * updating the weights.
+ *
+ * This sets the default value of the accumulation_steps field of the
+ * network, which can also be changed at runtime.
+ *
+ * \tparam S The number of accumulated mini-batches
+ */
+template <size_t S>
+struct gradient_accumulation : value_conf_elt<gradient_accumulation_id, size_t, S> {};
+
+/*!
+ * \brief Freeze the first K layers of the network during SGD training.
+ *
+ * The frozen layers are only forwarded, in inference mode (no dropout and
+ * the running statistics of the normalizations): they have no gradients
+ * and no updater state. Unless the inputs are augmented, the outputs of
+ * the frozen prefix are computed once for the training set and the
+ * following epochs only train the other layers (see
+ * cache_frozen_features).
+ *
+ * \tparam K The number of frozen layers
+ */
+template <size_t K>
+struct frozen_prefix : value_conf_elt<frozen_prefix_id, size_t, K> {};
+
+/*!
+ * \brief Sets the strides of a convolutional layer
+ * \tparam S1 The first stride
+ * \tparam S2 The second stride
+ */
+template <size_t S1, size_t S2 = S1>
+struct stride : value_pair_conf_elt<stride_id, size_t, S1, S2> {};
+
+/*!
+ * \brief Sets the dilation of the filters of a convolutional layer
+ * \tparam D1 The first dilation
+ * \tparam D2 The second dilation
+ */
+template <size_t D1, size_t D2 = D1>
+struct dilation : value_pair_conf_elt<dilation_id, size_t, D1, D2> {};
+
 /*!
  * \brief Conditional shuffle (shuffle if Cond = true)
  */
@@ -17,9 +17,159 @@
 #include "layer.hpp"
 #include "layer_traits.hpp"
 #include "util/tmp.hpp"
+#include "util/sequence_mask.hpp"
+#include "util/time_major.hpp"
 
 namespace dll {
 
+/*!
+ * \brief The workspace of the forward pass of a LSTM layer.
+ *
+ * The workspace is only grown, it can therefore be reused for batches of
+ * different sizes. The lengths of the mask can be set for batches of
+ * variable-length sequences.
+ */
+template <typename W>
+struct lstm_forward_workspace {
+    etl::dyn_matrix<W, 3> g_t; ///< The input modulation gate of each time step
+    etl::dyn_matrix<W, 3> i_t; ///< The input gate of each time step
+    etl::dyn_matrix<W, 3> f_t; ///< The forget gate of each time step
+    etl::dyn_matrix<W, 3> o_t; ///< The output gate of each time step
+
+    etl::dyn_matrix<W, 3> x_t; ///< The input of each time step
+    etl::dyn_matrix<W, 3> s_t; ///< The cell state of each time step
+    etl::dyn_matrix<W, 3> h_t; ///< The hidden state of each time step
+
+    etl::dyn_matrix<W, 2> xu; ///< The input projections of all the time steps
+    etl::dyn_matrix<W, 2> z;  ///< The hidden projection of one time step
+
+    etl::dyn_matrix<W, 2> u_all; ///< The packed U weights [U_g|U_i|U_f|U_o]
+    etl::dyn_matrix<W, 2> w_all; ///< The packed W weights [W_g|W_i|W_f|W_o]
+    etl::dyn_matrix<W, 1> b_all; ///< The packed biases [b_g|b_i|b_f|b_o]
+
+    sequence_mask mask; ///< The mask of the variable-length sequences of the batch
+
+    /*!
+     * \brief Prepare the workspace for a batch of the given size
+     */
+    void prepare(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) {
+        if (cpp_unlikely(!x_t.memory_start() || etl::dim<1>(x_t) < Batch)) {
+            g_t.resize(time_steps, Batch, hidden_units);
+            i_t.resize(time_steps, Batch, hidden_units);
+            f_t.resize(time_steps, Batch, hidden_units);
+            o_t.resize(time_steps, Batch, hidden_units);
+
+            x_t.resize(time_steps, Batch, sequence_length);
+            s_t.resize(time_steps, Batch, hidden_units);
+            h_t.resize(time_steps, Batch, hidden_units);
+
+            xu.resize(time_steps * Batch, 4 * hidden_units);
+            z.resize(Batch, 4 * hidden_units);
+
+            u_all.resize(sequence_length, 4 * hidden_units);
+            w_all.resize(hidden_units, 4 * hidden_units);
+            b_all.resize(4 * hidden_units);
+
+            x_t = W(0);
+        }
+    }
+};
+
+/*!
+ * \brief The workspace of a LSTM layer during training, holding the
+ * forward and the backward caches.
+ */
+template <typename W>
+struct lstm_workspace : lstm_forward_workspace<W> {
+    etl::dyn_matrix<W, 3> delta_t; ///< The errors of each time step
+    etl::dyn_matrix<W, 3> d_h_t;   ///< The errors of the hidden state of each time step
+    etl::dyn_matrix<W, 3> d_c_t;   ///< The errors of the cell state of each time step
+    etl::dyn_matrix<W, 3> d_x_t;   ///< The errors of the input of each time step
+
+    etl::dyn_matrix<W, 2> d_z; ///< The errors of the gates of one time step
+
+    etl::dyn_matrix<W, 2> u_all_grad; ///< The packed gradients of U
+    etl::dyn_matrix<W, 2> w_all_grad; ///< The packed gradients of W
+    etl::dyn_matrix<W, 1> b_all_grad; ///< The packed gradients of the biases
+
+    /*!
+     * \brief Prepare the backward caches for the current forward caches
+     */
+    void prepare_backward(size_t time_steps, size_t sequence_length, size_t hidden_units) {
+        const size_t Batch = etl::dim<1>(this->x_t);
+
+        if (cpp_unlikely(!d_h_t.memory_start() || etl::dim<1>(d_h_t) != Batch)) {
+            delta_t.resize(time_steps, Batch, hidden_units);
+            d_h_t.resize(time_steps, Batch, hidden_units);
+            d_c_t.resize(time_steps, Batch, hidden_units);
+            d_x_t.resize(time_steps, Batch, sequence_length);
+
+            d_z.resize(Batch, 4 * hidden_units);
+
+            u_all_grad.resize(sequence_length, 4 * hidden_units);
+            w_all_grad.resize(hidden_units, 4 * hidden_units);
+            b_all_grad.resize(4 * hidden_units);
+
+            delta_t = W(0);
+        }
+    }
+};
+
+/*!
+ * \brief The state of several streams for step-by-step inference with a
+ * LSTM layer.
+ *
+ * Each row holds the state of one stream. A stream starts from a zero
+ * state, as the first time step of a full sequence.
+ */
+template <typename W>
+struct lstm_stream_state {
+    etl::dyn_matrix<W, 2> h; ///< The hidden state of each stream
+    etl::dyn_matrix<W, 2> s; ///< The cell state of each stream
+
+    etl::dyn_matrix<W, 2> g; ///< The input modulation gate of the last step
+    etl::dyn_matrix<W, 2> i; ///< The input gate of the last step
+    etl::dyn_matrix<W, 2> f; ///< The forget gate of the last step
+    etl::dyn_matrix<W, 2> o; ///< The output gate of the last step
+
+    std::vector<bool> started; ///< Indicates if each stream has done at least one step
+
+    /*!
+     * \brief Create the state of the given number of streams
+     */
+    lstm_stream_state(size_t streams, size_t hidden_units)
+            : h(streams, hidden_units, W(0)), s(streams, hidden_units, W(0)),
+              g(streams, hidden_units), i(streams, hidden_units), f(streams, hidden_units), o(streams, hidden_units),
+              started(streams, false) {}
+
+    /*!
+     * \brief Return the number of streams
+     */
+    size_t streams() const {
+        return etl::dim<0>(h);
+    }
+
+    /*!
+     * \brief Restart the given stream from a zero state
+     */
+    void reset(size_t stream) {
+        h(stream) = W(0);
+        s(stream) = W(0);
+
+        started[stream] = false;
+    }
+
+    /*!
+     * \brief Restart all the streams from a zero state
+     */
+    void reset() {
+        h = W(0);
+        s = W(0);
+
+        std::fill(started.begin(), started.end(), false);
+    }
+};
+
 /*!
  * \brief Base class for LSTM layers (fast / dynamic)
  */
@@ -32,6 +182,7 @@ struct base_lstm_layer : layer<Derived> {
     using base_type = layer<Derived>;                          ///< The base type
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr auto precision           = desc::precision;           ///< The precision of the activation function and of the gates
 
     /*!
      * \brief Initialize the neural layer
@@ -83,6 +234,24 @@ struct base_lstm_layer : layer<Derived> {
         as_derived().b_o = *as_derived().bak_b_o;
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        as_derived().bak_w_i.reset();
+        as_derived().bak_u_i.reset();
+        as_derived().bak_b_i.reset();
+        as_derived().bak_w_g.reset();
+        as_derived().bak_u_g.reset();
+        as_derived().bak_b_g.reset();
+        as_derived().bak_w_f.reset();
+        as_derived().bak_u_f.reset();
+        as_derived().bak_b_f.reset();
+        as_derived().bak_w_o.reset();
+        as_derived().bak_u_o.reset();
+        as_derived().bak_b_o.reset();
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
@@ -159,6 +328,310 @@ struct base_lstm_layer : layer<Derived> {
             std::cref(as_derived().w_o), std::cref(as_derived().u_o), std::cref(as_derived().b_o));
     }
 
+    /*!
+     * \brief Create the state of the given number of streams for step-by-step inference
+     * \param streams The number of streams
+     */
+    lstm_stream_state<weight> make_stream_state(size_t streams) const {
+        return {streams, as_derived().hidden_units};
+    }
+
+    /*!
+     * \brief Advance each of the given streams by one time step.
+     *
+     * This computes the same outputs as forward_batch on the full
+     * sequences, at the cost of a single time step per call.
+     *
+     * \param output The output of each stream for this time step (streams x hidden_units)
+     * \param x The input frame of each stream (streams x sequence_length)
+     * \param state The state of the streams, updated in place
+     */
+    template <typename H, typename V>
+    void step_batch(H&& output, const V& x, lstm_stream_state<weight>& state) const {
+        static dll::timer_id timer_handle("lstm:step_batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(etl::dim<0>(x) == state.streams(), "One input frame is needed per stream");
+
+        auto& l = as_derived();
+
+        state.g = bias_add_2d(x * l.u_g + state.h * l.w_g, l.b_g);
+        state.i = bias_add_2d(x * l.u_i + state.h * l.w_i, l.b_i);
+        state.f = bias_add_2d(x * l.u_f + state.h * l.w_f, l.b_f);
+        state.o = bias_add_2d(x * l.u_o + state.h * l.w_o, l.b_o);
+
+        f_activate_inplace<function::TANH, precision>(state.g);
+        f_activate_inplace<function::SIGMOID, precision>(state.i);
+        f_activate_inplace<function::SIGMOID, precision>(state.f);
+        f_activate_inplace<function::SIGMOID, precision>(state.o);
+
+        for (size_t k = 0; k < state.streams(); ++k) {
+            if (state.started[k]) {
+                state.s(k) = f_activate<activation_function>((state.g(k) >> state.i(k)) + (state.s(k) >> state.f(k)));
+                state.h(k) = state.s(k) >> state.o(k);
+            } else {
+                // The first step of a sequence (see forward_batch)
+                state.s(k) = state.g(k) >> state.i(k);
+                state.h(k) = f_activate<activation_function>(state.s(k)) >> state.o(k);
+
+                state.started[k] = true;
+            }
+        }
+
+        output = state.h;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, computing only
+     * the output of the last time step.
+     *
+     * The states are advanced in place one step at a time (see
+     * step_batch), the states of the other steps are never stored. This is
+     * used for inference when the layer is followed by a
+     * recurrent_last_layer. All the sequences must have the full number of
+     * time steps.
+     *
+     * \param output The output of the last time step (Batch x hidden_units)
+     * \param x A batch of input
+     */
+    template <typename H, typename V>
+    void forward_last_batch(H&& output, const V& x) const {
+        static dll::timer_id timer_handle("lstm:forward_last_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t Batch = etl::dim<0>(x);
+
+        auto& l = as_derived();
+
+        // Each thread has its own state for inference
+        thread_local lstm_stream_state<weight> state(0, 0);
+        thread_local etl::dyn_matrix<weight, 2> frame;
+
+        if (state.streams() != Batch || etl::dim<1>(state.s) != l.hidden_units) {
+            state = make_stream_state(Batch);
+        } else {
+            state.reset();
+        }
+
+        if (etl::dim<0>(frame) != Batch || etl::dim<1>(frame) != l.sequence_length) {
+            frame = etl::dyn_matrix<weight, 2>(Batch, l.sequence_length);
+        }
+
+        for (size_t t = 0; t < l.time_steps; ++t) {
+            copy_time_step<derived_t::time_major_in>(frame, x, t, l.time_steps);
+
+            step_batch(output, frame, state);
+        }
+    }
+
+    /*!
+     * \brief Pack the given variables of the four gates side by side.
+     *
+     * Each variable is seen as a matrix of H columns and the packed
+     * variable is a matrix of 4H columns, in the order [g|i|f|o].
+     *
+     * \param packed The packed variable
+     */
+    template <typename P, typename G, typename I, typename F, typename O>
+    static void pack_gates(P& packed, const G& g, const I& i, const F& f, const O& o) {
+        g.ensure_cpu_up_to_date();
+        i.ensure_cpu_up_to_date();
+        f.ensure_cpu_up_to_date();
+        o.ensure_cpu_up_to_date();
+
+        const size_t H = etl::dim(g, etl::dimensions(g) - 1);
+        const size_t R = etl::size(g) / H;
+
+        auto* p = packed.memory_start();
+
+        for (size_t r = 0; r < R; ++r) {
+            for (size_t j = 0; j < H; ++j) {
+                p[r * 4 * H + 0 * H + j] = g.memory_start()[r * H + j];
+                p[r * 4 * H + 1 * H + j] = i.memory_start()[r * H + j];
+                p[r * 4 * H + 2 * H + j] = f.memory_start()[r * H + j];
+                p[r * 4 * H + 3 * H + j] = o.memory_start()[r * H + j];
+            }
+        }
+
+        packed.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Unpack a variable packed by pack_gates into the variables of
+     * the four gates.
+     *
+     * \param packed The packed variable
+     */
+    template <typename P, typename G, typename I, typename F, typename O>
+    static void unpack_gates(const P& packed, G& g, I& i, F& f, O& o) {
+        packed.ensure_cpu_up_to_date();
+
+        const size_t H = etl::dim(g, etl::dimensions(g) - 1);
+        const size_t R = etl::size(g) / H;
+
+        const auto* p = packed.memory_start();
+
+        for (size_t r = 0; r < R; ++r) {
+            for (size_t j = 0; j < H; ++j) {
+                g.memory_start()[r * H + j] = p[r * 4 * H + 0 * H + j];
+                i.memory_start()[r * H + j] = p[r * 4 * H + 1 * H + j];
+                f.memory_start()[r * H + j] = p[r * 4 * H + 2 * H + j];
+                o.memory_start()[r * H + j] = p[r * 4 * H + 3 * H + j];
+            }
+        }
+
+        g.invalidate_gpu();
+        i.invalidate_gpu();
+        f.invalidate_gpu();
+        o.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the four gates and the (non-activated) state of the
+     * time step t, in a single pass.
+     *
+     * \param t The time step
+     * \param n The number of active samples in this time step
+     * \param xu The input projections of all the time steps (packed gates)
+     * \param z The hidden projection of the time step (packed gates), unused for t == 0
+     * \param b The packed biases
+     */
+    template <typename XU, typename Z, typename B, typename T>
+    static void forward_gates(size_t t, size_t n, const XU& xu, const Z& z, const B& b, T& g_t, T& i_t, T& f_t, T& o_t, T& s_t) {
+        xu.ensure_cpu_up_to_date();
+        z.ensure_cpu_up_to_date();
+        b.ensure_cpu_up_to_date();
+        g_t.ensure_cpu_up_to_date();
+        i_t.ensure_cpu_up_to_date();
+        f_t.ensure_cpu_up_to_date();
+        o_t.ensure_cpu_up_to_date();
+        s_t.ensure_cpu_up_to_date();
+
+        const size_t Batch = etl::dim<1>(g_t);
+        const size_t H     = etl::dim<2>(g_t);
+
+        const auto* xu_p = xu.memory_start() + t * Batch * 4 * H;
+        const auto* z_p  = z.memory_start();
+        const auto* b_p  = b.memory_start();
+
+        auto* g_p = g_t.memory_start() + t * Batch * H;
+        auto* i_p = i_t.memory_start() + t * Batch * H;
+        auto* f_p = f_t.memory_start() + t * Batch * H;
+        auto* o_p = o_t.memory_start() + t * Batch * H;
+        auto* s_p = s_t.memory_start() + t * Batch * H;
+
+        const auto* s_prev = t > 0 ? s_t.memory_start() + (t - 1) * Batch * H : nullptr;
+
+        auto sigmoid = [](auto x) {
+            if constexpr (precision == function_precision::FAST) {
+                return fast_sigmoid(x);
+            } else {
+                return 1.0f / (1.0f + std::exp(-x));
+            }
+        };
+
+        auto tanh = [](auto x) {
+            if constexpr (precision == function_precision::FAST) {
+                return fast_tanh(x);
+            } else {
+                return std::tanh(x);
+            }
+        };
+
+        for (size_t bb = 0; bb < n; ++bb) {
+            for (size_t j = 0; j < H; ++j) {
+                const size_t zi = bb * 4 * H + j;
+                const size_t hi = bb * H + j;
+
+                auto pre = [&](size_t k) {
+                    auto v = xu_p[zi + k * H] + b_p[k * H + j];
+
+                    if (t > 0) {
+                        v += z_p[zi + k * H];
+                    }
+
+                    return v;
+                };
+
+                const auto g = tanh(pre(0));
+                const auto i = sigmoid(pre(1));
+                const auto f = sigmoid(pre(2));
+                const auto o = sigmoid(pre(3));
+
+                g_p[hi] = g;
+                i_p[hi] = i;
+                f_p[hi] = f;
+                o_p[hi] = o;
+
+                s_p[hi] = t > 0 ? g * i + s_prev[hi] * f : g * i;
+            }
+        }
+
+        g_t.invalidate_gpu();
+        i_t.invalidate_gpu();
+        f_t.invalidate_gpu();
+        o_t.invalidate_gpu();
+        s_t.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the errors of the four gates of the time step t, in a
+     * single pass.
+     *
+     * \param t The time step
+     * \param n The number of active samples in this time step
+     * \param d_z The errors of the gates (packed gates)
+     * \param d_h_t The errors of the hidden state
+     * \param d_c_t The errors of the cell state
+     */
+    template <typename Z, typename T>
+    static void backward_gates(size_t t, size_t n, Z& d_z, const T& g_t, const T& i_t, const T& f_t, const T& o_t, const T& s_t, const T& d_h_t, const T& d_c_t) {
+        g_t.ensure_cpu_up_to_date();
+        i_t.ensure_cpu_up_to_date();
+        f_t.ensure_cpu_up_to_date();
+        o_t.ensure_cpu_up_to_date();
+        s_t.ensure_cpu_up_to_date();
+        d_h_t.ensure_cpu_up_to_date();
+        d_c_t.ensure_cpu_up_to_date();
+
+        const size_t Batch = etl::dim<1>(g_t);
+        const size_t H     = etl::dim<2>(g_t);
+
+        const size_t offset = t * Batch * H;
+
+        const auto* g_p  = g_t.memory_start() + offset;
+        const auto* i_p  = i_t.memory_start() + offset;
+        const auto* f_p  = f_t.memory_start() + offset;
+        const auto* o_p  = o_t.memory_start() + offset;
+        const auto* s_p  = s_t.memory_start() + offset;
+        const auto* dh_p = d_h_t.memory_start() + offset;
+        const auto* dc_p = d_c_t.memory_start() + offset;
+
+        const auto* s_prev = t > 0 ? s_t.memory_start() + (t - 1) * Batch * H : nullptr;
+
+        auto* z_p = d_z.memory_start();
+
+        for (size_t bb = 0; bb < n; ++bb) {
+            for (size_t j = 0; j < H; ++j) {
+                const size_t zi = bb * 4 * H + j;
+                const size_t hi = bb * H + j;
+
+                const auto g  = g_p[hi];
+                const auto i  = i_p[hi];
+                const auto f  = f_p[hi];
+                const auto o  = o_p[hi];
+                const auto dc = dc_p[hi];
+
+                z_p[zi + 0 * H] = (1 - g * g) * (i * dc);
+                z_p[zi + 1 * H] = i * (1 - i) * (g * dc);
+                z_p[zi + 2 * H] = t > 0 ? f * (1 - f) * (s_prev[hi] * dc) : 0;
+                z_p[zi + 3 * H] = o * (1 - o) * (s_p[hi] * dh_p[hi]);
+            }
+        }
+
+        d_z.invalidate_gpu();
+    }
+
 private:
     //CRTP Deduction
 
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <array>
 #include <fstream>
+#include <tuple>
 
 #include "cpp_utils/assert.hpp" //Assertions
 #include "cpp_utils/io.hpp"     // For binary writing
@@ -17,9 +19,104 @@
 #include "layer.hpp"
 #include "layer_traits.hpp"
 #include "util/tmp.hpp"
+#include "util/sequence_mask.hpp"
+#include "util/time_major.hpp"
+#include "util/parallel.hpp"
 
 namespace dll {
 
+/*!
+ * \brief The workspace of the forward pass of a RNN layer.
+ *
+ * The workspace is only grown, it can therefore be reused for batches of
+ * different sizes. The lengths of the mask can be set for batches of
+ * variable-length sequences.
+ */
+template <typename W>
+struct rnn_forward_workspace {
+    etl::dyn_matrix<W, 3> x_t; ///< The input of each time step
+    etl::dyn_matrix<W, 3> s_t; ///< The state of each time step
+
+    sequence_mask mask; ///< The mask of the variable-length sequences of the batch
+
+    /*!
+     * \brief Prepare the workspace for a batch of the given size
+     */
+    void prepare(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) {
+        if (cpp_unlikely(!x_t.memory_start() || etl::dim<1>(x_t) < Batch)) {
+            x_t.resize(time_steps, Batch, sequence_length);
+            s_t.resize(time_steps, Batch, hidden_units);
+
+            x_t = W(0);
+            s_t = W(0);
+        }
+    }
+};
+
+/*!
+ * \brief The workspace of a RNN layer during training, holding the
+ * forward and the backward caches.
+ */
+template <typename W>
+struct rnn_workspace : rnn_forward_workspace<W> {
+    etl::dyn_matrix<W, 3> delta_t; ///< The errors of each time step
+    etl::dyn_matrix<W, 3> d_h_t;   ///< The errors of the state of each time step
+    etl::dyn_matrix<W, 3> d_x_t;   ///< The errors of the input of each time step
+
+    /*!
+     * \brief Prepare the backward caches for the current forward caches
+     */
+    void prepare_backward(size_t time_steps, size_t sequence_length, size_t hidden_units) {
+        const size_t Batch = etl::dim<1>(this->x_t);
+
+        if (cpp_unlikely(!d_h_t.memory_start() || etl::dim<1>(d_h_t) != Batch)) {
+            delta_t.resize(time_steps, Batch, hidden_units);
+            d_h_t.resize(time_steps, Batch, hidden_units);
+            d_x_t.resize(time_steps, Batch, sequence_length);
+
+            delta_t = W(0);
+        }
+    }
+};
+
+/*!
+ * \brief The state of several streams for step-by-step inference with a
+ * RNN layer.
+ *
+ * Each row holds the state of one stream. A stream starts from a zero
+ * state, as the first time step of a full sequence.
+ */
+template <typename W>
+struct rnn_stream_state {
+    etl::dyn_matrix<W, 2> s; ///< The state of each stream
+
+    /*!
+     * \brief Create the state of the given number of streams
+     */
+    rnn_stream_state(size_t streams, size_t hidden_units) : s(streams, hidden_units, W(0)) {}
+
+    /*!
+     * \brief Return the number of streams
+     */
+    size_t streams() const {
+        return etl::dim<0>(s);
+    }
+
+    /*!
+     * \brief Restart the given stream from a zero state
+     */
+    void reset(size_t stream) {
+        s(stream) = W(0);
+    }
+
+    /*!
+     * \brief Restart all the streams from a zero state
+     */
+    void reset() {
+        s = W(0);
+    }
+};
+
 /*!
  * \brief Base class for RNN layers (fast / dynamic)
  */
@@ -33,6 +130,9 @@ struct base_rnn_layer : layer<Derived> {
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
 
+    static constexpr bool time_major_in  = desc::parameters::template contains<time_major_input>();  ///< Indicates if the input is time-major
+    static constexpr bool time_major_out = desc::parameters::template contains<time_major_output>(); ///< Indicates if the output is time-major
+
     /*!
      * \brief Initialize the neural layer
      */
@@ -47,16 +147,6 @@ struct base_rnn_layer : layer<Derived> {
     base_rnn_layer& operator=(const base_rnn_layer& rhs) = delete;
     base_rnn_layer& operator=(base_rnn_layer&& rhs) = delete;
 
-    mutable etl::dyn_matrix<float, 3> x_t;
-    mutable etl::dyn_matrix<float, 3> s_t;
-
-    void prepare_cache(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
-        if (cpp_unlikely(!x_t.memory_start())) {
-            x_t.resize(time_steps, Batch, sequence_length);
-            s_t.resize(time_steps, Batch, hidden_units);
-        }
-    }
-
     /*!
      * \brief Apply the layer to the given batch of input.
      *
@@ -64,38 +154,66 @@ struct base_rnn_layer : layer<Derived> {
      * \param output A batch of output that will be filled
      * \param w The W weights matrix
      * \param u The U weights matrix
+     * \param ws The workspace of the forward pass
      */
-    template <typename H, typename V, typename W, typename U, typename B>
-    void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+    template <typename H, typename V, typename W, typename U, typename B, typename WS>
+    void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units, WS& ws) const {
         const auto Batch = etl::dim<0>(x);
 
-        prepare_cache(Batch, time_steps, sequence_length, hidden_units);
+        ws.prepare(Batch, time_steps, sequence_length, hidden_units);
 
-        // 1. Rearrange input
+        auto& x_t  = ws.x_t;
+        auto& s_t  = ws.s_t;
+        auto& mask = ws.mask;
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
-            }
-        }
+        mask.prepare(Batch, time_steps);
+
+        // 1. Rearrange input (sorted by decreasing length)
+
+        to_time_steps<time_major_in>(x_t, x, mask, time_steps);
 
         // 2. Forward propagation through time
 
-        // t == 0
+        forward_cached_impl(ws, mask, w, u, b, time_steps, sequence_length, hidden_units);
 
-        s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u, b));
+        // 3. Rearrange the output (the padding steps are set to zero)
 
-        for (size_t t = 1; t < time_steps; ++t) {
-            s_t(t) = f_activate<activation_function>(bias_add_2d(x_t(t) * u + s_t(t - 1) * w, b));
-        }
+        from_time_steps<time_major_out>(output, s_t, mask, time_steps);
+    }
 
-        // 3. Rearrange the output
+    /*!
+     * \brief Compute all the time steps of the forward pass, from the inputs
+     * of the steps already in the workspace.
+     *
+     * \param ws The workspace of the forward pass, prepared
+     * \param mask The mask of the batch, prepared
+     */
+    template <typename WS>
+    void forward_cached(WS& ws, const sequence_mask& mask) const {
+        auto& l = as_derived();
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = s_t(t)(b);
-            }
+        forward_cached_impl(ws, mask, l.w, l.u, l.b, l.time_steps, l.sequence_length, l.hidden_units);
+    }
+
+    /*!
+     * \brief Compute one time step of the forward pass, from the input of
+     * the step already in the workspace.
+     *
+     * \param t The time step
+     * \param n The number of active samples at this step
+     * \param ws The workspace of the forward pass, prepared
+     */
+    template <typename WS>
+    void forward_step(size_t t, size_t n, WS& ws) const {
+        auto s = etl::slice(ws.s_t(t), 0, n);
+
+        s = bias_add_2d(etl::slice(ws.x_t(t), 0, n) * as_derived().u, as_derived().b);
+
+        if (t > 0) {
+            s += etl::slice(ws.s_t(t - 1), 0, n) * as_derived().w;
         }
+
+        s = f_activate<activation_function>(s);
     }
 
     /*!
@@ -105,79 +223,91 @@ struct base_rnn_layer : layer<Derived> {
      */
     template <typename H, typename C, typename W, typename U>
     void backward_batch_impl(H&& output, C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps, bool direct = true) const {
-        cpp_unused(sequence_length);
-
         const size_t Batch = etl::dim<0>(context.errors);
 
-        etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
-        etl::dyn_matrix<float, 3> d_h_t(time_steps, Batch, hidden_units);
-        etl::dyn_matrix<float, 3> d_x_t(time_steps, Batch, sequence_length);
+        auto& ws = context.workspace;
 
-        // 1. Rearrange errors
+        ws.prepare_backward(time_steps, sequence_length, hidden_units);
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
-            }
-        }
+        auto& x_t     = ws.x_t;
+        auto& s_t     = ws.s_t;
+        auto& delta_t = ws.delta_t;
+        auto& d_h_t   = ws.d_h_t;
+        auto& d_x_t   = ws.d_x_t;
+        auto& mask    = ws.mask;
 
-        // 2. Get the gradients from the context
+        // 1. Rearrange errors (in the order of the forward pass)
 
-        auto& w_grad = std::get<0>(context.up.context)->grad;
-        auto& u_grad = std::get<1>(context.up.context)->grad;
-        auto& b_grad = std::get<2>(context.up.context)->grad;
+        to_time_steps<time_major_out>(delta_t, context.errors, mask, time_steps);
 
-        w_grad = 0;
-        u_grad = 0;
-        b_grad = 0;
+        // 2. Backpropagation through time, the errors of the states are kept for all the steps
 
-        // 3. Backpropagation through time
+        const size_t ws_batch  = etl::dim<1>(x_t);
+        const size_t last_step = bptt_steps < time_steps ? time_steps - bptt_steps : 0;
 
-        size_t ttt = time_steps - 1;
+        // The errors of the samples not computed must be zero for the gradients
+        if (mask.enabled() || last_step > 0 || Batch != ws_batch) {
+            d_h_t = 0;
+        }
 
-        do {
-            const size_t last_step = std::max(int(time_steps) - int(bptt_steps), 0);
+        for (size_t tt = time_steps; tt > last_step; --tt) {
+            const size_t t = tt - 1;
+            const size_t n = mask.active[t];
 
-            // Backpropagation through time
-            for (int tt = ttt; tt >= int(last_step); --tt) {
-                const size_t t = tt;
+            if (!n) {
+                continue;
+            }
 
-                if(t == time_steps - 1){
-                    d_h_t(t) = delta_t(t) >> f_derivative<activation_function>(s_t(t));
-                } else {
-                    d_h_t(t) = (delta_t(t) + d_h_t(t + 1)) >> f_derivative<activation_function>(s_t(t));
-                }
+            auto d_h = etl::slice(d_h_t(t), 0, n);
 
-                if (t > 0) {
-                    w_grad += etl::batch_outer(s_t(t - 1), d_h_t(t));
-                }
+            if (t == time_steps - 1) {
+                d_h = etl::slice(delta_t(t), 0, n) >> f_derivative<activation_function>(etl::slice(s_t(t), 0, n));
+            } else {
+                // The samples ending at this step have no errors from the next step (zero rows)
+                d_h = (etl::slice(delta_t(t), 0, n) + etl::slice(d_h_t(t + 1), 0, n) * trans(w)) >> f_derivative<activation_function>(etl::slice(s_t(t), 0, n));
+            }
+        }
 
-                u_grad += etl::batch_outer(x_t(t), d_h_t(t));
-                b_grad += etl::bias_batch_sum_2d(d_h_t(t));
+        auto d_h_all = etl::reshape(d_h_t, time_steps * ws_batch, hidden_units);
 
-                // Gradients to the input
-                d_x_t(t) = d_h_t(t) * trans(u);
+        // 3. Gradients to the input, for all the steps at once
 
-                // Update for next steps
-                d_h_t(t) = d_h_t(t) * trans(w);
-            }
+        if (direct) {
+            etl::reshape(d_x_t, time_steps * ws_batch, sequence_length) = d_h_all * trans(u);
+        }
+
+        // 4. Accumulate the gradients over all the steps at once
 
-            --ttt;
+        // Without last_only, each step is counted once per truncated window
+        // ending at or after it, i.e. time_steps - max(t, 1) times
+        if constexpr (!desc::parameters::template contains<last_only>()) {
+            for (size_t t = last_step; t < time_steps; ++t) {
+                const size_t windows = time_steps - std::max<size_t>(t, 1);
 
-            // If only the last time step is used, no need to use the other errors
-            if constexpr (desc::parameters::template contains<last_only>()) {
-                break;
+                if (windows > 1 && mask.active[t]) {
+                    etl::slice(d_h_t(t), 0, mask.active[t]) *= weight(windows);
+                }
             }
-        } while (ttt != 0);
+        }
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+        auto& u_grad = std::get<1>(context.up.context)->grad;
+        auto& b_grad = std::get<2>(context.up.context)->grad;
+
+        u_grad = etl::batch_outer(etl::reshape(x_t, time_steps * ws_batch, sequence_length), d_h_all);
+        b_grad = etl::bias_batch_sum_2d(d_h_all);
+
+        if (time_steps > 1) {
+            w_grad = etl::batch_outer(etl::reshape(etl::slice(s_t, 0, time_steps - 1), (time_steps - 1) * ws_batch, hidden_units),
+                                      etl::reshape(etl::slice(d_h_t, 1, time_steps), (time_steps - 1) * ws_batch, hidden_units));
+        } else {
+            w_grad = 0;
+        }
 
-        // 3. Rearrange for the output
+        // 5. Rearrange for the output
 
         if (direct) {
-            for (size_t b = 0; b < Batch; ++b) {
-                for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
-                }
-            }
+            from_time_steps<time_major_in>(output, d_x_t, mask, time_steps);
         }
     }
 
@@ -188,7 +318,80 @@ struct base_rnn_layer : layer<Derived> {
     template <typename C, typename W, typename U>
     void compute_gradients_impl(C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps) const {
         if constexpr (!C::layer){
-            backward_batch_impl(x_t, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps, false);
+            backward_batch_impl(context.workspace.x_t, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps, false);
+        }
+    }
+
+    /*!
+     * \brief Create the state of the given number of streams for step-by-step inference
+     * \param streams The number of streams
+     */
+    rnn_stream_state<weight> make_stream_state(size_t streams) const {
+        return {streams, as_derived().hidden_units};
+    }
+
+    /*!
+     * \brief Advance each of the given streams by one time step.
+     *
+     * This computes the same outputs as forward_batch on the full
+     * sequences, at the cost of a single time step per call.
+     *
+     * \param output The output of each stream for this time step (streams x hidden_units)
+     * \param x The input frame of each stream (streams x sequence_length)
+     * \param state The state of the streams, updated in place
+     */
+    template <typename H, typename V>
+    void step_batch(H&& output, const V& x, rnn_stream_state<weight>& state) const {
+        static dll::timer_id timer_handle("rnn:step_batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(etl::dim<0>(x) == state.streams(), "One input frame is needed per stream");
+
+        output = f_activate<activation_function>(bias_add_2d(x * as_derived().u + state.s * as_derived().w, as_derived().b));
+
+        state.s = output;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, computing only
+     * the output of the last time step.
+     *
+     * The states are advanced in place one step at a time (see
+     * step_batch), the states of the other steps are never stored. This is
+     * used for inference when the layer is followed by a
+     * recurrent_last_layer. All the sequences must have the full number of
+     * time steps.
+     *
+     * \param output The output of the last time step (Batch x hidden_units)
+     * \param x A batch of input
+     */
+    template <typename H, typename V>
+    void forward_last_batch(H&& output, const V& x) const {
+        static dll::timer_id timer_handle("rnn:forward_last_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t Batch = etl::dim<0>(x);
+
+        auto& l = as_derived();
+
+        // Each thread has its own state for inference
+        thread_local rnn_stream_state<weight> state(0, 0);
+        thread_local etl::dyn_matrix<weight, 2> frame;
+
+        if (state.streams() != Batch || etl::dim<1>(state.s) != l.hidden_units) {
+            state = make_stream_state(Batch);
+        } else {
+            state.reset();
+        }
+
+        if (etl::dim<0>(frame) != Batch || etl::dim<1>(frame) != l.sequence_length) {
+            frame = etl::dyn_matrix<weight, 2>(Batch, l.sequence_length);
+        }
+
+        for (size_t t = 0; t < l.time_steps; ++t) {
+            copy_time_step<derived_t::time_major_in>(frame, x, t, l.time_steps);
+
+            step_batch(output, frame, state);
         }
     }
 
@@ -210,6 +413,15 @@ struct base_rnn_layer : layer<Derived> {
         as_derived().b = *as_derived().bak_b;
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        as_derived().bak_w.reset();
+        as_derived().bak_u.reset();
+        as_derived().bak_b.reset();
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
@@ -261,6 +473,43 @@ struct base_rnn_layer : layer<Derived> {
     }
 
 private:
+    /*!
+     * \brief Compute all the time steps of the forward pass, from the inputs
+     * of the steps already in the workspace.
+     */
+    template <typename WS, typename W, typename U, typename B>
+    void forward_cached_impl(WS& ws, const sequence_mask& mask, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+        auto& x_t = ws.x_t;
+        auto& s_t = ws.s_t;
+
+        // 1. Compute the input projections of all the time steps at once
+
+        const size_t ws_batch = etl::dim<1>(x_t);
+
+        if (!mask.enabled()) {
+            etl::reshape(s_t, time_steps * ws_batch, hidden_units) = bias_add_2d(etl::reshape(x_t, time_steps * ws_batch, sequence_length) * u, b);
+        } else {
+            // Only the projections of the active samples are needed
+            for (size_t t = 0; t < time_steps && mask.active[t]; ++t) {
+                etl::slice(s_t(t), 0, mask.active[t]) = bias_add_2d(etl::slice(x_t(t), 0, mask.active[t]) * u, b);
+            }
+        }
+
+        // 2. Forward propagation through time, only the active samples are computed
+
+        for (size_t t = 0; t < time_steps && mask.active[t]; ++t) {
+            const size_t n = mask.active[t];
+
+            auto s = etl::slice(s_t(t), 0, n);
+
+            if (t > 0) {
+                s += etl::slice(s_t(t - 1), 0, n) * w;
+            }
+
+            s = f_activate<activation_function>(s);
+        }
+    }
+
     //CRTP Deduction
 
     /*!
@@ -280,4 +529,132 @@ private:
     }
 };
 
+namespace detail {
+
+/*!
+ * \brief Forward a batch through a stack of RNN layers.
+ *
+ * When the branches are run in parallel (set_branch_mode), each time step
+ * of each layer is computed as soon as the previous step of the layer and
+ * the same step of the previous layer are done (see for_each_wavefront).
+ * Otherwise, the layers are computed one after another.
+ *
+ * In both cases, the states are passed between the layers directly in
+ * their per-step caches, only the input of the first layer and the output
+ * of the last layer are rearranged.
+ *
+ * \tparam Last Indicates if only the last true step of each sample is output
+ * \param output The output of the last layer
+ * \param x The input of the first layer
+ * \param layers The layers of the stack, in order
+ */
+template <bool Last, typename H, typename V, typename... Layers>
+void rnn_wavefront_forward_impl(H&& output, const V& x, const Layers&... layers) {
+    static dll::timer_id timer_handle("rnn:wavefront_forward");
+    dll::auto_timer timer(timer_handle);
+
+    static_assert(sizeof...(Layers) > 1, "The wavefront needs at least two layers");
+
+    constexpr size_t N = sizeof...(Layers);
+
+    using first_t = std::decay_t<std::tuple_element_t<0, std::tuple<Layers...>>>;
+    using last_t  = std::decay_t<std::tuple_element_t<N - 1, std::tuple<Layers...>>>;
+    using weight  = typename first_t::weight;
+
+    const auto Batch = etl::dim<0>(x);
+
+    auto stack = std::forward_as_tuple(layers...);
+
+    const size_t time_steps = std::get<0>(stack).time_steps;
+
+    // Each thread has its own workspaces for inference
+    thread_local std::array<rnn_forward_workspace<weight>, N> ws;
+
+    cpp::for_each_i(stack, [&](size_t l, auto& layer) {
+        cpp_assert(layer.time_steps == time_steps, "The layers of the stack must have the same number of time steps");
+
+        ws[l].prepare(Batch, time_steps, layer.sequence_length, layer.hidden_units);
+    });
+
+    auto& mask = ws[0].mask;
+
+    mask.prepare(Batch, time_steps);
+
+    to_time_steps<first_t::time_major_in>(ws[0].x_t, x, mask, time_steps);
+
+    if (!is_wavefront_parallel(N, time_steps)) {
+        // One layer after another, with the input projections of all the steps at once
+        cpp::for_each_i(stack, [&](size_t l, auto& layer) {
+            if (l > 0) {
+                ws[l].x_t = ws[l - 1].s_t;
+            }
+
+            layer.forward_cached(ws[l], mask);
+        });
+    } else {
+        for_each_wavefront(N, time_steps, [&](size_t l, size_t t) {
+            const size_t n = mask.active[t];
+
+            if (!n) {
+                return;
+            }
+
+            if (l > 0) {
+                etl::slice(ws[l].x_t(t), 0, n) = etl::slice(ws[l - 1].s_t(t), 0, n);
+            }
+
+            cpp::for_each_i(stack, [&](size_t i, auto& layer) {
+                if (i == l) {
+                    layer.forward_step(t, n, ws[l]);
+                }
+            });
+        });
+    }
+
+    if constexpr (Last) {
+        auto& s_t = ws[N - 1].s_t;
+
+        for (size_t r = 0; r < Batch; ++r) {
+            const size_t bb     = mask.order[r];
+            const size_t length = mask.length(bb, time_steps);
+
+            if (length) {
+                output(bb) = s_t(length - 1)(r);
+            } else {
+                output(bb) = 0;
+            }
+        }
+    } else {
+        from_time_steps<last_t::time_major_out>(output, ws[N - 1].s_t, mask, time_steps);
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Forward a batch through a stack of RNN layers (see
+ * detail::rnn_wavefront_forward_impl).
+ *
+ * \param output The output of the last layer
+ * \param x The input of the first layer
+ * \param layers The layers of the stack, in order
+ */
+template <typename H, typename V, typename... Layers>
+void rnn_wavefront_forward(H&& output, const V& x, const Layers&... layers) {
+    detail::rnn_wavefront_forward_impl<false>(output, x, layers...);
+}
+
+/*!
+ * \brief Forward a batch through a stack of RNN layers and output only the
+ * last true step of each sample, as a following recurrent_last_layer.
+ *
+ * \param output The last output of the last layer (Batch x hidden_units)
+ * \param x The input of the first layer
+ * \param layers The layers of the stack, in order
+ */
+template <typename H, typename V, typename... Layers>
+void rnn_wavefront_forward_last(H&& output, const V& x, const Layers&... layers) {
+    detail::rnn_wavefront_forward_impl<true>(output, x, layers...);
+}
+
 } //end of dll namespace
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "cpp_utils/assert.hpp"         //Assertions
 #include "cpp_utils/maybe_parallel.hpp" //conditional parallel loops
 #include "cpp_utils/static_if.hpp"      //static_if for compile-time reduction
@@ -24,9 +27,14 @@
 
 #include "util/batch.hpp"
 #include "util/timers.hpp"
+#include "util/trace.hpp"
+#include "util/scheduler.hpp"
 #include "decay_type.hpp"
 #include "layer_traits.hpp"
 #include "util/blas.hpp"
+#include "util/gibbs.hpp"
+#include "util/sparse.hpp"
+#include "util/fft_conv.hpp"
 
 namespace dll {
 
@@ -45,11 +53,11 @@ struct base_trainer {
      * \brief Update the gradients given some type of decay
      * \param grad The gradients to update
      * \param rbm The current RBM
-     * \param penalty The penalty to apply
+     * \param penalty The penalty to apply, a scalar or one value per gradient
      * \tparam decay The type of decay to apply
      */
-    template <decay_type decay, typename V, typename G>
-    void update_grad(G& grad, const V& value, const RBM& rbm, double penalty) {
+    template <decay_type decay, typename V, typename G, typename P>
+    void update_grad(G& grad, const V& value, const RBM& rbm, const P& penalty) {
         STATIC_IF_DECAY(decay_type::NONE, grad = grad - penalty);
         STATIC_IF_DECAY(decay_type::L1, grad = grad - rbm.l1_weight_cost * abs(value) - penalty);
         STATIC_IF_DECAY(decay_type::L2, grad = grad - rbm.l2_weight_cost * value - penalty);
@@ -66,6 +74,65 @@ void apply_clip_gradients(Grad& grad, T t, size_t n){
     }
 }
 
+/*!
+ * \brief Compute, in a single pass over the hidden activations of the
+ * samples, the gradients of the hidden biases and the sums of the hidden
+ * activations at step K, from which the sparsity is computed.
+ *
+ * Each hidden bias is shared by size(h_sum) / size(b_grad) consecutive
+ * units of a sample, whose gradients are averaged.
+ *
+ * \param h1 The hidden activations at step one
+ * \param h2 The hidden activations at step K
+ * \param b_grad The gradients of the hidden biases
+ * \param h_sum The sum of the hidden activations at step K, per unit
+ */
+template <typename H1, typename H2, typename B, typename S>
+void hidden_statistics(const H1& h1, const H2& h2, B& b_grad, S& h_sum) {
+    using weight = etl::value_t<S>;
+
+    const size_t n = etl::dim<0>(h1);
+    const size_t U = etl::size(h_sum);
+    const size_t K = etl::size(b_grad);
+    const size_t G = U / K;
+
+    cpp_assert(etl::size(h1) == n * U && etl::size(h2) == n * U, "Invalid sizes for the hidden statistics");
+
+    h1.ensure_cpu_up_to_date();
+    h2.ensure_cpu_up_to_date();
+
+    weight* b = b_grad.memory_start();
+    weight* q = h_sum.memory_start();
+
+    std::fill_n(b, K, weight(0));
+    std::fill_n(q, U, weight(0));
+
+    for (size_t i = 0; i < n; ++i) {
+        const weight* a1 = h1.memory_start() + i * U;
+        const weight* a2 = h2.memory_start() + i * U;
+
+        for (size_t k = 0; k < K; ++k) {
+            weight d(0);
+
+            for (size_t u = k * G; u < (k + 1) * G; ++u) {
+                d += a1[u] - a2[u];
+                q[u] += a2[u];
+            }
+
+            b[k] += d;
+        }
+    }
+
+    if (G > 1) {
+        for (size_t k = 0; k < K; ++k) {
+            b[k] /= weight(G);
+        }
+    }
+
+    b_grad.invalidate_gpu();
+    h_sum.invalidate_gpu();
+}
+
 /* The update weights procedure */
 
 /*!
@@ -74,7 +141,8 @@ void apply_clip_gradients(Grad& grad, T t, size_t n){
  */
 template <typename RBM, typename Trainer>
 void update_normal(RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:update:normal");
+    static dll::timer_id timer_handle("cd:update:normal");
+    dll::auto_timer timer(timer_handle);
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
 
@@ -94,11 +162,12 @@ void update_normal(RBM& rbm, Trainer& t) {
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
-
-    t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_penalty);
+    //Apply L1/L2 regularization and the penalties, in the same pass
+    auto regularize = [&](const auto& w_pen, const auto& h_pen, const auto& v_pen) {
+        t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_pen);
+        t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_pen);
+        t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_pen);
+    };
 
     //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
@@ -108,19 +177,16 @@ void update_normal(RBM& rbm, Trainer& t) {
 
         t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
-
-        t.b_grad -= q_local_penalty;
+        auto q_local_penalty = etl::force_temporary(cost * (t.q_local_t - p));
 
-        for (size_t i = 0; i < num_hidden(rbm); ++i) {
-            for (size_t j = 0; j < num_visible(rbm); ++j) {
-                t.w_grad(j, i) -= q_local_penalty(i);
-            }
-        }
+        //The penalty of a hidden unit applies to all its weights
+        regularize(etl::rep_l(q_local_penalty, num_visible(rbm)), q_local_penalty, v_penalty);
+    } else {
+        regularize(w_penalty, h_penalty, v_penalty);
     }
 
-    //TODO the batch is not necessary full!
-    const auto n_samples = double(etl::dim<0>(t.v1));
+    // The incomplete batches are scaled by their own number of samples
+    const auto n_samples = double(t.active);
 
     // Gradients clipping
     if constexpr (rbm_layer_traits<rbm_t>::has_clip_gradients()){
@@ -163,7 +229,8 @@ void update_normal(RBM& rbm, Trainer& t) {
  */
 template <typename RBM, typename Trainer>
 void update_convolutional(RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:update:conv");
+    static dll::timer_id timer_handle("cd:update:conv");
+    dll::auto_timer timer(timer_handle);
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
     using weight = typename rbm_t::weight; ///< The data type for this layer
@@ -184,11 +251,12 @@ void update_convolutional(RBM& rbm, Trainer& t) {
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
-
-    t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_penalty);
+    //Apply L1/L2 regularization and the penalties, in the same pass
+    auto regularize = [&](const auto& w_pen, const auto& h_pen, const auto& v_pen) {
+        t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_pen);
+        t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_pen);
+        t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_pen);
+    };
 
     //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
@@ -198,26 +266,20 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
         t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
-
-        t.b_grad -= sum_r(q_local_penalty);
+        //The penalty of a filter is the sum of the penalties of its units
+        auto k_penalty = etl::force_temporary(sum_r(cost * (t.q_local_t - p)));
 
-        const auto K   = get_k(rbm);
-
-        auto k_penalty = sum_r(q_local_penalty);
-        for (size_t k = 0; k < K; ++k) {
-            t.w_grad(k) = t.w_grad(k) - k_penalty(k);
-        }
+        regularize(etl::rep_r(k_penalty, etl::dim<1>(t.w_grad), etl::dim<2>(t.w_grad), etl::dim<3>(t.w_grad)), k_penalty, v_penalty);
     }
-
     //Honglak Lee's sparsity method
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE) {
-        t.w_grad -= rbm.pbias_lambda * t.w_bias;
-        t.b_grad -= rbm.pbias_lambda * t.b_bias;
-        t.c_grad -= rbm.pbias_lambda * t.c_bias;
+    else if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE) {
+        regularize(rbm.pbias_lambda * t.w_bias, rbm.pbias_lambda * t.b_bias, rbm.pbias_lambda * t.c_bias);
+    } else {
+        regularize(w_penalty, h_penalty, v_penalty);
     }
 
-    constexpr auto n_samples = RBM::batch_size;
+    // The incomplete batches are scaled by their own number of samples
+    const auto n_samples = double(t.active);
     auto eps             = rbm.learning_rate / n_samples;
 
     //Apply momentum and learning rate
@@ -245,41 +307,218 @@ void update_convolutional(RBM& rbm, Trainer& t) {
     nan_check_deep(rbm.c);
 }
 
-/* The training procedures */
+/* Data-parallel training */
 
 /*!
- * \brief Compute the gradients for a fully-connected RBM
+ * \brief The private buffers of one shard of a batch, for the data-parallel
+ * training of a fully-connected RBM.
+ *
+ * \tparam S The number of samples of the shard
  */
-template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
-void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:gradients:normal:batch");
+template <typename RBM, bool Persistent, size_t S>
+struct cd_normal_shard {
+    using rbm_t  = RBM;                    ///< The type of RBM being trained
+    using weight = typename rbm_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_hidden  = rbm_t::num_hidden;  ///< The number of hidden units
+    static constexpr auto num_visible = rbm_t::num_visible; ///< The number of visible units
+    static constexpr auto batch_size  = S;                  ///< The number of samples of the shard
+
+    bool init = true; ///< Indicates if the persistent chains must be initialized
+
+    etl::fast_matrix<weight, S, num_visible> v1; ///< The Input
+    etl::fast_matrix<weight, S, num_visible> vf; ///< The Expected Output
+
+    etl::fast_matrix<weight, S, num_hidden> h1_a; ///< The hidden activation probabilites at step one
+    etl::fast_matrix<weight, S, num_hidden> h1_s; ///< The hidden states at step one
+
+    etl::fast_matrix<weight, S, num_visible> v2_a; ///< The visible activation probabilites at step N
+    etl::fast_matrix<weight, S, num_visible> v2_s; ///< The visible states at step N
+
+    etl::fast_matrix<weight, S, num_hidden> h2_a; ///< The hidden activation probabilites at step N
+    etl::fast_matrix<weight, S, num_hidden> h2_s; ///< The hidden states at step N
+
+    etl::fast_matrix<weight, num_visible, num_hidden> w_grad; ///< The gradients of the weights
+    etl::fast_vector<weight, num_hidden> b_grad;              ///< The gradients of the hidden biases
+    etl::fast_vector<weight, num_visible> c_grad;             ///< The gradients of the visible biases
+    etl::fast_vector<weight, num_hidden> h_sum;               ///< The sums of the hidden activations at step N
+
+    conditional_fast_matrix_t<Persistent, weight, S, num_hidden> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
+    conditional_fast_matrix_t<Persistent, weight, S, num_hidden> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
+
+    csr_batch<weight> v1_sparse; ///< The CSR copy of the input, with sparse_input
+    csr_batch<weight> vf_sparse; ///< The CSR copy of the expected output, with sparse_input
+};
+
+/*!
+ * \brief The private buffers of one shard of a batch, for the data-parallel
+ * training of a convolutional RBM.
+ *
+ * \tparam S The number of samples of the shard
+ */
+template <typename RBM, bool Persistent, size_t N, size_t S>
+struct cd_conv_shard {
+    using rbm_t  = RBM;                    ///< The type of RBM being trained
+    using weight = typename rbm_t::weight; ///< The data type for this layer
+
+    static constexpr auto K   = rbm_t::K;   ///< The number of filters
+    static constexpr auto NC  = rbm_t::NC;  ///< The number of channels
+    static constexpr auto NV1 = rbm_t::NV1; ///< The first dimension of the input
+    static constexpr auto NV2 = rbm_t::NV2; ///< The second dimension of the input
+    static constexpr auto NH1 = rbm_t::NH1; ///< The first dimension of the output
+    static constexpr auto NH2 = rbm_t::NH2; ///< The second dimension of the output
+    static constexpr auto NW1 = rbm_t::NW1; ///< The second dimension of the filter
+    static constexpr auto NW2 = rbm_t::NW2; ///< The second dimension of the filter
+
+    static constexpr auto batch_size = S; ///< The number of samples of the shard
+
+    bool init = true; ///< Indicates if the persistent chains must be initialized
+
+    conditional_fast_matrix_t<Persistent, weight, S, K, NH1, NH2> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
+    conditional_fast_matrix_t<Persistent, weight, S, K, NH1, NH2> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
+
+    etl::fast_matrix<weight, K, NC, NW1, NW2> w_pos; ///< The positive gradients
+    etl::fast_matrix<weight, K, NC, NW1, NW2> w_neg; ///< The negative gradients
+
+    etl::fast_matrix<weight, S, NC, NV1, NV2> v1; ///< Input
+    etl::fast_matrix<weight, S, NC, NV1, NV2> vf; ///< Expected
+
+    etl::fast_matrix<weight, S, K, NH1, NH2> h1_a; ///< The hidden activation at step 1
+    etl::fast_matrix<weight, S, K, NH1, NH2> h1_s; ///< The hidden samples at step 1
+
+    etl::fast_matrix<weight, S, NC, NV1, NV2> v2_a;                 ///< The visible activation at step K
+    conditional_fast_matrix_t<false, weight, S, NC, NV1, NV2> v2_s; ///< The visible samples at step K
+
+    etl::fast_matrix<weight, S, K, NH1, NH2> h2_a;                                 ///< The hidden activation at step K
+    conditional_fast_matrix_t<(Persistent || N > 1), weight, S, K, NH1, NH2> h2_s; ///< The hidden samples at step K
+};
+
+/*!
+ * \brief The shards of a data-parallel trainer and the task group running
+ * them.
+ *
+ * \tparam Shard The type of the private buffers of one shard
+ * \tparam S The number of shards
+ */
+template <typename Shard, size_t S>
+struct cd_shards {
+    static constexpr size_t shard_size = Shard::batch_size; ///< The number of samples of each shard
+
+    std::vector<Shard> shards;   ///< The private buffers of each shard
+    task_group pool;           ///< The tasks running the shards
+
+    cd_shards() : shards(S) {}
+};
+
+/*!
+ * \brief Non-parallel trainers have no shards.
+ */
+template <typename Shard>
+struct cd_shards<Shard, 1> {};
+
+/*!
+ * \brief Run the given gradients computation on each shard of the batch,
+ * concurrently, and gather the states of the chains of the shards into the
+ * buffers of the trainer.
+ *
+ * The states of the samples missing from an incomplete batch are not
+ * gathered, only the shards holding samples are computed.
+ *
+ * \param functor The gradients computation, called with the inputs, the
+ * expected outputs and the buffers of one shard
+ *
+ * \return The number of shards holding at least one sample
+ */
+template <bool Persistent, typename InputBatch, typename ExpectedBatch, typename Trainer, typename Functor>
+size_t compute_gradients_shards(InputBatch& input_batch, ExpectedBatch& expected_batch, Trainer& t, Functor functor) {
+    static dll::timer_id timer_handle("cd:gradients:shards");
+    dll::auto_timer timer(timer_handle);
+
+    constexpr size_t shard_size = Trainer::shard_size;
 
     cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
-    cpp_assert(etl::dim<0>(t.v1) >= etl::dim<0>(input_batch), "Invalid batch sizes");
-    cpp_assert(etl::dim<0>(t.vf) >= etl::dim<0>(expected_batch), "Invalid batch sizes");
 
-    cpp_assert(etl::size(input_batch) == etl::size(expected_batch), "Invalid input to compute_gradients_normal");
-    cpp_assert(etl::size(t.v1) >= etl::size(input_batch), "Invalid input to compute_gradients_normal");
-    cpp_assert(etl::size(t.vf) >= etl::size(expected_batch), "Invalid input to compute_gradients_normal");
+    const size_t n      = etl::dim<0>(input_batch);
+    const size_t active = (n + shard_size - 1) / shard_size;
 
-    const auto B          = etl::dim<0>(t.v1);
-    const size_t IB       = etl::dim<0>(input_batch);
-    const bool full_batch = (IB == RBM::batch_size);
+    for (size_t s = 0; s < active; ++s) {
+        t.pool.do_task([&t, &functor, &input_batch, &expected_batch, s, n] {
+            trace_scope scope("pool:task", "pool");
 
-    //Copy input/expected for computations
-    if(cpp_likely(full_batch)){
-        t.v1 = input_batch;
-        t.vf = expected_batch;
-    } else {
-        t.v1 = 0;
-        t.vf = 0;
+            const size_t first = s * shard_size;
+            const size_t last  = std::min(first + shard_size, n);
 
-        etl::slice(t.v1, 0, IB) = input_batch;
-        etl::slice(t.vf, 0, IB) = expected_batch;
+            auto input_s    = etl::slice(input_batch, first, last);
+            auto expected_s = etl::slice(expected_batch, first, last);
+
+            auto& shard = t.shards[s];
+
+            // ETL must not parallelize inside the workers
+            SERIAL_SECTION {
+                functor(input_s, expected_s, shard);
+
+                if constexpr (Persistent) {
+                    shard.p_h_a = shard.h2_a;
+                    shard.p_h_s = shard.h2_s;
+
+                    shard.init = false;
+                }
+            }
+        });
     }
 
+    t.pool.wait();
+
+    for (size_t s = 0; s < t.shards.size(); ++s) {
+        const size_t first = s * shard_size;
+        const size_t last  = first + shard_size;
+
+        if (s < active) {
+            // The last shard may only hold part of its samples
+            const size_t m = std::min(last, n) - first;
+
+            etl::slice(t.vf, first, first + m)   = etl::slice(t.shards[s].vf, 0, m);
+            etl::slice(t.h1_a, first, first + m) = etl::slice(t.shards[s].h1_a, 0, m);
+            etl::slice(t.v2_a, first, first + m) = etl::slice(t.shards[s].v2_a, 0, m);
+            etl::slice(t.h2_a, first, first + m) = etl::slice(t.shards[s].h2_a, 0, m);
+        } else {
+            etl::slice(t.vf, first, last)   = 0;
+            etl::slice(t.h1_a, first, last) = 0;
+            etl::slice(t.v2_a, first, last) = 0;
+            etl::slice(t.h2_a, first, last) = 0;
+        }
+    }
+
+    return active;
+}
+
+/* The training procedures */
+
+/*!
+ * \brief Run the chain of a fully-connected RBM and compute its gradients,
+ * on the rows of the buffers of the trainer selected by the given functor.
+ *
+ * \param denoising Indicates if the expected batch differs from the input
+ * \param rows A functor returning the rows of a buffer of the trainer that
+ * hold the samples of the batch
+ */
+template <bool Persistent, size_t K, typename RBM, typename Trainer, typename Rows>
+void cd_normal_chain(bool denoising, RBM& rbm, Trainer& t, Rows&& rows) {
+    decltype(auto) v1 = rows(t.v1);
+    decltype(auto) vf = rows(t.vf);
+
     //First step
-    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+    if constexpr (rbm_layer_traits<RBM>::sparse_input()) {
+        static dll::timer_id timer_handle("cd:gradients:normal:sparse");
+        dll::auto_timer timer(timer_handle);
+
+        //Only the rows of the weights of the non-zero inputs are used
+        t.v1_sparse.build(v1);
+        t.v1_sparse.multiply(rows(t.h1_a), rbm.w);
+        sigmoid_bernoulli<RBM::desc::precision>(rows(t.h1_a), rows(t.h1_s), rbm.b);
+    } else {
+        rbm.template batch_activate_hidden<true, true>(rows(t.h1_a), rows(t.h1_s), v1, v1);
+    }
 
     if (Persistent && t.init) {
         t.p_h_a = t.h1_a;
@@ -288,36 +527,107 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
 
     //CD-1
     if constexpr (Persistent) {
-        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_visible<true, false>(rows(t.p_h_a), rows(t.p_h_s), rows(t.v2_a), rows(t.v2_s));
+        rbm.template batch_activate_hidden<true, true>(rows(t.h2_a), rows(t.h2_s), rows(t.v2_a), rows(t.v2_s));
     } else {
-        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_visible<true, false>(rows(t.h1_a), rows(t.h1_s), rows(t.v2_a), rows(t.v2_s));
+        rbm.template batch_activate_hidden<true, (K > 1)>(rows(t.h2_a), rows(t.h2_s), rows(t.v2_a), rows(t.v2_s));
     }
 
     //CD-k
     for (size_t k = 1; k < K; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_visible<true, false>(rows(t.h2_a), rows(t.h2_s), rows(t.v2_a), rows(t.v2_s));
+        rbm.template batch_activate_hidden<true, true>(rows(t.h2_a), rows(t.h2_s), rows(t.v2_a), rows(t.v2_s));
     }
 
     //Compute the gradients
 
     {
-        dll::auto_timer timer("cd:batch_compute_gradients:std");
-
-        t.w_grad = batch_outer(t.vf, t.h1_a);
-        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+        static dll::timer_id timer_handle("cd:batch_compute_gradients:std");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (rbm_layer_traits<RBM>::sparse_input()) {
+            //The expected batch differs from the input when denoising
+            if (denoising) {
+                t.vf_sparse.build(vf);
+                t.vf_sparse.outer(t.w_grad, rows(t.h1_a));
+            } else {
+                t.v1_sparse.outer(t.w_grad, rows(t.h1_a));
+            }
+        } else {
+            cpp_unused(denoising);
 
-        t.b_grad = t.h1_a(0) - t.h2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.b_grad += t.h1_a(b) - t.h2_a(b);
+            t.w_grad = batch_outer(vf, rows(t.h1_a));
         }
 
-        t.c_grad = t.vf(0) - t.v2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.c_grad += t.vf(b) - t.v2_a(b);
-        }
+        t.w_grad -= batch_outer(rows(t.v2_a), rows(t.h2_a));
+
+        t.c_grad = etl::sum_l(vf - rows(t.v2_a));
+
+        //The mean activations are reduced with the gradients of the hidden biases
+        hidden_statistics(rows(t.h1_a), rows(t.h2_a), t.b_grad, t.h_sum);
+    }
+}
+
+/*!
+ * \brief Compute the gradients for a fully-connected RBM
+ */
+template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
+void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
+    static dll::timer_id timer_handle("cd:gradients:normal:batch");
+    dll::auto_timer timer(timer_handle);
+
+    cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
+    cpp_assert(etl::dim<0>(t.v1) >= etl::dim<0>(input_batch), "Invalid batch sizes");
+    cpp_assert(etl::dim<0>(t.vf) >= etl::dim<0>(expected_batch), "Invalid batch sizes");
+
+    cpp_assert(etl::size(input_batch) == etl::size(expected_batch), "Invalid input to compute_gradients_normal");
+    cpp_assert(etl::size(t.v1) >= etl::size(input_batch), "Invalid input to compute_gradients_normal");
+    cpp_assert(etl::size(t.vf) >= etl::size(expected_batch), "Invalid input to compute_gradients_normal");
+
+    const auto B          = etl::dim<0>(t.v1);
+    const size_t IB       = etl::dim<0>(input_batch);
+    const bool full_batch = (IB == B);
+    const bool denoising  = static_cast<const void*>(&input_batch) != static_cast<const void*>(&expected_batch);
+
+    //Copy input/expected for computations
+    if(cpp_likely(full_batch)){
+        t.v1 = input_batch;
+        t.vf = expected_batch;
+
+        cd_normal_chain<Persistent, K>(denoising, rbm, t, [](auto& m) -> auto& { return m; });
+    } else {
+        etl::slice(t.v1, 0, IB) = input_batch;
+        etl::slice(t.vf, 0, IB) = expected_batch;
+
+        // Only the samples of the batch are computed, the other rows are left untouched
+        cd_normal_chain<Persistent, K>(denoising, rbm, t, [IB](auto& m) { return etl::slice(m, 0, IB); });
+    }
+}
+
+/*!
+ * \brief Compute the gradients for a fully-connected RBM, the batch being
+ * split into shards processed concurrently.
+ */
+template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
+void compute_gradients_normal_parallel(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
+    static dll::timer_id timer_handle("cd:gradients:normal:parallel");
+    dll::auto_timer timer(timer_handle);
+
+    const size_t active = compute_gradients_shards<Persistent>(input_batch, expected_batch, t, [&rbm](auto& input_s, auto& expected_s, auto& shard) {
+        compute_gradients_normal<Persistent, K>(input_s, expected_s, rbm, shard);
+    });
+
+    t.w_grad = t.shards[0].w_grad;
+    t.b_grad = t.shards[0].b_grad;
+    t.c_grad = t.shards[0].c_grad;
+    t.h_sum  = t.shards[0].h_sum;
+
+    for (size_t s = 1; s < active; ++s) {
+        t.w_grad += t.shards[s].w_grad;
+        t.b_grad += t.shards[s].b_grad;
+        t.c_grad += t.shards[s].c_grad;
+        t.h_sum += t.shards[s].h_sum;
     }
 }
 
@@ -326,13 +636,23 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
  */
 template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
 void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:train:normal");
+    static dll::timer_id timer_handle("cd:train:normal");
+    dll::auto_timer timer(timer_handle);
 
     using namespace etl;
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
+    using weight = typename rbm_t::weight; ///< The data type for this layer
+
+    const size_t n = etl::dim<0>(input_batch);
 
-    compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
+    t.active = n;
+
+    if constexpr (rbm_layer_traits<rbm_t>::shards() > 1) {
+        compute_gradients_normal_parallel<Persistent, K>(input_batch, expected_batch, rbm, t);
+    } else {
+        compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
+    }
 
     if (Persistent) {
         t.p_h_a = t.h2_a;
@@ -341,15 +661,21 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
         t.init = false;
     }
 
-    context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
+    // The statistics only cover the samples of the batch
+    auto vf   = etl::slice(t.vf, 0, n);
+    auto v2_a = etl::slice(t.v2_a, 0, n);
+
+    if (context.monitor) {
+        context.batch_error = mean((vf - v2_a) >> (vf - v2_a));
+    }
 
     nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    //The mean activation probabilities, from the sums of the gradients pass
+    t.q_global_batch = sum(t.h_sum) / (n * etl::size(t.h_sum));
 
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
+        t.q_local_batch = t.h_sum / weight(n);
     }
 
     context.batch_sparsity = t.q_global_batch;
@@ -363,12 +689,13 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
  */
 template <bool Persistent, size_t N, typename Trainer, typename InputBatch, typename ExpectedBatch, typename RBM>
 void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:gradients:conv:batch");
+    static dll::timer_id timer_handle("cd:gradients:conv:batch");
+    dll::auto_timer timer(timer_handle);
 
     cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
 
     const size_t B        = etl::dim<0>(input_batch);
-    const bool full_batch = etl::dim<0>(input_batch) == RBM::batch_size;
+    const bool full_batch = B == etl::dim<0>(t.v1);
 
     //Copy input/expected for computations
     if(cpp_likely(full_batch)){
@@ -405,26 +732,78 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
         rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
     }
 
+    // The convolutions need complete batches, the padded samples are
+    // cleared so that they do not contribute to the gradients
+    if (cpp_unlikely(!full_batch)) {
+        const size_t S = etl::dim<0>(t.v1);
+
+        etl::slice(t.h1_a, B, S) = 0;
+        etl::slice(t.v2_a, B, S) = 0;
+        etl::slice(t.h2_a, B, S) = 0;
+    }
+
     //Compute gradients
 
     {
-        dll::auto_timer timer("cd:batch_compute_gradients_conv");
+        static dll::timer_id timer_handle("cd:batch_compute_gradients_conv");
+        dll::auto_timer timer(timer_handle);
 
         t.w_pos = conv_4d_valid_filter_flipped(t.vf, t.h1_a);
         t.w_neg = conv_4d_valid_filter_flipped(t.v2_a, t.h2_a);
     }
 }
 
+/*!
+ * \brief Compute the gradients for a Convolutional RBM, the batch being
+ * split into shards processed concurrently.
+ */
+template <bool Persistent, size_t N, typename Trainer, typename InputBatch, typename ExpectedBatch, typename RBM>
+void compute_gradients_conv_parallel(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
+    static dll::timer_id timer_handle("cd:gradients:conv:parallel");
+    dll::auto_timer timer(timer_handle);
+
+    const size_t active = compute_gradients_shards<Persistent>(input_batch, expected_batch, t, [&rbm](auto& input_s, auto& expected_s, auto& shard) {
+        compute_gradients_conv<Persistent, N>(input_s, expected_s, rbm, shard);
+    });
+
+    t.w_pos = t.shards[0].w_pos;
+    t.w_neg = t.shards[0].w_neg;
+
+    for (size_t s = 1; s < active; ++s) {
+        t.w_pos += t.shards[s].w_pos;
+        t.w_neg += t.shards[s].w_neg;
+    }
+}
+
 /*!
  * \brief Train a convolutional RBM
  */
 template <bool Persistent, size_t N, typename Trainer, typename InputBatch, typename ExpectedBatch, typename RBM>
 void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:train:conv");
+    static dll::timer_id timer_handle("cd:train:conv");
+    dll::auto_timer timer(timer_handle);
+
+    using rbm_t  = RBM;                    ///< The type of the RBM being trained
+    using weight = typename rbm_t::weight; ///< The data type for this layer
+
+    //The filters do not change during the step, their spectra are shared
+    //by all the convolutions of the activations, for all the samples
+    if (conv_fft_plan<weight>::pays_off(etl::dim<0>(rbm.w), etl::dim<1>(rbm.w), etl::dim<2>(t.v1), etl::dim<3>(t.v1), etl::dim<2>(rbm.w), etl::dim<3>(rbm.w))) {
+        static dll::timer_id timer_handle("cd:train:conv:fft");
+        dll::auto_timer timer(timer_handle);
 
-    using rbm_t = RBM; ///< The type of the RBM being trained
+        rbm.fft.prepare(rbm.w, etl::dim<2>(t.v1), etl::dim<3>(t.v1));
+    }
+
+    const size_t n = etl::dim<0>(input_batch);
 
-    compute_gradients_conv<Persistent, N>(input_batch, expected_batch, rbm, t);
+    t.active = n;
+
+    if constexpr (rbm_layer_traits<rbm_t>::shards() > 1) {
+        compute_gradients_conv_parallel<Persistent, N>(input_batch, expected_batch, rbm, t);
+    } else {
+        compute_gradients_conv<Persistent, N>(input_batch, expected_batch, rbm, t);
+    }
 
     if (Persistent) {
         t.p_h_a = t.h2_a;
@@ -435,35 +814,45 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
 
     //Compute the gradients
     t.w_grad = t.w_pos - t.w_neg;
-    t.b_grad = mean_r(sum_l(t.h1_a - t.h2_a));
     t.c_grad = mean_r(sum_l(t.vf - t.v2_a));
 
+    //The mean activations are reduced with the gradients of the hidden biases
+    hidden_statistics(etl::slice(t.h1_a, 0, n), etl::slice(t.h2_a, 0, n), t.b_grad, t.h_sum);
+
     nan_check_deep(t.w_grad);
     nan_check_deep(t.b_grad);
     nan_check_deep(t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    // The statistics only cover the samples of the batch
+    auto vf   = etl::slice(t.vf, 0, n);
+    auto v2_a = etl::slice(t.v2_a, 0, n);
+
+    //The mean activation probabilities, from the sums of the gradients pass
+    t.q_global_batch = sum(t.h_sum) / (n * etl::size(t.h_sum));
 
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
+        t.q_local_batch = t.h_sum / weight(n);
     }
 
     //Compute the biases for sparsity
 
     //Only b_bias are supported for now
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE) {
-        t.b_bias = mean_r(mean_l(t.h2_a)) - rbm.pbias;
+        t.b_bias = mean_r(t.h_sum) / weight(n) - rbm.pbias;
     }
 
     //Accumulate the sparsity
     context.batch_sparsity = t.q_global_batch;
 
     //Accumulate the error
-    context.batch_error = mean(etl::scale((t.vf - t.v2_a), (t.vf - t.v2_a)));
+    if (context.monitor) {
+        context.batch_error = mean(etl::scale((vf - v2_a), (vf - v2_a)));
+    }
 
     //Update the weights and biases based on the gradients
     t.update(rbm);
+
+    rbm.fft.invalidate();
 }
 
 /* The specialized trainers */
@@ -474,7 +863,7 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
  * This class provides update which applies the gradients to the RBM.
  */
 template <size_t N, typename RBM, bool Persistent, typename Enable = void>
-struct base_cd_trainer : base_trainer<RBM> {
+struct base_cd_trainer : base_trainer<RBM>, cd_shards<cd_normal_shard<RBM, Persistent, RBM::batch_size / rbm_layer_traits<RBM>::shards()>, rbm_layer_traits<RBM>::shards()> {
     static_assert(N > 0, "(P)CD-0 is not a valid training method");
 
     using rbm_t  = RBM;                    ///< The type of RBM being trained
@@ -486,6 +875,10 @@ struct base_cd_trainer : base_trainer<RBM> {
 
     rbm_t& rbm; ///< The RBM being trained
 
+    static constexpr bool partial_batches = true; ///< Indicates if the incomplete batches only train on their samples
+
+    size_t active = batch_size; ///< The number of samples of the current batch
+
     etl::fast_matrix<weight, batch_size, num_visible> v1; ///< The Input
     etl::fast_matrix<weight, batch_size, num_visible> vf; ///< The Expected Output
 
@@ -518,12 +911,16 @@ struct base_cd_trainer : base_trainer<RBM> {
 
     etl::fast_matrix<weight, num_hidden> q_local_batch; ///< The local sparsity on the batch
     etl::fast_vector<weight, num_hidden> q_local_t;     ///< The local sparsity penalty
+    etl::fast_vector<weight, num_hidden> h_sum;         ///< The sums of the hidden activations at step N
 
     //}}} Sparsity end
 
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    csr_batch<weight> v1_sparse; ///< The CSR copy of the input, with sparse_input
+    csr_batch<weight> vf_sparse; ///< The CSR copy of the expected output, with sparse_input
+
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm), q_global_t(0.0), q_local_t(0.0) {
         if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
@@ -572,6 +969,10 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
 
     rbm_t& rbm; ///< The RBM being trained
 
+    static constexpr bool partial_batches = true; ///< Indicates if the incomplete batches only train on their samples
+
+    size_t active = batch_size; ///< The number of samples of the current batch
+
     etl::dyn_matrix<weight> v1; ///< Input
     etl::dyn_matrix<weight> vf; ///< Expected
 
@@ -604,12 +1005,16 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
 
     etl::dyn_vector<weight> q_local_batch; ///< The local sparsity on the batch
     etl::dyn_vector<weight> q_local_t;     ///< The local sparsity penalty
+    etl::dyn_vector<weight> h_sum;         ///< The sums of the hidden activations at step K
 
     //}}} Sparsity end
 
     etl::dyn_matrix<weight> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::dyn_matrix<weight> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    csr_batch<weight> v1_sparse; ///< The CSR copy of the input, with sparse_input
+    csr_batch<weight> vf_sparse; ///< The CSR copy of the expected output, with sparse_input
+
     template <bool M = rbm_layer_traits<rbm_t>::has_momentum(), cpp_disable_iff(M)>
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm),
@@ -630,6 +1035,7 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
               q_global_t(0.0),
               q_local_batch(rbm.num_hidden),
               q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
+              h_sum(rbm.num_hidden),
               p_h_a(batch_size, rbm.num_hidden),
               p_h_s(batch_size, rbm.num_hidden){
         static_assert(!rbm_layer_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
@@ -655,6 +1061,7 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
               q_global_t(0.0),
               q_local_batch(rbm.num_hidden),
               q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
+              h_sum(rbm.num_hidden),
               p_h_a(batch_size, rbm.num_hidden),
               p_h_s(batch_size, rbm.num_hidden){
         static_assert(rbm_layer_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
@@ -689,7 +1096,8 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
  * This class provides update which applies the gradients to the RBM.
  */
 template <size_t N, typename RBM, bool Persistent>
-struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::is_dynamic() && layer_traits<RBM>::is_convolutional_rbm_layer()>> : base_trainer<RBM> {
+struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::is_dynamic() && layer_traits<RBM>::is_convolutional_rbm_layer()>>
+        : base_trainer<RBM>, cd_shards<cd_conv_shard<RBM, Persistent, N, RBM::batch_size / rbm_layer_traits<RBM>::shards()>, rbm_layer_traits<RBM>::shards()> {
     static_assert(N > 0, "(P)CD-0 is not a valid training method");
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
@@ -708,6 +1116,10 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
 
     rbm_t& rbm; ///< The RBM being trained
 
+    static constexpr bool partial_batches = true; ///< Indicates if the incomplete batches only train on their samples
+
+    size_t active = batch_size; ///< The number of samples of the current batch
+
 #define W_DIMS K, NC, NW1, NW2
 
     //Gradients
@@ -731,6 +1143,8 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
     conditional_fast_matrix_t<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET, weight, K, NH1, NH2> q_local_batch; ///< The local batch sparsity
     conditional_fast_matrix_t<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET, weight, K, NH1, NH2> q_local_t;     ///< The local batch sparsity penalty
 
+    etl::fast_matrix<weight, K, NH1, NH2> h_sum; ///< The sums of the hidden activations at step K
+
     //}}} Sparsity end
 
     //{{{ Sparsity biases
@@ -815,6 +1229,10 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
 
     rbm_t& rbm; ///< The RBM being trained
 
+    static constexpr bool partial_batches = true; ///< Indicates if the incomplete batches only train on their samples
+
+    size_t active = batch_size; ///< The number of samples of the current batch
+
 #define DYN_W_DIMS rbm.k, rbm.nc, rbm.nw1, rbm.nw2
 
     //Gradients
@@ -837,6 +1255,7 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
 
     etl::dyn_matrix<weight, 3> q_local_batch; ///< The local batch sparsity
     etl::dyn_matrix<weight, 3> q_local_t;     ///< The local batch penalty
+    etl::dyn_matrix<weight, 3> h_sum;         ///< The sums of the hidden activations at step K
 
     //}}} Sparsity end
 
@@ -877,6 +1296,7 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
              q_global_t(0.0),
              q_local_batch(rbm.k, rbm.nh1, rbm.nh2),
              q_local_t(rbm.k, rbm.nh1, rbm.nh2, 0.0),
+             h_sum(rbm.k, rbm.nh1, rbm.nh2),
              w_bias(DYN_W_DIMS, 0.0),
              b_bias(rbm.k, 0.0),
              c_bias(rbm.nc, 0.0),
@@ -232,3 +232,4 @@ dataset_holder<TrainG, TestG, ValG> make_dataset_holder(const std::string& name,
 #include "datasets/mnist.hpp"
 #include "datasets/mnist_ae.hpp"
 #include "datasets/cifar.hpp"
+#include "datasets/binary.hpp"
@@ -0,0 +1,624 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file binary.hpp
+ * \brief Sharded binary dataset format, served from memory-mapped files
+ *
+ * Each shard starts with a header giving the type and the shape of the
+ * samples, followed by the contiguous samples and then by their labels,
+ * stored as float. Since all the samples have the same size, the index of
+ * a sample in the file is implicit.
+ *
+ * The shards are mapped in memory and read sequentially by the iterators,
+ * with the next samples advised to the kernel ahead of time. After the
+ * first epoch, the samples come directly from the page cache, without any
+ * decoding.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dll {
+
+namespace binary {
+
+/*!
+ * \brief The type of the samples stored in a binary dataset
+ */
+enum class dtype : uint32_t {
+    FLOAT32, ///< 32 bits floating point
+    FLOAT64, ///< 64 bits floating point
+    UINT8    ///< Unsigned bytes
+};
+
+/*!
+ * \brief Traits to get the binary type of a C++ type
+ */
+template <typename S>
+struct dtype_of;
+
+/*!
+ * \copydoc dtype_of
+ */
+template <>
+struct dtype_of<float> {
+    static constexpr dtype value = dtype::FLOAT32; ///< The binary type
+};
+
+/*!
+ * \copydoc dtype_of
+ */
+template <>
+struct dtype_of<double> {
+    static constexpr dtype value = dtype::FLOAT64; ///< The binary type
+};
+
+/*!
+ * \copydoc dtype_of
+ */
+template <>
+struct dtype_of<uint8_t> {
+    static constexpr dtype value = dtype::UINT8; ///< The binary type
+};
+
+/*!
+ * \brief Returns the size, in bytes, of a value of the given type
+ */
+inline size_t dtype_size(dtype type) {
+    switch (type) {
+        case dtype::FLOAT32:
+            return sizeof(float);
+        case dtype::FLOAT64:
+            return sizeof(double);
+        case dtype::UINT8:
+            return sizeof(uint8_t);
+    }
+
+    return 0;
+}
+
+constexpr const char magic[8] = "DLLDATA"; ///< The magic string of the shards
+constexpr uint32_t version    = 1;         ///< The version of the format
+constexpr size_t max_dims     = 4;         ///< The maximum number of dimensions of a sample
+constexpr size_t alignment    = 4096;      ///< The alignment of the data in a shard
+
+/*!
+ * \brief The header of a shard
+ */
+struct header {
+    char magic[8];              ///< The magic string
+    uint32_t version;           ///< The version of the format
+    uint32_t type;              ///< The type of the samples
+    uint64_t samples;           ///< The number of samples in the shard
+    uint64_t dimensions;        ///< The number of dimensions of a sample
+    uint64_t shape[max_dims];   ///< The dimensions of a sample
+    uint64_t label_size;        ///< The number of values of a label, 0 without labels
+    uint64_t data_offset;       ///< The offset of the samples in the shard
+    uint64_t label_offset;      ///< The offset of the labels in the shard
+
+    /*!
+     * \brief Indicates if the samples and labels of the given header have
+     * the same type and shape as the ones of this header
+     */
+    friend bool same_layout(const header& lhs, const header& rhs) {
+        return lhs.type == rhs.type && lhs.dimensions == rhs.dimensions && lhs.label_size == rhs.label_size
+               && std::equal(lhs.shape, lhs.shape + max_dims, rhs.shape);
+    }
+
+    /*!
+     * \brief Returns the number of values of a sample
+     */
+    size_t sample_size() const {
+        size_t s = 1;
+
+        for (size_t d = 0; d < dimensions; ++d) {
+            s *= shape[d];
+        }
+
+        return s;
+    }
+};
+
+/*!
+ * \brief A shard mapped in memory
+ */
+struct shard {
+    header head;             ///< The header of the shard
+    void* base    = nullptr; ///< The start of the mapping
+    size_t length = 0;       ///< The length of the mapping
+
+    /*!
+     * \brief Map the given shard in memory.
+     *
+     * In case of error, the shard is left empty.
+     */
+    explicit shard(const std::string& path) {
+        std::memset(&head, 0, sizeof(head));
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Failed to open binary dataset: " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(header)) {
+            length = st.st_size;
+            base   = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (base == MAP_FAILED) {
+                std::cerr << "ERROR: Failed to map binary dataset: " << path << std::endl;
+                base   = nullptr;
+                length = 0;
+            }
+        }
+
+        // The mapping stays valid after the file is closed
+        ::close(fd);
+
+        if (!base) {
+            return;
+        }
+
+        std::memcpy(&head, base, sizeof(head));
+
+        if (std::memcmp(head.magic, magic, sizeof(magic)) != 0 || head.version != version || head.dimensions > max_dims
+            || head.data_offset + head.samples * head.sample_size() * dtype_size(dtype(head.type)) > length
+            || head.label_offset + head.samples * head.label_size * sizeof(float) > length) {
+            std::cerr << "ERROR: Invalid binary dataset: " << path << std::endl;
+            std::memset(&head, 0, sizeof(head));
+            return;
+        }
+
+        ::madvise(base, length, MADV_SEQUENTIAL);
+    }
+
+    shard(const shard& rhs) = delete;
+    shard& operator=(const shard& rhs) = delete;
+
+    /*!
+     * \brief Unmap the shard
+     */
+    ~shard() {
+        if (base) {
+            ::munmap(base, length);
+        }
+    }
+
+    /*!
+     * \brief Returns a pointer to the given sample
+     */
+    const char* sample(size_t i) const {
+        return static_cast<const char*>(base) + head.data_offset + i * head.sample_size() * dtype_size(dtype(head.type));
+    }
+
+    /*!
+     * \brief Returns a pointer to the label of the given sample
+     */
+    const float* label(size_t i) const {
+        return reinterpret_cast<const float*>(static_cast<const char*>(base) + head.label_offset) + i * head.label_size;
+    }
+
+    /*!
+     * \brief Advise the kernel that the given samples will be read soon
+     */
+    void will_need(size_t first, size_t n) const {
+        if (!base || first >= head.samples) {
+            return;
+        }
+
+        n = std::min(n, size_t(head.samples) - first);
+
+        const size_t page  = ::sysconf(_SC_PAGESIZE);
+        const size_t begin = size_t(sample(first) - static_cast<const char*>(base)) / page * page;
+        const size_t end   = size_t(sample(first + n) - static_cast<const char*>(base));
+
+        ::madvise(static_cast<char*>(base) + begin, end - begin, MADV_WILLNEED);
+    }
+};
+
+/*!
+ * \brief A binary dataset made of several shards
+ */
+struct dataset {
+    std::vector<std::unique_ptr<shard>> shards; ///< The mapped shards
+    std::vector<size_t> offsets;                ///< The index of the first sample of each shard
+
+    /*!
+     * \brief Map all the given shards
+     */
+    explicit dataset(const std::vector<std::string>& paths) {
+        size_t n = 0;
+
+        for (auto& path : paths) {
+            shards.emplace_back(std::make_unique<shard>(path));
+            offsets.push_back(n);
+            n += shards.back()->head.samples;
+        }
+
+        offsets.push_back(n);
+
+        // All the shards must hold the same type of samples
+        for (auto& s : shards) {
+            if (s->head.samples && !same_layout(s->head, head())) {
+                std::cerr << "ERROR: Inconsistent shards in binary dataset" << std::endl;
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the number of samples of the dataset
+     */
+    size_t size() const {
+        return offsets.back();
+    }
+
+    /*!
+     * \brief Returns the header of the dataset
+     */
+    const header& head() const {
+        return shards.front()->head;
+    }
+
+    /*!
+     * \brief Returns the shard holding the given sample and the index of
+     * the sample in this shard
+     */
+    std::pair<const shard*, size_t> locate(size_t i) const {
+        auto s = std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin() - 1;
+        return {shards[s].get(), i - offsets[s]};
+    }
+
+    /*!
+     * \brief Advise the kernel that the given samples will be read soon
+     */
+    void will_need(size_t first, size_t n) const {
+        while (n && first < size()) {
+            auto location = locate(first);
+            auto& s       = *location.first;
+
+            const size_t m = std::min(n, size_t(s.head.samples) - location.second);
+
+            s.will_need(location.second, m);
+
+            first += m;
+            n -= m;
+        }
+    }
+};
+
+/*!
+ * \brief Convert the values of the given type into the destination
+ */
+template <typename T>
+void convert(dtype type, const char* src, size_t n, T* dst) {
+    switch (type) {
+        case dtype::FLOAT32:
+            std::copy_n(reinterpret_cast<const float*>(src), n, dst);
+            break;
+        case dtype::FLOAT64:
+            std::copy_n(reinterpret_cast<const double*>(src), n, dst);
+            break;
+        case dtype::UINT8:
+            std::copy_n(reinterpret_cast<const uint8_t*>(src), n, dst);
+            break;
+    }
+}
+
+/*!
+ * \brief Iterator over the samples of a binary dataset.
+ *
+ * The samples are converted to T in a buffer of the iterator.
+ */
+template <typename T, size_t D>
+struct sample_iterator : std::iterator<std::input_iterator_tag, etl::dyn_matrix<T, D>, ptrdiff_t, etl::dyn_matrix<T, D>*, etl::dyn_matrix<T, D>&> {
+    using value_type = etl::dyn_matrix<T, D>; ///< The type of a sample
+
+    static constexpr size_t readahead = 256; ///< The number of samples to advise at once
+
+    std::shared_ptr<const dataset> data; ///< The dataset
+    size_t index;                        ///< The current sample
+    value_type sample;                   ///< The buffer of the current sample
+
+    /*!
+     * \brief Construct an iterator on the given sample of the dataset
+     */
+    sample_iterator(std::shared_ptr<const dataset> data, size_t index) : data(std::move(data)), index(index) {
+        init(std::make_index_sequence<D>());
+    }
+
+    sample_iterator(const sample_iterator& rhs) = default;
+    sample_iterator(sample_iterator&& rhs) = default;
+
+    sample_iterator& operator=(const sample_iterator& rhs) = default;
+    sample_iterator& operator=(sample_iterator&& rhs) = default;
+
+    sample_iterator& operator++() {
+        ++index;
+
+        if (index % readahead == 0) {
+            data->will_need(index + readahead, readahead);
+        }
+
+        return *this;
+    }
+
+    sample_iterator operator++(int) {
+        auto it = *this;
+        ++(*this);
+        return it;
+    }
+
+    const value_type& operator*() {
+        auto location = data->locate(index);
+        auto& s       = *location.first;
+
+        convert(dtype(s.head.type), s.sample(location.second), etl::size(sample), sample.memory_start());
+
+        sample.invalidate_gpu();
+
+        return sample;
+    }
+
+    bool operator==(const sample_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const sample_iterator& rhs) const {
+        return index != rhs.index;
+    }
+
+private:
+    /*!
+     * \brief Allocate the buffer for the shape of the dataset
+     */
+    template <size_t... I>
+    void init(std::index_sequence<I...> /*seq*/) {
+        auto& head = data->head();
+
+        if (head.dimensions != D) {
+            std::cerr << "ERROR: Binary dataset of invalid dimensions: " << head.dimensions << " instead of " << D << std::endl;
+            return;
+        }
+
+        sample = value_type(head.shape[I]...);
+
+        data->will_need(index, 2 * readahead);
+    }
+};
+
+/*!
+ * \brief Iterator over the labels of a binary dataset.
+ *
+ * The categorical labels are returned as the index of the class.
+ */
+struct label_iterator : std::iterator<std::input_iterator_tag, float, ptrdiff_t, float*, float&> {
+    std::shared_ptr<const dataset> data; ///< The dataset
+    size_t index;                        ///< The current sample
+
+    /*!
+     * \brief Construct an iterator on the given label of the dataset
+     */
+    label_iterator(std::shared_ptr<const dataset> data, size_t index) : data(std::move(data)), index(index) {
+        // Nothing else to init
+    }
+
+    label_iterator(const label_iterator& rhs) = default;
+    label_iterator(label_iterator&& rhs) = default;
+
+    label_iterator& operator=(const label_iterator& rhs) = default;
+    label_iterator& operator=(label_iterator&& rhs) = default;
+
+    label_iterator& operator++() {
+        ++index;
+        return *this;
+    }
+
+    label_iterator operator++(int) {
+        auto it = *this;
+        ++index;
+        return it;
+    }
+
+    float operator*() const {
+        auto location = data->locate(index);
+        auto& s       = *location.first;
+
+        const float* label = s.label(location.second);
+
+        if (s.head.label_size == 1) {
+            return *label;
+        }
+
+        return float(std::max_element(label, label + s.head.label_size) - label);
+    }
+
+    bool operator==(const label_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const label_iterator& rhs) const {
+        return index != rhs.index;
+    }
+};
+
+/*!
+ * \brief Write one shard of a binary dataset
+ */
+template <typename S>
+bool write_shard(const std::string& path, const std::vector<S>& samples, const std::vector<float>& labels, header head) {
+    std::ofstream stream(path, std::ios::binary);
+
+    if (!stream) {
+        std::cerr << "ERROR: Failed to create binary dataset: " << path << std::endl;
+        return false;
+    }
+
+    const size_t data_size = samples.size() * sizeof(S);
+
+    head.data_offset  = alignment;
+    head.label_offset = (head.data_offset + data_size + alignment - 1) / alignment * alignment;
+
+    std::vector<char> padding(alignment, 0);
+
+    stream.write(reinterpret_cast<const char*>(&head), sizeof(head));
+    stream.write(padding.data(), head.data_offset - sizeof(head));
+    stream.write(reinterpret_cast<const char*>(samples.data()), data_size);
+    stream.write(padding.data(), head.label_offset - head.data_offset - data_size);
+    stream.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(float));
+
+    return bool(stream);
+}
+
+} // end of namespace binary
+
+/*!
+ * \brief Write the data of the given generator to a binary dataset.
+ *
+ * The samples are stored as S. When shard_size is not zero, the dataset
+ * is split in shards of at most shard_size samples, named path.0,
+ * path.1, ... The labels are not written for auto-encoder generators.
+ *
+ * \param generator The generator to read the data from
+ * \param path The path of the dataset
+ * \param shard_size The maximum number of samples of a shard
+ * \return The paths of the written shards, empty in case of error
+ */
+template <typename S = float, typename Generator>
+std::vector<std::string> write_binary_dataset(Generator& generator, const std::string& path, size_t shard_size = 0) {
+    std::vector<std::string> paths;
+
+    binary::header head;
+    std::memset(&head, 0, sizeof(head));
+    std::memcpy(head.magic, binary::magic, sizeof(binary::magic));
+    head.version    = binary::version;
+    head.type       = uint32_t(binary::dtype_of<S>::value);
+    head.dimensions = Generator::dimensions();
+
+    static_assert(Generator::dimensions() <= binary::max_dims, "Too many dimensions for a binary dataset");
+
+    constexpr bool has_labels = !Generator::desc::AutoEncoder;
+
+    std::vector<S> samples;
+    std::vector<float> labels;
+
+    auto flush = [&]() {
+        head.samples = samples.size() / head.sample_size();
+
+        auto shard_path = shard_size ? path + "." + std::to_string(paths.size()) : path;
+
+        if (!binary::write_shard(shard_path, samples, labels, head)) {
+            return false;
+        }
+
+        paths.push_back(shard_path);
+
+        samples.clear();
+        labels.clear();
+
+        return true;
+    };
+
+    generator.reset();
+
+    while (generator.has_next_batch()) {
+        auto data  = generator.data_batch();
+        auto label = generator.label_batch();
+
+        const size_t n = etl::dim<0>(data);
+
+        for (size_t d = 0; d < Generator::dimensions(); ++d) {
+            head.shape[d] = etl::dim(data, d + 1);
+        }
+
+        if constexpr (has_labels) {
+            head.label_size = etl::size(label) / n;
+        }
+
+        const size_t sample_size = head.sample_size();
+
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < sample_size; ++j) {
+                samples.push_back(S(data[i * sample_size + j]));
+            }
+
+            if constexpr (has_labels) {
+                for (size_t j = 0; j < head.label_size; ++j) {
+                    labels.push_back(float(label[i * head.label_size + j]));
+                }
+            }
+
+            if (shard_size && samples.size() == shard_size * sample_size && !flush()) {
+                return {};
+            }
+        }
+
+        generator.next_batch();
+    }
+
+    if ((!samples.empty() || paths.empty()) && !flush()) {
+        return {};
+    }
+
+    return paths;
+}
+
+/*!
+ * \brief Make an out of memory data generator from the shards of a binary
+ * dataset.
+ *
+ * The samples are of type T, with D dimensions.
+ *
+ * \param paths The paths of the shards
+ * \param n_classes The number of classes
+ * \return The generator
+ */
+template <typename T, size_t D, typename... Parameters>
+auto make_binary_generator(const std::vector<std::string>& paths, size_t n_classes, const outmemory_data_generator_desc<Parameters...>& desc) {
+    auto data = std::make_shared<const binary::dataset>(paths);
+
+    binary::sample_iterator<T, D> iit(data, 0);
+    binary::sample_iterator<T, D> iend(data, data->size());
+
+    if constexpr (outmemory_data_generator_desc<Parameters...>::AutoEncoder) {
+        return make_generator(iit, iend, iit, iend, data->size(), n_classes, desc);
+    } else {
+        binary::label_iterator lit(data, 0);
+        binary::label_iterator lend(data, data->size());
+
+        return make_generator(iit, iend, lit, lend, data->size(), n_classes, desc);
+    }
+}
+
+/*!
+ * \brief Make an out of memory data generator from a binary dataset
+ * stored in a single file.
+ */
+template <typename T, size_t D, typename... Parameters>
+auto make_binary_generator(const std::string& path, size_t n_classes, const outmemory_data_generator_desc<Parameters...>& desc) {
+    return make_binary_generator<T, D>(std::vector<std::string>{path}, n_classes, desc);
+}
+
+} //end of dll namespace
@@ -0,0 +1,353 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file cache.hpp
+ * \brief Persistent cache of the preprocessed datasets
+ *
+ * The preprocessed samples and labels of a dataset are stored in the
+ * binary dataset format, in the directory given by the DLL_DATASET_CACHE
+ * environment variable (or set with dll::cache::directory()). The cache is
+ * disabled when no directory is set.
+ *
+ * The name of a cache file is made of a hash of the sources (path, size
+ * and modification time) and of the preprocessing. When the sources or the
+ * preprocessing change, the file name changes and the dataset is simply
+ * read and preprocessed again.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "dll/datasets/binary.hpp"
+
+namespace dll {
+
+namespace cache {
+
+/*!
+ * \brief Returns the directory of the cache, empty if the cache is disabled
+ */
+inline std::string& directory() {
+    static std::string dir = [] {
+        const auto* env = std::getenv("DLL_DATASET_CACHE");
+        return std::string(env ? env : "");
+    }();
+
+    return dir;
+}
+
+/*!
+ * \brief The key of a cached dataset (FNV-1a hash)
+ */
+struct key {
+    uint64_t value = 14695981039346656037ULL; ///< The current hash
+
+    /*!
+     * \brief Add the given bytes to the key
+     */
+    void add(const void* data, size_t n) {
+        auto* bytes = static_cast<const unsigned char*>(data);
+
+        for (size_t i = 0; i < n; ++i) {
+            value = (value ^ bytes[i]) * 1099511628211ULL;
+        }
+    }
+
+    /*!
+     * \brief Add the given string to the key
+     */
+    void add(const std::string& str) {
+        add(str.c_str(), str.size() + 1);
+    }
+
+    /*!
+     * \brief Add the given value to the key
+     */
+    template <typename T>
+    void add_value(T v) {
+        add(&v, sizeof(v));
+    }
+
+    /*!
+     * \brief Add the given source file to the key.
+     * \return false if the file does not exist
+     */
+    bool add_source(const std::string& path) {
+        struct stat st;
+
+        if (::stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+
+        add(path);
+        add_value(uint64_t(st.st_size));
+        add_value(int64_t(st.st_mtime));
+
+        return true;
+    }
+
+    /*!
+     * \brief Add the preprocessing of the given generator descriptor to the key
+     */
+    template <typename Desc>
+    void add_preprocessing() {
+        add_value(uint64_t(Desc::ScalePre));
+        add_value(uint64_t(Desc::BinarizePre));
+        add_value(uint8_t(Desc::NormalizePre));
+        add_value(uint8_t(Desc::AutoEncoder));
+        add_value(uint8_t(Desc::Categorical));
+    }
+};
+
+/*!
+ * \brief Returns the path of the cache file of the given dataset.
+ *
+ * \param name The name of the dataset
+ * \param sources The source files of the dataset
+ * \param k The key of the other parameters of the dataset
+ * \return The path of the cache file, empty if the cache is disabled or if
+ * a source is missing
+ */
+inline std::string file(const std::string& name, const std::vector<std::string>& sources, key k) {
+    if (directory().empty()) {
+        return {};
+    }
+
+    for (auto& source : sources) {
+        if (!k.add_source(source)) {
+            return {};
+        }
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(k.value));
+
+    return directory() + "/" + name + "-" + hex + ".dll";
+}
+
+/*!
+ * \brief Indicates if the given cache file exists
+ */
+inline bool exists(const std::string& path) {
+    struct stat st;
+    return !path.empty() && ::stat(path.c_str(), &st) == 0;
+}
+
+/*!
+ * \brief Write a cache file from the given samples and labels.
+ *
+ * The file is written next to its final path and then renamed, so that an
+ * interrupted run never leaves a partial cache file.
+ *
+ * \param path The path of the cache file
+ * \param samples The contiguous samples
+ * \param shape The shape of a sample
+ * \param labels The contiguous labels
+ * \param label_size The number of values of a label
+ */
+template <typename T>
+bool write(const std::string& path, const std::vector<T>& samples, const std::vector<size_t>& shape, const std::vector<float>& labels, size_t label_size) {
+    if (shape.size() > binary::max_dims) {
+        return false;
+    }
+
+    binary::header head;
+    std::memset(&head, 0, sizeof(head));
+    std::memcpy(head.magic, binary::magic, sizeof(binary::magic));
+    head.version    = binary::version;
+    head.type       = uint32_t(binary::dtype_of<T>::value);
+    head.dimensions = shape.size();
+    head.label_size = label_size;
+
+    for (size_t d = 0; d < shape.size(); ++d) {
+        head.shape[d] = shape[d];
+    }
+
+    head.samples = samples.size() / head.sample_size();
+
+    const std::string tmp = path + ".tmp";
+
+    if (!binary::write_shard(tmp, samples, labels, head)) {
+        return false;
+    }
+
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+/*!
+ * \brief Load the preprocessed data of a prepared generator from the cache
+ * \param generator The prepared generator, with its caches allocated
+ * \param path The path of the cache file
+ * \return true if the data has been loaded, false otherwise
+ */
+template <typename Generator>
+bool load(Generator& generator, const std::string& path) {
+    if (!exists(path)) {
+        return false;
+    }
+
+    binary::shard shard(path);
+
+    const size_t n          = etl::dim<0>(generator.input_cache);
+    const size_t label_size = n ? etl::size(generator.label_cache) / n : 0;
+
+    if (shard.head.samples != n || shard.head.sample_size() * n != etl::size(generator.input_cache) || shard.head.label_size != label_size) {
+        return false;
+    }
+
+    generator.input_cache.ensure_cpu_up_to_date();
+    generator.label_cache.ensure_cpu_up_to_date();
+
+    binary::convert(binary::dtype(shard.head.type), shard.sample(0), etl::size(generator.input_cache), generator.input_cache.memory_start());
+    std::copy_n(shard.label(0), etl::size(generator.label_cache), generator.label_cache.memory_start());
+
+    generator.input_cache.invalidate_gpu();
+    generator.label_cache.invalidate_gpu();
+
+    return true;
+}
+
+/*!
+ * \brief Store the preprocessed data of a generator in the cache
+ * \param generator The generator, with its data preprocessed
+ * \param path The path of the cache file, nothing is done if empty
+ */
+template <typename Generator>
+void store(Generator& generator, const std::string& path) {
+    if (path.empty()) {
+        return;
+    }
+
+    const size_t n = etl::dim<0>(generator.input_cache);
+
+    if (!n) {
+        return;
+    }
+
+    std::vector<size_t> shape;
+
+    for (size_t d = 1; d < etl::dimensions(generator.input_cache); ++d) {
+        shape.push_back(etl::dim(generator.input_cache, d));
+    }
+
+    generator.input_cache.ensure_cpu_up_to_date();
+    generator.label_cache.ensure_cpu_up_to_date();
+
+    std::vector<etl::value_t<decltype(generator.input_cache)>> samples(generator.input_cache.begin(), generator.input_cache.end());
+    std::vector<float> labels(generator.label_cache.begin(), generator.label_cache.end());
+
+    if (!write(path, samples, shape, labels, labels.size() / n)) {
+        std::cerr << "ERROR: Failed to write the dataset cache: " << path << std::endl;
+    }
+}
+
+/*!
+ * \brief Create an empty sample of the shape of the given header
+ */
+template <typename Sample, size_t... I>
+Sample make_sample(const binary::header& head, std::index_sequence<I...> /*seq*/) {
+    if constexpr (etl::decay_traits<Sample>::is_fast) {
+        cpp_unused(head);
+        return Sample();
+    } else {
+        return Sample(size_t(head.shape[I])...);
+    }
+}
+
+/*!
+ * \brief Load preprocessed samples from the cache
+ * \param samples The container to fill
+ * \param path The path of the cache file
+ * \return true if the samples have been loaded, false otherwise
+ */
+template <typename Sample>
+bool load_samples(std::vector<Sample>& samples, const std::string& path) {
+    static constexpr size_t D = etl::decay_traits<Sample>::dimensions();
+
+    if (!exists(path)) {
+        return false;
+    }
+
+    binary::shard shard(path);
+
+    if (!shard.head.samples || shard.head.dimensions != D) {
+        return false;
+    }
+
+    samples.clear();
+    samples.reserve(shard.head.samples);
+
+    for (size_t i = 0; i < shard.head.samples; ++i) {
+        samples.push_back(make_sample<Sample>(shard.head, std::make_index_sequence<D>()));
+
+        auto& sample = samples.back();
+
+        if (etl::size(sample) != shard.head.sample_size()) {
+            samples.clear();
+            return false;
+        }
+
+        binary::convert(binary::dtype(shard.head.type), shard.sample(i), etl::size(sample), sample.memory_start());
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Store preprocessed samples in the cache
+ * \param samples The samples to store
+ * \param path The path of the cache file, nothing is done if empty
+ */
+template <typename Sample>
+void store_samples(const std::vector<Sample>& samples, const std::string& path) {
+    using weight = etl::value_t<Sample>;
+
+    if (path.empty() || samples.empty()) {
+        return;
+    }
+
+    std::vector<size_t> shape;
+
+    for (size_t d = 0; d < etl::dimensions(samples.front()); ++d) {
+        shape.push_back(etl::dim(samples.front(), d));
+    }
+
+    const size_t sample_size = etl::size(samples.front());
+
+    // Only samples of the same size can be stored
+    for (auto& sample : samples) {
+        if (etl::size(sample) != sample_size) {
+            return;
+        }
+    }
+
+    std::vector<weight> data(samples.size() * sample_size);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        std::copy(samples[i].begin(), samples[i].end(), data.begin() + i * sample_size);
+    }
+
+    if (!write(path, data, shape, {}, 0)) {
+        std::cerr << "ERROR: Failed to write the dataset cache: " << path << std::endl;
+    }
+}
+
+} // end of namespace cache
+
+} //end of dll namespace
@@ -9,6 +9,9 @@
 
 #include "cifar/cifar10_reader.hpp"
 
+#include "dll/datasets/cache.hpp"
+#include "dll/datasets/mapped.hpp"
+
 namespace dll {
 
 /*!
@@ -25,24 +28,38 @@ auto make_cifar10_generator_train(const std::string& folder, size_t limit, Param
     float label;
 
     size_t n = 50000;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    generator->label_cache = 0;
+    // Reuse the preprocessed data of a previous run, if any
+    cache::key key;
+    key.add_preprocessing<typename std::decay_t<decltype(*generator)>::desc>();
+    key.add_value(n);
+
+    const std::vector<std::string> sources{folder + "/data_batch_1.bin", folder + "/data_batch_2.bin", folder + "/data_batch_3.bin", folder + "/data_batch_4.bin", folder + "/data_batch_5.bin"};
 
-    // Read all the necessary images and labels
-    cifar::read_training_categorical(folder, m, generator->input_cache, generator->label_cache);
+    const auto cache_file = cache::file("cifar10-train", sources, key);
+
+    if(cache::load(*generator, cache_file)){
+        return generator;
+    }
+
+    // Read all the necessary images and labels directly into the caches
+    if(!mapped::read_cifar_batches(generator->input_cache, generator->label_cache, sources)){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 training set" << std::endl;
+        return generator;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
+    cache::store(*generator, cache_file);
+
     return generator;
 }
 
@@ -60,24 +77,38 @@ auto make_cifar10_generator_test(const std::string& folder, size_t limit, Parame
     float label;
 
     size_t n = 10000;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    generator->label_cache = 0;
+    // Reuse the preprocessed data of a previous run, if any
+    cache::key key;
+    key.add_preprocessing<typename std::decay_t<decltype(*generator)>::desc>();
+    key.add_value(n);
 
-    // Read all the necessary images and labels
-    cifar::read_test_categorical(folder, m, generator->input_cache, generator->label_cache);
+    const std::vector<std::string> sources{folder + "/test_batch.bin"};
+
+    const auto cache_file = cache::file("cifar10-test", sources, key);
+
+    if(cache::load(*generator, cache_file)){
+        return generator;
+    }
+
+    // Read all the necessary images and labels directly into the caches
+    if(!mapped::read_cifar_batches(generator->input_cache, generator->label_cache, sources)){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 test set" << std::endl;
+        return generator;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
+    cache::store(*generator, cache_file);
+
     return generator;
 }
 
@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 #include <utility>
@@ -15,15 +19,23 @@
 #include <dirent.h>
 
 // Only for image loading...
+#include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "dll/util/batch_ring.hpp"
+
 namespace dll {
 
 namespace imagenet {
 
-inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
-    files.reserve(1200000);
+using image_type = etl::fast_dyn_matrix<float, 3, 256, 256>; ///< The type of an image
+
+constexpr const char* index_magic = "dll-imagenet-index-1"; ///< The first line of the index files
 
+/*!
+ * \brief Scan the directory tree of the dataset for the files
+ */
+inline void scan_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
     struct dirent* entry;
     auto dir = opendir(file_path.c_str());
 
@@ -55,27 +67,242 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
 
             files.emplace_back(label, image);
         }
+
+        closedir(sub_dir);
+    }
+
+    closedir(dir);
+}
+
+/*!
+ * \brief Read the files from the index of a previous scan.
+ *
+ * The labels are numbered in their order of first appearance, which is
+ * their order in the scan.
+ *
+ * \return true if the index has been read, false otherwise
+ */
+inline bool read_index(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& index_path){
+    std::ifstream stream(index_path);
+
+    std::string magic;
+
+    if (!std::getline(stream, magic) || magic != index_magic) {
+        return false;
+    }
+
+    size_t label;
+    size_t image;
+
+    while (stream >> label >> image) {
+        if (!label_map.count(label)) {
+            auto l = label_map.size();
+            label_map[label] = l;
+        }
+
+        files.emplace_back(label, image);
+    }
+
+    return !files.empty();
+}
+
+/*!
+ * \brief Write the index of the files, for the next runs.
+ *
+ * Failing to write the index is not an error, the tree will be scanned
+ * again next time.
+ */
+inline void write_index(const std::vector<std::pair<size_t, size_t>>& files, const std::string& index_path){
+    std::ofstream stream(index_path);
+
+    stream << index_magic << '\n';
+
+    for (auto& file : files) {
+        stream << file.first << ' ' << file.second << '\n';
+    }
+}
+
+/*!
+ * \brief Read the list of files of the dataset.
+ *
+ * The directory tree is only scanned when there is no index next to it
+ * from a previous scan.
+ */
+inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
+    files.reserve(1200000);
+
+    auto index_path = file_path + ".index";
+
+    if (read_index(files, label_map, index_path)) {
+        return;
+    }
+
+    files.clear();
+    label_map.clear();
+
+    scan_files(files, label_map, file_path);
+    write_index(files, index_path);
+}
+
+/*!
+ * \brief Returns the path of the given image
+ */
+inline std::string image_path(const std::string& imagenet_path, const std::pair<size_t, size_t>& image_file){
+    auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
+
+    return std::string(imagenet_path) + "/train" + label + label + "_" + std::to_string(image_file.second) + ".JPEG";
+}
+
+/*!
+ * \brief Decode the given image.
+ *
+ * The image is stored as (channel, x, y), the transpose of each plane of
+ * OpenCV. The planes are transposed and converted to float by OpenCV,
+ * which vectorizes both.
+ */
+inline void decode_image(const std::string& image_path, image_type& image){
+    auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+
+    if (!mat.data || mat.empty()) {
+        std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
+        image = 0;
+        return;
+    }
+
+    if (mat.cols != 256 || mat.rows != 256) {
+        std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
+        image = 0;
+        return;
+    }
+
+    std::vector<cv::Mat> planes;
+    cv::split(mat, planes);
+
+    // Grayscale images only fill the first channel
+    const size_t channels = planes.size() >= 3 ? 3 : 1;
+
+    cv::Mat transposed;
+
+    for (size_t c = 0; c < 3; ++c) {
+        cv::Mat channel(256, 256, CV_32F, image.memory_start() + c * 256 * 256);
+
+        if (c < channels) {
+            cv::transpose(planes[c], transposed);
+            transposed.convertTo(channel, CV_32F);
+        } else {
+            channel.setTo(0);
+        }
     }
+
+    image.invalidate_gpu();
 }
 
+/*!
+ * \brief Decode the images of the dataset ahead of their use, with several
+ * threads.
+ *
+ * The images are read in order by a single consumer. The decoding threads
+ * fill a window of images in advance and restart from the requested image
+ * when the consumer jumps, for instance when the generator is reset.
+ */
+struct decoder {
+    static constexpr size_t window = 32; ///< The number of images decoded in advance
+
+    /*!
+     * \brief Construct a decoder for the given files and start its threads
+     */
+    decoder(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, size_t workers)
+            : imagenet_path(imagenet_path), files(files), slots(window), ring(files->size()) {
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this] { decode_images(); });
+        }
+    }
+
+    decoder(const decoder& rhs) = delete;
+    decoder& operator=(const decoder& rhs) = delete;
+
+    /*!
+     * \brief Stop the decoding threads
+     */
+    ~decoder() {
+        ring.stop();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Returns the given image, waiting for it to be decoded
+     */
+    image_type get(size_t index) {
+        // The same image can be requested twice in a row
+        if (current && index + 1 == current) {
+            return last;
+        }
+
+        if (index != current) {
+            ring.reset([this, index] { base = index; });
+            current = index;
+        }
+
+        const size_t b = current - base;
+
+        ring.wait_ready(b);
+        last = slots[b % window];
+        ring.release();
+
+        ++current;
+
+        return last;
+    }
+
+private:
+    /*!
+     * \brief Decode the images claimed on the ring, until it is stopped
+     */
+    void decode_images() {
+        size_t b;
+
+        while (ring.acquire(b)) {
+            if (base + b < files->size()) {
+                decode_image(image_path(imagenet_path, (*files)[base + b]), slots[b % window]);
+            }
+
+            ring.publish(b);
+        }
+    }
+
+    const std::string imagenet_path;                               ///< The path to the dataset
+    std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files; ///< The files of the dataset
+
+    std::vector<image_type> slots;    ///< The decoded images
+    batch_ring<window> ring;          ///< The ring between the decoding threads and the consumer
+    std::vector<std::thread> threads; ///< The decoding threads
+
+    size_t base    = 0; ///< The first image of the current run of the ring
+    size_t current = 0; ///< The next image to be returned
+    image_type last;    ///< The last returned image
+};
+
 struct image_iterator : std::iterator<
                                      std::input_iterator_tag,
-                                     etl::fast_dyn_matrix<float, 3, 256, 256>,
+                                     image_type,
                                      ptrdiff_t,
-                                     etl::fast_dyn_matrix<float, 3, 256, 256>*,
-                                     etl::fast_dyn_matrix<float, 3, 256, 256>&
+                                     image_type*,
+                                     image_type&
                                  > {
 
-    using value_type = etl::fast_dyn_matrix<float, 3, 256, 256>;
+    using value_type = image_type;
 
-    std::string imagenet_path;
+    std::shared_ptr<decoder> images;
     std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files;
     std::shared_ptr<std::unordered_map<size_t, float>> labels;
 
     size_t index;
 
-    image_iterator(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, size_t index) :
-        imagenet_path(imagenet_path), files(files), labels(labels), index(index)
+    image_iterator(std::shared_ptr<decoder> images, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, size_t index) :
+        images(images), files(files), labels(labels), index(index)
     {
         // Nothing else to init
     }
@@ -100,52 +327,7 @@ struct image_iterator : std::iterator<
     }
 
     value_type operator*() {
-        auto& image_file = (*files)[index];
-
-        auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
-
-        auto image_path =
-            std::string(imagenet_path) + "/train" + label + label +
-            "_" + std::to_string(image_file.second) + ".JPEG";
-
-        auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
-
-        value_type image;
-
-        if (!mat.data || mat.empty()) {
-            std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (mat.cols != 256 || mat.rows != 256) {
-            std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (cpp_likely(mat.channels() == 3)) {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    auto pixel = mat.at<cv::Vec3b>(y, x);
-
-                    image(0, x, y) = pixel.val[0];
-                    image(1, x, y) = pixel.val[1];
-                    image(2, x, y) = pixel.val[2];
-                }
-            }
-        } else {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    image(0, x, y) = mat.at<unsigned char>(y, x);
-                }
-            }
-
-            image(1) = 0;
-            image(2) = 0;
-        }
-
-        return image;
+        return images->get(index);
     }
 
     bool operator==(const image_iterator& rhs) const {
@@ -226,9 +408,17 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
     std::default_random_engine engine(rd());
     std::shuffle(train_files->begin(), train_files->end(), engine);
 
+    // Each generator reads the images in its own order
+    const size_t workers = std::max(1u, std::thread::hardware_concurrency());
+
+    auto train_images = std::make_shared<imagenet::decoder>(folder, train_files, workers);
+    auto test_images  = std::make_shared<imagenet::decoder>(folder, train_files, workers);
+
     // The image iterators
-    imagenet::image_iterator iit(folder, train_files, labels, 0);
-    imagenet::image_iterator iend(folder, train_files, labels, train_files->size());
+    imagenet::image_iterator iit(train_images, train_files, labels, 0);
+    imagenet::image_iterator iend(train_images, train_files, labels, train_files->size());
+    imagenet::image_iterator tit(test_images, train_files, labels, 0);
+    imagenet::image_iterator tend(test_images, train_files, labels, train_files->size());
 
     // The label iterators
     imagenet::label_iterator lit(train_files, labels, 0);
@@ -237,7 +427,7 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
     return make_dataset_holder(
         "imagenet",
         make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}),
-        make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+        make_generator(tit, tend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
 }
 
 } // end of namespace dll
@@ -0,0 +1,275 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file mapped.hpp
+ * \brief Memory-mapped readers of the MNIST (IDX) and CIFAR-10 binary files
+ *
+ * The files are mapped in memory and the bytes are converted in parallel
+ * directly into the contiguous caches of the generators, without any
+ * intermediate container.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dll {
+
+namespace mapped {
+
+/*!
+ * \brief A read-only file mapped in memory
+ */
+struct file {
+    const uint8_t* data = nullptr; ///< The start of the mapping
+    size_t length       = 0;       ///< The length of the mapping
+
+    /*!
+     * \brief Map the given file in memory, the file is left empty in case
+     * of error.
+     */
+    explicit file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* base = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (base != MAP_FAILED) {
+                data   = static_cast<const uint8_t*>(base);
+                length = st.st_size;
+
+                ::madvise(base, length, MADV_SEQUENTIAL);
+            }
+        }
+
+        // The mapping stays valid after the file is closed
+        ::close(fd);
+    }
+
+    file(const file& rhs) = delete;
+    file& operator=(const file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~file() {
+        if (data) {
+            ::munmap(const_cast<uint8_t*>(data), length);
+        }
+    }
+
+    /*!
+     * \brief Returns the big-endian 32 bits integer at the given offset
+     */
+    uint32_t be32(size_t offset) const {
+        return (uint32_t(data[offset]) << 24) | (uint32_t(data[offset + 1]) << 16) | (uint32_t(data[offset + 2]) << 8) | uint32_t(data[offset + 3]);
+    }
+};
+
+/*!
+ * \brief Call functor(first, last) on contiguous chunks of [0, n), in
+ * parallel, with at least min_chunk elements per thread.
+ */
+template <typename Functor>
+void for_each_chunk(size_t n, size_t min_chunk, Functor&& functor) {
+    const size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (n + min_chunk - 1) / min_chunk);
+
+    if (threads < 2) {
+        functor(size_t(0), n);
+        return;
+    }
+
+    const size_t chunk = (n + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back([&functor, t, chunk, n] { functor(std::min(n, t * chunk), std::min(n, (t + 1) * chunk)); });
+    }
+
+    functor(size_t(0), std::min(n, chunk));
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/*!
+ * \brief Call functor(first, last) on contiguous chunks of samples of [0, n),
+ * in parallel.
+ */
+template <typename Functor>
+void for_each_chunk(size_t n, Functor&& functor) {
+    for_each_chunk(n, 1024, std::forward<Functor>(functor));
+}
+
+/*!
+ * \brief Store a label in a label cache, as a class or as a one-hot vector
+ */
+template <typename Cache>
+void store_label(Cache& cache, size_t i, uint8_t label) {
+    if constexpr (etl::dimensions<Cache>() == 1) {
+        cache[i] = label;
+    } else {
+        cache(i) = 0;
+        cache(i, label) = 1;
+    }
+}
+
+/*!
+ * \brief Read the images of an IDX file into the given cache
+ * \param cache The cache, already allocated for the samples to read
+ * \param path The path to the IDX image file
+ * \param start The index of the first image to read
+ * \return true if the images have been read, false otherwise
+ */
+template <typename Cache>
+bool read_idx_images(Cache& cache, const std::string& path, size_t start = 0) {
+    file f(path);
+
+    if (f.length < 16 || f.be32(0) != 0x803) {
+        return false;
+    }
+
+    const size_t count = f.be32(4);
+    const size_t size  = size_t(f.be32(8)) * f.be32(12);
+    const size_t n     = etl::dim<0>(cache);
+
+    if (start + n > count || f.length < 16 + (start + n) * size || etl::size(cache) != n * size) {
+        return false;
+    }
+
+    cache.ensure_cpu_up_to_date();
+
+    const uint8_t* src = f.data + 16 + start * size;
+    auto* dst          = cache.memory_start();
+
+    for_each_chunk(n, [src, dst, size](size_t first, size_t last) {
+        std::copy(src + first * size, src + last * size, dst + first * size);
+    });
+
+    cache.invalidate_gpu();
+
+    return true;
+}
+
+/*!
+ * \brief Read the labels of an IDX file into the given cache
+ * \param cache The label cache, already allocated for the labels to read
+ * \param path The path to the IDX label file
+ * \param start The index of the first label to read
+ * \return true if the labels have been read, false otherwise
+ */
+template <typename Cache>
+bool read_idx_labels(Cache& cache, const std::string& path, size_t start = 0) {
+    file f(path);
+
+    if (f.length < 8 || f.be32(0) != 0x801) {
+        return false;
+    }
+
+    const size_t count = f.be32(4);
+    const size_t n     = etl::dim<0>(cache);
+
+    if (start + n > count || f.length < 8 + start + n) {
+        return false;
+    }
+
+    cache.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < n; ++i) {
+        store_label(cache, i, f.data[8 + start + i]);
+    }
+
+    cache.invalidate_gpu();
+
+    return true;
+}
+
+/*!
+ * \brief Read CIFAR-10 binary batches into the given caches.
+ *
+ * Each record of a batch is made of the label byte followed by the 3x32x32
+ * image. The files are read in order until the caches are full.
+ *
+ * \param input_cache The image cache, already allocated
+ * \param label_cache The label cache, already allocated
+ * \param paths The paths to the batch files
+ * \return true if all the samples have been read, false otherwise
+ */
+template <typename Cache, typename LCache>
+bool read_cifar_batches(Cache& input_cache, LCache& label_cache, const std::vector<std::string>& paths) {
+    static constexpr size_t size   = 3 * 32 * 32; ///< The size of an image
+    static constexpr size_t record = 1 + size;    ///< The size of a record
+
+    const size_t n = etl::dim<0>(input_cache);
+
+    if (etl::size(input_cache) != n * size) {
+        return false;
+    }
+
+    input_cache.ensure_cpu_up_to_date();
+    label_cache.ensure_cpu_up_to_date();
+
+    auto* dst = input_cache.memory_start();
+
+    size_t i = 0;
+
+    for (auto& path : paths) {
+        if (i == n) {
+            break;
+        }
+
+        file f(path);
+
+        if (!f.data) {
+            return false;
+        }
+
+        const size_t m     = std::min(n - i, f.length / record);
+        const uint8_t* src = f.data;
+        const size_t base  = i;
+
+        for_each_chunk(m, [src, dst, base](size_t first, size_t last) {
+            for (size_t j = first; j < last; ++j) {
+                std::copy_n(src + j * record + 1, size, dst + (base + j) * size);
+            }
+        });
+
+        for (size_t j = 0; j < m; ++j) {
+            store_label(label_cache, base + j, src[j * record]);
+        }
+
+        i += m;
+    }
+
+    input_cache.invalidate_gpu();
+    label_cache.invalidate_gpu();
+
+    return i == n;
+}
+
+} // end of namespace mapped
+
+} //end of dll namespace
@@ -9,6 +9,9 @@
 
 #include "mnist/mnist_reader.hpp"
 
+#include "dll/datasets/cache.hpp"
+#include "dll/datasets/mapped.hpp"
+
 namespace dll {
 
 using mnist_example_t = etl::fast_dyn_matrix<float, 1, 28, 28>;
@@ -28,25 +31,34 @@ auto make_mnist_generator_train_impl(const std::string& folder, size_t start, si
     float label;
 
     size_t n = 60000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    // Reuse the preprocessed data of a previous run, if any
+    cache::key key;
+    key.add_preprocessing<typename std::decay_t<decltype(*generator)>::desc>();
+    key.add_value(start);
+    key.add_value(n);
+
+    const auto cache_file = cache::file("mnist-train", {folder + "/train-images-idx3-ubyte", folder + "/train-labels-idx1-ubyte"}, key);
+
+    if(cache::load(*generator, cache_file)){
+        return generator;
+    }
+
+    // Read all the necessary images directly into the cache
+    if(!mapped::read_idx_images(generator->input_cache, folder + "/train-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
 
-    // Read all the labels (categorical)
-    generator->label_cache = 0;
-    if(!mnist::read_mnist_label_file_categorical(generator->label_cache, folder + "/train-labels-idx1-ubyte", m, start)){
+    // Read all the labels directly into the cache
+    if(!mapped::read_idx_labels(generator->label_cache, folder + "/train-labels-idx1-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST training labels" << std::endl;
         return generator;
     }
@@ -54,6 +66,8 @@ auto make_mnist_generator_train_impl(const std::string& folder, size_t start, si
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
+    cache::store(*generator, cache_file);
+
     return generator;
 }
 
@@ -71,25 +85,34 @@ auto make_mnist_generator_test_impl(const std::string& folder, size_t start, siz
     float label;
 
     size_t n = 10000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    // Reuse the preprocessed data of a previous run, if any
+    cache::key key;
+    key.add_preprocessing<typename std::decay_t<decltype(*generator)>::desc>();
+    key.add_value(start);
+    key.add_value(n);
+
+    const auto cache_file = cache::file("mnist-test", {folder + "/t10k-images-idx3-ubyte", folder + "/t10k-labels-idx1-ubyte"}, key);
+
+    if(cache::load(*generator, cache_file)){
+        return generator;
+    }
+
+    // Read all the necessary images directly into the cache
+    if(!mapped::read_idx_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
 
-    // Read all the labels (categorical)
-    generator->label_cache = 0;
-    if(!mnist::read_mnist_label_file_categorical(generator->label_cache, folder + "/t10k-labels-idx1-ubyte", m, start)){
+    // Read all the labels directly into the cache
+    if(!mapped::read_idx_labels(generator->label_cache, folder + "/t10k-labels-idx1-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST test labels" << std::endl;
         return generator;
     }
@@ -97,6 +120,8 @@ auto make_mnist_generator_test_impl(const std::string& folder, size_t start, siz
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
+    cache::store(*generator, cache_file);
+
     return generator;
 }
 
@@ -9,6 +9,9 @@
 
 #include "mnist/mnist_reader.hpp"
 
+#include "dll/datasets/cache.hpp"
+#include "dll/datasets/mapped.hpp"
+
 namespace dll {
 
 /*!
@@ -24,27 +27,44 @@ auto make_mnist_ae_generator_train(const std::string& folder, size_t start, size
     etl::fast_dyn_matrix<float, 1, 28, 28> input;
 
     size_t n = 60000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    // The labels are the images themselves, when they are not augmented
+    const bool aliased = generator->alias_labels();
+
+    // Reuse the preprocessed data of a previous run, if any
+    cache::key key;
+    key.add_preprocessing<typename std::decay_t<decltype(*generator)>::desc>();
+    key.add_value(start);
+    key.add_value(n);
+
+    const auto cache_file = cache::file("mnist-ae-train", {folder + "/train-images-idx3-ubyte"}, key);
+
+    if(cache::load(*generator, cache_file)){
+        return generator;
+    }
+
+    // Read all the necessary images directly into the cache
+    if(!mapped::read_idx_images(generator->input_cache, folder + "/train-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
 
-    generator->label_cache = generator->input_cache;
+    if (!aliased) {
+        generator->label_cache = generator->input_cache;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
+    cache::store(*generator, cache_file);
+
     return generator;
 }
 
@@ -61,27 +81,44 @@ auto make_mnist_ae_generator_test(const std::string& folder, size_t start, size_
     etl::fast_dyn_matrix<float, 1, 28, 28> input;
 
     size_t n = 10000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    // The labels are the images themselves, when they are not augmented
+    const bool aliased = generator->alias_labels();
+
+    // Reuse the preprocessed data of a previous run, if any
+    cache::key key;
+    key.add_preprocessing<typename std::decay_t<decltype(*generator)>::desc>();
+    key.add_value(start);
+    key.add_value(n);
+
+    const auto cache_file = cache::file("mnist-ae-test", {folder + "/t10k-images-idx3-ubyte"}, key);
+
+    if(cache::load(*generator, cache_file)){
+        return generator;
+    }
+
+    // Read all the necessary images directly into the cache
+    if(!mapped::read_idx_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
 
-    generator->label_cache = generator->input_cache;
+    if (!aliased) {
+        generator->label_cache = generator->input_cache;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
+    cache::store(*generator, cache_file);
+
     return generator;
 }
 
@@ -13,3 +13,8 @@
 #include "dll/dbn_layers.hpp"
 #include "dll/dbn_impl.hpp"
 #include "dll/dbn_desc.hpp"
+
+// Use the precompiled instantiations of the common layers (libdll_instances)
+#ifdef DLL_EXTERN_TEMPLATES
+#include "dll/extern_templates.hpp"
+#endif
@@ -22,14 +22,42 @@
 #include "generators.hpp"
 #include "unit_type.hpp"
 #include "trainer/dbn_trainer.hpp"
+#include "trainer/multi_trainer.hpp"
+#include "trainer/cross_validation.hpp"
+#include "trainer/online_trainer.hpp"
+#include "trainer/replicated_trainer.hpp"
 #include "trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
 #include "dbn_common.hpp"
 #include "svm_common.hpp"
+#include "util/arena.hpp"
+#include "util/distributed.hpp"
 #include "util/export.hpp"
 #include "util/timers.hpp"
+#include "util/trace.hpp"
 #include "util/random.hpp"
 #include "util/ready.hpp"
+#include "util/fold.hpp"
+#include "util/frozen.hpp"
+#include "util/fusion.hpp"
+#include "util/in_place.hpp"
+#include "util/batching.hpp"
+#include "util/cascade.hpp"
+#include "util/checkpoint.hpp"
+#include "util/classification.hpp"
+#include "util/converter.hpp"
+#include "util/ensemble.hpp"
+#include "util/inference.hpp"
+#include "util/inference_plan.hpp"
+#include "util/memory_report.hpp"
+#include "util/pretrain_pipeline.hpp"
+#include "util/quantize.hpp"
+#include "util/sliding_window.hpp"
+#include "util/scheduler.hpp"
+#include "util/sparse.hpp"
+#include "util/throughput_tuner.hpp"
+#include "util/topk.hpp"
+#include "util/wavefront.hpp"
 #include "dbn_detail.hpp" // dbn_detail namespace
 
 namespace dll {
@@ -84,14 +112,17 @@ struct dbn final {
 
     using layers_t = typename desc::layers; ///< The layers container type
 
-    static_assert(!(dbn_traits<this_type>::batch_mode() && layers_t::has_shuffle_layer),
-        "batch_mode dbn does not support shuffle in layers");
     static_assert(!dbn_traits<this_type>::shuffle_pretrain() || dbn_traits<this_type>::batch_mode(),
         "shuffle_pre is only compatible with batch mode, for normal mode, use shuffle in layers");
+    static_assert(!dbn_traits<this_type>::pretrain_cache() || dbn_traits<this_type>::batch_mode(),
+        "pretrain_cache is only compatible with batch mode");
 
     template <size_t N>
     using layer_type = detail::layer_type_t<N, layers_t>; ///< The type of the layer at index Nth
 
+    template <size_t N>
+    using layer_type_or_void = typename std::conditional_t<(N < layers_t::size), detail::layer_type<N, layers_t>, std::common_type<void>>::type; ///< The type of the layer at index Nth, void past the last layer
+
     // The weight is is extracted from the first layer, since all layers have the same type
     using weight = typename dbn_detail::extract_weight_t<0, this_type>::type; ///< The type of the weights
 
@@ -138,11 +169,17 @@ public:
     static constexpr auto updater          = desc::Updater;      ///< The Updater type
     static constexpr auto early            = desc::Early;        ///< The Early Stopping stragy
 
+    static constexpr size_t forward_many_tile = batch_size > 1 ? batch_size : 64; ///< The number of samples forwarded at once by the *_forward_many functions
+
     layers_t tuples; ///< The layers
 
     weight learning_rate       = 0.1; ///< The learning rate for finetuning
     weight learning_rate_decay = 0.0; ///< The learning rate decay
 
+    size_t accumulation_steps = desc::AccumulationSteps; ///< The number of mini-batches over which the gradients are accumulated
+
+    std::shared_ptr<communicator> comm; ///< The communicator for distributed training (none by default)
+
     weight initial_momentum     = 0.9; ///< The initial momentum
     weight final_momentum       = 0.9; ///< The final momentum applied after *final_momentum_epoch* epoch
     weight final_momentum_epoch = 6;   ///< The epoch at which momentum change
@@ -156,21 +193,62 @@ public:
     weight adam_beta1           = 0.9;   ///< Adam's beta1 factor
     weight adam_beta2           = 0.999; ///< Adam's beta1 factor
     weight nadam_schedule_decay = 0.004; ///< NAdam's schedule decay
+    weight lars_trust           = 0.02;  ///< LARS's trust coefficient
 
     weight gradient_clip = 5.0; ///< The gradient clipping
 
+    size_t lbfgs_history     = 10; ///< The number of curvature pairs kept by L-BFGS
+    size_t lbfgs_iterations  = 5;  ///< The number of L-BFGS iterations on each batch
+    size_t lbfgs_evaluations = 10; ///< The maximum number of evaluations of the L-BFGS line search
+
+    weight loss_scale        = 0.0;  ///< The current dynamic loss scale of fine-tuning (0 to disable loss scaling)
+    size_t loss_scale_window = 1000; ///< The number of finite steps after which the loss scale is doubled
+
     weight goal     = 0.0; ///< The learning goal
     size_t patience = 1;   ///< The patience for early stopping goals
 
+    size_t validation_budget   = 0;     ///< The number of validation samples evaluated at each epoch (0 for all of them)
+    bool stratified_validation = false; ///< Indicates if the validation subset is stratified by class
+
+    bool parallel_evaluation = true; ///< Indicates if the batches are evaluated concurrently on the thread pool
+    bool pipelined_training  = true; ///< Indicates if the next batch is prepared while the current one is trained
+
+    bool cache_frozen_features = true; ///< Indicates if the outputs of the frozen prefix are computed once for the training set
+    std::string frozen_cache_file;     ///< The binary dataset file holding the cached outputs of the frozen prefix (in memory if empty)
+
+    bool pipelined_pretraining     = false; ///< Indicates if the consecutive RBMs are pretrained concurrently, in a pipeline
+    size_t pipeline_warmup_epochs  = 2;     ///< The number of epochs of a RBM before the next one starts (pipelined pretraining)
+    size_t pipeline_refresh_epochs = 1;     ///< The number of epochs between two refreshes of the inputs of a RBM (pipelined pretraining)
+
+    bool importance_sampling    = false; ///< Indicates if the training samples are drawn from their last losses (importance sampling)
+    double importance_smoothing = 0.1;   ///< The part of the uniform distribution in the importance sampling probabilities
+
+    weight distill_temperature = 4.0;   ///< The temperature of the soft targets of the teacher (distillation)
+    weight distill_weight      = 0.5;   ///< The weight of the soft targets in the errors, the hard labels having the rest (distillation)
+    bool cache_teacher_outputs = true;  ///< Indicates if the soft targets of the teacher are computed once for the training set (distillation)
+
+    bool background_backup = true; ///< Indicates if the best weights of early stopping are saved in the background (SGD only)
+
+    std::string checkpoint_prefix; ///< The prefix of the checkpoints written during fine-tuning (none if empty)
+    size_t checkpoint_epochs  = 0; ///< The number of epochs between two checkpoints (0 for none)
+    size_t checkpoint_batches = 0; ///< The number of batches between two checkpoints (0 for none)
+    size_t checkpoint_keep    = 0; ///< The number of checkpoints to keep (0 for all)
+
 #ifdef DLL_SVM_SUPPORT
     //TODO Ideally these fields should be private
     svm::model svm_model;    ///< The learned model
     svm::problem problem;    ///< libsvm is stupid, therefore, you cannot destroy the problem if you want to use the model...
     bool svm_loaded = false; ///< Indicates if a SVM model has been loaded (and therefore must be saved)
-#endif                       //DLL_SVM_SUPPORT
+
+    linear_svm<weight> linear_model; ///< The learned linear model (see linear_svm_train)
+#endif                               //DLL_SVM_SUPPORT
 
     mutable output_policy_t out; ///< The output policy instance
 
+    std::unique_ptr<task_group> backup_tasks; ///< The tasks of the background backup of the weights (none if done)
+
+    using view_generator_t = view_data_generator_desc<dll::batch_size<batch_size>, dll::categorical>;
+
     using categorical_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
         inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
@@ -178,13 +256,13 @@ public:
 
     using ae_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     using reg_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     template<size_t B>
     using rbm_generator_fast_t = std::conditional_t<
@@ -204,20 +282,20 @@ public:
     template<size_t B>
     using rbm_denoising_generator_fast_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     template<size_t B>
-    using rbm_denoising_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>;
+    using rbm_denoising_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>>;
 
     template<size_t B>
     using rbm_denoising_generator_fast_inner_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>,
-        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>>;
+        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>>,
+        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>, dll::noise_model<desc::NoiseModel>>>;
 
 private:
-    cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool;
+    std::conditional_t<dbn_traits<this_type>::is_serial(), cpp::thread_pool<false>, task_group> pool; ///< The tasks of the network
 
     template<size_t I, cpp_disable_iff(I == layers)>
     void dyn_init(){
@@ -233,6 +311,24 @@ private:
     template<size_t I, cpp_enable_iff(I == layers)>
     void dyn_init(){}
 
+    /*!
+     * \brief Tie the tied layers to the layers whose weights they use
+     */
+    template <size_t I = 0>
+    void tie_layers() {
+        if constexpr (I < layers) {
+            if constexpr (is_tied_layer<layer_type<I>>) {
+                constexpr size_t T = layer_type<I>::tied_layer;
+
+                static_assert(T < I, "A tied layer must follow the layer it is tied to");
+
+                layer_get<I>().tie(layer_get<T>());
+            }
+
+            tie_layers<I + 1>();
+        }
+    }
+
     template<size_t L = rbm_layer_n>
     auto get_rbm_generator_desc(){
         static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_desc");
@@ -288,7 +384,7 @@ private:
     }
 
     template<typename Generator>
-    void validate_generator(const Generator& generator){
+    void validate_generator(const Generator& generator) const {
         static_assert(batch_size == Generator::batch_size, "Invalid batch size for generator");
 
         cpp_unused(generator);
@@ -307,6 +403,8 @@ public:
             this->template dyn_init<0>();
         }
 
+        this->template tie_layers<0>();
+
         // Update defaults for each updater type
 
         if(updater == updater_type::RMSPROP){
@@ -328,6 +426,10 @@ public:
         if(updater == updater_type::NADAM){
             learning_rate = 0.002;
         }
+
+        if(updater == updater_type::LAMB){
+            learning_rate = 0.01;
+        }
     }
 
     //No copying
@@ -338,6 +440,26 @@ public:
     dbn(dbn&& dbn) = delete;
     dbn& operator=(dbn&& dbn) = delete;
 
+    /*!
+     * \brief Returns the predicted memory of the SGD training of the
+     * network, with its batch size and its updater.
+     *
+     * This can be called before training, to choose a batch size that fits
+     * in memory. The sgd_trainer reports the memory of the allocated
+     * contexts during training.
+     */
+    memory_usage memory_report() const {
+        return predict_memory(*this, batch_size, updater);
+    }
+
+    /*!
+     * \brief Returns the predicted memory of the SGD training of the
+     * network, with the given batch size and updater
+     */
+    memory_usage memory_report(size_t batch, updater_type ut) const {
+        return predict_memory(*this, batch, ut);
+    }
+
     /*!
      * \brief Prints a textual representation of the network.
      */
@@ -503,11 +625,48 @@ public:
      * twice will erase the first saved weights.
      */
     void backup_weights() {
+        wait_backup();
+
         for_each_layer([](auto& layer) {
             layer.backup_weights();
         });
     }
 
+    /*!
+     * \brief Start to backup the weights of all the layers in the
+     * background, one task per layer on the scheduler.
+     *
+     * The weights can be read, but must not be modified, until
+     * wait_backup() returns. The other functions of the backup wait for
+     * it.
+     */
+    void start_backup_weights() {
+        wait_backup();
+
+        backup_tasks = std::make_unique<task_group>();
+
+        for_each_layer([this](auto& layer) {
+            backup_tasks->do_task([&layer] {
+                // ETL must not parallelize inside the workers
+                SERIAL_SECTION {
+                    layer.backup_weights();
+                }
+            });
+        });
+    }
+
+    /*!
+     * \brief Wait for the backup started by start_backup_weights(), if any
+     */
+    void wait_backup() {
+        if (backup_tasks) {
+            static dll::timer_id timer_handle("net:wait_backup");
+            dll::auto_timer timer(timer_handle);
+
+            backup_tasks.reset();
+        }
+    }
+
     /*!
      * \brief Restore the weights previously saved.
      *
@@ -515,11 +674,132 @@ public:
      * Calling this function twice will restore the same weights.
      */
     void restore_weights() {
+        wait_backup();
+
         for_each_layer([](auto& layer) {
             layer.restore_weights();
         });
     }
 
+    /*!
+     * \brief Release the weights saved by backup_weights() in all the
+     * layers, once the network is not trained anymore.
+     */
+    void release_backup() {
+        wait_backup();
+
+        for_each_layer([](auto& layer) {
+            layer.release_backup();
+        });
+    }
+
+    /*!
+     * \brief Fold the batch normalization layers into the weights and biases
+     * of their preceding layers, for faster inference.
+     *
+     * Only the normalizations following a dense or convolutional layer
+     * with biases and without activation function can be folded. A folded
+     * normalization layer simply forwards its input.
+     *
+     * This is only valid for inference: the network must not be trained
+     * after this. It should be applied on a copy of the network, for
+     * instance loaded from the stored weights. A folded network can be
+     * stored, its folded normalizations being stored as the identity.
+     *
+     * \return The number of folded normalization layers
+     */
+    size_t fold_batch_normalization() {
+        size_t n = 0;
+
+        for_each_layer_pair([&n](auto& l1, auto& l2) {
+            if constexpr (is_foldable_normalization<decltype(l2)>) {
+                if (l2.fold_into(l1)) {
+                    ++n;
+                }
+            }
+        });
+
+        return n;
+    }
+
+    /*!
+     * \brief Quantize the dense and convolutional layers to INT8, for faster
+     * inference.
+     *
+     * The scales of the inputs of each layer are calibrated on the samples
+     * of the given generator. Once quantized, the test forward passes of
+     * these layers (and therefore features, predict and evaluate) use INT8
+     * weights and activations with 32 bits accumulation.
+     *
+     * The quantization must be done again each time the weights are
+     * changed, for instance after training or loading the network.
+     *
+     * \param generator The generator of calibration samples
+     *
+     * \return The number of quantized layers
+     */
+    template <typename Generator>
+    size_t quantize(Generator& generator) {
+        clear_quantization();
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            calibrate_quantization<0>(generator.data_batch());
+
+            generator.next_batch();
+        }
+
+        size_t n = 0;
+
+        for_each_layer([&n](auto& layer) {
+            if constexpr (is_quantizable<decltype(layer)>) {
+                if (layer.quantize()) {
+                    ++n;
+                }
+            }
+        });
+
+        return n;
+    }
+
+    /*!
+     * \brief Prune the weights of smallest magnitude of all the dense
+     * layers.
+     *
+     * The pruned weights are kept to zero during further training (for
+     * fine-tuning) and the inference of the pruned layers uses sparse
+     * products.
+     *
+     * \param sparsity The fraction of the weights to prune in each layer, in [0, 1]
+     *
+     * \return The number of pruned layers
+     */
+    size_t prune(double sparsity) {
+        size_t n = 0;
+
+        for_each_layer([&n, sparsity](auto& layer) {
+            if constexpr (is_prunable<decltype(layer)>) {
+                layer.prune(sparsity);
+                ++n;
+            }
+        });
+
+        return n;
+    }
+
+    /*!
+     * \brief Go back to floating point inference in all the layers
+     */
+    void clear_quantization() {
+        for_each_layer([](auto& layer) {
+            if constexpr (is_quantizable<decltype(layer)>) {
+                layer.clear_quantization();
+            }
+        });
+    }
+
     /*!
      * \brief Store the network weights to the given file.
      * \param file The path to the file
@@ -570,6 +850,74 @@ public:
 #endif //DLL_SVM_SUPPORT
     }
 
+    /*!
+     * \brief Store a checkpoint of the network weights to the given file.
+     *
+     * The checkpoint has a header, a table of the tensors and the tensors,
+     * aligned on 64 bytes. It can be mapped in memory (checkpoint_file).
+     *
+     * \param file The path to the file
+     * \param precision The precision of the stored weights
+     */
+    void store_checkpoint(const std::string& file, checkpoint_precision precision = checkpoint_precision::NATIVE) const {
+        dll::store_checkpoint(*this, file, precision);
+    }
+
+    /*!
+     * \brief Load the network weights from the given checkpoint file.
+     * \param file The path to the file
+     * \param verify Indicates if the checksum of the checkpoint is verified
+     * \return true if the checkpoint was loaded, false otherwise
+     */
+    bool load_checkpoint(const std::string& file, bool verify = true) {
+        return dll::load_checkpoint(*this, file, verify);
+    }
+
+    /*!
+     * \brief Create a network whose weights are not initialized, to be
+     * loaded right after.
+     */
+    static std::unique_ptr<this_type> make_uninitialized() {
+        uninitialized_scope scope;
+        return std::make_unique<this_type>();
+    }
+
+    /*!
+     * \brief Create a network with the weights of the given file (stored
+     * with store()), without initializing them first.
+     * \param file The path to the file
+     * \return The network, or nullptr if the file cannot be read
+     */
+    static std::unique_ptr<this_type> from_file(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+
+        if (!is) {
+            std::cerr << "ERROR: Impossible to read " << file << std::endl;
+            return nullptr;
+        }
+
+        auto network = make_uninitialized();
+        network->load(is);
+        return network;
+    }
+
+    /*!
+     * \brief Create a network with the weights of the given checkpoint
+     * (stored with store_checkpoint()), without initializing them first.
+     * \param file The path to the checkpoint
+     * \param verify Indicates if the checksum of the checkpoint is verified
+     * \return The network, or nullptr if the checkpoint cannot be loaded
+     */
+    static std::unique_ptr<this_type> from_checkpoint(const std::string& file, bool verify = true) {
+        auto network = make_uninitialized();
+
+        if (!network->load_checkpoint(file, verify)) {
+            return nullptr;
+        }
+
+        return network;
+    }
+
     /*!
      * \brief Returns the Nth layer.
      * \return The Nth layer
@@ -656,7 +1004,8 @@ public:
 
         validate_pretraining();
 
-        dll::auto_timer timer("net:pretrain");
+        static dll::timer_id timer_handle("net:pretrain");
+        dll::auto_timer timer(timer_handle);
 
         watcher_t watcher;
 
@@ -666,10 +1015,6 @@ public:
         if constexpr (batch_mode()) {
             out << "DBN: Pretraining done in batch mode" << std::endl;
 
-            if (layers_t::has_shuffle_layer) {
-                out << "warning: batch_mode dbn does not support shuffle in layers (will be ignored)";
-            }
-
             pretrain_layer_batch<0>(generator, watcher, max_epochs);
         } else {
             pretrain_layer<0>(generator, watcher, max_epochs);
@@ -738,7 +1083,8 @@ public:
 
         validate_pretraining();
 
-        dll::auto_timer timer("net:pretrain:denoising");
+        static dll::timer_id timer_handle("net:pretrain:denoising");
+        dll::auto_timer timer(timer_handle);
 
         watcher_t watcher;
 
@@ -748,10 +1094,6 @@ public:
         if constexpr (batch_mode()) {
             out << "DBN: Denoising Pretraining done in batch mode" << std::endl;
 
-            if (layers_t::has_shuffle_layer) {
-                out << "warning: batch_mode dbn does not support shuffle in layers (will be ignored)";
-            }
-
             pretrain_layer_denoising_batch<0>(generator, watcher, max_epochs);
         } else {
             out << "DBN: Denoising Pretraining" << std::endl;
@@ -832,7 +1174,8 @@ public:
     void train_with_labels(Iterator&& first, Iterator&& last, LabelIterator&& lfirst, LabelIterator&& llast, size_t labels, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
 
-        dll::auto_timer timer("net:train:labels");
+        static dll::timer_id timer_handle("net:train:labels");
+        dll::auto_timer timer(timer_handle);
 
         cpp_assert(std::distance(first, last) == std::distance(lfirst, llast), "There must be the same number of values than labels");
         cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
@@ -871,6 +1214,136 @@ public:
             std::max_element(std::prev(output_a.end(), labels), output_a.end()));
     }
 
+    /*!
+     * \brief Predict the label of each of the given samples, with the label
+     * units of the last RBM (only when pretrained with labels).
+     *
+     * The samples are classified by batches of batch_size, the up-pass and
+     * the Gibbs step of the last RBM being computed with batch GEMMs. The
+     * batches are spread over the thread pool.
+     *
+     * \param samples The samples (an ETL batch or a container of samples)
+     * \param labels The number of labels
+     * \return The label of each sample
+     */
+    template <typename Samples, cpp_enable_iff(!is_generator<Samples>)>
+    std::vector<size_t> predict_labels_batch(const Samples& samples, size_t labels) {
+        static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+
+        static dll::timer_id timer_handle("net:predict_labels:batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
+
+        size_t n;
+
+        if constexpr (etl::is_etl_expr<Samples>) {
+            n = etl::dim<0>(samples);
+        } else {
+            n = std::size(samples);
+        }
+
+        std::vector<size_t> predicted(n);
+
+        const size_t tiles = (n + batch_size - 1) / batch_size;
+
+        size_t workers = 1;
+
+        if constexpr (!dbn_traits<this_type>::is_serial()) {
+            workers = std::max<size_t>(1, std::min(etl::threads, tiles));
+        }
+
+        auto predict_worker = [this, &samples, &predicted, labels, workers, tiles, n](size_t w) {
+            labels_workspace ws(*this, labels);
+
+            for (size_t t = w; t < tiles; t += workers) {
+                const size_t first = t * batch_size;
+                const size_t count = std::min(batch_size, n - first);
+
+                // The samples after count are left from the previous tiles and ignored
+                for (size_t i = 0; i < count; ++i) {
+                    if constexpr (etl::is_etl_expr<Samples>) {
+                        ws.input(i) = samples(first + i);
+                    } else {
+                        ws.input(i) = *std::next(std::begin(samples), first + i);
+                    }
+                }
+
+                predict_labels_batch<0>(ws.input, ws, labels);
+
+                ws.argmax(predicted.data() + first, count, labels);
+            }
+        };
+
+        if (workers == 1) {
+            predict_worker(0);
+        } else {
+            for (size_t w = 0; w < workers; ++w) {
+                pool.do_task([&predict_worker, w] {
+                    trace_scope scope("pool:task", "pool");
+
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        predict_worker(w);
+                    }
+                });
+            }
+
+            pool.wait();
+        }
+
+        return predicted;
+    }
+
+    /*!
+     * \brief Predict the label of each sample of the given generator, with
+     * the label units of the last RBM (only when pretrained with labels).
+     *
+     * \param generator The data generator, of batch_size samples per batch
+     * \param labels The number of labels
+     * \return The label of each sample
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    std::vector<size_t> predict_labels_batch(Generator& generator, size_t labels) {
+        static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+
+        static dll::timer_id timer_handle("net:predict_labels:batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
+
+        validate_generator(generator);
+
+        generator.reset();
+        generator.set_test();
+
+        std::vector<size_t> predicted;
+        predicted.reserve(generator.size());
+
+        labels_workspace ws(*this, labels);
+
+        while (generator.has_next_batch()) {
+            auto input_batch = generator.data_batch();
+
+            const size_t count = etl::dim<0>(input_batch);
+
+            cpp_assert(count <= batch_size, "The batches of the generator must not be larger than the batches of the network");
+
+            for (size_t i = 0; i < count; ++i) {
+                ws.input(i) = input_batch(i);
+            }
+
+            predict_labels_batch<0>(ws.input, ws, labels);
+
+            predicted.resize(predicted.size() + count);
+            ws.argmax(predicted.data() + predicted.size() - count, count, labels);
+
+            generator.next_batch();
+        }
+
+        return predicted;
+    }
+
     //Note: features_sub are alias functions for forward_one
 
     /*!
@@ -921,63 +1394,270 @@ public:
 
     // Forward one batch at a time
 
-    // Forward functions are not perfect:
-    // TODO: Transform layers should be applied inline
-
     /*
      * \brief Return the test representation for the given input batch.
      *
+     * When the input batch is an intermediate result owned by the network,
+     * the layers that can be applied in place are applied directly on it,
+     * without allocating their output.
+     *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
+     * \tparam Owned Indicates if the input batch is owned by the network
      *
      * \param sample The input batch to the layer L
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input>
+    template <size_t LS, size_t L, bool Owned = false, typename Input>
     decltype(auto) test_forward_batch_impl(Input&& sample) const {
-        if constexpr (L != LS) {
+        if constexpr (L + 1 <= LS && is_fusable_activation<layer_type<L>, layer_type_or_void<L + 1>>) {
+            return test_forward_batch_fused<LS, L, L + 1>(sample);
+        } else if constexpr (L + 2 <= LS && is_fusable_normalization_activation<layer_type<L>, layer_type_or_void<L + 1>, layer_type_or_void<L + 2>>) {
+            return test_forward_batch_fused<LS, L, L + 2>(sample);
+        } else if constexpr (L + 1 <= LS && is_wavefront_pair<layer_type<L>, layer_type_or_void<L + 1>>) {
+            return test_forward_batch_wavefront<LS, L, wavefront_end<L, LS>()>(sample);
+        } else if constexpr (L + 1 <= LS && is_last_step_pair<layer_type<L>, layer_type_or_void<L + 1>>) {
+            return test_forward_batch_last<LS, L>(sample);
+        } else if constexpr (L + 1 <= LS && is_subpixel_pair<layer_type<L>, layer_type_or_void<L + 1>>) {
+            return test_forward_batch_subpixel<LS, L>(sample);
+        } else if constexpr (Owned && is_in_place<false, layer_type<L>, Input>) {
+            forward_batch_in_place<false>(layer_get<L>(), sample);
+
+            if constexpr (L != LS) {
+                return test_forward_batch_impl<LS, L + 1, true>(sample);
+            } else {
+                return std::decay_t<Input>(std::move(sample));
+            }
+        } else if constexpr (L != LS) {
             decltype(auto) next = layer_get<L>().test_forward_batch(sample);
-            return test_forward_batch_impl<LS, L + 1>(next);
+            return test_forward_batch_impl<LS, L + 1, true>(next);
         } else {
             return layer_get<L>().test_forward_batch(sample);
         }
     }
 
     /*
-     * \brief Return the train representation for the given input batch.
+     * \brief Return the test representation for the given input batch, with
+     * the layers from L to A fused.
+     *
+     * The layer L directly applies the activation function of the layer A.
+     * A batch normalization between them is skipped if it has been folded
+     * into the layer L, otherwise the layers are executed one by one.
      *
      * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
+     * \tparam L The fusion head, to which the input is given
+     * \tparam A The activation layer fused into the head
      *
      * \param sample The input batch to the layer L
      *
-     * \return The train representation of the LS layer forwarded from L
+     * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input>
-    decltype(auto) train_forward_batch_impl(Input&& sample) {
-        if constexpr (L != LS) {
-            decltype(auto) next = layer_get<L>().train_forward_batch(sample);
-            return train_forward_batch_impl<LS, L + 1>(next);
+    template <size_t LS, size_t L, size_t A, typename Input>
+    decltype(auto) test_forward_batch_fused(const Input& sample) const {
+        decltype(auto) layer = layer_get<L>();
+
+        auto one    = prepare_one_ready_output(layer, sample(0));
+        auto output = batch_extend(sample, one);
+
+        if constexpr (A == L + 1) {
+            layer.template test_forward_batch<layer_type<A>::activation_function>(output, sample);
         } else {
-            return layer_get<L>().train_forward_batch(sample);
+            if (layer_get<L + 1>().folded) {
+                layer.template test_forward_batch<layer_type<A>::activation_function>(output, sample);
+            } else {
+                decltype(auto) next = layer_get<L + 1>().test_forward_batch(layer.test_forward_batch(sample));
+                layer_get<A>().test_forward_batch(output, next);
+            }
+        }
+
+        if constexpr (A == LS) {
+            return output;
+        } else {
+            return test_forward_batch_impl<LS, A + 1, true>(output);
         }
     }
 
     /*
-     * \brief Return the test representation for the given input batch.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
-     *
-     * \param sample The input batch to the layer L
-     *
-     * \return The test representation of the LS layer forwarded from L
+     * \brief Return the last layer of the recurrent stack starting at the
+     * layer L, up to the layer LS.
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) test_forward_batch(Input&& sample) const {
-        return test_forward_batch_impl<LS, L>(sample);
-    }
+    template <size_t L, size_t LS>
+    static constexpr size_t wavefront_end() {
+        if constexpr (L < LS && is_wavefront_pair<layer_type<L>, layer_type_or_void<L + 1>>) {
+            return wavefront_end<L + 1, LS>();
+        } else {
+            return L;
+        }
+    }
+
+    /*
+     * \brief Return one empty output of the layer E, for the given input of
+     * the layer L.
+     */
+    template <size_t L, size_t E, typename One>
+    auto prepare_wavefront_output(const One& one) const {
+        auto next = prepare_one_ready_output(layer_get<L>(), one);
+
+        if constexpr (L == E) {
+            return next;
+        } else {
+            return prepare_wavefront_output<L + 1, E>(next);
+        }
+    }
+
+    /*
+     * \brief Return the test representation for the given input batch, with
+     * the recurrent stack from L to E forwarded together.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The first layer of the stack, to which the input is given
+     * \tparam E The last layer of the stack
+     *
+     * \param sample The input batch to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS, size_t L, size_t E, typename Input>
+    decltype(auto) test_forward_batch_wavefront(const Input& sample) const {
+        // A following recurrent_last_layer is computed with the stack
+        constexpr bool last = E < LS && is_recurrent_last<layer_type_or_void<E + 1>>;
+        constexpr size_t O  = last ? E + 1 : E;
+
+        auto one    = prepare_wavefront_output<L, O>(sample(0));
+        auto output = batch_extend(sample, one);
+
+        test_forward_wavefront<L, last>(output, sample, std::make_index_sequence<E - L + 1>());
+
+        if constexpr (O == LS) {
+            return output;
+        } else {
+            return test_forward_batch_impl<LS, O + 1, true>(output);
+        }
+    }
+
+    /*
+     * \brief Forward the given batch through the recurrent stack of the
+     * layers L + I...
+     *
+     * \tparam Last Indicates if only the last step of the stack is output
+     */
+    template <size_t L, bool Last, typename Output, typename Input, size_t... I>
+    void test_forward_wavefront(Output& output, const Input& sample, std::index_sequence<I...> /*seq*/) const {
+        if constexpr (Last) {
+            rnn_wavefront_forward_last(output, sample, layer_get<L + I>()...);
+        } else {
+            rnn_wavefront_forward(output, sample, layer_get<L + I>()...);
+        }
+    }
+
+    /*
+     * \brief Return the test representation for the given input batch, with
+     * the recurrent layer L only computing the last time step needed by the
+     * recurrent_last_layer L + 1.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The recurrent layer, to which the input is given
+     *
+     * \param sample The input batch to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS, size_t L, typename Input>
+    decltype(auto) test_forward_batch_last(const Input& sample) const {
+        auto one    = prepare_wavefront_output<L, L + 1>(sample(0));
+        auto output = batch_extend(sample, one);
+
+        layer_get<L>().forward_last_batch(output, sample);
+
+        if constexpr (L + 1 == LS) {
+            return output;
+        } else {
+            return test_forward_batch_impl<LS, L + 2, true>(output);
+        }
+    }
+
+    /*
+     * \brief Return the test representation for the given input batch, with
+     * the upsampling layer L fused into the same convolution L + 1.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The upsampling layer, to which the input is given
+     *
+     * \param sample The input batch to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS, size_t L, typename Input>
+    decltype(auto) test_forward_batch_subpixel(const Input& sample) const {
+        auto one    = prepare_wavefront_output<L, L + 1>(sample(0));
+        auto output = batch_extend(sample, one);
+
+        layer_get<L + 1>().template upsampled_forward_batch<layer_type<L>::C2, layer_type<L>::C3>(output, sample);
+
+        if constexpr (L + 1 == LS) {
+            return output;
+        } else {
+            return test_forward_batch_impl<LS, L + 2, true>(output);
+        }
+    }
+
+    /*
+     * \brief Update the quantization calibration of the layers from L with
+     * the given input batch.
+     *
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input batch to the layer L
+     */
+    template <size_t L, typename Input>
+    void calibrate_quantization(const Input& sample) {
+        decltype(auto) layer = layer_get<L>();
+
+        if constexpr (is_quantizable<decltype(layer)>) {
+            layer.calibrate_quantization(sample);
+        }
+
+        if constexpr (L + 1 < layers) {
+            decltype(auto) next = layer.test_forward_batch(sample);
+            calibrate_quantization<L + 1>(next);
+        }
+    }
+
+    /*
+     * \brief Return the train representation for the given input batch.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input batch to the layer L
+     *
+     * \return The train representation of the LS layer forwarded from L
+     */
+    template <size_t LS, size_t L, typename Input>
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        if constexpr (L != LS) {
+            decltype(auto) next = layer_get<L>().train_forward_batch(sample);
+            return train_forward_batch_impl<LS, L + 1>(next);
+        } else {
+            return layer_get<L>().train_forward_batch(sample);
+        }
+    }
+
+    /*
+     * \brief Return the test representation for the given input batch.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input batch to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Input>
+    decltype(auto) test_forward_batch(Input&& sample) const {
+        return test_forward_batch_impl<LS, L>(sample);
+    }
 
     /*
      * \brief Return the train representation for the given input batch.
@@ -1009,11 +1689,150 @@ public:
         return test_forward_batch_impl<LS, L>(sample);
     }
 
+    /*!
+     * \brief Compute the lazy inference caches of the layers, after which
+     * the test forward pass does not modify the network anymore.
+     */
+    void prepare_inference() const {
+        for_each_layer([](auto& layer) {
+            if constexpr (has_prepare_inference<decltype(layer)>) {
+                layer.prepare_inference();
+            }
+        });
+    }
+
+    /*!
+     * \brief Create a context for concurrent inference on this network.
+     *
+     * Each thread must use its own context.
+     *
+     * \tparam B The maximum number of samples of a batch
+     * \param sample A sample, only used for its dimensions
+     * \return The inference context
+     */
+    template <size_t B = batch_size, typename Sample>
+    auto make_inference_context(const Sample& sample) const {
+        return dll::inference_context<this_type, Sample, B>(*this, sample);
+    }
+
+    /*!
+     * \brief Create a trainer for the incremental training of this network
+     * from batches arriving over time.
+     *
+     * \param replay_capacity The number of last samples kept for replay (0 to disable replay)
+     * \param replayed The maximum number of replayed samples added to each batch
+     * \return The online trainer
+     */
+    auto make_online_trainer(size_t replay_capacity = 0, size_t replayed = 0) {
+        return std::make_unique<dll::online_trainer<this_type>>(*this, replay_capacity, replayed);
+    }
+
+    /*!
+     * \brief Create an inference plan for this network, with all the
+     * activations in a single preallocated arena.
+     *
+     * A plan must only be used by one thread at a time.
+     *
+     * \tparam B The maximum number of samples of a batch
+     * \param sample A sample, only used for its dimensions
+     * \return The inference plan
+     */
+    template <size_t B = batch_size, typename Sample>
+    auto make_inference_plan(const Sample& sample) const {
+        return std::make_unique<dll::inference_plan<this_type, Sample, B>>(*this, sample);
+    }
+
+    /*!
+     * \brief Create a cascade for early-exit inference on this network.
+     *
+     * A cascade must only be used by one thread at a time.
+     *
+     * \param exits The auxiliary classifiers, created with dll::exit_head,
+     * in increasing order of layers
+     *
+     * \return The cascade
+     */
+    template <typename... Exits>
+    auto make_cascade(Exits... exits) const {
+        return dll::cascade_inference<this_type, Exits...>(*this, exits...);
+    }
+
+    /*!
+     * \brief Return the test representation for the given input batch,
+     * computed in the given inference context or plan.
+     *
+     * This does not modify the network and can be called concurrently from
+     * several threads, each with its own context.
+     *
+     * \param context The inference context or plan of the current thread
+     * \param sample The input batch
+     *
+     * \return A reference to the output in the context
+     */
+    template <typename Context, typename Input>
+    auto& forward_batch(Context& context, const Input& sample) const {
+        cpp_assert(&context.dbn == this, "The context must be created from the same network");
+
+        return context.forward_batch(sample);
+    }
+
+    /*!
+     * \brief Forward the given image, larger than the input of the network,
+     * at each location, with the convolutions computed once over the full
+     * image.
+     *
+     * The network must be made of stride 1 convolutional layers (or CRBMs),
+     * optionally followed by a dense head.
+     *
+     * \param image The image (C x H x W)
+     *
+     * \return The output of the network at each location (O x N1 x N2), where
+     * (y, x) is the output of the patch whose top left corner is (y, x).
+     * Without dense head, the feature maps of the last layer over the image.
+     */
+    template <typename Image>
+    auto forward_sliding_window(const Image& image) const {
+        return dll::sliding_window_inference<this_type>::forward(*this, image);
+    }
+
+    /*!
+     * \brief Create an executor batching the single-sample inference
+     * requests on this network.
+     *
+     * \tparam B The maximum number of samples of a batch
+     * \param sample A sample, only used for its dimensions
+     * \param max_batch The maximum number of samples of a batch (at most B)
+     * \param deadline The maximum time waited by a request before its batch is forwarded
+     * \param workers The number of worker threads
+     *
+     * \return The executor, which must not outlive the network
+     */
+    template <size_t B = batch_size, typename Sample>
+    auto make_batching_executor(const Sample& sample, size_t max_batch = B,
+                                std::chrono::microseconds deadline = std::chrono::microseconds(2000), size_t workers = 1) const {
+        return std::make_unique<dll::batching_executor<this_type, Sample, B>>(*this, sample, max_batch, deadline, workers);
+    }
+
     // Forward one sample at a time
     // This is not as fast as it could be, far from it, but supports
     // larger range of input. The rationale being that time should
     // be spent in forward_batch
 
+    /*
+     * \brief Prepare the given sample to be the input of the layer L.
+     *
+     * The contiguous user containers given to the first layer are viewed in
+     * place, without copy (see converter.hpp).
+     */
+    template <size_t L, typename Input>
+    decltype(auto) one_input(const Input& sample) const {
+        if constexpr (L == input_layer_n) {
+            return make_input_view<input_one_t>(layer_get<L>(), sample);
+        } else {
+            return (sample);
+        }
+    }
+
     /*
      * \brief Return the test representation for the given input sample.
      *
@@ -1066,7 +1885,8 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) test_forward_one(Input&& sample) const {
-        return test_forward_one_impl<LS, L>(sample);
+        decltype(auto) input = one_input<L>(sample);
+        return test_forward_one_impl<LS, L>(input);
     }
 
     /*
@@ -1081,7 +1901,8 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) train_forward_one(Input&& sample) {
-        return train_forward_one_impl<LS, L>(sample);
+        decltype(auto) input = one_input<L>(sample);
+        return train_forward_one_impl<LS, L>(input);
     }
 
     /*
@@ -1096,13 +1917,88 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) forward_one(Input&& sample) const {
-        return test_forward_one_impl<LS, L>(sample);
+        decltype(auto) input = one_input<L>(sample);
+        return test_forward_one_impl<LS, L>(input);
     }
 
     // Forward a collection of samples at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
+    // The samples are forwarded by tiles of forward_many_tile samples
+    // through all the layers at once
+
+    /*
+     * \brief Return the representation for the given collection of inputs.
+     *
+     * The inputs are gathered into batches of forward_many_tile samples. Each batch
+     * is forwarded through the layers from L to LS with the batch functions
+     * and the batch of outputs is scattered into the returned collection.
+     *
+     * \tparam Train if true compute the train representation, otherwise the test representation
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param dbn The network
+     * \param first Iterator to the first element of the collection of inputs
+     * \param last Iterator to the past-the-end element of the collection of inputs
+     *
+     * \return The representation of the LS layer forwarded from L
+     */
+    template <bool Train, size_t LS, size_t L, typename DBN, typename Iterator>
+    static auto select_forward_many_tiles(DBN& dbn, Iterator first, Iterator last) {
+        using output_t = std::decay_t<decltype(dbn.template test_forward_one<LS, L>(*first))>;
+
+        const size_t n = std::distance(first, last);
+
+        std::vector<output_t> outputs;
+
+        if (!n) {
+            return outputs;
+        }
+
+        // The first output gives the dimensions of all the outputs
+        outputs.resize(n, dbn.template test_forward_one<LS, L>(*first));
+
+        size_t i = 0;
+
+        auto forward_tile = [&](auto& batch) {
+            const size_t b = etl::dim<0>(batch);
+
+            for (size_t j = 0; j < b; ++j, ++first) {
+                batch(j) = *first;
+            }
+
+            auto forward = [&dbn](auto& input) {
+                if constexpr (Train) {
+                    return dbn.template train_forward_batch<LS, L>(input);
+                } else {
+                    return dbn.template test_forward_batch<LS, L>(input);
+                }
+            };
+
+            auto output = forward(batch);
+
+            for (size_t j = 0; j < b; ++j) {
+                outputs[i + j] = output(j);
+            }
+
+            i += b;
+        };
+
+        if (n >= forward_many_tile) {
+            auto batch = batch_make<forward_many_tile>(*first);
+
+            while (i + forward_many_tile <= n) {
+                forward_tile(batch);
+            }
+        }
+
+        if (i < n) {
+            auto batch = batch_make(n - i, *first);
+
+            forward_tile(batch);
+        }
+
+        return outputs;
+    }
 
     /*
      * \brief Return the test representation for the given collection of inputs.
@@ -1116,17 +2012,7 @@ public:
      */
     template <size_t LS, size_t L, typename Inputs>
     decltype(auto) test_forward_many_impl(Inputs&& samples) const {
-        decltype(auto) layer = layer_get<L>();
-
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.test_forward_many(next, samples);
-
-        if constexpr (L != LS) {
-            return test_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+        return select_forward_many_tiles<false, LS, L>(*this, std::begin(samples), std::end(samples));
     }
 
     /*
@@ -1141,17 +2027,7 @@ public:
      */
     template <size_t LS, size_t L, typename Inputs>
     decltype(auto) train_forward_many_impl(Inputs&& samples) {
-        decltype(auto) layer = layer_get<L>();
-
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.train_forward_many(next, samples);
-
-        if constexpr (L != LS) {
-            return train_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+        return select_forward_many_tiles<true, LS, L>(*this, std::begin(samples), std::end(samples));
     }
 
     /*
@@ -1200,9 +2076,6 @@ public:
     }
 
     // Forward a collection of samples (iterators) at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
 
     /*
      * \brief Return the test representation for the given collection of inputs.
@@ -1217,20 +2090,7 @@ public:
      */
     template <size_t LS, size_t L, typename Iterator>
     decltype(auto) test_forward_many_impl(const Iterator& first, const Iterator& last) const {
-        decltype(auto) layer = layer_get<L>();
-
-        auto n    = std::distance(first, last);
-        auto next = prepare_many_ready_output(layer, *first, n);
-
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.test_forward_one(next[i], sample);
-        });
-
-        if constexpr (L != LS) {
-            return test_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+        return select_forward_many_tiles<false, LS, L>(*this, first, last);
     }
 
     /*
@@ -1246,21 +2106,7 @@ public:
      */
     template <size_t LS, size_t L, typename Iterator>
     decltype(auto) train_forward_many_impl(const Iterator& first, const Iterator& last) {
-        decltype(auto) layer = layer_get<L>();
-
-        auto n = std::distance(first, last);
-
-        auto next = prepare_many_ready_output(layer, *first, n);
-
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.train_forward_one(next[i], sample);
-        });
-
-        if constexpr (L != LS) {
-            return train_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+        return select_forward_many_tiles<true, LS, L>(*this, first, last);
     }
 
     /*
@@ -1340,13 +2186,110 @@ public:
     }
 
     /*!
-     * \brief Create a trainer for custom training of the network
-     * \return The trainer for this network
+     * \brief Predict the label of each sample of the given batch of inputs.
+     *
+     * The samples are forwarded by batches of batch_size, in an inference
+     * context.
+     *
+     * \param batch The batch of inputs
+     * \return The label of each sample
      */
-    dll::dbn_trainer<this_type> get_trainer() {
-        dll::dbn_trainer<this_type> trainer;
-        return trainer;
-    }
+    template <typename Input, cpp_enable_iff(!is_generator<Input>)>
+    std::vector<size_t> predict_batch(const Input& batch) const {
+        std::vector<size_t> labels;
+        labels.reserve(etl::dim<0>(batch));
+
+        forward_tiles(batch, [&labels](auto& output, size_t n) {
+            argmax_rows(output, n, labels);
+        });
+
+        return labels;
+    }
+
+    /*!
+     * \brief Predict the label of each sample of the given generator.
+     *
+     * \param generator The data generator
+     * \return The label of each sample
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    std::vector<size_t> predict_batch(Generator& generator) const {
+        std::vector<size_t> labels;
+        labels.reserve(generator.size());
+
+        forward_generator(generator, [&labels](auto& output, size_t n) {
+            argmax_rows(output, n, labels);
+        });
+
+        return labels;
+    }
+
+    /*!
+     * \brief Predict the k best labels of each sample of the given batch of
+     * inputs, with their scores.
+     *
+     * Only the k best outputs of each sample are sorted.
+     *
+     * \param batch The batch of inputs
+     * \param k The number of labels per sample
+     * \return The k best labels of each sample, best first
+     */
+    template <typename Input, cpp_enable_iff(!is_generator<Input>)>
+    topk_result<weight> predict_topk_batch(const Input& batch, size_t k) const {
+        topk_result<weight> result;
+        result.k = std::min(k, output_size());
+        result.indices.reserve(etl::dim<0>(batch) * result.k);
+        result.scores.reserve(etl::dim<0>(batch) * result.k);
+
+        std::vector<size_t> order;
+
+        forward_tiles(batch, [&result, &order](auto& output, size_t n) {
+            topk_rows(output, n, result, order);
+        });
+
+        return result;
+    }
+
+    /*!
+     * \brief Predict the k best labels of each sample of the given
+     * generator, with their scores.
+     *
+     * \param generator The data generator
+     * \param k The number of labels per sample
+     * \return The k best labels of each sample, best first
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    topk_result<weight> predict_topk_batch(Generator& generator, size_t k) const {
+        topk_result<weight> result;
+        result.k = std::min(k, output_size());
+        result.indices.reserve(generator.size() * result.k);
+        result.scores.reserve(generator.size() * result.k);
+
+        std::vector<size_t> order;
+
+        forward_generator(generator, [&result, &order](auto& output, size_t n) {
+            topk_rows(output, n, result, order);
+        });
+
+        return result;
+    }
+
+    /*!
+     * \brief Create a trainer for custom training of the network
+     * \return The trainer for this network
+     */
+    dll::dbn_trainer<this_type> get_trainer() {
+        dll::dbn_trainer<this_type> trainer;
+        return trainer;
+    }
+
+    /*!
+     * \brief Returns the thread pool of the network
+     * \return A reference to the thread pool of the network
+     */
+    auto& get_pool() {
+        return pool;
+    }
 
     // Fine-tune for classification
 
@@ -1360,7 +2303,8 @@ public:
      */
     template <typename Generator>
     weight fine_tune(Generator& generator, size_t max_epochs) {
-        dll::auto_timer timer("net:train:ft");
+        static dll::timer_id timer_handle("net:train:ft");
+        dll::auto_timer timer(timer_handle);
 
         validate_generator(generator);
 
@@ -1368,6 +2312,32 @@ public:
         return trainer.train(*this, generator, max_epochs);
     }
 
+    /*!
+     * \brief Fine tune the network for classification with a generator,
+     * distilling the knowledge of a teacher network.
+     *
+     * The errors mix the hard labels with the soft targets of the teacher
+     * (see distill_temperature and distill_weight). The teacher of each
+     * batch runs concurrently with the training of the batch, or once for
+     * all the training set (see cache_teacher_outputs).
+     *
+     * \param teacher The teacher network, ending with a softmax
+     * \param generator A generator for data and labels
+     * \param max_epochs The maximum number of epochs to train the network for.
+     *
+     * \return The final classification error
+     */
+    template <typename Teacher, typename Generator>
+    weight distill(const Teacher& teacher, Generator& generator, size_t max_epochs) {
+        static dll::timer_id timer_handle("net:train:distill");
+        dll::auto_timer timer(timer_handle);
+
+        validate_generator(generator);
+
+        dll::dbn_trainer<this_type> trainer;
+        return trainer.distill(*this, teacher, generator, max_epochs);
+    }
+
     /*!
      * \brief Fine tune the network for classifcation with a generator.
      *
@@ -1379,7 +2349,8 @@ public:
      */
     template <typename Generator, typename ValGenerator>
     weight fine_tune_val(Generator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
-        dll::auto_timer timer("net:train:ft");
+        static dll::timer_id timer_handle("net:train:ft");
+        dll::auto_timer timer(timer_handle);
 
         validate_generator(train_generator);
         validate_generator(val_generator);
@@ -1397,14 +2368,23 @@ public:
      */
     template <typename Input, typename Labels>
     weight fine_tune(const Input& training_data, Labels& labels, size_t max_epochs) {
-        // Create generator around the containers
-        auto generator = dll::make_generator(
-            training_data, labels,
-            training_data.size(), output_size(), categorical_generator_t{});
+        if constexpr (etl::is_etl_expr<Input>) {
+            static_assert(!desc::ScalePre && !desc::BinarizePre && !desc::NormalizePre, "The samples of a tensor cannot be preprocessed in place");
 
-        generator->set_safe();
+            // View the samples of the tensor, without copying them
+            auto generator = dll::make_generator(training_data, labels, output_size(), view_generator_t{});
 
-        return fine_tune(*generator, max_epochs);
+            return fine_tune(*generator, max_epochs);
+        } else {
+            // Create generator around the containers
+            auto generator = dll::make_generator(
+                training_data, labels,
+                training_data.size(), output_size(), categorical_generator_t{});
+
+            generator->set_safe();
+
+            return fine_tune(*generator, max_epochs);
+        }
     }
 
     /*!
@@ -1439,7 +2419,8 @@ public:
      */
     template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
     weight fine_tune_ae(Generator& generator, size_t max_epochs) {
-        dll::auto_timer timer("net:train:ft:ae");
+        static dll::timer_id timer_handle("net:train:ft:ae");
+        dll::auto_timer timer(timer_handle);
 
         validate_generator(generator);
 
@@ -1497,7 +2478,8 @@ public:
      */
     template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
     weight fine_tune_reg(Generator& generator, size_t max_epochs) {
-        dll::auto_timer timer("net:train:ft:reg");
+        static dll::timer_id timer_handle("net:train:ft:reg");
+        dll::auto_timer timer(timer_handle);
 
         validate_generator(generator);
 
@@ -1903,34 +2885,38 @@ public:
         double batch_error;
 
         if constexpr (loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
-            dll::auto_timer timer("net:compute_loss:CCE");
+            static dll::timer_id timer_handle("net:compute_loss:CCE");
+            dll::auto_timer timer(timer_handle);
 
-            if (cpp_unlikely(!full_batch)) {
-                auto soutput = slice(output, 0, n);
+            cpp_unused(full_batch);
 
-                batch_loss  = etl::ml::cce_loss(soutput, labels, -1.0 / s);
-                batch_error = etl::ml::cce_error(soutput, labels, 1.0 / s);
-            } else {
-                batch_loss  = etl::ml::cce_loss(output, labels, -1.0 / s);
-                batch_error = etl::ml::cce_error(output, labels, 1.0 / s);
-            }
+            // The error and the loss in a single sweep over the output
+            auto [errors, losses] = cce_metrics(output, labels, n);
+
+            batch_loss  = losses / s;
+            batch_error = errors / s;
         } else if constexpr (loss == loss_function::BINARY_CROSS_ENTROPY) {
-            dll::auto_timer timer("net:compute_loss:BCE");
+            static dll::timer_id timer_handle("net:compute_loss:BCE");
+            dll::auto_timer timer(timer_handle);
 
-            // Avoid Nan in log(out) or log(1-out)
-            auto out = etl::force_temporary(etl::clip(output, 0.001, 0.999));
+            arena_scope scope;
 
             if (cpp_unlikely(!full_batch)) {
-                auto sout = slice(out, 0, n);
+                // Avoid Nan in log(out) or log(1-out)
+                auto sout = arena_temporary(etl::clip(slice(output, 0, n), 0.001, 0.999));
 
                 batch_loss  = (-1.0 / (s * output_size())) * sum((labels >> log(sout)) + ((1.0 - labels) >> log(1.0 - sout)));
                 batch_error = (1.0 / (s * output_size())) * asum(labels - sout);
             } else {
+                // Avoid Nan in log(out) or log(1-out)
+                auto out = arena_temporary(etl::clip(output, 0.001, 0.999));
+
                 batch_loss  = (-1.0 / (s * output_size())) * sum((labels >> log(out)) + ((1.0 - labels) >> log(1.0 - out)));
                 batch_error = (1.0 / (s * output_size())) * asum(labels - output);
             }
         } else { // MEAN_SQUARED_ERROR
-            dll::auto_timer timer("net:compute_loss:MSE");
+            static dll::timer_id timer_handle("net:compute_loss:MSE");
+            dll::auto_timer timer(timer_handle);
 
             if (cpp_unlikely(!full_batch)) {
                 auto soutput = slice(output, 0, n);
@@ -1984,6 +2970,10 @@ public:
     metrics_t evaluate_metrics(Generator& generator){
         validate_generator(generator);
 
+        if (is_parallel_evaluation(generator)) {
+            return evaluate_metrics_parallel(generator);
+        }
+
         auto forward_helper = [this](auto&& input_batch){
             return this->forward_batch(input_batch);
         };
@@ -1991,6 +2981,203 @@ public:
         return evaluate_metrics(generator, forward_helper);
     }
 
+    /*!
+     * \brief Indicates if the evaluation of the given generator is done
+     * concurrently on the thread pool of the network.
+     */
+    template <typename Generator>
+    bool is_parallel_evaluation(const Generator& generator) const {
+        if constexpr (!dbn_traits<this_type>::is_serial()) {
+            return parallel_evaluation && etl::threads > 1 && generator.batches() > 1;
+        } else {
+            cpp_unused(generator);
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task
+     * and return the evaluation metrics, with the batches forwarded
+     * concurrently on the thread pool.
+     *
+     * The generator is only used by the calling thread, which copies the
+     * batches for the workers, each with its own inference context. The
+     * metrics of the batches are reduced in the order of the batches, as
+     * in the serial evaluation.
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics_parallel(Generator& generator){
+        static dll::timer_id timer_handle("net:evaluate:parallel");
+        dll::auto_timer timer(timer_handle);
+
+        std::vector<metrics_t> metrics;
+
+        evaluate_batches_parallel(generator, [&metrics](size_t batches) { metrics.resize(batches); },
+                                  [this, &metrics](size_t b, auto& output, const auto& labels, size_t n) {
+                                      metrics[b] = this->evaluate_metrics_batch(output, labels, n, false);
+                                  });
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (auto& [batch_error, batch_loss] : metrics) {
+            error += batch_error;
+            loss += batch_loss;
+        }
+
+        error /= generator.size();
+        loss /= generator.size();
+
+        return std::make_tuple(error, loss);
+    }
+
+    /*!
+     * \brief Forward the batches of the given generator concurrently on the
+     * thread pool and give their outputs to the given functor.
+     *
+     * The generator is only used by the calling thread, which copies the
+     * batches for the workers, each with its own inference context.
+     *
+     * \param generator The data generator
+     * \param grow The functor called with the number of batches seen so
+     * far, before their outputs are given to the workers
+     * \param functor The functor called on the workers with the index of a
+     * batch, its output, its labels and its number of samples
+     */
+    template <typename Generator, typename Grow, typename Functor>
+    void evaluate_batches_parallel(Generator& generator, Grow&& grow, Functor&& functor){
+        // Starts a new
+        generator.reset();
+
+        // Set the generator in test mode
+        generator.set_test();
+
+        auto sample = etl::force_temporary(generator.data_batch()(0));
+        auto label  = etl::force_temporary(generator.label_batch()(0));
+
+        using context_t = dll::inference_context<this_type, decltype(sample), batch_size>;
+        using labels_t  = std::decay_t<decltype(batch_make<batch_size>(label))>;
+
+        const size_t workers = std::min(etl::threads, generator.batches());
+
+        std::vector<std::unique_ptr<context_t>> contexts;
+        std::vector<typename context_t::input_t> inputs;
+        std::vector<labels_t> labels;
+        std::vector<size_t> sizes(workers);
+
+        for (size_t w = 0; w < workers; ++w) {
+            contexts.push_back(std::make_unique<context_t>(*this, sample));
+            inputs.push_back(batch_make<batch_size>(sample));
+            labels.push_back(batch_make<batch_size>(label));
+        }
+
+        size_t batches = 0;
+
+        while (generator.has_next_batch()) {
+            const size_t first = batches;
+
+            // Copy the next batches for the workers
+
+            size_t active = 0;
+
+            for (; active < workers && generator.has_next_batch(); ++active) {
+                auto input_batch = generator.data_batch();
+                auto label_batch = generator.label_batch();
+
+                sizes[active] = etl::dim<0>(input_batch);
+
+                etl::slice(inputs[active], 0, sizes[active]) = input_batch;
+                etl::slice(labels[active], 0, sizes[active]) = label_batch;
+
+                generator.next_batch();
+            }
+
+            batches = first + active;
+
+            grow(batches);
+
+            for (size_t w = 0; w < active; ++w) {
+                pool.do_task([w, first, &contexts, &inputs, &labels, &sizes, &functor] {
+                    trace_scope scope("pool:task", "pool");
+
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        // The samples after sizes[w] are left from the previous batches and not computed
+                        auto& output = contexts[w]->forward_batch(etl::slice(inputs[w], 0, sizes[w]));
+
+                        functor(first + w, output, etl::slice(labels[w], 0, sizes[w]), sizes[w]);
+                    }
+                });
+            }
+
+            pool.wait();
+        }
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task and
+     * return the loss, the error, the top-k accuracy and the confusion
+     * matrix, computed in a single pass over the generator.
+     *
+     * The batches are evaluated concurrently on the thread pool, when
+     * parallel_evaluation is enabled, each into its own report. The reports
+     * are merged in the order of the batches.
+     *
+     * \param generator The data generator
+     * \param k The number of best classes of the top-k accuracy
+     *
+     * \return The classification report
+     */
+    template <typename Generator>
+    classification_report evaluate_classification(Generator& generator, size_t k = 5){
+        static dll::timer_id timer_handle("net:evaluate:classification");
+        dll::auto_timer timer(timer_handle);
+
+        validate_generator(generator);
+
+        const size_t classes = output_size();
+
+        classification_report report(classes, k);
+
+        if (is_parallel_evaluation(generator)) {
+            std::vector<classification_report> reports;
+
+            evaluate_batches_parallel(generator, [&](size_t batches) { reports.resize(batches, report); },
+                                      [&reports](size_t b, auto& output, const auto& labels, size_t n) {
+                                          reports[b].add_batch(output, labels, n);
+                                      });
+
+            for (auto& batch_report : reports) {
+                report.merge(batch_report);
+            }
+
+            return report;
+        }
+
+        // Starts a new
+        generator.reset();
+
+        // Set the generator in test mode
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            auto input_batch = generator.data_batch();
+            auto label_batch = generator.label_batch();
+
+            decltype(auto) output = this->forward_batch(input_batch);
+
+            report.add_batch(output, label_batch, etl::dim<0>(input_batch));
+
+            generator.next_batch();
+        }
+
+        return report;
+    }
+
     /*!
      * \brief Evaluate the network on the given classification task
      * and return the evaluation metrics.
@@ -2059,6 +3246,48 @@ public:
         return result;
     }
 
+    /*!
+     * \brief Compute the concatenated activation probabilities of all the
+     * layers for each sample of the given batch.
+     *
+     * The batch is forwarded by tiles of batch_size samples, concurrently
+     * on the thread pool, and the output of each layer is written directly
+     * in its columns of the result.
+     *
+     * \param batch The batch of inputs
+     * \param result The features, of dimensions [N, full_output_size()]
+     */
+    template <typename Input, typename Output>
+    void full_activation_probabilities_batch(const Input& batch, Output& result) {
+        const size_t n = etl::dim<0>(batch);
+
+        cpp_assert(etl::dim<0>(result) == n && etl::dim<1>(result) == full_output_size(), "Invalid dimensions of the features");
+
+        if (!n) {
+            return;
+        }
+
+        full_activation_probabilities_tiles(etl::force_temporary(batch(0)), n, result, [&batch](auto& input, size_t first, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                input(i) = batch(first + i);
+            }
+        });
+    }
+
+    /*!
+     * \brief Compute the concatenated activation probabilities of all the
+     * layers for each sample of the given batch.
+     *
+     * \param batch The batch of inputs
+     * \return The features, of dimensions [N, full_output_size()]
+     */
+    template <typename Input>
+    auto full_activation_probabilities_batch(const Input& batch) {
+        etl::dyn_matrix<weight, 2> result(etl::dim<0>(batch), full_output_size());
+        full_activation_probabilities_batch(batch, result);
+        return result;
+    }
+
     template <typename Functor>
     void for_each_layer(Functor&& functor) {
         for_each_impl_t(*this).for_each_layer(std::forward<Functor>(functor));
@@ -2190,51 +3419,321 @@ public:
         //Make libsvm quiet
         svm::make_quiet();
 
-        auto parameters = default_svm_parameters();
+        auto parameters = default_svm_parameters();
+
+        //Make sure parameters are not messed up
+        if (!svm::check(problem, parameters)) {
+            return false;
+        }
+
+        //Perform a grid-search
+        svm::rbf_grid_search(problem, parameters, n_fold, g);
+
+        return true;
+    }
+
+    /*!
+     * \brief Perform a grid search of the RBF parameters, in parallel over
+     * the cells of the grid and the folds, see svm_rbf_grid_search.
+     *
+     * \param parameters The parameters of the SVM, C and gamma are set to the best cell
+     * \return true if the grid search was performed, false otherwise
+     */
+    template <typename Samples, typename Labels>
+    bool svm_grid_search(const Samples& training_data, const Labels& labels, svm_parameter& parameters, const svm_rbf_grid& g, size_t n_fold = 5) {
+        make_problem(training_data, labels, dbn_traits<this_type>::scale());
+
+        //Make libsvm quiet
+        svm::make_quiet();
+
+        //Make sure parameters are not messed up
+        if (!svm::check(problem, parameters)) {
+            return false;
+        }
+
+        svm_rbf_grid_search(problem, std::size(training_data), parameters, n_fold, g);
+
+        return true;
+    }
+
+    template <typename It, typename LIt>
+    bool svm_grid_search(It&& first, It&& last, LIt&& lfirst, LIt&& llast, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
+        make_problem(
+            std::forward<It>(first), std::forward<It>(last),
+            std::forward<LIt>(lfirst), std::forward<LIt>(llast),
+            dbn_traits<this_type>::scale());
+
+        //Make libsvm quiet
+        svm::make_quiet();
+
+        auto parameters = default_svm_parameters();
+
+        //Make sure parameters are not messed up
+        if (!svm::check(problem, parameters)) {
+            return false;
+        }
+
+        //Perform a grid-search
+        svm::rbf_grid_search(problem, parameters, n_fold, g);
+
+        return true;
+    }
+
+    template <typename Input>
+    double svm_predict(const Input& sample) {
+        auto features = get_final_activation_probabilities(sample);
+        return svm::predict(svm_model, features);
+    }
+
+    /*!
+     * \brief Train a linear SVM on the features of the given samples.
+     *
+     * The features are computed by tiles on the thread pool into one dense
+     * matrix, on which the classes are trained one-vs-rest, concurrently,
+     * by dual coordinate descent. This is much faster than libsvm for the
+     * high-dimensional features of svm_concatenate. The features are not
+     * scaled.
+     *
+     * \return true if the classifier was trained, false otherwise
+     */
+    template <typename Samples, typename Labels>
+    bool linear_svm_train(const Samples& training_data, const Labels& labels, const linear_svm_parameters& parameters = linear_svm_parameters()) {
+        return linear_svm_train(std::begin(training_data), std::end(training_data), std::begin(labels), std::end(labels), parameters);
+    }
+
+    /*!
+     * \brief Train a linear SVM on the features of the given samples.
+     * \return true if the classifier was trained, false otherwise
+     */
+    template <typename Iterator, typename LIterator>
+    bool linear_svm_train(Iterator first, Iterator last, LIterator lfirst, LIterator llast, const linear_svm_parameters& parameters = linear_svm_parameters()) {
+        cpp::stop_watch<std::chrono::seconds> watch;
+
+        const size_t n = std::distance(first, last);
+
+        if (!n || size_t(std::distance(lfirst, llast)) != n) {
+            std::cerr << "ERROR: There must be as many labels as samples, and at least one" << std::endl;
+            return false;
+        }
+
+        std::vector<size_t> labels(lfirst, llast);
+
+        auto features = svm_features(first, n);
+
+        {
+            static dll::timer_id timer_handle("net:svm:linear:train");
+            dll::auto_timer timer(timer_handle);
+
+            linear_model.train(features, labels, parameters, pool);
+        }
+
+        out << "Linear SVM training took " << watch.elapsed() << "s" << std::endl;
+
+        return true;
+    }
+
+    /*!
+     * \brief Predict the class of the given sample with the linear SVM
+     */
+    template <typename Input>
+    size_t linear_svm_predict(const Input& sample) {
+        return linear_svm_predict_batch(&sample, &sample + 1).front();
+    }
+
+    /*!
+     * \brief Predict the class of each of the given samples with the linear
+     * SVM. The scores of all the samples are computed as one matrix
+     * multiplication of their features.
+     */
+    template <typename Samples>
+    std::vector<size_t> linear_svm_predict_batch(const Samples& samples) {
+        return linear_svm_predict_batch(std::begin(samples), std::end(samples));
+    }
+
+    /*!
+     * \brief Predict the class of each of the given samples with the linear
+     * SVM.
+     */
+    template <typename Iterator>
+    std::vector<size_t> linear_svm_predict_batch(Iterator first, Iterator last) {
+        const size_t n = std::distance(first, last);
+
+        if (!n) {
+            return {};
+        }
+
+        auto features = svm_features(first, n);
+
+        static dll::timer_id timer_handle("net:svm:linear:predict");
+        dll::auto_timer timer(timer_handle);
+
+        return linear_model.predict_batch(features);
+    }
+
+#endif //DLL_SVM_SUPPORT
+
+private:
+    /*!
+     * \brief Forward n samples by tiles of batch_size samples, concurrently.
+     *
+     * Each worker of the thread pool forwards every workers-th tile in its
+     * own inference context and gives it to sink(context, first, count),
+     * where first is the index of the first sample of the tile and count
+     * its number of samples.
+     *
+     * \param sample A sample, only used for its dimensions
+     * \param n The number of samples
+     * \param fill The functor copying count samples, from first, into an input batch
+     * \param sink The functor consuming the outputs of a tile
+     * \tparam Fuse Indicates if the layers can be fused, in which case only
+     * the output of the last layer is valid
+     */
+    template <bool Fuse, typename Sample, typename Fill, typename Sink>
+    void forward_tiles(const Sample& sample, size_t n, Fill&& fill, Sink&& sink) {
+        using context_t = dll::inference_context<this_type, Sample, batch_size, Fuse>;
+
+        const size_t tiles = (n + batch_size - 1) / batch_size;
+
+        size_t workers = 1;
+
+        if constexpr (!dbn_traits<this_type>::is_serial()) {
+            workers = std::max<size_t>(1, std::min(etl::threads, tiles));
+        }
+
+        std::vector<std::unique_ptr<context_t>> contexts;
+
+        for (size_t w = 0; w < workers; ++w) {
+            contexts.push_back(std::make_unique<context_t>(*this, sample));
+        }
+
+        auto forward_worker = [&contexts, &fill, &sink, workers, tiles, n](size_t w) {
+            auto& context = *contexts[w];
+
+            for (size_t t = w; t < tiles; t += workers) {
+                const size_t first = t * batch_size;
+                const size_t count = std::min(batch_size, n - first);
+
+                // The samples after count are left from the previous tiles and ignored
+                fill(context.input, first, count);
+
+                context.forward_batch(context.input);
+
+                sink(context, first, count);
+            }
+        };
+
+        if (workers == 1) {
+            forward_worker(0);
+        } else {
+            for (size_t w = 0; w < workers; ++w) {
+                pool.do_task([&forward_worker, w] {
+                    trace_scope scope("pool:task", "pool");
+
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        forward_worker(w);
+                    }
+                });
+            }
+
+            pool.wait();
+        }
+    }
+
+    /*!
+     * \brief Compute the concatenated activation probabilities of n samples,
+     * by tiles of batch_size samples.
+     *
+     * The tiles are forwarded without fusion so that the output of each
+     * layer is kept, and each worker copies the outputs into its rows of
+     * the result.
+     *
+     * \param sample A sample, only used for its dimensions
+     * \param n The number of samples
+     * \param result The features, of dimensions [n, full_output_size()]
+     * \param fill The functor copying count samples, from first, into an input batch
+     */
+    template <typename Sample, typename Output, typename Fill>
+    void full_activation_probabilities_tiles(const Sample& sample, size_t n, Output& result, Fill&& fill) {
+        static dll::timer_id timer_handle("net:full_activation_probabilities:batch");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t full = full_output_size();
+
+        // The whole result is written from the CPU
+        result.ensure_cpu_up_to_date();
+
+        auto* out = result.memory_start();
+
+        forward_tiles<false>(sample, n, fill, [full, out](auto& context, size_t first, size_t count) {
+            size_t offset = 0;
+
+            cpp::for_each(context.outputs, [&](auto& output) {
+                output.ensure_cpu_up_to_date();
+
+                const size_t size = etl::size(output) / batch_size;
+
+                for (size_t s = 0; s < count; ++s) {
+                    std::copy_n(output.memory_start() + s * size, size, out + (first + s) * full + offset);
+                }
+
+                offset += size;
+            });
+        });
+
+        result.invalidate_gpu();
+    }
 
-        //Make sure parameters are not messed up
-        if (!svm::check(problem, parameters)) {
-            return false;
+    /*!
+     * \brief Forward the given batch of inputs by batches of batch_size and
+     * pass each output, with its number of valid samples, to the given
+     * functor.
+     */
+    template <typename Input, typename Functor>
+    void forward_tiles(const Input& batch, Functor&& functor) const {
+        const size_t n = etl::dim<0>(batch);
+
+        if (!n) {
+            return;
         }
 
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        auto sample  = etl::force_temporary(batch(0));
+        auto context = std::make_unique<dll::inference_context<this_type, decltype(sample), batch_size>>(*this, sample);
 
-        return true;
-    }
+        for (size_t i = 0; i < n; i += batch_size) {
+            const size_t tile = std::min(batch_size, n - i);
 
-    template <typename It, typename LIt>
-    bool svm_grid_search(It&& first, It&& last, LIt&& lfirst, LIt&& llast, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
-        make_problem(
-            std::forward<It>(first), std::forward<It>(last),
-            std::forward<LIt>(lfirst), std::forward<LIt>(llast),
-            dbn_traits<this_type>::scale());
+            functor(context->forward_batch(etl::slice(batch, i, i + tile)), tile);
+        }
+    }
 
-        //Make libsvm quiet
-        svm::make_quiet();
+    /*!
+     * \brief Forward the batches of the given generator and pass each
+     * output, with its number of valid samples, to the given functor.
+     */
+    template <typename Generator, typename Functor>
+    void forward_generator(Generator& generator, Functor&& functor) const {
+        validate_generator(generator);
 
-        auto parameters = default_svm_parameters();
+        generator.reset();
+        generator.set_test();
 
-        //Make sure parameters are not messed up
-        if (!svm::check(problem, parameters)) {
-            return false;
+        if (!generator.has_next_batch()) {
+            return;
         }
 
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        auto sample  = etl::force_temporary(generator.data_batch()(0));
+        auto context = std::make_unique<dll::inference_context<this_type, decltype(sample), batch_size>>(*this, sample);
 
-        return true;
-    }
+        while (generator.has_next_batch()) {
+            auto input_batch = generator.data_batch();
 
-    template <typename Input>
-    double svm_predict(const Input& sample) {
-        auto features = get_final_activation_probabilities(sample);
-        return svm::predict(svm_model, features);
-    }
+            functor(context->forward_batch(input_batch), etl::dim<0>(input_batch));
 
-#endif //DLL_SVM_SUPPORT
+            generator.next_batch();
+        }
+    }
 
-private:
     //By default all layer are trained
     template <size_t I, typename Enable = void>
     struct train_next : std::true_type {};
@@ -2294,9 +3793,27 @@ private:
         pretrain_layer<I + 2>(*next_generator, watcher, max_epochs);
     }
 
+    //Two consecutive RBMs can be pretrained in a pipeline
+    template <size_t I, typename Enable = void>
+    struct pipeline_next : std::false_type {};
+
+    template <size_t I>
+    struct pipeline_next<I, std::enable_if_t<(I + 1 < layers)>> : cpp::bool_constant<
+        layer_traits<layer_type<I>>::is_pretrained() && layer_traits<layer_type<I + 1>>::is_pretrained() && train_next<I + 1>::value> {};
+
     template <size_t I, typename Generator>
     void pretrain_layer(Generator& generator, watcher_t& watcher, size_t max_epochs) {
         if constexpr (I < layers) {
+            if constexpr (pipeline_next<I>::value) {
+                if (pipelined_pretraining && max_epochs > 1) {
+                    std::vector<pretrain_stage> stages;
+
+                    this->template pipelined_pretrain_layer<I>(generator, watcher, max_epochs, stages);
+
+                    return;
+                }
+            }
+
             using layer_t = layer_type<I>;
 
             decltype(auto) layer = layer_get<I>();
@@ -2310,49 +3827,136 @@ private:
                     (generator, max_epochs);
             }
 
-            //When the next layer is a pooling layer, a lot of memory can be saved by directly computing
-            //the activations of two layers at once
-            if constexpr (inline_next<I + 1>::value) {
-                this->template inline_layer_pretrain<I>(generator, watcher, max_epochs);
+            pretrain_layer_next<I>(generator, watcher, max_epochs);
+        }
+    }
+
+    /*!
+     * \brief Pretrain the layers after the given trained layer
+     */
+    template <size_t I, typename Generator>
+    void pretrain_layer_next(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        //When the next layer is a pooling layer, a lot of memory can be saved by directly computing
+        //the activations of two layers at once
+        if constexpr (inline_next<I + 1>::value) {
+            this->template inline_layer_pretrain<I>(generator, watcher, max_epochs);
+        }
+
+        if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value) {
+            decltype(auto) layer = layer_get<I>();
+
+            // Reset correctly the generator
+            generator.reset();
+            generator.set_test();
+
+            // Need one output in order to create the generator
+            auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
+
+            // Prepare a generator to hold the data
+            auto next_generator = prepare_generator(
+                one, one,
+                generator.size(), output_size(),
+                get_rbm_ingenerator_inner_desc());
+
+            next_generator->set_safe();
+
+            // Compute the input of the next layer
+            // using batch activation
+
+            size_t i = 0;
+            while (generator.has_next_batch()) {
+                auto next_batch = layer.train_forward_batch(generator.data_batch());
+
+                next_generator->set_data_batch(i, next_batch);
+                next_generator->set_label_batch(i, next_batch);
+
+                i += etl::dim<0>(next_batch);
+
+                generator.next_batch();
             }
 
-            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value) {
-                // Reset correctly the generator
-                generator.reset();
-                generator.set_test();
+            // Release the memory if possible
+            generator.clear();
 
-                // Need one output in order to create the generator
-                auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
+            //Pass the output to the next layer
+            this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
+        }
+    }
 
-                // Prepare a generator to hold the data
-                auto next_generator = prepare_generator(
-                    one, one,
-                    generator.size(), output_size(),
-                    get_rbm_ingenerator_inner_desc());
+    /*!
+     * \brief Add the given RBM and the following ones to a pipelined
+     * pretraining and run it once all the consecutive RBMs are added.
+     *
+     * The inputs of each RBM are kept for the whole pretraining, the
+     * frames of the recursion holding them.
+     */
+    template <size_t I, typename Generator>
+    void pipelined_pretrain_layer(Generator& generator, watcher_t& watcher, size_t max_epochs, std::vector<pretrain_stage>& stages) {
+        using layer_t       = layer_type<I>;
+        using rbm_trainer_t = dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>>;
 
-                next_generator->set_safe();
+        decltype(auto) layer = layer_get<I>();
 
-                // Compute the input of the next layer
-                // using batch activation
+        rbm_trainer_t r_trainer;
+        typename rbm_trainer_t::trainer_type trainer;
+
+        stages.emplace_back();
+
+        auto& stage = stages.back();
+
+        stage.begin = [&] {
+            watcher.pretrain_layer(*this, I, layer, generator.size());
+
+            trainer = r_trainer.start_training(layer, generator);
+        };
+
+        stage.epoch = [&](size_t epoch) {
+            r_trainer.train_epoch(layer, generator, trainer, epoch);
+        };
+
+        stage.end = [&] {
+            r_trainer.finalize_training(layer);
+        };
+
+        if constexpr (pipeline_next<I>::value) {
+            // Reset correctly the generator
+            generator.reset();
+            generator.set_test();
+
+            // Need one output in order to create the generator
+            auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
+
+            // Prepare a generator to hold the inputs of the next RBM
+            auto next_generator = prepare_generator(
+                one, one,
+                generator.size(), output_size(),
+                get_rbm_ingenerator_inner_desc());
+
+            next_generator->set_safe();
+
+            stage.forward = [&layer, &generator, &next = *next_generator] {
+                generator.reset();
+                generator.set_test();
 
                 size_t i = 0;
                 while (generator.has_next_batch()) {
                     auto next_batch = layer.train_forward_batch(generator.data_batch());
 
-                    next_generator->set_data_batch(i, next_batch);
-                    next_generator->set_label_batch(i, next_batch);
+                    next.set_data_batch(i, next_batch);
+                    next.set_label_batch(i, next_batch);
 
                     i += etl::dim<0>(next_batch);
 
                     generator.next_batch();
                 }
+            };
 
-                // Release the memory if possible
-                generator.clear();
+            this->template pipelined_pretrain_layer<I + 1>(*next_generator, watcher, max_epochs, stages);
+        } else {
+            dll::pipelined_pretrain(stages, max_epochs, pipeline_warmup_epochs, pipeline_refresh_epochs);
 
-                //Pass the output to the next layer
-                this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
-            }
+            // The following layers are pretrained one-by-one
+            pretrain_layer_next<I>(generator, watcher, max_epochs);
         }
     }
 
@@ -2419,6 +4023,16 @@ private:
 
     /* Pretrain in batch mode */
 
+    /*!
+     * \brief Indicates if the samples are shuffled before each epoch of the
+     * batch mode pretraining of the given layer, with shuffle_pre or with
+     * shuffle in the layer.
+     */
+    template <size_t I>
+    static constexpr bool shuffle_pretrain_layer() {
+        return dbn_traits<this_type>::shuffle_pretrain() || rbm_layer_traits<layer_type<I>>::has_shuffle();
+    }
+
     //By default no layer is ignored
     template <size_t I, typename Enable = void>
     struct batch_layer_ignore : std::false_type {};
@@ -2435,16 +4049,18 @@ private:
     //data is coming from iterators not from input
     template <size_t I, typename Generator, cpp_enable_iff((I == 0 && !batch_layer_ignore<I>::value))>
     void pretrain_layer_batch(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        using layer_t = layer_type<I>;
+
         decltype(auto) rbm = layer_get<I>();
 
         watcher.pretrain_layer(*this, I, rbm, 0);
 
-        // The train function can be used directly because the
+        // The RBM trainer can be used directly because the
         // batch mode will be done by the generator itself
-        rbm.template train<
-                !watcher_t::ignore_sub,               //Enable the RBM Watcher or not
-                dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
-            (generator, max_epochs);
+        dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>> r_trainer;
+
+        r_trainer.shuffle = shuffle_pretrain_layer<I>();
+        r_trainer.train(rbm, generator, max_epochs);
 
         //Train the next layer
         pretrain_layer_batch<I + 1>(generator, watcher, max_epochs);
@@ -2477,6 +4093,15 @@ private:
         //Get the specific trainer (CD)
         auto trainer = rbm_trainer_t::get_trainer(rbm);
 
+        //The inputs of the first batches, forwarded once
+        using batch_t = std::decay_t<decltype(forward_batch<I - 1>(generator.data_batch()))>;
+
+        std::vector<batch_t> cache;
+
+        //The first batches differ at each epoch when shuffled
+        constexpr bool shuffle = shuffle_pretrain_layer<I>();
+        constexpr size_t cached = shuffle ? 0 : dbn_traits<this_type>::pretrain_cache();
+
         //Train for max_epochs epoch
         for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
             size_t big_batch = 0;
@@ -2486,13 +4111,28 @@ private:
 
             r_trainer.init_epoch();
 
-            generator.reset();
+            if (shuffle) {
+                generator.reset_shuffle();
+            } else {
+                generator.reset();
+            }
+
             generator.set_train();
 
             while (generator.has_next_batch()) {
-                auto next_batch = forward_batch<I - 1>(generator.data_batch());
+                const size_t b = generator.current_batch();
+
+                if (b < cache.size()) {
+                    r_trainer.train_batch(cache[b], cache[b], trainer, context, rbm);
+                } else {
+                    auto next_batch = forward_batch<I - 1>(generator.data_batch());
+
+                    if (b == cache.size() && b < cached) {
+                        cache.push_back(next_batch);
+                    }
 
-                r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+                    r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+                }
 
                 if (dbn_traits<this_type>::is_verbose()) {
                     watcher.pretraining_batch(*this, big_batch);
@@ -2520,16 +4160,18 @@ private:
     //data is coming from iterators not from input
     template <size_t I, typename Generator, cpp_enable_iff((I == 0 && !batch_layer_ignore<I>::value))>
     void pretrain_layer_denoising_batch(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        using layer_t = layer_type<I>;
+
         decltype(auto) rbm = layer_get<I>();
 
         watcher.pretrain_layer(*this, I, rbm, 0);
 
-        // The train function can be used directly because the
+        // The RBM trainer can be used directly because the
         // batch mode will be done by the generator itself
-        rbm.template train_denoising<
-                !watcher_t::ignore_sub,               //Enable the RBM Watcher or not
-                dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
-            (generator, max_epochs);
+        dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>> r_trainer;
+
+        r_trainer.shuffle = shuffle_pretrain_layer<I>();
+        r_trainer.train(rbm, generator, max_epochs);
 
         //Train the next layer
         pretrain_layer_denoising_batch<I + 1>(generator, watcher, max_epochs);
@@ -2571,7 +4213,12 @@ private:
 
             r_trainer.init_epoch();
 
-            generator.reset();
+            if (shuffle_pretrain_layer<I>()) {
+                generator.reset_shuffle();
+            } else {
+                generator.reset();
+            }
+
             generator.set_train();
 
             while (generator.has_next_batch()) {
@@ -2700,6 +4347,94 @@ private:
     template <size_t I, typename Input, typename Output>
     std::enable_if_t<(I == layers)> predict_labels(const Input&, Output&, size_t) const {}
 
+    /*!
+     * \brief The buffers of the batch prediction of the labels, for one
+     * batch of batch_size samples.
+     *
+     * The activations of each layer are kept as matrices. The output of the
+     * layer before the last one has room for the label units and holds the
+     * reconstruction of the last RBM at the end.
+     */
+    struct labels_workspace {
+        etl::dyn_matrix<weight, 2> input;               ///< The batch of inputs
+        std::vector<etl::dyn_matrix<weight, 2>> hidden; ///< The hidden probabilities of each layer
+        etl::dyn_matrix<weight, 2> samples;             ///< The hidden samples of the last RBM
+        etl::dyn_matrix<weight, 2> visible;             ///< The visible units of the last RBM, with the labels
+
+        /*!
+         * \brief Allocate the buffers for the given network
+         */
+        labels_workspace(const this_type& dbn, size_t labels) : input(batch_size, dll::input_size(dbn.template layer_get<0>())) {
+            dbn.for_each_layer([this](auto& layer) {
+                hidden.emplace_back(batch_size, dll::output_size(layer));
+            });
+
+            samples = etl::dyn_matrix<weight, 2>(batch_size, etl::dim<1>(hidden.back()));
+            visible = etl::dyn_matrix<weight, 2>(batch_size, etl::dim<1>(hidden[layers - 2]) + labels);
+        }
+
+        /*!
+         * \brief Write the label of the first count samples, the best of
+         * the reconstructed label units
+         */
+        void argmax(size_t* predicted, size_t count, size_t labels) {
+            visible.ensure_cpu_up_to_date();
+
+            const size_t width = etl::dim<1>(visible);
+
+            for (size_t i = 0; i < count; ++i) {
+                const weight* units = visible.memory_start() + i * width + width - labels;
+
+                predicted[i] = std::distance(units, std::max_element(units, units + labels));
+            }
+        }
+    };
+
+    /*!
+     * \brief Predict the label units of a batch (only when pretrained with
+     * labels): the up-pass to the layer before the last with the
+     * probabilities and one Gibbs step of the last RBM, initialized with
+     * label units of 0.1.
+     */
+    template <size_t I, typename Input>
+    void predict_labels_batch(const Input& input, labels_workspace& ws, size_t labels) const {
+        decltype(auto) layer = layer_get<I>();
+
+        auto& h_a = ws.hidden[I];
+
+        if constexpr (I == layers - 1) {
+            cpp_unused(labels);
+
+            layer.template batch_activate_hidden<true, true>(h_a, ws.samples, input, input);
+            layer.template batch_activate_visible<true, false>(h_a, ws.samples, ws.visible, ws.visible);
+        } else {
+            layer.template batch_activate_hidden<true, false>(h_a, h_a, input, input);
+
+            if constexpr (I == layers - 2) {
+                const size_t out = etl::dim<1>(h_a);
+
+                h_a.ensure_cpu_up_to_date();
+                ws.visible.ensure_cpu_up_to_date();
+
+                for (size_t i = 0; i < batch_size; ++i) {
+                    weight* row = ws.visible.memory_start() + i * (out + labels);
+
+                    std::copy_n(h_a.memory_start() + i * out, out, row);
+                    std::fill_n(row + out, labels, weight(0.1));
+                }
+
+                ws.visible.invalidate_gpu();
+
+                // The visible units are the input of the last RBM, and then its reconstruction
+                auto last_input = etl::force_temporary(ws.visible);
+
+                predict_labels_batch<I + 1>(last_input, ws, labels);
+            } else {
+                predict_labels_batch<I + 1>(h_a, ws, labels);
+            }
+        }
+    }
+
     /* Activation Probabilities */
 
 #ifdef DLL_SVM_SUPPORT
@@ -2714,6 +4449,44 @@ private:
         }
     }
 
+    template <typename Samples, typename Iterator>
+    void add_activation_probabilities(Samples& result, Iterator first, Iterator last) {
+        if constexpr (dbn_traits<this_type>::concatenate()) {
+            const size_t n = std::distance(first, last);
+
+            if (!n) {
+                return;
+            }
+
+            // The features of all the layers are computed by tiles
+            etl::dyn_matrix<weight, 2> features(n, full_output_size());
+
+            full_activation_probabilities_tiles(*first, n, features, [first](auto& input, size_t begin, size_t count) {
+                auto it = std::next(first, begin);
+
+                for (size_t i = 0; i < count; ++i, ++it) {
+                    input(i) = *it;
+                }
+            });
+
+            result.reserve(result.size() + n);
+
+            for (size_t i = 0; i < n; ++i) {
+                result.emplace_back(full_output_size());
+                result.back() = features(i);
+            }
+        } else {
+            // The samples are forwarded by tiles instead of one by one
+            auto features = forward_many(first, last);
+
+            result.reserve(result.size() + features.size());
+
+            for (auto& feature : features) {
+                result.push_back(std::move(feature));
+            }
+        }
+    }
+
     template <typename Input>
     using svm_sample_t = std::conditional_t<
         dbn_traits<this_type>::concatenate(),
@@ -2723,14 +4496,128 @@ private:
     template <typename Input>
     using svm_samples_t = std::vector<svm_sample_t<Input>>;
 
+    /*!
+     * \brief Create the svm problem of n samples, with the features written
+     * directly into the nodes of the problem.
+     *
+     * The features are computed by tiles of batch_size samples,
+     * concurrently on the thread pool. Each worker writes the non-zero
+     * features of its samples into their nodes.
+     */
+    template <typename Iterator, typename LIterator>
+    void make_sparse_problem(Iterator first, size_t n, LIterator lfirst) {
+        static dll::timer_id timer_handle("net:svm:make_problem");
+        dll::auto_timer timer(timer_handle);
+
+        constexpr bool concatenate = dbn_traits<this_type>::concatenate();
+
+        problem = svm::problem(n, concatenate ? full_output_size() : output_size());
+
+        for (size_t i = 0; i < n; ++i, ++lfirst) {
+            problem.label(i) = *lfirst;
+        }
+
+        // The number of nodes written for each sample
+        std::vector<size_t> nodes(n, 0);
+
+        auto write = [this, &nodes](auto& output, size_t begin, size_t count, size_t offset) {
+            output.ensure_cpu_up_to_date();
+
+            const size_t size = etl::size(output) / batch_size;
+
+            for (size_t s = 0; s < count; ++s) {
+                const size_t i = begin + s;
+
+                nodes[i] = detail::svm_append_nodes(problem.sample(i), nodes[i], output.memory_start() + s * size, size, offset);
+            }
+
+            return size;
+        };
+
+        auto fill = [first](auto& input, size_t begin, size_t count) {
+            auto it = std::next(first, begin);
+
+            for (size_t i = 0; i < count; ++i, ++it) {
+                input(i) = *it;
+            }
+        };
+
+        forward_tiles<!concatenate>(*first, n, fill, [&write](auto& context, size_t begin, size_t count) {
+            if constexpr (concatenate) {
+                size_t offset = 0;
+
+                cpp::for_each(context.outputs, [&](auto& output) {
+                    offset += write(output, begin, count, offset);
+                });
+            } else {
+                write(std::get<layers - 1>(context.outputs), begin, count, 0);
+            }
+        });
+
+        for (size_t i = 0; i < n; ++i) {
+            detail::svm_terminate_nodes(problem.sample(i), nodes[i]);
+        }
+    }
+
+    /*!
+     * \brief Compute the features of n samples, into one dense matrix of
+     * [n, features], by tiles of batch_size samples on the thread pool.
+     */
+    template <typename Iterator>
+    etl::dyn_matrix<weight, 2> svm_features(Iterator first, size_t n) {
+        static dll::timer_id timer_handle("net:svm:features");
+        dll::auto_timer timer(timer_handle);
+
+        constexpr bool concatenate = dbn_traits<this_type>::concatenate();
+
+        const size_t features = concatenate ? full_output_size() : output_size();
+
+        etl::dyn_matrix<weight, 2> result(n, features);
+
+        auto fill = [first](auto& input, size_t begin, size_t count) {
+            auto it = std::next(first, begin);
+
+            for (size_t i = 0; i < count; ++i, ++it) {
+                input(i) = *it;
+            }
+        };
+
+        if constexpr (concatenate) {
+            full_activation_probabilities_tiles(*first, n, result, fill);
+        } else {
+            auto* out = result.memory_start();
+
+            forward_tiles<true>(*first, n, fill, [features, out](auto& context, size_t begin, size_t count) {
+                auto& output = std::get<layers - 1>(context.outputs);
+
+                output.ensure_cpu_up_to_date();
+
+                std::copy_n(output.memory_start(), count * features, out + begin * features);
+            });
+
+            result.invalidate_gpu();
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Create the svm problem for this dbn
+     *
+     * Without scaling, the features are written directly into a sparse
+     * problem, see make_sparse_problem.
+     */
     template <typename Samples, typename Labels>
     void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
+        if (!scale && std::size(training_data)) {
+            make_sparse_problem(std::begin(training_data), std::size(training_data), std::begin(labels));
+            return;
+        }
+
         svm_samples_t<safe_value_t<Samples>> svm_samples;
 
         //Get all the activation probabilities
-        for (auto& sample : training_data) {
-            add_activation_probabilities(svm_samples, sample);
-        }
+        add_activation_probabilities(svm_samples, std::begin(training_data), std::end(training_data));
 
         //static_cast ensure using the correct overload
         problem = svm::make_problem(labels, static_cast<const svm_samples_t<safe_value_t<Samples>>&>(svm_samples), scale);
@@ -2741,12 +4628,15 @@ private:
      */
     template <typename Iterator, typename LIterator>
     void make_problem(Iterator first, Iterator last, LIterator&& lfirst, LIterator&& llast, bool scale = false) {
+        if (!scale && first != last) {
+            make_sparse_problem(first, std::distance(first, last), lfirst);
+            return;
+        }
+
         svm_samples_t<safe_value_t<Iterator>> svm_samples;
 
         //Get all the activation probabilities
-        std::for_each(first, last, [this, &svm_samples](auto& sample) {
-            this->add_activation_probabilities(svm_samples, sample);
-        });
+        add_activation_probabilities(svm_samples, first, last);
 
         //static_cast ensure using the correct overload
         problem = svm::make_problem(
@@ -48,6 +48,14 @@ struct dbn_traits {
         return desc::parameters::template contains<dll::batch_mode>();
     }
 
+    /*!
+     * \brief Returns the number of batches cached during pretraining in
+     * batch mode.
+     */
+    static constexpr size_t pretrain_cache() noexcept {
+        return desc::PretrainCache;
+    }
+
     /*!
      * \brief Indicates if the DBN computes error on epoch.
      */
@@ -55,6 +63,22 @@ struct dbn_traits {
         return !desc::parameters::template contains<dll::no_epoch_error>();
     }
 
+    /*!
+     * \brief Indicates if the DBN computes the training error on epoch
+     * with a complete pass over the training set.
+     */
+    static constexpr bool full_epoch_error() noexcept {
+        return desc::parameters::template contains<dll::full_epoch_error>();
+    }
+
+    /*!
+     * \brief Indicates if the validation set is evaluated concurrently with
+     * the next training epoch.
+     */
+    static constexpr bool overlapped_validation() noexcept {
+        return desc::parameters::template contains<dll::overlapped_validation>();
+    }
+
     /*!
      * \brief Indicates if early stopping strategy is forced to use
      * training statistics when validation statistics are available.
@@ -86,6 +110,54 @@ struct dbn_traits {
         return desc::parameters::template contains<svm_concatenate>();
     }
 
+    /*!
+     * \brief Indicates if the inference plans of the DBN use the NCHWc
+     * layout for the convolutional layers
+     */
+    static constexpr bool blocked_inference() noexcept {
+        return desc::parameters::template contains<dll::blocked_inference>();
+    }
+
+    /*!
+     * \brief Indicates if the errors of the non-adjacent layers share their
+     * memory during SGD training
+     */
+    static constexpr bool shared_errors() noexcept {
+        return desc::parameters::template contains<dll::shared_errors>();
+    }
+
+    /*!
+     * \brief Indicates if the weights are updated without the fused passes
+     * during SGD training
+     */
+    static constexpr bool unfused_updates() noexcept {
+        return desc::parameters::template contains<dll::unfused_updates>();
+    }
+
+    /*!
+     * \brief Indicates if the SGD training is resident on the GPU (in
+     * ETL_GPU builds)
+     */
+    static constexpr bool is_gpu_resident() noexcept {
+        return desc::parameters::template contains<dll::gpu_resident>();
+    }
+
+    /*!
+     * \brief Indicates if the activations are recomputed from checkpoints
+     * during SGD training
+     */
+    static constexpr bool recomputes_activations() noexcept {
+        return desc::RecomputeSegment > 1;
+    }
+
+    /*!
+     * \brief Returns the number of layers of each segment of recomputed
+     * activations during SGD training
+     */
+    static constexpr size_t recompute_segment_size() noexcept {
+        return desc::RecomputeSegment;
+    }
+
     /*!
      * \brief Indicates if the DBN cannot use threading
      */
@@ -93,6 +165,57 @@ struct dbn_traits {
         return desc::parameters::template contains<serial>();
     }
 
+    /*!
+     * \brief Indicates if the DBN is trained with data-parallel SGD
+     */
+    static constexpr bool is_data_parallel() noexcept {
+        return desc::Shards > 1;
+    }
+
+    /*!
+     * \brief Returns the number of shards of each batch for data-parallel SGD
+     */
+    static constexpr size_t shards() noexcept {
+        return desc::Shards;
+    }
+
+    /*!
+     * \brief Indicates if the shards of data-parallel SGD apply their
+     * updates asynchronously (Hogwild)
+     */
+    static constexpr bool is_hogwild() noexcept {
+        return desc::parameters::template contains<dll::hogwild>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN is trained with pipeline-parallel SGD
+     */
+    static constexpr bool is_pipeline_parallel() noexcept {
+        return desc::PipelineStages > 1;
+    }
+
+    /*!
+     * \brief Returns the number of stages for pipeline-parallel SGD
+     */
+    static constexpr size_t pipeline_stages() noexcept {
+        return desc::PipelineStages;
+    }
+
+    /*!
+     * \brief Returns the number of micro-batches of each batch for
+     * pipeline-parallel SGD
+     */
+    static constexpr size_t micro_batches() noexcept {
+        return desc::MicroBatches;
+    }
+
+    /*!
+     * \brief Returns the number of first layers frozen during SGD training
+     */
+    static constexpr size_t frozen_prefix() noexcept {
+        return desc::FrozenPrefix;
+    }
+
     /*!
      * \brief Indicates if the DBN is verbose
      */
@@ -0,0 +1,70 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file extern_templates.hpp
+ * \brief Explicit instantiations of the common dynamic layers
+ *
+ * The dynamic layers only depend on their descriptor: their inputs and
+ * outputs are always etl::dyn_matrix of the same dimensions, whatever the
+ * size of the network. The float dense, convolutional, pooling and RBM
+ * layers with their common activations are instantiated once in the
+ * libdll_instances library (lib/src/extern_templates.cpp), with their
+ * forward passes on dyn_matrix batches.
+ *
+ * When DLL_EXTERN_TEMPLATES is defined, these instantiations are declared
+ * extern and the translation units using these layers do not instantiate
+ * them again; the program must then be linked with libdll_instances. The
+ * other layers, and the SGD contexts which depend on the network, are
+ * still instantiated in each translation unit.
+ *
+ * The compiler may still instantiate the functions it wants to inline, the
+ * savings are the largest in debug builds.
+ */
+
+#pragma once
+
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/pooling/dyn_mp_layer.hpp"
+#include "dll/rbm/dyn_rbm.hpp"
+
+/*!
+ * \brief Instantiate a dynamic layer and its forward pass, with the given
+ * prefix (extern for a declaration, nothing for a definition)
+ */
+#define DLL_INSTANTIATE_DYN_NEURAL(EXTERN, LAYER, DESC, D)                                                                                     \
+    EXTERN template struct dll::LAYER<DESC>;                                                                                                   \
+    EXTERN template void dll::LAYER<DESC>::forward_batch<DESC::activation_function, etl::dyn_matrix<float, D>&, etl::dyn_matrix<float, D>>(   \
+        etl::dyn_matrix<float, D>&, const etl::dyn_matrix<float, D>&) const;                                                                   \
+    EXTERN template void dll::LAYER<DESC>::test_forward_batch<DESC::activation_function, etl::dyn_matrix<float, D>, etl::dyn_matrix<float, D>&>( \
+        etl::dyn_matrix<float, D>&, const etl::dyn_matrix<float, D>&) const;
+
+/*!
+ * \copydoc DLL_INSTANTIATE_DYN_NEURAL
+ */
+#define DLL_INSTANTIATE_DYN_POOLING(EXTERN, LAYER, DESC, D) \
+    EXTERN template struct dll::LAYER<DESC>;               \
+    EXTERN template void dll::LAYER<DESC>::forward_batch<etl::dyn_matrix<float, D>, etl::dyn_matrix<float, D>>(etl::dyn_matrix<float, D>&, const etl::dyn_matrix<float, D>&) const;
+
+/*!
+ * \brief All the common instantiations, with the given prefix
+ */
+#define DLL_COMMON_INSTANTIATIONS(EXTERN)                                                                    \
+    DLL_INSTANTIATE_DYN_NEURAL(EXTERN, dyn_dense_layer_impl, dll::dyn_dense_layer_desc<>, 2)                 \
+    DLL_INSTANTIATE_DYN_NEURAL(EXTERN, dyn_dense_layer_impl, dll::dyn_dense_layer_desc<dll::relu>, 2)        \
+    DLL_INSTANTIATE_DYN_NEURAL(EXTERN, dyn_dense_layer_impl, dll::dyn_dense_layer_desc<dll::softmax>, 2)     \
+    DLL_INSTANTIATE_DYN_NEURAL(EXTERN, dyn_conv_layer_impl, dll::dyn_conv_layer_desc<>, 4)                   \
+    DLL_INSTANTIATE_DYN_NEURAL(EXTERN, dyn_conv_layer_impl, dll::dyn_conv_layer_desc<dll::relu>, 4)          \
+    DLL_INSTANTIATE_DYN_POOLING(EXTERN, dyn_mp_2d_layer_impl, dll::dyn_mp_2d_layer_desc<>, 3)                \
+    DLL_INSTANTIATE_DYN_POOLING(EXTERN, dyn_mp_3d_layer_impl, dll::dyn_mp_3d_layer_desc<>, 4)                \
+    EXTERN template struct dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>;                                           \
+    EXTERN template struct dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>;
+
+#ifdef DLL_EXTERN_TEMPLATES
+DLL_COMMON_INSTANTIATIONS(extern)
+#endif
@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include "dll/util/fast_math.hpp"
+
 namespace dll {
 
 /*!
@@ -72,8 +74,59 @@ decltype(auto) f_activate(E&& expr) {
     }
 }
 
+/*!
+ * \brief Indicates if the given activation function has a fast approximation
+ */
+template <function F>
+constexpr bool has_fast_function = F == function::SIGMOID || F == function::TANH || F == function::SOFTMAX;
+
+/*!
+ * \brief Apply the activation function to the given output, in place, with
+ * the given precision.
+ *
+ * The fast approximations are only used on containers with direct memory
+ * access, the softmax being computed on each row of a matrix (and exactly
+ * on the containers of more dimensions).
+ *
+ * \param output The output to activate
+ * \tparam F The activation function to use
+ * \tparam P The precision of the activation function
+ */
+template <function F, function_precision P = function_precision::EXACT, typename O>
+void f_activate_inplace(O&& output) {
+    using output_t = std::decay_t<O>;
+
+    constexpr bool fast = P == function_precision::FAST && has_fast_function<F> && etl::is_dma<output_t>
+                          && (F != function::SOFTMAX || etl::dimensions<output_t>() <= 2);
+
+    if constexpr (fast) {
+        output.ensure_cpu_up_to_date();
+
+        auto* memory   = output.memory_start();
+        const size_t n = etl::size(output);
+
+        if constexpr (F == function::SIGMOID) {
+            fast_sigmoid(memory, n);
+        } else if constexpr (F == function::TANH) {
+            fast_tanh(memory, n);
+        } else {
+            const size_t rows = etl::dimensions<output_t>() == 2 ? etl::dim<0>(output) : 1;
+
+            fast_softmax(memory, rows, n / rows);
+        }
+
+        output.invalidate_gpu();
+    } else if constexpr (F != function::IDENTITY) {
+        output = f_activate<F>(output);
+    }
+}
+
 /*!
  * \brief Computes the derivatives from the given output using the specified activation function
+ *
+ * The derivatives are computed from the outputs, without transcendental
+ * functions, they are the same for all the precisions.
+ *
  * \param expr The input expression
  * \tparam F The activation function to use
  * \return The derivative of the activation function
@@ -95,4 +148,96 @@ decltype(auto) f_derivative(E&& expr) {
     }
 }
 
+/*!
+ * \brief Indicates if the given activation function is computed
+ * independently on each element and can therefore be fused with other
+ * element-wise operations.
+ */
+template <function F>
+constexpr bool is_elementwise_function = F != function::SOFTMAX;
+
+/*!
+ * \brief Add the biases and apply the activation function to a batch of
+ * dense outputs, in place.
+ *
+ * For element-wise activation functions, each sample is biased and
+ * activated in a single pass, while it is still in cache.
+ *
+ * \param output The batch of outputs (Batch x N)
+ * \param b The biases (N)
+ * \tparam F The activation function to use
+ * \tparam Bias Indicates if the biases are added
+ * \tparam P The precision of the activation function
+ */
+template <function F, bool Bias, function_precision P = function_precision::EXACT, typename O, typename B>
+void f_bias_activate_2d(O&& output, const B& b) {
+    if constexpr (!Bias) {
+        cpp_unused(b);
+
+        f_activate_inplace<F, P>(output);
+    } else if constexpr (P == function_precision::FAST && has_fast_function<F>) {
+        output = bias_add_2d(output, b);
+        f_activate_inplace<F, P>(output);
+    } else if constexpr (is_elementwise_function<F>) {
+        for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+            output(i) = f_activate<F>(output(i) + b);
+        }
+    } else {
+        output = bias_add_2d(output, b);
+        output = f_activate<F>(output);
+    }
+}
+
+/*!
+ * \brief Add the biases to a batch of feature maps, in place.
+ *
+ * Each bias is broadcast over its feature map, no replicated biases are
+ * created.
+ *
+ * \param output The batch of feature maps (Batch x K x N1 x N2)
+ * \param b The biases (K)
+ */
+template <typename O, typename B>
+void add_bias_4d(O&& output, const B& b) {
+    for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+        for (size_t k = 0; k < etl::dim<1>(output); ++k) {
+            output(i)(k) += b(k);
+        }
+    }
+}
+
+/*!
+ * \brief Add the biases and apply the activation function to a batch of
+ * convolutional outputs, in place.
+ *
+ * For element-wise activation functions, each feature map is biased and
+ * activated in a single pass, while it is still in cache.
+ *
+ * \param output The batch of outputs (Batch x K x N1 x N2)
+ * \param b The biases (K)
+ * \tparam F The activation function to use
+ * \tparam Bias Indicates if the biases are added
+ * \tparam P The precision of the activation function
+ */
+template <function F, bool Bias, function_precision P = function_precision::EXACT, typename O, typename B>
+void f_bias_activate_4d(O&& output, const B& b) {
+    if constexpr (!Bias) {
+        cpp_unused(b);
+
+        f_activate_inplace<F, P>(output);
+    } else if constexpr (P == function_precision::FAST && is_elementwise_function<F> && has_fast_function<F>) {
+        add_bias_4d(output, b);
+        f_activate_inplace<F, P>(output);
+    } else if constexpr (is_elementwise_function<F>) {
+        for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+            for (size_t k = 0; k < etl::dim<1>(output); ++k) {
+                output(i)(k) = f_activate<F>(output(i)(k) + b(k));
+            }
+        }
+    } else {
+        output = bias_add_4d(output, b);
+        output = f_activate<F>(output);
+    }
+}
+
 } //end of dll namespace
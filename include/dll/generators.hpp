@@ -38,6 +38,45 @@ struct is_generator_impl<T, decltype((void)T::dll_generator, 0)> : std::true_typ
 template <typename T>
 constexpr bool is_generator = is_generator_impl<T>::value;
 
+/*!
+ * \brief Traits to test if a generator can hold the lengths of
+ * variable-length sequences
+ */
+template <typename T, typename = int>
+struct generator_has_lengths_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a generator can hold the lengths of
+ * variable-length sequences
+ */
+template <typename T>
+struct generator_has_lengths_impl<T, decltype((void)std::declval<const T&>().length_batch(), 0)> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator can hold the lengths of
+ * variable-length sequences
+ */
+template <typename T>
+constexpr bool generator_has_lengths = generator_has_lengths_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a generator prefetches its batches in threads
+ */
+template <typename T, typename = int>
+struct generator_has_prefetch_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a generator prefetches its batches in threads
+ */
+template <typename T>
+struct generator_has_prefetch_impl<T, decltype((void)std::declval<const T&>().prefetch(), 0)> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator prefetches its batches in threads
+ */
+template <typename T>
+constexpr bool generator_has_prefetch = generator_has_prefetch_impl<T>::value;
+
 /*!
  * \brief Helper to tell from the generator description if it is
  * augmenting the data
@@ -47,6 +86,55 @@ constexpr bool is_augmented =
             (Desc::random_crop_x > 0 && Desc::random_crop_y > 0)
         ||  Desc::HorizontalMirroring || Desc::VerticalMirroring || Desc::Noise || Desc::ElasticDistortion;
 
+/*!
+ * \brief Traits to test if a generator gives the same samples at each
+ * epoch (a DLL generator without augmentation)
+ */
+template <typename T, typename = int>
+struct generator_is_replayable_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a generator gives the same samples at each
+ * epoch (a DLL generator without augmentation)
+ */
+template <typename T>
+struct generator_is_replayable_impl<T, decltype((void)T::dll_generator, 0)> : std::bool_constant<!is_augmented<typename T::desc>> {};
+
+/*!
+ * \brief Traits to test if a generator gives the same samples at each
+ * epoch (a DLL generator without augmentation)
+ */
+template <typename T>
+constexpr bool generator_is_replayable = generator_is_replayable_impl<T>::value;
+
+/*!
+ * \brief Traits to test if the samples of a generator can be read one by
+ * one, by index, always in the same order
+ */
+template <typename T, typename = int>
+struct generator_is_indexable_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if the samples of a generator can be read one by
+ * one, by index, always in the same order
+ */
+template <typename T>
+struct generator_is_indexable_impl<T, decltype((void)T::indexable, 0)> : std::bool_constant<T::indexable && generator_is_replayable<T>> {};
+
+/*!
+ * \brief Traits to test if the samples of a generator can be read one by
+ * one, by index, always in the same order
+ */
+template <typename T>
+constexpr bool generator_is_indexable = generator_is_indexable_impl<T>::value;
+
+/*!
+ * \brief Helper to tell from the generator description if it stores its
+ * samples in a compact type
+ */
+template<typename Desc>
+constexpr bool is_compact = !std::is_void<typename cache_storage<Desc, void>::type>::value;
+
 /*!
  * \brief Helper to tell from the generator description if it is
  * threaded.
@@ -58,3 +146,5 @@ static constexpr bool is_threaded = Desc::Threaded;
 
 #include "dll/generators/inmemory_data_generator.hpp"
 #include "dll/generators/outmemory_data_generator.hpp"
+#include "dll/generators/view_data_generator.hpp"
+#include "dll/generators/shard.hpp"
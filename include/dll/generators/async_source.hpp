@@ -0,0 +1,274 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file async_source.hpp
+ * \brief Asynchronous user data sources for the out-of-memory generators.
+ *
+ * A source only has to start the read of a sample and to complete it
+ * later, from any thread:
+ *
+ *     struct my_source {
+ *         using value_type = etl::fast_dyn_matrix<float, 784>;
+ *
+ *         size_t size() const;
+ *
+ *         template <typename Done>
+ *         void read(size_t index, Done done); // done(sample) once the sample is read
+ *     };
+ *
+ * The reader keeps a window of reads in flight ahead of the generator, so
+ * that many reads overlap without one thread per read: the source can
+ * complete them from its own I/O threads or from the callbacks of an
+ * asynchronous API. The generator only waits when the next sample is not
+ * read yet.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief Read the samples of an asynchronous source in order, with a window
+ * of reads in flight.
+ *
+ * \tparam Source The asynchronous source
+ * \tparam W The maximum number of reads in flight
+ */
+template <typename Source, size_t W = 64>
+struct async_reader {
+    using source_t   = Source;                         ///< The type of the source
+    using value_type = typename source_t::value_type; ///< The type of the samples
+
+    static constexpr size_t window = W; ///< The maximum number of reads in flight
+
+    static_assert(W > 0, "At least one read must be in flight");
+
+    /*!
+     * \brief The completion of the read of one sample
+     */
+    struct completion {
+        async_reader* reader; ///< The reader waiting for the sample
+        size_t index;         ///< The index of the sample
+
+        /*!
+         * \brief Complete the read with the given sample
+         */
+        void operator()(value_type value) const {
+            reader->complete(index, std::move(value));
+        }
+    };
+
+    /*!
+     * \brief Construct a reader for the given source. No read is started
+     * before the first sample is requested.
+     */
+    explicit async_reader(source_t source) : source(std::move(source)), slots(window) {}
+
+    async_reader(const async_reader& rhs) = delete;
+    async_reader& operator=(const async_reader& rhs) = delete;
+
+    /*!
+     * \brief Wait for the reads in flight
+     */
+    ~async_reader() {
+        drain();
+    }
+
+    /*!
+     * \brief Returns the number of samples of the source
+     */
+    size_t size() const {
+        return source.size();
+    }
+
+    /*!
+     * \brief Returns the given sample, waiting for its read to complete
+     */
+    value_type get(size_t index) {
+        // The same sample can be requested twice in a row
+        if (current && index + 1 == current) {
+            return last;
+        }
+
+        if (index != current || !started) {
+            restart(index);
+        }
+
+        auto& slot = slots[index % window];
+
+        {
+            std::unique_lock<std::mutex> l(lock);
+            ready_cv.wait(l, [&slot, index] { return slot.ready && slot.index == index; });
+
+            last       = std::move(slot.value);
+            slot.ready = false;
+        }
+
+        ++current;
+
+        // The slot is free for the read at the end of the window
+        start_read(index + window);
+
+        return last;
+    }
+
+private:
+    /*!
+     * \brief The slot of one read
+     */
+    struct slot_t {
+        value_type value;     ///< The read sample
+        size_t index = 0;     ///< The index of the sample
+        bool ready   = false; ///< Indicates if the read is complete
+    };
+
+    /*!
+     * \brief Start the read of the given sample, if it is in the source
+     */
+    void start_read(size_t index) {
+        if (index >= source.size()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            ++in_flight;
+        }
+
+        source.read(index, completion{this, index});
+    }
+
+    /*!
+     * \brief Store a completed read and wake up the consumer
+     */
+    void complete(size_t index, value_type value) {
+        std::lock_guard<std::mutex> l(lock);
+
+        auto& slot = slots[index % window];
+
+        slot.value = std::move(value);
+        slot.index = index;
+        slot.ready = true;
+
+        --in_flight;
+
+        ready_cv.notify_all();
+    }
+
+    /*!
+     * \brief Wait for all the reads in flight
+     */
+    void drain() {
+        std::unique_lock<std::mutex> l(lock);
+        ready_cv.wait(l, [this] { return !in_flight; });
+
+        for (auto& slot : slots) {
+            slot.ready = false;
+        }
+    }
+
+    /*!
+     * \brief Start the window of reads from the given sample, once the
+     * reads of the previous window are complete
+     */
+    void restart(size_t index) {
+        drain();
+
+        current = index;
+        started = true;
+
+        for (size_t i = index; i < index + window; ++i) {
+            start_read(i);
+        }
+    }
+
+    source_t source;                  ///< The source
+    std::vector<slot_t> slots;        ///< The slots of the reads of the window
+    std::mutex lock;                  ///< The lock protecting the slots
+    std::condition_variable ready_cv; ///< The condition of completed reads
+
+    size_t in_flight = 0;     ///< The number of reads in flight
+    size_t current   = 0;     ///< The next sample to be returned
+    bool started     = false; ///< Indicates if the reads have been started
+    value_type last;          ///< The last returned sample
+};
+
+/*!
+ * \brief Input iterator on the samples of an asynchronous reader
+ */
+template <typename Reader>
+struct async_source_iterator {
+    using iterator_category = std::input_iterator_tag;     ///< The category of the iterator
+    using value_type        = typename Reader::value_type; ///< The type of the samples
+    using difference_type   = std::ptrdiff_t;              ///< The type of the distances
+    using pointer           = value_type*;                 ///< The type of pointer to a sample
+    using reference         = value_type;                  ///< The type returned by dereference
+
+    std::shared_ptr<Reader> reader; ///< The reader of the source
+    size_t index;                   ///< The index of the sample
+
+    /*!
+     * \brief Construct an iterator on the given sample of the reader
+     */
+    async_source_iterator(std::shared_ptr<Reader> reader, size_t index) : reader(std::move(reader)), index(index) {}
+
+    async_source_iterator& operator++() {
+        ++index;
+        return *this;
+    }
+
+    async_source_iterator operator++(int) {
+        auto it = *this;
+        ++index;
+        return it;
+    }
+
+    value_type operator*() const {
+        return reader->get(index);
+    }
+
+    bool operator==(const async_source_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const async_source_iterator& rhs) const {
+        return index != rhs.index;
+    }
+};
+
+/*!
+ * \brief Create the iterators on the samples of the given asynchronous
+ * source, to be given to an out-of-memory generator.
+ *
+ * The samples must be read in order, the iterators of one source cannot be
+ * shared by several generators.
+ *
+ * \tparam W The maximum number of reads in flight
+ * \param source The asynchronous source
+ *
+ * \return The pair of the first and the last iterators
+ */
+template <size_t W = 64, typename Source>
+auto make_async_source(Source source) {
+    using reader_t = async_reader<Source, W>;
+
+    auto reader = std::make_shared<reader_t>(std::move(source));
+
+    const size_t n = reader->size();
+
+    return std::make_pair(async_source_iterator<reader_t>(reader, 0), async_source_iterator<reader_t>(reader, n));
+}
+
+} //end of dll namespace
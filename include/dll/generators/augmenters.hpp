@@ -7,10 +7,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <thread>
+#include <vector>
 
+#include "dll/util/philox.hpp"
 #include "dll/util/random.hpp"
+#include "dll/noise_type.hpp"
 
 namespace dll {
 
@@ -64,19 +69,14 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      *
      * \param target The target output
      * \param image The input image
+     * \param g The random engine
      */
     template <typename O, typename T>
-    void transform_first(O&& target, const T& image) {
-        const size_t y_offset = dist_y(dll::rand_engine());
-        const size_t x_offset = dist_x(dll::rand_engine());
+    void transform_first(O&& target, const T& image, random_engine& g) {
+        const size_t y_offset = dist_y(g);
+        const size_t x_offset = dist_x(g);
 
-        for (size_t c = 0; c < etl::dim<0>(image); ++c) {
-            for (size_t y = 0; y < random_crop_y; ++y) {
-                for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
-                }
-            }
-        }
+        crop(target, image, y_offset, x_offset);
     }
 
     /*!
@@ -92,10 +92,38 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
         const size_t y_offset = (x - random_crop_x) / 2;
         const size_t x_offset = (y - random_crop_y) / 2;
 
-        for (size_t c = 0; c < etl::dim<0>(image); ++c) {
-            for (size_t y = 0; y < random_crop_y; ++y) {
-                for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
+        crop(target, image, y_offset, x_offset);
+    }
+
+private:
+    /*!
+     * \brief Copy the crop at the given offsets into the target.
+     *
+     * In memory, the crop is made of contiguous rows, copied at once.
+     */
+    template <typename O, typename T>
+    void crop(O&& target, const T& image, size_t y_offset, size_t x_offset) {
+        const size_t C = etl::dim<0>(image);
+
+        if constexpr (etl::is_dma<std::decay_t<O>> && etl::is_dma<T>) {
+            image.ensure_cpu_up_to_date();
+
+            const auto* in = image.memory_start();
+            auto* out      = target.memory_start();
+
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t r = 0; r < random_crop_y; ++r) {
+                    std::copy_n(in + (c * y + y_offset + r) * x + x_offset, random_crop_x, out + (c * random_crop_y + r) * random_crop_x);
+                }
+            }
+
+            target.invalidate_gpu();
+        } else {
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t y = 0; y < random_crop_y; ++y) {
+                    for (size_t x = 0; x < random_crop_x; ++x) {
+                        target(c, y, x) = image(c, y_offset + y, x_offset + x);
+                    }
                 }
             }
         }
@@ -131,9 +159,12 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x == 0 || Desc::r
      *
      * \param target The target output
      * \param image The input image
+     * \param g The random engine
      */
     template <typename O, typename T>
-    void transform_first(O&& target, const T& image) {
+    void transform_first(O&& target, const T& image, random_engine& g) {
+        cpp_unused(g);
+
         target = image;
     }
 
@@ -199,33 +230,82 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    void transform(O&& target) {
-        auto choice = dist(dll::rand_engine());
+    void transform(O&& target, random_engine& g) {
+        auto choice = dist(g);
 
-        if (horizontal && vertical && choice == 1) {
+        if (flip_vertical(choice)) {
             for (size_t c = 0; c < etl::dim<0>(target); ++c) {
                 target(c) = vflip(target(c));
             }
-        } else if (horizontal && vertical && choice == 2) {
+        } else if (flip_horizontal(choice)) {
             for (size_t c = 0; c < etl::dim<0>(target); ++c) {
                 target(c) = hflip(target(c));
             }
         }
+    }
 
-        if (horizontal && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = hflip(target(c));
+    /*!
+     * \brief Apply the transform on the first n samples of a batch.
+     *
+     * The rows are reversed or swapped in place in memory.
+     *
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     * \param g The random engine
+     */
+    template <typename O>
+    void transform_batch(O&& batch, size_t n, random_engine& g) {
+        if constexpr (etl::is_dma<std::decay_t<O>>) {
+            batch.ensure_cpu_up_to_date();
+
+            const size_t C = etl::dim<1>(batch);
+            const size_t H = etl::dim<2>(batch);
+            const size_t W = etl::dim<3>(batch);
+
+            for (size_t i = 0; i < n; ++i) {
+                auto choice = dist(g);
+                auto* image = batch.memory_start() + i * C * H * W;
+
+                if (flip_vertical(choice)) {
+                    for (size_t c = 0; c < C; ++c) {
+                        auto* channel = image + c * H * W;
+
+                        for (size_t y = 0; y < H / 2; ++y) {
+                            std::swap_ranges(channel + y * W, channel + (y + 1) * W, channel + (H - 1 - y) * W);
+                        }
+                    }
+                } else if (flip_horizontal(choice)) {
+                    for (size_t r = 0; r < C * H; ++r) {
+                        std::reverse(image + r * W, image + (r + 1) * W);
+                    }
+                }
             }
-        }
 
-        if (vertical && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = vflip(target(c));
+            batch.invalidate_gpu();
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                transform(batch(i), g);
             }
         }
     }
+
+private:
+    /*!
+     * \brief Indicates if the given choice flips the image vertically
+     */
+    static bool flip_vertical(size_t choice) {
+        return vertical && choice == 1;
+    }
+
+    /*!
+     * \brief Indicates if the given choice flips the image horizontally
+     */
+    static bool flip_horizontal(size_t choice) {
+        return horizontal && (vertical ? choice == 2 : choice == 1);
+    }
 };
 
 /*!
@@ -253,10 +333,25 @@ struct random_mirrorer<Desc, std::enable_if_t<!Desc::HorizontalMirroring && !Des
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    static void transform(O&& target) {
+    static void transform(O&& target, random_engine& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     * \param g The random engine
+     */
+    template <typename O>
+    static void transform_batch(O&& batch, size_t n, random_engine& g) {
+        cpp_unused(batch);
+        cpp_unused(n);
+        cpp_unused(g);
     }
 };
 
@@ -271,16 +366,18 @@ struct random_noise;
  */
 template <typename Desc>
 struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
-    static constexpr size_t N = Desc::Noise; ///< The amount of noise (in percent)
+    static constexpr size_t N         = Desc::Noise;      ///< The amount of noise (in percent)
+    static constexpr noise_type model = Desc::NoiseModel; ///< The type of noise
 
     std::uniform_int_distribution<size_t> dist; ///< The random distribution
+    std::normal_distribution<double> normal;    ///< The distribution of the gaussian noise
 
     /*!
      * \brief Initialize the random_noise
      * \param image The image to crop from
      */
     template <typename T>
-    random_noise(const T& image) : dist(0, 1000) {
+    random_noise(const T& image) : dist(0, 1000), normal(0.0, N / 100.0) {
         cpp_unused(image);
     }
 
@@ -295,13 +392,95 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    void transform(O&& target) {
-        auto& g = dll::rand_engine();
+    void transform(O&& target, random_engine& g) {
+        if constexpr (model == noise_type::MASKING) {
+            for (auto& v : target) {
+                v *= dist(g) < N * 10 ? 0.0 : 1.0;
+            }
+        } else if constexpr (model == noise_type::GAUSSIAN) {
+            for (auto& v : target) {
+                v += normal(g);
+            }
+        } else if constexpr (model == noise_type::SALT_PEPPER) {
+            for (auto& v : target) {
+                const size_t r = dist(g);
+
+                // Half of the corrupted inputs are set to zero, half to one
+                if (r < N * 10) {
+                    v = r < N * 5 ? 0.0 : 1.0;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch.
+     *
+     * The random numbers come from a counter-based generator, keyed once
+     * for the batch, so that the values are noised in a single pass
+     * without any dependency between them.
+     *
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     * \param g The random engine
+     */
+    template <typename O>
+    void transform_batch(O&& batch, size_t n, random_engine& g) {
+        if constexpr (etl::is_dma<std::decay_t<O>>) {
+            batch.ensure_cpu_up_to_date();
+
+            const philox4x32 generator(g());
 
-        for (auto& v : target) {
-            v *= dist(g) < N * 10 ? 0.0 : 1.0;
+            apply(batch.memory_start(), n * (etl::size(batch) / etl::dim<0>(batch)), generator);
+
+            batch.invalidate_gpu();
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                transform(batch(i), g);
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief Apply the noise on raw memory
+     */
+    template <typename T>
+    static void apply(T* x, size_t n, const philox4x32& generator) {
+        constexpr float p     = N / 100.0f;
+        constexpr float sigma = N / 100.0f;
+
+        for (size_t i = 0; i < n; i += philox4x32::block_size) {
+            auto block = generator(i / philox4x32::block_size);
+
+            const size_t end = std::min(n - i, philox4x32::block_size);
+
+            if constexpr (model == noise_type::MASKING) {
+                for (size_t j = 0; j < end; ++j) {
+                    x[i + j] = philox4x32::uniform(block[j]) < p ? T(0) : x[i + j];
+                }
+            } else if constexpr (model == noise_type::GAUSSIAN) {
+                // Box-Muller, two normal values from two uniform values
+                for (size_t j = 0; j < end; j += 2) {
+                    const float r     = sigma * std::sqrt(-2.0f * std::log(1.0f - philox4x32::uniform(block[j])));
+                    const float theta = float(2.0 * M_PI) * philox4x32::uniform(block[j + 1]);
+
+                    x[i + j] += r * std::cos(theta);
+
+                    if (j + 1 < end) {
+                        x[i + j + 1] += r * std::sin(theta);
+                    }
+                }
+            } else if constexpr (model == noise_type::SALT_PEPPER) {
+                for (size_t j = 0; j < end; ++j) {
+                    const float u = philox4x32::uniform(block[j]);
+
+                    x[i + j] = u < p ? (u < p / 2 ? T(0) : T(1)) : x[i + j];
+                }
+            }
         }
     }
 };
@@ -331,10 +510,25 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    static void transform(O&& target) {
+    static void transform(O&& target, random_engine& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     * \param g The random engine
+     */
+    template <typename O>
+    static void transform_batch(O&& batch, size_t n, random_engine& g) {
+        cpp_unused(batch);
+        cpp_unused(n);
+        cpp_unused(g);
     }
 };
 
@@ -344,33 +538,55 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
 template <typename Desc, typename Enable = void>
 struct elastic_distorter;
 
-// TODO This needs to be made MUCH faster
-
 /*!
  * \copydoc elastic_distorter
+ *
+ * The random displacement fields are expensive to generate, because of
+ * the gaussian blur. A bank of fields is generated once, when the
+ * distorter is created, and each image is distorted with a random field
+ * of the bank, with a random sign. The four pixels and the weights of the
+ * bilinear interpolation of each field are precomputed as well, so that
+ * the warp is a single gather loop over each channel.
  */
 template <typename Desc>
 struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
-    using weight = typename Desc::weight; ///< The data type
+    using weight = float; ///< The type of the displacement fields
 
     static constexpr size_t K     = Desc::ElasticDistortion;         ///< size of elastic distortion kernel
     static constexpr size_t mid   = K / 2;                           ///< Half of the kernel
     static constexpr double sigma = 0.8 + 0.3 * ((K - 1) * 0.5 - 1); ///< Sigma for gaussian kernel
+    static constexpr size_t bank  = 16;                              ///< The number of precomputed fields
+
+    static_assert(K % 2 == 1, "The kernel size must be odd");
+
+    /*!
+     * \brief The precomputed bilinear interpolation of a displacement
+     * field, for both of its signs.
+     */
+    struct field {
+        std::vector<uint32_t> corners[2][4]; ///< The index of the four source pixels of each pixel
+        std::vector<weight> fx[2];           ///< The weight of the second row of each pixel
+        std::vector<weight> fy[2];           ///< The weight of the second column of each pixel
+    };
 
     etl::fast_dyn_matrix<weight, K, K> kernel; ///< The precomputed kernel
 
-    static_assert(K % 2 == 1, "The kernel size must be odd");
+    size_t width  = 0; ///< The first dimension of the distorted images
+    size_t height = 0; ///< The second dimension of the distorted images
+
+    std::vector<field> fields;                  ///< The bank of displacement fields
+    std::vector<weight> source;                 ///< The copy of the channel being distorted
+    std::uniform_int_distribution<size_t> dist; ///< The distribution for picking a field and its sign
 
     /*!
-     * \brief Initialize the elastic_distorter
+     * \brief Initialize the elastic_distorter and generate its bank of
+     * fields.
      * \param image The image to distort
      */
     template <typename T>
-    elastic_distorter(const T& image) {
+    elastic_distorter(const T& image) : dist(0, 2 * bank - 1) {
         static_assert(etl::dimensions<T>() == 3, "elastic_distorter can only be used with 3D images");
 
-        cpp_unused(image);
-
         // Precompute the gaussian kernel
 
         auto gaussian = [](double x, double y) {
@@ -383,6 +599,13 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
                 kernel(i, j) = gaussian(double(i) - mid, double(j) - mid);
             }
         }
+
+        // The images are distorted after the crop
+        if (Desc::random_crop_x && Desc::random_crop_y) {
+            generate(Desc::random_crop_y, Desc::random_crop_x, dll::rand_engine());
+        } else {
+            generate(etl::dim<1>(image), etl::dim<2>(image), dll::rand_engine());
+        }
     }
 
     /*!
@@ -396,63 +619,146 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    void transform(O&& target) {
-        const size_t width  = etl::dim<1>(target);
-        const size_t height = etl::dim<2>(target);
+    void transform(O&& target, random_engine& g) {
+        if (etl::dim<1>(target) != width || etl::dim<2>(target) != height) {
+            generate(etl::dim<1>(target), etl::dim<2>(target), g);
+        }
 
-        // 0. Generate random displacement fields
+        const size_t choice = dist(g);
+        const field& f      = fields[choice / 2];
+        const size_t sign   = choice % 2;
 
-        etl::dyn_matrix<weight> d_x(width, height);
-        etl::dyn_matrix<weight> d_y(width, height);
+        if constexpr (etl::is_dma<std::decay_t<O>>) {
+            target.ensure_cpu_up_to_date();
+
+            warp(target.memory_start(), etl::dim<0>(target), f, sign);
+
+            target.invalidate_gpu();
+        } else {
+            auto tmp = etl::force_temporary(target);
 
-        d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-        d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+            warp(tmp.memory_start(), etl::dim<0>(tmp), f, sign);
+
+            target = tmp;
+        }
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     * \param g The random engine
+     */
+    template <typename O>
+    void transform_batch(O&& batch, size_t n, random_engine& g) {
+        for (size_t i = 0; i < n; ++i) {
+            transform(batch(i), g);
+        }
+    }
+
+private:
+    /*!
+     * \brief Warp the channels of an image, in place, with the given field
+     */
+    template <typename T>
+    void warp(T* image, size_t channels, const field& f, size_t sign) {
+        const size_t S = width * height;
 
-        // 1. Gaussian blur the displacement fields
+        const uint32_t* a = f.corners[sign][0].data();
+        const uint32_t* b = f.corners[sign][1].data();
+        const uint32_t* c = f.corners[sign][2].data();
+        const uint32_t* d = f.corners[sign][3].data();
+        const weight* fx  = f.fx[sign].data();
+        const weight* fy  = f.fy[sign].data();
+
+        source.resize(S);
+
+        for (size_t channel = 0; channel < channels; ++channel) {
+            T* out = image + channel * S;
+
+            std::copy_n(out, S, source.begin());
+
+            const weight* in = source.data();
+
+            for (size_t k = 0; k < S; ++k) {
+                const weight top    = in[a[k]] + fx[k] * (in[b[k]] - in[a[k]]);
+                const weight bottom = in[d[k]] + fx[k] * (in[c[k]] - in[d[k]]);
+
+                out[k] = T(top + fy[k] * (bottom - top));
+            }
+        }
+    }
+
+    /*!
+     * \brief Generate the bank of fields for images of the given size
+     */
+    void generate(size_t w, size_t h, random_engine& g) {
+        width  = w;
+        height = h;
+
+        fields.resize(bank);
+
+        etl::dyn_matrix<weight> d_x(width, height);
+        etl::dyn_matrix<weight> d_y(width, height);
 
         etl::dyn_matrix<weight> d_x_blur(width, height);
         etl::dyn_matrix<weight> d_y_blur(width, height);
 
-        gaussian_blur(d_x, d_x_blur);
-        gaussian_blur(d_y, d_y_blur);
+        for (auto& f : fields) {
+            // 0. Generate random displacement fields
 
-        // 2. Normalize and scale the displacement field
+            d_x = etl::uniform_generator(g, -1.0, 1.0);
+            d_y = etl::uniform_generator(g, -1.0, 1.0);
 
-        d_x_blur *= (weight(8) / sum(d_x_blur));
-        d_y_blur *= (weight(8) / sum(d_y_blur));
+            // 1. Gaussian blur the displacement fields
 
-        // 3. Apply the displacement field (using bilinear interpolation)
+            gaussian_blur(d_x, d_x_blur);
+            gaussian_blur(d_y, d_y_blur);
 
-        auto safe = [&](size_t channel, weight x, weight y) {
-            if (x < 0 || y < 0 || x > width - 1 || y > height - 1) {
-                return target(channel, 0UL, 0UL);
-            } else {
-                return target(channel, size_t(x), size_t(y));
-            }
-        };
+            // 2. Normalize and scale the displacement field
+
+            d_x_blur *= (weight(8) / sum(d_x_blur));
+            d_y_blur *= (weight(8) / sum(d_y_blur));
 
-        for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
-            for (int x = 0; x < int(width); ++x) {
-                for (int y = 0; y < int(height); ++y) {
-                    auto dx = d_x_blur(x, y);
-                    auto dy = d_y_blur(x, y);
+            // 3. Precompute the bilinear interpolation, for both signs
 
-                    weight px = x + dx;
-                    weight py = y + dy;
+            for (size_t sign = 0; sign < 2; ++sign) {
+                const weight s = sign ? weight(-1) : weight(1);
 
-                    weight a = safe(channel, std::floor(px), std::floor(py));
-                    weight b = safe(channel, std::ceil(px), std::floor(py));
-                    weight c = safe(channel, std::ceil(px), std::ceil(py));
-                    weight d = safe(channel, std::floor(px), std::ceil(py));
+                for (auto& corner : f.corners[sign]) {
+                    corner.resize(width * height);
+                }
+
+                f.fx[sign].resize(width * height);
+                f.fy[sign].resize(width * height);
+
+                // The pixels outside of the image are read from the first pixel
+                auto index = [&](weight x, weight y) -> uint32_t {
+                    if (x < 0 || y < 0 || x > width - 1 || y > height - 1) {
+                        return 0;
+                    } else {
+                        return uint32_t(size_t(x) * height + size_t(y));
+                    }
+                };
+
+                for (size_t x = 0; x < width; ++x) {
+                    for (size_t y = 0; y < height; ++y) {
+                        const size_t k = x * height + y;
 
-                    auto e = a * (1.0 - (px - std::floor(px))) + d * (px - std::floor(px));
-                    auto f = b * (1.0 - (px - std::floor(px))) + c * (px - std::floor(px));
+                        const weight px = x + s * d_x_blur(x, y);
+                        const weight py = y + s * d_y_blur(x, y);
 
-                    auto value = e * (1.0 - (py - std::floor(py))) + f * (py - std::floor(py));
+                        f.corners[sign][0][k] = index(std::floor(px), std::floor(py));
+                        f.corners[sign][1][k] = index(std::ceil(px), std::floor(py));
+                        f.corners[sign][2][k] = index(std::ceil(px), std::ceil(py));
+                        f.corners[sign][3][k] = index(std::floor(px), std::ceil(py));
 
-                    target(channel, x, y) = value;
+                        f.fx[sign][k] = px - std::floor(px);
+                        f.fy[sign][k] = py - std::floor(py);
+                    }
                 }
             }
         }
@@ -462,17 +768,17 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
      * \brief Apply a gaussian blur on the distortion matrix
      */
     void gaussian_blur(const etl::dyn_matrix<weight>& d, etl::dyn_matrix<weight>& d_blur) {
-        const size_t width  = etl::dim<0>(d);
-        const size_t height = etl::dim<1>(d);
+        const size_t w = etl::dim<0>(d);
+        const size_t h = etl::dim<1>(d);
 
-        for (size_t j = 0; j < width; ++j) {
-            for (size_t k = 0; k < height; ++k) {
+        for (size_t j = 0; j < w; ++j) {
+            for (size_t k = 0; k < h; ++k) {
                 weight sum(0.0);
 
                 for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - mid >= 0 && long(j) + p - mid < width) {
+                    if (long(j) + p - mid >= 0 && long(j) + p - mid < w) {
                         for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - mid >= 0 && long(k) + q - mid < height) {
+                            if (long(k) + q - mid >= 0 && long(k) + q - mid < h) {
                                 sum += kernel(p, q) * d(j + p - mid, k + q - mid);
                             }
                         }
@@ -510,10 +816,105 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion == 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    static void transform(O&& target) {
+    static void transform(O&& target, random_engine& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     * \param g The random engine
+     */
+    template <typename O>
+    static void transform_batch(O&& batch, size_t n, random_engine& g) {
+        cpp_unused(batch);
+        cpp_unused(n);
+        cpp_unused(g);
+    }
+};
+
+/*!
+ * \brief The complete augmentation of the samples, with its own random
+ * engine.
+ *
+ * Each augmentation thread of a generator owns one, so that the
+ * augmentation of several batches can run concurrently.
+ */
+template <typename Desc>
+struct data_augmenter {
+    random_engine engine;              ///< The random engine of the augmentation
+    random_cropper<Desc> cropper;      ///< The random cropper
+    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
+    elastic_distorter<Desc> distorter; ///< The elastic distorter
+    random_noise<Desc> noiser;         ///< The random noiser
+
+    /*!
+     * \brief Initialize the augmenter.
+     *
+     * The random engine is seeded from the DLL random engine, so that the
+     * generation stays reproducible with a fixed seed.
+     *
+     * \param image An example image
+     */
+    template <typename T>
+    data_augmenter(const T& image)
+            : engine(dll::rand_engine()()), cropper(image), mirrorer(image), distorter(image), noiser(image) {}
+
+    /*!
+     * \brief The number of generated images from one input image
+     * \return The augmentation factor
+     */
+    size_t scaling() const {
+        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling();
+    }
+
+    /*!
+     * \brief Randomly crop the image into the target
+     * \param target The target output
+     * \param image The input image
+     */
+    template <typename O, typename T>
+    void transform_first(O&& target, const T& image) {
+        cropper.transform_first(target, image, engine);
+    }
+
+    /*!
+     * \brief Center crop the image into the target
+     * \param target The target output
+     * \param image The input image
+     */
+    template <typename O, typename T>
+    void transform_first_test(O&& target, const T& image) {
+        cropper.transform_first_test(target, image);
+    }
+
+    /*!
+     * \brief Mirror, distort and noise the (cropped) target
+     * \param target The input to transform
+     */
+    template <typename O>
+    void transform(O&& target) {
+        mirrorer.transform(target, engine);
+        distorter.transform(target, engine);
+        noiser.transform(target, engine);
+    }
+
+    /*!
+     * \brief Mirror, distort and noise the first n (cropped) samples of
+     * a batch, one transform at a time over the whole batch
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     */
+    template <typename O>
+    void transform_batch(O&& batch, size_t n) {
+        mirrorer.transform_batch(batch, n, engine);
+        distorter.transform_batch(batch, n, engine);
+        noiser.transform_batch(batch, n, engine);
     }
 };
 
@@ -12,6 +12,22 @@
 
 namespace dll {
 
+/*!
+ * \brief Helper to get the type used to store the samples of a generator
+ */
+template <typename Desc, typename T, typename Enable = void>
+struct cache_storage {
+    using type = T; ///< The storage type
+};
+
+/*!
+ * \copydoc cache_storage
+ */
+template <typename Desc, typename T>
+struct cache_storage<Desc, T, std::enable_if_t<!std::is_void<typename Desc::storage_type>::value>> {
+    using type = typename Desc::storage_type; ///< The storage type
+};
+
 /*!
  * \brief Helper to create and initialize a cache for inputs
  *
@@ -27,8 +43,9 @@ struct cache_helper;
 template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
+    using S = typename cache_storage<Desc, T>::type;                             ///< Storage type
 
-    using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
+    using cache_type     = etl::dyn_matrix<S, 2>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
@@ -62,8 +79,9 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::it
 template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
+    using S = typename cache_storage<Desc, T>::type;                             ///< Storage type
 
-    using cache_type     = etl::dyn_matrix<T, 4>; ///< The type of the cache
+    using cache_type     = etl::dyn_matrix<S, 4>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 5>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
@@ -102,8 +120,9 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::it
 template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_2d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
+    using S = typename cache_storage<Desc, T>::type;                             ///< Storage type
 
-    using cache_type     = etl::dyn_matrix<T, 3>; ///< The type of the cache
+    using cache_type     = etl::dyn_matrix<S, 3>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 4>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
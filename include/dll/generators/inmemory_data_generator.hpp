@@ -12,9 +12,17 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <numeric>
 #include <thread>
 
+#include "dll/util/batch_ring.hpp"
+#include "dll/util/placement.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/util/trace.hpp"
+#include "dll/util/random_stream.hpp"
+
 namespace dll {
 
 /*!
@@ -27,7 +35,7 @@ struct inmemory_data_generator;
  * \copydoc inmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc>>> {
+struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_compact<Desc>>> {
     using desc                 = Desc;                                                              ///< The generator descriptor
     using weight               = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< The data type
     using data_cache_helper_t  = cache_helper<Desc, Iterator>;                                      ///< The helper for the data cache
@@ -40,17 +48,35 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
 
     static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
 
+    /*!
+     * \brief Indicates if the labels can be the inputs themselves, for
+     * autoencoders without augmentation
+     */
+    static constexpr bool aliasable = desc::AutoEncoder && std::is_same_v<data_cache_type, label_cache_type>;
+
     data_cache_type input_cache;  ///< The input cache
-    label_cache_type label_cache; ///< The label cache
+    label_cache_type label_cache; ///< The label cache (empty if aliased)
+
+    mutable etl::dyn_matrix<weight, 2> label_batch_cache; ///< The one-hot labels of the current batch (sparse labels only)
+
+    std::vector<size_t> lengths; ///< The length of each sequence (empty if all the sequences are full)
 
     size_t current = 0;     ///< The current index
     bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+    bool aliased   = false; ///< Indicates if the labels are the inputs themselves
+
+    random_stream engine; ///< The random stream of the shuffles
 
     template <typename Input, typename Label>
     inmemory_data_generator(const Input& input, const Label& label, size_t n, size_t n_classes){
         // Initialize both caches for enough elements
         data_cache_helper_t::init(n, &input, input_cache);
         label_cache_helper_t::init(n, n_classes, &label, label_cache);
+
+        placement::place(input_cache);
+        placement::place(label_cache);
+
+        init_label_batch(n_classes);
     }
 
     /*!
@@ -59,8 +85,20 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes){
         const size_t n = std::distance(first, last);
 
+        // The labels of an autoencoder read from the inputs are not copied
+        if constexpr (aliasable && std::is_same_v<Iterator, LIterator> && std::is_lvalue_reference_v<decltype(*first)>) {
+            aliased = n && &*first == &*lfirst;
+        }
+
         data_cache_helper_t::init(n, first, input_cache);
-        label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        placement::place(input_cache);
+
+        if (!aliased) {
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+            placement::place(label_cache);
+        }
+
+        init_label_batch(n_classes);
 
         // Fill the cache
 
@@ -68,7 +106,9 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         while (first != last) {
             input_cache(i) = *first;
 
-            label_cache_helper_t::set(i, lfirst, label_cache);
+            if (!aliased) {
+                label_cache_helper_t::store(i, lfirst, label_cache);
+            }
 
             ++i;
             ++first;
@@ -83,9 +123,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
 
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+            if (!aliased) {
+                pre_scaler<desc>::transform_all(label_cache);
+                pre_normalizer<desc>::transform_all(label_cache);
+                pre_binarizer<desc>::transform_all(label_cache);
+            }
         }
 
         cpp_unused(llast);
@@ -121,6 +163,24 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         display(std::cout);
     }
 
+    /*!
+     * \brief Use the inputs as labels, instead of a copy of the inputs, if
+     * possible (autoencoder without augmentation).
+     *
+     * This must be called before filling a prepared generator, the labels
+     * are then never set.
+     *
+     * \return true if the labels are aliased, false if they must be filled
+     */
+    bool alias_labels() {
+        if constexpr (aliasable) {
+            aliased     = true;
+            label_cache = label_cache_type();
+        }
+
+        return aliased;
+    }
+
     /*!
      * \brief Indicates that it is safe to destroy the memory of the generator
      * when not used by the pretraining phase
@@ -138,9 +198,31 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         if (is_safe) {
             input_cache.clear();
             label_cache.clear();
+            label_batch_cache.clear();
         }
     }
 
+    /*!
+     * \brief Set the length of each sequence of the generator.
+     *
+     * The samples are padded to the full number of time steps. The
+     * recurrent layers only compute the true time steps of each sequence.
+     *
+     * \param lengths The length of each sample
+     */
+    void set_lengths(std::vector<size_t> lengths) {
+        cpp_assert(lengths.empty() || lengths.size() == size(), "There must be one length for each sample");
+
+        this->lengths = std::move(lengths);
+    }
+
+    /*!
+     * \brief Indicates if the generator holds variable-length sequences
+     */
+    bool has_lengths() const {
+        return !lengths.empty();
+    }
+
     /*!
      * brief Sets the generator in test mode
      */
@@ -178,7 +260,45 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        if (has_lengths() || aliased) {
+            shuffle_rows();
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, engine);
+        }
+    }
+
+    /*!
+     * \brief Shuffle the samples, the labels (if not aliased) and the
+     * lengths (if any) together
+     */
+    void shuffle_rows() {
+        input_cache.ensure_cpu_up_to_date();
+        label_cache.ensure_cpu_up_to_date();
+
+        const size_t n  = size();
+        const size_t is = etl::size(input_cache) / n;
+        const size_t ls = etl::size(label_cache) / n;
+
+        auto* input_p = input_cache.memory_start();
+        auto* label_p = label_cache.memory_start();
+
+        for (size_t i = n - 1; i > 0; --i) {
+            std::uniform_int_distribution<size_t> dist(0, i);
+
+            const size_t j = dist(engine);
+
+            if (i != j) {
+                std::swap_ranges(input_p + i * is, input_p + (i + 1) * is, input_p + j * is);
+                std::swap_ranges(label_p + i * ls, label_p + (i + 1) * ls, label_p + j * ls);
+
+                if (has_lengths()) {
+                    std::swap(lengths[i], lengths[j]);
+                }
+            }
+        }
+
+        input_cache.invalidate_gpu();
+        label_cache.invalidate_gpu();
     }
 
     /*!
@@ -186,7 +306,10 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     void prepare_epoch(){
         input_cache.ensure_gpu_up_to_date();
-        label_cache.ensure_gpu_up_to_date();
+
+        if (!aliased) {
+            label_cache.ensure_gpu_up_to_date();
+        }
     }
 
     /*!
@@ -217,6 +340,30 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         return etl::dim<0>(input_cache);
     }
 
+    static constexpr bool indexable = true; ///< Indicates that the samples can be read one by one, by index
+
+    /*!
+     * \brief Returns the sample at the given index, in the current order
+     */
+    auto sample(size_t i) const {
+        return input_cache(i);
+    }
+
+    /*!
+     * \brief Copy the label of the sample at the given index, in the current
+     * order, to the given destination (a row of a batch of labels)
+     */
+    template <typename Label>
+    void copy_label(size_t i, Label&& label) const {
+        if constexpr (label_cache_helper_t::sparse) {
+            label_cache_helper_t::expand(label, label_cache[i]);
+        } else if constexpr (aliasable) {
+            label = aliased ? input_cache(i) : label_cache(i);
+        } else {
+            label = label_cache(i);
+        }
+    }
+
     /*!
      * \brief Returns the number of batches in the generator.
      * \return The number of batches in the generator
@@ -255,7 +402,33 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        const size_t last = std::min(current + batch_size, size());
+
+        if constexpr (label_cache_helper_t::sparse) {
+            for (size_t i = current; i < last; ++i) {
+                label_cache_helper_t::expand(label_batch_cache(i - current), label_cache[i]);
+            }
+
+            label_batch_cache.invalidate_gpu();
+
+            return etl::slice(label_batch_cache, 0, last - current);
+        } else if constexpr (aliasable) {
+            return etl::slice(aliased ? input_cache : label_cache, current, last);
+        } else {
+            return etl::slice(label_cache, current, last);
+        }
+    }
+
+    /*!
+     * \brief Returns the lengths of the sequences of the current batch
+     * \return a vector with the length of each sample of the batch, empty if the sequences are full.
+     */
+    std::vector<size_t> length_batch() const {
+        if (!has_lengths()) {
+            return {};
+        }
+
+        return std::vector<size_t>(lengths.begin() + current, lengths.begin() + std::min(current + batch_size, size()));
     }
 
     /*!
@@ -275,7 +448,18 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     template <typename Input>
     void set_label_batch(size_t i, Input&& input_batch) {
-        etl::slice(label_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        // The labels are the inputs themselves
+        if (aliased) {
+            return;
+        }
+
+        if constexpr (label_cache_helper_t::sparse) {
+            for (size_t k = 0; k < etl::dim<0>(input_batch); ++k) {
+                label_cache[i + k] = etl::max_index(input_batch(k));
+            }
+        } else {
+            etl::slice(label_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        }
     }
 
     /*!
@@ -288,9 +472,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
 
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+            if (!aliased) {
+                pre_scaler<desc>::transform_all(label_cache);
+                pre_normalizer<desc>::transform_all(label_cache);
+                pre_binarizer<desc>::transform_all(label_cache);
+            }
         }
     }
 
@@ -301,82 +487,118 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     static constexpr size_t dimensions() {
         return etl::dimensions<data_cache_type>() - 1;
     }
+
+private:
+    /*!
+     * \brief Allocate the one-hot labels of a batch, if the labels are sparse
+     * \param n_classes The number of classes
+     */
+    void init_label_batch(size_t n_classes) {
+        if constexpr (label_cache_helper_t::sparse) {
+            label_batch_cache = etl::dyn_matrix<weight, 2>(batch_size, n_classes);
+        } else {
+            cpp_unused(n_classes);
+        }
+    }
 };
 
 /*!
  * \copydoc inmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>> {
+struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_compact<Desc>>> {
     using desc                 = Desc;                                        ///< The generator descriptor
-    using weight               = etl::value_t<typename Iterator::value_type>; ///< The data type
+    using sample_type          = typename Iterator::value_type;               ///< The type of a sample
+    using weight               = etl::value_t<sample_type>;                   ///< The data type
     using data_cache_helper_t  = cache_helper<desc, Iterator>;                ///< The helper for the data cache
     using label_cache_helper_t = label_cache_helper<desc, weight, LIterator>; ///< The helper for the label cache
 
-    using data_cache_type  = typename data_cache_helper_t::cache_type;     ///< The type of the data cache
-    using big_cache_type   = typename data_cache_helper_t::big_cache_type; ///< The type of big data cache
-    using label_cache_type = typename label_cache_helper_t::cache_type;    ///< The type of the label cache
+    using data_cache_type      = typename data_cache_helper_t::cache_type;      ///< The type of the data cache
+    using big_cache_type       = typename data_cache_helper_t::big_cache_type;  ///< The type of big data cache
+    using label_cache_type     = typename label_cache_helper_t::cache_type;     ///< The type of the label cache
+    using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
     static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
 
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
-    data_cache_type input_cache;  ///< The data cache
-    big_cache_type batch_cache;   ///< The data batch cache
-    label_cache_type label_cache; ///< The label cache
+    static constexpr size_t workers = std::min(desc::AugmentationWorkers, big_batch_size); ///< The number of augmentation threads
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    data_cache_type input_cache;            ///< The data cache
+    big_cache_type batch_cache;             ///< The data batch cache
+    label_cache_type label_cache;           ///< The label cache
+    big_label_cache_type label_batch_cache; ///< The label batch cache
 
+    std::vector<size_t> order; ///< The order in which the samples are generated
+
+    std::vector<data_augmenter<Desc>> augmenters; ///< The augmenters, one for each thread
+    std::vector<sample_type> samples;             ///< The converted samples of the threads (compact storage only)
 
     size_t current = 0;     ///< The current index
     bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
-
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    random_stream engine; ///< The random stream of the shuffles
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    mutable batch_ring<big_batch_size> ring; ///< The ring of batches between the threads and the consumer
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::vector<std::thread> threads; ///< The augmentation threads
+    bool train_mode = false;          ///< The train mode status
 
     /*!
      * \brief Construct an inmemory data generator
      */
     inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes)
-            : cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+            : ring((std::distance(first, last) + batch_size - 1) / batch_size, 2 * workers) {
         const size_t n = std::distance(first, last);
 
+        augmenters.reserve(workers);
+
+        for (size_t w = 0; w < workers; ++w) {
+            augmenters.emplace_back(*first);
+
+            if constexpr (is_compact<desc>) {
+                samples.emplace_back(*first);
+            }
+        }
+
         data_cache_helper_t::init(n, first, input_cache);
         data_cache_helper_t::init_big(first, batch_cache);
 
         label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        label_cache_helper_t::init_big(n_classes, lfirst, label_batch_cache);
+
+        placement::place(input_cache);
+        placement::place(batch_cache);
+        placement::place(label_cache);
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
 
         // Fill the cache
 
         size_t i = 0;
         while (first != last) {
-            input_cache(i) = *first;
+            if constexpr (is_compact<desc>) {
+                std::copy(first->begin(), first->end(), input_cache(i).begin());
+            } else {
+                input_cache(i) = *first;
+            }
 
-            label_cache_helper_t::set(i, lfirst, label_cache);
+            label_cache_helper_t::store(i, lfirst, label_cache);
 
             ++i;
             ++first;
             ++lfirst;
         }
 
-        // Transform if necessary
+        // Transform if necessary (the compact samples are transformed when the batches are filled)
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
+        if constexpr (!is_compact<desc>) {
+            pre_scaler<desc>::transform_all(input_cache);
+            pre_normalizer<desc>::transform_all(input_cache);
+            pre_binarizer<desc>::transform_all(input_cache);
+        }
 
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
@@ -385,94 +607,12 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             pre_binarizer<desc>::transform_all(label_cache);
         }
 
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
-
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    bool found = false;
-
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < size()) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
-
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < size()) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
-
-                // Get the batch that needs to be read
-                const size_t batch = indices[index];
-
-                // Get the index from where to read inside the input cache
-                const size_t input_n = batch * batch_size;
-
-                for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
-                    if (train_mode) {
-                        // Random crop the image
-                        cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i));
-
-                        // Mirror the image
-                        mirrorer.transform(batch_cache(index)(i));
-
-                        // Distort the image
-                        distorter.transform(batch_cache(index)(i));
-
-                        // Noise the image
-                        noiser.transform(batch_cache(index)(i));
-                    } else {
-                        // Center crop the image
-                        cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
-                    }
-                }
-
-                // Notify a waiter that one batch is ready
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    status[index] = true;
-
-                    ready_condition.notify_one();
-                }
-            }
-        });
+        // The data budget of the process may limit the number of threads
+        for (size_t w = 0; w < data_threads(workers); ++w) {
+            threads.emplace_back([this, w] { augment_batches(w); });
+        }
     }
 
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
@@ -505,6 +645,18 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         display(std::cout);
     }
 
+    /*!
+     * \brief Use the inputs as labels, instead of a copy of the inputs.
+     *
+     * The labels of the augmented generators are always copied, they must
+     * not be augmented like the inputs.
+     *
+     * \return false, the labels must be filled
+     */
+    bool alias_labels() {
+        return false;
+    }
+
     /*!
      * \brief Indicates that it is safe to destroy the memory of the generator
      * when not used by the pretraining phase
@@ -523,6 +675,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             input_cache.clear();
             batch_cache.clear();
             label_cache.clear();
+            label_batch_cache.clear();
         }
     }
 
@@ -544,25 +697,18 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \brief Destructs the inmemory_data_generator
      */
     ~inmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        ring.stop();
 
-        main_thread.join();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     /*!
      * \brief Reset the generation to its beginning
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
-
-        condition.notify_one();
+        ring.reset();
     }
 
     /*!
@@ -578,19 +724,23 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      */
     void reset_shuffle() {
         current = 0;
-        shuffle();
-        reset_generation();
+
+        // The threads must not read the samples while they are shuffled
+        ring.reset([this] { shuffle(); });
     }
 
     /*!
      * \brief Shuffle the order of the samples.
      *
+     * Only the order is shuffled, the samples are gathered from the caches
+     * when the batches are filled.
+     *
      * This should only be done when the generator is at the beginning.
      */
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        std::shuffle(order.begin(), order.end(), engine);
     }
 
     /*!
@@ -600,6 +750,13 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         // Nothing can be done here
     }
 
+    /*!
+     * \brief Returns the prefetching statistics of the generator
+     */
+    prefetch_stats prefetch() const {
+        return ring.stats();
+    }
+
     /*!
      * \brief Return the index of the current batch in the generation
      * \return The current batch index
@@ -625,7 +782,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * etl::dim<0>(input_cache);
+        return augmenters.front().scaling() * etl::dim<0>(input_cache);
     }
 
     /*!
@@ -650,18 +807,8 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * This should only be called if the generator has a next batch.
      */
     void next_batch() {
-        // Get information from batch that has been consumed
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
-
-            status[b] = false;
-            indices[b] += big_batch_size;
-
-            condition.notify_one();
-        }
+        // Free the slot of the batch that has been consumed
+        ring.release();
 
         current += batch_size;
     }
@@ -671,26 +818,12 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            const auto input_n = indices[b] * batch_size + batch_size;
+        const auto b     = ring.slot(batch);
 
-            if (input_n > size()) {
-                return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-            } else {
-                return etl::slice(batch_cache(b), 0, batch_size);
-            }
-        }
+        ring.wait_ready(batch);
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
-
-        const auto input_n = indices[b] * batch_size + batch_size;
+        const auto input_n = batch * batch_size + batch_size;
 
         if (input_n > size()) {
             return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
@@ -704,7 +837,12 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        const auto batch = current / batch_size;
+        const auto b     = ring.slot(batch);
+
+        ring.wait_ready(batch);
+
+        return etl::slice(label_batch_cache(b), 0, std::min(batch_size, size() - current));
     }
 
     /*!
@@ -714,16 +852,93 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     static constexpr size_t dimensions() {
         return etl::dimensions<data_cache_type>() - 1;
     }
+
+private:
+    /*!
+     * \brief Crop one sample of a batch from the given image
+     * \param augmenter The augmenter of the thread
+     * \param target The sample of the batch
+     * \param image The input image
+     */
+    template <typename O, typename T>
+    void crop_sample(data_augmenter<Desc>& augmenter, O&& target, const T& image) {
+        if (train_mode) {
+            // Random crop the image
+            augmenter.transform_first(target, image);
+        } else {
+            // Center crop the image
+            augmenter.transform_first_test(target, image);
+        }
+    }
+
+    /*!
+     * \brief The loop of an augmentation thread, filling the free batches
+     * until the generator is destroyed.
+     * \param w The index of the thread
+     */
+    void augment_batches(size_t w) {
+        pin_data_thread(w);
+
+        auto& augmenter = augmenters[w];
+
+        // The batch to fill
+        size_t batch = 0;
+
+        while (ring.acquire(batch)) {
+            trace_scope scope("generator:batch", "generator");
+
+            // The index of the batch inside the batch cache
+            const size_t index = ring.slot(batch);
+
+            // Get the index from where to read inside the input cache
+            const size_t input_n = batch * batch_size;
+
+            // The number of samples in the batch
+            const size_t n = std::min(batch_size, size() - input_n);
+
+            for (size_t i = 0; i < n; ++i) {
+                // Gather the sample in the order of the epoch
+                const size_t s = order[input_n + i];
+
+                if constexpr (is_compact<desc>) {
+                    // Convert the sample and preprocess it
+                    auto& sample = samples[w];
+
+                    std::copy(input_cache(s).begin(), input_cache(s).end(), sample.begin());
+
+                    pre_scaler<desc>::transform(sample);
+                    pre_normalizer<desc>::transform(sample);
+                    pre_binarizer<desc>::transform(sample);
+
+                    crop_sample(augmenter, batch_cache(index)(i), sample);
+                } else {
+                    crop_sample(augmenter, batch_cache(index)(i), input_cache(s));
+                }
+
+                label_cache_helper_t::expand(label_batch_cache(index)(i), label_cache(s));
+            }
+
+            if (train_mode) {
+                // Mirror, distort and noise the whole batch
+                augmenter.transform_batch(batch_cache(index), n);
+            }
+
+            ring.publish(batch);
+        }
+    }
 };
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc>>>::batch_size;
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_compact<Desc>>>::batch_size;
+
+template <typename Iterator, typename LIterator, typename Desc>
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_compact<Desc>>>::batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>>::batch_size;
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_compact<Desc>>>::big_batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>>::big_batch_size;
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_compact<Desc>>>::workers;
 
 /*!
  * \brief Display the given generator on the given stream
@@ -756,6 +971,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of threads augmenting the batches
+     */
+    static constexpr size_t AugmentationWorkers = detail::get_value_v<augmentation_workers<1>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
@@ -791,6 +1011,16 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The type of noise
+     */
+    static constexpr noise_type NoiseModel = detail::get_value_v<noise_model<noise_type::MASKING>, Parameters...>;
+
+    /*!
+     * \brief The type used to store the samples (void for the type of the network)
+     */
+    using storage_type = detail::get_type_t<compact_storage<void>, Parameters...>;
+
     /*!
      * \brief The scaling
      */
@@ -813,14 +1043,15 @@ struct inmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(AugmentationWorkers > 0, "There must be at least one augmentation worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
-                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                batch_size_id, big_batch_size_id, augmentation_workers_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
+                categorical_id, noise_id, noise_model_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, compact_storage_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
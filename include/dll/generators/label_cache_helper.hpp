@@ -18,16 +18,20 @@ struct label_cache_helper;
 /*!
  * \brief Helper to create and initialize a cache for labels.
  *
- * This version makes the label categorical.
+ * This version makes the label categorical. The cache only holds the
+ * class of each sample, the one-hot vectors are only created in the
+ * batches.
  */
 template <typename Desc, typename T, typename LIterator>
 struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
-    using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
+    using cache_type     = etl::dyn_matrix<T, 1>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
 
+    static constexpr bool sparse = true; ///< Indicates that the cache holds class indices instead of one-hot vectors
+
     /*!
      * \brief Init the cache
      * \param n The size of the cache
@@ -36,10 +40,10 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
      * \param cache The cache to initialize
      */
     static void init(size_t n, size_t n_classes, const LIterator& it, cache_type& cache) {
-        cache = cache_type(n, n_classes);
-        cache = T(0);
+        cache = cache_type(n);
 
         cpp_unused(it);
+        cpp_unused(n_classes);
     }
 
     /*!
@@ -65,6 +69,28 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
         cache(i) = T(0);
         cache(i, *it) = T(1);
     }
+
+    /*!
+     * \brief Store the value of a label in the cache from the iterator
+     * \param i The index of the label in the cache
+     * \param it The label iterator
+     * \param cache The label cache
+     */
+    template <typename E>
+    static void store(size_t i, const LIterator& it, E&& cache) {
+        cache[i] = *it;
+    }
+
+    /*!
+     * \brief Expand a label of the cache into a batch label
+     * \param target The batch label
+     * \param label The label from the cache
+     */
+    template <typename E, typename L>
+    static void expand(E&& target, const L& label) {
+        target = T(0);
+        target[size_t(label)] = T(1);
+    }
 };
 
 /*!
@@ -80,6 +106,8 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<!Desc::Categorica
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
 
+    static constexpr bool sparse = false; ///< Indicates that the cache holds class indices instead of one-hot vectors
+
     /*!
      * \brief Init the cache
      * \param n The size of the cache
@@ -117,6 +145,27 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<!Desc::Categorica
     static void set(size_t i, const LIterator& it, E&& cache) {
         cache[i] = *it;
     }
+
+    /*!
+     * \brief Store the value of a label in the cache from the iterator
+     * \param i The index of the label in the cache
+     * \param it The label iterator
+     * \param cache The label cache
+     */
+    template <typename E>
+    static void store(size_t i, const LIterator& it, E&& cache) {
+        set(i, it, cache);
+    }
+
+    /*!
+     * \brief Expand a label of the cache into a batch label
+     * \param target The batch label
+     * \param label The label from the cache
+     */
+    template <typename E, typename L>
+    static void expand(E&& target, const L& label) {
+        target = label;
+    }
 };
 
 /*!
@@ -134,6 +183,8 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_1d<typena
 
     static_assert(!Desc::Categorical, "Cannot make such vector labels categorical");
 
+    static constexpr bool sparse = false; ///< Indicates that the cache holds class indices instead of one-hot vectors
+
     /*!
      * \brief Init the cache
      * \param n The size of the cache
@@ -173,6 +224,27 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_1d<typena
     static void set(size_t i, const LIterator& it, E&& cache) {
         cache(i) = *it;
     }
+
+    /*!
+     * \brief Store the value of a label in the cache from the iterator
+     * \param i The index of the label in the cache
+     * \param it The label iterator
+     * \param cache The label cache
+     */
+    template <typename E>
+    static void store(size_t i, const LIterator& it, E&& cache) {
+        set(i, it, cache);
+    }
+
+    /*!
+     * \brief Expand a label of the cache into a batch label
+     * \param target The batch label
+     * \param label The label from the cache
+     */
+    template <typename E, typename L>
+    static void expand(E&& target, const L& label) {
+        target = label;
+    }
 };
 
 /*!
@@ -190,6 +262,8 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_3d<typena
 
     static_assert(!Desc::Categorical, "Cannot make such matrix labels categorical");
 
+    static constexpr bool sparse = false; ///< Indicates that the cache holds class indices instead of one-hot vectors
+
     /*!
      * \brief Init the cache
      * \param n The size of the cache
@@ -229,6 +303,27 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_3d<typena
     static void set(size_t i, const LIterator& it, E&& cache) {
         cache(i) = *it;
     }
+
+    /*!
+     * \brief Store the value of a label in the cache from the iterator
+     * \param i The index of the label in the cache
+     * \param it The label iterator
+     * \param cache The label cache
+     */
+    template <typename E>
+    static void store(size_t i, const LIterator& it, E&& cache) {
+        set(i, it, cache);
+    }
+
+    /*!
+     * \brief Expand a label of the cache into a batch label
+     * \param target The batch label
+     * \param label The label from the cache
+     */
+    template <typename E, typename L>
+    static void expand(E&& target, const L& label) {
+        target = label;
+    }
 };
 
 } //end of dll namespace
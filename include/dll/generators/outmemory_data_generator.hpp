@@ -8,12 +8,28 @@
 /*!
  * \file
  * \brief Implementation of an out-of-memory data generator
+ *
+ * The samples are read into the cache by blocks of big_batch_size
+ * batches, in the order of the iterators. When shuffled, the order of the
+ * complete blocks is permuted, if the iterators are random access, and
+ * the samples of each block are shuffled in memory, so that the samples
+ * are still read sequentially within each block.
  */
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <iterator>
+#include <numeric>
 #include <thread>
+#include <vector>
+
+#include "dll/util/batch_ring.hpp"
+#include "dll/util/placement.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/util/trace.hpp"
 
 namespace dll {
 
@@ -36,9 +52,17 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     using big_data_cache_type  = typename data_cache_helper_t::big_cache_type;  ///< The type of the big data cache
     using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
-    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
-    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the batch
-    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
+    static constexpr bool dll_generator    = true;                        ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size     = desc::BatchSize;             ///< The size of the batch
+    static constexpr size_t big_batch_size = desc::BigBatchSize;          ///< The number of batches kept in cache
+    static constexpr size_t block_size     = big_batch_size * batch_size; ///< The number of samples read at once
+
+    /*!
+     * \brief Indicates if the blocks can be read in any order
+     */
+    static constexpr bool random_access =
+        std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>
+        && std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<LIterator>::iterator_category>;
 
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
@@ -48,6 +72,11 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     size_t current_b    = 0;     ///< The current batch
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
+    bool shuffled = false;     ///< Indicates if the samples are shuffled
+    size_t block  = 0;         ///< The position of the next block in the order of the blocks
+    std::vector<size_t> order; ///< The order of the blocks, when shuffled
+    std::vector<size_t> slots; ///< The positions of the samples of the current block, when shuffled
+
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
     LIterator orig_lit; ///< The original first iterator on label
@@ -69,6 +98,9 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
 
+        placement::place(batch_cache);
+        placement::place(label_cache);
+
         reset();
 
         cpp_unused(last);
@@ -145,30 +177,52 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     void fetch_next() {
         current_b = 0;
 
-        for (size_t b = 0; b < big_batch_size && current_real < _size; ++b) {
-            for (size_t i = 0; i < batch_size && current_real < _size;) {
-                auto sub = batch_cache(b)(i);
+        // Only the last block can be incomplete, it is always read last
+        const size_t n = std::min(block_size, _size - current_real);
 
-                sub = *it;
+        if (!n) {
+            return;
+        }
 
-                pre_scaler<desc>::transform(sub);
-                pre_normalizer<desc>::transform(sub);
-                pre_binarizer<desc>::transform(sub);
+        if (shuffled) {
+            if constexpr (random_access) {
+                const size_t first = order[block++] * block_size;
 
-                label_cache_helper_t::set(i, lit, label_cache(b));
+                it  = std::next(orig_it, first);
+                lit = std::next(orig_lit, first);
+            }
 
-                // In case of auto-encoders, the label images also need to be transformed
-                if constexpr (desc::AutoEncoder) {
-                    pre_scaler<desc>::transform(label_cache(b)(i));
-                    pre_normalizer<desc>::transform(label_cache(b)(i));
-                    pre_binarizer<desc>::transform(label_cache(b)(i));
-                }
+            slots.resize(n);
+            std::iota(slots.begin(), slots.end(), 0);
+            std::shuffle(slots.begin(), slots.end(), dll::rand_engine());
+        }
+
+        // The samples are read sequentially and stored at their position in the block
+        for (size_t k = 0; k < n; ++k) {
+            const size_t s = shuffled ? slots[k] : k;
+            const size_t b = s / batch_size;
+            const size_t i = s % batch_size;
+
+            auto sub = batch_cache(b)(i);
+
+            sub = *it;
 
-                ++i;
-                ++current_real;
-                ++it;
-                ++lit;
+            pre_scaler<desc>::transform(sub);
+            pre_normalizer<desc>::transform(sub);
+            pre_binarizer<desc>::transform(sub);
+
+            label_cache_helper_t::set(i, lit, label_cache(b));
+
+            // In case of auto-encoders, the label images also need to be transformed
+            if constexpr (desc::AutoEncoder) {
+                pre_scaler<desc>::transform(label_cache(b)(i));
+                pre_normalizer<desc>::transform(label_cache(b)(i));
+                pre_binarizer<desc>::transform(label_cache(b)(i));
             }
+
+            ++current_real;
+            ++it;
+            ++lit;
         }
     }
 
@@ -178,6 +232,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     void reset() {
         current      = 0;
         current_real = 0;
+        block        = 0;
 
         it  = orig_it;
         lit = orig_lit;
@@ -189,16 +244,29 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
      * \brief Reset the generator and shuffle the order of samples
      */
     void reset_shuffle() {
-        cpp_unreachable("Impossible to shuffle out-of-memory data set");
+        shuffle();
     }
 
     /*!
-     * \brief Shuffle the order of the samples.
+     * \brief Shuffle the order of the samples and go back to the beginning.
      *
-     * This should only be done when the generator is at the beginning.
+     * The order of the complete blocks is permuted, if the iterators are
+     * random access, and the samples are shuffled inside each block. The
+     * following resets keep the order of the blocks.
      */
     void shuffle() {
-        cpp_unreachable("Impossible to shuffle out-of-memory data set");
+        const size_t complete = _size / block_size;
+
+        order.resize(complete + (_size % block_size ? 1 : 0));
+        std::iota(order.begin(), order.end(), 0);
+
+        if constexpr (random_access) {
+            std::shuffle(order.begin(), order.begin() + complete, dll::rand_engine());
+        }
+
+        shuffled = true;
+
+        reset();
     }
 
     /*!
@@ -309,6 +377,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
+    static constexpr size_t workers = std::min(desc::AugmentationWorkers, big_batch_size); ///< The number of augmentation threads
+
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
@@ -316,17 +386,11 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     size_t current_read = 0;     ///< The current index read
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    mutable batch_ring<big_batch_size> ring; ///< The ring of batches between the threads and the consumer
+    std::mutex read_lock;                    ///< The lock for reading from the iterators
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
-
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
-
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::vector<std::thread> threads; ///< The augmentation threads
+    bool train_mode = false;          ///< The train mode status
 
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
@@ -334,10 +398,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     Iterator it;        ///< The current iterator on data
     LIterator lit;      ///< The current iterator on label
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    std::vector<data_augmenter<Desc>> augmenters; ///< The augmenters, one for each thread
 
     /*!
      * \brief Construct an outmemory_data_generator
@@ -349,113 +410,29 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \param size The size of the entire dataset
      */
     outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
-            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+            : ring((size + batch_size - 1) / batch_size, 2 * workers), _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
 
+        placement::place(batch_cache);
+        placement::place(label_cache);
+
         cpp_unused(last);
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        augmenters.reserve(workers);
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    bool found = false;
-
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < _size) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
-
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < _size) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
-
-                SERIAL_SECTION {
-                    for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
-                        auto sub = batch_cache(index)(i);
-
-                        if (train_mode) {
-                            // Random crop the image
-                            cropper.transform_first(sub, *it);
-
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
-
-                            // Mirror the image
-                            mirrorer.transform(sub);
-
-                            // Distort the image
-                            distorter.transform(sub);
-
-                            // Noise the image
-                            noiser.transform(sub);
-                        } else {
-                            // Center crop the image
-                            cropper.transform_first_test(sub, *it);
-
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
-                        }
-
-                        label_cache_helper_t::set(i, lit, label_cache(index));
-
-                        // In case of auto-encoders, the label images also need to be transformed
-                        if constexpr (desc::AutoEncoder){
-                            pre_scaler<desc>::transform(label_cache(index)(i));
-                            pre_normalizer<desc>::transform(label_cache(index)(i));
-                            pre_binarizer<desc>::transform(label_cache(index)(i));
-                        }
-
-                        ++it;
-                        ++lit;
-                        ++current_read;
-                    }
-                }
-
-                // Notify a waiter that one batch is ready
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    status[index] = true;
+        for (size_t w = 0; w < workers; ++w) {
+            augmenters.emplace_back(*first);
+        }
 
-                    ready_condition.notify_one();
-                }
-            }
-        });
+        // The data budget of the process may limit the number of threads
+        for (size_t w = 0; w < data_threads(workers); ++w) {
+            threads.emplace_back([this, w] {
+                pin_data_thread(w);
+                augment_batches(augmenters[w]);
+            });
+        }
     }
 
     outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
@@ -468,11 +445,11 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Destructs the outmemory_data_generator
      */
     ~outmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        ring.stop();
 
-        main_thread.join();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     /*!
@@ -537,18 +514,12 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Reset the generation
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        current_read = 0;
-        it           = orig_it;
-        lit          = orig_lit;
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
-
-        condition.notify_one();
+        // The iterators are rewound once no thread is reading from them
+        ring.reset([this] {
+            current_read = 0;
+            it           = orig_it;
+            lit          = orig_lit;
+        });
     }
 
     /*!
@@ -582,6 +553,13 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         // Nothing can be done here
     }
 
+    /*!
+     * \brief Returns the prefetching statistics of the generator
+     */
+    prefetch_stats prefetch() const {
+        return ring.stats();
+    }
+
     /*!
      * \brief Return the index of the current batch in the generation
      * \return The current batch index
@@ -607,7 +585,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * size();
+        return augmenters.front().scaling() * size();
     }
 
     /*!
@@ -632,18 +610,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * This should only be called if the generator has a next batch.
      */
     void next_batch() {
-        // Get information from batch that has been consumed
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
-
-            status[b] = false;
-            indices[b] += big_batch_size;
-
-            condition.notify_one();
-        }
+        // Free the slot of the batch that has been consumed
+        ring.release();
 
         current += batch_size;
     }
@@ -653,18 +621,10 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
-        }
+        const auto b     = ring.slot(batch);
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.wait_ready(batch);
 
         return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -674,18 +634,10 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
-        }
+        const auto b     = ring.slot(batch);
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.wait_ready(batch);
 
         return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -697,6 +649,87 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     static constexpr size_t dimensions() {
         return etl::dimensions<big_data_cache_type>() - 2;
     }
+
+private:
+    /*!
+     * \brief The loop of an augmentation thread, filling the free batches
+     * until the generator is destroyed.
+     *
+     * The batches are claimed and read from the iterators in order, under
+     * the read lock, and are then augmented concurrently with the other
+     * threads.
+     *
+     * \param augmenter The augmenter of the thread
+     */
+    void augment_batches(data_augmenter<Desc>& augmenter) {
+        while (true) {
+            // The batch to fill
+            size_t batch = 0;
+
+            // The index of the batch inside the batch cache
+            size_t index = 0;
+
+            // The number of samples in the batch
+            size_t n = 0;
+
+            // The time the batch was acquired
+            std::chrono::steady_clock::time_point start;
+
+            {
+                std::unique_lock<std::mutex> rlock(read_lock);
+
+                if (!ring.acquire(batch)) {
+                    return;
+                }
+
+                start = std::chrono::steady_clock::now();
+
+                index = ring.slot(batch);
+
+                for (; n < batch_size && current_read < _size; ++n) {
+                    if (train_mode) {
+                        // Random crop the image
+                        augmenter.transform_first(batch_cache(index)(n), *it);
+                    } else {
+                        // Center crop the image
+                        augmenter.transform_first_test(batch_cache(index)(n), *it);
+                    }
+
+                    label_cache_helper_t::set(n, lit, label_cache(index));
+
+                    ++it;
+                    ++lit;
+                    ++current_read;
+                }
+            }
+
+            SERIAL_SECTION {
+                for (size_t i = 0; i < n; ++i) {
+                    auto sub = batch_cache(index)(i);
+
+                    pre_scaler<desc>::transform(sub);
+                    pre_normalizer<desc>::transform(sub);
+                    pre_binarizer<desc>::transform(sub);
+
+                    // In case of auto-encoders, the label images also need to be transformed
+                    if constexpr (desc::AutoEncoder){
+                        pre_scaler<desc>::transform(label_cache(index)(i));
+                        pre_normalizer<desc>::transform(label_cache(index)(i));
+                        pre_binarizer<desc>::transform(label_cache(index)(i));
+                    }
+                }
+
+                if (train_mode) {
+                    // Mirror, distort and noise the whole batch
+                    augmenter.transform_batch(batch_cache(index), n);
+                }
+            }
+
+            trace_complete("generator:batch", "generator", start, std::chrono::steady_clock::now());
+
+            ring.publish(batch);
+        }
+    }
 };
 
 // Allow odr-use of the constexpr static members
@@ -713,6 +746,9 @@ const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_
 template <typename Iterator, typename LIterator, typename Desc>
 const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_threaded<Desc>>>::big_batch_size;
 
+template <typename Iterator, typename LIterator, typename Desc>
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_threaded<Desc>>>::workers;
+
 /*!
  * \brief Display the given generator on the given stream
  * \param os The output stream
@@ -744,6 +780,11 @@ struct outmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of threads augmenting the batches
+     */
+    static constexpr size_t AugmentationWorkers = detail::get_value_v<augmentation_workers<1>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
@@ -784,6 +825,11 @@ struct outmemory_data_generator_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The type of noise
+     */
+    static constexpr noise_type NoiseModel = detail::get_value_v<noise_model<noise_type::MASKING>, Parameters...>;
+
     /*!
      * \brief The scaling
      */
@@ -806,14 +852,15 @@ struct outmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(AugmentationWorkers > 0, "There must be at least one augmentation worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
-                elastic_distortion_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                batch_size_id, big_batch_size_id, augmentation_workers_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
+                elastic_distortion_id, categorical_id, noise_id, noise_model_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -0,0 +1,273 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sharding of the datasets between the processes of a distributed
+ * training
+ *
+ * Each process owns a disjoint shard of the dataset and only loads this
+ * shard in its generator. All the shards have the same size, n / world
+ * samples, so that all the processes have the same number of batches and
+ * reach the end of an epoch together. The at most world - 1 remaining
+ * samples are left out.
+ *
+ * For containers, the samples are dealt to the processes from a
+ * permutation of the dataset computed from a shared seed, using a
+ * counter-based generator. The permutation is the same on every process,
+ * whatever the standard library, and a sorted dataset still gives
+ * balanced shards. For streams (out-of-memory generators), the samples
+ * are dealt in turn to the processes.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "dll/util/distributed.hpp"
+#include "dll/util/philox.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The shard of a dataset owned by a process
+ */
+struct shard {
+    size_t rank  = 0; ///< The rank of the process
+    size_t world = 1; ///< The number of processes
+    size_t seed  = 0; ///< The seed shared by all the processes
+
+    /*!
+     * \brief Create the shard of the given process
+     * \param rank The rank of the process
+     * \param world The number of processes
+     * \param seed The seed shared by all the processes
+     */
+    shard(size_t rank, size_t world, size_t seed = 0) : rank(rank), world(world), seed(seed) {
+        cpp_assert(rank < world, "The rank must be smaller than the number of processes");
+    }
+
+    /*!
+     * \brief Create the shard of the current process of the given communicator
+     * \param comm The communicator of the distributed training
+     * \param seed The seed shared by all the processes
+     */
+    explicit shard(const communicator& comm, size_t seed = 0) : shard(comm.rank(), comm.size(), seed) {}
+
+    /*!
+     * \brief Returns the size of the shard of a dataset of n samples
+     */
+    size_t size(size_t n) const {
+        return n / world;
+    }
+
+    /*!
+     * \brief Returns the indices of the samples of the shard, in
+     * increasing order, from the shared permutation of the n samples.
+     */
+    std::vector<size_t> indices(size_t n) const {
+        std::vector<size_t> permutation(n);
+        std::iota(permutation.begin(), permutation.end(), 0);
+
+        philox4x32 generator(seed);
+
+        for (size_t i = n; i > 1; --i) {
+            auto block = generator(i);
+            auto r     = (uint64_t(block[0]) << 32) | block[1];
+
+            std::swap(permutation[i - 1], permutation[r % i]);
+        }
+
+        const size_t m = size(n);
+
+        std::vector<size_t> owned(permutation.begin() + rank * m, permutation.begin() + (rank + 1) * m);
+        std::sort(owned.begin(), owned.end());
+
+        return owned;
+    }
+};
+
+/*!
+ * \brief Iterator over the given indices of a random access sequence
+ */
+template <typename Iterator>
+struct indexed_iterator {
+    using iterator_category = std::forward_iterator_tag;                           ///< The category of the iterator
+    using value_type        = typename std::iterator_traits<Iterator>::value_type; ///< The type of the values
+    using difference_type   = std::ptrdiff_t;                                      ///< The type of the differences
+    using pointer           = typename std::iterator_traits<Iterator>::pointer;    ///< The type of a pointer to a value
+    using reference         = typename std::iterator_traits<Iterator>::reference;  ///< The type of a reference to a value
+
+    Iterator base;                                  ///< The start of the sequence
+    std::shared_ptr<const std::vector<size_t>> ids; ///< The indices to iterate over
+    size_t position;                                ///< The current position in the indices
+
+    /*!
+     * \brief Construct an iterator at the given position of the indices
+     */
+    indexed_iterator(Iterator base, std::shared_ptr<const std::vector<size_t>> ids, size_t position)
+            : base(base), ids(std::move(ids)), position(position) {}
+
+    /*!
+     * \brief Returns the current element
+     */
+    reference operator*() const {
+        return *std::next(base, (*ids)[position]);
+    }
+
+    /*!
+     * \brief Returns a pointer to the current element
+     */
+    pointer operator->() const {
+        return std::addressof(**this);
+    }
+
+    /*!
+     * \brief Move to the next element
+     */
+    indexed_iterator& operator++() {
+        ++position;
+        return *this;
+    }
+
+    /*!
+     * \brief Indicates if the two iterators are at the same position
+     */
+    bool operator==(const indexed_iterator& rhs) const {
+        return position == rhs.position;
+    }
+
+    /*!
+     * \brief Indicates if the two iterators are not at the same position
+     */
+    bool operator!=(const indexed_iterator& rhs) const {
+        return position != rhs.position;
+    }
+};
+
+/*!
+ * \brief Iterator over every world-th element of a sequence, starting at
+ * the rank-th element
+ */
+template <typename Iterator>
+struct strided_iterator {
+    using iterator_category = std::input_iterator_tag;                             ///< The category of the iterator
+    using value_type        = typename std::iterator_traits<Iterator>::value_type; ///< The type of the values
+    using difference_type   = std::ptrdiff_t;                                      ///< The type of the differences
+    using pointer           = typename std::iterator_traits<Iterator>::pointer;    ///< The type of a pointer to a value
+    using reference         = typename std::iterator_traits<Iterator>::reference;  ///< The type of a reference to a value
+
+    Iterator base; ///< The current element of the sequence
+    size_t stride; ///< The distance between two elements
+    size_t left;   ///< The number of elements of the sequence after base
+
+    /*!
+     * \brief Construct an iterator on the given element
+     */
+    strided_iterator(Iterator base, size_t stride, size_t left) : base(base), stride(stride), left(left) {}
+
+    /*!
+     * \brief Returns the current element
+     */
+    reference operator*() const {
+        return *base;
+    }
+
+    /*!
+     * \brief Returns a pointer to the current element
+     */
+    pointer operator->() const {
+        return std::addressof(**this);
+    }
+
+    /*!
+     * \brief Move to the next element
+     */
+    strided_iterator& operator++() {
+        // Never move past the end of the sequence
+        for (size_t s = 0; s < stride && left; ++s, --left) {
+            ++base;
+        }
+
+        return *this;
+    }
+
+    /*!
+     * \brief Indicates if the two iterators are at the same position
+     */
+    bool operator==(const strided_iterator& rhs) const {
+        return left == rhs.left;
+    }
+
+    /*!
+     * \brief Indicates if the two iterators are not at the same position
+     */
+    bool operator!=(const strided_iterator& rhs) const {
+        return left != rhs.left;
+    }
+};
+
+/*!
+ * \brief Make an in-memory data generator over the shard of the given
+ * containers owned by the current process.
+ *
+ * \param container The samples
+ * \param lcontainer The labels
+ * \param n_classes The number of classes
+ * \param part The shard of the current process
+ */
+template <typename Container, typename LContainer, typename... Parameters>
+auto make_generator(const Container& container, const LContainer& lcontainer, size_t n_classes, const shard& part, const inmemory_data_generator_desc<Parameters...>& desc) {
+    using iterator  = indexed_iterator<typename Container::const_iterator>;
+    using literator = indexed_iterator<typename LContainer::const_iterator>;
+
+    auto ids = std::make_shared<const std::vector<size_t>>(part.indices(std::min<size_t>(container.size(), lcontainer.size())));
+
+    iterator first(container.begin(), ids, 0);
+    iterator last(container.begin(), ids, ids->size());
+    literator lfirst(lcontainer.begin(), ids, 0);
+    literator llast(lcontainer.begin(), ids, ids->size());
+
+    return make_generator(first, last, lfirst, llast, n_classes, desc);
+}
+
+/*!
+ * \brief Make an out-of-memory data generator over the shard of the given
+ * stream owned by the current process.
+ *
+ * The whole stream is read, only every world-th sample is kept.
+ *
+ * \param first The iterator on the beginning on data
+ * \param lfirst The iterator on the beginning on labels
+ * \param n The size of the entire dataset
+ * \param n_classes The number of classes
+ * \param part The shard of the current process
+ */
+template <typename Iterator, typename LIterator, typename... Parameters>
+auto make_generator(Iterator first, LIterator lfirst, size_t n, size_t n_classes, const shard& part, const outmemory_data_generator_desc<Parameters...>& desc) {
+    const size_t m = part.size(n);
+
+    // The number of elements after the first owned one
+    const size_t left = m ? n - part.rank - 1 : 0;
+
+    if (m) {
+        std::advance(first, part.rank);
+        std::advance(lfirst, part.rank);
+    }
+
+    strided_iterator<Iterator> it(first, part.world, left);
+    strided_iterator<LIterator> lit(lfirst, part.world, left);
+
+    return make_generator(it, it, lit, lit, m, n_classes, desc);
+}
+
+} //end of dll namespace
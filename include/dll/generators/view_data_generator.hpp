@@ -0,0 +1,343 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator viewing existing containers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+
+#include "dll/util/random_stream.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A data generator over an existing contiguous tensor of samples,
+ * without any copy of the samples.
+ *
+ * The tensor (and the labels) must outlive the generator and must not be
+ * modified while the generator is used. Since the samples cannot be
+ * moved, the generator shuffles the order of the batches and not the
+ * order of the samples inside the batches.
+ *
+ * For categorical generators, the labels are class indices, expanded
+ * into one-hot vectors one batch at a time. Otherwise, the labels are
+ * viewed directly as well.
+ */
+template <typename Input, typename Labels, typename Desc>
+struct view_data_generator {
+    using desc   = Desc;                 ///< The generator descriptor
+    using weight = etl::value_t<Input>; ///< The data type
+
+    static_assert(etl::is_dma<Input>, "view_data_generator needs samples in contiguous memory");
+    static_assert(desc::Categorical || etl::is_dma<Labels>, "view_data_generator needs labels in contiguous memory");
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    const Input& input;   ///< The viewed samples
+    const Labels& labels; ///< The viewed labels
+
+    etl::dyn_matrix<weight, 2> label_batch_cache; ///< The one-hot labels of the current batch (categorical only)
+
+    std::vector<size_t> order; ///< The order of the batches
+
+    size_t current = 0; ///< The current index
+
+    random_stream engine; ///< The random stream of the shuffles
+
+    /*!
+     * \brief Construct a generator viewing the given samples and labels
+     * \param input The samples, with the samples along the first dimension
+     * \param labels The labels
+     * \param n_classes The number of classes
+     */
+    view_data_generator(const Input& input, const Labels& labels, size_t n_classes) : input(input), labels(labels), order(batches()) {
+        std::iota(order.begin(), order.end(), 0);
+
+        if constexpr (desc::Categorical) {
+            label_batch_cache = etl::dyn_matrix<weight, 2>(batch_size, n_classes);
+            fill_labels();
+        } else {
+            cpp_unused(n_classes);
+        }
+    }
+
+    view_data_generator(const view_data_generator& rhs) = delete;
+    view_data_generator operator=(const view_data_generator& rhs) = delete;
+
+    view_data_generator(view_data_generator&& rhs) = delete;
+    view_data_generator operator=(view_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "View Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // The memory is not owned by the generator
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        // The memory is not owned by the generator
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+        fill_labels();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of the batches
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the batches.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), engine);
+
+        fill_labels();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        input.ensure_gpu_up_to_date();
+
+        if constexpr (!desc::Categorical) {
+            labels.ensure_gpu_up_to_date();
+        }
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return etl::dim<0>(input);
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+        fill_labels();
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        return etl::slice(input, first(), last());
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        if constexpr (desc::Categorical) {
+            return etl::slice(label_batch_cache, 0, last() - first());
+        } else {
+            return etl::slice(labels, first(), last());
+        }
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<Input>() - 1;
+    }
+
+private:
+    /*!
+     * \brief Returns the first sample of the current batch
+     */
+    size_t first() const {
+        return order[current_batch()] * batch_size;
+    }
+
+    /*!
+     * \brief Returns the end of the samples of the current batch
+     */
+    size_t last() const {
+        return std::min(first() + batch_size, size());
+    }
+
+    /*!
+     * \brief Expand the labels of the current batch into one-hot vectors
+     */
+    void fill_labels() {
+        if constexpr (desc::Categorical) {
+            if (has_next_batch()) {
+                label_batch_cache = weight(0);
+
+                for (size_t i = first(); i < last(); ++i) {
+                    label_batch_cache(i - first(), size_t(labels[i])) = weight(1);
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Input, typename Labels, typename Desc>
+std::ostream& operator<<(std::ostream& os, view_data_generator<Input, Labels, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a view_data_generator
+ */
+template <typename... Parameters>
+struct view_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the generators must make the labels categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    /*!
+     * \brief Indicates if this is an auto-encoder task
+     */
+    static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<batch_size_id, categorical_id, nop_id, autoencoder_id>, Parameters...>,
+        "Invalid parameters type for view_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename Input, typename Labels>
+    using generator_t = view_data_generator<Input, Labels, view_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a generator viewing the given samples and labels, without
+ * copying them.
+ *
+ * \param input The samples, with the samples along the first dimension
+ * \param labels The labels
+ * \param n_classes The number of classes
+ */
+template <typename Input, typename Labels, typename... Parameters>
+auto make_generator(const Input& input, const Labels& labels, size_t n_classes, const view_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename view_data_generator_desc<Parameters...>::template generator_t<Input, Labels>;
+    return std::make_unique<generator_t>(input, labels, n_classes);
+}
+
+} //end of dll namespace
@@ -58,6 +58,11 @@ struct generic_dbn_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The type of noise
+     */
+    static constexpr noise_type NoiseModel = detail::get_value_v<noise_model<noise_type::MASKING>, Parameters...>;
+
     /*!
      * \brief The pre binarization thresholding
      */
@@ -83,6 +88,42 @@ struct generic_dbn_desc {
      */
     static constexpr auto Early = detail::get_value_v<early_stopping<strategy::ERROR_GOAL>, Parameters...>;
 
+    /*!
+     * \brief The number of shards for data-parallel training
+     */
+    static constexpr size_t Shards = detail::get_value_v<data_parallel<1>, Parameters...>;
+
+    /*!
+     * \brief The number of stages for pipeline-parallel training
+     */
+    static constexpr size_t PipelineStages = detail::get_value_v<pipeline_parallel<1>, Parameters...>;
+
+    /*!
+     * \brief The number of micro-batches for pipeline-parallel training
+     */
+    static constexpr size_t MicroBatches = detail::get_value_v<micro_batches<PipelineStages>, Parameters...>;
+
+    /*!
+     * \brief The number of mini-batches over which the gradients are accumulated
+     */
+    static constexpr size_t AccumulationSteps = detail::get_value_v<gradient_accumulation<1>, Parameters...>;
+
+    /*!
+     * \brief The number of layers of each segment of recomputed activations
+     * (0 if the activations are not recomputed)
+     */
+    static constexpr size_t RecomputeSegment = detail::get_value_v<recompute_activations<0>, Parameters...>;
+
+    /*!
+     * \brief The number of first layers that are frozen during SGD training
+     */
+    static constexpr size_t FrozenPrefix = detail::get_value_v<frozen_prefix<0>, Parameters...>;
+
+    /*!
+     * \brief The number of batches cached during pretraining in batch mode
+     */
+    static constexpr size_t PretrainCache = detail::get_value_v<pretrain_cache<0>, Parameters...>;
+
     /*! The type of the trainer to use to train the DBN */
     template <typename DBN>
     using trainer_t = typename detail::get_template_type<trainer<default_dbn_trainer_t>, Parameters...>::template value<DBN>;
@@ -106,15 +147,26 @@ struct generic_dbn_desc {
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
     static_assert(BigBatchSize > 0, "Big Batch size must be at least 1");
+    static_assert(Shards > 0, "The number of shards must be at least 1");
+    static_assert(BatchSize % Shards == 0, "The batch size must be divisible by the number of shards");
+    static_assert(PipelineStages > 0, "The number of pipeline stages must be at least 1");
+    static_assert(MicroBatches > 0, "The number of micro-batches must be at least 1");
+    static_assert(PipelineStages == 1 || BatchSize % MicroBatches == 0, "The batch size must be divisible by the number of micro-batches");
+    static_assert(PipelineStages == 1 || Shards == 1, "Pipeline and data parallelism cannot be combined");
+    static_assert(AccumulationSteps > 0, "The number of accumulation steps must be at least 1");
+    static_assert(RecomputeSegment < 2 || (Shards == 1 && PipelineStages == 1), "The recomputation of the activations is only supported by the serial trainer");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                trainer_id, watcher_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id, no_epoch_error_id,
+                trainer_id, watcher_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id, no_epoch_error_id, full_epoch_error_id, overlapped_validation_id,
                 batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, loss_id,
-                normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, updater_id,
-                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id>,
+                normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, noise_model_id, updater_id,
+                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id, data_parallel_id,
+                gradient_accumulation_id, pretrain_cache_id, blocked_inference_id, hogwild_id,
+                pipeline_parallel_id, micro_batches_id, frozen_prefix_id, shared_errors_id, recompute_activations_id,
+                unfused_updates_id, gpu_resident_id>,
             Parameters...>,
         "Invalid parameters type");
 };
@@ -124,3 +176,4 @@ struct generic_dbn_desc {
 // Include the trainers
 #include "dll/trainer/conjugate_gradient.hpp"
 #include "dll/trainer/stochastic_gradient_descent.hpp"
+#include "dll/trainer/lbfgs.hpp"
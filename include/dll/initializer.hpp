@@ -6,15 +6,87 @@
 //=======================================================================
 
 #include "dll/util/random.hpp"
+#include "dll/util/random_stream.hpp"
 
 /*!
  * \brief Initialization methods
+ *
+ * The random initializations fill each tensor from its own counter-based
+ * stream, in parallel chunks. For a given seed, the weights are the same
+ * whatever the number of threads.
  */
 
 #pragma once
 
 namespace dll {
 
+namespace detail {
+
+/*!
+ * \brief Returns the flag indicating if the initialization of the weights is
+ * skipped in the current thread
+ */
+inline bool& skip_initialization() {
+    static thread_local bool skip = false;
+    return skip;
+}
+
+/*!
+ * \brief Fill the given tensor with normal numbers, from a new stream
+ */
+template <typename B>
+void init_normal_fill(B& b, double mean, double stddev) {
+    using T = etl::value_t<B>;
+
+    b.ensure_cpu_up_to_date();
+    parallel_normal_fill(b.memory_start(), etl::size(b), next_stream_key(), T(mean), T(stddev));
+    b.invalidate_gpu();
+}
+
+/*!
+ * \brief Fill the given tensor with uniform numbers in [a, b), from a new
+ * stream
+ */
+template <typename W>
+void init_uniform_fill(W& w, double a, double b) {
+    using T = etl::value_t<W>;
+
+    w.ensure_cpu_up_to_date();
+    parallel_uniform_fill(w.memory_start(), etl::size(w), next_stream_key(), T(a), T(b));
+    w.invalidate_gpu();
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Skip the initialization of the weights of the layers constructed
+ * by the current thread while the scope is alive.
+ *
+ * This is only useful for networks whose weights are loaded right after
+ * their construction, the weights are left uninitialized.
+ */
+struct uninitialized_scope {
+    /*!
+     * \brief Start skipping the initialization
+     */
+    uninitialized_scope() : previous(detail::skip_initialization()) {
+        detail::skip_initialization() = true;
+    }
+
+    uninitialized_scope(const uninitialized_scope& rhs) = delete;
+    uninitialized_scope& operator=(const uninitialized_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous state
+     */
+    ~uninitialized_scope() {
+        detail::skip_initialization() = previous;
+    }
+
+private:
+    const bool previous; ///< The state before the scope
+};
+
 /*!
  * \brief Initialization function no-op
  */
@@ -48,6 +120,10 @@ struct init_constant {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
+        if (detail::skip_initialization()) {
+            return;
+        }
+
         cpp_unused(nin);
         cpp_unused(nout);
 
@@ -79,13 +155,17 @@ struct init_normal {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
+        if (detail::skip_initialization()) {
+            return;
+        }
+
         cpp_unused(nin);
         cpp_unused(nout);
 
         constexpr auto mean   = etl::value_t<B>(Mean::num) / etl::value_t<B>(Mean::den);
         constexpr auto stddev = etl::value_t<B>(Std::num) / etl::value_t<B>(Std::den);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), mean, stddev);
+        detail::init_normal_fill(b, mean, stddev);
     }
 };
 
@@ -103,13 +183,17 @@ struct init_uniform {
      */
     template<typename W>
     static void initialize(W& w, size_t nin, size_t nout){
+        if (detail::skip_initialization()) {
+            return;
+        }
+
         cpp_unused(nin);
         cpp_unused(nout);
 
         constexpr auto a = etl::value_t<W>(A::num) / etl::value_t<W>(A::den);
         constexpr auto b = etl::value_t<W>(B::num) / etl::value_t<W>(B::den);
 
-        w = etl::uniform_generator<etl::value_t<W>>(dll::rand_engine(), a, b);
+        detail::init_uniform_fill(w, a, b);
     }
 };
 
@@ -128,9 +212,13 @@ struct init_lecun {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
+        if (detail::skip_initialization()) {
+            return;
+        }
+
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) / sqrt(double(nin));
+        detail::init_normal_fill(b, 0.0, 1.0 / sqrt(double(nin)));
     }
 };
 
@@ -147,9 +235,13 @@ struct init_xavier {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
+        if (detail::skip_initialization()) {
+            return;
+        }
+
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(1.0 / nin);
+        detail::init_normal_fill(b, 0.0, sqrt(1.0 / nin));
     }
 };
 
@@ -166,7 +258,11 @@ struct init_xavier_full {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / (nin + nout));
+        if (detail::skip_initialization()) {
+            return;
+        }
+
+        detail::init_normal_fill(b, 0.0, sqrt(2.0 / (nin + nout)));
     }
 };
 
@@ -183,9 +279,13 @@ struct init_he {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
+        if (detail::skip_initialization()) {
+            return;
+        }
+
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / nin);
+        detail::init_normal_fill(b, 0.0, sqrt(2.0 / nin));
     }
 };
 
@@ -36,6 +36,8 @@ template <typename Parent>
 struct layer {
     using parent_t = Parent; ///< The CRTP parent layer
 
+    static constexpr size_t forward_many_tile = 64; ///< The number of samples forwarded at once by the *_forward_many functions
+
     //No copying
     layer(const layer& rbm) = delete;
     layer& operator=(const layer& rbm) = delete;
@@ -182,9 +184,7 @@ struct layer {
      */
     template <typename Input, typename Output>
     void test_forward_many(Output&& output, const Input& input) const {
-        for(size_t i = 0; i < output.size(); ++i){
-            test_forward_one(output[i], input[i]);
-        }
+        select_forward_many_tiles<false>(output, input);
     }
 
     /*!
@@ -195,9 +195,7 @@ struct layer {
      */
     template <typename Input, typename Output>
     void train_forward_many(Output&& output, const Input& input) const {
-        for(size_t i = 0; i < output.size(); ++i){
-            train_forward_one(output[i], input[i]);
-        }
+        select_forward_many_tiles<true>(output, input);
     }
 
     /*!
@@ -219,6 +217,62 @@ struct layer {
         }
     }
 
+    /*!
+     * \brief Compute the presentation for a collection of inputs, by tiles
+     * of forward_many_tile samples.
+     *
+     * The inputs of each tile are gathered into a batch, forwarded at once
+     * and the batch of outputs is scattered into the collection of outputs.
+     *
+     * \tparam Train if true compute the train representation,
+     * otherwise the test representation
+     *
+     * \param output The collection of output to fill
+     * \param input The collection of input to compute the representation from
+     */
+    template <bool Train, typename Input, typename Output>
+    void select_forward_many_tiles(Output&& output, const Input& input) const {
+        const size_t n = output.size();
+
+        size_t i = 0;
+
+        auto forward_tile = [&](auto& input_batch, auto& output_batch) {
+            const size_t b = etl::dim<0>(input_batch);
+
+            for (size_t j = 0; j < b; ++j) {
+                input_batch(j) = input[i + j];
+            }
+
+            if constexpr (Train) {
+                as_derived().train_forward_batch(output_batch, input_batch);
+            } else {
+                as_derived().test_forward_batch(output_batch, input_batch);
+            }
+
+            for (size_t j = 0; j < b; ++j) {
+                output[i + j] = output_batch(j);
+            }
+
+            i += b;
+        };
+
+        if (n >= forward_many_tile) {
+            auto input_batch  = batch_make<forward_many_tile>(input[0]);
+            auto output_batch = batch_make<forward_many_tile>(output[0]);
+
+            while (i + forward_many_tile <= n) {
+                forward_tile(input_batch, output_batch);
+            }
+        }
+
+        if (i < n) {
+            auto input_batch  = batch_make(n - i, input[0]);
+            auto output_batch = batch_make(n - i, output[0]);
+
+            forward_tile(input_batch, output_batch);
+        }
+    }
+
     // Functions to propagate one batch at time
 
     /*!
@@ -239,7 +293,7 @@ struct layer {
         auto output_batch = batch_extend(input_batch, one);
 
         // Finally forward propagation from input to output
-        test_forward_batch(output_batch, input_batch);
+        as_derived().test_forward_batch(output_batch, input_batch);
 
         // Return the output batch
         return output_batch;
@@ -375,6 +429,13 @@ struct layer {
         }
     }
 
+    /*!
+     * \brief Release the CG context, once the layer is not trained anymore
+     */
+    void release_cg_context() const {
+        cg_context_ptr.reset();
+    }
+
     /*!
      * \brief Returns the context for CG training.
      * \return A reference to the CG context training.
@@ -409,6 +470,13 @@ struct layer {
         // Nothing by default
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() const {
+        // Nothing by default
+    }
+
 private:
     //CRTP Deduction
 
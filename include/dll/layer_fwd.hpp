@@ -29,18 +29,30 @@ struct conv_rbm_mp_impl;
 template <typename Desc>
 struct dyn_conv_rbm_mp_impl;
 
+template <typename Desc>
+struct mp_2d_layer_impl;
+
 template <typename Desc>
 struct mp_3d_layer_impl;
 
 template <typename Desc>
 struct dyn_mp_3d_layer_impl;
 
+template <typename Desc>
+struct avgp_2d_layer_impl;
+
 template <typename Desc>
 struct avgp_3d_layer_impl;
 
 template <typename Desc>
 struct dyn_avgp_3d_layer_impl;
 
+template <typename Desc>
+struct global_avgp_layer_impl;
+
+template <typename Desc>
+struct dyn_global_avgp_layer_impl;
+
 template <typename Desc>
 struct upsample_3d_layer_impl;
 
@@ -74,12 +86,33 @@ struct dense_layer_impl;
 template <typename Desc>
 struct dyn_dense_layer_impl;
 
+template <typename Desc>
+struct tied_dense_layer_impl;
+
+template <typename Desc>
+struct binary_dense_layer_impl;
+
+template <typename Desc>
+struct sampled_softmax_layer_impl;
+
+template <typename Desc>
+struct hierarchical_softmax_layer_impl;
+
 template <typename Desc>
 struct conv_layer_impl;
 
 template <typename Desc>
 struct dyn_conv_layer_impl;
 
+template <typename Desc>
+struct conv_same_layer_impl;
+
+template <typename Desc>
+struct grouped_conv_layer_impl;
+
+template <typename Desc>
+struct dyn_grouped_conv_layer_impl;
+
 template <typename Desc>
 struct deconv_layer_impl;
 
@@ -89,6 +122,12 @@ struct dyn_deconv_layer_impl;
 template <typename Desc>
 struct activation_layer_impl;
 
+template <typename Desc>
+struct dropout_layer_impl;
+
+template <typename Desc>
+struct dyn_dropout_layer_impl;
+
 template <typename... Layers>
 struct group_layer_desc;
 
@@ -113,4 +152,22 @@ struct dyn_merge_layer_desc;
 template <typename Desc>
 struct dyn_merge_layer_impl;
 
+template <typename Desc>
+struct rnn_layer_impl;
+
+template <typename Desc>
+struct dyn_rnn_layer_impl;
+
+template <typename Desc>
+struct lstm_layer_impl;
+
+template <typename Desc>
+struct dyn_lstm_layer_impl;
+
+template <typename Desc>
+struct recurrent_last_layer_impl;
+
+template <typename Desc>
+struct dyn_recurrent_last_layer_impl;
+
 } //end of dll namespace
@@ -234,6 +234,30 @@ struct rbm_layer_traits {
     static constexpr bool free_energy() {
         return base_traits::has_free_energy;
     }
+
+    /*!
+     * \brief Returns the number of shards of each batch for data-parallel
+     * Contrastive Divergence.
+     */
+    static constexpr size_t shards() {
+        return base_traits::shards;
+    }
+
+    /*!
+     * \brief Returns the number of batches between two batches whose
+     * monitoring metrics are computed.
+     */
+    static constexpr size_t monitor_batches() {
+        return base_traits::monitor_batches;
+    }
+
+    /*!
+     * \brief Indicates if the inputs of the RBM are sparse and the positive
+     * phase computed on a CSR copy of the batch.
+     */
+    static constexpr bool sparse_input() {
+        return base_traits::has_sparse_input;
+    }
 };
 
 template <typename T>
@@ -407,4 +431,11 @@ constexpr size_t input_size(const RBM&) {
     return RBM::input_size();
 }
 
+/*!
+ * \brief Indicates if the given layer uses the weights of another layer of
+ * the network
+ */
+template <typename Layer>
+static constexpr bool is_tied_layer = cpp::is_specialization_of_v<dll::tied_dense_layer_impl, std::decay_t<Layer>>;
+
 } //end of dll namespace
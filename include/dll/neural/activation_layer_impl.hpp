@@ -26,6 +26,8 @@ struct activation_layer_impl : transform_layer<activation_layer_impl<Desc>> {
 
     static constexpr function activation_function = desc::activation_function;
 
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     activation_layer_impl() = default;
 
     /*!
@@ -128,6 +130,8 @@ struct sgd_context<DBN, activation_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
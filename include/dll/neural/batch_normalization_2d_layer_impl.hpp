@@ -8,6 +8,8 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
+#include "dll/util/fold.hpp"
 
 namespace dll {
 
@@ -26,25 +28,30 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     static constexpr size_t Input = desc::Input; ///< The input size
     static constexpr weight e     = 1e-8;        ///< Epsilon for numerical stability
 
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Input>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, Input>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;            ///< The type of the input
     using output_t     = std::vector<output_one_t>;           ///< The type of the output
 
+    using workspace_t  = batch_norm_workspace<etl::fast_matrix<weight, Input>, etl::dyn_matrix<weight, 2>>; ///< The type of the caches of a training forward pass
+
     etl::fast_matrix<weight, Input> gamma;
     etl::fast_matrix<weight, Input> beta;
 
     etl::fast_matrix<weight, Input> mean;
     etl::fast_matrix<weight, Input> var;
 
-    etl::fast_matrix<weight, Input> last_mean;
-    etl::fast_matrix<weight, Input> last_var;
-    etl::fast_matrix<weight, Input> inv_var;
+    mutable etl::fast_matrix<weight, Input> scale; ///< The inference scale, gamma / sqrt(var + e)
+    mutable etl::fast_matrix<weight, Input> shift; ///< The inference shift, beta - mean * scale
 
-    etl::dyn_matrix<weight, 2> input_pre; /// B x Input
+    mutable bool inference_ready = false; ///< Indicates if scale and shift are up to date with the statistics
 
     weight momentum = 0.9;
 
+    bool folded = false; ///< Indicates if the normalization has been folded into the previous layer
+
     //Backup gamma and beta
     std::unique_ptr<etl::fast_matrix<weight, Input>> bak_gamma; ///< Backup gamma
     std::unique_ptr<etl::fast_matrix<weight, Input>> bak_beta;  ///< Backup beta
@@ -109,6 +116,50 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         test_forward_batch(output, input);
     }
 
+    /*!
+     * \brief Fold the normalization into the weights and the biases of the
+     * given previous (dense) layer, for inference.
+     *
+     * Once folded, the layer forwards its input unchanged and its
+     * parameters are reset to the identity, which is what is stored. The
+     * layer must not be trained anymore after this.
+     *
+     * \param layer The previous layer
+     * \return true if the normalization is folded, false if it cannot be folded into this layer
+     */
+    template <typename L>
+    bool fold_into(L& layer) {
+        if constexpr (is_fold_target<L, 2>) {
+            if (!folded) {
+                fold_batch_normalization_2d(layer, gamma, beta, mean, var, e);
+                folded = true;
+                inference_ready = false;
+            }
+
+            return true;
+        } else {
+            cpp_unused(layer);
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Compute the inference scale and shift from the current
+     * statistics, if they changed since the last inference.
+     *
+     * The statistics and the parameters only change during training,
+     * which always starts with a training forward pass, or when they are
+     * loaded or restored.
+     */
+    void prepare_inference() const {
+        if (!inference_ready) {
+            scale = gamma >> (1.0 / etl::sqrt(var + e));
+            shift = beta - (mean >> scale);
+
+            inference_ready = true;
+        }
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -116,14 +167,20 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
-        dll::auto_timer timer("bn:2d:test:forward");
+        if (folded) {
+            output = input;
+            return;
+        }
+
+        static dll::timer_id timer_handle("bn:2d:test:forward");
+        dll::auto_timer timer(timer_handle);
 
         const auto B = etl::dim<0>(input);
 
-        auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
+        prepare_inference();
 
         for(size_t b = 0; b < B; ++b){
-            output(b) = (gamma >> ((input(b) - mean) >> inv_var)) + beta;
+            output(b) = (input(b) >> scale) + shift;
         }
     }
 
@@ -134,7 +191,31 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("bn:2d:train:forward");
+        workspace_t workspace;
+        forward_batch(output, input, workspace);
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input, during training.
+     *
+     * The statistics of the mini-batch and the normalized inputs are kept
+     * in the workspace, for the backward pass.
+     *
+     * \param output The batch of output
+     * \param input The batch of input to apply the layer to
+     * \param workspace The workspace of the training context
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input, workspace_t& workspace) {
+        cpp_assert(!folded, "A folded normalization cannot be trained");
+
+        auto& last_mean = workspace.last_mean;
+        auto& last_var  = workspace.last_var;
+        auto& inv_var   = workspace.inv_var;
+        auto& input_pre = workspace.input_pre;
+
+        static dll::timer_id timer_handle("bn:2d:train:forward");
+        dll::auto_timer timer(timer_handle);
 
         const auto B = etl::dim<0>(input);
 
@@ -149,7 +230,12 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
             output(b)    = (input_pre(b) >> gamma) + beta;
         }
 
-        // Update the current mean and variance
+        // Update the current mean and variance, the shards of data-parallel
+        // training update them concurrently
+        std::lock_guard<std::mutex> lock(batch_norm_lock());
+
+        inference_ready = false;
+
         mean = momentum * mean + (1.0 - momentum) * last_mean;
         var  = momentum * var + (1.0 - momentum) * (B / (B - 1) * last_var);
     }
@@ -173,7 +259,11 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("bn:2d:backward");
+        const auto& input_pre = context.workspace.input_pre;
+        const auto& inv_var   = context.workspace.inv_var;
+
+        static dll::timer_id timer_handle("bn:2d:backward");
+        dll::auto_timer timer(timer_handle);
 
         const auto B = etl::dim<0>(context.input);
 
@@ -197,7 +287,10 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         // If the layer is not the first one, the gradients already have been computed
 
         if (!C::layer) {
-            dll::unsafe_auto_timer timer("bn:2d:gradients");
+            static dll::timer_id timer_handle("bn:2d:gradients");
+            dll::auto_timer timer(timer_handle);
+
+            const auto& input_pre = context.workspace.input_pre;
 
             // Gradients of gamma
             std::get<0>(context.up.context)->grad = bias_batch_sum_2d(input_pre >> context.errors);
@@ -254,6 +347,44 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         return std::make_tuple(std::cref(gamma), std::cref(beta));
     }
 
+    /*!
+     * \brief Store the parameters and the statistics into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, gamma);
+        cpp::binary_write_all(os, beta);
+        cpp::binary_write_all(os, mean);
+        cpp::binary_write_all(os, var);
+    }
+
+    /*!
+     * \brief Load the parameters and the statistics from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, gamma);
+        cpp::binary_load_all(is, beta);
+        cpp::binary_load_all(is, mean);
+        cpp::binary_load_all(is, var);
+
+        inference_ready = false;
+    }
+
+    /*!
+     * \brief Store the parameters and the statistics into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the parameters and the statistics from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -268,6 +399,16 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     void restore_weights() {
         gamma = *bak_gamma;
         beta  = *bak_beta;
+
+        inference_ready = false;
+    }
+
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        bak_gamma.reset();
+        bak_beta.reset();
     }
 };
 
@@ -306,6 +447,8 @@ struct sgd_context<DBN, batch_normalization_2d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, Desc::Input> output; ///< A batch of output
     etl::fast_matrix<weight, batch_size, Desc::Input> errors; ///< A batch of errors
 
+    typename layer_t::workspace_t workspace; ///< The caches of the last training forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -0,0 +1,538 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "dll/base_traits.hpp"
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/bitpack.hpp" // For bit_matrix
+#include "dll/util/timers.hpp"  // For auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Binary dense layer of neural network.
+ *
+ * The inputs and the weights are binarized to +1/-1, a positive value being
+ * +1. The binary weights of the output n are scaled by the mean magnitude
+ * alpha_n of the real weights of this output.
+ *
+ * The real weights are kept for training. The gradients go straight through
+ * the binarization, cancelled where the magnitude of the real value is
+ * greater than one.
+ *
+ * For inference, the weights are packed once into bits and each output is
+ * computed with XNOR/popcount, alpha_n * (K - 2 * popcount(x ^ w_n)).
+ */
+template <typename Desc>
+struct binary_dense_layer_impl final : neural_layer<binary_dense_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                          ///< The descriptor of the layer
+    using weight      = typename desc::weight;         ///< The data type for this layer
+    using this_type   = binary_dense_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>; ///< The base type
+    using layer_t     = this_type;                     ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
+
+    static constexpr size_t num_visible = desc::num_visible; ///< The number of visible units
+    static constexpr size_t num_hidden  = desc::num_hidden;  ///< The number of hidden units
+
+    static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_hidden>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, num_visible, num_hidden>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, num_hidden>;              ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Real weights
+    b_type b; ///< Hidden biases
+
+    //Backup Weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    mutable bit_matrix w_bits;         ///< The signs of the weights, one row per output
+    mutable std::vector<weight> alpha; ///< The scale of each output
+    mutable bool bits_ready = false;   ///< Indicates if w_bits and alpha are up to date
+
+    /*!
+     * \brief Initialize a binary dense layer with basic weights.
+     */
+    binary_dense_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     */
+    static constexpr size_t parameters() noexcept {
+        // Weights + Biases
+        return num_visible * num_hidden + num_hidden;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "BinaryDense";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "BinaryDense (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if constexpr (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "BinaryDense: %lu -> %lu", num_visible, num_hidden);
+        } else {
+            snprintf(buffer, 512, "BinaryDense: %lu -> %s -> %lu", num_visible, to_string(activation_function).c_str(), num_hidden);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_hidden};
+    }
+
+    /*!
+     * \brief Compute the scale of each output, the mean magnitude of its
+     * real weights
+     * \param scales The scales, of num_hidden elements
+     */
+    void compute_scales(weight* scales) const {
+        w.ensure_cpu_up_to_date();
+
+        const weight* ws = w.memory_start();
+
+        for (size_t n = 0; n < num_hidden; ++n) {
+            scales[n] = weight(0);
+        }
+
+        for (size_t k = 0; k < num_visible; ++k) {
+            for (size_t n = 0; n < num_hidden; ++n) {
+                scales[n] += std::abs(ws[k * num_hidden + n]);
+            }
+        }
+
+        for (size_t n = 0; n < num_hidden; ++n) {
+            scales[n] /= weight(num_visible);
+        }
+    }
+
+    /*!
+     * \brief Compute the scaled binary weights, alpha_n * sign(w)
+     * \param wb The binary weights to fill
+     */
+    template <typename WB>
+    void binary_weights(WB& wb) const {
+        std::vector<weight> scales(num_hidden);
+
+        compute_scales(scales.data());
+
+        const weight* ws = w.memory_start();
+        weight* bs       = wb.memory_start();
+
+        for (size_t k = 0; k < num_visible; ++k) {
+            for (size_t n = 0; n < num_hidden; ++n) {
+                bs[k * num_hidden + n] = ws[k * num_hidden + n] > weight(0) ? scales[n] : -scales[n];
+            }
+        }
+
+        wb.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Returns the binarized (+1/-1) batch of inputs
+     * \param input The batch of inputs
+     */
+    template <typename V>
+    static etl::dyn_matrix<weight, 2> binary_input(const V& input) {
+        const auto Batch = etl::dim<0>(input);
+
+        etl::dyn_matrix<weight, 2> xb(Batch, num_visible);
+
+        xb = etl::reshape(input, Batch, num_visible);
+
+        xb.ensure_cpu_up_to_date();
+
+        for (auto& x : xb) {
+            x = x > weight(0) ? weight(1) : weight(-1);
+        }
+
+        xb.invalidate_gpu();
+
+        return xb;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, in floating point,
+     * as it is trained.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("binary_dense:forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(etl::dim<0>(output) == etl::dim<0>(input), "The number of samples must be consistent");
+
+        // Local temporaries, the forward pass is run concurrently by the data-parallel trainers
+        etl::fast_dyn_matrix<weight, num_visible, num_hidden> wb;
+        binary_weights(wb);
+
+        output = binary_input(input) * wb;
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, !no_bias>(output, b);
+    }
+
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs, with
+     * XNOR/popcount products on the packed bits.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        static dll::timer_id timer_handle("binary_dense:test_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const auto Batch = etl::dim<0>(input);
+
+        if constexpr (etl::is_dma<Input>) {
+            input.ensure_cpu_up_to_date();
+
+            forward_bits<F>(output, pack_bits(input.memory_start(), Batch, num_visible, weight(0)));
+        } else {
+            etl::dyn_matrix<weight, 2> x(Batch, num_visible);
+
+            x = etl::reshape(input, Batch, num_visible);
+
+            forward_bits<F>(output, pack_bits(x.memory_start(), Batch, num_visible, weight(0)));
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to a batch of inputs already packed into bits
+     * (for instance, the binarized inputs of the first layer).
+     *
+     * \param output The output batch to fill
+     * \param input The packed input batch, one row of num_visible bits per sample
+     */
+    template <function F = activation_function, typename Output>
+    void forward_bits(Output&& output, const bit_matrix& input) const {
+        cpp_assert(input.cols == num_visible, "Invalid number of bits of the inputs");
+        cpp_assert(etl::dim<0>(output) == input.rows, "The number of samples must be consistent");
+
+        prepare_inference();
+
+        if constexpr (etl::is_dma<Output>) {
+            xnor_popcount_gemm(output.memory_start(), input, w_bits, alpha.data());
+
+            output.invalidate_gpu();
+
+            // Bias and activation in a single pass over the output
+            f_bias_activate_2d<F, !no_bias>(output, b);
+        } else {
+            etl::dyn_matrix<weight, 2> out(input.rows, num_hidden);
+
+            xnor_popcount_gemm(out.memory_start(), input, w_bits, alpha.data());
+
+            out.invalidate_gpu();
+
+            f_bias_activate_2d<F, !no_bias>(out, b);
+
+            output = out;
+        }
+    }
+
+    /*!
+     * \brief Pack the signs of the weights into bits, if they changed since
+     * the last inference.
+     */
+    void prepare_inference() const {
+        if (!bits_ready) {
+            alpha.resize(num_hidden);
+            compute_scales(alpha.data());
+
+            // One row of bits per output, for the XNOR of the input rows
+            w_bits = pack_bits(w.memory_start(), num_hidden, num_visible, weight(0), true);
+
+            bits_ready = true;
+        }
+    }
+
+    /*!
+     * \brief Forget the packed bits of the weights, after a change of the
+     * weights
+     */
+    void weights_changed() {
+        bits_ready = false;
+    }
+
+    /*!
+     * \brief Restore the weights from the secondary weights matrix
+     */
+    void restore_weights() {
+        base_type::restore_weights();
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Load the weigts from the given stream
+     */
+    void load(std::istream& is) {
+        base_type::load(is);
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Load the weigts from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Returns the size of the packed weights (and scales), in bytes
+     */
+    size_t packed_memory() const {
+        prepare_inference();
+
+        return w_bits.memory() + alpha.size() * sizeof(weight);
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DLayer>
+    static void dyn_init(DLayer& dyn){
+        cpp_unused(dyn);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        static dll::timer_id timer_handle("binary_dense:adapt_errors");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers, straight
+     * through the binarization of the inputs
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        static dll::timer_id timer_handle("binary_dense:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+        etl::fast_dyn_matrix<weight, num_visible, num_hidden> wb;
+        binary_weights(wb);
+
+        etl::fast_dyn_matrix<weight, Batch, num_visible> input_errors;
+
+        input_errors = context.errors * etl::transpose(wb);
+
+        // Clipped straight-through estimator: no gradient where |x| > 1
+        context.input.ensure_cpu_up_to_date();
+        input_errors.ensure_cpu_up_to_date();
+
+        const weight* x = context.input.memory_start();
+        weight* e       = input_errors.memory_start();
+
+        for (size_t i = 0; i < Batch * num_visible; ++i) {
+            if (std::abs(x[i]) > weight(1)) {
+                e[i] = weight(0);
+            }
+        }
+
+        input_errors.invalidate_gpu();
+
+        etl::reshape<Batch, num_visible>(output) = input_errors;
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        static dll::timer_id timer_handle("binary_dense:compute_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        w_grad = batch_outer(binary_input(context.input), context.errors);
+
+        // Clipped straight-through estimator: no gradient where |w| > 1
+        w.ensure_cpu_up_to_date();
+        w_grad.ensure_cpu_up_to_date();
+
+        const weight* ws = w.memory_start();
+        weight* gs       = w_grad.memory_start();
+
+        for (size_t i = 0; i < num_visible * num_hidden; ++i) {
+            if (std::abs(ws[i]) > weight(1)) {
+                gs[i] = weight(0);
+            }
+        }
+
+        w_grad.invalidate_gpu();
+
+        if constexpr (!no_bias) {
+            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+        }
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t binary_dense_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t binary_dense_layer_impl<Desc>::num_hidden;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<binary_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for binary_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, binary_dense_layer_impl<Desc>, L> {
+    using layer_t = binary_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_hidden  = layer_t::num_hidden;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;
+    etl::fast_matrix<weight, batch_size, num_hidden> output;
+    etl::fast_matrix<weight, batch_size, num_hidden> errors;
+
+    sgd_context(const layer_t& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
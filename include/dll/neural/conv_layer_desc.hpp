@@ -29,6 +29,11 @@ struct conv_layer_desc {
      */
     using parameters = cpp::type_list<Parameters...>;
 
+    static constexpr size_t S1 = detail::get_value_1<stride<1, 1>, Parameters...>::value;   ///< The first stride
+    static constexpr size_t S2 = detail::get_value_2<stride<1, 1>, Parameters...>::value;   ///< The second stride
+    static constexpr size_t D1 = detail::get_value_1<dilation<1, 1>, Parameters...>::value; ///< The first dilation
+    static constexpr size_t D2 = detail::get_value_2<dilation<1, 1>, Parameters...>::value; ///< The second dilation
+
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
@@ -49,10 +54,12 @@ struct conv_layer_desc {
     static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
     static_assert(NC > 0, "At least one channel is necessary");
     static_assert(K > 0, "At least one group is necessary");
+    static_assert(S1 > 0 && S2 > 0, "The strides must be at least 1");
+    static_assert(D1 > 0 && D2 > 0, "The dilations must be at least 1");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, stride_id, dilation_id>, Parameters...>,
         "Invalid parameters type for rbm_desc");
 };
 
@@ -10,6 +10,12 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/conv_tuner.hpp"
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/nchwc.hpp"
+#include "dll/util/quantize.hpp"
+#include "dll/trainer/shared_errors.hpp"
+#include "dll/trainer/recomputation.hpp"
 
 namespace dll {
 
@@ -32,12 +38,30 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     static constexpr size_t NC  = desc::NC;  ///< The number of input channels
     static constexpr size_t K   = desc::K;   ///< The number of filters
 
-    static constexpr size_t NH1 = NV1 - NW1 + 1; //By definition
-    static constexpr size_t NH2 = NV2 - NW2 + 1; //By definition
+    static constexpr size_t S1 = desc::S1; ///< The first stride
+    static constexpr size_t S2 = desc::S2; ///< The second stride
+    static constexpr size_t D1 = desc::D1; ///< The first dilation
+    static constexpr size_t D2 = desc::D2; ///< The second dilation
+
+    static constexpr size_t DW1 = D1 * (NW1 - 1) + 1; ///< The first dimension of the dilated filter
+    static constexpr size_t DW2 = D2 * (NW2 - 1) + 1; ///< The second dimension of the dilated filter
+
+    static_assert(NV1 >= DW1 && NV2 >= DW2, "The (dilated) filters cannot be larger than the input");
+
+    static constexpr size_t NH1 = (NV1 - DW1) / S1 + 1; //By definition
+    static constexpr size_t NH2 = (NV2 - DW2) / S2 + 1; //By definition
+
+    /*!
+     * \brief Indicates if the convolution is strided or dilated. ETL only
+     * supports dense convolutions, such convolutions use direct kernels.
+     */
+    static constexpr bool direct = S1 != 1 || S2 != 1 || D1 != 1 || D2 != 1;
 
     static constexpr auto activation_function = desc::activation_function; ///< The activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
 
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
 
@@ -57,6 +81,10 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    int8_quantization quantization; ///< The INT8 quantization of the layer
+
+    mutable etl::dyn_vector<weight> blocked_w; ///< The filters packed for the NCHWc layout, empty until requested
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -143,32 +171,152 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     }
 
     using base_type::forward_batch;
+    using base_type::test_forward_batch;
 
     /*!
      * \brief Apply the layer to the given batch of input.
      *
      * \param input A batch of input
      * \param output A batch of output that will be filled
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
      */
-    template <typename H1, typename V>
+    template <function F = activation_function, typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
+        static dll::timer_id timer_handle("conv:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward(v, w);
+        if constexpr (direct) {
+            grouped_conv_forward(output, v, w, dims(etl::dim<0>(v)));
         } else {
-            output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
+            conv_tuner::instance().run(conv_pass::FORWARD, {etl::dim<0>(v), NC, NV1, NV2, K, NW1, NW2}, [&] {
+                if constexpr (etl::dimensions<V>() == 4) {
+                    output = etl::ml::convolution_forward(v, w);
+                } else {
+                    output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
+                }
+            });
         }
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<F, !no_bias>(output, b);
+    }
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * Once the layer is quantized, the INT8 path is used.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        if (quantization.ready) {
+            quantized_forward_batch<F>(output, input);
+        } else {
+            forward_batch<F>(output, input);
         }
+    }
+
+    /*!
+     * \brief Pack the filters for the NCHWc layout (see nchwc.hpp), used by
+     * blocked_forward_batch.
+     */
+    void prepare_blocked_inference() const {
+        w.ensure_cpu_up_to_date();
+
+        blocked_w = etl::dyn_vector<weight>(nchwc_filters_size<weight>(K, NC, NW1, NW2));
+
+        nchwc_pack_filters(blocked_w.memory_start(), w.memory_start(), K, NC, NW1, NW2);
+    }
+
+    /*!
+     * \brief Pack the filters again, if they were packed, since the weights
+     * may have been changed since.
+     */
+    void prepare_inference() const {
+        if (etl::size(blocked_w)) {
+            prepare_blocked_inference();
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to a batch of input in the NCHWc layout, with
+     * the packed filters.
+     *
+     * \param output The blocked output [B, ceil(K / c), NH1, NH2, c]
+     * \param input The blocked input [B, ceil(NC / c), NV1, NV2, c]
+     * \param B The number of samples
+     * \tparam F The activation function, which must be element-wise
+     */
+    template <function F = activation_function>
+    void blocked_forward_batch(weight* output, const weight* input, size_t B) const {
+        static dll::timer_id timer_handle("conv:blocked_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        static_assert(is_elementwise_function<F>, "The NCHWc layout only supports element-wise activations");
+
+        cpp_assert(etl::size(blocked_w), "The filters must be packed first");
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+        b.ensure_cpu_up_to_date();
+
+        nchwc_conv_forward(output, input, blocked_w.memory_start(), no_bias ? nullptr : b.memory_start(), dims(B));
+
+        if constexpr (F != function::IDENTITY) {
+            etl::custom_dyn_matrix<weight, 1> out(output, nchwc_size<weight>(B, K, NH1 * NH2));
+
+            out = f_activate<F>(out);
         }
     }
 
+    /*!
+     * \brief Apply the INT8 quantized layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F = activation_function, typename H, typename V>
+    void quantized_forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("conv:quantized_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(quantization.ready, "The layer must be quantized first");
+
+        int8_conv_forward(output, input, quantization, dims(etl::dim<0>(input)));
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<F, !no_bias>(output, b);
+    }
+
+    /*!
+     * \brief Update the quantization calibration with the given batch of input
+     */
+    template <typename V>
+    void calibrate_quantization(const V& input) {
+        quantization.calibrate(input);
+    }
+
+    /*!
+     * \brief Quantize the weights to INT8, with the current calibration.
+     *
+     * This must be done again each time the weights are changed.
+     *
+     * \return true if the layer was quantized, false otherwise
+     */
+    bool quantize() {
+        return quantization.quantize(w, K, NC * NW1 * NW2, false);
+    }
+
+    /*!
+     * \brief Go back to the floating point inference and forget the calibration
+     */
+    void clear_quantization() {
+        quantization.clear();
+    }
+
 
     /*!
      * \brief Prepare one empty output for this layer
@@ -197,7 +345,7 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename DRBM>
     static void dyn_init(DRBM& dyn){
-        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2);
+        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2, S1, S2, D1, D2);
     }
 
     /*!
@@ -209,7 +357,8 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void adapt_errors(C& context) const {
-        dll::auto_timer timer("conv:adapt_errors");
+        static dll::timer_id timer_handle("conv:adapt_errors");
+        dll::auto_timer timer(timer_handle);
 
         if constexpr (activation_function != function::IDENTITY){
             context.errors = f_derivative<activation_function>(context.output) >> context.errors;
@@ -223,12 +372,19 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("conv:backward_batch");
+        static dll::timer_id timer_handle("conv:backward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        if constexpr (etl::dimensions<H>() == 4) {
-            output = etl::ml::convolution_backward(context.errors, w);
+        if constexpr (direct) {
+            grouped_conv_backward(output, context.errors, w, dims(etl::dim<0>(output)));
         } else {
-            etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(context.errors, w);
+            conv_tuner::instance().run(conv_pass::BACKWARD, {etl::dim<0>(output), K, NH1, NH2, NC, NW1, NW2}, [&] {
+                if constexpr (etl::dimensions<H>() == 4) {
+                    output = etl::ml::convolution_backward(context.errors, w);
+                } else {
+                    etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(context.errors, w);
+                }
+            });
         }
     }
 
@@ -238,14 +394,31 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("conv:compute_gradients");
+        static dll::timer_id timer_handle("conv:compute_gradients");
+        dll::auto_timer timer(timer_handle);
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (direct) {
+            grouped_conv_backward_filter(w_grad, context.input, context.errors, dims(etl::dim<0>(context.errors)));
+        } else {
+            conv_tuner::instance().run(conv_pass::BACKWARD_FILTER, {etl::dim<0>(context.errors), NC, NV1, NV2, K, NH1, NH2}, [&] {
+                w_grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+            });
+        }
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
         }
     }
+
+private:
+    /*!
+     * \brief Return the dimensions of the direct convolution for a batch of the given size
+     */
+    static detail::grouped_conv_dims dims(size_t B) {
+        return {B, NC, NV1, NV2, K, NW1, NW2, 1, S1, S2, D1, D2, 0, 0};
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -313,12 +486,17 @@ struct sgd_context<DBN, conv_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
-    etl::fast_matrix<weight, batch_size, K, NH1, NH2> output;
-    etl::fast_matrix<weight, batch_size, K, NH1, NH2> errors;
+    static constexpr bool shared_errors = sgd_shared_errors<DBN, layer_t, L>; ///< Indicates if the errors are in the shared pool
+    static constexpr bool recomputed    = sgd_recomputed<DBN, layer_t, L>;    ///< Indicates if the activations are recomputed
+
+    sgd_activations_t<recomputed, weight, batch_size, NC, NV1, NV2> input;
+    sgd_activations_t<recomputed, weight, batch_size, K, NH1, NH2> output;
+    sgd_errors_t<shared_errors, weight, batch_size, K, NH1, NH2> errors;
 
-    sgd_context(const conv_layer_impl<Desc>& /* layer */)
-            : output(0.0), errors(0.0) {}
+    sgd_context(const conv_layer_impl<Desc>& /* layer */, weight* errors_memory = nullptr, weight* activations_memory = nullptr)
+            : input(make_sgd_activations<recomputed, decltype(input)>(activations_memory, 0)),
+              output(make_sgd_activations<recomputed, decltype(output)>(activations_memory, batch_size * NC * NV1 * NV2)),
+              errors(make_sgd_errors<shared_errors, decltype(errors)>(errors_memory)) {}
 };
 
 } //end of dll namespace
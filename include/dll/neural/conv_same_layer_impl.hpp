@@ -10,6 +10,9 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/subpixel_conv.hpp"
+#include "dll/util/fusion.hpp" // For is_subpixel_fused
 
 namespace dll {
 
@@ -32,11 +35,22 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     static constexpr size_t NC  = desc::NC;  ///< The number of input channels
     static constexpr size_t K   = desc::K;   ///< The number of filters
 
-    static constexpr size_t NH1 = NV1; //By definition
-    static constexpr size_t NH2 = NV2; //By definition
+    static constexpr size_t S1 = desc::S1; ///< The first stride
+    static constexpr size_t S2 = desc::S2; ///< The second stride
+    static constexpr size_t D1 = desc::D1; ///< The first dilation
+    static constexpr size_t D2 = desc::D2; ///< The second dilation
 
-    static constexpr size_t P1 = (NW1 - 1) / 2;
-    static constexpr size_t P2 = (NW2 - 1) / 2;
+    static constexpr size_t NH1 = (NV1 - 1) / S1 + 1; //By definition
+    static constexpr size_t NH2 = (NV2 - 1) / S2 + 1; //By definition
+
+    static constexpr size_t P1 = D1 * (NW1 - 1) / 2;
+    static constexpr size_t P2 = D2 * (NW2 - 1) / 2;
+
+    /*!
+     * \brief Indicates if the convolution is strided or dilated. ETL only
+     * supports dense convolutions, such convolutions use direct kernels.
+     */
+    static constexpr bool direct = S1 != 1 || S2 != 1 || D1 != 1 || D2 != 1;
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
 
@@ -136,16 +150,40 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
+        static dll::timer_id timer_handle("conv:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if constexpr (direct) {
+            grouped_conv_forward(output, v, w, dims(etl::dim<0>(v)));
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(v, w);
         } else {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
         }
 
-        output = bias_add_4d(output, b);
-        output = f_activate<activation_function>(output);
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<activation_function, true>(output, b);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, upsampled by
+     * (U1, U2) with the nearest neighbour, without computing the upsampled
+     * input (sub-pixel convolution).
+     *
+     * \param input A batch of input, before upsampling
+     * \param output A batch of output that will be filled
+     * \tparam U1 The first upsampling factor
+     * \tparam U2 The second upsampling factor
+     */
+    template <size_t U1, size_t U2, typename H1, typename V>
+    void upsampled_forward_batch(H1&& output, const V& v) const {
+        static dll::timer_id timer_handle("conv_same:upsampled_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        subpixel_conv_forward(output, v, w, subpixel_dims<U1, U2>(etl::dim<0>(v)));
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<activation_function, true>(output, b);
     }
 
     template <typename Input>
@@ -172,7 +210,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename DRBM>
     static void dyn_init(DRBM& dyn){
-        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2);
+        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2, S1, S2, D1, D2);
     }
 
     /*!
@@ -184,7 +222,8 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename C>
     void adapt_errors(C& context) const {
-        dll::auto_timer timer("conv_same:adapt_errors");
+        static dll::timer_id timer_handle("conv_same:adapt_errors");
+        dll::auto_timer timer(timer_handle);
 
         if constexpr (activation_function != function::IDENTITY){
             context.errors = f_derivative<activation_function>(context.output) >> context.errors;
@@ -198,9 +237,17 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("conv_same:backward_batch");
-
-        output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        static dll::timer_id timer_handle("conv_same:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (sgd_subpixel_v<C>) {
+            // The errors are directly backpropagated through the upsampling
+            subpixel_conv_backward(output, context.errors, w, subpixel_dims<C::U1, C::U2>(etl::dim<0>(output)));
+        } else if constexpr (direct) {
+            grouped_conv_backward(output, context.errors, w, dims(etl::dim<0>(output)));
+        } else {
+            output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        }
     }
 
     /*!
@@ -209,11 +256,38 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("conv_same:compute_gradients");
+        static dll::timer_id timer_handle("conv_same:compute_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (sgd_subpixel_v<C>) {
+            subpixel_conv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors, subpixel_dims<C::U1, C::U2>(etl::dim<0>(context.errors)));
+        } else if constexpr (direct) {
+            grouped_conv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors, dims(etl::dim<0>(context.errors)));
+        } else {
+            std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
+        }
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
+
+private:
+    /*!
+     * \brief Return the dimensions of the direct convolution for a batch of the given size
+     */
+    static detail::grouped_conv_dims dims(size_t B) {
+        return {B, NC, NV1, NV2, K, NW1, NW2, 1, S1, S2, D1, D2, P1, P2};
+    }
+
+    /*!
+     * \brief Return the dimensions of the sub-pixel convolution for a batch
+     * of the given size, upsampled by (U1, U2)
+     */
+    template <size_t U1, size_t U2>
+    static detail::subpixel_conv_dims subpixel_dims(size_t B) {
+        static_assert(NV1 % U1 == 0 && NV2 % U2 == 0, "Invalid upsampling factors");
+
+        return {B, NC, NV1 / U1, NV2 / U2, K, NW1, NW2, U1, U2, P1, P2};
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -272,14 +346,26 @@ struct sgd_context<DBN, conv_same_layer_impl<Desc>, L> {
 
     static constexpr size_t NV1 = layer_t::NV1;
     static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NH1 = layer_t::NH1;
+    static constexpr size_t NH2 = layer_t::NH2;
     static constexpr size_t NC  = layer_t::NC;
     static constexpr size_t K   = layer_t::K;
 
+    // When the layer is fused with the upsampling layer preceding it, the
+    // context holds the input of the upsampling
+    using subpixel_t = std::conditional_t<(L > 0 && std::is_same_v<typename DBN::template layer_type<L>, layer_t>),
+                                          detail::is_subpixel_fused_impl<DBN, L - 1>,
+                                          detail::is_subpixel_pair_impl<void, void>>;
+
+    static constexpr bool subpixel = subpixel_t::value; ///< Indicates if the layer is fused with the preceding upsampling layer
+    static constexpr size_t U1     = subpixel_t::U1;    ///< The first upsampling factor
+    static constexpr size_t U2     = subpixel_t::U2;    ///< The second upsampling factor
+
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
-    etl::fast_matrix<weight, batch_size, K,  NV1, NV2> output;
-    etl::fast_matrix<weight, batch_size, K,  NV1, NV2> errors;
+    etl::fast_matrix<weight, batch_size, NC, NV1 / U1, NV2 / U2> input;
+    etl::fast_matrix<weight, batch_size, K,  NH1, NH2> output;
+    etl::fast_matrix<weight, batch_size, K,  NH1, NH2> errors;
 
     sgd_context(const layer_t& /* layer */)
             : output(0.0), errors(0.0) {}
@@ -9,6 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_tuner.hpp"
+#include "dll/util/deconv_gemm.hpp"
+
 namespace dll {
 
 /*!
@@ -128,21 +131,14 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
-
-        if constexpr (etl::decay_traits<H1>::is_fast) {
-            static constexpr auto batch_size = etl::decay_traits<H1>::template dim<0>();
-
-            auto b_rep = etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NH1, NH2>(b)));
-
-            output = f_activate<activation_function>(b_rep + output);
-        } else {
-            auto batch_size = etl::dim<0>(output);
+        const size_t B = etl::dim<0>(v);
 
-            auto b_rep = etl::force_temporary(etl::rep_l(etl::rep<NH1, NH2>(b), batch_size));
+        conv_tuner::instance().run(conv_pass::DECONV_FORWARD, {B, NC, NV1, NV2, K, NW1, NW2},
+            [&] { output = etl::conv_4d_full_flipped(v, w); },
+            [&] { deconv_gemm_forward(output, v, w, dims(B)); });
 
-            output = f_activate<activation_function>(b_rep + output);
-        }
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<activation_function, true>(output, b);
     }
 
     /*!
@@ -199,12 +195,17 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::conv_4d_valid_flipped(context.errors, w);
-        } else {
-            static constexpr auto B               = etl::decay_traits<H>::template dim<0>();
-            etl::reshape<B, NC, NV1, NV2>(output) = etl::conv_4d_valid_flipped(context.errors, w);
-        }
+        static constexpr auto B = etl::decay_traits<H>::template dim<0>();
+
+        conv_tuner::instance().run(conv_pass::DECONV_BACKWARD, {B, K, NH1, NH2, NC, NW1, NW2},
+            [&] {
+                if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+                    output = etl::conv_4d_valid_flipped(context.errors, w);
+                } else {
+                    etl::reshape<B, NC, NV1, NV2>(output) = etl::conv_4d_valid_flipped(context.errors, w);
+                }
+            },
+            [&] { deconv_gemm_backward(output, context.errors, w, dims(B)); });
     }
 
     /*!
@@ -213,9 +214,24 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        const size_t B = etl::dim<0>(context.errors);
+
+        conv_tuner::instance().run(conv_pass::DECONV_BACKWARD_FILTER, {B, NC, NV1, NV2, K, NH1, NH2},
+            [&] { w_grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input); },
+            [&] { deconv_gemm_backward_filter(w_grad, context.errors, context.input, dims(B)); });
+
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
+
+private:
+    /*!
+     * \brief Return the dimensions of the deconvolution for a batch of the given size
+     */
+    static detail::deconv_dims dims(size_t B) {
+        return {B, NC, NV1, NV2, K, NW1, NW2};
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -26,6 +26,8 @@ struct dense_layer_desc {
     using parameters = cpp::type_list<Parameters...>;
 
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr auto precision           = detail::get_value_v<activation_precision<function_precision::EXACT>, Parameters...>; ///< The precision of the activation function
+    static constexpr size_t ColumnShards      = detail::get_value_v<dll::column_shards<1>, Parameters...>;                   ///< The number of column shards of the layer
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
@@ -41,11 +43,13 @@ struct dense_layer_desc {
 
     static_assert(num_visible > 0, "There must be at least 1 visible unit");
     static_assert(num_hidden > 0, "There must be at least 1 hidden unit");
+    static_assert(ColumnShards > 0, "There must be at least 1 column shard");
+    static_assert(ColumnShards == 1 || !parameters::template contains<packed_weights>(), "Column shards cannot be combined with packed weights");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>,
+            weight_type_id, activation_id, activation_precision_id, initializer_id, initializer_bias_id, no_bias_id, packed_weights_id, column_shards_id, sparse_input_id>,
             Parameters...>,
         "Invalid parameters type for dense_layer_desc");
 };
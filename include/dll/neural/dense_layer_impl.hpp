@@ -11,6 +11,13 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/packed_gemm.hpp"
+#include "dll/util/small_gemm.hpp"
+#include "dll/util/column_shards.hpp"
+#include "dll/util/quantize.hpp"
+#include "dll/util/sparse.hpp"
+#include "dll/trainer/shared_errors.hpp"
+#include "dll/trainer/recomputation.hpp"
 
 namespace dll {
 
@@ -31,6 +38,40 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto precision           = desc::precision;                                     ///< The precision of the activation function
+
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
+    /*!
+     * \brief Indicates if the weights are kept packed in the GEMM panels
+     */
+    static constexpr bool packed = desc::parameters::template contains<dll::packed_weights>() && is_gemm_packable<weight>;
+
+    /*!
+     * \brief The number of shards of the output columns
+     */
+#ifdef ETL_GPU
+    static constexpr size_t column_shards = 1;
+#else
+    static constexpr size_t column_shards = desc::ColumnShards;
+#endif
+
+    /*!
+     * \brief Indicates if the sparse batches of input use the gathered
+     * sparse products
+     */
+#ifdef ETL_GPU
+    static constexpr bool sparse = false;
+#else
+    static constexpr bool sparse = desc::parameters::template contains<dll::sparse_input>();
+#endif
+
+    /*!
+     * \brief The maximum density of a batch of input for the sparse products.
+     *
+     * Denser batches are faster with the dense GEMM.
+     */
+    static constexpr double sparse_density = 0.3;
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -51,6 +92,15 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    int8_quantization quantization; ///< The INT8 quantization of the layer
+
+    std::unique_ptr<w_type> mask; ///< The mask of the pruned weights (nullptr if not pruned)
+
+    mutable bcsr_matrix<weight> sparse_w; ///< The pruned weights, in blocked CSR format
+    mutable bool sparse_ready = false;    ///< Indicates if sparse_w is up to date
+
+    packed_gemm_weights<weight> packed_w; ///< The weights packed in the GEMM panels (only if packed)
+
     /*!
      * \brief Initialize a dense layer with basic weights.
      *
@@ -133,10 +183,85 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      *
      * \param input A batch of input
      * \param output A batch of output that will be filled
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
      */
-    template <typename H, typename V>
+    template <function F = activation_function, typename H, typename V>
     void forward_batch(H&& output, const V& input) const {
-        dll::auto_timer timer("dense:forward_batch");
+        if constexpr (sparse && etl::is_dma<V> && etl::is_dma<H>) {
+            thread_local csc_batch<weight> sparse_input;
+
+            if (sparse_input_forward_batch<F>(output, input, sparse_input)) {
+                return;
+            }
+        }
+
+        dense_forward_batch<F>(output, input);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input during training.
+     *
+     * The CSC copy of a sparse batch is kept in the workspace, to compute
+     * the gradients of the weights.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     * \param workspace The workspace of the layer
+     */
+    template <function F = activation_function, typename H, typename V>
+    void forward_batch(H&& output, const V& input, sparse_input_workspace<weight>& workspace) const {
+        if constexpr (etl::is_dma<V> && etl::is_dma<H>) {
+            workspace.measured = true;
+            workspace.sparse   = sparse_input_forward_batch<F>(output, input, workspace.input);
+
+            if (workspace.sparse) {
+                return;
+            }
+        }
+
+        dense_forward_batch<F>(output, input);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with a gathered
+     * sparse product if the batch is sparse enough.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     * \param sparse_input The CSC copy of the input to build
+     *
+     * \return true if the output was computed, false if the batch is too dense
+     */
+    template <function F = activation_function, typename H, typename V>
+    bool sparse_input_forward_batch(H&& output, const V& input, csc_batch<weight>& sparse_input) const {
+        static dll::timer_id timer_handle("dense:sparse_input_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        input.ensure_cpu_up_to_date();
+
+        if (!sparse_input.build(input.memory_start(), etl::dim<0>(input), num_visible, sparse_density)) {
+            return false;
+        }
+
+        sparse_input.multiply(output, w);
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, !no_bias, precision>(output, b);
+
+        return true;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with dense products.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F = activation_function, typename H, typename V>
+    void dense_forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("dense:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
         const auto Batch = etl::dim<0>(input);
 
@@ -145,13 +270,228 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
+        // The columns of a very large layer are computed (and normalized) in parallel
+        if constexpr (column_shards > 1 && etl::is_dma<V> && etl::is_dma<H>) {
+            input.ensure_cpu_up_to_date();
+            w.ensure_cpu_up_to_date();
+            b.ensure_cpu_up_to_date();
+
+            constexpr bool softmax = F == function::SOFTMAX;
 
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
+            column_sharded_forward(output.memory_start(), input.memory_start(), w.memory_start(), no_bias ? nullptr : b.memory_start(),
+                                   Batch, num_visible, num_hidden, column_shards, softmax);
+
+            output.invalidate_gpu();
+
+            if constexpr (!softmax) {
+                f_bias_activate_2d<F, false, precision>(output, b);
+            }
+
+            return;
+        }
+
+        // A few samples through compact weights do not need a BLAS call
+        if constexpr (is_small_gemm<weight, num_visible, num_hidden> && etl::is_dma<V> && etl::is_dma<H>) {
+            if (Batch <= small_gemm_max_rows) {
+                input.ensure_cpu_up_to_date();
+                w.ensure_cpu_up_to_date();
+
+                small_gemm<num_visible, num_hidden>(output.memory_start(), input.memory_start(), w.memory_start(), Batch);
+
+                output.invalidate_gpu();
+
+                // Bias and activation in a single pass over the output
+                f_bias_activate_2d<F, !no_bias, precision>(output, b);
+
+                return;
+            }
+        }
+
+        if constexpr (packed && etl::is_dma<V> && etl::is_dma<H>) {
+            input.ensure_cpu_up_to_date();
+
+            packed_w.forward_gemm(output.memory_start(), input.memory_start(), w, Batch);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::reshape(input, Batch, num_visible) * w;
         }
 
-        output = f_activate<activation_function>(output);
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, !no_bias, precision>(output, b);
+    }
+
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * Once the layer is quantized, the INT8 path is used.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        if (quantization.ready) {
+            quantized_forward_batch<F>(output, input);
+        } else if (mask) {
+            sparse_forward_batch<F>(output, input);
+        } else {
+            forward_batch<F>(output, input);
+        }
+    }
+
+    /*!
+     * \brief Build the sparse weights of a pruned layer, if they changed
+     * since the last inference.
+     */
+    void prepare_inference() const {
+        if (mask && !sparse_ready) {
+            w.ensure_cpu_up_to_date();
+
+            sparse_w.build(w.memory_start(), num_visible, num_hidden);
+            sparse_ready = true;
+        }
+    }
+
+    /*!
+     * \brief Apply the pruned layer to the given batch of input, with a
+     * sparse product when the weights are sparse enough.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F = activation_function, typename H, typename V>
+    void sparse_forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("dense:sparse_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        prepare_inference();
+
+        // The blocked product only pays off on sparse enough weights
+        if (sparse_w.density() > 0.5) {
+            forward_batch<F>(output, input);
+            return;
+        }
+
+        sparse_w.multiply(output, input);
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, !no_bias, precision>(output, b);
+    }
+
+    /*!
+     * \brief Prune the weights of smallest magnitude.
+     *
+     * The pruned weights are kept to zero during further training and the
+     * test forward pass uses a sparse product.
+     *
+     * \param sparsity The fraction of the weights to prune, in [0, 1]
+     *
+     * \return The number of pruned weights
+     */
+    size_t prune(double sparsity) {
+        weights_changed();
+
+        return prune_magnitude(w, unique_safe_get(mask), sparsity);
+    }
+
+    /*!
+     * \brief Forget the caches of the weights (sparse and packed), after a
+     * change of the weights
+     */
+    void weights_changed() {
+        sparse_ready = false;
+
+        if constexpr (packed) {
+            packed_w.invalidate();
+        }
+    }
+
+    /*!
+     * \brief Set the pruned weights back to zero, after an update of the
+     * weights
+     */
+    void apply_weight_mask() {
+        if (mask) {
+            w = w >> *mask;
+        }
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Restore the weights from the secondary weights matrix
+     */
+    void restore_weights() {
+        base_type::restore_weights();
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Load the weigts from the given stream
+     */
+    void load(std::istream& is) {
+        base_type::load(is);
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Load the weigts from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Apply the INT8 quantized layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F = activation_function, typename H, typename V>
+    void quantized_forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("dense:quantized_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_assert(quantization.ready, "The layer must be quantized first");
+
+        int8_dense_forward(output, input, quantization, num_visible, num_hidden);
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, !no_bias, precision>(output, b);
+    }
+
+    /*!
+     * \brief Update the quantization calibration with the given batch of input
+     */
+    template <typename V>
+    void calibrate_quantization(const V& input) {
+        quantization.calibrate(input);
+    }
+
+    /*!
+     * \brief Quantize the weights to INT8, with the current calibration.
+     *
+     * This must be done again each time the weights are changed.
+     *
+     * \return true if the layer was quantized, false otherwise
+     */
+    bool quantize() {
+        return quantization.quantize(w, num_hidden, num_visible, true);
+    }
+
+    /*!
+     * \brief Go back to the floating point inference and forget the calibration
+     */
+    void clear_quantization() {
+        quantization.clear();
     }
 
     /*!
@@ -196,25 +536,64 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void adapt_errors(C& context) const {
-        dll::unsafe_auto_timer timer("dense:adapt_errors");
+        static dll::timer_id timer_handle("dense:adapt_errors");
+        dll::auto_timer timer(timer_handle);
 
         if constexpr (activation_function != function::IDENTITY){
-            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+            const size_t n = context.active;
+
+            if (cpp_unlikely(n < etl::dim<0>(context.errors))) {
+                etl::slice(context.errors, 0, n) = f_derivative<activation_function>(etl::slice(context.output, 0, n)) >> etl::slice(context.errors, 0, n);
+            } else {
+                context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+            }
         }
     }
 
     /*!
      * \brief Backpropagate the errors to the previous layers
+     *
+     * Only the active samples of the context are computed, the errors
+     * of the other samples are cleared.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("dense:backward_batch");
+        static dll::timer_id timer_handle("dense:backward_batch");
+        dll::auto_timer timer(timer_handle);
 
         // The reshape has no overhead, so better than SFINAE for nothing
         constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
-        etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
+
+        const size_t n = context.active;
+
+        if constexpr (column_shards > 1 && etl::is_dma<H>) {
+            context.errors.ensure_cpu_up_to_date();
+            w.ensure_cpu_up_to_date();
+
+            column_sharded_backward(output.memory_start(), context.errors.memory_start(), w.memory_start(), n, num_visible, num_hidden, column_shards);
+
+            std::fill(output.memory_start() + n * num_visible, output.memory_start() + Batch * num_visible, weight(0));
+
+            output.invalidate_gpu();
+        } else if constexpr (packed && etl::is_dma<H>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            packed_w.backward_gemm(output.memory_start(), context.errors.memory_start(), w, n);
+
+            std::fill(output.memory_start() + n * num_visible, output.memory_start() + Batch * num_visible, weight(0));
+
+            output.invalidate_gpu();
+        } else if (cpp_unlikely(n < Batch)) {
+            auto errors = etl::reshape<Batch, num_visible>(output);
+
+            etl::slice(errors, 0, n)     = etl::slice(context.errors, 0, n) * etl::transpose(w);
+            etl::slice(errors, n, Batch) = 0;
+        } else {
+            etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
+        }
     }
 
     /*!
@@ -223,13 +602,106 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::unsafe_auto_timer timer("dense:compute_gradients");
+        static dll::timer_id timer_handle("dense:compute_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        // Only the active samples contribute to the gradients
+        const size_t n = context.active;
+
+        if constexpr (sparse) {
+            if (sparse_input_gradients(context)) {
+                return;
+            }
+        }
+
+        if constexpr (column_shards > 1) {
+            auto& w_grad = std::get<0>(context.up.context)->grad;
+
+            context.input.ensure_cpu_up_to_date();
+            context.errors.ensure_cpu_up_to_date();
+
+            if constexpr (no_bias) {
+                column_sharded_gradients(w_grad.memory_start(), static_cast<weight*>(nullptr), context.input.memory_start(), context.errors.memory_start(),
+                                         n, num_visible, num_hidden, column_shards);
+            } else {
+                auto& b_grad = std::get<1>(context.up.context)->grad;
+
+                column_sharded_gradients(w_grad.memory_start(), b_grad.memory_start(), context.input.memory_start(), context.errors.memory_start(),
+                                         n, num_visible, num_hidden, column_shards);
+
+                b_grad.invalidate_gpu();
+            }
+
+            w_grad.invalidate_gpu();
+        } else if (cpp_unlikely(n < etl::dim<0>(context.errors))) {
+            auto input  = etl::slice(context.input, 0, n);
+            auto errors = etl::slice(context.errors, 0, n);
+
+            std::get<0>(context.up.context)->grad = batch_outer(input, errors);
+
+            if constexpr (!no_bias) {
+                std::get<1>(context.up.context)->grad = bias_batch_sum_2d(errors);
+            }
+        } else {
+            std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+
+            if constexpr (!no_bias) {
+                std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of a sparse batch of input, from its CSC
+     * copy, skipping the zero inputs.
+     *
+     * The copy built by the forward pass is reused for complete batches,
+     * otherwise the active samples are gathered again.
+     *
+     * \param context The trainng context
+     *
+     * \return true if the gradients were computed, false if the batch is too dense
+     */
+    template<typename C>
+    bool sparse_input_gradients(C& context) const {
+        static dll::timer_id timer_handle("dense:sparse_input_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t n = context.active;
+
+        auto& workspace = context.workspace;
+
+        const bool complete = n == etl::dim<0>(context.errors);
+
+        if (!workspace.measured || !complete) {
+            context.input.ensure_cpu_up_to_date();
+
+            workspace.sparse = workspace.input.build(context.input.memory_start(), n, num_visible, sparse_density);
+        }
+
+        workspace.measured = false;
+
+        if (!workspace.sparse) {
+            return false;
+        }
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        if (complete) {
+            workspace.input.outer(std::get<0>(context.up.context)->grad, context.errors);
 
-        if constexpr (!no_bias) {
-            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            if constexpr (!no_bias) {
+                std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            }
+        } else {
+            auto errors = etl::slice(context.errors, 0, n);
+
+            workspace.input.outer(std::get<0>(context.up.context)->grad, errors);
+
+            if constexpr (!no_bias) {
+                std::get<1>(context.up.context)->grad = bias_batch_sum_2d(errors);
+            }
         }
+
+        return true;
     }
 };
 
@@ -261,11 +733,26 @@ struct layer_base_traits<dense_layer_impl<Desc>> {
     static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
 };
 
+/*!
+ * \brief The workspace of the SGD context of a dense layer with sparse
+ * inputs (none otherwise)
+ */
+template <typename Layer, bool Sparse = Layer::sparse>
+struct dense_sparse_context {};
+
+/*!
+ * \copydoc dense_sparse_context
+ */
+template <typename Layer>
+struct dense_sparse_context<Layer, true> {
+    sparse_input_workspace<typename Layer::weight> workspace; ///< The CSC copy of the input batch
+};
+
 /*!
  * \brief specialization of sgd_context for dense_layer_impl
  */
 template <typename DBN, typename Desc, size_t L>
-struct sgd_context<DBN, dense_layer_impl<Desc>, L> {
+struct sgd_context<DBN, dense_layer_impl<Desc>, L> : dense_sparse_context<dense_layer_impl<Desc>> {
     using layer_t = dense_layer_impl<Desc>;
     using weight  = typename layer_t::weight; ///< The data type for this layer
 
@@ -274,12 +761,19 @@ struct sgd_context<DBN, dense_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, num_visible> input;
-    etl::fast_matrix<weight, batch_size, num_hidden> output;
-    etl::fast_matrix<weight, batch_size, num_hidden> errors;
+    static constexpr bool shared_errors = sgd_shared_errors<DBN, layer_t, L>; ///< Indicates if the errors are in the shared pool
+    static constexpr bool recomputed    = sgd_recomputed<DBN, layer_t, L>;    ///< Indicates if the activations are recomputed
+
+    sgd_activations_t<recomputed, weight, batch_size, num_visible> input;
+    sgd_activations_t<recomputed, weight, batch_size, num_hidden> output;
+    sgd_errors_t<shared_errors, weight, batch_size, num_hidden> errors;
+
+    size_t active = batch_size; ///< The number of active samples of the batch
 
-    sgd_context(const dense_layer_impl<Desc>& /* layer */)
-            : output(0.0), errors(0.0) {}
+    sgd_context(const dense_layer_impl<Desc>& /* layer */, weight* errors_memory = nullptr, weight* activations_memory = nullptr)
+            : input(make_sgd_activations<recomputed, decltype(input)>(activations_memory, 0)),
+              output(make_sgd_activations<recomputed, decltype(output)>(activations_memory, batch_size * num_visible)),
+              errors(make_sgd_errors<shared_errors, decltype(errors)>(errors_memory)) {}
 };
 
 } //end of dll namespace
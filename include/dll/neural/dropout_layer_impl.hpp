@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/dropout.hpp"
 
 namespace dll {
 
@@ -24,9 +25,9 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
 
     static constexpr float p = float(desc::Drop) / 100.0f; ///< The dropout rate
 
-    mutable decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p)) dropout; ///< The dropout mask generator (ETL)
+    mutable dropout_stream stream; ///< The random stream of the dropout masks
 
-    dropout_layer_impl() : dropout(dll::rand_engine(), p) {
+    dropout_layer_impl() : stream(next_stream_key()) {
         // Nothing else to init
     }
 
@@ -82,11 +83,24 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void test_forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("dropout:test:forward");
+        static dll::timer_id timer_handle("dropout:test:forward");
+        dll::auto_timer timer(timer_handle);
 
         output = input;
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place.
+     *
+     * In test mode, the layer is the identity and there is nothing to do.
+     *
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch>
+    static void test_forward_batch_in_place(Batch& batch) {
+        cpp_unused(batch);
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -94,11 +108,30 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) const noexcept {
-        dll::auto_timer timer("dropout:train:forward");
+        static dll::timer_id timer_handle("dropout:train:forward");
+        dll::auto_timer timer(timer_handle);
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = dropout;
-        output = output >> input;
+        inverted_dropout(output, input, p, stream, stream.reserve(etl::size(input)));
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input, during training.
+     *
+     * The position of the mask in the random stream is kept in the
+     * workspace so that the backward pass can generate the same mask.
+     *
+     * \param output The batch of output
+     * \param input The batch of input to apply the layer to
+     * \param workspace The workspace of the training context
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input, dropout_workspace& workspace) const {
+        static dll::timer_id timer_handle("dropout:train:forward");
+        dll::auto_timer timer(timer_handle);
+
+        workspace.offset = stream.reserve(etl::size(input));
+
+        inverted_dropout(output, input, p, stream, workspace.offset);
     }
 
     /*!
@@ -120,9 +153,11 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("dropout:backward");
+        static dll::timer_id timer_handle("dropout:backward");
+        dll::auto_timer timer(timer_handle);
 
-        output = context.errors;
+        // The gradient of the dropout is the same (scaled) mask
+        inverted_dropout(output, context.errors, p, stream, context.workspace.offset);
     }
 
     /*!
@@ -169,6 +204,10 @@ struct sgd_context<DBN, dropout_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    dropout_workspace workspace; ///< The position of the last dropout mask
+
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -8,6 +8,8 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
+#include "dll/util/fold.hpp"
 
 namespace dll {
 
@@ -30,20 +32,23 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
     using output_t     = std::vector<output_one_t>;  ///< The type of the output
 
+    using workspace_t  = batch_norm_workspace<etl::dyn_matrix<weight, 1>, etl::dyn_matrix<weight, 4>>; ///< The type of the caches of a training forward pass
+
     etl::dyn_matrix<weight, 1> gamma;
     etl::dyn_matrix<weight, 1> beta;
 
     etl::dyn_matrix<weight, 1> mean;
     etl::dyn_matrix<weight, 1> var;
 
-    etl::dyn_matrix<weight, 1> last_mean;
-    etl::dyn_matrix<weight, 1> last_var;
-    etl::dyn_matrix<weight, 1> inv_var;
+    mutable etl::dyn_matrix<weight, 1> scale; ///< The inference scale, gamma / sqrt(var + e)
+    mutable etl::dyn_matrix<weight, 1> shift; ///< The inference shift, beta - mean * scale
 
-    etl::dyn_matrix<weight, 4> input_pre; /// B x K x W x H
+    mutable bool inference_ready = false; ///< Indicates if scale and shift are up to date with the statistics
 
     weight momentum = 0.9;
 
+    bool folded = false; ///< Indicates if the normalization has been folded into the previous layer
+
     //Backup gamma and beta
     std::unique_ptr<etl::dyn_matrix<weight, 1>> bak_gamma; ///< Backup gamma
     std::unique_ptr<etl::dyn_matrix<weight, 1>> bak_beta;  ///< Backup beta
@@ -67,13 +72,14 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         mean = etl::dyn_vector<weight>(Kernels);
         var  = etl::dyn_vector<weight>(Kernels);
 
-        last_mean = etl::dyn_vector<weight>(Kernels);
-        last_var  = etl::dyn_vector<weight>(Kernels);
-        inv_var   = etl::dyn_vector<weight>(Kernels);
+        scale = etl::dyn_vector<weight>(Kernels);
+        shift = etl::dyn_vector<weight>(Kernels);
 
         // Initializate the weights
         gamma = 1.0;
         beta = 0.0;
+
+        inference_ready = false;
     }
 
     /*!
@@ -131,6 +137,50 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         test_forward_batch(output, input);
     }
 
+    /*!
+     * \brief Fold the normalization into the weights and the biases of the
+     * given previous (convolutional) layer, for inference.
+     *
+     * Once folded, the layer forwards its input unchanged and its
+     * parameters are reset to the identity, which is what is stored. The
+     * layer must not be trained anymore after this.
+     *
+     * \param layer The previous layer
+     * \return true if the normalization is folded, false if it cannot be folded into this layer
+     */
+    template <typename L>
+    bool fold_into(L& layer) {
+        if constexpr (is_fold_target<L, 4>) {
+            if (!folded) {
+                fold_batch_normalization_4d(layer, gamma, beta, mean, var, e);
+                folded = true;
+                inference_ready = false;
+            }
+
+            return true;
+        } else {
+            cpp_unused(layer);
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Compute the inference scale and shift from the current
+     * statistics, if they changed since the last inference.
+     *
+     * The statistics and the parameters only change during training,
+     * which always starts with a training forward pass, or when they are
+     * loaded or restored.
+     */
+    void prepare_inference() const {
+        if (!inference_ready) {
+            scale = gamma >> (1.0 / etl::sqrt(var + e));
+            shift = beta - (mean >> scale);
+
+            inference_ready = true;
+        }
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -138,13 +188,18 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
+        if (folded) {
+            output = input;
+            return;
+        }
+
         const auto B = etl::dim<0>(input);
 
-        auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
+        prepare_inference();
 
         for (size_t b = 0; b < B; ++b) {
             for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = (gamma(k) >> ((input(b)(k) - mean(k)) >> inv_var(k))) + beta(k);
+                output(b)(k) = (input(b)(k) * scale(k)) + shift(k);
             }
         }
     }
@@ -156,6 +211,29 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
+        workspace_t workspace(Kernels);
+        forward_batch(output, input, workspace);
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input, during training.
+     *
+     * The statistics of the mini-batch and the normalized inputs are kept
+     * in the workspace, for the backward pass.
+     *
+     * \param output The batch of output
+     * \param input The batch of input to apply the layer to
+     * \param workspace The workspace of the training context
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input, workspace_t& workspace) {
+        cpp_assert(!folded, "A folded normalization cannot be trained");
+
+        auto& last_mean = workspace.last_mean;
+        auto& last_var  = workspace.last_var;
+        auto& inv_var   = workspace.inv_var;
+        auto& input_pre = workspace.input_pre;
+
         cpp_unused(output);
 
         const auto B = etl::dim<0>(input);
@@ -186,7 +264,12 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
             }
         }
 
-        //// Update the current mean and variance
+        // Update the current mean and variance, the shards of data-parallel
+        // training update them concurrently
+        std::lock_guard<std::mutex> lock(batch_norm_lock());
+
+        inference_ready = false;
+
         mean = momentum * mean + (1.0 - momentum) * last_mean;
         var  = momentum * var + (1.0 - momentum) * (S / (S - 1) * last_var);
     }
@@ -210,6 +293,9 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
+        const auto& input_pre = context.workspace.input_pre;
+        const auto& inv_var   = context.workspace.inv_var;
+
         const auto B = etl::dim<0>(context.input);
         const auto S = B * W * H;
 
@@ -240,6 +326,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename C>
     void compute_gradients(C& context) const {
+        const auto& input_pre = context.workspace.input_pre;
+
         // Gradients of gamma
         std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
 
@@ -299,6 +387,44 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         return std::make_tuple(std::cref(gamma), std::cref(beta));
     }
 
+    /*!
+     * \brief Store the parameters and the statistics into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, gamma);
+        cpp::binary_write_all(os, beta);
+        cpp::binary_write_all(os, mean);
+        cpp::binary_write_all(os, var);
+    }
+
+    /*!
+     * \brief Load the parameters and the statistics from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, gamma);
+        cpp::binary_load_all(is, beta);
+        cpp::binary_load_all(is, mean);
+        cpp::binary_load_all(is, var);
+
+        inference_ready = false;
+    }
+
+    /*!
+     * \brief Store the parameters and the statistics into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the parameters and the statistics from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -313,6 +439,16 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
     void restore_weights() {
         gamma = *bak_gamma;
         beta  = *bak_beta;
+
+        inference_ready = false;
+    }
+
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        bak_gamma.reset();
+        bak_beta.reset();
     }
 };
 
@@ -350,8 +486,10 @@ struct sgd_context<DBN, dyn_batch_normalization_4d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output; ///< A batch of output
     etl::dyn_matrix<weight, 4> errors; ///< A batch of errors
 
+    typename layer_t::workspace_t workspace; ///< The caches of the last training forward pass
+
     sgd_context(const layer_t& layer)
-            : input(batch_size, layer.Kernels, layer.W, layer.H), output(batch_size, layer.Kernels, layer.W, layer.H), errors(batch_size, layer.Kernels, layer.W, layer.H) {}
+            : input(batch_size, layer.Kernels, layer.W, layer.H), output(batch_size, layer.Kernels, layer.W, layer.H), errors(batch_size, layer.Kernels, layer.W, layer.H), workspace(layer.Kernels) {}
 };
 
 } //end of dll namespace
@@ -11,6 +11,8 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/conv_tuner.hpp"
+#include "dll/util/grouped_conv.hpp"
 
 namespace dll {
 
@@ -58,6 +60,11 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     size_t nw1; ///< The first dimension of the filters
     size_t nw2; ///< The second dimension of the filters
 
+    size_t s1 = 1; ///< The first stride
+    size_t s2 = 1; ///< The second stride
+    size_t d1 = 1; ///< The first dilation
+    size_t d2 = 1; ///< The second dilation
+
     dyn_conv_layer_impl(): base_type() {
         // Nothing else to init
     }
@@ -65,7 +72,9 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     /*!
      * \brief Initialize the dynamic layer
      */
-    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2){
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, size_t s1 = 1, size_t s2 = 1, size_t d1 = 1, size_t d2 = 1){
+        cpp_assert(nv1 >= d1 * (nw1 - 1) + 1 && nv2 >= d2 * (nw2 - 1) + 1, "The (dilated) filters cannot be larger than the input");
+
         this->nv1 = nv1;
         this->nv2 = nv2;
         this->nw1 = nw1;
@@ -73,8 +82,13 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
         this->nc = nc;
         this->k = k;
 
-        this->nh1 = nv1 - nw1 + 1;
-        this->nh2 = nv2 - nw2 + 1;
+        this->s1 = s1;
+        this->s2 = s2;
+        this->d1 = d1;
+        this->d2 = d2;
+
+        this->nh1 = (nv1 - (d1 * (nw1 - 1) + 1)) / s1 + 1;
+        this->nh2 = (nv2 - (d2 * (nw2 - 1) + 1)) / s2 + 1;
 
         w = etl::dyn_matrix<weight, 4>(k, nc, nw1, nw2);
 
@@ -159,24 +173,43 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      *
      * \param input A batch of input
      * \param output A batch of output that will be filled
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
      */
-    template <typename H1, typename V>
+    template <function F = activation_function, typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
+        static dll::timer_id timer_handle("conv:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward(v, w);
+        if (direct()) {
+            grouped_conv_forward(output, v, w, dims(etl::dim<0>(v)));
         } else {
-            output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
+            conv_tuner::instance().run(conv_pass::FORWARD, {etl::dim<0>(v), nc, nv1, nv2, k, nw1, nw2}, [&] {
+                if constexpr (etl::dimensions<V>() == 4) {
+                    output = etl::ml::convolution_forward(v, w);
+                } else {
+                    output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
+                }
+            });
         }
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
-        }
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<F, !no_bias>(output, b);
+    }
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
-        }
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        forward_batch<F>(output, input);
     }
 
     void prepare_input(input_one_t& input) const {
@@ -230,7 +263,8 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template<typename C>
     void adapt_errors(C& context) const {
-        dll::auto_timer timer("conv:adapt_errors");
+        static dll::timer_id timer_handle("conv:adapt_errors");
+        dll::auto_timer timer(timer_handle);
 
         if constexpr (activation_function != function::IDENTITY){
             context.errors = f_derivative<activation_function>(context.output) >> context.errors;
@@ -244,12 +278,19 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("conv:backward_batch");
+        static dll::timer_id timer_handle("conv:backward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        if constexpr (etl::dimensions<H>() == 4) {
-            output = etl::ml::convolution_backward(context.errors, w);
+        if (direct()) {
+            grouped_conv_backward(output, context.errors, w, dims(etl::dim<0>(output)));
         } else {
-            etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2) = etl::ml::convolution_backward(context.errors, w);
+            conv_tuner::instance().run(conv_pass::BACKWARD, {etl::dim<0>(output), k, nh1, nh2, nc, nw1, nw2}, [&] {
+                if constexpr (etl::dimensions<H>() == 4) {
+                    output = etl::ml::convolution_backward(context.errors, w);
+                } else {
+                    etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2) = etl::ml::convolution_backward(context.errors, w);
+                }
+            });
         }
     }
 
@@ -259,14 +300,39 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("conv:compute_gradients");
+        static dll::timer_id timer_handle("conv:compute_gradients");
+        dll::auto_timer timer(timer_handle);
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        if (direct()) {
+            grouped_conv_backward_filter(w_grad, context.input, context.errors, dims(etl::dim<0>(context.errors)));
+        } else {
+            conv_tuner::instance().run(conv_pass::BACKWARD_FILTER, {etl::dim<0>(context.errors), nc, nv1, nv2, k, nh1, nh2}, [&] {
+                w_grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+            });
+        }
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
         }
     }
+
+private:
+    /*!
+     * \brief Indicates if the convolution is strided or dilated. ETL only
+     * supports dense convolutions, such convolutions use direct kernels.
+     */
+    bool direct() const {
+        return s1 != 1 || s2 != 1 || d1 != 1 || d2 != 1;
+    }
+
+    /*!
+     * \brief Return the dimensions of the direct convolution for a batch of the given size
+     */
+    detail::grouped_conv_dims dims(size_t B) const {
+        return {B, nc, nv1, nv2, k, nw1, nw2, 1, s1, s2, d1, d2, 0, 0};
+    }
 };
 
 // Declare the traits for the Layer
@@ -11,6 +11,7 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/grouped_conv.hpp"
 
 namespace dll {
 
@@ -60,6 +61,11 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     size_t p1; ///< The first dimension padding
     size_t p2; ///< The second dimension padding
 
+    size_t s1 = 1; ///< The first stride
+    size_t s2 = 1; ///< The second stride
+    size_t d1 = 1; ///< The first dilation
+    size_t d2 = 1; ///< The second dilation
+
     dyn_conv_same_layer_impl(): base_type() {
         // Nothing else to init
     }
@@ -67,7 +73,7 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     /*!
      * \brief Initialize the dynamic layer
      */
-    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2){
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, size_t s1 = 1, size_t s2 = 1, size_t d1 = 1, size_t d2 = 1){
         this->nv1 = nv1;
         this->nv2 = nv2;
         this->nw1 = nw1;
@@ -75,11 +81,16 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
         this->nc = nc;
         this->k = k;
 
-        this->nh1 = nv1;
-        this->nh2 = nv2;
+        this->s1 = s1;
+        this->s2 = s2;
+        this->d1 = d1;
+        this->d2 = d2;
+
+        this->nh1 = (nv1 - 1) / s1 + 1;
+        this->nh2 = (nv2 - 1) / s2 + 1;
 
-        this->p1 = (nw1 - 1) / 2;
-        this->p2 = (nw2 - 1) / 2;
+        this->p1 = d1 * (nw1 - 1) / 2;
+        this->p2 = d2 * (nw2 - 1) / 2;
 
         w = etl::dyn_matrix<weight, 4>(k, nc, nw1, nw2);
 
@@ -127,8 +138,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     size_t context_memory_size(size_t batch_size) const noexcept {
         return batch_size * nc * nv1 * nv2  // Input
-           + batch_size * k * nv1 * nv2  // Output
-           + batch_size * k * nv1 * nv2; // Errors
+           + batch_size * k * nh1 * nh2  // Output
+           + batch_size * k * nh1 * nh2; // Errors
     }
 
     /*!
@@ -173,16 +184,19 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("conv:forward_batch");
+        static dll::timer_id timer_handle("conv:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if (direct()) {
+            grouped_conv_forward(output, v, w, dims(etl::dim<0>(v)));
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward(v, w, 1, 1, p1, p2);
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, 1, 1, p1, p2);
         }
 
-        output = bias_add_4d(output, b);
-        output = f_activate<activation_function>(output);
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<activation_function, true>(output, b);
     }
 
     void prepare_input(input_one_t& input) const {
@@ -248,7 +262,11 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        if (direct()) {
+            grouped_conv_backward(output, context.errors, w, dims(etl::dim<0>(output)));
+        } else {
+            output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        }
     }
 
     /*!
@@ -257,9 +275,30 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
+        if (direct()) {
+            grouped_conv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors, dims(etl::dim<0>(context.errors)));
+        } else {
+            std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
+        }
+
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
+
+private:
+    /*!
+     * \brief Indicates if the convolution is strided or dilated. ETL only
+     * supports dense convolutions, such convolutions use direct kernels.
+     */
+    bool direct() const {
+        return s1 != 1 || s2 != 1 || d1 != 1 || d2 != 1;
+    }
+
+    /*!
+     * \brief Return the dimensions of the direct convolution for a batch of the given size
+     */
+    detail::grouped_conv_dims dims(size_t B) const {
+        return {B, nc, nv1, nv2, k, nw1, nw2, 1, s1, s2, d1, d2, p1, p2};
+    }
 };
 
 // Declare the traits for the Layer
@@ -298,7 +337,7 @@ struct sgd_context<DBN, dyn_conv_same_layer_impl<Desc>, L> {
 
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.nc, layer.nv1, layer.nv2),
-              output(batch_size, layer.k, layer.nv1, layer.nv2), errors(batch_size, layer.k, layer.nv1, layer.nv2) {}
+              output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2) {}
 };
 
 } //end of dll namespace
@@ -10,6 +10,9 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_tuner.hpp"
+#include "dll/util/deconv_gemm.hpp"
+
 namespace dll {
 
 /*!
@@ -150,13 +153,14 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
-
-        const auto batch_size = etl::dim<0>(output);
+        const size_t B = etl::dim<0>(v);
 
-        auto b_rep = etl::force_temporary(etl::rep_l(etl::rep(b, nh1, nh2), batch_size));
+        conv_tuner::instance().run(conv_pass::DECONV_FORWARD, {B, nc, nv1, nv2, k, nw1, nw2},
+            [&] { output = etl::conv_4d_full_flipped(v, w); },
+            [&] { deconv_gemm_forward(output, v, w, dims(B)); });
 
-        output = f_activate<activation_function>(b_rep + output);
+        // Bias and activation in a single pass over the output
+        f_bias_activate_4d<activation_function, true>(output, b);
     }
 
     void prepare_input(input_one_t& input) const {
@@ -222,12 +226,17 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::conv_4d_valid_flipped(context.errors, w);
-        } else {
-            const auto B                          = etl::dim<0>(output);
-            etl::reshape(output, B, nc, nv1, nv2) = etl::conv_4d_valid_flipped(context.errors, w);
-        }
+        const size_t B = etl::dim<0>(output);
+
+        conv_tuner::instance().run(conv_pass::DECONV_BACKWARD, {B, k, nh1, nh2, nc, nw1, nw2},
+            [&] {
+                if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+                    output = etl::conv_4d_valid_flipped(context.errors, w);
+                } else {
+                    etl::reshape(output, B, nc, nv1, nv2) = etl::conv_4d_valid_flipped(context.errors, w);
+                }
+            },
+            [&] { deconv_gemm_backward(output, context.errors, w, dims(B)); });
     }
 
     /*!
@@ -236,9 +245,24 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        //TODO Update the gradients (probably with conv_4d_valid_filter)
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        const size_t B = etl::dim<0>(context.errors);
+
+        conv_tuner::instance().run(conv_pass::DECONV_BACKWARD_FILTER, {B, nc, nv1, nv2, k, nh1, nh2},
+            [&] { w_grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input); },
+            [&] { deconv_gemm_backward_filter(w_grad, context.errors, context.input, dims(B)); });
+
         std::get<1>(context.up.context)->grad = etl::mean_r(etl::sum_l(context.errors));
     }
+
+private:
+    /*!
+     * \brief Return the dimensions of the deconvolution for a batch of the given size
+     */
+    detail::deconv_dims dims(size_t B) const {
+        return {B, nc, nv1, nv2, k, nw1, nw2};
+    }
 };
 
 // Declare the traits for the Layer
@@ -27,6 +27,7 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto precision           = desc::precision;                                     ///< The precision of the activation function
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -137,10 +138,13 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      *
      * \param input A batch of input
      * \param output A batch of output that will be filled
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
      */
-    template <typename H, typename V>
+    template <function F = activation_function, typename H, typename V>
     void forward_batch(H&& output, const V& input) const {
-        dll::auto_timer timer("dense:forward");
+        static dll::timer_id timer_handle("dense:forward");
+        dll::auto_timer timer(timer_handle);
 
         const auto Batch = etl::dim<0>(input);
 
@@ -151,11 +155,23 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         output = etl::reshape(input, Batch, num_visible) * w;
 
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
-        }
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, !no_bias, precision>(output, b);
+    }
+
+    using base_type::test_forward_batch;
 
-        output = f_activate<activation_function>(output);
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        forward_batch<F>(output, input);
     }
 
     /*!
@@ -209,7 +225,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template<typename C>
     void adapt_errors(C& context) const {
-        dll::unsafe_auto_timer timer("dense:errors");
+        static dll::timer_id timer_handle("dense:errors");
+        dll::auto_timer timer(timer_handle);
 
         context.errors = f_derivative<activation_function>(context.output) >> context.errors;
     }
@@ -221,7 +238,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("dense:backward");
+        static dll::timer_id timer_handle("dense:backward");
+        dll::auto_timer timer(timer_handle);
 
         // The reshape has no overhead, so better than SFINAE for nothing
         auto batch_size = etl::dim<0>(output);
@@ -234,7 +252,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::unsafe_auto_timer timer("dense:gradients");
+        static dll::timer_id timer_handle("dense:gradients");
+        dll::auto_timer timer(timer_handle);
 
         std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
 
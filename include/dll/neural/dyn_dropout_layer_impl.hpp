@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/dropout.hpp"
 
 namespace dll {
 
@@ -24,19 +25,10 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
 
     float p; ///< The dropout probability
 
-    using dropout_t = decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p));
+    mutable dropout_stream stream; ///< The random stream of the dropout masks
 
-    dropout_t* dropout = nullptr; ///< The dropout mask generator (ETL)
-
-    dyn_dropout_layer_impl() = default;
-
-    /*!
-     * \brief Delete the layer and frees all allocated resources
-     */
-    ~dyn_dropout_layer_impl() {
-        if (dropout) {
-            delete dropout;
-        }
+    dyn_dropout_layer_impl() : stream(next_stream_key()) {
+        // Nothing else to init
     }
 
     /*!
@@ -44,8 +36,6 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
      */
     void init_layer(float p) {
         this->p = p;
-
-        dropout = new dropout_t(dll::rand_engine(), p);
     }
 
     /*!
@@ -89,11 +79,24 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void test_forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("dropout:test:forward");
+        static dll::timer_id timer_handle("dropout:test:forward");
+        dll::auto_timer timer(timer_handle);
 
         output = input;
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place.
+     *
+     * In test mode, the layer is the identity and there is nothing to do.
+     *
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch>
+    static void test_forward_batch_in_place(Batch& batch) {
+        cpp_unused(batch);
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -101,11 +104,30 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) const {
-        dll::auto_timer timer("dropout:train:forward");
+        static dll::timer_id timer_handle("dropout:train:forward");
+        dll::auto_timer timer(timer_handle);
+
+        inverted_dropout(output, input, p, stream, stream.reserve(etl::size(input)));
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input, during training.
+     *
+     * The position of the mask in the random stream is kept in the
+     * workspace so that the backward pass can generate the same mask.
+     *
+     * \param output The batch of output
+     * \param input The batch of input to apply the layer to
+     * \param workspace The workspace of the training context
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input, dropout_workspace& workspace) const {
+        static dll::timer_id timer_handle("dropout:train:forward");
+        dll::auto_timer timer(timer_handle);
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = *dropout;
-        output = output >> input;
+        workspace.offset = stream.reserve(etl::size(input));
+
+        inverted_dropout(output, input, p, stream, workspace.offset);
     }
 
     /*!
@@ -127,9 +149,11 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::unsafe_auto_timer timer("dropout:backward");
+        static dll::timer_id timer_handle("dropout:backward");
+        dll::auto_timer timer(timer_handle);
 
-        output = context.errors;
+        // The gradient of the dropout is the same (scaled) mask
+        inverted_dropout(output, context.errors, p, stream, context.workspace.offset);
     }
 
     /*!
@@ -176,6 +200,10 @@ struct sgd_context<DBN, dyn_dropout_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    dropout_workspace workspace; ///< The position of the last dropout mask
+
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -10,6 +10,7 @@
 #include "dll/base_traits.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/time_major.hpp"
 
 namespace dll {
 
@@ -25,6 +26,8 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
     using layer_t     = this_type;                       ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;      ///< The dynamic version of this layer
 
+    static constexpr bool time_major_in = desc::parameters::template contains<time_major_input>(); ///< Indicates if the input is time-major
+
     using input_one_t  = etl::dyn_matrix<weight, 2>; ///< The type of one input
     using output_one_t = etl::dyn_matrix<weight, 1>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
@@ -102,15 +105,36 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& input) const {
-        dll::auto_timer timer("recurrent_last:forward_batch");
+        sequence_workspace ws;
+
+        forward_batch(output, input, ws);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, using the lengths
+     * of the sequences of the workspace.
+     *
+     * The last true time step of each sample is selected.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     * \param ws The workspace
+     */
+    template <typename H, typename V, typename WS>
+    void forward_batch(H&& output, const V& input, WS& ws) const {
+        static dll::timer_id timer_handle("recurrent_last:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
         const auto Batch = etl::dim<0>(input);
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b) = input(b)(time_steps - 1);
+        // The order of the samples of a time-major input
+        if constexpr (time_major_in) {
+            ws.mask.prepare(Batch, time_steps);
         }
+
+        select_last_steps<time_major_in>(output, input, ws.mask, time_steps);
     }
 
     /*!
@@ -171,15 +195,10 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("recurrent_last:backward_batch");
-
-        const auto Batch = etl::dim<0>(output);
+        static dll::timer_id timer_handle("recurrent_last:backward_batch");
+        dll::auto_timer timer(timer_handle);
 
-        output = 0;
-
-        for(size_t b = 0; b < Batch; ++b){
-            output(b)(time_steps - 1) = context.errors(b);
-        }
+        expand_last_steps<time_major_in>(output, context.errors, context.workspace.mask, time_steps);
     }
 
     /*!
@@ -227,6 +246,10 @@ struct sgd_context<DBN, dyn_recurrent_last_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 2> output;
     etl::dyn_matrix<weight, 2> errors;
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
+    sequence_workspace workspace; ///< The lengths of the sequences of the batch
+
     sgd_context(const dyn_recurrent_last_layer_impl<Desc>& layer)
             : input(batch_size, layer.time_steps, layer.hidden_units), output(batch_size, layer.hidden_units, 0.0), errors(batch_size, layer.hidden_units, 0.0) {}
 };
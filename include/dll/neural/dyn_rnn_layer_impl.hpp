@@ -158,11 +158,28 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& x) const {
-        dll::auto_timer timer("rnn:forward_batch");
+        // Each thread has its own workspace for inference
+        thread_local rnn_forward_workspace<weight> ws;
+
+        forward_batch(output, x, ws);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, using the given
+     * workspace for the caches
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param ws The workspace
+     */
+    template <typename H, typename V, typename WS>
+    void forward_batch(H&& output, const V& x, WS& ws) const {
+        static dll::timer_id timer_handle("rnn:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
         cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
 
-        base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
+        base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units, ws);
     }
 
     /*!
@@ -223,7 +240,8 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
      */
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("rnn:backward_batch");
+        static dll::timer_id timer_handle("rnn:backward_batch");
+        dll::auto_timer timer(timer_handle);
 
         base_type::backward_batch_impl(output, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
     }
@@ -234,7 +252,8 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
      */
     template <typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("rnn:compute_gradients");
+        static dll::timer_id timer_handle("rnn:compute_gradients");
+        dll::auto_timer timer(timer_handle);
 
         base_type::compute_gradients_impl(context, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
     }
@@ -275,6 +294,8 @@ struct sgd_context<DBN, dyn_rnn_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 3> output;
     etl::dyn_matrix<weight, 3> errors;
 
+    rnn_workspace<weight> workspace; ///< The forward and backward caches of the layer
+
     sgd_context(const dyn_rnn_layer_impl<Desc>& layer)
             : input(batch_size, layer.time_steps, layer.sequence_length), output(batch_size, layer.time_steps, layer.hidden_units, 0.0), errors(batch_size, layer.time_steps, layer.hidden_units, 0.0) {}
 };
@@ -9,7 +9,8 @@
 
 #include "dll/neural_layer_no_bias.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/embedding_table.hpp" // for embedding_table
+#include "dll/util/timers.hpp"          // for auto_timer
 
 namespace dll {
 
@@ -44,6 +45,8 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     //Backup weights and biases
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
 
+    embedding_table table; ///< The copy of the weights for the lookups in reduced precision
+
     /*!
      * \brief Initialize a embedding layer with basic weights.
      */
@@ -115,9 +118,65 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        dll::auto_timer timer("embedding:forward_batch");
+        static dll::timer_id timer_handle("embedding:forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        table.gather(v, w, output);
+    }
+
+    /*!
+     * \brief Set the precision of the lookups of the embeddings.
+     *
+     * In reduced precision, the rows are gathered from a copy of the
+     * weights, rebuilt at the next lookup after each change of the weights.
+     * This is best for the inference and for the frozen embeddings. The
+     * gradients and the updates are still done in full precision.
+     *
+     * \param precision The precision of the lookups
+     */
+    void set_lookup_precision(embedding_precision precision) {
+        table.set_precision(precision);
+    }
+
+    /*!
+     * \brief Returns the precision of the lookups of the embeddings
+     */
+    embedding_precision lookup_precision() const {
+        return table.get_precision();
+    }
+
+    /*!
+     * \brief Forget the copy of the weights in reduced precision, after a
+     * change of the weights
+     */
+    void weights_changed() {
+        table.invalidate();
+    }
+
+    /*!
+     * \brief Restore the weights from the secondary weights matrix
+     */
+    void restore_weights() {
+        base_type::restore_weights();
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Load the weigts from the given stream
+     */
+    void load(std::istream& is) {
+        base_type::load(is);
+
+        weights_changed();
+    }
 
-        output = batch_embedding_lookup(v, w);
+    /*!
+     * \brief Load the weigts from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
     }
 
     /*!
@@ -170,9 +229,39 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        dll::auto_timer timer("embedding:compute_gradients");
+        static dll::timer_id timer_handle("embedding:compute_gradients");
+        dll::auto_timer timer(timer_handle);
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        // Only the rows touched by the previous batch need to be cleared
+
+        if (context.stale_grad) {
+            grad = weight(0);
+        } else {
+            for (auto row : context.rows) {
+                grad(row) = weight(0);
+            }
+        }
+
+        context.rows.clear();
+
+        const size_t B = etl::dim<0>(context.input);
+        const size_t Is = etl::dim<1>(context.input);
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t i = 0; i < Is; ++i) {
+                const size_t row = context.input(b, i);
+
+                context.rows.push_back(row);
+                grad(row) += context.errors(b)(i);
+            }
+        }
+
+        std::sort(context.rows.begin(), context.rows.end());
+        context.rows.erase(std::unique(context.rows.begin(), context.rows.end()), context.rows.end());
+
+        context.stale_grad = false;
     }
 };
 
@@ -225,6 +314,9 @@ struct sgd_context<DBN, embedding_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, I, K> output;
     etl::fast_matrix<weight, batch_size, I, K> errors;
 
+    std::vector<size_t> rows; ///< The rows of the gradients touched by the current batch
+    bool stale_grad = true;   ///< Indicates if the gradients may be non-zero outside of rows
+
     sgd_context(const embedding_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
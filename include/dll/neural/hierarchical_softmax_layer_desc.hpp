@@ -0,0 +1,62 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+#include "dll/util/sampled_output.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Descriptor for a hierarchical softmax output layer.
+ *
+ * The classes are the leaves of a balanced binary tree, each inner node
+ * being a logistic unit. The probability of a class is the product of the
+ * probabilities of the branches on its path. During training, only the
+ * nodes of the paths of the labels are computed. The probabilities of all
+ * the classes are computed for evaluation.
+ */
+template <size_t visibles, size_t classes, typename... Parameters>
+struct hierarchical_softmax_layer_desc {
+    static constexpr size_t num_visible = visibles; ///< The number of visible units of the layer
+    static constexpr size_t num_classes = classes;  ///< The number of classes of the layer
+
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = hierarchical_softmax_layer_impl<hierarchical_softmax_layer_desc<visibles, classes, Parameters...>>;
+
+    /*! The layer type (no dynamic version) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(num_visible > 0, "There must be at least 1 visible unit");
+    static_assert(num_classes > 1, "There must be at least 2 classes");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id, initializer_bias_id>, Parameters...>,
+        "Invalid parameters type for hierarchical_softmax_layer_desc");
+};
+
+/*!
+ * \brief Describe a hierarchical softmax output layer
+ */
+template <size_t visibles, size_t classes, typename... Parameters>
+using hierarchical_softmax_layer = typename hierarchical_softmax_layer_desc<visibles, classes, Parameters...>::layer_t;
+
+} //end of dll namespace
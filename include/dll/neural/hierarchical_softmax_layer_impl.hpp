@@ -0,0 +1,440 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/sampled_output.hpp" // For hsoftmax_depth
+#include "dll/util/timers.hpp"         // For auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Hierarchical softmax output layer.
+ *
+ * The classes are the leaves of a full binary tree stored as a heap (see
+ * hsoftmax_depth). Each of the N - 1 inner nodes k is a logistic unit
+ * giving the probability sigmoid(w_k * x + b_k) of going to its left
+ * child. The probability of a class is the product of the probabilities
+ * of the branches from the root to its leaf.
+ *
+ * During training, only the nodes of the path of the class of each sample
+ * are computed, in O(log(N)) products. For evaluation, the probabilities of
+ * all the classes are computed.
+ */
+template <typename Desc>
+struct hierarchical_softmax_layer_impl final : neural_layer<hierarchical_softmax_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                                  ///< The descriptor of the layer
+    using weight      = typename desc::weight;                 ///< The data type for this layer
+    using this_type   = hierarchical_softmax_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>;         ///< The base type
+    using layer_t     = this_type;                             ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;            ///< The dynamic version of this layer
+
+    static constexpr size_t num_visible = desc::num_visible;          ///< The number of visible units
+    static constexpr size_t num_classes = desc::num_classes;          ///< The number of classes
+    static constexpr size_t num_nodes   = num_classes - 1;            ///< The number of inner nodes of the tree
+    static constexpr size_t depth       = hsoftmax_depth(num_classes); ///< The depth of the deepest leaf
+
+    static constexpr auto activation_function = function::SOFTMAX; ///< The layer's activation function
+    static constexpr bool sampled_output      = true;              ///< The layer is trained from the labels
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_classes>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, num_nodes, num_visible>; ///< The type of the weights (one row per inner node)
+    using b_type = etl::fast_matrix<weight, num_nodes>;              ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Biases
+
+    //Backup Weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Biases
+
+    /*!
+     * \brief Initialize a hierarchical softmax layer with basic weights.
+     */
+    hierarchical_softmax_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_classes;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     */
+    static constexpr size_t parameters() noexcept {
+        // Weights + Biases
+        return num_visible * num_nodes + num_nodes;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        return "Hierarchical Softmax";
+    }
+
+    /*!
+     * \brief Returns a full description of the layer
+     * \return an std::string containing a full description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+        snprintf(buffer, 512, "Hierarchical Softmax: %lu -> %lu (depth %lu)", num_visible, num_classes, depth);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_classes};
+    }
+
+    /*!
+     * \brief Compute the probabilities of all the classes for the given
+     * batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("hierarchical_softmax:forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        // The probability of the left branch of each node
+        etl::dyn_matrix<weight, 2> left(Batch, num_nodes);
+
+        left = etl::reshape(input, Batch, num_visible) * etl::transpose(w);
+        left = etl::sigmoid(bias_add_2d(left, b));
+
+        left.ensure_cpu_up_to_date();
+        output.ensure_cpu_up_to_date();
+
+        // The probabilities of the nodes, from the root (parents before children)
+        std::vector<weight> p(num_nodes + num_classes);
+
+        for (size_t i = 0; i < Batch; ++i) {
+            p[0] = weight(1);
+
+            for (size_t k = 0; k < num_nodes; ++k) {
+                const weight l = left(i, k);
+
+                p[2 * k + 1] = p[k] * l;
+                p[2 * k + 2] = p[k] * (weight(1) - l);
+            }
+
+            for (size_t c = 0; c < num_classes; ++c) {
+                output(i, c) = p[num_nodes + c];
+            }
+        }
+
+        output.invalidate_gpu();
+    }
+
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     */
+    template <typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        forward_batch(output, input);
+    }
+
+    /*!
+     * \brief Compute the probabilities of the paths of the classes of a
+     * batch, together with the errors of the nodes and the categorical
+     * cross-entropy metrics.
+     *
+     * A sample is counted as an error when a branch of its path is not the
+     * most probable one.
+     *
+     * Only the first n = dim<0>(labels) samples are processed, the errors
+     * of the other samples are cleared.
+     *
+     * \param context The training context, holding the inputs of the layer
+     * \param labels The labels of the batch [n, num_classes]
+     *
+     * \return a pair containing the sums of the error and of the loss over the batch
+     */
+    template <typename C, typename Labels>
+    std::pair<double, double> sampled_errors(C& context, const Labels& labels) const {
+        static dll::timer_id timer_handle("hierarchical_softmax:errors");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t n = etl::dim<0>(labels);
+
+        context.input.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        b.ensure_cpu_up_to_date();
+
+        label_classes(context.classes, labels);
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        context.errors = weight(0);
+
+        for (size_t i = 0; i < n; ++i) {
+            const weight* x = context.input.memory_start() + i * num_visible;
+
+            bool wrong = false;
+            size_t d   = 0;
+
+            for (size_t node = num_nodes + context.classes[i]; node > 0; node = (node - 1) / 2, ++d) {
+                const size_t parent = (node - 1) / 2;
+                const bool left     = node == 2 * parent + 1;
+
+                const weight* w_k = w.memory_start() + parent * num_visible;
+
+                weight z = b(parent);
+
+                for (size_t v = 0; v < num_visible; ++v) {
+                    z += x[v] * w_k[v];
+                }
+
+                // -log(sigmoid(+-z)) = log(1 + exp(-+z)), computed stably
+                const weight s = left ? z : -z;
+
+                loss += s > 0 ? std::log1p(std::exp(-s)) : -s + std::log1p(std::exp(s));
+                wrong |= s < 0;
+
+                context.nodes[i * depth + d] = parent;
+                context.errors(i, d)         = (left ? weight(1) : weight(0)) - weight(1) / (weight(1) + std::exp(-z));
+            }
+
+            error += wrong;
+        }
+
+        context.errors.invalidate_gpu();
+
+        return {error, loss};
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DLayer>
+    static void dyn_init(DLayer& dyn){
+        cpp_unused(dyn);
+
+        // There is no dynamic version
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * The errors of the nodes are already the errors of their logits.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the nodes to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        static dll::timer_id timer_handle("hierarchical_softmax:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+        auto out = etl::reshape<Batch, num_visible>(output);
+
+        out = weight(0);
+
+        for (size_t i = 0; i < Batch; ++i) {
+            for (size_t d = 0; d < depth; ++d) {
+                if (context.errors(i, d) != weight(0)) {
+                    out(i) += context.errors(i, d) * w(context.nodes[i * depth + d]);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the nodes of the paths of the batch.
+     *
+     * Only the rows of the weights of these nodes are non-zero.
+     *
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        static dll::timer_id timer_handle("hierarchical_softmax:compute_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+        auto& b_grad = std::get<1>(context.up.context)->grad;
+
+        // Only the rows touched by the previous batch need to be cleared
+
+        if (context.stale_grad) {
+            w_grad = weight(0);
+        } else {
+            for (auto row : context.rows) {
+                w_grad(row) = weight(0);
+            }
+        }
+
+        b_grad = weight(0);
+
+        context.rows.clear();
+
+        for (size_t i = 0; i < etl::dim<0>(context.errors); ++i) {
+            for (size_t d = 0; d < depth; ++d) {
+                const weight e = context.errors(i, d);
+
+                if (e != weight(0)) {
+                    const size_t node = context.nodes[i * depth + d];
+
+                    context.rows.push_back(node);
+
+                    w_grad(node) += e * context.input(i);
+                    b_grad(node) += e;
+                }
+            }
+        }
+
+        std::sort(context.rows.begin(), context.rows.end());
+        context.rows.erase(std::unique(context.rows.begin(), context.rows.end()), context.rows.end());
+
+        context.stale_grad = false;
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t hierarchical_softmax_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t hierarchical_softmax_layer_impl<Desc>::num_classes;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<hierarchical_softmax_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for hierarchical_softmax_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, hierarchical_softmax_layer_impl<Desc>, L> {
+    using layer_t = hierarchical_softmax_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_classes = layer_t::num_classes;
+    static constexpr auto depth       = layer_t::depth;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;
+    etl::fast_matrix<weight, batch_size, num_classes> output;
+    etl::fast_matrix<weight, batch_size, depth> errors; ///< The errors of the nodes of the path of each sample
+
+    std::vector<size_t> nodes;   ///< The nodes of the path of each sample [batch_size, depth]
+    std::vector<size_t> classes; ///< The class of each sample
+
+    std::vector<size_t> rows; ///< The rows of the gradients touched by the current batch
+    bool stale_grad = true;   ///< Indicates if the gradients may be non-zero outside of rows
+
+    sgd_context(const layer_t& /* layer */)
+            : output(0.0), errors(0.0), nodes(batch_size * depth) {}
+};
+
+} //end of dll namespace
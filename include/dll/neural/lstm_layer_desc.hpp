@@ -31,6 +31,11 @@ struct lstm_layer_desc {
      */
     static constexpr auto activation_function = detail::get_value_v<activation<function::TANH>, Parameters...>;            ///< The layer's activation function
 
+    /*!
+     * \brief The precision of the activation function and of the gates
+     */
+    static constexpr auto precision = detail::get_value_v<activation_precision<function_precision::EXACT>, Parameters...>;
+
     /*!
      * \brief The BPTT steps
      */
@@ -57,8 +62,9 @@ struct lstm_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id,
-            initializer_bias_id, initializer_forget_bias_id, truncate_id, last_only_id>,
+            weight_type_id, activation_id, activation_precision_id, rnn_initializer_w_id, rnn_initializer_u_id,
+            initializer_bias_id, initializer_forget_bias_id, truncate_id, last_only_id,
+            time_major_input_id, time_major_output_id>,
             Parameters...>,
         "Invalid parameters type for lstm_layer_desc");
 };
@@ -33,6 +33,10 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     static constexpr size_t bptt_steps = desc::Truncate == 0 ? time_steps : desc::Truncate; ///< The number of bptt steps
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr auto precision           = desc::precision;           ///< The precision of the activation function and of the gates
+
+    static constexpr bool time_major_in  = desc::parameters::template contains<time_major_input>();  ///< Indicates if the input is time-major
+    static constexpr bool time_major_out = desc::parameters::template contains<time_major_output>(); ///< Indicates if the output is time-major
 
     using w_initializer  = typename desc::w_initializer;  ///< The initializer for the W weights
     using u_initializer  = typename desc::u_initializer;  ///< The initializer for the U weights
@@ -166,66 +170,6 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
         return {time_steps, hidden_units};
     }
 
-    mutable etl::dyn_matrix<float, 3> g_t;
-    mutable etl::dyn_matrix<float, 3> i_t;
-    mutable etl::dyn_matrix<float, 3> f_t;
-    mutable etl::dyn_matrix<float, 3> o_t;
-
-    mutable etl::dyn_matrix<float, 3> x_t;
-    mutable etl::dyn_matrix<float, 3> s_t;
-    mutable etl::dyn_matrix<float, 3> h_t;
-
-    mutable etl::dyn_matrix<float, 3> d_h_t;
-    mutable etl::dyn_matrix<float, 3> d_c_t;
-    mutable etl::dyn_matrix<float, 3> d_x_t;
-
-    mutable etl::dyn_matrix<float, 3> d_h_o_t;
-    mutable etl::dyn_matrix<float, 3> d_h_f_t;
-    mutable etl::dyn_matrix<float, 3> d_h_i_t;
-    mutable etl::dyn_matrix<float, 3> d_h_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_x_o_t;
-    mutable etl::dyn_matrix<float, 3> d_x_f_t;
-    mutable etl::dyn_matrix<float, 3> d_x_i_t;
-    mutable etl::dyn_matrix<float, 3> d_x_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_xh_o_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_f_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_i_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_c_t;
-
-    void prepare_cache(size_t Batch) const {
-        if (cpp_unlikely(!i_t.memory_start())) {
-            g_t.resize(time_steps, Batch, hidden_units);
-            i_t.resize(time_steps, Batch, hidden_units);
-            f_t.resize(time_steps, Batch, hidden_units);
-            o_t.resize(time_steps, Batch, hidden_units);
-
-            x_t.resize(time_steps, Batch, sequence_length);
-            s_t.resize(time_steps, Batch, hidden_units);
-            h_t.resize(time_steps, Batch, hidden_units);
-
-            d_h_t.resize(time_steps, Batch, hidden_units);
-            d_c_t.resize(time_steps, Batch, hidden_units);
-            d_x_t.resize(time_steps, Batch, sequence_length);
-
-            d_h_o_t.resize(time_steps, Batch, hidden_units);
-            d_h_f_t.resize(time_steps, Batch, hidden_units);
-            d_h_i_t.resize(time_steps, Batch, hidden_units);
-            d_h_c_t.resize(time_steps, Batch, hidden_units);
-
-            d_x_o_t.resize(time_steps, Batch, sequence_length);
-            d_x_f_t.resize(time_steps, Batch, sequence_length);
-            d_x_i_t.resize(time_steps, Batch, sequence_length);
-            d_x_c_t.resize(time_steps, Batch, sequence_length);
-
-            d_xh_o_t.resize(time_steps, Batch, hidden_units);
-            d_xh_f_t.resize(time_steps, Batch, hidden_units);
-            d_xh_i_t.resize(time_steps, Batch, hidden_units);
-            d_xh_c_t.resize(time_steps, Batch, hidden_units);
-        }
-    }
-
     /*!
      * \brief Apply the layer to the given batch of input.
      *
@@ -234,51 +178,104 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& x) const {
-        dll::auto_timer timer("lstm:forward_batch");
+        // Each thread has its own workspace for inference
+        thread_local lstm_forward_workspace<weight> ws;
+
+        forward_batch(output, x, ws);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, using the given
+     * workspace for the caches
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param ws The workspace
+     */
+    template <typename H, typename V, typename WS>
+    void forward_batch(H&& output, const V& x, WS& ws) const {
+        static dll::timer_id timer_handle("lstm:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
         const auto Batch = etl::dim<0>(x);
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        prepare_cache(Batch);
+        ws.prepare(Batch, time_steps, sequence_length, hidden_units);
 
-        // 1. Rearrange input
+        auto& g_t = ws.g_t;
+        auto& i_t = ws.i_t;
+        auto& f_t = ws.f_t;
+        auto& o_t = ws.o_t;
+        auto& x_t = ws.x_t;
+        auto& s_t = ws.s_t;
+        auto& h_t = ws.h_t;
+        auto& xu  = ws.xu;
+        auto& z   = ws.z;
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
-            }
-        }
+        auto& u_all = ws.u_all;
+        auto& w_all = ws.w_all;
+        auto& b_all = ws.b_all;
+
+        auto& mask = ws.mask;
 
-        // 2. Forward propagation through time
+        mask.prepare(Batch, time_steps);
 
-        // t == 0
+        // 1. Rearrange input (sorted by decreasing length)
 
-        g_t(0) =    etl::tanh(bias_add_2d(x_t(0) * (u_g), b_g));
-        i_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_i), b_i));
-        f_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_f), b_f));
-        o_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_o), b_o));
+        to_time_steps<time_major_in>(x_t, x, mask, time_steps);
 
-        s_t(0) = g_t(0) >> i_t(0);
-        h_t(0) = f_activate<activation_function>(s_t(0)) >> o_t(0);
+        // 2. Pack the weights of the four gates
 
-        for (size_t t = 1; t < time_steps; ++t) {
-            g_t(t) =    etl::tanh(bias_add_2d(x_t(t) * u_g + h_t(t - 1) * w_g, b_g));
-            i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_i + h_t(t - 1) * w_i, b_i));
-            f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_f + h_t(t - 1) * w_f, b_f));
-            o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_o + h_t(t - 1) * w_o, b_o));
+        this->pack_gates(u_all, u_g, u_i, u_f, u_o);
+        this->pack_gates(w_all, w_g, w_i, w_f, w_o);
+        this->pack_gates(b_all, b_g, b_i, b_f, b_o);
 
-            s_t(t) = f_activate<activation_function>( (g_t(t) >> i_t(t)) + (s_t(t - 1) >> f_t(t)) );
-            h_t(t) = s_t(t) >> o_t(t);
+        // 3. Compute the input projections of all the time steps at once
+
+        const size_t ws_batch = etl::dim<1>(x_t);
+
+        if (!mask.enabled()) {
+            xu = etl::reshape(x_t, etl::dim<0>(x_t) * ws_batch, sequence_length) * u_all;
+        } else {
+            // Only the projections of the active samples are needed
+            for (size_t t = 0; t < time_steps && mask.active[t]; ++t) {
+                etl::slice(xu, t * ws_batch, t * ws_batch + mask.active[t]) = etl::slice(x_t(t), 0, mask.active[t]) * u_all;
+            }
         }
 
-        // 3. Rearrange the output
+        // 4. Forward propagation through time, only the active samples are computed
+
+        for (size_t t = 0; t < time_steps && mask.active[t]; ++t) {
+            const size_t n = mask.active[t];
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = h_t(t)(b);
+            if (t > 0) {
+                etl::slice(z, 0, n) = etl::slice(h_t(t - 1), 0, n) * w_all;
+            }
+
+            this->forward_gates(t, n, xu, z, b_all, g_t, i_t, f_t, o_t, s_t);
+
+            auto s = etl::slice(s_t(t), 0, n);
+            auto h = etl::slice(h_t(t), 0, n);
+            auto o = etl::slice(o_t(t), 0, n);
+
+            if (t == 0) {
+                if constexpr (precision == function_precision::FAST) {
+                    h = s;
+                    f_activate_inplace<activation_function, precision>(h);
+                    h = h >> o;
+                } else {
+                    h = f_activate<activation_function>(s) >> o;
+                }
+            } else {
+                f_activate_inplace<activation_function, precision>(s);
+                h = s >> o;
             }
         }
+
+        // 5. Rearrange the output (the padding steps are set to zero)
+
+        from_time_steps<time_major_out>(output, h_t, mask, time_steps);
     }
 
     /*!
@@ -331,15 +328,36 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     void backward_pass(Output& output, C& context, bool direct = true) const {
         const size_t Batch = etl::dim<0>(context.errors);
 
-        // 1. Rearrange input/errors
+        auto& ws = context.workspace;
 
-        etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
+        ws.prepare_backward(time_steps, sequence_length, hidden_units);
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
-            }
-        }
+        auto& g_t = ws.g_t;
+        auto& i_t = ws.i_t;
+        auto& f_t = ws.f_t;
+        auto& o_t = ws.o_t;
+        auto& x_t = ws.x_t;
+        auto& s_t = ws.s_t;
+        auto& h_t = ws.h_t;
+        auto& d_z = ws.d_z;
+
+        auto& u_all = ws.u_all;
+        auto& w_all = ws.w_all;
+
+        auto& delta_t = ws.delta_t;
+        auto& d_h_t   = ws.d_h_t;
+        auto& d_c_t   = ws.d_c_t;
+        auto& d_x_t   = ws.d_x_t;
+
+        auto& u_all_grad = ws.u_all_grad;
+        auto& w_all_grad = ws.w_all_grad;
+        auto& b_all_grad = ws.b_all_grad;
+
+        auto& mask = ws.mask;
+
+        // 1. Rearrange input/errors (in the order of the forward pass)
+
+        to_time_steps<time_major_out>(delta_t, context.errors, mask, time_steps);
 
         // 2. Get gradients from the context
 
@@ -356,18 +374,11 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
         auto& u_o_grad = std::get<10>(context.up.context)->grad;
         auto& b_o_grad = std::get<11>(context.up.context)->grad;
 
-        w_i_grad = 0;
-        u_i_grad = 0;
-        b_i_grad = 0;
-        w_g_grad = 0;
-        u_g_grad = 0;
-        b_g_grad = 0;
-        w_f_grad = 0;
-        u_f_grad = 0;
-        b_f_grad = 0;
-        w_o_grad = 0;
-        u_o_grad = 0;
-        b_o_grad = 0;
+        // The gradients are accumulated packed and unpacked at the end
+
+        w_all_grad = 0;
+        u_all_grad = 0;
+        b_all_grad = 0;
 
         // 3. Backpropagation through time
 
@@ -379,59 +390,48 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
             // Backpropagation through time
             for(int tt = ttt; tt >= int(last_step); --tt){
                 const size_t t = tt;
+                const size_t n = mask.active[t];
 
-                if (t == time_steps - 1) {
-                    d_h_t(t) = delta_t(t);
-                    d_c_t(t) = (o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t));
-                } else {
-                    d_h_t(t) = delta_t(t) + d_h_t(t + 1);
-                    d_c_t(t) = ((o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t))) + d_c_t(t + 1);
+                if (!n) {
+                    continue;
                 }
 
-                d_h_o_t(t) = etl::ml::sigmoid_backward(o_t(t), s_t(t) >> d_h_t(t));
-                d_h_i_t(t) = etl::ml::sigmoid_backward(i_t(t), g_t(t) >> d_c_t(t));
-                d_h_c_t(t) = etl::ml::tanh_backward(g_t(t), i_t(t) >> d_c_t(t));
+                auto d_h = etl::slice(d_h_t(t), 0, n);
+                auto d_c = etl::slice(d_c_t(t), 0, n);
+                auto o   = etl::slice(o_t(t), 0, n);
+                auto s   = etl::slice(s_t(t), 0, n);
+                auto dz  = etl::slice(d_z, 0, n);
 
-                if (t == 0) {
-                    d_h_f_t(t) = 0;
+                if (t == time_steps - 1) {
+                    d_h = etl::slice(delta_t(t), 0, n);
+                    d_c = (o >> d_h) >> f_derivative<activation_function>(s);
                 } else {
-                    d_h_f_t(t) = etl::ml::sigmoid_backward(f_t(t), s_t(t - 1) >> d_c_t(t));
+                    // The samples ending at this step have no errors from the next step
+                    if (mask.active[t + 1] < n) {
+                        etl::slice(d_h_t(t + 1), mask.active[t + 1], n) = 0;
+                        etl::slice(d_c_t(t + 1), mask.active[t + 1], n) = 0;
+                    }
+
+                    d_h = etl::slice(delta_t(t), 0, n) + etl::slice(d_h_t(t + 1), 0, n);
+                    d_c = ((o >> d_h) >> f_derivative<activation_function>(s)) + etl::slice(d_c_t(t + 1), 0, n);
                 }
 
-                b_o_grad += bias_batch_sum_2d(d_h_o_t(t));
-                b_i_grad += bias_batch_sum_2d(d_h_i_t(t));
-                b_f_grad += bias_batch_sum_2d(d_h_f_t(t));
-                b_g_grad += bias_batch_sum_2d(d_h_c_t(t));
+                // The errors of the four gates, packed
+                this->backward_gates(t, n, d_z, g_t, i_t, f_t, o_t, s_t, d_h_t, d_c_t);
 
-                u_o_grad += batch_outer(x_t(t), d_h_o_t(t));
-                u_i_grad += batch_outer(x_t(t), d_h_i_t(t));
-                u_f_grad += batch_outer(x_t(t), d_h_f_t(t));
-                u_g_grad += batch_outer(x_t(t), d_h_c_t(t));
+                b_all_grad += bias_batch_sum_2d(dz);
+                u_all_grad += batch_outer(etl::slice(x_t(t), 0, n), dz);
 
                 if(t > 0){
-                    w_o_grad += batch_outer(h_t(t - 1), d_h_o_t(t));
-                    w_i_grad += batch_outer(h_t(t - 1), d_h_i_t(t));
-                    w_f_grad += batch_outer(h_t(t - 1), d_h_f_t(t));
-                    w_g_grad += batch_outer(h_t(t - 1), d_h_c_t(t));
+                    w_all_grad += batch_outer(etl::slice(h_t(t - 1), 0, n), dz);
                 }
 
                 // The part going back to x
-                d_x_o_t(t) = d_h_o_t(t) * trans(u_o);
-                d_x_i_t(t) = d_h_i_t(t) * trans(u_i);
-                d_x_f_t(t) = d_h_f_t(t) * trans(u_f);
-                d_x_c_t(t) = d_h_c_t(t) * trans(u_g);
-
-                d_x_t(t) = d_x_o_t(t) + d_x_i_t(t) + d_x_f_t(t) + d_x_c_t(t);
-
-                // The part going back to h
-                d_xh_o_t(t) = d_h_o_t(t) * trans(w_o);
-                d_xh_i_t(t) = d_h_i_t(t) * trans(w_i);
-                d_xh_f_t(t) = d_h_f_t(t) * trans(w_f);
-                d_xh_c_t(t) = d_h_c_t(t) * trans(w_g);
-
-                // Update for the next step
-                d_h_t(t) = d_xh_o_t(t) + d_xh_i_t(t) + d_xh_f_t(t) + d_xh_c_t(t);
-                d_c_t(t) = f_t(t) >> d_c_t(t);
+                etl::slice(d_x_t(t), 0, n) = dz * trans(u_all);
+
+                // The part going back to h (update for the next step)
+                d_h = dz * trans(w_all);
+                d_c = etl::slice(f_t(t), 0, n) >> d_c;
             }
 
             --ttt;
@@ -442,14 +442,14 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
             }
         } while (ttt != 0);
 
-        // 3. Rearrange for the output
+        this->unpack_gates(w_all_grad, w_g_grad, w_i_grad, w_f_grad, w_o_grad);
+        this->unpack_gates(u_all_grad, u_g_grad, u_i_grad, u_f_grad, u_o_grad);
+        this->unpack_gates(b_all_grad, b_g_grad, b_i_grad, b_f_grad, b_o_grad);
+
+        // 4. Rearrange for the output
 
         if (direct) {
-            for (size_t b = 0; b < Batch; ++b) {
-                for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
-                }
-            }
+            from_time_steps<time_major_in>(output, d_x_t, mask, time_steps);
         }
     }
 
@@ -460,7 +460,8 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
      */
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("lstm:backward_batch");
+        static dll::timer_id timer_handle("lstm:backward_batch");
+        dll::auto_timer timer(timer_handle);
 
         backward_pass(output, context, true);
     }
@@ -472,8 +473,9 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     template <typename C>
     void compute_gradients(C& context) const {
         if constexpr (!C::layer) {
-            dll::auto_timer timer("lstm:compute_gradients");
-            backward_pass(x_t, context, false);
+            static dll::timer_id timer_handle("lstm:compute_gradients");
+            dll::auto_timer timer(timer_handle);
+            backward_pass(context.workspace.x_t, context, false);
         }
     }
 };
@@ -527,6 +529,8 @@ struct sgd_context<DBN, lstm_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> output;
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> errors;
 
+    lstm_workspace<weight> workspace; ///< The forward and backward caches of the layer
+
     sgd_context(const lstm_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
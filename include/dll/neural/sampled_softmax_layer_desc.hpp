@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+#include "dll/util/sampled_output.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Descriptor for a sampled softmax output layer.
+ *
+ * The layer is a dense softmax layer over a large number of classes. During
+ * training, the softmax is only computed over the classes of the labels and
+ * a set of negative classes sampled at each step. The full softmax is
+ * computed for evaluation.
+ */
+template <size_t visibles, size_t classes, typename... Parameters>
+struct sampled_softmax_layer_desc {
+    static constexpr size_t num_visible = visibles; ///< The number of visible units of the layer
+    static constexpr size_t num_classes = classes;  ///< The number of classes of the layer
+
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr size_t NegativeSamples = detail::get_value_v<negative_samples<64>, Parameters...>; ///< The number of negative classes sampled at each step
+
+    using sampler_t = detail::get_type_t<negative_sampler<log_uniform_sampler>, Parameters...>; ///< The sampler of the negative classes
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = sampled_softmax_layer_impl<sampled_softmax_layer_desc<visibles, classes, Parameters...>>;
+
+    /*! The layer type (no dynamic version) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(num_visible > 0, "There must be at least 1 visible unit");
+    static_assert(num_classes > 1, "There must be at least 2 classes");
+    static_assert(NegativeSamples > 0 && NegativeSamples < num_classes, "The negative samples must be fewer than the classes");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id, initializer_bias_id, negative_samples_id, negative_sampler_id>, Parameters...>,
+        "Invalid parameters type for sampled_softmax_layer_desc");
+};
+
+/*!
+ * \brief Describe a sampled softmax output layer
+ */
+template <size_t visibles, size_t classes, typename... Parameters>
+using sampled_softmax_layer = typename sampled_softmax_layer_desc<visibles, classes, Parameters...>::layer_t;
+
+} //end of dll namespace
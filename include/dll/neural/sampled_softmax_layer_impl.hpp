@@ -0,0 +1,483 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/random.hpp"         // For random_engine
+#include "dll/util/sampled_output.hpp" // For the samplers
+#include "dll/util/timers.hpp"         // For auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Sampled softmax output layer.
+ *
+ * For evaluation, the layer is a dense softmax layer. During training, the
+ * softmax of each sample is only computed over its class and a set of
+ * negative classes, sampled once per batch without replacement. The logits
+ * are corrected by the logarithm of the expected count of each class in
+ * the samples, so that the sampled softmax is an estimate of the full one.
+ * A negative class that is the class of a sample is not a negative for
+ * this sample (accidental hit).
+ *
+ * The weights have one row per class, only the rows of the candidates of a
+ * batch have non-zero gradients and they are updated alone when possible.
+ */
+template <typename Desc>
+struct sampled_softmax_layer_impl final : neural_layer<sampled_softmax_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                             ///< The descriptor of the layer
+    using weight      = typename desc::weight;            ///< The data type for this layer
+    using this_type   = sampled_softmax_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>;    ///< The base type
+    using layer_t     = this_type;                        ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;       ///< The dynamic version of this layer
+    using sampler_t   = typename desc::sampler_t;         ///< The sampler of the negative classes
+
+    static constexpr size_t num_visible      = desc::num_visible;     ///< The number of visible units
+    static constexpr size_t num_classes      = desc::num_classes;     ///< The number of classes
+    static constexpr size_t negative_samples = desc::NegativeSamples; ///< The number of negative classes of each batch
+
+    static constexpr auto activation_function = function::SOFTMAX; ///< The layer's activation function
+    static constexpr bool sampled_output      = true;              ///< The layer is trained from the labels
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_classes>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, num_classes, num_visible>; ///< The type of the weights (one row per class)
+    using b_type = etl::fast_matrix<weight, num_classes>;              ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Biases
+
+    //Backup Weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Biases
+
+    /*!
+     * \brief Initialize a sampled softmax layer with basic weights.
+     */
+    sampled_softmax_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_classes;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     */
+    static constexpr size_t parameters() noexcept {
+        // Weights + Biases
+        return num_visible * num_classes + num_classes;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        return "Sampled Softmax";
+    }
+
+    /*!
+     * \brief Returns a full description of the layer
+     * \return an std::string containing a full description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+        snprintf(buffer, 512, "Sampled Softmax: %lu -> %lu (%lu negatives)", num_visible, num_classes, negative_samples);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_classes};
+    }
+
+    /*!
+     * \brief Apply the full layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     * \tparam F The activation function (the logits with IDENTITY)
+     */
+    template <function F = activation_function, typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("sampled_softmax:forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        output = etl::reshape(input, Batch, num_visible) * etl::transpose(w);
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, true>(output, b);
+    }
+
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function (the logits with IDENTITY)
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        forward_batch<F>(output, input);
+    }
+
+    /*!
+     * \brief Compute the sampled softmax of a batch, together with the errors
+     * of the candidates and the categorical cross-entropy metrics.
+     *
+     * Only the first n = dim<0>(labels) samples are processed, the errors
+     * of the other samples are cleared.
+     *
+     * \param context The training context, holding the inputs of the layer
+     * \param labels The labels of the batch [n, num_classes]
+     *
+     * \return a pair containing the sums of the error (over the candidates)
+     * and of the loss over the batch
+     */
+    template <typename C, typename Labels>
+    std::pair<double, double> sampled_errors(C& context, const Labels& labels) const {
+        static dll::timer_id timer_handle("sampled_softmax:errors");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t n = etl::dim<0>(labels);
+
+        context.input.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        b.ensure_cpu_up_to_date();
+
+        auto& classes = context.classes;
+
+        // 1. Sample the negative classes, without replacement
+
+        classes.clear();
+
+        size_t tries = 0;
+
+        while (classes.size() < negative_samples) {
+            while (classes.size() < negative_samples) {
+                classes.push_back(sampler_t::sample(context.engine, num_classes));
+                ++tries;
+            }
+
+            std::sort(classes.begin(), classes.end());
+            classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+        }
+
+        // 2. Add the classes of the samples that are not negatives
+
+        label_classes(context.targets, labels);
+
+        for (size_t i = 0; i < n; ++i) {
+            const size_t t = context.targets[i];
+
+            auto it = std::lower_bound(classes.begin(), classes.begin() + negative_samples, t);
+
+            if (it == classes.begin() + negative_samples || *it != t) {
+                it = std::find(classes.begin() + negative_samples, classes.end(), t);
+
+                if (it == classes.end()) {
+                    classes.push_back(t);
+                    it = classes.end() - 1;
+                }
+            }
+
+            context.targets[i] = it - classes.begin();
+        }
+
+        const size_t candidates = classes.size();
+
+        // 3. Compute the logits of the candidates
+
+        std::vector<weight> correction(candidates);
+
+        for (size_t j = 0; j < candidates; ++j) {
+            context.w_candidates(j) = w(classes[j]);
+
+            // The logarithm of the expected count of the class in the samples
+            const double p = sampler_t::probability(classes[j], num_classes);
+            correction[j]  = b(classes[j]) - std::log(-std::expm1(tries * std::log1p(-p)));
+        }
+
+        context.errors = context.input * etl::transpose(context.w_candidates);
+
+        context.errors.ensure_cpu_up_to_date();
+
+        // 4. Softmax, errors and metrics, sample by sample
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t i = 0; i < etl::dim<0>(context.errors); ++i) {
+            weight* z = context.errors.memory_start() + i * C::candidates;
+
+            if (i >= n) {
+                std::fill(z, z + C::candidates, weight(0));
+                continue;
+            }
+
+            const size_t t = context.targets[i];
+
+            // The classes of the other samples are not negatives
+            auto active = [t](size_t j) { return j == t || j < negative_samples; };
+
+            weight z_max = -std::numeric_limits<weight>::infinity();
+            size_t best  = t;
+
+            for (size_t j = 0; j < candidates; ++j) {
+                if (active(j)) {
+                    z[j] += correction[j];
+
+                    if (z[j] > z_max) {
+                        z_max = z[j];
+                        best  = j;
+                    }
+                }
+            }
+
+            weight sum(0);
+
+            for (size_t j = 0; j < candidates; ++j) {
+                if (active(j)) {
+                    z[j] = std::exp(z[j] - z_max);
+                    sum += z[j];
+                }
+            }
+
+            loss -= std::log(std::max(z[t] / sum, std::numeric_limits<weight>::min()));
+            error += best != t;
+
+            for (size_t j = 0; j < C::candidates; ++j) {
+                if (j < candidates && active(j)) {
+                    z[j] = (j == t ? weight(1) : weight(0)) - z[j] / sum;
+                } else {
+                    z[j] = weight(0);
+                }
+            }
+        }
+
+        context.errors.invalidate_gpu();
+
+        return {error, loss};
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DLayer>
+    static void dyn_init(DLayer& dyn){
+        cpp_unused(dyn);
+
+        // There is no dynamic version
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * The errors of the sampled softmax are already the errors of its
+     * logits.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the candidates to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        static dll::timer_id timer_handle("sampled_softmax:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        // The reshape has no overhead, so better than SFINAE for nothing
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+        etl::reshape<Batch, num_visible>(output) = context.errors * context.w_candidates;
+    }
+
+    /*!
+     * \brief Compute the gradients of the candidates of the batch.
+     *
+     * Only the rows of the weights of the candidates are non-zero.
+     *
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        static dll::timer_id timer_handle("sampled_softmax:compute_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+        auto& b_grad = std::get<1>(context.up.context)->grad;
+
+        // Only the rows touched by the previous batch need to be cleared
+
+        if (context.stale_grad) {
+            w_grad = weight(0);
+        } else {
+            for (auto row : context.rows) {
+                w_grad(row) = weight(0);
+            }
+        }
+
+        b_grad = weight(0);
+
+        context.w_candidates_grad = etl::transpose(context.errors) * context.input;
+
+        for (size_t j = 0; j < context.classes.size(); ++j) {
+            w_grad(context.classes[j]) = context.w_candidates_grad(j);
+        }
+
+        for (size_t i = 0; i < etl::dim<0>(context.errors); ++i) {
+            for (size_t j = 0; j < context.classes.size(); ++j) {
+                b_grad(context.classes[j]) += context.errors(i, j);
+            }
+        }
+
+        context.rows = context.classes;
+
+        std::sort(context.rows.begin(), context.rows.end());
+
+        context.stale_grad = false;
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t sampled_softmax_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t sampled_softmax_layer_impl<Desc>::num_classes;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<sampled_softmax_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for sampled_softmax_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, sampled_softmax_layer_impl<Desc>, L> {
+    using layer_t = sampled_softmax_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_classes = layer_t::num_classes;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    static constexpr size_t candidates = layer_t::negative_samples + batch_size; ///< The maximum number of candidates of a batch
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;
+    etl::fast_matrix<weight, batch_size, num_classes> output;
+    etl::fast_matrix<weight, batch_size, candidates> errors; ///< The errors of the logits of the candidates
+
+    etl::fast_matrix<weight, candidates, num_visible> w_candidates;      ///< The weights of the candidates
+    etl::fast_matrix<weight, candidates, num_visible> w_candidates_grad; ///< The gradients of the weights of the candidates
+
+    std::vector<size_t> classes; ///< The classes of the candidates, the negatives first
+    std::vector<size_t> targets; ///< The candidate of the class of each sample
+
+    std::vector<size_t> rows; ///< The rows of the gradients touched by the current batch
+    bool stale_grad = true;   ///< Indicates if the gradients may be non-zero outside of rows
+
+    random_engine engine; ///< The random engine of the negative samples
+
+    sgd_context(const layer_t& /* layer */)
+            : output(0.0), errors(0.0), w_candidates(0.0), engine(dll::rand_engine()()) {}
+};
+
+} //end of dll namespace
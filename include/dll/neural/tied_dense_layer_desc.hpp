@@ -0,0 +1,58 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Descriptor for a tied dense layer.
+ *
+ * A tied dense layer uses the transposed weights of the dense layer L of
+ * the network, which must precede it. It only has its own biases. Its
+ * dimensions are the transposed dimensions of the layer L.
+ *
+ * \tparam L The index of the dense layer whose weights are used
+ */
+template <size_t L, typename... Parameters>
+struct tied_dense_layer_desc {
+    static constexpr size_t tied_layer = L; ///< The index of the layer whose weights are used
+
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The tied dense type */
+    using layer_t = tied_dense_layer_impl<tied_dense_layer_desc<L, Parameters...>>;
+
+    /*! The tied dense type (always dynamic) */
+    using dyn_layer_t = layer_t;
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_bias_id>, Parameters...>,
+        "Invalid parameters type for tied_dense_layer_desc");
+};
+
+/*!
+ * \brief Describe a tied dense layer
+ */
+template <size_t L, typename... Parameters>
+using tied_dense_layer = typename tied_dense_layer_desc<L, Parameters...>::layer_t;
+
+} //end of dll namespace
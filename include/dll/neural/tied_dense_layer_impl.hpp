@@ -0,0 +1,396 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <functional>
+
+#include "dll/base_traits.hpp" // The traits
+#include "dll/layer.hpp"       // The base class
+#include "dll/util/timers.hpp" // For auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Dense layer using the transposed weights of a previous dense layer
+ * of the network (tied weights).
+ *
+ * The layer is tied by the network at construction. The weights are not
+ * copied: the products use the weights of the tied layer in place, with a
+ * transposition in the BLAS calls. Only the biases are trained by this
+ * layer, the gradients of the weights are added to the gradients of the
+ * tied layer by the trainer.
+ */
+template <typename Desc>
+struct tied_dense_layer_impl final : layer<tied_dense_layer_impl<Desc>> {
+    using desc        = Desc;                           ///< The descriptor of the layer
+    using weight      = typename desc::weight;          ///< The data type for this layer
+    using this_type   = tied_dense_layer_impl<desc>;    ///< The type of this layer
+    using base_type   = layer<this_type>;               ///< The type of the base type
+    using layer_t     = this_type;                      ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;     ///< The dynamic type of this layer
+
+    static constexpr size_t tied_layer        = desc::tied_layer;          ///< The index of the layer whose weights are used
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::dyn_matrix<weight, 1>; ///< The type of one input
+    using output_one_t = etl::dyn_matrix<weight, 1>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;   ///< The type of the input
+    using output_t     = std::vector<output_one_t>;  ///< The type of the output
+
+    using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
+
+    b_type b; ///< Biases
+
+    std::unique_ptr<b_type> bak_b; ///< Backup biases
+
+    size_t num_visible = 0; ///< The number of visible units
+    size_t num_hidden  = 0; ///< The number of hidden units
+
+    std::function<weight*()> tied_w; ///< Returns the memory of the weights of the tied layer
+
+    tied_dense_layer_impl() : base_type() {}
+
+    /*!
+     * \brief Tie the layer to the given dense layer
+     */
+    template <typename Layer>
+    void tie(Layer& layer) {
+        static_assert(decay_layer_traits<Layer>::is_dense_layer(), "Only dense layers can be tied");
+
+        num_visible = layer.output_size();
+        num_hidden  = layer.input_size();
+
+        b = b_type(num_hidden);
+
+        b_initializer::initialize(b, input_size(), output_size());
+
+        tied_w = [&layer]() {
+            layer.w.ensure_cpu_up_to_date();
+            return layer.w.memory_start();
+        };
+    }
+
+    /*!
+     * \brief Returns the weights of the tied layer, not transposed
+     * (num_hidden x num_visible)
+     */
+    etl::custom_dyn_matrix<weight, 2> weights() const {
+        cpp_assert(tied_w, "The layer must be tied first");
+
+        return etl::custom_dyn_matrix<weight, 2>(tied_w(), num_hidden, num_visible);
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    size_t input_size() const noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    size_t output_size() const noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     */
+    size_t parameters() const noexcept {
+        // Only the biases, the weights are the ones of the tied layer
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_short_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "Tied Dense";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "Tied Dense (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a full description of the layer
+     * \return an std::string containing a full description of the layer
+     */
+    std::string to_full_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if constexpr (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Tied Dense(%lu): %lu -> %lu", tied_layer, num_visible, num_hidden);
+        } else {
+            snprintf(buffer, 512, "Tied Dense(%lu): %lu -> %s -> %lu", tied_layer, num_visible, to_string(activation_function).c_str(), num_hidden);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_hidden};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        static dll::timer_id timer_handle("tied_dense:forward");
+        dll::auto_timer timer(timer_handle);
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        output = etl::reshape(input, Batch, num_visible) * etl::transpose(weights());
+
+        // Bias and activation in a single pass over the output
+        f_bias_activate_2d<F, true>(output, b);
+    }
+
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Compute the test presentation for a batch of inputs.
+     *
+     * \param output The output batch to fill
+     * \param input The input batch to compute the representation from
+     * \tparam F The activation function, which can differ from the one of
+     * the layer when it is fused with a following activation layer
+     */
+    template <function F = activation_function, typename Input, typename Output>
+    void test_forward_batch(Output&& output, const Input& input) const {
+        forward_batch<F>(output, input);
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(num_hidden);
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(num_hidden);
+        }
+        return output;
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change, the dimensions are set when the layer is tied
+    }
+
+    /*!
+     * \brief Backup the biases in the secondary biases matrix
+     */
+    void backup_weights() {
+        unique_safe_get(bak_b) = b;
+    }
+
+    /*!
+     * \brief Restore the biases from the secondary biases matrix
+     */
+    void restore_weights() {
+        b = *bak_b;
+    }
+
+    /*!
+     * \brief Release the secondary biases matrix
+     */
+    void release_backup() {
+        bak_b.reset();
+    }
+
+    /*!
+     * \brief Store the biases into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the biases from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, b);
+    }
+
+    /*!
+     * \brief Store the biases into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the biases from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters(){
+        return std::make_tuple(std::ref(b));
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() const {
+        return std::make_tuple(std::cref(b));
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        static dll::timer_id timer_handle("tied_dense:errors");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        static dll::timer_id timer_handle("tied_dense:backward");
+        dll::auto_timer timer(timer_handle);
+
+        // The reshape has no overhead, so better than SFINAE for nothing
+        auto batch_size = etl::dim<0>(output);
+        etl::reshape(output, batch_size, num_visible) = context.errors * weights();
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        static dll::timer_id timer_handle("tied_dense:gradients");
+        dll::auto_timer timer(timer_handle);
+
+        std::get<0>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+    }
+
+    /*!
+     * \brief Add the gradients of the weights to the gradients of the tied
+     * layer, once they have been computed.
+     *
+     * \param context The training context of this layer
+     * \param tied_context The training context of the tied layer
+     */
+    template<typename C, typename TC>
+    void tie_gradients(C& context, TC& tied_context) const {
+        static dll::timer_id timer_handle("tied_dense:tie_gradients");
+        dll::auto_timer timer(timer_handle);
+
+        std::get<0>(tied_context.up.context)->grad += batch_outer(context.errors, context.input);
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<tied_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = true;  ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for tied_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, tied_dense_layer_impl<Desc>, L> {
+    using layer_t = tied_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 2> input;
+    etl::dyn_matrix<weight, 2> output;
+    etl::dyn_matrix<weight, 2> errors;
+
+    sgd_context(const layer_t& layer) : input(batch_size, layer.num_visible, 0.0), output(batch_size, layer.num_hidden, 0.0), errors(batch_size, layer.num_hidden, 0.0) {}
+};
+
+} //end of dll namespace
@@ -60,6 +60,14 @@ struct neural_layer : layer<Derived> {
         as_derived().b = *as_derived().bak_b;
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        as_derived().bak_w.reset();
+        as_derived().bak_b.reset();
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
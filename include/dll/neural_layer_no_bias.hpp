@@ -58,6 +58,13 @@ struct neural_layer_no_bias : layer<Derived> {
         as_derived().w = *as_derived().bak_w;
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        as_derived().bak_w.reset();
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
@@ -0,0 +1,21 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief Define how the noise of the generators corrupts the inputs
+ */
+enum class noise_type {
+    MASKING,    ///< N percent of the inputs are set to zero
+    GAUSSIAN,   ///< Gaussian noise of standard deviation N / 100 is added to the inputs
+    SALT_PEPPER ///< N percent of the inputs are set to zero or to one
+};
+
+} //end of dll namespace
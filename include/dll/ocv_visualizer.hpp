@@ -13,6 +13,13 @@
 #include "dbn_traits.hpp"
 
 #ifndef DLL_DETAIL_ONLY
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include <opencv2/opencv.hpp>
 #endif
 
@@ -126,6 +133,175 @@ constexpr inline size_t best_width(const size_t total) {
 
 #ifndef DLL_DETAIL_ONLY
 
+/*!
+ * \brief The renderer of the windows of the OpenCV visualizers.
+ *
+ * The windows are shown by a thread of the renderer, at a capped frame
+ * rate. Showing an image only copies it into the next frame of its window:
+ * the training is never blocked by the rendering and the images submitted
+ * faster than the frame rate are dropped, only the last one being shown.
+ */
+struct ocv_renderer {
+    size_t max_fps = 15; ///< The maximum number of frames per second
+
+    /*!
+     * \brief Returns the renderer of the process
+     */
+    static ocv_renderer& instance() {
+        static ocv_renderer renderer;
+        return renderer;
+    }
+
+    ocv_renderer(const ocv_renderer&) = delete;
+    ocv_renderer& operator=(const ocv_renderer&) = delete;
+
+    ~ocv_renderer() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        ready.notify_all();
+
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Show the given image in the given window, at the next frame
+     * \param window The name of the window
+     * \param image The image to show, copied
+     */
+    void show(const std::string& window, const cv::Mat& image) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            auto& frame = frames[window];
+
+            image.copyTo(frame.image);
+            frame.dirty = true;
+
+            start();
+        }
+
+        ready.notify_all();
+    }
+
+    /*!
+     * \brief Show the pending frames and wait for a key to be pressed in
+     * one of the windows
+     */
+    void wait_key() {
+        std::unique_lock<std::mutex> l(lock);
+
+        start();
+
+        key_requested = true;
+        ready.notify_all();
+
+        ready.wait(l, [this] { return !key_requested; });
+    }
+
+private:
+    ocv_renderer() = default;
+
+    /*!
+     * \brief The next frame of a window
+     */
+    struct frame_t {
+        cv::Mat image;      ///< The image to show
+        bool dirty = false; ///< Indicates if the image has not been shown yet
+        bool shown = false; ///< Indicates if the window has been created
+    };
+
+    /*!
+     * \brief Start the thread of the renderer, if necessary (the lock must
+     * be held)
+     */
+    void start() {
+        if (!thread.joinable()) {
+            thread = std::thread([this] { run(); });
+        }
+    }
+
+    /*!
+     * \brief The loop of the thread of the renderer
+     */
+    void run() {
+        std::vector<std::pair<std::string, cv::Mat>> pending;
+
+        while (true) {
+            bool key = false;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                ready.wait(l, [this] { return stop || key_requested || any_dirty(); });
+
+                if (stop) {
+                    return;
+                }
+
+                pending.clear();
+
+                for (auto& [window, frame] : frames) {
+                    if (frame.dirty) {
+                        if (!frame.shown) {
+                            cv::namedWindow(window, cv::WINDOW_NORMAL);
+                            frame.shown = true;
+                        }
+
+                        pending.emplace_back(window, frame.image.clone());
+                        frame.dirty = false;
+                    }
+                }
+
+                key = key_requested;
+            }
+
+            for (auto& [window, image] : pending) {
+                cv::imshow(window, image);
+            }
+
+            if (key) {
+                cv::waitKey(0);
+
+                {
+                    std::lock_guard<std::mutex> l(lock);
+                    key_requested = false;
+                }
+
+                ready.notify_all();
+            } else {
+                // Process the events of the windows and cap the frame rate
+                cv::waitKey(std::max<int>(1, 1000 / std::max<size_t>(1, max_fps)));
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if a frame has not been shown yet (the lock must be
+     * held)
+     */
+    bool any_dirty() const {
+        for (auto& [window, frame] : frames) {
+            if (frame.dirty) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::mutex lock;                        ///< The lock of the frames
+    std::condition_variable ready;          ///< The condition for the thread of the renderer
+    std::map<std::string, frame_t> frames;  ///< The next frame of each window
+    bool key_requested = false;             ///< Indicates if a key is awaited
+    bool stop          = false;             ///< Indicates if the renderer must stop
+    std::thread thread;                     ///< The thread of the renderer
+};
+
 /*!
  * \brief The base type for an OpenCV visualizer
  */
@@ -176,8 +352,6 @@ struct base_ocv_rbm_visualizer {
             std::cout << "   sparsity_target(Local)=" << rbm.sparsity_target << std::endl;
         }
 
-        cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
-
         refresh();
     }
 
@@ -189,7 +363,7 @@ struct base_ocv_rbm_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window..." << std::endl;
-        cv::waitKey(0);
+        ocv_renderer::instance().wait_key();
 
         cpp_unused(rbm);
     }
@@ -209,11 +383,10 @@ struct base_ocv_rbm_visualizer {
     }
 
     /*!
-     * \brief Refresh the view
+     * \brief Refresh the view, the image being shown by the renderer
      */
     void refresh() {
-        cv::imshow("RBM Training", buffer_image);
-        cv::waitKey(30);
+        ocv_renderer::instance().show("RBM Training", buffer_image);
     }
 };
 
@@ -255,6 +428,15 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                   filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
 
     void draw_weights(const RBM& rbm) {
+        // The scale is the same for all the filters
+        typename RBM::weight min = 0;
+        typename RBM::weight max = 0;
+
+        if (scale) {
+            min = etl::min(rbm.w);
+            max = etl::max(rbm.w);
+        }
+
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -263,14 +445,6 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
-
                 for (size_t i = 0; i < filter_shape.width; ++i) {
                     for (size_t j = 0; j < filter_shape.height; ++j) {
                         auto real_v = i * filter_shape.height + j;
@@ -423,8 +597,6 @@ struct opencv_dbn_visualizer {
         cpp_unused(dbn);
 
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
-
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
     }
 
     /*!
@@ -524,6 +696,15 @@ struct opencv_dbn_visualizer {
                     "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
                     cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
+        // The scale is the same for all the filters
+        typename RBM::weight min = 0;
+        typename RBM::weight max = 0;
+
+        if (scale) {
+            min = etl::min(rbm.w);
+            max = etl::max(rbm.w);
+        }
+
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -532,14 +713,6 @@ struct opencv_dbn_visualizer {
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
-
                 for (size_t i = 0; i < filter_shape.width; ++i) {
                     for (size_t j = 0; j < filter_shape.height; ++j) {
                         auto real_v = i * filter_shape.height + j;
@@ -588,7 +761,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        ocv_renderer::instance().wait_key();
     }
 
     /*!
@@ -647,17 +820,16 @@ struct opencv_dbn_visualizer {
         std::cout << "Total training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window" << std::endl;
-        cv::waitKey(0);
+        ocv_renderer::instance().wait_key();
     }
 
     //Utility functions
 
     /*!
-     * \brief Refresh the view
+     * \brief Refresh the view, the image being shown by the renderer
      */
     void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        ocv_renderer::instance().show("DBN Training", buffer_images[current_image]);
     }
 };
 
@@ -692,8 +864,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
-
         cpp_unused(dbn);
     }
 
@@ -778,6 +948,15 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
                     "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
                     cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
+        // The scale is the same for all the filters
+        typename RBM::weight min = 0;
+        typename RBM::weight max = 0;
+
+        if (scale) {
+            min = etl::min(rbm.w);
+            max = etl::max(rbm.w);
+        }
+
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -786,14 +965,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
-
                 for (size_t i = 0; i < filter_shape.width; ++i) {
                     for (size_t j = 0; j < filter_shape.height; ++j) {
                         auto real_v = i * filter_shape.height + j;
@@ -842,7 +1013,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        ocv_renderer::instance().wait_key();
     }
 
     /*!
@@ -864,11 +1035,10 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     //Utility functions
 
     /*!
-     * \brief Refresh the view
+     * \brief Refresh the view, the image being shown by the renderer
      */
     void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        ocv_renderer::instance().show("DBN Training", buffer_images[current_image]);
     }
 };
 
@@ -903,8 +1073,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "CDBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("CDBN Training", cv::WINDOW_NORMAL);
-
         cpp_unused(dbn);
     }
 
@@ -1052,7 +1220,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        ocv_renderer::instance().wait_key();
     }
 
     /*!
@@ -1065,8 +1233,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     //Utility functions
 
     void refresh() {
-        cv::imshow("CDBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        ocv_renderer::instance().show("CDBN Training", buffer_images[current_image]);
     }
 };
 
@@ -1078,12 +1245,11 @@ size_t opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
 
 template <typename RBM>
 void visualize_rbm(const RBM& rbm) {
-    cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
-
     opencv_rbm_visualizer<RBM> visualizer;
     visualizer.draw_weights(rbm);
     visualizer.refresh();
-    cv::waitKey(0);
+
+    ocv_renderer::instance().wait_key();
 }
 
 #endif
@@ -0,0 +1,314 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file parallel_tempering.hpp
+ * \brief Parallel Tempering trainer for RBM
+ *
+ * The negative phase is estimated from M persistent chains, each sampling
+ * the model at a different inverse temperature, from 1 (the model itself)
+ * down to 1/M. The hot chains mix quickly and their states are carried
+ * down to the model chain by swap moves between neighbouring
+ * temperatures, accepted with the Metropolis rule on the energy of the
+ * joint configurations.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "contrastive_divergence.hpp"
+#include "util/random.hpp"
+#include "util/trace.hpp"
+#include "util/scheduler.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Parallel Tempering trainer for fully-connected RBM with binary
+ * units.
+ *
+ * The Gibbs step of each temperature is run concurrently on the shared
+ * scheduler. The swap moves are then attempted between the
+ * pairs of neighbouring temperatures, alternatively the even and the odd
+ * pairs, for all the particles at once.
+ *
+ * \tparam M The number of temperatures
+ */
+template <size_t M, typename RBM>
+struct parallel_tempering_trainer : base_cd_trainer<1, RBM, true> {
+    static_assert(M > 1, "Parallel Tempering needs at least two temperatures");
+    static_assert(!layer_traits<RBM>::is_dynamic() && layer_traits<RBM>::is_dense_rbm_layer(), "Parallel Tempering only supports static fully-connected RBM");
+    static_assert(rbm_layer_traits<RBM>::shards() == 1, "Parallel Tempering is not supported with data_parallel");
+
+    using base_type = base_cd_trainer<1, RBM, true>; ///< The base trainer type
+    using rbm_t     = RBM;                           ///< The type of RBM being trained
+    using weight    = typename rbm_t::weight;        ///< The data type for this layer
+
+    static_assert(rbm_t::desc::visible_unit == unit_type::BINARY && rbm_t::desc::hidden_unit == unit_type::BINARY,
+                  "Parallel Tempering only supports binary units");
+
+    static constexpr auto num_hidden  = rbm_t::num_hidden;  ///< The number of hidden units
+    static constexpr auto num_visible = rbm_t::num_visible; ///< The number of visible units
+    static constexpr auto batch_size  = rbm_t::batch_size;  ///< The batch size of the RBM
+
+    /*!
+     * \brief The persistent particles of one temperature
+     */
+    struct chain {
+        etl::fast_matrix<weight, batch_size, num_visible> v_a; ///< The visible activation probabilities
+        etl::fast_matrix<weight, batch_size, num_visible> v_s; ///< The visible states
+        etl::fast_matrix<weight, batch_size, num_hidden> h_a;  ///< The hidden activation probabilities
+        etl::fast_matrix<weight, batch_size, num_hidden> h_s;  ///< The hidden states
+        etl::fast_vector<weight, batch_size> energy;           ///< The energy of each joint configuration
+    };
+
+    std::array<weight, M> betas; ///< The inverse temperature of each chain, betas[0] = 1 being the model
+
+    size_t swaps_proposed = 0; ///< The number of proposed swaps
+    size_t swaps_accepted = 0; ///< The number of accepted swaps
+
+    /*!
+     * \brief Construct a new trainer for the given RBM.
+     *
+     * The inverse temperatures are evenly spaced from 1 down to 1/M.
+     */
+    parallel_tempering_trainer(rbm_t& rbm)
+            : base_type(rbm), chains(M) {
+        for (size_t m = 0; m < M; ++m) {
+            betas[m] = weight(1) - weight(m) / weight(M);
+        }
+    }
+
+    /*!
+     * \brief Returns the rate of accepted swaps since the beginning of the
+     * training.
+     */
+    double swap_rate() const {
+        return swaps_proposed ? double(swaps_accepted) / double(swaps_proposed) : 0.0;
+    }
+
+    /*!
+     * \brief Train the RBM with one batch of data
+     */
+    template <typename InputBatch, typename ExpectedBatch>
+    void train_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context) {
+        static dll::timer_id timer_handle("pt:train:normal");
+        dll::auto_timer timer(timer_handle);
+
+        using namespace etl;
+
+        auto& t   = *this;
+        auto& rbm = t.rbm;
+
+        cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
+
+        const size_t IB = etl::dim<0>(input_batch);
+
+        //Copy input/expected for computations
+        if (cpp_likely(IB == batch_size)) {
+            t.v1 = input_batch;
+            t.vf = expected_batch;
+        } else {
+            t.v1 = 0;
+            t.vf = 0;
+
+            etl::slice(t.v1, 0, IB) = input_batch;
+            etl::slice(t.vf, 0, IB) = expected_batch;
+        }
+
+        //Positive phase
+        rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+
+        //The chains of all temperatures start from the first batch
+        if (t.init) {
+            for (auto& x : chains) {
+                x.v_a = t.v1;
+                x.v_s = t.v1;
+                x.h_a = t.h1_a;
+                x.h_s = t.h1_s;
+            }
+
+            t.init = false;
+        }
+
+        //Gibbs step at each temperature
+
+        {
+            static dll::timer_id timer_handle("pt:gibbs");
+            dll::auto_timer timer(timer_handle);
+
+            for (size_t m = 0; m < M; ++m) {
+                pool.do_task([this, m] {
+                    trace_scope scope("pool:task", "pool");
+
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        this->gibbs_step(m);
+                    }
+                });
+            }
+
+            pool.wait();
+        }
+
+        swap_chains();
+
+        //Negative phase, from the chain of the model
+        t.v2_a = chains[0].v_a;
+        rbm.template batch_activate_hidden<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+
+        //Compute the gradients
+
+        {
+            static dll::timer_id timer_handle("pt:batch_compute_gradients");
+            dll::auto_timer timer(timer_handle);
+
+            t.w_grad = batch_outer(t.vf, t.h1_a);
+            t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+
+            t.c_grad = t.vf(0) - t.v2_a(0);
+            for (size_t b = 1; b < batch_size; b++) {
+                t.c_grad += t.vf(b) - t.v2_a(b);
+            }
+
+            //The mean activations are reduced with the gradients of the hidden biases
+            hidden_statistics(t.h1_a, t.h2_a, t.b_grad, t.h_sum);
+        }
+
+        if (context.monitor) {
+            context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
+        }
+
+        nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+
+        //The mean activation probabilities, from the sums of the gradients pass
+        t.q_global_batch = sum(t.h_sum) / (batch_size * etl::size(t.h_sum));
+
+        if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
+            t.q_local_batch = t.h_sum / weight(batch_size);
+        }
+
+        context.batch_sparsity = t.q_global_batch;
+
+        //Update the weights and biases based on the gradients
+        t.update(rbm);
+    }
+
+    /*!
+     * \brief The name of the trainer
+     */
+    static std::string name() {
+        return "Parallel Tempering (" + std::to_string(M) + " temperatures)";
+    }
+
+private:
+    /*!
+     * \brief Run one Gibbs step on the chain of the given temperature and
+     * compute the energy of its new joint configurations.
+     */
+    void gibbs_step(size_t m) {
+        using namespace etl;
+
+        auto& rbm         = this->rbm;
+        auto& x           = chains[m];
+        const weight beta = betas[m];
+
+        x.h_a = etl::sigmoid(beta >> (rep_l(rbm.b, batch_size) + x.v_s * rbm.w));
+        x.h_s = bernoulli(x.h_a);
+
+        x.v_a = etl::sigmoid(beta >> (rep_l(rbm.c, batch_size) + transpose(rbm.w * transpose(x.h_s))));
+        x.v_s = bernoulli(x.v_a);
+
+        //E(v,h) = -sum(ci*vi) - sum(bj*hj) - sum(vi*hj*wij)
+        auto vw = etl::force_temporary(x.v_s * rbm.w);
+
+        for (size_t n = 0; n < batch_size; ++n) {
+            x.energy[n] = -(etl::dot(rbm.c, x.v_s(n)) + etl::dot(rbm.b, x.h_s(n)) + etl::dot(vw(n), x.h_s(n)));
+        }
+    }
+
+    /*!
+     * \brief Swap the given particle between two chains
+     */
+    static void swap_particle(chain& a, chain& b, size_t n) {
+        auto swap_row = [n](auto& x, auto& y) {
+            const size_t R = etl::size(x) / etl::dim<0>(x);
+            std::swap_ranges(x.memory_start() + n * R, x.memory_start() + (n + 1) * R, y.memory_start() + n * R);
+        };
+
+        swap_row(a.v_a, b.v_a);
+        swap_row(a.v_s, b.v_s);
+        swap_row(a.h_a, b.h_a);
+        swap_row(a.h_s, b.h_s);
+
+        std::swap(a.energy[n], b.energy[n]);
+    }
+
+    /*!
+     * \brief Attempt the swap moves between the neighbouring temperatures
+     */
+    void swap_chains() {
+        static dll::timer_id timer_handle("pt:swap");
+        dll::auto_timer timer(timer_handle);
+
+        for (auto& x : chains) {
+            x.v_a.ensure_cpu_up_to_date();
+            x.v_s.ensure_cpu_up_to_date();
+            x.h_a.ensure_cpu_up_to_date();
+            x.h_s.ensure_cpu_up_to_date();
+            x.energy.ensure_cpu_up_to_date();
+        }
+
+        auto& g = dll::rand_engine();
+        std::uniform_real_distribution<weight> dist(0.0, 1.0);
+
+        for (size_t m = parity; m + 1 < M; m += 2) {
+            auto& a = chains[m];
+            auto& b = chains[m + 1];
+
+            // The log of the acceptance ratio of each particle
+            log_r = (betas[m] - betas[m + 1]) >> (a.energy - b.energy);
+
+            for (size_t n = 0; n < batch_size; ++n) {
+                if (log_r[n] >= weight(0) || dist(g) < std::exp(log_r[n])) {
+                    swap_particle(a, b, n);
+                    ++swaps_accepted;
+                }
+            }
+
+            swaps_proposed += batch_size;
+        }
+
+        for (auto& x : chains) {
+            x.v_a.invalidate_gpu();
+            x.v_s.invalidate_gpu();
+            x.h_a.invalidate_gpu();
+            x.h_s.invalidate_gpu();
+            x.energy.invalidate_gpu();
+        }
+
+        parity = 1 - parity;
+    }
+
+    std::vector<chain> chains;                 ///< The chains, from the coldest to the hottest
+    etl::fast_vector<weight, batch_size> log_r; ///< The log acceptance ratio of the swaps
+    task_group pool;                           ///< The tasks running the Gibbs steps
+    size_t parity = 0;                         ///< Indicates if the even (0) or odd (1) pairs are swapped next
+};
+
+/*!
+ * \brief Parallel Tempering trainer with four temperatures for RBM
+ */
+template <typename RBM>
+using pt_trainer_t = parallel_tempering_trainer<4, RBM>;
+
+} //end of dll namespace
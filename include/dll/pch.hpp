@@ -0,0 +1,32 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file pch.hpp
+ * \brief The headers of DLL worth precompiling
+ *
+ * "make pch" precompiles this header, for each build mode, in
+ * <mode>/pch/dll/pch.hpp.gch. A translation unit compiled with the same
+ * flags can then use it with "-I<mode>/pch -include dll/pch.hpp". dllp
+ * uses it when the DLLP_PCH environment variable gives its directory.
+ */
+
+#pragma once
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/neural/activation_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/dyn_mp_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/rbm/dyn_rbm.hpp"
+#include "dll/rbm/conv_rbm.hpp"
+#include "dll/dbn.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
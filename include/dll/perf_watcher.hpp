@@ -0,0 +1,180 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <cstdlib>
+
+#include "dll/watcher.hpp"
+#include "dll/util/throughput.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the throughput of the epochs of the last fine-tuning
+ * watched by a perf_dbn_watcher
+ */
+inline std::vector<epoch_throughput>& perf_history() {
+    static std::vector<epoch_throughput> history;
+    return history;
+}
+
+/*!
+ * \brief A watcher reporting the throughput of the fine-tuning.
+ *
+ * For each epoch, the number of samples trained per second and the split
+ * of the time of the batches between the wait for the generator, the
+ * forward pass, the backward pass and the update are reported, with the
+ * change of throughput since the previous epoch. The report is written by
+ * a background thread, the training thread only pushes the records of the
+ * batches in a lock-free queue.
+ *
+ * If the DLL_PERF_CSV environment variable is set, the report is also
+ * written in the CSV file it names.
+ */
+template <typename DBN>
+struct perf_dbn_watcher : mute_dbn_watcher<DBN> {
+    throughput_reporter reporter; ///< The reporter of the throughput
+
+    perf_dbn_watcher() {
+        if (auto* file = std::getenv("DLL_PERF_CSV")) {
+            reporter.csv_file = file;
+        }
+    }
+
+    /*!
+     * \brief Fine-tuning of the given network just started
+     * \param dbn The DBN that is being trained
+     * \param max_epochs The maximum number of epochs to train the network
+     */
+    void fine_tuning_begin(const DBN& dbn, size_t max_epochs) {
+        std::cout << "\nTrain the network with \"" << DBN::desc::template trainer_t<DBN>::name() << "\"" << std::endl;
+        std::cout << "    Updater: " << dll::to_string(dbn_traits<DBN>::updater()) << std::endl;
+        std::cout << "       Loss: " << dll::to_string(DBN::loss) << std::endl;
+        std::cout << " Batch size: " << DBN::batch_size << std::endl;
+        std::cout << "     Epochs: " << max_epochs << std::endl << std::endl;
+
+        cpp_unused(dbn);
+
+        reporter.start();
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is starting
+     * \param epoch The current epoch
+     * \param dbn The network being trained
+     */
+    void ft_epoch_start(size_t epoch, const DBN& dbn) {
+        cpp_unused(epoch);
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Indicates the phases of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param phases The time of the phases of the batch
+     * \param samples The number of samples of the batch
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_phases(size_t epoch, const batch_phases& phases, size_t samples, const DBN& dbn) {
+        throughput_record record;
+
+        record.epoch   = epoch;
+        record.samples = samples;
+        record.phases  = phases;
+
+        reporter.push(record);
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is ended
+     * \param epoch The current epoch
+     * \param error The current epoch error
+     * \param loss The current epoch loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        throughput_record record;
+
+        record.end_of_epoch = true;
+        record.epoch        = epoch;
+        record.error        = error;
+        record.loss         = loss;
+
+        reporter.push(record);
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is ended
+     * \param epoch The current epoch
+     * \param train_error The current epoch training error
+     * \param train_loss The current epoch training loss
+     * \param val_error The current epoch validation error
+     * \param val_loss The current epoch validation loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        ft_epoch_end(epoch, train_error, train_loss, dbn);
+
+        cpp_unused(val_error);
+        cpp_unused(val_loss);
+    }
+
+    /*!
+     * \brief Indicates the end of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param batch The current batch
+     * \param batches THe total number of batches
+     * \param batch_error The batch error
+     * \param batch_loss The batch loss
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
+        cpp_unused(epoch);
+        cpp_unused(batch);
+        cpp_unused(batches);
+        cpp_unused(batch_error);
+        cpp_unused(batch_loss);
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Fine-tuning of the given network just finished
+     * \param dbn The DBN that is being trained
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        reporter.stop();
+
+        auto history = reporter.history();
+
+        epoch_throughput total;
+
+        for (auto& epoch : history) {
+            total.samples += epoch.samples;
+            total.phases.wait += epoch.phases.wait;
+            total.phases.compute += epoch.phases.compute;
+        }
+
+        std::cout << "Training: " << total.samples_per_second() << " samples/s, " << total.percent(total.phases.wait) << "% waiting for the generator";
+
+        if (reporter.dropped_records()) {
+            std::cout << " (" << reporter.dropped_records() << " records dropped)";
+        }
+
+        std::cout << std::endl;
+
+        perf_history() = std::move(history);
+
+        cpp_unused(dbn);
+    }
+};
+
+} //end of dll namespace
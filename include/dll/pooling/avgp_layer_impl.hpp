@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/nchwc.hpp"
+
 namespace dll {
 
 /*!
@@ -28,6 +31,8 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     avgp_2d_layer_impl() = default;
 
     /*!
@@ -71,6 +76,20 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
         output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
     }
 
+    /*!
+     * \brief Forward activation of the layer for one batch of sample in the
+     * NCHWc layout (see nchwc.hpp)
+     * \param output The blocked output
+     * \param input The blocked input
+     * \param B The number of samples
+     */
+    static void blocked_forward_batch(weight* output, const weight* input, size_t B) {
+        static dll::timer_id timer_handle("avgp:blocked_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        nchwc_pool<false>(output, input, B, base::I1, base::I2, base::I3, base::C1, base::C2);
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -180,6 +199,8 @@ struct avgp_3d_layer_impl final : pooling_3d_layer<avgp_3d_layer_impl<Desc>, Des
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     avgp_3d_layer_impl() = default;
 
     /*!
@@ -0,0 +1,236 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "etl/etl.hpp"
+
+#include "dll/layer.hpp"
+#include "dll/util/global_avg_pool.hpp"
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Dynamic global average pooling layer
+ *
+ * Each channel of the input is reduced to its mean value.
+ */
+template <typename Desc>
+struct dyn_global_avgp_layer_impl final : layer<dyn_global_avgp_layer_impl<Desc>> {
+    using desc        = Desc;                             ///< The layer descriptor
+    using weight      = typename desc::weight;            ///< The layer weight type
+    using this_type   = dyn_global_avgp_layer_impl<Desc>; ///< The type of this layer
+    using layer_t     = this_type;                        ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;       ///< The dynamic version of this layer
+
+    using input_one_t  = etl::dyn_matrix<weight, 3>;  ///< The type of one input
+    using output_one_t = etl::dyn_matrix<weight, 1>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;    ///< The type of the input
+    using output_t     = std::vector<output_one_t>;   ///< The type of the output
+
+    size_t i1; ///< The first dimension of the input (the number of channels)
+    size_t i2; ///< The second dimension of the input
+    size_t i3; ///< The third dimension of the input
+
+    dyn_global_avgp_layer_impl() = default;
+
+    /*!
+     * \brief Initialize the dynamic layer
+     */
+    void init_layer(size_t i1, size_t i2, size_t i3){
+        this->i1 = i1;
+        this->i2 = i2;
+        this->i3 = i3;
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    size_t input_size() const noexcept {
+        return i1 * i2 * i3;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    size_t output_size() const noexcept {
+        return i1;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    size_t parameters() const noexcept {
+        return 0;
+    }
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    std::string to_short_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        return "GAVGP";
+    }
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    std::string to_full_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "GAVGP: %lux%lux%lu -> %lu", i1, i2, i3, i1);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {i1};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(i1);
+        }
+        return output;
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(i1);
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input) const {
+        static dll::timer_id timer_handle("global_avgp:forward");
+        dll::auto_timer timer(timer_handle);
+
+        global_avg_pool_forward(output, input);
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers.
+     *
+     * The error of each channel is broadcast to its feature map, the input
+     * is not needed.
+     *
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        static dll::timer_id timer_handle("global_avgp:backward");
+        dll::auto_timer timer(timer_handle);
+
+        global_avg_pool_backward(output, context.errors);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        cpp_unused(context);
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<dyn_global_avgp_layer_impl<Desc>> {
+    static constexpr bool is_neural     = false; ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = true;  ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = true;  ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for dyn_global_avgp_layer_impl
+ *
+ * The backward pass only needs the errors, so the input is not stored.
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, dyn_global_avgp_layer_impl<Desc>, L> {
+    using layer_t = dyn_global_avgp_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 2> output; ///< A batch of output
+    etl::dyn_matrix<weight, 2> errors; ///< A batch of errors
+
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
+    sgd_context(const layer_t& layer)
+            : output(batch_size, layer.i1), errors(batch_size, layer.i1) {}
+};
+
+} //end of dll namespace
@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/max_pool.hpp"
+
 namespace dll {
 
 /*!
@@ -28,6 +31,8 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    using index_t = uint16_t; ///< The type of the offsets of the maxima
+
     dyn_mp_2d_layer_impl() = default;
 
     /*!
@@ -71,6 +76,32 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         output = etl::ml::max_pool_forward(input, base::c1, base::c2);
     }
 
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, during
+     * training.
+     *
+     * The position of the maximum of each window is recorded in the
+     * workspace for the backward pass (except with the GPU, see
+     * max_pool_argmax).
+     *
+     * \param output The output matrix
+     * \param input The input matrix
+     * \param workspace The workspace of the layer
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input, max_pool_workspace<index_t>& workspace) const {
+        static dll::timer_id timer_handle("mp:train:forward");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_forward(output, input, workspace, dims(etl::dim<0>(input)));
+        } else {
+            cpp_unused(workspace);
+
+            output = etl::ml::max_pool_forward(input, base::c1, base::c2);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -101,10 +132,14 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        size_t c1 = base::c1;
-        size_t c2 = base::c2;
-
-        output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, c2);
+        static dll::timer_id timer_handle("mp:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_backward(output, context.errors, context.workspace, dims(etl::dim<0>(context.errors)));
+        } else {
+            output = etl::ml::max_pool_backward(context.input, context.output, context.errors, base::c1, base::c2);
+        }
     }
 
     /*!
@@ -115,6 +150,15 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
     void compute_gradients(C& context) const {
         cpp_unused(context);
     }
+private:
+    /*!
+     * \brief Return the dimensions of the pooling for a batch of the given size
+     */
+    detail::max_pool_dims dims(size_t B) const {
+        cpp_assert(base::c1 * base::c2 <= 65536, "The pooling window is too large");
+
+        return {B, base::i1, base::i2, base::i3, 1, base::c1, base::c2};
+    }
 };
 
 // Declare the traits for the Layer
@@ -151,6 +195,10 @@ struct sgd_context<DBN, dyn_mp_2d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    max_pool_workspace<typename layer_t::index_t> workspace; ///< The positions of the maxima
+
+    static constexpr bool keep_input = !max_pool_argmax; ///< The input is only needed by the ETL backward pass
+
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
               output(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2),
@@ -174,6 +222,8 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    using index_t = uint16_t; ///< The type of the offsets of the maxima
+
     dyn_mp_3d_layer_impl() = default;
 
     /*!
@@ -235,6 +285,32 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
         output = etl::ml::max_pool_3d_forward(input, base::c1, base::c2, base::c3);
     }
 
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, during
+     * training.
+     *
+     * The position of the maximum of each window is recorded in the
+     * workspace for the backward pass (except with the GPU, see
+     * max_pool_argmax).
+     *
+     * \param output The output matrix
+     * \param input The input matrix
+     * \param workspace The workspace of the layer
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input, max_pool_workspace<index_t>& workspace) const {
+        static dll::timer_id timer_handle("mp:train:forward");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_forward(output, input, workspace, dims(etl::dim<0>(input)));
+        } else {
+            cpp_unused(workspace);
+
+            output = etl::ml::max_pool_3d_forward(input, base::c1, base::c2, base::c3);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -265,11 +341,14 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        size_t c1 = base::c1;
-        size_t c2 = base::c2;
-        size_t c3 = base::c3;
-
-        output = etl::ml::max_pool_3d_backward(context.input, context.output, context.errors, c1, c2, c3);
+        static dll::timer_id timer_handle("mp:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_backward(output, context.errors, context.workspace, dims(etl::dim<0>(context.errors)));
+        } else {
+            output = etl::ml::max_pool_3d_backward(context.input, context.output, context.errors, base::c1, base::c2, base::c3);
+        }
     }
 
     /*!
@@ -280,6 +359,15 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
     void compute_gradients(C& context) const {
         cpp_unused(context);
     }
+private:
+    /*!
+     * \brief Return the dimensions of the pooling for a batch of the given size
+     */
+    detail::max_pool_dims dims(size_t B) const {
+        cpp_assert(base::c1 * base::c2 * base::c3 <= 65536, "The pooling window is too large");
+
+        return {B, base::i1, base::i2, base::i3, base::c1, base::c2, base::c3};
+    }
 };
 
 // Declare the traits for the Layer
@@ -316,6 +404,10 @@ struct sgd_context<DBN, dyn_mp_3d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    max_pool_workspace<typename layer_t::index_t> workspace; ///< The positions of the maxima
+
+    static constexpr bool keep_input = !max_pool_argmax; ///< The input is only needed by the ETL backward pass
+
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
               output(batch_size, layer.i1 / layer.c1, layer.i2 / layer.c2, layer.i3 / layer.c3),
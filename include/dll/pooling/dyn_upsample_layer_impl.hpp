@@ -105,12 +105,15 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
         const size_t c2 = base::c2;
         const size_t c3 = base::c3;
 
+        // Each input is copied into a block of the output, its gradient is
+        // the sum of the errors of the block
+
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::max_pool_3d(context.errors, c1, c2, c3);
+            output = weight(c1 * c2 * c3) * etl::ml::avg_pool_3d_forward(context.errors, c1, c2, c3);
         } else {
             const size_t B = etl::dim<0>(output);
 
-            etl::reshape(output, B, base::i1, base::i2, base::i3) = etl::max_pool_3d(context.errors, c1, c2, c3);
+            etl::reshape(output, B, base::i1, base::i2, base::i3) = weight(c1 * c2 * c3) * etl::ml::avg_pool_3d_forward(context.errors, c1, c2, c3);
         }
     }
 
@@ -158,6 +161,8 @@ struct sgd_context<DBN, dyn_upsample_3d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
               output(batch_size, layer.i1 * layer.c1, layer.i2 * layer.c2, layer.i3 * layer.c3),
@@ -10,6 +10,8 @@
 #include "pooling_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/max_pool.hpp"
+#include "dll/util/nchwc.hpp"
 
 namespace dll {
 
@@ -30,6 +32,12 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    using index_t = max_pool_index_t<base::C1 * base::C2>; ///< The type of the offsets of the maxima
+
+    static_assert(base::C1 * base::C2 <= 65536, "The pooling window is too large");
+
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     mp_2d_layer_impl() = default;
 
     /*!
@@ -70,11 +78,52 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("mp:forward_batch");
+        static dll::timer_id timer_handle("mp:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
         output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
     }
 
+    /*!
+     * \brief Forward activation of the layer for one batch of sample in the
+     * NCHWc layout (see nchwc.hpp)
+     * \param output The blocked output
+     * \param input The blocked input
+     * \param B The number of samples
+     */
+    static void blocked_forward_batch(weight* output, const weight* input, size_t B) {
+        static dll::timer_id timer_handle("mp:blocked_forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        nchwc_pool<true>(output, input, B, base::I1, base::I2, base::I3, base::C1, base::C2);
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, during
+     * training.
+     *
+     * The position of the maximum of each window is recorded in the
+     * workspace for the backward pass (except with the GPU, see
+     * max_pool_argmax).
+     *
+     * \param output The output matrix
+     * \param input The input matrix
+     * \param workspace The workspace of the layer
+     */
+    template <typename Input, typename Output>
+    static void forward_batch(Output& output, const Input& input, max_pool_workspace<index_t>& workspace) {
+        static dll::timer_id timer_handle("mp:train:forward");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_forward(output, input, workspace, dims(etl::dim<0>(input)));
+        } else {
+            cpp_unused(workspace);
+
+            output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -105,12 +154,14 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("mp:backward_batch");
-
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-
-        output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        static dll::timer_id timer_handle("mp:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_backward(output, context.errors, context.workspace, dims(etl::dim<0>(context.errors)));
+        } else {
+            output = etl::ml::max_pool_backward<base::C1, base::C2>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
@@ -121,6 +172,14 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         cpp_unused(context);
     }
+
+private:
+    /*!
+     * \brief Return the dimensions of the pooling for a batch of the given size
+     */
+    static detail::max_pool_dims dims(size_t B) {
+        return {B, base::I1, base::I2, base::I3, 1, base::C1, base::C2};
+    }
 };
 
 // Declare the traits for the Layer
@@ -165,6 +224,10 @@ struct sgd_context<DBN, mp_2d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
     etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
 
+    max_pool_workspace<typename layer_t::index_t> workspace; ///< The positions of the maxima
+
+    static constexpr bool keep_input = !max_pool_argmax; ///< The input is only needed by the ETL backward pass
+
     sgd_context(const mp_2d_layer_impl<Desc>& /*layer*/){}
 };
 
@@ -185,6 +248,12 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    using index_t = max_pool_index_t<base::C1 * base::C2 * base::C3>; ///< The type of the offsets of the maxima
+
+    static_assert(base::C1 * base::C2 * base::C3 <= 65536, "The pooling window is too large");
+
+    static constexpr bool partial_batches = true; ///< Indicates if the layer can only compute the first samples of a batch
+
     mp_3d_layer_impl() = default;
 
     /*!
@@ -225,11 +294,38 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        dll::auto_timer timer("mp:forward_batch");
+        static dll::timer_id timer_handle("mp:forward_batch");
+        dll::auto_timer timer(timer_handle);
 
         output = etl::ml::max_pool_3d_forward<base::C1, base::C2, base::C3>(input);
     }
 
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, during
+     * training.
+     *
+     * The position of the maximum of each window is recorded in the
+     * workspace for the backward pass (except with the GPU, see
+     * max_pool_argmax).
+     *
+     * \param output The output matrix
+     * \param input The input matrix
+     * \param workspace The workspace of the layer
+     */
+    template <typename Input, typename Output>
+    static void forward_batch(Output& output, const Input& input, max_pool_workspace<index_t>& workspace) {
+        static dll::timer_id timer_handle("mp:train:forward");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_forward(output, input, workspace, dims(etl::dim<0>(input)));
+        } else {
+            cpp_unused(workspace);
+
+            output = etl::ml::max_pool_3d_forward<base::C1, base::C2, base::C3>(input);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -260,13 +356,14 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        dll::auto_timer timer("mp:backward_batch");
-
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling third dimension
-
-        output = etl::ml::max_pool_3d_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        static dll::timer_id timer_handle("mp:backward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (max_pool_argmax) {
+            max_pool_backward(output, context.errors, context.workspace, dims(etl::dim<0>(context.errors)));
+        } else {
+            output = etl::ml::max_pool_3d_backward<base::C1, base::C2, base::C3>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
@@ -277,6 +374,14 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         cpp_unused(context);
     }
+
+private:
+    /*!
+     * \brief Return the dimensions of the pooling for a batch of the given size
+     */
+    static detail::max_pool_dims dims(size_t B) {
+        return {B, base::I1, base::I2, base::I3, base::C1, base::C2, base::C3};
+    }
 };
 
 // Declare the traits for the Layer
@@ -321,6 +426,10 @@ struct sgd_context<DBN, mp_3d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
     etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
 
+    max_pool_workspace<typename layer_t::index_t> workspace; ///< The positions of the maxima
+
+    static constexpr bool keep_input = !max_pool_argmax; ///< The input is only needed by the ETL backward pass
+
     sgd_context(const mp_3d_layer_impl<Desc>& /*layer*/){}
 };
 
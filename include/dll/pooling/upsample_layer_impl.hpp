@@ -10,6 +10,8 @@
 #include "dll/base_traits.hpp"
 #include "unpooling_layer.hpp"
 
+#include "dll/util/fusion.hpp" // For is_subpixel_fused
+
 namespace dll {
 
 /*!
@@ -103,16 +105,29 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
+        // Each input is copied into a block of the output, its gradient is
+        // the sum of the errors of the block
+
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
         static constexpr size_t C3 = base::C3; ///< The pooling third dimension
 
+        constexpr bool subpixel = sgd_subpixel_v<C>; ///< The following convolution already backpropagated the errors through the upsampling
+
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::max_pool_3d<C1, C2, C3>(context.errors);
+            if constexpr (subpixel) {
+                output = context.errors;
+            } else {
+                output = weight(C1 * C2 * C3) * etl::ml::avg_pool_3d_forward<C1, C2, C3>(context.errors);
+            }
         } else {
             constexpr auto B = etl::decay_traits<H>::template dim<0>();
 
-            etl::reshape<B, base::I1, base::I2, base::I3>(output) = etl::max_pool_3d<C1, C2, C3>(context.errors);
+            if constexpr (subpixel) {
+                etl::reshape<B, base::I1, base::I2, base::I3>(output) = context.errors;
+            } else {
+                etl::reshape<B, base::I1, base::I2, base::I3>(output) = weight(C1 * C2 * C3) * etl::ml::avg_pool_3d_forward<C1, C2, C3>(context.errors);
+            }
         }
     }
 
@@ -164,9 +179,19 @@ struct sgd_context<DBN, upsample_3d_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
+    /*!
+     * \brief Indicates if the layer is fused with the same convolution
+     * following it, in which case the errors are the errors of the input
+     */
+    static constexpr bool subpixel = std::is_same_v<typename DBN::template layer_type<L>, layer_t> && is_subpixel_fused<DBN, L>;
+
+    using errors_t = std::conditional_t<subpixel, etl::fast_matrix<weight, batch_size, I1, I2, I3>, etl::fast_matrix<weight, batch_size, O1, O2, O3>>;
+
     etl::fast_matrix<weight, batch_size, I1, I2, I3> input;
     etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
-    etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
+    errors_t errors; ///< The errors of the output (of the input when fused)
+
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
 
     sgd_context(const layer_t& /*layer*/) {}
 };
@@ -0,0 +1,231 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+/*!
+ * \file interpreter.hpp
+ * \brief Networks built at runtime by the dllp interpreter.
+ *
+ * The type of a DLL network is known at compile-time, only the shapes of
+ * the dyn_ layers are set at runtime. The interpreter is therefore compiled
+ * once with the common dense networks: up to three dyn_dense layers, with
+ * the same activation for the hidden layers, trained by SGD with momentum,
+ * with one of batch_sizes. dllp only generates and compiles the networks
+ * that are not in this family.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/processor/processor.hpp"
+
+namespace dll {
+
+namespace processor {
+
+namespace interpreter {
+
+using batch_sizes = std::index_sequence<1, 10, 100>; ///< The batch sizes of the interpreted networks
+
+constexpr size_t max_layers = 3; ///< The maximum number of layers of the interpreted networks
+
+/*!
+ * \brief A dense layer of an interpreted network
+ */
+struct dense_spec {
+    size_t visible      = 0;                 ///< The number of inputs
+    size_t hidden       = 0;                 ///< The number of outputs
+    function activation = function::SIGMOID; ///< The activation function
+};
+
+/*!
+ * \brief The type of an interpreted network with the given batch size and
+ * activation functions (one per layer)
+ */
+template <size_t B, function... F>
+using dense_network_t = typename dll::dbn_desc<
+    dll::dbn_layers<typename dll::dyn_dense_layer_desc<dll::activation<F>>::layer_t...>,
+    dll::trainer<dll::sgd_trainer>,
+    dll::updater<dll::updater_type::MOMENTUM>,
+    dll::batch_size<B>,
+    dll::weight_decay<dll::decay_type::NONE>>::dbn_t;
+
+/*!
+ * \brief Parse the name of an activation function (sigmoid, tanh, relu or softmax)
+ */
+inline bool parse_function(std::string name, function& f) {
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) { return std::toupper(c); });
+
+    for (auto candidate : {function::SIGMOID, function::TANH, function::RELU, function::SOFTMAX}) {
+        if (name == to_string(candidate)) {
+            f = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * \brief Read the network description, as stored by dllp, from the given
+ * parameters
+ */
+inline bool read_network(const parameters& params, std::vector<dense_spec>& layers, size_t& batch) {
+    size_t n = 0;
+
+    if (!params.apply("network.layers", n) || !params.apply("network.batch", batch)) {
+        return false;
+    }
+
+    layers.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto key = "network.layer." + std::to_string(i);
+
+        std::string type;
+        std::string activation;
+
+        if (!params.apply(key + ".type", type) || type != "dense") {
+            return false;
+        }
+
+        params.apply(key + ".visible", layers[i].visible);
+        params.apply(key + ".hidden", layers[i].hidden);
+        params.apply(key + ".activation", activation);
+
+        if (!parse_function(activation, layers[i].activation)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <size_t... B>
+bool supported_batch(size_t batch, std::index_sequence<B...> /*sizes*/) {
+    return ((batch == B) || ...);
+}
+
+inline bool hidden_function(function f) {
+    return f == function::SIGMOID || f == function::TANH || f == function::RELU;
+}
+
+inline bool output_function(function f) {
+    return f == function::SIGMOID || f == function::SOFTMAX;
+}
+
+/*!
+ * \brief Indicates if the given network is part of the interpreted networks
+ */
+inline bool supported(const std::vector<dense_spec>& layers, size_t batch) {
+    if (layers.empty() || layers.size() > max_layers || !supported_batch(batch, batch_sizes())) {
+        return false;
+    }
+
+    for (size_t i = 0; i + 1 < layers.size(); ++i) {
+        if (!hidden_function(layers[i].activation) || layers[i].activation != layers.front().activation) {
+            return false;
+        }
+    }
+
+    return output_function(layers.back().activation);
+}
+
+/*!
+ * \brief Build the given network and execute the task of the parameters with it
+ */
+template <typename DBN, size_t... I>
+void run(const parameters& params, const std::vector<dense_spec>& layers, std::index_sequence<I...> /*indices*/) {
+    auto dbn = std::make_unique<DBN>();
+
+    (dbn->template layer_get<I>().init_layer(layers[I].visible, layers[I].hidden), ...);
+
+    params.apply("learning_rate", dbn->learning_rate);
+    params.apply("momentum", dbn->initial_momentum);
+    params.apply("momentum", dbn->final_momentum);
+
+    task t;
+    std::vector<std::string> actions;
+
+    load_task(params, t, actions);
+
+    execute<etl::dyn_vector<float>, false>(*dbn, t, actions);
+}
+
+template <size_t B, function... F>
+void run_network(const parameters& params, const std::vector<dense_spec>& layers) {
+    run<dense_network_t<B, F...>>(params, layers, std::make_index_sequence<sizeof...(F)>());
+}
+
+/*!
+ * \brief Call functor with the function f as a compile-time constant, if f
+ * is one of Fs
+ */
+template <function... Fs, typename Functor>
+void select_function(function f, Functor&& functor) {
+    ((f == Fs ? (functor(std::integral_constant<function, Fs>()), true) : false) || ...);
+}
+
+template <size_t B>
+void run_batch(const parameters& params, const std::vector<dense_spec>& layers) {
+    const auto h = layers.front().activation;
+    const auto o = layers.back().activation;
+
+    select_function<function::SIGMOID, function::SOFTMAX>(o, [&](auto out) {
+        constexpr auto O = decltype(out)::value;
+
+        if (layers.size() == 1) {
+            run_network<B, O>(params, layers);
+        } else {
+            select_function<function::SIGMOID, function::TANH, function::RELU>(h, [&](auto hidden) {
+                constexpr auto H = decltype(hidden)::value;
+
+                if (layers.size() == 2) {
+                    run_network<B, H, O>(params, layers);
+                } else {
+                    run_network<B, H, H, O>(params, layers);
+                }
+            });
+        }
+    });
+}
+
+template <size_t... B>
+void run_batches(size_t batch, const parameters& params, const std::vector<dense_spec>& layers, std::index_sequence<B...> /*sizes*/) {
+    ((batch == B ? (run_batch<B>(params, layers), true) : false) || ...);
+}
+
+/*!
+ * \brief Build the network described in the given parameters and execute
+ * their task with it.
+ * \return true if the network was supported, false otherwise
+ */
+inline bool interpret(const parameters& params) {
+    std::vector<dense_spec> layers;
+    size_t batch = 0;
+
+    if (!read_network(params, layers, batch) || !supported(layers, batch)) {
+        std::cout << "dllp: error: The network cannot be interpreted" << std::endl;
+        return false;
+    }
+
+    run_batches(batch, params, layers, batch_sizes());
+
+    return true;
+}
+
+} //end of namespace interpreter
+
+} //end of namespace processor
+
+} //end of namespace dll
@@ -0,0 +1,252 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file preprocess.hpp
+ * \brief Fused preprocessing of the samples read by dllp
+ *
+ * The steps of a datasource (binarize, normalize, shift, scale and normal
+ * noise) are composed into a single affine map per sample. Each sample is
+ * then read once to compute its moments and written once, plus one pass to
+ * normalize again after the noise. The samples are processed in parallel
+ * and the noise of a sample only depends on its index, not on the thread
+ * that processes it.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/random_stream.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/util/trace.hpp"
+
+namespace dll {
+
+namespace processor {
+
+/*!
+ * \brief The preprocessing steps of a datasource, in their order of application
+ */
+struct preprocessing {
+    bool binarize   = false; ///< Binarize the values against the threshold
+    float threshold = 30.0f; ///< The binarization threshold
+    bool normalize  = false; ///< Normalize each sample (zero mean, unit variance)
+    float shift     = 0.0f;  ///< The value added to each value
+    float scale     = 1.0f;  ///< The factor of each value
+    bool noise      = false; ///< Add normal noise (the samples are normalized before and after)
+    float noise_stddev = 0.0f; ///< The standard deviation of the noise
+    uint64_t noise_key = 0;    ///< The key of the noise stream
+
+    /*!
+     * \brief Indicates if the preprocessing changes the samples
+     */
+    bool active() const {
+        return binarize || normalize || shift != 0.0f || scale != 1.0f || noise;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Compute the mean and the standard deviation of the n values of x,
+ * as seen through the given transform.
+ *
+ * The sums are split into independent lanes, so that the compiler can
+ * vectorize them.
+ */
+template <typename T, typename Transform>
+void sample_moments(const T* x, size_t n, Transform transform, double& mean, double& stddev) {
+    constexpr size_t lanes = 8;
+
+    double sums[lanes]    = {};
+    double squares[lanes] = {};
+
+    size_t j = 0;
+
+    for (; j + lanes <= n; j += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            const double v = transform(x[j + l]);
+
+            sums[l] += v;
+            squares[l] += v * v;
+        }
+    }
+
+    double sum    = 0.0;
+    double square = 0.0;
+
+    for (; j < n; ++j) {
+        const double v = transform(x[j]);
+
+        sum += v;
+        square += v * v;
+    }
+
+    for (size_t l = 0; l < lanes; ++l) {
+        sum += sums[l];
+        square += squares[l];
+    }
+
+    mean   = n ? sum / n : 0.0;
+    stddev = n ? std::sqrt(std::max(square / n - mean * mean, 0.0)) : 0.0;
+}
+
+/*!
+ * \brief Compose the normalization with the given moments into the affine
+ * map a * x + c. A constant sample is only centered.
+ */
+inline void compose_normalize(double mean, double stddev, double& a, double& c) {
+    const double factor = stddev > 0.0 ? 1.0 / stddev : 1.0;
+
+    a = a * factor;
+    c = (c - mean) * factor;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Preprocess the n values of the sample of the given index, in place.
+ * \param x The values of the sample
+ * \param n The number of values
+ * \param p The preprocessing steps
+ * \param index The index of the sample (selects its noise)
+ * \param noise A buffer for the noise of the sample
+ */
+template <typename T>
+void preprocess_sample(T* x, size_t n, const preprocessing& p, size_t index, std::vector<T>& noise) {
+    const T threshold = p.threshold;
+    const bool binarize = p.binarize;
+
+    auto input = [threshold, binarize](T v) { return binarize ? (v > threshold ? T(1) : T(0)) : v; };
+
+    // The affine map of the whole pipeline
+    double a = 1.0;
+    double c = 0.0;
+
+    double mean   = 0.0;
+    double stddev = 0.0;
+
+    if (p.normalize || p.noise) {
+        detail::sample_moments(x, n, input, mean, stddev);
+    }
+
+    if (p.normalize) {
+        detail::compose_normalize(mean, stddev, a, c);
+
+        mean   = 0.0;
+        stddev = stddev > 0.0 ? 1.0 : 0.0;
+    }
+
+    c += p.shift;
+    mean += p.shift;
+
+    a *= p.scale;
+    c *= p.scale;
+    mean *= p.scale;
+    stddev *= std::abs(p.scale);
+
+    if (!p.noise) {
+        const T fa = a;
+        const T fc = c;
+
+        for (size_t j = 0; j < n; ++j) {
+            x[j] = fa * input(x[j]) + fc;
+        }
+
+        return;
+    }
+
+    // The samples are normalized before the noise, from the known moments
+    detail::compose_normalize(mean, stddev, a, c);
+
+    noise.resize(n);
+
+    random_stream stream(p.noise_key, index * ((n + philox4x32::block_size - 1) / philox4x32::block_size));
+    normal_fill(noise.data(), n, stream, T(0), T(p.noise_stddev));
+
+    const T fa = a;
+    const T fc = c;
+
+    for (size_t j = 0; j < n; ++j) {
+        x[j] = fa * input(x[j]) + fc + noise[j];
+    }
+
+    // And normalized again after the noise
+    detail::sample_moments(x, n, [](T v) { return v; }, mean, stddev);
+
+    a = 1.0;
+    c = 0.0;
+    detail::compose_normalize(mean, stddev, a, c);
+
+    const T fa2 = a;
+    const T fc2 = c;
+
+    for (size_t j = 0; j < n; ++j) {
+        x[j] = fa2 * x[j] + fc2;
+    }
+}
+
+/*!
+ * \brief Preprocess all the given samples in place, in parallel
+ * \param samples The samples (etl containers)
+ * \param p The preprocessing steps
+ */
+template <typename Sample>
+void preprocess(std::vector<Sample>& samples, const preprocessing& p) {
+    using T = etl::value_t<Sample>;
+
+    if (!p.active() || samples.empty()) {
+        return;
+    }
+
+    const size_t threads = get_thread_budget().compute;
+    const size_t chunks  = std::min(samples.size(), threads * 4);
+    const size_t chunk   = (samples.size() + chunks - 1) / chunks;
+
+    auto process = [&samples, &p, chunk](size_t first) {
+        std::vector<T> noise;
+
+        const size_t last = std::min(samples.size(), first + chunk);
+
+        for (size_t i = first; i < last; ++i) {
+            auto& sample = samples[i];
+
+            sample.ensure_cpu_up_to_date();
+            preprocess_sample(sample.memory_start(), etl::size(sample), p, i, noise);
+            sample.invalidate_gpu();
+        }
+    };
+
+    if (threads == 1 || chunks == 1) {
+        for (size_t first = 0; first < samples.size(); first += chunk) {
+            process(first);
+        }
+
+        return;
+    }
+
+    task_group pool;
+
+    for (size_t first = 0; first < samples.size(); first += chunk) {
+        pool.do_task([&process, first] {
+            trace_scope scope("pool:task", "pool");
+
+            process(first);
+        });
+    }
+
+    pool.wait();
+}
+
+} //end of namespace processor
+
+} //end of namespace dll
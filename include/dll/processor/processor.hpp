@@ -16,6 +16,11 @@
 #include <vector>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
 
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/conv_rbm.hpp"
@@ -23,6 +28,12 @@
 #include "dll/neural/conv_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/text_reader.hpp"
+#include "dll/tabular_reader.hpp"
+#include "dll/datasets/binary.hpp"
+#include "dll/datasets/cache.hpp"
+#include "dll/processor/preprocess.hpp"
+#include "dll/processor/profile.hpp"
+#include "dll/processor/serve.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -37,6 +48,16 @@ struct options {
     bool cublas = false;
     bool cufft  = false;
     bool cache  = false;
+
+    std::string cache_dir; ///< The directory of the compiled networks (DLLP_CACHE or ~/.cache/dllp by default)
+
+    bool interpret = false;  ///< Run the supported networks with the interpreter, without compilation
+    std::string interpreter; ///< The interpreter program (DLLP_INTERPRETER or dllp_interpreter by default)
+
+    std::string profile; ///< The build profile, overriding the one of the configuration
+
+    size_t jobs    = 0; ///< The number of concurrent trials of a sweep (0 for all the cores divided by threads)
+    size_t threads = 0; ///< The number of cores of each trial of a sweep (0 for all the cores divided by jobs)
 };
 
 template <typename LastLayer, typename Enable = void>
@@ -52,6 +73,7 @@ struct sgd_possible<LastLayer, std::enable_if_t<decay_layer_traits<LastLayer>::b
 //These functions are only exposed to be able to unit-test the program
 int process_file(const options& opt, const std::vector<std::string>& actions, const std::string& source_file);
 std::string process_file_result(const options& opt, const std::vector<std::string>& actions, const std::string& source_file);
+int process_sweep(const options& opt, const std::vector<std::string>& actions, const std::string& source_file, const std::string& grid_file);
 
 constexpr double stupid_default = -666.0;
 
@@ -87,6 +109,9 @@ struct datasource_pack {
 struct general_desc {
     bool batch_mode       = false;
     size_t big_batch = 1;
+    bool threaded    = false; ///< Indicates if the streamed datasources are read by a thread
+
+    std::string profile = "release_debug"; ///< The build profile (debug, release_debug, release or release_native)
 };
 
 struct pretraining_desc {
@@ -113,6 +138,12 @@ struct weights_desc {
     std::string file = "weights.dat";
 };
 
+struct profiling_desc {
+    size_t warmup    = 5;                   ///< The number of batches trained before profiling
+    size_t batches   = 20;                  ///< The number of profiled batches
+    std::string json = "dllp_profile.json"; ///< The file of the JSON report
+};
+
 struct task {
     std::vector<std::string> default_actions;
 
@@ -124,67 +155,271 @@ struct task {
     dll::processor::pretraining_desc pt_desc;
     dll::processor::training_desc ft_desc;
     dll::processor::weights_desc w_desc;
+    dll::processor::profiling_desc prof_desc;
+    dll::processor::serving_desc serve_desc;
     dll::processor::general_desc general_desc;
 };
 
-template <bool Three, typename Sample>
-bool read_samples(const datasource& ds, std::vector<Sample>& samples) {
-    size_t limit = 0;
-
-    if (ds.limit > 0) {
-        limit = ds.limit;
+/*!
+ * \brief The runtime parameters of a generated program.
+ *
+ * The values that do not change the type of the network (data sources,
+ * epochs, learning rates, weights file, actions) are not compiled into the
+ * generated program, but given to it in a file of key=value lines. This
+ * way, a compiled network can be reused for all these values.
+ */
+struct parameters {
+    std::map<std::string, std::string> values; ///< The values, by key
+
+    /*!
+     * \brief Set the value of the given key
+     */
+    template <typename T>
+    void set(const std::string& key, const T& value) {
+        std::ostringstream stream;
+        stream << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+        values[key] = stream.str();
     }
 
-    if (ds.reader == "mnist") {
-        mnist::read_mnist_image_file<std::vector, Sample>(samples, ds.source_file, limit, [] { return Sample(1 * 28 * 28); });
-    } else if(ds.reader == "text"){
-        dll::text::read_images_direct<Three>(samples, ds.source_file, limit);
-    } else {
-        std::cout << "dllp: error: unknown samples reader: " << ds.reader << std::endl;
-        return false;
+    /*!
+     * \brief Set the value of the given key
+     */
+    void set(const std::string& key, const std::string& value) {
+        values[key] = value;
     }
 
-    if (ds.binarize) {
-        mnist::binarize_each(samples);
+    /*!
+     * \brief Assign the value of the given key, if any, to target
+     * \return true if the key was present, false otherwise
+     */
+    template <typename T>
+    bool apply(const std::string& key, T& target) const {
+        auto it = values.find(key);
+
+        if (it == values.end()) {
+            return false;
+        }
+
+        std::istringstream stream(it->second);
+        stream >> target;
+
+        return true;
     }
 
-    if (ds.normalize) {
-        mnist::normalize_each(samples);
+    /*!
+     * \brief Assign the value of the given key, if any, to target
+     * \return true if the key was present, false otherwise
+     */
+    bool apply(const std::string& key, std::string& target) const {
+        auto it = values.find(key);
+
+        if (it == values.end()) {
+            return false;
+        }
+
+        target = it->second;
+
+        return true;
     }
 
-    if (ds.shift) {
-        for (auto& vec : samples) {
-            for (auto& v : vec) {
-                v += ds.shift_d;
-            }
+    /*!
+     * \brief Store the parameters into the given file
+     */
+    bool store(const std::string& file) const {
+        std::ofstream stream(file);
+
+        for (auto& [key, value] : values) {
+            stream << key << '=' << value << '\n';
         }
+
+        return bool(stream);
     }
 
-    if (ds.scale) {
-        for (auto& vec : samples) {
-            for (auto& v : vec) {
-                v *= ds.scale_d;
+    /*!
+     * \brief Load the parameters from the given file
+     */
+    bool load(const std::string& file) {
+        std::ifstream stream(file);
+
+        if (!stream) {
+            return false;
+        }
+
+        std::string line;
+
+        while (std::getline(stream, line)) {
+            auto sep = line.find('=');
+
+            if (sep != std::string::npos) {
+                values[line.substr(0, sep)] = line.substr(sep + 1);
             }
         }
+
+        return true;
     }
+};
 
-    if (ds.normal_noise) {
-        mnist::normalize_each(samples);
+inline void store_datasource(parameters& params, const std::string& prefix, const datasource& ds) {
+    params.set(prefix + ".source_file", ds.source_file);
+    params.set(prefix + ".reader", ds.reader);
+    params.set(prefix + ".binarize", ds.binarize);
+    params.set(prefix + ".normalize", ds.normalize);
+    params.set(prefix + ".scale", ds.scale);
+    params.set(prefix + ".scale_d", ds.scale_d);
+    params.set(prefix + ".shift", ds.shift);
+    params.set(prefix + ".shift_d", ds.shift_d);
+    params.set(prefix + ".normal_noise", ds.normal_noise);
+    params.set(prefix + ".normal_noise_d", ds.normal_noise_d);
+    params.set(prefix + ".limit", ds.limit);
+}
 
-        std::random_device rd;
-        std::default_random_engine rand_engine(rd());
-        std::normal_distribution<float> normal_distribution(0.0, ds.normal_noise_d);
-        auto noise = std::bind(normal_distribution, rand_engine);
+inline void load_datasource(const parameters& params, const std::string& prefix, datasource& ds) {
+    params.apply(prefix + ".source_file", ds.source_file);
+    params.apply(prefix + ".reader", ds.reader);
+    params.apply(prefix + ".binarize", ds.binarize);
+    params.apply(prefix + ".normalize", ds.normalize);
+    params.apply(prefix + ".scale", ds.scale);
+    params.apply(prefix + ".scale_d", ds.scale_d);
+    params.apply(prefix + ".shift", ds.shift);
+    params.apply(prefix + ".shift_d", ds.shift_d);
+    params.apply(prefix + ".normal_noise", ds.normal_noise);
+    params.apply(prefix + ".normal_noise_d", ds.normal_noise_d);
+    params.apply(prefix + ".limit", ds.limit);
+}
 
-        for (auto& vec : samples) {
-            for (auto& noisy_x : vec) {
-                noisy_x += noise();
-            }
+/*!
+ * \brief Store the runtime values of the given task and the actions to
+ * execute into the given parameters
+ */
+inline void store_task(parameters& params, const task& t, const std::vector<std::string>& actions) {
+    store_datasource(params, "pretraining.samples", t.pretraining.samples);
+    store_datasource(params, "pretraining_clean.samples", t.pretraining_clean.samples);
+    store_datasource(params, "training.samples", t.training.samples);
+    store_datasource(params, "training.labels", t.training.labels);
+    store_datasource(params, "testing.samples", t.testing.samples);
+    store_datasource(params, "testing.labels", t.testing.labels);
+
+    params.set("pt_desc.epochs", t.pt_desc.epochs);
+    params.set("pt_desc.denoising", t.pt_desc.denoising);
+    params.set("ft_desc.epochs", t.ft_desc.epochs);
+    params.set("w_desc.file", t.w_desc.file);
+    params.set("prof_desc.warmup", t.prof_desc.warmup);
+    params.set("prof_desc.batches", t.prof_desc.batches);
+    params.set("prof_desc.json", t.prof_desc.json);
+    params.set("serve_desc.socket", t.serve_desc.socket);
+    params.set("serve_desc.output", t.serve_desc.output);
+    params.set("serve_desc.max_batch", t.serve_desc.max_batch);
+    params.set("serve_desc.deadline", t.serve_desc.deadline);
+    params.set("serve_desc.workers", t.serve_desc.workers);
+
+    std::string list;
+
+    for (auto& action : actions) {
+        list += (list.empty() ? "" : " ") + action;
+    }
+
+    params.set("actions", list);
+}
+
+/*!
+ * \brief Load the runtime values of the given task and the actions to
+ * execute from the given parameters
+ */
+inline void load_task(const parameters& params, task& t, std::vector<std::string>& actions) {
+    load_datasource(params, "pretraining.samples", t.pretraining.samples);
+    load_datasource(params, "pretraining_clean.samples", t.pretraining_clean.samples);
+    load_datasource(params, "training.samples", t.training.samples);
+    load_datasource(params, "training.labels", t.training.labels);
+    load_datasource(params, "testing.samples", t.testing.samples);
+    load_datasource(params, "testing.labels", t.testing.labels);
+
+    params.apply("pt_desc.epochs", t.pt_desc.epochs);
+    params.apply("pt_desc.denoising", t.pt_desc.denoising);
+    params.apply("ft_desc.epochs", t.ft_desc.epochs);
+    params.apply("w_desc.file", t.w_desc.file);
+    params.apply("prof_desc.warmup", t.prof_desc.warmup);
+    params.apply("prof_desc.batches", t.prof_desc.batches);
+    params.apply("prof_desc.json", t.prof_desc.json);
+    params.apply("serve_desc.socket", t.serve_desc.socket);
+    params.apply("serve_desc.output", t.serve_desc.output);
+    params.apply("serve_desc.max_batch", t.serve_desc.max_batch);
+    params.apply("serve_desc.deadline", t.serve_desc.deadline);
+    params.apply("serve_desc.workers", t.serve_desc.workers);
+
+    std::string list;
+    params.apply("actions", list);
+
+    std::istringstream stream(list);
+    std::string action;
+
+    while (stream >> action) {
+        actions.push_back(action);
+    }
+}
+
+template <bool Three, typename Sample>
+bool read_samples(const datasource& ds, std::vector<Sample>& samples) {
+    size_t limit = 0;
+
+    if (ds.limit > 0) {
+        limit = ds.limit;
+    }
+
+    // Reuse the preprocessed samples of a previous run, if any (the noise is random, it is never cached)
+    std::string cache_file;
+
+    if (!ds.normal_noise) {
+        cache::key key;
+        key.add(ds.reader);
+        key.add_value(limit);
+        key.add_value(Three);
+        key.add_value(ds.binarize);
+        key.add_value(ds.normalize);
+        key.add_value(ds.shift);
+        key.add_value(ds.shift_d);
+        key.add_value(ds.scale);
+        key.add_value(ds.scale_d);
+
+        cache_file = cache::file("dllp", {ds.source_file}, key);
+
+        if (cache::load_samples(samples, cache_file)) {
+            return true;
         }
+    }
+
+    dll::tabular::format format;
 
-        mnist::normalize_each(samples);
+    if (ds.reader == "mnist") {
+        mnist::read_mnist_image_file<std::vector, Sample>(samples, ds.source_file, limit, [] { return Sample(1 * 28 * 28); });
+    } else if(ds.reader == "text"){
+        dll::text::read_images_direct<Three>(samples, ds.source_file, limit);
+    } else if(dll::tabular::parse_format(ds.reader, format)){
+        dll::tabular::read_samples(samples, ds.source_file, format, limit, [](size_t n) {
+            if constexpr (Three) {
+                return Sample(1, 1, n);
+            } else {
+                return Sample(n);
+            }
+        });
+    } else {
+        std::cout << "dllp: error: unknown samples reader: " << ds.reader << std::endl;
+        return false;
     }
 
+    // All the steps are applied in a single pass over each sample
+    preprocessing steps;
+    steps.binarize     = ds.binarize;
+    steps.normalize    = ds.normalize;
+    steps.shift        = ds.shift ? ds.shift_d : 0.0;
+    steps.scale        = ds.scale ? ds.scale_d : 1.0;
+    steps.noise        = ds.normal_noise;
+    steps.noise_stddev = ds.normal_noise_d;
+    steps.noise_key    = next_stream_key();
+
+    preprocess(samples, steps);
+
+    cache::store_samples(samples, cache_file);
+
     return !samples.empty();
 }
 
@@ -196,10 +431,14 @@ bool read_labels(const datasource& ds, std::vector<Label>& labels) {
         limit = ds.limit;
     }
 
+    dll::tabular::format format;
+
     if (ds.reader == "mnist") {
         mnist::read_mnist_label_file<std::vector, Label>(labels, ds.source_file, limit);
     } else if (ds.reader == "text") {
         dll::text::read_labels<std::vector, Label>(labels, ds.source_file, limit);
+    } else if (dll::tabular::parse_format(ds.reader, format)) {
+        dll::tabular::read_labels(labels, ds.source_file, format, limit);
     } else {
         std::cout << "dllp: error: unknown labels reader: " << ds.reader << std::endl;
         return false;
@@ -208,6 +447,98 @@ bool read_labels(const datasource& ds, std::vector<Label>& labels) {
     return !labels.empty();
 }
 
+/*!
+ * \brief Indicates if the given datasource is streamed from the disk
+ * instead of being read in memory.
+ *
+ * The binary datasources are sharded binary datasets (see
+ * dll/datasets/binary.hpp), the shards are given as a comma-separated
+ * list in the source. The labels are read from the shards too.
+ */
+inline bool is_streamed(const datasource& ds) {
+    return ds.reader == "binary";
+}
+
+/*!
+ * \brief Returns the paths of the shards of a streamed datasource
+ */
+inline std::vector<std::string> stream_paths(const datasource& ds) {
+    std::vector<std::string> paths;
+
+    std::istringstream stream(ds.source_file);
+    std::string path;
+
+    while (std::getline(stream, path, ',')) {
+        if (!path.empty()) {
+            paths.push_back(path);
+        }
+    }
+
+    return paths;
+}
+
+/*!
+ * \brief Map the shards of a streamed datasource
+ * \return The dataset, or nullptr in case of error
+ */
+inline std::shared_ptr<const binary::dataset> open_stream(const datasource& ds) {
+    if (ds.binarize || ds.normalize || ds.shift || ds.scale || ds.normal_noise) {
+        std::cout << "dllp: error: binary datasources must be preprocessed before being written" << std::endl;
+        return nullptr;
+    }
+
+    auto data = std::make_shared<const binary::dataset>(stream_paths(ds));
+
+    if (!data->size()) {
+        std::cout << "dllp: error: failed to read the binary datasource: " << ds.source_file << std::endl;
+        return nullptr;
+    }
+
+    return data;
+}
+
+/*!
+ * \brief Returns the number of samples to use from a streamed datasource
+ */
+inline size_t stream_size(const datasource& ds, const binary::dataset& data) {
+    return ds.limit > 0 ? std::min(data.size(), size_t(ds.limit)) : data.size();
+}
+
+/*!
+ * \brief The descriptor of the generators streaming the datasources of the
+ * given network. The batches are the batches of the network and
+ * big_batch_size batches are kept in cache. When Threaded is set, the
+ * next batches are read by a thread while the current one is used.
+ */
+template <typename DBN, bool Threaded, typename... Parameters>
+using stream_generator_desc = std::conditional_t<
+    Threaded,
+    outmemory_data_generator_desc<dll::batch_size<DBN::batch_size>, dll::big_batch_size<DBN::big_batch_size>, dll::threaded, Parameters...>,
+    outmemory_data_generator_desc<dll::batch_size<DBN::batch_size>, dll::big_batch_size<DBN::big_batch_size>, Parameters...>>;
+
+/*!
+ * \brief Make a generator streaming the given binary dataset
+ * \param data The mapped dataset
+ * \param n The number of samples to use
+ * \param n_classes The number of classes
+ */
+template <typename T, bool Three, typename Desc>
+auto make_stream_generator(const std::shared_ptr<const binary::dataset>& data, size_t n, size_t n_classes, const Desc& desc) {
+    constexpr size_t D = Three ? 3 : 1;
+
+    binary::sample_iterator<T, D> iit(data, 0);
+    binary::sample_iterator<T, D> iend(data, n);
+
+    if constexpr (Desc::AutoEncoder) {
+        return make_generator(iit, iend, iit, iend, n, n_classes, desc);
+    } else {
+        binary::label_iterator lit(data, 0);
+        binary::label_iterator lend(data, n);
+
+        return make_generator(iit, iend, lit, lend, n, n_classes, desc);
+    }
+}
+
 inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
     std::cout << std::string(25, '*') << std::endl;
@@ -216,12 +547,25 @@ inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
 }
 
-template <typename Container, bool Three, typename DBN>
+/*!
+ * \brief Execute the given actions with the given network.
+ *
+ * \tparam Container The type of the samples read in memory
+ * \tparam Three Indicates if the samples are three-dimensional
+ * \tparam Threaded Indicates if the streamed datasources are read by a thread
+ */
+template <typename Container, bool Three, bool Threaded = false, typename DBN>
 void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
+    // The standard output only carries the responses of the server
+    if (serves_standard_output(task.serve_desc, actions)) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     print_title("Network");
     dbn.display();
 
-    using dbn_t = std::decay_t<DBN>;
+    using dbn_t  = std::decay_t<DBN>;
+    using weight = typename dbn_t::weight;
 
     //Execute all the actions sequentially
     for (auto& action : actions) {
@@ -233,6 +577,29 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
+            if (is_streamed(task.pretraining.samples)) {
+                if (task.pt_desc.denoising) {
+                    std::cout << "dllp: error: denoising pretraining is not possible with a binary datasource" << std::endl;
+                    return;
+                }
+
+                auto data = open_stream(task.pretraining.samples);
+
+                if (!data) {
+                    return;
+                }
+
+                if constexpr (dbn_t::pretrain_possible) {
+                    auto generator = make_stream_generator<weight, Three>(data, stream_size(task.pretraining.samples, *data), 0,
+                                                                          stream_generator_desc<dbn_t, Threaded, dll::autoencoder>{});
+
+                    //Pretrain the network
+                    dbn.pretrain(*generator, task.pt_desc.epochs);
+                }
+
+                continue;
+            }
+
             std::vector<Container> pt_samples;
 
             //Try to read the samples
@@ -263,11 +630,37 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "train") {
             print_title("Training");
 
-            if (task.training.samples.empty() || task.training.labels.empty()) {
+            if (task.training.samples.empty() || (task.training.labels.empty() && !is_streamed(task.training.samples))) {
                 std::cout << "dllp: error: train is not possible without samples and labels" << std::endl;
                 return;
             }
 
+            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+            if (is_streamed(task.training.samples)) {
+                if (!sgd_possible<last_layer>::value) {
+                    std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
+                    return;
+                }
+
+                auto data = open_stream(task.training.samples);
+
+                if (!data) {
+                    return;
+                }
+
+                if constexpr (sgd_possible<last_layer>::value) {
+                    auto generator = make_stream_generator<weight, Three>(data, stream_size(task.training.samples, *data), dbn.output_size(),
+                                                                          stream_generator_desc<dbn_t, Threaded, dll::categorical>{});
+
+                    //Train the network
+                    auto ft_error = dbn.fine_tune(*generator, task.ft_desc.epochs);
+                    std::cout << "Train Classification Error:" << ft_error << std::endl;
+                }
+
+                continue;
+            }
+
             std::vector<Container> ft_samples;
             std::vector<size_t> ft_labels;
 
@@ -283,8 +676,6 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
-            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
-
             if(!sgd_possible<last_layer>::value){
                 std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
                 return;
@@ -298,37 +689,19 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "test") {
             print_title("Testing");
 
-            if (task.testing.samples.empty() || task.testing.labels.empty()) {
+            if (task.testing.samples.empty() || (task.testing.labels.empty() && !is_streamed(task.testing.samples))) {
                 std::cout << "dllp: error: test is not possible without samples and labels" << std::endl;
                 return;
             }
 
-            std::vector<Container> test_samples;
-            std::vector<size_t> test_labels;
-
-            //Try to read the samples
-            if (!read_samples<Three>(task.testing.samples, test_samples)) {
-                std::cout << "dllp: error: failed to read the test samples" << std::endl;
-                return;
-            }
-
-            //Try to read the labels
-            if (!read_labels(task.testing.labels, test_labels)) {
-                std::cout << "dllp: error: failed to read the test labels" << std::endl;
-                return;
-            }
-
             auto classes = dbn.output_size();
 
             etl::dyn_matrix<size_t, 2> conf(classes, classes, 0.0);
 
-            size_t n  = test_samples.size();
+            size_t n  = 0;
             size_t tp = 0;
 
-            for (size_t i = 0; i < test_samples.size(); ++i) {
-                auto sample = test_samples[i];
-                auto label  = test_labels[i];
-
+            auto classify = [&](const auto& sample, size_t label) {
                 auto predicted = dbn.predict(sample);
 
                 if (predicted == label) {
@@ -336,6 +709,43 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 }
 
                 ++conf(label, predicted);
+                ++n;
+            };
+
+            if (is_streamed(task.testing.samples)) {
+                auto data = open_stream(task.testing.samples);
+
+                if (!data) {
+                    return;
+                }
+
+                const size_t size = stream_size(task.testing.samples, *data);
+
+                binary::sample_iterator<weight, Three ? 3 : 1> iit(data, 0);
+                binary::label_iterator lit(data, 0);
+
+                for (size_t i = 0; i < size; ++i, ++iit, ++lit) {
+                    classify(*iit, size_t(*lit));
+                }
+            } else {
+                std::vector<Container> test_samples;
+                std::vector<size_t> test_labels;
+
+                //Try to read the samples
+                if (!read_samples<Three>(task.testing.samples, test_samples)) {
+                    std::cout << "dllp: error: failed to read the test samples" << std::endl;
+                    return;
+                }
+
+                //Try to read the labels
+                if (!read_labels(task.testing.labels, test_labels)) {
+                    std::cout << "dllp: error: failed to read the test labels" << std::endl;
+                    return;
+                }
+
+                for (size_t i = 0; i < test_samples.size(); ++i) {
+                    classify(test_samples[i], test_labels[i]);
+                }
             }
 
             double test_error = (n - tp) / double(n);
@@ -392,6 +802,68 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
 
             dbn.load(task.w_desc.file);
             std::cout << "Weights loaded" << std::endl;
+        } else if (action == "prepare") {
+            print_title("Prepare");
+
+            // The samples are read once and stored preprocessed in the dataset cache
+            for (auto* pack : {&task.pretraining, &task.pretraining_clean, &task.training, &task.testing}) {
+                if (!pack->samples.empty() && !is_streamed(pack->samples)) {
+                    std::vector<Container> samples;
+
+                    if (!read_samples<Three>(pack->samples, samples)) {
+                        std::cout << "dllp: error: failed to read the samples" << std::endl;
+                        return;
+                    }
+                }
+            }
+
+            std::cout << "Samples prepared" << std::endl;
+        } else if (action == "profile") {
+            print_title("Profile");
+
+            if (task.training.samples.empty() || task.training.labels.empty() || is_streamed(task.training.samples)) {
+                std::cout << "dllp: error: profile is not possible without in-memory samples and labels" << std::endl;
+                return;
+            }
+
+            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+            if (!sgd_possible<last_layer>::value) {
+                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
+                return;
+            }
+
+            std::vector<Container> prof_samples;
+            std::vector<size_t> prof_labels;
+
+            if (!read_samples<Three>(task.training.samples, prof_samples)) {
+                std::cout << "dllp: error: failed to read the training samples" << std::endl;
+                return;
+            }
+
+            if (!read_labels(task.training.labels, prof_labels)) {
+                std::cout << "dllp: error: failed to read the training labels" << std::endl;
+                return;
+            }
+
+            if constexpr (sgd_possible<last_layer>::value) {
+                auto generator = dll::make_generator(prof_samples, prof_labels, prof_samples.size(), dbn.output_size(), typename dbn_t::categorical_generator_t{});
+
+                generator->set_safe();
+
+                profile(dbn, *generator, task.prof_desc.warmup, task.prof_desc.batches, task.prof_desc.json);
+            }
+        } else if (action == "serve") {
+            print_title("Serve");
+
+            if (task.serve_desc.output != "predict" && task.serve_desc.output != "features") {
+                std::cout << "dllp: error: serve output must be one of [predict, features]" << std::endl;
+                return;
+            }
+
+            if (!serve(dbn, task.serve_desc)) {
+                return;
+            }
         } else {
             std::cout << "dllp: error: Invalid action: " << action << std::endl;
         }
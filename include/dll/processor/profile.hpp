@@ -0,0 +1,221 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file profile.hpp
+ * \brief Per-layer profile of the training of a network, for dllp
+ *
+ * A few batches are trained to warm up, then the timed batches are trained
+ * with a layer_profiler. The time of each layer is reported with its
+ * throughput, from the costs estimated by estimate_cost(), and its memory
+ * footprint. The report ends with the roofline of the network on this
+ * machine. A layer fused into the previous one (an activation) reports no
+ * forward time.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "dll/util/layer_profiler.hpp"
+#include "dll/util/roofline.hpp"
+
+namespace dll {
+
+namespace processor {
+
+/*!
+ * \brief The profile of one layer
+ */
+struct layer_profile {
+    layer_cost cost;     ///< The estimated cost of the layer for a batch
+    double time[3] = {}; ///< The average time of each phase per batch (ms)
+};
+
+namespace detail {
+
+template <typename DBN, size_t... I>
+void register_layers(DBN& dbn, layer_profiler& profiler, std::index_sequence<I...> /*indices*/) {
+    (profiler.add(dbn.template layer_get<I>()), ...);
+}
+
+/*!
+ * \brief Escape a string for JSON
+ */
+inline std::string json_string(const std::string& value) {
+    std::string escaped = "\"";
+
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped + "\"";
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Write the profiles of the layers as JSON into the given file
+ */
+inline bool write_profile_json(const std::string& file, const std::vector<layer_profile>& profiles, size_t batch_size, size_t batches, double total) {
+    static constexpr const char* phases[3] = {"forward", "backward", "update"};
+
+    std::ofstream stream(file);
+
+    stream << "{\n";
+    stream << "  \"batch_size\": " << batch_size << ",\n";
+    stream << "  \"batches\": " << batches << ",\n";
+    stream << "  \"batch_time_ms\": " << total << ",\n";
+    stream << "  \"layers\": [\n";
+
+    for (size_t i = 0; i < profiles.size(); ++i) {
+        auto& p = profiles[i];
+        auto& c = p.cost;
+
+        stream << "    {\"index\": " << i << ", \"name\": " << detail::json_string(c.name)
+               << ", \"parameters\": " << c.parameters << ", \"outputs\": " << c.outputs
+               << ", \"footprint_bytes\": " << c.footprint;
+
+        for (size_t ph = 0; ph < 3; ++ph) {
+            stream << ", \"" << phases[ph] << "\": {\"time_ms\": " << p.time[ph]
+                   << ", \"gflops\": " << (p.time[ph] > 0.0 ? c.flops[ph] / (p.time[ph] * 1e6) : 0.0)
+                   << ", \"bytes\": " << c.bytes[ph] << "}";
+        }
+
+        stream << "}" << (i + 1 < profiles.size() ? "," : "") << "\n";
+    }
+
+    stream << "  ]\n";
+    stream << "}\n";
+
+    return bool(stream);
+}
+
+/*!
+ * \brief Print the profiles of the layers as a table
+ */
+inline void print_profile(const std::vector<layer_profile>& profiles, double total) {
+    std::cout << std::setw(3) << "#" << " | " << std::setw(40) << std::left << "Layer" << std::right
+              << " | " << std::setw(10) << "Fwd (ms)" << " | " << std::setw(10) << "Bwd (ms)" << " | " << std::setw(10) << "Upd (ms)"
+              << " | " << std::setw(9) << "GFLOP/s" << " | " << std::setw(9) << "GB/s" << " | " << std::setw(10) << "Memory" << std::endl;
+
+    for (size_t i = 0; i < profiles.size(); ++i) {
+        auto& p = profiles[i];
+        auto& c = p.cost;
+
+        const double time  = p.time[0] + p.time[1] + p.time[2];
+        const double flops = c.flops[0] + c.flops[1] + c.flops[2];
+        const double bytes = c.bytes[0] + c.bytes[1] + c.bytes[2];
+
+        std::cout << std::setw(3) << i << " | " << std::setw(40) << std::left << c.name.substr(0, 40) << std::right
+                  << " | " << std::setw(10) << p.time[0] << " | " << std::setw(10) << p.time[1] << " | " << std::setw(10) << p.time[2]
+                  << " | " << std::setw(9) << (time > 0.0 ? flops / (time * 1e6) : 0.0)
+                  << " | " << std::setw(9) << (time > 0.0 ? bytes / (time * 1e6) : 0.0)
+                  << " | " << std::setw(8) << c.footprint / 1024 << "KB" << std::endl;
+    }
+
+    std::cout << "Batch time (ms): " << total << std::endl;
+}
+
+/*!
+ * \brief Profile the training of the network on the given samples
+ * \param dbn The network
+ * \param generator The generator of the training batches
+ * \param warmup The number of batches trained before profiling
+ * \param batches The number of profiled batches
+ * \param json The file of the JSON report (none if empty)
+ */
+template <typename DBN, typename Generator>
+void profile(DBN& dbn, Generator& generator, size_t warmup, size_t batches, const std::string& json) {
+    using dbn_t     = std::decay_t<DBN>;
+    using trainer_t = typename dbn_t::desc::template trainer_t<dbn_t>;
+
+    dbn.momentum = dbn.initial_momentum;
+
+    auto trainer = std::make_unique<trainer_t>(dbn);
+    trainer->init_training(dbn_t::batch_size);
+
+    generator.reset();
+    generator.set_train();
+
+    auto train = [&]() {
+        if (!generator.has_next_batch()) {
+            generator.reset();
+        }
+
+        trainer->train_batch(0, generator.data_batch(), generator.label_batch());
+
+        generator.next_batch();
+    };
+
+    for (size_t b = 0; b < warmup; ++b) {
+        train();
+    }
+
+    layer_profiler profiler;
+    detail::register_layers(dbn, profiler, std::make_index_sequence<dbn_t::layers>());
+
+    set_layer_profiler(&profiler);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t b = 0; b < batches; ++b) {
+        train();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    set_layer_profiler(nullptr);
+
+    const double n     = std::max<size_t>(batches, 1);
+    const double total = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (1e6 * n);
+
+    generator.reset();
+
+    auto costs = network_costs(dbn, etl::size(generator.data_batch()) / etl::dim<0>(generator.data_batch()));
+
+    std::vector<layer_profile> profiles(costs.size());
+
+    for (size_t i = 0; i < profiles.size(); ++i) {
+        profiles[i].cost = costs[i];
+
+        for (size_t ph = 0; ph < profile_phases; ++ph) {
+            profiles[i].time[ph] = profiler.layers[i]->total(profile_phase(ph)) / (1e6 * n);
+        }
+    }
+
+    print_profile(profiles, total);
+
+    if (!json.empty()) {
+        if (write_profile_json(json, profiles, dbn_t::batch_size, batches, total)) {
+            std::cout << "Profile written to " << json << std::endl;
+        } else {
+            std::cout << "dllp: error: Impossible to write the profile to " << json << std::endl;
+        }
+    }
+
+    dump_roofline(dbn, profiler, batches);
+}
+
+} //end of namespace processor
+
+} //end of namespace dll
@@ -0,0 +1,367 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file serve.hpp
+ * \brief Long-running inference daemon of dllp (the serve action)
+ *
+ * The network is built and loaded once, then the samples are read from the
+ * standard input or from the connections of a Unix socket and forwarded
+ * through a batching executor, several requests being batched together.
+ *
+ * All the values are in the native byte order. A request is the number of
+ * values of the sample (uint32) followed by the values (float32). A request
+ * of zero values closes the stream. The responses are written in the order
+ * of the requests:
+ *  - predict: the predicted label (uint32)
+ *  - features: the number of values (uint32) followed by the output of the
+ *  network (float32)
+ *
+ * An invalid request is answered by 0xFFFFFFFF, and the stream is closed.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace processor {
+
+/*!
+ * \brief The configuration of the serve action
+ */
+struct serving_desc {
+    std::string socket;             ///< The path of the Unix socket (the standard input and output if empty)
+    std::string output = "predict"; ///< The responses, predict (the label) or features (the output of the network)
+    size_t max_batch   = 0;         ///< The maximum number of samples of a batch (0 for the batch size of the network)
+    size_t deadline    = 2000;      ///< The maximum time waited by a sample before its batch is forwarded (us)
+    size_t workers     = 1;         ///< The number of threads forwarding the batches
+};
+
+constexpr uint32_t serve_error = 0xFFFFFFFF; ///< The response to an invalid request
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer must prepare the dimensions of its input
+ */
+template <typename L, typename I, typename = void>
+struct has_prepare_input : std::false_type {};
+
+/*!
+ * \copydoc has_prepare_input
+ */
+template <typename L, typename I>
+struct has_prepare_input<L, I, std::void_t<decltype(std::declval<const L&>().prepare_input(std::declval<I&>()))>> : std::true_type {};
+
+/*!
+ * \brief Read exactly n bytes from the given file descriptor
+ * \return false at the end of the stream or on error
+ */
+inline bool read_exact(int fd, void* memory, size_t n) {
+    auto* p = static_cast<char*>(memory);
+
+    while (n) {
+        const auto r = ::read(fd, p, n);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            return false;
+        }
+
+        p += r;
+        n -= size_t(r);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write exactly n bytes to the given file descriptor
+ * \return false on error
+ */
+inline bool write_exact(int fd, const void* memory, size_t n) {
+    const auto* p = static_cast<const char*>(memory);
+
+    while (n) {
+        const auto r = ::write(fd, p, n);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            return false;
+        }
+
+        p += r;
+        n -= size_t(r);
+    }
+
+    return true;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Serve the requests of one stream with the given executor.
+ *
+ * The requests are read and submitted in the calling thread, without
+ * waiting for the previous responses, which are written by another thread,
+ * in order.
+ *
+ * \param executor The batching executor
+ * \param sample A sample of the network, used for the dimensions
+ * \param in The file descriptor of the requests
+ * \param out The file descriptor of the responses
+ * \param features Indicates if the features are returned instead of the labels
+ *
+ * \return The number of served requests
+ */
+template <typename Executor, typename Sample>
+size_t serve_stream(Executor& executor, const Sample& sample, int in, int out, bool features) {
+    using future_t = typename Executor::future_t;
+
+    const size_t n = etl::size(sample);
+
+    std::mutex lock;
+    std::condition_variable condition;
+    std::deque<std::optional<future_t>> pending; // An empty request is invalid
+    bool done = false;
+
+    std::thread writer([&] {
+        std::vector<float> buffer;
+
+        while (true) {
+            std::optional<future_t> future;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+                condition.wait(l, [&] { return done || !pending.empty(); });
+
+                if (pending.empty()) {
+                    return;
+                }
+
+                future = std::move(pending.front());
+                pending.pop_front();
+            }
+
+            if (!future) {
+                detail::write_exact(out, &serve_error, sizeof(serve_error));
+                return;
+            }
+
+            auto output = future->get();
+
+            bool written;
+
+            if (features) {
+                buffer.assign(output.begin(), output.end());
+
+                const auto size = uint32_t(buffer.size());
+
+                written = detail::write_exact(out, &size, sizeof(size)) && detail::write_exact(out, buffer.data(), buffer.size() * sizeof(float));
+            } else {
+                const auto label = uint32_t(std::distance(output.begin(), std::max_element(output.begin(), output.end())));
+
+                written = detail::write_exact(out, &label, sizeof(label));
+            }
+
+            // The client is gone, the remaining responses are dropped
+            if (!written) {
+                return;
+            }
+        }
+    });
+
+    Sample current(sample);
+    std::vector<float> values(n);
+
+    size_t requests = 0;
+
+    while (true) {
+        uint32_t size;
+
+        if (!detail::read_exact(in, &size, sizeof(size)) || !size) {
+            break;
+        }
+
+        const bool valid = size == n && detail::read_exact(in, values.data(), n * sizeof(float));
+
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            pending.emplace_back();
+            break;
+        }
+
+        std::copy(values.begin(), values.end(), current.memory_start());
+
+        pending.emplace_back(executor.submit(current));
+        ++requests;
+
+        condition.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        done = true;
+    }
+
+    condition.notify_one();
+
+    writer.join();
+
+    return requests;
+}
+
+/*!
+ * \brief Serve the network until the end of the standard input, or forever
+ * on the Unix socket of the configuration.
+ *
+ * \return false if the server could not be started
+ */
+template <typename DBN>
+bool serve(const DBN& dbn, const serving_desc& desc) {
+    using dbn_t = std::decay_t<DBN>;
+
+    typename dbn_t::input_one_t sample;
+
+    if constexpr (detail::has_prepare_input<typename dbn_t::input_layer_t, typename dbn_t::input_one_t>::value) {
+        dbn.template layer_get<0>().prepare_input(sample);
+    }
+
+    sample = 0;
+
+    const size_t max_batch = desc.max_batch ? std::min(desc.max_batch, dbn_t::batch_size) : dbn_t::batch_size;
+
+    auto executor = dbn.make_batching_executor(sample, max_batch, std::chrono::microseconds(desc.deadline), desc.workers);
+
+    const bool features = desc.output == "features";
+
+    auto report = [&executor]() {
+        auto stats = executor->stats();
+
+        std::cout << "Served " << stats.requests << " requests in " << stats.batches << " batches (mean batch size " << stats.mean_batch_size
+                  << ", mean latency " << stats.mean_latency << "ms, max latency " << stats.max_latency << "ms)" << std::endl;
+    };
+
+    if (desc.socket.empty()) {
+        std::cout << "Serving on the standard input" << std::endl;
+
+        serve_stream(*executor, sample, STDIN_FILENO, STDOUT_FILENO, features);
+
+        report();
+
+        return true;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (desc.socket.size() >= sizeof(address.sun_path)) {
+        std::cout << "dllp: error: the socket path is too long" << std::endl;
+        return false;
+    }
+
+    std::strncpy(address.sun_path, desc.socket.c_str(), sizeof(address.sun_path) - 1);
+
+    const int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    ::unlink(desc.socket.c_str());
+
+    if (server < 0 || ::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(server, 64) < 0) {
+        std::cout << "dllp: error: impossible to listen on " << desc.socket << ": " << std::strerror(errno) << std::endl;
+
+        if (server >= 0) {
+            ::close(server);
+        }
+
+        return false;
+    }
+
+    std::cout << "Serving on " << desc.socket << std::endl;
+
+    // Each connection has its own thread, all the connections share the executor
+    std::mutex lock;
+    std::condition_variable condition;
+    size_t connections = 0;
+
+    while (true) {
+        const int client = ::accept(server, nullptr, nullptr);
+
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            ++connections;
+        }
+
+        std::thread([&, client] {
+            serve_stream(*executor, sample, client, client, features);
+
+            ::close(client);
+
+            std::lock_guard<std::mutex> l(lock);
+            --connections;
+            condition.notify_all();
+        }).detach();
+    }
+
+    // The executor must outlive the connections
+    std::unique_lock<std::mutex> l(lock);
+    condition.wait(l, [&connections] { return !connections; });
+
+    ::close(server);
+    ::unlink(desc.socket.c_str());
+
+    report();
+
+    return true;
+}
+
+/*!
+ * \brief Indicates if the given actions serve the network on the standard
+ * output, in which case nothing else can be written to it
+ */
+inline bool serves_standard_output(const serving_desc& desc, const std::vector<std::string>& actions) {
+    return desc.socket.empty() && std::find(actions.begin(), actions.end(), "serve") != actions.end();
+}
+
+} //end of namespace processor
+
+} //end of namespace dll
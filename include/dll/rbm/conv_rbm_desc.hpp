@@ -38,6 +38,12 @@ struct conv_rbm_desc {
      */
     static constexpr size_t BatchSize         = detail::get_value_v<batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of shards of each batch for data-parallel
+     * Contrastive Divergence
+     */
+    static constexpr size_t Shards            = detail::get_value_v<data_parallel<1>, Parameters...>;
+
     /*!
      * \brief The type of visible unit
      */
@@ -95,13 +101,15 @@ public:
     static_assert(NC > 0, "At least one channel is necessary");
     static_assert(K > 0, "At least one group is necessary");
     static_assert(BatchSize > 0, "Batch size must be at least 1");
+    static_assert(Shards > 0, "The number of shards must be at least 1");
+    static_assert(BatchSize % Shards == 0, "The batch size must be divisible by the number of shards");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
                              momentum_id, batch_size_id, visible_id, hidden_id, dbn_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, clip_gradients_id,
-                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id, data_parallel_id, monitor_every_id>,
                          Parameters...>,
         "Invalid parameters type");
 
@@ -78,11 +78,17 @@ struct conv_rbm_impl final : public standard_crbm<conv_rbm_impl<Desc>, Desc> {
 
     conv_rbm_impl() : base_type() {
         if (is_relu(hidden_unit)) {
-            w = etl::normal_generator(0.0, 0.01);
+            if (!detail::skip_initialization()) {
+                w = etl::normal_generator(0.0, 0.01);
+            }
+
             b = 0.0;
             c = 0.0;
         } else {
-            w = 0.01 * etl::normal_generator();
+            if (!detail::skip_initialization()) {
+                w = 0.01 * etl::normal_generator();
+            }
+
             b = -0.1;
             c = 0.0;
         }
@@ -232,36 +238,6 @@ struct conv_rbm_impl final : public standard_crbm<conv_rbm_impl<Desc>, Desc> {
     friend base_type;
 
 private:
-    auto get_b_rep() const {
-        return etl::force_temporary(etl::rep<NH1, NH2>(b));
-    }
-
-    auto get_c_rep() const {
-        return etl::force_temporary(etl::rep<NV1, NV2>(c));
-    }
-
-    template<typename V>
-    auto get_batch_b_rep(V&& v) const {
-        if constexpr (etl::all_fast<V>) {
-            static constexpr auto batch_size = etl::decay_traits<V>::template dim<0>();
-            return etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NH1, NH2>(b)));
-        } else {
-            const auto batch_size = etl::dim<0>(v);
-            return etl::force_temporary(etl::rep_l(etl::rep<NH1, NH2>(b), batch_size));
-        }
-    }
-
-    template <typename H>
-    auto get_batch_c_rep(H&& h) const {
-        if constexpr (etl::all_fast<H>) {
-            static constexpr auto batch_size = etl::decay_traits<H>::template dim<0>();
-            return etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NV1, NV2>(c)));
-        } else {
-            const auto batch_size = etl::dim<0>(h);
-            return etl::force_temporary(etl::rep_l(etl::rep<NV1, NV2>(c), batch_size));
-        }
-    }
-
     template<typename H>
     auto reshape_h_a(H&& h_a) const {
         return etl::reshape<1, K, NH1, NH2>(h_a);
@@ -370,6 +346,9 @@ struct rbm_layer_base_traits<conv_rbm_impl<Desc>> {
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RBM's sparsity decay type
     static constexpr bool has_sparsity       = sparsity_method != dll::sparsity_method::NONE;              ///< Does the RBM has sparsity
+    static constexpr size_t shards           = get_value_l_v<data_parallel<1>, param>;                     ///< The number of shards for data-parallel CD
+    static constexpr size_t monitor_batches  = get_value_l_v<monitor_every<1>, param>;                     ///< The number of batches between two monitored batches
+    static constexpr bool has_sparse_input   = param::template contains<sparse_input>();                   ///< Does the RBM has sparse inputs
 };
 
 /*!
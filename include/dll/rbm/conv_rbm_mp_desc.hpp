@@ -41,6 +41,12 @@ struct conv_rbm_mp_desc {
      */
     static constexpr size_t BatchSize         = detail::get_value_v<batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of shards of each batch for data-parallel
+     * Contrastive Divergence
+     */
+    static constexpr size_t Shards            = detail::get_value_v<data_parallel<1>, Parameters...>;
+
     /*!
      * \brief The type of visible unit
      */
@@ -109,11 +115,13 @@ public:
         detail::is_valid_v<cpp::type_list<
                              momentum_id, batch_size_id, visible_id, hidden_id, pooling_id, dbn_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, bias_id, clip_gradients_id,
-                             weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             weight_type_id, shuffle_id, verbose_id, nop_id, data_parallel_id, monitor_every_id>,
                          Parameters...>,
         "Invalid parameters type");
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
+    static_assert(Shards > 0, "The number of shards must be at least 1");
+    static_assert(BatchSize % Shards == 0, "The batch size must be divisible by the number of shards");
 
     static_assert(Sparsity == sparsity_method::NONE || hidden_unit == unit_type::BINARY,
                   "Sparsity only works with binary hidden units");
@@ -54,6 +54,9 @@ struct dyn_conv_rbm_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! The shapes for which the convolutions are instantiated statically */
+    using static_shapes_t = detail::get_type_t<static_shapes<>, Parameters...>;
+
     /*! The type of the trainer to use to train the RBM */
     template <typename RBM>
     using trainer_t = typename detail::get_template_type<trainer_rbm<cd1_trainer_t>, Parameters...>::template value<RBM>;
@@ -73,7 +76,7 @@ struct dyn_conv_rbm_desc {
         detail::is_valid_v<cpp::type_list<
                              batch_size_id, momentum_id, visible_id, hidden_id, dbn_only_id, clip_gradients_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id,
-                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id, data_parallel_id, monitor_every_id, static_shapes_id>,
                          Parameters...>,
         "Invalid parameters type");
 
@@ -70,6 +70,8 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
     size_t nw1; ///< The first dimension of the filters
     size_t nw2; ///< The second dimension of the filters
 
+    size_t shape_index = desc::static_shapes_t::size; ///< The index of the static shape of the layer, if registered
+
     dyn_conv_rbm_impl() : base_type() {
         // Nothing else to init
     }
@@ -89,6 +91,8 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
         this->nc = nc;
         this->k = k;
 
+        this->shape_index = desc::static_shapes_t::find(nc, nv1, nv2, k, nw1, nw2);
+
         this->nh1 = nv1 - nw1 + 1;
         this->nh2 = nv2 - nw2 + 1;
 
@@ -109,11 +113,17 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
         h2_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
 
         if (is_relu(hidden_unit)) {
-            w = etl::normal_generator(0.0, 0.01);
+            if (!detail::skip_initialization()) {
+                w = etl::normal_generator(0.0, 0.01);
+            }
+
             b = 0.0;
             c = 0.0;
         } else {
-            w = 0.01 * etl::normal_generator();
+            if (!detail::skip_initialization()) {
+                w = 0.01 * etl::normal_generator();
+            }
+
             b = -0.1;
             c = 0.0;
         }
@@ -280,26 +290,6 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
     friend base_type;
 
 private:
-    auto get_b_rep() const {
-        return etl::force_temporary(etl::rep(b, nh1, nh2));
-    }
-
-    auto get_c_rep() const {
-        return etl::force_temporary(etl::rep(c, nv1, nv2));
-    }
-
-    template<typename V>
-    auto get_batch_b_rep(V&& v) const {
-        const auto batch_size = etl::dim<0>(v);
-        return etl::force_temporary(etl::rep_l(etl::rep(b, nh1, nh2), batch_size));
-    }
-
-    template<typename H>
-    auto get_batch_c_rep(H&& h) const {
-        const auto batch_size = etl::dim<0>(h);
-        return etl::force_temporary(etl::rep_l(etl::rep(c, nv1, nv2), batch_size));
-    }
-
     template<typename H>
     auto reshape_h_a(H&& h_a) const {
         return etl::reshape(h_a, 1, k, nh1, nh2);
@@ -372,6 +362,9 @@ struct rbm_layer_base_traits<dyn_conv_rbm_impl<Desc>> {
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RMB's sparsity decay type
     static constexpr bool has_sparsity       = sparsity_method != dll::sparsity_method::NONE;              ///< Does the RBM has sparsity
+    static constexpr size_t shards           = 1;                                                          ///< The dynamic RBMs are always trained on one thread
+    static constexpr size_t monitor_batches  = get_value_l_v<monitor_every<1>, param>;                     ///< The number of batches between two monitored batches
+    static constexpr bool has_sparse_input   = param::template contains<sparse_input>();                   ///< Does the RBM has sparse inputs
 };
 
 /*!
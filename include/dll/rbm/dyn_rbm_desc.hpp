@@ -42,6 +42,11 @@ struct dyn_rbm_desc {
      */
     static constexpr unit_type hidden_unit    = detail::get_value_v<hidden<unit_type::BINARY>, Parameters...>;
 
+    /*!
+     * \brief The precision of the sigmoid of the binary units
+     */
+    static constexpr function_precision precision = detail::get_value_v<activation_precision<function_precision::EXACT>, Parameters...>;
+
     /*!
      * \brief The sparsity penalty for pretraining
      */
@@ -66,13 +71,16 @@ struct dyn_rbm_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<batch_size_id, momentum_id, visible_id, hidden_id, weight_decay_id, verbose_id,
-                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id>,
+        detail::is_valid_v<cpp::type_list<batch_size_id, momentum_id, visible_id, hidden_id, activation_precision_id, weight_decay_id, verbose_id,
+                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id, data_parallel_id, monitor_every_id, sparse_input_id>,
                          Parameters...>,
         "Invalid parameters type");
 
     static_assert(Sparsity == sparsity_method::NONE || hidden_unit == unit_type::BINARY,
                   "Sparsity only works with binary hidden units");
+
+    static_assert(!parameters::template contains<sparse_input>() || hidden_unit == unit_type::BINARY,
+                  "sparse_input only works with binary hidden units");
 };
 
 /*!
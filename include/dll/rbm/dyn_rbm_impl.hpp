@@ -89,7 +89,9 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
               num_visible(num_visible),
               num_hidden(num_hidden) {
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
-        w = etl::normal_generator<weight>() * 0.1;
+        if (!detail::skip_initialization()) {
+            w = etl::normal_generator<weight>() * 0.1;
+        }
     }
 
     /*!
@@ -111,7 +113,9 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
         h2_s = etl::dyn_vector<weight>(num_hidden);
 
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
-        w = etl::normal_generator<weight>() * 0.1;
+        if (!detail::skip_initialization()) {
+            w = etl::normal_generator<weight>() * 0.1;
+        }
     }
 
     /*!
@@ -302,6 +306,9 @@ struct rbm_layer_base_traits<dyn_rbm_impl<Desc>> {
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RMB's sparsity decay type
     static constexpr bool has_sparsity       = sparsity_method != dll::sparsity_method::NONE;              ///< Does the RBM has sparsity
+    static constexpr size_t shards           = 1;                                                          ///< The dynamic RBMs are always trained on one thread
+    static constexpr size_t monitor_batches  = get_value_l_v<monitor_every<1>, param>;                     ///< The number of batches between two monitored batches
+    static constexpr bool has_sparse_input   = param::template contains<sparse_input>();                   ///< Does the RBM has sparse inputs
 };
 
 /*!
@@ -353,8 +360,8 @@ struct cg_context<dyn_rbm_impl<Desc>> {
     etl::dyn_matrix<weight, 2> gr_w_tmp;
     etl::dyn_matrix<weight, 1> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs; ///< The activation probabilities of the batch, one sample per row
+    etl::dyn_matrix<weight, 2> gr_diffs; ///< The diffs of the batch, one sample per row
 
     cg_context(size_t num_visible, size_t num_hidden) :
         gr_w_incs(num_visible, num_hidden), gr_b_incs(num_hidden),
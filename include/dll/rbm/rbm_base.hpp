@@ -91,6 +91,15 @@ struct rbm_base : layer<Parent> {
         as_derived().c = *as_derived().bak_c;
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        as_derived().bak_w.reset();
+        as_derived().bak_b.reset();
+        as_derived().bak_c.reset();
+    }
+
     /*!
      * \brief Compute the reconstruction error for the given input
      */
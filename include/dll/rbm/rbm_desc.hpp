@@ -9,6 +9,7 @@
 
 #include "dll/base_conf.hpp"
 #include "dll/contrastive_divergence.hpp"
+#include "dll/parallel_tempering.hpp"
 #include "dll/watcher.hpp"
 #include "dll/util/tmp.hpp"
 
@@ -35,6 +36,12 @@ struct rbm_desc {
      */
     static constexpr size_t BatchSize    = detail::get_value_v<batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of shards of each batch for data-parallel
+     * Contrastive Divergence
+     */
+    static constexpr size_t Shards       = detail::get_value_v<data_parallel<1>, Parameters...>;
+
     /*!
      * \brief The type of visible unit
      */
@@ -45,6 +52,11 @@ struct rbm_desc {
      */
     static constexpr unit_type hidden_unit    = detail::get_value_v<hidden<unit_type::BINARY>, Parameters...>;
 
+    /*!
+     * \brief The precision of the sigmoid of the binary units
+     */
+    static constexpr function_precision precision = detail::get_value_v<activation_precision<function_precision::EXACT>, Parameters...>;
+
     /*!
      * \brief The sparsity penalty for pretraining
      */
@@ -72,17 +84,22 @@ struct rbm_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<momentum_id, verbose_id, batch_size_id, visible_id,
+        detail::is_valid_v<cpp::type_list<momentum_id, verbose_id, batch_size_id, visible_id, activation_precision_id,
                                         hidden_id, weight_decay_id, init_weights_id, sparsity_id, trainer_rbm_id, watcher_id,
-                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id>,
+                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id, data_parallel_id, monitor_every_id, sparse_input_id>,
                          Parameters...>,
         "Invalid parameters type for rbm_desc");
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
+    static_assert(Shards > 0, "The number of shards must be at least 1");
+    static_assert(BatchSize % Shards == 0, "The batch size must be divisible by the number of shards");
 
     static_assert(Sparsity == sparsity_method::NONE || hidden_unit == unit_type::BINARY,
                   "Sparsity only works with binary hidden units");
 
+    static_assert(!parameters::template contains<sparse_input>() || hidden_unit == unit_type::BINARY,
+                  "sparse_input only works with binary hidden units");
+
     /*!
      * The layer type
      */
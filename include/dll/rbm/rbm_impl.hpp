@@ -86,7 +86,9 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
     rbm_impl()
             : standard_rbm<rbm_impl<Desc>, Desc>(), b(0.0), c(0.0) {
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
-        w = etl::normal_generator<weight>() * 0.1;
+        if (!detail::skip_initialization()) {
+            w = etl::normal_generator<weight>() * 0.1;
+        }
     }
 
     /*!
@@ -271,6 +273,9 @@ struct rbm_layer_base_traits<rbm_impl<Desc>> {
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RMB's sparsity decay type
     static constexpr bool has_sparsity       = sparsity_method != dll::sparsity_method::NONE;              ///< Does the RBM has sparsity
+    static constexpr size_t shards           = get_value_l_v<data_parallel<1>, param>;                     ///< The number of shards for data-parallel CD
+    static constexpr size_t monitor_batches  = get_value_l_v<monitor_every<1>, param>;                     ///< The number of batches between two monitored batches
+    static constexpr bool has_sparse_input   = param::template contains<sparse_input>();                   ///< Does the RBM has sparse inputs
 };
 
 /*!
@@ -328,8 +333,8 @@ struct cg_context<rbm_impl<Desc>> {
     etl::fast_matrix<weight, num_visible, num_hidden> gr_w_tmp;
     etl::fast_vector<weight, num_hidden> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs; ///< The activation probabilities of the batch, one sample per row
+    etl::dyn_matrix<weight, 2> gr_diffs; ///< The diffs of the batch, one sample per row
 };
 
 } //end of dll namespace
@@ -12,6 +12,7 @@
 #include "dll/layer_traits.hpp" //layer_traits
 #include "dll/util/checks.hpp"  //nan_check
 #include "dll/util/timers.hpp"  //auto_timer
+#include "dll/util/fft_conv.hpp" //conv_fft_plan
 
 namespace dll {
 
@@ -45,6 +46,8 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
     static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit),
                   "Only binary hidden units are supported");
 
+    conv_fft_plan<weight> fft; ///< The spectra of the filters, computed by the trainer while they are fixed
+
     //Constructors
 
     /*!
@@ -60,6 +63,38 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
                                                                        : /* Only Gaussian Units needs lower rate */ 1e-3;
     }
 
+    /*!
+     * \brief Compute the valid convolutions of a batch of visible maps with
+     * the filters, with the spectra of the filters when they are ready.
+     */
+    template <typename H, typename V>
+    void batch_conv_hidden(H&& h_a, const V& v_a) const {
+        if (fft.ready()) {
+            fft.valid_flipped(h_a, v_a);
+        } else if (!static_conv(v_a, [&](auto B, auto NC, auto NV1, auto NV2, auto K, auto NW1, auto NW2) {
+                       etl::reshape<B, K, NV1 - NW1 + 1, NV2 - NW2 + 1>(h_a) =
+                           etl::conv_4d_valid_flipped(etl::reshape<B, NC, NV1, NV2>(v_a), etl::reshape<K, NC, NW1, NW2>(as_derived().w));
+                   })) {
+            h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        }
+    }
+
+    /*!
+     * \brief Compute the full convolutions of a batch of hidden maps with
+     * the filters, with the spectra of the filters when they are ready.
+     */
+    template <typename V, typename H>
+    void batch_conv_visible(V&& v_a, const H& h_s) const {
+        if (fft.ready()) {
+            fft.full(v_a, h_s);
+        } else if (!static_conv(h_s, [&](auto B, auto NC, auto NV1, auto NV2, auto K, auto NW1, auto NW2) {
+                       etl::reshape<B, NC, NV1, NV2>(v_a) =
+                           etl::conv_4d_full(etl::reshape<B, K, NV1 - NW1 + 1, NV2 - NW2 + 1>(h_s), etl::reshape<K, NC, NW1, NW2>(as_derived().w));
+                   })) {
+            v_a = etl::conv_4d_full(h_s, as_derived().w);
+        }
+    }
+
     //Utility functions
 
     /*!
@@ -144,9 +179,60 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
         return free_energy(as_derived().v1);
     }
 
+    /*!
+     * \brief Return the energy of gaussian visible units, sum((v - c) ^ 2) / 2,
+     * each visible bias being broadcast over its channel
+     *
+     * \param rv One input, reshaped (1 x NC x NV1 x NV2)
+     */
+    template <typename V>
+    weight gaussian_visible_energy(const V& rv) const {
+        weight energy = 0;
+
+        for (size_t k = 0; k < etl::dim<1>(rv); ++k) {
+            energy += etl::sum(etl::pow(rv(0)(k) - as_derived().c(k), 2));
+        }
+
+        return energy / 2.0;
+    }
+
     friend base_type;
 
 private:
+    /*!
+     * \brief Run the given convolution with the static dimensions of the
+     * layer, for the dynamic layers of a registered shape and full batches.
+     *
+     * The functor receives the dimensions as integral constants.
+     *
+     * \return true if the convolution was run, false otherwise
+     */
+    template <typename X, typename Functor>
+    bool static_conv(const X& x, Functor&& functor) const {
+        if constexpr (layer_traits<parent_t>::is_dynamic()) {
+            constexpr size_t B = parent_t::batch_size;
+
+            if (etl::dim<0>(x) != B) {
+                return false;
+            }
+
+            return desc::static_shapes_t::dispatch(as_derived().shape_index, [&](auto shape) {
+                using shape_t = decltype(shape);
+
+                functor(std::integral_constant<size_t, B>{},
+                        std::integral_constant<size_t, shape_t::dims[0]>{}, std::integral_constant<size_t, shape_t::dims[1]>{},
+                        std::integral_constant<size_t, shape_t::dims[2]>{}, std::integral_constant<size_t, shape_t::dims[3]>{},
+                        std::integral_constant<size_t, shape_t::dims[4]>{}, std::integral_constant<size_t, shape_t::dims[5]>{});
+
+                return true;
+            });
+        } else {
+            cpp_unused(x);
+            cpp_unused(functor);
+            return false;
+        }
+    }
+
     //Since the sub classes do not have the same fields, it is not possible
     //to put the fields in standard_rbm, therefore, it is necessary to use template
     //functions to implement the details
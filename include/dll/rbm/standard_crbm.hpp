@@ -24,6 +24,7 @@
 
 #include "standard_conv_rbm.hpp" //The base class
 #include "rbm_tmp.hpp"           // static_if macros
+#include "dll/util/gibbs.hpp"    // sigmoid_bernoulli
 
 namespace dll {
 
@@ -58,7 +59,8 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2& /*v_s*/) const {
-        dll::auto_timer timer("crbm:activate_hidden");
+        static dll::timer_id timer_handle("crbm:activate_hidden");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type");
         static_assert(P, "Computing S without P is not implemented");
@@ -67,20 +69,22 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        auto b_rep = as_derived().get_b_rep();
+        auto rh_a = as_derived().reshape_h_a(h_a);
 
-        as_derived().reshape_h_a(h_a) = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        rh_a = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+
+        add_bias_4d(rh_a, as_derived().b);
 
         // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(h_a), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(h_a, 6.0), 0.0), 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(h_a, 1.0), 0.0), 1.0));
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::sigmoid(b_rep + h_a));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::sigmoid((1.0 / (0.1 * 0.1)) >> (b_rep + h_a)));
-        H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
+        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::sigmoid(h_a));
+        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::sigmoid((1.0 / (0.1 * 0.1)) >> h_a));
+        H_PROBS(unit_type::RELU, h_a = max(h_a, 0.0));
+        H_PROBS(unit_type::RELU6, h_a = min(max(h_a, 0.0), 6.0));
+        H_PROBS(unit_type::RELU1, h_a = min(max(h_a, 0.0), 1.0));
 
         H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
 
@@ -98,7 +102,8 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void activate_visible(const H1& /*h_a*/, const H2& h_s, V1&& v_a, V2&& v_s) const {
-        dll::auto_timer timer("crbm:activate_visible");
+        static dll::timer_id timer_handle("crbm:activate_visible");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
         static_assert(P, "Computing S without P is not implemented");
@@ -107,12 +112,13 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        as_derived().reshape_v_a(v_a) = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
+        auto rv_a = as_derived().reshape_v_a(v_a);
+
+        rv_a = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
 
-        auto c_rep = as_derived().get_c_rep();
+        add_bias_4d(rv_a, as_derived().c);
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
-        V_PROBS(unit_type::GAUSSIAN, v_a = c_rep + v_a);
+        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(v_a));
 
         nan_check_deep(v_a);
 
@@ -126,7 +132,8 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void batch_activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2& /*v_s*/) const {
-        dll::auto_timer timer("crbm:batch_activate_hidden");
+        static dll::timer_id timer_handle("crbm:batch_activate_hidden");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type");
         static_assert(P, "Computing S without P is not implemented");
@@ -135,24 +142,31 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        as_derived().batch_conv_hidden(h_a, v_a);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
+        if constexpr (S && hidden_unit == unit_type::BINARY && visible_unit == unit_type::BINARY) {
+            // Bias, sigmoid and sampling in one pass over the result of the convolution
+            sigmoid_bernoulli(h_a, h_s, as_derived().b);
 
-        // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+            nan_check_deep(h_a);
+        } else {
+            add_bias_4d(h_a, as_derived().b);
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::sigmoid(b_rep + h_a));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::sigmoid((1.0 / (0.1 * 0.1)) >> (b_rep + h_a)));
-        H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
+            // Need to be done before h_a is computed!
+            H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(h_a), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(h_a, 6.0), 0.0), 6.0));
+            H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(h_a, 1.0), 0.0), 1.0));
 
-        nan_check_deep(h_a);
+            H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::sigmoid(h_a));
+            H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::sigmoid((1.0 / (0.1 * 0.1)) >> h_a));
+            H_PROBS(unit_type::RELU, h_a = max(h_a, 0.0));
+            H_PROBS(unit_type::RELU6, h_a = min(max(h_a, 0.0), 6.0));
+            H_PROBS(unit_type::RELU1, h_a = min(max(h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+            nan_check_deep(h_a);
+
+            H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        }
 
         if (S) {
             nan_check_deep(h_s);
@@ -161,24 +175,30 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void batch_activate_visible(const H1& /*h_a*/, const H2& h_s, V1&& v_a, V2&& v_s) const {
-        dll::auto_timer timer("crbm:batch_activate_visible");
+        static dll::timer_id timer_handle("crbm:batch_activate_visible");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
         static_assert(P, "Computing S without P is not implemented");
 
         as_derived().template validate_outputs<H1, H2, 1>();
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
+        as_derived().batch_conv_visible(v_a, h_s);
 
-        auto c_rep = as_derived().get_batch_c_rep(h_s);
+        if constexpr (S && visible_unit == unit_type::BINARY) {
+            // Bias, sigmoid and sampling in one pass over the result of the convolution
+            sigmoid_bernoulli(v_a, v_s, as_derived().c);
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
-        V_PROBS(unit_type::GAUSSIAN, v_a = c_rep + v_a);
+            nan_check_deep(v_a);
+        } else {
+            add_bias_4d(v_a, as_derived().c);
 
-        nan_check_deep(v_a);
+            V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(v_a));
 
-        V_SAMPLE_PROBS(unit_type::BINARY, v_s = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+            nan_check_deep(v_a);
+
+            V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+        }
 
         if (S) {
             nan_check_deep(v_s);
@@ -205,8 +225,7 @@ private:
             //Definition according to Honglak Lee / Mixed with Gaussian
             //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk - sum_v ((v - c) ^ 2 / 2)
 
-            auto c_rep = as_derived().get_c_rep();
-            return -sum(etl::pow(rv(0) - c_rep, 2) / 2.0) - etl::sum(as_derived().b >> etl::sum_r(h)) - etl::sum(h >> tmp(0));
+            return -this->gaussian_visible_energy(rv) - etl::sum(as_derived().b >> etl::sum_r(h)) - etl::sum(h >> tmp(0));
         } else {
             return 0.0;
         }
@@ -221,16 +240,17 @@ private:
         if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            auto b_rep = as_derived().get_b_rep();
-            auto x = b_rep + tmp(0);
+            add_bias_4d(tmp, as_derived().b);
+
+            auto x = tmp(0);
             return -etl::sum(as_derived().c >> etl::sum_r(rv(0))) - etl::sum(etl::log(1.0 + etl::exp(x)));
         } else if constexpr (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            auto b_rep = as_derived().get_b_rep();
-            auto x = b_rep + tmp(0);
-            auto c_rep = as_derived().get_c_rep();
-            return -sum(etl::pow(rv(0) - c_rep, 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(x)));
+            add_bias_4d(tmp, as_derived().b);
+
+            auto x = tmp(0);
+            return -this->gaussian_visible_energy(rv) - etl::sum(etl::log(1.0 + etl::exp(x)));
         } else {
             return 0.0;
         }
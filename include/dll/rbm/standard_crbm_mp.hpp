@@ -25,6 +25,7 @@
 #include "dll/rbm/standard_conv_rbm.hpp" //The base class
 #include "dll/base_conf.hpp"             //The configuration helpers
 #include "dll/rbm/rbm_tmp.hpp"           // static_if macros
+#include "dll/util/gibbs.hpp"            // sigmoid_bernoulli
 
 namespace dll {
 
@@ -62,27 +63,30 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2&) const {
-        dll::auto_timer timer("crbm:mp:activate_hidden");
+        static dll::timer_id timer_handle("crbm:mp:activate_hidden");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type");
         static_assert(P, "Computing S without P is not implemented");
 
-        auto b_rep = as_derived().get_b_rep();
+        auto rh_a = as_derived().reshape_h_a(h_a);
 
-        as_derived().reshape_h_a(h_a) = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        rh_a = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+
+        add_bias_4d(rh_a, as_derived().b);
 
         // Note: this is wrong because of PMP
 
         // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(h_a), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(h_a, 6.0), 0.0), 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(h_a, 1.0), 0.0), 1.0));
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
-        H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
+        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(h_a, this->C(), this->C()));
+        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> h_a, this->C(), this->C()));
+        H_PROBS(unit_type::RELU, h_a = max(h_a, 0.0));
+        H_PROBS(unit_type::RELU6, h_a = min(max(h_a, 0.0), 6.0));
+        H_PROBS(unit_type::RELU1, h_a = min(max(h_a, 0.0), 1.0));
 
         H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
 
@@ -95,19 +99,21 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void activate_visible(const H1&, const H2& h_s, V1&& v_a, V2&& v_s) const {
-        dll::auto_timer timer("crbm:mp:activate_visible");
+        static dll::timer_id timer_handle("crbm:mp:activate_visible");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
         static_assert(P, "Computing S without P is not implemented");
 
         using namespace etl;
 
-        as_derived().reshape_v_a(v_a) = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
+        auto rv_a = as_derived().reshape_v_a(v_a);
+
+        rv_a = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
 
-        auto c_rep = as_derived().get_c_rep();
+        add_bias_4d(rv_a, as_derived().c);
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
-        V_PROBS(unit_type::GAUSSIAN, v_a = c_rep + v_a);
+        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(v_a));
 
         nan_check_deep(v_a);
 
@@ -121,18 +127,19 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename Po, typename V>
     void activate_pooling(Po& p_a, Po& p_s, const V& v_a, const V&) const {
-        dll::auto_timer timer("crbm:mp:activate_pooling");
+        static dll::timer_id timer_handle("crbm:mp:activate_pooling");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(pooling_unit == unit_type::BINARY, "Invalid pooling unit type");
         static_assert(P, "Computing S without P is not implemented");
 
-        auto b_rep = as_derived().get_b_rep();
-
         auto v_cv = as_derived().energy_tmp();
         v_cv = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
 
+        add_bias_4d(v_cv, as_derived().b);
+
         if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + v_cv(0), C(), C());
+            p_a = etl::p_max_pool_p(v_cv(0), C(), C());
         }
 
         nan_check_etl(p_a);
@@ -148,7 +155,8 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void batch_activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2&) const {
-        dll::auto_timer timer("crbm:mp:batch_activate_hidden");
+        static dll::timer_id timer_handle("crbm:mp:batch_activate_hidden");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type");
         static_assert(P, "Computing S without P is not implemented");
@@ -159,24 +167,25 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        as_derived().batch_conv_hidden(h_a, v_a);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
+        if constexpr (hidden_unit == unit_type::BINARY) {
+            // Bias, softmax of the blocks and sampling of the blocks in one pass over the result of the convolution
+            const weight scale = visible_unit == unit_type::GAUSSIAN ? 1.0 / (0.1 * 0.1) : 1.0;
 
-        // Note: this is wrong because of PMP
-
-        // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+            p_max_pool_hidden<S>(h_a, h_s, as_derived().b, this->C(), scale);
+        } else {
+            add_bias_4d(h_a, as_derived().b);
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
-        H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
+            // Need to be done before h_a is computed!
+            H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(h_a), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(h_a, 6.0), 0.0), 6.0));
+            H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(h_a, 1.0), 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+            H_PROBS(unit_type::RELU, h_a = max(h_a, 0.0));
+            H_PROBS(unit_type::RELU6, h_a = min(max(h_a, 0.0), 6.0));
+            H_PROBS(unit_type::RELU1, h_a = min(max(h_a, 0.0), 1.0));
+        }
 
         nan_check_deep(h_a);
 
@@ -187,7 +196,8 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
     template <bool P = true, bool S = true, typename Po, typename V>
     void batch_activate_pooling(Po& p_a, Po& p_s, const V& v_a, const V&) const {
-        dll::auto_timer timer("crbm:mp:activate_pooling");
+        static dll::timer_id timer_handle("crbm:mp:activate_pooling");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(pooling_unit == unit_type::BINARY, "Invalid pooling unit type");
         static_assert(P, "Computing S without P is not implemented");
@@ -198,35 +208,27 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
-
         auto h_a = etl::force_temporary(etl::conv_4d_valid_flipped(v_a, as_derived().w));
 
-        if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + h_a, C(), C());
-        }
+        // Bias, softmax of the blocks and sampling of the pooling units in one pass
+        p_max_pool_pooling<S>(p_a, p_s, h_a, as_derived().b, C());
 
         nan_check_etl(p_a);
 
         if (S) {
-            if (pooling_unit == unit_type::BINARY) {
-                p_s = r_bernoulli(p_a);
-            }
-
             nan_check_etl(p_s);
         }
     }
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void batch_activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s) const {
-        dll::auto_timer timer("crbm:mp:batch_activate_visible");
+        static dll::timer_id timer_handle("crbm:mp:batch_activate_visible");
+        dll::auto_timer timer(timer_handle);
 
         static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
         static_assert(P, "Computing S without P is not implemented");
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
-
-        auto c_rep = as_derived().get_batch_c_rep(h_s);
+        as_derived().batch_conv_visible(v_a, h_s);
 
         const auto Batch = etl::dim<0>(h_a);
         cpp_assert(etl::dim<0>(h_s) == Batch, "The number of batch must be consistent");
@@ -234,11 +236,16 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_s) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
-        V_PROBS(unit_type::GAUSSIAN, v_a = c_rep + v_a);
+        if constexpr (S && visible_unit == unit_type::BINARY) {
+            // Bias, sigmoid and sampling in one pass over the result of the convolution
+            sigmoid_bernoulli(v_a, v_s, as_derived().c);
+        } else {
+            add_bias_4d(v_a, as_derived().c);
+
+            V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(v_a));
 
-        V_SAMPLE_PROBS(unit_type::BINARY, v_s = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+            V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+        }
 
         nan_check_deep(v_a);
 
@@ -306,17 +313,19 @@ private:
         auto tmp = as_derived().energy_tmp();
         tmp = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(rv), as_derived().w);
 
+        // The hidden biases are added to the convolution: sum_k hk . (Wk*v + bk)
+        add_bias_4d(tmp, as_derived().b);
+
         if  constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee
             //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk - c sum_v v
 
-            return -etl::sum(as_derived().c >> etl::sum_r(rv(0))) - etl::sum((h >> tmp(0)) + (as_derived().get_b_rep() >> h));
+            return -etl::sum(as_derived().c >> etl::sum_r(rv(0))) - etl::sum(h >> tmp(0));
         } else if  constexpr (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee / Mixed with Gaussian
             //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk - sum_v ((v - c) ^ 2 / 2)
 
-            auto c_rep = as_derived().get_c_rep();
-            return sum(etl::pow(rv(0) - c_rep, 2) / 2.0) - etl::sum((h >> tmp(0)) + (as_derived().get_b_rep() >> h));
+            return this->gaussian_visible_energy(rv) - etl::sum(h >> tmp(0));
         } else {
             return 0.0;
         }
@@ -331,18 +340,17 @@ private:
         if  constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            auto b_rep = as_derived().get_b_rep();
-            auto x = b_rep + tmp(0);
+            add_bias_4d(tmp, as_derived().b);
+
+            auto x = tmp(0);
 
             return -etl::sum(as_derived().c >> etl::sum_r(rv(0))) - etl::sum(etl::log(1.0 + etl::exp(x)));
         } else if  constexpr (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            auto b_rep = as_derived().get_b_rep();
-            auto x = b_rep + tmp(0);
-            auto c_rep = as_derived().get_c_rep();
+            add_bias_4d(tmp, as_derived().b);
 
-            return -sum(etl::pow(rv(0) - c_rep, 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(x)));
+            return -this->gaussian_visible_energy(rv) - etl::sum(etl::log(1.0 + etl::exp(tmp(0))));
         } else {
             return 0.0;
         }
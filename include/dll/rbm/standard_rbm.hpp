@@ -20,6 +20,7 @@
 
 #include "dll/util/checks.hpp"    //NaN checks
 #include "dll/util/timers.hpp"    //auto_timer
+#include "dll/util/gibbs.hpp"     //sigmoid_bernoulli
 #include "dll/rbm/rbm_base.hpp"       //The base class
 #include "dll/base_conf.hpp"      //Descriptor configuration
 #include "dll/rbm/rbm_tmp.hpp"        // static_if macros
@@ -187,6 +188,23 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, as_derived().b, as_derived().w);
     }
 
+    /*!
+     * \brief Compute the hidden representation from the given batch of input.
+     *
+     * Special functions to be used by optimizer.
+     *
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v_a The batch input activation probabilities of the visible representation
+     * \param v_s The batch input the activation samples of the visible representation
+     * \param b The biases
+     * \param w The weights
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w) const {
+        batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w);
+    }
+
     /*!
      * \brief Compute the hidden representation from a given batch of input
      *
@@ -487,7 +505,8 @@ private:
     template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
     void std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) const {
         if constexpr (etl::decay_traits<V>::dimensions() == 1) {
-            dll::auto_timer timer("rbm:std:activate_hidden");
+            static dll::timer_id timer_handle("rbm:std:activate_hidden");
+            dll::auto_timer timer(timer_handle);
 
             using namespace etl;
 
@@ -527,7 +546,8 @@ private:
 
     template <bool P = true, bool S = true, typename H, typename V, typename C, typename W>
     static void std_activate_visible(const H&, const H& h_s, V&& v_a, V&& v_s, const C& c, const W& w) {
-        dll::auto_timer timer("rbm:std:activate_visible");
+        static dll::timer_id timer_handle("rbm:std:activate_visible");
+        dll::auto_timer timer(timer_handle);
 
         using namespace etl;
 
@@ -550,7 +570,8 @@ private:
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
     static void batch_std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) {
-        dll::auto_timer timer("rbm:std:batch_activate_hidden");
+        static dll::timer_id timer_handle("rbm:std:batch_activate_hidden");
+        dll::auto_timer timer(timer_handle);
 
         using namespace etl;
 
@@ -558,7 +579,14 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(rep_l(b, Batch) + v_a * w));
+        if constexpr (P && S && hidden_unit == unit_type::BINARY) {
+            // Bias, sigmoid and sampling in one pass over the result of the GEMM
+            h_a = v_a * w;
+            sigmoid_bernoulli<desc::precision>(h_a, h_s, b);
+        } else {
+            H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(rep_l(b, Batch) + v_a * w));
+        }
+
         H_PROBS(unit_type::RELU, h_a = max(rep_l(b, Batch) + v_a * w, 0.0));
         H_PROBS(unit_type::RELU1, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
         H_PROBS(unit_type::RELU6, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0));
@@ -571,7 +599,6 @@ private:
             }
         }
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
         H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
         H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
         H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
@@ -604,7 +631,8 @@ private:
 
     template <bool P = true, bool S = true, typename H, typename V, typename C, typename W>
     static void batch_std_activate_visible(const H&, const H& h_s, V&& v_a, V&& v_s, const C& c, const W& w) {
-        dll::auto_timer timer("rbm:std:batch_activate_visible");
+        static dll::timer_id timer_handle("rbm:std:batch_activate_visible");
+        dll::auto_timer timer(timer_handle);
 
         using namespace etl;
 
@@ -612,7 +640,14 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
+        if constexpr (P && S && visible_unit == unit_type::BINARY) {
+            // Bias, sigmoid and sampling in one pass over the result of the GEMM
+            v_a = transpose(w * transpose(h_s));
+            sigmoid_bernoulli<desc::precision>(v_a, v_s, c);
+        } else {
+            V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
+        }
+
         V_PROBS(unit_type::GAUSSIAN, v_a = rep_l(c, Batch) + transpose(w * transpose(h_s)));
         V_PROBS(unit_type::RELU, v_a = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
 
@@ -80,6 +80,18 @@ using adam = updater<updater_type::ADAM>;
  */
 using nadam = updater<updater_type::NADAM>;
 
+/*!
+ * \brief Specify that a network uses the LARS updater for
+ * gradient descent.
+ */
+using lars = updater<updater_type::LARS>;
+
+/*!
+ * \brief Specify that a network uses the LAMB updater for
+ * gradient descent.
+ */
+using lamb = updater<updater_type::LAMB>;
+
 /*!
  * \brief Specify that the network should not output anything
  */
@@ -12,11 +12,27 @@
 
 #ifdef DLL_SVM_SUPPORT
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include <unistd.h> // For close
 
 #include "cpp_utils/io.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
 #include "nice_svm.hpp"
 
+#include "dll/util/linear_svm.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/scheduler.hpp"
+
 namespace dll {
 
 inline svm_parameter default_svm_parameters() {
@@ -31,59 +47,343 @@ inline svm_parameter default_svm_parameters() {
     return parameters;
 }
 
+/*!
+ * \brief The grid of a parallel RBF grid search.
+ *
+ * The values of C and gamma are spaced logarithmically. With successive
+ * halving, all the cells are first evaluated on a subset of the samples,
+ * and only the best 1/halving of them are evaluated again on a subset
+ * halving times larger, until the full set.
+ */
+struct svm_rbf_grid {
+    double c_first     = 1e-2; ///< The first value of C
+    double c_last      = 1e4;  ///< The last value of C
+    size_t c_steps     = 7;    ///< The number of values of C
+    double gamma_first = 1e-5; ///< The first value of gamma
+    double gamma_last  = 1e1;  ///< The last value of gamma
+    size_t gamma_steps = 7;    ///< The number of values of gamma
+    size_t halving     = 0;    ///< The reduction factor of successive halving (0 to evaluate all the cells on all the samples)
+};
+
+namespace detail {
+
+/*!
+ * \brief Write n values to the given stream, in one write
+ */
+template <typename T>
+void svm_write_array(std::ostream& os, const T* values, size_t n) {
+    os.write(reinterpret_cast<const char*>(values), n * sizeof(T));
+}
+
+/*!
+ * \brief Read n values from the given stream into a new array, allocated
+ * with malloc as libsvm frees it.
+ */
+template <typename T>
+T* svm_read_array(std::istream& is, size_t n) {
+    auto* values = static_cast<T*>(std::malloc(std::max<size_t>(1, n) * sizeof(T)));
+
+    is.read(reinterpret_cast<char*>(values), n * sizeof(T));
+
+    return values;
+}
+
+/*!
+ * \brief Write an optional array to the given stream, preceded by its presence
+ */
+template <typename T>
+void svm_write_optional(std::ostream& os, const T* values, size_t n) {
+    cpp::binary_write(os, values != nullptr);
+
+    if (values) {
+        svm_write_array(os, values, n);
+    }
+}
+
+/*!
+ * \brief Read an optional array from the given stream
+ */
+template <typename T>
+T* svm_read_optional(std::istream& is, size_t n) {
+    bool present = false;
+    cpp::binary_load(is, present);
+
+    return present ? svm_read_array<T>(is, n) : nullptr;
+}
+
+/*!
+ * \brief Append the non-zero values of a segment of the features of a
+ * sample to its nodes.
+ *
+ * libsvm considers the missing features as zeros, the nodes are therefore
+ * as sparse as the features.
+ *
+ * \param nodes The nodes of the sample
+ * \param k The number of nodes already written for the sample
+ * \param values The values of the segment
+ * \param size The number of values of the segment
+ * \param offset The index of the first feature of the segment
+ *
+ * \return The number of nodes written for the sample
+ */
+template <typename T>
+size_t svm_append_nodes(svm_node* nodes, size_t k, const T* values, size_t size, size_t offset) {
+    for (size_t j = 0; j < size; ++j) {
+        if (values[j] != T(0)) {
+            nodes[k].index = int(offset + j + 1);
+            nodes[k].value = values[j];
+            ++k;
+        }
+    }
+
+    return k;
+}
+
+/*!
+ * \brief Terminate the k nodes of a sample
+ */
+inline void svm_terminate_nodes(svm_node* nodes, size_t k) {
+    nodes[k].index = -1;
+    nodes[k].value = 0.0;
+}
+
+constexpr uint32_t svm_magic   = 0x4D565344; ///< The magic number of the stored SVM models ("DSVM")
+constexpr uint32_t svm_version = 1;          ///< The version of the stored SVM models
+
+/*!
+ * \brief Load a SVM model stored by the previous versions, as the flag of
+ * the model followed by the libsvm text format until the end of the
+ * stream.
+ *
+ * libsvm can only parse its text format from a file, the model is
+ * therefore copied into a temporary file.
+ */
+template <typename DBN>
+void svm_load_text(DBN& dbn, std::istream& is) {
+    bool svm;
+    cpp::binary_load(is, svm);
+
+    if (!is || !svm) {
+        return;
+    }
+
+    char path[] = "/tmp/dll_svm_XXXXXX";
+
+    const int fd = mkstemp(path);
+
+    if (fd < 0) {
+        std::cerr << "ERROR: Impossible to create a temporary file for the SVM model" << std::endl;
+        return;
+    }
+
+    close(fd);
+
+    {
+        std::ofstream svm_os(path, std::ios::binary);
+        svm_os << is.rdbuf();
+    }
+
+    dbn.svm_model  = svm::load(path);
+    dbn.svm_loaded = true;
+
+    std::remove(path);
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Store the SVM model of the given network into the given stream.
+ *
+ * The model is written in binary directly in the stream, after a magic
+ * number and the version of the format: the parameters
+ * used for prediction, the arrays of the classes and the support vectors,
+ * as one array of nodes (with their terminators) preceded by the length of
+ * each vector. The linear model, if any, is written after it.
+ */
 template <typename DBN>
 void svm_store(const DBN& dbn, std::ostream& os) {
+    cpp::binary_write(os, detail::svm_magic);
+    cpp::binary_write(os, detail::svm_version);
+
     if (dbn.svm_loaded) {
         cpp::binary_write(os, true);
 
-        svm::save(dbn.svm_model, "..tmp.svm");
+        const svm_model& model = *dbn.svm_model.get();
+
+        const size_t k     = model.nr_class;
+        const size_t l     = model.l;
+        const size_t pairs = k * (k - 1) / 2;
+
+        const auto& param = model.param;
 
-        std::ifstream svm_is("..tmp.svm", std::ios::binary);
+        cpp::binary_write(os, param.svm_type);
+        cpp::binary_write(os, param.kernel_type);
+        cpp::binary_write(os, param.degree);
+        cpp::binary_write(os, param.gamma);
+        cpp::binary_write(os, param.coef0);
+        cpp::binary_write(os, param.probability);
 
-        char buffer[1024];
+        cpp::binary_write(os, model.nr_class);
+        cpp::binary_write(os, model.l);
 
-        while (true) {
-            svm_is.read(buffer, 1024);
+        detail::svm_write_array(os, model.rho, pairs);
+        detail::svm_write_optional(os, model.label, k);
+        detail::svm_write_optional(os, model.nSV, k);
+        detail::svm_write_optional(os, model.probA, pairs);
+        detail::svm_write_optional(os, model.probB, pairs);
+
+        for (size_t c = 0; c + 1 < k; ++c) {
+            detail::svm_write_array(os, model.sv_coef[c], l);
+        }
 
-            if (svm_is.gcount() == 0) {
-                break;
+        // The support vectors are stored as a single array of nodes
+
+        std::vector<uint32_t> lengths(l);
+        std::vector<svm_node> nodes;
+
+        for (size_t i = 0; i < l; ++i) {
+            const svm_node* node = model.SV[i];
+
+            while (node->index != -1) {
+                nodes.push_back(*node++);
             }
 
-            os.write(buffer, svm_is.gcount());
+            nodes.push_back(*node);
+
+            lengths[i] = std::distance(model.SV[i], node) + 1;
         }
+
+        cpp::binary_write(os, uint64_t(nodes.size()));
+
+        detail::svm_write_array(os, lengths.data(), l);
+        detail::svm_write_array(os, nodes.data(), nodes.size());
     } else {
         cpp::binary_write(os, false);
     }
+
+    // The linear model follows the libsvm model
+    cpp::binary_write(os, dbn.linear_model.trained());
+
+    if (dbn.linear_model.trained()) {
+        dbn.linear_model.store(os);
+    }
 }
 
+/*!
+ * \brief Load the SVM model of the given network from the given stream.
+ *
+ * The streams without the magic number are the libsvm text format of the
+ * previous versions.
+ */
 template <typename DBN>
 void svm_load(DBN& dbn, std::istream& is) {
-    dbn.svm_loaded = false;
+    dbn.svm_loaded   = false;
+    dbn.linear_model = {};
+
+    // The previous versions start with the flag of the model (0 or 1)
+    if (is.good() && is.peek() != std::char_traits<char>::eof() && is.peek() <= 1) {
+        detail::svm_load_text(dbn, is);
+        return;
+    }
+
+    if (is.good() && is.peek() != std::char_traits<char>::eof()) {
+        uint32_t magic   = 0;
+        uint32_t version = 0;
+
+        cpp::binary_load(is, magic);
+        cpp::binary_load(is, version);
+
+        if (!is || magic != detail::svm_magic || version > detail::svm_version) {
+            std::cerr << "ERROR: Unknown format of the SVM model" << std::endl;
+            return;
+        }
 
-    if (is.good()) {
         bool svm;
         cpp::binary_load(is, svm);
 
         if (svm) {
-            std::ofstream svm_os("..tmp.svm", std::ios::binary);
+            // Allocated as libsvm does, to be freed by libsvm
+            auto* model = static_cast<svm_model*>(std::calloc(1, sizeof(svm_model)));
 
-            char buffer[1024];
+            auto& param = model->param;
 
-            while (true) {
-                is.read(buffer, 1024);
+            cpp::binary_load(is, param.svm_type);
+            cpp::binary_load(is, param.kernel_type);
+            cpp::binary_load(is, param.degree);
+            cpp::binary_load(is, param.gamma);
+            cpp::binary_load(is, param.coef0);
+            cpp::binary_load(is, param.probability);
 
-                if (is.gcount() == 0) {
-                    break;
-                }
+            cpp::binary_load(is, model->nr_class);
+            cpp::binary_load(is, model->l);
+
+            if (!is || model->nr_class < 1 || model->l < 0) {
+                std::cerr << "ERROR: Impossible to read the SVM model" << std::endl;
+                std::free(model);
+                return;
+            }
+
+            const size_t k     = model->nr_class;
+            const size_t l     = model->l;
+            const size_t pairs = k * (k - 1) / 2;
+
+            model->rho   = detail::svm_read_array<double>(is, pairs);
+            model->label = detail::svm_read_optional<int>(is, k);
+            model->nSV   = detail::svm_read_optional<int>(is, k);
+            model->probA = detail::svm_read_optional<double>(is, pairs);
+            model->probB = detail::svm_read_optional<double>(is, pairs);
+
+            model->sv_coef = static_cast<double**>(std::malloc(std::max<size_t>(1, k - 1) * sizeof(double*)));
 
-                svm_os.write(buffer, is.gcount());
+            for (size_t c = 0; c + 1 < k; ++c) {
+                model->sv_coef[c] = detail::svm_read_array<double>(is, l);
             }
 
-            svm_os.close();
+            uint64_t n = 0;
+            cpp::binary_load(is, n);
 
-            dbn.svm_model = svm::load("..tmp.svm");
+            std::vector<uint32_t> lengths(l);
+            is.read(reinterpret_cast<char*>(lengths.data()), l * sizeof(uint32_t));
 
-            dbn.svm_loaded = true;
+            if (std::accumulate(lengths.begin(), lengths.end(), uint64_t(0)) != n) {
+                is.setstate(std::ios::failbit);
+                std::fill(lengths.begin(), lengths.end(), 0);
+                n = 0;
+            }
+
+            // All the vectors share the same array of nodes (free_sv)
+            auto* nodes = detail::svm_read_array<svm_node>(is, n);
+
+            model->SV      = static_cast<svm_node**>(std::malloc(std::max<size_t>(1, l) * sizeof(svm_node*)));
+            model->free_sv = 1;
+
+            for (size_t i = 0, offset = 0; i < l; ++i) {
+                model->SV[i] = nodes + offset;
+                offset += lengths[i];
+            }
+
+            if (!l) {
+                std::free(nodes);
+            }
+
+            dbn.svm_model = svm::model(model);
+
+            dbn.svm_loaded = bool(is);
+
+            if (!is) {
+                std::cerr << "ERROR: Impossible to read the SVM model" << std::endl;
+                return;
+            }
+        }
+    }
+
+    // The streams stored before the linear models end after the libsvm model
+    if (is.good() && is.peek() != std::char_traits<char>::eof()) {
+        bool linear;
+        cpp::binary_load(is, linear);
+
+        if (linear && !dbn.linear_model.load(is)) {
+            std::cerr << "ERROR: Impossible to read the linear SVM model" << std::endl;
         }
     }
 }
@@ -108,8 +408,34 @@ etl::dyn_vector<typename DBN::weight> get_activation_probabilities(DBN& dbn, Sam
     }
 }
 
+/*!
+ * \brief Create the svm problem of the given samples, with the features
+ * written directly into the nodes of the problem.
+ */
+template <typename DBN, typename Iterator, typename LIterator>
+void make_sparse_problem(DBN& dbn, Iterator first, size_t n, LIterator lfirst) {
+    const size_t features = etl::size(get_activation_probabilities(dbn, *first));
+
+    dbn.problem = svm::problem(n, features);
+
+    for (size_t i = 0; i < n; ++i, ++first, ++lfirst) {
+        auto sample = get_activation_probabilities(dbn, *first);
+
+        auto* nodes = dbn.problem.sample(i);
+
+        dbn.problem.label(i) = *lfirst;
+
+        detail::svm_terminate_nodes(nodes, detail::svm_append_nodes(nodes, 0, sample.memory_start(), features, 0));
+    }
+}
+
 template <typename DBN, typename Samples, typename Labels>
 void make_problem(DBN& dbn, const Samples& training_data, const Labels& labels, bool scale = false) {
+    if (!scale && std::size(training_data)) {
+        make_sparse_problem(dbn, std::begin(training_data), std::size(training_data), std::begin(labels));
+        return;
+    }
+
     using svm_samples_t = std::vector<etl::dyn_vector<typename DBN::weight>>;
     svm_samples_t svm_samples;
 
@@ -124,6 +450,11 @@ void make_problem(DBN& dbn, const Samples& training_data, const Labels& labels,
 
 template <typename DBN, typename Iterator, typename LIterator>
 void make_problem(DBN& dbn, Iterator first, Iterator last, LIterator&& lfirst, LIterator&& llast, bool scale = false) {
+    if (!scale && first != last) {
+        make_sparse_problem(dbn, first, std::distance(first, last), lfirst);
+        return;
+    }
+
     std::vector<etl::dyn_vector<typename DBN::weight>> svm_samples;
 
     //Get all the activation probabilities
@@ -232,6 +563,207 @@ bool svm_grid_search(DBN& dbn, Iterator&& first, Iterator&& last, LIterator&& lf
     return true;
 }
 
+namespace detail {
+
+/*!
+ * \brief Returns the value i of steps values spaced logarithmically between
+ * first and last
+ */
+inline double svm_grid_value(double first, double last, size_t steps, size_t i) {
+    if (steps < 2 || !i) {
+        return first;
+    }
+
+    return i + 1 == steps ? last : first * std::pow(last / first, double(i) / (steps - 1));
+}
+
+/*!
+ * \brief Compute the number of correct predictions of the cross validation
+ * of each of the given cells, on the first m samples of the given order.
+ *
+ * Each (cell, fold) pair is an independent task of the group. The
+ * tasks share the nodes of the problem, which are only read.
+ */
+inline std::vector<size_t> svm_cross_validate_cells(const std::vector<double>& y, const std::vector<svm_node*>& x, const std::vector<size_t>& order, size_t m,
+                                                    const std::vector<std::pair<double, double>>& cells, const svm_parameter& parameters, size_t n_fold,
+                                                    task_group& pool) {
+    std::vector<size_t> correct(cells.size() * n_fold, 0);
+
+    for (size_t c = 0; c < cells.size(); ++c) {
+        for (size_t f = 0; f < n_fold; ++f) {
+            pool.do_task([&, c, f] {
+                std::vector<double> train_y;
+                std::vector<svm_node*> train_x;
+
+                train_y.reserve(m);
+                train_x.reserve(m);
+
+                for (size_t k = 0; k < m; ++k) {
+                    if (k % n_fold != f) {
+                        train_y.push_back(y[order[k]]);
+                        train_x.push_back(x[order[k]]);
+                    }
+                }
+
+                svm_problem sub;
+                sub.l = int(train_y.size());
+                sub.y = train_y.data();
+                sub.x = train_x.data();
+
+                auto cell        = parameters;
+                cell.C           = cells[c].first;
+                cell.gamma       = cells[c].second;
+                cell.probability = 0;
+
+                auto* model = ::svm_train(&sub, &cell);
+
+                size_t& count = correct[c * n_fold + f];
+
+                for (size_t k = f; k < m; k += n_fold) {
+                    if (::svm_predict(model, x[order[k]]) == y[order[k]]) {
+                        ++count;
+                    }
+                }
+
+                ::svm_free_and_destroy_model(&model);
+            });
+        }
+    }
+
+    pool.wait();
+
+    std::vector<size_t> result(cells.size(), 0);
+
+    for (size_t c = 0; c < cells.size(); ++c) {
+        for (size_t f = 0; f < n_fold; ++f) {
+            result[c] += correct[c * n_fold + f];
+        }
+    }
+
+    return result;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Perform a grid search of the C and gamma parameters of the RBF
+ * kernel, by cross validation, in parallel over the cells and the folds.
+ *
+ * \param problem The problem, which is not modified
+ * \param n The number of samples of the problem
+ * \param parameters The parameters of the SVM, C and gamma are set to the best cell
+ * \param n_fold The number of folds of the cross validation
+ * \param grid The grid of the search
+ *
+ * \return The cross validation accuracy of the best cell
+ */
+inline double svm_rbf_grid_search(svm::problem& problem, size_t n, svm_parameter& parameters, size_t n_fold, const svm_rbf_grid& grid) {
+    cpp::stop_watch<std::chrono::seconds> watch;
+
+    std::vector<double> y(n);
+    std::vector<svm_node*> x(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        y[i] = problem.label(i);
+        x[i] = problem.sample(i);
+    }
+
+    std::vector<std::pair<double, double>> cells;
+
+    for (size_t i = 0; i < grid.c_steps; ++i) {
+        for (size_t j = 0; j < grid.gamma_steps; ++j) {
+            cells.emplace_back(
+                detail::svm_grid_value(grid.c_first, grid.c_last, grid.c_steps, i),
+                detail::svm_grid_value(grid.gamma_first, grid.gamma_last, grid.gamma_steps, j));
+        }
+    }
+
+    // The folds are taken in a random order
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+    const size_t eta = grid.halving;
+
+    size_t rounds = 1;
+
+    if (eta > 1) {
+        for (size_t c = cells.size(); c > 1; c = (c + eta - 1) / eta) {
+            ++rounds;
+        }
+    }
+
+    task_group pool;
+
+    std::vector<size_t> correct;
+    size_t m = n;
+
+    for (size_t r = 0; r < rounds; ++r) {
+        m = n;
+
+        for (size_t k = r + 1; k < rounds; ++k) {
+            m /= eta;
+        }
+
+        m = std::min(n, std::max(m, 10 * n_fold));
+
+        correct = detail::svm_cross_validate_cells(y, x, order, m, cells, parameters, n_fold, pool);
+
+        if (r + 1 < rounds) {
+            // Only keep the best cells for the next round
+            std::vector<size_t> best(cells.size());
+            std::iota(best.begin(), best.end(), 0);
+            std::stable_sort(best.begin(), best.end(), [&correct](size_t a, size_t b) { return correct[a] > correct[b]; });
+
+            best.resize(std::max<size_t>(1, (cells.size() + eta - 1) / eta));
+
+            std::vector<std::pair<double, double>> next;
+
+            for (auto c : best) {
+                next.push_back(cells[c]);
+            }
+
+            cells = std::move(next);
+        }
+    }
+
+    const size_t best = std::max_element(correct.begin(), correct.end()) - correct.begin();
+
+    parameters.C     = cells[best].first;
+    parameters.gamma = cells[best].second;
+
+    const double accuracy = double(correct[best]) / m;
+
+    std::cout << "Best: C=" << parameters.C << " gamma=" << parameters.gamma << " accuracy=" << accuracy
+              << " (grid search took " << watch.elapsed() << "s)" << std::endl;
+
+    return accuracy;
+}
+
+/*!
+ * \brief Perform a parallel grid search of the RBF parameters on the
+ * features of the given network.
+ *
+ * \param parameters The parameters of the SVM, C and gamma are set to the best cell
+ * \return true if the grid search was performed, false otherwise
+ */
+template <typename DBN, typename Samples, typename Labels>
+bool svm_grid_search(DBN& dbn, const Samples& training_data, const Labels& labels, svm_parameter& parameters, const svm_rbf_grid& g, size_t n_fold = 5) {
+    make_problem(dbn, training_data, labels, dbn_traits<DBN>::scale());
+
+    //Make libsvm quiet
+    svm::make_quiet();
+
+    //Make sure parameters are not messed up
+    if (!svm::check(dbn.problem, parameters)) {
+        return false;
+    }
+
+    svm_rbf_grid_search(dbn.problem, std::size(training_data), parameters, n_fold, g);
+
+    return true;
+}
+
 template <typename DBN, typename Sample>
 double svm_predict(DBN& dbn, const Sample& sample) {
     auto features = get_activation_probabilities(dbn, sample);
@@ -0,0 +1,589 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Streaming readers of the CSV and libsvm tabular formats
+ *
+ * A CSV line is made of the label followed by the values, separated by
+ * commas. A libsvm line is made of the label followed by index:value
+ * pairs (1-based indices), the missing values being zero.
+ *
+ * The file is memory-mapped and read sequentially, in chunks of lines
+ * that are parsed in parallel. The iterators over the samples and over
+ * the labels can be given directly to an outmemory_data_generator, only
+ * one chunk of the file is ever held in memory. The samples are always
+ * dense, the layers with sparse_input build their sparse copy of the
+ * batches themselves.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dll/generators.hpp"
+#include "dll/text_reader.hpp"
+#include "dll/datasets/mapped.hpp"
+
+namespace dll {
+namespace tabular {
+
+/*!
+ * \brief The format of a tabular file
+ */
+enum class format {
+    CSV,   ///< Label and values separated by commas
+    LIBSVM ///< Label and sparse index:value pairs
+};
+
+/*!
+ * \brief A tabular file, mapped in memory and scanned for its shape
+ */
+struct source {
+    const tabular::format fmt;  ///< The format of the file
+    const mapped::file mapping; ///< The mapping of the file
+
+    const char* first = nullptr; ///< The first data line
+    const char* last  = nullptr; ///< The end of the file
+
+    size_t samples  = 0; ///< The number of samples of the file
+    size_t features = 0; ///< The number of values of a sample
+
+    /*!
+     * \brief Open and scan the given file
+     * \param path The path to the file
+     * \param fmt The format of the file
+     * \param features The number of values of a sample (0 = detect)
+     * \param header Indicates if the first line is a header to skip
+     */
+    source(const std::string& path, tabular::format fmt, size_t features, bool header) : fmt(fmt), mapping(path) {
+        first = reinterpret_cast<const char*>(mapping.data);
+        last  = first + mapping.length;
+
+        if (!mapping.data) {
+            std::cerr << "ERROR: Impossible to read the tabular file " << path << std::endl;
+            return;
+        }
+
+        if (header) {
+            first = std::min(last, std::find(first, last, '\n') + 1);
+        }
+
+        scan();
+
+        if (features) {
+            this->features = features;
+        }
+    }
+
+    source(const source& rhs) = delete;
+    source& operator=(const source& rhs) = delete;
+
+    /*!
+     * \brief Returns the end of the line starting at the given position
+     */
+    const char* end_of_line(const char* line) const {
+        return std::find(line, last, '\n');
+    }
+
+    /*!
+     * \brief Returns the start of the next line after the given end of line
+     */
+    const char* next_line(const char* eol) const {
+        return eol == last ? last : eol + 1;
+    }
+
+    /*!
+     * \brief Indicates if the given line contains no value
+     */
+    static bool blank(const char* line, const char* eol) {
+        return std::all_of(line, eol, [](char c) { return c == ' ' || c == '\t' || c == '\r'; });
+    }
+
+private:
+    /*!
+     * \brief Count the samples and detect the number of values, in
+     * parallel over blocks of lines.
+     */
+    void scan() {
+        static constexpr size_t block = 1 << 20; ///< The number of bytes of a block
+
+        const size_t length = last - first;
+        const size_t blocks = (length + block - 1) / block;
+
+        std::vector<size_t> counts(blocks);
+        std::vector<size_t> widths(blocks);
+
+        mapped::for_each_chunk(blocks, 1, [&](size_t b_first, size_t b_last) {
+            for (size_t b = b_first; b < b_last; ++b) {
+                const char* end  = first + std::min(length, (b + 1) * block);
+                const char* line = first + b * block;
+
+                // A block only handles the lines starting inside it
+                if (b) {
+                    line = std::min(end, end_of_line(line - 1) + 1);
+                }
+
+                while (line < end) {
+                    const char* eol = end_of_line(line);
+
+                    if (!blank(line, eol)) {
+                        ++counts[b];
+
+                        if (fmt == format::LIBSVM) {
+                            widths[b] = std::max(widths[b], libsvm_width(line, eol));
+                        }
+                    }
+
+                    line = next_line(eol);
+                }
+            }
+        });
+
+        for (size_t b = 0; b < blocks; ++b) {
+            samples += counts[b];
+            features = std::max(features, widths[b]);
+        }
+
+        // The CSV values are counted on the first sample
+        if (fmt == format::CSV) {
+            for (const char* line = first; line < last;) {
+                const char* eol = end_of_line(line);
+
+                if (!blank(line, eol)) {
+                    features = std::count(line, eol, ',');
+                    break;
+                }
+
+                line = next_line(eol);
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the largest index of the given libsvm line
+     */
+    static size_t libsvm_width(const char* line, const char* eol) {
+        size_t width = 0;
+
+        // Stop at a comment
+        eol = std::find(line, eol, '#');
+
+        for (const char* c = std::find(line, eol, ':'); c != eol; c = std::find(c + 1, eol, ':')) {
+            const char* start = c;
+
+            while (start != line && start[-1] >= '0' && start[-1] <= '9') {
+                --start;
+            }
+
+            size_t index = 0;
+            std::from_chars(start, c, index);
+            width = std::max(width, index);
+        }
+
+        return width;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Returns the end of the label of the given line
+ */
+inline const char* end_of_label(const source& src, const char* line, const char* eol) {
+    if (src.fmt == format::CSV) {
+        return std::find(line, eol, ',');
+    }
+
+    while (line != eol && (*line == ' ' || *line == '\t')) {
+        ++line;
+    }
+
+    return std::find_if(line, eol, [](char c) { return c == ' ' || c == '\t'; });
+}
+
+/*!
+ * \brief Parse the values of the given line into the given sample
+ * \param src The source of the line
+ * \param line The position after the label
+ * \param eol The end of the line
+ * \param out The values of the sample
+ */
+template <typename T>
+void parse_values(const source& src, const char* line, const char* eol, T* out) {
+    const size_t n = src.features;
+
+    std::fill(out, out + n, T(0));
+
+    if (src.fmt == format::CSV) {
+        for (size_t i = 0; line != eol && i < n; ++i) {
+            ++line; // The comma ending the previous value
+
+            const char* end = std::find(line, eol, ',');
+            out[i]          = text::detail::parse_value<T>(line, end);
+            line            = end;
+        }
+    } else {
+        // Stop at a comment
+        eol = std::find(line, eol, '#');
+
+        for (const char* c = std::find(line, eol, ':'); c != eol; c = std::find(c + 1, eol, ':')) {
+            const char* start = c;
+
+            while (start != line && start[-1] >= '0' && start[-1] <= '9') {
+                --start;
+            }
+
+            size_t index = 0;
+            std::from_chars(start, c, index);
+
+            if (index > 0 && index <= n) {
+                const char* end = std::find_if(c + 1, eol, [](char v) { return v == ' ' || v == '\t'; });
+                out[index - 1]  = text::detail::parse_value<T>(c + 1, end);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief A sequential reader of a tabular file, parsing the file in
+ * chunks of lines.
+ *
+ * \tparam T The type of the values
+ * \tparam L The type of the labels
+ * \tparam Samples Indicates if the values must be parsed or only the labels
+ */
+template <typename T, typename L, bool Samples>
+struct cursor {
+    static constexpr size_t chunk = 4096; ///< The number of samples of a chunk
+
+    std::shared_ptr<const source> src; ///< The source file
+
+    const char* next = nullptr; ///< The next line to read
+
+    std::vector<etl::dyn_matrix<T, 1>> rows; ///< The samples of the chunk
+    std::vector<L> labels;                   ///< The labels of the chunk
+    std::vector<const char*> lines;          ///< The lines of the chunk
+
+    size_t current = 0; ///< The current sample of the chunk
+
+    /*!
+     * \brief Construct a cursor at the beginning of the given source
+     */
+    explicit cursor(std::shared_ptr<const source> source) : src(std::move(source)), next(src->first) {
+        if constexpr (Samples) {
+            rows.reserve(chunk);
+
+            for (size_t i = 0; i < chunk; ++i) {
+                rows.emplace_back(src->features);
+            }
+        }
+
+        labels.resize(chunk);
+        lines.reserve(chunk);
+
+        fill();
+    }
+
+    /*!
+     * \brief Returns the current sample
+     */
+    const etl::dyn_matrix<T, 1>& sample() const {
+        return rows[std::min(current, chunk - 1)];
+    }
+
+    /*!
+     * \brief Returns the current label
+     */
+    const L& label() const {
+        return labels[std::min(current, chunk - 1)];
+    }
+
+    /*!
+     * \brief Move to the next sample
+     */
+    void advance() {
+        if (++current >= lines.size() && next != src->last) {
+            fill();
+        }
+    }
+
+    /*!
+     * \brief Move forward by the given number of samples, without parsing
+     * the skipped chunks.
+     */
+    void skip(size_t n) {
+        while (n >= lines.size() - current && next != src->last) {
+            n -= lines.size() - current;
+            collect();
+        }
+
+        current += n;
+        parse();
+    }
+
+private:
+    /*!
+     * \brief Read and parse the next chunk
+     */
+    void fill() {
+        collect();
+        parse();
+    }
+
+    /*!
+     * \brief Find the lines of the next chunk
+     */
+    void collect() {
+        lines.clear();
+        current = 0;
+
+        while (lines.size() < chunk && next != src->last) {
+            const char* eol = src->end_of_line(next);
+
+            if (!source::blank(next, eol)) {
+                lines.push_back(next);
+            }
+
+            next = src->next_line(eol);
+        }
+    }
+
+    /*!
+     * \brief Parse the lines of the current chunk, in parallel
+     */
+    void parse() {
+        mapped::for_each_chunk(lines.size(), 256, [this](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                const char* eol   = src->end_of_line(lines[i]);
+                const char* label = end_of_label(*src, lines[i], eol);
+
+                labels[i] = text::detail::parse_value<L>(lines[i], label);
+
+                if constexpr (Samples) {
+                    parse_values(*src, label, eol, rows[i].memory_start());
+                }
+            }
+        });
+    }
+};
+
+/*!
+ * \brief An input iterator over the samples or the labels of a tabular
+ * file.
+ *
+ * A copy of an iterator reads the file independently, from the position
+ * of the copied iterator.
+ */
+template <typename T, typename L, bool Samples>
+struct iterator {
+    using iterator_category = std::input_iterator_tag;                                ///< The category of the iterator
+    using value_type        = std::conditional_t<Samples, etl::dyn_matrix<T, 1>, L>; ///< The type of the values
+    using difference_type   = std::ptrdiff_t;                                         ///< The type of the differences
+    using pointer           = const value_type*;                                      ///< The type of a pointer to a value
+    using reference         = const value_type&;                                      ///< The type of a reference to a value
+
+    std::shared_ptr<const source> src; ///< The source file
+    size_t position = 0;               ///< The index of the current sample
+
+    mutable std::unique_ptr<cursor<T, L, Samples>> reader; ///< The reader, created on first use
+
+    /*!
+     * \brief Construct an iterator on the given sample of the given source
+     */
+    iterator(std::shared_ptr<const source> src, size_t position) : src(std::move(src)), position(position) {}
+
+    iterator(const iterator& rhs) : src(rhs.src), position(rhs.position) {}
+
+    iterator& operator=(const iterator& rhs) {
+        if (this != &rhs) {
+            src      = rhs.src;
+            position = rhs.position;
+            reader.reset();
+        }
+
+        return *this;
+    }
+
+    iterator(iterator&& rhs) noexcept = default;
+    iterator& operator=(iterator&& rhs) noexcept = default;
+
+    /*!
+     * \brief Returns the current value
+     */
+    reference operator*() const {
+        if constexpr (Samples) {
+            return get().sample();
+        } else {
+            return get().label();
+        }
+    }
+
+    /*!
+     * \brief Move to the next value
+     */
+    iterator& operator++() {
+        get().advance();
+        ++position;
+        return *this;
+    }
+
+    /*!
+     * \brief Indicates if the two iterators are at the same position
+     */
+    bool operator==(const iterator& rhs) const {
+        return position == rhs.position;
+    }
+
+    /*!
+     * \brief Indicates if the two iterators are not at the same position
+     */
+    bool operator!=(const iterator& rhs) const {
+        return position != rhs.position;
+    }
+
+private:
+    /*!
+     * \brief Returns the reader, created at the current position if necessary
+     */
+    cursor<T, L, Samples>& get() const {
+        if (!reader) {
+            reader = std::make_unique<cursor<T, L, Samples>>(src);
+
+            if (position) {
+                reader->skip(position);
+            }
+        }
+
+        return *reader;
+    }
+};
+
+} //end of namespace detail
+
+/*!
+ * \brief Iterator over the samples of a tabular file
+ */
+template <typename T = float>
+using sample_iterator = detail::iterator<T, T, true>;
+
+/*!
+ * \brief Iterator over the labels of a tabular file
+ */
+template <typename L = size_t>
+using label_iterator = detail::iterator<float, L, false>;
+
+/*!
+ * \brief Open a tabular file
+ * \param path The path to the file
+ * \param fmt The format of the file
+ * \param features The number of values of a sample (0 = detect)
+ * \param header Indicates if the first line is a header to skip
+ */
+inline std::shared_ptr<const source> open(const std::string& path, format fmt, size_t features = 0, bool header = false) {
+    return std::make_shared<const source>(path, fmt, features, header);
+}
+
+/*!
+ * \brief Returns the format of the given reader name ("csv" or "libsvm")
+ * \param name The name of the reader
+ * \param fmt The format to set
+ * \return true if the name is a tabular reader, false otherwise
+ */
+inline bool parse_format(const std::string& name, format& fmt) {
+    if (name == "csv") {
+        fmt = format::CSV;
+        return true;
+    } else if (name == "libsvm") {
+        fmt = format::LIBSVM;
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief Read the samples of a tabular file into a container
+ * \param samples The container to fill
+ * \param path The path to the file
+ * \param fmt The format of the file
+ * \param limit The maximum number of samples to read (0 = no limit)
+ * \param func The functor creating a sample from its number of values
+ */
+template <typename Container, typename Functor>
+void read_samples(Container& samples, const std::string& path, format fmt, size_t limit, Functor func) {
+    using T = etl::value_t<typename Container::value_type>;
+
+    auto src = open(path, fmt);
+
+    const size_t n = limit ? std::min(limit, src->samples) : src->samples;
+
+    sample_iterator<T> it(src, 0);
+
+    for (size_t i = 0; i < n; ++i, ++it) {
+        samples.push_back(func(src->features));
+        std::copy((*it).begin(), (*it).end(), samples.back().begin());
+    }
+}
+
+/*!
+ * \brief Read the labels of a tabular file into a container
+ * \param labels The container to fill
+ * \param path The path to the file
+ * \param fmt The format of the file
+ * \param limit The maximum number of labels to read (0 = no limit)
+ */
+template <typename Label>
+void read_labels(std::vector<Label>& labels, const std::string& path, format fmt, size_t limit = 0) {
+    auto src = open(path, fmt);
+
+    const size_t n = limit ? std::min(limit, src->samples) : src->samples;
+
+    label_iterator<Label> it(src, 0);
+
+    for (size_t i = 0; i < n; ++i, ++it) {
+        labels.push_back(*it);
+    }
+}
+
+/*!
+ * \brief Make an out of memory data generator streaming the given tabular
+ * file.
+ *
+ * The labels are read as class indices for categorical generators and as
+ * values otherwise.
+ *
+ * \param path The path to the file
+ * \param fmt The format of the file
+ * \param n_classes The number of classes
+ * \param features The number of values of a sample (0 = detect)
+ */
+template <typename T = float, typename... Parameters>
+auto make_generator(const std::string& path, format fmt, size_t n_classes, size_t features, const outmemory_data_generator_desc<Parameters...>& desc) {
+    using desc_t = outmemory_data_generator_desc<Parameters...>;
+    using L      = std::conditional_t<desc_t::Categorical, size_t, T>;
+
+    auto src = open(path, fmt, features);
+
+    sample_iterator<T> first(src, 0);
+    sample_iterator<T> last(src, src->samples);
+    label_iterator<L> lfirst(src, 0);
+    label_iterator<L> llast(src, src->samples);
+
+    return dll::make_generator(first, last, lfirst, llast, src->samples, n_classes, desc);
+}
+
+} //end of namespace tabular
+} //end of namespace dll
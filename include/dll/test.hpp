@@ -40,6 +40,20 @@ struct svm_predictor {
     }
 };
 
+/*!
+ * \brief Utility to predict a label from an input with the linear SVM
+ */
+struct linear_svm_predictor {
+    /*!
+     * \brief Return the predicted label for the given image using the given DBN
+     * with its linear SVM.
+     */
+    template <typename T, typename V>
+    size_t operator()(T& dbn, V& image) {
+        return dbn->linear_svm_predict(image);
+    }
+};
+
 #endif //DLL_SVM_SUPPORT
 
 /*!
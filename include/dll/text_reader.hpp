@@ -12,28 +12,53 @@
 
 #pragma once
 
+#include <algorithm>
+#include <charconv>
 #include <string>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <type_traits>
+#include <utility>
 
 #include <dirent.h>
 
 #include "cpp_utils/tmp.hpp"
 #include "etl/etl_light.hpp"
 
+#include "dll/datasets/mapped.hpp"
+
 namespace dll {
 namespace text {
 
-template<typename Container, typename Functor>
-void read_images(Container& images, const std::string& path, size_t limit, Functor func){
-    using Image = typename Container::value_type;
+namespace detail {
+
+/*!
+ * \brief A numbered file of a text dataset
+ */
+struct text_file {
+    size_t id;        ///< The number of the file (starting at 1)
+    std::string path; ///< The full path to the file
+};
+
+/*!
+ * \brief List the numbered .dat files of the given directory
+ * \param path The directory
+ * \param limit Only the files up to this number are listed (0 = no limit)
+ * \return The listed files
+ */
+inline std::vector<text_file> list_files(const std::string& path, size_t limit){
+    std::vector<text_file> files;
 
-    struct dirent* entry;
     auto dir = opendir(path.c_str());
 
+    if(!dir){
+        std::cerr << "ERROR: Impossible to open the directory " << path << std::endl;
+        return files;
+    }
+
+    struct dirent* entry;
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -43,75 +68,154 @@ void read_images(Container& images, const std::string& path, size_t limit, Funct
 
         int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
 
-        if(!limit || id - 1 < (int) limit){
-            std::vector<double> temp;
+        if(id > 0 && (!limit || id - 1 < (int) limit)){
+            files.push_back({size_t(id), path + "/" + file_name});
+        }
+    }
+
+    closedir(dir);
 
-            std::string full_path(path + "/" + file_name);
+    return files;
+}
+
+/*!
+ * \brief Parse a value of a text file.
+ *
+ * Like atof, leading spaces are ignored and an invalid value is parsed as
+ * zero. Integral values are parsed as floating point and then truncated.
+ */
+template<typename T>
+T parse_value(const char* first, const char* last){
+    using value_t = std::conditional_t<std::is_floating_point_v<T>, T, double>;
 
-            std::ifstream file(full_path);
+    while(first != last && (*first == ' ' || *first == '\t' || *first == '\r' || *first == '+')){
+        ++first;
+    }
+
+    value_t value(0);
+    std::from_chars(first, last, value);
+
+    if constexpr (std::is_floating_point_v<T>) {
+        return value;
+    } else {
+        return static_cast<T>(static_cast<long long>(value));
+    }
+}
 
-            size_t lines = 0;
-            size_t columns = 0;
+/*!
+ * \brief Returns the number of lines and the number of values of the first
+ * line of the given text
+ */
+inline std::pair<size_t, size_t> text_shape(const char* first, const char* last){
+    if(first == last){
+        return {0, 0};
+    }
 
-            // There is a bug in G++7.1 that causes this false positive
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstrict-aliasing"
-            std::string line;
-            while (std::getline(file, line)) {
-                std::istringstream ss(line);
-                std::string value;
+    size_t lines = std::count(first, last, '\n') + (last[-1] == '\n' ? 0 : 1);
 
-                while (std::getline(ss, value, ';')) {
-                    auto v = std::atof(value.c_str());
-                    temp.push_back(v);
+    const char* eol = std::find(first, last, '\n');
 
-                    if(lines == 0){
-                        ++columns;
-                    }
-                }
+    // Like getline, the empty value after the last separator is not counted
+    size_t columns = 0;
+    if(eol != first){
+        columns = std::count(first, eol, ';') + (eol[-1] == ';' ? 0 : 1);
+    }
 
-                ++lines;
-            }
-#pragma GCC diagnostic pop
+    return {lines, columns};
+}
 
-            if((int) images.size() < id){
-                images.resize(id);
-            }
+/*!
+ * \brief Parse the values of the given text into the given image.
+ *
+ * The lines are separated by new lines and the values by semicolons.
+ * Values in excess of the size of the image are ignored.
+ */
+template<typename Image>
+void parse_values(Image& image, const char* first, const char* last){
+    using value_type = typename Image::value_type;
 
-            images[id - 1] = func(1, lines, columns);
+    const size_t n = image.size();
 
-            size_t i = 0;
-            for (auto& value : temp) {
-                images[id - 1][i++] = static_cast<typename Image::value_type>(value);
-            }
+    size_t i = 0;
+
+    while(first != last && i < n){
+        const char* eol = std::find(first, last, '\n');
+
+        while(first != eol && i < n){
+            const char* end = std::find(first, eol, ';');
+
+            image[i++] = parse_value<value_type>(first, end);
+
+            first = end == eol ? eol : end + 1;
         }
+
+        first = eol == last ? last : eol + 1;
     }
 }
 
-template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
-void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
-    struct dirent* entry;
-    auto dir = opendir(path.c_str());
+} //end of namespace detail
 
-    while ((entry = readdir(dir))) {
-        std::string file_name(entry->d_name);
+/*!
+ * \brief Read the images of a text dataset.
+ *
+ * Each image is a file N.dat made of lines of values separated by
+ * semicolons. The files are memory-mapped and parsed in parallel, directly
+ * into the images.
+ *
+ * \param images The container to fill
+ * \param path The directory of the images
+ * \param limit The maximum number of images to read (0 = no limit)
+ * \param func The functor creating an image from its (channels, lines, columns)
+ */
+template<typename Container, typename Functor>
+void read_images(Container& images, const std::string& path, size_t limit, Functor func){
+    auto files = detail::list_files(path, limit);
 
-        if (file_name.size() <= 3 || file_name.find(".dat") != file_name.size() - 4) {
-            continue;
+    for(auto& file : files){
+        if(images.size() < file.id){
+            images.resize(file.id);
         }
+    }
 
-        int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
+    dll::mapped::for_each_chunk(files.size(), 8, [&](size_t first, size_t last){
+        for(size_t f = first; f < last; ++f){
+            dll::mapped::file mapping(files[f].path);
+
+            auto* begin = reinterpret_cast<const char*>(mapping.data);
+            auto* end   = begin + mapping.length;
 
-        if((int) labels.size() < id){
-            labels.resize(id);
+            auto [lines, columns] = detail::text_shape(begin, end);
+
+            auto& image = images[files[f].id - 1];
+
+            image = func(1, lines, columns);
+
+            detail::parse_values(image, begin, end);
         }
+    });
+}
+
+/*!
+ * \brief Read the labels of a text dataset.
+ *
+ * Each label is a file N.dat containing the value of the label.
+ *
+ * \param labels The container to fill
+ * \param path The directory of the labels
+ * \param limit The maximum number of labels to read (0 = no limit)
+ */
+template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
+void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
+    for(auto& file : detail::list_files(path, 0)){
+        if(labels.size() < file.id){
+            labels.resize(file.id);
+        }
+
+        dll::mapped::file mapping(file.path);
 
-        std::string full_path(path + "/" + file_name);
+        auto* begin = reinterpret_cast<const char*>(mapping.data);
 
-        std::ifstream file(full_path);
-        int value;
-        file >> value;
-        labels[id - 1] = static_cast<Label>(value);
+        labels[file.id - 1] = detail::parse_value<Label>(begin, begin + mapping.length);
     }
 
     if(limit && labels.size() > limit){
@@ -24,16 +24,19 @@ namespace dll {
 
 /*!
  * \brief The context of the gradient search for a batch
+ *
+ * The samples and the targets are stored one per row, so that each layer is
+ * activated in a single GEMM for the whole batch.
  */
-template <typename Sample, typename Label>
+template <typename T>
 struct gradient_context {
-    size_t max_iterations; ///< The maximum number of iterations
-    size_t epoch;          ///< The current epoch
-    batch<Sample> inputs;  ///< The inputs
-    batch<Label> targets;  ///< The targets
-    size_t start_layer;    ///< The index of the starting layer
+    size_t max_iterations;         ///< The maximum number of iterations
+    size_t epoch;                  ///< The current epoch
+    etl::dyn_matrix<T, 2> inputs;  ///< The inputs, one sample per row
+    etl::dyn_matrix<T, 2> targets; ///< The targets, one sample per row
+    size_t start_layer;            ///< The index of the starting layer
 
-    gradient_context(batch<Sample> i, batch<Label> t, size_t e)
+    gradient_context(etl::dyn_matrix<T, 2> i, etl::dyn_matrix<T, 2> t, size_t e)
             : max_iterations(5), epoch(e), inputs(std::move(i)), targets(std::move(t)), start_layer(0) {
         //Nothing else to init
     }
@@ -73,14 +76,25 @@ struct cg_trainer_base {
             if (ctx.is_trained) {
                 const auto n_hidden = num_hidden(rbm);
 
-                for (size_t i = 0; i < batch_size; ++i) {
-                    ctx.gr_probs_a.emplace_back(n_hidden);
-                    ctx.gr_probs_s.emplace_back(n_hidden);
-                }
+                ctx.gr_probs = etl::dyn_matrix<weight, 2>(batch_size, n_hidden);
+                ctx.gr_diffs = etl::dyn_matrix<weight, 2>(batch_size, n_hidden);
             }
         });
     }
 
+    /*!
+     * \brief Set the lengths of the sequences of the next batches.
+     *
+     * Variable-length sequences are not supported by CG, the lengths must
+     * be empty.
+     *
+     * \param lengths The length of each sample of the batch
+     */
+    void set_sequence_lengths(const std::vector<size_t>& lengths) {
+        cpp_assert(lengths.empty(), "CG does not support variable-length sequences");
+        cpp_unused(lengths);
+    }
+
     /*!
      * \brief Train a batch of inputs
      *
@@ -92,21 +106,17 @@ struct cg_trainer_base {
      */
     template <typename Inputs, typename Labels>
     std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
-        using T = etl::dyn_matrix<etl::value_t<Inputs>, etl::decay_traits<Inputs>::dimensions() - 1>;
-        using L = etl::dyn_matrix<etl::value_t<Labels>, etl::decay_traits<Labels>::dimensions() - 1>;
+        const size_t n = etl::dim<0>(inputs);
 
-        std::vector<T> inputs_cache(etl::dim<0>(inputs));
-        std::vector<L> labels_cache(etl::dim<0>(labels));
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
 
-        for(size_t i = 0; i < etl::dim<0>(inputs); ++i){
-            inputs_cache[i] = inputs(i);
-            labels_cache[i] = labels(i);
-        }
+        etl::dyn_matrix<weight, 2> inputs_cache(n, etl::size(inputs) / n);
+        etl::dyn_matrix<weight, 2> labels_cache(n, etl::size(labels) / n);
+
+        inputs_cache = etl::reshape(inputs, n, etl::size(inputs) / n);
+        labels_cache = etl::reshape(labels, n, etl::size(labels) / n);
 
-        gradient_context<decltype(inputs_cache.begin()), decltype(labels_cache.begin())> context(
-            make_batch(inputs_cache.begin(), inputs_cache.end()),
-            make_batch(labels_cache.begin(), labels_cache.end()),
-            epoch);
+        gradient_context<weight> context(std::move(inputs_cache), std::move(labels_cache), epoch);
 
         minimize(context);
 
@@ -116,167 +126,125 @@ struct cg_trainer_base {
 
     /* Gradient */
 
-    template <bool Temp, typename R1, typename R2, typename C1, typename C2, typename D>
-    static void update_diffs(R1&, R2& r2, C1& c1, C2& c2, std::vector<D>& diffs, size_t n_samples) {
-        auto n_visible = num_visible(r2);
-        auto n_hidden  = num_hidden(r2);
-
-        for (size_t sample = 0; sample < n_samples; ++sample) {
-            D diff(n_visible);
-
-            for (size_t i = 0; i < n_visible; ++i) {
-                double s = 0.0;
-                for (size_t j = 0; j < n_hidden; ++j) {
-                    s += diffs[sample][j] * (Temp ? c2.gr_w_tmp(i, j) : r2.w(i, j));
-                }
-
-                if (R1::hidden_unit != unit_type::RELU) {
-                    s *= c1.gr_probs_a[sample][i] * (1.0 - c1.gr_probs_a[sample][i]);
-                }
-
-                diff[i] = s;
-            }
-
-            diffs[sample].swap(diff);
+    /*!
+     * \brief Make sure the given matrix has n rows of the given size
+     */
+    static void ensure_rows(etl::dyn_matrix<weight, 2>& m, size_t n, size_t columns) {
+        if (etl::dim<0>(m) != n || etl::dim<1>(m) != columns) {
+            m = etl::dyn_matrix<weight, 2>(n, columns);
         }
     }
 
-    template <bool Temp, typename R, typename D, typename V>
-    static void update_incs(R& r, std::vector<D>& diffs, const V& visibles) {
-        auto& ctx = r.get_cg_context();
+    /*!
+     * \brief Compute the activation probabilities of the layer I and the
+     * following ones, for the whole batch.
+     *
+     * With Temp, the temporary weights of the line search are used instead
+     * of the weights of the layers.
+     *
+     * \param inputs The inputs of the network, one sample per row
+     */
+    template <bool Temp, size_t I = 0>
+    void batch_forward(const etl::dyn_matrix<weight, 2>& inputs) {
+        auto& rbm = dbn.template layer_get<I>();
+        auto& ctx = rbm.get_cg_context();
 
-        auto n_visible = num_visible(r);
-        auto n_hidden  = num_hidden(r);
+        const size_t n = etl::dim<0>(inputs);
 
-        auto it            = visibles.begin();
-        auto end           = visibles.end();
-        size_t sample = 0;
+        ensure_rows(ctx.gr_probs, n, num_hidden(rbm));
 
-        while (it != end) {
-            auto& v = *it;
-            auto& d = diffs[sample];
+        auto& b = Temp ? ctx.gr_b_tmp : rbm.b;
+        auto& w = Temp ? ctx.gr_w_tmp : rbm.w;
 
-            for (size_t i = 0; i < n_visible; ++i) {
-                for (size_t j = 0; j < n_hidden; ++j) {
-                    ctx.gr_w_incs(i, j) += v[i] * d[j];
-                }
-            }
+        if constexpr (I == 0) {
+            rbm.template batch_activate_hidden<true, false>(ctx.gr_probs, ctx.gr_probs, inputs, inputs, b, w);
+        } else {
+            auto& previous = dbn.template layer_get<I - 1>().get_cg_context().gr_probs;
 
-            for (size_t j = 0; j < n_hidden; ++j) {
-                ctx.gr_b_incs(j) += d[j];
-            }
+            rbm.template batch_activate_hidden<true, false>(ctx.gr_probs, ctx.gr_probs, previous, previous, b, w);
+        }
 
-            ++it;
-            ++sample;
+        if constexpr (I + 1 < layers) {
+            batch_forward<Temp, I + 1>(inputs);
         }
     }
 
     /*!
-     * \brief Compute the gradient of one context
-     * \param contex The current gradient context
-     * \param cost The current cost
+     * \brief Compute the increments of the layer I and of the previous ones
+     * from the diffs of the layer I, for the whole batch.
+     *
+     * \param inputs The inputs of the network, one sample per row
      */
-    template <bool Temp, typename Sample, typename Target>
-    void gradient(const gradient_context<Sample, Target>& context, weight& cost) {
-        const auto n_hidden = output_size(dbn.template layer_get<layers - 1>());
-        auto n_samples      = context.inputs.size();
-
-        static std::vector<std::vector<weight>> diffs;
-        diffs.resize(n_samples);
-
-        dbn.for_each_layer([](auto& rbm) {
-            rbm.get_cg_context().gr_w_incs = 0.0;
-            rbm.get_cg_context().gr_b_incs = 0.0;
-        });
-
-        cost         = 0.0;
-        weight error = 0.0;
+    template <bool Temp, size_t I>
+    void batch_backward(const etl::dyn_matrix<weight, 2>& inputs) {
+        auto& rbm = dbn.template layer_get<I>();
+        auto& ctx = rbm.get_cg_context();
 
-        auto it  = context.inputs.begin();
-        auto end = context.inputs.end();
-        auto tit = context.targets.begin();
+        ctx.gr_b_incs = etl::bias_batch_sum_2d(ctx.gr_diffs);
 
-        size_t sample = 0;
+        if constexpr (I == 0) {
+            ctx.gr_w_incs = etl::transpose(inputs) * ctx.gr_diffs;
+        } else {
+            using previous_t = std::decay_t<decltype(dbn.template layer_get<I - 1>())>;
 
-        while (it != end) {
-            auto& input  = *it;
-            auto output  = std::ref(dbn.template layer_get<0>().get_cg_context().gr_probs_a[sample]);
-            auto& target = *tit;
+            auto& previous_rbm = dbn.template layer_get<I - 1>();
+            auto& previous     = previous_rbm.get_cg_context();
 
-            dbn.for_each_layer_i([&input, &output, sample](size_t I, auto& rbm) {
-                auto& ctx        = rbm.get_cg_context();
-                auto& output_ref = static_cast<etl::dyn_vector<weight>&>(output);
+            ctx.gr_w_incs = etl::transpose(previous.gr_probs) * ctx.gr_diffs;
 
-                if (I == 0) {
-                    rbm.activate_hidden(output_ref, ctx.gr_probs_s[sample], input, input, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                } else {
-                    rbm.activate_hidden(ctx.gr_probs_a[sample], ctx.gr_probs_s[sample], output_ref, output_ref, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                    output = std::ref(ctx.gr_probs_a[sample]);
-                }
-            });
-
-            auto& diff = diffs[sample];
-            diff.resize(n_hidden);
+            // Backpropagate the diffs to the previous layer
+            ensure_rows(previous.gr_diffs, etl::dim<0>(inputs), num_hidden(previous_rbm));
 
-            auto& result = dbn.template layer_get<layers - 1>().get_cg_context().gr_probs_a[sample];
-            weight scale = std::accumulate(result.begin(), result.end(), 0.0);
+            previous.gr_diffs = ctx.gr_diffs * etl::transpose(Temp ? ctx.gr_w_tmp : rbm.w);
 
-            for (auto& r : result) {
-                r *= (1.0 / scale);
+            if constexpr (previous_t::hidden_unit != unit_type::RELU) {
+                previous.gr_diffs = previous.gr_diffs >> previous.gr_probs >> (weight(1) - previous.gr_probs);
             }
 
-            for (size_t i = 0; i < n_hidden; ++i) {
-                diff[i] = result[i] - target[i];
-                cost += target[i] * log(result[i]);
-                error += diff[i] * diff[i];
-            }
-
-            ++it;
-            ++tit;
-            ++sample;
+            batch_backward<Temp, I - 1>(inputs);
         }
+    }
 
-        cost = -cost;
-
-        //Get pointers to the different gr_probs
-        std::array<std::vector<etl::dyn_vector<weight>>*, layers> probs_refs;
-        dbn.for_each_layer_i([&probs_refs](size_t I, auto& rbm) {
-            probs_refs[I] = &rbm.get_cg_context().gr_probs_a;
-        });
+    /*!
+     * \brief Compute the gradient of one context
+     *
+     * The layers are activated and the diffs are backpropagated with one
+     * GEMM per layer for the whole batch, and the increments of the weights
+     * are accumulated with one GEMM per layer as well.
+     *
+     * \param context The current gradient context
+     * \param cost The current cost
+     */
+    template <bool Temp>
+    void gradient(const gradient_context<weight>& context, weight& cost) {
+        const size_t n_samples = etl::dim<0>(context.inputs);
 
-        update_incs<Temp>(dbn.template layer_get<layers - 1>(), diffs, dbn.template layer_get<layers - 2>().get_cg_context().gr_probs_a);
+        batch_forward<Temp>(context.inputs);
 
-#ifdef __clang__
-        dbn.for_each_layer_rpair_i([n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
-            auto& c1 = r1.get_cg_context();
-            auto& c2 = r2.get_cg_context();
+        auto& last_rbm = dbn.template layer_get<layers - 1>();
+        auto& last     = last_rbm.get_cg_context();
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs, n_samples);
+        // Normalize the outputs of each sample
+        for (size_t i = 0; i < n_samples; ++i) {
+            const weight scale = etl::sum(last.gr_probs(i));
 
-            if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs, *probs_refs[I - 1]);
-            }
-        });
+            last.gr_probs(i) *= (weight(1) / scale);
+        }
 
-#else
-        std::vector<std::vector<weight>>& diffs_p = diffs;
+        ensure_rows(last.gr_diffs, n_samples, num_hidden(last_rbm));
 
-        dbn.for_each_layer_rpair_i([&diffs_p, n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
-            auto& c1 = r1.get_cg_context();
-            auto& c2 = r2.get_cg_context();
+        last.gr_diffs = last.gr_probs - context.targets;
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs_p, n_samples);
+        cost = -etl::sum(context.targets >> etl::log(last.gr_probs));
 
-            if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs_p, *probs_refs[I - 1]);
-            }
-        });
-#endif
+        const weight error = etl::sum(last.gr_diffs >> last.gr_diffs);
 
-        update_incs<Temp>(dbn.template layer_get<0>(), diffs, context.inputs);
+        batch_backward<Temp, layers - 1>(context.inputs);
 
         if (Debug) {
             std::cout << "evaluating(" << Temp << "): cost:" << cost << " error: " << (error / n_samples) << std::endl;
+        } else {
+            cpp_unused(error);
         }
     }
 
@@ -389,8 +357,7 @@ struct cg_trainer_base {
     /*!
      * \brief Minimize the gradient of the given context
      */
-    template <typename Sample, typename Target>
-    void minimize(const gradient_context<Sample, Target>& context) {
+    void minimize(const gradient_context<weight>& context) {
         constexpr weight INT   = 0.1;       //Don't reevaluate within 0.1 of the limit of the current bracket
         constexpr weight EXT   = 3.0;       //Extrapolate maximum 3 times the current step-size
         constexpr weight SIG   = 0.1;       //Maximum allowed maximum ration between previous and new slopes
@@ -22,6 +22,214 @@ namespace dll {
 template <typename DBN, typename Layer, size_t L>
 struct sgd_context;
 
+/*!
+ * \brief Indicates if a SGD context must hold a copy of its input batch.
+ *
+ * A context whose layer does not read its input after the forward pass can
+ * declare a static constexpr bool keep_input = false member. In that case,
+ * the trainer forwards the output of the previous layer directly, without
+ * copying it into the context.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_keeps_input : std::true_type {};
+
+/*!
+ * \copydoc sgd_keeps_input
+ */
+template <typename Context>
+struct sgd_keeps_input<Context, std::void_t<decltype(Context::keep_input)>> : std::bool_constant<Context::keep_input> {};
+
+/*!
+ * \brief Indicates if a SGD context must hold a copy of its input batch.
+ */
+template <typename Context>
+static constexpr bool sgd_keeps_input_v = sgd_keeps_input<Context>::value;
+
+/*!
+ * \brief Indicates if the errors of a SGD context are a view on the shared
+ * pool of the errors of the trainer.
+ *
+ * A context can declare a static constexpr bool shared_errors = true member
+ * (see sgd_shared_errors). In that case, it is constructed with the memory
+ * of its errors in the pool, shared with the errors of the other
+ * non-adjacent layers.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_shares_errors : std::false_type {};
+
+/*!
+ * \copydoc sgd_shares_errors
+ */
+template <typename Context>
+struct sgd_shares_errors<Context, std::void_t<decltype(Context::shared_errors)>> : std::bool_constant<Context::shared_errors> {};
+
+/*!
+ * \brief Indicates if the errors of a SGD context are a view on the shared
+ * pool of the errors of the trainer.
+ */
+template <typename Context>
+static constexpr bool sgd_shares_errors_v = sgd_shares_errors<Context>::value;
+
+/*!
+ * \brief Indicates if the activations of a SGD context are recomputed during
+ * the backward pass.
+ *
+ * A context can declare a static constexpr bool recomputed = true member
+ * (see sgd_recomputed). In that case, it is constructed with the memory of
+ * its input and its output in the pool of the recomputed activations of the
+ * trainer, shared with the layers of the other segments.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_recomputes : std::false_type {};
+
+/*!
+ * \copydoc sgd_recomputes
+ */
+template <typename Context>
+struct sgd_recomputes<Context, std::void_t<decltype(Context::recomputed)>> : std::bool_constant<Context::recomputed> {};
+
+/*!
+ * \brief Indicates if the activations of a SGD context are recomputed
+ * during the backward pass.
+ */
+template <typename Context>
+static constexpr bool sgd_recomputes_v = sgd_recomputes<Context>::value;
+
+/*!
+ * \brief Indicates if a SGD context is part of a sub-pixel convolution.
+ *
+ * The contexts of an upsampling layer and of the same convolution following
+ * it declare a static constexpr bool subpixel = true member when the two
+ * layers are fused (see is_subpixel_pair). In that case, the convolution
+ * keeps the input of the upsampling in its context and its errors are
+ * directly backpropagated to the input of the upsampling.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_subpixel : std::false_type {};
+
+/*!
+ * \copydoc sgd_subpixel
+ */
+template <typename Context>
+struct sgd_subpixel<Context, std::void_t<decltype(Context::subpixel)>> : std::bool_constant<Context::subpixel> {};
+
+/*!
+ * \brief Indicates if a SGD context is part of a sub-pixel convolution.
+ */
+template <typename Context>
+static constexpr bool sgd_subpixel_v = sgd_subpixel<Context>::value;
+
+/*!
+ * \brief Indicates if a SGD context holds the workspace of its layer.
+ *
+ * A context whose layer needs caches between the forward and the backward
+ * passes can declare a workspace member. In that case, the trainer calls
+ * layer.forward_batch(output, input, workspace) during training and the
+ * layer can use the workspace of the context during backpropagation,
+ * instead of keeping the caches in the layer itself.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_has_workspace : std::false_type {};
+
+/*!
+ * \copydoc sgd_has_workspace
+ */
+template <typename Context>
+struct sgd_has_workspace<Context, std::void_t<decltype(std::declval<Context&>().workspace)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a SGD context holds the workspace of its layer.
+ */
+template <typename Context>
+static constexpr bool sgd_has_workspace_v = sgd_has_workspace<Context>::value;
+
+/*!
+ * \brief Indicates if a SGD context holds row-sparse gradients.
+ *
+ * A context can declare a std::vector<size_t> rows member holding the rows
+ * of its first variable touched by the current batch together with a bool
+ * stale_grad member. In that case, the gradients are zero outside of these
+ * rows (unless stale_grad is set) and the trainer can update only these
+ * rows.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_sparse_rows : std::false_type {};
+
+/*!
+ * \copydoc sgd_sparse_rows
+ */
+template <typename Context>
+struct sgd_sparse_rows<Context, std::void_t<decltype(std::declval<Context&>().rows), decltype(std::declval<Context&>().stale_grad)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a SGD context holds row-sparse gradients.
+ */
+template <typename Context>
+static constexpr bool sgd_sparse_rows_v = sgd_sparse_rows<Context>::value;
+
+/*!
+ * \brief Indicates if the workspace of a SGD context holds the mask of
+ * variable-length sequences.
+ *
+ * The trainer sets the lengths of the sequences of each batch in the mask
+ * of such workspaces before the forward pass.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_has_mask : std::false_type {};
+
+/*!
+ * \copydoc sgd_has_mask
+ */
+template <typename Context>
+struct sgd_has_mask<Context, std::void_t<decltype(std::declval<Context&>().workspace.mask)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the workspace of a SGD context holds the mask of
+ * variable-length sequences.
+ */
+template <typename Context>
+static constexpr bool sgd_has_mask_v = sgd_has_mask<Context>::value;
+
+/*!
+ * \brief Indicates if a SGD context holds the number of active samples of
+ * the batch.
+ *
+ * A context can declare a size_t active member. The trainer sets it to the
+ * number of samples of each batch and the layer only computes the first
+ * active rows of its batch, the other rows of its outputs being cleared.
+ *
+ * \tparam Context The SGD context
+ */
+template <typename Context, typename Enable = void>
+struct sgd_has_active : std::false_type {};
+
+/*!
+ * \copydoc sgd_has_active
+ */
+template <typename Context>
+struct sgd_has_active<Context, std::void_t<decltype(std::declval<Context&>().active)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a SGD context holds the number of active samples of
+ * the batch.
+ */
+template <typename Context>
+static constexpr bool sgd_has_active_v = sgd_has_active<Context>::value;
+
 /*!
  * \brief The context of a RBM during CG training
  * \tparam RBM The RBM.
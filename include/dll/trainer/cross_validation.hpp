@@ -0,0 +1,230 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file cross_validation.hpp
+ * \brief k-fold cross-validation over the cache of a single generator
+ *
+ * The samples are never copied: the folds are ranges of a permutation of
+ * the indices of the samples of the generator, whose cache is only read.
+ * The training batches and the validation batches of each fold are
+ * gathered by index from the cache. The folds are trained concurrently on
+ * the shared scheduler.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/generators.hpp" // For generator_is_indexable
+#include "dll/trainer/dbn_trainer.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/scheduler.hpp" // For task_group
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The results of a k-fold cross-validation
+ */
+struct cv_results {
+    std::vector<double> errors; ///< The validation error of each fold
+    std::vector<double> losses; ///< The validation loss of each fold
+
+    double mean_error   = 0.0; ///< The mean of the validation errors
+    double stddev_error = 0.0; ///< The standard deviation of the validation errors
+    double mean_loss    = 0.0; ///< The mean of the validation losses
+    double stddev_loss  = 0.0; ///< The standard deviation of the validation losses
+
+    /*!
+     * \brief Compute the aggregate metrics from the metrics of the folds
+     */
+    void aggregate() {
+        auto stats = [](const std::vector<double>& values, double& mean, double& stddev) {
+            mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+
+            double var = 0.0;
+            for (double v : values) {
+                var += (v - mean) * (v - mean);
+            }
+
+            stddev = std::sqrt(var / values.size());
+        };
+
+        stats(errors, mean_error, stddev_error);
+        stats(losses, mean_loss, stddev_loss);
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Compute the (error, loss) of the network on the samples of the
+ * generator with the given indices.
+ */
+template <typename DBN, typename Generator, typename Inputs, typename Labels>
+std::pair<double, double> evaluate_subset(DBN& dbn, const Generator& generator, const size_t* subset, size_t samples, Inputs& inputs, Labels& labels) {
+    const size_t B = etl::dim<0>(inputs);
+
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t first = 0; first < samples; first += B) {
+        const size_t n = std::min(B, samples - first);
+
+        for (size_t i = 0; i < n; ++i) {
+            inputs(i) = generator.sample(subset[first + i]);
+            generator.copy_label(subset[first + i], labels(i));
+        }
+
+        auto [batch_error, batch_loss] = n == B
+            ? dbn.evaluate_metrics_batch(dbn.test_forward_batch(inputs), labels, n, false)
+            : dbn.evaluate_metrics_batch(dbn.test_forward_batch(etl::slice(inputs, 0, n)), etl::slice(labels, 0, n), n, false);
+
+        error += batch_error;
+        loss += batch_loss;
+    }
+
+    return std::make_pair(error / samples, loss / samples);
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Run a k-fold cross-validation of the networks created by the
+ * given factory over the samples of the generator.
+ *
+ * Each fold trains a new network on the other folds, for at most
+ * max_epochs, with its own early stopping on the training metrics, and
+ * evaluates it on the fold.
+ *
+ * \param factory A functor returning a std::unique_ptr to a new network
+ * \param generator The generator holding the samples (only read)
+ * \param k The number of folds
+ * \param max_epochs The maximum number of epochs of each fold
+ * \param parallel Indicates if the folds are trained concurrently
+ *
+ * \return The metrics of the folds and their aggregate
+ */
+template <typename Factory, typename Generator>
+cv_results cross_validate(Factory&& factory, Generator& generator, size_t k, size_t max_epochs, bool parallel = true) {
+    static_assert(generator_is_indexable<Generator>, "Cross-validation needs a generator whose samples can be read by index");
+
+    using dbn_t = typename std::decay_t<decltype(factory())>::element_type;
+
+    static_assert(dbn_t::batch_size == Generator::batch_size, "Invalid batch size for generator");
+
+    static dll::timer_id timer_handle("net:cross_validate");
+    dll::auto_timer timer(timer_handle);
+
+    const size_t N = generator.size();
+
+    cpp_assert(k > 1 && k <= N, "Invalid number of folds");
+
+    cv_results results;
+    results.errors.resize(k);
+    results.losses.resize(k);
+
+    // The folds are ranges of one permutation of the samples
+    std::vector<size_t> permutation(N);
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::shuffle(permutation.begin(), permutation.end(), dll::rand_engine());
+
+    // The gathered batches have the shape of the batches of the generator
+    generator.reset();
+    generator.set_train();
+
+    auto inputs_0 = etl::force_temporary(generator.data_batch());
+    auto labels_0 = etl::force_temporary(generator.label_batch());
+
+    using inputs_t = decltype(inputs_0);
+    using labels_t = decltype(labels_0);
+
+    // The state of the training of one fold
+    struct fold_t {
+        std::unique_ptr<dbn_t> dbn; // The network of the fold
+        dbn_trainer<dbn_t> trainer; // The trainer of the network
+        std::vector<size_t> train;  // The indices of the training samples
+        inputs_t inputs;            // The gathered inputs
+        labels_t labels;            // The gathered labels
+
+        fold_t(std::unique_ptr<dbn_t> dbn, const inputs_t& inputs, const labels_t& labels) : dbn(std::move(dbn)), inputs(inputs), labels(labels) {}
+    };
+
+    // The networks and the trainers are created one after the other, they draw from the DLL engine
+    std::vector<std::unique_ptr<fold_t>> folds;
+
+    for (size_t f = 0; f < k; ++f) {
+        auto fold = std::make_unique<fold_t>(factory(), inputs_0, labels_0);
+
+        const size_t first = f * N / k;
+        const size_t last  = (f + 1) * N / k;
+
+        fold->train.reserve(N - (last - first));
+        fold->train.insert(fold->train.end(), permutation.begin(), permutation.begin() + first);
+        fold->train.insert(fold->train.end(), permutation.begin() + last, permutation.end());
+
+        fold->trainer.engine = std::make_unique<random_engine>(dll::rand_engine()());
+        fold->trainer.start_training(*fold->dbn, max_epochs);
+
+        folds.push_back(std::move(fold));
+    }
+
+    auto train_fold = [&](size_t f) {
+        auto& fold    = *folds[f];
+        auto& dbn     = *fold.dbn;
+        auto& trainer = fold.trainer;
+
+        size_t epoch = 0;
+        for (; epoch < max_epochs; ++epoch) {
+            trainer.start_epoch(dbn, epoch);
+
+            auto [error, loss] = trainer.train_epoch_gathered(dbn, generator, fold.train.data(), fold.train.size(), epoch, fold.inputs, fold.labels);
+
+            if (trainer.stop_epoch(dbn, epoch, error, loss)) {
+                break;
+            }
+        }
+
+        trainer.stop_training(dbn, epoch, max_epochs);
+
+        // Release the training contexts before the evaluation
+        trainer.trainer.reset();
+
+        const size_t first = f * N / k;
+        const size_t last  = (f + 1) * N / k;
+
+        std::tie(results.errors[f], results.losses[f]) = detail::evaluate_subset(dbn, generator, permutation.data() + first, last - first, fold.inputs, fold.labels);
+    };
+
+    if (parallel) {
+        task_group pool;
+
+        for (size_t f = 0; f < k; ++f) {
+            pool.do_task([&train_fold, f] { train_fold(f); });
+        }
+
+        pool.wait();
+    } else {
+        for (size_t f = 0; f < k; ++f) {
+            train_fold(f);
+        }
+    }
+
+    results.aggregate();
+
+    return results;
+}
+
+} //end of dll namespace
@@ -7,19 +7,217 @@
 
 #pragma once
 
+#include <algorithm>
+#include <future>
+#include <numeric>
+#include <optional>
+#include <sstream>
+
 #include "cpp_utils/algorithm.hpp" // For parallel_shuffle
 
 #include "etl/etl.hpp"
 
 #include "dll/util/labels.hpp"
 #include "dll/util/timers.hpp"
+#include "dll/util/trace.hpp"
 #include "dll/util/random.hpp"
 #include "dll/util/batch.hpp" // For make_batch
+#include "dll/util/batch_ring.hpp" // For prefetch_stats
+#include "dll/util/batch_phases.hpp" // For batch_phases
+#include "dll/util/checkpointer.hpp"
+#include "dll/util/distillation.hpp" // For distillation
+#include "dll/util/importance.hpp" // For importance_sampler
+#include "dll/util/scheduler.hpp" // For task_group
 #include "dll/test.hpp"
 #include "dll/dbn_traits.hpp"
 
 namespace dll {
 
+/*!
+ * \brief Traits to test if a watcher can report the prefetching statistics
+ * of the generators
+ */
+template <typename W, typename DBN, typename = int>
+struct watcher_has_prefetch_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a watcher can report the prefetching statistics
+ * of the generators
+ */
+template <typename W, typename DBN>
+struct watcher_has_prefetch_impl<W, DBN, decltype((void)std::declval<W&>().ft_prefetch(std::declval<const prefetch_stats&>(), std::declval<const DBN&>()), 0)>
+        : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can report the prefetching statistics
+ * of the generators
+ */
+template <typename W, typename DBN>
+constexpr bool watcher_has_prefetch = watcher_has_prefetch_impl<W, DBN>::value;
+
+/*!
+ * \brief Traits to test if a watcher can report the phases of the batches
+ */
+template <typename W, typename DBN, typename = int>
+struct watcher_has_phases_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a watcher can report the phases of the batches
+ */
+template <typename W, typename DBN>
+struct watcher_has_phases_impl<W, DBN, decltype((void)std::declval<W&>().ft_batch_phases(size_t(), std::declval<const batch_phases&>(), size_t(), std::declval<const DBN&>()), 0)>
+        : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can report the phases of the batches
+ */
+template <typename W, typename DBN>
+constexpr bool watcher_has_phases = watcher_has_phases_impl<W, DBN>::value;
+
+/*!
+ * \brief Traits to test if a trainer measures the phases of its batches
+ */
+template <typename T, typename = int>
+struct trainer_has_phases_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer measures the phases of its batches
+ */
+template <typename T>
+struct trainer_has_phases_impl<T, decltype((void)batch_phases(std::declval<T&>().phases), 0)> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer measures the phases of its batches
+ */
+template <typename T>
+constexpr bool trainer_has_phases = trainer_has_phases_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a trainer can train batches whose inputs have
+ * been staged beforehand
+ */
+template <typename T, typename = int>
+struct trainer_has_staging_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer can train batches whose inputs have
+ * been staged beforehand
+ */
+template <typename T>
+struct trainer_has_staging_impl<T, decltype((void)std::declval<T&>().swap_staged_inputs(), 0)> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer can train batches whose inputs have
+ * been staged beforehand
+ */
+template <typename T>
+constexpr bool trainer_has_staging = trainer_has_staging_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a trainer accumulates gradients over several
+ * mini-batches, to be flushed at the end of each epoch
+ */
+template <typename T, typename = int>
+struct trainer_has_accumulation_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer accumulates gradients over several
+ * mini-batches, to be flushed at the end of each epoch
+ */
+template <typename T>
+struct trainer_has_accumulation_impl<T, decltype((void)std::declval<T&>().flush_gradients(size_t(0)), 0)> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer accumulates gradients over several
+ * mini-batches, to be flushed at the end of each epoch
+ */
+template <typename T>
+constexpr bool trainer_has_accumulation = trainer_has_accumulation_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a trainer can train from the cached outputs of
+ * the frozen prefix of the network
+ */
+template <typename T, typename = int>
+struct trainer_has_frozen_cache_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer can train from the cached outputs of
+ * the frozen prefix of the network
+ */
+template <typename T>
+struct trainer_has_frozen_cache_impl<T, decltype((void)T::has_frozen_cache, 0)> : std::bool_constant<T::has_frozen_cache> {};
+
+/*!
+ * \brief Traits to test if a trainer can train from the cached outputs of
+ * the frozen prefix of the network
+ */
+template <typename T>
+constexpr bool trainer_has_frozen_cache = trainer_has_frozen_cache_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a trainer can weight the errors of each sample
+ * and give back their losses
+ */
+template <typename T, typename = int>
+struct trainer_has_sample_weights_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer can weight the errors of each sample
+ * and give back their losses
+ */
+template <typename T>
+struct trainer_has_sample_weights_impl<T, decltype((void)T::has_sample_weights, 0)> : std::bool_constant<T::has_sample_weights> {};
+
+/*!
+ * \brief Traits to test if a trainer can weight the errors of each sample
+ * and give back their losses
+ */
+template <typename T>
+constexpr bool trainer_has_sample_weights = trainer_has_sample_weights_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a trainer can mix the soft targets of a teacher
+ * in the errors
+ */
+template <typename T, typename = int>
+struct trainer_has_soft_targets_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer can mix the soft targets of a teacher
+ * in the errors
+ */
+template <typename T>
+struct trainer_has_soft_targets_impl<T, decltype((void)T::has_soft_targets, 0)> : std::bool_constant<T::has_soft_targets> {};
+
+/*!
+ * \brief Traits to test if a trainer can mix the soft targets of a teacher
+ * in the errors
+ */
+template <typename T>
+constexpr bool trainer_has_soft_targets = trainer_has_soft_targets_impl<T>::value;
+
+/*!
+ * \brief Traits to test if a trainer waits for the background backup of
+ * the weights before updating them
+ */
+template <typename T, typename = int>
+struct trainer_waits_backup_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a trainer waits for the background backup of
+ * the weights before updating them
+ */
+template <typename T>
+struct trainer_waits_backup_impl<T, decltype((void)T::waits_backup, 0)> : std::bool_constant<T::waits_backup> {};
+
+/*!
+ * \brief Traits to test if a trainer waits for the background backup of
+ * the weights before updating them
+ */
+template <typename T>
+constexpr bool trainer_waits_backup = trainer_waits_backup_impl<T>::value;
+
 /*!
  * \brief A generic trainer for Deep Belief Network
  *
@@ -60,6 +258,53 @@ struct dbn_trainer {
     size_t best_epoch     = 0;   ///< The best epoch
     size_t patience       = 0;   ///< The current patience
 
+    std::unique_ptr<async_checkpointer> checkpointer; ///< The checkpointer (only when checkpoints are enabled)
+
+    importance_sampler sampler; ///< The loss scores of the training samples (importance sampling)
+
+    std::unique_ptr<distillation<weight>> distiller; ///< The teacher of the training (none if null)
+
+    std::unique_ptr<random_engine> engine; ///< The random engine of the shuffles of the indexed epochs (the DLL engine if null)
+
+    /*!
+     * \brief Returns the random engine of the shuffles of the indexed epochs
+     */
+    random_engine& shuffle_engine(){
+        return engine ? *engine : dll::rand_engine();
+    }
+    size_t trained_batches = 0;                       ///< The number of batches trained since the beginning of the training
+
+    /*!
+     * \brief Indicates if the current process drives the watcher. This is
+     * only false for the non-master processes of a distributed training.
+     * \param dbn The network that is trained
+     */
+    bool master(const dbn_t& dbn) const {
+        return !dbn.comm || dbn.comm->master();
+    }
+
+    /*!
+     * \brief Reduce the error and loss over all the processes of a
+     * distributed training.
+     * \param dbn The network that is trained
+     * \param stats The local (error, loss)
+     * \param n The local number of samples
+     * \return the global (error, loss)
+     */
+    std::pair<double, double> global_error_loss(dbn_t& dbn, std::pair<double, double> stats, size_t n){
+        if (dbn.comm && dbn.comm->size() > 1) {
+            double values[3] = {stats.first * n, stats.second * n, double(n)};
+
+            dbn.comm->all_reduce(values, 3);
+
+            if (values[2] > 0.0) {
+                return std::make_pair(values[0] / values[2], values[1] / values[2]);
+            }
+        }
+
+        return stats;
+    }
+
     /*!
      * \brief Initialize the training
      * \param dbn The network to train
@@ -72,7 +317,11 @@ struct dbn_trainer {
         //Initialize the momentum
         dbn.momentum = dbn.initial_momentum;
 
-        watcher.fine_tuning_begin(dbn, max_epochs);
+        if (master(dbn)) {
+            trace_scope scope("watcher:fine_tuning_begin", "watcher");
+
+            watcher.fine_tuning_begin(dbn, max_epochs);
+        }
 
         trainer = std::make_unique<trainer_t<dbn_t>>(dbn);
 
@@ -85,6 +334,37 @@ struct dbn_trainer {
 
         current_val_error = 0.0;
         current_val_loss = 0.0;
+
+        trained_batches = 0;
+
+        sampler.reset(0);
+        sampler.smoothing = dbn.importance_smoothing;
+
+        // Only the master process writes the checkpoints
+        if (master(dbn) && !dbn.checkpoint_prefix.empty() && (dbn.checkpoint_epochs || dbn.checkpoint_batches)) {
+            checkpointer = std::make_unique<async_checkpointer>(dbn.checkpoint_keep);
+        }
+    }
+
+    /*!
+     * \brief Write a checkpoint of the network, in the background
+     * \param dbn The network that is trained
+     * \param kind The kind of step ("epoch" or "batch")
+     * \param step The number of steps done
+     */
+    void checkpoint(const dbn_t& dbn, const char* kind, size_t step){
+        checkpointer->checkpoint(dbn, dbn.checkpoint_prefix + "." + kind + std::to_string(step) + ".dllc");
+    }
+
+    /*!
+     * \brief Write a checkpoint at the end of the given epoch, if necessary
+     * \param dbn The network that is trained
+     * \param epoch The current epoch
+     */
+    void epoch_checkpoint(const dbn_t& dbn, size_t epoch){
+        if (checkpointer && dbn.checkpoint_epochs && (epoch + 1) % dbn.checkpoint_epochs == 0) {
+            checkpoint(dbn, "epoch", epoch + 1);
+        }
     }
 
     /*!
@@ -116,7 +396,14 @@ struct dbn_trainer {
             }
         }
 
-        watcher.fine_tuning_end(dbn);
+        // Wait for the last checkpoint to be written
+        checkpointer.reset();
+
+        if (master(dbn)) {
+            trace_scope scope("watcher:fine_tuning_end", "watcher");
+
+            watcher.fine_tuning_end(dbn);
+        }
 
         return current_error;
     }
@@ -127,7 +414,28 @@ struct dbn_trainer {
      * \param epoch The current epoch
      */
     void start_epoch(dbn_t& dbn, size_t epoch){
-        watcher.ft_epoch_start(epoch, dbn);
+        if (master(dbn)) {
+            trace_scope scope("watcher:ft_epoch_start", "watcher");
+
+            watcher.ft_epoch_start(epoch, dbn);
+        }
+    }
+
+    /*!
+     * \brief Save the current weights as the best ones.
+     *
+     * If the trainer waits for it, the copy is done in the background,
+     * while the next batch is forwarded and backpropagated.
+     */
+    void backup_best(dbn_t& dbn){
+        if constexpr (trainer_waits_backup<trainer_t<dbn_t>>) {
+            if (dbn.background_backup) {
+                dbn.start_backup_weights();
+                return;
+            }
+        }
+
+        dbn.backup_weights();
     }
 
     /*!
@@ -157,14 +465,14 @@ struct dbn_trainer {
                     best_error = error;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best(dbn);
                 }
             } else {
                 if(!epoch || loss < best_loss){
                     best_loss = loss;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best(dbn);
                 }
             }
         }
@@ -308,11 +616,17 @@ struct dbn_trainer {
      */
     bool stop_epoch(dbn_t& dbn, size_t epoch, double error, double loss){
         //After some time increase the momentum
-        if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
+        if ((dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM || dbn_traits<dbn_t>::updater() == updater_type::LARS) && epoch == dbn.final_momentum_epoch) {
             dbn.momentum = dbn.final_momentum;
         }
 
-        watcher.ft_epoch_end(epoch, error, loss, dbn);
+        if (master(dbn)) {
+            trace_scope scope("watcher:ft_epoch_end", "watcher");
+
+            watcher.ft_epoch_end(epoch, error, loss, dbn);
+        }
+
+        epoch_checkpoint(dbn, epoch);
 
         // Early stopping with training error/loss
         auto stop =  early_stop(dbn, epoch, error, loss, current_error, current_loss);
@@ -333,14 +647,33 @@ struct dbn_trainer {
      * \return true if the training is over
      */
     bool stop_epoch(dbn_t& dbn, size_t epoch, const std::pair<double, double>& train_stats, const std::pair<double, double>& val_stats){
+        return stop_epoch(dbn, epoch, train_stats, val_stats, val_stats);
+    }
+
+    /*!
+     * \brief Indicates the end of an epoch
+     * \param dbn The network that is trained
+     * \param epoch The current epoch
+     * \param train_stats The training (error, loss)
+     * \param val_stats The validation (error, loss) reported to the watcher
+     * \param early_stats The validation (error, loss) used for early stopping
+     * \return true if the training is over
+     */
+    bool stop_epoch(dbn_t& dbn, size_t epoch, const std::pair<double, double>& train_stats, const std::pair<double, double>& val_stats, const std::pair<double, double>& early_stats){
         double error = train_stats.first;
 
         //After some time increase the momentum
-        if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
+        if ((dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM || dbn_traits<dbn_t>::updater() == updater_type::LARS) && epoch == dbn.final_momentum_epoch) {
             dbn.momentum = dbn.final_momentum;
         }
 
-        watcher.ft_epoch_end(epoch, error, train_stats.second, val_stats.first, val_stats.second, dbn);
+        if (master(dbn)) {
+            trace_scope scope("watcher:ft_epoch_end", "watcher");
+
+            watcher.ft_epoch_end(epoch, error, train_stats.second, val_stats.first, val_stats.second, dbn);
+        }
+
+        epoch_checkpoint(dbn, epoch);
 
         // Early stopping with validation (or training) error/loss
 
@@ -348,15 +681,15 @@ struct dbn_trainer {
         if (dbn_traits<dbn_t>::early_uses_training()) {
             stop = early_stop(dbn, epoch, train_stats.first, train_stats.second, current_error, current_loss);
         } else {
-            stop = early_stop(dbn, epoch, val_stats.first, val_stats.second, current_val_error, current_val_loss);
+            stop = early_stop(dbn, epoch, early_stats.first, early_stats.second, current_val_error, current_val_loss);
         }
 
         // Save current error and loss for training and validation
         current_error = train_stats.first;
         current_loss  = train_stats.second;
 
-        current_val_error = val_stats.first;
-        current_val_loss  = val_stats.second;
+        current_val_error = early_stats.first;
+        current_val_loss  = early_stats.second;
 
         return stop;
     }
@@ -374,161 +707,1103 @@ struct dbn_trainer {
         double new_loss  = -1.0;
 
         if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
-            dll::auto_timer timer("net:trainer:train:epoch:error");
+            static dll::timer_id timer_handle("net:trainer:train:epoch:error");
+            dll::auto_timer timer(timer_handle);
 
-            auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
-                return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
-            };
+            if (dbn.is_parallel_evaluation(generator)) {
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator);
+            } else {
+                auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
+                    return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
+                };
 
-            std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+            }
+
+            std::tie(new_error, new_loss) = global_error_loss(dbn, std::make_pair(new_error, new_loss), generator.size());
         }
 
         return std::make_pair(new_error, new_loss);
     }
 
     /*!
-     * \brief Train the network for one epoch
-     * \param generator The generator for training data
+     * \brief Indicates if the given validation (error, loss) would be a new
+     * best for the early stopping strategy
      * \param epoch The current epoch
+     * \param stats The validation (error, loss)
      */
-    template<typename Generator>
-    void train_epoch_only(dbn_t& dbn, Generator& generator, size_t epoch){
-        // Set the generator in train mode
-        generator.set_train();
-
-        //Train one mini-batch at a time
-        while(generator.has_next_batch()){
-            dll::auto_timer timer("net:trainer:train:epoch:batch");
-
-            watcher.ft_batch_start(epoch, dbn);
-
-            auto [batch_error, batch_loss] = trainer->train_batch(
-                epoch,
-                generator.data_batch(),
-                generator.label_batch());
+    bool is_new_best(size_t epoch, const std::pair<double, double>& stats) const {
+        static constexpr auto s = dbn_t::early;
 
-            watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
+        if constexpr (s == strategy::NONE || dbn_traits<dbn_t>::early_uses_training()) {
+            cpp_unused(epoch);
+            cpp_unused(stats);
 
-            generator.next_batch();
+            return false;
+        } else if constexpr (is_error(s)) {
+            return !epoch || stats.first < best_error;
+        } else {
+            return !epoch || stats.second < best_loss;
         }
     }
 
     /*!
-     * \brief Train the network for one epoch and compute the loss and error on the training set
+     * \brief Select the samples of the validation subset
      *
-     * \param dbn The network to train
-     * \param generator The generator to use for training data
-     * \param epoch The current epoch
+     * The samples are either selected at random or, for stratified
+     * validation, with the same proportion of each class as the complete
+     * validation set.
      *
-     * \return a pair containing (error, loss)
+     * \param dbn The network that is trained
+     * \param generator The validation generator
+     * \param budget The number of samples to select
+     * \return the indices of the selected samples, in increasing order
      */
-    template<typename Generator>
-    std::pair<double, double> train_epoch(dbn_t& dbn, Generator& generator, size_t epoch){
-        // Train one epoch of training data
-        train_epoch_only(dbn, generator, epoch);
+    template <typename Generator>
+    std::vector<size_t> select_validation(dbn_t& dbn, Generator& generator, size_t budget){
+        const size_t n = generator.size();
 
-        // Compute the error at this epoch
-        return compute_error_loss(dbn, generator);
-    }
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
 
-    /*!
-     * \brief Train the network for one epoch and compute the loss and error
-     * on the training and validation sets
-     *
-     * \param dbn The network to train
-     * \param train_generator The generator to use for training data
-     * \param val_generator The generator to use for validation data
-     * \param epoch The current epoch
-     *
-     * \return a pair of pair containing ((train_error, train_loss), (val_error, val_loss))
-     */
-    template<typename TrainGenerator, typename ValGenerator>
-    std::pair<std::pair<double, double>, std::pair<double, double>> train_epoch(dbn_t& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t epoch){
-        // Train one epoch of training data
-        train_epoch_only(dbn, train_generator, epoch);
+        using label_batch_t = decltype(generator.label_batch());
 
-        // Compute the training error at this epoch
-        auto train_stats = compute_error_loss(dbn, train_generator);
+        std::vector<size_t> selected;
+        selected.reserve(budget);
 
-        // Compute the training error at this epoch
-        auto val_stats = compute_error_loss(dbn, val_generator);
+        if constexpr (etl::dimensions<label_batch_t>() == 2) {
+            if (dbn.stratified_validation) {
+                std::vector<size_t> classes(n);
 
-        // Return the stats
-        return std::make_pair(train_stats, val_stats);
-    }
+                size_t i = 0;
+                for (generator.reset(); generator.has_next_batch(); generator.next_batch()) {
+                    auto label_batch = generator.label_batch();
 
-    template<typename Generator>
-    void reset_shuffle(Generator& generator){
-        if constexpr (is_generator<Generator> && dbn_traits<dbn_t>::shuffle()) {
-            generator.reset_shuffle();
+                    for (size_t k = 0; k < etl::dim<0>(label_batch); ++k) {
+                        classes[i++] = etl::max_index(label_batch(k));
+                    }
+                }
+
+                // Every (n / budget)th sample of the shuffled samples grouped
+                // by class gives each class its share of the budget
+                std::stable_sort(order.begin(), order.end(), [&classes](size_t a, size_t b) { return classes[a] < classes[b]; });
+
+                for (size_t j = 0; j < budget; ++j) {
+                    selected.push_back(order[j * n / budget]);
+                }
+            }
         } else {
-            generator.reset();
+            cpp_unused(dbn);
+        }
+
+        if (selected.empty()) {
+            selected.assign(order.begin(), order.begin() + budget);
         }
+
+        std::sort(selected.begin(), selected.end());
+
+        return selected;
     }
 
     /*!
-     * \brief Train the network for max_epochs
+     * \brief Make a generator over a subset of the validation set, of the
+     * size of the validation budget of the network.
      *
-     * \param dbn The network to be trained
-     * \param generator The generator for the training data
-     * \param max_epochs The maximum number of epochs
+     * The samples are copied once, after their preprocessing by the
+     * validation generator.
      *
-     * \return The final error
+     * \param dbn The network that is trained
+     * \param generator The validation generator
+     * \return the generator of the subset, or nullptr if the complete set must be used
      */
     template <typename Generator>
-    error_type train(DBN& dbn, Generator& generator, size_t max_epochs) {
-        dll::auto_timer timer("net:trainer:train");
+    auto make_validation_subset(dbn_t& dbn, Generator& generator){
+        using data_batch_t  = decltype(generator.data_batch());
+        using label_batch_t = decltype(generator.label_batch());
 
-        // Initialization steps
-        start_training(dbn, max_epochs);
+        using sample_t = etl::dyn_matrix<etl::value_t<data_batch_t>, etl::dimensions<data_batch_t>() - 1>;
+        using label_t  = etl::dyn_matrix<etl::value_t<label_batch_t>, etl::dimensions<label_batch_t>() - 1>;
 
-        //Train the model for max_epochs epoch
+        using desc_t = inmemory_data_generator_desc<dll::batch_size<dbn_t::batch_size>>;
 
-        size_t epoch = 0;
-        for (; epoch < max_epochs; ++epoch) {
-            dll::auto_timer timer("net:trainer:train:epoch");
+        using subset_t = decltype(make_generator(std::declval<std::vector<sample_t>&>(), std::declval<std::vector<label_t>&>(), size_t(0), desc_t{}));
 
-            {
-                dll::auto_timer timer("net:trainer:train:epoch:prepare");
+        subset_t subset;
 
-                // Shuffle before the epoch if necessary
-                reset_shuffle(generator);
+        const size_t budget = dbn.validation_budget;
 
-                // This will ensure maximum performance for the training
-                generator.prepare_epoch();
-            }
+        if (!budget || budget >= generator.size()) {
+            return subset;
+        }
 
-            start_epoch(dbn, epoch);
+        auto selected = select_validation(dbn, generator, budget);
 
-            auto [error, loss] = train_epoch(dbn, generator, epoch);
+        std::vector<sample_t> samples;
+        std::vector<label_t> labels;
 
-            if(stop_epoch(dbn, epoch, error, loss)){
-                break;
+        samples.reserve(budget);
+        labels.reserve(budget);
+
+        size_t i    = 0;
+        size_t next = 0;
+
+        for (generator.reset(); generator.has_next_batch() && next < budget; generator.next_batch()) {
+            auto data_batch  = generator.data_batch();
+            auto label_batch = generator.label_batch();
+
+            for (size_t k = 0; k < etl::dim<0>(data_batch); ++k, ++i) {
+                if (next < budget && selected[next] == i) {
+                    samples.emplace_back(data_batch(k));
+                    labels.emplace_back(label_batch(k));
+
+                    ++next;
+                }
             }
         }
 
-        // Finalization
+        subset = make_generator(samples, labels, etl::dim<0>(labels.front()), desc_t{});
+        subset->set_test();
 
-        return stop_training(dbn, epoch, max_epochs);
+        return subset;
     }
 
     /*!
-     * \brief Train the network for max_epochs
-     *
-     * \param dbn The network to be trained
-     * \param train_generator The generator for the training data
-     * \param val_generator The generator for the validation data
-     * \param max_epochs The maximum number of epochs
-     *
-     * \return The final error
-     */
-    template <typename TrainGenerator, typename ValGenerator>
+     * \brief Compute the training error and loss of the epoch, either from
+     * the metrics accumulated during training or with a complete pass
+     * over the training set.
+     * \param dbn The network to be used
+     * \param generator The generator to get data from
+     * \param stats The metrics accumulated during the training epoch
+     * \return a pair containing (error, loss)
+     */
+    template<typename Generator>
+    std::pair<double, double> compute_train_error_loss(dbn_t& dbn, Generator& generator, std::pair<double, double> stats){
+        if constexpr (dbn_traits<dbn_t>::full_epoch_error()) {
+            cpp_unused(stats);
+
+            return compute_error_loss(dbn, generator);
+        } else {
+            cpp_unused(dbn);
+            cpp_unused(generator);
+
+            return stats;
+        }
+    }
+
+    /*!
+     * \brief Report the end of a batch to the watcher and write the batch
+     * checkpoints
+     */
+    void end_batch(dbn_t& dbn, size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss) {
+        if (master(dbn)) {
+            trace_scope scope("watcher:ft_batch_end", "watcher");
+
+            watcher.ft_batch_end(epoch, batch, batches, batch_error, batch_loss, dbn);
+        }
+
+        ++trained_batches;
+
+        if (checkpointer && dbn.checkpoint_batches && trained_batches % dbn.checkpoint_batches == 0) {
+            checkpoint(dbn, "batch", trained_batches);
+        }
+    }
+
+    /*!
+     * \brief Train the network for one epoch, preparing each batch while the
+     * previous one is trained.
+     *
+     * The inputs of the next batch are copied into the staging buffer of the
+     * first layer, and its labels into a private copy, by a task of the
+     * shared scheduler, while the current batch is forwarded, backpropagated
+     * and applied. The generator is only used by this task during the
+     * training of a batch. The batches and their order are the same as with
+     * the serial loop. When the training is resident on the GPU, the next
+     * batch is also uploaded to the device by this task.
+     *
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch_pipelined(dbn_t& dbn, Generator& generator, size_t epoch){
+        using labels_t = std::decay_t<decltype(etl::force_temporary(generator.label_batch()))>;
+
+        double error = 0.0;
+        double loss  = 0.0;
+        size_t n     = 0;
+
+        static constexpr bool report_phases = watcher_has_phases<watcher_t<dbn_t>, dbn_t>;
+
+        const size_t batches = generator.batches();
+
+        std::optional<labels_t> labels;
+        std::optional<labels_t> next_labels;
+
+        bool next         = false; // Indicates if a batch has been staged
+        size_t next_index = 0;     // The index of the staged batch
+
+        auto stage = [&] {
+            trace_scope scope("trainer:stage", "trainer");
+
+            SERIAL_SECTION {
+                trainer->stage_inputs(generator.data_batch());
+                next_labels.emplace(etl::force_temporary(generator.label_batch()));
+            }
+
+            if constexpr (trainer_t<dbn_t>::gpu_resident) {
+                next_labels->ensure_gpu_up_to_date();
+            }
+
+            next_index = generator.current_batch();
+            next       = true;
+        };
+
+        // The first batch cannot be overlapped
+        if (generator.has_next_batch()) {
+            stage();
+        }
+
+        task_group prefetcher;
+
+        // The time from which the next batch is awaited
+        std::chrono::steady_clock::time_point wait_start;
+
+        if constexpr (report_phases) {
+            wait_start = std::chrono::steady_clock::now();
+        }
+
+        while (next) {
+            static dll::timer_id timer_handle("net:trainer:train:epoch:batch");
+            dll::auto_timer timer(timer_handle);
+
+            if (master(dbn)) {
+                trace_scope scope("watcher:ft_batch_start", "watcher");
+
+                watcher.ft_batch_start(epoch, dbn);
+            }
+
+            trainer->swap_staged_inputs();
+            std::swap(labels, next_labels);
+
+            const size_t index   = next_index;
+            const size_t batch_n = etl::dim<0>(*labels);
+
+            std::chrono::steady_clock::time_point ready;
+
+            if constexpr (report_phases) {
+                ready = std::chrono::steady_clock::now();
+            }
+
+            // Prepare the next batch while this one is trained
+            next = false;
+
+            prefetcher.do_task([&generator, &stage] {
+                generator.next_batch();
+
+                if (generator.has_next_batch()) {
+                    stage();
+                }
+            });
+
+            auto [batch_error, batch_loss] = trainer->train_staged_batch(epoch, *labels);
+
+            if constexpr (report_phases) {
+                wait_start = std::chrono::steady_clock::now();
+            }
+
+            // Only the part of the preparation longer than the batch is waited
+            {
+                trace_scope scope("trainer:stage_wait", "trainer");
+
+                prefetcher.wait();
+            }
+
+            if constexpr (report_phases) {
+                if (master(dbn)) {
+                    batch_phases phases;
+
+                    if constexpr (trainer_has_phases<trainer_t<dbn_t>>) {
+                        phases = trainer->phases;
+                    } else {
+                        phases.compute = batch_phases::seconds(ready, wait_start);
+                    }
+
+                    phases.wait = batch_phases::seconds(wait_start, std::chrono::steady_clock::now());
+
+                    trace_scope scope("watcher:ft_batch_phases", "watcher");
+
+                    watcher.ft_batch_phases(epoch, phases, batch_n, dbn);
+                }
+            }
+
+            end_batch(dbn, epoch, index, batches, batch_error, batch_loss);
+
+            // The batch metrics are normalized by the size of the batch
+            error += batch_error * batch_n;
+            loss += batch_loss * batch_n;
+            n += batch_n;
+        }
+
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch()) {
+            if (n) {
+                return global_error_loss(dbn, std::make_pair(error / n, loss / n), n);
+            }
+        }
+
+        return std::make_pair(1.0, -1.0);
+    }
+
+    /*!
+     * \brief Train the network for one epoch over samples read by index.
+     *
+     * The samples are visited once, shuffled if the network shuffles its
+     * training data. With importance sampling, once all the samples have a
+     * loss, the samples of the epoch are instead drawn from their losses and
+     * their errors are weighted accordingly.
+     *
+     * \param dbn The network to train
+     * \param samples The number of samples
+     * \param epoch The current epoch
+     * \param train_batch The functor training the batch of the given samples
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Train>
+    std::pair<double, double> train_epoch_indexed(dbn_t& dbn, size_t samples, size_t epoch, Train&& train_batch){
+        std::vector<size_t> order;
+        std::vector<weight> weights;
+
+        constexpr bool importance = trainer_has_sample_weights<trainer_t<dbn_t>>;
+
+        const bool sampled = importance && dbn.importance_sampling;
+
+        if (sampled && sampler.scored(samples)) {
+            sampler.draw(order, weights, samples, shuffle_engine());
+        } else {
+            if (sampled) {
+                sampler.reset(samples);
+            }
+
+            order.resize(samples);
+            std::iota(order.begin(), order.end(), 0);
+
+            if (dbn_traits<dbn_t>::shuffle()) {
+                std::shuffle(order.begin(), order.end(), shuffle_engine());
+            }
+        }
+
+        std::vector<weight> losses(sampled ? dbn_t::batch_size : 0);
+
+        const size_t batches = (order.size() + dbn_t::batch_size - 1) / dbn_t::batch_size;
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t b = 0; b < batches; ++b) {
+            static dll::timer_id timer_handle("net:trainer:train:epoch:batch");
+            dll::auto_timer timer(timer_handle);
+
+            if (master(dbn)) {
+                trace_scope scope("watcher:ft_batch_start", "watcher");
+
+                watcher.ft_batch_start(epoch, dbn);
+            }
+
+            const size_t first   = b * dbn_t::batch_size;
+            const size_t batch_n = std::min(dbn_t::batch_size, order.size() - first);
+
+            if constexpr (importance) {
+                trainer->sample_weights = weights.empty() ? nullptr : weights.data() + first;
+                trainer->sample_losses  = losses.empty() ? nullptr : losses.data();
+            }
+
+            auto [batch_error, batch_loss] = train_batch(order.data() + first, batch_n);
+
+            if (sampled) {
+                sampler.update(order.data() + first, losses.data(), batch_n);
+            }
+
+            end_batch(dbn, epoch, b, batches, batch_error, batch_loss);
+
+            // The batch metrics are normalized by the size of the batch
+            error += batch_error * batch_n;
+            loss += batch_loss * batch_n;
+        }
+
+        if constexpr (importance) {
+            trainer->sample_weights = nullptr;
+            trainer->sample_losses  = nullptr;
+        }
+
+        // After a complete pass, all the samples have a loss
+        if (sampled) {
+            sampler.ready = true;
+        }
+
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch()) {
+            if (samples) {
+                return global_error_loss(dbn, std::make_pair(error / samples, loss / samples), samples);
+            }
+        }
+
+        return std::make_pair(1.0, -1.0);
+    }
+
+    /*!
+     * \brief Train the layers after the frozen prefix of the network for one
+     * epoch, from the cached outputs of the prefix.
+     *
+     * The cache is built from the generator at the first epoch.
+     *
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch_frozen(dbn_t& dbn, Generator& generator, size_t epoch){
+        auto& cache = trainer->frozen_cache;
+
+        if (!cache.ready || cache.source != &generator) {
+            trainer->build_frozen_cache(generator);
+        }
+
+        return train_epoch_indexed(dbn, cache.samples, epoch, [this, epoch](const size_t* samples, size_t n) {
+            return trainer->train_frozen_batch(epoch, samples, n);
+        });
+    }
+
+    /*!
+     * \brief Train the network for one epoch with importance sampling,
+     * gathering the drawn samples from the generator.
+     *
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch_importance(dbn_t& dbn, Generator& generator, size_t epoch){
+        const size_t samples = generator.size();
+
+        if (!samples) {
+            return std::make_pair(1.0, -1.0);
+        }
+
+        // The buffers of the gathered batches, of the shape of the first batch
+        generator.reset();
+
+        auto inputs = etl::force_temporary(generator.data_batch());
+        auto labels = etl::force_temporary(generator.label_batch());
+
+        return train_epoch_gathered(dbn, generator, nullptr, samples, epoch, inputs, labels);
+    }
+
+    /*!
+     * \brief Train the network for one epoch on samples gathered by index
+     * from the generator, without moving the generator.
+     *
+     * \param generator The generator holding the samples
+     * \param subset The indices of the training samples in the generator (all the samples if null)
+     * \param samples The number of training samples
+     * \param epoch The current epoch
+     * \param inputs The buffer of the gathered inputs [B, ...]
+     * \param labels The buffer of the gathered labels [B, ...]
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator, typename Inputs, typename Labels>
+    std::pair<double, double> train_epoch_gathered(dbn_t& dbn, const Generator& generator, const size_t* subset, size_t samples, size_t epoch, Inputs& inputs, Labels& labels){
+        return train_epoch_indexed(dbn, samples, epoch, [&](const size_t* indices, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                const size_t index = subset ? subset[indices[i]] : indices[i];
+
+                inputs(i) = generator.sample(index);
+                generator.copy_label(index, labels(i));
+            }
+
+            if (n == etl::dim<0>(inputs)) {
+                return trainer->train_batch(epoch, inputs, labels);
+            } else {
+                return trainer->train_batch(epoch, etl::slice(inputs, 0, n), etl::slice(labels, 0, n));
+            }
+        });
+    }
+
+    /*!
+     * \brief Start the teacher on the current batch of the generator, on the
+     * workers of the scheduler. The trainer waits for its soft targets once
+     * the forward pass of the student is done.
+     */
+    void start_teacher(){
+        auto& d = *distiller;
+
+        d.tasks.do_task([&d] {
+            // ETL must not parallelize inside the workers
+            SERIAL_SECTION {
+                d.teach_batch(d.targets.data());
+            }
+        });
+
+        trainer->soft_targets       = d.targets.data();
+        trainer->soft_targets_tasks = &d.tasks;
+    }
+
+    /*!
+     * \brief Train the network for one epoch with the cached soft targets of
+     * the teacher, gathering the samples from the generator.
+     *
+     * The soft targets of all the samples are computed at the first epoch.
+     *
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch_distilled(dbn_t& dbn, Generator& generator, size_t epoch){
+        auto& d = *distiller;
+
+        const size_t samples = generator.size();
+        const size_t C       = d.classes;
+
+        if (!samples) {
+            return std::make_pair(1.0, -1.0);
+        }
+
+        if (!d.cached || d.source != &generator) {
+            static dll::timer_id timer_handle("net:trainer:train:teacher_cache");
+            dll::auto_timer timer(timer_handle);
+
+            d.cache.resize(samples * C);
+
+            std::vector<size_t> indices(dbn_t::batch_size);
+
+            for (size_t first = 0; first < samples; first += dbn_t::batch_size) {
+                const size_t n = std::min(dbn_t::batch_size, samples - first);
+
+                std::iota(indices.begin(), indices.begin() + n, first);
+
+                d.teach_samples(indices.data(), n, d.cache.data() + first * C);
+            }
+
+            d.cached = true;
+            d.source = &generator;
+        }
+
+        // The buffers of the gathered batches, of the shape of the first batch
+        generator.reset();
+
+        auto inputs = etl::force_temporary(generator.data_batch());
+        auto labels = etl::force_temporary(generator.label_batch());
+
+        return train_epoch_indexed(dbn, samples, epoch, [&](const size_t* indices, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                inputs(i) = generator.sample(indices[i]);
+                generator.copy_label(indices[i], labels(i));
+
+                std::copy_n(d.cache.data() + indices[i] * C, C, d.targets.data() + i * C);
+            }
+
+            trainer->soft_targets       = d.targets.data();
+            trainer->soft_targets_tasks = nullptr;
+
+            if (n == etl::dim<0>(inputs)) {
+                return trainer->train_batch(epoch, inputs, labels);
+            } else {
+                return trainer->train_batch(epoch, etl::slice(inputs, 0, n), etl::slice(labels, 0, n));
+            }
+        });
+    }
+
+    /*!
+     * \brief Train the network for one epoch
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch_only(dbn_t& dbn, Generator& generator, size_t epoch){
+        auto stats = train_epoch_batches(dbn, generator, epoch);
+
+        // The mini-batches of an incomplete group of accumulated gradients
+        // are applied at the end of the epoch
+        if constexpr (trainer_has_accumulation<trainer_t<dbn_t>>) {
+            trainer->flush_gradients(epoch);
+        }
+
+        return stats;
+    }
+
+    /*!
+     * \brief Train the network on all the batches of one epoch
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     * \return a pair containing the (error, loss) accumulated over the batches
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch_batches(dbn_t& dbn, Generator& generator, size_t epoch){
+        // Set the generator in train mode
+        generator.set_train();
+
+        if constexpr (trainer_has_soft_targets<trainer_t<dbn_t>> && generator_is_indexable<Generator>) {
+            bool lengths = false;
+
+            if constexpr (generator_has_lengths<Generator>) {
+                lengths = generator.has_lengths();
+            }
+
+            if (distiller && dbn.cache_teacher_outputs && !lengths) {
+                return train_epoch_distilled(dbn, generator, epoch);
+            }
+        }
+
+        if constexpr (trainer_has_frozen_cache<trainer_t<dbn_t>> && generator_is_replayable<Generator>) {
+            bool lengths = false;
+
+            if constexpr (generator_has_lengths<Generator>) {
+                lengths = generator.has_lengths();
+            }
+
+            // The frozen prefix of the student has no teacher
+            if (dbn.cache_frozen_features && !lengths && !distiller) {
+                return train_epoch_frozen(dbn, generator, epoch);
+            }
+        }
+
+        if constexpr (trainer_has_sample_weights<trainer_t<dbn_t>> && generator_is_indexable<Generator>) {
+            bool lengths = false;
+
+            if constexpr (generator_has_lengths<Generator>) {
+                lengths = generator.has_lengths();
+            }
+
+            if (dbn.importance_sampling && !lengths && !distiller) {
+                return train_epoch_importance(dbn, generator, epoch);
+            }
+        }
+
+        if constexpr (trainer_has_staging<trainer_t<dbn_t>> && !dbn_traits<dbn_t>::is_data_parallel() && !dbn_traits<dbn_t>::is_pipeline_parallel()) {
+            bool lengths = false;
+
+            if constexpr (generator_has_lengths<Generator>) {
+                lengths = generator.has_lengths();
+            }
+
+            // The teacher reads the batch from the generator
+            if (dbn.pipelined_training && !lengths && !distiller) {
+                return train_epoch_pipelined(dbn, generator, epoch);
+            }
+        }
+
+        double error = 0.0;
+        double loss  = 0.0;
+        size_t n     = 0;
+
+        static constexpr bool report_phases = watcher_has_phases<watcher_t<dbn_t>, dbn_t>;
+
+        // The time from which the next batch is awaited
+        std::chrono::steady_clock::time_point wait_start;
+
+        if constexpr (report_phases) {
+            wait_start = std::chrono::steady_clock::now();
+        }
+
+        //Train one mini-batch at a time
+        while(generator.has_next_batch()){
+            static dll::timer_id timer_handle("net:trainer:train:epoch:batch");
+            dll::auto_timer timer(timer_handle);
+
+            if (master(dbn)) {
+                trace_scope scope("watcher:ft_batch_start", "watcher");
+
+                watcher.ft_batch_start(epoch, dbn);
+            }
+
+            const size_t batch_n = etl::dim<0>(generator.label_batch());
+
+            // The batch is ready once its labels are available
+            std::chrono::steady_clock::time_point ready;
+
+            if constexpr (report_phases) {
+                ready = std::chrono::steady_clock::now();
+            }
+
+            if constexpr (generator_has_lengths<Generator>) {
+                if (generator.has_lengths()) {
+                    trainer->set_sequence_lengths(generator.length_batch());
+                }
+            }
+
+            if constexpr (trainer_has_soft_targets<trainer_t<dbn_t>>) {
+                if (distiller) {
+                    start_teacher();
+                }
+            }
+
+            auto [batch_error, batch_loss] = trainer->train_batch(
+                epoch,
+                generator.data_batch(),
+                generator.label_batch());
+
+            if constexpr (report_phases) {
+                if (master(dbn)) {
+                    batch_phases phases;
+
+                    if constexpr (trainer_has_phases<trainer_t<dbn_t>>) {
+                        phases = trainer->phases;
+                    } else {
+                        phases.compute = batch_phases::seconds(ready, std::chrono::steady_clock::now());
+                    }
+
+                    phases.wait = batch_phases::seconds(wait_start, ready);
+
+                    trace_scope scope("watcher:ft_batch_phases", "watcher");
+
+                    watcher.ft_batch_phases(epoch, phases, batch_n, dbn);
+                }
+            }
+
+            end_batch(dbn, epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss);
+
+            // The batch metrics are normalized by the size of the batch
+            error += batch_error * batch_n;
+            loss += batch_loss * batch_n;
+            n += batch_n;
+
+            if constexpr (report_phases) {
+                wait_start = std::chrono::steady_clock::now();
+            }
+
+            generator.next_batch();
+        }
+
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch()) {
+            if (n) {
+                return global_error_loss(dbn, std::make_pair(error / n, loss / n), n);
+            }
+        }
+
+        return std::make_pair(1.0, -1.0);
+    }
+
+    /*!
+     * \brief Train the network for one epoch and compute the loss and error on the training set
+     *
+     * \param dbn The network to train
+     * \param generator The generator to use for training data
+     * \param epoch The current epoch
+     *
+     * \return a pair containing (error, loss)
+     */
+    template<typename Generator>
+    std::pair<double, double> train_epoch(dbn_t& dbn, Generator& generator, size_t epoch){
+        // Train one epoch of training data
+        auto stats = train_epoch_only(dbn, generator, epoch);
+
+        // Compute the error at this epoch
+        return compute_train_error_loss(dbn, generator, stats);
+    }
+
+    /*!
+     * \brief Train the network for one epoch and compute the loss and error
+     * on the training and validation sets
+     *
+     * \param dbn The network to train
+     * \param train_generator The generator to use for training data
+     * \param val_generator The generator to use for validation data
+     * \param epoch The current epoch
+     *
+     * \return a pair of pair containing ((train_error, train_loss), (val_error, val_loss))
+     */
+    template<typename TrainGenerator, typename ValGenerator>
+    std::pair<std::pair<double, double>, std::pair<double, double>> train_epoch(dbn_t& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t epoch){
+        // Train one epoch of training data
+        auto stats = train_epoch_only(dbn, train_generator, epoch);
+
+        // Compute the training error at this epoch
+        auto train_stats = compute_train_error_loss(dbn, train_generator, stats);
+
+        // Compute the validation error at this epoch
+        auto val_stats = compute_error_loss(dbn, val_generator);
+
+        // Return the stats
+        return std::make_pair(train_stats, val_stats);
+    }
+
+    /*!
+     * \brief Report the prefetching statistics of the training generator to
+     * the watcher, if possible
+     * \param dbn The network that is trained
+     * \param generator The training generator
+     */
+    template <typename Generator>
+    void report_prefetch(dbn_t& dbn, const Generator& generator) {
+        if constexpr (generator_has_prefetch<Generator> && watcher_has_prefetch<watcher_t<dbn_t>, dbn_t>) {
+            if (master(dbn)) {
+                trace_scope scope("watcher:ft_prefetch", "watcher");
+
+                watcher.ft_prefetch(generator.prefetch(), dbn);
+            }
+        } else {
+            cpp_unused(dbn);
+            cpp_unused(generator);
+        }
+    }
+
+    /*!
+     * \brief Store the weights of the layers of the given network into the
+     * given stream
+     */
+    static void store_weights(const dbn_t& dbn, std::ostream& os){
+        dbn.for_each_layer([&os](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                layer.store(os);
+            }
+        });
+    }
+
+    /*!
+     * \brief Load the weights of the layers of the given network from the
+     * given stream
+     */
+    static void load_weights(dbn_t& dbn, std::istream& is){
+        dbn.for_each_layer([&is](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                layer.load(is);
+            }
+        });
+    }
+
+    /*!
+     * \brief Copy the weights of a network into another network of the
+     * same type
+     * \param from The network to copy the weights from
+     * \param to The network to copy the weights to
+     */
+    static void copy_weights(const dbn_t& from, dbn_t& to){
+        std::stringstream buffer;
+
+        store_weights(from, buffer);
+        load_weights(to, buffer);
+    }
+
+    /*!
+     * \brief Start the evaluation of the validation set on the snapshot
+     * network, on a separate thread.
+     * \param snapshot The network holding the weights to evaluate
+     * \param generator The generator for the validation data
+     * \return the future (error, loss) of the snapshot
+     */
+    template<typename Generator>
+    std::future<std::pair<double, double>> start_validation(dbn_t& snapshot, Generator& generator){
+        return std::async(std::launch::async, [&snapshot, &generator]() {
+            std::pair<double, double> stats(1.0, -1.0);
+
+            if constexpr (dbn_traits<dbn_t>::error_on_epoch()) {
+                // Leave the cores to the training epoch
+                SERIAL_SECTION {
+                    stats = snapshot.evaluate_metrics(generator);
+                }
+            } else {
+                cpp_unused(snapshot);
+                cpp_unused(generator);
+            }
+
+            return stats;
+        });
+    }
+
+    /*!
+     * \brief Wait for the validation of a snapshot and take the end of
+     * epoch decisions for the epoch of the snapshot.
+     *
+     * The early stopping strategy backups and restores the weights of the
+     * network, so the weights of the snapshot are temporarily put back in
+     * the network. If the training continues, the current weights are then
+     * restored.
+     *
+     * \param dbn The network that is trained
+     * \param snapshot The network holding the weights of the epoch
+     * \param epoch The epoch of the snapshot
+     * \param train_stats The training (error, loss) of the epoch
+     * \param pending The validation of the snapshot
+     * \param n The number of validation samples
+     * \return true if the training is over
+     */
+    bool stop_snapshot(dbn_t& dbn, dbn_t& snapshot, size_t epoch, const std::pair<double, double>& train_stats, std::future<std::pair<double, double>>& pending, size_t n){
+        auto val_stats = global_error_loss(dbn, pending.get(), n);
+
+        if constexpr (dbn_t::early == strategy::NONE) {
+            cpp_unused(snapshot);
+
+            return stop_epoch(dbn, epoch, train_stats, val_stats);
+        } else {
+            std::stringstream current;
+
+            store_weights(dbn, current);
+
+            copy_weights(snapshot, dbn);
+
+            const bool stop = stop_epoch(dbn, epoch, train_stats, val_stats);
+
+            if (!stop) {
+                load_weights(dbn, current);
+            }
+
+            return stop;
+        }
+    }
+
+    template<typename Generator>
+    void reset_shuffle(Generator& generator){
+        if (sampler.ready) {
+            // The scores of the samples are kept by index, the samples are drawn from them
+            generator.reset();
+        } else if constexpr (is_generator<Generator> && dbn_traits<dbn_t>::shuffle()) {
+            generator.reset_shuffle();
+        } else {
+            generator.reset();
+        }
+    }
+
+    /*!
+     * \brief Train the network for max_epochs
+     *
+     * \param dbn The network to be trained
+     * \param generator The generator for the training data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename Generator>
+    error_type train(DBN& dbn, Generator& generator, size_t max_epochs) {
+        static dll::timer_id timer_handle("net:trainer:train");
+        dll::auto_timer timer(timer_handle);
+
+        // Initialization steps
+        start_training(dbn, max_epochs);
+
+        //Train the model for max_epochs epoch
+
+        size_t epoch = 0;
+        for (; epoch < max_epochs; ++epoch) {
+            static dll::timer_id timer_handle("net:trainer:train:epoch");
+            dll::auto_timer timer(timer_handle);
+
+            {
+                static dll::timer_id timer_handle("net:trainer:train:epoch:prepare");
+                dll::auto_timer timer(timer_handle);
+
+                // Shuffle before the epoch if necessary
+                reset_shuffle(generator);
+
+                // This will ensure maximum performance for the training
+                generator.prepare_epoch();
+            }
+
+            start_epoch(dbn, epoch);
+
+            auto [error, loss] = train_epoch(dbn, generator, epoch);
+
+            const bool stop = stop_epoch(dbn, epoch, error, loss);
+
+            report_prefetch(dbn, generator);
+
+            if (stop) {
+                break;
+            }
+        }
+
+        // Finalization
+
+        return stop_training(dbn, epoch, max_epochs);
+    }
+
+    /*!
+     * \brief Train the network for max_epochs, distilling the knowledge of
+     * the given teacher.
+     *
+     * The teacher must end with a softmax over the classes of the labels.
+     *
+     * \param dbn The network to be trained (the student)
+     * \param teacher The teacher network
+     * \param generator The generator for the training data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename Teacher, typename Generator>
+    error_type distill(DBN& dbn, const Teacher& teacher, Generator& generator, size_t max_epochs) {
+        static_assert(trainer_has_soft_targets<trainer_t<dbn_t>>,
+                      "Distillation needs serial SGD training with a complete softmax output and a categorical cross-entropy loss");
+
+        generator.reset();
+
+        distiller = std::make_unique<distillation<weight>>();
+
+        auto& d = *distiller;
+
+        d.classes = etl::size(generator.label_batch()) / etl::dim<0>(generator.label_batch());
+        d.targets.resize(dbn_t::batch_size * d.classes);
+
+        d.teach_batch = [&dbn, &teacher, &generator, &d](weight* targets) {
+            decltype(auto) batch = generator.data_batch();
+
+            const size_t n = etl::dim<0>(batch);
+
+            auto output = etl::force_temporary(teacher.forward_batch(batch));
+
+            cpp_assert(etl::size(output) == n * d.classes, "The teacher must have an output for each class");
+
+            teacher_soft_targets(targets, output.memory_start(), n, d.classes, dbn.distill_temperature);
+        };
+
+        if constexpr (generator_is_indexable<Generator>) {
+            d.teach_samples = [&dbn, &teacher, &generator, &d, inputs = etl::force_temporary(generator.data_batch())](const size_t* samples, size_t n, weight* targets) mutable {
+                for (size_t i = 0; i < n; ++i) {
+                    inputs(i) = generator.sample(samples[i]);
+                }
+
+                auto output = etl::force_temporary(teacher.forward_batch(etl::slice(inputs, 0, n)));
+
+                cpp_assert(etl::size(output) == n * d.classes, "The teacher must have an output for each class");
+
+                teacher_soft_targets(targets, output.memory_start(), n, d.classes, dbn.distill_temperature);
+            };
+        }
+
+        auto error = train(dbn, generator, max_epochs);
+
+        trainer->soft_targets       = nullptr;
+        trainer->soft_targets_tasks = nullptr;
+
+        distiller.reset();
+
+        return error;
+    }
+
+    /*!
+     * \brief Train the network for max_epochs
+     *
+     * \param dbn The network to be trained
+     * \param train_generator The generator for the training data
+     * \param val_generator The generator for the validation data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename TrainGenerator, typename ValGenerator>
     error_type train(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
-        dll::auto_timer timer("net:trainer:train");
+        if constexpr (dbn_traits<dbn_t>::overlapped_validation()) {
+            return train_overlapped(dbn, train_generator, val_generator, max_epochs);
+        }
+
+        static dll::timer_id timer_handle("net:trainer:train");
+        dll::auto_timer timer(timer_handle);
 
         // The validation generator is always in test mode
         val_generator.set_test();
 
+        // The subset of the validation set evaluated at each epoch, if any
+        auto subset = make_validation_subset(dbn, val_generator);
+
         // Initialization steps
         start_training(dbn, max_epochs);
 
@@ -536,21 +1811,137 @@ struct dbn_trainer {
 
         size_t epoch = 0;
         for (; epoch < max_epochs; ++epoch) {
-            dll::auto_timer timer("net:trainer:train:epoch");
+            static dll::timer_id timer_handle("net:trainer:train:epoch");
+            dll::auto_timer timer(timer_handle);
 
             // Shuffle before the epoch if necessary
-            if(dbn_traits<dbn_t>::shuffle()){
-                train_generator.reset_shuffle();
+            reset_shuffle(train_generator);
+
+            start_epoch(dbn, epoch);
+
+            bool stop;
+
+            if (subset) {
+                // Train one epoch of training data
+                auto stats       = train_epoch_only(dbn, train_generator, epoch);
+                auto train_stats = compute_train_error_loss(dbn, train_generator, stats);
+
+                // Early stopping is driven by the subset, the complete set is
+                // only evaluated for the new best weights
+                auto early_stats = compute_error_loss(dbn, *subset);
+                auto val_stats   = is_new_best(epoch, early_stats) ? compute_error_loss(dbn, val_generator) : early_stats;
+
+                stop = stop_epoch(dbn, epoch, train_stats, val_stats, early_stats);
             } else {
-                train_generator.reset();
+                auto [train_stats, val_stats] = train_epoch(dbn, train_generator, val_generator, epoch);
+
+                stop = stop_epoch(dbn, epoch, train_stats, val_stats);
+            }
+
+            report_prefetch(dbn, train_generator);
+
+            if (stop) {
+                break;
+            }
+        }
+
+        // Finalization
+
+        auto error = stop_training(dbn, epoch, max_epochs);
+
+        // The final weights are evaluated on the complete validation set
+        if (subset) {
+            std::tie(current_val_error, current_val_loss) = compute_error_loss(dbn, val_generator);
+
+            if (master(dbn)) {
+                dbn.out << "Validation: error=" << current_val_error << " loss=" << current_val_loss << std::endl;
             }
+        }
+
+        return error;
+    }
+
+    /*!
+     * \brief Train the network for max_epochs, evaluating the validation
+     * set of each epoch concurrently with the next epoch.
+     *
+     * At the end of each epoch, the weights are copied into a snapshot
+     * network that is evaluated on a separate thread while the next epoch
+     * is trained. The end of epoch decisions (watcher, early stopping) are
+     * therefore taken one epoch late. When the training is stopped early,
+     * the epoch that was trained in the mean time is discarded.
+     *
+     * \param dbn The network to be trained
+     * \param train_generator The generator for the training data
+     * \param val_generator The generator for the validation data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename TrainGenerator, typename ValGenerator>
+    error_type train_overlapped(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
+        static_assert(!dbn_traits<dbn_t>::is_dynamic() || !std::is_same<typename dbn_t::desc::base_layers, typename dbn_t::desc::layers>::value,
+                      "overlapped_validation needs a network that can be default constructed (not initialized with init_layer)");
+
+        static dll::timer_id timer_handle("net:trainer:train");
+        dll::auto_timer timer(timer_handle);
+
+        // The validation generator is always in test mode
+        val_generator.set_test();
+
+        // Initialization steps
+        start_training(dbn, max_epochs);
+
+        // The network holding the weights being validated
+        auto snapshot = std::make_unique<dbn_t>();
+
+        std::future<std::pair<double, double>> pending;
+        std::pair<double, double> pending_train_stats;
+
+        bool stop = false;
+
+        //Train the model for max_epochs epoch
+
+        size_t epoch = 0;
+        for (; epoch < max_epochs; ++epoch) {
+            static dll::timer_id timer_handle("net:trainer:train:epoch");
+            dll::auto_timer timer(timer_handle);
+
+            // Shuffle before the epoch if necessary
+            reset_shuffle(train_generator);
 
             start_epoch(dbn, epoch);
 
-            auto [train_stats, val_stats] = train_epoch(dbn, train_generator, val_generator, epoch);
+            // Train one epoch while the previous one is validated
+            auto stats       = train_epoch_only(dbn, train_generator, epoch);
+            auto train_stats = compute_train_error_loss(dbn, train_generator, stats);
 
-            if (stop_epoch(dbn, epoch, train_stats, val_stats)) {
-                break;
+            // The momentum must not change one epoch late
+            if ((dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM || dbn_traits<dbn_t>::updater() == updater_type::LARS) && epoch == dbn.final_momentum_epoch) {
+                dbn.momentum = dbn.final_momentum;
+            }
+
+            if (epoch) {
+                stop = stop_snapshot(dbn, *snapshot, epoch - 1, pending_train_stats, pending, val_generator.size());
+
+                if (stop) {
+                    break;
+                }
+            }
+
+            // Validate this epoch during the next one
+            copy_weights(dbn, *snapshot);
+
+            pending             = start_validation(*snapshot, val_generator);
+            pending_train_stats = train_stats;
+
+            report_prefetch(dbn, train_generator);
+        }
+
+        // The last epoch is validated once the training is over
+        if (!stop && pending.valid()) {
+            if (stop_snapshot(dbn, *snapshot, epoch - 1, pending_train_stats, pending, val_generator.size())) {
+                --epoch;
             }
         }
 
@@ -0,0 +1,417 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file lbfgs.hpp
+ * \brief Limited-memory BFGS (L-BFGS) trainer
+ *
+ * Each batch given to the trainer is a chunk of the training set (the full
+ * training set for full-batch training) on which several L-BFGS iterations
+ * are done. The loss and the gradients of a chunk are computed by the
+ * forward and backward passes of the SGD trainer. When the network is
+ * data-parallel (dll::data_parallel<S>), the chunk is split into S shards
+ * evaluated concurrently on the thread pool of the network.
+ *
+ * The curvature pairs are always computed on a single chunk and are kept
+ * from one chunk to the next, up to dbn.lbfgs_history pairs. The step is
+ * found by a backtracking line search (Armijo condition).
+ *
+ * The weight decay, the gradient clipping and the loss scaling of SGD are
+ * not applied.
+ */
+
+#pragma once
+
+#include <deque>
+
+#include "etl/etl.hpp"
+
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace dll {
+
+/*!
+ * \brief An L-BFGS trainer for the given DBN
+ */
+template <typename DBN>
+struct lbfgs_trainer {
+    using dbn_t     = DBN;                    ///< The DBN being trained
+    using weight    = typename dbn_t::weight; ///< The data type for this layer
+    using sgd_t     = sgd_trainer<dbn_t>;     ///< The SGD trainer computing the gradients
+    using vector_t  = etl::dyn_vector<weight>; ///< The type of the flat vectors of parameters
+    using this_type = lbfgs_trainer<dbn_t>;   ///< The type of this trainer
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers of the DBN
+
+    dbn_t& dbn;          ///< The DBN being trained
+    sgd_t sgd;           ///< The SGD trainer computing the losses and the gradients
+    batch_phases phases; ///< The time of the phases of the last batch
+
+    std::deque<vector_t> s_history; ///< The last differences of parameters
+    std::deque<vector_t> y_history; ///< The last differences of gradients
+    std::deque<weight> rho_history; ///< The inverses of the dot products of the pairs
+
+    /*!
+     * \brief Construct a new lbfgs_trainer
+     * \param dbn The DBN being trained
+     */
+    explicit lbfgs_trainer(dbn_t& dbn) : dbn(dbn), sgd(dbn) {}
+
+    /*!
+     * \brief Initialize the training of the network with the given batch size
+     * \param batch_size The batch size of the network
+     */
+    void init_training(size_t batch_size) {
+        sgd.init_training(batch_size);
+
+        s_history.clear();
+        y_history.clear();
+        rho_history.clear();
+    }
+
+    /*!
+     * \brief Set the lengths of the sequences of the next batches
+     * \param lengths The length of each sample of the batch
+     */
+    void set_sequence_lengths(const std::vector<size_t>& lengths) {
+        sgd.set_sequence_lengths(lengths);
+    }
+
+    /*!
+     * \brief Do dbn.lbfgs_iterations iterations of L-BFGS on the given chunk
+     *
+     * \param epoch The current epoch
+     * \param inputs The batch of inputs
+     * \param labels The batch of labels
+     *
+     * \return the error and the loss of the batch, after the iterations
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        static dll::timer_id timer_handle("lbfgs::train_batch");
+        dll::auto_timer timer(timer_handle);
+
+        cpp_unused(epoch);
+
+        const size_t n = etl::dim<0>(inputs);
+
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        const auto start = std::chrono::steady_clock::now();
+
+        vector_t x(parameters());
+        vector_t g(etl::size(x));
+
+        get_parameters(x);
+
+        auto metrics = evaluate(inputs, labels, g);
+
+        for (size_t it = 0; it < dbn.lbfgs_iterations; ++it) {
+            vector_t d = direction(g);
+
+            weight slope = etl::dot(g, d);
+
+            // Not a descent direction, restart from the gradient
+            if (slope >= 0) {
+                clear_history();
+
+                d     = -g;
+                slope = etl::dot(g, d);
+            }
+
+            if (slope == 0) {
+                break;
+            }
+
+            // Without curvature information, the first step is normalized
+            weight t = s_history.empty() ? std::min(weight(1), weight(1) / std::sqrt(-slope)) : weight(1);
+
+            vector_t x_new(etl::size(x));
+            vector_t g_new(etl::size(x));
+
+            std::pair<double, double> new_metrics;
+
+            bool found = false;
+
+            for (size_t e = 0; e < dbn.lbfgs_evaluations; ++e) {
+                x_new = x + t * d;
+
+                set_parameters(x_new);
+
+                new_metrics = evaluate(inputs, labels, g_new);
+
+                if (std::isfinite(new_metrics.second) && new_metrics.second <= metrics.second + 1e-4 * t * slope) {
+                    found = true;
+                    break;
+                }
+
+                t *= 0.5;
+            }
+
+            if (!found) {
+                // Keep the last good parameters and forget the curvature
+                set_parameters(x);
+                clear_history();
+                break;
+            }
+
+            vector_t s = x_new - x;
+            vector_t y = g_new - g;
+
+            const weight sy = etl::dot(s, y);
+
+            // Only keep the pairs that keep the approximation positive definite
+            if (sy > 1e-10) {
+                if (s_history.size() == std::max<size_t>(1, dbn.lbfgs_history)) {
+                    s_history.pop_front();
+                    y_history.pop_front();
+                    rho_history.pop_front();
+                }
+
+                s_history.push_back(std::move(s));
+                y_history.push_back(std::move(y));
+                rho_history.push_back(weight(1) / sy);
+            }
+
+            x       = x_new;
+            g       = g_new;
+            metrics = new_metrics;
+        }
+
+        phases.forward  = 0.0;
+        phases.backward = 0.0;
+        phases.update   = 0.0;
+        phases.compute  = batch_phases::seconds(start, std::chrono::steady_clock::now());
+
+        return std::make_pair(metrics.first, metrics.second);
+    }
+
+    /*!
+     * \brief Forward a batch, for the evaluation of the network
+     */
+    template <bool Train, typename Inputs>
+    decltype(auto) forward_batch_helper(dbn_t& dbn, Inputs&& inputs) {
+        return sgd.template forward_batch_helper<Train>(dbn, inputs);
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return "L-BFGS";
+    }
+
+private:
+    /*!
+     * \brief Forget the curvature pairs
+     */
+    void clear_history() {
+        s_history.clear();
+        y_history.clear();
+        rho_history.clear();
+    }
+
+    /*!
+     * \brief Compute the search direction from the gradient with the
+     * two-loop recursion.
+     * \param g The gradient at the current parameters
+     * \return the search direction
+     */
+    vector_t direction(const vector_t& g) const {
+        vector_t q = g;
+
+        const size_t m = s_history.size();
+
+        std::vector<weight> alpha(m);
+
+        for (size_t k = m; k > 0; --k) {
+            const size_t i = k - 1;
+
+            alpha[i] = rho_history[i] * etl::dot(s_history[i], q);
+            q -= alpha[i] * y_history[i];
+        }
+
+        // Scale by the curvature of the last pair
+        if (m) {
+            q *= etl::dot(s_history[m - 1], y_history[m - 1]) / etl::dot(y_history[m - 1], y_history[m - 1]);
+        }
+
+        for (size_t i = 0; i < m; ++i) {
+            const weight beta = rho_history[i] * etl::dot(y_history[i], q);
+            q += (alpha[i] - beta) * s_history[i];
+        }
+
+        return -q;
+    }
+
+    /*!
+     * \brief Compute the loss and the gradient of the loss at the current
+     * parameters on the given batch.
+     * \param g The flat vector to fill with the gradient
+     * \return a pair containing the mean error and the mean loss over the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> evaluate(const Inputs& inputs, const Labels& labels, vector_t& g) {
+        static dll::timer_id timer_handle("lbfgs::evaluate");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t n = etl::dim<0>(inputs);
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        if constexpr (dbn_traits<dbn_t>::is_data_parallel()) {
+            constexpr size_t shard_size = decltype(sgd.shard_contexts)::shard_size;
+
+            // The number of shards holding at least one sample
+            const size_t active = (n + shard_size - 1) / shard_size;
+
+            std::vector<std::pair<double, double>> metrics(active);
+
+            auto& pool = dbn.get_pool();
+
+            for (size_t s = 0; s < active; ++s) {
+                pool.do_task([this, s, n, &inputs, &labels, &metrics] {
+                    trace_scope scope("pool:task", "pool");
+
+                    const size_t first = s * shard_size;
+                    const size_t last  = std::min(first + shard_size, n);
+
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        metrics[s] = sgd.train_shard(sgd.shard_contexts.contexts[s], etl::slice(inputs, first, last), etl::slice(labels, first, last));
+                    }
+                });
+            }
+
+            pool.wait();
+
+            for (size_t s = 0; s < active; ++s) {
+                cpp::for_each(sgd.full_context, sgd.shard_contexts.contexts[s], [s](auto& layer_ctx, auto& shard_layer_ctx) {
+                    sgd_t::reduce_gradients_layer(layer_ctx.first, *layer_ctx.second, *shard_layer_ctx.second, s == 0);
+                });
+
+                error += metrics[s].first;
+                loss += metrics[s].second;
+            }
+        } else {
+            std::tie(error, loss) = sgd.train_shard(sgd.full_context, inputs, labels);
+        }
+
+        // The SGD gradients are the sums of the descent directions
+        const weight scale = weight(-1) / n;
+
+        size_t i = 0;
+
+        for_each_variable([&g, &i, scale](auto& /*w*/, auto& grad) {
+            grad.ensure_cpu_up_to_date();
+
+            for (size_t j = 0; j < etl::size(grad); ++j) {
+                g[i++] = scale * grad[j];
+            }
+        });
+
+        return std::make_pair(error / n, loss / n);
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of the network
+     */
+    size_t parameters() {
+        size_t n = 0;
+
+        for_each_variable([&n](auto& w, auto& /*grad*/) {
+            n += etl::size(w);
+        });
+
+        return n;
+    }
+
+    /*!
+     * \brief Copy the parameters of the network into the given flat vector
+     */
+    void get_parameters(vector_t& x) {
+        size_t i = 0;
+
+        for_each_variable([&x, &i](auto& w, auto& /*grad*/) {
+            w.ensure_cpu_up_to_date();
+
+            for (size_t j = 0; j < etl::size(w); ++j) {
+                x[i++] = w[j];
+            }
+        });
+    }
+
+    /*!
+     * \brief Set the parameters of the network from the given flat vector
+     */
+    void set_parameters(const vector_t& x) {
+        size_t i = 0;
+
+        for_each_variable([&x, &i](auto& w, auto& /*grad*/) {
+            for (size_t j = 0; j < etl::size(w); ++j) {
+                w[j] = x[i++];
+            }
+
+            w.invalidate_gpu();
+        });
+
+        // Keep the pruned weights to zero
+        for_each_neural_layer([](auto& layer, auto& /*context*/) {
+            if constexpr (is_prunable<std::decay_t<decltype(layer)>>) {
+                layer.apply_weight_mask();
+            }
+        });
+    }
+
+    /*!
+     * \brief Call functor(w, grad) for each trainable variable of the network
+     * and its gradients in the full context, always in the same order.
+     */
+    template <typename Functor>
+    void for_each_variable(Functor&& functor) {
+        for_each_neural_layer([&functor](auto& layer, auto& context) {
+            constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            this_type::for_each_variable_impl(layer, context, functor, std::make_index_sequence<N>());
+
+            // The gradients are read densely
+            if constexpr (sgd_sparse_rows_v<std::decay_t<decltype(context)>>) {
+                context.stale_grad = true;
+            }
+        });
+    }
+
+    template <typename Layer, typename Context, typename Functor, size_t... I>
+    static void for_each_variable_impl(Layer& layer, Context& context, Functor& functor, std::index_sequence<I...> /*seq*/) {
+        (functor(std::get<I>(layer.trainable_parameters()), std::get<I>(context.up.context)->grad), ...);
+    }
+
+    /*!
+     * \brief Call functor(layer, context) for each neural layer of the
+     * network, including the layers of the groups and merges.
+     */
+    template <typename Functor>
+    void for_each_neural_layer(Functor&& functor) {
+        cpp::for_each(sgd.full_context, [&functor](auto& layer_ctx) {
+            this_type::for_each_neural_layer_impl(layer_ctx.first, *layer_ctx.second, functor);
+        });
+    }
+
+    template <typename Layer, typename Context, typename Functor>
+    static void for_each_neural_layer_impl([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context, [[maybe_unused]] Functor& functor) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [&functor](auto& sub_layer, auto& sub_context) {
+                this_type::for_each_neural_layer_impl(sub_layer, sub_context, functor);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            functor(layer, context);
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,274 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file multi_trainer.hpp
+ * \brief Training of several networks from a single pass over a generator
+ *
+ * For ensembles or hyperparameter searches, several small networks are
+ * trained on the same data. Instead of reading and augmenting the data once
+ * per network, each batch is fetched once from the generator and all the
+ * networks are trained on it concurrently, on the shared scheduler. Each
+ * network keeps its own trainer, watcher and early stopping: a network that
+ * stops is simply not trained on the following batches.
+ */
+
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/trainer/dbn_trainer.hpp"
+#include "dll/util/scheduler.hpp" // For task_group
+#include "dll/util/timers.hpp"
+#include "dll/util/trace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Train several networks, possibly of different types, from the
+ * batches of the same generator.
+ *
+ * The networks are trained on the same batches, in the same order, as if
+ * they were fine-tuned one after the other on the generator. The networks
+ * must not share their weights.
+ *
+ * \tparam DBNs The types of the networks
+ */
+template <typename... DBNs>
+struct multi_trainer {
+    static constexpr size_t networks = sizeof...(DBNs); ///< The number of networks
+
+    static_assert(networks > 0, "A multi_trainer needs at least one network");
+
+    std::tuple<DBNs&...> dbns;                ///< The networks being trained
+    std::tuple<dbn_trainer<DBNs>...> trainers; ///< The trainer of each network
+
+    std::array<bool, networks> active;     ///< Indicates if each network is still trained
+    std::array<double, networks> errors;   ///< The final error of each network
+    std::array<double, networks> sum_error; ///< The error of each network accumulated over the epoch
+    std::array<double, networks> sum_loss;  ///< The loss of each network accumulated over the epoch
+    std::array<size_t, networks> samples;   ///< The number of samples each network was trained on during the epoch
+
+    /*!
+     * \brief Create a trainer for the given networks
+     */
+    explicit multi_trainer(DBNs&... dbns) : dbns(dbns...) {
+        active.fill(false);
+        errors.fill(0.0);
+    }
+
+    /*!
+     * \brief Train all the networks for at most max_epochs
+     *
+     * \param generator The generator for the training data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error of each network
+     */
+    template <typename Generator>
+    std::array<double, networks> train(Generator& generator, size_t max_epochs) {
+        static_assert(((DBNs::batch_size == Generator::batch_size) && ...), "Invalid batch size for generator");
+
+        static dll::timer_id timer_handle("net:multi_trainer:train");
+        dll::auto_timer timer(timer_handle);
+
+        for_each_network([this, max_epochs](auto& dbn, auto& trainer, size_t k) {
+            trainer.start_training(dbn, max_epochs);
+
+            active[k] = true;
+        });
+
+        size_t epoch = 0;
+        for (; epoch < max_epochs && any_active(); ++epoch) {
+            static dll::timer_id timer_handle("net:multi_trainer:train:epoch");
+            dll::auto_timer timer(timer_handle);
+
+            {
+                static dll::timer_id timer_handle("net:multi_trainer:train:epoch:prepare");
+                dll::auto_timer timer(timer_handle);
+
+                // Shuffle before the epoch if one of the networks needs it
+                if constexpr (is_generator<Generator> && (dbn_traits<DBNs>::shuffle() || ...)) {
+                    generator.reset_shuffle();
+                } else {
+                    generator.reset();
+                }
+
+                generator.prepare_epoch();
+            }
+
+            for_each_network([this, epoch](auto& dbn, auto& trainer, size_t k) {
+                if (active[k]) {
+                    trainer.start_epoch(dbn, epoch);
+                }
+            });
+
+            train_epoch(generator, epoch);
+
+            // The end of epoch decisions are taken network by network
+            for_each_network([this, &generator, epoch, max_epochs](auto& dbn, auto& trainer, size_t k) {
+                if (active[k]) {
+                    auto [error, loss] = trainer.compute_train_error_loss(dbn, generator, epoch_stats(dbn, trainer, k));
+
+                    if (trainer.stop_epoch(dbn, epoch, error, loss)) {
+                        errors[k] = trainer.stop_training(dbn, epoch, max_epochs);
+                        active[k] = false;
+
+                        // Release the training contexts of the stopped network
+                        trainer.trainer.reset();
+                    }
+                }
+            });
+        }
+
+        for_each_network([this, epoch, max_epochs](auto& dbn, auto& trainer, size_t k) {
+            if (active[k]) {
+                errors[k] = trainer.stop_training(dbn, epoch, max_epochs);
+                active[k] = false;
+            }
+        });
+
+        return errors;
+    }
+
+private:
+    /*!
+     * \brief Call functor(dbn, trainer, k) for each network
+     */
+    template <typename Functor>
+    void for_each_network(Functor&& functor) {
+        for_each_network(functor, std::make_index_sequence<networks>());
+    }
+
+    /*!
+     * \copydoc for_each_network
+     */
+    template <typename Functor, size_t... I>
+    void for_each_network(Functor& functor, std::index_sequence<I...> /*seq*/) {
+        (functor(std::get<I>(dbns), std::get<I>(trainers), I), ...);
+    }
+
+    /*!
+     * \brief Indicates if at least one network is still trained
+     */
+    bool any_active() const {
+        for (bool a : active) {
+            if (a) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Returns the (error, loss) of the given network over the epoch
+     */
+    template <typename DBN, typename Trainer>
+    std::pair<double, double> epoch_stats(DBN& dbn, Trainer& trainer, size_t k) {
+        if constexpr (dbn_traits<DBN>::error_on_epoch()) {
+            if (samples[k]) {
+                return trainer.global_error_loss(dbn, std::make_pair(sum_error[k] / samples[k], sum_loss[k] / samples[k]), samples[k]);
+            }
+        } else {
+            cpp_unused(dbn);
+            cpp_unused(trainer);
+        }
+
+        return std::make_pair(1.0, -1.0);
+    }
+
+    /*!
+     * \brief Train the active networks for one epoch, each batch being
+     * fetched once and dispatched to all the networks
+     *
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     */
+    template <typename Generator>
+    void train_epoch(Generator& generator, size_t epoch) {
+        generator.set_train();
+
+        sum_error.fill(0.0);
+        sum_loss.fill(0.0);
+        samples.fill(0);
+
+        task_group pool;
+
+        while (generator.has_next_batch()) {
+            static dll::timer_id timer_handle("net:multi_trainer:train:epoch:batch");
+            dll::auto_timer timer(timer_handle);
+
+            // The batch is only read by the networks
+            auto data   = generator.data_batch();
+            auto labels = generator.label_batch();
+
+            const size_t batch_n = etl::dim<0>(labels);
+            const size_t batch   = generator.current_batch();
+            const size_t batches = generator.batches();
+
+            for_each_network([&](auto& dbn, auto& trainer, size_t k) {
+                if (!active[k]) {
+                    return;
+                }
+
+                pool.do_task([&, k] {
+                    if (trainer.master(dbn)) {
+                        trace_scope scope("watcher:ft_batch_start", "watcher");
+
+                        trainer.watcher.ft_batch_start(epoch, dbn);
+                    }
+
+                    if constexpr (generator_has_lengths<Generator>) {
+                        if (generator.has_lengths()) {
+                            trainer.trainer->set_sequence_lengths(generator.length_batch());
+                        }
+                    }
+
+                    auto [batch_error, batch_loss] = trainer.trainer->train_batch(epoch, data, labels);
+
+                    trainer.end_batch(dbn, epoch, batch, batches, batch_error, batch_loss);
+
+                    // The batch metrics are normalized by the size of the batch
+                    sum_error[k] += batch_error * batch_n;
+                    sum_loss[k] += batch_loss * batch_n;
+                    samples[k] += batch_n;
+                });
+            });
+
+            // The generator must not move while the batch is trained
+            pool.wait();
+
+            generator.next_batch();
+        }
+    }
+};
+
+/*!
+ * \brief Fine-tune several networks, possibly of different types, from a
+ * single pass over the generator per epoch.
+ *
+ * \param generator The generator for the training data
+ * \param max_epochs The maximum number of epochs
+ * \param dbns The networks to train
+ *
+ * \return The final error of each network
+ */
+template <typename Generator, typename... DBNs>
+std::array<double, sizeof...(DBNs)> multi_fine_tune(Generator& generator, size_t max_epochs, DBNs&... dbns) {
+    static dll::timer_id timer_handle("net:train:multi_ft");
+    dll::auto_timer timer(timer_handle);
+
+    multi_trainer<DBNs...> trainer(dbns...);
+    return trainer.train(generator, max_epochs);
+}
+
+} //end of dll namespace
@@ -0,0 +1,315 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file online_trainer.hpp
+ * \brief Incremental training of a network from batches arriving over time
+ *
+ * fine_tune trains from a complete dataset: it builds a generator over a
+ * copy of the data and a new trainer for each call. An online trainer is
+ * created once and keeps the trainer, and thus the contexts and the
+ * updater state, alive between the batches given to it. The samples can
+ * be given by batches or one by one.
+ *
+ * A bounded replay buffer keeps the last samples: each trained batch can
+ * be completed with samples drawn from it, so that the network does not
+ * only fit the most recent samples.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/trainer/dbn_trainer.hpp" // For trainer_has_staging
+#include "dll/util/random.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Incremental training of a network.
+ *
+ * All the buffers are allocated at the first batch, the following batches
+ * do not allocate. The network must not be trained by other means while
+ * the online trainer is used.
+ *
+ * \tparam DBN The network type
+ */
+template <typename DBN>
+struct online_trainer {
+    using dbn_t     = DBN;                                             ///< The network type
+    using weight    = typename dbn_t::weight;                          ///< The data type of the network
+    using trainer_t = typename dbn_t::desc::template trainer_t<dbn_t>; ///< The concrete trainer
+    using input_t   = typename trainer_t::input_stage_t;               ///< The type of a batch of inputs
+
+    static_assert(trainer_has_staging<trainer_t>, "Online training is only supported with SGD");
+
+    static constexpr size_t batch_size = dbn_t::batch_size; ///< The maximum number of samples of a batch
+
+    dbn_t& dbn;                         ///< The network being trained
+    std::unique_ptr<trainer_t> trainer; ///< The trainer, kept alive between the batches
+
+    size_t epoch   = 0; ///< The epoch given to the trainer (for the learning rate schedules)
+    size_t samples = 0; ///< The number of new samples trained
+    size_t batches = 0; ///< The number of batches trained
+
+    const size_t replay_capacity; ///< The maximum number of samples of the replay buffer
+    const size_t replayed;        ///< The maximum number of replayed samples added to each batch
+
+    /*!
+     * \brief Create an online trainer for the given network
+     *
+     * \param dbn The network to train
+     * \param replay_capacity The number of last samples kept for replay (0 to disable replay)
+     * \param replayed The maximum number of replayed samples added to each batch
+     */
+    explicit online_trainer(dbn_t& dbn, size_t replay_capacity = 0, size_t replayed = 0)
+            : dbn(dbn), replay_capacity(replay_capacity), replayed(replay_capacity ? std::min(replayed, batch_size - 1) : 0) {
+        dbn.momentum = dbn.initial_momentum;
+
+        trainer = std::make_unique<trainer_t>(dbn);
+        trainer->init_training(batch_size);
+    }
+
+    /*!
+     * \brief Train the network on a batch of new samples.
+     *
+     * The batch is completed with replayed samples, if possible, and the
+     * new samples are then added to the replay buffer.
+     *
+     * \param inputs The new samples [n, ...], with n <= batch_size
+     * \param labels The labels of the samples, either one-hot [n, ...] or a
+     * container of n class indices
+     *
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(const Inputs& inputs, const Labels& labels) {
+        const size_t n = etl::dim<0>(inputs);
+
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        if (!n) {
+            return {0.0, 0.0};
+        }
+
+        // The samples added one by one are trained first
+        if (pending) {
+            flush();
+        }
+
+        if (!buffers) {
+            allocate(etl::size(inputs) / n, batch_label_size(labels, n));
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            copy_row(inputs(i), input_batch->memory_start() + i * sample_size);
+
+            if constexpr (etl::is_etl_expr<Labels>) {
+                copy_label_row(labels(i), i);
+            } else {
+                copy_label_row(labels[i], i);
+            }
+        }
+
+        pending = n;
+
+        return flush();
+    }
+
+    /*!
+     * \brief Add one new sample, the network being trained once a complete
+     * batch has been added.
+     *
+     * \param sample The new sample
+     * \param label The label of the sample, either one-hot or a class index
+     *
+     * \return true if a batch has been trained
+     */
+    template <typename Sample, typename Label>
+    bool push(const Sample& sample, const Label& label) {
+        if (!buffers) {
+            allocate(etl::size(sample), label_size_of(label));
+        }
+
+        copy_row(sample, input_batch->memory_start() + pending * sample_size);
+        copy_label_row(label, pending);
+
+        if (++pending == batch_size - replayed) {
+            flush();
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Train the network on the samples added with push() and not
+     * trained yet
+     *
+     * \return a pair containing the error and the loss for the batch
+     */
+    std::pair<double, double> flush() {
+        static dll::timer_id timer_handle("net:online:train_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t n = pending;
+
+        if (!n) {
+            return {0.0, 0.0};
+        }
+
+        // Complete the batch with replayed samples
+        const size_t r = std::min({replayed, batch_size - n, stored});
+
+        for (size_t i = 0; i < r; ++i) {
+            std::uniform_int_distribution<size_t> dist(0, stored - 1);
+
+            const size_t j = dist(dll::rand_engine());
+
+            std::copy_n(replay_inputs.data() + j * sample_size, sample_size, input_batch->memory_start() + (n + i) * sample_size);
+            std::copy_n(replay_labels.data() + j * label_size, label_size, labels.memory_start() + (n + i) * label_size);
+        }
+
+        // The new samples are kept for the next batches
+        for (size_t i = 0; i < n && replay_capacity; ++i) {
+            std::copy_n(input_batch->memory_start() + i * sample_size, sample_size, replay_inputs.data() + next * sample_size);
+            std::copy_n(labels.memory_start() + i * label_size, label_size, replay_labels.data() + next * label_size);
+
+            next   = (next + 1) % replay_capacity;
+            stored = std::min(stored + 1, replay_capacity);
+        }
+
+        input_batch->invalidate_gpu();
+        labels.invalidate_gpu();
+
+        const size_t m = n + r;
+
+        samples += n;
+        ++batches;
+
+        pending = 0;
+
+        if (m == batch_size) {
+            return trainer->train_batch(epoch, *input_batch, labels);
+        } else {
+            return trainer->train_batch(epoch, etl::slice(*input_batch, 0, m), etl::slice(labels, 0, m));
+        }
+    }
+
+    /*!
+     * \brief Returns the number of samples currently in the replay buffer
+     */
+    size_t replay_size() const {
+        return stored;
+    }
+
+private:
+    /*!
+     * \brief Allocate the buffers, for samples and labels of the given sizes
+     */
+    void allocate(size_t S, size_t C) {
+        // The batch of inputs has the shape of the inputs of the first layer
+        input_batch = std::make_unique<input_t>(std::get<0>(trainer->full_context).second->input);
+
+        sample_size = S;
+        label_size  = C;
+
+        cpp_assert(sample_size * batch_size == etl::size(*input_batch), "Invalid sample size");
+
+        labels = etl::dyn_matrix<weight, 2>(batch_size, label_size);
+
+        replay_inputs.resize(replay_capacity * sample_size);
+        replay_labels.resize(replay_capacity * label_size);
+
+        buffers = true;
+    }
+
+    /*!
+     * \brief Returns the number of values of one label
+     */
+    template <typename Label>
+    size_t label_size_of(const Label& label) const {
+        if constexpr (etl::is_etl_expr<Label>) {
+            return etl::size(label);
+        } else {
+            cpp_unused(label);
+
+            // A class index
+            return dbn.output_size();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of values of one label of the given batch
+     * of n labels
+     */
+    template <typename Labels>
+    size_t batch_label_size(const Labels& batch_labels, size_t n) const {
+        if constexpr (etl::is_etl_expr<Labels>) {
+            return etl::size(batch_labels) / n;
+        } else {
+            cpp_unused(batch_labels);
+            cpp_unused(n);
+
+            // Class indices
+            return dbn.output_size();
+        }
+    }
+
+    /*!
+     * \brief Copy the given sample to the given memory
+     */
+    template <typename Sample>
+    void copy_row(const Sample& sample, weight* dst) {
+        if constexpr (etl::is_dma<Sample>) {
+            sample.ensure_cpu_up_to_date();
+
+            std::copy_n(sample.memory_start(), sample_size, dst);
+        } else {
+            copy_row(etl::force_temporary(sample), dst);
+        }
+    }
+
+    /*!
+     * \brief Copy the given label to the given row of the batch of labels
+     */
+    template <typename Label>
+    void copy_label_row(const Label& label, size_t i) {
+        weight* dst = labels.memory_start() + i * label_size;
+
+        if constexpr (etl::is_etl_expr<Label>) {
+            auto l = etl::force_temporary(label);
+
+            std::copy_n(l.memory_start(), label_size, dst);
+        } else {
+            std::fill_n(dst, label_size, weight(0));
+            dst[size_t(label)] = weight(1);
+        }
+    }
+
+    bool buffers   = false; ///< Indicates if the buffers are allocated
+    size_t pending = 0;     ///< The number of new samples in the batch
+
+    size_t sample_size = 0; ///< The number of values of one sample
+    size_t label_size  = 0; ///< The number of values of one label
+
+    std::unique_ptr<input_t> input_batch; ///< The batch of inputs
+    etl::dyn_matrix<weight, 2> labels;    ///< The batch of labels
+
+    std::vector<weight> replay_inputs; ///< The samples of the replay buffer
+    std::vector<weight> replay_labels; ///< The labels of the replay buffer
+    size_t stored = 0;                 ///< The number of samples in the replay buffer
+    size_t next   = 0;                 ///< The position of the next sample in the replay buffer
+};
+
+} //end of dll namespace
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <type_traits>
 
 #include "cpp_utils/algorithm.hpp"
 
@@ -34,6 +36,24 @@ struct watcher_type<RBM, RW, std::enable_if_t<cpp::not_u<std::is_void<RW>::value
     using watcher_t = RW;
 };
 
+/*!
+ * \brief Traits to test if a RBM trainer handles the incomplete batches
+ */
+template <typename T, typename = int>
+struct rbm_trainer_partial_batches_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a RBM trainer handles the incomplete batches
+ */
+template <typename T>
+struct rbm_trainer_partial_batches_impl<T, decltype((void)T::partial_batches, 0)> : std::bool_constant<T::partial_batches> {};
+
+/*!
+ * \brief Traits to test if a RBM trainer handles the incomplete batches
+ */
+template <typename T>
+constexpr bool rbm_trainer_partial_batches = rbm_trainer_partial_batches_impl<T>::value;
+
 /*!
  * \brief A generic trainer for Restricted Boltzmann Machine
  *
@@ -71,6 +91,8 @@ struct rbm_trainer {
     size_t total_batches  = 0;   ///< The total number of batches
     error_type last_error = 0.0; ///< The last training error
 
+    bool shuffle = rbm_layer_traits<rbm_t>::has_shuffle(); ///< Indicates if the samples are shuffled before each epoch
+
     //Note: input_first/input_last only relevant for its size, not
     //values since they can point to the input of the first level
     //and not the current level
@@ -84,9 +106,8 @@ struct rbm_trainer {
 
         auto size = generator.size();
 
-        //TODO Better handling of incomplete batch size would solve this problem (this could be done by
-        //cleaning the data before the last batch)
-        if (size % batch_size != 0) {
+        //The trainers handling the incomplete batches only train on their samples
+        if (!rbm_trainer_partial_batches<trainer_t<rbm_t>> && size % batch_size != 0) {
 #ifndef DLL_SILENT
             std::cout << "WARNING: The number of samples should be divisible by the batch size" << std::endl;
             std::cout << "         This may cause discrepancies in the results." << std::endl;
@@ -117,8 +138,25 @@ struct rbm_trainer {
 
     template <typename Generator>
     error_type train(RBM& rbm, Generator & generator, size_t max_epochs) {
-        dll::auto_timer timer("rbm_trainer:train");
+        static dll::timer_id timer_handle("rbm_trainer:train");
+        dll::auto_timer timer(timer_handle);
 
+        auto trainer = start_training(rbm, generator);
+
+        //Train for max_epochs epoch
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            train_epoch(rbm, generator, trainer, epoch);
+        }
+
+        return finalize_training(rbm);
+    }
+
+    /*!
+     * \brief Start the training of the given RBM on the given generator
+     * \return the trainer of the RBM, to pass to train_epoch()
+     */
+    template <typename Generator>
+    trainer_type start_training(RBM& rbm, Generator& generator) {
         //Initialize RBM and trainign parameters
         init_training(rbm, generator);
 
@@ -130,45 +168,48 @@ struct rbm_trainer {
         }
 
         //Allocate the trainer
-        auto trainer = get_trainer(rbm);
-
-        //Train for max_epochs epoch
-        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
-            //Shuffle if necessary
-            if(rbm_layer_traits<rbm_t>::has_shuffle()){
-                generator.reset_shuffle();
-            } else {
-                generator.reset();
-            }
+        return get_trainer(rbm);
+    }
 
-            // Set the the generator in train mode
-            generator.set_train();
+    /*!
+     * \brief Train the given RBM for one epoch on the given generator
+     */
+    template <typename Generator>
+    void train_epoch(RBM& rbm, Generator& generator, trainer_type& trainer, size_t epoch) {
+        //Shuffle if necessary
+        if(shuffle){
+            generator.reset_shuffle();
+        } else {
+            generator.reset();
+        }
 
-            //Create a new context for this epoch
-            rbm_training_context context;
+        // Set the the generator in train mode
+        generator.set_train();
 
-            //Start a new epoch
-            init_epoch();
+        //Create a new context for this epoch
+        rbm_training_context context;
 
-            //Train on all the data
-            train_sub(generator, trainer, context, rbm);
+        //Start a new epoch
+        init_epoch();
 
-            //Finalize the current epoch
-            finalize_epoch(epoch, context, rbm);
-        }
+        //Train on all the data
+        train_sub(generator, trainer, context, rbm);
 
-        return finalize_training(rbm);
+        //Finalize the current epoch
+        finalize_epoch(epoch, context, rbm);
     }
 
-    size_t batches = 0; ///< The number of batches
-    size_t samples = 0; ///< The number of samples
+    size_t batches   = 0; ///< The number of batches
+    size_t samples   = 0; ///< The number of monitored samples
+    size_t monitored = 0; ///< The number of monitored batches
 
     /*!
      * \brief Initialization of the epoch
      */
     void init_epoch() {
-        batches = 0;
-        samples = 0;
+        batches   = 0;
+        samples   = 0;
+        monitored = 0;
     }
 
     template <typename Generator>
@@ -184,16 +225,27 @@ struct rbm_trainer {
 
     template <typename InputBatch, typename ExpectedBatch>
     void train_batch(InputBatch&& input, ExpectedBatch&& expected, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
+        constexpr size_t monitor_batches = rbm_layer_traits<rbm_t>::monitor_batches();
+
+        context.monitor = batches % monitor_batches == 0;
+
         ++batches;
 
         trainer->train_batch(input, expected, context);
 
-        context.reconstruction_error += context.batch_error;
         context.sparsity += context.batch_sparsity;
 
-        if constexpr (EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()) {
-            for (auto& v : input) {
-                context.free_energy += rbm.free_energy(v);
+        if (context.monitor) {
+            ++monitored;
+
+            context.reconstruction_error += context.batch_error;
+
+            if constexpr (EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()) {
+                for (size_t i = 0; i < etl::dim<0>(input); ++i) {
+                    context.free_energy += rbm.free_energy(input(i));
+                }
+
+                samples += etl::dim<0>(input);
             }
         }
 
@@ -204,9 +256,9 @@ struct rbm_trainer {
 
     void finalize_epoch(size_t epoch, rbm_training_context& context, rbm_t& rbm) {
         //Average all the gathered information
-        context.reconstruction_error /= batches;
+        context.reconstruction_error /= std::max(monitored, size_t(1));
         context.sparsity /= batches;
-        context.free_energy /= samples;
+        context.free_energy /= std::max(samples, size_t(1));
 
         //After some time increase the momentum
         if (rbm_layer_traits<rbm_t>::has_momentum() && epoch == rbm.final_momentum_epoch) {
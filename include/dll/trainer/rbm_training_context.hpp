@@ -23,6 +23,8 @@ struct rbm_training_context {
 
     double batch_error    = 0.0; ///< The mean reconstruction error for the last batch
     double batch_sparsity = 0.0; ///< The mean sparsity for the last batch
+
+    bool monitor = true; ///< Indicates if the reconstruction error of the current batch must be computed
 };
 
 } //end of dll namespace
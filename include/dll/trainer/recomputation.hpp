@@ -0,0 +1,271 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file recomputation.hpp
+ * \brief Recomputation of the activations during SGD training
+ *
+ * With the recompute_activations<K> option, the layers whose index modulo K is
+ * K - 1 are checkpoints, as well as the first and the last layers. The
+ * layers between two checkpoints form a segment. The input and the output
+ * of the dense and convolutional layers of a segment are views on the
+ * slot of their index modulo K in the pool of the trainer, shared with the
+ * layers of the other segments.
+ *
+ * Before a checkpoint is backpropagated, the segment below it is forwarded
+ * again from the output of the previous checkpoint. The last segment is
+ * still intact after the forward pass and is not recomputed.
+ *
+ * A layer fused into a checkpoint (an activation layer or the convolution
+ * of a sub-pixel convolution) is a checkpoint too, since the output of the
+ * checkpoint is then never computed.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/dbn_traits.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/trainer/context_fwd.hpp"
+#include "dll/util/fusion.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the L-th layer of the given checkpointed network is
+ * a checkpoint
+ */
+template <typename DBN, size_t L>
+constexpr bool sgd_is_checkpoint() {
+    constexpr size_t K = dbn_traits<DBN>::recompute_segment_size();
+
+    if constexpr (L == 0 || L + 1 == DBN::layers || L % K == K - 1) {
+        return true;
+    } else {
+        using previous_t = typename DBN::template layer_type<L - 1>;
+        using layer_t    = typename DBN::template layer_type<L>;
+
+        return (is_fusable_activation<previous_t, layer_t> || is_subpixel_pair<previous_t, layer_t>) && sgd_is_checkpoint<DBN, L - 1>();
+    }
+}
+
+/*!
+ * \brief Indicates if the activations of the L-th layer of the given network
+ * are recomputed during SGD training
+ */
+template <typename DBN, size_t L>
+constexpr bool sgd_is_recomputed() {
+    if constexpr (dbn_traits<DBN>::recomputes_activations()) {
+        return !sgd_is_checkpoint<DBN, L>();
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Indicates if the activations of the SGD context of the given layer
+ * are in the pool of the recomputed activations.
+ *
+ * Only the contexts of the layers of the network itself are in the pool,
+ * not the contexts of the layers of a group or merge layer.
+ *
+ * \tparam DBN The network
+ * \tparam Layer The layer of the context
+ * \tparam L The index of the layer in the network
+ */
+template <typename DBN, typename Layer, size_t L>
+static constexpr bool sgd_recomputed = std::is_same_v<typename DBN::template layer_type<L>, Layer> && sgd_is_recomputed<DBN, L>();
+
+/*!
+ * \brief Indicates if the given layer can be recomputed, its forward pass
+ * giving the same outputs and having no side effects
+ */
+template <typename Layer>
+static constexpr bool sgd_recomputable = decay_layer_traits<Layer>::is_standard_dense_layer() || decay_layer_traits<Layer>::is_standard_convolutional_layer()
+                                         || decay_layer_traits<Layer>::is_pooling_layer() || is_fusion_activation<Layer>;
+
+/*!
+ * \brief Returns the index of the checkpoint before the checkpoint C
+ */
+template <typename DBN, size_t C>
+constexpr size_t sgd_previous_checkpoint() {
+    if constexpr (sgd_is_checkpoint<DBN, C - 1>()) {
+        return C - 1;
+    } else {
+        return sgd_previous_checkpoint<DBN, C - 1>();
+    }
+}
+
+/*!
+ * \brief Indicates if the segment ended by the L-th layer must be
+ * recomputed before the L-th layer is backpropagated
+ */
+template <typename DBN, size_t L>
+constexpr bool sgd_recomputes_segment() {
+    if constexpr (dbn_traits<DBN>::recomputes_activations() && L > 0 && L + 1 < DBN::layers) {
+        if constexpr (sgd_is_checkpoint<DBN, L>()) {
+            return sgd_previous_checkpoint<DBN, L>() + 1 < L;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief The type of the input or the output of a SGD context, a view on
+ * the pool when the activations are recomputed
+ */
+template <bool Recomputed, typename T, size_t... Dims>
+using sgd_activations_t = std::conditional_t<Recomputed, etl::custom_fast_matrix<T, Dims...>, etl::fast_matrix<T, Dims...>>;
+
+/*!
+ * \brief Create the input or the output of a SGD context, initialized to
+ * zero
+ * \param memory The memory of the activations in the pool (only for recomputed activations)
+ * \param offset The offset of the activations in this memory
+ */
+template <bool Recomputed, typename E, typename T>
+E make_sgd_activations([[maybe_unused]] T* memory, [[maybe_unused]] size_t offset) {
+    if constexpr (Recomputed) {
+        cpp_assert(memory, "Recomputed activations must be constructed in the pool");
+
+        return E(memory + offset);
+    } else {
+        return E(T(0));
+    }
+}
+
+/*!
+ * \brief The pool of the recomputed activations of the contexts of a
+ * network.
+ *
+ * The pool holds one slot by position in the segments, each of the size
+ * of the largest input and output of the layers at this position. Without
+ * the recompute_activations option, nothing is allocated.
+ *
+ * \tparam DBN The network
+ */
+template <typename DBN>
+struct sgd_activation_pool {
+    using weight = typename DBN::weight; ///< The data type of the network
+
+    static constexpr size_t layers = DBN::layers; ///< The number of layers
+
+    static constexpr size_t K = dbn_traits<DBN>::recomputes_activations() ? dbn_traits<DBN>::recompute_segment_size() : 1; ///< The number of layers of each segment
+
+    /*!
+     * \brief The type of the SGD context of the I-th layer
+     */
+    template <size_t I>
+    using context_t = sgd_context<DBN, typename DBN::template layer_type<I>, I>;
+
+    /*!
+     * \brief Returns the number of values of the input of the I-th layer
+     * in the pool
+     */
+    template <size_t I>
+    static constexpr size_t input_size() {
+        if constexpr (sgd_recomputes_v<context_t<I>>) {
+            return etl::decay_traits<decltype(std::declval<context_t<I>&>().input)>::size();
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of values of the input and the output of the
+     * I-th layer in the pool
+     */
+    template <size_t I>
+    static constexpr size_t activations_size() {
+        if constexpr (sgd_recomputes_v<context_t<I>>) {
+            using output_t = decltype(std::declval<context_t<I>&>().output);
+
+            static_assert(std::is_same_v<etl::value_t<output_t>, weight>, "The recomputed activations must be of the type of the network");
+
+            return input_size<I>() + etl::decay_traits<output_t>::size();
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of values of the slots
+     */
+    template <size_t... I>
+    static constexpr std::array<size_t, K> slot_sizes(std::index_sequence<I...> /*seq*/) {
+        std::array<size_t, K> sizes{};
+
+        ((sizes[I % K] = std::max(sizes[I % K], activations_size<I>())), ...);
+
+        return sizes;
+    }
+
+    /*!
+     * \brief Indicates if all the recomputed layers can be recomputed
+     */
+    template <size_t... I>
+    static constexpr bool recomputable(std::index_sequence<I...> /*seq*/) {
+        return (... && (!sgd_is_recomputed<DBN, I>() || sgd_recomputable<typename DBN::template layer_type<I>>));
+    }
+
+    static_assert(recomputable(std::make_index_sequence<layers>()), "The recomputed layers must be dense, convolutional, pooling or activation layers");
+
+    static constexpr std::array<size_t, K> sizes = slot_sizes(std::make_index_sequence<layers>()); ///< The number of values of each slot
+
+    std::array<std::vector<weight>, K> slots; ///< The slots of the layers of each position in the segments
+
+    /*!
+     * \brief Allocate the slots of the pool
+     */
+    sgd_activation_pool() {
+        for (size_t i = 0; i < K; ++i) {
+            slots[i].resize(sizes[i]);
+        }
+    }
+
+    sgd_activation_pool(const sgd_activation_pool& rhs) = delete;
+    sgd_activation_pool& operator=(const sgd_activation_pool& rhs) = delete;
+
+    sgd_activation_pool(sgd_activation_pool&& rhs) noexcept = default;
+    sgd_activation_pool& operator=(sgd_activation_pool&& rhs) noexcept = default;
+
+    /*!
+     * \brief Returns the memory of the input (followed by the output) of the
+     * I-th layer (null if its activations are not recomputed)
+     */
+    template <size_t I>
+    weight* memory() {
+        return activations_size<I>() ? slots[I % K].data() : nullptr;
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the pool
+     */
+    size_t bytes() const {
+        size_t values = 0;
+
+        for (size_t i = 0; i < K; ++i) {
+            values += sizes[i];
+        }
+
+        return values * sizeof(weight);
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,111 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file replicated_trainer.hpp
+ * \brief Data-parallel training of replicas of a network in one process
+ *
+ * Each replica is a copy of the network trained by its own thread, on its
+ * own device when the training is on GPU, from its own shard of the data.
+ * The replicas are synchronized by the distributed training of the SGD
+ * trainer: the weights are broadcast from the first replica and the
+ * gradients of each layer are all-reduced during the backpropagation.
+ *
+ * With DLL_NCCL on GPU, the reductions are done device to device by NCCL,
+ * asynchronously with the backpropagation. Otherwise, the replicas reduce
+ * their gradients in host memory.
+ */
+
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef ETL_GPU
+#include <cuda_runtime.h>
+#endif
+
+#include "dll/generators/shard.hpp"
+#include "dll/util/distributed.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Create the communicators of the given number of replicas in the
+ * current process, by NCCL on GPU if available.
+ */
+inline std::vector<std::shared_ptr<communicator>> make_replica_communicators(size_t replicas) {
+#if defined(ETL_GPU) && defined(DLL_NCCL)
+    return make_nccl_communicators(replicas);
+#else
+    return make_local_communicators(replicas);
+#endif
+}
+
+/*!
+ * \brief Fine-tune replicas of a network, each from its own shard of the
+ * data, replica r on the GPU r when the training is on GPU.
+ *
+ * The networks and the generators are created one after the other, by
+ * the calling thread. The device memory of a replica is only allocated by
+ * its own thread, once its device is selected.
+ *
+ * \param factory A functor returning a std::unique_ptr to a new network
+ * \param generators A functor returning a std::unique_ptr to the generator of the given dll::shard
+ * \param replicas The number of replicas
+ * \param max_epochs The maximum number of epochs
+ * \param seed The seed of the shards
+ *
+ * \return The network of the first replica, all the replicas having the same weights
+ */
+template <typename Factory, typename Generators>
+auto replicated_fine_tune(Factory&& factory, Generators&& generators, size_t replicas, size_t max_epochs, size_t seed = 0) {
+    static dll::timer_id timer_handle("net:train:replicated_ft");
+    dll::auto_timer timer(timer_handle);
+
+    cpp_assert(replicas > 0, "At least one replica must be trained");
+
+    auto comms = make_replica_communicators(replicas);
+
+    using dbn_ptr       = std::decay_t<decltype(factory())>;
+    using generator_ptr = std::decay_t<decltype(generators(std::declval<const shard&>()))>;
+
+    std::vector<dbn_ptr> dbns;
+    std::vector<generator_ptr> parts;
+
+    for (size_t r = 0; r < replicas; ++r) {
+        dbns.push_back(factory());
+        parts.push_back(generators(shard(r, replicas, seed)));
+
+        dbns.back()->comm = comms[r];
+    }
+
+    std::vector<std::thread> threads;
+
+    for (size_t r = 0; r < replicas; ++r) {
+        threads.emplace_back([&dbns, &parts, r, max_epochs] {
+#ifdef ETL_GPU
+            cudaSetDevice(int(r));
+#endif
+
+            dbns[r]->fine_tune(*parts[r], max_epochs);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // The returned network is no longer part of the group
+    dbns[0]->comm.reset();
+
+    return std::move(dbns[0]);
+}
+
+} //end of dll namespace
@@ -0,0 +1,175 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file shared_errors.hpp
+ * \brief Sharing of the errors of the layers during SGD training
+ *
+ * The errors of a layer are written by the backpropagation of the next
+ * layer and are dead once the layer has backpropagated them and computed
+ * its gradients. With the shared_errors option, the gradients of each
+ * layer are computed during the backpropagation and the errors of two
+ * layers that are not adjacent are never alive at the same time: the layers
+ * of even index share one buffer of the pool and the layers of odd index
+ * the other one.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/dbn_traits.hpp"
+#include "dll/trainer/context_fwd.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the errors of the SGD context of the given layer
+ * are in the shared pool.
+ *
+ * Only the contexts of the layers of the network itself are shared, not
+ * the contexts of the layers of a group or merge layer.
+ *
+ * \tparam DBN The network
+ * \tparam Layer The layer of the context
+ * \tparam L The index of the layer in the network
+ */
+template <typename DBN, typename Layer, size_t L>
+static constexpr bool sgd_shared_errors = dbn_traits<DBN>::shared_errors() && std::is_same_v<typename DBN::template layer_type<L>, Layer>;
+
+/*!
+ * \brief The type of the errors of a SGD context, a view on the pool when
+ * the errors are shared
+ */
+template <bool Shared, typename T, size_t... Dims>
+using sgd_errors_t = std::conditional_t<Shared, etl::custom_fast_matrix<T, Dims...>, etl::fast_matrix<T, Dims...>>;
+
+/*!
+ * \brief Create the errors of a SGD context, initialized to zero
+ * \param memory The memory of the errors in the pool (only for shared errors)
+ */
+template <bool Shared, typename E, typename T>
+E make_sgd_errors([[maybe_unused]] T* memory) {
+    if constexpr (Shared) {
+        cpp_assert(memory, "Shared errors must be constructed in the pool");
+
+        return E(memory);
+    } else {
+        return E(T(0));
+    }
+}
+
+/*!
+ * \brief The pool of the shared errors of the contexts of a network.
+ *
+ * The pool holds two buffers, each of the size of the largest errors of
+ * the layers of its parity. Without the shared_errors option, nothing is
+ * allocated.
+ *
+ * \tparam DBN The network
+ */
+template <typename DBN>
+struct sgd_error_pool {
+    using weight = typename DBN::weight; ///< The data type of the network
+
+    static constexpr size_t layers = DBN::layers; ///< The number of layers
+
+    /*!
+     * \brief The type of the SGD context of the I-th layer
+     */
+    template <size_t I>
+    using context_t = sgd_context<DBN, typename DBN::template layer_type<I>, I>;
+
+    /*!
+     * \brief Returns the number of values of the errors of the I-th layer
+     * in the pool
+     */
+    template <size_t I>
+    static constexpr size_t errors_size() {
+        if constexpr (sgd_shares_errors_v<context_t<I>>) {
+            using errors_t = decltype(std::declval<context_t<I>&>().errors);
+
+            static_assert(std::is_same_v<etl::value_t<errors_t>, weight>, "The shared errors must be of the type of the network");
+
+            return etl::decay_traits<errors_t>::size();
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of values of the two buffers
+     */
+    template <size_t... I>
+    static constexpr std::array<size_t, 2> buffer_sizes(std::index_sequence<I...> /*seq*/) {
+        std::array<size_t, 2> sizes{{0, 0}};
+
+        ((sizes[I % 2] = std::max(sizes[I % 2], errors_size<I>())), ...);
+
+        return sizes;
+    }
+
+    static constexpr std::array<size_t, 2> sizes = buffer_sizes(std::make_index_sequence<layers>()); ///< The number of values of each buffer
+
+    std::array<std::vector<weight>, 2> buffers; ///< The buffers of the layers of even and odd indices
+
+    /*!
+     * \brief Allocate the buffers of the pool
+     */
+    sgd_error_pool() {
+        buffers[0].resize(sizes[0]);
+        buffers[1].resize(sizes[1]);
+    }
+
+    sgd_error_pool(const sgd_error_pool& rhs) = delete;
+    sgd_error_pool& operator=(const sgd_error_pool& rhs) = delete;
+
+    sgd_error_pool(sgd_error_pool&& rhs) noexcept = default;
+    sgd_error_pool& operator=(sgd_error_pool&& rhs) noexcept = default;
+
+    /*!
+     * \brief Returns the memory of the errors of the I-th layer (null if its
+     * errors are not shared)
+     */
+    template <size_t I>
+    weight* memory() {
+        return errors_size<I>() ? buffers[I % 2].data() : nullptr;
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the pool
+     */
+    size_t bytes() const {
+        return (sizes[0] + sizes[1]) * sizeof(weight);
+    }
+};
+
+/*!
+ * \brief Create the SGD context of a layer, with its errors in the given
+ * memory of the pool if they are shared and its activations in the given
+ * memory of the pool if they are recomputed
+ */
+template <typename Context, typename Layer, typename T>
+std::shared_ptr<Context> make_sgd_context(Layer& layer, [[maybe_unused]] T* errors_memory, [[maybe_unused]] T* activations_memory = nullptr) {
+    if constexpr (sgd_recomputes_v<Context>) {
+        return std::make_shared<Context>(layer, errors_memory, activations_memory);
+    } else if constexpr (sgd_shares_errors_v<Context>) {
+        return std::make_shared<Context>(layer, errors_memory);
+    } else {
+        return std::make_shared<Context>(layer);
+    }
+}
+
+} //end of dll namespace
@@ -18,8 +18,29 @@
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/trainer/context_fwd.hpp" // For sgd_context
+#include "dll/trainer/shared_errors.hpp" // For sgd_error_pool
+#include "dll/trainer/recomputation.hpp" // For sgd_activation_pool
+#include "dll/util/arena.hpp"          // For arena_temporary
+#include "dll/util/batch_phases.hpp"   // For batch_phases
 #include "dll/util/checks.hpp"         // For NaN checks
+#include "dll/util/concat.hpp"         // For concat_slice
+#include "dll/util/distillation.hpp"   // For distill_errors
+#include "dll/util/distributed.hpp"    // For communicator
+#include "dll/util/fold.hpp"           // For weights_changed
+#include "dll/util/frozen_cache.hpp"   // For frozen_feature_cache
+#include "dll/util/fusion.hpp"         // For is_fusable_activation
+#include "dll/util/health.hpp"         // For health_monitor
+#include "dll/util/in_place.hpp"       // For forward_batch_in_place
+#include "dll/util/isa.hpp"            // For DLL_MULTI_ISA_KERNEL
+#include "dll/util/parallel.hpp"       // For for_each_branch
+#include "dll/util/pipeline_schedule.hpp" // For run_pipeline_1f1b
+#include "dll/util/sampled_output.hpp" // For is_sampled_output
+#include "dll/util/layer_profiler.hpp" // For layer_scope
+#include "dll/util/memory_report.hpp"  // For memory_usage
+#include "dll/util/softmax_cce.hpp"    // For softmax_cce
+#include "dll/util/sparse.hpp"         // For is_prunable
 #include "dll/util/timers.hpp"         // For auto_timer
+#include "dll/util/trace.hpp"          // For trace_scope
 
 namespace dll {
 
@@ -32,6 +53,14 @@ static constexpr bool is_merge_layer = cpp::is_specialization_of_v<dll::merge_la
 template <typename Layer>
 static constexpr bool is_utility_layer = is_group_layer<Layer> || is_merge_layer<Layer>;
 
+/*!
+ * \brief Indicates if the given network has tied layers
+ */
+template <typename DBN, size_t... I>
+constexpr bool has_tied_layers(std::index_sequence<I...> /*seq*/) {
+    return (is_tied_layer<typename DBN::template layer_type<I>> || ...);
+}
+
 /*!
  * \brief Build the sub context for a updater context
  *
@@ -320,6 +349,54 @@ struct updater_sub_context <Layer, I, updater_type::ADAMAX> {
     }
 };
 
+/*!
+ * \brief The context for the LARS updater
+ */
+template<typename Layer, size_t I>
+struct updater_sub_context <Layer, I, updater_type::LARS> {
+    /*!
+     * \brief The type of the variable to optimize
+     */
+    using type = std::remove_reference_t<decltype(std::get<I>(std::declval<Layer>().trainable_parameters()))>;
+
+    type grad; ///< The gradients of the variable
+    type inc;  ///< The accumulated momentum cache
+
+    /*!
+     * \brief Construct the sub_context for the given layer
+     * \param layer The layer to build the context for
+     */
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), inc(grad) {
+        grad = 0;
+        inc = 0;
+    }
+};
+
+/*!
+ * \brief The context for the LAMB updater
+ */
+template<typename Layer, size_t I>
+struct updater_sub_context <Layer, I, updater_type::LAMB> {
+    /*!
+     * \brief The type of the variable to optimize
+     */
+    using type = std::remove_reference_t<decltype(std::get<I>(std::declval<Layer>().trainable_parameters()))>;
+
+    type grad; ///< The gradients of the variable
+    type m;    ///< Estimates of the first moment of the gradient
+    type v;    ///< Estimates of the second moment of the gradient
+
+    /*!
+     * \brief Construct the sub_context for the given layer
+     * \param layer The layer to build the context for
+     */
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), v(grad) {
+        grad = 0;
+        m = 0;
+        v = 0;
+    }
+};
+
 
 /*!
  * \brief The context for the base updater (no update).
@@ -344,6 +421,12 @@ struct updater_context<UT, true, Layer> {
      */
     decltype(build_sub_context<updater_sub_context, UT>(std::declval<Layer&>())) context;
 
+    /*!
+     * \brief The gradients accumulated over several mini-batches, only
+     * allocated when gradient accumulation is used.
+     */
+    decltype(build_sub_context<updater_sub_context, updater_type::SGD>(std::declval<Layer&>())) accumulated;
+
     /*!
      * \brief Construct a new updater_context using the parent context
      */
@@ -360,10 +443,14 @@ template <typename DBN, typename Layer, size_t L>
 struct full_sgd_context : sgd_context<DBN, Layer, L> {
     using context_type = sgd_context<DBN, Layer, L>; ///< The parent context type
 
+    static constexpr size_t index = L; ///< The index of the layer in the network
+
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_prefix(); ///< Indicates if the layer is frozen
+
     /*!
-     * \brief The updater context
+     * \brief The updater context (none for frozen layers)
      */
-    updater_context<DBN::updater, decay_layer_traits<Layer>::is_neural_layer(), Layer> up;
+    updater_context<DBN::updater, decay_layer_traits<Layer>::is_neural_layer() && !frozen, Layer> up;
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -371,6 +458,24 @@ struct full_sgd_context : sgd_context<DBN, Layer, L> {
     full_sgd_context(const Layer& layer) : context_type(layer), up(layer) {
         // Nothing else to init
     }
+
+    /*!
+     * \brief Construct the full_sgd_context for the given layer, its errors
+     * being in the given memory of the shared pool
+     */
+    template <typename T>
+    full_sgd_context(const Layer& layer, T* errors_memory) : context_type(layer, errors_memory), up(layer) {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief Construct the full_sgd_context for the given layer, its errors
+     * and its activations being in the given memories of the pools
+     */
+    template <typename T>
+    full_sgd_context(const Layer& layer, T* errors_memory, T* activations_memory) : context_type(layer, errors_memory, activations_memory), up(layer) {
+        // Nothing else to init
+    }
 };
 
 /*!
@@ -383,6 +488,9 @@ struct full_sgd_context <DBN, group_layer_impl<group_layer_desc<Layers...>>, L>
     using context_type = sgd_context<DBN, layer_t, L>;                  ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t index    = L;                 ///< The index of the layer in the network
+
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_prefix(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
@@ -404,6 +512,9 @@ struct full_sgd_context <DBN, dyn_group_layer_impl<dyn_group_layer_desc<Layers..
     using context_type = sgd_context<DBN, layer_t, L>;                  ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t index    = L;                 ///< The index of the layer in the network
+
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_prefix(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
@@ -425,13 +536,18 @@ struct full_sgd_context<DBN, merge_layer_impl<merge_layer_desc<D, Layers...>>, L
     using context_type = sgd_context<DBN, layer_t, L>;                     ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t index    = L;                 ///< The index of the layer in the network
+
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_prefix(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
+    std::vector<typename context_type::input_type> back_errors; ///< The scratch errors of the branches
+
     /*!
      * \brief Construct the full_sgd_context for the given layer
      */
-    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers) {
+    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers), back_errors(n_layers > 1 ? 1 : 0, context_type::input) {
         // Nothing else to init
     }
 };
@@ -446,13 +562,18 @@ struct full_sgd_context<DBN, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers
     using context_type = sgd_context<DBN, layer_t, L>;                     ///< The parent context type
 
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t index    = L;                 ///< The index of the layer in the network
+
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_prefix(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
+    std::vector<typename context_type::input_type> back_errors; ///< The scratch errors of the branches
+
     /*!
      * \brief Construct the full_sgd_context for the given layer
      */
-    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers) {
+    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers), back_errors(n_layers > 1 ? 1 : 0, context_type::input) {
         // Nothing else to init
     }
 };
@@ -460,14 +581,16 @@ struct full_sgd_context<DBN, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers
 /*!
  * \brief Build the context for a DBN for the given sequence of layers
  * \param dbn The DBN to build the context from
+ * \param pool The pool of the shared errors
+ * \param activations The pool of the recomputed activations
  */
 template<template<typename, typename, size_t> typename Context, typename DBN, size_t... I>
-auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
+auto build_context(DBN& dbn, sgd_error_pool<DBN>& pool, sgd_activation_pool<DBN>& activations, std::index_sequence<I...> /*seq*/){
     return std::make_tuple
         (
             (std::make_pair(
                 std::ref(dbn.template layer_get<I>()),  // Reference to the layer
-                std::make_shared<Context<DBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
+                make_sgd_context<Context<DBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>(), pool.template memory<I>(), activations.template memory<I>()))
             )...
         );
 }
@@ -475,10 +598,175 @@ auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
 /*!
  * \brief Build the context for a DBN
  * \param dbn The DBN to build the context from
+ * \param pool The pool of the shared errors
+ * \param activations The pool of the recomputed activations
  */
 template<template<typename, typename, size_t> typename Context, typename DBN>
-auto build_context(DBN& dbn){
-    return build_context<Context>(dbn, std::make_index_sequence<DBN::layers>());
+auto build_context(DBN& dbn, sgd_error_pool<DBN>& pool, sgd_activation_pool<DBN>& activations){
+    return build_context<Context>(dbn, pool, activations, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief A view of a DBN with a smaller batch size.
+ *
+ * This is used to build the contexts of the shards of data-parallel SGD,
+ * each shard only holding a part of the mini-batch.
+ *
+ * \tparam DBN The viewed DBN
+ * \tparam B The batch size of the shard
+ */
+template <typename DBN, size_t B>
+struct sgd_shard_dbn {
+    using desc     = typename DBN::desc;     ///< The DBN descriptor
+    using weight   = typename DBN::weight;   ///< The data type of the DBN
+    using layers_t = typename DBN::layers_t; ///< The layers container type
+
+    template <size_t N>
+    using layer_type = typename DBN::template layer_type<N>; ///< The type of the layer at index N
+
+    static constexpr size_t layers     = DBN::layers;  ///< The number of layers
+    static constexpr size_t batch_size = B;            ///< The batch size of the shard
+    static constexpr auto loss         = DBN::loss;    ///< The loss function
+    static constexpr auto updater      = DBN::updater; ///< The Updater type
+    static constexpr auto early        = DBN::early;   ///< The Early Stopping strategy
+};
+
+/*!
+ * \brief Build the context of a shard of the given DBN for the given
+ * sequence of layers
+ * \param dbn The DBN to build the context from
+ * \param pool The pool of the shared errors of the shard
+ */
+template<template<typename, typename, size_t> typename Context, typename Shard, typename DBN, size_t... I>
+auto build_shard_context(DBN& dbn, sgd_error_pool<Shard>& pool, std::index_sequence<I...> /*seq*/){
+    return std::make_tuple
+        (
+            (std::make_pair(
+                std::ref(dbn.template layer_get<I>()),  // Reference to the layer
+                make_sgd_context<Context<Shard, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>(), pool.template memory<I>()))
+            )...
+        );
+}
+
+/*!
+ * \brief Build the context of a shard of the given DBN
+ * \param dbn The DBN to build the context from
+ * \param pool The pool of the shared errors of the shard
+ */
+template<template<typename, typename, size_t> typename Context, typename Shard, typename DBN>
+auto build_shard_context(DBN& dbn, sgd_error_pool<Shard>& pool){
+    return build_shard_context<Context, Shard>(dbn, pool, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief The contexts of the shards of a data-parallel SGD trainer.
+ *
+ * Without data-parallelism, no context is built.
+ */
+template <typename DBN, size_t Shards, typename Enable = void>
+struct sgd_shards {
+    /*!
+     * \brief Construct the (empty) shard contexts
+     */
+    explicit sgd_shards(DBN& /*dbn*/) {}
+};
+
+/*!
+ * \copydoc sgd_shards
+ */
+template <typename DBN, size_t Shards>
+struct sgd_shards<DBN, Shards, std::enable_if_t<(Shards > 1)>> {
+    static constexpr size_t shard_size = DBN::batch_size / Shards; ///< The number of samples per shard
+
+    using shard_dbn_t = sgd_shard_dbn<DBN, shard_size>; ///< The view of the DBN for one shard
+
+    /*!
+     * \brief The type of the context of one shard
+     */
+    using context_t = decltype(build_shard_context<full_sgd_context, shard_dbn_t>(std::declval<DBN&>(), std::declval<sgd_error_pool<shard_dbn_t>&>()));
+
+    std::vector<sgd_error_pool<shard_dbn_t>> pools; ///< The pools of the shared errors of each shard
+    std::vector<context_t> contexts;                ///< The contexts of each shard
+
+    /*!
+     * \brief Construct the contexts for each shard
+     * \param dbn The DBN being trained
+     */
+    explicit sgd_shards(DBN& dbn) {
+        // The contexts point into the pools, they must not be reallocated
+        pools.reserve(Shards);
+        contexts.reserve(Shards);
+
+        for (size_t s = 0; s < Shards; ++s) {
+            pools.emplace_back();
+            contexts.push_back(build_shard_context<full_sgd_context, shard_dbn_t>(dbn, pools.back()));
+        }
+    }
+};
+
+/*!
+ * \brief Apply the given functor on each element of the given tensors, in a
+ * single pass over memory.
+ *
+ * The functor is called with an element of the variable being updated, the
+ * corresponding gradient and the corresponding elements of each updater
+ * state.
+ *
+ * \param functor The functor to apply
+ * \param w The variable being updated
+ * \param grad The gradients of the variable
+ * \param states The updater states of the variable
+ */
+template <typename Functor, typename W, typename G, typename... S>
+DLL_MULTI_ISA_KERNEL void fused_update_loop(Functor&& functor, W& w, const G& grad, S&... states) {
+    w.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+    (states.ensure_cpu_up_to_date(), ...);
+
+    auto* w_p       = w.memory_start();
+    const auto* g_p = grad.memory_start();
+
+    const size_t N = etl::size(w);
+
+    for (size_t i = 0; i < N; ++i) {
+        functor(w_p[i], g_p[i], states.memory_start()[i]...);
+    }
+
+    w.invalidate_gpu();
+    (states.invalidate_gpu(), ...);
+}
+
+/*!
+ * \brief Apply the given functor on each element of the given rows of the
+ * given tensors, in a single pass over memory.
+ *
+ * The tensors are seen as matrices of etl::dim<0>(w) rows.
+ *
+ * \param functor The functor to apply
+ * \param rows The rows to update
+ * \param w The variable being updated
+ * \param grad The gradients of the variable
+ * \param states The updater states of the variable
+ */
+template <typename Functor, typename W, typename G, typename... S>
+DLL_MULTI_ISA_KERNEL void fused_update_rows(Functor&& functor, const std::vector<size_t>& rows, W& w, const G& grad, S&... states) {
+    w.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+    (states.ensure_cpu_up_to_date(), ...);
+
+    auto* w_p       = w.memory_start();
+    const auto* g_p = grad.memory_start();
+
+    const size_t K = etl::size(w) / etl::dim<0>(w);
+
+    for (auto row : rows) {
+        for (size_t i = row * K; i < (row + 1) * K; ++i) {
+            functor(w_p[i], g_p[i], states.memory_start()[i]...);
+        }
+    }
+
+    w.invalidate_gpu();
+    (states.invalidate_gpu(), ...);
 }
 
 /*!
@@ -492,10 +780,161 @@ struct sgd_trainer {
 
     static constexpr auto layers     = dbn_t::layers;     ///< The number of layers
     static constexpr auto batch_size = dbn_t::batch_size; ///< The batch size for training
+    static constexpr auto shards     = dbn_traits<dbn_t>::shards(); ///< The number of shards for data-parallel training
+    static constexpr auto stages     = dbn_traits<dbn_t>::pipeline_stages(); ///< The number of stages for pipeline-parallel training
+
+    /*!
+     * \brief The number of parts of each batch trained in their own contexts
+     * (the shards of data-parallel training or the micro-batches of
+     * pipeline-parallel training)
+     */
+    static constexpr size_t partitions = dbn_traits<dbn_t>::is_pipeline_parallel() ? dbn_traits<dbn_t>::micro_batches() : shards;
+
+    static_assert(!dbn_traits<dbn_t>::is_hogwild() || shards > 1, "Hogwild training needs data_parallel shards");
+    static_assert(!dbn_traits<dbn_t>::is_hogwild() || dbn_traits<dbn_t>::updater() == updater_type::SGD || dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM,
+                  "Hogwild training only supports the SGD and MOMENTUM updaters");
+
+    /*!
+     * \brief Indicates if the training is resident on the GPU.
+     *
+     * In that case, the weights, the contexts and the updater states stay
+     * on the device for the whole training: the updates and the errors of
+     * the last layer are computed with ETL expressions, the staged inputs
+     * are uploaded while the previous batch is trained and only the
+     * metrics are read back on the host.
+     *
+     * This is only the case with the gpu_resident option in ETL_GPU builds,
+     * the training on the CPU of the other networks keeps the fused passes.
+     */
+#ifdef ETL_GPU
+    static constexpr bool gpu_resident = dbn_traits<dbn_t>::is_gpu_resident();
+#else
+    static constexpr bool gpu_resident = false;
+#endif
+
+    static constexpr bool fused_updates = !gpu_resident && !dbn_traits<dbn_t>::unfused_updates(); ///< Indicates if the updates are done in a single pass over memory
+
+    static constexpr bool waits_backup = true; ///< Indicates if the weights are only updated once their background backup is done
+
+    /*!
+     * \brief Indicates if the output stage is a fused softmax and
+     * categorical cross-entropy.
+     *
+     * In that case, the last layer only computes its logits during training
+     * and the softmax, the errors of the last layer, the loss and the error
+     * are computed together in a single pass over them.
+     *
+     * A sampled output layer computes nothing in the forward pass during
+     * training, its errors, loss and error are computed from the labels.
+     */
+    static constexpr bool fused_softmax_cce =
+        dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY
+        && ((!gpu_resident && has_softmax_logits<typename dbn_t::template layer_type<layers - 1>>) || is_sampled_output<typename dbn_t::template layer_type<layers - 1>>);
+
+    /*!
+     * \brief Indicates if the last layer is a sampled output layer
+     */
+    static constexpr bool sampled_output = is_sampled_output<typename dbn_t::template layer_type<layers - 1>>;
+
+    static_assert(!sampled_output || fused_softmax_cce, "Sampled output layers are only trained with the categorical cross-entropy");
+
+    /*!
+     * \brief Indicates if the network has tied layers.
+     *
+     * In that case, the gradients of all the layers must be computed before
+     * the weights are updated, since the gradients of the tied layers are
+     * added to the gradients of the layers they are tied to.
+     */
+    static constexpr bool tied_layers = has_tied_layers<dbn_t>(std::make_index_sequence<layers>());
+
+    static_assert(stages <= layers, "There cannot be more pipeline stages than layers");
+    static_assert(stages == 1 || !tied_layers, "Pipeline-parallel training does not support tied layers");
+
+    /*!
+     * \brief The number of first layers that are frozen.
+     *
+     * The frozen layers are forwarded in inference mode, the errors are not
+     * backpropagated into them and they have no gradients nor updater
+     * state.
+     */
+    static constexpr size_t frozen = dbn_traits<dbn_t>::frozen_prefix();
+
+    static_assert(frozen < layers, "At least the last layer must be trained");
 
-    dbn_t& dbn;                                                  ///< The DBN being trained
-    decltype(build_context<full_sgd_context>(dbn)) full_context; ///< The context
-    size_t iteration;                                            ///< The current iteration
+    /*!
+     * \brief Indicates if the errors of the non-adjacent layers share their
+     * memory.
+     *
+     * In that case, the errors of a layer are overwritten during the
+     * backpropagation of the lower layers: its gradients are computed as
+     * soon as it has backpropagated its errors.
+     */
+    static constexpr bool shared_errors = dbn_traits<dbn_t>::shared_errors();
+
+    /*!
+     * \brief Indicates if the activations between the checkpoints are
+     * recomputed during the backward pass.
+     *
+     * In that case, the activations of a layer are overwritten by the
+     * recomputation of the lower segments: its gradients are computed as
+     * soon as it has backpropagated its errors.
+     */
+    static constexpr bool recomputes = dbn_traits<dbn_t>::recomputes_activations();
+
+    /*!
+     * \brief Indicates if the gradients of each layer are computed during
+     * the backpropagation rather than after it
+     */
+    static constexpr bool backward_gradients = shared_errors || recomputes;
+
+    static_assert(frozen == 0 || !recomputes, "The recomputation of the activations does not support frozen layers");
+    static_assert(frozen == 0 || stages == 1, "Pipeline-parallel training does not support frozen layers");
+    static_assert(frozen == 0 || !is_utility_layer<typename dbn_t::template layer_type<frozen>>, "The first trained layer cannot be a group or a merge layer");
+
+    dbn_t& dbn;                                                                               ///< The DBN being trained
+    sgd_error_pool<dbn_t> error_pool;                                                         ///< The memory of the shared errors
+    sgd_activation_pool<dbn_t> activation_pool;                                               ///< The memory of the recomputed activations
+    decltype(build_context<full_sgd_context>(dbn, error_pool, activation_pool)) full_context; ///< The context
+    sgd_shards<dbn_t, partitions> shard_contexts;                                             ///< The contexts of the shards (data-parallel training) or of the micro-batches (pipeline-parallel training)
+    size_t iteration;                                                                         ///< The current iteration
+    size_t micro_batches       = 0;                                                           ///< The number of mini-batches currently accumulated
+    size_t accumulated_samples = 0;                                                           ///< The number of samples currently accumulated
+    size_t good_steps          = 0;                                                           ///< The number of finite steps since the last change of the loss scale
+    batch_phases phases;                                                                      ///< The time of the phases of the last batch
+
+    using input_stage_t = std::decay_t<decltype(std::get<0>(full_context).second->input)>; ///< The type of the inputs of the first layer
+
+    std::unique_ptr<input_stage_t> input_stage; ///< The staging buffer of the next inputs (pipelined training)
+    size_t staged_n  = 0;                       ///< The number of samples in the staging buffer
+    size_t current_n = 0;                       ///< The number of staged samples in the inputs of the first layer
+
+    /*!
+     * \brief Indicates if the trainer can train the layers after the frozen
+     * prefix from its cached outputs (only for serial training)
+     */
+    static constexpr bool has_frozen_cache = frozen > 0 && partitions == 1;
+
+    frozen_feature_cache<weight> frozen_cache; ///< The outputs of the frozen prefix for the training set
+
+    /*!
+     * \brief Indicates if the trainer can weight the errors of each sample
+     * and give back their losses (only for serial training with a complete
+     * output layer)
+     */
+    static constexpr bool has_sample_weights = partitions == 1 && !sampled_output;
+
+    const weight* sample_weights = nullptr; ///< The weights of the errors of the samples of the next batches (none if null)
+    weight* sample_losses        = nullptr; ///< The losses of the samples of the next batches (not computed if null)
+
+    /*!
+     * \brief Indicates if the trainer can mix the soft targets of a teacher
+     * in the errors (knowledge distillation, only for serial training with a
+     * softmax output and a categorical cross-entropy loss)
+     */
+    static constexpr bool has_soft_targets = has_sample_weights && dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY;
+
+    const weight* soft_targets     = nullptr; ///< The soft targets of the teacher for the next batch (no distillation if null)
+    task_group* soft_targets_tasks = nullptr; ///< The tasks computing the soft targets, waited before their use (ready if null)
 
     // Transform layers need to inherit dimensions from back
 
@@ -510,7 +949,10 @@ struct sgd_trainer {
         if (ctx2.errors.size() == 0) {
             ctx2.output = ctx1.output;
             ctx2.errors = ctx1.output;
-            ctx2.input  = ctx1.output;
+
+            if constexpr (sgd_keeps_input_v<std::decay_t<decltype(ctx2)>>) {
+                ctx2.input = ctx1.output;
+            }
         }
     }
 
@@ -524,10 +966,67 @@ struct sgd_trainer {
      * \brief construct a new sgd_trainer
      * \param dbn The DBN being trained
      */
-    explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(dbn)), iteration(1) {
+    explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(dbn, error_pool, activation_pool)), shard_contexts(dbn), iteration(1) {
+        if constexpr (frozen > 0) {
+            using last_frozen_t = std::decay_t<decltype(*std::get<frozen - 1>(full_context).second)>;
+
+            static_assert(!sgd_subpixel_v<last_frozen_t>, "A sub-pixel convolution cannot be split by the frozen prefix");
+        }
+
         // Inherit dimensions from front to end (for transform layers)
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+        inherit_dimensions(full_context);
+
+        if constexpr (partitions > 1) {
+            for (auto& context : shard_contexts.contexts) {
+                inherit_dimensions(context);
+            }
+        }
+
+        // All the processes must start from the same weights
+
+        if (distributed()) {
+            cpp::for_each(full_context, [this](auto& layer_ctx) {
+                this_type::broadcast_weights_layer(layer_ctx.first, *dbn.comm);
+            });
+        }
+    }
+
+    /*!
+     * \brief Indicates if the training is distributed over several processes
+     */
+    bool distributed() const {
+        return dbn.comm && dbn.comm->size() > 1;
+    }
+
+    /*!
+     * \brief Indicates if the loss is dynamically scaled.
+     *
+     * The loss scaling is not used in distributed training since the
+     * processes would have to agree on skipping the steps.
+     */
+    bool loss_scaling() const {
+        return dbn.loss_scale > 0 && !distributed();
+    }
+
+    /*!
+     * \brief Indicates if the shards apply their updates asynchronously.
+     *
+     * The distributed training, the gradient accumulation and the loss
+     * scaling need the reduced gradients, they fall back to the synchronous
+     * data-parallel training.
+     */
+    bool hogwild() const {
+        return dbn_traits<dbn_t>::is_hogwild() && !distributed() && dbn.accumulation_steps <= 1 && !loss_scaling();
+    }
+
+    /*!
+     * \brief Inherit the dimensions from front to end in the given context
+     * \param context The full context of the network
+     */
+    template <typename Context>
+    static void inherit_dimensions(Context& context) {
+        cpp::for_each_pair(context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
             constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
 
             if (l2_transform) {
@@ -537,170 +1036,1803 @@ struct sgd_trainer {
     }
 
     /*!
-     * \brief Initialize the training
+     * \brief Set the lengths of the sequences of the next batches.
+     *
+     * The recurrent layers only compute the true time steps of each
+     * sequence. An empty vector means that all the sequences have the full
+     * number of time steps.
+     *
+     * \param lengths The length of each sample of the batch
      */
-    void init_training(size_t) {}
+    void set_sequence_lengths(const std::vector<size_t>& lengths) {
+        set_sequence_lengths_context(full_context, lengths);
 
-    // CPP17 Replace SFINAE with if constexpr
+        if constexpr (partitions > 1) {
+            constexpr size_t shard_size = decltype(shard_contexts)::shard_size;
 
-    /*!
-     * \brief Compute the errors of the last layer given the loss function
-     */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+            std::vector<size_t> shard_lengths;
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+            for (size_t s = 0; s < shard_contexts.contexts.size(); ++s) {
+                const size_t first = std::min(s * shard_size, lengths.size());
+                const size_t last  = std::min(first + shard_size, lengths.size());
+
+                // The shards past the end of the batch are not trained
+                shard_lengths.assign(lengths.begin() + first, lengths.begin() + last);
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = labels(i) - last_ctx.output(i);
+                set_sequence_lengths_context(shard_contexts.contexts[s], shard_lengths);
             }
-        } else {
-            last_ctx.errors = labels - last_ctx.output;
         }
-
-        // Note: No need to multiply by the derivative of
-        // the activation function since the terms are
-        // canceling out in the derivative of the loss
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Set the number of active samples of the batch in the layers of
+     * the given context that only compute them
+     * \param context The full context of the network
+     * \param n The number of samples of the batch
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    template <typename Context>
+    static void set_active_context(Context& context, size_t n) {
+        cpp::for_each(context, [n](auto& layer_ctx) {
+            using context_t = std::decay_t<decltype(*layer_ctx.second)>;
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+            if constexpr (sgd_has_active_v<context_t>) {
+                layer_ctx.second->active = n;
+            }
+        });
+    }
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = 2.0 * (labels(i) - last_ctx.output(i));
+    /*!
+     * \brief Set the lengths of the sequences in the masks of the given context
+     * \param context The full context of the network
+     * \param lengths The length of each sample of the batch
+     */
+    template <typename Context>
+    static void set_sequence_lengths_context(Context& context, const std::vector<size_t>& lengths) {
+        cpp::for_each(context, [&lengths](auto& layer_ctx) {
+            using context_t = std::decay_t<decltype(*layer_ctx.second)>;
+
+            if constexpr (sgd_has_mask_v<context_t>) {
+                layer_ctx.second->workspace.mask.lengths = lengths;
             }
-        } else {
-            last_ctx.errors = 2.0 * (labels - last_ctx.output);
-        }
+        });
+    }
 
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
+    /*!
+     * \brief Initialize the training
+     *
+     * When the training is resident on the GPU, the weights are uploaded
+     * once, before the first batch.
+     */
+    void init_training(size_t) {
+        if constexpr (gpu_resident) {
+            cpp::for_each(full_context, [](auto& layer_ctx) {
+                this_type::upload_weights_layer(layer_ctx.first);
+            });
+        }
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Returns the memory of the contexts of the layers (and of their
+     * shards in data-parallel training)
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    memory_usage memory_report() const {
+        memory_usage report;
 
-        // Avoid Nan from division by ((1 - out) * out)
-        auto out = etl::force_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
+        cpp::for_each_i(full_context, [&report](size_t i, auto& layer_ctx) {
+            report.add("layer " + std::to_string(i) + ": ", context_memory_report<dbn_t::updater>(*layer_ctx.second));
+        });
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        if constexpr (shared_errors) {
+            report.add("shared errors", error_pool.bytes());
+        }
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = (labels(i) - out(i)) / ((1.0 - out(i)) >> out(i));
-            }
-        } else {
-            last_ctx.errors = (labels - out) / ((1.0 - out) >> out);
+        if constexpr (recomputes) {
+            report.add("recomputed activations", activation_pool.bytes());
+        }
+
+        if constexpr (partitions > 1) {
+            for (size_t s = 0; s < shard_contexts.contexts.size(); ++s) {
+                cpp::for_each_i(shard_contexts.contexts[s], [&report, s](size_t i, auto& layer_ctx) {
+                    report.add("shard " + std::to_string(s) + ": layer " + std::to_string(i) + ": ", context_memory_report<dbn_t::updater>(*layer_ctx.second));
+                });
+
+                if constexpr (shared_errors) {
+                    report.add("shard " + std::to_string(s) + ": shared errors", shard_contexts.pools[s].bytes());
+                }
+            }
+        }
+
+        return report;
+    }
+
+    // CPP17 Replace SFINAE with if constexpr
+
+    /*!
+     * \brief Compute the softmax of the logits of the last layer, the errors
+     * of the last layer and the metrics of the batch, in a single pass.
+     *
+     * \return a pair containing the sums of the error and of the loss over the batch
+     */
+    template <typename Context, typename Labels>
+    static std::pair<double, double> last_errors_fused(Context& context, bool full_batch, const Labels& labels) {
+        auto& last_ctx = *std::get<layers - 1>(context).second;
+
+        if constexpr (sampled_output) {
+            // The rows of the incomplete batches are cleared by the layer
+            cpp_unused(full_batch);
+
+            return std::get<layers - 1>(context).first.sampled_errors(last_ctx, labels);
+        } else {
+            if (cpp_unlikely(!full_batch)) {
+                etl::slice(last_ctx.errors, etl::dim<0>(labels), etl::dim<0>(last_ctx.errors)) = 0;
+            }
+
+            return softmax_cce(last_ctx.output, last_ctx.errors, labels);
+        }
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Context, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
+    static void last_errors(Context& context, bool full_batch, size_t n, const Labels& labels){
+        auto& last_ctx   = *std::get<layers - 1>(context).second;
+
+        if (cpp_unlikely(!full_batch)) {
+            etl::slice(last_ctx.errors, 0, n)                            = labels - etl::slice(last_ctx.output, 0, n);
+            etl::slice(last_ctx.errors, n, etl::dim<0>(last_ctx.errors)) = 0;
+        } else {
+            last_ctx.errors = labels - last_ctx.output;
+        }
+
+        // Note: No need to multiply by the derivative of
+        // the activation function since the terms are
+        // canceling out in the derivative of the loss
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Context, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
+    static void last_errors(Context& context, bool full_batch, size_t n, const Labels& labels){
+        auto& last_layer = std::get<layers - 1>(context).first;
+        auto& last_ctx   = *std::get<layers - 1>(context).second;
+
+        if (cpp_unlikely(!full_batch)) {
+            etl::slice(last_ctx.errors, 0, n)                            = 2.0 * (labels - etl::slice(last_ctx.output, 0, n));
+            etl::slice(last_ctx.errors, n, etl::dim<0>(last_ctx.errors)) = 0;
+        } else {
+            last_ctx.errors = 2.0 * (labels - last_ctx.output);
+        }
+
+        // Multiply by the derivative of the activation function
+        last_layer.adapt_errors(last_ctx);
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Context, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
+    static void last_errors(Context& context, bool full_batch, size_t n, const Labels& labels){
+        auto& last_layer = std::get<layers - 1>(context).first;
+        auto& last_ctx   = *std::get<layers - 1>(context).second;
+
+        arena_scope scope;
+
+        // Avoid Nan from division by ((1 - out) * out)
+        auto out = arena_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
+
+        if (cpp_unlikely(!full_batch)) {
+            auto out_n = etl::slice(out, 0, n);
+
+            etl::slice(last_ctx.errors, 0, n)                            = (labels - out_n) / ((1.0 - out_n) >> out_n);
+            etl::slice(last_ctx.errors, n, etl::dim<0>(last_ctx.errors)) = 0;
+        } else {
+            last_ctx.errors = (labels - out) / ((1.0 - out) >> out);
         }
 
         // Check for NAN before derivative
         nan_check_etl(last_ctx.errors);
 
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
+        // Multiply by the derivative of the activation function
+        last_layer.adapt_errors(last_ctx);
+
+        // Check for NAN after derivative
+        nan_check_etl(last_ctx.errors);
+    }
+
+    /*!
+     * \brief Compute the loss of each of the first n samples of a batch from
+     * the output of the last layer
+     *
+     * \param output The output of the last layer [B, ...]
+     * \param labels The labels [n, ...]
+     * \param n The number of samples
+     * \param losses The losses of the samples [n]
+     */
+    template <typename Output, typename Labels>
+    static void compute_sample_losses(Output& output, const Labels& labels, size_t n, weight* losses) {
+        if (!n) {
+            return;
+        }
+
+        auto l = etl::force_temporary(labels);
+
+        output.ensure_cpu_up_to_date();
+        l.ensure_cpu_up_to_date();
+
+        const size_t N = etl::size(l) / n;
+
+        const weight* o = output.memory_start();
+        const auto* y   = l.memory_start();
+
+        // Avoid infinite losses from saturated outputs
+        constexpr weight eps = 1e-7;
+
+        for (size_t i = 0; i < n; ++i) {
+            weight loss = 0;
+
+            for (size_t j = i * N; j < (i + 1) * N; ++j) {
+                const weight p = std::min(std::max(o[j], eps), weight(1) - eps);
+
+                if constexpr (dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+                    loss -= y[j] * std::log(p);
+                } else if constexpr (dbn_t::loss == loss_function::BINARY_CROSS_ENTROPY) {
+                    loss -= y[j] * std::log(p) + (1 - y[j]) * std::log(1 - p);
+                } else {
+                    loss += (y[j] - o[j]) * (y[j] - o[j]);
+                }
+            }
+
+            losses[i] = loss;
+        }
+    }
+
+    /*!
+     * \brief Weight the errors of each of the first n samples of a batch
+     *
+     * \param errors The errors of the last layer [B, ...]
+     * \param n The number of samples
+     * \param weights The weights of the samples [n]
+     */
+    template <typename Errors>
+    static void weight_sample_errors(Errors& errors, size_t n, const weight* weights) {
+        errors.ensure_cpu_up_to_date();
+
+        const size_t N = etl::size(errors) / etl::dim<0>(errors);
+
+        weight* e = errors.memory_start();
+
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i * N; j < (i + 1) * N; ++j) {
+                e[j] *= weights[i];
+            }
+        }
+
+        errors.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Train a batch of data
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        if constexpr (dbn_traits<dbn_t>::is_data_parallel()) {
+            return train_batch_parallel(epoch, inputs, labels);
+        } else if constexpr (dbn_traits<dbn_t>::is_pipeline_parallel()) {
+            return train_batch_pipeline(epoch, inputs, labels);
+        } else {
+            return train_batch_serial(epoch, inputs, labels);
+        }
+    }
+
+    /*!
+     * \brief Train a batch of data in the full context
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_serial(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        return train_batch_serial_impl(epoch, etl::dim<0>(inputs), labels, [this, &inputs] {
+            this->template forward_batch_helper<true>(inputs);
+        });
+    }
+
+    /*!
+     * \brief Copy a batch of inputs into the staging buffer of the first
+     * layer, for the next call to swap_staged_inputs().
+     *
+     * Only the staging buffer is written: once it has been created by a
+     * first call, this can run concurrently with train_staged_batch().
+     * When the training is resident on the GPU, the staged inputs are
+     * also uploaded to the device.
+     *
+     * \param inputs A batch of inputs
+     */
+    template <typename Inputs>
+    void stage_inputs(const Inputs& inputs) {
+        if (!input_stage) {
+            input_stage = std::make_unique<input_stage_t>(std::get<0>(full_context).second->input);
+        }
+
+        auto& stage = *input_stage;
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= etl::dim<0>(stage), "Invalid sizes");
+
+        if (cpp_unlikely(n != etl::dim<0>(stage))) {
+            etl::slice(stage, 0, n)                  = inputs;
+            etl::slice(stage, n, etl::dim<0>(stage)) = 0;
+        } else {
+            stage = inputs;
+        }
+
+        // The upload overlaps the training of the current batch
+        if constexpr (gpu_resident) {
+            stage.ensure_gpu_up_to_date();
+        }
+
+        staged_n = n;
+    }
+
+    /*!
+     * \brief Make the staged inputs the inputs of the next batch, the
+     * previous inputs becoming the staging buffer.
+     */
+    void swap_staged_inputs() {
+        auto& first_ctx = *std::get<0>(full_context).second;
+
+        cpp_assert(input_stage, "No inputs have been staged");
+
+        using std::swap;
+        swap(first_ctx.input, *input_stage);
+
+        current_n = staged_n;
+        staged_n  = 0;
+    }
+
+    /*!
+     * \brief Train a batch of data whose inputs have been staged with
+     * stage_inputs() and swap_staged_inputs().
+     * \param epoch The current epoch
+     * \param labels The labels of the staged batch
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Labels>
+    std::pair<double, double> train_staged_batch(size_t epoch, const Labels& labels) {
+        static_assert(partitions == 1, "Staged batches are only supported by the serial trainer");
+
+        const size_t n = current_n;
+
+        return train_batch_serial_impl(epoch, n, labels, [this, n] {
+            auto& first_ctx = *std::get<0>(full_context).second;
+
+            if (cpp_unlikely(n != etl::dim<0>(first_ctx.input))) {
+                first_ctx.output = 0;
+            }
+
+            forward_context_layers<true, 0>(full_context, first_ctx.input);
+        });
+    }
+
+    /*!
+     * \brief Compute the outputs of the frozen prefix for all the samples of
+     * the given generator, in order.
+     *
+     * The outputs are computed once, in inference mode. With
+     * dbn.frozen_cache_file, the cache is then written to a binary dataset
+     * shard and served from the mapped file.
+     *
+     * \param generator The generator of the training samples
+     */
+    template <typename Generator>
+    void build_frozen_cache(Generator& generator) {
+        static_assert(has_frozen_cache, "The frozen cache needs frozen layers and serial training");
+
+        static dll::timer_id timer_handle("sgd::build_frozen_cache");
+        dll::auto_timer timer(timer_handle);
+
+        frozen_cache.clear();
+
+        for (generator.reset(); generator.has_next_batch(); generator.next_batch()) {
+            frozen_cache.append(dbn.template test_forward_batch<frozen - 1>(generator.data_batch()), generator.label_batch());
+        }
+
+        generator.reset();
+
+        if (!dbn.frozen_cache_file.empty() && !frozen_cache.map(dbn.frozen_cache_file)) {
+            std::cerr << "WARNING: The frozen cache is kept in memory" << std::endl;
+        }
+
+        frozen_cache.source = &generator;
+        frozen_cache.ready  = true;
+    }
+
+    /*!
+     * \brief Train a batch of cached samples, only through the layers after
+     * the frozen prefix.
+     *
+     * \param epoch The current epoch
+     * \param samples The indices of the samples of the batch in the cache
+     * \param n The number of samples of the batch
+     * \return a pair containing the error and the loss for the batch
+     */
+    std::pair<double, double> train_frozen_batch(size_t epoch, const size_t* samples, size_t n) {
+        static_assert(has_frozen_cache, "The frozen cache needs frozen layers and serial training");
+
+        cpp_assert(frozen_cache.ready, "The frozen cache must be built first");
+
+        // The inputs of the first trained layer are the outputs of the last frozen one
+        auto& inputs = get_output(*std::get<frozen - 1>(full_context).second);
+
+        const size_t S = frozen_cache.sample_size;
+        const size_t C = frozen_cache.label_size;
+
+        cpp_assert(n <= etl::dim<0>(inputs), "Invalid sizes");
+        cpp_assert(S * etl::dim<0>(inputs) == etl::size(inputs), "The cache does not match the frozen prefix");
+
+        weight* dst = inputs.memory_start();
+
+        for (size_t i = 0; i < n; ++i) {
+            std::copy_n(frozen_cache.sample(samples[i]), S, dst + i * S);
+        }
+
+        std::fill(dst + n * S, dst + etl::size(inputs), weight(0));
+
+        inputs.invalidate_gpu();
+
+        etl::dyn_matrix<weight, 2> labels(n, C);
+
+        for (size_t i = 0; i < n; ++i) {
+            std::copy_n(frozen_cache.label(samples[i]), C, labels.memory_start() + i * C);
+        }
+
+        labels.invalidate_gpu();
+
+        return train_batch_serial_impl(epoch, n, labels, [this, &inputs] {
+            forward_context_layers<true, frozen>(full_context, inputs);
+        });
+    }
+
+    /*!
+     * \brief Train a batch of n samples in the full context
+     * \param epoch The current epoch
+     * \param n The number of samples of the batch
+     * \param labels A batch of labels
+     * \param forward The functor doing the forward pass of the batch
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Labels, typename Forward>
+    std::pair<double, double> train_batch_serial_impl(size_t epoch, size_t n, const Labels& labels, Forward&& forward) {
+        static dll::timer_id timer_handle("sgd::train_batch");
+        dll::auto_timer timer(timer_handle);
+
+        auto& first_ctx   = *std::get<0>(full_context).second;
+        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        // The layers of an incomplete batch only compute its samples
+        set_active_context(full_context, n);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        //Feedforward pass
+
+        {
+            static dll::timer_id timer_handle("sgd::forward");
+            dll::auto_timer timer(timer_handle);
+
+            forward();
+        }
+
+        const auto forwarded = std::chrono::steady_clock::now();
+
+        // The metrics of the fused output stage
+        std::pair<double, double> metrics;
+
+        {
+            static dll::timer_id timer_handle("sgd::backward");
+            dll::auto_timer timer(timer_handle);
+
+            //Compute the errors of the last layer
+
+            if constexpr (fused_softmax_cce) {
+                metrics = last_errors_fused(full_context, full_batch, labels);
+            } else {
+                last_errors<dbn_t::loss>(full_context, full_batch, n, labels);
+            }
+
+            if constexpr (has_soft_targets) {
+                if (soft_targets) {
+                    // The teacher runs concurrently with the forward pass
+                    if (soft_targets_tasks) {
+                        soft_targets_tasks->wait();
+                    }
+
+                    distill_errors(last_ctx.errors, last_ctx.output, soft_targets, n, dbn.distill_temperature, dbn.distill_weight);
+                }
+            }
+
+            if constexpr (has_sample_weights) {
+                if (sample_losses) {
+                    compute_sample_losses(last_ctx.output, labels, n, sample_losses);
+                }
+
+                if (sample_weights) {
+                    weight_sample_errors(last_ctx.errors, n, sample_weights);
+                }
+            }
+
+            if (loss_scaling()) {
+                last_ctx.errors *= dbn.loss_scale;
+            }
+
+            // Backpropagate the error
+
+            if (distributed()) {
+                // The gradients are computed and reduced during backpropagation
+                backward_context_reduce(full_context, *dbn.comm);
+            } else {
+                backward_context(full_context);
+            }
+        }
+
+        const auto backwarded = std::chrono::steady_clock::now();
+
+        // Compute and apply the gradients
+
+        {
+            static dll::timer_id timer_handle("sgd::grad");
+            dll::auto_timer timer(timer_handle);
+
+            dbn.wait_backup();
+
+            if (distributed()) {
+                size_t accumulated_n = global_samples(n);
+
+                if (accumulate_gradients(accumulated_n)) {
+                    update_weights_all(epoch, accumulated_n);
+                }
+            } else if (tied_layers || dbn.accumulation_steps > 1 || loss_scaling()) {
+                // With shared errors or recomputed activations, the gradients are computed during the backpropagation
+                if constexpr (!backward_gradients) {
+                    cpp::for_each(full_context, [](auto& layer_ctx) {
+                        layer_scope scope(layer_ctx.first, profile_phase::UPDATE);
+
+                        this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+                    });
+                }
+
+                tie_gradients(full_context);
+
+                size_t accumulated_n = n;
+
+                if (unscale_gradients() && accumulate_gradients(accumulated_n)) {
+                    update_weights_all(epoch, accumulated_n);
+                }
+            } else {
+                cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                    layer_scope scope(layer_ctx.first, profile_phase::UPDATE);
+
+                    this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+                });
+
+                // Update the counter of iterations
+                ++iteration;
+            }
+        }
+
+        const auto updated = std::chrono::steady_clock::now();
+
+        phases.forward  = batch_phases::seconds(start, forwarded);
+        phases.backward = batch_phases::seconds(forwarded, backwarded);
+        phases.update   = batch_phases::seconds(backwarded, updated);
+        phases.compute  = batch_phases::seconds(start, updated);
+
+        monitor_health(full_context, full_context);
+
+        // Compute error and loss
+
+        if constexpr (fused_softmax_cce) {
+            cpp_unused(last_ctx);
+
+            return std::make_pair(metrics.first / n, metrics.second / n);
+        } else {
+            static dll::timer_id timer_handle("sgd::error");
+            dll::auto_timer timer(timer_handle);
+
+            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+
+            return std::make_pair(error, loss);
+        }
+    }
+
+    /*!
+     * \brief Train a batch of data, split into shards processed concurrently.
+     *
+     * Each shard is forwarded and backpropagated in its own context on the
+     * thread pool of the network. The gradients of the shards are then
+     * summed into the full context and applied once.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_parallel(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        static dll::timer_id timer_handle("sgd::train_batch");
+        dll::auto_timer timer(timer_handle);
+
+        constexpr size_t shard_size = decltype(shard_contexts)::shard_size;
+
+        const size_t n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the contexts can hold the inputs
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        // The number of shards holding at least one sample
+        const size_t active = (n + shard_size - 1) / shard_size;
+
+        // The metrics of each shard
+        std::vector<std::pair<double, double>> metrics(active);
+
+        // Each shard updates the shared weights itself, without locks
+        const bool async = hogwild();
+
+        // The shards update the weights during the passes
+        if (async) {
+            dbn.wait_backup();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        // Forward and backward passes of each shard
+
+        {
+            static dll::timer_id timer_handle("sgd::shards");
+            dll::auto_timer timer(timer_handle);
+
+            auto& pool = dbn.get_pool();
+
+            for (size_t s = 0; s < active; ++s) {
+                pool.do_task([this, s, n, epoch, async, &inputs, &labels, &metrics] {
+                    trace_scope scope("pool:task", "pool");
+
+                    const size_t first = s * shard_size;
+                    const size_t last  = std::min(first + shard_size, n);
+
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        metrics[s] = this->train_shard(shard_contexts.contexts[s], etl::slice(inputs, first, last), etl::slice(labels, first, last));
+
+                        if (async) {
+                            this->update_weights_shard(epoch, shard_contexts.contexts[s], last - first);
+                        }
+                    }
+                });
+            }
+
+            pool.wait();
+        }
+
+        const auto backwarded = std::chrono::steady_clock::now();
+
+        // Reduce and apply the gradients
+
+        if (async) {
+            ++iteration;
+        } else {
+            static dll::timer_id timer_handle("sgd::grad");
+            dll::auto_timer timer(timer_handle);
+
+            dbn.wait_backup();
+
+            for (size_t s = 0; s < active; ++s) {
+                cpp::for_each(full_context, shard_contexts.contexts[s], [s](auto& layer_ctx, auto& shard_layer_ctx) {
+                    this_type::reduce_gradients_layer(layer_ctx.first, *layer_ctx.second, *shard_layer_ctx.second, s == 0);
+                });
+            }
+
+            update_weights_reduced(epoch, n);
+        }
+
+        const auto updated = std::chrono::steady_clock::now();
+
+        // The passes of the shards overlap, only their total is known
+        phases.forward  = 0.0;
+        phases.backward = 0.0;
+        phases.update   = batch_phases::seconds(backwarded, updated);
+        phases.compute  = batch_phases::seconds(start, updated);
+
+        if (!async) {
+            monitor_health(shard_contexts.contexts[0], full_context);
+        }
+
+        // Compute error and loss
+
+        {
+            static dll::timer_id timer_handle("sgd::error");
+            dll::auto_timer timer(timer_handle);
+
+            double error = 0.0;
+            double loss  = 0.0;
+
+            for (size_t s = 0; s < active; ++s) {
+                error += metrics[s].first;
+                loss += metrics[s].second;
+            }
+
+            return std::make_pair(error / n, loss / n);
+        }
+    }
+
+    /*!
+     * \brief Forward and backpropagate a shard of a batch and compute its
+     * gradients in the given shard context.
+     * \param context The full context of the shard
+     * \param inputs The inputs of the shard
+     * \param labels The labels of the shard
+     * \return a pair containing the sums of the error and of the loss over the shard
+     */
+    template <typename Context, typename Inputs, typename Labels>
+    std::pair<double, double> train_shard(Context& context, const Inputs& inputs, const Labels& labels) {
+        auto& first_ctx = *std::get<0>(context).second;
+        auto& last_ctx  = *std::get<layers - 1>(context).second;
+
+        const auto n          = etl::dim<0>(inputs);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        forward_context<true>(context, inputs);
+
+        std::pair<double, double> metrics;
+
+        if constexpr (fused_softmax_cce) {
+            metrics = last_errors_fused(context, full_batch, labels);
+        } else {
+            last_errors<dbn_t::loss>(context, full_batch, n, labels);
+        }
+
+        if (loss_scaling()) {
+            last_ctx.errors *= dbn.loss_scale;
+        }
+
+        backward_context(context);
+
+        if constexpr (!backward_gradients) {
+            cpp::for_each(context, [](auto& layer_ctx) {
+                this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+            });
+        }
+
+        tie_gradients(context);
+
+        if constexpr (!fused_softmax_cce) {
+            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, false);
+
+            metrics = std::make_pair(error, loss);
+        } else {
+            cpp_unused(last_ctx);
+        }
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Train a batch of data with pipeline parallelism.
+     *
+     * The batch is split into micro-batches, each trained in its own
+     * context. The stages of layers run the forward and backward passes of
+     * the micro-batches with a 1F1B schedule. Once a stage has
+     * backpropagated its last micro-batch, it reduces the gradients of its
+     * layers into the full context, the weights are then updated as in
+     * serial training.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_pipeline(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        static dll::timer_id timer_handle("sgd::train_batch");
+        dll::auto_timer timer(timer_handle);
+
+        constexpr size_t micro_size = decltype(shard_contexts)::shard_size;
+
+        const size_t n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the contexts can hold the inputs
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        // The number of micro-batches holding at least one sample
+        const size_t active = (n + micro_size - 1) / micro_size;
+
+        // The metrics of each micro-batch
+        std::vector<std::pair<double, double>> metrics(active);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        // Forward and backward passes of the stages
+
+        {
+            static dll::timer_id timer_handle("sgd::stages");
+            dll::auto_timer timer(timer_handle);
+
+            auto forward = [this, n, &inputs, &labels, &metrics](size_t s, size_t m) {
+                trace_scope scope("pool:task", "pool");
+
+                const size_t first = m * micro_size;
+                const size_t last  = std::min(first + micro_size, n);
+
+                auto& context = shard_contexts.contexts[m];
+
+                // ETL must not parallelize inside the workers
+                SERIAL_SECTION {
+                    this_type::for_stage(s, [&](auto a, auto e) {
+                        constexpr size_t A = decltype(a)::value;
+                        constexpr size_t E = decltype(e)::value;
+
+                        if constexpr (A == 0) {
+                            this_type::set_context_inputs(*std::get<0>(context).second, etl::slice(inputs, first, last));
+                        }
+
+                        this_type::forward_stage<A, E>(context);
+
+                        // The last non-empty stage computes the errors
+                        if constexpr (A < E && E == layers) {
+                            metrics[m] = this->last_errors_micro(context, etl::slice(labels, first, last));
+                        }
+                    });
+                }
+            };
+
+            auto backward = [this, active](size_t s, size_t m) {
+                trace_scope scope("pool:task", "pool");
+
+                SERIAL_SECTION {
+                    this_type::for_stage(s, [&](auto a, auto e) {
+                        constexpr size_t A = decltype(a)::value;
+                        constexpr size_t E = decltype(e)::value;
+
+                        this_type::backward_stage<A, E>(shard_contexts.contexts[m]);
+
+                        // The last micro-batch of the stage
+                        if (m + 1 == active) {
+                            this->reduce_gradients_stage<A, E>(active);
+                        }
+                    });
+                }
+            };
+
+            run_pipeline_1f1b(dbn.get_pool(), stages, active, forward, backward);
+        }
+
+        const auto backwarded = std::chrono::steady_clock::now();
+
+        // Apply the gradients
+
+        {
+            static dll::timer_id timer_handle("sgd::grad");
+            dll::auto_timer timer(timer_handle);
+
+            dbn.wait_backup();
+
+            update_weights_reduced(epoch, n);
+        }
+
+        const auto updated = std::chrono::steady_clock::now();
+
+        // The passes of the stages overlap, only their total is known
+        phases.forward  = 0.0;
+        phases.backward = 0.0;
+        phases.update   = batch_phases::seconds(backwarded, updated);
+        phases.compute  = batch_phases::seconds(start, updated);
+
+        monitor_health(shard_contexts.contexts[0], full_context);
+
+        // Compute error and loss
+
+        {
+            static dll::timer_id timer_handle("sgd::error");
+            dll::auto_timer timer(timer_handle);
+
+            double error = 0.0;
+            double loss  = 0.0;
+
+            for (size_t m = 0; m < active; ++m) {
+                error += metrics[m].first;
+                loss += metrics[m].second;
+            }
+
+            return std::make_pair(error / n, loss / n);
+        }
+    }
+
+    /*!
+     * \brief Indicates if a stage of the pipeline can start at the I-th layer.
+     *
+     * A layer is never separated from the activation layer fused into it,
+     * nor an upsampling layer from the convolution of its sub-pixel
+     * convolution.
+     */
+    template <size_t I>
+    static constexpr bool stage_split_before() {
+        if constexpr (I == 0 || I >= layers) {
+            return true;
+        } else {
+            using l1_t = typename dbn_t::template layer_type<I - 1>;
+            using l2_t = typename dbn_t::template layer_type<I>;
+
+            return !is_fusable_activation<l1_t, l2_t> && !is_subpixel_pair<l1_t, l2_t>;
+        }
+    }
+
+    template <size_t... I>
+    static constexpr std::array<bool, sizeof...(I)> stage_splits(std::index_sequence<I...> /*seq*/) {
+        return {{stage_split_before<I>()...}};
+    }
+
+    /*!
+     * \brief Returns the first layer of the given stage of the pipeline.
+     *
+     * The layers are split evenly between the stages, each boundary moving
+     * to the next layer where a stage can start.
+     */
+    static constexpr size_t stage_begin(size_t s) {
+        if (s == 0) {
+            return 0;
+        } else if (s >= stages) {
+            return layers;
+        }
+
+        constexpr auto splits = stage_splits(std::make_index_sequence<layers + 1>());
+
+        size_t b = std::max(s * layers / stages, stage_begin(s - 1) + 1);
+
+        while (b < layers && !splits[b]) {
+            ++b;
+        }
+
+        return std::min(b, layers);
+    }
+
+    /*!
+     * \brief Call the functor with the (compile-time) bounds of the layers
+     * of the given stage
+     */
+    template <size_t S = 0, typename Functor>
+    static void for_stage(size_t s, Functor&& functor) {
+        if constexpr (S < stages) {
+            if (s == S) {
+                functor(std::integral_constant<size_t, stage_begin(S)>{}, std::integral_constant<size_t, stage_begin(S + 1)>{});
+            } else {
+                for_stage<S + 1>(s, functor);
+            }
+        }
+    }
+
+    /*!
+     * \brief Call the functor with the (compile-time) index of each layer
+     * in [A, E), in increasing order, or in decreasing order if Reverse
+     */
+    template <size_t A, size_t E, bool Reverse = false, typename Functor>
+    static void for_each_stage_layer(Functor&& functor) {
+        for_each_stage_layer_impl<A, E, Reverse>(functor, std::make_index_sequence<E - A>());
+    }
+
+    template <size_t A, size_t E, bool Reverse, typename Functor, size_t... I>
+    static void for_each_stage_layer_impl(Functor& functor, std::index_sequence<I...> /*seq*/) {
+        (functor(std::integral_constant<size_t, Reverse ? E - 1 - I : A + I>{}), ...);
+    }
+
+    /*!
+     * \brief Forward the layers [A, E) of a micro-batch context.
+     *
+     * The inputs of the first stage are already in the context of the first
+     * layer, the other stages read the outputs of the previous stage.
+     */
+    template <size_t A, size_t E, typename Context>
+    static void forward_stage(Context& context) {
+        if constexpr (A == 0) {
+            forward_context_layers<true, 0, E>(context, std::get<0>(context).second->input);
+        } else if constexpr (A < E) {
+            forward_context_layers<true, A, E>(context, get_output(*std::get<A - 1>(context).second));
+        }
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer of a micro-batch context
+     * \param context The full context of the micro-batch
+     * \param labels The labels of the micro-batch
+     * \return a pair containing the sums of the error and of the loss over the micro-batch
+     */
+    template <typename Context, typename Labels>
+    std::pair<double, double> last_errors_micro(Context& context, const Labels& labels) {
+        auto& first_ctx = *std::get<0>(context).second;
+        auto& last_ctx  = *std::get<layers - 1>(context).second;
+
+        const auto n          = etl::dim<0>(labels);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        std::pair<double, double> metrics;
+
+        if constexpr (fused_softmax_cce) {
+            metrics = last_errors_fused(context, full_batch, labels);
+        } else {
+            last_errors<dbn_t::loss>(context, full_batch, n, labels);
+
+            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, false);
+
+            metrics = std::make_pair(error, loss);
+        }
+
+        if (loss_scaling()) {
+            last_ctx.errors *= dbn.loss_scale;
+        }
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layers [A, E) of a
+     * micro-batch context and compute their gradients.
+     *
+     * The errors of the layer before the stage are computed, they are the
+     * errors of the next stage to backpropagate.
+     */
+    template <size_t A, size_t E, typename Context>
+    static void backward_stage(Context& context) {
+        bool last = E == layers;
+
+        for_each_stage_layer<A, E, true>([&context, &last](auto i) {
+            constexpr size_t I = decltype(i)::value;
+
+            if constexpr (I > 0) {
+                auto& layer_ctx = std::get<I>(context);
+
+                layer_scope scope(layer_ctx.first, profile_phase::BACKWARD);
+
+                backward_layer(layer_ctx.first, *layer_ctx.second, get_errors(*std::get<I - 1>(context).second), last);
+
+                if constexpr (backward_gradients) {
+                    this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+                }
+            }
+        });
+
+        if constexpr (A == 0) {
+            auto& first_layer = std::get<0>(context).first;
+            auto& first_ctx   = *std::get<0>(context).second;
+
+            layer_scope scope(first_layer, profile_phase::BACKWARD);
+
+            first_layer.adapt_errors(first_ctx);
+
+            if constexpr (backward_gradients) {
+                compute_gradients_layer(first_layer, first_ctx);
+            }
+        }
+
+        if constexpr (!backward_gradients) {
+            for_each_stage_layer<A, E>([&context](auto i) {
+                auto& layer_ctx = std::get<decltype(i)::value>(context);
+
+                this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+            });
+        }
+    }
+
+    /*!
+     * \brief Reduce the gradients of the layers [A, E) of the micro-batch
+     * contexts into the full context
+     * \param active The number of trained micro-batches
+     */
+    template <size_t A, size_t E>
+    void reduce_gradients_stage(size_t active) {
+        for (size_t m = 0; m < active; ++m) {
+            for_each_stage_layer<A, E>([this, m](auto i) {
+                constexpr size_t I = decltype(i)::value;
+
+                auto& layer_ctx = std::get<I>(full_context);
+
+                this_type::reduce_gradients_layer(layer_ctx.first, *layer_ctx.second, *std::get<I>(shard_contexts.contexts[m]).second, m == 0);
+            });
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the given context
+     * \param context The full context of the network
+     */
+    template <typename Context>
+    static void backward_context(Context& context) {
+        auto& first_layer = std::get<0>(context).first;
+        auto& first_ctx   = *std::get<0>(context).second;
+
+        bool last = true;
+
+        cpp::for_each_rpair(context, [&context, &last](auto& layer_ctx_1, auto& layer_ctx_2) {
+            using ctx_1_t = std::decay_t<decltype(*layer_ctx_1.second)>;
+            using ctx_2_t = std::decay_t<decltype(*layer_ctx_2.second)>;
+
+            recompute_segment<ctx_2_t::index>(context);
+
+            if constexpr (!ctx_2_t::frozen) {
+                layer_scope scope(layer_ctx_2.first, profile_phase::BACKWARD);
+
+                if constexpr (ctx_1_t::frozen) {
+                    // The errors are not backpropagated into the frozen layers
+                    adapt_layer(layer_ctx_2.first, *layer_ctx_2.second, last);
+                } else {
+                    backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+                }
+
+                // The errors and the activations of the layer are overwritten by the next backpropagations
+                if constexpr (backward_gradients) {
+                    this_type::compute_gradients_layer(layer_ctx_2.first, *layer_ctx_2.second);
+                }
+            }
+        });
+
+        if constexpr (!frozen) {
+            layer_scope scope(first_layer, profile_phase::BACKWARD);
+
+            first_layer.adapt_errors(first_ctx);
+
+            if constexpr (backward_gradients) {
+                compute_gradients_layer(first_layer, first_ctx);
+            }
+        } else {
+            cpp_unused(first_layer);
+            cpp_unused(first_ctx);
+        }
+    }
+
+    /*!
+     * \brief Forward again the segment ended by the C-th layer, from the
+     * output of the previous checkpoint, if its activations were
+     * overwritten by the upper segments.
+     *
+     * The C-th layer itself is not forwarded, its activations are kept.
+     */
+    template <size_t C, typename Context>
+    static void recompute_segment([[maybe_unused]] Context& context) {
+        if constexpr (sgd_recomputes_segment<dbn_t, C>()) {
+            static dll::timer_id timer_handle("sgd::recompute");
+            dll::auto_timer timer(timer_handle);
+
+            constexpr size_t P = sgd_previous_checkpoint<dbn_t, C>();
+
+            auto& checkpoint_ctx = *std::get<P>(context).second;
+
+            using first_layer_t = std::decay_t<decltype(std::get<0>(context).first)>;
+            using first_input_t = std::decay_t<decltype(checkpoint_ctx.input)>;
+
+            // The first layer may have been applied in place on its inputs
+            if constexpr (P == 0 && is_in_place<true, first_layer_t, first_input_t>) {
+                forward_context_layers<true, P + 1, C>(context, checkpoint_ctx.input);
+            } else {
+                forward_context_layers<true, P + 1, C>(context, get_output(checkpoint_ctx));
+            }
+        }
+    }
+
+    /*!
+     * \brief Adapt the errors of the first trained layer, which does not
+     * backpropagate them into the frozen layers
+     */
+    template <typename Layer, typename Context>
+    static void adapt_layer(Layer& layer, Context& context, bool& last){
+        if (!last) {
+            layer.adapt_errors(context);
+        }
+
+        last = false;
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the given
+     * context, computing the gradients of each layer and reducing them over
+     * all the processes.
+     *
+     * The reduction of the gradients of a layer is started as soon as its
+     * errors are known, while the lower layers are still backpropagated.
+     *
+     * \param context The full context of the network
+     * \param comm The communicator between the processes
+     */
+    template <typename Context>
+    static void backward_context_reduce(Context& context, communicator& comm) {
+        auto& first_layer = std::get<0>(context).first;
+        auto& first_ctx   = *std::get<0>(context).second;
+
+        // The gradients of the tied layers are only complete at the end
+        if constexpr (tied_layers) {
+            backward_context(context);
+
+            if constexpr (!backward_gradients) {
+                cpp::for_each(context, [](auto& layer_ctx) {
+                    this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+                });
+            }
+
+            tie_gradients(context);
 
-        // Check for NAN after derivative
-        nan_check_etl(last_ctx.errors);
+            cpp::for_each(context, [&comm](auto& layer_ctx) {
+                this_type::start_reduce_gradients_layer(layer_ctx.first, *layer_ctx.second, comm);
+            });
+
+            comm.wait();
+
+            return;
+        }
+
+        bool last = true;
+
+        cpp::for_each_rpair(context, [&context, &last, &comm](auto& layer_ctx_1, auto& layer_ctx_2) {
+            using ctx_1_t = std::decay_t<decltype(*layer_ctx_1.second)>;
+            using ctx_2_t = std::decay_t<decltype(*layer_ctx_2.second)>;
+
+            recompute_segment<ctx_2_t::index>(context);
+
+            if constexpr (!ctx_2_t::frozen) {
+                if constexpr (ctx_1_t::frozen) {
+                    adapt_layer(layer_ctx_2.first, *layer_ctx_2.second, last);
+                } else {
+                    backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+                }
+
+                this_type::compute_gradients_layer(layer_ctx_2.first, *layer_ctx_2.second);
+                this_type::start_reduce_gradients_layer(layer_ctx_2.first, *layer_ctx_2.second, comm);
+            }
+        });
+
+        if constexpr (!frozen) {
+            first_layer.adapt_errors(first_ctx);
+
+            compute_gradients_layer(first_layer, first_ctx);
+            start_reduce_gradients_layer(first_layer, first_ctx, comm);
+        } else {
+            cpp_unused(first_layer);
+            cpp_unused(first_ctx);
+        }
+
+        comm.wait();
     }
 
     /*!
-     * \brief Train a batch of data
-     * \param epoch The current epoch
-     * \param inputs A batch of inputs
-     * \param labels A batch of labels
-     * \return a pair containing the error and the loss for the batch
+     * \brief Return the number of samples of the current batch over all the processes
+     * \param n The local number of samples
      */
-    template <typename Inputs, typename Labels>
-    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
-        dll::auto_timer timer("sgd::train_batch");
+    size_t global_samples(size_t n) const {
+        double samples = n;
 
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        dbn.comm->all_reduce(&samples, 1);
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+        return size_t(samples);
+    }
 
-        // Ensure that the data batch and the label batch are of the same size
-        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+    /*!
+     * \brief Upload the weights of the given layer to the GPU
+     */
+    template <typename Layer>
+    static void upload_weights_layer([[maybe_unused]] Layer& layer){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, [](auto& sub_layer) {
+                this_type::upload_weights_layer(sub_layer);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            auto parameters = layer.trainable_parameters();
 
-        // Ensure that the context can hold the inputs
-        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+            cpp::for_each(parameters, [](auto& parameter) {
+                parameter.get().ensure_gpu_up_to_date();
+            });
+        }
+    }
 
-        //Feedforward pass
+    template <typename Layer>
+    static void broadcast_weights_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] communicator& comm){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, [&comm](auto& sub_layer) {
+                this_type::broadcast_weights_layer(sub_layer, comm);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            auto parameters = layer.trainable_parameters();
+
+            cpp::for_each(parameters, [&comm](auto& parameter) {
+                auto& w = parameter.get();
+
+#ifdef ETL_GPU
+                if (comm.device()) {
+                    w.ensure_gpu_up_to_date();
+                    comm.broadcast(w.gpu_memory(), etl::size(w), 0);
+                    w.invalidate_cpu();
+                    return;
+                }
+#endif
+
+                w.ensure_cpu_up_to_date();
+                comm.broadcast(w.memory_start(), etl::size(w), 0);
+                w.invalidate_gpu();
+            });
+        }
+    }
 
-        {
-            dll::auto_timer timer("sgd::forward");
+    template <typename Layer, typename Context>
+    static void start_reduce_gradients_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context, [[maybe_unused]] communicator& comm){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [&comm](auto& sub_layer, auto& sub_context) {
+                this_type::start_reduce_gradients_layer(sub_layer, sub_context, comm);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-            forward_batch_helper<true>(inputs);
+            start_reduce_gradients_variables(context, comm, std::make_index_sequence<N>());
         }
+    }
 
-        {
-            dll::auto_timer timer("sgd::backward");
-
-            //Compute the errors of the last layer
+    template <typename Context, size_t... I>
+    static void start_reduce_gradients_variables(Context& context, communicator& comm, std::index_sequence<I...> /*seq*/){
+        (start_reduce_gradients_variable(std::get<I>(context.up.context)->grad, comm), ...);
+    }
 
-            last_errors<dbn_t::loss>(full_batch, n, labels);
+    template <typename G>
+    static void start_reduce_gradients_variable(G& grad, communicator& comm){
+#ifdef ETL_GPU
+        // The gradients are reduced device to device
+        if (comm.device()) {
+            grad.ensure_gpu_up_to_date();
+            grad.invalidate_cpu();
+
+            comm.start_all_reduce(grad.gpu_memory(), etl::size(grad));
+            return;
+        }
+#endif
 
-            // Backpropagate the error
+        grad.ensure_cpu_up_to_date();
+        grad.invalidate_gpu();
 
-            bool last = true;
+        comm.start_all_reduce(grad.memory_start(), etl::size(grad));
+    }
 
-            cpp::for_each_rpair(full_context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
-                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+    template <typename Layer, typename Context>
+    static void compute_gradients_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [](auto& sub_layer, auto& sub_context) {
+                this_type::compute_gradients_layer(sub_layer, sub_context);
             });
+        } else {
+            layer.compute_gradients(context);
+        }
+    }
 
-            first_layer.adapt_errors(first_ctx);
+    /*!
+     * \brief Report the health of the layers to the active health monitor,
+     * if a check is due.
+     *
+     * \param activations The context holding the activations of the batch
+     * \param gradients The context holding the gradients of the batch
+     */
+    template <typename ActivationContext, typename GradientContext>
+    static void monitor_health(ActivationContext& activations, GradientContext& gradients) {
+        auto* monitor = detail::active_health_monitor().load(std::memory_order_relaxed);
+
+        if (cpp_likely(!monitor) || !monitor->due()) {
+            return;
         }
 
-        // Compute and apply the gradients
+        static dll::timer_id timer_handle("sgd::health");
+        dll::auto_timer timer(timer_handle);
 
-        {
-            dll::auto_timer timer("sgd::grad");
+        const size_t stride = monitor->stride;
+
+        cpp::for_each_i(activations, gradients, [monitor, stride](size_t i, auto& act_ctx, auto& grad_ctx) {
+            sampled_stats grads;
+            this_type::gradient_stats(grad_ctx.first, *grad_ctx.second, grads, stride);
+
+            // The recomputed activations are not those of the last batch anymore
+            if constexpr (sgd_recomputes_v<std::decay_t<decltype(*act_ctx.second)>>) {
+                monitor->report(i, sampled_stats{}, grads);
+            } else {
+                monitor->report(i, sample_stats(this_type::get_output(*act_ctx.second), stride), grads);
+            }
+        });
+    }
 
-            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
-                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+    template <typename Layer, typename Context>
+    static void gradient_stats([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context, [[maybe_unused]] sampled_stats& stats, [[maybe_unused]] size_t stride){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [&stats, stride](auto& sub_layer, auto& sub_context) {
+                this_type::gradient_stats(sub_layer, sub_context, stats, stride);
             });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            gradient_stats_variables(context, stats, stride, std::make_index_sequence<N>());
         }
+    }
+
+    template <typename Context, size_t... I>
+    static void gradient_stats_variables(Context& context, sampled_stats& stats, size_t stride, std::index_sequence<I...> /*seq*/){
+        ((stats += sample_stats(std::get<I>(context.up.context)->grad, stride)), ...);
+    }
+
+    /*!
+     * \brief Apply the gradients of the full context to all the layers
+     * \param epoch The current epoch
+     * \param n The number of samples the gradients were computed from
+     */
+    void update_weights_all(size_t epoch, size_t n){
+        cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+            this->update_weights_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+        });
 
         // Update the counter of iterations
         ++iteration;
+    }
 
-        // Compute error and loss
+    /*!
+     * \brief Apply the gradients reduced in the full context to all the
+     * layers, once they are reduced over the processes, unscaled and
+     * accumulated.
+     * \param epoch The current epoch
+     * \param n The number of local samples the gradients were computed from
+     */
+    void update_weights_reduced(size_t epoch, size_t n){
+        size_t accumulated_n = n;
 
-        {
-            dll::auto_timer timer("sgd::error");
+        if (distributed()) {
+            cpp::for_each(full_context, [this](auto& layer_ctx) {
+                this_type::start_reduce_gradients_layer(layer_ctx.first, *layer_ctx.second, *dbn.comm);
+            });
 
-            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+            dbn.comm->wait();
 
-            return std::make_pair(error, loss);
+            accumulated_n = global_samples(n);
+        }
+
+        if (unscale_gradients() && accumulate_gradients(accumulated_n)) {
+            update_weights_all(epoch, accumulated_n);
+        }
+    }
+
+    /*!
+     * \brief Apply the gradients of a shard context to the shared weights,
+     * with the updater states of the shard (Hogwild training).
+     *
+     * The shards update the weights concurrently, without locks: the
+     * races on the weights are accepted.
+     *
+     * \param epoch The current epoch
+     * \param context The full context of the shard
+     * \param n The number of samples of the shard
+     */
+    template <typename Context>
+    void update_weights_shard(size_t epoch, Context& context, size_t n){
+        cpp::for_each(context, [this, epoch, n](auto& layer_ctx) {
+            this->update_weights_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+        });
+    }
+
+    /*!
+     * \brief Add the gradients of the weights of the tied layers to the
+     * gradients of the layers they are tied to
+     * \param context The full context of the network
+     */
+    template <size_t I = 0, typename Context>
+    static void tie_gradients([[maybe_unused]] Context& context) {
+        if constexpr (I < layers) {
+            using layer_t = typename dbn_t::template layer_type<I>;
+
+            if constexpr (is_tied_layer<layer_t> && I >= frozen) {
+                static_assert(layer_t::tied_layer >= frozen, "A trained layer cannot be tied to a frozen layer");
+
+                auto& layer_ctx = std::get<I>(context);
+
+                layer_ctx.first.tie_gradients(*layer_ctx.second, *std::get<layer_t::tied_layer>(context).second);
+            }
+
+            tie_gradients<I + 1>(context);
+        }
+    }
+
+    /*!
+     * \brief Unscale the gradients of the full context by the loss scale.
+     *
+     * When the gradients are not finite, the loss scale is halved and the
+     * step must be skipped. The loss scale is doubled after
+     * dbn.loss_scale_window finite steps.
+     *
+     * \return true if the gradients must be used, false otherwise
+     */
+    bool unscale_gradients(){
+        if (!loss_scaling()) {
+            return true;
+        }
+
+        const weight inverse = weight(1.0) / dbn.loss_scale;
+
+        bool finite = true;
+
+        cpp::for_each(full_context, [inverse, &finite](auto& layer_ctx) {
+            this_type::unscale_gradients_layer(layer_ctx.first, *layer_ctx.second, inverse, finite);
+        });
+
+        if (!finite) {
+            // The step is skipped, with a smaller scale for the next ones
+            dbn.loss_scale *= 0.5;
+            good_steps = 0;
+
+            return false;
+        }
+
+        if (++good_steps >= dbn.loss_scale_window) {
+            dbn.loss_scale *= 2.0;
+            good_steps = 0;
         }
+
+        return true;
     }
 
+    /*!
+     * \brief Unscale the gradients of the given layer and check that they
+     * are finite.
+     */
     template <typename Layer, typename Context>
-    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context){
-        if constexpr (is_utility_layer<Layer>) {
+    static void unscale_gradients_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context, [[maybe_unused]] weight inverse, [[maybe_unused]] bool& finite){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [inverse, &finite](auto& sub_layer, auto& sub_context) {
+                this_type::unscale_gradients_layer(sub_layer, sub_context, inverse, finite);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            unscale_gradients_variables(context, inverse, finite, std::make_index_sequence<N>());
+        }
+    }
+
+    /*!
+     * \brief Unscale the gradients of all the variables of the given context
+     */
+    template <typename Context, size_t... I>
+    static void unscale_gradients_variables(Context& context, weight inverse, bool& finite, std::index_sequence<I...> /*seq*/){
+        (unscale_gradient(std::get<I>(context.up.context)->grad, inverse, finite), ...);
+    }
+
+    /*!
+     * \brief Unscale the given gradients and check that they are finite
+     */
+    template <typename G>
+    static void unscale_gradient(G& grad, weight inverse, bool& finite){
+        grad *= inverse;
+        finite = finite && grad.is_finite();
+    }
+
+    /*!
+     * \brief Accumulate the gradients of the current mini-batch.
+     *
+     * With dbn.accumulation_steps > 1, the gradients of the full context
+     * are summed over several mini-batches and only applied once all of
+     * them have been accumulated.
+     *
+     * \param n The number of samples of the current mini-batch. If the
+     * gradients must be applied, this is set to the number of accumulated
+     * samples.
+     * \return true if the gradients must be applied, false otherwise
+     */
+    bool accumulate_gradients(size_t& n){
+        const size_t steps = dbn.accumulation_steps;
+
+        if (steps <= 1) {
+            return true;
+        }
+
+        const bool first = micro_batches == 0;
+        const bool last  = micro_batches + 1 >= steps;
+
+        cpp::for_each(full_context, [first, last](auto& layer_ctx) {
+            this_type::accumulate_gradients_layer(layer_ctx.first, *layer_ctx.second, first, last);
+        });
+
+        accumulated_samples += n;
+
+        if (last) {
+            n = accumulated_samples;
+
+            accumulated_samples = 0;
+            micro_batches       = 0;
+
+            return true;
+        }
+
+        ++micro_batches;
+
+        return false;
+    }
+
+    /*!
+     * \brief Apply the gradients of an incomplete group of accumulated
+     * mini-batches, at the end of an epoch, so that they are neither
+     * carried into the next epoch nor lost at the end of the training.
+     *
+     * The gradients are applied as a normal group, normalized by the
+     * number of samples accumulated so far.
+     *
+     * \param epoch The current epoch
+     */
+    void flush_gradients(size_t epoch){
+        if (!micro_batches) {
+            return;
+        }
+
+        cpp::for_each(full_context, [](auto& layer_ctx) {
+            this_type::flush_gradients_layer(layer_ctx.first, *layer_ctx.second);
+        });
+
+        const size_t n = accumulated_samples;
+
+        accumulated_samples = 0;
+        micro_batches       = 0;
+
+        dbn.wait_backup();
+
+        update_weights_all(epoch, n);
+    }
+
+    template <typename Layer, typename Context>
+    static void flush_gradients_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [](auto& sub_layer, auto& sub_context) {
+                this_type::flush_gradients_layer(sub_layer, sub_context);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            flush_gradients_variables(context, std::make_index_sequence<N>());
+        }
+    }
+
+    template <typename Context, size_t... I>
+    static void flush_gradients_variables(Context& context, std::index_sequence<I...> /*seq*/){
+        ((std::get<I>(context.up.context)->grad = std::get<I>(context.up.accumulated)->grad), ...);
+    }
+
+    template <typename Layer, typename Context>
+    static void accumulate_gradients_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context, [[maybe_unused]] bool first, [[maybe_unused]] bool last){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [first, last](auto& sub_layer, auto& sub_context) {
+                this_type::accumulate_gradients_layer(sub_layer, sub_context, first, last);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            // The accumulators are only allocated when accumulation is used
+            if (!std::get<0>(context.up.accumulated)) {
+                context.up.accumulated = build_sub_context<updater_sub_context, updater_type::SGD>(layer);
+            }
+
+            accumulate_gradients_variables(context, first, last, std::make_index_sequence<N>());
+        }
+    }
+
+    template <typename Context, size_t... I>
+    static void accumulate_gradients_variables(Context& context, bool first, bool last, std::index_sequence<I...> /*seq*/){
+        (accumulate_gradients_variable(std::get<I>(context.up.context)->grad, std::get<I>(context.up.accumulated)->grad, first, last), ...);
+    }
+
+    template <typename G, typename A>
+    static void accumulate_gradients_variable(G& grad, A& accumulated, bool first, bool last){
+        if (last) {
+            // The last mini-batch gets the gradients of all the previous ones
+            if (!first) {
+                grad += accumulated;
+            }
+        } else if (first) {
+            accumulated = grad;
+        } else {
+            accumulated += grad;
+        }
+    }
+
+    template <typename Layer, typename Context>
+    void update_weights_layer([[maybe_unused]] size_t epoch, [[maybe_unused]] size_t n, [[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
+                this->update_weights_layer(epoch, n, sub_layer, sub_context);
+            });
+        } else {
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        }
+    }
+
+    /*!
+     * \brief Reduce the gradients of a shard context into the given context
+     * \param layer The layer
+     * \param context The context receiving the gradients
+     * \param shard_context The context of the shard
+     * \param first Indicates if this is the first reduced shard
+     */
+    template <typename Layer, typename Context, typename ShardContext>
+    static void reduce_gradients_layer([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context, [[maybe_unused]] ShardContext& shard_context, [[maybe_unused]] bool first){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
+            reduce_gradients_sub(layer, context, shard_context, first, std::make_index_sequence<Context::n_layers>());
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            reduce_gradients_variables(context, shard_context, first, std::make_index_sequence<N>());
+        }
+    }
+
+    template <typename Layer, typename Context, typename ShardContext, size_t... I>
+    static void reduce_gradients_sub(Layer& layer, Context& context, ShardContext& shard_context, bool first, std::index_sequence<I...> /*seq*/){
+        (reduce_gradients_layer(std::get<I>(layer.layers), std::get<I>(context.sub_contexts), std::get<I>(shard_context.sub_contexts), first), ...);
+    }
+
+    template <typename Context, typename ShardContext, size_t... I>
+    static void reduce_gradients_variables(Context& context, ShardContext& shard_context, bool first, std::index_sequence<I...> /*seq*/){
+        (reduce_gradients_variable(std::get<I>(context.up.context)->grad, std::get<I>(shard_context.up.context)->grad, first), ...);
+    }
+
+    template <typename G, typename SG>
+    static void reduce_gradients_variable(G& grad, const SG& shard_grad, bool first){
+        if (first) {
+            grad = shard_grad;
+        } else {
+            grad += shard_grad;
+        }
+    }
+
+    template <typename Layer, typename Context>
+    void apply_gradients_layer([[maybe_unused]] size_t epoch, [[maybe_unused]] size_t n, [[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context){
+        if constexpr (Context::frozen) {
+            // The frozen layers have no gradients
+        } else if constexpr (is_utility_layer<Layer>) {
             cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
                 this->apply_gradients_layer(epoch, n, sub_layer, sub_context);
             });
         } else {
-            // Compute the gradients
-            layer.compute_gradients(context);
+            // Compute the gradients (already computed during the backpropagation with shared errors or recomputed activations)
+            if constexpr (!backward_gradients) {
+                layer.compute_gradients(context);
+            }
 
             // Apply the gradients
             this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
@@ -747,33 +2879,105 @@ struct sgd_trainer {
 
     template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_merge_layer<Layer>)>
     static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
-        errors = 0;
+        // When the branches are run concurrently, each branch needs its own
+        // scratch errors, otherwise a single one is reused
+
+        const bool shared = get_branch_mode() == branch_mode::SERIAL;
+
+        if (!shared) {
+            while (context.back_errors.size() < Layer::n_layers - 1) {
+                context.back_errors.push_back(context.input);
+            }
+        }
+
+        // Each branch copies its slice of the errors in its own task
+
+        const auto offsets = merge_offsets(context);
+
+        context.errors.ensure_cpu_up_to_date();
+
+        for_each_branch(Layer::n_layers, [&context, &errors, &last, shared, &layer, &offsets](size_t b){
+            cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last, shared, &offsets, b](size_t i, auto& sub_layer, auto& sub_context){
+                if (i != b) {
+                    return;
+                }
+
+                split_slice(get_errors(sub_context), context.errors, Layer::merge_dim + 1, offsets[i]);
 
-        // Dispatch all the sub contexts
+                bool sub_last = last;
 
-        cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last](size_t i, auto& sub_layer, auto& sub_context){
-            batch_dispatch(get_errors(sub_context), context.errors, i);
+                // The first branch writes directly the errors, the others go
+                // through the preallocated scratch errors
 
-            auto back_errors = errors;
+                if (i == 0) {
+                    backward_layer(sub_layer, sub_context, errors, sub_last);
+                } else {
+                    auto& back_errors = context.back_errors[shared ? 0 : i - 1];
 
-            bool sub_last = last;
-            backward_layer(sub_layer, sub_context, back_errors, sub_last);
+                    backward_layer(sub_layer, sub_context, back_errors, sub_last);
 
-            errors += back_errors;
+                    if (shared) {
+                        errors += back_errors;
+                    }
+                }
+            });
         });
 
-        last = false;
+        if (!shared) {
+            for (size_t i = 1; i < Layer::n_layers; ++i) {
+                errors += context.back_errors[i - 1];
+            }
+        }
+
+        last = false;
+    }
+
+    /*!
+     * \brief Forward the inputs through a (non-utility) layer.
+     *
+     * The inputs are only copied into the context if the layer needs them
+     * after the forward pass, otherwise they are directly used from the
+     * output of the previous layer.
+     */
+    template <bool Train, typename Layer, typename Inputs, typename Context>
+    static void forward_layer_input(Layer& layer, Inputs&& inputs, Context& context) {
+        if constexpr (sgd_keeps_input_v<Context>) {
+            context.input = inputs;
+
+            forward_layer_output<Train>(layer, context.input, context);
+        } else {
+            forward_layer_output<Train>(layer, inputs, context);
+        }
+    }
+
+    /*!
+     * \brief Forward the inputs through a (non-utility) layer into the
+     * output of its context.
+     *
+     * During training, layers keeping their caches in the context are given
+     * the workspace of the context.
+     */
+    template <bool Train, typename Layer, typename Inputs, typename Context>
+    static void forward_layer_output(Layer& layer, const Inputs& inputs, Context& context) {
+        if constexpr (sgd_has_active_v<Context>) {
+            if (cpp_unlikely(context.active < etl::dim<0>(context.output))) {
+                forward_active<Train, std::decay_t<Layer>::activation_function>(layer, inputs, context, context.output);
+                return;
+            }
+        }
+
+        if constexpr (Train && sgd_has_workspace_v<Context>) {
+            layer.forward_batch(context.output, inputs, context.workspace);
+        } else if constexpr (Train) {
+            layer.train_forward_batch(context.output, inputs);
+        } else {
+            layer.test_forward_batch(context.output, inputs);
+        }
     }
 
     template <bool Train, typename Layer, typename Inputs, typename Context, cpp_disable_iff(is_utility_layer<Layer>)>
     static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        context.input = inputs;
-
-        if constexpr (Train) {
-            layer.train_forward_batch(context.output, context.input);
-        } else {
-            layer.test_forward_batch(context.output, context.input);
-        }
+        forward_layer_input<Train>(layer, inputs, context);
     }
 
     template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
@@ -782,13 +2986,7 @@ struct sgd_trainer {
             auto& sub_layer   = std::get<L>(layer.layers);
             auto& sub_context = std::get<L>(context.sub_contexts);
 
-            sub_context.input = inputs;
-
-            if constexpr (Train) {
-                sub_layer.train_forward_batch(sub_context.output, sub_context.input);
-            } else {
-                sub_layer.test_forward_batch(sub_context.output, sub_context.input);
-            }
+            forward_layer_input<Train>(sub_layer, inputs, sub_context);
 
             forward_layer_group<Train, L + 1>(layer, sub_context.output, context);
         }
@@ -799,31 +2997,47 @@ struct sgd_trainer {
         forward_layer_group<Train, 0>(layer, inputs, context);
     }
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_merge(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
-
-            forward_layer<Train>(sub_layer, inputs, sub_context);
-
-            forward_layer_merge<Train, L + 1>(layer, inputs, context);
-        }
-    }
-
     template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_merge_layer<Layer>)>
     static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
         context.input = inputs;
 
-        // Fully forward each group
+        // Fully forward each branch (concurrently if enabled), each branch
+        // copies its output into its slice of the merged output while it is
+        // still hot in cache
+
+        const auto offsets = merge_offsets(context);
+
+        for_each_branch(Layer::n_layers, [&layer, &context, &offsets](size_t b){
+            cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &offsets, b](size_t i, auto& sub_layer, auto& sub_context){
+                if (i == b) {
+                    forward_layer<Train>(sub_layer, context.input, sub_context);
+
+                    concat_slice(context.output, get_output(sub_context), Layer::merge_dim + 1, offsets[i]);
+                }
+            });
+        });
+
+        context.output.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Return the position of each branch of a merge layer along the
+     * merge dimension of the merged batch
+     */
+    template <typename Context>
+    static std::array<size_t, Context::n_layers> merge_offsets(Context& context) {
+        constexpr size_t D = Context::layer_t::merge_dim + 1;
 
-        forward_layer_merge<Train, 0>(layer, context.input, context);
+        std::array<size_t, Context::n_layers> offsets;
 
-        // Concatenate all the sub contexts
+        size_t offset = 0;
 
-        cpp::for_each_i(context.sub_contexts, [&context](size_t i, auto& sub_context){
-            batch_merge(context.output, get_output(sub_context), i);
+        cpp::for_each_i(context.sub_contexts, [&offsets, &offset](size_t i, auto& sub_context) {
+            offsets[i] = offset;
+            offset += etl::dim(get_output(sub_context), D);
         });
+
+        return offsets;
     }
 
     template <typename Context>
@@ -854,10 +3068,35 @@ struct sgd_trainer {
 
     template <bool Train, typename Inputs>
     auto& forward_batch_helper(Inputs&& inputs) {
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        return forward_context<Train>(full_context, inputs);
+    }
+
+    /*!
+     * \brief Forward a batch of inputs through the given context
+     * \param context The full context of the network
+     * \param inputs A batch of inputs
+     * \return A reference to the output of the last layer
+     */
+    template <bool Train, typename Context, typename Inputs>
+    static auto& forward_context(Context& context, Inputs&& inputs) {
+        auto& first_ctx   = *std::get<0>(context).second;
+        auto& last_ctx    = *std::get<layers - 1>(context).second;
+
+        set_context_inputs(first_ctx, inputs);
+        set_active_context(context, etl::dim<0>(inputs));
+
+        forward_context_layers<Train, 0>(context, first_ctx.input);
+
+        return last_ctx.output;
+    }
 
+    /*!
+     * \brief Copy a batch of inputs into the context of the first layer
+     * \param first_ctx The context of the first layer
+     * \param inputs A batch of inputs
+     */
+    template <typename Context, typename Inputs>
+    static void set_context_inputs(Context& first_ctx, Inputs&& inputs) {
         const auto n          = etl::dim<0>(inputs);
         const bool full_batch = n == etl::dim<0>(first_ctx.input);
 
@@ -865,27 +3104,158 @@ struct sgd_trainer {
         cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
 
         if (cpp_unlikely(!full_batch)) {
-            first_ctx.input  = 0;
+            etl::slice(first_ctx.input, 0, n)                            = inputs;
+            etl::slice(first_ctx.input, n, etl::dim<0>(first_ctx.input)) = 0;
+
             first_ctx.output = 0;
+        } else {
+            first_ctx.input = inputs;
+        }
+    }
+
+    /*!
+     * \brief Forward the given inputs through the layers of the context,
+     * starting from the L-th one.
+     *
+     * A layer followed by an activation layer that can be fused into it
+     * directly writes the activated output into the context of the
+     * activation layer, which is not executed. Since the activation layer
+     * only needs its output for backpropagation, and the fused layer has no
+     * activation function, the backward pass is unchanged.
+     *
+     * With the fused output stage, the last layer only computes its logits
+     * during training.
+     *
+     * The inputs of the first layer are already in its context. Since they
+     * are not needed after the forward pass, a first layer that can be
+     * applied in place is applied directly on them and the second layer
+     * reads them instead of the output of the first layer.
+     *
+     * An upsampling layer fused with the same convolution following it is
+     * not executed, the convolution directly reads the inputs of the
+     * upsampling (sub-pixel convolution).
+     *
+     * The forward pass stops before the E-th layer (the end of a stage of
+     * pipeline-parallel training).
+     */
+    template <bool Train, size_t L, size_t E = layers, typename Context, typename Inputs>
+    static void forward_context_layers(Context& context, Inputs& inputs) {
+        auto& layer     = std::get<L>(context).first;
+        auto& layer_ctx = *std::get<L>(context).second;
+
+        // The frozen layers are forwarded in inference mode
+        constexpr bool T = Train && L >= frozen;
+
+        if constexpr (sgd_subpixel_v<std::decay_t<decltype(layer_ctx)>>) {
+            auto& conv     = std::get<L + 1>(context).first;
+            auto& conv_ctx = *std::get<L + 1>(context).second;
+
+            using conv_ctx_t = std::decay_t<decltype(conv_ctx)>;
+
+            {
+                layer_scope scope(conv, profile_phase::FORWARD);
+
+                conv_ctx.input = inputs;
 
-            for (size_t i = 0; i < etl::dim<0>(inputs); ++i) {
-                first_ctx.input(i) = inputs(i);
+                conv.template upsampled_forward_batch<conv_ctx_t::U1, conv_ctx_t::U2>(conv_ctx.output, conv_ctx.input);
             }
+
+            if constexpr (L + 2 < E) {
+                forward_context_layers<Train, L + 2, E>(context, get_output(conv_ctx));
+            }
+        } else if constexpr (L + 1 < E && is_fusable_activation<decltype(layer), decltype(std::get<L + 1>(context).first)>) {
+            auto& activation_ctx = *std::get<L + 1>(context).second;
+
+            constexpr auto F = std::decay_t<decltype(std::get<L + 1>(context).first)>::activation_function;
+
+            {
+                layer_scope scope(layer, profile_phase::FORWARD);
+
+                forward_layer_fused<T, F, L == 0>(layer, inputs, layer_ctx, activation_ctx.output);
+            }
+
+            if constexpr (L + 2 < E) {
+                forward_context_layers<Train, L + 2, E>(context, get_output(activation_ctx));
+            }
+        } else if constexpr (L == 0 && L + 1 < E && is_in_place<T, decltype(layer), Inputs>) {
+            {
+                layer_scope scope(layer, profile_phase::FORWARD);
+
+                forward_batch_in_place<T>(layer, inputs);
+            }
+
+            forward_context_layers<Train, L + 1, E>(context, inputs);
         } else {
-            first_ctx.input = inputs;
+            {
+                layer_scope scope(layer, profile_phase::FORWARD);
+
+                if constexpr (Train && sampled_output && L == layers - 1) {
+                    // The sampled output layer is only computed with the labels
+                    if constexpr (L > 0 && sgd_keeps_input_v<std::decay_t<decltype(layer_ctx)>>) {
+                        layer_ctx.input = inputs;
+                    }
+                } else if constexpr (Train && fused_softmax_cce && L == layers - 1) {
+                    forward_layer_fused<Train, function::IDENTITY, L == 0>(layer, inputs, layer_ctx, layer_ctx.output);
+                } else if constexpr (L == 0) {
+                    forward_layer_output<T>(layer, inputs, layer_ctx);
+                } else {
+                    forward_layer<T>(layer, inputs, layer_ctx);
+                }
+            }
+
+            if constexpr (L + 1 < E) {
+                forward_context_layers<Train, L + 1, E>(context, get_output(layer_ctx));
+            }
         }
+    }
 
-        if constexpr (Train) {
-            first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
+    /*!
+     * \brief Forward the inputs through a layer, with the given activation
+     * function instead of its own, into the given output.
+     *
+     * \tparam F The activation function to apply
+     * \tparam First Indicates if the inputs are already in the context
+     */
+    template <bool Train, function F, bool First, typename Layer, typename Inputs, typename Context, typename Output>
+    static void forward_layer_fused(Layer& layer, Inputs& inputs, Context& context, Output& output) {
+        if constexpr (!First && sgd_keeps_input_v<Context>) {
+            context.input = inputs;
+
+            forward_layer_fused<Train, F, true>(layer, context.input, context, output);
         } else {
-            first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
+            if constexpr (sgd_has_active_v<Context>) {
+                if (cpp_unlikely(context.active < etl::dim<0>(output))) {
+                    forward_active<Train, F>(layer, inputs, context, output);
+                    return;
+                }
+            }
+
+            if constexpr (Train) {
+                layer.template forward_batch<F>(output, inputs);
+            } else {
+                layer.template test_forward_batch<F>(output, inputs);
+            }
         }
+    }
 
-        cpp::for_each_pair(full_context, [this](auto& layer_ctx_1, auto& layer_ctx_2) {
-            this->template forward_layer<Train>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
-        });
+    /*!
+     * \brief Forward the active samples of an incomplete batch through a
+     * layer into the given output, with the given activation function.
+     *
+     * The rows of the output after the active samples are cleared, the
+     * following layers seeing a zero-padded batch.
+     */
+    template <bool Train, function F, typename Layer, typename Inputs, typename Context, typename Output>
+    static void forward_active(Layer& layer, const Inputs& inputs, Context& context, Output& output) {
+        const size_t n = context.active;
 
-        return last_ctx.output;
+        if constexpr (Train) {
+            layer.template forward_batch<F>(etl::slice(output, 0, n), etl::slice(inputs, 0, n));
+        } else {
+            layer.template test_forward_batch<F>(etl::slice(output, 0, n), etl::slice(inputs, 0, n));
+        }
+
+        etl::slice(output, n, etl::dim<0>(output)) = 0;
     }
 
     /*!
@@ -894,13 +3264,22 @@ struct sgd_trainer {
     template <updater_type UT, typename L, typename C>
     void update_weights([[maybe_unused]] size_t epoch, [[maybe_unused]] L& layer, [[maybe_unused]] C& context, [[maybe_unused]] size_t n) {
         if constexpr (decay_layer_traits<L>::is_neural_layer()) {
-            dll::auto_timer timer("sgd::update_weights");
+            static dll::timer_id timer_handle("sgd::update_weights");
+            dll::auto_timer timer(timer_handle);
 
             // Update all variables of the layer
 
             static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
             update_variables<UT>(epoch, layer, context, n, std::make_index_sequence<N>());
+
+            // Keep the pruned weights to zero
+            if constexpr (is_prunable<L>) {
+                layer.apply_weight_mask();
+            } else {
+                // Forget the caches of the weights (packed bits, ...)
+                detail::weights_changed(layer);
+            }
         }
     }
 
@@ -920,21 +3299,392 @@ struct sgd_trainer {
             eps *= 1.0 / (1.0 + eps_decay * iteration);
         }
 
-        //2. Update the gradients (L1/L2 and gradient clipping)
+        // 2. Fused path: decay, clipping and update in one pass
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
+        if constexpr (fused_updates) {
+            const auto* rows = sparse_rows<I, UT>(context);
 
-        // Note the distinction for w and b for decay is far from optimal...
-        if constexpr (I == 0) {
-            this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            // Note the distinction for w and b for decay is far from optimal...
+            if constexpr (I == 0) {
+                fused_update_variable<I, UT, w_decay(dbn_traits<dbn_t>::decay())>(layer, context, n, eps, rows);
+            } else {
+                fused_update_variable<I, UT, b_decay(dbn_traits<dbn_t>::decay())>(layer, context, n, eps, rows);
+            }
+
+            cpp_unused(epoch);
+        } else {
+            // The gradients are updated densely
+            if constexpr (sgd_sparse_rows_v<C>) {
+                context.stale_grad = true;
+            }
+
+            //2. Update the gradients (L1/L2 and gradient clipping)
+
+            auto& w      = std::get<I>(layer.trainable_parameters());
+            auto& w_grad = std::get<I>(context.up.context)->grad;
+
+            // Note the distinction for w and b for decay is far from optimal...
+            if constexpr (I == 0) {
+                this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            } else {
+                this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            }
+
+            // 3. Apply the gradients
+
+            apply_gradients<I, UT>(epoch, layer, context, n, eps);
+        }
+    }
+
+    /*!
+     * \brief Returns the rows of the given variable that can be updated alone.
+     *
+     * This is only possible for row-sparse gradients that were directly
+     * computed from the current batch. Otherwise, the full variable is
+     * updated and the gradients must be cleared entirely next time.
+     *
+     * The trust ratios of LARS and LAMB are computed from the norms of the
+     * full variable, which is therefore always updated entirely.
+     *
+     * \return a pointer to the rows to update, or nullptr to update the full variable
+     */
+    template <size_t I, updater_type UT, typename C>
+    const std::vector<size_t>* sparse_rows([[maybe_unused]] C& context) {
+        if constexpr (I == 0 && sgd_sparse_rows_v<C>) {
+            // The rows of a shard are only known to the shard itself (Hogwild)
+            const bool own_rows = partitions == 1 || hogwild();
+
+            // The norms of the trust ratio span the untouched rows as well
+            const bool full_norms = UT == updater_type::LARS || UT == updater_type::LAMB;
+
+            if (own_rows && !full_norms && dbn.accumulation_steps <= 1 && !distributed() && !context.stale_grad) {
+                return &context.rows;
+            }
+
+            context.stale_grad = true;
+        }
+
+        return nullptr;
+    }
+
+    /*!
+     * \brief Returns the decayed gradient of one element of a variable
+     * \param g The gradient
+     * \param x The value of the variable
+     * \param l1 The L1 weight cost
+     * \param l2 The L2 weight cost
+     * \return The decayed gradient
+     */
+    template <decay_type D, typename G, typename X>
+    static G decay_gradient(G g, X x, weight l1, weight l2) {
+        if constexpr (D == decay_type::L1) {
+            cpp_unused(l2);
+            return g - l1 * std::abs(x);
+        } else if constexpr (D == decay_type::L2) {
+            cpp_unused(l1);
+            return g - l2 * x;
+        } else if constexpr (D == decay_type::L1L2) {
+            return g - l1 * std::abs(x) - l2 * x;
         } else {
-            this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            cpp_unused(x);
+            cpp_unused(l1);
+            cpp_unused(l2);
+            return g;
+        }
+    }
+
+    /*!
+     * \brief Compute the scaling factor of the (decayed) gradients for
+     * gradient clipping.
+     * \return The scaling factor to apply to the gradients
+     */
+    template <decay_type D, typename V, typename G>
+    weight fused_clip_scale([[maybe_unused]] const V& value, [[maybe_unused]] const G& grad, [[maybe_unused]] size_t n, [[maybe_unused]] const std::vector<size_t>* rows) {
+        if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
+            value.ensure_cpu_up_to_date();
+            grad.ensure_cpu_up_to_date();
+
+            const weight l1 = dbn.l1_weight_cost;
+            const weight l2 = dbn.l2_weight_cost;
+
+            const auto* v_p = value.memory_start();
+            const auto* g_p = grad.memory_start();
+
+            double sum = 0.0;
+
+            auto add = [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    const auto g = decay_gradient<D>(g_p[i], v_p[i], l1, l2);
+                    sum += g * g;
+                }
+            };
+
+            if (rows) {
+                const size_t K = etl::size(value) / etl::dim<0>(value);
+
+                for (auto row : *rows) {
+                    add(row * K, (row + 1) * K);
+                }
+            } else {
+                add(0, etl::size(value));
+            }
+
+            const auto t            = dbn.gradient_clip;
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                return t / grad_l2_norm;
+            }
+        }
+
+        return 1.0;
+    }
+
+    /*!
+     * \brief Apply the decay, the clipping and the updater on a variable in
+     * a single pass over its memory.
+     *
+     * If rows is set, only these rows of the variable and of its updater
+     * states are updated (lazy update of row-sparse gradients).
+     */
+    template <size_t I, updater_type UT, decay_type D, typename L, typename C>
+    void fused_update_variable(L& layer, C& context, size_t n, weight eps, const std::vector<size_t>* rows) {
+        static dll::timer_id timer_handle("sgd::fused_update");
+        dll::auto_timer timer(timer_handle);
+
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& sub = *std::get<I>(context.up.context);
+
+        const weight l1 = dbn.l1_weight_cost;
+        const weight l2 = dbn.l2_weight_cost;
+        const weight s  = fused_clip_scale<D>(w, sub.grad, n, rows);
+        const weight e  = 1e-8;
+
+        // Update either the touched rows or the full variable
+        auto fused_update_loop = [rows](auto&& functor, auto& x, auto& g, auto&... states) {
+            if (rows) {
+                dll::fused_update_rows(functor, *rows, x, g, states...);
+            } else {
+                dll::fused_update_loop(functor, x, g, states...);
+            }
+
+            nan_check_deep(x);
+        };
+
+        // The decayed and clipped gradient of one element
+        auto grad = [=](auto g, auto x) {
+            return s * decay_gradient<D>(g, x, l1, l2);
+        };
+
+        if constexpr (UT == updater_type::SGD) {
+            const weight f = eps / n;
+
+            fused_update_loop([=](auto& x, auto g) {
+                x += f * grad(g, x);
+            }, w, sub.grad);
+        } else if constexpr (UT == updater_type::MOMENTUM) {
+            const weight f        = eps / n;
+            const weight momentum = dbn.momentum;
+
+            fused_update_loop([=](auto& x, auto g, auto& inc) {
+                inc = momentum * inc + f * grad(g, x);
+                x += inc;
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::NESTEROV) {
+            const weight f        = eps / n;
+            const weight momentum = dbn.momentum;
+
+            fused_update_loop([=](auto& x, auto g, auto& inc, auto& inc_prev) {
+                inc_prev = inc;
+                inc      = momentum * inc + f * grad(g, x);
+                x += -momentum * inc_prev + (1.0 + momentum) * inc;
+            }, w, sub.grad, sub.inc, sub.inc_prev);
+        } else if constexpr (UT == updater_type::ADAGRAD) {
+            fused_update_loop([=](auto& x, auto g, auto& inc) {
+                const auto dg = grad(g, x);
+
+                inc = inc + dg * dg;
+                x += (eps * dg) / std::sqrt(inc + e);
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::ADADELTA) {
+            const weight beta = dbn.adadelta_beta;
+
+            fused_update_loop([=](auto& x, auto g, auto& s_g, auto& s_x, auto& s_v) {
+                const auto dg = grad(g, x);
+
+                s_g = beta * s_g + (1.0 - beta) * (dg * dg);
+                s_v = (std::sqrt(s_x + e) * dg) / std::sqrt(s_g + e);
+                s_x = beta * s_x + (1.0 - beta) * (s_v * s_v);
+
+                x += s_v;
+            }, w, sub.grad, sub.g, sub.x, sub.v);
+        } else if constexpr (UT == updater_type::ADAM) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            fused_update_loop([=](auto& x, auto g, auto& m, auto& v) {
+                const auto dg = grad(g, x);
+
+                m = beta1 * m + (1.0 - beta1) * dg;
+                v = beta2 * v + (1.0 - beta2) * (dg * dg);
+
+                x += (eps * m) / (std::sqrt(v) + e);
+            }, w, sub.grad, sub.m, sub.v);
+        } else if constexpr (UT == updater_type::ADAM_CORRECT) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+            const weight d1    = 1.0 - std::pow(beta1, iteration);
+            const weight d2    = 1.0 - std::pow(beta2, iteration);
+
+            fused_update_loop([=](auto& x, auto g, auto& m, auto& mt, auto& v, auto& vt) {
+                const auto dg = grad(g, x);
+
+                m = beta1 * m + (1.0 - beta1) * dg;
+                v = beta2 * v + (1.0 - beta2) * (dg * dg);
+
+                mt = m / d1;
+                vt = v / d2;
+
+                x += (eps * m) / (std::sqrt(v) + e);
+            }, w, sub.grad, sub.m, sub.mt, sub.v, sub.vt);
+        } else if constexpr (UT == updater_type::ADAMAX) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            fused_update_loop([=](auto& x, auto g, auto& m, auto& v) {
+                const auto dg = grad(g, x);
+
+                m = beta1 * m + (1.0 - beta1) * dg;
+                v = std::max<std::decay_t<decltype(v)>>(beta2 * v, std::abs(dg));
+
+                x += (eps * m) / v;
+            }, w, sub.grad, sub.m, sub.v);
+        } else if constexpr (UT == updater_type::NADAM) {
+            const weight beta1          = dbn.adam_beta1;
+            const weight beta2          = dbn.adam_beta2;
+            const weight schedule_decay = dbn.nadam_schedule_decay;
+            const weight t              = iteration;
+
+            auto& m_schedule = sub.m_schedule;
+
+            // Compute the schedule for momentum
+
+            weight momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
+            weight momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
+
+            weight m_schedule_new  = m_schedule * momentum_cache_t;
+            weight m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
+
+            if constexpr (I == 0) {
+                m_schedule = m_schedule_new;
+            }
+
+            const weight d1 = 1.0 - m_schedule_next;
+            const weight d2 = 1.0 - std::pow(beta2, t);
+
+            const weight m1 = eps * ((1.0 - momentum_cache_t) / (1.0 - m_schedule_new));
+            const weight m2 = eps * momentum_cache_t_1;
+
+            fused_update_loop([=](auto& x, auto g, auto& m, auto& mt, auto& v, auto& vt) {
+                const auto dg = grad(g, x);
+
+                m = beta1 * m + (1.0 - beta1) * dg;
+                v = beta2 * v + (1.0 - beta2) * (dg * dg);
+
+                mt = m / d1;
+                vt = v / d2;
+
+                x += (m1 * dg + m2 * mt) / (std::sqrt(vt) + e);
+            }, w, sub.grad, sub.m, sub.mt, sub.v, sub.vt);
+        } else if constexpr (UT == updater_type::RMSPROP) {
+            const weight decay = dbn.rmsprop_decay;
+
+            fused_update_loop([=](auto& x, auto g, auto& inc) {
+                const auto dg = grad(g, x);
+
+                inc = decay * inc + (1.0 - decay) * (dg * dg);
+                x += (eps * dg) / std::sqrt(inc + e);
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::LARS) {
+            const weight f        = eps / n;
+            const weight momentum = dbn.momentum;
+
+            // The trust ratio of the weights (the biases are not adapted)
+
+            weight trust = 1.0;
+
+            if constexpr (I == 0) {
+                double x_norm = 0.0;
+                double g_norm = 0.0;
+
+                fused_update_loop([&](auto& x, auto g) {
+                    const auto dg = grad(g, x);
+
+                    x_norm += x * x;
+                    g_norm += dg * dg;
+                }, w, sub.grad);
+
+                trust = lars_trust_ratio(dbn.lars_trust * std::sqrt(x_norm), std::sqrt(g_norm) / n);
+            }
+
+            const weight ft = f * trust;
+
+            fused_update_loop([=](auto& x, auto g, auto& inc) {
+                inc = momentum * inc + ft * grad(g, x);
+                x += inc;
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::LAMB) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+            const weight d1    = 1.0 - std::pow(beta1, iteration);
+            const weight d2    = 1.0 - std::pow(beta2, iteration);
+
+            double x_norm = 0.0;
+            double r_norm = 0.0;
+
+            // The moments are updated along with the norms of the ratio
+
+            fused_update_loop([&](auto& x, auto g, auto& m, auto& v) {
+                const auto dg = grad(g, x);
+
+                m = beta1 * m + (1.0 - beta1) * dg;
+                v = beta2 * v + (1.0 - beta2) * (dg * dg);
+
+                const auto r = (m / d1) / (std::sqrt(v / d2) + e);
+
+                x_norm += x * x;
+                r_norm += r * r;
+            }, w, sub.grad, sub.m, sub.v);
+
+            // The trust ratio of the weights (the biases are not adapted)
+
+            weight trust = 1.0;
+
+            if constexpr (I == 0) {
+                trust = lars_trust_ratio(std::sqrt(x_norm), std::sqrt(r_norm));
+            }
+
+            const weight ft = eps * trust;
+
+            fused_update_loop([=](auto& x, auto /*g*/, auto& m, auto& v) {
+                x += ft * ((m / d1) / (std::sqrt(v / d2) + e));
+            }, w, sub.grad, sub.m, sub.v);
         }
+    }
 
-        // 3. Apply the gradients
+    /*!
+     * \brief Returns the layer-wise trust ratio of LARS and LAMB from the
+     * (scaled) norm of the weights and the norm of their update.
+     *
+     * When one of the norms is zero (for instance freshly zeroed weights),
+     * the ratio is one and the updater falls back to its base rule.
+     */
+    static weight lars_trust_ratio(double w_norm, double u_norm) {
+        if (w_norm > 0.0 && u_norm > 0.0) {
+            return w_norm / u_norm;
+        }
 
-        apply_gradients<I, UT>(epoch, layer, context, n, eps);
+        return 1.0;
     }
 
     /*!
@@ -942,7 +3692,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::SGD)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:sgd");
+        static dll::timer_id timer_handle("sgd::apply_grad:sgd");
+        dll::auto_timer timer(timer_handle);
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
@@ -959,7 +3710,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::MOMENTUM)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:momentum");
+        static dll::timer_id timer_handle("sgd::apply_grad:momentum");
+        dll::auto_timer timer(timer_handle);
 
         const auto momentum = dbn.momentum;
 
@@ -983,7 +3735,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::NESTEROV)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:nesterov");
+        static dll::timer_id timer_handle("sgd::apply_grad:nesterov");
+        dll::auto_timer timer(timer_handle);
 
         const auto momentum = dbn.momentum;
 
@@ -1010,7 +3763,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAGRAD)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adagrad");
+        static dll::timer_id timer_handle("sgd::apply_grad:adagrad");
+        dll::auto_timer timer(timer_handle);
 
         const auto e = 1e-8;
 
@@ -1033,7 +3787,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADADELTA)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adadelta");
+        static dll::timer_id timer_handle("sgd::apply_grad:adadelta");
+        dll::auto_timer timer(timer_handle);
 
         const auto beta = dbn.adadelta_beta;
         const auto e = 1e-8;
@@ -1062,7 +3817,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAM)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adam");
+        static dll::timer_id timer_handle("sgd::apply_grad:adam");
+        dll::auto_timer timer(timer_handle);
 
         const auto beta1 = dbn.adam_beta1;
         const auto beta2 = dbn.adam_beta2;
@@ -1093,7 +3849,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAM_CORRECT)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adam_correct");
+        static dll::timer_id timer_handle("sgd::apply_grad:adam_correct");
+        dll::auto_timer timer(timer_handle);
 
         const auto beta1 = dbn.adam_beta1;
         const auto beta2 = dbn.adam_beta2;
@@ -1132,7 +3889,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAMAX)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adamax");
+        static dll::timer_id timer_handle("sgd::apply_grad:adamax");
+        dll::auto_timer timer(timer_handle);
 
         const auto beta1 = dbn.adam_beta1;
         const auto beta2 = dbn.adam_beta2;
@@ -1165,7 +3923,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::NADAM)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:nadam");
+        static dll::timer_id timer_handle("sgd::apply_grad:nadam");
+        dll::auto_timer timer(timer_handle);
 
         const weight beta1          = dbn.adam_beta1;
         const weight beta2          = dbn.adam_beta2;
@@ -1224,7 +3983,8 @@ struct sgd_trainer {
      */
     template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::RMSPROP)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:rmsprop");
+        static dll::timer_id timer_handle("sgd::apply_grad:rmsprop");
+        dll::auto_timer timer(timer_handle);
 
         const auto decay = dbn.rmsprop_decay;
         const auto e = 1e-8;
@@ -1243,6 +4003,90 @@ struct sgd_trainer {
         cpp_unused(epoch);
     }
 
+    /*!
+     * \brief Apply the gradients to the given layer
+     */
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::LARS)>
+    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+        static dll::timer_id timer_handle("sgd::apply_grad:lars");
+        dll::auto_timer timer(timer_handle);
+
+        const auto momentum = dbn.momentum;
+
+        auto& w      = std::get<I>(layer.trainable_parameters());
+        auto& w_grad = std::get<I>(context.up.context)->grad;
+        auto& w_inc  = std::get<I>(context.up.context)->inc;
+
+        // Adapt the learning rate of the weights to the norm of their gradients
+
+        weight trust = 1.0;
+
+        if constexpr (I == 0) {
+            const double w_norm = std::sqrt(etl::sum(w >> w));
+            const double g_norm = std::sqrt(etl::sum(w_grad >> w_grad)) / n;
+
+            trust = lars_trust_ratio(dbn.lars_trust * w_norm, g_norm);
+        }
+
+        //Update with momentum and the local learning rate
+
+        w_inc = momentum * w_inc + (trust * eps / n) * w_grad;
+
+        w += w_inc;
+
+        nan_check_deep(w);
+
+        cpp_unused(epoch);
+    }
+
+    /*!
+     * \brief Apply the gradients to the given layer
+     */
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::LAMB)>
+    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+        static dll::timer_id timer_handle("sgd::apply_grad:lamb");
+        dll::auto_timer timer(timer_handle);
+
+        const auto beta1 = dbn.adam_beta1;
+        const auto beta2 = dbn.adam_beta2;
+        const auto e = 1e-8;
+        const auto t = iteration;
+
+        auto& w      = std::get<I>(layer.trainable_parameters());
+        auto& w_grad = std::get<I>(context.up.context)->grad;
+        auto& w_m    = std::get<I>(context.up.context)->m;
+        auto& w_v    = std::get<I>(context.up.context)->v;
+
+        // Standard Adam estimations of the first and second moments
+
+        w_m = beta1 * w_m + ((1.0 - beta1) * w_grad);
+        w_v = beta2 * w_v + ((1.0 - beta2) * (w_grad >> w_grad));
+
+        // The bias-corrected Adam ratio
+
+        const auto d1 = 1.0 - std::pow(beta1, t);
+        const auto d2 = 1.0 - std::pow(beta2, t);
+
+        auto r = (w_m / d1) / (etl::sqrt(w_v / d2) + e);
+
+        // Adapt the learning rate of the weights to the norm of the ratio
+
+        weight trust = 1.0;
+
+        if constexpr (I == 0) {
+            trust = lars_trust_ratio(std::sqrt(etl::sum(w >> w)), std::sqrt(etl::sum(r >> r)));
+        }
+
+        // Update the parameters
+
+        w += (eps * trust) * r;
+
+        nan_check_deep(w);
+
+        cpp_unused(n);
+        cpp_unused(epoch);
+    }
+
     /*!
      * \brief Update the given gradients according to the given decay function
      */
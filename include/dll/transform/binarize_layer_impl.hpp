@@ -62,6 +62,17 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
         }
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch>
+    static void forward_batch_in_place(Batch& batch) {
+        for (auto& value : batch) {
+            value = value > Threshold ? 1 : 0;
+        }
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -134,6 +145,8 @@ struct sgd_context<DBN, binarize_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -171,8 +184,8 @@ struct cg_context<binarize_layer_impl<Desc>> {
     etl::fast_matrix<weight, 1, 1> gr_w_tmp;
     etl::fast_vector<weight, 1> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs; ///< The activation probabilities of the batch, one sample per row
+    etl::dyn_matrix<weight, 2> gr_diffs; ///< The diffs of the batch, one sample per row
 };
 
 } //end of dll namespace
@@ -62,10 +62,10 @@ struct dyn_lcn_layer_impl : transform_layer<dyn_lcn_layer_impl<Desc>> {
     }
 
     template <typename W>
-    etl::dyn_matrix<W, 2> filter(double sigma) const {
-        etl::dyn_matrix<W, 2> w(K, K);
+    etl::dyn_matrix<W, 1> filter(double sigma) const {
+        etl::dyn_matrix<W, 1> w(K);
 
-        lcn_filter(w, K, Mid, sigma);
+        lcn_filter_1d(w, K, Mid, sigma);
 
         return w;
     }
@@ -123,6 +123,8 @@ struct sgd_context<DBN, dyn_lcn_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -92,6 +92,19 @@ struct dyn_shape_1d_layer_impl : transform_layer<dyn_shape_1d_layer_impl<Desc>>
         output = input;
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place.
+     *
+     * A batch that already has the dimensions of the output does not need
+     * to be reshaped.
+     *
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch, cpp_enable_iff(etl::dimensions<Batch>() == 2)>
+    void forward_batch_in_place(Batch& batch) const {
+        cpp_unused(batch);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -161,6 +174,8 @@ struct sgd_context<DBN, dyn_shape_1d_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& layer) : input(batch_size, layer.S), output(batch_size, layer.S), errors(batch_size, layer.S){}
 };
 
@@ -98,6 +98,20 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
         output = input;
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place.
+     *
+     * A batch that already has the dimensions of the output does not need
+     * to be reshaped.
+     *
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch, cpp_enable_iff(etl::dimensions<Batch>() == 4)>
+    void forward_batch_in_place(Batch& batch) const {
+        cpp_assert(etl::dim<1>(batch) == C && etl::dim<2>(batch) == W && etl::dim<3>(batch) == H, "The batch must have the shape of the output");
+        cpp_unused(batch);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -167,6 +181,8 @@ struct sgd_context<DBN, dyn_shape_3d_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& layer) : input(batch_size, layer.C, layer.W, layer.H), output(batch_size, layer.C, layer.W, layer.H), errors(batch_size, layer.C, layer.W, layer.H){}
 };
 
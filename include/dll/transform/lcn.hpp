@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 namespace dll {
 
 inline double gaussian(double x, double y, double sigma) {
@@ -25,58 +29,118 @@ void lcn_filter(W& w, size_t K, size_t Mid, double sigma){
     w /= etl::sum(w);
 }
 
+/*!
+ * \brief Fill the 1D Gaussian filter of a LCN layer.
+ *
+ * The 2D Gaussian filter of lcn_filter is the outer product of this filter
+ * with itself.
+ */
+template <typename W>
+void lcn_filter_1d(W& w, size_t K, size_t Mid, double sigma){
+    for (size_t i = 0; i < K; ++i) {
+        w(i) = std::exp(-((double(i) - Mid) * (double(i) - Mid) / (2.0 * sigma * sigma)));
+    }
+
+    w /= etl::sum(w);
+}
+
 /*!
  * \brief Apply the layer to the input
+ *
+ * The Gaussian filter is separable, so the weighted sums of the K x K
+ * neighbourhoods are computed with a horizontal and a vertical 1D pass.
+ * The sums of the values (mean) and of their squares (variance) are done
+ * in the same passes. The innermost loops run along the rows.
+ *
  * \param y The output
  * \param x The input to apply the layer to
+ * \param w The 1D Gaussian filter (see lcn_filter_1d)
+ * \param K The size of the filter
+ * \param Mid The center of the filter
  */
 template <typename Input, typename Output, typename W>
 void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
     using weight_t = etl::value_t<Input>;
 
-    auto v = etl::force_temporary(x(0));
-    auto o = etl::force_temporary(x(0));
+    const size_t N1 = etl::dim<1>(x);
+    const size_t N2 = etl::dim<2>(x);
+
+    auto xc = etl::force_temporary(x(0));
+    auto v  = etl::force_temporary(x(0));
+    auto o  = etl::force_temporary(x(0));
+
+    std::vector<weight_t> h(N1 * N2);
+    std::vector<weight_t> h2(N1 * N2);
 
     for (size_t c = 0; c < etl::dim<0>(x); ++c) {
-        //1. For each pixel, remove mean of 9x9 neighborhood
-        for (size_t j = 0; j < etl::dim<1>(x); ++j) {
-            for (size_t k = 0; k < etl::dim<2>(x); ++k) {
-                weight_t sum(0.0);
-
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - Mid >= 0 && long(j) + p - Mid < etl::dim<1>(x)) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - Mid >= 0 && long(k) + q - Mid < etl::dim<2>(x)) {
-                                sum += w(p, q) * x(c, j + p - Mid, k + q - Mid);
-                            }
-                        }
-                    }
+        xc = x(c);
+        xc.ensure_cpu_up_to_date();
+
+        const weight_t* in = xc.memory_start();
+
+        //1. Horizontal pass over the values and their squares
+
+        std::fill(h.begin(), h.end(), weight_t(0));
+        std::fill(h2.begin(), h2.end(), weight_t(0));
+
+        for (size_t j = 0; j < N1; ++j) {
+            const weight_t* in_row = in + j * N2;
+            weight_t* h_row        = h.data() + j * N2;
+            weight_t* h2_row       = h2.data() + j * N2;
+
+            for (size_t q = 0; q < K; ++q) {
+                if (q >= N2 + Mid) {
+                    break;
                 }
 
-                v(j, k) = x(c, j, k) - sum;
+                const weight_t wq = w(q);
+
+                // The columns k such that k + q - Mid is inside the row
+                const size_t first = q < Mid ? Mid - q : 0;
+                const size_t last  = std::min(N2, N2 + Mid - q);
+
+                for (size_t k = first; k < last; ++k) {
+                    const weight_t value = in_row[k + q - Mid];
+
+                    h_row[k] += wq * value;
+                    h2_row[k] += wq * value * value;
+                }
             }
         }
 
-        //2. Scale down norm of 9x9 patch if norm is bigger than 1
+        //2. Vertical pass, directly into the mean and the variance
 
-        for (size_t j = 0; j < etl::dim<1>(x); ++j) {
-            for (size_t k = 0; k < etl::dim<2>(x); ++k) {
-                weight_t sum(0.0);
+        weight_t* mean = v.memory_start();
+        weight_t* var  = o.memory_start();
 
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - Mid >= 0 && long(j) + p - Mid < etl::dim<1>(x)) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - Mid >= 0 && long(k) + q - Mid < etl::dim<2>(x)) {
-                                sum += w(p, q) * x(c, j + p - Mid, k + q - Mid) * x(c, j + p - Mid, k + q - Mid);
-                            }
-                        }
-                    }
+        std::fill_n(mean, N1 * N2, weight_t(0));
+        std::fill_n(var, N1 * N2, weight_t(0));
+
+        for (size_t j = 0; j < N1; ++j) {
+            for (size_t p = 0; p < K; ++p) {
+                if (j + p < Mid || j + p - Mid >= N1) {
+                    continue;
                 }
 
-                o(j, k) = std::sqrt(sum);
+                const weight_t wp      = w(p);
+                const weight_t* h_row  = h.data() + (j + p - Mid) * N2;
+                const weight_t* h2_row = h2.data() + (j + p - Mid) * N2;
+
+                for (size_t k = 0; k < N2; ++k) {
+                    mean[j * N2 + k] += wp * h_row[k];
+                    var[j * N2 + k] += wp * h2_row[k];
+                }
             }
         }
 
+        v.invalidate_gpu();
+        o.invalidate_gpu();
+
+        //3. Remove the mean and scale down the norm of the patch if it is bigger than the average norm
+
+        v = xc - v;
+        o = etl::sqrt(o);
+
         auto cst = etl::mean(o);
         y(c) = v / etl::max(o, cst);
     }
@@ -55,10 +55,10 @@ struct lcn_layer_impl : transform_layer<lcn_layer_impl<Desc>> {
     }
 
     template <typename W>
-    static etl::fast_dyn_matrix<W, K, K> filter(double sigma) {
-        etl::fast_dyn_matrix<W, K, K> w;
+    static etl::fast_dyn_matrix<W, K> filter(double sigma) {
+        etl::fast_dyn_matrix<W, K> w;
 
-        lcn_filter(w, K, Mid, sigma);
+        lcn_filter_1d(w, K, Mid, sigma);
 
         return w;
     }
@@ -127,6 +127,8 @@ struct sgd_context<DBN, lcn_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -56,6 +56,15 @@ struct normalize_layer_impl : transform_layer<normalize_layer_impl<Desc>> {
         cpp::normalize(output);
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch>
+    static void forward_batch_in_place(Batch& batch) {
+        cpp::normalize(batch);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -123,6 +132,8 @@ struct sgd_context<DBN, normalize_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -58,6 +58,17 @@ struct rectifier_layer_impl : transform_layer<rectifier_layer_impl<Desc>> {
             output = etl::abs(input);
         }
     }
+
+    /*!
+     * \brief Apply the layer to the batch of input, in place
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch>
+    static void forward_batch_in_place(Batch& batch) {
+        if (method == rectifier_method::ABS) {
+            batch = etl::abs(batch);
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -99,6 +110,8 @@ struct sgd_context<DBN, rectifier_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
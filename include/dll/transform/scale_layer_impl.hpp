@@ -57,6 +57,15 @@ struct scale_layer_impl : transform_layer<scale_layer_impl<Desc>> {
         output = input * (double(A) / double(B));
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch>
+    static void forward_batch_in_place(Batch& batch) {
+        batch = batch * (double(A) / double(B));
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -124,6 +133,8 @@ struct sgd_context<DBN, scale_layer_impl<Desc>, L> {
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -86,6 +86,19 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
         output = input;
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place.
+     *
+     * A batch that already has the dimensions of the output does not need
+     * to be reshaped.
+     *
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch, cpp_enable_iff(etl::dimensions<Batch>() == 2)>
+    static void forward_batch_in_place(Batch& batch) {
+        cpp_unused(batch);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -158,6 +171,8 @@ struct sgd_context<DBN, shape_1d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, layer_t::Size> output;
     etl::fast_matrix<weight, batch_size, layer_t::Size> errors;
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const shape_1d_layer_impl<Desc>& /* layer */){}
 };
 
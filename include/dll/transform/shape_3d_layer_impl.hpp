@@ -88,6 +88,20 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
         output = input;
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, in place.
+     *
+     * A batch that already has the dimensions of the output does not need
+     * to be reshaped.
+     *
+     * \param batch The batch of input, replaced by the batch of output
+     */
+    template <typename Batch, cpp_enable_iff(etl::dimensions<Batch>() == 4)>
+    static void forward_batch_in_place(Batch& batch) {
+        cpp_assert(etl::dim<1>(batch) == C && etl::dim<2>(batch) == W && etl::dim<3>(batch) == H, "The batch must have the shape of the output");
+        cpp_unused(batch);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -166,6 +180,8 @@ struct sgd_context<DBN, shape_3d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> output;
     etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> errors;
 
+    static constexpr bool keep_input = false; ///< The input is not needed after the forward pass
+
     sgd_context(const shape_3d_layer_impl<Desc>& /* layer */){}
 };
 
@@ -0,0 +1,195 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file arena.hpp
+ * \brief Per-thread arena for the temporaries of the hot paths
+ *
+ * Some temporaries of the training and of the evaluation are only needed
+ * during one call. Instead of being allocated on the heap at each batch,
+ * they are bumped from the arena of the calling thread and all released
+ * at the end of the enclosing arena_scope. Once the arena has grown to the
+ * needs of the thread, the following batches do not allocate any more.
+ *
+ * The ETL containers cannot be given an allocator: the temporaries of the
+ * arena are ETL views (custom matrices) on its memory. They must not
+ * outlive their scope.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A bump allocator whose memory is released by scopes.
+ */
+struct arena {
+    static constexpr size_t alignment = 64; ///< The alignment of each allocation
+
+    arena() = default;
+
+    arena(const arena& rhs) = delete;
+    arena& operator=(const arena& rhs) = delete;
+
+    /*!
+     * \brief Allocate n uninitialized values of type T
+     */
+    template <typename T>
+    T* allocate(size_t n) {
+        const size_t bytes = align(n * sizeof(T));
+
+        if (used + bytes <= capacity) {
+            auto* memory = block.get() + used;
+
+            used += bytes;
+            peak = std::max(peak, used + overflow_bytes);
+
+            return reinterpret_cast<T*>(memory);
+        }
+
+        // The block is full, the memory is taken from an overflow block
+        // until the arena is completely released
+        overflow.emplace_back(allocate_block(bytes));
+        overflow_bytes += bytes;
+        peak = std::max(peak, used + overflow_bytes);
+
+        return reinterpret_cast<T*>(overflow.back().get());
+    }
+
+    /*!
+     * \brief Returns the current position of the arena, to be released later
+     */
+    size_t mark() const {
+        return used;
+    }
+
+    /*!
+     * \brief Release all the memory allocated since the given mark.
+     *
+     * When the arena is completely released after an overflow, the block
+     * is grown to the peak usage, for the next uses not to overflow.
+     */
+    void release(size_t m) {
+        used = m;
+
+        if (!m && !overflow.empty()) {
+            overflow.clear();
+            overflow_bytes = 0;
+
+            capacity = align(peak + peak / 2);
+            block    = allocate_block(capacity);
+        }
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the main block of the arena
+     */
+    size_t size() const {
+        return capacity;
+    }
+
+private:
+    /*!
+     * \brief Deallocate an aligned block
+     */
+    struct block_deleter {
+        void operator()(char* memory) const {
+            ::operator delete(memory, std::align_val_t(alignment));
+        }
+    };
+
+    using block_t = std::unique_ptr<char, block_deleter>; ///< An aligned block of memory
+
+    /*!
+     * \brief Round the given number of bytes up to the alignment
+     */
+    static constexpr size_t align(size_t bytes) {
+        return ((bytes + alignment - 1) / alignment) * alignment;
+    }
+
+    /*!
+     * \brief Allocate an aligned block of the given number of bytes
+     */
+    static block_t allocate_block(size_t bytes) {
+        return block_t(static_cast<char*>(::operator new(bytes, std::align_val_t(alignment))));
+    }
+
+    block_t block;                 ///< The main block
+    size_t capacity = 0;           ///< The size of the main block
+    size_t used     = 0;           ///< The bytes used in the main block
+    size_t peak     = 0;           ///< The peak number of bytes used
+    std::vector<block_t> overflow; ///< The blocks allocated when the main block is full
+    size_t overflow_bytes = 0;     ///< The bytes of the overflow blocks
+};
+
+/*!
+ * \brief Returns the arena of the calling thread
+ */
+inline arena& thread_arena() {
+    thread_local arena a;
+    return a;
+}
+
+/*!
+ * \brief Release the memory allocated from the arena of the thread during
+ * the lifetime of the scope.
+ */
+struct arena_scope {
+    arena_scope() : a(thread_arena()), m(a.mark()) {}
+
+    arena_scope(const arena_scope& rhs) = delete;
+    arena_scope& operator=(const arena_scope& rhs) = delete;
+
+    ~arena_scope() {
+        a.release(m);
+    }
+
+private:
+    arena& a;       ///< The arena of the thread
+    const size_t m; ///< The position of the arena at the beginning of the scope
+};
+
+namespace detail {
+
+/*!
+ * \brief Create a view with the dimensions of the given expression on the
+ * given memory
+ */
+template <typename T, typename E, size_t... I>
+auto arena_view(T* memory, const E& expr, std::index_sequence<I...> /*seq*/) {
+    return etl::custom_dyn_matrix<T, sizeof...(I)>(memory, etl::dim(expr, I)...);
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Evaluate the given expression into a temporary of the arena of
+ * the calling thread, valid until the end of the enclosing arena_scope.
+ *
+ * \param expr The expression to evaluate
+ * \return a view on the evaluated expression
+ */
+template <typename E>
+auto arena_temporary(const E& expr) {
+    using T = etl::value_t<E>;
+
+    auto view = detail::arena_view(thread_arena().allocate<T>(etl::size(expr)), expr, std::make_index_sequence<etl::dimensions<E>()>());
+
+    view = expr;
+
+    return view;
+}
+
+} //end of dll namespace
@@ -48,4 +48,51 @@ decltype(auto) batch_extend(Batch&& batch, One&& one){
     cpp_unreachable("Invalid selection in batch_extend");
 }
 
+/*!
+ * \brief Create a batch of n samples of the same dimensions as the given
+ * one expression
+ *
+ * \param n The number of samples of the batch
+ * \param one The one expression
+ *
+ * \return the batch
+ */
+template<typename One>
+decltype(auto) batch_make(size_t n, const One& one){
+    if constexpr (etl::dimensions<One>() == 1) {
+        return etl::dyn_matrix<etl::value_t<One>, 2>(n, etl::dim<0>(one));
+    } else if constexpr (etl::dimensions<One>() == 2) {
+        return etl::dyn_matrix<etl::value_t<One>, 3>(n, etl::dim<0>(one), etl::dim<1>(one));
+    } else if constexpr (etl::dimensions<One>() == 3) {
+        return etl::dyn_matrix<etl::value_t<One>, 4>(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+    }
+
+    cpp_unreachable("Invalid selection in batch_make");
+}
+
+/*!
+ * \brief Create a batch of B samples of the same dimensions as the given
+ * one expression. The batch is fast if the one expression is fast.
+ *
+ * \param one The one expression
+ *
+ * \return the batch
+ */
+template<size_t B, typename One>
+decltype(auto) batch_make(const One& one){
+    if constexpr (etl::all_fast<One>) {
+        if constexpr (etl::dimensions<One>() == 1) {
+            return etl::fast_dyn_matrix<etl::value_t<One>, B, etl::dim<0, One>()>();
+        } else if constexpr (etl::dimensions<One>() == 2) {
+            return etl::fast_dyn_matrix<etl::value_t<One>, B, etl::dim<0, One>(), etl::dim<1, One>()>();
+        } else if constexpr (etl::dimensions<One>() == 3) {
+            return etl::fast_dyn_matrix<etl::value_t<One>, B, etl::dim<0, One>(), etl::dim<1, One>(), etl::dim<2, One>()>();
+        }
+    } else {
+        return batch_make(B, one);
+    }
+
+    cpp_unreachable("Invalid selection in batch_make");
+}
+
 } //end of dll namespace
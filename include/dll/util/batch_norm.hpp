@@ -0,0 +1,63 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file batch_norm.hpp
+ * \brief Training state of the batch normalization layers
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The workspace of a batch normalization layer.
+ *
+ * It holds the statistics of the mini-batch and the normalized inputs of
+ * the last training forward pass, which are needed by the backward pass.
+ * It is kept in the training context so that each shard of data-parallel
+ * training and each micro-batch of pipeline-parallel training has its own.
+ *
+ * \tparam S The type of the statistics
+ * \tparam P The type of the batch of normalized inputs
+ */
+template <typename S, typename P>
+struct batch_norm_workspace {
+    S last_mean; ///< The mean of the mini-batch
+    S last_var;  ///< The variance of the mini-batch
+    S inv_var;   ///< The inverse of the standard deviation of the mini-batch
+    P input_pre; ///< The normalized inputs of the mini-batch
+
+    /*!
+     * \brief Create a workspace with statistics of static size
+     */
+    batch_norm_workspace() = default;
+
+    /*!
+     * \brief Create a workspace with statistics of n values
+     */
+    explicit batch_norm_workspace(size_t n) : last_mean(n), last_var(n), inv_var(n) {}
+};
+
+/*!
+ * \brief Return the lock protecting the running statistics of the batch
+ * normalization layers.
+ *
+ * The shards of data-parallel training forward their mini-batches
+ * concurrently through the same layers, their updates of the running mean
+ * and variance are serialized.
+ */
+inline std::mutex& batch_norm_lock() {
+    static std::mutex lock;
+    return lock;
+}
+
+} //end of dll namespace
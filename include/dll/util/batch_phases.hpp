@@ -0,0 +1,40 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file batch_phases.hpp
+ * \brief Split of the time of a training batch between its phases
+ */
+
+#pragma once
+
+#include <chrono>
+
+namespace dll {
+
+/*!
+ * \brief The time spent by a training batch in each of its phases (seconds).
+ *
+ * The trainers that measure their passes fill forward, backward and update;
+ * the others only fill compute. The wait is measured by the dbn_trainer.
+ */
+struct batch_phases {
+    double wait     = 0.0; ///< The time waiting for the batch of the generator
+    double forward  = 0.0; ///< The time of the forward pass
+    double backward = 0.0; ///< The time of the backward pass
+    double update   = 0.0; ///< The time of the computation and application of the gradients
+    double compute  = 0.0; ///< The total time of the trainer for the batch
+
+    /*!
+     * \brief Returns the seconds between the two given times
+     */
+    static double seconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        return std::chrono::duration<double>(end - start).count();
+    }
+};
+
+} //end of dll namespace
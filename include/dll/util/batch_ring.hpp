@@ -0,0 +1,361 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file batch_ring.hpp
+ * \brief Lock-free ring of batch slots between the threads of a generator
+ * and its consumer.
+ *
+ * The batch i of an epoch is filled in the slot i % depth. The producers claim
+ * the batches in order with a single atomic counter and publish them with
+ * a release store of the batch number in the slot. The consumer waits for
+ * this number with an acquire load and frees the slot by incrementing the
+ * number of consumed batches.
+ *
+ * A thread only goes to sleep when there is nothing to do, i.e. when the
+ * ring is empty for the consumer or full for the producers. The sleeping
+ * threads are counted so that the hand-off of a batch only takes the
+ * sleep mutex when somebody is actually sleeping.
+ *
+ * Only the first depth slots of the ring are used. The depth is adapted on
+ * each reset: it is doubled when the consumer had to wait for the
+ * producers for more than 2% of the epoch and it is decreased by one when
+ * the consumer (almost) never waited while the producers had to wait for
+ * free slots. The slots beyond the largest depth reached are never
+ * touched, their memory is never committed.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace dll {
+
+/*!
+ * \brief The prefetching statistics of a generator
+ */
+struct prefetch_stats {
+    size_t depth    = 0; ///< The number of batches prefetched
+    size_t slots    = 0; ///< The maximum number of batches prefetched
+    size_t stall_ms = 0; ///< The time the consumer waited for batches since the last reset
+    size_t busy_ms  = 0; ///< The time the producers spent filling batches since the last reset
+};
+
+/*!
+ * \brief A ring of B batch slots, filled by several producers and read in
+ * order by a single consumer.
+ */
+template <size_t B>
+struct batch_ring {
+    static constexpr size_t slots = B;          ///< The number of slots
+    static constexpr size_t none  = size_t(-1); ///< The tag of an empty slot
+    static constexpr size_t spins = 256;        ///< The number of tries before sleeping
+
+    static constexpr size_t min_depth = std::min<size_t>(B, 2); ///< The minimum number of active slots
+
+    /*!
+     * \brief Construct a ring for the given number of batches per epoch
+     * \param batches The number of batches per epoch
+     * \param depth The initial number of active slots
+     */
+    explicit batch_ring(size_t batches, size_t depth = B) : batches(batches), depth(std::clamp(depth, min_depth, B)) {
+        for (auto& tag : ready) {
+            tag.store(none, std::memory_order_relaxed);
+        }
+
+        epoch_start = std::chrono::steady_clock::now();
+    }
+
+    batch_ring(const batch_ring& rhs) = delete;
+    batch_ring& operator=(const batch_ring& rhs) = delete;
+
+    /*!
+     * \brief Claim the next batch to fill and wait for its slot to be free.
+     *
+     * This blocks at the end of the epoch, until the ring is reset.
+     *
+     * \param batch The claimed batch
+     * \return true if a batch has been claimed, false if the ring is stopped
+     */
+    bool acquire(size_t& batch) {
+        while (true) {
+            wait_for([this] { return stopped.load(std::memory_order_acquire) || !paused.load(std::memory_order_acquire); });
+
+            if (stopped.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            // Announce the claim before checking the pause, see reset()
+            inflight.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (paused.load(std::memory_order_relaxed)) {
+                leave();
+                continue;
+            }
+
+            size_t b = claimed.load(std::memory_order_relaxed);
+
+            while (b < batches && !claimed.compare_exchange_weak(b, b + 1, std::memory_order_relaxed)) {}
+
+            // The end of the epoch, wait for the reset
+            if (b >= batches) {
+                leave();
+
+                wait_for([this] {
+                    return stopped.load(std::memory_order_acquire) || paused.load(std::memory_order_acquire)
+                           || claimed.load(std::memory_order_relaxed) < batches;
+                });
+
+                continue;
+            }
+
+            // Wait for the slot to be freed by the consumer
+            timed_wait(full_ns, [this, b] {
+                return stopped.load(std::memory_order_acquire) || paused.load(std::memory_order_acquire)
+                       || b < consumed.load(std::memory_order_acquire) + depth.load(std::memory_order_relaxed);
+            });
+
+            if (stopped.load(std::memory_order_acquire) || paused.load(std::memory_order_acquire)) {
+                // The claim is dropped, the reset starts again from zero
+                leave();
+                continue;
+            }
+
+            batch = b;
+
+            // Only the producer holding the claim uses this slot until it is published
+            claim_times[slot(b)] = std::chrono::steady_clock::now();
+
+            return true;
+        }
+    }
+
+    /*!
+     * \brief Publish a batch that has been filled
+     */
+    void publish(size_t batch) {
+        const auto busy = std::chrono::steady_clock::now() - claim_times[slot(batch)];
+
+        busy_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count(), std::memory_order_relaxed);
+
+        ready[slot(batch)].store(batch, std::memory_order_release);
+        leave();
+    }
+
+    /*!
+     * \brief Returns the slot of the given batch
+     */
+    size_t slot(size_t batch) const {
+        return batch % depth.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Wait for the given batch to be published
+     */
+    void wait_ready(size_t batch) const {
+        timed_wait(stall_ns, [this, batch] { return ready[slot(batch)].load(std::memory_order_acquire) == batch; });
+    }
+
+    /*!
+     * \brief Returns the prefetching statistics of the ring
+     */
+    prefetch_stats stats() const {
+        prefetch_stats stats;
+
+        stats.depth    = depth.load(std::memory_order_relaxed);
+        stats.slots    = B;
+        stats.stall_ms = stall_ns.load(std::memory_order_relaxed) / 1000000;
+        stats.busy_ms  = busy_ns.load(std::memory_order_relaxed) / 1000000;
+
+        return stats;
+    }
+
+    /*!
+     * \brief Free the slot of the oldest batch of the ring
+     */
+    void release() {
+        consumed.fetch_add(1, std::memory_order_release);
+        wake();
+    }
+
+    /*!
+     * \brief Restart the generation from the first batch.
+     *
+     * The producers are paused and the functor is called once none of
+     * them is filling a batch anymore.
+     */
+    template <typename Functor>
+    void reset(Functor&& functor) {
+        paused.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        wake();
+
+        wait_for([this] { return inflight.load(std::memory_order_acquire) == 0; });
+
+        functor();
+
+        adapt();
+
+        claimed.store(0, std::memory_order_relaxed);
+        consumed.store(0, std::memory_order_relaxed);
+
+        for (auto& tag : ready) {
+            tag.store(none, std::memory_order_relaxed);
+        }
+
+        paused.store(false, std::memory_order_release);
+        wake();
+    }
+
+    /*!
+     * \brief Restart the generation from the first batch.
+     */
+    void reset() {
+        reset([] {});
+    }
+
+    /*!
+     * \brief Stop the ring, every waiting producer returns.
+     */
+    void stop() {
+        stopped.store(true, std::memory_order_release);
+        wake();
+    }
+
+private:
+    /*!
+     * \brief Adapt the number of active slots to the rates of the producers
+     * and of the consumer since the last reset.
+     *
+     * This is only called when no producer holds a claim.
+     */
+    void adapt() {
+        const auto now = std::chrono::steady_clock::now();
+
+        const size_t epoch_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - epoch_start).count();
+        const size_t stall    = stall_ns.exchange(0, std::memory_order_relaxed);
+        const size_t full     = full_ns.exchange(0, std::memory_order_relaxed);
+
+        busy_ns.store(0, std::memory_order_relaxed);
+
+        epoch_start = now;
+
+        // Nothing has been consumed, nothing can be learned
+        if (!consumed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        const size_t d = depth.load(std::memory_order_relaxed);
+
+        if (stall * 50 > epoch_ns) {
+            depth.store(std::min(B, 2 * d), std::memory_order_relaxed);
+        } else if (stall * 1000 < epoch_ns && full && d > min_depth) {
+            depth.store(d - 1, std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+     * \brief Wait until the given condition holds and add the waiting time
+     * to the given counter.
+     */
+    template <typename Pred>
+    void timed_wait(std::atomic<size_t>& counter, Pred&& pred) const {
+        if (pred()) {
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        wait_for(pred);
+
+        const auto end = std::chrono::steady_clock::now();
+
+        counter.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Release a claim of a producer
+     */
+    void leave() {
+        inflight.fetch_sub(1, std::memory_order_release);
+        wake();
+    }
+
+    /*!
+     * \brief Wake up the sleeping threads, if any.
+     *
+     * The fence orders the previous store with the load of the number of
+     * sleepers, the same fence in wait_for() orders the increment of the
+     * sleepers with the check of the condition. Either the sleeper sees
+     * the new state or it is seen here and woken up.
+     */
+    void wake() const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (sleepers.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            sleep_condition.notify_all();
+        }
+    }
+
+    /*!
+     * \brief Wait until the given condition holds, spinning for a short
+     * time before going to sleep.
+     */
+    template <typename Pred>
+    void wait_for(Pred&& pred) const {
+        for (size_t i = 0; i < spins; ++i) {
+            if (pred()) {
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_lock);
+
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        sleep_condition.wait(lock, pred);
+
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    const size_t batches; ///< The number of batches in an epoch
+
+    std::atomic<size_t> claimed{0};   ///< The next batch to fill
+    std::atomic<size_t> consumed{0};  ///< The number of batches freed by the consumer
+    std::atomic<size_t> inflight{0};  ///< The number of producers holding a claim
+    std::atomic<bool> paused{false};  ///< Indicates that a reset is in progress
+    std::atomic<bool> stopped{false}; ///< Indicates that the producers must exit
+    std::atomic<size_t> depth;        ///< The number of active slots
+
+    mutable std::atomic<size_t> stall_ns{0}; ///< The time the consumer waited for the producers
+    mutable std::atomic<size_t> full_ns{0};  ///< The time the producers waited for free slots
+    std::atomic<size_t> busy_ns{0};          ///< The time the producers spent filling batches
+
+    std::chrono::steady_clock::time_point epoch_start; ///< The time of the last reset
+
+    std::array<std::atomic<size_t>, B> ready; ///< The batch published in each slot
+
+    std::array<std::chrono::steady_clock::time_point, B> claim_times; ///< The time each slot was claimed by a producer
+
+    mutable std::atomic<size_t> sleepers{0};         ///< The number of sleeping threads
+    mutable std::mutex sleep_lock;                   ///< The lock for sleeping
+    mutable std::condition_variable sleep_condition; ///< The condition for sleeping
+};
+
+} //end of dll namespace
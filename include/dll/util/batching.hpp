@@ -0,0 +1,293 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file batching.hpp
+ * \brief Dynamic micro-batching of single-sample inference requests
+ *
+ * Forwarding samples one by one through a network leaves most of the
+ * throughput of the matrix multiplications unused. The batching executor
+ * queues the incoming samples and forwards them together: a batch is
+ * formed as soon as max_batch samples are waiting or the oldest waiting
+ * sample has waited for the deadline, whichever comes first. Each request
+ * is completed through its own future.
+ *
+ * Each worker thread of the executor has its own inference_context, so
+ * several workers can forward batches at the same time.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dll/util/inference.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The statistics of a batching executor
+ */
+struct batching_stats {
+    size_t requests        = 0;   ///< The number of completed requests
+    size_t batches         = 0;   ///< The number of forwarded batches
+    double mean_batch_size = 0.0; ///< The mean number of samples of a batch
+    double mean_latency    = 0.0; ///< The mean latency of a request, in milliseconds
+    double max_latency     = 0.0; ///< The maximum latency of a request, in milliseconds
+    double throughput      = 0.0; ///< The number of requests per second, since the first request
+};
+
+/*!
+ * \brief Executor batching single-sample inference requests on a network.
+ *
+ * The network must not be modified while the executor is running. The
+ * waiting requests are all completed before the executor is destroyed.
+ *
+ * \tparam DBN The network type
+ * \tparam Sample The type of one input sample
+ * \tparam B The maximum number of samples of a batch
+ */
+template <typename DBN, typename Sample, size_t B = DBN::batch_size>
+struct batching_executor {
+    using dbn_t      = DBN;                               ///< The network type
+    using context_t  = inference_context<DBN, Sample, B>; ///< The type of the inference contexts
+    using output_t   = typename context_t::output_t;      ///< The output of one sample
+    using future_t   = std::future<output_t>;             ///< The future of a request
+    using clock_type = std::chrono::steady_clock;         ///< The clock of the latencies
+
+    static constexpr size_t batch_size = B; ///< The maximum number of samples of a batch
+
+    /*!
+     * \brief Create a batching executor and start its workers
+     * \param dbn The network, which must outlive the executor
+     * \param sample A sample, only used for its dimensions
+     * \param max_batch The maximum number of samples of a batch (at most B)
+     * \param deadline The maximum time waited by a request before its batch is forwarded
+     * \param workers The number of worker threads
+     */
+    batching_executor(const dbn_t& dbn, const Sample& sample, size_t max_batch = B,
+                      std::chrono::microseconds deadline = std::chrono::microseconds(2000), size_t workers = 1)
+            : prototype(context_t::make_output(dbn, sample)), max_batch(std::max<size_t>(1, std::min(max_batch, B))), deadline(deadline) {
+        cpp_assert(max_batch <= B, "max_batch cannot be larger than the batch size of the executor");
+
+        for (size_t w = 0; w < std::max<size_t>(1, workers); ++w) {
+            auto state = std::make_unique<worker_state>(dbn, sample);
+            threads.emplace_back(&batching_executor::work, this, std::ref(*state));
+            states.push_back(std::move(state));
+        }
+    }
+
+    batching_executor(const batching_executor& rhs) = delete;
+    batching_executor& operator=(const batching_executor& rhs) = delete;
+
+    /*!
+     * \brief Complete the waiting requests and stop the workers
+     */
+    ~batching_executor() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stopping = true;
+        }
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Submit a sample for inference
+     * \param sample The input sample, which is copied
+     * \return The future output of the network for the sample
+     */
+    future_t submit(const Sample& sample) {
+        request r{sample, std::promise<output_t>(), clock_type::now()};
+        auto future = r.promise.get_future();
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (!started) {
+                started = true;
+                first   = r.arrival;
+            }
+
+            queue.push_back(std::move(r));
+        }
+
+        condition.notify_one();
+
+        return future;
+    }
+
+    /*!
+     * \brief Returns the statistics of the executor
+     */
+    batching_stats stats() const {
+        std::lock_guard<std::mutex> l(lock);
+
+        batching_stats s;
+
+        s.requests = requests;
+        s.batches  = batches;
+
+        if (batches) {
+            s.mean_batch_size = double(requests) / batches;
+        }
+
+        if (requests) {
+            s.mean_latency = std::chrono::duration<double, std::milli>(total_latency).count() / requests;
+            s.max_latency  = std::chrono::duration<double, std::milli>(max_latency).count();
+
+            const double elapsed = std::chrono::duration<double>(last - first).count();
+
+            if (elapsed > 0.0) {
+                s.throughput = requests / elapsed;
+            }
+        }
+
+        return s;
+    }
+
+private:
+    /*!
+     * \brief A waiting request
+     */
+    struct request {
+        Sample sample;                  ///< The input sample
+        std::promise<output_t> promise; ///< The promise of the output
+        clock_type::time_point arrival; ///< The submission time
+    };
+
+    /*!
+     * \brief The buffers of a worker
+     */
+    struct worker_state {
+        context_t context;                 ///< The inference context of the worker
+        typename context_t::input_t batch; ///< The input batch
+        std::vector<request> current;      ///< The requests of the current batch
+
+        /*!
+         * \brief Create the buffers for the given network
+         */
+        worker_state(const dbn_t& dbn, const Sample& sample)
+                : context(dbn, sample), batch(batch_make<B>(sample)) {
+            current.reserve(B);
+        }
+    };
+
+    /*!
+     * \brief The loop of a worker thread
+     */
+    void work(worker_state& state) {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                condition.wait(l, [this] { return stopping || !queue.empty(); });
+
+                if (queue.empty()) {
+                    return;
+                }
+
+                // Wait for a complete batch, at most until the deadline of the oldest request
+                const auto limit = queue.front().arrival + deadline;
+
+                condition.wait_until(l, limit, [this] { return stopping || queue.empty() || queue.size() >= max_batch; });
+
+                // Another worker may have taken the requests
+                if (queue.empty()) {
+                    continue;
+                }
+
+                const size_t n = std::min(queue.size(), max_batch);
+
+                for (size_t i = 0; i < n; ++i) {
+                    state.current.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+
+            // The remaining requests may already form a batch
+            condition.notify_one();
+
+            forward(state);
+        }
+    }
+
+    /*!
+     * \brief Forward the current batch of a worker and complete its requests
+     */
+    void forward(worker_state& state) {
+        const size_t n = state.current.size();
+
+        for (size_t i = 0; i < n; ++i) {
+            state.batch(i) = state.current[i].sample;
+        }
+
+        // Only the n samples are forwarded, without padding in the layers with partial batches
+        auto& output = state.context.forward_batch(etl::slice(state.batch, 0, n));
+
+        const auto end = clock_type::now();
+
+        auto batch_latency = clock_type::duration::zero();
+        auto batch_max     = clock_type::duration::zero();
+
+        for (size_t i = 0; i < n; ++i) {
+            output_t result(prototype);
+            result = output(i);
+
+            state.current[i].promise.set_value(std::move(result));
+
+            const auto latency = end - state.current[i].arrival;
+
+            batch_latency += latency;
+            batch_max = std::max(batch_max, latency);
+        }
+
+        state.current.clear();
+
+        std::lock_guard<std::mutex> l(lock);
+
+        requests += n;
+        ++batches;
+        total_latency += batch_latency;
+        max_latency = std::max(max_latency, batch_max);
+        last        = std::max(last, end);
+    }
+
+    const output_t prototype;                 ///< An output of the network, for its dimensions
+    const size_t max_batch;                   ///< The maximum number of samples of a batch
+    const std::chrono::microseconds deadline; ///< The maximum waiting time of a request
+
+    mutable std::mutex lock;           ///< The lock protecting the queue and the statistics
+    std::condition_variable condition; ///< The condition of the workers
+    std::deque<request> queue;         ///< The waiting requests
+    bool stopping = false;             ///< Indicates if the executor is being destroyed
+
+    std::vector<std::unique_ptr<worker_state>> states; ///< The buffers of the workers
+    std::vector<std::thread> threads;                  ///< The worker threads
+
+    bool started                       = false;                        ///< Indicates if a request has been submitted
+    size_t requests                    = 0;                            ///< The number of completed requests
+    size_t batches                     = 0;                            ///< The number of forwarded batches
+    clock_type::duration total_latency = clock_type::duration::zero(); ///< The total latency of the completed requests
+    clock_type::duration max_latency   = clock_type::duration::zero(); ///< The maximum latency of a request
+    clock_type::time_point first;                                      ///< The time of the first request
+    clock_type::time_point last;                                       ///< The time of the last completed batch
+};
+
+} //end of dll namespace
@@ -0,0 +1,123 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file bitpack.hpp
+ * \brief Bit-packed binary matrices and XNOR/popcount products
+ *
+ * A binary value (the result of binarize_pre or of a sign) only needs one
+ * bit: a bit_matrix stores each row in 64 bits words, 32 times smaller than
+ * floats. The bit 1 stands for +1 and the bit 0 for -1, so that the dot
+ * product of two binary rows of K values is K - 2 * popcount(a XOR b).
+ * The unused bits of the last word of each row are zero in both operands
+ * and never count as differences.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dll/util/isa.hpp" // For DLL_MULTI_ISA_KERNEL
+
+namespace dll {
+
+/*!
+ * \brief A row-major matrix of bits, each row padded to 64 bits words
+ */
+struct bit_matrix {
+    size_t rows  = 0;           ///< The number of rows
+    size_t cols  = 0;           ///< The number of binary values of each row
+    size_t words = 0;           ///< The number of words of each row
+    std::vector<uint64_t> bits; ///< The words of the rows
+
+    bit_matrix() = default;
+
+    /*!
+     * \brief Create a matrix of the given dimensions, all the bits being 0
+     */
+    bit_matrix(size_t rows, size_t cols) : rows(rows), cols(cols), words((cols + 63) / 64), bits(rows * words) {}
+
+    /*!
+     * \brief Returns the words of the given row
+     */
+    const uint64_t* row(size_t i) const {
+        return bits.data() + i * words;
+    }
+
+    /*!
+     * \brief Returns the size of the matrix, in bytes
+     */
+    size_t memory() const {
+        return bits.size() * sizeof(uint64_t);
+    }
+};
+
+/*!
+ * \brief Pack the given row-major values into a bit matrix, a value
+ * greater than the threshold being +1.
+ *
+ * \param values The values [rows, cols]
+ * \param threshold The threshold of the binarization
+ * \param transpose If true, the values are [cols, rows] and their
+ * columns are packed as the rows of the matrix
+ */
+template <typename T>
+bit_matrix pack_bits(const T* values, size_t rows, size_t cols, T threshold, bool transpose = false) {
+    bit_matrix m(rows, cols);
+
+    for (size_t i = 0; i < rows; ++i) {
+        uint64_t* r = m.bits.data() + i * m.words;
+
+        for (size_t j = 0; j < cols; ++j) {
+            const T v = transpose ? values[j * rows + i] : values[i * cols + j];
+
+            if (v > threshold) {
+                r[j / 64] |= uint64_t(1) << (j % 64);
+            }
+        }
+    }
+
+    return m;
+}
+
+/*!
+ * \brief Compute the binary products C [M, N] = A [M, K] * B [N, K]^T of
+ * +1/-1 values, scaled by the given scale of each column of C.
+ *
+ * \param c The output
+ * \param a The bit rows of the first operand
+ * \param b The bit rows of the second operand (one row per column of C)
+ * \param scales The scale of each column of C
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void xnor_popcount_gemm(T* c, const bit_matrix& a, const bit_matrix& b, const T* scales) {
+    const size_t M     = a.rows;
+    const size_t N     = b.rows;
+    const size_t K     = a.cols;
+    const size_t words = a.words;
+
+    for (size_t m = 0; m < M; ++m) {
+        const uint64_t* a_m = a.row(m);
+        T* c_m              = c + m * N;
+
+        for (size_t n = 0; n < N; ++n) {
+            const uint64_t* b_n = b.row(n);
+
+            size_t different = 0;
+
+            for (size_t k = 0; k < words; ++k) {
+                different += __builtin_popcountll(a_m[k] ^ b_n[k]);
+            }
+
+            c_m[n] = scales[n] * (T(K) - T(2 * different));
+        }
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,271 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file cascade.hpp
+ * \brief Early-exit inference with auxiliary classifiers
+ *
+ * Most samples are easy to classify and do not need all the layers of a
+ * deep network. In a cascade, auxiliary classifiers (heads) are attached to
+ * the outputs of some intermediate layers. A sample for which the head
+ * is confident enough (its largest probability reaches the threshold of
+ * the head) exits at this head. The samples that did not exit are
+ * compacted into a smaller batch before the following layers, which
+ * therefore only compute the hard samples.
+ *
+ * The network and the heads must be classifiers, with outputs of the same
+ * dimensions (N x classes).
+ */
+
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/batch_extend.hpp"
+#include "dll/util/topk.hpp"
+
+namespace dll {
+
+/*!
+ * \brief An auxiliary classifier attached to the output of the layer L of a
+ * network.
+ *
+ * \tparam L The layer of the network whose output is given to the head
+ * \tparam Head The type of the head, a network taking the output of L
+ */
+template <size_t L, typename Head>
+struct exit_head_t {
+    static constexpr size_t layer = L; ///< The layer whose output is given to the head
+
+    const Head& head; ///< The classifier
+    double threshold; ///< The probability above which a sample exits
+};
+
+/*!
+ * \brief Create an auxiliary classifier attached to the output of the layer L
+ * \param head The classifier, which must outlive the cascade
+ * \param threshold The probability above which a sample exits
+ */
+template <size_t L, typename Head>
+exit_head_t<L, Head> exit_head(const Head& head, double threshold) {
+    return {head, threshold};
+}
+
+/*!
+ * \brief The statistics of a cascade
+ */
+struct cascade_stats {
+    size_t samples = 0;        ///< The number of forwarded samples
+    std::vector<size_t> exits; ///< The number of samples exiting at each head, the last being the full network
+    double mean_depth = 0.0;   ///< The mean number of layers of the network computed per sample
+};
+
+/*!
+ * \brief Early-exit inference of a network, with auxiliary classifiers.
+ *
+ * A cascade must only be used by one thread at a time and the network and
+ * the heads must not be modified while it is used.
+ *
+ * \tparam DBN The network type
+ * \tparam Exits The auxiliary classifiers, in increasing order of layers
+ */
+template <typename DBN, typename... Exits>
+struct cascade_inference {
+    using dbn_t    = DBN;                        ///< The network type
+    using weight   = typename dbn_t::weight;     ///< The type of the probabilities
+    using output_t = etl::dyn_matrix<weight, 2>; ///< The type of the output of a batch
+
+    static constexpr size_t layers = dbn_t::layers;    ///< The number of layers of the network
+    static constexpr size_t heads  = sizeof...(Exits); ///< The number of auxiliary classifiers
+
+    /*!
+     * \brief Create a cascade
+     * \param dbn The network, which must outlive the cascade
+     * \param exits The auxiliary classifiers
+     */
+    explicit cascade_inference(const dbn_t& dbn, Exits... exits) : dbn(dbn), exits(exits...), counts(heads + 1, 0) {}
+
+    /*!
+     * \brief Forward the given batch through the cascade
+     *
+     * \param batch The batch of inputs
+     * \param depths The exit of each sample (heads for the full network)
+     *
+     * \return The probabilities of each sample, computed by its exit
+     */
+    template <typename Input>
+    output_t forward_batch(const Input& batch, std::vector<size_t>& depths) {
+        static dll::timer_id timer_handle("net:cascade:forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        const size_t n = etl::dim<0>(batch);
+
+        output_t output(n, dbn.output_size());
+
+        depths.assign(n, heads);
+
+        std::vector<size_t> rows(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            rows[i] = i;
+        }
+
+        if (n) {
+            forward_stage<0, 0>(batch, rows, output, depths);
+        }
+
+        samples += n;
+
+        for (auto depth : depths) {
+            ++counts[depth];
+        }
+
+        return output;
+    }
+
+    /*!
+     * \brief Forward the given batch through the cascade
+     * \param batch The batch of inputs
+     * \return The probabilities of each sample, computed by its exit
+     */
+    template <typename Input>
+    output_t forward_batch(const Input& batch) {
+        std::vector<size_t> depths;
+        return forward_batch(batch, depths);
+    }
+
+    /*!
+     * \brief Predict the label of each sample of the given batch
+     * \param batch The batch of inputs
+     * \return The label of each sample
+     */
+    template <typename Input>
+    std::vector<size_t> predict_batch(const Input& batch) {
+        auto output = forward_batch(batch);
+
+        std::vector<size_t> labels;
+        labels.reserve(etl::dim<0>(batch));
+
+        argmax_rows(output, etl::dim<0>(batch), labels);
+
+        return labels;
+    }
+
+    /*!
+     * \brief Returns the statistics of the cascade
+     */
+    cascade_stats stats() const {
+        cascade_stats s;
+
+        s.samples = samples;
+        s.exits   = counts;
+
+        if (samples) {
+            double depth = 0.0;
+
+            for (size_t e = 0; e < heads + 1; ++e) {
+                depth += double(counts[e]) * exit_depth(e);
+            }
+
+            s.mean_depth = depth / samples;
+        }
+
+        return s;
+    }
+
+private:
+    /*!
+     * \brief Returns the number of layers of the network computed by a
+     * sample exiting at the given exit.
+     */
+    template <size_t E = 0>
+    static size_t exit_depth(size_t e) {
+        if constexpr (E < heads) {
+            if (e == E) {
+                return std::tuple_element_t<E, std::tuple<Exits...>>::layer + 1;
+            }
+
+            return exit_depth<E + 1>(e);
+        } else {
+            cpp_unused(e);
+            return layers;
+        }
+    }
+
+    /*!
+     * \brief Forward the remaining samples from the layer S to the exit E.
+     *
+     * \param input The remaining samples, given to the layer S
+     * \param rows The index in the batch of each remaining sample
+     * \param output The output of the batch
+     * \param depths The exit of each sample of the batch
+     */
+    template <size_t E, size_t S, typename Input>
+    void forward_stage(const Input& input, const std::vector<size_t>& rows, output_t& output, std::vector<size_t>& depths) {
+        if constexpr (E < heads) {
+            auto& exit = std::get<E>(exits);
+
+            constexpr size_t L = std::decay_t<decltype(exit)>::layer;
+
+            static_assert(L >= S, "The heads must be attached in increasing order of layers");
+            static_assert(L + 1 < layers, "A head cannot be attached to the last layer");
+
+            decltype(auto) features = dbn.template forward_batch<L, S>(input);
+            decltype(auto) probs    = exit.head.forward_batch(features);
+
+            cpp_assert(etl::dim<1>(probs) == etl::dim<1>(output), "The heads must have the outputs of the network");
+
+            // The confident samples exit, the others are kept for the next stage
+
+            std::vector<size_t> keep;
+            std::vector<size_t> next_rows;
+
+            for (size_t i = 0; i < rows.size(); ++i) {
+                if (etl::max(probs(i)) >= exit.threshold) {
+                    output(rows[i]) = probs(i);
+                    depths[rows[i]] = E;
+                } else {
+                    keep.push_back(i);
+                    next_rows.push_back(rows[i]);
+                }
+            }
+
+            if (keep.empty()) {
+                return;
+            }
+
+            if (keep.size() == rows.size()) {
+                forward_stage<E + 1, L + 1>(features, rows, output, depths);
+                return;
+            }
+
+            auto next = batch_make(keep.size(), features(0));
+
+            for (size_t i = 0; i < keep.size(); ++i) {
+                next(i) = features(keep[i]);
+            }
+
+            forward_stage<E + 1, L + 1>(next, next_rows, output, depths);
+        } else {
+            decltype(auto) probs = dbn.template forward_batch<layers - 1, S>(input);
+
+            for (size_t i = 0; i < rows.size(); ++i) {
+                output(rows[i]) = probs(i);
+            }
+        }
+    }
+
+    const dbn_t& dbn;           ///< The network
+    std::tuple<Exits...> exits; ///< The auxiliary classifiers
+    std::vector<size_t> counts; ///< The number of samples exiting at each exit
+    size_t samples = 0;         ///< The number of forwarded samples
+};
+
+} //end of dll namespace
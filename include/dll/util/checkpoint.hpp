@@ -0,0 +1,583 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file checkpoint.hpp
+ * \brief Single-blob binary checkpoints of networks, loaded with mmap
+ *
+ * A checkpoint is made of:
+ *
+ *  - A header of 64 bytes (magic, version, size of the stored values,
+ *    number of layers and tensors, checksum, length of the file and
+ *    precision).
+ *  - A table of 64 bytes per tensor (hash of the description of the layer,
+ *    index of the layer, dimensions and offset of the tensor).
+ *  - For INT8 checkpoints, the scale of each tensor (float).
+ *  - The tensors, contiguous, each starting at a 64-byte aligned offset.
+ *
+ * The values are stored in the byte order of the host, either in the type
+ * of the weights or in a reduced precision (fp16, bf16 or INT8 with one
+ * symmetric scale per tensor), widened back to the type of the weights when
+ * loaded.
+ *
+ * A checkpoint is mapped in memory (checkpoint_file), which gives read-only
+ * and aligned access to the tensors directly in the mapped pages, paged in
+ * lazily and shared across the processes mapping the same file. Since the
+ * layers own their weights, loading a checkpoint into a network costs one
+ * copy per tensor out of the mapping.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_traits.hpp"
+#include "dll/datasets/mapped.hpp"
+#include "dll/util/fold.hpp"
+#include "dll/util/precision.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The precision of the values stored in a checkpoint
+ */
+enum class checkpoint_precision : uint32_t {
+    NATIVE = 0, ///< The type of the weights
+    FP16   = 1, ///< IEEE half precision
+    BF16   = 2, ///< Brain floating point
+    INT8   = 3  ///< Symmetric INT8, with one scale per tensor
+};
+
+/*!
+ * \brief The header of a checkpoint
+ */
+struct checkpoint_header {
+    uint32_t magic;      ///< The magic number ("DLLC")
+    uint32_t version;    ///< The version of the format
+    uint32_t dtype;      ///< The size of the stored values, in bytes
+    uint32_t layers;     ///< The number of layers of the network
+    uint64_t tensors;    ///< The number of tensors
+    uint64_t checksum;   ///< The checksum of the table and of the tensors
+    uint64_t length;     ///< The length of the file, in bytes
+    uint32_t precision;  ///< The precision of the stored values (checkpoint_precision)
+    uint8_t padding[20]; ///< Padding up to 64 bytes
+};
+
+/*!
+ * \brief The description of one tensor of a checkpoint
+ */
+struct checkpoint_tensor {
+    uint64_t layer_type; ///< The hash of the description of the layer
+    uint32_t layer;      ///< The index of the layer in the network
+    uint32_t dimensions; ///< The number of dimensions of the tensor
+    uint64_t dims[4];    ///< The dimensions of the tensor
+    uint64_t offset;     ///< The offset of the tensor in the file, in bytes
+    uint64_t size;       ///< The number of elements of the tensor
+};
+
+static_assert(sizeof(checkpoint_header) == 64, "Invalid size of checkpoint_header");
+static_assert(sizeof(checkpoint_tensor) == 64, "Invalid size of checkpoint_tensor");
+
+constexpr uint32_t checkpoint_magic   = 0x434C4C44; ///< The magic number of the checkpoints ("DLLC")
+constexpr uint32_t checkpoint_version = 1;          ///< The version of the checkpoints
+constexpr size_t checkpoint_alignment = 64;         ///< The alignment of the tensors of the checkpoints
+
+namespace detail {
+
+/*!
+ * \brief Returns the offset aligned to the alignment of the checkpoints
+ */
+inline uint64_t checkpoint_align(uint64_t offset) {
+    return (offset + checkpoint_alignment - 1) & ~uint64_t(checkpoint_alignment - 1);
+}
+
+/*!
+ * \brief Hash the given bytes into the given hash (FNV-1a)
+ */
+inline uint64_t checkpoint_hash(uint64_t hash, const void* data, size_t n) {
+    auto* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < n; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+constexpr uint64_t checkpoint_seed = 14695981039346656037ULL; ///< The initial value of the hashes
+
+/*!
+ * \brief Returns the size of the values stored with the given precision
+ */
+template <typename W>
+uint32_t checkpoint_dtype(checkpoint_precision precision) {
+    switch (precision) {
+        case checkpoint_precision::FP16:
+        case checkpoint_precision::BF16:
+            return 2;
+        case checkpoint_precision::INT8:
+            return 1;
+        default:
+            return sizeof(W);
+    }
+}
+
+/*!
+ * \brief Returns the offset of the scales of the tensors of a checkpoint
+ */
+inline uint64_t checkpoint_scales(uint64_t tensors) {
+    return sizeof(checkpoint_header) + tensors * sizeof(checkpoint_tensor);
+}
+
+/*!
+ * \brief Store n values converted to the given precision
+ * \return The scale of the values (only for INT8)
+ */
+template <typename W>
+float narrow_checkpoint(const W* values, size_t n, char* out, checkpoint_precision precision) {
+    float scale = 1.0f;
+
+    if (precision == checkpoint_precision::FP16 || precision == checkpoint_precision::BF16) {
+        auto* out16 = reinterpret_cast<uint16_t*>(out);
+
+        for (size_t i = 0; i < n; ++i) {
+            out16[i] = precision == checkpoint_precision::FP16 ? float_to_half(values[i]) : float_to_bf16(values[i]);
+        }
+    } else if (precision == checkpoint_precision::INT8) {
+        auto* out8 = reinterpret_cast<int8_t*>(out);
+
+        scale = int8_scale(values, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            out8[i] = float_to_int8(values[i], scale);
+        }
+    } else {
+        std::memcpy(out, values, n * sizeof(W));
+    }
+
+    return scale;
+}
+
+/*!
+ * \brief Load n values stored with the given precision
+ */
+template <typename W>
+void widen_checkpoint(const char* in, size_t n, W* values, checkpoint_precision precision, float scale) {
+    if (precision == checkpoint_precision::FP16 || precision == checkpoint_precision::BF16) {
+        uint16_t v;
+
+        for (size_t i = 0; i < n; ++i) {
+            std::memcpy(&v, in + i * sizeof(v), sizeof(v));
+            values[i] = precision == checkpoint_precision::FP16 ? half_to_float(v) : bf16_to_float(v);
+        }
+    } else if (precision == checkpoint_precision::INT8) {
+        auto* in8 = reinterpret_cast<const int8_t*>(in);
+
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = W(in8[i] * scale);
+        }
+    } else {
+        std::memcpy(values, in, n * sizeof(W));
+    }
+}
+
+/*!
+ * \brief Returns the tensors of the given layer stored in a checkpoint,
+ * the same as the ones saved by its store() function.
+ */
+template <typename L>
+decltype(auto) checkpoint_tensors(const L& layer) {
+    if constexpr (is_foldable_normalization<L>) {
+        return std::make_tuple(std::cref(layer.gamma), std::cref(layer.beta), std::cref(layer.mean), std::cref(layer.var));
+    } else if constexpr (decay_layer_traits<L>::is_rbm_layer()) {
+        return std::make_tuple(std::cref(layer.w), std::cref(layer.b), std::cref(layer.c));
+    } else {
+        return layer.trainable_parameters();
+    }
+}
+
+/*!
+ * \brief Call functor(l, layer_type, tensor) for each tensor of each neural
+ * layer l of the given network, in order.
+ */
+template <typename DBN, typename Functor>
+void for_each_checkpoint_tensor(const DBN& dbn, Functor&& functor) {
+    size_t l = 0;
+
+    dbn.for_each_layer([&functor, &l](auto& layer) {
+        if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+            const auto description = layer.to_short_string("");
+            const auto layer_type  = checkpoint_hash(checkpoint_seed, description.c_str(), description.size());
+
+            auto tensors = checkpoint_tensors(layer);
+
+            cpp::for_each(tensors, [&functor, l, layer_type](auto& tensor) {
+                functor(l, layer_type, tensor.get());
+            });
+        }
+
+        ++l;
+    });
+}
+
+/*!
+ * \brief Returns the table of the tensors of a checkpoint of the given
+ * network, with the offsets of the tensors stored with the given precision.
+ */
+template <typename DBN>
+std::vector<checkpoint_tensor> checkpoint_table(const DBN& dbn, checkpoint_precision precision) {
+    std::vector<checkpoint_tensor> table;
+
+    for_each_checkpoint_tensor(dbn, [&table](size_t l, uint64_t layer_type, auto& tensor) {
+        using tensor_t = std::decay_t<decltype(tensor)>;
+
+        static_assert(etl::dimensions<tensor_t>() <= 4, "The checkpoints only support tensors of at most 4 dimensions");
+        static_assert(std::is_same<etl::value_t<tensor_t>, typename DBN::weight>::value, "The checkpoints only support tensors of weights");
+
+        checkpoint_tensor entry = {};
+
+        entry.layer_type = layer_type;
+        entry.layer      = l;
+        entry.dimensions = etl::dimensions(tensor);
+        entry.size       = etl::size(tensor);
+
+        for (size_t d = 0; d < etl::dimensions(tensor); ++d) {
+            entry.dims[d] = etl::dim(tensor, d);
+        }
+
+        table.push_back(entry);
+    });
+
+    const size_t scales = precision == checkpoint_precision::INT8 ? table.size() * sizeof(float) : 0;
+    const size_t dtype  = checkpoint_dtype<typename DBN::weight>(precision);
+
+    uint64_t offset = checkpoint_align(checkpoint_scales(table.size()) + scales);
+
+    for (auto& entry : table) {
+        entry.offset = offset;
+        offset       = checkpoint_align(offset + entry.size * dtype);
+    }
+
+    return table;
+}
+
+/*!
+ * \brief Returns the checksum of the table and of the tensors of the given
+ * checkpoint, whose table must be valid.
+ */
+inline uint64_t checkpoint_checksum(const char* data) {
+    const auto& header = *reinterpret_cast<const checkpoint_header*>(data);
+    const auto* table  = reinterpret_cast<const checkpoint_tensor*>(data + sizeof(checkpoint_header));
+
+    uint64_t checksum = checkpoint_hash(checkpoint_seed, table, header.tensors * sizeof(checkpoint_tensor));
+
+    if (checkpoint_precision(header.precision) == checkpoint_precision::INT8) {
+        checksum = checkpoint_hash(checksum, data + checkpoint_scales(header.tensors), header.tensors * sizeof(float));
+    }
+
+    for (size_t t = 0; t < header.tensors; ++t) {
+        checksum = checkpoint_hash(checksum, data + table[t].offset, table[t].size * header.dtype);
+    }
+
+    return checksum;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Store a checkpoint of the given network into the given buffer,
+ * without its checksum.
+ *
+ * The buffer is resized to the length of the checkpoint and each tensor is
+ * copied (or converted) at once. This is the only part of a checkpoint
+ * that must be done while the network is not modified, seal_checkpoint()
+ * completes it.
+ *
+ * \param dbn The network
+ * \param buffer The buffer
+ * \param precision The precision of the stored values
+ */
+template <typename DBN>
+void snapshot_checkpoint(const DBN& dbn, std::string& buffer, checkpoint_precision precision = checkpoint_precision::NATIVE) {
+    using weight = typename DBN::weight;
+
+    const auto table = detail::checkpoint_table(dbn, precision);
+
+    checkpoint_header header = {};
+
+    header.magic     = checkpoint_magic;
+    header.version   = checkpoint_version;
+    header.dtype     = detail::checkpoint_dtype<weight>(precision);
+    header.layers    = DBN::layers;
+    header.tensors   = table.size();
+    header.precision = uint32_t(precision);
+    header.length    = detail::checkpoint_align(detail::checkpoint_scales(table.size()));
+
+    if (!table.empty()) {
+        header.length = detail::checkpoint_align(table.back().offset + table.back().size * header.dtype);
+    }
+
+    // The padding must be zeroed, which resize does not do for recycled buffers
+    buffer.assign(header.length, '\0');
+
+    std::memcpy(&buffer[0], &header, sizeof(header));
+    std::memcpy(&buffer[sizeof(header)], table.data(), table.size() * sizeof(checkpoint_tensor));
+
+    size_t t = 0;
+
+    detail::for_each_checkpoint_tensor(dbn, [&buffer, &table, &t, precision](size_t, uint64_t, auto& tensor) {
+        tensor.ensure_cpu_up_to_date();
+
+        const float scale = detail::narrow_checkpoint(tensor.memory_start(), table[t].size, &buffer[table[t].offset], precision);
+
+        if (precision == checkpoint_precision::INT8) {
+            std::memcpy(&buffer[detail::checkpoint_scales(table.size()) + t * sizeof(float)], &scale, sizeof(float));
+        }
+
+        ++t;
+    });
+}
+
+/*!
+ * \brief Compute the checksum of the checkpoint stored in the given buffer
+ * and store it into its header.
+ */
+inline void seal_checkpoint(std::string& buffer) {
+    const uint64_t checksum = detail::checkpoint_checksum(buffer.data());
+
+    std::memcpy(&buffer[offsetof(checkpoint_header, checksum)], &checksum, sizeof(checksum));
+}
+
+/*!
+ * \brief Store a checkpoint of the given network into the given stream.
+ *
+ * The checkpoint is built in memory and written at once.
+ *
+ * \param dbn The network
+ * \param os The stream
+ * \param precision The precision of the stored values
+ */
+template <typename DBN>
+void store_checkpoint(const DBN& dbn, std::ostream& os, checkpoint_precision precision = checkpoint_precision::NATIVE) {
+    std::string buffer;
+
+    snapshot_checkpoint(dbn, buffer, precision);
+    seal_checkpoint(buffer);
+
+    os.write(buffer.data(), buffer.size());
+}
+
+/*!
+ * \brief Store a checkpoint of the given network into the given file
+ *
+ * \param dbn The network
+ * \param file The path to the file
+ * \param precision The precision of the stored values
+ */
+template <typename DBN>
+void store_checkpoint(const DBN& dbn, const std::string& file, checkpoint_precision precision = checkpoint_precision::NATIVE) {
+    std::ofstream os(file, std::ofstream::binary);
+    store_checkpoint(dbn, os, precision);
+}
+
+/*!
+ * \brief A checkpoint mapped in memory.
+ *
+ * The tensors are accessed directly in the mapping, which is read-only,
+ * and are only paged in when they are read.
+ */
+struct checkpoint_file {
+    /*!
+     * \brief Map the given checkpoint file
+     */
+    explicit checkpoint_file(const std::string& path) : file(path) {}
+
+    /*!
+     * \brief Indicates if the file is a valid checkpoint.
+     *
+     * \param verify Indicates if the checksum is verified, which reads all
+     * the tensors.
+     */
+    bool valid(bool verify = true) const {
+        if (file.length < sizeof(checkpoint_header)) {
+            return false;
+        }
+
+        auto& head = header();
+
+        if (head.magic != checkpoint_magic || head.version != checkpoint_version || head.length != file.length || !head.dtype) {
+            return false;
+        }
+
+        if (head.precision > uint32_t(checkpoint_precision::INT8)) {
+            return false;
+        }
+
+        const size_t scales = precision() == checkpoint_precision::INT8 ? sizeof(float) : 0;
+
+        if (head.tensors > (file.length - sizeof(checkpoint_header)) / (sizeof(checkpoint_tensor) + scales)) {
+            return false;
+        }
+
+        for (size_t t = 0; t < head.tensors; ++t) {
+            auto& entry = tensor(t);
+
+            if (entry.offset % checkpoint_alignment || entry.size > file.length / head.dtype || entry.offset > file.length - entry.size * head.dtype) {
+                return false;
+            }
+        }
+
+        return !verify || detail::checkpoint_checksum(reinterpret_cast<const char*>(file.data)) == head.checksum;
+    }
+
+    /*!
+     * \brief Returns the header of the checkpoint
+     */
+    const checkpoint_header& header() const {
+        return *reinterpret_cast<const checkpoint_header*>(file.data);
+    }
+
+    /*!
+     * \brief Returns the number of tensors of the checkpoint
+     */
+    size_t tensors() const {
+        return header().tensors;
+    }
+
+    /*!
+     * \brief Returns the description of the t-th tensor
+     */
+    const checkpoint_tensor& tensor(size_t t) const {
+        return reinterpret_cast<const checkpoint_tensor*>(file.data + sizeof(checkpoint_header))[t];
+    }
+
+    /*!
+     * \brief Returns the precision of the stored values
+     */
+    checkpoint_precision precision() const {
+        return checkpoint_precision(header().precision);
+    }
+
+    /*!
+     * \brief Returns the scale of the t-th tensor (1 if not INT8)
+     */
+    float scale(size_t t) const {
+        float scale = 1.0f;
+
+        if (precision() == checkpoint_precision::INT8) {
+            std::memcpy(&scale, file.data + detail::checkpoint_scales(tensors()) + t * sizeof(float), sizeof(float));
+        }
+
+        return scale;
+    }
+
+    /*!
+     * \brief Returns a pointer to the stored values of the t-th tensor, in
+     * the mapping, aligned on 64 bytes.
+     */
+    const char* values(size_t t) const {
+        return reinterpret_cast<const char*>(file.data + tensor(t).offset);
+    }
+
+    /*!
+     * \brief Returns a pointer to the values of the t-th tensor, in the
+     * mapping, aligned on 64 bytes.
+     */
+    template <typename T>
+    const T* data(size_t t) const {
+        cpp_assert(header().dtype == sizeof(T), "Invalid type of tensor");
+        return reinterpret_cast<const T*>(values(t));
+    }
+
+private:
+    mapped::file file; ///< The mapped file
+};
+
+/*!
+ * \brief Load a checkpoint into the given network.
+ *
+ * The checkpoint must have been stored from a network of the same type.
+ * The values stored in a reduced precision are widened to the type of the
+ * weights.
+ *
+ * \param dbn The network
+ * \param path The path to the checkpoint
+ * \param verify Indicates if the checksum of the checkpoint is verified
+ *
+ * \return true if the checkpoint was loaded, false otherwise
+ */
+template <typename DBN>
+bool load_checkpoint(DBN& dbn, const std::string& path, bool verify = true) {
+    using weight = typename DBN::weight;
+
+    checkpoint_file checkpoint(path);
+
+    if (!checkpoint.valid(verify)) {
+        std::cerr << "ERROR: Invalid checkpoint " << path << std::endl;
+        return false;
+    }
+
+    const auto precision = checkpoint.precision();
+    const auto table     = detail::checkpoint_table(dbn, precision);
+
+    if (checkpoint.header().dtype != detail::checkpoint_dtype<weight>(precision) || checkpoint.header().layers != DBN::layers || checkpoint.tensors() != table.size()) {
+        std::cerr << "ERROR: The checkpoint " << path << " does not match this network" << std::endl;
+        return false;
+    }
+
+    // The shapes are validated before anything is loaded
+
+    for (size_t t = 0; t < table.size(); ++t) {
+        if (std::memcmp(&table[t], &checkpoint.tensor(t), sizeof(checkpoint_tensor)) != 0) {
+            auto& entry = checkpoint.tensor(t);
+
+            std::cerr << "ERROR: The tensor " << t << " of the checkpoint " << path << " (layer " << entry.layer << ", ";
+
+            for (size_t d = 0; d < std::min<size_t>(entry.dimensions, 4); ++d) {
+                std::cerr << (d ? "x" : "") << entry.dims[d];
+            }
+
+            std::cerr << ") does not match the layer " << table[t].layer << " of this network" << std::endl;
+
+            return false;
+        }
+    }
+
+    size_t t = 0;
+
+    detail::for_each_checkpoint_tensor(dbn, [&checkpoint, &t, precision](size_t, uint64_t, auto& tensor) {
+        // The layers only expose their parameters as const references
+        auto& target = const_cast<std::decay_t<decltype(tensor)>&>(tensor);
+
+        detail::widen_checkpoint(checkpoint.values(t), etl::size(target), target.memory_start(), precision, checkpoint.scale(t));
+
+        target.invalidate_gpu();
+
+        ++t;
+    });
+
+    // The caches of the weights (sparse or packed) are out of date
+    dbn.for_each_layer([](auto& layer) {
+        detail::weights_changed(layer);
+    });
+
+    return true;
+}
+
+} //end of dll namespace
@@ -0,0 +1,186 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file checkpointer.hpp
+ * \brief Asynchronous checkpointing of networks during training
+ *
+ * The training is only blocked while the weights are copied into an
+ * in-memory snapshot. The checksum, the write, the fsync and the rename of
+ * the file are done on a background thread. There are two snapshot
+ * buffers, so that a snapshot can be taken while the previous one is still
+ * being written.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dll/util/checkpoint.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Write the given data into the given file, atomically.
+ *
+ * The data is written into a temporary file, which is synced to the disk
+ * and then renamed into the file. The file is therefore either the
+ * previous one or the complete new one, even after a crash.
+ *
+ * \return true if the file was written, false otherwise
+ */
+inline bool atomic_write(const std::string& path, const std::string& data) {
+    const auto tmp = path + ".tmp";
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t written = 0;
+
+    while (written < data.size()) {
+        auto n = ::write(fd, data.data() + written, data.size() - written);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            ::close(fd);
+            ::unlink(tmp.c_str());
+
+            return false;
+        }
+
+        written += n;
+    }
+
+    bool ok = ::fsync(fd) == 0;
+    ok      = ::close(fd) == 0 && ok;
+
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write checkpoints of a network in the background.
+ *
+ * The checkpointer keeps the last files it has written, according to its
+ * retention, and removes the older ones.
+ */
+struct async_checkpointer {
+    /*!
+     * \brief Create a checkpointer
+     * \param keep The number of checkpoints to keep (0 to keep all of them)
+     */
+    explicit async_checkpointer(size_t keep = 0) : keep(keep) {}
+
+    async_checkpointer(const async_checkpointer& rhs) = delete;
+    async_checkpointer& operator=(const async_checkpointer& rhs) = delete;
+
+    /*!
+     * \brief Wait for the last checkpoint to be written
+     */
+    ~async_checkpointer() {
+        wait();
+    }
+
+    /*!
+     * \brief Take a snapshot of the given network and write it in the
+     * background into the given file.
+     *
+     * This only blocks while the weights are copied, and while the previous
+     * checkpoint is written if it is not done yet.
+     */
+    template <typename DBN>
+    void checkpoint(const DBN& dbn, const std::string& path) {
+        static dll::timer_id timer_handle("net:checkpoint:snapshot");
+        dll::auto_timer timer(timer_handle);
+
+        auto& buffer = buffers[current];
+
+        snapshot_checkpoint(dbn, buffer);
+
+        // The other buffer is free once the previous write is done
+        wait();
+
+        pending = std::async(std::launch::async, [this, &buffer, path] { return write(buffer, path); });
+
+        current = 1 - current;
+    }
+
+    /*!
+     * \brief Wait for the checkpoint in progress to be written
+     * \return false if a checkpoint could not be written, true otherwise
+     */
+    bool wait() {
+        if (pending.valid()) {
+            ok = pending.get() && ok;
+        }
+
+        return ok;
+    }
+
+    /*!
+     * \brief Returns the files of the retained checkpoints, from the oldest
+     * to the most recent one.
+     *
+     * This waits for the checkpoint in progress.
+     */
+    const std::deque<std::string>& files() {
+        wait();
+        return retained;
+    }
+
+private:
+    /*!
+     * \brief Seal and write the given snapshot and apply the retention
+     */
+    bool write(std::string& buffer, const std::string& path) {
+        seal_checkpoint(buffer);
+
+        if (!atomic_write(path, buffer)) {
+            std::cerr << "ERROR: Impossible to write the checkpoint " << path << std::endl;
+            return false;
+        }
+
+        if (retained.empty() || retained.back() != path) {
+            retained.push_back(path);
+        }
+
+        while (keep && retained.size() > keep) {
+            std::remove(retained.front().c_str());
+            retained.pop_front();
+        }
+
+        return true;
+    }
+
+    const size_t keep;                ///< The number of checkpoints to keep (0 for all)
+    std::string buffers[2];           ///< The snapshot buffers
+    size_t current = 0;               ///< The buffer for the next snapshot
+    std::future<bool> pending;        ///< The checkpoint being written
+    std::deque<std::string> retained; ///< The retained checkpoints, oldest first
+    bool ok = true;                   ///< Indicates if all the checkpoints were written
+};
+
+} //end of dll namespace
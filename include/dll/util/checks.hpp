@@ -21,17 +21,22 @@
 
 #include "cpp_utils/assert.hpp"
 
+#include "dll/util/health.hpp"
+
+/*!
+ * \brief The distance between two elements read by the checks of the
+ * tensors (1 to scan the complete tensors)
+ */
+#ifndef NAN_DEBUG_STRIDE
+#define NAN_DEBUG_STRIDE 16
+#endif
+
 #define nan_check(value) cpp_assert(std::isfinite(((value))), "NaN Verify");
-#define nan_check_etl(value) cpp_assert(((value)).is_finite(), "NaN Verify");
-#define nan_check_deep(list)                           \
-    for (auto& _nan : ((list))) {                      \
-        cpp_assert(std::isfinite(_nan), "NaN Verify"); \
-    }
-#define nan_check_deep_deep(l)                               \
-    for (auto& _nan_a : ((l))) {                             \
-        for (auto& _nan_b : _nan_a) {                        \
-            cpp_assert(std::isfinite(_nan_b), "NaN Verify"); \
-        }                                                    \
+#define nan_check_etl(value) cpp_assert(dll::sampled_finite(((value)), NAN_DEBUG_STRIDE), "NaN Verify");
+#define nan_check_deep(list) cpp_assert(dll::sampled_finite(((list)), NAN_DEBUG_STRIDE), "NaN Verify");
+#define nan_check_deep_deep(l)                                                   \
+    for (auto& _nan_a : ((l))) {                                                 \
+        cpp_assert(dll::sampled_finite(_nan_a, NAN_DEBUG_STRIDE), "NaN Verify"); \
     }
 #define nan_check_deep_3(l1, l2, l3) \
     nan_check_deep(l1);              \
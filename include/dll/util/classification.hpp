@@ -0,0 +1,248 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file classification.hpp
+ * \brief Fused classification metrics of batches of outputs
+ *
+ * The loss, the error, the top-k accuracy and the confusion matrix of a
+ * batch are computed together, each row of the output being read once for
+ * its argmax and its loss and once for its rank.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The metrics of one sample
+ */
+struct sample_metrics {
+    size_t label;     ///< The expected class
+    size_t predicted; ///< The predicted class
+    size_t rank;      ///< The number of classes with a larger output than the expected one
+    double loss;      ///< The categorical cross-entropy loss
+};
+
+/*!
+ * \brief Compute the metrics of one sample from its output and its
+ * (categorical) label
+ * \param p The output of the sample [N]
+ * \param y The label of the sample [N]
+ * \param N The number of classes
+ */
+template <typename T, typename L>
+sample_metrics classify_row(const T* p, const L* y, size_t N) {
+    // First pass: argmax of the output and of the label, and the loss
+
+    size_t p_arg = 0;
+    size_t y_arg = 0;
+    double loss  = 0.0;
+
+    for (size_t j = 0; j < N; ++j) {
+        if (p[j] > p[p_arg]) {
+            p_arg = j;
+        }
+
+        if (y[j] > y[y_arg]) {
+            y_arg = j;
+        }
+
+        if (y[j] != L(0)) {
+            loss -= double(y[j]) * std::log(double(p[j]));
+        }
+    }
+
+    // Second pass: the rank of the expected class
+
+    const T p_y = p[y_arg];
+
+    size_t rank = 0;
+
+    for (size_t j = 0; j < N; ++j) {
+        rank += p[j] > p_y;
+    }
+
+    return {y_arg, p_arg, rank, loss};
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the number of classification errors and the sum of the
+ * categorical cross-entropy losses of the first n samples of a batch, in a
+ * single sweep over the output.
+ *
+ * \param output The output [B, N]
+ * \param labels The categorical labels [n, N]
+ * \param n The number of samples
+ *
+ * \return a pair containing the number of errors and the sum of the losses
+ */
+template <typename Output, typename Labels>
+std::pair<double, double> cce_metrics(Output& output, const Labels& labels, size_t n) {
+    if constexpr (!etl::is_dma<Output>) {
+        auto output_t = etl::force_temporary(output);
+        return cce_metrics(output_t, labels, n);
+    } else if constexpr (!etl::is_dma<Labels>) {
+        auto labels_t = etl::force_temporary(labels);
+        return cce_metrics(output, labels_t, n);
+    } else {
+        output.ensure_cpu_up_to_date();
+        labels.ensure_cpu_up_to_date();
+
+        const size_t N = etl::size(output) / etl::dim<0>(output);
+
+        const auto* p = output.memory_start();
+        const auto* y = labels.memory_start();
+
+        double errors = 0.0;
+        double loss   = 0.0;
+
+        for (size_t i = 0; i < n; ++i) {
+            auto m = detail::classify_row(p + i * N, y + i * N, N);
+
+            errors += m.predicted != m.label;
+            loss += m.loss;
+        }
+
+        return {errors, loss};
+    }
+}
+
+/*!
+ * \brief The classification metrics of a set of samples: loss, error,
+ * top-k accuracy and confusion matrix.
+ *
+ * The metrics of the batches can be computed independently and merged.
+ */
+struct classification_report {
+    size_t classes = 0; ///< The number of classes
+    size_t k       = 1; ///< The number of best classes of the top-k accuracy
+    size_t samples = 0; ///< The number of samples
+
+    double loss   = 0.0; ///< The sum of the losses
+    size_t errors = 0;   ///< The number of misclassified samples
+    size_t top_k  = 0;   ///< The number of samples with their class in the k best classes
+
+    std::vector<size_t> confusion; ///< The confusion matrix, [expected class, predicted class]
+
+    classification_report() = default;
+
+    /*!
+     * \brief Create an empty report
+     * \param classes The number of classes
+     * \param k The number of best classes of the top-k accuracy
+     */
+    classification_report(size_t classes, size_t k) : classes(classes), k(k), confusion(classes * classes, 0) {}
+
+    /*!
+     * \brief Add the first n samples of a batch to the report
+     * \param output The output [B, N]
+     * \param labels The categorical labels [n, N]
+     * \param n The number of samples
+     */
+    template <typename Output, typename Labels>
+    void add_batch(Output& output, const Labels& labels, size_t n) {
+        if constexpr (!etl::is_dma<Output>) {
+            auto output_t = etl::force_temporary(output);
+            add_batch(output_t, labels, n);
+        } else if constexpr (!etl::is_dma<Labels>) {
+            auto labels_t = etl::force_temporary(labels);
+            add_batch(output, labels_t, n);
+        } else {
+            output.ensure_cpu_up_to_date();
+            labels.ensure_cpu_up_to_date();
+
+            cpp_assert(etl::size(output) / etl::dim<0>(output) == classes, "Invalid number of classes");
+
+            const auto* p = output.memory_start();
+            const auto* y = labels.memory_start();
+
+            for (size_t i = 0; i < n; ++i) {
+                auto m = detail::classify_row(p + i * classes, y + i * classes, classes);
+
+                loss += m.loss;
+                errors += m.predicted != m.label;
+                top_k += m.rank < k;
+
+                ++confusion[m.label * classes + m.predicted];
+            }
+
+            samples += n;
+        }
+    }
+
+    /*!
+     * \brief Add the metrics of another report to this report
+     */
+    void merge(const classification_report& rhs) {
+        cpp_assert(classes == rhs.classes && k == rhs.k, "Only reports of the same kind can be merged");
+
+        samples += rhs.samples;
+        loss += rhs.loss;
+        errors += rhs.errors;
+        top_k += rhs.top_k;
+
+        for (size_t i = 0; i < confusion.size(); ++i) {
+            confusion[i] += rhs.confusion[i];
+        }
+    }
+
+    /*!
+     * \brief Returns the classification error
+     */
+    double error() const {
+        return samples ? double(errors) / samples : 0.0;
+    }
+
+    /*!
+     * \brief Returns the mean loss
+     */
+    double mean_loss() const {
+        return samples ? loss / samples : 0.0;
+    }
+
+    /*!
+     * \brief Returns the top-k accuracy
+     */
+    double top_k_accuracy() const {
+        return samples ? double(top_k) / samples : 0.0;
+    }
+
+    /*!
+     * \brief Returns the number of samples of the given class predicted as
+     * the given class
+     */
+    size_t count(size_t label, size_t predicted) const {
+        return confusion[label * classes + predicted];
+    }
+
+    /*!
+     * \brief Returns the accuracy on the samples of the given class (its
+     * recall)
+     */
+    double class_accuracy(size_t label) const {
+        size_t total = 0;
+
+        for (size_t j = 0; j < classes; ++j) {
+            total += count(label, j);
+        }
+
+        return total ? double(count(label, label)) / total : 0.0;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,364 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file column_shards.hpp
+ * \brief Column-sharded kernels for very large dense layers
+ *
+ * The weights W [K, N] of a very wide dense layer (a large-vocabulary
+ * softmax) do not fit the caches and the single product of each batch, as
+ * well as its softmax, run serially at the end of the network. With
+ * column sharding, the output columns are split into S shards, each shard
+ * owning the columns [c0, c1) of W, of the biases and of the gradients:
+ *
+ *  - forward: each shard computes its logits X * W[:, c0:c1] + b[c0:c1] and,
+ *    for a softmax, the maximum and the sum of the exponentials of each
+ *    of its rows. These partial statistics are combined in a cheap
+ *    reduction and each shard normalizes its own columns.
+ *  - backward: each shard computes its partial product E[:, c0:c1] *
+ *    W[:, c0:c1]^T, the partial products are summed.
+ *  - gradients: each shard computes X^T * E[:, c0:c1] and the sums of the
+ *    errors of its columns.
+ *
+ * The shards run on the shared scheduler. The products use BLAS on the
+ * sub-matrices when it is available and blocked loops otherwise.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dll/util/isa.hpp"       // For DLL_MULTI_ISA_KERNEL
+#include "dll/util/scheduler.hpp" // For task_group
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer has column shards
+ */
+template <typename L, typename Enable = void>
+struct is_column_sharded_impl : std::false_type {};
+
+/*!
+ * \copydoc is_column_sharded_impl
+ */
+template <typename L>
+struct is_column_sharded_impl<L, std::void_t<decltype(L::column_shards)>> : std::bool_constant<(L::column_shards > 1)> {};
+
+/*!
+ * \brief The number of columns of the cache blocks of the loop kernels
+ */
+constexpr size_t column_block = 256;
+
+#ifdef ETL_BLAS_MODE
+
+inline void gemm_columns(bool ta, bool tb, size_t m, size_t n, size_t k, const float* a, size_t lda, const float* b, size_t ldb, float* c, size_t ldc) {
+    cblas_sgemm(CblasRowMajor, ta ? CblasTrans : CblasNoTrans, tb ? CblasTrans : CblasNoTrans, m, n, k, 1.0f, a, lda, b, ldb, 0.0f, c, ldc);
+}
+
+inline void gemm_columns(bool ta, bool tb, size_t m, size_t n, size_t k, const double* a, size_t lda, const double* b, size_t ldb, double* c, size_t ldc) {
+    cblas_dgemm(CblasRowMajor, ta ? CblasTrans : CblasNoTrans, tb ? CblasTrans : CblasNoTrans, m, n, k, 1.0, a, lda, b, ldb, 0.0, c, ldc);
+}
+
+#endif //ETL_BLAS_MODE
+
+/*!
+ * \brief Compute C[:, c0:c1] = A [M, K] * W[:, c0:c1], W being [K, N]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void shard_forward_gemm(T* c, const T* a, const T* w, size_t M, size_t K, size_t N, size_t c0, size_t c1) {
+#ifdef ETL_BLAS_MODE
+    gemm_columns(false, false, M, c1 - c0, K, a, K, w + c0, N, c + c0, N);
+#else
+    for (size_t jb = c0; jb < c1; jb += column_block) {
+        const size_t je = std::min(jb + column_block, c1);
+
+        for (size_t m = 0; m < M; ++m) {
+            std::fill(c + m * N + jb, c + m * N + je, T(0));
+        }
+
+        // Each row of W is read once, the block of C stays in cache
+        for (size_t k = 0; k < K; ++k) {
+            const T* w_k = w + k * N;
+
+            for (size_t m = 0; m < M; ++m) {
+                const T a_mk = a[m * K + k];
+                T* c_m       = c + m * N;
+
+                for (size_t j = jb; j < je; ++j) {
+                    c_m[j] += a_mk * w_k[j];
+                }
+            }
+        }
+    }
+#endif
+}
+
+/*!
+ * \brief Compute P [M, K] = E[:, c0:c1] * W[:, c0:c1]^T, E being [M, N] and
+ * W [K, N]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void shard_backward_gemm(T* p, const T* e, const T* w, size_t M, size_t K, size_t N, size_t c0, size_t c1) {
+#ifdef ETL_BLAS_MODE
+    gemm_columns(false, true, M, K, c1 - c0, e + c0, N, w + c0, N, p, K);
+#else
+    for (size_t k = 0; k < K; ++k) {
+        const T* w_k = w + k * N;
+
+        for (size_t m = 0; m < M; ++m) {
+            const T* e_m = e + m * N;
+
+            T sum(0);
+
+            for (size_t j = c0; j < c1; ++j) {
+                sum += e_m[j] * w_k[j];
+            }
+
+            p[m * K + k] = sum;
+        }
+    }
+#endif
+}
+
+/*!
+ * \brief Compute G[:, c0:c1] = X^T * E[:, c0:c1], X being [M, K], E
+ * [M, N] and G [K, N]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void shard_gradients_gemm(T* g, const T* x, const T* e, size_t M, size_t K, size_t N, size_t c0, size_t c1) {
+#ifdef ETL_BLAS_MODE
+    gemm_columns(true, false, K, c1 - c0, M, x, K, e + c0, N, g + c0, N);
+#else
+    for (size_t jb = c0; jb < c1; jb += column_block) {
+        const size_t je = std::min(jb + column_block, c1);
+
+        // The block of E stays in cache, each row of G is written once
+        for (size_t k = 0; k < K; ++k) {
+            T* g_k = g + k * N;
+
+            std::fill(g_k + jb, g_k + je, T(0));
+
+            for (size_t m = 0; m < M; ++m) {
+                const T x_mk = x[m * K + k];
+                const T* e_m = e + m * N;
+
+                for (size_t j = jb; j < je; ++j) {
+                    g_k[j] += x_mk * e_m[j];
+                }
+            }
+        }
+    }
+#endif
+}
+
+/*!
+ * \brief Run the given functor for each shard, on the shared scheduler
+ */
+template <typename Functor>
+void for_each_column_shard(size_t S, Functor&& functor) {
+    task_group group;
+
+    for (size_t s = 0; s < S; ++s) {
+        group.do_task([&functor, s] { functor(s); });
+    }
+
+    group.wait();
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer shards its weights by output columns
+ */
+template <typename L>
+constexpr bool is_column_sharded = detail::is_column_sharded_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Returns the columns [c0, c1) of the given shard.
+ *
+ * The columns are split evenly, in multiples of 16 columns so that the
+ * shards start on cache lines. The last shards can be empty.
+ *
+ * \param N The number of columns
+ * \param S The number of shards
+ * \param s The shard
+ */
+inline std::pair<size_t, size_t> column_shard_bounds(size_t N, size_t S, size_t s) {
+    const size_t width = ((N + S - 1) / S + 15) / 16 * 16;
+
+    return {std::min(s * width, N), std::min((s + 1) * width, N)};
+}
+
+/*!
+ * \brief Compute the output [M, N] = X [M, K] * W [K, N] + b of a dense
+ * layer by column shards, followed by a softmax if necessary.
+ *
+ * \param out The output
+ * \param x The input
+ * \param w The weights
+ * \param b The biases (nullptr for no biases)
+ * \param softmax Indicates if the softmax of each row is computed
+ */
+template <typename T>
+void column_sharded_forward(T* out, const T* x, const T* w, const T* b, size_t M, size_t K, size_t N, size_t S, bool softmax) {
+    // The maximum and the sum of the exponentials of each row of each shard
+    std::vector<std::pair<T, T>> stats(softmax ? S * M : 0);
+
+    detail::for_each_column_shard(S, [&](size_t s) {
+        const auto [c0, c1] = column_shard_bounds(N, S, s);
+
+        if (c0 == c1) {
+            if (softmax) {
+                std::fill(stats.begin() + s * M, stats.begin() + (s + 1) * M, std::make_pair(-std::numeric_limits<T>::infinity(), T(0)));
+            }
+
+            return;
+        }
+
+        detail::shard_forward_gemm(out, x, w, M, K, N, c0, c1);
+
+        for (size_t m = 0; m < M; ++m) {
+            T* z = out + m * N;
+
+            if (b) {
+                for (size_t j = c0; j < c1; ++j) {
+                    z[j] += b[j];
+                }
+            }
+
+            if (softmax) {
+                const T z_max = *std::max_element(z + c0, z + c1);
+
+                T sum(0);
+
+                for (size_t j = c0; j < c1; ++j) {
+                    z[j] = std::exp(z[j] - z_max);
+                    sum += z[j];
+                }
+
+                stats[s * M + m] = {z_max, sum};
+            }
+        }
+    });
+
+    if (!softmax) {
+        return;
+    }
+
+    // Combine the partial statistics into the scale of each row of each shard
+
+    for (size_t m = 0; m < M; ++m) {
+        T z_max = -std::numeric_limits<T>::infinity();
+
+        for (size_t s = 0; s < S; ++s) {
+            z_max = std::max(z_max, stats[s * M + m].first);
+        }
+
+        T sum(0);
+
+        for (size_t s = 0; s < S; ++s) {
+            stats[s * M + m].first = std::exp(stats[s * M + m].first - z_max);
+            sum += stats[s * M + m].second * stats[s * M + m].first;
+        }
+
+        for (size_t s = 0; s < S; ++s) {
+            stats[s * M + m].first /= sum;
+        }
+    }
+
+    detail::for_each_column_shard(S, [&](size_t s) {
+        const auto [c0, c1] = column_shard_bounds(N, S, s);
+
+        for (size_t m = 0; m < M; ++m) {
+            T* p          = out + m * N;
+            const T scale = stats[s * M + m].first;
+
+            for (size_t j = c0; j < c1; ++j) {
+                p[j] *= scale;
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the errors [M, K] = E [M, N] * W^T of the previous layer
+ * of a dense layer by column shards.
+ *
+ * \param out The errors of the previous layer
+ * \param e The errors of the layer
+ * \param w The weights [K, N]
+ */
+template <typename T>
+void column_sharded_backward(T* out, const T* e, const T* w, size_t M, size_t K, size_t N, size_t S) {
+    // The partial products of the shards after the first one
+    std::vector<T> partial((S - 1) * M * K);
+
+    detail::for_each_column_shard(S, [&](size_t s) {
+        const auto [c0, c1] = column_shard_bounds(N, S, s);
+
+        T* p = s == 0 ? out : partial.data() + (s - 1) * M * K;
+
+        if (c0 == c1) {
+            std::fill(p, p + M * K, T(0));
+        } else {
+            detail::shard_backward_gemm(p, e, w, M, K, N, c0, c1);
+        }
+    });
+
+    for (size_t s = 1; s < S; ++s) {
+        const T* p = partial.data() + (s - 1) * M * K;
+
+        for (size_t i = 0; i < M * K; ++i) {
+            out[i] += p[i];
+        }
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the weights (X^T * E) and of the biases
+ * (the sums of the columns of E) of a dense layer by column shards.
+ *
+ * \param g_w The gradients of the weights [K, N]
+ * \param g_b The gradients of the biases [N] (nullptr for no biases)
+ * \param x The inputs [M, K]
+ * \param e The errors [M, N]
+ */
+template <typename T>
+void column_sharded_gradients(T* g_w, T* g_b, const T* x, const T* e, size_t M, size_t K, size_t N, size_t S) {
+    detail::for_each_column_shard(S, [&](size_t s) {
+        const auto [c0, c1] = column_shard_bounds(N, S, s);
+
+        if (c0 == c1) {
+            return;
+        }
+
+        detail::shard_gradients_gemm(g_w, x, e, M, K, N, c0, c1);
+
+        if (g_b) {
+            std::fill(g_b + c0, g_b + c1, T(0));
+
+            for (size_t m = 0; m < M; ++m) {
+                const T* e_m = e + m * N;
+
+                for (size_t j = c0; j < c1; ++j) {
+                    g_b[j] += e_m[j];
+                }
+            }
+        }
+    });
+}
+
+} //end of dll namespace
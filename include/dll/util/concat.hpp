@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file concat.hpp
+ * \brief Concatenation of the batches of the branches of a merge layer
+ *
+ * The slice of a branch in the merged batch is made of one contiguous block
+ * per index of the dimensions before the merge dimension, i.e. the batch of
+ * a branch is exactly the sequence of its blocks. Concatenating (and
+ * splitting) the batches is therefore a single pass of block copies
+ * directly between the memory of the branch and its slice, without any
+ * temporary. The slice of each branch is disjoint from the others, so that
+ * concurrent branches can copy their blocks at the same time.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The layout of the slice of a branch in a merged batch
+ */
+struct concat_layout {
+    size_t blocks; ///< The number of blocks
+    size_t sub;    ///< The size of a block of the branch
+    size_t merged; ///< The size of a block of the merged batch
+    size_t start;  ///< The position of the block of the branch inside the block of the merged batch
+};
+
+/*!
+ * \brief Compute the layout of the slice of a branch in a merged batch
+ * \param merged The merged batch
+ * \param sub The batch of the branch
+ * \param D The merge dimension (of the batches)
+ * \param offset The position of the branch along the merge dimension
+ */
+template <typename M, typename S>
+concat_layout make_concat_layout(const M& merged, const S& sub, size_t D, size_t offset) {
+    size_t blocks = 1;
+
+    for (size_t d = 0; d < D; ++d) {
+        blocks *= etl::dim(sub, d);
+    }
+
+    const size_t inner = etl::size(sub) / (blocks * etl::dim(sub, D));
+
+    return {blocks, etl::size(sub) / blocks, etl::size(merged) / blocks, offset * inner};
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Copy the batch of a branch into its slice of the merged batch.
+ *
+ * The CPU memory of the merged batch is written but not invalidated on the
+ * GPU, this must be done once all the branches have been copied.
+ *
+ * \param merged The merged batch
+ * \param sub The batch of the branch
+ * \param D The merge dimension (of the batches)
+ * \param offset The position of the branch along the merge dimension
+ */
+template <typename M, typename S>
+void concat_slice(M& merged, const S& sub, size_t D, size_t offset) {
+    const auto l = detail::make_concat_layout(merged, sub, D, offset);
+
+    sub.ensure_cpu_up_to_date();
+
+    const auto* in = sub.memory_start();
+    auto* out      = merged.memory_start() + l.start;
+
+    for (size_t b = 0; b < l.blocks; ++b) {
+        std::copy_n(in + b * l.sub, l.sub, out + b * l.merged);
+    }
+}
+
+/*!
+ * \brief Copy the slice of a branch of the merged batch into the batch of
+ * the branch.
+ *
+ * \param sub The batch of the branch
+ * \param merged The merged batch
+ * \param D The merge dimension (of the batches)
+ * \param offset The position of the branch along the merge dimension
+ */
+template <typename S, typename M>
+void split_slice(S& sub, const M& merged, size_t D, size_t offset) {
+    const auto l = detail::make_concat_layout(merged, sub, D, offset);
+
+    const auto* in = merged.memory_start() + l.start;
+    auto* out      = sub.memory_start();
+
+    for (size_t b = 0; b < l.blocks; ++b) {
+        std::copy_n(in + b * l.merged, l.sub, out + b * l.sub);
+    }
+
+    sub.invalidate_gpu();
+}
+
+} //end of dll namespace
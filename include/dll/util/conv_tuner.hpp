@@ -0,0 +1,349 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file conv_tuner.hpp
+ * \brief Autotuning of the implementations of the convolutions
+ */
+
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#include <fstream>
+#include <string>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The passes of a convolutional layer that are tuned separately
+ */
+enum class conv_pass {
+    FORWARD,        ///< The forward pass (valid convolution)
+    BACKWARD,       ///< The backward pass of the errors (full convolution)
+    BACKWARD_FILTER,       ///< The gradients of the filters
+    DECONV_FORWARD,        ///< The forward pass of a deconvolution (full convolution)
+    DECONV_BACKWARD,       ///< The backward pass of the errors of a deconvolution (valid convolution)
+    DECONV_BACKWARD_FILTER ///< The gradients of the filters of a deconvolution
+};
+
+/*!
+ * \brief Autotuner for the convolutions of the convolutional layers.
+ *
+ * The first time a pass is run for a given shape, each available ETL
+ * implementation is benchmarked and the fastest one is kept for all the
+ * next runs with the same shape. The winners can be stored into a file and
+ * loaded back to avoid the benchmarks.
+ *
+ * The tuning of the ETL implementations is only possible when
+ * ETL_MANUAL_SELECT is defined, otherwise the implementation chosen by ETL
+ * is always used. The passes that have a GEMM implementation of their own
+ * (see deconv_gemm.hpp) are always tuned between the ETL convolution and
+ * the GEMM.
+ */
+struct conv_tuner {
+    using key_t = std::vector<size_t>; ///< The key of a tuned shape
+
+    static constexpr int etl_impl  = -2; ///< The implementation chosen by ETL
+    static constexpr int gemm_impl = -3; ///< The GEMM implementation of the pass
+
+    /*!
+     * \brief Return the global tuner
+     */
+    static conv_tuner& instance() {
+        static conv_tuner tuner;
+        return tuner;
+    }
+
+    /*!
+     * \brief Run the given pass with the best implementation for its shape.
+     *
+     * The functor may be run several times during tuning, it must
+     * therefore be idempotent.
+     *
+     * \param pass The pass being run
+     * \param dims The dimensions identifying the shape of the pass
+     * \param functor The functor computing the pass
+     */
+    template <typename Functor>
+    void run(conv_pass pass, std::initializer_list<size_t> dims, Functor&& functor) {
+#ifdef ETL_MANUAL_SELECT
+        auto key = make_key(pass, dims);
+
+        int best = find(key);
+
+        if (best == unknown_impl) {
+            double t;
+            best = tune(functor, t);
+
+            std::lock_guard<std::mutex> l(lock);
+            cache[key] = best;
+        }
+
+        run_impl(best, functor);
+#else
+        cpp_unused(pass);
+        cpp_unused(dims);
+
+        functor();
+#endif
+    }
+
+    /*!
+     * \brief Run the given pass with the best implementation for its shape,
+     * between the ETL convolution and a GEMM implementation.
+     *
+     * Both functors must compute the same result and may be run several
+     * times during tuning, they must therefore be idempotent.
+     *
+     * \param pass The pass being run
+     * \param dims The dimensions identifying the shape of the pass
+     * \param functor The functor computing the pass with ETL
+     * \param gemm The functor computing the pass with a GEMM
+     */
+    template <typename Functor, typename Gemm>
+    void run(conv_pass pass, std::initializer_list<size_t> dims, Functor&& functor, Gemm&& gemm) {
+        auto key = make_key(pass, dims);
+
+        int best = find(key);
+
+        if (best == unknown_impl) {
+            double best_t;
+
+#ifdef ETL_MANUAL_SELECT
+            best = tune(functor, best_t);
+#else
+            best   = etl_impl;
+            best_t = measure(functor);
+#endif
+
+            if (measure(gemm) < best_t) {
+                best = gemm_impl;
+            }
+
+            std::lock_guard<std::mutex> l(lock);
+            cache[key] = best;
+        }
+
+        if (best == gemm_impl) {
+            gemm();
+        } else {
+            run_impl(best, functor);
+        }
+    }
+
+    /*!
+     * \brief Return the number of tuned shapes
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> l(lock);
+        return cache.size();
+    }
+
+    /*!
+     * \brief Forget all the tuned shapes
+     */
+    void clear() {
+        std::lock_guard<std::mutex> l(lock);
+        cache.clear();
+    }
+
+    /*!
+     * \brief Store the tuned shapes into the given file
+     * \param file The path to the file
+     * \return true if the file could be written, false otherwise
+     */
+    bool store(const std::string& file) const {
+        std::ofstream os(file);
+
+        if (!os) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& [key, impl] : cache) {
+            os << key.size();
+
+            for (auto d : key) {
+                os << ' ' << d;
+            }
+
+            os << ' ' << impl << '\n';
+        }
+
+        return bool(os);
+    }
+
+    /*!
+     * \brief Load tuned shapes from the given file
+     * \param file The path to the file
+     * \return true if the file could be read, false otherwise
+     */
+    bool load(const std::string& file) {
+        std::ifstream is(file);
+
+        if (!is) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+
+        size_t n;
+        while (is >> n) {
+            key_t key(n);
+
+            for (auto& d : key) {
+                is >> d;
+            }
+
+            int impl;
+            if (!(is >> impl)) {
+                return false;
+            }
+
+            cache[key] = impl;
+        }
+
+        return true;
+    }
+
+private:
+    static constexpr int unknown_impl = -1; ///< No implementation has been tuned yet
+
+    /*!
+     * \brief Return the key of the given pass and dimensions
+     */
+    static key_t make_key(conv_pass pass, std::initializer_list<size_t> dims) {
+        key_t key;
+        key.reserve(dims.size() + 1);
+        key.push_back(size_t(pass));
+        key.insert(key.end(), dims.begin(), dims.end());
+        return key;
+    }
+
+    /*!
+     * \brief Return the tuned implementation of the given key, or unknown_impl
+     */
+    int find(const key_t& key) const {
+        std::lock_guard<std::mutex> l(lock);
+
+        auto it = cache.find(key);
+
+        if (it != cache.end()) {
+            return it->second;
+        }
+
+        return unknown_impl;
+    }
+
+    /*!
+     * \brief Measure the best time of the given functor, after a warmup
+     * \return The best time, in seconds
+     */
+    template <typename Functor>
+    static double measure(Functor& functor) {
+        constexpr size_t repeat = 3;
+
+        // Warmup
+        functor();
+
+        double t = std::numeric_limits<double>::max();
+
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            functor();
+            auto end = std::chrono::steady_clock::now();
+
+            t = std::min(t, std::chrono::duration<double>(end - start).count());
+        }
+
+        return t;
+    }
+
+    /*!
+     * \brief Run the functor with the given ETL implementation
+     */
+    template <typename Functor>
+    static void run_impl(int impl, Functor& functor) {
+#ifdef ETL_MANUAL_SELECT
+        if (impl >= 0) {
+            SELECTED_SECTION(etl::conv4_impl(impl)) {
+                functor();
+            }
+
+            return;
+        }
+#else
+        cpp_unused(impl);
+#endif
+
+        functor();
+    }
+
+#ifdef ETL_MANUAL_SELECT
+    /*!
+     * \brief Return the implementations that can be tuned in the current configuration
+     */
+    static std::vector<etl::conv4_impl> candidates() {
+        std::vector<etl::conv4_impl> impls;
+
+        if (etl::vec_enabled) {
+            impls.push_back(etl::conv4_impl::VEC);      // Direct vectorized
+            impls.push_back(etl::conv4_impl::BLAS_VEC); // im2col + GEMM
+        } else {
+            impls.push_back(etl::conv4_impl::STD);
+        }
+
+        if (etl::mkl_enabled) {
+            impls.push_back(etl::conv4_impl::BLAS_MKL); // FFT
+        }
+
+        if (etl::cudnn_enabled) {
+            impls.push_back(etl::conv4_impl::CUDNN);
+        }
+
+        return impls;
+    }
+
+    /*!
+     * \brief Benchmark all the implementations for the given pass
+     * \param best_t The time of the fastest implementation, in seconds
+     * \return The fastest implementation
+     */
+    template <typename Functor>
+    static int tune(Functor& functor, double& best_t) {
+        int best = unknown_impl;
+
+        best_t = std::numeric_limits<double>::max();
+
+        for (auto impl : candidates()) {
+            SELECTED_SECTION(impl) {
+                double t = measure(functor);
+
+                if (t < best_t) {
+                    best_t = t;
+                    best   = int(impl);
+                }
+            }
+        }
+
+        return best;
+    }
+#endif
+
+    mutable std::mutex lock;    ///< The lock protecting the cache
+    std::map<key_t, int> cache; ///< The best implementation of each shape
+};
+
+} //end of dll namespace
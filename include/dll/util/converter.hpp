@@ -5,11 +5,26 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+/*!
+ * \file converter.hpp
+ * \brief Conversion of the user containers to the input of the layers
+ *
+ * The contiguous containers (std::vector and std::array) of the weight type
+ * of the layer are not copied: the input is a non-owning ETL view of their
+ * memory, which must stay alive and unchanged during the forward pass. The
+ * other containers are copied into a new ETL matrix.
+ */
+
 #pragma once
 
+#include "cpp_utils/assert.hpp"
 #include "cpp_utils/tmp.hpp"
 
+#include "etl/etl.hpp"
+
+#include <array>
 #include <list>
+#include <type_traits>
 #include <vector>
 #include <deque>
 
@@ -446,6 +461,155 @@ struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D2>, std::ena
     }
 };
 
+namespace detail {
+
+/*!
+ * \brief Traits to test if a type is a user container of values, which must
+ * be converted to be given to a layer
+ */
+template <typename C>
+struct is_user_container : std::false_type {};
+
+/*!
+ * \copydoc is_user_container
+ */
+template <typename T, typename A>
+struct is_user_container<std::vector<T, A>> : std::bool_constant<std::is_arithmetic_v<T>> {};
+
+/*!
+ * \copydoc is_user_container
+ */
+template <typename T, typename A>
+struct is_user_container<std::list<T, A>> : std::bool_constant<std::is_arithmetic_v<T>> {};
+
+/*!
+ * \copydoc is_user_container
+ */
+template <typename T, typename A>
+struct is_user_container<std::deque<T, A>> : std::bool_constant<std::is_arithmetic_v<T>> {};
+
+/*!
+ * \copydoc is_user_container
+ */
+template <typename T, size_t N>
+struct is_user_container<std::array<T, N>> : std::bool_constant<std::is_arithmetic_v<T>> {};
+
+/*!
+ * \brief Traits to test if a user container is contiguous and can be viewed
+ * as a matrix of T. The values of a std::vector<bool> are not contiguous.
+ */
+template <typename C, typename T>
+struct is_contiguous_container : std::false_type {};
+
+/*!
+ * \copydoc is_contiguous_container
+ */
+template <typename T, typename A>
+struct is_contiguous_container<std::vector<T, A>, T> : std::bool_constant<!std::is_same_v<T, bool>> {};
+
+/*!
+ * \copydoc is_contiguous_container
+ */
+template <typename T, size_t N>
+struct is_contiguous_container<std::array<T, N>, T> : std::true_type {};
+
+/*!
+ * \brief The views of user memory as the input of a layer, for the input
+ * types that can be viewed
+ */
+template <typename To>
+struct input_view_impl : std::false_type {};
+
+/*!
+ * \copydoc input_view_impl
+ */
+template <typename T, size_t... Dims>
+struct input_view_impl<etl::fast_dyn_matrix<T, Dims...>> : std::true_type {
+    /*!
+     * \brief Create a view of the given memory, holding n values
+     */
+    static etl::custom_fast_matrix<T, Dims...> make(const T* memory, [[maybe_unused]] size_t n) {
+        cpp_assert(n == (Dims * ...), "The input does not have the size of the input of the layer");
+
+        // The view is never written by the forward pass
+        return etl::custom_fast_matrix<T, Dims...>(const_cast<T*>(memory));
+    }
+};
+
+/*!
+ * \copydoc input_view_impl
+ */
+template <typename T>
+struct input_view_impl<etl::dyn_matrix<T, 1>> : std::true_type {
+    /*!
+     * \brief Create a view of the given memory, holding n values
+     */
+    static etl::custom_dyn_matrix<T, 1> make(const T* memory, size_t n) {
+        // The view is never written by the forward pass
+        return etl::custom_dyn_matrix<T, 1>(const_cast<T*>(memory), n);
+    }
+};
+
+} // end of namespace detail
+
+/*!
+ * \brief Prepare the given sample to be the input of a layer expecting To
+ * inputs.
+ *
+ * A contiguous container of the value type of To is viewed in place, the
+ * other user containers are copied and the ETL expressions are returned as
+ * they are.
+ *
+ * \param layer The layer receiving the input
+ * \param sample The sample to convert
+ *
+ * \return A view, a copy or a reference to the sample
+ */
+template <typename To, typename L, typename From>
+decltype(auto) make_input_view([[maybe_unused]] const L& layer, const From& sample) {
+    if constexpr (!detail::is_user_container<From>::value) {
+        return (sample);
+    } else if constexpr (detail::is_contiguous_container<From, etl::value_t<To>>::value && detail::input_view_impl<To>::value) {
+        return detail::input_view_impl<To>::make(sample.data(), sample.size());
+    } else {
+        return converter_one<From, To>::convert(layer, sample);
+    }
+}
+
+/*!
+ * \brief Create a non-owning view of the given memory, of the given
+ * dimensions, to be given as input to a network.
+ *
+ * The memory must stay alive and unchanged while the view is used.
+ *
+ * \tparam Dims The dimensions of the input
+ * \param memory The memory of the input
+ */
+template <size_t... Dims, typename T>
+etl::custom_fast_matrix<T, Dims...> input_view(const T* memory) {
+    static_assert(sizeof...(Dims) > 0, "input_view needs the dimensions of the input");
+
+    cpp_assert(memory, "The memory of the input cannot be null");
+
+    return etl::custom_fast_matrix<T, Dims...>(const_cast<T*>(memory));
+}
+
+/*!
+ * \brief Create a non-owning view of the given memory, of the given
+ * dimensions, to be given as input to a network.
+ *
+ * The memory must stay alive and unchanged while the view is used.
+ *
+ * \param memory The memory of the input
+ * \param dims The dimensions of the input
+ */
+template <typename T, typename... S, cpp_enable_iff(sizeof...(S) > 0)>
+etl::custom_dyn_matrix<T, sizeof...(S)> input_view(const T* memory, S... dims) {
+    cpp_assert(memory, "The memory of the input cannot be null");
+
+    return etl::custom_dyn_matrix<T, sizeof...(S)>(const_cast<T*>(memory), size_t(dims)...);
+}
+
 template<typename From, typename To>
 struct converter_many {
     static_assert(cannot_convert<From, To>::value, "DLL does not know how to convert your input type (many)");
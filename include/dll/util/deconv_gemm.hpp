@@ -0,0 +1,219 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file deconv_gemm.hpp
+ * \brief GEMM implementations of the passes of the deconvolutional layers
+ *
+ * The passes of the deconvolutional layers compute the same results as
+ * their ETL convolutions:
+ *
+ *  - forward: conv_4d_full_flipped(v, w), computed as one GEMM per
+ *    sample giving the contribution of each input pixel to each tap of
+ *    the filters, scattered into the output (col2im)
+ *  - backward: conv_4d_valid_flipped(errors, w), computed as the
+ *    unfolding of the errors (im2col) followed by one GEMM per sample
+ *  - backward filter: conv_4d_valid_filter_flipped(errors, v), computed
+ *    as one GEMM per sample on the same unfolded errors
+ *
+ * The filters are seen as a NC x (K * NW1 * NW2) matrix and the inputs of
+ * a sample as a NC x (NV1 * NV2) matrix. The unfolded matrices have
+ * K * NW1 * NW2 rows of NV1 * NV2 columns, which are contiguous rows of
+ * the images, so that the loops of im2col and col2im can be vectorized.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The dimensions of a deconvolution
+ */
+struct deconv_dims {
+    size_t B;   ///< The number of samples
+    size_t NC;  ///< The number of input channels
+    size_t NV1; ///< The first dimension of the input
+    size_t NV2; ///< The second dimension of the input
+    size_t K;   ///< The number of filters
+    size_t NW1; ///< The first dimension of the filters
+    size_t NW2; ///< The second dimension of the filters
+
+    size_t NH1() const { return NV1 + NW1 - 1; } ///< The first dimension of the output
+    size_t NH2() const { return NV2 + NW2 - 1; } ///< The second dimension of the output
+    size_t taps() const { return K * NW1 * NW2; } ///< The number of rows of the unfolded matrices
+    size_t pixels() const { return NV1 * NV2; }   ///< The number of columns of the unfolded matrices
+};
+
+/*!
+ * \brief Scatter the unfolded contributions of one sample into its output
+ * \param out The output of the sample [K, NH1, NH2], accumulated
+ * \param col The contributions [K * NW1 * NW2, NV1 * NV2]
+ * \param d The dimensions of the deconvolution
+ */
+template <typename T>
+void deconv_col2im(T* out, const T* col, const deconv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    for (size_t k = 0; k < d.K; ++k) {
+        for (size_t a = 0; a < d.NW1; ++a) {
+            for (size_t b = 0; b < d.NW2; ++b) {
+                const T* c = col + ((k * d.NW1 + a) * d.NW2 + b) * d.pixels();
+
+                // The filters are flipped
+                T* o = out + (k * NH1 + d.NW1 - 1 - a) * NH2 + d.NW2 - 1 - b;
+
+                for (size_t y = 0; y < d.NV1; ++y) {
+                    for (size_t x = 0; x < d.NV2; ++x) {
+                        o[y * NH2 + x] += c[y * d.NV2 + x];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Unfold the errors of one sample
+ * \param col The unfolded errors [K * NW1 * NW2, NV1 * NV2]
+ * \param errors The errors of the sample [K, NH1, NH2]
+ * \param d The dimensions of the deconvolution
+ */
+template <typename T>
+void deconv_im2col(T* col, const T* errors, const deconv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    for (size_t k = 0; k < d.K; ++k) {
+        for (size_t a = 0; a < d.NW1; ++a) {
+            for (size_t b = 0; b < d.NW2; ++b) {
+                T* c       = col + ((k * d.NW1 + a) * d.NW2 + b) * d.pixels();
+                const T* e = errors + (k * NH1 + a) * NH2 + b;
+
+                for (size_t y = 0; y < d.NV1; ++y) {
+                    std::copy_n(e + y * NH2, d.NV2, c + y * d.NV2);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Return the unfolded matrix of the current thread, for the given
+ * dimensions
+ */
+template <typename T>
+etl::dyn_matrix<T, 2>& deconv_col(const deconv_dims& d) {
+    thread_local etl::dyn_matrix<T, 2> col;
+
+    if (etl::dim<0>(col) != d.taps() || etl::dim<1>(col) != d.pixels()) {
+        col = etl::dyn_matrix<T, 2>(d.taps(), d.pixels());
+    }
+
+    return col;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the forward pass of a deconvolution, as
+ * conv_4d_full_flipped(in, w)
+ *
+ * \param out The output [B, K, NH1, NH2]
+ * \param in The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param w The filters [NC, K, NW1, NW2]
+ * \param d The dimensions of the deconvolution
+ */
+template <typename O, typename I, typename W>
+void deconv_gemm_forward(O&& out, const I& in, const W& w, const detail::deconv_dims& d) {
+    using T = etl::value_t<W>;
+
+    auto& col = detail::deconv_col<T>(d);
+
+    auto w_r = etl::reshape(w, d.NC, d.taps());
+
+    out = T(0);
+
+    out.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < d.B; ++i) {
+        col = etl::transpose(w_r) * etl::reshape(in(i), d.NC, d.pixels());
+
+        col.ensure_cpu_up_to_date();
+
+        detail::deconv_col2im(out.memory_start() + i * d.K * d.NH1() * d.NH2(), col.memory_start(), d);
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the input of a deconvolution, as
+ * conv_4d_valid_flipped(errors, w)
+ *
+ * \param d_in The gradients of the input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param errors The gradients of the output [B, K, NH1, NH2]
+ * \param w The filters [NC, K, NW1, NW2]
+ * \param d The dimensions of the deconvolution
+ */
+template <typename O, typename E, typename W>
+void deconv_gemm_backward(O&& d_in, const E& errors, const W& w, const detail::deconv_dims& d) {
+    using T = etl::value_t<W>;
+
+    auto& col = detail::deconv_col<T>(d);
+
+    auto w_r = etl::reshape(w, d.NC, d.taps());
+
+    errors.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < d.B; ++i) {
+        detail::deconv_im2col(col.memory_start(), errors.memory_start() + i * d.K * d.NH1() * d.NH2(), d);
+
+        col.invalidate_gpu();
+
+        etl::reshape(d_in(i), d.NC, d.pixels()) = w_r * col;
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a deconvolution, as
+ * conv_4d_valid_filter_flipped(errors, in)
+ *
+ * \param d_w The gradients of the filters [NC, K, NW1, NW2]
+ * \param errors The gradients of the output [B, K, NH1, NH2]
+ * \param in The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param d The dimensions of the deconvolution
+ */
+template <typename G, typename E, typename I>
+void deconv_gemm_backward_filter(G&& d_w, const E& errors, const I& in, const detail::deconv_dims& d) {
+    using T = etl::value_t<E>;
+
+    auto& col = detail::deconv_col<T>(d);
+
+    auto d_w_r = etl::reshape(d_w, d.NC, d.taps());
+
+    d_w = T(0);
+
+    errors.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < d.B; ++i) {
+        detail::deconv_im2col(col.memory_start(), errors.memory_start() + i * d.K * d.NH1() * d.NH2(), d);
+
+        col.invalidate_gpu();
+
+        d_w_r += etl::reshape(in(i), d.NC, d.pixels()) * etl::transpose(col);
+    }
+}
+
+} //end of dll namespace
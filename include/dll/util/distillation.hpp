@@ -0,0 +1,155 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file distillation.hpp
+ * \brief Soft targets of a teacher network for knowledge distillation
+ *
+ * The student is trained on a mix of the hard labels and of the outputs
+ * of the teacher, both softened by a temperature T:
+ *
+ *     L = (1 - a) * CCE(y, p) + a * T^2 * KL(q_T || p_T)
+ *
+ * with p_T = softmax(z / T) for the logits z of the student and q_T the
+ * same for the teacher. Since both networks end with a softmax, p_T and q_T
+ * are computed from their outputs, as p^(1 / T) normalized. The errors of
+ * the last layer (the negative gradients of the loss with respect to the
+ * logits) are then:
+ *
+ *     e = (1 - a) * (y - p) + a * T * (q_T - p_T)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/scheduler.hpp" // For task_group
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Soften a row of probabilities by the given temperature
+ * \param out The softened probabilities [N]
+ * \param probs The probabilities [N]
+ * \param N The number of classes
+ * \param temperature The temperature
+ */
+template <typename T, typename P>
+void soften_row(T* out, const P* probs, size_t N, T temperature) {
+    // Avoid infinite logarithms of saturated outputs
+    constexpr T eps = 1e-30;
+
+    T l_max = std::log(std::max(T(probs[0]), eps)) / temperature;
+
+    for (size_t j = 0; j < N; ++j) {
+        out[j] = std::log(std::max(T(probs[j]), eps)) / temperature;
+        l_max  = std::max(l_max, out[j]);
+    }
+
+    T sum(0);
+
+    for (size_t j = 0; j < N; ++j) {
+        out[j] = std::exp(out[j] - l_max);
+        sum += out[j];
+    }
+
+    for (size_t j = 0; j < N; ++j) {
+        out[j] /= sum;
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the soft targets of the given outputs of a teacher
+ * \param targets The soft targets [n, N]
+ * \param probs The outputs of the teacher [n, N]
+ * \param n The number of samples
+ * \param N The number of classes
+ * \param temperature The temperature
+ */
+template <typename T, typename P>
+void teacher_soft_targets(T* targets, const P* probs, size_t n, size_t N, T temperature) {
+    for (size_t i = 0; i < n; ++i) {
+        detail::soften_row(targets + i * N, probs + i * N, N, temperature);
+    }
+}
+
+/*!
+ * \brief Mix the errors of the hard labels of a batch with the errors of
+ * the soft targets of the teacher
+ *
+ * \param errors The errors of the last layer for the hard labels [B, N]
+ * \param output The output of the student [B, N]
+ * \param targets The soft targets of the teacher [n, N]
+ * \param n The number of samples
+ * \param temperature The temperature
+ * \param alpha The weight of the soft targets
+ */
+template <typename E, typename O, typename T>
+void distill_errors(E& errors, O& output, const T* targets, size_t n, T temperature, T alpha) {
+    errors.ensure_cpu_up_to_date();
+    output.ensure_cpu_up_to_date();
+
+    const size_t N = etl::size(errors) / etl::dim<0>(errors);
+
+    T* e       = errors.memory_start();
+    const T* p = output.memory_start();
+
+    std::vector<T> p_t(N);
+
+    for (size_t i = 0; i < n; ++i) {
+        detail::soften_row(p_t.data(), p + i * N, N, temperature);
+
+        const T* q = targets + i * N;
+
+        for (size_t j = 0; j < N; ++j) {
+            e[i * N + j] = (T(1) - alpha) * e[i * N + j] + alpha * temperature * (q[j] - p_t[j]);
+        }
+    }
+
+    errors.invalidate_gpu();
+}
+
+/*!
+ * \brief The teacher of a distillation and its soft targets.
+ *
+ * The teacher is hidden behind functors, the trainer of the student not
+ * depending on its type.
+ */
+template <typename T>
+struct distillation {
+    size_t classes = 0; ///< The number of outputs of the teacher
+
+    /*!
+     * \brief Compute the soft targets of the current batch of the generator
+     */
+    std::function<void(T* targets)> teach_batch;
+
+    /*!
+     * \brief Compute the soft targets of the given samples of the generator
+     * (at most a batch), only for indexable generators
+     */
+    std::function<void(const size_t* samples, size_t n, T* targets)> teach_samples;
+
+    std::vector<T> targets; ///< The soft targets of the current batch [B, N]
+    std::vector<T> cache;   ///< The soft targets of all the samples, when cached [S, N]
+    bool cached = false;    ///< Indicates if the cache is complete
+
+    const void* source = nullptr; ///< The generator of the cached soft targets
+
+    task_group tasks; ///< The pending teacher of the current batch
+};
+
+} //end of dll namespace
@@ -0,0 +1,465 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file distributed.hpp
+ * \brief Communicators for data-parallel training over several processes or
+ * over several replicas of a network in the same process
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef DLL_MPI
+#include <mpi.h>
+#endif
+
+#ifdef DLL_NCCL
+#include <cuda_runtime.h>
+#include <nccl.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief A communicator between the processes of a distributed training.
+ *
+ * Each process trains the same network on its own shard of the data. The
+ * gradients are summed over all the processes before the weights are
+ * updated. The start_all_reduce functions may return before the reduction
+ * is done, in which case wait() must block until all the started
+ * reductions are completed.
+ */
+struct communicator {
+    virtual ~communicator() = default;
+
+    /*!
+     * \brief Return the rank of the current process
+     */
+    virtual size_t rank() const = 0;
+
+    /*!
+     * \brief Return the number of processes
+     */
+    virtual size_t size() const = 0;
+
+    /*!
+     * \brief Sum the given values in place over all the processes
+     * \param data The values to reduce
+     * \param n The number of values
+     */
+    virtual void all_reduce(float* data, size_t n) = 0;
+
+    /*!
+     * \copydoc all_reduce
+     */
+    virtual void all_reduce(double* data, size_t n) = 0;
+
+    /*!
+     * \brief Broadcast the given values from the root process to all the processes
+     * \param data The values to broadcast
+     * \param n The number of values
+     * \param root The rank of the root process
+     */
+    virtual void broadcast(float* data, size_t n, size_t root) = 0;
+
+    /*!
+     * \copydoc broadcast
+     */
+    virtual void broadcast(double* data, size_t n, size_t root) = 0;
+
+    /*!
+     * \brief Start to sum the given values in place over all the processes.
+     *
+     * By default, the reduction is done synchronously.
+     *
+     * \param data The values to reduce
+     * \param n The number of values
+     */
+    virtual void start_all_reduce(float* data, size_t n) {
+        all_reduce(data, n);
+    }
+
+    /*!
+     * \copydoc start_all_reduce
+     */
+    virtual void start_all_reduce(double* data, size_t n) {
+        all_reduce(data, n);
+    }
+
+    /*!
+     * \brief Wait for all the started reductions to be completed
+     */
+    virtual void wait() {}
+
+    /*!
+     * \brief Indicates if the buffers of start_all_reduce() and broadcast()
+     * are in device (GPU) memory instead of host memory.
+     *
+     * The values of all_reduce(), which are only metrics, are always in
+     * host memory.
+     */
+    virtual bool device() const {
+        return false;
+    }
+
+    /*!
+     * \brief Indicates if the current process is the master (rank 0) process
+     */
+    bool master() const {
+        return rank() == 0;
+    }
+};
+
+#ifdef DLL_MPI
+
+/*!
+ * \brief A communicator based on MPI.
+ *
+ * MPI must be initialized before the communicator is used. The reductions
+ * started with start_all_reduce are non-blocking.
+ */
+struct mpi_communicator final : communicator {
+    /*!
+     * \brief Create a communicator over the given MPI communicator
+     */
+    explicit mpi_communicator(MPI_Comm comm = MPI_COMM_WORLD) : comm(comm) {
+        int r;
+        int s;
+
+        MPI_Comm_rank(comm, &r);
+        MPI_Comm_size(comm, &s);
+
+        rank_ = r;
+        size_ = s;
+    }
+
+    size_t rank() const override {
+        return rank_;
+    }
+
+    size_t size() const override {
+        return size_;
+    }
+
+    void all_reduce(float* data, size_t n) override {
+        MPI_Allreduce(MPI_IN_PLACE, data, int(n), MPI_FLOAT, MPI_SUM, comm);
+    }
+
+    void all_reduce(double* data, size_t n) override {
+        MPI_Allreduce(MPI_IN_PLACE, data, int(n), MPI_DOUBLE, MPI_SUM, comm);
+    }
+
+    void broadcast(float* data, size_t n, size_t root) override {
+        MPI_Bcast(data, int(n), MPI_FLOAT, int(root), comm);
+    }
+
+    void broadcast(double* data, size_t n, size_t root) override {
+        MPI_Bcast(data, int(n), MPI_DOUBLE, int(root), comm);
+    }
+
+    void start_all_reduce(float* data, size_t n) override {
+        requests.emplace_back();
+        MPI_Iallreduce(MPI_IN_PLACE, data, int(n), MPI_FLOAT, MPI_SUM, comm, &requests.back());
+    }
+
+    void start_all_reduce(double* data, size_t n) override {
+        requests.emplace_back();
+        MPI_Iallreduce(MPI_IN_PLACE, data, int(n), MPI_DOUBLE, MPI_SUM, comm, &requests.back());
+    }
+
+    void wait() override {
+        if (!requests.empty()) {
+            MPI_Waitall(int(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+            requests.clear();
+        }
+    }
+
+private:
+    MPI_Comm comm;                     ///< The MPI communicator
+    size_t rank_;                      ///< The rank of this process
+    size_t size_;                      ///< The number of processes
+    std::vector<MPI_Request> requests; ///< The pending reductions
+};
+
+#endif //DLL_MPI
+
+/*!
+ * \brief The state shared by the local communicators of a group
+ */
+struct local_group {
+    const size_t size;             ///< The number of replicas
+    std::vector<void*> buffers;    ///< The buffer given by each replica to the current collective
+    std::mutex lock;               ///< The lock of the barrier
+    std::condition_variable ready; ///< The condition of the barrier
+    size_t arrived    = 0;         ///< The number of replicas in the barrier
+    size_t generation = 0;         ///< The number of completed barriers
+
+    /*!
+     * \brief Create the state of a group of the given number of replicas
+     */
+    explicit local_group(size_t size) : size(size), buffers(size, nullptr) {}
+
+    /*!
+     * \brief Wait for all the replicas of the group
+     */
+    void barrier() {
+        std::unique_lock<std::mutex> l(lock);
+
+        const size_t g = generation;
+
+        if (++arrived == size) {
+            arrived = 0;
+            ++generation;
+            ready.notify_all();
+        } else {
+            ready.wait(l, [this, g] { return generation != g; });
+        }
+    }
+};
+
+/*!
+ * \brief A communicator between the replicas of a network trained by
+ * threads of the same process, on host memory.
+ *
+ * Each replica sums a distinct slice of the buffers of all the replicas and
+ * writes the sum back into all of them: every replica reads the same
+ * sums, computed in the same order.
+ */
+struct local_communicator final : communicator {
+    /*!
+     * \brief Create the communicator of the given replica of the group
+     */
+    local_communicator(std::shared_ptr<local_group> group, size_t rank) : group(std::move(group)), rank_(rank) {}
+
+    size_t rank() const override {
+        return rank_;
+    }
+
+    size_t size() const override {
+        return group->size;
+    }
+
+    void all_reduce(float* data, size_t n) override {
+        reduce(data, n);
+    }
+
+    void all_reduce(double* data, size_t n) override {
+        reduce(data, n);
+    }
+
+    void broadcast(float* data, size_t n, size_t root) override {
+        copy(data, n, root);
+    }
+
+    void broadcast(double* data, size_t n, size_t root) override {
+        copy(data, n, root);
+    }
+
+private:
+    /*!
+     * \brief Sum the given values in place over all the replicas
+     */
+    template <typename T>
+    void reduce(T* data, size_t n) {
+        auto& g = *group;
+
+        g.buffers[rank_] = data;
+        g.barrier();
+
+        const size_t first = rank_ * n / g.size;
+        const size_t last  = (rank_ + 1) * n / g.size;
+
+        for (size_t i = first; i < last; ++i) {
+            T sum = 0;
+
+            for (size_t r = 0; r < g.size; ++r) {
+                sum += static_cast<T*>(g.buffers[r])[i];
+            }
+
+            for (size_t r = 0; r < g.size; ++r) {
+                static_cast<T*>(g.buffers[r])[i] = sum;
+            }
+        }
+
+        // The buffers must not be reused before all the slices are reduced
+        g.barrier();
+    }
+
+    /*!
+     * \brief Copy the values of the root replica to all the replicas
+     */
+    template <typename T>
+    void copy(T* data, size_t n, size_t root) {
+        auto& g = *group;
+
+        g.buffers[rank_] = data;
+        g.barrier();
+
+        if (rank_ != root) {
+            std::copy_n(static_cast<const T*>(g.buffers[root]), n, data);
+        }
+
+        g.barrier();
+    }
+
+    std::shared_ptr<local_group> group; ///< The state shared by the replicas
+    size_t rank_;                       ///< The rank of this replica
+};
+
+/*!
+ * \brief Create the communicators of a group of replicas trained in the
+ * same process, one per replica.
+ */
+inline std::vector<std::shared_ptr<communicator>> make_local_communicators(size_t replicas) {
+    auto group = std::make_shared<local_group>(replicas);
+
+    std::vector<std::shared_ptr<communicator>> comms;
+
+    for (size_t r = 0; r < replicas; ++r) {
+        comms.push_back(std::make_shared<local_communicator>(group, r));
+    }
+
+    return comms;
+}
+
+#ifdef DLL_NCCL
+
+/*!
+ * \brief A communicator based on NCCL, between replicas on the GPUs of the
+ * same process.
+ *
+ * The reductions are done device to device, on the stream of the
+ * communicator. The reductions started with start_all_reduce are
+ * asynchronous, they are overlapped with the backpropagation.
+ */
+struct nccl_communicator final : communicator {
+    /*!
+     * \brief Create a communicator over the given NCCL communicator, of the
+     * given device
+     */
+    nccl_communicator(ncclComm_t comm, int gpu) : comm(comm) {
+        int r;
+        int s;
+
+        ncclCommUserRank(comm, &r);
+        ncclCommCount(comm, &s);
+
+        rank_ = r;
+        size_ = s;
+
+        cudaSetDevice(gpu);
+        cudaStreamCreate(&stream);
+    }
+
+    nccl_communicator(const nccl_communicator&) = delete;
+    nccl_communicator& operator=(const nccl_communicator&) = delete;
+
+    ~nccl_communicator() {
+        cudaFree(scratch);
+        cudaStreamDestroy(stream);
+        ncclCommDestroy(comm);
+    }
+
+    size_t rank() const override {
+        return rank_;
+    }
+
+    size_t size() const override {
+        return size_;
+    }
+
+    bool device() const override {
+        return true;
+    }
+
+    void all_reduce(float* data, size_t n) override {
+        host_reduce(data, n, ncclFloat);
+    }
+
+    void all_reduce(double* data, size_t n) override {
+        host_reduce(data, n, ncclDouble);
+    }
+
+    void broadcast(float* data, size_t n, size_t root) override {
+        ncclBroadcast(data, data, n, ncclFloat, int(root), comm, stream);
+        wait();
+    }
+
+    void broadcast(double* data, size_t n, size_t root) override {
+        ncclBroadcast(data, data, n, ncclDouble, int(root), comm, stream);
+        wait();
+    }
+
+    void start_all_reduce(float* data, size_t n) override {
+        ncclAllReduce(data, data, n, ncclFloat, ncclSum, comm, stream);
+    }
+
+    void start_all_reduce(double* data, size_t n) override {
+        ncclAllReduce(data, data, n, ncclDouble, ncclSum, comm, stream);
+    }
+
+    void wait() override {
+        cudaStreamSynchronize(stream);
+    }
+
+private:
+    /*!
+     * \brief Sum the given values of host memory over all the replicas,
+     * through a device buffer
+     */
+    template <typename T>
+    void host_reduce(T* data, size_t n, ncclDataType_t type) {
+        const size_t bytes = n * sizeof(T);
+
+        if (bytes > scratch_size) {
+            cudaFree(scratch);
+            cudaMalloc(&scratch, bytes);
+            scratch_size = bytes;
+        }
+
+        cudaMemcpyAsync(scratch, data, bytes, cudaMemcpyHostToDevice, stream);
+        ncclAllReduce(scratch, scratch, n, type, ncclSum, comm, stream);
+        cudaMemcpyAsync(data, scratch, bytes, cudaMemcpyDeviceToHost, stream);
+
+        wait();
+    }
+
+    ncclComm_t comm;               ///< The NCCL communicator
+    cudaStream_t stream;           ///< The stream of the reductions
+    void* scratch       = nullptr; ///< The device buffer of the reductions of host values
+    size_t scratch_size = 0;       ///< The size of the device buffer, in bytes
+    size_t rank_;                  ///< The rank of this replica
+    size_t size_;                  ///< The number of replicas
+};
+
+/*!
+ * \brief Create the NCCL communicators of replicas on the first given
+ * number of GPUs, replica r being on the GPU r.
+ */
+inline std::vector<std::shared_ptr<communicator>> make_nccl_communicators(size_t gpus) {
+    std::vector<ncclComm_t> raw(gpus);
+
+    ncclCommInitAll(raw.data(), int(gpus), nullptr);
+
+    std::vector<std::shared_ptr<communicator>> comms;
+
+    for (size_t r = 0; r < gpus; ++r) {
+        comms.push_back(std::make_shared<nccl_communicator>(raw[r], int(r)));
+    }
+
+    return comms;
+}
+
+#endif //DLL_NCCL
+
+} //end of dll namespace
@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file dropout.hpp
+ * \brief Fused inverted dropout driven by a counter-based generator
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/random_stream.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The workspace of a dropout layer.
+ *
+ * It only holds the position of the mask of the last forward pass in the
+ * random stream of the layer, from which the mask is generated again
+ * during the backward pass.
+ */
+struct dropout_workspace {
+    uint64_t offset = 0; ///< The first block of the mask of the last forward pass
+};
+
+/*!
+ * \brief The random stream of the masks of a dropout layer.
+ *
+ * Each forward pass reserves a new range of counters in the stream, which
+ * can safely be done concurrently.
+ */
+struct dropout_stream {
+    philox4x32 generator;             ///< The random generator
+    std::atomic<uint64_t> next{0};    ///< The next free block
+
+    /*!
+     * \brief Create a new stream with the given seed
+     */
+    explicit dropout_stream(uint64_t seed) : generator(seed) {}
+
+    /*!
+     * \brief Reserve the counters for a mask of n values
+     * \return The first block of the mask
+     */
+    uint64_t reserve(size_t n) {
+        return next.fetch_add((n + philox4x32::block_size - 1) / philox4x32::block_size);
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Apply the inverted dropout mask starting at the given block, on
+ * raw memory
+ */
+template <typename T>
+void inverted_dropout(T* out, const T* in, size_t n, float p, const philox4x32& generator, uint64_t offset) {
+    const T scale = T(1) / T(1 - p);
+
+    for (size_t i = 0; i < n; i += philox4x32::block_size) {
+        auto block = generator(offset + i / philox4x32::block_size);
+
+        const size_t end = std::min(n - i, philox4x32::block_size);
+
+        for (size_t j = 0; j < end; ++j) {
+            out[i + j] = philox4x32::uniform(block[j]) < p ? T(0) : in[i + j] * scale;
+        }
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Apply inverted dropout to the input, in a single pass.
+ *
+ * The mask is generated on the fly from the given position of the stream.
+ * Calling this function again on the errors with the same position
+ * applies the exact same mask, which is the gradient of the dropout.
+ *
+ * \param output The output, of the same size as the input
+ * \param input The input
+ * \param p The dropout probability
+ * \param stream The random stream
+ * \param offset The position of the mask in the stream
+ */
+template <typename Output, typename Input>
+void inverted_dropout(Output&& output, const Input& input, float p, const dropout_stream& stream, uint64_t offset) {
+    if constexpr (etl::is_dma<Output> && etl::is_dma<Input>) {
+        input.ensure_cpu_up_to_date();
+
+        detail::inverted_dropout(output.memory_start(), input.memory_start(), etl::size(input), p, stream.generator, offset);
+
+        output.invalidate_gpu();
+    } else {
+        auto in  = etl::force_temporary(input);
+        auto out = etl::force_temporary(input);
+
+        detail::inverted_dropout(out.memory_start(), in.memory_start(), etl::size(in), p, stream.generator, offset);
+
+        output = out;
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,325 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file embedding_table.hpp
+ * \brief Gather of the rows of the embedding tables
+ *
+ * The lookups of a large vocabulary are random accesses to memory: the
+ * gather prefetches the rows of the next indices while the current rows
+ * are copied.
+ *
+ * The rows can also be read from a copy of the table in reduced precision
+ * (fp16, bf16 or INT8 with one scale per row), widened during the gather,
+ * to read 2 to 4 times less memory. The copy is rebuilt lazily, from the
+ * weights in full precision, when the weights have changed. The updates
+ * and the gradients are always in the precision of the weights.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/precision.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The precision of the lookup table of an embedding layer
+ */
+enum class embedding_precision {
+    FULL, ///< The weights themselves
+    FP16, ///< IEEE half precision
+    BF16, ///< Brain floating point
+    INT8  ///< Symmetric INT8 with one scale per row
+};
+
+namespace detail {
+
+constexpr size_t embedding_prefetch = 8; ///< The number of rows prefetched ahead of the gather
+
+/*!
+ * \brief Prefetch the given bytes for reading
+ */
+inline void prefetch_bytes([[maybe_unused]] const void* memory, [[maybe_unused]] size_t bytes) {
+#if defined(__GNUC__) || defined(__clang__)
+    const char* p = static_cast<const char*>(memory);
+
+    for (size_t b = 0; b < bytes; b += 64) {
+        __builtin_prefetch(p + b, 0, 1);
+    }
+#endif
+}
+
+/*!
+ * \brief Gather the rows of the given indices into the output, K values
+ * per index, prefetching the rows of the next indices.
+ *
+ * \param v The indices
+ * \param output The output, of K values per index
+ * \param K The number of values per index
+ * \param prefetch A functor prefetching the given row
+ * \param widen A functor copying the given row to the given memory
+ */
+template <typename V, typename O, typename Prefetch, typename Widen>
+void gather_rows(const V& v, O&& output, size_t K, Prefetch&& prefetch, Widen&& widen) {
+    if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<O>>) {
+        v.ensure_cpu_up_to_date();
+
+        const auto* indices = v.memory_start();
+        auto* out           = output.memory_start();
+
+        const size_t n = etl::size(v);
+
+        cpp_assert(etl::size(output) == n * K, "Invalid output size for the gather");
+
+        for (size_t j = 0; j < std::min(n, embedding_prefetch); ++j) {
+            prefetch(size_t(indices[j]));
+        }
+
+        for (size_t j = 0; j < n; ++j) {
+            if (j + embedding_prefetch < n) {
+                prefetch(size_t(indices[j + embedding_prefetch]));
+            }
+
+            widen(size_t(indices[j]), out + j * K);
+        }
+
+        output.invalidate_gpu();
+    } else {
+        using T = etl::value_t<std::decay_t<O>>;
+
+        // The gather is done in contiguous temporaries
+        auto indices = etl::force_temporary(v);
+        etl::dyn_matrix<T, 3> out(etl::dim<0>(output), etl::dim<1>(output), K);
+
+        gather_rows(indices, out, K, prefetch, widen);
+
+        output = out;
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Gather the rows of the given weights, K per index.
+ *
+ * \param v The batch of indices [B, I]
+ * \param w The weights [V, K]
+ * \param output The output [B, I, K]
+ */
+template <typename V, typename W, typename O>
+void gather_embeddings(const V& v, const W& w, O&& output) {
+    if constexpr (etl::is_dma<W>) {
+        using T = etl::value_t<W>;
+
+        const size_t K = etl::dim<1>(w);
+
+        w.ensure_cpu_up_to_date();
+
+        const T* weights = w.memory_start();
+
+        detail::gather_rows(v, output, K,
+            [weights, K](size_t row) { detail::prefetch_bytes(weights + row * K, K * sizeof(T)); },
+            [weights, K](size_t row, auto* out) { std::copy(weights + row * K, weights + (row + 1) * K, out); });
+    } else {
+        output = batch_embedding_lookup(v, w);
+    }
+}
+
+/*!
+ * \brief A copy of the weights of an embedding layer in reduced precision,
+ * for the lookups.
+ *
+ * The copy is built lazily, at the first gather after a change of the
+ * weights. It must be invalidated each time the weights are changed.
+ */
+struct embedding_table {
+    /*!
+     * \brief Construct an empty table, the weights are used directly
+     */
+    embedding_table() = default;
+
+    /*!
+     * \brief Move the table, the lock is not moved
+     */
+    embedding_table(embedding_table&& rhs) noexcept
+            : precision(rhs.precision), ready(rhs.ready), values16(std::move(rhs.values16)), values8(std::move(rhs.values8)), scales(std::move(rhs.scales)) {}
+
+    /*!
+     * \brief Move the table, the lock is not moved
+     */
+    embedding_table& operator=(embedding_table&& rhs) noexcept {
+        precision = rhs.precision;
+        ready     = rhs.ready;
+        values16  = std::move(rhs.values16);
+        values8   = std::move(rhs.values8);
+        scales    = std::move(rhs.scales);
+
+        return *this;
+    }
+
+    /*!
+     * \brief Use the given precision for the next lookups
+     */
+    void set_precision(embedding_precision p) {
+        std::lock_guard<std::mutex> l(lock);
+
+        precision = p;
+        ready     = false;
+
+        values16 = {};
+        values8  = {};
+        scales   = {};
+    }
+
+    /*!
+     * \brief Returns the precision of the lookups
+     */
+    embedding_precision get_precision() const {
+        return precision;
+    }
+
+    /*!
+     * \brief Indicates if the lookups are done in reduced precision
+     */
+    bool reduced() const {
+        return precision != embedding_precision::FULL;
+    }
+
+    /*!
+     * \brief Forget the copy of the weights, after a change of the weights
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+
+        ready = false;
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the copy of the weights
+     */
+    size_t bytes() const {
+        return values16.size() * sizeof(uint16_t) + values8.size() * sizeof(int8_t) + scales.size() * sizeof(float);
+    }
+
+    /*!
+     * \brief Gather the rows of the given indices, widened from the
+     * reduced precision, building the copy of the weights if necessary.
+     *
+     * \param v The batch of indices [B, I]
+     * \param w The weights [V, K]
+     * \param output The output [B, I, K]
+     */
+    template <typename V, typename W, typename O>
+    void gather(const V& v, const W& w, O&& output) const {
+        if (!reduced()) {
+            gather_embeddings(v, w, output);
+            return;
+        }
+
+        build(w);
+
+        const size_t K = etl::dim<1>(w);
+
+        if (precision == embedding_precision::INT8) {
+            const int8_t* values = values8.data();
+            const float* s       = scales.data();
+
+            detail::gather_rows(v, output, K,
+                [values, K](size_t row) { detail::prefetch_bytes(values + row * K, K); },
+                [values, s, K](size_t row, auto* out) {
+                    const float scale = s[row];
+
+                    for (size_t k = 0; k < K; ++k) {
+                        out[k] = values[row * K + k] * scale;
+                    }
+                });
+        } else if (precision == embedding_precision::FP16) {
+            const uint16_t* values = values16.data();
+
+            detail::gather_rows(v, output, K,
+                [values, K](size_t row) { detail::prefetch_bytes(values + row * K, K * sizeof(uint16_t)); },
+                [values, K](size_t row, auto* out) {
+                    for (size_t k = 0; k < K; ++k) {
+                        out[k] = half_to_float(values[row * K + k]);
+                    }
+                });
+        } else {
+            const uint16_t* values = values16.data();
+
+            detail::gather_rows(v, output, K,
+                [values, K](size_t row) { detail::prefetch_bytes(values + row * K, K * sizeof(uint16_t)); },
+                [values, K](size_t row, auto* out) {
+                    for (size_t k = 0; k < K; ++k) {
+                        out[k] = bf16_to_float(values[row * K + k]);
+                    }
+                });
+        }
+    }
+
+private:
+    /*!
+     * \brief Narrow the weights to the reduced precision, if the copy is not
+     * up to date
+     */
+    template <typename W>
+    void build(const W& w) const {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (ready) {
+            return;
+        }
+
+        const size_t V = etl::dim<0>(w);
+        const size_t K = etl::dim<1>(w);
+
+        w.ensure_cpu_up_to_date();
+
+        if (precision == embedding_precision::INT8) {
+            values8.resize(V * K);
+            scales.resize(V);
+
+            for (size_t row = 0; row < V; ++row) {
+                const auto* weights = w.memory_start() + row * K;
+
+                scales[row] = int8_scale(weights, K);
+
+                for (size_t k = 0; k < K; ++k) {
+                    values8[row * K + k] = float_to_int8(weights[k], scales[row]);
+                }
+            }
+        } else {
+            values16.resize(V * K);
+
+            const auto* weights = w.memory_start();
+
+            for (size_t i = 0; i < V * K; ++i) {
+                values16[i] = precision == embedding_precision::FP16 ? float_to_half(weights[i]) : float_to_bf16(weights[i]);
+            }
+        }
+
+        ready = true;
+    }
+
+    embedding_precision precision = embedding_precision::FULL; ///< The precision of the lookups
+
+    mutable std::mutex lock;                ///< The lock protecting the copy
+    mutable bool ready = false;             ///< Indicates if the copy is up to date
+    mutable std::vector<uint16_t> values16; ///< The values in fp16 or bf16
+    mutable std::vector<int8_t> values8;    ///< The values in INT8
+    mutable std::vector<float> scales;      ///< The scale of each row in INT8
+};
+
+} //end of dll namespace
@@ -0,0 +1,302 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file ensemble.hpp
+ * \brief Inference of ensembles of networks of the same type
+ *
+ * The members of an ensemble are forwarded concurrently, each in its own
+ * inference context, and their outputs are averaged in place.
+ *
+ * When the first layer is a dense layer, the members all read the same
+ * input: their first layers are stacked into a single layer with the
+ * weights of all the members side by side, so that the input is read once
+ * in a single matrix multiplication. Only the following layers are run by
+ * member.
+ */
+
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/layer_fwd.hpp"
+#include "dll/util/inference.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/util/trace.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if the first layers of the members of an ensemble
+ * can be stacked (dense layers with an element-wise activation)
+ */
+template <typename L>
+struct is_stackable_dense_impl : std::false_type {};
+
+/*!
+ * \copydoc is_stackable_dense_impl
+ */
+template <typename Desc>
+struct is_stackable_dense_impl<dense_layer_impl<Desc>> : std::bool_constant<is_elementwise_function<Desc::activation_function>> {};
+
+/*!
+ * \copydoc is_stackable_dense_impl
+ */
+template <typename Desc>
+struct is_stackable_dense_impl<dyn_dense_layer_impl<Desc>> : std::bool_constant<is_elementwise_function<Desc::activation_function>> {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can be stacked across the members of
+ * an ensemble
+ */
+template <typename L>
+constexpr bool is_stackable_dense = detail::is_stackable_dense_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Inference of an ensemble of networks of the same type.
+ *
+ * An ensemble must only be used by one thread at a time and the members
+ * must not be modified while it is used.
+ *
+ * \tparam DBN The network type of the members
+ * \tparam Sample The type of one input sample
+ * \tparam B The maximum number of samples of a batch
+ */
+template <typename DBN, typename Sample, size_t B = DBN::batch_size>
+struct ensemble_inference {
+    using dbn_t     = DBN;                               ///< The network type
+    using weight    = typename dbn_t::weight;            ///< The type of the weights
+    using context_t = inference_context<DBN, Sample, B>; ///< The type of the inference contexts
+
+    static constexpr size_t layers     = dbn_t::layers; ///< The number of layers
+    static constexpr size_t batch_size = B;             ///< The maximum number of samples of a batch
+
+    using first_t = typename dbn_t::template layer_type<0>; ///< The type of the first layer
+
+    static constexpr bool stackable = is_stackable_dense<first_t>; ///< Indicates if the first layers can be stacked
+
+    /*!
+     * \brief Create an ensemble
+     *
+     * \param members The members, which must outlive the ensemble
+     * \param sample A sample, only used for its dimensions
+     * \param stack Indicates if the first layers are stacked, when possible
+     */
+    ensemble_inference(std::vector<const dbn_t*> members, const Sample& sample, bool stack = true)
+            : members(std::move(members)) {
+        cpp_assert(!this->members.empty(), "An ensemble needs at least one member");
+
+        for (auto* member : this->members) {
+            contexts.push_back(std::make_unique<context_t>(*member, sample));
+        }
+
+        if constexpr (stackable) {
+            stacked = stack;
+
+            if (stacked) {
+                stack_first_layers();
+            }
+        } else {
+            cpp_unused(stack);
+        }
+    }
+
+    ensemble_inference(const ensemble_inference& rhs) = delete;
+    ensemble_inference& operator=(const ensemble_inference& rhs) = delete;
+
+    /*!
+     * \brief Returns the number of members of the ensemble
+     */
+    size_t size() const {
+        return members.size();
+    }
+
+    /*!
+     * \brief Indicates if the first layers of the members are stacked
+     */
+    bool is_stacked() const {
+        return stacked;
+    }
+
+    /*!
+     * \brief Forward a batch of at most B samples through the ensemble
+     * \param batch The batch of samples
+     * \return A reference to the mean output of the members, of which only
+     * the first dim<0>(batch) samples are valid. The output is overwritten
+     * by the next forward pass.
+     */
+    template <typename Input>
+    auto& forward_batch(const Input& batch) {
+        static dll::timer_id timer_handle("net:ensemble:forward_batch");
+        dll::auto_timer timer(timer_handle);
+
+        if constexpr (stackable) {
+            if (stacked) {
+                forward_stacked(batch);
+            } else {
+                for_each_member([this, &batch](size_t m) { contexts[m]->forward_batch(batch); });
+            }
+        } else {
+            for_each_member([this, &batch](size_t m) { contexts[m]->forward_batch(batch); });
+        }
+
+        // The mean is accumulated in the output of the first member
+
+        auto& output = std::get<layers - 1>(contexts[0]->outputs);
+
+        for (size_t m = 1; m < members.size(); ++m) {
+            output += std::get<layers - 1>(contexts[m]->outputs);
+        }
+
+        if (members.size() > 1) {
+            output *= weight(1.0) / weight(members.size());
+        }
+
+        return output;
+    }
+
+private:
+    /*!
+     * \brief Run functor(m) for each member m, concurrently on the shared scheduler
+     */
+    template <typename Functor>
+    void for_each_member(Functor&& functor) {
+        if (members.size() == 1 || etl::threads == 1) {
+            for (size_t m = 0; m < members.size(); ++m) {
+                functor(m);
+            }
+
+            return;
+        }
+
+        for (size_t m = 0; m < members.size(); ++m) {
+            pool.do_task([&functor, m] {
+                trace_scope scope("pool:task", "pool");
+
+                // ETL must not parallelize inside the workers
+                SERIAL_SECTION {
+                    functor(m);
+                }
+            });
+        }
+
+        pool.wait();
+    }
+
+    /*!
+     * \brief Stack the weights and biases of the first layers of the members
+     */
+    void stack_first_layers() {
+        const size_t m = members.size();
+        const size_t v = etl::dim<0>(members[0]->template layer_get<0>().w);
+        const size_t h = etl::dim<1>(members[0]->template layer_get<0>().w);
+
+        stacked_w = etl::dyn_matrix<weight, 2>(v, m * h);
+        stacked_b = etl::dyn_matrix<weight, 1>(m * h);
+        hidden    = etl::dyn_matrix<weight, 2>(B, m * h);
+
+        for (size_t k = 0; k < m; ++k) {
+            decltype(auto) layer = members[k]->template layer_get<0>();
+
+            for (size_t i = 0; i < v; ++i) {
+                for (size_t j = 0; j < h; ++j) {
+                    stacked_w(i, k * h + j) = layer.w(i, j);
+                }
+            }
+
+            for (size_t j = 0; j < h; ++j) {
+                stacked_b(k * h + j) = layer.b(j);
+            }
+        }
+    }
+
+    /*!
+     * \brief Forward a batch with the first layers of the members stacked
+     */
+    template <typename Input>
+    void forward_stacked(const Input& batch) {
+        const size_t n = etl::dim<0>(batch);
+        const size_t v = etl::dim<0>(stacked_w);
+        const size_t h = etl::dim<1>(stacked_w) / members.size();
+
+        cpp_assert(n <= B, "The batch is too large for the ensemble");
+
+        // The input of all the members is read once
+        if (n == B) {
+            hidden = etl::reshape(batch, B, v) * stacked_w;
+        } else {
+            auto& input = contexts[0]->input;
+
+            input = 0;
+
+            for (size_t i = 0; i < n; ++i) {
+                input(i) = batch(i);
+            }
+
+            hidden = etl::reshape(input, B, v) * stacked_w;
+        }
+
+        f_bias_activate_2d<first_t::activation_function, !first_t::no_bias>(hidden, stacked_b);
+
+        for_each_member([this, h](size_t m) {
+            auto& first = std::get<0>(contexts[m]->outputs);
+
+            for (size_t i = 0; i < B; ++i) {
+                for (size_t j = 0; j < h; ++j) {
+                    first(i, j) = hidden(i, m * h + j);
+                }
+            }
+
+            if constexpr (layers > 1) {
+                contexts[m]->template forward_batch_from<1>(first);
+            }
+        });
+    }
+
+    std::vector<const dbn_t*> members;                ///< The members of the ensemble
+    std::vector<std::unique_ptr<context_t>> contexts; ///< The inference context of each member
+    task_group pool;                                  ///< The tasks running the members
+
+    bool stacked = false;                 ///< Indicates if the first layers are stacked
+    etl::dyn_matrix<weight, 2> stacked_w; ///< The stacked weights of the first layers
+    etl::dyn_matrix<weight, 1> stacked_b; ///< The stacked biases of the first layers
+    etl::dyn_matrix<weight, 2> hidden;    ///< The stacked output of the first layers
+};
+
+/*!
+ * \brief Create an ensemble of the given networks
+ * \param members The members, which must outlive the ensemble
+ * \param sample A sample, only used for its dimensions
+ * \param stack Indicates if the first layers are stacked, when possible
+ * \tparam B The maximum number of samples of a batch
+ * \return The ensemble
+ */
+template <size_t B = 0, typename DBN, typename Sample>
+auto make_ensemble(const std::vector<std::unique_ptr<DBN>>& members, const Sample& sample, bool stack = true) {
+    constexpr size_t batch = B ? B : DBN::batch_size;
+
+    std::vector<const DBN*> pointers;
+
+    for (auto& member : members) {
+        pointers.push_back(member.get());
+    }
+
+    return std::make_unique<ensemble_inference<DBN, Sample, batch>>(std::move(pointers), sample, stack);
+}
+
+} //end of dll namespace
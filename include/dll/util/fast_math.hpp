@@ -0,0 +1,154 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fast_math.hpp
+ * \brief Fast approximations of exp, sigmoid and tanh
+ *
+ * The exponential is computed with a Cody-Waite range reduction and a
+ * polynomial of degree 7, the power of two being built directly in the
+ * exponent bits. The loops have no branches and no calls, so that they are
+ * vectorized by the compiler, which is not possible with std::exp.
+ *
+ * The approximations are computed in single precision: the relative error
+ * of fast_exp is below 1e-6 on [-87, 87] and the absolute error of
+ * fast_sigmoid and fast_tanh is below 1e-6. The exponential saturates
+ * outside of this range, there are no infinities, but the NaN are
+ * propagated.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace dll {
+
+/*!
+ * \brief The precision of the evaluation of the activation functions
+ */
+enum class function_precision {
+    EXACT, ///< The functions of ETL
+    FAST   ///< Vectorized approximations of exp, sigmoid and tanh
+};
+
+/*!
+ * \brief Compute an approximation of the exponential of x
+ */
+template <typename T>
+inline T fast_exp(T x) {
+    // The comparisons of floats prevent the vectorization (std::floor and
+    // the conversion to an integer as well), everything is done on the bits
+
+    // Clamp |x| to 87, the power of two is then a normal float, the NaN are
+    // kept as they are
+    float v = float(x);
+
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(float));
+
+    const uint32_t a = bits & 0x7FFFFFFFu;
+    bits             = (bits & 0x80000000u) | (a > 0x7F800000u ? a : std::min(a, 0x42AE0000u));
+
+    std::memcpy(&v, &bits, sizeof(float));
+
+    // Round v / ln(2) to nearest by the addition of 1.5 * 2^23, the integer
+    // is then in the low bits of the mantissa
+    const float t = v * 1.44269504088896341f + 12582912.0f;
+
+    int32_t k;
+    std::memcpy(&k, &t, sizeof(float));
+    k -= 0x4B400000;
+
+    const float n = float(k);
+
+    // r = v - n * ln(2), in two steps for the rounding errors
+    float r = v - n * 0.693359375f;
+    r       = r + n * 2.12194440e-4f;
+
+    float p = 1.9875691500e-4f;
+    p       = p * r + 1.3981999507e-3f;
+    p       = p * r + 8.3334519073e-3f;
+    p       = p * r + 4.1665795894e-2f;
+    p       = p * r + 1.6666665459e-1f;
+    p       = p * r + 5.0000001201e-1f;
+    p       = p * r * r + r + 1.0f;
+
+    const int32_t e = (k + 127) << 23;
+
+    float scale;
+    std::memcpy(&scale, &e, sizeof(float));
+
+    return T(p * scale);
+}
+
+/*!
+ * \brief Compute an approximation of the logistic sigmoid of x
+ */
+template <typename T>
+inline T fast_sigmoid(T x) {
+    return T(1) / (T(1) + fast_exp(-x));
+}
+
+/*!
+ * \brief Compute an approximation of the hyperbolic tangent of x
+ */
+template <typename T>
+inline T fast_tanh(T x) {
+    return T(2) / (T(1) + fast_exp(T(-2) * x)) - T(1);
+}
+
+/*!
+ * \brief Apply the approximation of the sigmoid to n values, in place
+ */
+template <typename T>
+void fast_sigmoid(T* values, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = fast_sigmoid(values[i]);
+    }
+}
+
+/*!
+ * \brief Apply the approximation of the hyperbolic tangent to n values, in
+ * place
+ */
+template <typename T>
+void fast_tanh(T* values, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = fast_tanh(values[i]);
+    }
+}
+
+/*!
+ * \brief Apply the softmax, with the approximation of the exponential, to
+ * each of the rows of n values, in place
+ */
+template <typename T>
+void fast_softmax(T* values, size_t rows, size_t n) {
+    for (size_t r = 0; r < rows; ++r) {
+        T* row = values + r * n;
+
+        T max = row[0];
+        for (size_t i = 1; i < n; ++i) {
+            max = std::max(max, row[i]);
+        }
+
+        T sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            row[i] = fast_exp(row[i] - max);
+            sum += row[i];
+        }
+
+        const T inv = T(1) / sum;
+        for (size_t i = 0; i < n; ++i) {
+            row[i] *= inv;
+        }
+    }
+}
+
+} //end of dll namespace
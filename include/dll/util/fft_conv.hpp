@@ -0,0 +1,396 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fft_conv.hpp
+ * \brief FFT convolutions with the spectra of the filters computed once
+ *
+ * The inputs and the filters are zero-padded to the next powers of two of
+ * the size of the visible maps. This is enough for both the valid
+ * correlation (hidden activations) and the full convolution (visible
+ * activations) to be computed without wrap-around, and therefore for a
+ * single spectrum of each filter to serve both: the correlation simply
+ * uses its conjugate.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Compute the twiddle factors of a FFT of size n
+ */
+template <typename T>
+std::vector<std::complex<T>> fft_twiddles(size_t n) {
+    std::vector<std::complex<T>> tw(n / 2);
+
+    for (size_t k = 0; k < n / 2; ++k) {
+        const double a = -2.0 * M_PI * double(k) / double(n);
+        tw[k]          = std::complex<T>(T(std::cos(a)), T(std::sin(a)));
+    }
+
+    return tw;
+}
+
+/*!
+ * \brief Compute the unnormalized FFT (or inverse FFT) of x in place
+ * \param x The data [n]
+ * \param n The size of the transform, a power of two
+ * \param tw The twiddle factors of size n
+ * \param inverse true for the inverse transform
+ */
+template <typename T>
+void fft_1d(std::complex<T>* x, size_t n, const std::complex<T>* tw, bool inverse) {
+    // Bit reversal permutation
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j) {
+            std::swap(x[i], x[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t j = 0; j < half; ++j) {
+                const auto w = inverse ? std::conj(tw[j * step]) : tw[j * step];
+                const auto u = x[i + j];
+                const auto v = x[i + j + half] * w;
+
+                x[i + j]        = u + v;
+                x[i + j + half] = u - v;
+            }
+        }
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief The spectra of the filters of a convolutional RBM, for FFT
+ * convolutions while the filters do not change.
+ *
+ * The filters are [K, C, NW1, NW2], the visible maps [N, C, NV1, NV2] and
+ * the hidden maps [N, K, NV1 - NW1 + 1, NV2 - NW2 + 1].
+ */
+template <typename T>
+struct conv_fft_plan {
+    using complex_t = std::complex<T>; ///< The complex type
+
+    size_t K   = 0; ///< The number of filters
+    size_t C   = 0; ///< The number of channels
+    size_t NV1 = 0; ///< The first dimension of the visible maps
+    size_t NV2 = 0; ///< The second dimension of the visible maps
+    size_t NW1 = 0; ///< The first dimension of the filters
+    size_t NW2 = 0; ///< The second dimension of the filters
+    size_t P1  = 0; ///< The first padded dimension
+    size_t P2  = 0; ///< The second padded dimension
+
+    std::vector<complex_t> spectra; ///< The spectra of the filters [K, C, P1, P2]
+
+    /*!
+     * \brief Returns the smallest power of two greater or equal to n
+     */
+    static size_t padded(size_t n) noexcept {
+        size_t p = 1;
+
+        while (p < n) {
+            p <<= 1;
+        }
+
+        return p;
+    }
+
+    /*!
+     * \brief Indicates if the FFT convolutions are expected to be faster
+     * than the direct ones for the given shape.
+     *
+     * The cost of the FFT of the maps of each sample and of the products of
+     * their spectra is compared to the cost of the direct convolution.
+     */
+    static bool pays_off(size_t K, size_t C, size_t NV1, size_t NV2, size_t NW1, size_t NW2) noexcept {
+        const double P      = double(padded(NV1) * padded(NV2));
+        const double fft    = double(K + C) * 5.0 * P * std::log2(P) + double(K * C) * 8.0 * P;
+        const double direct = double(K * C) * 2.0 * double((NV1 - NW1 + 1) * (NV2 - NW2 + 1) * NW1 * NW2);
+
+        return fft < direct;
+    }
+
+    /*!
+     * \brief Indicates if the spectra are computed
+     */
+    bool ready() const noexcept {
+        return !spectra.empty();
+    }
+
+    /*!
+     * \brief Drop the spectra, once the filters have changed
+     */
+    void invalidate() {
+        spectra.clear();
+    }
+
+    /*!
+     * \brief Compute the spectra of the given filters on raw memory
+     */
+    void prepare(const T* w, size_t K, size_t C, size_t NV1, size_t NV2, size_t NW1, size_t NW2) {
+        this->K   = K;
+        this->C   = C;
+        this->NV1 = NV1;
+        this->NV2 = NV2;
+        this->NW1 = NW1;
+        this->NW2 = NW2;
+
+        if (P1 != padded(NV1) || P2 != padded(NV2)) {
+            P1 = padded(NV1);
+            P2 = padded(NV2);
+
+            tw1 = detail::fft_twiddles<T>(P1);
+            tw2 = detail::fft_twiddles<T>(P2);
+        }
+
+        const size_t P = P1 * P2;
+
+        spectra.assign(K * C * P, complex_t(0));
+
+        for (size_t kc = 0; kc < K * C; ++kc) {
+            complex_t* s = spectra.data() + kc * P;
+
+            for (size_t i = 0; i < NW1; ++i) {
+                for (size_t j = 0; j < NW2; ++j) {
+                    s[i * P2 + j] = w[(kc * NW1 + i) * NW2 + j];
+                }
+            }
+
+            transform(s, NW1, false);
+        }
+    }
+
+    /*!
+     * \brief Compute the hidden maps, the valid correlations of the
+     * visible maps with the filters, on raw memory
+     * \param out The hidden maps [N, K, NH1, NH2]
+     * \param in The visible maps [N, C, NV1, NV2]
+     * \param N The number of samples
+     */
+    void valid_flipped(T* out, const T* in, size_t N) const {
+        const size_t P   = P1 * P2;
+        const size_t NH1 = NV1 - NW1 + 1;
+        const size_t NH2 = NV2 - NW2 + 1;
+        const T scale    = T(1) / T(P);
+
+        std::vector<complex_t> x(C * P);
+        std::vector<complex_t> acc(P);
+
+        for (size_t n = 0; n < N; ++n) {
+            load(x.data(), in + n * C * NV1 * NV2, C, NV1, NV2);
+
+            for (size_t k = 0; k < K; ++k) {
+                std::fill(acc.begin(), acc.end(), complex_t(0));
+
+                for (size_t c = 0; c < C; ++c) {
+                    const complex_t* xc = x.data() + c * P;
+                    const complex_t* wc = spectra.data() + (k * C + c) * P;
+
+                    for (size_t i = 0; i < P; ++i) {
+                        acc[i] += xc[i] * std::conj(wc[i]);
+                    }
+                }
+
+                transform(acc.data(), P1, true);
+
+                T* o = out + (n * K + k) * NH1 * NH2;
+
+                for (size_t i = 0; i < NH1; ++i) {
+                    for (size_t j = 0; j < NH2; ++j) {
+                        o[i * NH2 + j] = acc[i * P2 + j].real() * scale;
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the visible maps, the full convolutions of the hidden
+     * maps with the filters, on raw memory
+     * \param out The visible maps [N, C, NV1, NV2]
+     * \param in The hidden maps [N, K, NH1, NH2]
+     * \param N The number of samples
+     */
+    void full(T* out, const T* in, size_t N) const {
+        const size_t P   = P1 * P2;
+        const size_t NH1 = NV1 - NW1 + 1;
+        const size_t NH2 = NV2 - NW2 + 1;
+        const T scale    = T(1) / T(P);
+
+        std::vector<complex_t> x(K * P);
+        std::vector<complex_t> acc(P);
+
+        for (size_t n = 0; n < N; ++n) {
+            load(x.data(), in + n * K * NH1 * NH2, K, NH1, NH2);
+
+            for (size_t c = 0; c < C; ++c) {
+                std::fill(acc.begin(), acc.end(), complex_t(0));
+
+                for (size_t k = 0; k < K; ++k) {
+                    const complex_t* xk = x.data() + k * P;
+                    const complex_t* wk = spectra.data() + (k * C + c) * P;
+
+                    for (size_t i = 0; i < P; ++i) {
+                        acc[i] += xk[i] * wk[i];
+                    }
+                }
+
+                transform(acc.data(), P1, true);
+
+                T* o = out + (n * C + c) * NV1 * NV2;
+
+                for (size_t i = 0; i < NV1; ++i) {
+                    for (size_t j = 0; j < NV2; ++j) {
+                        o[i * NV2 + j] = acc[i * P2 + j].real() * scale;
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the spectra of the given filters [K, C, NW1, NW2] for
+     * visible maps of NV1 x NV2
+     */
+    template <typename W>
+    void prepare(const W& w, size_t NV1, size_t NV2) {
+        if constexpr (!etl::is_dma<W>) {
+            auto w_t = etl::force_temporary(w);
+            prepare(w_t, NV1, NV2);
+        } else {
+            w.ensure_cpu_up_to_date();
+
+            prepare(w.memory_start(), etl::dim<0>(w), etl::dim<1>(w), NV1, NV2, etl::dim<2>(w), etl::dim<3>(w));
+        }
+    }
+
+    /*!
+     * \brief Compute output = conv_4d_valid_flipped(input, w)
+     * \param output The hidden maps [N, K, NH1, NH2]
+     * \param input The visible maps [N, C, NV1, NV2]
+     */
+    template <typename O, typename I>
+    void valid_flipped(O&& output, const I& input) const {
+        if constexpr (!etl::is_dma<I>) {
+            auto input_t = etl::force_temporary(input);
+            valid_flipped(output, input_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+            auto output_t = etl::force_temporary(output);
+            valid_flipped(output_t, input);
+            output = output_t;
+        } else {
+            cpp_assert(etl::size(input) == etl::dim<0>(input) * C * NV1 * NV2, "Invalid input for conv_fft_plan::valid_flipped");
+
+            input.ensure_cpu_up_to_date();
+
+            valid_flipped(output.memory_start(), input.memory_start(), etl::dim<0>(input));
+
+            output.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Compute output = conv_4d_full(input, w)
+     * \param output The visible maps [N, C, NV1, NV2]
+     * \param input The hidden maps [N, K, NH1, NH2]
+     */
+    template <typename O, typename I>
+    void full(O&& output, const I& input) const {
+        if constexpr (!etl::is_dma<I>) {
+            auto input_t = etl::force_temporary(input);
+            full(output, input_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+            auto output_t = etl::force_temporary(output);
+            full(output_t, input);
+            output = output_t;
+        } else {
+            cpp_assert(etl::size(output) == etl::dim<0>(input) * C * NV1 * NV2, "Invalid output for conv_fft_plan::full");
+
+            input.ensure_cpu_up_to_date();
+
+            full(output.memory_start(), input.memory_start(), etl::dim<0>(input));
+
+            output.invalidate_gpu();
+        }
+    }
+
+private:
+    /*!
+     * \brief Compute the 2D transform of a padded map in place
+     * \param x The map [P1, P2]
+     * \param rows The number of leading rows that may be non-zero
+     * \param inverse true for the inverse transform
+     */
+    void transform(complex_t* x, size_t rows, bool inverse) const {
+        // The rows past the map are zero, and so are their transforms
+        for (size_t i = 0; i < rows; ++i) {
+            detail::fft_1d(x + i * P2, P2, tw2.data(), inverse);
+        }
+
+        std::vector<complex_t> column(P1);
+
+        for (size_t j = 0; j < P2; ++j) {
+            for (size_t i = 0; i < P1; ++i) {
+                column[i] = x[i * P2 + j];
+            }
+
+            detail::fft_1d(column.data(), P1, tw1.data(), inverse);
+
+            for (size_t i = 0; i < P1; ++i) {
+                x[i * P2 + j] = column[i];
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the spectra of M maps of D1 x D2
+     */
+    void load(complex_t* x, const T* in, size_t M, size_t D1, size_t D2) const {
+        const size_t P = P1 * P2;
+
+        std::fill_n(x, M * P, complex_t(0));
+
+        for (size_t m = 0; m < M; ++m) {
+            for (size_t i = 0; i < D1; ++i) {
+                for (size_t j = 0; j < D2; ++j) {
+                    x[m * P + i * P2 + j] = in[(m * D1 + i) * D2 + j];
+                }
+            }
+
+            transform(x + m * P, D1, false);
+        }
+    }
+
+    std::vector<complex_t> tw1; ///< The twiddle factors of the first dimension
+    std::vector<complex_t> tw2; ///< The twiddle factors of the second dimension
+};
+
+} //end of dll namespace
@@ -0,0 +1,145 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fold.hpp
+ * \brief Folding of batch normalization into the preceding layer, for inference
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer is a batch normalization layer that can
+ * be folded
+ */
+template <typename L, typename Enable = void>
+struct is_foldable_normalization_impl : std::false_type {};
+
+/*!
+ * \copydoc is_foldable_normalization_impl
+ */
+template <typename L>
+struct is_foldable_normalization_impl<L, std::void_t<decltype(std::declval<L&>().folded)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a batch normalization can be folded into a
+ * layer, with D-dimensional weights
+ */
+template <typename L, size_t D, typename Enable = void>
+struct is_fold_target_impl : std::false_type {};
+
+/*!
+ * \copydoc is_fold_target_impl
+ */
+template <typename L, size_t D>
+struct is_fold_target_impl<L, D, std::void_t<decltype(L::no_bias), decltype(L::activation_function), decltype(std::declval<L&>().w)>>
+        : std::bool_constant<!L::no_bias && L::activation_function == function::IDENTITY && etl::dimensions<decltype(std::declval<L&>().w)>() == D> {};
+
+/*!
+ * \brief Traits to test if a layer has caches of its weights
+ */
+template <typename L, typename Enable = void>
+struct has_weights_changed_impl : std::false_type {};
+
+/*!
+ * \copydoc has_weights_changed_impl
+ */
+template <typename L>
+struct has_weights_changed_impl<L, std::void_t<decltype(std::declval<L&>().weights_changed())>> : std::true_type {};
+
+/*!
+ * \brief Forget the caches of the weights of the layer, if any
+ */
+template <typename L>
+void weights_changed([[maybe_unused]] L& layer) {
+    if constexpr (has_weights_changed_impl<L>::value) {
+        layer.weights_changed();
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer is a batch normalization layer that
+ * can be folded into its preceding layer
+ */
+template <typename L>
+constexpr bool is_foldable_normalization = detail::is_foldable_normalization_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if a batch normalization can be folded into the given
+ * layer.
+ *
+ * This is only possible for layers with D-dimensional weights, biases and
+ * no activation function (the activation must be done after the
+ * normalization).
+ */
+template <typename L, size_t D>
+constexpr bool is_fold_target = detail::is_fold_target_impl<std::decay_t<L>, D>::value;
+
+/*!
+ * \brief Reset the parameters and the statistics of a folded batch
+ * normalization to the identity.
+ *
+ * The stored normalization (store() or checkpoints) is then the identity,
+ * and does not normalize the folded layer a second time once loaded.
+ */
+template <typename G, typename M, typename W>
+void reset_folded_normalization(G& gamma, G& beta, M& mean, M& var, W e) {
+    gamma = 1.0;
+    beta  = 0.0;
+    mean  = 0.0;
+    var   = 1.0 - e;
+}
+
+/*!
+ * \brief Fold a 2D batch normalization into the weights and biases of the
+ * given dense layer, and reset the normalization to the identity.
+ */
+template <typename L, typename G, typename M, typename W>
+void fold_batch_normalization_2d(L& layer, G& gamma, G& beta, M& mean, M& var, W e) {
+    auto s = etl::force_temporary(gamma / etl::sqrt(var + e));
+
+    for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+        layer.w(i) = layer.w(i) >> s;
+    }
+
+    layer.b = ((layer.b - mean) >> s) + beta;
+
+    detail::weights_changed(layer);
+
+    reset_folded_normalization(gamma, beta, mean, var, e);
+}
+
+/*!
+ * \brief Fold a 4D batch normalization into the filters and biases of the
+ * given convolutional layer, and reset the normalization to the identity.
+ */
+template <typename L, typename G, typename M, typename W>
+void fold_batch_normalization_4d(L& layer, G& gamma, G& beta, M& mean, M& var, W e) {
+    auto s = etl::force_temporary(gamma / etl::sqrt(var + e));
+
+    for (size_t k = 0; k < etl::dim<0>(layer.w); ++k) {
+        layer.w(k) = layer.w(k) * s(k);
+        layer.b(k) = (layer.b(k) - mean(k)) * s(k) + beta(k);
+    }
+
+    detail::weights_changed(layer);
+    reset_folded_normalization(gamma, beta, mean, var, e);
+}
+
+} //end of dll namespace
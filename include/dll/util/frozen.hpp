@@ -0,0 +1,276 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file frozen.hpp
+ * \brief Frozen, inference-only networks
+ *
+ * A trained network still holds state that is only useful for training.
+ * Freezing a network prepares it once and for all for inference:
+ *
+ *  - The batch normalization layers are folded into their preceding
+ *    layers, when possible.
+ *  - The backups of the weights (backup_weights()) and the contexts of
+ *    the conjugate gradient training are released.
+ *  - The lazy inference caches of the layers are computed.
+ *  - The dropout layers, the identity activations and the folded
+ *    normalizations are skipped by the forward pass, which runs on an
+ *    inference_plan, without allocations.
+ *
+ * The frozen network can only forward batches. Its weights are stored as
+ * a single contiguous blob, aligned after a small header, holding only the
+ * parameters of the layers that are still executed. It is loaded with a
+ * single read.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "dll/util/checkpoint.hpp"
+#include "dll/util/inference_plan.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A frozen network, bound to inference
+ *
+ * \tparam DBN The network type
+ * \tparam Sample The type of one input sample
+ * \tparam B The maximum number of samples of a batch
+ */
+template <typename DBN, typename Sample, size_t B = DBN::batch_size>
+struct frozen_dbn {
+    using dbn_t  = DBN;                             ///< The network type
+    using plan_t = inference_plan<DBN, Sample, B>; ///< The type of the inference plan
+
+    static constexpr size_t batch_size = B; ///< The maximum number of samples of a batch
+
+    static constexpr uint32_t magic   = 0x464C4C44; ///< The magic number of the frozen files ("DLLF")
+    static constexpr uint32_t version = 1;          ///< The version of the frozen files
+    static constexpr size_t header    = 64;         ///< The size of the header of the frozen files, in bytes
+
+private:
+    std::unique_ptr<dbn_t> network; ///< The frozen network
+
+    /*!
+     * \brief Freeze the given network
+     */
+    static std::unique_ptr<dbn_t> freeze(std::unique_ptr<dbn_t> network) {
+        network->fold_batch_normalization();
+        network->release_backup();
+
+        network->for_each_layer([](auto& layer) {
+            layer.release_cg_context();
+        });
+
+        return network;
+    }
+
+public:
+    plan_t plan; ///< The inference plan of the network
+
+    /*!
+     * \brief Freeze the given network
+     * \param network The trained network, which is not usable for training anymore
+     * \param sample A sample, only used for its dimensions
+     */
+    frozen_dbn(std::unique_ptr<dbn_t> network, const Sample& sample)
+            : network(freeze(std::move(network))), plan(*this->network, sample) {}
+
+    frozen_dbn(const frozen_dbn& rhs) = delete;
+    frozen_dbn& operator=(const frozen_dbn& rhs) = delete;
+
+    /*!
+     * \brief Returns the frozen network
+     */
+    const dbn_t& dbn() const {
+        return *network;
+    }
+
+    /*!
+     * \brief Forward a batch of at most B samples through the network
+     * \param batch The batch of samples
+     * \return A reference to the output of the network, of which only the
+     * first dim<0>(batch) samples are valid. The output is overwritten by
+     * the next forward pass.
+     */
+    template <typename Input>
+    auto& forward_batch(const Input& batch) {
+        return plan.forward_batch(batch);
+    }
+
+    /*!
+     * \brief Returns the weights of the executed layers, as one blob
+     */
+    std::string weights() const {
+        std::ostringstream os;
+
+        size_t l = 0;
+
+        network->for_each_layer([this, &os, &l](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                if (!plan.layout.skipped[l]) {
+                    layer.store(os);
+                }
+            }
+
+            ++l;
+        });
+
+        return os.str();
+    }
+
+    /*!
+     * \brief Store the frozen network into the given stream
+     */
+    void store(std::ostream& os) const {
+        const auto blob = weights();
+
+        char head[header] = {};
+
+        const uint32_t fields[2] = {magic, version};
+        const uint64_t size      = blob.size();
+
+        std::copy_n(reinterpret_cast<const char*>(fields), sizeof(fields), head);
+        std::copy_n(reinterpret_cast<const char*>(&size), sizeof(size), head + sizeof(fields));
+
+        os.write(head, header);
+        os.write(blob.data(), blob.size());
+    }
+
+    /*!
+     * \brief Load the frozen network from the given stream.
+     *
+     * The stream must have been stored from a frozen network of the same
+     * type.
+     *
+     * \return true if the network was loaded, false otherwise
+     */
+    bool load(std::istream& is) {
+        char head[header] = {};
+
+        uint32_t fields[2] = {};
+        uint64_t size      = 0;
+
+        if (!is.read(head, header)) {
+            std::cerr << "ERROR: Impossible to read the frozen network" << std::endl;
+            return false;
+        }
+
+        std::copy_n(head, sizeof(fields), reinterpret_cast<char*>(fields));
+        std::copy_n(head + sizeof(fields), sizeof(size), reinterpret_cast<char*>(&size));
+
+        if (fields[0] != magic || fields[1] != version) {
+            std::cerr << "ERROR: Invalid frozen network" << std::endl;
+            return false;
+        }
+
+        if (size != weights().size()) {
+            std::cerr << "ERROR: The frozen network does not match this network" << std::endl;
+            return false;
+        }
+
+        std::string blob(size, '\0');
+
+        if (!is.read(&blob[0], size)) {
+            std::cerr << "ERROR: Impossible to read the frozen network" << std::endl;
+            return false;
+        }
+
+        std::istringstream bs(std::move(blob));
+
+        size_t l = 0;
+
+        network->for_each_layer([this, &bs, &l](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                if (!plan.layout.skipped[l]) {
+                    layer.load(bs);
+                }
+            }
+
+            ++l;
+        });
+
+        std::lock_guard<std::mutex> lock(detail::inference_lock());
+
+        network->prepare_inference();
+
+        return true;
+    }
+
+    /*!
+     * \brief Store a checkpoint of the frozen network into the given file
+     * \param file The path to the file
+     * \param precision The precision of the stored weights
+     */
+    void store_checkpoint(const std::string& file, checkpoint_precision precision = checkpoint_precision::NATIVE) const {
+        network->store_checkpoint(file, precision);
+    }
+
+    /*!
+     * \brief Load the frozen network from the given checkpoint file.
+     *
+     * The checkpoint must have been stored from a frozen network of the
+     * same type.
+     *
+     * \param file The path to the checkpoint
+     * \param verify Indicates if the checksum of the checkpoint is verified
+     * \return true if the network was loaded, false otherwise
+     */
+    bool load_checkpoint(const std::string& file, bool verify = true) {
+        if (!network->load_checkpoint(file, verify)) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(detail::inference_lock());
+
+        network->prepare_inference();
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the frozen network into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the frozen network from the given file
+     * \return true if the network was loaded, false otherwise
+     */
+    bool load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        return load(is);
+    }
+};
+
+/*!
+ * \brief Freeze the given trained network for inference
+ * \param network The trained network
+ * \param sample A sample, only used for its dimensions
+ * \tparam B The maximum number of samples of a batch
+ * \return The frozen network
+ */
+template <size_t B = 0, typename DBN, typename Sample>
+auto freeze(std::unique_ptr<DBN> network, const Sample& sample) {
+    constexpr size_t batch = B ? B : DBN::batch_size;
+
+    return std::make_unique<frozen_dbn<DBN, Sample, batch>>(std::move(network), sample);
+}
+
+} //end of dll namespace
@@ -0,0 +1,162 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file frozen_cache.hpp
+ * \brief Cache of the outputs of the frozen prefix of a network
+ *
+ * When the first layers of a network are frozen (see frozen_prefix), their
+ * outputs for a sample never change during training. If the samples are not
+ * augmented, the outputs of the prefix are computed once for the whole
+ * training set and the following epochs directly train the other layers
+ * from them.
+ *
+ * The cache is kept in memory or written once to a binary dataset shard
+ * (see binary.hpp) and served from the mapped file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/datasets/binary.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The outputs of the frozen prefix of a network for a training set,
+ * with their labels.
+ *
+ * \tparam T The type of the outputs
+ */
+template <typename T>
+struct frozen_feature_cache {
+    size_t samples     = 0; ///< The number of cached samples
+    size_t sample_size = 0; ///< The number of values of the output of one sample
+    size_t label_size  = 0; ///< The number of values of one label
+
+    const void* source = nullptr; ///< The generator the cache was built from
+    bool ready         = false;   ///< Indicates if the cache is complete
+
+    std::vector<T> features;   ///< The outputs of the prefix (when kept in memory)
+    std::vector<float> labels; ///< The labels (when kept in memory)
+
+    std::unique_ptr<binary::shard> mapped; ///< The mapped shard (when written to a file)
+
+    /*!
+     * \brief Forget the cached samples
+     */
+    void clear() {
+        samples     = 0;
+        sample_size = 0;
+        label_size  = 0;
+        source      = nullptr;
+        ready       = false;
+
+        features.clear();
+        labels.clear();
+        mapped.reset();
+    }
+
+    /*!
+     * \brief Append a batch of outputs of the prefix and their labels to
+     * the cache
+     * \param outputs The outputs of the prefix [n, ...]
+     * \param batch_labels The labels [n, ...]
+     */
+    template <typename O, typename L>
+    void append(const O& outputs, const L& batch_labels) {
+        const size_t n = etl::dim<0>(outputs);
+
+        if (!n) {
+            return;
+        }
+
+        sample_size = etl::size(outputs) / n;
+        label_size  = etl::size(batch_labels) / n;
+
+        auto o = etl::force_temporary(outputs);
+        auto l = etl::force_temporary(batch_labels);
+
+        o.ensure_cpu_up_to_date();
+        l.ensure_cpu_up_to_date();
+
+        features.insert(features.end(), o.memory_start(), o.memory_start() + n * sample_size);
+
+        for (size_t i = 0; i < n * label_size; ++i) {
+            labels.push_back(float(l.memory_start()[i]));
+        }
+
+        samples += n;
+    }
+
+    /*!
+     * \brief Write the cache to a binary dataset shard and serve it from
+     * the mapped file, releasing the memory.
+     *
+     * \param path The path of the shard
+     * \return true if the cache is now mapped, false if it is still in memory
+     */
+    bool map(const std::string& path) {
+        binary::header head;
+        std::memset(&head, 0, sizeof(head));
+        std::memcpy(head.magic, binary::magic, sizeof(binary::magic));
+        head.version    = binary::version;
+        head.type       = uint32_t(binary::dtype_of<T>::value);
+        head.samples    = samples;
+        head.dimensions = 1;
+        head.shape[0]   = sample_size;
+        head.label_size = label_size;
+
+        if (!binary::write_shard(path, features, labels, head)) {
+            return false;
+        }
+
+        auto shard = std::make_unique<binary::shard>(path);
+
+        if (shard->head.samples != samples) {
+            return false;
+        }
+
+        mapped = std::move(shard);
+
+        std::vector<T>().swap(features);
+        std::vector<float>().swap(labels);
+
+        return true;
+    }
+
+    /*!
+     * \brief Returns the cached output of the given sample
+     */
+    const T* sample(size_t i) const {
+        if (mapped) {
+            return reinterpret_cast<const T*>(mapped->sample(i));
+        }
+
+        return features.data() + i * sample_size;
+    }
+
+    /*!
+     * \brief Returns the label of the given sample
+     */
+    const float* label(size_t i) const {
+        if (mapped) {
+            return mapped->label(i);
+        }
+
+        return labels.data() + i * label_size;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,172 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fusion.hpp
+ * \brief Compile-time detection of the adjacent layers that can be fused
+ *
+ * A dense or convolutional layer without activation function (the head)
+ * followed by an element-wise activation_layer is executed as a single
+ * layer: the head directly applies the activation function in its bias
+ * pass and writes into the output of the activation layer. The output of
+ * the head is never written and the activation layer is not executed.
+ *
+ * For inference, a head followed by a batch normalization folded into it
+ * and by an activation layer is fused the same way, the normalization
+ * being skipped.
+ *
+ * A nearest-neighbour upsampling followed by a same convolution is
+ * executed by the convolution directly on the input of the upsampling (see
+ * subpixel_conv.hpp), the output of the upsampling is never computed.
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/layer_fwd.hpp"
+#include "dll/util/fold.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer can compute its output with another
+ * activation function than its own
+ */
+template <typename L, typename Enable = void>
+struct has_activation_forward_impl : std::false_type {};
+
+/*!
+ * \copydoc has_activation_forward_impl
+ */
+template <typename L>
+struct has_activation_forward_impl<L, std::void_t<decltype(std::declval<const L&>().template forward_batch<function::IDENTITY>(
+                                                              std::declval<etl::dyn_matrix<typename L::weight, 2>&>(),
+                                                              std::declval<const etl::dyn_matrix<typename L::weight, 2>&>()))>>
+        : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can be the head of a fusion
+ */
+template <typename L, bool = has_activation_forward_impl<L>::value>
+struct is_fusion_head_impl : std::false_type {};
+
+/*!
+ * \copydoc is_fusion_head_impl
+ */
+template <typename L>
+struct is_fusion_head_impl<L, true> : std::bool_constant<L::activation_function == function::IDENTITY> {};
+
+/*!
+ * \brief Traits to test if a layer is an activation layer that can be
+ * fused into its preceding layer
+ */
+template <typename L>
+struct is_fusion_activation_impl : std::false_type {};
+
+/*!
+ * \copydoc is_fusion_activation_impl
+ */
+template <typename Desc>
+struct is_fusion_activation_impl<activation_layer_impl<Desc>> : std::bool_constant<is_elementwise_function<Desc::activation_function>> {};
+
+/*!
+ * \brief Traits to test if an upsampling layer and a convolutional layer can
+ * be fused into a sub-pixel convolution, with the upsampling factors U1, U2
+ */
+template <typename L1, typename L2>
+struct is_subpixel_pair_impl : std::false_type {
+    static constexpr size_t U1 = 1; ///< The first upsampling factor
+    static constexpr size_t U2 = 1; ///< The second upsampling factor
+};
+
+/*!
+ * \copydoc is_subpixel_pair_impl
+ */
+template <typename D1, typename D2>
+struct is_subpixel_pair_impl<upsample_3d_layer_impl<D1>, conv_same_layer_impl<D2>>
+        : std::bool_constant<std::is_same_v<typename D1::weight, typename D2::weight>
+                             && D1::C1 == 1 && (D1::C2 * D1::C3 > 1)
+                             && D1::I1 == D2::NC && D1::I2 * D1::C2 == D2::NV1 && D1::I3 * D1::C3 == D2::NV2
+                             && D2::S1 == 1 && D2::S2 == 1 && D2::D1 == 1 && D2::D2 == 1> {
+    static constexpr size_t U1 = D1::C2; ///< The first upsampling factor
+    static constexpr size_t U2 = D1::C3; ///< The second upsampling factor
+};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can compute its output with another
+ * activation function than its own
+ */
+template <typename L>
+constexpr bool has_activation_forward = detail::has_activation_forward_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer can be the head of a fusion
+ */
+template <typename L>
+constexpr bool is_fusion_head = detail::is_fusion_head_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer is an activation layer that can be
+ * fused into its preceding layer
+ */
+template <typename L>
+constexpr bool is_fusion_activation = detail::is_fusion_activation_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the two given adjacent layers can be fused
+ */
+template <typename L1, typename L2>
+constexpr bool is_fusable_activation = is_fusion_head<L1> && is_fusion_activation<L2>;
+
+/*!
+ * \brief Indicates if the three given adjacent layers can be fused once
+ * the normalization is folded into the first layer
+ */
+template <typename L1, typename L2, typename L3>
+constexpr bool is_fusable_normalization_activation = is_fusion_head<L1> && is_foldable_normalization<L2> && is_fusion_activation<L3>;
+
+/*!
+ * \brief Indicates if the two given adjacent layers (an upsampling and a same
+ * convolution) can be fused into a sub-pixel convolution
+ */
+template <typename L1, typename L2>
+constexpr bool is_subpixel_pair = detail::is_subpixel_pair_impl<std::decay_t<L1>, std::decay_t<L2>>::value;
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if the layers L and L + 1 of the given network are
+ * fused into a sub-pixel convolution
+ */
+template <typename DBN, size_t L, typename Enable = void>
+struct is_subpixel_fused_impl : is_subpixel_pair_impl<void, void> {};
+
+/*!
+ * \copydoc is_subpixel_fused_impl
+ */
+template <typename DBN, size_t L>
+struct is_subpixel_fused_impl<DBN, L, std::enable_if_t<(L + 1 < DBN::layers)>>
+        : is_subpixel_pair_impl<std::decay_t<typename DBN::template layer_type<L>>, std::decay_t<typename DBN::template layer_type<L + 1>>> {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the layers L and L + 1 of the given network are fused
+ * into a sub-pixel convolution
+ */
+template <typename DBN, size_t L>
+constexpr bool is_subpixel_fused = detail::is_subpixel_fused_impl<DBN, L>::value;
+
+} //end of dll namespace
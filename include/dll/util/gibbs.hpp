@@ -0,0 +1,389 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file gibbs.hpp
+ * \brief Fused activation and sampling of binary units for Gibbs sampling
+ *
+ * Once the GEMM (or the convolution) of an activation has been computed,
+ * the bias, the sigmoid and the Bernoulli sampling are applied in a single
+ * pass. The uniform numbers are drawn from a counter-based generator: the
+ * number of an element only depends on a key and on the index of the
+ * element, which makes the pass vectorizable and safe to run from several
+ * threads. Each pass uses a new key.
+ *
+ * The probabilistic max pooling of the units of a CRBM is done the same
+ * way: the bias, the softmax of each pooling block with its "off" state,
+ * the probabilities of the hidden and of the pooling units and the
+ * sampling of the block are computed in one pass over the block.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/fast_math.hpp"
+#include "dll/util/random_stream.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Return the uniform number in [0, 1) of the given counter in the
+ * stream of the given key
+ */
+template <typename T>
+T counter_uniform(uint64_t key, uint64_t counter) {
+    return T(double(counter_mix(key + counter * 0x9E3779B97F4A7C15ULL) >> 40) * (1.0 / 16777216.0));
+}
+
+/*!
+ * \brief Return a new key for a counter-based stream
+ */
+inline uint64_t counter_key() {
+    return next_stream_key();
+}
+
+/*!
+ * \brief Compute sigmoid(a + bias) and sample it, on raw memory
+ *
+ * \param a The pre-activations [M, K, S], replaced by the probabilities
+ * \param s The samples [M, K, S]
+ * \param bias The biases [K]
+ * \param M The number of samples
+ * \param K The number of biases
+ * \param S The number of units sharing the same bias (1 for dense layers)
+ * \param key The key of the random stream
+ * \tparam P The precision of the sigmoid
+ */
+template <function_precision P = function_precision::EXACT, typename T>
+void sigmoid_bernoulli(T* a, T* s, const T* bias, size_t M, size_t K, size_t S, uint64_t key) {
+    auto sigmoid = [](T x) {
+        if constexpr (P == function_precision::FAST) {
+            return fast_sigmoid(x);
+        } else {
+            return T(1) / (T(1) + std::exp(-x));
+        }
+    };
+
+    if (S == 1) {
+        for (size_t m = 0; m < M; ++m) {
+            const size_t base = m * K;
+
+            for (size_t k = 0; k < K; ++k) {
+                const T p = sigmoid(a[base + k] + bias[k]);
+
+                a[base + k] = p;
+                s[base + k] = counter_uniform<T>(key, base + k) < p ? T(1) : T(0);
+            }
+        }
+    } else {
+        for (size_t m = 0; m < M; ++m) {
+            for (size_t k = 0; k < K; ++k) {
+                const size_t base = (m * K + k) * S;
+                const T b         = bias[k];
+
+                for (size_t i = 0; i < S; ++i) {
+                    const T p = sigmoid(a[base + i] + b);
+
+                    a[base + i] = p;
+                    s[base + i] = counter_uniform<T>(key, base + i) < p ? T(1) : T(0);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Sample the given probabilities, on raw memory
+ *
+ * \param s The samples [N]
+ * \param p The probabilities [N]
+ * \param N The number of units
+ * \param key The key of the random stream
+ */
+template <typename T>
+void bernoulli_sample(T* s, const T* p, size_t N, uint64_t key) {
+    for (size_t i = 0; i < N; ++i) {
+        s[i] = counter_uniform<T>(key, i) < p[i] ? T(1) : T(0);
+    }
+}
+
+/*!
+ * \brief Compute the probabilistic max pooling of binary units, on raw
+ * memory.
+ *
+ * In each block of C x C units, at most one unit is on. With x the scaled
+ * pre-activations of the block, P(h_i = 1) = exp(x_i) / (1 + sum(exp(x)))
+ * and the pooling unit is on with probability sum(exp(x)) / (1 + sum(exp(x))).
+ * The state of the block is sampled once, from these C x C + 1 outcomes.
+ *
+ * All the outputs, except the input, can be null, in which case they are
+ * not computed. The hidden probabilities can be written over the input.
+ *
+ * \param in The pre-activations [M, K, N1, N2]
+ * \param h_a The hidden probabilities [M, K, N1, N2]
+ * \param h_s The hidden samples [M, K, N1, N2]
+ * \param p_a The pooling probabilities [M, K, N1 / C, N2 / C]
+ * \param p_s The pooling samples [M, K, N1 / C, N2 / C]
+ * \param bias The biases [K]
+ * \param scale The scale of the pre-activations, after the bias
+ * \param key The key of the random stream
+ */
+template <typename T>
+void p_max_pool(const T* in, T* h_a, T* h_s, T* p_a, T* p_s, const T* bias, size_t M, size_t K, size_t N1, size_t N2, size_t C, T scale, uint64_t key) {
+    const size_t P1 = N1 / C;
+    const size_t P2 = N2 / C;
+
+    std::vector<T> e(C * C);
+
+    for (size_t mk = 0; mk < M * K; ++mk) {
+        const T b = bias[mk % K];
+
+        const size_t base   = mk * N1 * N2;
+        const size_t p_base = mk * P1 * P2;
+
+        for (size_t i = 0; i < P1; ++i) {
+            for (size_t j = 0; j < P2; ++j) {
+                // The maximum includes the "off" state, of energy zero
+                T max = T(0);
+
+                for (size_t ii = 0; ii < C; ++ii) {
+                    const T* row = in + base + (i * C + ii) * N2 + j * C;
+
+                    for (size_t jj = 0; jj < C; ++jj) {
+                        e[ii * C + jj] = scale * (row[jj] + b);
+                        max            = std::max(max, e[ii * C + jj]);
+                    }
+                }
+
+                const T off = std::exp(-max);
+                T sum       = T(0);
+
+                for (size_t x = 0; x < C * C; ++x) {
+                    e[x] = std::exp(e[x] - max);
+                    sum += e[x];
+                }
+
+                const T inv = T(1) / (off + sum);
+
+                if (p_a) {
+                    p_a[p_base + i * P2 + j] = sum * inv;
+                }
+
+                // The unit that is on, C * C if none
+                size_t on = C * C;
+
+                if (h_s || p_s) {
+                    T u = counter_uniform<T>(key, p_base + i * P2 + j) * (off + sum) - off;
+
+                    for (size_t x = 0; x < C * C && u >= T(0); ++x) {
+                        u -= e[x];
+
+                        if (u < T(0)) {
+                            on = x;
+                        }
+                    }
+
+                    // Rounding errors can leave u positive after the sum
+                    if (u >= T(0) && on == C * C) {
+                        on = C * C - 1;
+                    }
+                }
+
+                if (p_s) {
+                    p_s[p_base + i * P2 + j] = on < C * C ? T(1) : T(0);
+                }
+
+                for (size_t ii = 0; ii < C; ++ii) {
+                    const size_t r = base + (i * C + ii) * N2 + j * C;
+
+                    for (size_t jj = 0; jj < C; ++jj) {
+                        if (h_a) {
+                            h_a[r + jj] = e[ii * C + jj] * inv;
+                        }
+
+                        if (h_s) {
+                            h_s[r + jj] = on == ii * C + jj ? T(1) : T(0);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the probabilities of a batch of binary units from their
+ * pre-activations and sample them, in one pass.
+ *
+ * \param a The pre-activations [B, K, ...], replaced by sigmoid(a + bias)
+ * \param s The samples of the units [B, K, ...]
+ * \param bias The biases [K], shared by all the units of a feature map
+ * \tparam P The precision of the sigmoid
+ */
+template <function_precision P = function_precision::EXACT, typename A, typename S, typename Bias>
+void sigmoid_bernoulli(A&& a, S&& s, const Bias& bias) {
+    if constexpr (!etl::is_dma<Bias>) {
+        auto bias_t = etl::force_temporary(bias);
+        sigmoid_bernoulli<P>(a, s, bias_t);
+    } else if constexpr (!etl::is_dma<std::decay_t<A>>) {
+        auto a_t = etl::force_temporary(a);
+        sigmoid_bernoulli<P>(a_t, s, bias);
+        a = a_t;
+    } else if constexpr (!etl::is_dma<std::decay_t<S>>) {
+        auto s_t = etl::force_temporary(s);
+        sigmoid_bernoulli<P>(a, s_t, bias);
+        s = s_t;
+    } else {
+        cpp_assert(etl::size(a) == etl::size(s), "Invalid sizes for sigmoid_bernoulli");
+
+        const size_t M = etl::dim<0>(a);
+        const size_t K = etl::size(bias);
+
+        a.ensure_cpu_up_to_date();
+        bias.ensure_cpu_up_to_date();
+
+        detail::sigmoid_bernoulli<P>(a.memory_start(), s.memory_start(), bias.memory_start(), M, K, etl::size(a) / (M * K), detail::counter_key());
+
+        a.invalidate_gpu();
+        s.invalidate_gpu();
+    }
+}
+
+/*!
+ * \brief Sample the given probabilities of binary units
+ *
+ * \param s The samples
+ * \param p The probabilities
+ */
+template <typename S, typename P>
+void bernoulli_sample(S&& s, const P& p) {
+    if constexpr (!etl::is_dma<P>) {
+        auto p_t = etl::force_temporary(p);
+        bernoulli_sample(s, p_t);
+    } else if constexpr (!etl::is_dma<std::decay_t<S>>) {
+        auto s_t = etl::force_temporary(s);
+        bernoulli_sample(s_t, p);
+        s = s_t;
+    } else {
+        cpp_assert(etl::size(s) == etl::size(p), "Invalid sizes for bernoulli_sample");
+
+        p.ensure_cpu_up_to_date();
+
+        detail::bernoulli_sample(s.memory_start(), p.memory_start(), etl::size(p), detail::counter_key());
+
+        s.invalidate_gpu();
+    }
+}
+
+/*!
+ * \brief Compute the probabilistic max pooling of a batch of binary hidden
+ * units from their pre-activations and, if S is true, sample them.
+ *
+ * \param h_a The pre-activations [B, K, NH1, NH2], replaced by the
+ * probabilities of the units
+ * \param h_s The samples of the units [B, K, NH1, NH2]
+ * \param bias The biases [K]
+ * \param C The size of the pooling blocks
+ * \param scale The scale of the pre-activations, after the bias
+ */
+template <bool S, typename A, typename HS, typename Bias>
+void p_max_pool_hidden(A&& h_a, HS&& h_s, const Bias& bias, size_t C, etl::value_t<std::decay_t<A>> scale = 1) {
+    if constexpr (!etl::is_dma<Bias>) {
+        auto bias_t = etl::force_temporary(bias);
+        p_max_pool_hidden<S>(h_a, h_s, bias_t, C, scale);
+    } else if constexpr (!etl::is_dma<std::decay_t<A>>) {
+        auto h_a_t = etl::force_temporary(h_a);
+        p_max_pool_hidden<S>(h_a_t, h_s, bias, C, scale);
+        h_a = h_a_t;
+    } else if constexpr (S && !etl::is_dma<std::decay_t<HS>>) {
+        auto h_s_t = etl::force_temporary(h_s);
+        p_max_pool_hidden<S>(h_a, h_s_t, bias, C, scale);
+        h_s = h_s_t;
+    } else {
+        using T = etl::value_t<std::decay_t<A>>;
+
+        h_a.ensure_cpu_up_to_date();
+        bias.ensure_cpu_up_to_date();
+
+        T* s = nullptr;
+
+        if constexpr (S) {
+            s = h_s.memory_start();
+        }
+
+        detail::p_max_pool<T>(h_a.memory_start(), h_a.memory_start(), s, nullptr, nullptr, bias.memory_start(),
+                              etl::dim<0>(h_a), etl::dim<1>(h_a), etl::dim<2>(h_a), etl::dim<3>(h_a), C, scale, detail::counter_key());
+
+        h_a.invalidate_gpu();
+
+        if constexpr (S) {
+            h_s.invalidate_gpu();
+        }
+    }
+}
+
+/*!
+ * \brief Compute the probabilities of a batch of pooling units from the
+ * pre-activations of their hidden units and, if S is true, sample them.
+ *
+ * \param p_a The probabilities of the pooling units [B, K, NH1 / C, NH2 / C]
+ * \param p_s The samples of the pooling units [B, K, NH1 / C, NH2 / C]
+ * \param h The pre-activations of the hidden units [B, K, NH1, NH2]
+ * \param bias The biases [K]
+ * \param C The size of the pooling blocks
+ * \param scale The scale of the pre-activations, after the bias
+ */
+template <bool S, typename PA, typename PS, typename H, typename Bias>
+void p_max_pool_pooling(PA&& p_a, PS&& p_s, const H& h, const Bias& bias, size_t C, etl::value_t<H> scale = 1) {
+    if constexpr (!etl::is_dma<Bias>) {
+        auto bias_t = etl::force_temporary(bias);
+        p_max_pool_pooling<S>(p_a, p_s, h, bias_t, C, scale);
+    } else if constexpr (!etl::is_dma<H>) {
+        auto h_t = etl::force_temporary(h);
+        p_max_pool_pooling<S>(p_a, p_s, h_t, bias, C, scale);
+    } else if constexpr (!etl::is_dma<std::decay_t<PA>>) {
+        auto p_a_t = etl::force_temporary(p_a);
+        p_max_pool_pooling<S>(p_a_t, p_s, h, bias, C, scale);
+        p_a = p_a_t;
+    } else if constexpr (S && !etl::is_dma<std::decay_t<PS>>) {
+        auto p_s_t = etl::force_temporary(p_s);
+        p_max_pool_pooling<S>(p_a, p_s_t, h, bias, C, scale);
+        p_s = p_s_t;
+    } else {
+        using T = etl::value_t<H>;
+
+        h.ensure_cpu_up_to_date();
+        bias.ensure_cpu_up_to_date();
+
+        T* s = nullptr;
+
+        if constexpr (S) {
+            s = p_s.memory_start();
+        }
+
+        detail::p_max_pool<T>(h.memory_start(), nullptr, nullptr, p_a.memory_start(), s, bias.memory_start(),
+                              etl::dim<0>(h), etl::dim<1>(h), etl::dim<2>(h), etl::dim<3>(h), C, scale, detail::counter_key());
+
+        p_a.invalidate_gpu();
+
+        if constexpr (S) {
+            p_s.invalidate_gpu();
+        }
+    }
+}
+
+} //end of dll namespace
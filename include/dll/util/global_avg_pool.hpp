@@ -0,0 +1,144 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file global_avg_pool.hpp
+ * \brief Global average pooling, reducing each feature map to its mean
+ *
+ * Each feature map is contiguous in memory, so the forward pass is one
+ * reduction per map. The backward pass does not need the input nor the
+ * output since the derivative of the mean is constant: the error of each
+ * map is broadcast, divided by the size of the map.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Compute the mean of n contiguous values.
+ *
+ * The sum is done with several independent accumulators so that the
+ * compiler can vectorize it without reordering a single sum.
+ */
+template <typename T>
+T global_avg_pool_mean(const T* in, size_t n) {
+    static constexpr size_t lanes = 8;
+
+    T acc[lanes] = {};
+
+    size_t i = 0;
+
+    for (; i + lanes <= n; i += lanes) {
+        for (size_t k = 0; k < lanes; ++k) {
+            acc[k] += in[i + k];
+        }
+    }
+
+    T sum(0);
+
+    for (; i < n; ++i) {
+        sum += in[i];
+    }
+
+    for (size_t k = 0; k < lanes; ++k) {
+        sum += acc[k];
+    }
+
+    return sum / T(n);
+}
+
+/*!
+ * \brief Compute the global average pooling on raw memory
+ * \param out The output [M]
+ * \param in The input [M, S]
+ * \param M The number of feature maps (samples * channels)
+ * \param S The size of each feature map
+ */
+template <typename T>
+void global_avg_pool_forward(T* out, const T* in, size_t M, size_t S) {
+    for (size_t m = 0; m < M; ++m) {
+        out[m] = global_avg_pool_mean(in + m * S, S);
+    }
+}
+
+/*!
+ * \brief Compute the errors of the input of the global average pooling on
+ * raw memory
+ * \param d_in The errors of the input [M, S]
+ * \param errors The errors of the output [M]
+ * \param M The number of feature maps (samples * channels)
+ * \param S The size of each feature map
+ */
+template <typename T>
+void global_avg_pool_backward(T* d_in, const T* errors, size_t M, size_t S) {
+    const T scale = T(1) / T(S);
+
+    for (size_t m = 0; m < M; ++m) {
+        std::fill_n(d_in + m * S, S, errors[m] * scale);
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the global average pooling of a batch
+ * \param output The output [B, C]
+ * \param input The input [B, C, H, W] (or any view of the same size)
+ */
+template <typename O, typename I>
+void global_avg_pool_forward(O&& output, const I& input) {
+    if constexpr (!etl::is_dma<I>) {
+        auto input_t = etl::force_temporary(input);
+        global_avg_pool_forward(output, input_t);
+    } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+        auto output_t = etl::force_temporary(output);
+        global_avg_pool_forward(output_t, input);
+        output = output_t;
+    } else {
+        const size_t M = etl::size(output);
+
+        input.ensure_cpu_up_to_date();
+
+        detail::global_avg_pool_forward(output.memory_start(), input.memory_start(), M, etl::size(input) / M);
+
+        output.invalidate_gpu();
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of a global average pooling
+ * \param output The errors of the input [B, C, H, W]
+ * \param errors The errors of the output [B, C] (or any view of the same size)
+ */
+template <typename O, typename E>
+void global_avg_pool_backward(O&& output, const E& errors) {
+    if constexpr (!etl::is_dma<E>) {
+        auto errors_t = etl::force_temporary(errors);
+        global_avg_pool_backward(output, errors_t);
+    } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+        auto output_t = etl::force_temporary(output);
+        global_avg_pool_backward(output_t, errors);
+        output = output_t;
+    } else {
+        const size_t M = etl::size(errors);
+
+        errors.ensure_cpu_up_to_date();
+
+        detail::global_avg_pool_backward(output.memory_start(), errors.memory_start(), M, etl::size(output) / M);
+
+        output.invalidate_gpu();
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,295 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file grouped_conv.hpp
+ * \brief Direct kernels of the grouped, strided and dilated convolutions
+ *
+ * The input channels and the filters are split into G groups and each
+ * filter only sees the input channels of its group. The convolutions can
+ * also be strided, dilated and padded with zeroes. Like
+ * etl::ml::convolution_forward, the kernels compute cross-correlations.
+ *
+ * The innermost loops always run over a row of the output (or of the
+ * errors), so that they can be vectorized by the compiler, at least when
+ * the second stride is 1.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/isa.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The dimensions of a grouped convolution
+ */
+struct grouped_conv_dims {
+    size_t B;      ///< The number of samples
+    size_t NC;     ///< The number of input channels
+    size_t NV1;    ///< The first dimension of the input
+    size_t NV2;    ///< The second dimension of the input
+    size_t K;      ///< The number of filters
+    size_t NW1;    ///< The first dimension of the filters
+    size_t NW2;    ///< The second dimension of the filters
+    size_t G  = 1; ///< The number of groups
+    size_t S1 = 1; ///< The first stride
+    size_t S2 = 1; ///< The second stride
+    size_t D1 = 1; ///< The first dilation
+    size_t D2 = 1; ///< The second dilation
+    size_t P1 = 0; ///< The first padding
+    size_t P2 = 0; ///< The second padding
+
+    size_t NH1() const { return (NV1 + 2 * P1 - (D1 * (NW1 - 1) + 1)) / S1 + 1; } ///< The first dimension of the output
+    size_t NH2() const { return (NV2 + 2 * P2 - (D2 * (NW2 - 1) + 1)) / S2 + 1; } ///< The second dimension of the output
+    size_t NCg() const { return NC / G; }                                          ///< The number of input channels of each group
+    size_t Kg() const { return K / G; }                                            ///< The number of filters of each group
+};
+
+/*!
+ * \brief Iterate over all the (filter tap, output row) pairs of a grouped
+ * convolution that touch the input.
+ *
+ * For each of them, the functor is called with the indices of the input
+ * row (sample, channel, row), of the filter element (filter, channel in
+ * the group, p, q) and of the output row, the first output column j0
+ * reading inside the input, the input column read by j0 and the number of
+ * output columns reading inside the input.
+ */
+template <typename Functor>
+void grouped_conv_loop(const grouped_conv_dims& d, Functor&& functor) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+    const size_t NCg = d.NCg();
+
+    for (size_t b = 0; b < d.B; ++b) {
+        for (size_t k = 0; k < d.K; ++k) {
+            const size_t g = k / d.Kg();
+
+            for (size_t c = 0; c < NCg; ++c) {
+                for (size_t p = 0; p < d.NW1; ++p) {
+                    for (size_t q = 0; q < d.NW2; ++q) {
+                        const std::ptrdiff_t col0 = std::ptrdiff_t(q * d.D2) - std::ptrdiff_t(d.P2);
+
+                        // The output columns reading inside the input
+                        const size_t j0 = col0 < 0 ? (size_t(-col0) + d.S2 - 1) / d.S2 : 0;
+                        const size_t j1 = std::ptrdiff_t(d.NV2) - col0 > 0 ? std::min(NH2, size_t((std::ptrdiff_t(d.NV2) - 1 - col0) / std::ptrdiff_t(d.S2)) + 1) : 0;
+
+                        if (j0 >= j1) {
+                            continue;
+                        }
+
+                        for (size_t i = 0; i < NH1; ++i) {
+                            const std::ptrdiff_t r = std::ptrdiff_t(i * d.S1 + p * d.D1) - std::ptrdiff_t(d.P1);
+
+                            if (r < 0 || r >= std::ptrdiff_t(d.NV1)) {
+                                continue;
+                            }
+
+                            functor(b, g * NCg + c, size_t(r), k, c, p, q, i, j0, size_t(std::ptrdiff_t(j0 * d.S2) + col0), j1 - j0);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate a scaled strided row into a contiguous row: y[j] += a * x[j * S]
+ */
+template <typename T>
+void grouped_conv_axpy(T* y, const T* x, T a, size_t n, size_t S) {
+    if (S == 1) {
+        for (size_t j = 0; j < n; ++j) {
+            y[j] += a * x[j];
+        }
+    } else {
+        for (size_t j = 0; j < n; ++j) {
+            y[j] += a * x[j * S];
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate a scaled contiguous row into a strided row: y[j * S] += a * x[j]
+ */
+template <typename T>
+void grouped_conv_axpy_strided(T* y, const T* x, T a, size_t n, size_t S) {
+    if (S == 1) {
+        for (size_t j = 0; j < n; ++j) {
+            y[j] += a * x[j];
+        }
+    } else {
+        for (size_t j = 0; j < n; ++j) {
+            y[j * S] += a * x[j];
+        }
+    }
+}
+
+/*!
+ * \brief Compute the dot product of a strided row and a contiguous row: sum(x[j * S] * y[j])
+ */
+template <typename T>
+T grouped_conv_dot(const T* x, const T* y, size_t n, size_t S) {
+    T acc(0);
+
+    if (S == 1) {
+        for (size_t j = 0; j < n; ++j) {
+            acc += x[j] * y[j];
+        }
+    } else {
+        for (size_t j = 0; j < n; ++j) {
+            acc += x[j * S] * y[j];
+        }
+    }
+
+    return acc;
+}
+
+/*!
+ * \brief Compute the forward grouped convolution on raw memory
+ * \param out The output [B, K, NH1, NH2]
+ * \param in The input [B, NC, NV1, NV2]
+ * \param w The filters [K, NC / G, NW1, NW2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void grouped_conv_forward(T* out, const T* in, const T* w, const grouped_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+    const size_t NCg = d.NCg();
+
+    std::fill_n(out, d.B * d.K * NH1 * NH2, T(0));
+
+    grouped_conv_loop(d, [&](size_t b, size_t ch, size_t r, size_t k, size_t c, size_t p, size_t q, size_t i, size_t j0, size_t x0, size_t n) {
+        const T wv     = w[((k * NCg + c) * d.NW1 + p) * d.NW2 + q];
+        const T* x_row = in + ((b * d.NC + ch) * d.NV1 + r) * d.NV2 + x0;
+        T* o_row       = out + ((b * d.K + k) * NH1 + i) * NH2 + j0;
+
+        grouped_conv_axpy(o_row, x_row, wv, n, d.S2);
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the input of a grouped convolution on raw memory
+ * \param d_in The gradients of the input [B, NC, NV1, NV2]
+ * \param d_out The gradients of the output [B, K, NH1, NH2]
+ * \param w The filters [K, NC / G, NW1, NW2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void grouped_conv_backward(T* d_in, const T* d_out, const T* w, const grouped_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+    const size_t NCg = d.NCg();
+
+    std::fill_n(d_in, d.B * d.NC * d.NV1 * d.NV2, T(0));
+
+    grouped_conv_loop(d, [&](size_t b, size_t ch, size_t r, size_t k, size_t c, size_t p, size_t q, size_t i, size_t j0, size_t x0, size_t n) {
+        const T wv     = w[((k * NCg + c) * d.NW1 + p) * d.NW2 + q];
+        T* x_row       = d_in + ((b * d.NC + ch) * d.NV1 + r) * d.NV2 + x0;
+        const T* e_row = d_out + ((b * d.K + k) * NH1 + i) * NH2 + j0;
+
+        grouped_conv_axpy_strided(x_row, e_row, wv, n, d.S2);
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a grouped convolution on raw memory
+ * \param d_w The gradients of the filters [K, NC / G, NW1, NW2]
+ * \param in The input [B, NC, NV1, NV2]
+ * \param d_out The gradients of the output [B, K, NH1, NH2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void grouped_conv_backward_filter(T* d_w, const T* in, const T* d_out, const grouped_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+    const size_t NCg = d.NCg();
+
+    std::fill_n(d_w, d.K * NCg * d.NW1 * d.NW2, T(0));
+
+    grouped_conv_loop(d, [&](size_t b, size_t ch, size_t r, size_t k, size_t c, size_t p, size_t q, size_t i, size_t j0, size_t x0, size_t n) {
+        const T* x_row = in + ((b * d.NC + ch) * d.NV1 + r) * d.NV2 + x0;
+        const T* e_row = d_out + ((b * d.K + k) * NH1 + i) * NH2 + j0;
+
+        d_w[((k * NCg + c) * d.NW1 + p) * d.NW2 + q] += grouped_conv_dot(x_row, e_row, n, d.S2);
+    });
+}
+
+/*!
+ * \brief Run the given kernel on the memory of the given output and inputs.
+ *
+ * Expressions without direct memory access are first evaluated into
+ * temporaries. The output is written back if necessary.
+ */
+template <typename Kernel, typename O, typename A, typename W>
+void grouped_conv_apply(Kernel&& kernel, O&& out, const A& a, const W& w) {
+    if constexpr (!etl::is_dma<A>) {
+        auto a_t = etl::force_temporary(a);
+        grouped_conv_apply(kernel, out, a_t, w);
+    } else if constexpr (!etl::is_dma<W>) {
+        auto w_t = etl::force_temporary(w);
+        grouped_conv_apply(kernel, out, a, w_t);
+    } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+        auto out_t = etl::force_temporary(out);
+        grouped_conv_apply(kernel, out_t, a, w);
+        out = out_t;
+    } else {
+        a.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+
+        kernel(out.memory_start(), a.memory_start(), w.memory_start());
+
+        out.invalidate_gpu();
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the forward pass of a grouped convolution
+ * \param out The output [B, K, NH1, NH2]
+ * \param in The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param w The filters [K, NC / G, NW1, NW2]
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename I, typename W>
+void grouped_conv_forward(O&& out, const I& in, const W& w, const detail::grouped_conv_dims& d) {
+    detail::grouped_conv_apply([&d](auto* o, const auto* x, const auto* f) { detail::grouped_conv_forward(o, x, f, d); }, out, in, w);
+}
+
+/*!
+ * \brief Compute the gradients of the input of a grouped convolution
+ * \param d_in The gradients of the input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param d_out The gradients of the output [B, K, NH1, NH2]
+ * \param w The filters [K, NC / G, NW1, NW2]
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename E, typename W>
+void grouped_conv_backward(O&& d_in, const E& d_out, const W& w, const detail::grouped_conv_dims& d) {
+    detail::grouped_conv_apply([&d](auto* x, const auto* e, const auto* f) { detail::grouped_conv_backward(x, e, f, d); }, d_in, d_out, w);
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a grouped convolution
+ * \param d_w The gradients of the filters [K, NC / G, NW1, NW2]
+ * \param in The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param d_out The gradients of the output [B, K, NH1, NH2]
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename I, typename E>
+void grouped_conv_backward_filter(O&& d_w, const I& in, const E& d_out, const detail::grouped_conv_dims& d) {
+    detail::grouped_conv_apply([&d](auto* f, const auto* x, const auto* e) { detail::grouped_conv_backward_filter(f, x, e, d); }, d_w, in, d_out);
+}
+
+} //end of dll namespace
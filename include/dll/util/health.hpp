@@ -0,0 +1,272 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file health.hpp
+ * \brief Low-overhead monitoring of the numerical health of the training
+ *
+ * The checks do not scan complete tensors, they read one element over
+ * stride, the offset of the sample rotating at each check so that all the
+ * elements are eventually read. A NaN or an infinity spreads quickly to the
+ * other elements, the following layers and the following batches, so that
+ * the divergences are still detected.
+ *
+ * The SGD trainer reports the sampled NaN and infinity counts and the norms
+ * of the activations and of the gradients of each layer to the active
+ * health monitor, every interval batches. Without an active monitor, this
+ * costs a single test per batch.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The statistics of a sample of the elements of a tensor
+ */
+struct sampled_stats {
+    size_t size        = 0;   ///< The number of elements of the tensor
+    size_t samples     = 0;   ///< The number of sampled elements
+    size_t nans        = 0;   ///< The number of sampled NaN
+    size_t infs        = 0;   ///< The number of sampled infinities
+    double sum_squares = 0.0; ///< The estimated sum of the squares of the finite elements
+
+    /*!
+     * \brief Indicates if all the sampled elements are finite
+     */
+    bool finite() const {
+        return !nans && !infs;
+    }
+
+    /*!
+     * \brief Returns the estimated L2 norm of the tensor
+     */
+    double norm() const {
+        return std::sqrt(sum_squares);
+    }
+
+    /*!
+     * \brief Merge the statistics of another tensor
+     */
+    sampled_stats& operator+=(const sampled_stats& rhs) {
+        size += rhs.size;
+        samples += rhs.samples;
+        nans += rhs.nans;
+        infs += rhs.infs;
+        sum_squares += rhs.sum_squares;
+
+        return *this;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Returns the offset of the next sample of the calling thread
+ */
+inline size_t next_sample_offset(size_t stride) {
+    thread_local size_t offset = 0;
+    return offset++ % stride;
+}
+
+/*!
+ * \brief Add the given sampled value to the statistics
+ */
+template <typename T>
+void add_sample(sampled_stats& stats, T value) {
+    ++stats.samples;
+
+    if (std::isnan(value)) {
+        ++stats.nans;
+    } else if (std::isinf(value)) {
+        ++stats.infs;
+    } else {
+        stats.sum_squares += double(value) * double(value);
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the statistics of one element over stride of the given
+ * tensor (an ETL container or a range of values)
+ *
+ * \param values The tensor to sample
+ * \param stride The distance between two sampled elements (1 for a complete scan)
+ */
+template <typename E>
+sampled_stats sample_stats(const E& values, size_t stride) {
+    sampled_stats stats;
+
+    const size_t offset = detail::next_sample_offset(stride);
+
+    if constexpr (etl::is_dma<E>) {
+        values.ensure_cpu_up_to_date();
+
+        const auto* memory = values.memory_start();
+
+        stats.size = etl::size(values);
+
+        for (size_t i = offset; i < stats.size; i += stride) {
+            detail::add_sample(stats, memory[i]);
+        }
+    } else {
+        for (auto& value : values) {
+            if (stats.size++ % stride == offset) {
+                detail::add_sample(stats, value);
+            }
+        }
+    }
+
+    // The sampled elements stand for all the elements
+    if (stats.samples) {
+        stats.sum_squares *= double(stats.size) / stats.samples;
+    }
+
+    return stats;
+}
+
+/*!
+ * \brief Indicates if one element over stride of the given tensor is finite
+ */
+template <typename E>
+bool sampled_finite(const E& values, size_t stride) {
+    return sample_stats(values, stride).finite();
+}
+
+/*!
+ * \brief The numerical health of one layer
+ */
+struct layer_health {
+    size_t checks          = 0;   ///< The number of checks of the layer
+    size_t nans            = 0;   ///< The total number of sampled NaN
+    size_t infs            = 0;   ///< The total number of sampled infinities
+    size_t first_failure   = 0;   ///< The batch of the first non-finite value (only if failures)
+    double activation_norm = 0.0; ///< The estimated norm of the activations of the last check
+    double gradient_norm   = 0.0; ///< The estimated norm of the gradients of the last check
+
+    /*!
+     * \brief Returns the number of non-finite values seen in the layer
+     */
+    size_t failures() const {
+        return nans + infs;
+    }
+};
+
+/*!
+ * \brief Monitor of the numerical health of the layers of a network
+ */
+struct health_monitor {
+    size_t interval = 1;  ///< The number of batches between two checks
+    size_t stride   = 16; ///< The distance between two sampled elements
+
+    size_t batches = 0;               ///< The number of batches seen by the monitor
+    std::vector<layer_health> layers; ///< The health of each layer
+
+    health_monitor() = default;
+
+    /*!
+     * \brief Create a monitor checking the layers every interval batches,
+     * reading one element over stride
+     */
+    health_monitor(size_t interval, size_t stride) : interval(interval), stride(stride) {}
+
+    /*!
+     * \brief Count a new batch and indicates if it must be checked
+     */
+    bool due() {
+        return batches++ % interval == 0;
+    }
+
+    /*!
+     * \brief Report the statistics of the activations and of the gradients
+     * of the given layer for the current batch
+     */
+    void report(size_t layer, const sampled_stats& activations, const sampled_stats& gradients) {
+        if (layers.size() <= layer) {
+            layers.resize(layer + 1);
+        }
+
+        auto& health = layers[layer];
+
+        if (!health.failures() && (!activations.finite() || !gradients.finite())) {
+            health.first_failure = batches - 1;
+        }
+
+        ++health.checks;
+        health.nans += activations.nans + gradients.nans;
+        health.infs += activations.infs + gradients.infs;
+        health.activation_norm = activations.norm();
+        health.gradient_norm   = gradients.norm();
+    }
+
+    /*!
+     * \brief Indicates if no non-finite value has been seen
+     */
+    bool healthy() const {
+        for (auto& health : layers) {
+            if (health.failures()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Reset the health of all the layers
+     */
+    void reset() {
+        batches = 0;
+        layers.clear();
+    }
+
+    /*!
+     * \brief Print the health of the layers on the given stream
+     */
+    void print(std::ostream& os = std::cout) const {
+        for (size_t i = 0; i < layers.size(); ++i) {
+            auto& health = layers[i];
+
+            os << "layer " << i << ": |a|=" << health.activation_norm << " |g|=" << health.gradient_norm << " nan=" << health.nans << " inf=" << health.infs;
+
+            if (health.failures()) {
+                os << " (first at batch " << health.first_failure << ")";
+            }
+
+            os << '\n';
+        }
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Return a reference to the active health monitor
+ */
+inline std::atomic<health_monitor*>& active_health_monitor() {
+    static std::atomic<health_monitor*> monitor(nullptr);
+    return monitor;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Set the active health monitor, nullptr to stop monitoring
+ */
+inline void set_health_monitor(health_monitor* monitor) {
+    detail::active_health_monitor() = monitor;
+}
+
+} //end of dll namespace
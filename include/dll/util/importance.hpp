@@ -0,0 +1,146 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file importance.hpp
+ * \brief Loss-based importance sampling of the training samples
+ *
+ * Late in training, most samples have a near-zero loss and contribute
+ * little to the gradients. With importance sampling, the samples of an
+ * epoch are drawn with replacement, with a probability mixing their last
+ * loss and the uniform distribution:
+ *
+ *     p_i = (1 - s) * loss_i / sum(loss) + s / N
+ *
+ * The errors of each drawn sample are weighted by 1 / (N * p_i), so that
+ * the expected gradient is the one of the uniform sampling. The smoothing
+ * s keeps every sample reachable and bounds the weights by 1 / s.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The loss scores of the training samples and the drawing of the
+ * samples of an epoch from them.
+ */
+struct importance_sampler {
+    std::vector<double> scores;     ///< The last loss of each sample
+    std::vector<double> cumulative; ///< The cumulative probabilities of the samples
+    double smoothing = 0.1;         ///< The part of the uniform distribution in the probabilities
+    bool ready       = false;       ///< Indicates if all the samples have been scored once
+
+    /*!
+     * \brief Indicates if the sampler holds the scores of n samples
+     */
+    bool scored(size_t n) const {
+        return ready && scores.size() == n;
+    }
+
+    /*!
+     * \brief Forget the scores and prepare for n samples
+     */
+    void reset(size_t n) {
+        scores.assign(n, 0.0);
+        cumulative.clear();
+        ready = false;
+    }
+
+    /*!
+     * \brief Compute the order of the first epoch: all the samples, once,
+     * with unit weights.
+     *
+     * \param order The indices of the samples
+     * \param weights The weights of the samples
+     * \param shuffle Indicates if the samples are shuffled
+     * \param engine The random engine
+     */
+    template <typename W, typename Engine>
+    void uniform(std::vector<size_t>& order, std::vector<W>& weights, bool shuffle, Engine& engine) const {
+        order.resize(scores.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        if (shuffle) {
+            std::shuffle(order.begin(), order.end(), engine);
+        }
+
+        weights.assign(order.size(), W(1));
+    }
+
+    /*!
+     * \brief Draw the samples of an epoch, with replacement, from the
+     * scores of the samples.
+     *
+     * \param order The indices of the drawn samples
+     * \param weights The weights of the drawn samples, 1 / (N * p_i)
+     * \param n The number of samples to draw
+     * \param engine The random engine
+     */
+    template <typename W, typename Engine>
+    void draw(std::vector<size_t>& order, std::vector<W>& weights, size_t n, Engine& engine) {
+        const size_t N = scores.size();
+
+        const double total = std::accumulate(scores.begin(), scores.end(), 0.0);
+
+        // Without any loss, the sampling is uniform
+        const double s = total > 0.0 ? std::clamp(smoothing, 0.0, 1.0) : 1.0;
+
+        cumulative.resize(N);
+
+        double sum = 0.0;
+        for (size_t i = 0; i < N; ++i) {
+            sum += probability(i, s, total);
+            cumulative[i] = sum;
+        }
+
+        std::uniform_real_distribution<double> dist(0.0, sum);
+
+        order.resize(n);
+        weights.resize(n);
+
+        for (size_t j = 0; j < n; ++j) {
+            const size_t i = std::min<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), dist(engine)) - cumulative.begin(), N - 1);
+
+            order[j]   = i;
+            weights[j] = W(1.0 / (N * probability(i, s, total)));
+        }
+    }
+
+    /*!
+     * \brief Update the scores of the given samples with their last losses
+     *
+     * \param order The indices of the samples
+     * \param losses The losses of the samples
+     * \param n The number of samples
+     */
+    template <typename W>
+    void update(const size_t* order, const W* losses, size_t n) {
+        for (size_t j = 0; j < n; ++j) {
+            // A diverging sample must not take all the probability
+            scores[order[j]] = std::isfinite(double(losses[j])) ? std::max(0.0, double(losses[j])) : 0.0;
+        }
+    }
+
+private:
+    /*!
+     * \brief Returns the probability of drawing the given sample
+     */
+    double probability(size_t i, double s, double total) const {
+        const double uniform = 1.0 / scores.size();
+
+        return s >= 1.0 ? uniform : (1.0 - s) * scores[i] / total + s * uniform;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,87 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file in_place.hpp
+ * \brief Detection of the layers that can be applied in place
+ *
+ * The element-wise transform layers (scale, binarize, normalize,
+ * rectifier) and the pure reshapes (shape_1d, shape_3d) can overwrite
+ * their input with their output, instead of writing a copy of it into a
+ * separate batch. The dropout layers can do the same, but only in test
+ * mode, where they are the identity.
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer can be applied in place on the given
+ * batch, both for training and for inference
+ */
+template <typename L, typename B, typename Enable = void>
+struct has_in_place_forward_impl : std::false_type {};
+
+/*!
+ * \copydoc has_in_place_forward_impl
+ */
+template <typename L, typename B>
+struct has_in_place_forward_impl<L, B, std::void_t<decltype(std::declval<const L&>().forward_batch_in_place(std::declval<B&>()))>>
+        : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can be applied in place on the given
+ * batch, for inference only
+ */
+template <typename L, typename B, typename Enable = void>
+struct has_in_place_test_forward_impl : std::false_type {};
+
+/*!
+ * \copydoc has_in_place_test_forward_impl
+ */
+template <typename L, typename B>
+struct has_in_place_test_forward_impl<L, B, std::void_t<decltype(std::declval<const L&>().test_forward_batch_in_place(std::declval<B&>()))>>
+        : std::true_type {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can be applied in place on the given
+ * batch.
+ *
+ * \tparam Train true for the training forward pass, false for inference
+ */
+template <bool Train, typename L, typename B>
+constexpr bool is_in_place =
+    detail::has_in_place_forward_impl<std::decay_t<L>, std::decay_t<B>>::value
+    || (!Train && detail::has_in_place_test_forward_impl<std::decay_t<L>, std::decay_t<B>>::value);
+
+/*!
+ * \brief Apply the given layer in place on the given batch, the batch
+ * being replaced by the output of the layer.
+ *
+ * \tparam Train true for the training forward pass, false for inference
+ */
+template <bool Train, typename L, typename B>
+void forward_batch_in_place(const L& layer, B& batch) {
+    static_assert(is_in_place<Train, L, B>, "The layer cannot be applied in place");
+
+    if constexpr (detail::has_in_place_forward_impl<std::decay_t<L>, std::decay_t<B>>::value) {
+        layer.forward_batch_in_place(batch);
+    } else {
+        layer.test_forward_batch_in_place(batch);
+    }
+}
+
+} //end of dll namespace
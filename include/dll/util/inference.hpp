@@ -0,0 +1,334 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file inference.hpp
+ * \brief Concurrent inference over a shared network
+ *
+ * An inference_context holds all the activations of a forward pass, for a
+ * fixed number of samples, allocated once. Each thread uses its own
+ * context and several threads can forward batches through the same
+ * network at the same time, without locks or allocations of the
+ * activations.
+ *
+ * The network must not be modified (trained, loaded or pruned) while it is
+ * used for inference. The lazy inference caches of the layers (the scale
+ * and shift of the batch normalization, the sparse weights of the pruned
+ * dense layers) are computed when a context is created, after which the
+ * forward pass only reads the layers.
+ *
+ * The activations are allocated for B samples, but a batch can hold any
+ * number of samples up to B. The layers with partial_batches only compute
+ * the samples of the batch, the inner dimensions staying fixed at compile
+ * time, and the other layers compute the zero-padded batch.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/batch_extend.hpp"
+#include "dll/util/fusion.hpp"
+#include "dll/util/ready.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer has lazy inference caches
+ */
+template <typename L, typename = void>
+struct has_prepare_inference_impl : std::false_type {};
+
+/*!
+ * \copydoc has_prepare_inference_impl
+ */
+template <typename L>
+struct has_prepare_inference_impl<L, std::void_t<decltype(std::declval<const L&>().prepare_inference())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can only compute the first samples of a
+ * batch
+ */
+template <typename L, typename = int>
+struct has_partial_batches_impl : std::false_type {};
+
+/*!
+ * \copydoc has_partial_batches_impl
+ */
+template <typename L>
+struct has_partial_batches_impl<L, decltype((void)L::partial_batches, 0)> : std::bool_constant<L::partial_batches> {};
+
+/*!
+ * \brief Returns the lock protecting the preparation of the networks for
+ * inference
+ */
+inline std::mutex& inference_lock() {
+    static std::mutex lock;
+    return lock;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer has lazy inference caches
+ */
+template <typename L>
+constexpr bool has_prepare_inference = detail::has_prepare_inference_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer can only compute the first samples of
+ * a batch
+ */
+template <typename L>
+constexpr bool has_partial_batches = detail::has_partial_batches_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief The activations of the inference of a network, for one thread.
+ *
+ * \tparam DBN The network type
+ * \tparam Sample The type of one input sample
+ * \tparam B The maximum number of samples of a batch
+ * \tparam Fuse Indicates if the activation layers are fused with their
+ * preceding layers. Otherwise, the output of each layer is kept.
+ */
+template <typename DBN, typename Sample, size_t B = DBN::batch_size, bool Fuse = true>
+struct inference_context {
+    using dbn_t = DBN; ///< The network type
+
+    static constexpr size_t layers     = dbn_t::layers; ///< The number of layers
+    static constexpr size_t batch_size = B;             ///< The maximum number of samples of a batch
+
+private:
+    /*!
+     * \brief Create the outputs of the layers from L, for the given output
+     * of the previous layer
+     */
+    template <size_t L, typename One>
+    static auto make_outputs(const dbn_t& dbn, const One& one) {
+        auto next  = prepare_one_ready_output(dbn.template layer_get<L>(), one);
+        auto batch = batch_make<B>(next);
+
+        if constexpr (L + 1 < layers) {
+            return std::tuple_cat(std::make_tuple(std::move(batch)), make_outputs<L + 1>(dbn, next));
+        } else {
+            return std::make_tuple(std::move(batch));
+        }
+    }
+
+    /*!
+     * \brief Create the output of one sample of the layers from L, for the
+     * given output of the previous layer
+     */
+    template <size_t L, typename One>
+    static auto make_one_output(const dbn_t& dbn, const One& one) {
+        auto next = prepare_one_ready_output(dbn.template layer_get<L>(), one);
+
+        if constexpr (L + 1 < layers) {
+            return make_one_output<L + 1>(dbn, next);
+        } else {
+            return next;
+        }
+    }
+
+public:
+    using input_t   = std::decay_t<decltype(batch_make<B>(std::declval<const Sample&>()))>;                      ///< The type of the input batch
+    using outputs_t = decltype(make_outputs<0>(std::declval<const dbn_t&>(), std::declval<const Sample&>()));    ///< The outputs of the layers
+    using output_t  = decltype(make_one_output<0>(std::declval<const dbn_t&>(), std::declval<const Sample&>())); ///< The output of one sample
+
+    const dbn_t& dbn;  ///< The network
+    input_t input;     ///< The input batch, for incomplete batches
+    outputs_t outputs; ///< The outputs of the layers
+
+    /*!
+     * \brief If not nullptr, the time of each layer (seconds) is added to it
+     * by the forward passes. With fusion, the time of a fused activation
+     * layer is added to the preceding layer.
+     */
+    double* layer_times = nullptr;
+
+    /*!
+     * \brief Create an inference context for the given network
+     * \param dbn The network, which must outlive the context
+     * \param sample A sample, only used for its dimensions
+     */
+    inference_context(const dbn_t& dbn, const Sample& sample)
+            : dbn(dbn), input(batch_make<B>(sample)), outputs(make_outputs<0>(dbn, sample)) {
+        std::lock_guard<std::mutex> l(detail::inference_lock());
+
+        dbn.prepare_inference();
+    }
+
+    /*!
+     * \brief Create the output of the network for one sample
+     * \param dbn The network
+     * \param sample A sample, only used for its dimensions
+     */
+    static output_t make_output(const dbn_t& dbn, const Sample& sample) {
+        return make_one_output<0>(dbn, sample);
+    }
+
+    /*!
+     * \brief Forward a batch of at most B samples through the network
+     * \param batch The batch of samples
+     * \return A reference to the output of the last layer, of which only the
+     * first dim<0>(batch) samples are valid
+     */
+    template <typename Input>
+    auto& forward_batch(const Input& batch) {
+        const size_t n = etl::dim<0>(batch);
+
+        cpp_assert(n <= B, "The batch is too large for the inference context");
+
+        // A first layer with partial batches reads the batch directly
+        if (n == B || has_partial_batches<typename dbn_t::template layer_type<0>>) {
+            forward_layers<0>(batch, n);
+        } else {
+            etl::slice(input, 0, n) = batch;
+            etl::slice(input, n, B) = 0;
+
+            forward_layers<0>(input, n);
+        }
+
+        return std::get<layers - 1>(outputs);
+    }
+
+    /*!
+     * \brief Forward a complete batch of B samples through the layers from L
+     * \param batch The batch of outputs of the layer L - 1
+     * \return A reference to the output of the last layer
+     */
+    template <size_t L, typename Input>
+    auto& forward_batch_from(const Input& batch) {
+        static_assert(L < layers, "Invalid first layer");
+
+        cpp_assert(etl::dim<0>(batch) == B, "The batch must be complete");
+
+        forward_layers<L>(batch, B);
+
+        return std::get<layers - 1>(outputs);
+    }
+
+private:
+    using clock_type = std::chrono::steady_clock; ///< The clock of the layer times
+
+    /*!
+     * \brief Returns the start time of a layer, if the layers are timed
+     */
+    clock_type::time_point layer_start() const {
+        return layer_times ? clock_type::now() : clock_type::time_point();
+    }
+
+    /*!
+     * \brief Add the time of the layer L, if the layers are timed
+     */
+    void layer_end(size_t L, clock_type::time_point start) const {
+        if (layer_times) {
+            layer_times[L] += std::chrono::duration<double>(clock_type::now() - start).count();
+        }
+    }
+
+    /*!
+     * \brief Indicates if the output of the layer L must be zero-padded,
+     * because the next layer computes the complete batch. The output of the
+     * last layer is always cleared after the samples.
+     */
+    template <size_t L>
+    static constexpr bool padded_output() {
+        if constexpr (L + 1 < layers) {
+            return !has_partial_batches<typename dbn_t::template layer_type<L + 1>>;
+        } else {
+            return true;
+        }
+    }
+
+    /*!
+     * \brief Apply a layer to a batch, with the given activation function if
+     * Fused, with the activation function of the layer otherwise.
+     */
+    template <bool Fused, function F, typename Layer, typename Output, typename Input>
+    static void apply_layer(const Layer& layer, Output&& out, const Input& in) {
+        if constexpr (Fused) {
+            layer.template test_forward_batch<F>(out, in);
+        } else {
+            layer.test_forward_batch(out, in);
+        }
+    }
+
+    /*!
+     * \brief Apply a layer to the first n samples of the input.
+     *
+     * The layers that can only compute the first samples of a batch skip
+     * the missing samples. Their output is only cleared after the samples
+     * when Padded is set.
+     */
+    template <bool Fused, function F, bool Padded, typename Layer, typename Output, typename Input>
+    static void forward_layer(const Layer& layer, Output& out, const Input& in, size_t n) {
+        if constexpr (has_partial_batches<Layer>) {
+            if (n < B) {
+                auto out_n = etl::slice(out, 0, n);
+
+                apply_layer<Fused, F>(layer, out_n, etl::slice(in, 0, n));
+
+                if constexpr (Padded) {
+                    etl::slice(out, n, B) = 0;
+                }
+
+                return;
+            }
+        }
+
+        apply_layer<Fused, F>(layer, out, in);
+    }
+
+    /*!
+     * \brief Forward the given input, holding n samples, through the layers
+     * from L
+     */
+    template <size_t L, typename Input>
+    void forward_layers(const Input& in, size_t n) {
+        decltype(auto) layer = dbn.template layer_get<L>();
+
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (Fuse && L + 1 < layers && is_fusable_activation<layer_t, typename dbn_t::template layer_type<L + 1>>) {
+            // The activation is applied directly in the output of the activation layer
+            auto& out = std::get<L + 1>(outputs);
+
+            const auto start = layer_start();
+
+            forward_layer<true, dbn_t::template layer_type<L + 1>::activation_function, padded_output<L + 1>()>(layer, out, in, n);
+
+            layer_end(L, start);
+
+            if constexpr (L + 2 < layers) {
+                forward_layers<L + 2>(out, n);
+            }
+        } else {
+            auto& out = std::get<L>(outputs);
+
+            const auto start = layer_start();
+
+            forward_layer<false, function::IDENTITY, padded_output<L>()>(layer, out, in, n);
+
+            layer_end(L, start);
+
+            if constexpr (L + 1 < layers) {
+                forward_layers<L + 1>(out, n);
+            }
+        }
+    }
+};
+
+} //end of dll namespace
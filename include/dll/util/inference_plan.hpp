@@ -0,0 +1,851 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file inference_plan.hpp
+ * \brief Preplanned inference with all the activations in a single arena
+ *
+ * An inference_plan is built once for a network and a batch size. Since
+ * the activation of a layer is only read by the next layer, the outputs
+ * of the layers alternate between two buffers (ping-pong) and a third
+ * buffer holds the incomplete input batches. All three are contiguous in
+ * one arena, sized for the largest activation of the network, and the
+ * outputs of the layers are views into it. Compared to an
+ * inference_context, which holds the output of each layer, the memory
+ * used by the activations does not depend on the depth of the network
+ * and stays hot in the caches.
+ *
+ * The layers that do nothing at inference (dropout, identity activations
+ * and batch normalizations folded into their preceding layer) are skipped
+ * and the fused activation layers are applied by their head. The
+ * assignment of the layers to the buffers is computed once, when the plan
+ * is created, so the normalizations must be folded before. The forward
+ * passes do not allocate.
+ *
+ * With the blocked_inference option of the network, the sequences of
+ * convolutional layers (with their pooling and activation layers) run in
+ * the NCHWc layout (see nchwc.hpp): the filters are packed once, when the
+ * plan is created, and the activations stay blocked in two additional
+ * buffers of the arena. They are only converted at the boundaries of the
+ * sequences, for instance before a dense layer.
+ *
+ * Like an inference_context, a plan must only be used by one thread at a
+ * time and the network must not be modified while it is used.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/dbn_traits.hpp"
+#include "dll/function.hpp"
+#include "dll/layer_fwd.hpp"
+#include "dll/util/fusion.hpp"
+#include "dll/util/inference.hpp"
+#include "dll/util/nchwc.hpp"
+#include "dll/util/ready.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer does nothing at inference
+ */
+template <typename L>
+struct is_inference_noop_impl : std::false_type {};
+
+/*!
+ * \copydoc is_inference_noop_impl
+ */
+template <typename Desc>
+struct is_inference_noop_impl<dropout_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_inference_noop_impl
+ */
+template <typename Desc>
+struct is_inference_noop_impl<dyn_dropout_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_inference_noop_impl
+ */
+template <typename Desc>
+struct is_inference_noop_impl<activation_layer_impl<Desc>> : std::bool_constant<Desc::activation_function == function::IDENTITY> {};
+
+/*!
+ * \brief Traits to test if a layer is a convolution that can run in the
+ * NCHWc layout
+ */
+template <typename L>
+struct is_nchwc_conv_impl : std::false_type {};
+
+/*!
+ * \copydoc is_nchwc_conv_impl
+ */
+template <typename Desc>
+struct is_nchwc_conv_impl<conv_layer_impl<Desc>> : std::bool_constant<is_elementwise_function<Desc::activation_function>> {};
+
+/*!
+ * \brief Traits to test if a layer is a pooling layer that can run in the
+ * NCHWc layout
+ */
+template <typename L>
+struct is_nchwc_pool_impl : std::false_type {};
+
+/*!
+ * \copydoc is_nchwc_pool_impl
+ */
+template <typename Desc>
+struct is_nchwc_pool_impl<mp_2d_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_nchwc_pool_impl
+ */
+template <typename Desc>
+struct is_nchwc_pool_impl<avgp_2d_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer is an activation layer that can run in
+ * the NCHWc layout
+ */
+template <typename L>
+struct is_nchwc_activation_impl : std::false_type {};
+
+/*!
+ * \copydoc is_nchwc_activation_impl
+ */
+template <typename Desc>
+struct is_nchwc_activation_impl<activation_layer_impl<Desc>> : std::bool_constant<is_elementwise_function<Desc::activation_function>> {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer does nothing at inference (its output
+ * is its input)
+ */
+template <typename L>
+constexpr bool is_inference_noop = detail::is_inference_noop_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer is a convolution that can run in the
+ * NCHWc layout
+ */
+template <typename L>
+constexpr bool is_nchwc_conv = detail::is_nchwc_conv_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer is a pooling layer that can run in
+ * the NCHWc layout
+ */
+template <typename L>
+constexpr bool is_nchwc_pool = detail::is_nchwc_pool_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer is an activation layer that can run
+ * in the NCHWc layout
+ */
+template <typename L>
+constexpr bool is_nchwc_activation = detail::is_nchwc_activation_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief The plan of the inference of a network, for one thread.
+ *
+ * \tparam DBN The network type
+ * \tparam Sample The type of one input sample
+ * \tparam B The maximum number of samples of a batch
+ */
+template <typename DBN, typename Sample, size_t B = DBN::batch_size>
+struct inference_plan {
+    using dbn_t  = DBN;                  ///< The network type
+    using weight = etl::value_t<Sample>; ///< The type of the activations
+
+    static constexpr size_t layers     = dbn_t::layers; ///< The number of layers
+    static constexpr size_t batch_size = B;             ///< The maximum number of samples of a batch
+    static constexpr size_t alignment  = 64;            ///< The alignment of the buffers, in bytes
+
+    static constexpr bool blocked = dbn_traits<dbn_t>::blocked_inference(); ///< Indicates if the convolutions run in the NCHWc layout
+
+private:
+    /*!
+     * \brief Indicates if the layer L is fused with the following activation layer
+     */
+    template <size_t L>
+    static constexpr bool fused() {
+        if constexpr (L + 1 < layers) {
+            return is_fusable_activation<typename dbn_t::template layer_type<L>, typename dbn_t::template layer_type<L + 1>>;
+        } else {
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the layers L, L + 1 and L + 2 can be fused once
+     * the normalization L + 1 is folded into L
+     */
+    template <size_t L>
+    static constexpr bool fused_normalization() {
+        if constexpr (L + 2 < layers) {
+            return is_fusable_normalization_activation<typename dbn_t::template layer_type<L>, typename dbn_t::template layer_type<L + 1>, typename dbn_t::template layer_type<L + 2>>;
+        } else {
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the normalization L + 1 is folded into L and the
+     * three layers L, L + 1 and L + 2 are executed as one
+     */
+    template <size_t L>
+    static bool is_folded_fusion(const dbn_t& dbn) {
+        if constexpr (fused_normalization<L>()) {
+            return dbn.template layer_get<L + 1>().folded;
+        } else {
+            cpp_unused(dbn);
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the layer L does nothing at inference
+     */
+    template <size_t L>
+    static bool is_skipped(const dbn_t& dbn) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (is_inference_noop<layer_t>) {
+            cpp_unused(dbn);
+            return true;
+        } else if constexpr (is_foldable_normalization<layer_t>) {
+            return dbn.template layer_get<L>().folded;
+        } else {
+            cpp_unused(dbn);
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the layer L, with the layers fused with it, can
+     * run in the NCHWc layout
+     */
+    template <size_t L>
+    static constexpr bool nchwc_layer() {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (is_nchwc_conv<layer_t>) {
+            if constexpr (fused<L>()) {
+                return is_elementwise_function<dbn_t::template layer_type<L + 1>::activation_function>;
+            } else if constexpr (fused_normalization<L>()) {
+                return is_elementwise_function<dbn_t::template layer_type<L + 2>::activation_function>;
+            } else {
+                return true;
+            }
+        } else if constexpr (fused<L>() || fused_normalization<L>()) {
+            return false;
+        } else {
+            return is_nchwc_pool<layer_t> || is_nchwc_activation<layer_t>;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the layer L can be part of a sequence in the NCHWc
+     * layout, either by running in it or by being skipped
+     */
+    template <size_t L>
+    static constexpr bool nchwc_step() {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        return nchwc_layer<L>() || is_inference_noop<layer_t> || is_foldable_normalization<layer_t>;
+    }
+
+    /*!
+     * \brief Returns the number of channels of the input of the layer L, if
+     * it is a convolution or a pooling layer, 0 otherwise
+     */
+    template <size_t L>
+    static constexpr size_t nchwc_input_channels() {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (is_nchwc_conv<layer_t>) {
+            return layer_t::NC;
+        } else if constexpr (is_nchwc_pool<layer_t>) {
+            return layer_t::I1;
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of pixels of the input of the layer L, if it
+     * is a convolution or a pooling layer, 0 otherwise
+     */
+    template <size_t L>
+    static constexpr size_t nchwc_input_pixels() {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (is_nchwc_conv<layer_t>) {
+            return layer_t::NV1 * layer_t::NV2;
+        } else if constexpr (is_nchwc_pool<layer_t>) {
+            return layer_t::I2 * layer_t::I3;
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the convolution L is quantized, in which case it
+     * does not run in the NCHWc layout
+     */
+    template <size_t L>
+    static bool is_quantized(const dbn_t& dbn) {
+        if constexpr (is_nchwc_conv<typename dbn_t::template layer_type<L>>) {
+            return dbn.template layer_get<L>().quantization.ready;
+        } else {
+            cpp_unused(dbn);
+            return false;
+        }
+    }
+
+public:
+    /*!
+     * \brief The execution of the layers
+     */
+    struct layout_t {
+        std::array<size_t, layers> slots{};       ///< The buffer of the output of each layer
+        std::array<bool, layers> skipped{};       ///< Indicates if a layer is skipped
+        std::array<bool, layers> folded_fusion{}; ///< Indicates if a layer is fused with the folded normalization and the activation following it
+        std::array<bool, layers> blocked{};       ///< Indicates if a layer runs in the NCHWc layout
+    };
+
+private:
+    /*!
+     * \brief Compute the execution of the layers of the given network.
+     *
+     * The steps of the forward pass alternate between the two buffers.
+     * The fused layers share the buffer of their last layer, which is the
+     * only one written. A skipped layer forwards its input to the next
+     * layer and its output is only written if it is the last layer.
+     */
+    template <size_t... I>
+    static layout_t make_layout(const dbn_t& dbn, std::index_sequence<I...> /*seq*/) {
+        constexpr bool fusable[layers] = {fused<I>()...};
+
+        const bool folded[layers]  = {is_folded_fusion<I>(dbn)...};
+        const bool skipped[layers] = {is_skipped<I>(dbn)...};
+
+        layout_t layout;
+
+        // The buffer holding the current activation (2 for the input)
+        size_t current = 2;
+
+        for (size_t l = 0; l < layers;) {
+            const size_t next = current == 0 ? 1 : 0;
+
+            if (fusable[l]) {
+                layout.slots[l]     = next;
+                layout.slots[l + 1] = next;
+
+                current = next;
+                l += 2;
+            } else if (folded[l]) {
+                layout.folded_fusion[l] = true;
+                layout.slots[l]         = next;
+                layout.slots[l + 1]     = next;
+                layout.slots[l + 2]     = next;
+
+                current = next;
+                l += 3;
+            } else if (skipped[l]) {
+                layout.skipped[l] = true;
+                layout.slots[l]   = next;
+
+                l += 1;
+            } else {
+                layout.slots[l] = next;
+
+                current = next;
+                l += 1;
+            }
+        }
+
+        if constexpr (blocked) {
+            make_blocked_layout(layout, dbn, std::index_sequence<I...>());
+        }
+
+        return layout;
+    }
+
+    /*!
+     * \brief Select the layers running in the NCHWc layout.
+     *
+     * A sequence starts at a convolution or a pooling layer and continues
+     * while the steps (a layer with the layers fused with it) can run in the
+     * NCHWc layout (or are skipped) and their input is the blocked output
+     * of the previous step. Only the sequences with at least one
+     * convolution are blocked, the others would only pay for the
+     * conversions.
+     */
+    template <size_t... I>
+    static void make_blocked_layout(layout_t& layout, const dbn_t& dbn, std::index_sequence<I...> /*seq*/) {
+        constexpr bool fusable[layers]  = {fused<I>()...};
+        constexpr bool capable[layers]  = {nchwc_layer<I>()...};
+        constexpr bool conv[layers]     = {is_nchwc_conv<typename dbn_t::template layer_type<I>>...};
+        constexpr size_t in_c[layers]   = {nchwc_input_channels<I>()...};
+        constexpr size_t in_hw[layers]  = {nchwc_input_pixels<I>()...};
+        constexpr size_t out_c[layers]  = {nchwc_output_channels<I>()...};
+        constexpr size_t out_hw[layers] = {nchwc_output_pixels<I>()...};
+
+        const bool quantized[layers] = {is_quantized<I>(dbn)...};
+
+        // The steps of the forward pass, as (first layer, last layer)
+        std::array<std::pair<size_t, size_t>, layers> steps{};
+        size_t n = 0;
+
+        for (size_t l = 0; l < layers;) {
+            const size_t length = fusable[l] ? 2 : layout.folded_fusion[l] ? 3 : 1;
+
+            steps[n++] = {l, l + length - 1};
+            l += length;
+        }
+
+        auto runs = [&](size_t s) {
+            const size_t l = steps[s].first;
+
+            return layout.skipped[l] || (capable[l] && !quantized[l]);
+        };
+
+        for (size_t s = 0; s < n;) {
+            const size_t first = steps[s].first;
+
+            if (!runs(s) || !in_c[first] || !out_c[steps[s].second]) {
+                ++s;
+                continue;
+            }
+
+            size_t e      = s + 1;
+            bool has_conv = conv[first];
+
+            while (e < n && runs(e)) {
+                const size_t l    = steps[e].first;
+                const size_t prev = steps[e - 1].second;
+
+                // The input of a convolution or a pooling must be the blocked output of the previous step
+                if (in_c[l] && (in_c[l] != out_c[prev] || in_hw[l] != out_hw[prev])) {
+                    break;
+                }
+
+                if (!out_c[steps[e].second]) {
+                    break;
+                }
+
+                has_conv |= conv[l];
+                ++e;
+            }
+
+            if (has_conv) {
+                for (size_t t = s; t < e; ++t) {
+                    layout.blocked[steps[t].first] = true;
+                }
+            }
+
+            s = e;
+        }
+    }
+
+private:
+    /*!
+     * \brief Round the given number of elements up to the alignment
+     */
+    static constexpr size_t align(size_t n) {
+        constexpr size_t step = alignment / sizeof(weight);
+
+        return ((n + step - 1) / step) * step;
+    }
+
+    /*!
+     * \brief Create a view of a batch of B samples of the dimensions of
+     * the given one expression, on the given memory. The view is fast if
+     * the one expression is fast.
+     */
+    template <typename One>
+    static auto make_view(weight* memory, const One& one) {
+        static_assert(std::is_same<etl::value_t<One>, weight>::value, "All the activations must be of the type of the input");
+
+        if constexpr (etl::all_fast<One>) {
+            if constexpr (etl::dimensions<One>() == 1) {
+                return etl::custom_fast_matrix<weight, B, etl::dim<0, One>()>(memory);
+            } else if constexpr (etl::dimensions<One>() == 2) {
+                return etl::custom_fast_matrix<weight, B, etl::dim<0, One>(), etl::dim<1, One>()>(memory);
+            } else if constexpr (etl::dimensions<One>() == 3) {
+                return etl::custom_fast_matrix<weight, B, etl::dim<0, One>(), etl::dim<1, One>(), etl::dim<2, One>()>(memory);
+            }
+        } else {
+            if constexpr (etl::dimensions<One>() == 1) {
+                return etl::custom_dyn_matrix<weight, 2>(memory, B, etl::dim<0>(one));
+            } else if constexpr (etl::dimensions<One>() == 2) {
+                return etl::custom_dyn_matrix<weight, 3>(memory, B, etl::dim<0>(one), etl::dim<1>(one));
+            } else if constexpr (etl::dimensions<One>() == 3) {
+                return etl::custom_dyn_matrix<weight, 4>(memory, B, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+            }
+        }
+
+        cpp_unreachable("Invalid selection in make_view");
+    }
+
+    /*!
+     * \brief Returns the size of the largest output of one sample of the
+     * layers from L
+     */
+    template <size_t L, typename One>
+    static size_t max_output_size(const dbn_t& dbn, const One& one) {
+        auto next = prepare_one_ready_output(dbn.template layer_get<L>(), one);
+
+        if constexpr (L + 1 < layers) {
+            return std::max(etl::size(next), max_output_size<L + 1>(dbn, next));
+        } else {
+            return etl::size(next);
+        }
+    }
+
+    /*!
+     * \brief Create the views of the outputs of the layers from L, for the
+     * given output of the previous layer
+     */
+    template <size_t L, typename One>
+    static auto make_outputs(const dbn_t& dbn, const layout_t& layout, weight* buffers, size_t buffer_size, const One& one) {
+        auto next = prepare_one_ready_output(dbn.template layer_get<L>(), one);
+        auto view = make_view(buffers + layout.slots[L] * buffer_size, next);
+
+        if constexpr (L + 1 < layers) {
+            return std::tuple_cat(std::make_tuple(std::move(view)), make_outputs<L + 1>(dbn, layout, buffers, buffer_size, next));
+        } else {
+            return std::make_tuple(std::move(view));
+        }
+    }
+
+public:
+    using input_t   = decltype(make_view(std::declval<weight*>(), std::declval<const Sample&>())); ///< The type of the input batch
+    using outputs_t = decltype(make_outputs<0>(std::declval<const dbn_t&>(), std::declval<const layout_t&>(), std::declval<weight*>(), 0, std::declval<const Sample&>())); ///< The outputs of the layers
+
+    const dbn_t& dbn;              ///< The network
+    const layout_t layout;         ///< The execution of the layers
+    const size_t input_size;       ///< The size of the input buffer
+    const size_t buffer_size;      ///< The size of each of the two output buffers
+    const size_t blocked_size;     ///< The size of each of the two NCHWc buffers
+    etl::dyn_vector<weight> arena; ///< The memory of all the activations
+    input_t input;                 ///< The input batch, for incomplete batches
+    outputs_t outputs;             ///< The outputs of the layers, views on the arena
+
+    /*!
+     * \brief Create the inference plan of the given network
+     * \param dbn The network, which must outlive the plan
+     * \param sample A sample, only used for its dimensions
+     */
+    inference_plan(const dbn_t& dbn, const Sample& sample)
+            : dbn(dbn),
+              layout(make_layout(dbn, std::make_index_sequence<layers>())),
+              input_size(align(B * etl::size(sample))),
+              buffer_size(align(B * max_output_size<0>(dbn, sample))),
+              blocked_size(blocked ? align(B * max_blocked_size(std::make_index_sequence<layers>())) : 0),
+              arena(input_size + 2 * buffer_size + 2 * blocked_size + alignment / sizeof(weight)),
+              input(make_view(aligned_memory(), sample)),
+              outputs(make_outputs<0>(dbn, layout, aligned_memory() + input_size, buffer_size, sample)) {
+        std::lock_guard<std::mutex> l(detail::inference_lock());
+
+        dbn.prepare_inference();
+
+        if constexpr (blocked) {
+            prepare_blocked(std::make_index_sequence<layers>());
+        }
+    }
+
+    // The views point inside the arena
+    inference_plan(const inference_plan& rhs) = delete;
+    inference_plan(inference_plan&& rhs)      = delete;
+    inference_plan& operator=(const inference_plan& rhs) = delete;
+    inference_plan& operator=(inference_plan&& rhs) = delete;
+
+    /*!
+     * \brief Returns the number of bytes of the arena
+     */
+    size_t arena_bytes() const {
+        return etl::size(arena) * sizeof(weight);
+    }
+
+    /*!
+     * \brief Forward a batch of at most B samples through the network
+     * \param batch The batch of samples
+     * \return A reference to the output of the last layer, of which only the
+     * first dim<0>(batch) samples are valid. The output is overwritten by
+     * the next forward pass.
+     */
+    template <typename Input>
+    auto& forward_batch(const Input& batch) {
+        const size_t n = etl::dim<0>(batch);
+
+        cpp_assert(n <= B, "The batch is too large for the inference plan");
+
+        if (n == B) {
+            forward_layers<0>(batch);
+        } else {
+            input = 0;
+
+            for (size_t i = 0; i < n; ++i) {
+                input(i) = batch(i);
+            }
+
+            forward_layers<0>(input);
+        }
+
+        return std::get<layers - 1>(outputs);
+    }
+
+private:
+    /*!
+     * \brief Returns the start of the arena, aligned on the alignment
+     */
+    weight* aligned_memory() {
+        auto address = reinterpret_cast<uintptr_t>(arena.memory_start());
+
+        return reinterpret_cast<weight*>((address + alignment - 1) & ~uintptr_t(alignment - 1));
+    }
+
+    /*!
+     * \brief Returns the given NCHWc buffer (0 or 1)
+     */
+    weight* blocked_memory(size_t i) {
+        return aligned_memory() + input_size + 2 * buffer_size + i * blocked_size;
+    }
+
+    /*!
+     * \brief Returns the number of channels of the output of the layer L, if
+     * it is a batch of feature maps, 0 otherwise
+     */
+    template <size_t L>
+    static constexpr size_t nchwc_output_channels() {
+        using view_t = std::tuple_element_t<L, outputs_t>;
+
+        if constexpr (etl::all_fast<view_t> && etl::dimensions<view_t>() == 4) {
+            return etl::dim<1, view_t>();
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of pixels of the output of the layer L, if it
+     * is a batch of feature maps, 0 otherwise
+     */
+    template <size_t L>
+    static constexpr size_t nchwc_output_pixels() {
+        using view_t = std::tuple_element_t<L, outputs_t>;
+
+        if constexpr (etl::all_fast<view_t> && etl::dimensions<view_t>() == 4) {
+            return etl::dim<2, view_t>() * etl::dim<3, view_t>();
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the size of the largest input or output of one sample
+     * in the NCHWc layout
+     */
+    template <size_t... I>
+    static constexpr size_t max_blocked_size(std::index_sequence<I...> /*seq*/) {
+        return std::max({size_t(0),
+                         nchwc_size<weight>(1, nchwc_input_channels<I>(), nchwc_input_pixels<I>())...,
+                         nchwc_size<weight>(1, nchwc_output_channels<I>(), nchwc_output_pixels<I>())...});
+    }
+
+    /*!
+     * \brief Pack the filters of the convolutions running in the NCHWc
+     * layout, if they are not already
+     */
+    template <size_t... I>
+    void prepare_blocked(std::index_sequence<I...> /*seq*/) const {
+        auto prepare = [this](auto l) {
+            constexpr size_t L = decltype(l)::value;
+
+            if constexpr (is_nchwc_conv<typename dbn_t::template layer_type<L>>) {
+                decltype(auto) layer = dbn.template layer_get<L>();
+
+                if (layout.blocked[L] && !etl::size(layer.blocked_w)) {
+                    layer.prepare_blocked_inference();
+                }
+            }
+        };
+
+        (prepare(std::integral_constant<size_t, I>()), ...);
+    }
+
+    /*!
+     * \brief Forward the blocked input, in the given NCHWc buffer, through
+     * the layers from L, which starts a sequence in the NCHWc layout
+     */
+    template <size_t L>
+    void forward_blocked(size_t current) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        decltype(auto) layer = dbn.template layer_get<L>();
+
+        const weight* in = blocked_memory(current);
+        weight* out      = blocked_memory(1 - current);
+
+        if constexpr (is_nchwc_conv<layer_t>) {
+            if constexpr (fused<L>()) {
+                layer.template blocked_forward_batch<dbn_t::template layer_type<L + 1>::activation_function>(out, in, B);
+
+                next_blocked<L + 1>(1 - current);
+            } else {
+                if constexpr (fused_normalization<L>()) {
+                    if (layout.folded_fusion[L]) {
+                        layer.template blocked_forward_batch<dbn_t::template layer_type<L + 2>::activation_function>(out, in, B);
+
+                        next_blocked<L + 2>(1 - current);
+
+                        return;
+                    }
+                }
+
+                layer.blocked_forward_batch(out, in, B);
+
+                next_blocked<L>(1 - current);
+            }
+        } else if constexpr (is_nchwc_pool<layer_t>) {
+            layer.blocked_forward_batch(out, in, B);
+
+            next_blocked<L>(1 - current);
+        } else {
+            cpp_unused(layer);
+
+            if (layout.skipped[L]) {
+                next_blocked<L>(current);
+                return;
+            }
+
+            if constexpr (is_nchwc_activation<layer_t>) {
+                const size_t n = nchwc_size<weight>(B, nchwc_output_channels<L>(), nchwc_output_pixels<L>());
+
+                etl::custom_dyn_matrix<weight, 1> in_v(blocked_memory(current), n);
+                etl::custom_dyn_matrix<weight, 1> out_v(out, n);
+
+                out_v = f_activate<layer_t::activation_function>(in_v);
+
+                next_blocked<L>(1 - current);
+            } else {
+                cpp_unreachable("Invalid layer in the NCHWc layout");
+            }
+        }
+    }
+
+    /*!
+     * \brief Continue the forward pass after the layer L, whose blocked
+     * output is in the given NCHWc buffer, either in the NCHWc layout or
+     * from its (converted) output
+     */
+    template <size_t L>
+    void next_blocked(size_t current) {
+        if constexpr (L + 1 < layers && nchwc_step<L + 1>()) {
+            if (layout.blocked[L + 1]) {
+                forward_blocked<L + 1>(current);
+                return;
+            }
+        }
+
+        auto& out = std::get<L>(outputs);
+
+        nchwc_unpack(out.memory_start(), blocked_memory(current), B, nchwc_output_channels<L>(), nchwc_output_pixels<L>());
+
+        out.invalidate_gpu();
+
+        if constexpr (L + 1 < layers) {
+            forward_layers<L + 1>(out);
+        }
+    }
+
+    /*!
+     * \brief Forward the given input through the layers from L
+     */
+    template <size_t L, typename Input>
+    void forward_layers(const Input& in) {
+        decltype(auto) layer = dbn.template layer_get<L>();
+
+        if constexpr (blocked && nchwc_input_channels<L>() && nchwc_layer<L>()) {
+            if (layout.blocked[L]) {
+                // Start of a sequence in the NCHWc layout
+                if constexpr (etl::is_dma<Input>) {
+                    in.ensure_cpu_up_to_date();
+
+                    nchwc_pack(blocked_memory(0), in.memory_start(), B, nchwc_input_channels<L>(), nchwc_input_pixels<L>());
+                } else {
+                    input = in;
+
+                    nchwc_pack(blocked_memory(0), input.memory_start(), B, nchwc_input_channels<L>(), nchwc_input_pixels<L>());
+                }
+
+                forward_blocked<L>(0);
+
+                return;
+            }
+        }
+
+        if constexpr (fused<L>()) {
+            // The activation is applied directly in the output of the activation layer
+            auto& out = std::get<L + 1>(outputs);
+
+            layer.template test_forward_batch<dbn_t::template layer_type<L + 1>::activation_function>(out, in);
+
+            if constexpr (L + 2 < layers) {
+                forward_layers<L + 2>(out);
+            }
+        } else {
+            if constexpr (fused_normalization<L>()) {
+                if (layout.folded_fusion[L]) {
+                    // The normalization is skipped and the activation is applied in the output of the activation layer
+                    auto& out = std::get<L + 2>(outputs);
+
+                    layer.template test_forward_batch<dbn_t::template layer_type<L + 2>::activation_function>(out, in);
+
+                    if constexpr (L + 3 < layers) {
+                        forward_layers<L + 3>(out);
+                    }
+
+                    return;
+                }
+            }
+
+            if (layout.skipped[L]) {
+                if constexpr (L + 1 < layers) {
+                    forward_layers<L + 1>(in);
+                } else {
+                    std::get<L>(outputs) = in;
+                }
+
+                return;
+            }
+
+            auto& out = std::get<L>(outputs);
+
+            layer.test_forward_batch(out, in);
+
+            if constexpr (L + 1 < layers) {
+                forward_layers<L + 1>(out);
+            }
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,63 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file isa.hpp
+ * \brief Runtime selection of the instruction set of the raw kernels
+ *
+ * With DLL_MULTI_ISA, the raw kernels of DLL (the convolutions on raw
+ * memory, the small and blocked products, the INT8 products and the fused
+ * updaters) are compiled once for each instruction set of
+ * DLL_MULTI_ISA_TARGETS (AVX-512 and AVX2 by default) as well as for
+ * the target of the build. The version matching the CPU is selected once,
+ * when the program is loaded (with cpuid). A binary built for the lowest
+ * common instruction set of a fleet therefore still uses the wider vectors
+ * of the newer machines in these kernels.
+ *
+ * This relies on the target_clones attribute (GCC and Clang >= 14, on
+ * x86-64 Linux). Elsewhere, DLL_MULTI_ISA has no effect. The kernels of
+ * ETL (the expressions, the activations, BLAS) are selected at compile
+ * time and are not affected.
+ */
+
+#pragma once
+
+#ifndef DLL_MULTI_ISA_TARGETS
+#define DLL_MULTI_ISA_TARGETS "avx512f", "avx2"
+#endif
+
+#if defined(DLL_MULTI_ISA) && defined(__x86_64__) && defined(__linux__) && (!defined(__clang__) || __clang_major__ >= 14)
+#define DLL_MULTI_ISA_ENABLED
+#define DLL_MULTI_ISA_KERNEL __attribute__((target_clones(DLL_MULTI_ISA_TARGETS, "default")))
+#else
+#define DLL_MULTI_ISA_KERNEL
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Returns the name of the widest instruction set of the CPU used by
+ * the raw kernels.
+ *
+ * This follows the default DLL_MULTI_ISA_TARGETS. Without DLL_MULTI_ISA,
+ * this is always "default", the target of the build.
+ */
+inline const char* kernel_isa() {
+#ifdef DLL_MULTI_ISA_ENABLED
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+#endif
+
+    return "default";
+}
+
+} //end of dll namespace
@@ -0,0 +1,157 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file layer_profiler.hpp
+ * \brief Time spent by each layer of a network during SGD training
+ *
+ * The SGD trainer opens a layer_scope around the forward, the backward and
+ * the update of each layer. The scopes only measure time while a profiler
+ * is active and only for the layers registered in it, otherwise they cost
+ * a single test.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The phases of the training of a layer
+ */
+enum class profile_phase : size_t {
+    FORWARD  = 0, ///< The forward propagation
+    BACKWARD = 1, ///< The backpropagation of the errors
+    UPDATE   = 2  ///< The computation and the application of the gradients
+};
+
+constexpr size_t profile_phases = 3; ///< The number of profiled phases
+
+/*!
+ * \brief The time spent by one layer in each phase
+ */
+struct layer_timings {
+    const void* layer;                                 ///< The profiled layer
+    std::atomic<size_t> duration[profile_phases] = {}; ///< The total duration of each phase (ns)
+    std::atomic<size_t> count[profile_phases]    = {}; ///< The number of executions of each phase
+
+    /*!
+     * \brief Create the timings of the given layer
+     */
+    explicit layer_timings(const void* layer) : layer(layer) {}
+
+    /*!
+     * \brief Returns the total duration of the given phase, in nanoseconds
+     */
+    size_t total(profile_phase phase) const {
+        return duration[size_t(phase)];
+    }
+};
+
+/*!
+ * \brief The timings of the registered layers
+ */
+struct layer_profiler {
+    std::vector<std::unique_ptr<layer_timings>> layers; ///< The timings, in the order of registration
+
+    /*!
+     * \brief Register the given layer
+     */
+    template <typename Layer>
+    void add(const Layer& layer) {
+        layers.emplace_back(std::make_unique<layer_timings>(&layer));
+    }
+
+    /*!
+     * \brief Returns the timings of the given layer, nullptr if it is not
+     * registered
+     */
+    layer_timings* find(const void* layer) const {
+        for (auto& timings : layers) {
+            if (timings->layer == layer) {
+                return timings.get();
+            }
+        }
+
+        return nullptr;
+    }
+
+    /*!
+     * \brief Reset the timings of all the layers
+     */
+    void reset() {
+        for (auto& timings : layers) {
+            for (size_t p = 0; p < profile_phases; ++p) {
+                timings->duration[p] = 0;
+                timings->count[p]    = 0;
+            }
+        }
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Return a reference to the active profiler
+ */
+inline std::atomic<layer_profiler*>& active_layer_profiler() {
+    static std::atomic<layer_profiler*> profiler(nullptr);
+    return profiler;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Set the active profiler, nullptr to stop profiling
+ */
+inline void set_layer_profiler(layer_profiler* profiler) {
+    detail::active_layer_profiler() = profiler;
+}
+
+/*!
+ * \brief RAII measure of one phase of a layer
+ */
+struct layer_scope {
+    layer_timings* timings;                                   ///< The timings of the layer, nullptr if not profiled
+    profile_phase phase;                                      ///< The measured phase
+    std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
+
+    /*!
+     * \brief Start measuring the given phase of the given layer
+     */
+    template <typename Layer>
+    layer_scope(const Layer& layer, profile_phase phase) : timings(nullptr), phase(phase) {
+        if (auto* profiler = detail::active_layer_profiler().load(std::memory_order_relaxed)) {
+            timings = profiler->find(&layer);
+
+            if (timings) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+    }
+
+    layer_scope(const layer_scope& rhs) = delete;
+    layer_scope& operator=(const layer_scope& rhs) = delete;
+
+    /*!
+     * \brief Stop measuring and accumulate the duration
+     */
+    ~layer_scope() {
+        if (timings) {
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+            timings->duration[size_t(phase)] += duration;
+            ++timings->count[size_t(phase)];
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,301 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file linear_svm.hpp
+ * \brief Linear SVM trained by dual coordinate descent
+ *
+ * The classifier is trained one-vs-rest, with the L2-loss dual coordinate
+ * descent of liblinear, on a dense matrix of features. The bias is trained
+ * as the weight of an extra constant feature. The classes are trained
+ * concurrently and the prediction of a batch is a single matrix
+ * multiplication.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "cpp_utils/io.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The parameters of the training of a linear SVM
+ */
+struct linear_svm_parameters {
+    double C          = 1.0; ///< The cost of the errors
+    double eps        = 0.1; ///< The tolerance of the stopping criterion (on the projected gradient)
+    size_t iterations = 1000; ///< The maximum number of passes over the samples
+};
+
+namespace detail {
+
+/*!
+ * \brief Returns the dot product of the vectors a and b of size n.
+ *
+ * The sum is split into independent lanes, so that the compiler can
+ * vectorize it without reordering the additions of a lane.
+ */
+template <typename T>
+T linear_dot(const T* a, const T* b, size_t n) {
+    constexpr size_t lanes = 8;
+
+    T sums[lanes] = {};
+
+    size_t j = 0;
+
+    for (; j + lanes <= n; j += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            sums[l] += a[j + l] * b[j + l];
+        }
+    }
+
+    T sum = 0;
+
+    for (; j < n; ++j) {
+        sum += a[j] * b[j];
+    }
+
+    for (size_t l = 0; l < lanes; ++l) {
+        sum += sums[l];
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Compute a += alpha * b, for vectors of size n
+ */
+template <typename T>
+void linear_axpy(T* a, T alpha, const T* b, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        a[j] += alpha * b[j];
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief A multi-class linear SVM (one-vs-rest).
+ *
+ * \tparam T The type of the features and the weights
+ */
+template <typename T>
+struct linear_svm {
+    etl::dyn_matrix<T, 2> w; ///< The weights of each class (classes x features)
+    etl::dyn_matrix<T, 1> b; ///< The bias of each class
+
+    /*!
+     * \brief Indicates if the classifier has been trained (or loaded)
+     */
+    bool trained() const {
+        return etl::size(b) > 0;
+    }
+
+    /*!
+     * \brief Returns the number of classes
+     */
+    size_t classes() const {
+        return etl::size(b);
+    }
+
+    /*!
+     * \brief Returns the number of features
+     */
+    size_t features() const {
+        return trained() ? etl::dim<1>(w) : 0;
+    }
+
+    /*!
+     * \brief Train the classifier.
+     *
+     * \param x The features of the samples (samples x features)
+     * \param labels The class of each sample, in [0, classes)
+     * \param parameters The parameters of the training
+     * \param pool The thread pool on which the classes are trained
+     */
+    template <typename Pool>
+    void train(const etl::dyn_matrix<T, 2>& x, const std::vector<size_t>& labels, const linear_svm_parameters& parameters, Pool& pool) {
+        const size_t n = etl::dim<0>(x);
+        const size_t d = etl::dim<1>(x);
+
+        cpp_assert(labels.size() == n, "There must be one label per sample");
+
+        const size_t k = n ? *std::max_element(labels.begin(), labels.end()) + 1 : 0;
+
+        w = etl::dyn_matrix<T, 2>(k, d);
+        b = etl::dyn_matrix<T, 1>(k);
+
+        w = T(0);
+        b = T(0);
+
+        x.ensure_cpu_up_to_date();
+
+        // The diagonal of the kernel, with the constant feature of the bias
+        std::vector<T> diagonal(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            diagonal[i] = detail::linear_dot(x.memory_start() + i * d, x.memory_start() + i * d, d) + T(1);
+        }
+
+        for (size_t c = 0; c < k; ++c) {
+            pool.do_task([&, c] {
+                train_class(x, labels, diagonal, parameters, c);
+            });
+        }
+
+        pool.wait();
+
+        w.invalidate_gpu();
+        b.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the scores of each class for the given batch of
+     * features (samples x features), in one matrix multiplication
+     */
+    template <typename X>
+    etl::dyn_matrix<T, 2> scores(const X& x) const {
+        cpp_assert(trained(), "The classifier must be trained first");
+
+        etl::dyn_matrix<T, 2> scores(etl::dim<0>(x), classes());
+
+        scores = etl::bias_add_2d(x * etl::transpose(w), b);
+
+        return scores;
+    }
+
+    /*!
+     * \brief Predict the class of each sample of the given batch of features
+     */
+    template <typename X>
+    std::vector<size_t> predict_batch(const X& x) const {
+        auto s = scores(x);
+
+        s.ensure_cpu_up_to_date();
+
+        const size_t n = etl::dim<0>(s);
+        const size_t k = classes();
+
+        std::vector<size_t> labels(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            const T* row = s.memory_start() + i * k;
+
+            labels[i] = std::max_element(row, row + k) - row;
+        }
+
+        return labels;
+    }
+
+    /*!
+     * \brief Store the classifier into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write(os, uint64_t(classes()));
+        cpp::binary_write(os, uint64_t(features()));
+
+        if (trained()) {
+            cpp::binary_write_all(os, w);
+            cpp::binary_write_all(os, b);
+        }
+    }
+
+    /*!
+     * \brief Load the classifier from the given stream
+     * \return true if the classifier was read, false otherwise
+     */
+    bool load(std::istream& is) {
+        uint64_t k = 0;
+        uint64_t d = 0;
+
+        cpp::binary_load(is, k);
+        cpp::binary_load(is, d);
+
+        w = etl::dyn_matrix<T, 2>(k, d);
+        b = etl::dyn_matrix<T, 1>(k);
+
+        if (k) {
+            cpp::binary_load_all(is, w);
+            cpp::binary_load_all(is, b);
+        }
+
+        return bool(is);
+    }
+
+private:
+    /*!
+     * \brief Train the class c against the others.
+     *
+     * This is the dual coordinate descent of liblinear for the L2-loss SVM,
+     * without shrinking. The samples are visited in a random order at each
+     * pass, until the projected gradients are within eps of each other.
+     */
+    void train_class(const etl::dyn_matrix<T, 2>& x, const std::vector<size_t>& labels, const std::vector<T>& diagonal, const linear_svm_parameters& parameters, size_t c) {
+        const size_t n = etl::dim<0>(x);
+        const size_t d = etl::dim<1>(x);
+
+        const T D = T(0.5 / parameters.C);
+
+        T* wc = w.memory_start() + c * d;
+        T bc  = 0;
+
+        std::vector<T> alpha(n, T(0));
+        std::vector<size_t> order(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            order[i] = i;
+        }
+
+        // Each class has its own engine, the classes are trained concurrently
+        std::mt19937_64 engine(c);
+
+        for (size_t it = 0; it < parameters.iterations; ++it) {
+            std::shuffle(order.begin(), order.end(), engine);
+
+            T max_pg = std::numeric_limits<T>::lowest();
+            T min_pg = std::numeric_limits<T>::max();
+
+            for (auto i : order) {
+                const T* xi = x.memory_start() + i * d;
+                const T y   = labels[i] == c ? T(1) : T(-1);
+
+                const T g  = y * (detail::linear_dot(wc, xi, d) + bc) - T(1) + D * alpha[i];
+                const T pg = alpha[i] == T(0) ? std::min(g, T(0)) : g;
+
+                max_pg = std::max(max_pg, pg);
+                min_pg = std::min(min_pg, pg);
+
+                if (pg != T(0)) {
+                    const T previous = alpha[i];
+
+                    alpha[i] = std::max(previous - g / (diagonal[i] + D), T(0));
+
+                    const T delta = (alpha[i] - previous) * y;
+
+                    detail::linear_axpy(wc, delta, xi, d);
+                    bc += delta;
+                }
+            }
+
+            if (max_pg - min_pg <= T(parameters.eps)) {
+                break;
+            }
+        }
+
+        b[c] = bc;
+    }
+};
+
+} //end of dll namespace
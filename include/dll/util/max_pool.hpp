@@ -0,0 +1,220 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file max_pool.hpp
+ * \brief Max pooling recording the position of the maximum of each window
+ *
+ * The training forward pass records, for each output, the offset of the
+ * maximum inside its pooling window. The backward pass is then a simple
+ * scatter of the errors at these offsets, without reading the input and
+ * the output again. With ties, the whole error of a window goes to its
+ * first maximum.
+ *
+ * With the GPU, the max pooling layers keep the pooling kernels of ETL
+ * (cuDNN) and their input for the backward pass instead.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the max pooling layers record the position of the
+ * maxima during training, instead of using the ETL kernels.
+ */
+#if defined(ETL_GPU) || defined(ETL_CUDNN_MODE)
+constexpr bool max_pool_argmax = false;
+#else
+constexpr bool max_pool_argmax = true;
+#endif
+
+/*!
+ * \brief The smallest type able to store an offset inside a pooling window
+ * of N elements.
+ */
+template <size_t N>
+using max_pool_index_t = std::conditional_t<N <= 256, uint8_t, uint16_t>;
+
+/*!
+ * \brief The workspace of a max pooling layer
+ */
+template <typename Index>
+struct max_pool_workspace {
+    std::vector<Index> argmax; ///< The offset of the maximum in the window of each output
+};
+
+namespace detail {
+
+/*!
+ * \brief The dimensions of a max pooling of a batch of 3D inputs.
+ *
+ * The 2D pooling is a 3D pooling with a first ratio of 1.
+ */
+struct max_pool_dims {
+    size_t B;  ///< The number of samples
+    size_t I1; ///< The first dimension of the input
+    size_t I2; ///< The second dimension of the input
+    size_t I3; ///< The third dimension of the input
+    size_t C1; ///< The first pooling ratio
+    size_t C2; ///< The second pooling ratio
+    size_t C3; ///< The third pooling ratio
+
+    size_t O1() const { return I1 / C1; }                ///< The first dimension of the output
+    size_t O2() const { return I2 / C2; }                ///< The second dimension of the output
+    size_t O3() const { return I3 / C3; }                ///< The third dimension of the output
+    size_t O() const { return B * O1() * O2() * O3(); } ///< The total number of outputs
+};
+
+/*!
+ * \brief Compute the max pooling of the input on raw memory and record the
+ * offset of the maximum of each window.
+ */
+template <typename T, typename Index>
+void max_pool_forward(T* out, Index* argmax, const T* in, const max_pool_dims& d) {
+    const size_t O1 = d.O1();
+    const size_t O2 = d.O2();
+    const size_t O3 = d.O3();
+
+    size_t o = 0;
+
+    for (size_t b = 0; b < d.B; ++b) {
+        const T* x = in + b * d.I1 * d.I2 * d.I3;
+
+        for (size_t i = 0; i < O1; ++i) {
+            for (size_t j = 0; j < O2; ++j) {
+                for (size_t k = 0; k < O3; ++k, ++o) {
+                    const T* w = x + ((i * d.C1) * d.I2 + j * d.C2) * d.I3 + k * d.C3;
+
+                    T best     = w[0];
+                    size_t arg = 0;
+                    size_t off = 0;
+
+                    for (size_t p = 0; p < d.C1; ++p) {
+                        for (size_t q = 0; q < d.C2; ++q) {
+                            const T* row = w + (p * d.I2 + q) * d.I3;
+
+                            for (size_t r = 0; r < d.C3; ++r, ++off) {
+                                if (row[r] > best) {
+                                    best = row[r];
+                                    arg  = off;
+                                }
+                            }
+                        }
+                    }
+
+                    out[o]    = best;
+                    argmax[o] = Index(arg);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Scatter the errors of the outputs at the recorded maximum of
+ * their window, on raw memory.
+ */
+template <typename T, typename Index>
+void max_pool_backward(T* d_in, const T* errors, const Index* argmax, const max_pool_dims& d) {
+    const size_t O1 = d.O1();
+    const size_t O2 = d.O2();
+    const size_t O3 = d.O3();
+
+    std::fill_n(d_in, d.B * d.I1 * d.I2 * d.I3, T(0));
+
+    size_t o = 0;
+
+    for (size_t b = 0; b < d.B; ++b) {
+        T* x = d_in + b * d.I1 * d.I2 * d.I3;
+
+        for (size_t i = 0; i < O1; ++i) {
+            for (size_t j = 0; j < O2; ++j) {
+                for (size_t k = 0; k < O3; ++k, ++o) {
+                    const size_t arg = argmax[o];
+
+                    const size_t p = arg / (d.C2 * d.C3);
+                    const size_t q = (arg / d.C3) % d.C2;
+                    const size_t r = arg % d.C3;
+
+                    x[((i * d.C1 + p) * d.I2 + j * d.C2 + q) * d.I3 + k * d.C3 + r] = errors[o];
+                }
+            }
+        }
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the max pooling of the input and record the position of
+ * the maximum of each window in the workspace.
+ *
+ * \param output The output [B, O1, O2, O3]
+ * \param input The input [B, I1, I2, I3] (or any view of the same size)
+ * \param workspace The workspace of the layer
+ * \param d The dimensions of the pooling
+ */
+template <typename O, typename I, typename Index>
+void max_pool_forward(O&& output, const I& input, max_pool_workspace<Index>& workspace, const detail::max_pool_dims& d) {
+    workspace.argmax.resize(d.O());
+
+    if constexpr (!etl::is_dma<I>) {
+        auto input_t = etl::force_temporary(input);
+        max_pool_forward(output, input_t, workspace, d);
+    } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+        auto output_t = etl::force_temporary(output);
+        max_pool_forward(output_t, input, workspace, d);
+        output = output_t;
+    } else {
+        input.ensure_cpu_up_to_date();
+
+        detail::max_pool_forward(output.memory_start(), workspace.argmax.data(), input.memory_start(), d);
+
+        output.invalidate_gpu();
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of a max pooling from the positions
+ * recorded in the workspace during the forward pass.
+ *
+ * \param output The errors of the input [B, I1, I2, I3]
+ * \param errors The errors of the output [B, O1, O2, O3] (or any view of the same size)
+ * \param workspace The workspace of the layer
+ * \param d The dimensions of the pooling
+ */
+template <typename O, typename E, typename Index>
+void max_pool_backward(O&& output, const E& errors, const max_pool_workspace<Index>& workspace, const detail::max_pool_dims& d) {
+    cpp_assert(workspace.argmax.size() == d.O(), "The forward pass must have been done with the workspace");
+
+    if constexpr (!etl::is_dma<E>) {
+        auto errors_t = etl::force_temporary(errors);
+        max_pool_backward(output, errors_t, workspace, d);
+    } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+        auto output_t = etl::force_temporary(output);
+        max_pool_backward(output_t, errors, workspace, d);
+        output = output_t;
+    } else {
+        errors.ensure_cpu_up_to_date();
+
+        detail::max_pool_backward(output.memory_start(), errors.memory_start(), workspace.argmax.data(), d);
+
+        output.invalidate_gpu();
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,278 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file memory_report.hpp
+ * \brief Memory used by the networks, their training contexts and the
+ * generators
+ *
+ * A memory_usage lists the bytes of each component. The reports of the
+ * SGD trainer and of the generators measure the buffers that are
+ * allocated. predict_memory() estimates the memory of the training of a
+ * network for a batch size and an updater, from the shapes of its layers,
+ * before anything is allocated.
+ */
+
+#pragma once
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dll/updater_type.hpp"
+#include "dll/trainer/context_fwd.hpp" // For sgd_shares_errors_v and sgd_recomputes_v
+#include "dll/util/roofline.hpp" // For network_costs
+
+namespace dll {
+
+/*!
+ * \brief The bytes used by each component
+ */
+struct memory_usage {
+    std::vector<std::pair<std::string, size_t>> entries; ///< The components and their bytes
+
+    /*!
+     * \brief Add a component, if it uses memory
+     */
+    void add(const std::string& component, size_t bytes) {
+        if (bytes) {
+            entries.emplace_back(component, bytes);
+        }
+    }
+
+    /*!
+     * \brief Add all the components of the given report, with a prefix
+     */
+    void add(const std::string& prefix, const memory_usage& report) {
+        for (auto& entry : report.entries) {
+            entries.emplace_back(prefix + entry.first, entry.second);
+        }
+    }
+
+    /*!
+     * \brief Returns the total bytes of all the components
+     */
+    size_t total() const {
+        size_t bytes = 0;
+
+        for (auto& entry : entries) {
+            bytes += entry.second;
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Print the report on the given stream
+     */
+    void print(std::ostream& os = std::cout) const {
+        size_t width = 5;
+
+        for (auto& entry : entries) {
+            width = std::max(width, entry.first.size());
+        }
+
+        for (auto& entry : entries) {
+            os << std::setw(width) << std::left << entry.first << std::right << " : " << memory_str(entry.second) << '\n';
+        }
+
+        os << std::setw(width) << std::left << "Total" << std::right << " : " << memory_str(total()) << std::endl;
+    }
+
+    /*!
+     * \brief Returns a human readable string for the given bytes
+     */
+    static std::string memory_str(size_t bytes) {
+        if (bytes > 1024 * 1024 * 1024) {
+            return std::to_string(bytes / (1024.0 * 1024.0 * 1024.0)) + "GB";
+        } else if (bytes > 1024 * 1024) {
+            return std::to_string(bytes / (1024.0 * 1024.0)) + "MB";
+        } else if (bytes > 1024) {
+            return std::to_string(bytes / 1024.0) + "KB";
+        } else {
+            return std::to_string(bytes) + "B";
+        }
+    }
+};
+
+/*!
+ * \brief Returns the number of buffers of the size of a variable held by
+ * the updater, including the gradients
+ */
+constexpr size_t updater_buffers(updater_type updater) {
+    switch (updater) {
+        case updater_type::SGD:
+            return 1;
+        case updater_type::MOMENTUM:
+        case updater_type::ADAGRAD:
+        case updater_type::RMSPROP:
+        case updater_type::LARS:
+            return 2;
+        case updater_type::NESTEROV:
+        case updater_type::ADAM:
+        case updater_type::ADAMAX:
+        case updater_type::LAMB:
+            return 3;
+        case updater_type::ADADELTA:
+            return 4;
+        case updater_type::ADAM_CORRECT:
+        case updater_type::NADAM:
+            return 5;
+    }
+
+    return 1;
+}
+
+/*!
+ * \brief Returns the bytes of the values of the given container (an ETL
+ * container or a vector of ETL containers), 0 for anything else
+ */
+template <typename T>
+size_t container_bytes(const T& container) {
+    if constexpr (etl::is_etl_expr<T>) {
+        return etl::size(container) * sizeof(etl::value_t<T>);
+    } else if constexpr (cpp::is_specialization_of_v<std::vector, T>) {
+        size_t bytes = 0;
+
+        for (auto& value : container) {
+            bytes += container_bytes(value);
+        }
+
+        return bytes;
+    } else {
+        return 0;
+    }
+}
+
+namespace detail {
+
+#define DLL_MEMORY_MEMBER(member)                                                                    \
+    template <typename T, typename Enable = void>                                                   \
+    struct has_##member : std::false_type {};                                                       \
+    template <typename T>                                                                           \
+    struct has_##member<T, std::void_t<decltype(std::declval<T&>().member)>> : std::true_type {}; \
+    template <typename T>                                                                           \
+    size_t member##_bytes(const T& value) {                                                         \
+        if constexpr (has_##member<T>::value) {                                                     \
+            return container_bytes(value.member);                                                   \
+        } else {                                                                                    \
+            return 0;                                                                               \
+        }                                                                                           \
+    }
+
+DLL_MEMORY_MEMBER(input)
+DLL_MEMORY_MEMBER(output)
+DLL_MEMORY_MEMBER(errors)
+DLL_MEMORY_MEMBER(workspace)
+DLL_MEMORY_MEMBER(grad)
+DLL_MEMORY_MEMBER(input_cache)
+DLL_MEMORY_MEMBER(label_cache)
+DLL_MEMORY_MEMBER(batch_cache)
+DLL_MEMORY_MEMBER(label_batch_cache)
+
+#undef DLL_MEMORY_MEMBER
+
+template <typename T, typename Enable = void>
+struct has_updater_context : std::false_type {};
+
+template <typename T>
+struct has_updater_context<T, std::void_t<decltype(std::declval<T&>().up.context)>> : std::true_type {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Returns the memory of the given SGD context of a layer.
+ *
+ * The buffers of the context (input, output, errors and an ETL workspace)
+ * and of its updater (the gradients and the state of the updater, by
+ * variable, and the accumulated gradients) are reported.
+ *
+ * \tparam UT The updater of the network
+ */
+template <updater_type UT, typename Context>
+memory_usage context_memory_report(const Context& context) {
+    memory_usage report;
+
+    // The recomputed activations and the shared errors are reported with the pools of the trainer
+    report.add("input", sgd_recomputes_v<Context> ? 0 : detail::input_bytes(context));
+    report.add("output", sgd_recomputes_v<Context> ? 0 : detail::output_bytes(context));
+    report.add("errors", sgd_shares_errors_v<Context> ? 0 : detail::errors_bytes(context));
+    report.add("workspace", detail::workspace_bytes(context));
+
+    if constexpr (detail::has_updater_context<Context>::value) {
+        size_t grad        = 0;
+        size_t accumulated = 0;
+
+        // The sub contexts are shared, the accumulated ones are only allocated when used
+        cpp::for_each(context.up.context, [&grad](auto& sub) { grad += sub ? detail::grad_bytes(*sub) : 0; });
+        cpp::for_each(context.up.accumulated, [&accumulated](auto& sub) { accumulated += sub ? detail::grad_bytes(*sub) : 0; });
+
+        report.add("grad", grad);
+        report.add("updater", grad * (updater_buffers(UT) - 1));
+        report.add("accumulated", accumulated);
+    }
+
+    return report;
+}
+
+/*!
+ * \brief Returns the memory of the caches of the given generator
+ */
+template <typename Generator>
+memory_usage generator_memory_report(const Generator& generator) {
+    memory_usage report;
+
+    report.add("input_cache", detail::input_cache_bytes(generator));
+    report.add("label_cache", detail::label_cache_bytes(generator));
+    report.add("batch_cache", detail::batch_cache_bytes(generator));
+    report.add("label_batch_cache", detail::label_batch_cache_bytes(generator));
+
+    return report;
+}
+
+/*!
+ * \brief Predict the memory of the SGD training of the given network.
+ *
+ * For each layer, the parameters, the gradients and the state of the
+ * updater are counted with its input, output and errors for a batch. The
+ * total is the peak of the training, since all these buffers live during
+ * the whole training.
+ *
+ * \param dbn The network
+ * \param batch The batch size
+ * \param updater The updater
+ */
+template <typename DBN>
+memory_usage predict_memory(const DBN& dbn, size_t batch, updater_type updater) {
+    using weight = typename std::decay_t<DBN>::weight;
+
+    memory_usage report;
+
+    auto costs = network_costs(dbn);
+
+    for (size_t i = 0; i < costs.size(); ++i) {
+        auto& cost = costs[i];
+
+        const std::string prefix = "layer " + std::to_string(i) + ": ";
+
+        const size_t parameters = cost.parameters * sizeof(weight);
+
+        report.add(prefix + "parameters", parameters);
+        report.add(prefix + "grad", parameters);
+        report.add(prefix + "updater", parameters * (updater_buffers(updater) - 1));
+        report.add(prefix + "input", batch * cost.inputs * sizeof(weight));
+        report.add(prefix + "output", batch * cost.outputs * sizeof(weight));
+        report.add(prefix + "errors", batch * cost.outputs * sizeof(weight));
+    }
+
+    return report;
+}
+
+} //end of dll namespace
@@ -0,0 +1,295 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file nchwc.hpp
+ * \brief Channel-blocked (NCHWc) layout of the convolutional activations
+ *
+ * In the NCHWc layout, the channels of a batch of feature maps are split
+ * in blocks of c channels, c being the SIMD width. A sample is stored as
+ * [ceil(C / c), H, W, c]: the c channels of a block at a given pixel are
+ * contiguous. The filters of a convolution are packed accordingly as
+ * [ceil(K / c), ceil(NC / c), NW1, NW2, c (input), c (output)], so that
+ * each tap of the convolution is a broadcast of one input value
+ * multiplied by c contiguous weights and accumulated into c contiguous
+ * outputs, which is vectorized without any gather. The padding channels
+ * of the last blocks have zero filters, their activations are never read
+ * back.
+ *
+ * The pooling layers and the element-wise activations work on each
+ * channel independently, they are computed directly in the blocked
+ * layout.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/grouped_conv.hpp" // For grouped_conv_dims
+#include "dll/util/isa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The number of channels of a block of the NCHWc layout, the
+ * number of values of the given type in a 256-bit vector
+ */
+template <typename T>
+constexpr size_t nchwc_width = 32 / sizeof(T);
+
+/*!
+ * \brief Returns the number of blocks of c channels holding C channels
+ */
+constexpr size_t nchwc_blocks(size_t C, size_t c) {
+    return (C + c - 1) / c;
+}
+
+/*!
+ * \brief Returns the number of values of a batch of feature maps in the
+ * NCHWc layout
+ * \param B The number of samples
+ * \param C The number of channels
+ * \param HW The number of pixels of a feature map
+ */
+template <typename T>
+constexpr size_t nchwc_size(size_t B, size_t C, size_t HW) {
+    return B * nchwc_blocks(C, nchwc_width<T>) * nchwc_width<T> * HW;
+}
+
+/*!
+ * \brief Convert a batch of feature maps from NCHW to NCHWc
+ * \param out The blocked batch
+ * \param in The batch [B, C, HW]
+ * \param B The number of samples
+ * \param C The number of channels
+ * \param HW The number of pixels of a feature map
+ */
+template <typename T>
+void nchwc_pack(T* out, const T* in, size_t B, size_t C, size_t HW) {
+    constexpr size_t c = nchwc_width<T>;
+
+    const size_t CB = nchwc_blocks(C, c);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t cb = 0; cb < CB; ++cb) {
+            T* o = out + (b * CB + cb) * HW * c;
+
+            for (size_t ci = 0; ci < c; ++ci) {
+                const size_t ch = cb * c + ci;
+
+                if (ch < C) {
+                    const T* x = in + (b * C + ch) * HW;
+
+                    for (size_t p = 0; p < HW; ++p) {
+                        o[p * c + ci] = x[p];
+                    }
+                } else {
+                    for (size_t p = 0; p < HW; ++p) {
+                        o[p * c + ci] = T(0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Convert a batch of feature maps from NCHWc to NCHW
+ * \param out The batch [B, C, HW]
+ * \param in The blocked batch
+ * \param B The number of samples
+ * \param C The number of channels
+ * \param HW The number of pixels of a feature map
+ */
+template <typename T>
+void nchwc_unpack(T* out, const T* in, size_t B, size_t C, size_t HW) {
+    constexpr size_t c = nchwc_width<T>;
+
+    const size_t CB = nchwc_blocks(C, c);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t ch = 0; ch < C; ++ch) {
+            const T* x = in + (b * CB + ch / c) * HW * c + ch % c;
+            T* o       = out + (b * C + ch) * HW;
+
+            for (size_t p = 0; p < HW; ++p) {
+                o[p] = x[p * c];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Returns the number of values of the packed filters of a
+ * convolution
+ */
+template <typename T>
+constexpr size_t nchwc_filters_size(size_t K, size_t NC, size_t NW1, size_t NW2) {
+    constexpr size_t c = nchwc_width<T>;
+
+    return nchwc_blocks(K, c) * nchwc_blocks(NC, c) * NW1 * NW2 * c * c;
+}
+
+/*!
+ * \brief Pack the filters of a convolution for the NCHWc layout
+ * \param out The packed filters [KB, CB, NW1, NW2, c, c]
+ * \param w The filters [K, NC, NW1, NW2]
+ */
+template <typename T>
+void nchwc_pack_filters(T* out, const T* w, size_t K, size_t NC, size_t NW1, size_t NW2) {
+    constexpr size_t c = nchwc_width<T>;
+
+    const size_t CB = nchwc_blocks(NC, c);
+
+    std::fill_n(out, nchwc_filters_size<T>(K, NC, NW1, NW2), T(0));
+
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t ch = 0; ch < NC; ++ch) {
+            for (size_t p = 0; p < NW1; ++p) {
+                for (size_t q = 0; q < NW2; ++q) {
+                    T* o = out + (((k / c * CB + ch / c) * NW1 + p) * NW2 + q) * c * c;
+
+                    o[(ch % c) * c + k % c] = w[((k * NC + ch) * NW1 + p) * NW2 + q];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the forward convolution on blocked feature maps.
+ *
+ * The convolution is the same as grouped_conv_forward, without groups.
+ *
+ * \param out The blocked output [B, KB, NH1, NH2, c]
+ * \param in The blocked input [B, CB, NV1, NV2, c]
+ * \param w The packed filters [KB, CB, NW1, NW2, c, c]
+ * \param bias The biases [K], or nullptr
+ * \param d The dimensions of the convolution
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void nchwc_conv_forward(T* out, const T* in, const T* w, const T* bias, const detail::grouped_conv_dims& d) {
+    constexpr size_t c = nchwc_width<T>;
+
+    const size_t KB  = nchwc_blocks(d.K, c);
+    const size_t CB  = nchwc_blocks(d.NC, c);
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    for (size_t b = 0; b < d.B; ++b) {
+        for (size_t kb = 0; kb < KB; ++kb) {
+            T init[c] = {};
+
+            if (bias) {
+                for (size_t co = 0; co < c && kb * c + co < d.K; ++co) {
+                    init[co] = bias[kb * c + co];
+                }
+            }
+
+            for (size_t i = 0; i < NH1; ++i) {
+                for (size_t j = 0; j < NH2; ++j) {
+                    T acc[c];
+
+                    std::copy_n(init, c, acc);
+
+                    for (size_t cb = 0; cb < CB; ++cb) {
+                        for (size_t p = 0; p < d.NW1; ++p) {
+                            const std::ptrdiff_t r = std::ptrdiff_t(i * d.S1 + p * d.D1) - std::ptrdiff_t(d.P1);
+
+                            if (r < 0 || r >= std::ptrdiff_t(d.NV1)) {
+                                continue;
+                            }
+
+                            for (size_t q = 0; q < d.NW2; ++q) {
+                                const std::ptrdiff_t s = std::ptrdiff_t(j * d.S2 + q * d.D2) - std::ptrdiff_t(d.P2);
+
+                                if (s < 0 || s >= std::ptrdiff_t(d.NV2)) {
+                                    continue;
+                                }
+
+                                const T* x  = in + (((b * CB + cb) * d.NV1 + r) * d.NV2 + s) * c;
+                                const T* wv = w + (((kb * CB + cb) * d.NW1 + p) * d.NW2 + q) * c * c;
+
+                                for (size_t ci = 0; ci < c; ++ci) {
+                                    const T xv = x[ci];
+
+                                    for (size_t co = 0; co < c; ++co) {
+                                        acc[co] += xv * wv[ci * c + co];
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    std::copy_n(acc, c, out + (((b * KB + kb) * NH1 + i) * NH2 + j) * c);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the non-overlapping 2D pooling of blocked feature maps
+ * \param out The blocked output [B, CB, NV1 / P1, NV2 / P2, c]
+ * \param in The blocked input [B, CB, NV1, NV2, c]
+ * \param B The number of samples
+ * \param C The number of channels
+ * \param NV1 The first dimension of the input
+ * \param NV2 The second dimension of the input
+ * \param P1 The first pooling ratio
+ * \param P2 The second pooling ratio
+ * \tparam Max Indicates if the max is computed, otherwise the average
+ */
+template <bool Max, typename T>
+DLL_MULTI_ISA_KERNEL void nchwc_pool(T* out, const T* in, size_t B, size_t C, size_t NV1, size_t NV2, size_t P1, size_t P2) {
+    constexpr size_t c = nchwc_width<T>;
+
+    const size_t CB  = nchwc_blocks(C, c);
+    const size_t NH1 = NV1 / P1;
+    const size_t NH2 = NV2 / P2;
+
+    for (size_t bc = 0; bc < B * CB; ++bc) {
+        for (size_t i = 0; i < NH1; ++i) {
+            for (size_t j = 0; j < NH2; ++j) {
+                T acc[c];
+
+                std::copy_n(in + ((bc * NV1 + i * P1) * NV2 + j * P2) * c, c, acc);
+
+                for (size_t p = 0; p < P1; ++p) {
+                    for (size_t q = 0; q < P2; ++q) {
+                        if (p == 0 && q == 0) {
+                            continue;
+                        }
+
+                        const T* x = in + ((bc * NV1 + i * P1 + p) * NV2 + j * P2 + q) * c;
+
+                        for (size_t co = 0; co < c; ++co) {
+                            if constexpr (Max) {
+                                acc[co] = std::max(acc[co], x[co]);
+                            } else {
+                                acc[co] += x[co];
+                            }
+                        }
+                    }
+                }
+
+                if constexpr (!Max) {
+                    for (size_t co = 0; co < c; ++co) {
+                        acc[co] /= T(P1 * P2);
+                    }
+                }
+
+                std::copy_n(acc, c, out + ((bc * NH1 + i) * NH2 + j) * c);
+            }
+        }
+    }
+}
+
+} //end of dll namespace
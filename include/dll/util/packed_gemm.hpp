@@ -0,0 +1,194 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file packed_gemm.hpp
+ * \brief Weights packed once in the internal panels of the GEMM
+ *
+ * A GEMM packs its operands in panels fitting the caches before computing
+ * the product. The weights of a dense layer are the same operand for every
+ * batch, until they are updated. With MKL, they are packed once for the
+ * forward product (X * W) and once for the backward product (E * W^T) and
+ * the packed panels are reused for all the batches of the same size.
+ * Without MKL, there is no packing interface and the standard products are
+ * used.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#ifdef ETL_MKL_MODE
+#include "mkl_cblas.h"
+#endif
+
+namespace dll {
+
+namespace detail {
+
+#ifdef ETL_MKL_MODE
+
+inline size_t gemm_pack_size(float /*type*/, size_t m, size_t n, size_t k) {
+    return cblas_sgemm_pack_get_size(CblasBMatrix, m, n, k);
+}
+
+inline size_t gemm_pack_size(double /*type*/, size_t m, size_t n, size_t k) {
+    return cblas_dgemm_pack_get_size(CblasBMatrix, m, n, k);
+}
+
+inline void gemm_pack(bool trans, size_t m, size_t n, size_t k, const float* b, size_t ldb, float* dest) {
+    cblas_sgemm_pack(CblasRowMajor, CblasBMatrix, trans ? CblasTrans : CblasNoTrans, m, n, k, 1.0f, b, ldb, dest);
+}
+
+inline void gemm_pack(bool trans, size_t m, size_t n, size_t k, const double* b, size_t ldb, double* dest) {
+    cblas_dgemm_pack(CblasRowMajor, CblasBMatrix, trans ? CblasTrans : CblasNoTrans, m, n, k, 1.0, b, ldb, dest);
+}
+
+inline void gemm_compute(size_t m, size_t n, size_t k, const float* a, const float* packed, float* c) {
+    cblas_sgemm_compute(CblasRowMajor, CblasNoTrans, CblasPacked, m, n, k, a, k, packed, n, 0.0f, c, n);
+}
+
+inline void gemm_compute(size_t m, size_t n, size_t k, const double* a, const double* packed, double* c) {
+    cblas_dgemm_compute(CblasRowMajor, CblasNoTrans, CblasPacked, m, n, k, a, k, packed, n, 0.0, c, n);
+}
+
+#endif //ETL_MKL_MODE
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the weights of the given type can be packed
+ */
+#ifdef ETL_MKL_MODE
+template <typename T>
+constexpr bool is_gemm_packable = std::is_same_v<T, float> || std::is_same_v<T, double>;
+#else
+template <typename T>
+constexpr bool is_gemm_packable = false;
+#endif
+
+/*!
+ * \brief The weights W [NV, NH] of a dense layer, packed for the forward
+ * product (X * W) and for the backward product (E * W^T).
+ *
+ * The panels are packed lazily, for a given number of rows of the other
+ * operand (the batch size), and they must be invalidated each time the
+ * weights are changed. The panels in use are shared, so that a concurrent
+ * inference packing them for another batch size does not release them.
+ */
+template <typename T>
+struct packed_gemm_weights {
+    /*!
+     * \brief Construct empty panels
+     */
+    packed_gemm_weights() = default;
+
+    /*!
+     * \brief Move the panels, the lock is not moved
+     */
+    packed_gemm_weights(packed_gemm_weights&& rhs) noexcept : forward(std::move(rhs.forward)), backward(std::move(rhs.backward)) {}
+
+    /*!
+     * \brief Move the panels, the lock is not moved
+     */
+    packed_gemm_weights& operator=(packed_gemm_weights&& rhs) noexcept {
+        forward  = std::move(rhs.forward);
+        backward = std::move(rhs.backward);
+
+        return *this;
+    }
+
+    /*!
+     * \brief Forget the packed panels, after a change of the weights
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+
+        forward  = {};
+        backward = {};
+    }
+
+#ifdef ETL_MKL_MODE
+    /*!
+     * \brief Compute C [M, NH] = A [M, NV] * W
+     * \param c The output
+     * \param a The input
+     * \param w The weights, that are packed if necessary
+     * \param M The number of rows of the input
+     */
+    template <typename W>
+    void forward_gemm(T* c, const T* a, const W& w, size_t M) const {
+        const size_t NV = etl::dim<0>(w);
+        const size_t NH = etl::dim<1>(w);
+
+        auto p = get_panels(forward, false, w, M, NH, NV);
+
+        detail::gemm_compute(M, NH, NV, a, p->memory_start(), c);
+    }
+
+    /*!
+     * \brief Compute C [M, NV] = A [M, NH] * W^T
+     * \param c The output
+     * \param a The input
+     * \param w The weights, that are packed if necessary
+     * \param M The number of rows of the input
+     */
+    template <typename W>
+    void backward_gemm(T* c, const T* a, const W& w, size_t M) const {
+        const size_t NV = etl::dim<0>(w);
+        const size_t NH = etl::dim<1>(w);
+
+        auto p = get_panels(backward, true, w, M, NV, NH);
+
+        detail::gemm_compute(M, NV, NH, a, p->memory_start(), c);
+    }
+#endif //ETL_MKL_MODE
+
+private:
+    /*!
+     * \brief A set of packed panels
+     */
+    struct panels {
+        std::shared_ptr<etl::dyn_vector<T>> values; ///< The packed panels
+        size_t m = 0;                               ///< The number of rows the panels are packed for
+    };
+
+#ifdef ETL_MKL_MODE
+    /*!
+     * \brief Returns the given panels of the weights, packed for m rows
+     */
+    template <typename W>
+    std::shared_ptr<etl::dyn_vector<T>> get_panels(panels& p, bool trans, const W& w, size_t m, size_t n, size_t k) const {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!p.values || p.m != m) {
+            w.ensure_cpu_up_to_date();
+
+            // MKL returns the size in bytes
+            const size_t bytes = detail::gemm_pack_size(T(), m, n, k);
+
+            p.values = std::make_shared<etl::dyn_vector<T>>((bytes + sizeof(T) - 1) / sizeof(T));
+            p.m      = m;
+
+            detail::gemm_pack(trans, m, n, k, w.memory_start(), etl::dim<1>(w), p.values->memory_start());
+        }
+
+        return p.values;
+    }
+#endif //ETL_MKL_MODE
+
+    mutable panels forward;  ///< The panels of W
+    mutable panels backward; ///< The panels of W^T
+    mutable std::mutex lock; ///< Lock for the lazy packing in concurrent inference
+};
+
+} //end of dll namespace
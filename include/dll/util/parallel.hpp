@@ -0,0 +1,207 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file parallel.hpp
+ * \brief Concurrent execution of independent branches (merge layers) and
+ * of the steps of recurrent stacks (wavefront)
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/scheduler.hpp"
+#include "dll/util/trace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The execution mode of the independent branches of merge layers and
+ * of the layers of recurrent stacks
+ */
+enum class branch_mode {
+    SERIAL,   ///< The branches are run one after another (default)
+    PARALLEL, ///< The branches are run concurrently, ETL is serial inside each branch
+    NESTED    ///< The branches are run concurrently, ETL can still parallelize inside each branch
+};
+
+namespace detail {
+
+/*!
+ * \brief Return a reference to the current branch mode
+ */
+inline branch_mode& branch_mode_impl(){
+    static branch_mode mode = branch_mode::SERIAL;
+    return mode;
+}
+
+/*!
+ * \brief Return a reference to the flag indicating if the current thread is
+ * already running a branch.
+ */
+inline bool& in_branch(){
+    thread_local bool flag = false;
+    return flag;
+}
+
+/*!
+ * \brief Run one branch on the current thread
+ * \param functor The branch functor
+ * \param i The index of the branch
+ */
+template <typename Functor>
+void run_branch(Functor& functor, size_t i){
+    in_branch() = true;
+
+    if (branch_mode_impl() == branch_mode::NESTED) {
+        functor(i);
+    } else {
+        SERIAL_SECTION {
+            functor(i);
+        }
+    }
+
+    in_branch() = false;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Return the execution mode of the branches of merge layers and of
+ * the recurrent stacks
+ */
+inline branch_mode get_branch_mode(){
+    return detail::branch_mode_impl();
+}
+
+/*!
+ * \brief Set the execution mode of the branches of merge layers and of the
+ * recurrent stacks
+ * \param mode The new mode
+ */
+inline void set_branch_mode(branch_mode mode){
+    detail::branch_mode_impl() = mode;
+}
+
+/*!
+ * \brief Run functor(i) for each branch i in [0, n).
+ *
+ * In parallel mode, the first branch is run by the calling thread and the
+ * others by the shared scheduler. Branches started from inside a branch (nested
+ * merge layers) are always run sequentially to avoid exhausting the pool.
+ *
+ * \param n The number of branches
+ * \param functor The functor to run for each branch
+ */
+template <typename Functor>
+void for_each_branch(size_t n, Functor&& functor){
+    if (n < 2 || get_branch_mode() == branch_mode::SERIAL || detail::in_branch()) {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+
+        return;
+    }
+
+    task_group group;
+
+    for (size_t i = 1; i < n; ++i) {
+        group.do_task([&functor, i] {
+            trace_scope scope("pool:task", "pool");
+
+            detail::run_branch(functor, i);
+        });
+    }
+
+    detail::run_branch(functor, 0);
+
+    group.wait();
+}
+
+/*!
+ * \brief Indicates if a wavefront of the given size would be run concurrently
+ * \param layers The number of layers
+ * \param steps The number of steps
+ */
+inline bool is_wavefront_parallel(size_t layers, size_t steps){
+    return layers > 1 && steps > 1 && get_branch_mode() != branch_mode::SERIAL && !detail::in_branch() && scheduler::instance().workers();
+}
+
+/*!
+ * \brief Run functor(l, t) for each layer l in [0, layers) and each step t
+ * in [0, steps) of a recurrent stack.
+ *
+ * The step t of the layer l depends on the step t - 1 of the same layer and
+ * on the step t of the layer l - 1. In parallel mode, each step is run as
+ * soon as its dependencies are done, so that the layers advance together as
+ * a wavefront on the shared scheduler. Otherwise, the layers are run one
+ * after another.
+ *
+ * \param layers The number of layers
+ * \param steps The number of steps
+ * \param functor The functor to run for each step of each layer
+ */
+template <typename Functor>
+void for_each_wavefront(size_t layers, size_t steps, Functor&& functor){
+    if (!is_wavefront_parallel(layers, steps)) {
+        for (size_t l = 0; l < layers; ++l) {
+            for (size_t t = 0; t < steps; ++t) {
+                functor(l, t);
+            }
+        }
+
+        return;
+    }
+
+    // The number of unfinished dependencies of each step
+    std::unique_ptr<std::atomic<size_t>[]> deps(new std::atomic<size_t>[layers * steps]);
+
+    for (size_t l = 0; l < layers; ++l) {
+        for (size_t t = 0; t < steps; ++t) {
+            deps[l * steps + t] = size_t(l > 0) + size_t(t > 0);
+        }
+    }
+
+    task_group group;
+
+    auto step = [&functor, steps](size_t i) {
+        functor(i / steps, i % steps);
+    };
+
+    // Declared before its definition to submit the successors
+    std::function<void(size_t)> submit;
+
+    submit = [&](size_t i) {
+        group.do_task([&, i] {
+            trace_scope scope("pool:task", "pool");
+
+            detail::run_branch(step, i);
+
+            const size_t l = i / steps;
+            const size_t t = i % steps;
+
+            if (t + 1 < steps && --deps[i + 1] == 0) {
+                submit(i + 1);
+            }
+
+            if (l + 1 < layers && --deps[i + steps] == 0) {
+                submit(i + steps);
+            }
+        });
+    };
+
+    submit(0);
+
+    group.wait();
+}
+
+} //end of dll namespace
@@ -0,0 +1,230 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file perf_counters.hpp
+ * \brief Hardware performance counters of the current thread
+ *
+ * When DLL_PERF_COUNTERS is defined, each thread opens a group of hardware
+ * counters with perf_event_open on its first timer: the cycles, the
+ * instructions, the last level cache misses and the vector floating point
+ * operations. The group is read, with a single system call, at the start
+ * and at the end of each auto_timer and the differences are added to the
+ * timer, in the shard of the thread.
+ *
+ * There is no portable event for the vector operations. By default, the
+ * FP_ARITH_INST_RETIRED packed events of Intel processors are used on
+ * x86-64; another raw event can be given, in hexadecimal, in the
+ * DLL_PERF_FP_EVENT environment variable. The events that cannot be opened
+ * (unsupported event, perf_event_paranoid, containers) are reported as
+ * unavailable, the others are still counted.
+ *
+ * Only the user space is counted, which is allowed with the default
+ * perf_event_paranoid of 2.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dll {
+
+constexpr size_t perf_events = 4; ///< The number of hardware counters
+
+/*!
+ * \brief The hardware counters
+ */
+enum class perf_event : size_t {
+    CYCLES       = 0, ///< The CPU cycles
+    INSTRUCTIONS = 1, ///< The retired instructions
+    LLC_MISSES   = 2, ///< The last level cache misses
+    VECTOR_FP    = 3  ///< The retired vector floating point instructions
+};
+
+/*!
+ * \brief A reading of the counters of the current thread
+ */
+struct perf_sample {
+    uint64_t values[perf_events] = {}; ///< The value of each counter
+    uint64_t enabled             = 0;  ///< The time the group was enabled
+    uint64_t running             = 0;  ///< The time the group was counting
+};
+
+/*!
+ * \brief The group of hardware counters of one thread
+ */
+struct perf_counters {
+    int fds[perf_events];       ///< The file descriptor of each counter, -1 if it is unavailable
+    size_t slots[perf_events];  ///< The position of each counter in the group
+    int leader = -1;            ///< The file descriptor of the leader of the group
+
+    /*!
+     * \brief Open the counters of the current thread
+     */
+    perf_counters() {
+        for (size_t e = 0; e < perf_events; ++e) {
+            fds[e] = -1;
+            slots[e] = perf_events;
+        }
+
+        size_t slot = 0;
+
+        for (size_t e = 0; e < perf_events; ++e) {
+            uint32_t type   = PERF_TYPE_HARDWARE;
+            uint64_t config = 0;
+
+            if (!event_config(perf_event(e), type, config)) {
+                continue;
+            }
+
+            perf_event_attr attr = {};
+
+            attr.size           = sizeof(attr);
+            attr.type           = type;
+            attr.config         = config;
+            attr.disabled       = leader < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+
+            if (fd < 0) {
+                continue;
+            }
+
+            if (leader < 0) {
+                leader = fd;
+            }
+
+            fds[e]   = fd;
+            slots[e] = slot++;
+        }
+
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    perf_counters(const perf_counters& rhs) = delete;
+    perf_counters& operator=(const perf_counters& rhs) = delete;
+
+    /*!
+     * \brief Close the counters
+     */
+    ~perf_counters() {
+        for (auto fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if the given counter is counted
+     */
+    bool available(perf_event event) const {
+        return fds[size_t(event)] >= 0;
+    }
+
+    /*!
+     * \brief Read all the counters
+     * \return true if the counters were read, false otherwise
+     */
+    bool read(perf_sample& sample) const {
+        if (leader < 0) {
+            return false;
+        }
+
+        // nr, time_enabled, time_running and the values of the group
+        uint64_t buffer[3 + perf_events];
+
+        if (::read(leader, buffer, sizeof(buffer)) < ssize_t(3 * sizeof(uint64_t))) {
+            return false;
+        }
+
+        sample.enabled = buffer[1];
+        sample.running = buffer[2];
+
+        for (size_t e = 0; e < perf_events; ++e) {
+            sample.values[e] = slots[e] < buffer[0] ? buffer[3 + slots[e]] : 0;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Compute the counts between two readings, scaled if the group was
+     * not always counting (multiplexing)
+     */
+    static void difference(const perf_sample& start, const perf_sample& end, uint64_t* counts) {
+        const uint64_t enabled = end.enabled - start.enabled;
+        const uint64_t running = end.running - start.running;
+
+        for (size_t e = 0; e < perf_events; ++e) {
+            const uint64_t count = end.values[e] - start.values[e];
+
+            counts[e] = running && running < enabled ? uint64_t(double(count) * enabled / running) : count;
+        }
+    }
+
+private:
+    /*!
+     * \brief Returns the type and the configuration of an event
+     * \return false if the event is not supported
+     */
+    static bool event_config(perf_event event, uint32_t& type, uint64_t& config) {
+        switch (event) {
+            case perf_event::CYCLES:
+                config = PERF_COUNT_HW_CPU_CYCLES;
+                return true;
+
+            case perf_event::INSTRUCTIONS:
+                config = PERF_COUNT_HW_INSTRUCTIONS;
+                return true;
+
+            case perf_event::LLC_MISSES:
+                config = PERF_COUNT_HW_CACHE_MISSES;
+                return true;
+
+            case perf_event::VECTOR_FP:
+                type = PERF_TYPE_RAW;
+
+                if (auto* raw = std::getenv("DLL_PERF_FP_EVENT")) {
+                    config = std::strtoull(raw, nullptr, 16);
+                    return config != 0;
+                }
+
+#ifdef __x86_64__
+                // FP_ARITH_INST_RETIRED: 128 and 256 bits, packed single and double
+                config = 0x3CC7;
+                return true;
+#else
+                return false;
+#endif
+        }
+
+        return false;
+    }
+};
+
+/*!
+ * \brief Get the counters of the current thread, opened on the first call
+ */
+inline perf_counters& local_perf_counters() {
+    static thread_local perf_counters counters;
+    return counters;
+}
+
+} //end of dll namespace
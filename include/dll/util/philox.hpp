@@ -0,0 +1,82 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file philox.hpp
+ * \brief Counter-based Philox4x32-10 random number generator
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace dll {
+
+/*!
+ * \brief Counter-based random number generator (Philox4x32-10).
+ *
+ * Philox computes a block of four random numbers from a counter and a key,
+ * without any state. Any range of random numbers can therefore be generated
+ * again from the same (key, counter), in any order and in parallel.
+ *
+ * Reference: Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3",
+ * SC 2011.
+ */
+struct philox4x32 {
+    using block_t = std::array<uint32_t, 4>; ///< A block of random numbers
+
+    static constexpr size_t block_size = 4; ///< The number of random numbers generated at once
+
+    /*!
+     * \brief Create a generator with the given key
+     * \param key The key (seed) of the generator
+     */
+    explicit philox4x32(uint64_t key) : k0(uint32_t(key)), k1(uint32_t(key >> 32)) {}
+
+    /*!
+     * \brief Compute the block of random numbers at the given counter
+     * \param counter The index of the block
+     * \return The four random numbers of the block
+     */
+    block_t operator()(uint64_t counter) const {
+        block_t c{{uint32_t(counter), uint32_t(counter >> 32), 0, 0}};
+
+        uint32_t key0 = k0;
+        uint32_t key1 = k1;
+
+        for (size_t r = 0; r < 10; ++r) {
+            const uint64_t p0 = uint64_t(M0) * c[0];
+            const uint64_t p1 = uint64_t(M1) * c[2];
+
+            c = {{uint32_t(p1 >> 32) ^ c[1] ^ key0, uint32_t(p1), uint32_t(p0 >> 32) ^ c[3] ^ key1, uint32_t(p0)}};
+
+            key0 += W0;
+            key1 += W1;
+        }
+
+        return c;
+    }
+
+    /*!
+     * \brief Convert a random number into a float uniformly distributed in [0, 1)
+     */
+    static float uniform(uint32_t x) {
+        return float(x >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    static constexpr uint32_t M0 = 0xD2511F53; ///< The first multiplier
+    static constexpr uint32_t M1 = 0xCD9E8D57; ///< The second multiplier
+    static constexpr uint32_t W0 = 0x9E3779B9; ///< The first Weyl constant
+    static constexpr uint32_t W1 = 0xBB67AE85; ///< The second Weyl constant
+
+    uint32_t k0; ///< The low part of the key
+    uint32_t k1; ///< The high part of the key
+};
+
+} //end of dll namespace
@@ -0,0 +1,150 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file pipeline_schedule.hpp
+ * \brief One-forward-one-backward (1F1B) schedule of pipeline parallelism
+ *
+ * The layers of the network are split into stages and each mini-batch into
+ * micro-batches. A stage runs its operations (the forward or the backward
+ * pass of its layers on one micro-batch) one at a time, in the 1F1B order:
+ * after a warmup of forward passes filling the stages after it, it
+ * alternates one forward and one backward pass, so that at most S - s
+ * micro-batches are in flight in the stage s.
+ *
+ * The forward pass of a micro-batch in a stage depends on its forward pass
+ * in the previous stage and its backward pass depends on its backward pass
+ * in the next stage. Each operation is submitted to the thread pool once its
+ * dependencies are done, no task ever blocks on another one.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief An operation of a stage of the pipeline
+ */
+struct pipeline_op {
+    bool forward;       ///< true for the forward pass, false for the backward pass
+    size_t micro_batch; ///< The micro-batch
+};
+
+/*!
+ * \brief Returns the operations of a stage in the 1F1B order
+ * \param stages The number of stages
+ * \param micro_batches The number of micro-batches
+ * \param s The stage
+ * \return the ordered operations of the stage
+ */
+inline std::vector<pipeline_op> pipeline_1f1b_order(size_t stages, size_t micro_batches, size_t s) {
+    const size_t warmup = std::min(stages - s - 1, micro_batches);
+
+    std::vector<pipeline_op> ops;
+    ops.reserve(2 * micro_batches);
+
+    for (size_t m = 0; m < warmup; ++m) {
+        ops.push_back({true, m});
+    }
+
+    for (size_t m = 0; m + warmup < micro_batches; ++m) {
+        ops.push_back({true, m + warmup});
+        ops.push_back({false, m});
+    }
+
+    for (size_t m = micro_batches - warmup; m < micro_batches; ++m) {
+        ops.push_back({false, m});
+    }
+
+    return ops;
+}
+
+/*!
+ * \brief Run the forward and backward passes of all the micro-batches
+ * through all the stages with the 1F1B schedule, on the given pool.
+ *
+ * \param pool The thread pool (do_task and wait)
+ * \param stages The number of stages
+ * \param micro_batches The number of micro-batches
+ * \param forward The forward pass of a stage on a micro-batch (s, m)
+ * \param backward The backward pass of a stage on a micro-batch (s, m)
+ */
+template <typename Pool, typename Forward, typename Backward>
+void run_pipeline_1f1b(Pool& pool, size_t stages, size_t micro_batches, Forward&& forward, Backward&& backward) {
+    if (!stages || !micro_batches) {
+        return;
+    }
+
+    const size_t ops = 2 * micro_batches;
+
+    std::vector<std::vector<pipeline_op>> order(stages);
+    std::vector<size_t> position(stages * ops); // [s][forward ? m : M + m]
+
+    for (size_t s = 0; s < stages; ++s) {
+        order[s] = pipeline_1f1b_order(stages, micro_batches, s);
+
+        for (size_t k = 0; k < ops; ++k) {
+            auto& op = order[s][k];
+
+            position[s * ops + (op.forward ? 0 : micro_batches) + op.micro_batch] = k;
+        }
+    }
+
+    // The number of unfinished dependencies of each operation
+
+    std::unique_ptr<std::atomic<size_t>[]> deps(new std::atomic<size_t>[stages * ops]);
+
+    for (size_t s = 0; s < stages; ++s) {
+        for (size_t k = 0; k < ops; ++k) {
+            const bool cross = order[s][k].forward ? s > 0 : s + 1 < stages;
+
+            deps[s * ops + k] = (k > 0 ? 1 : 0) + (cross ? 1 : 0);
+        }
+    }
+
+    std::function<void(size_t, size_t)> run;
+
+    auto release = [&](size_t s, size_t k) {
+        if (--deps[s * ops + k] == 0) {
+            pool.do_task([&run, s, k] { run(s, k); });
+        }
+    };
+
+    run = [&](size_t s, size_t k) {
+        const auto op = order[s][k];
+
+        if (op.forward) {
+            forward(s, op.micro_batch);
+        } else {
+            backward(s, op.micro_batch);
+        }
+
+        if (k + 1 < ops) {
+            release(s, k + 1);
+        }
+
+        if (op.forward && s + 1 < stages) {
+            release(s + 1, position[(s + 1) * ops + op.micro_batch]);
+        } else if (!op.forward && s > 0) {
+            release(s - 1, position[(s - 1) * ops + micro_batches + op.micro_batch]);
+        }
+    };
+
+    // Only the first forward pass of the first stage has no dependency
+    pool.do_task([&run] { run(0, 0); });
+
+    pool.wait();
+}
+
+} //end of dll namespace
@@ -0,0 +1,184 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file placement.hpp
+ * \brief Placement of the large buffers in memory (NUMA nodes and huge
+ * pages)
+ *
+ * By default, a page is allocated on the NUMA node of the thread that
+ * touches it first. For the caches of the generators, this is the thread
+ * constructing the generator, while the batches are then read by all the
+ * workers. The DLL_NUMA environment variable changes the placement of
+ * these buffers:
+ *
+ *  - "interleave": the pages are interleaved over all the nodes
+ *  - "local": the pages are placed on the node of the constructing thread
+ *
+ * The buffers are also advised to use transparent huge pages, which
+ * reduces the TLB misses when gathering shuffled samples. This is
+ * disabled by setting DLL_HUGE_PAGES to 0.
+ *
+ * All of this is only done on Linux and silently ignored elsewhere or if
+ * the kernel refuses it.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "etl/etl_light.hpp"
+
+namespace dll {
+
+namespace placement {
+
+/*!
+ * \brief The NUMA policy of the large buffers
+ */
+enum class numa_policy {
+    DEFAULT,    ///< First-touch placement
+    INTERLEAVE, ///< Interleaved over all the nodes
+    LOCAL       ///< On the node of the allocating thread
+};
+
+static constexpr size_t huge_page_size = 2 * 1024 * 1024; ///< The size of a huge page
+
+/*!
+ * \brief Returns the NUMA policy of the large buffers
+ */
+inline numa_policy& numa() {
+    static numa_policy policy = [] {
+        const auto* env = std::getenv("DLL_NUMA");
+        const std::string value(env ? env : "");
+
+        if (value == "interleave") {
+            return numa_policy::INTERLEAVE;
+        } else if (value == "local") {
+            return numa_policy::LOCAL;
+        }
+
+        return numa_policy::DEFAULT;
+    }();
+
+    return policy;
+}
+
+/*!
+ * \brief Indicates if the large buffers use transparent huge pages
+ */
+inline bool& huge_pages() {
+    static bool enabled = [] {
+        const auto* env = std::getenv("DLL_HUGE_PAGES");
+        return !env || std::string(env) != "0";
+    }();
+
+    return enabled;
+}
+
+/*!
+ * \brief Returns the mask of the online NUMA nodes (at most 64 nodes)
+ */
+inline uint64_t online_nodes() {
+    static uint64_t mask = [] {
+        uint64_t nodes = 0;
+
+        // The format is a list of ranges, for instance "0-1,3"
+        std::ifstream stream("/sys/devices/system/node/online");
+        std::string range;
+
+        while (std::getline(stream, range, ',')) {
+            auto sep   = range.find('-');
+            size_t low = std::strtoul(range.c_str(), nullptr, 10);
+            size_t up  = sep == std::string::npos ? low : std::strtoul(range.c_str() + sep + 1, nullptr, 10);
+
+            for (size_t n = low; n <= up && n < 64; ++n) {
+                nodes |= uint64_t(1) << n;
+            }
+        }
+
+        return nodes;
+    }();
+
+    return mask;
+}
+
+/*!
+ * \brief Place the given memory according to the current policies.
+ *
+ * Only the pages fully inside the buffer are affected.
+ *
+ * \param memory The start of the buffer
+ * \param bytes The size of the buffer, in bytes
+ */
+inline void place(void* memory, size_t bytes) {
+#ifdef __linux__
+    const auto start = reinterpret_cast<uintptr_t>(memory);
+    const auto end   = start + bytes;
+
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages
+    if (huge_pages()) {
+        const uintptr_t first = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+        const uintptr_t last  = end & ~(huge_page_size - 1);
+
+        if (first < last) {
+            ::madvise(reinterpret_cast<void*>(first), last - first, MADV_HUGEPAGE);
+        }
+    }
+#endif
+
+    // NUMA placement, through the system call to avoid depending on libnuma
+    if (numa() != numa_policy::DEFAULT) {
+        const uint64_t nodes = online_nodes();
+
+        // Nothing to do on a single node
+        if (nodes & (nodes - 1)) {
+            static constexpr int mpol_interleave = 3;      ///< MPOL_INTERLEAVE
+            static constexpr int mpol_local      = 4;      ///< MPOL_LOCAL
+            static constexpr unsigned mpol_move  = 1 << 1; ///< MPOL_MF_MOVE
+
+            const uintptr_t page  = ::sysconf(_SC_PAGESIZE);
+            const uintptr_t first = (start + page - 1) & ~(page - 1);
+            const uintptr_t last  = end & ~(page - 1);
+
+            if (first < last) {
+                if (numa() == numa_policy::INTERLEAVE) {
+                    ::syscall(SYS_mbind, first, last - first, mpol_interleave, &nodes, 65, mpol_move);
+                } else {
+                    ::syscall(SYS_mbind, first, last - first, mpol_local, nullptr, 0, mpol_move);
+                }
+            }
+        }
+    }
+#else
+    cpp_unused(memory);
+    cpp_unused(bytes);
+#endif
+}
+
+/*!
+ * \brief Place the memory of the given tensor according to the current
+ * policies.
+ */
+template <typename E>
+void place(E& tensor) {
+    place(tensor.memory_start(), etl::size(tensor) * sizeof(etl::value_t<E>));
+}
+
+} // end of namespace placement
+
+} //end of dll namespace
@@ -0,0 +1,158 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file precision.hpp
+ * \brief Conversions between the weights and reduced precision formats
+ *
+ * The IEEE half precision (fp16) and brain floating point (bf16) values are
+ * stored as 16 bits integers. The narrowing conversions round to the
+ * nearest even value.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace dll {
+
+/*!
+ * \brief Convert a float to half precision
+ */
+inline uint16_t float_to_half(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+
+    const uint32_t sign = (x >> 16) & 0x8000;
+
+    x &= 0x7FFFFFFF;
+
+    // Infinity and NaN (kept quiet)
+    if (x >= 0x7F800000) {
+        return sign | 0x7C00 | (x > 0x7F800000 ? 0x200 : 0);
+    }
+
+    // Too large, rounded to infinity
+    if (x >= 0x477FF000) {
+        return sign | 0x7C00;
+    }
+
+    // Subnormal values (units of 2^-24)
+    if (x < 0x38800000) {
+        if (x < 0x33000000) {
+            return sign;
+        }
+
+        const uint32_t m     = (x & 0x7FFFFF) | 0x800000;
+        const uint32_t shift = 126 - (x >> 23);
+        const uint32_t rem   = m & ((1u << shift) - 1);
+        const uint32_t tie   = 1u << (shift - 1);
+
+        uint32_t h = m >> shift;
+
+        if (rem > tie || (rem == tie && (h & 1))) {
+            ++h;
+        }
+
+        return sign | h;
+    }
+
+    uint32_t h = (x >> 13) - (112 << 10);
+
+    const uint32_t rem = x & 0x1FFF;
+
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+        ++h;
+    }
+
+    return sign | h;
+}
+
+/*!
+ * \brief Convert a half precision value to float
+ */
+inline float half_to_float(uint16_t h) {
+    const uint32_t sign = uint32_t(h & 0x8000) << 16;
+
+    uint32_t e = (h >> 10) & 0x1F;
+    uint32_t m = h & 0x3FF;
+    uint32_t x;
+
+    if (e == 0x1F) {
+        x = sign | 0x7F800000 | (m << 13);
+    } else if (e) {
+        x = sign | ((e + 112) << 23) | (m << 13);
+    } else if (!m) {
+        x = sign;
+    } else {
+        // Subnormal values are normalized
+        e = 113;
+
+        while (!(m & 0x400)) {
+            m <<= 1;
+            --e;
+        }
+
+        x = sign | (e << 23) | ((m & 0x3FF) << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+/*!
+ * \brief Convert a float to bf16
+ */
+inline uint16_t float_to_bf16(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+
+    // NaN are kept quiet, not rounded to infinity
+    if ((x & 0x7FFFFFFF) > 0x7F800000) {
+        return (x >> 16) | 0x40;
+    }
+
+    return (x + 0x7FFF + ((x >> 16) & 1)) >> 16;
+}
+
+/*!
+ * \brief Convert a bf16 value to float
+ */
+inline float bf16_to_float(uint16_t b) {
+    const uint32_t x = uint32_t(b) << 16;
+
+    float value;
+    std::memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+/*!
+ * \brief Returns the symmetric INT8 scale of the given n values
+ */
+template <typename T>
+float int8_scale(const T* values, size_t n) {
+    float max = 0.0f;
+
+    for (size_t i = 0; i < n; ++i) {
+        max = std::max(max, float(std::abs(values[i])));
+    }
+
+    return max > 0.0f ? max / 127.0f : 1.0f;
+}
+
+/*!
+ * \brief Quantize a value to INT8 with the given scale
+ */
+inline int8_t float_to_int8(float value, float scale) {
+    return int8_t(std::min(127.0f, std::max(-127.0f, std::nearbyint(value / scale))));
+}
+
+} //end of dll namespace
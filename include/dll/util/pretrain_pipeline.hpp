@@ -0,0 +1,138 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file pretrain_pipeline.hpp
+ * \brief Greedy layer-wise pretraining of a stack of RBMs, pipelined
+ * across the layers
+ *
+ * Each layer of the stack starts training after the first epochs of the
+ * previous layer, on the activations of the current weights of the
+ * previous layer. The layers then train concurrently, one epoch per
+ * round, their inputs being recomputed between the rounds from snapshots
+ * of the weights of the previous layers. Finally, each layer is refined
+ * for one epoch on the activations of the final weights of the previous
+ * layer, from the first to the last.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/util/scheduler.hpp" // For task_group
+
+namespace dll {
+
+/*!
+ * \brief One layer of a pipelined pretraining.
+ *
+ * The layer and its inputs are hidden behind functors, the layers of the
+ * stack having different types.
+ */
+struct pretrain_stage {
+    std::function<void()> begin;             ///< Start the training of the layer
+    std::function<void(size_t epoch)> epoch; ///< Train the layer for one epoch on its current inputs
+    std::function<void()> end;               ///< Finish the training of the layer
+    std::function<void()> forward;           ///< Compute the inputs of the next layer from the current weights (none for the last layer)
+};
+
+/*!
+ * \brief Pretrain a stack of layers in a pipeline
+ *
+ * \param stages The layers, from the first to the last
+ * \param max_epochs The number of epochs of each layer (at least 2)
+ * \param warmup The number of epochs of a layer before the next layer starts
+ * \param refresh The number of epochs between two refreshes of the inputs of a layer
+ */
+inline void pipelined_pretrain(std::vector<pretrain_stage>& stages, size_t max_epochs, size_t warmup, size_t refresh) {
+    cpp_assert(max_epochs > 1, "The pipelined pretraining needs at least two epochs");
+
+    warmup  = std::max(warmup, size_t(1));
+    refresh = std::max(refresh, size_t(1));
+
+    const size_t n = stages.size();
+
+    // The last epoch of each layer is the synchronous refinement
+    const size_t pipelined = max_epochs - 1;
+    const size_t rounds    = (n - 1) * warmup + pipelined;
+
+    std::vector<size_t> epochs(n, 0);  // The number of epochs of each layer
+    std::vector<bool> stale(n, false); // Indicates if the inputs of a layer are older than the previous layer
+    std::vector<size_t> active;
+
+    for (size_t round = 0; round < rounds; ++round) {
+        active.clear();
+
+        // Take a consistent snapshot of the inputs, from the first layer
+
+        for (size_t s = 0; s < n && round >= s * warmup; ++s) {
+            const size_t start = s * warmup;
+
+            if (s > 0 && (round == start || (stale[s] && (round - start) % refresh == 0))) {
+                stages[s - 1].forward();
+
+                stale[s] = false;
+
+                if (s + 1 < n) {
+                    stale[s + 1] = true;
+                }
+            }
+
+            if (round == start) {
+                stages[s].begin();
+            }
+
+            if (epochs[s] < pipelined) {
+                active.push_back(s);
+            }
+        }
+
+        // Train the started layers concurrently, for one epoch
+
+        if (active.size() == 1) {
+            stages[active.front()].epoch(epochs[active.front()]);
+        } else {
+            task_group tasks;
+
+            for (auto s : active) {
+                tasks.do_task([&stages, &epochs, s] {
+                    // ETL must not parallelize inside the workers
+                    SERIAL_SECTION {
+                        stages[s].epoch(epochs[s]);
+                    }
+                });
+            }
+
+            tasks.wait();
+        }
+
+        for (auto s : active) {
+            ++epochs[s];
+
+            if (s + 1 < n) {
+                stale[s + 1] = true;
+            }
+        }
+    }
+
+    // Refine each layer on the inputs of the final weights of the previous one
+
+    for (size_t s = 0; s < n; ++s) {
+        if (s > 0) {
+            stages[s - 1].forward();
+        }
+
+        stages[s].epoch(pipelined);
+        stages[s].end();
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,310 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file quantize.hpp
+ * \brief Post-training INT8 quantization of the dense and convolutional layers
+ *
+ * The inputs of a layer are quantized with a single symmetric scale,
+ * calibrated on a set of samples, and the weights with one symmetric scale
+ * per output (neuron or filter). The products are accumulated in 32 bits
+ * integers and converted back to floating point once per output.
+ *
+ * The dot products are written so that the compiler can vectorize them
+ * with widening multiply-add instructions (pmaddwd with AVX2, vpdpbssd
+ * with AVX-VNNI-INT8).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/isa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The INT8 quantization state of a layer
+ */
+struct int8_quantization {
+    float input_max   = 0.0f;    ///< The maximum absolute value of the calibration inputs
+    float input_scale = 0.0f;    ///< The scale of the quantized inputs
+    std::vector<int8_t> weights; ///< The quantized weights (outputs x inputs)
+    std::vector<float> scales;   ///< The dequantization scale of each output
+    bool ready = false;          ///< Indicates if the quantized weights are ready
+
+    /*!
+     * \brief Update the calibration with the given batch of inputs
+     */
+    template <typename Input>
+    void calibrate(const Input& input) {
+        input_max = std::max(input_max, float(etl::max(etl::abs(input))));
+    }
+
+    /*!
+     * \brief Quantize the given weights with the current calibration.
+     *
+     * \param w The weights
+     * \param outputs The number of outputs
+     * \param inputs The number of inputs of each output
+     * \param transposed true if w is stored (inputs x outputs), false if (outputs x inputs)
+     *
+     * \return true if the weights were quantized, false if there was no calibration
+     */
+    template <typename W>
+    bool quantize(const W& w, size_t outputs, size_t inputs, bool transposed) {
+        ready = false;
+
+        if (input_max <= 0.0f) {
+            return false;
+        }
+
+        w.ensure_cpu_up_to_date();
+
+        const auto* raw = w.memory_start();
+
+        auto at = [&](size_t o, size_t i) {
+            return float(transposed ? raw[i * outputs + o] : raw[o * inputs + i]);
+        };
+
+        input_scale = input_max / 127.0f;
+
+        weights.resize(outputs * inputs);
+        scales.resize(outputs);
+
+        for (size_t o = 0; o < outputs; ++o) {
+            float w_max = 0.0f;
+
+            for (size_t i = 0; i < inputs; ++i) {
+                w_max = std::max(w_max, std::abs(at(o, i)));
+            }
+
+            const float w_scale = w_max > 0.0f ? w_max / 127.0f : 1.0f;
+
+            for (size_t i = 0; i < inputs; ++i) {
+                weights[o * inputs + i] = quantize_one(at(o, i), 1.0f / w_scale);
+            }
+
+            scales[o] = w_scale * input_scale;
+        }
+
+        ready = true;
+
+        return true;
+    }
+
+    /*!
+     * \brief Forget the calibration and the quantized weights
+     */
+    void clear() {
+        input_max   = 0.0f;
+        input_scale = 0.0f;
+        ready       = false;
+
+        weights.clear();
+        weights.shrink_to_fit();
+        scales.clear();
+        scales.shrink_to_fit();
+    }
+
+    /*!
+     * \brief Quantize one value to INT8 (rounded and saturated to [-127, 127])
+     * \param x The value to quantize
+     * \param inv_scale The inverse of the quantization scale
+     */
+    static int8_t quantize_one(float x, float inv_scale) {
+        return int8_t(std::min(127.0f, std::max(-127.0f, std::nearbyint(x * inv_scale))));
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer can be quantized
+ */
+template <typename L, typename Enable = void>
+struct is_quantizable_impl : std::false_type {};
+
+/*!
+ * \copydoc is_quantizable_impl
+ */
+template <typename L>
+struct is_quantizable_impl<L, std::void_t<decltype(std::declval<L&>().quantization)>> : std::true_type {};
+
+/*!
+ * \brief Quantize n values to INT8 on raw memory
+ */
+template <typename T>
+void int8_quantize(int8_t* out, const T* in, size_t n, float inv_scale) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = int8_quantization::quantize_one(float(in[i]), inv_scale);
+    }
+}
+
+/*!
+ * \brief Compute the dot product of two INT8 vectors with 32 bits accumulation
+ */
+inline int32_t int8_dot(const int8_t* a, const int8_t* b, size_t n) {
+    int32_t acc = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        acc += int32_t(a[i]) * int32_t(b[i]);
+    }
+
+    return acc;
+}
+
+/*!
+ * \brief Compute the INT8 dense forward pass on raw memory, without biases
+ * \param out The output [B, N]
+ * \param in The input [B, K]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void int8_dense_forward(T* out, const T* in, const int8_quantization& q, size_t B, size_t K, size_t N) {
+    std::vector<int8_t> in_q(B * K);
+
+    int8_quantize(in_q.data(), in, B * K, 1.0f / q.input_scale);
+
+    // Each row of weights is reused for the complete batch
+    for (size_t o = 0; o < N; ++o) {
+        const int8_t* w_row = q.weights.data() + o * K;
+
+        for (size_t b = 0; b < B; ++b) {
+            out[b * N + o] = T(float(int8_dot(in_q.data() + b * K, w_row, K)) * q.scales[o]);
+        }
+    }
+}
+
+/*!
+ * \brief Compute the INT8 convolution forward pass on raw memory, without
+ * biases.
+ *
+ * The patches of each sample are unrolled (im2col) into INT8 rows so that
+ * each output is a single contiguous dot product.
+ *
+ * \param out The output [B, K, NH1, NH2]
+ * \param in The input [B, NC, NV1, NV2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void int8_conv_forward(T* out, const T* in, const int8_quantization& q, const grouped_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+    const size_t P   = d.NC * d.NW1 * d.NW2;
+
+    const size_t in_size = d.NC * d.NV1 * d.NV2;
+
+    std::vector<int8_t> in_q(in_size);
+    std::vector<int8_t> cols(NH1 * NH2 * P);
+
+    for (size_t b = 0; b < d.B; ++b) {
+        int8_quantize(in_q.data(), in + b * in_size, in_size, 1.0f / q.input_scale);
+
+        // Zero is exact in symmetric quantization, so the padding is free
+        std::fill(cols.begin(), cols.end(), int8_t(0));
+
+        for (size_t i = 0; i < NH1; ++i) {
+            for (size_t j = 0; j < NH2; ++j) {
+                int8_t* col = cols.data() + (i * NH2 + j) * P;
+
+                for (size_t c = 0; c < d.NC; ++c) {
+                    for (size_t p = 0; p < d.NW1; ++p) {
+                        const std::ptrdiff_t r = std::ptrdiff_t(i * d.S1 + p * d.D1) - std::ptrdiff_t(d.P1);
+
+                        if (r < 0 || r >= std::ptrdiff_t(d.NV1)) {
+                            continue;
+                        }
+
+                        for (size_t qq = 0; qq < d.NW2; ++qq) {
+                            const std::ptrdiff_t s = std::ptrdiff_t(j * d.S2 + qq * d.D2) - std::ptrdiff_t(d.P2);
+
+                            if (s >= 0 && s < std::ptrdiff_t(d.NV2)) {
+                                col[(c * d.NW1 + p) * d.NW2 + qq] = in_q[(c * d.NV1 + size_t(r)) * d.NV2 + size_t(s)];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        for (size_t k = 0; k < d.K; ++k) {
+            const int8_t* w_row = q.weights.data() + k * P;
+            T* o_map            = out + (b * d.K + k) * NH1 * NH2;
+
+            for (size_t ij = 0; ij < NH1 * NH2; ++ij) {
+                o_map[ij] = T(float(int8_dot(cols.data() + ij * P, w_row, P)) * q.scales[k]);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Run the given kernel on the memory of the given output and input.
+ *
+ * Expressions without direct memory access are first evaluated into
+ * temporaries. The output is written back if necessary.
+ */
+template <typename Kernel, typename O, typename I>
+void int8_apply(Kernel&& kernel, O&& out, const I& in) {
+    if constexpr (!etl::is_dma<I>) {
+        auto in_t = etl::force_temporary(in);
+        int8_apply(kernel, out, in_t);
+    } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+        auto out_t = etl::force_temporary(out);
+        int8_apply(kernel, out_t, in);
+        out = out_t;
+    } else {
+        in.ensure_cpu_up_to_date();
+
+        kernel(out.memory_start(), in.memory_start());
+
+        out.invalidate_gpu();
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can be quantized to INT8
+ */
+template <typename L>
+constexpr bool is_quantizable = detail::is_quantizable_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Compute the INT8 forward pass of a dense layer, without biases
+ * \param output The output [B, N]
+ * \param input The input [B, K] (or any view of the same size)
+ * \param q The quantization of the layer
+ * \param K The number of inputs
+ * \param N The number of outputs
+ */
+template <typename O, typename I>
+void int8_dense_forward(O&& output, const I& input, const int8_quantization& q, size_t K, size_t N) {
+    const size_t B = etl::dim<0>(input);
+
+    detail::int8_apply([&](auto* o, const auto* x) { detail::int8_dense_forward(o, x, q, B, K, N); }, output, input);
+}
+
+/*!
+ * \brief Compute the INT8 forward pass of a convolutional layer, without biases
+ * \param output The output [B, K, NH1, NH2]
+ * \param input The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param q The quantization of the layer
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename I>
+void int8_conv_forward(O&& output, const I& input, const int8_quantization& q, const detail::grouped_conv_dims& d) {
+    detail::int8_apply([&](auto* o, const auto* x) { detail::int8_conv_forward(o, x, q, d); }, output, input);
+}
+
+} //end of dll namespace
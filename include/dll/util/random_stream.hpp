@@ -0,0 +1,358 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file random_stream.hpp
+ * \brief Deterministic counter-based random streams
+ *
+ * All the streams are derived from the seed of DLL (dll::seed()) and from
+ * an identifier, without sharing any state, which makes them safe to use
+ * from several threads and contention-free:
+ *
+ *  - Each object that draws random numbers (layer, generator, ...) takes
+ *    the key of a new stream with next_stream_key(). The keys are given in
+ *    creation order, so a network creates the same streams for the same
+ *    seed.
+ *  - Each thread has its own stream with thread_stream(), the threads
+ *    being numbered in the order of their first draw.
+ *
+ * The fill functions compute the number of an element from its index in
+ * the stream only. The result does not depend on how the elements are
+ * split between threads, and the inner loops are vectorizable. The
+ * parallel fills split large tensors into chunks filled concurrently on
+ * the scheduler, with the same numbers as a serial fill.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/philox.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/scheduler.hpp" // For task_group
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Mix the bits of the given value (finalizer of splitmix64)
+ */
+inline uint64_t counter_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Return the key of the stream with the given identifier
+ */
+inline uint64_t stream_key(uint64_t id) {
+    return detail::counter_mix(uint64_t(dll::seed()) ^ detail::counter_mix(id));
+}
+
+/*!
+ * \brief Return the key of a new stream
+ */
+inline uint64_t next_stream_key() {
+    static std::atomic<uint64_t> streams(0);
+
+    return stream_key(++streams);
+}
+
+/*!
+ * \brief A counter-based random stream.
+ *
+ * This is a standard uniform random bit generator, usable with the
+ * standard distributions and algorithms. The position in the stream can
+ * be reserved and set, to draw the same numbers again.
+ */
+struct random_stream {
+    using result_type = uint32_t; ///< The type of the generated numbers
+
+    philox4x32 generator; ///< The counter-based generator
+
+    /*!
+     * \brief Create a stream with the given key
+     * \param key The key of the stream
+     * \param block The first block of the stream
+     */
+    explicit random_stream(uint64_t key, uint64_t block = 0) : generator(key), block(block) {}
+
+    /*!
+     * \brief Create a new stream, see next_stream_key()
+     */
+    random_stream() : random_stream(next_stream_key()) {}
+
+    /*!
+     * \brief Returns the smallest generated number
+     */
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the largest generated number
+     */
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    /*!
+     * \brief Returns the next random number of the stream
+     */
+    result_type operator()() {
+        if (position == philox4x32::block_size) {
+            values   = generator(block++);
+            position = 0;
+        }
+
+        return values[position++];
+    }
+
+    /*!
+     * \brief Reserve the blocks for n random numbers, for a fill
+     * \return The first reserved block
+     */
+    uint64_t reserve(size_t n) {
+        const uint64_t first = block;
+
+        block += (n + philox4x32::block_size - 1) / philox4x32::block_size;
+        position = philox4x32::block_size;
+
+        return first;
+    }
+
+    /*!
+     * \brief Move to the given block of the stream
+     */
+    void seek(uint64_t new_block) {
+        block    = new_block;
+        position = philox4x32::block_size;
+    }
+
+private:
+    uint64_t block;                           ///< The next block
+    philox4x32::block_t values{};             ///< The current block
+    size_t position = philox4x32::block_size; ///< The position in the current block
+};
+
+/*!
+ * \brief Returns the random stream of the current thread
+ */
+inline random_stream& thread_stream() {
+    static std::atomic<uint64_t> threads(0);
+
+    // The thread streams are far from the object streams
+    thread_local random_stream stream(stream_key((uint64_t(1) << 63) + threads++));
+
+    return stream;
+}
+
+namespace detail {
+
+/*!
+ * \brief Apply functor(x, u) to each of the n first elements of x, with
+ * u the uniform [0, 1) number of the element, starting at the given block
+ * of the generator.
+ *
+ * The numbers are generated by tiles to keep the loops vectorizable.
+ */
+template <typename T, typename Functor>
+void for_each_uniform(T* x, size_t n, const philox4x32& generator, uint64_t block, Functor&& functor) {
+    static constexpr size_t tile = 64; ///< The number of values generated at once
+
+    float u[tile];
+
+    for (size_t i = 0; i < n; i += tile) {
+        const size_t end = std::min(n - i, tile);
+
+        for (size_t j = 0; j < end; j += philox4x32::block_size) {
+            auto values = generator(block + (i + j) / philox4x32::block_size);
+
+            for (size_t k = 0; k < philox4x32::block_size; ++k) {
+                u[j + k] = philox4x32::uniform(values[k]);
+            }
+        }
+
+        for (size_t j = 0; j < end; ++j) {
+            functor(x[i + j], u[j]);
+        }
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Fill the given memory with uniform numbers in [a, b)
+ * \param x The memory to fill
+ * \param n The number of elements
+ * \param stream The random stream
+ * \param a The lower bound
+ * \param b The upper bound
+ */
+template <typename T>
+void uniform_fill(T* x, size_t n, random_stream& stream, T a = T(0), T b = T(1)) {
+    const T scale = b - a;
+
+    detail::for_each_uniform(x, n, stream.generator, stream.reserve(n), [a, scale](T& v, float u) { v = a + T(u) * scale; });
+}
+
+/*!
+ * \brief Fill the given memory with normal numbers
+ * \param x The memory to fill
+ * \param n The number of elements
+ * \param stream The random stream
+ * \param mean The mean of the distribution
+ * \param stddev The standard deviation of the distribution
+ */
+template <typename T>
+void normal_fill(T* x, size_t n, random_stream& stream, T mean = T(0), T stddev = T(1)) {
+    static constexpr size_t tile = 64; ///< The number of values generated at once
+
+    const uint64_t first = stream.reserve(n);
+
+    T r[tile / 2];
+    T theta[tile / 2];
+    T z[tile];
+
+    for (size_t i = 0; i < n; i += tile) {
+        const size_t end = std::min(n - i, tile);
+
+        // Box-Muller, two normal values from two uniform values
+        for (size_t j = 0; j < end; j += philox4x32::block_size) {
+            auto values = stream.generator(first + (i + j) / philox4x32::block_size);
+
+            for (size_t k = 0; k < philox4x32::block_size; k += 2) {
+                r[(j + k) / 2]     = T(1) - T(philox4x32::uniform(values[k]));
+                theta[(j + k) / 2] = T(2.0 * M_PI) * T(philox4x32::uniform(values[k + 1]));
+            }
+        }
+
+        const size_t pairs = (end + 1) / 2;
+
+        for (size_t k = 0; k < pairs; ++k) {
+            r[k] = stddev * std::sqrt(T(-2) * std::log(r[k]));
+        }
+
+        for (size_t k = 0; k < pairs; ++k) {
+            z[2 * k]     = mean + r[k] * std::cos(theta[k]);
+            z[2 * k + 1] = mean + r[k] * std::sin(theta[k]);
+        }
+
+        std::copy_n(z, end, x + i);
+    }
+}
+
+/*!
+ * \brief Fill the given memory with Bernoulli samples (1 with probability p)
+ * \param x The memory to fill
+ * \param n The number of elements
+ * \param stream The random stream
+ * \param p The probability of 1
+ */
+template <typename T>
+void bernoulli_fill(T* x, size_t n, random_stream& stream, float p) {
+    detail::for_each_uniform(x, n, stream.generator, stream.reserve(n), [p](T& v, float u) { v = u < p ? T(1) : T(0); });
+}
+
+namespace detail {
+
+/*!
+ * \brief The number of elements of a chunk of a parallel fill (a multiple
+ * of the block size of the generator)
+ */
+constexpr size_t fill_chunk = 64 * 1024;
+
+/*!
+ * \brief Apply fill(x + first, length, stream) to each chunk of the n
+ * elements of x, concurrently, the stream of a chunk starting at the
+ * block of its first element in the stream of the given key.
+ */
+template <typename T, typename Fill>
+void parallel_fill(T* x, size_t n, uint64_t key, Fill&& fill) {
+    if (n <= fill_chunk) {
+        random_stream stream(key);
+        fill(x, n, stream);
+        return;
+    }
+
+    task_group pool;
+
+    for (size_t first = 0; first < n; first += fill_chunk) {
+        pool.do_task([x, n, key, first, &fill] {
+            random_stream stream(key, first / philox4x32::block_size);
+            fill(x + first, std::min(fill_chunk, n - first), stream);
+        });
+    }
+
+    pool.wait();
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Fill the given memory with uniform numbers in [a, b), in parallel
+ * chunks, with the numbers of the stream of the given key
+ */
+template <typename T>
+void parallel_uniform_fill(T* x, size_t n, uint64_t key, T a = T(0), T b = T(1)) {
+    detail::parallel_fill(x, n, key, [a, b](T* chunk, size_t length, random_stream& stream) {
+        uniform_fill(chunk, length, stream, a, b);
+    });
+}
+
+/*!
+ * \brief Fill the given memory with normal numbers, in parallel chunks,
+ * with the numbers of the stream of the given key
+ */
+template <typename T>
+void parallel_normal_fill(T* x, size_t n, uint64_t key, T mean = T(0), T stddev = T(1)) {
+    detail::parallel_fill(x, n, key, [mean, stddev](T* chunk, size_t length, random_stream& stream) {
+        normal_fill(chunk, length, stream, mean, stddev);
+    });
+}
+
+/*!
+ * \brief Fill the given tensor with uniform numbers in [a, b)
+ */
+template <typename E>
+void uniform_fill(E&& x, random_stream& stream, etl::value_t<E> a = 0, etl::value_t<E> b = 1) {
+    x.ensure_cpu_up_to_date();
+    uniform_fill(x.memory_start(), etl::size(x), stream, a, b);
+    x.invalidate_gpu();
+}
+
+/*!
+ * \brief Fill the given tensor with normal numbers
+ */
+template <typename E>
+void normal_fill(E&& x, random_stream& stream, etl::value_t<E> mean = 0, etl::value_t<E> stddev = 1) {
+    x.ensure_cpu_up_to_date();
+    normal_fill(x.memory_start(), etl::size(x), stream, mean, stddev);
+    x.invalidate_gpu();
+}
+
+/*!
+ * \brief Fill the given tensor with Bernoulli samples (1 with probability p)
+ */
+template <typename E>
+void bernoulli_fill(E&& x, random_stream& stream, float p) {
+    x.ensure_cpu_up_to_date();
+    bernoulli_fill(x.memory_start(), etl::size(x), stream, p);
+    x.invalidate_gpu();
+}
+
+} //end of dll namespace
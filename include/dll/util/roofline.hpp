@@ -0,0 +1,359 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file roofline.hpp
+ * \brief Operations and bytes of the layers and roofline report
+ *
+ * The cost of each layer is estimated from its shapes, for the forward
+ * pass, the backward pass (the errors of the inputs) and the computation
+ * of the gradients:
+ *
+ *  - a dense layer does two operations per weight and per sample in each
+ *    of the three phases.
+ *  - a convolutional layer does two operations per weight of each filter
+ *    and per output position in each phase.
+ *  - a pooling layer does one operation per input value.
+ *  - the other layers do a few operations per output value.
+ *
+ * The bytes are the inputs, the outputs, the errors and the parameters
+ * that each phase must read or write at least once. With the time of each
+ * layer measured by a layer_profiler, dump_roofline() compares the
+ * achieved throughput with the roof of the machine: the minimum of its
+ * peak compute and of its bandwidth times the arithmetic intensity of the
+ * layer. A layer whose intensity is below the ridge point is bound by the
+ * bandwidth and gains from fusion, the others are bound by the compute.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/layer_traits.hpp"
+#include "dll/util/layer_profiler.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The estimated cost of one layer for one batch, by profile_phase
+ */
+struct layer_cost {
+    std::string name;      ///< The description of the layer
+    size_t parameters = 0; ///< The number of parameters
+    size_t inputs     = 0; ///< The number of inputs of a sample
+    size_t outputs    = 0; ///< The number of outputs of a sample
+    double flops[3]   = {}; ///< The operations of each phase
+    double bytes[3]   = {}; ///< The bytes read and written by each phase
+    size_t footprint  = 0; ///< The memory of the layer for a batch (bytes)
+
+    /*!
+     * \brief Returns the arithmetic intensity of the given phase (FLOP/byte)
+     */
+    double intensity(profile_phase phase) const {
+        const auto p = size_t(phase);
+        return bytes[p] > 0.0 ? flops[p] / bytes[p] : 0.0;
+    }
+};
+
+/*!
+ * \brief Estimate the cost of the given layer for a batch
+ * \param layer The layer
+ * \param inputs The number of inputs of a sample
+ * \param shape The output shape of the previous layer, updated to the one
+ * of the layer
+ * \param batch The number of samples of the batch
+ * \tparam W The type of the values
+ */
+template <typename W, typename Layer>
+layer_cost estimate_cost(const Layer& layer, size_t inputs, std::vector<size_t>& shape, size_t batch) {
+    using traits = decay_layer_traits<Layer>;
+
+    layer_cost cost;
+
+    cost.name   = layer.to_short_string();
+    cost.inputs = inputs;
+
+    shape = layer.output_shape(shape);
+
+    cost.outputs = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+
+    if constexpr (traits::is_neural_layer()) {
+        cost.parameters = layer.parameters();
+    }
+
+    const double B   = batch;
+    const double in  = double(cost.inputs) * sizeof(W);
+    const double out = double(cost.outputs) * sizeof(W);
+    const double par = double(cost.parameters) * sizeof(W);
+
+    // The operations of each phase for one sample
+    double forward   = cost.outputs;
+    double backward  = 2.0 * cost.outputs;
+    double gradients = cost.parameters ? 2.0 * cost.outputs : 0.0;
+
+    if constexpr (traits::is_dense_layer()) {
+        // The weights without the biases (one per output)
+        forward = backward = gradients = 2.0 * (cost.parameters - cost.outputs);
+    } else if constexpr (traits::is_convolutional_layer() || traits::is_deconvolutional_layer()) {
+        // Each filter (without its bias) is applied at each output position
+        const size_t k = shape.empty() ? 1 : shape.front();
+
+        forward = backward = gradients = 2.0 * (cost.parameters - k) * (cost.outputs / double(k));
+    } else if constexpr (traits::is_pooling_layer() || traits::is_unpooling_layer()) {
+        forward  = cost.inputs;
+        backward = cost.inputs;
+    }
+
+    cost.flops[0] = B * forward;
+    cost.flops[1] = B * backward;
+    cost.flops[2] = B * gradients;
+
+    // Forward: read the inputs and the parameters, write the outputs
+    cost.bytes[0] = B * (in + out) + par;
+
+    // Backward: read the outputs, their errors and the parameters, write the errors of the inputs
+    cost.bytes[1] = B * (in + 2.0 * out) + par;
+
+    // Gradients: read the inputs and the errors, write the gradients
+    cost.bytes[2] = cost.parameters ? B * (in + out) + 2.0 * par : 0.0;
+
+    cost.footprint = size_t((2.0 * par) + 2.0 * B * out);
+
+    return cost;
+}
+
+namespace detail {
+
+template <typename DBN, size_t... I>
+std::vector<layer_cost> network_costs(const DBN& dbn, size_t inputs, std::index_sequence<I...> /*indices*/) {
+    using dbn_t = std::decay_t<DBN>;
+
+    std::vector<layer_cost> costs;
+    std::vector<size_t> shape;
+
+    ((costs.push_back(estimate_cost<typename dbn_t::weight>(dbn.template layer_get<I>(), inputs, shape, dbn_t::batch_size)),
+      inputs = costs.back().outputs),
+     ...);
+
+    return costs;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Estimate the cost of each layer of the network for one batch
+ * \param dbn The network
+ * \param inputs The number of inputs of a sample
+ */
+template <typename DBN>
+std::vector<layer_cost> network_costs(const DBN& dbn, size_t inputs) {
+    return detail::network_costs(dbn, inputs, std::make_index_sequence<std::decay_t<DBN>::layers>());
+}
+
+/*!
+ * \brief Estimate the cost of each layer of the network for one batch
+ */
+template <typename DBN>
+std::vector<layer_cost> network_costs(const DBN& dbn) {
+    return network_costs(dbn, dbn.input_size());
+}
+
+/*!
+ * \brief The peaks of the machine
+ */
+struct machine_peaks {
+    double gflops = 0.0; ///< The peak compute (GFLOP/s)
+    double gbps   = 0.0; ///< The peak bandwidth (GB/s)
+
+    /*!
+     * \brief Returns the arithmetic intensity (FLOP/byte) above which a
+     * kernel is bound by the compute
+     */
+    double ridge() const {
+        return gbps > 0.0 ? gflops / gbps : 0.0;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Returns the GFLOP/s of a multiply-add loop on one thread
+ */
+inline double measure_compute() {
+    constexpr size_t lanes = 64;
+    constexpr size_t steps = 1 << 18;
+
+    float acc[lanes];
+
+    for (size_t l = 0; l < lanes; ++l) {
+        acc[l] = 1.0f + l * 1e-3f;
+    }
+
+    volatile float a = 0.999999f;
+    volatile float b = 1e-7f;
+
+    const float fa = a;
+    const float fb = b;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t s = 0; s < steps; ++s) {
+        for (size_t l = 0; l < lanes; ++l) {
+            acc[l] = acc[l] * fa + fb;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    volatile float sink = std::accumulate(acc, acc + lanes, 0.0f);
+    (void)sink;
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    return 2.0 * lanes * steps / (seconds * 1e9);
+}
+
+/*!
+ * \brief Returns the GB/s of a triad over arrays larger than the caches, on
+ * one thread
+ */
+inline double measure_bandwidth() {
+    constexpr size_t n = 1 << 22;
+
+    std::vector<float> x(n, 1.0f);
+    std::vector<float> y(n, 2.0f);
+    std::vector<float> z(n, 0.0f);
+
+    double best = 0.0;
+
+    for (size_t r = 0; r < 3; ++r) {
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < n; ++i) {
+            z[i] = x[i] + 3.0f * y[i];
+        }
+
+        auto end = std::chrono::steady_clock::now();
+
+        const double seconds = std::chrono::duration<double>(end - start).count();
+
+        best = std::max(best, 3.0 * n * sizeof(float) / (seconds * 1e9));
+    }
+
+    volatile float sink = z[n / 2];
+    (void)sink;
+
+    return best;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Measure the peaks of the machine with short kernels on all the
+ * cores.
+ *
+ * The kernels are scalar code vectorized by the compiler, not tuned BLAS,
+ * so the peaks are those reachable by the compiled code. Pass known peaks
+ * to dump_roofline() for a more exact roof.
+ */
+inline machine_peaks measure_peaks() {
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<double> compute(threads);
+    std::vector<double> bandwidth(threads);
+
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&compute, t] { compute[t] = detail::measure_compute(); });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    workers.clear();
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&bandwidth, t] { bandwidth[t] = detail::measure_bandwidth(); });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    machine_peaks peaks;
+    peaks.gflops = std::accumulate(compute.begin(), compute.end(), 0.0);
+    peaks.gbps   = std::accumulate(bandwidth.begin(), bandwidth.end(), 0.0);
+
+    return peaks;
+}
+
+/*!
+ * \brief Print the achieved throughput of each layer of the network against
+ * the roof of the machine.
+ *
+ * \param dbn The network
+ * \param profiler The profiler with the times of the layers, registered in
+ * the order of the network
+ * \param batches The number of batches measured by the profiler
+ * \param peaks The peaks of the machine
+ */
+template <typename DBN>
+void dump_roofline(const DBN& dbn, const layer_profiler& profiler, size_t batches, const machine_peaks& peaks) {
+    static constexpr const char* phases[3] = {"fwd", "bwd", "grad"};
+
+    auto costs = network_costs(dbn);
+
+    std::cout << std::endl;
+    std::cout << "Machine: " << peaks.gflops << " GFLOP/s, " << peaks.gbps << " GB/s, ridge at " << peaks.ridge() << " FLOP/B" << std::endl;
+
+    printf(" | %-3s | %-30s | %-5s | %10s | %10s | %9s | %9s | %8s | %-7s |\n",
+           "#", "Layer", "Phase", "Time (ms)", "GFLOP/s", "GB/s", "FLOP/B", "Roof (%)", "Bound");
+
+    const double n = std::max<size_t>(batches, 1);
+
+    for (size_t i = 0; i < costs.size() && i < profiler.layers.size(); ++i) {
+        auto& cost = costs[i];
+
+        for (size_t p = 0; p < profile_phases; ++p) {
+            const double ms = profiler.layers[i]->total(profile_phase(p)) / (1e6 * n);
+
+            if (ms <= 0.0 || (cost.flops[p] == 0.0 && cost.bytes[p] == 0.0)) {
+                continue;
+            }
+
+            const double gflops    = cost.flops[p] / (ms * 1e6);
+            const double gbps      = cost.bytes[p] / (ms * 1e6);
+            const double intensity = cost.intensity(profile_phase(p));
+            const double roof      = std::min(peaks.gflops, intensity * peaks.gbps);
+
+            printf(" | %-3zu | %-30s | %-5s | %10.4f | %10.3f | %9.3f | %9.3f | %8.1f | %-7s |\n",
+                   i, cost.name.substr(0, 30).c_str(), phases[p], ms, gflops, gbps, intensity,
+                   roof > 0.0 ? 100.0 * gflops / roof : 0.0,
+                   intensity < peaks.ridge() ? "memory" : "compute");
+        }
+    }
+}
+
+/*!
+ * \brief Print the achieved throughput of each layer of the network against
+ * the measured roof of the machine.
+ */
+template <typename DBN>
+void dump_roofline(const DBN& dbn, const layer_profiler& profiler, size_t batches) {
+    dump_roofline(dbn, profiler, batches, measure_peaks());
+}
+
+} //end of dll namespace
@@ -0,0 +1,167 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sampled_output.hpp
+ * \brief Output layers trained on a subset of their classes
+ *
+ * With a very large number of classes, a full softmax output layer
+ * computes the logits and the gradients of every class at every training
+ * step. A sampled output layer (sampled softmax or hierarchical softmax)
+ * only computes, during training, the rows of its weights needed by the
+ * labels of the batch: its errors, its loss and its error are computed
+ * together from the labels (sampled_errors) and its gradients are only
+ * non-zero on these rows, updated alone by the trainer. The full softmax
+ * is only computed for evaluation.
+ *
+ * The weights of these layers are stored with one row per class (or per
+ * node of the tree), [classes, visibles].
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Sample the negative classes uniformly
+ */
+struct uniform_sampler {
+    /*!
+     * \brief Returns the probability of the given class
+     * \param c The class
+     * \param N The number of classes
+     */
+    static double probability(size_t c, size_t N) {
+        cpp_unused(c);
+
+        return 1.0 / N;
+    }
+
+    /*!
+     * \brief Sample a class
+     * \param g The random engine
+     * \param N The number of classes
+     */
+    template <typename G>
+    static size_t sample(G& g, size_t N) {
+        return std::uniform_int_distribution<size_t>(0, N - 1)(g);
+    }
+};
+
+/*!
+ * \brief Sample the negative classes from a log-uniform (Zipfian)
+ * distribution, P(c) = log((c + 2) / (c + 1)) / log(N + 1).
+ *
+ * This assumes that the classes are sorted by decreasing frequency, as the
+ * words of the vocabulary of a language model.
+ */
+struct log_uniform_sampler {
+    /*!
+     * \brief Returns the probability of the given class
+     * \param c The class
+     * \param N The number of classes
+     */
+    static double probability(size_t c, size_t N) {
+        return std::log((c + 2.0) / (c + 1.0)) / std::log(N + 1.0);
+    }
+
+    /*!
+     * \brief Sample a class
+     * \param g The random engine
+     * \param N The number of classes
+     */
+    template <typename G>
+    static size_t sample(G& g, size_t N) {
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(g);
+        const auto c   = size_t(std::exp(u * std::log(N + 1.0))) - 1;
+
+        return std::min(c, N - 1);
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer is a sampled output layer
+ */
+template <typename L, typename Enable = void>
+struct is_sampled_output_impl : std::false_type {};
+
+/*!
+ * \copydoc is_sampled_output_impl
+ */
+template <typename L>
+struct is_sampled_output_impl<L, std::void_t<decltype(L::sampled_output)>> : std::bool_constant<L::sampled_output> {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer is a sampled output layer, computing
+ * its errors, loss and error from the labels (sampled_errors)
+ */
+template <typename L>
+constexpr bool is_sampled_output = detail::is_sampled_output_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Compute the class of each sample of a batch of one-hot labels
+ * \param classes The classes of the samples, resized to dim<0>(labels)
+ * \param labels The labels [n, N]
+ */
+template <typename Labels>
+void label_classes(std::vector<size_t>& classes, const Labels& labels) {
+    if constexpr (!etl::is_dma<Labels>) {
+        auto labels_t = etl::force_temporary(labels);
+        label_classes(classes, labels_t);
+    } else {
+        const size_t n = etl::dim<0>(labels);
+
+        classes.resize(n);
+
+        if (!n) {
+            return;
+        }
+
+        const size_t N = etl::size(labels) / n;
+
+        labels.ensure_cpu_up_to_date();
+
+        for (size_t i = 0; i < n; ++i) {
+            const auto* l = labels.memory_start() + i * N;
+
+            classes[i] = std::max_element(l, l + N) - l;
+        }
+    }
+}
+
+/*!
+ * \brief Returns the depth of the deepest leaf of the tree of a
+ * hierarchical softmax over N classes.
+ *
+ * The tree is a full binary tree stored as a heap: the N - 1 inner nodes
+ * are the nodes [0, N - 1), the children of the node k are 2k + 1 and
+ * 2k + 2 and the leaf of the class c is the node N - 1 + c.
+ */
+constexpr size_t hsoftmax_depth(size_t N) {
+    size_t depth = 0;
+
+    for (size_t nodes = 2 * N - 1; nodes > 1; nodes /= 2) {
+        ++depth;
+    }
+
+    return depth;
+}
+
+} //end of dll namespace
@@ -0,0 +1,513 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file scheduler.hpp
+ * \brief Shared work-stealing scheduler for the compute threads of DLL
+ *
+ * All the parallel parts of DLL (branches of merge layers, ensembles,
+ * data-parallel shards, parallel tempering chains, SVM grid search and
+ * multi-class training, preprocessing) submit their tasks to a single
+ * process-wide scheduler instead of creating their own thread pools. The
+ * number of threads is given by a thread budget:
+ *
+ *  - DLL_COMPUTE_THREADS: the number of compute threads, including the
+ *    thread waiting for the tasks (default: etl::threads)
+ *  - DLL_DATA_THREADS: the maximum number of augmentation threads of each
+ *    data generator (default: no limit)
+ *  - DLL_AFFINITY: a list of CPUs (e.g. "0-7,16-23"). The compute threads
+ *    are pinned to the first CPUs of the list and the data threads to the
+ *    following ones.
+ *
+ * A thread waiting for a task group runs the pending tasks itself, so that
+ * nested groups cannot exhaust the workers. The threads inside ETL and the
+ * BLAS library are not managed by the scheduler: the tasks are expected to
+ * run ETL serially (SERIAL_SECTION), as they did with the previous pools.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The number of threads DLL is allowed to use and their placement
+ */
+struct thread_budget {
+    size_t compute = 1;        ///< The number of compute threads, including the waiting thread
+    size_t data    = 0;        ///< The maximum number of augmentation threads per generator (0 for no limit)
+    std::vector<size_t> cpus;  ///< The CPUs to pin the threads to (empty for no pinning)
+};
+
+namespace detail {
+
+/*!
+ * \brief Parse a list of CPUs ("0,2,4-7")
+ * \param list The textual list
+ * \return The CPUs of the list, in order
+ */
+inline std::vector<size_t> parse_cpu_list(const std::string& list) {
+    std::vector<size_t> cpus;
+
+    size_t i = 0;
+
+    while (i < list.size()) {
+        size_t end = list.find(',', i);
+
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+
+        const std::string item = list.substr(i, end - i);
+        const size_t dash      = item.find('-');
+
+        try {
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoul(item));
+            } else {
+                const size_t first = std::stoul(item.substr(0, dash));
+                const size_t last  = std::stoul(item.substr(dash + 1));
+
+                for (size_t c = first; c <= last; ++c) {
+                    cpus.push_back(c);
+                }
+            }
+        } catch (const std::exception&) {
+            // Invalid items are ignored
+        }
+
+        i = end + 1;
+    }
+
+    return cpus;
+}
+
+/*!
+ * \brief Read a number of threads from the environment
+ * \param name The name of the variable
+ * \param value The value to use when the variable is not set
+ */
+inline size_t env_threads(const char* name, size_t value) {
+    if (auto* env = std::getenv(name)) {
+        try {
+            return std::stoul(env);
+        } catch (const std::exception&) {
+            // Keep the default value
+        }
+    }
+
+    return value;
+}
+
+/*!
+ * \brief Return a reference to the thread budget of the process
+ */
+inline thread_budget& thread_budget_impl() {
+    static thread_budget budget = [] {
+        thread_budget b;
+
+        b.compute = std::max<size_t>(1, env_threads("DLL_COMPUTE_THREADS", etl::threads));
+        b.data    = env_threads("DLL_DATA_THREADS", 0);
+
+        if (auto* env = std::getenv("DLL_AFFINITY")) {
+            b.cpus = parse_cpu_list(env);
+        }
+
+        return b;
+    }();
+
+    return budget;
+}
+
+/*!
+ * \brief Pin the current thread to the given CPU
+ * \return true if the thread has been pinned
+ */
+inline bool pin_current_thread(size_t cpu) {
+#ifdef __linux__
+    if (cpu >= CPU_SETSIZE) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Return the thread budget of the process
+ */
+inline const thread_budget& get_thread_budget() {
+    return detail::thread_budget_impl();
+}
+
+/*!
+ * \brief Set the thread budget of the process.
+ *
+ * This must be called before the scheduler is first used (before any
+ * network is created), the number of compute threads cannot change once
+ * the workers are started.
+ *
+ * \param budget The new budget
+ */
+inline void set_thread_budget(const thread_budget& budget) {
+    auto& b = detail::thread_budget_impl();
+
+    b         = budget;
+    b.compute = std::max<size_t>(1, b.compute);
+}
+
+/*!
+ * \brief Return the number of augmentation threads a generator may start
+ * \param requested The number of threads asked by the generator
+ */
+inline size_t data_threads(size_t requested) {
+    auto& budget = get_thread_budget();
+
+    return budget.data ? std::max<size_t>(1, std::min(requested, budget.data)) : requested;
+}
+
+/*!
+ * \brief Pin the current data thread to its CPU, if an affinity is set.
+ *
+ * The data threads use the CPUs following the ones of the compute
+ * threads.
+ *
+ * \param w The index of the data thread inside its generator
+ */
+inline void pin_data_thread(size_t w) {
+    auto& budget = get_thread_budget();
+
+    if (!budget.cpus.empty()) {
+        detail::pin_current_thread(budget.cpus[(budget.compute + w) % budget.cpus.size()]);
+    }
+}
+
+/*!
+ * \brief Work-stealing scheduler shared by all the parallel parts of DLL.
+ *
+ * Each worker has its own queue: the tasks submitted by a worker are pushed
+ * to its queue and run last-in first-out by the worker, while idle workers
+ * steal the oldest tasks of the other queues. The tasks submitted by the
+ * other threads go to a shared queue.
+ */
+struct scheduler {
+    using task_t = std::function<void()>; ///< The type of a task
+
+    /*!
+     * \brief Start the workers of the budget.
+     *
+     * The thread waiting for a group counts as a compute thread, only
+     * compute - 1 workers are started.
+     */
+    explicit scheduler(const thread_budget& budget) : n_workers(budget.compute - 1), active(budget.compute - 1) {
+        // The last queue is the one of the external threads
+        for (size_t w = 0; w <= n_workers; ++w) {
+            queues.emplace_back(std::make_unique<queue>());
+        }
+
+        for (size_t w = 0; w < n_workers; ++w) {
+            // The first CPU is left to the waiting thread
+            const size_t cpu = budget.cpus.empty() ? size_t(-1) : budget.cpus[(w + 1) % budget.cpus.size()];
+
+            threads.emplace_back([this, w, cpu] {
+                if (cpu != size_t(-1)) {
+                    detail::pin_current_thread(cpu);
+                }
+
+                work(w);
+            });
+        }
+    }
+
+    scheduler(const scheduler& rhs) = delete;
+    scheduler& operator=(const scheduler& rhs) = delete;
+
+    /*!
+     * \brief Stop and join the workers
+     */
+    ~scheduler() {
+        {
+            std::lock_guard<std::mutex> l(sleep_lock);
+            stopping = true;
+        }
+
+        sleep.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Return the scheduler of the process, started on first use
+     */
+    static scheduler& instance() {
+        static scheduler s(get_thread_budget());
+        return s;
+    }
+
+    /*!
+     * \brief Return the number of worker threads
+     */
+    size_t workers() const {
+        return n_workers;
+    }
+
+    /*!
+     * \brief Limit the number of workers running tasks.
+     *
+     * Unlike the thread budget, this can be changed at any time: the
+     * other workers finish their current task and then sleep. The threads
+     * waiting for a group still run the tasks themselves.
+     *
+     * \param n The number of active workers (at most workers())
+     */
+    void set_active_workers(size_t n) {
+        {
+            std::lock_guard<std::mutex> l(sleep_lock);
+            active = std::min(n, n_workers);
+        }
+
+        sleep.notify_all();
+    }
+
+    /*!
+     * \brief Return the number of workers running tasks
+     */
+    size_t active_workers() const {
+        return active;
+    }
+
+    /*!
+     * \brief Submit a task
+     */
+    void submit(task_t task) {
+        const size_t q = current_worker() < workers() ? current_worker() : workers();
+
+        {
+            std::lock_guard<std::mutex> l(queues[q]->lock);
+            queues[q]->tasks.push_back(std::move(task));
+        }
+
+        ++pending;
+
+        // Taking the lock makes sure a worker about to sleep sees the task
+        {
+            std::lock_guard<std::mutex> l(sleep_lock);
+        }
+
+        // A woken inactive worker would go back to sleep with the task
+        if (active < n_workers) {
+            sleep.notify_all();
+        } else {
+            sleep.notify_one();
+        }
+    }
+
+    /*!
+     * \brief Run one pending task on the current thread, if any
+     * \return true if a task has been run
+     */
+    bool run_one() {
+        task_t task;
+
+        if (!pop(task)) {
+            return false;
+        }
+
+        --pending;
+
+        task();
+
+        return true;
+    }
+
+private:
+    /*!
+     * \brief The queue of tasks of one thread
+     */
+    struct queue {
+        std::mutex lock;           ///< The lock protecting the tasks
+        std::deque<task_t> tasks; ///< The pending tasks
+    };
+
+    /*!
+     * \brief Return a reference to the index of the worker running on the current thread
+     */
+    static size_t& current_worker() {
+        thread_local size_t index = size_t(-1);
+        return index;
+    }
+
+    /*!
+     * \brief Take a task, from the queue of the current worker first and
+     * then from the others
+     */
+    bool pop(task_t& task) {
+        const size_t n    = queues.size();
+        const size_t self = current_worker() < workers() ? current_worker() : workers();
+
+        {
+            auto& q = *queues[self];
+            std::lock_guard<std::mutex> l(q.lock);
+
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < n; ++i) {
+            auto& q = *queues[(self + i) % n];
+            std::lock_guard<std::mutex> l(q.lock);
+
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief The loop of a worker
+     */
+    void work(size_t w) {
+        current_worker() = w;
+
+        while (true) {
+            if (w < active && run_one()) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> l(sleep_lock);
+
+            sleep.wait(l, [this, w] { return stopping || (pending > 0 && w < active); });
+
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    const size_t n_workers;                     ///< The number of workers
+    std::vector<std::unique_ptr<queue>> queues; ///< The queues of the workers and of the external threads
+    std::vector<std::thread> threads;           ///< The workers
+    std::atomic<size_t> pending{0};             ///< The number of submitted tasks not yet started
+    std::atomic<size_t> active;                 ///< The number of workers allowed to run tasks
+    std::mutex sleep_lock;                      ///< The lock protecting the sleep of the workers
+    std::condition_variable sleep;              ///< The condition the idle workers wait on
+    bool stopping = false;                      ///< Indicates if the workers must stop
+};
+
+/*!
+ * \brief A group of tasks running on the shared scheduler.
+ *
+ * This has the same interface as cpp::thread_pool (do_task and wait), the
+ * number of threads given to the constructor is only kept for
+ * compatibility, the concurrency is the one of the thread budget.
+ */
+struct task_group {
+    /*!
+     * \brief Create an empty group
+     */
+    explicit task_group(size_t threads = 0) {
+        (void)threads;
+    }
+
+    task_group(const task_group& rhs) = delete;
+    task_group& operator=(const task_group& rhs) = delete;
+
+    /*!
+     * \brief Wait for the remaining tasks
+     */
+    ~task_group() {
+        wait();
+    }
+
+    /*!
+     * \brief Submit a task to the group. Without workers, the task is run
+     * directly.
+     */
+    template <typename Functor>
+    void do_task(Functor&& functor) {
+        auto& s = scheduler::instance();
+
+        if (!s.workers()) {
+            functor();
+            return;
+        }
+
+        ++remaining;
+
+        s.submit([this, f = std::forward<Functor>(functor)]() mutable {
+            f();
+
+            std::lock_guard<std::mutex> l(lock);
+
+            if (--remaining == 0) {
+                done.notify_all();
+            }
+        });
+    }
+
+    /*!
+     * \brief Wait for all the tasks of the group, running the pending tasks
+     * of the scheduler in the meantime.
+     */
+    void wait() {
+        auto& s = scheduler::instance();
+
+        while (remaining > 0) {
+            if (!s.run_one()) {
+                std::unique_lock<std::mutex> l(lock);
+                done.wait_for(l, std::chrono::microseconds(100), [this] { return remaining == 0; });
+            }
+        }
+
+        // The last task may still hold the lock after the decrement
+        std::lock_guard<std::mutex> l(lock);
+    }
+
+private:
+    std::atomic<size_t> remaining{0}; ///< The number of unfinished tasks
+    std::mutex lock;                   ///< The lock of the completion condition
+    std::condition_variable done;      ///< Notified when the last task finishes
+};
+
+} //end of dll namespace
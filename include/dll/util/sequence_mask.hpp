@@ -0,0 +1,99 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sequence_mask.hpp
+ * \brief Masks for batches of variable-length sequences
+ */
+
+#pragma once
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The mask of a batch of variable-length sequences.
+ *
+ * The samples of the batch are padded to the same number of time steps.
+ * The recurrent layers process the samples sorted by decreasing length, so
+ * that the samples still active at a given time step always form a prefix
+ * of the batch that shrinks as the sequences end.
+ *
+ * When no lengths are set, every sample has the full number of time steps.
+ * When fewer lengths than samples are set (incomplete last batch), the
+ * remaining samples are considered empty.
+ */
+struct sequence_mask {
+    std::vector<size_t> lengths; ///< The length of each sample of the batch (empty if all the samples are full)
+    std::vector<size_t> order;   ///< The samples of the batch, sorted by decreasing length
+    std::vector<size_t> active;  ///< The number of active samples at each time step
+
+    /*!
+     * \brief Indicates if the batch contains variable-length sequences
+     */
+    bool enabled() const {
+        return !lengths.empty();
+    }
+
+    /*!
+     * \brief Compute the order and the active samples of a batch
+     * \param Batch The number of samples in the batch
+     * \param time_steps The number of (padded) time steps
+     */
+    void prepare(size_t Batch, size_t time_steps) {
+        order.resize(Batch);
+        std::iota(order.begin(), order.end(), 0);
+
+        active.assign(time_steps, Batch);
+
+        if (enabled()) {
+            cpp_assert(lengths.size() <= Batch, "There must be at most one length for each sample");
+
+            std::stable_sort(order.begin(), order.end(), [this, time_steps](size_t lhs, size_t rhs) {
+                return length(lhs, time_steps) > length(rhs, time_steps);
+            });
+
+            size_t n = Batch;
+
+            for (size_t t = 0; t < time_steps; ++t) {
+                while (n > 0 && length(order[n - 1], time_steps) <= t) {
+                    --n;
+                }
+
+                active[t] = n;
+            }
+        }
+    }
+
+    /*!
+     * \brief Return the number of time steps of the given sample
+     * \param b The index of the sample in the batch
+     * \param time_steps The number of (padded) time steps
+     */
+    size_t length(size_t b, size_t time_steps) const {
+        if (!enabled()) {
+            return time_steps;
+        }
+
+        return b < lengths.size() ? std::min(lengths[b], time_steps) : 0;
+    }
+};
+
+/*!
+ * \brief The workspace of a layer that only needs the lengths of the
+ * sequences of the batch.
+ */
+struct sequence_workspace {
+    sequence_mask mask; ///< The mask of the batch
+};
+
+} //end of dll namespace
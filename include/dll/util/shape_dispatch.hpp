@@ -0,0 +1,84 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file shape_dispatch.hpp
+ * \brief Runtime selection of kernels instantiated for static shapes
+ *
+ * A dynamic layer can register a list of common shapes. The shape of the
+ * layer is looked up once, when the layer is initialized, and its kernels
+ * are then run on static views of their inputs, with all the dimensions
+ * known at compile-time.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace dll {
+
+/*!
+ * \brief A shape known at compile-time
+ */
+template <size_t... Dims>
+struct static_shape {
+    static constexpr size_t dimensions = sizeof...(Dims); ///< The number of dimensions
+
+    static constexpr std::array<size_t, sizeof...(Dims)> dims = {{Dims...}}; ///< The dimensions
+
+    /*!
+     * \brief Indicates if the given runtime dimensions are the dimensions
+     * of this shape
+     */
+    template <typename... D>
+    static constexpr bool matches(D... d) noexcept {
+        static_assert(sizeof...(D) == sizeof...(Dims), "Invalid number of dimensions");
+
+        return ((size_t(d) == Dims) && ...);
+    }
+};
+
+/*!
+ * \brief A list of static shapes
+ */
+template <typename... Shapes>
+struct static_shape_list {
+    static constexpr size_t size = sizeof...(Shapes); ///< The number of shapes
+
+    /*!
+     * \brief Returns the index of the first shape matching the given
+     * dimensions, size if none match.
+     */
+    template <typename... D>
+    static size_t find(D... d) noexcept {
+        size_t index = 0;
+        size_t found = size;
+
+        ((found == size && Shapes::matches(d...) ? (void)(found = index) : (void)0, ++index), ...);
+
+        return found;
+    }
+
+    /*!
+     * \brief Call the functor with the shape of the given index.
+     *
+     * \return The result of the functor, false if there is no shape at the
+     * given index
+     */
+    template <typename Functor>
+    static bool dispatch(size_t i, Functor&& functor) {
+        size_t index = 0;
+        bool done    = false;
+
+        ((index++ == i ? (void)(done = functor(Shapes{})) : (void)0), ...);
+
+        return done;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,365 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sliding_window.hpp
+ * \brief Fully-convolutional inference of patch networks over large images
+ *
+ * A convolutional network trained on patches can be applied at each
+ * location of a larger image. Forwarding the patches one by one computes
+ * the convolutions of the overlapping regions again and again. The
+ * sliding-window inference runs each convolutional layer once over the
+ * full image instead, the way a fully-convolutional network does. The
+ * first dense layer of the head is applied as a convolution with filters
+ * of the size of the patch-level feature maps and the following dense
+ * layers as 1x1 convolutions, as a batch of all the locations.
+ *
+ * Only the layers that keep a dense output are supported: the stride 1
+ * convolutional layers and CRBMs, the activation and dropout layers and
+ * the dense head. Pooling and strided convolutions are rejected.
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/unit_type.hpp"
+#include "dll/util/inference_plan.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer is a standard convolutional layer
+ */
+template <typename L>
+struct is_sliding_conv_impl : std::false_type {};
+
+/*!
+ * \copydoc is_sliding_conv_impl
+ */
+template <typename Desc>
+struct is_sliding_conv_impl<conv_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_sliding_conv_impl
+ */
+template <typename Desc>
+struct is_sliding_conv_impl<dyn_conv_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer is a convolutional RBM (without pooling)
+ */
+template <typename L>
+struct is_sliding_crbm_impl : std::false_type {};
+
+/*!
+ * \copydoc is_sliding_crbm_impl
+ */
+template <typename Desc>
+struct is_sliding_crbm_impl<conv_rbm_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_sliding_crbm_impl
+ */
+template <typename Desc>
+struct is_sliding_crbm_impl<dyn_conv_rbm_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer is an activation layer
+ */
+template <typename L>
+struct is_activation_layer_impl : std::false_type {};
+
+/*!
+ * \copydoc is_activation_layer_impl
+ */
+template <typename Desc>
+struct is_activation_layer_impl<activation_layer_impl<Desc>> : std::true_type {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer is a standard convolutional layer
+ */
+template <typename L>
+constexpr bool is_sliding_conv = detail::is_sliding_conv_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer is a convolutional RBM
+ */
+template <typename L>
+constexpr bool is_sliding_crbm = detail::is_sliding_crbm_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the given layer is an activation layer
+ */
+template <typename L>
+constexpr bool is_activation_layer = detail::is_activation_layer_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Sliding-window inference of a convolutional network over images
+ * larger than its input.
+ *
+ * \tparam DBN The network type
+ */
+template <typename DBN>
+struct sliding_window_inference {
+    using dbn_t    = DBN;                        ///< The network type
+    using weight   = typename dbn_t::weight;     ///< The type of the activations
+    using maps_t   = etl::dyn_matrix<weight, 4>; ///< The type of the feature maps of the image
+    using rows_t   = etl::dyn_matrix<weight, 2>; ///< The type of the outputs of the dense head, one row per location
+    using output_t = etl::dyn_matrix<weight, 3>; ///< The type of the dense output
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+private:
+    /*!
+     * \brief The state of the forward pass
+     */
+    struct state {
+        maps_t maps; ///< The feature maps of the full image (1 x C x H x W)
+        rows_t rows; ///< The outputs of the dense head, one row per location
+        size_t p1;   ///< The first dimension of the patch-level feature maps
+        size_t p2;   ///< The second dimension of the patch-level feature maps
+        size_t n1;   ///< The first dimension of the grid of locations
+        size_t n2;   ///< The second dimension of the grid of locations
+    };
+
+    /*!
+     * \brief Indicates if the layer L is part of the dense head (a dense
+     * layer comes before it)
+     */
+    template <size_t L>
+    static constexpr bool is_head() {
+        if constexpr (L == 0) {
+            return false;
+        } else {
+            return decay_layer_traits<typename dbn_t::template layer_type<L - 1>>::is_dense_layer() || is_head<L - 1>();
+        }
+    }
+
+public:
+    /*!
+     * \brief Forward the given image through the network, at each location.
+     *
+     * \param dbn The network
+     * \param image The image (C x H x W), at least as large as the input of the network
+     *
+     * \return For a network with a dense head, the output of the network at
+     * each location (O x N1 x N2), where (y, x) is the output for the patch
+     * whose top left corner is (y, x). For a network without dense layer,
+     * the feature maps of the last layer over the full image.
+     */
+    template <typename Image>
+    static output_t forward(const dbn_t& dbn, const Image& image) {
+        static dll::timer_id timer_handle("net:sliding_window:forward");
+        dll::auto_timer timer(timer_handle);
+
+        using first_t = typename dbn_t::template layer_type<0>;
+
+        static_assert(is_sliding_conv<first_t> || is_sliding_crbm<first_t>, "The first layer must be convolutional for sliding-window inference");
+
+        decltype(auto) first = dbn.template layer_get<0>();
+
+        const size_t c = etl::dim<0>(image);
+        const size_t h = etl::dim<1>(image);
+        const size_t w = etl::dim<2>(image);
+
+        cpp_assert(c == get_nc(first), "The image must have the channels of the input of the network");
+        cpp_assert(h >= get_nv1(first) && w >= get_nv2(first), "The image cannot be smaller than the input of the network");
+
+        state s;
+
+        s.maps    = maps_t(1, c, h, w);
+        s.maps(0) = image;
+        s.p1      = get_nv1(first);
+        s.p2      = get_nv2(first);
+
+        forward_layers<0>(dbn, s);
+
+        if constexpr (is_head<layers>()) {
+            const size_t o = etl::dim<1>(s.rows);
+
+            rows_t channels(o, s.n1 * s.n2);
+            channels = etl::transpose(s.rows);
+
+            output_t output(o, s.n1, s.n2);
+            output = etl::reshape(channels, o, s.n1, s.n2);
+
+            return output;
+        } else {
+            output_t output(etl::dim<1>(s.maps), etl::dim<2>(s.maps), etl::dim<3>(s.maps));
+            output = s.maps(0);
+
+            return output;
+        }
+    }
+
+private:
+    /*!
+     * \brief Forward the current state through the layers from L
+     */
+    template <size_t L>
+    static void forward_layers(const dbn_t& dbn, state& s) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        decltype(auto) layer = dbn.template layer_get<L>();
+
+        if constexpr (is_inference_noop<layer_t>) {
+            cpp_unused(layer);
+        } else if constexpr (is_head<L>()) {
+            forward_rows(layer, s);
+        } else {
+            forward_maps(layer, s);
+        }
+
+        if constexpr (L + 1 < layers) {
+            forward_layers<L + 1>(dbn, s);
+        }
+    }
+
+    /*!
+     * \brief Forward the feature maps of the full image through the given layer
+     */
+    template <typename Layer>
+    static void forward_maps(const Layer& layer, state& s) {
+        using layer_t = std::decay_t<Layer>;
+
+        if constexpr (is_sliding_conv<layer_t> || is_sliding_crbm<layer_t>) {
+            if constexpr (is_sliding_conv<layer_t>) {
+                if constexpr (layer_traits<layer_t>::is_dynamic()) {
+                    cpp_assert(!layer.direct(), "Strided and dilated convolutions are not supported for sliding-window inference");
+                } else {
+                    static_assert(!layer_t::direct, "Strided and dilated convolutions are not supported for sliding-window inference");
+                }
+            }
+
+            const size_t h   = etl::dim<2>(s.maps);
+            const size_t w   = etl::dim<3>(s.maps);
+            const size_t k   = get_k(layer);
+            const size_t nw1 = get_nw1(layer);
+            const size_t nw2 = get_nw2(layer);
+
+            maps_t next(1, k, h - nw1 + 1, w - nw2 + 1);
+
+            if constexpr (is_sliding_conv<layer_t>) {
+                next = etl::ml::convolution_forward(s.maps, layer.w);
+
+                f_bias_activate_4d<layer_t::activation_function, !layer_t::no_bias>(next, layer.b);
+            } else {
+                next = etl::conv_4d_valid_flipped(s.maps, layer.w);
+
+                crbm_activate(layer, next);
+            }
+
+            s.maps = std::move(next);
+            s.p1 -= nw1 - 1;
+            s.p2 -= nw2 - 1;
+        } else if constexpr (is_activation_layer<layer_t>) {
+            static_assert(is_elementwise_function<layer_t::activation_function>, "Softmax activation layers are only supported in the dense head");
+
+            s.maps = f_activate<layer_t::activation_function>(s.maps);
+        } else if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+            const size_t c = etl::dim<1>(s.maps);
+            const size_t h = etl::dim<2>(s.maps);
+            const size_t w = etl::dim<3>(s.maps);
+
+            cpp_assert(layer.input_size() == c * s.p1 * s.p2, "The dense layer must take the patch-level feature maps");
+
+            // The dense layer is a convolution with filters of the size of
+            // the patch-level feature maps: one row of windows per location
+
+            s.n1 = h - s.p1 + 1;
+            s.n2 = w - s.p2 + 1;
+
+            rows_t windows(s.n1 * s.n2, c * s.p1 * s.p2);
+
+            for (size_t y = 0; y < s.n1; ++y) {
+                for (size_t x = 0; x < s.n2; ++x) {
+                    const size_t r = y * s.n2 + x;
+
+                    for (size_t cc = 0; cc < c; ++cc) {
+                        for (size_t i = 0; i < s.p1; ++i) {
+                            for (size_t j = 0; j < s.p2; ++j) {
+                                windows(r, (cc * s.p1 + i) * s.p2 + j) = s.maps(0, cc, y + i, x + j);
+                            }
+                        }
+                    }
+                }
+            }
+
+            s.rows = rows_t(s.n1 * s.n2, layer.output_size());
+
+            layer.test_forward_batch(s.rows, windows);
+        } else {
+            static_assert(is_sliding_conv<layer_t>, "This layer is not supported for sliding-window inference");
+        }
+    }
+
+    /*!
+     * \brief Forward the outputs of the dense head at all the locations
+     * through the given layer, as a batch.
+     */
+    template <typename Layer>
+    static void forward_rows(const Layer& layer, state& s) {
+        using layer_t = std::decay_t<Layer>;
+
+        if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+            // A 1x1 convolution over the grid of locations
+            rows_t next(etl::dim<0>(s.rows), layer.output_size());
+
+            layer.test_forward_batch(next, s.rows);
+
+            s.rows = std::move(next);
+        } else if constexpr (is_activation_layer<layer_t>) {
+            rows_t next(etl::dim<0>(s.rows), etl::dim<1>(s.rows));
+
+            layer.test_forward_batch(next, s.rows);
+
+            s.rows = std::move(next);
+        } else {
+            static_assert(is_activation_layer<layer_t>, "Only dense and activation layers are supported after the first dense layer");
+        }
+    }
+
+    /*!
+     * \brief Add the biases and compute the activation probabilities of the
+     * hidden units of a CRBM, in place
+     */
+    template <typename Layer>
+    static void crbm_activate(const Layer& layer, maps_t& h) {
+        using layer_t = std::decay_t<Layer>;
+
+        constexpr auto hidden_unit  = layer_t::hidden_unit;
+        constexpr auto visible_unit = layer_t::visible_unit;
+
+        static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type for sliding-window inference");
+
+        for (size_t k = 0; k < etl::dim<1>(h); ++k) {
+            if constexpr (hidden_unit == unit_type::BINARY && visible_unit == unit_type::GAUSSIAN) {
+                h(0)(k) = etl::sigmoid((1.0 / (0.1 * 0.1)) >> (h(0)(k) + layer.b(k)));
+            } else if constexpr (hidden_unit == unit_type::BINARY) {
+                h(0)(k) = etl::sigmoid(h(0)(k) + layer.b(k));
+            } else if constexpr (hidden_unit == unit_type::RELU) {
+                h(0)(k) = etl::max(h(0)(k) + layer.b(k), 0.0);
+            } else if constexpr (hidden_unit == unit_type::RELU6) {
+                h(0)(k) = etl::min(etl::max(h(0)(k) + layer.b(k), 0.0), 6.0);
+            } else {
+                h(0)(k) = etl::min(etl::max(h(0)(k) + layer.b(k), 0.0), 1.0);
+            }
+        }
+    }
+};
+
+} //end of dll namespace
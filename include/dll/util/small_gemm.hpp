@@ -0,0 +1,130 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file small_gemm.hpp
+ * \brief Register-blocked GEMM kernels for small batches of fast layers
+ *
+ * For a single sample or a few samples, the cost of a BLAS call (the
+ * checks, the packing and the threading) dominates the product of a
+ * compact layer. When the dimensions of the weights are known at compile
+ * time, the product C [M, NH] = A [M, NV] * W [NV, NH] is computed by
+ * blocks of up to four rows and a fixed number of columns, with all the
+ * accumulators in registers: each row of W is loaded once per block and
+ * multiplied by a broadcast value of each row of A.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "dll/util/isa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The maximum number of rows for which the small kernels are used
+ */
+constexpr size_t small_gemm_max_rows = 8;
+
+/*!
+ * \brief Indicates if the small kernels are used for weights [NV, NH] of
+ * the given type, i.e. if the weights are small enough to stay in the
+ * cache between the samples.
+ */
+template <typename T, size_t NV, size_t NH>
+#ifdef ETL_GPU
+constexpr bool is_small_gemm = false;
+#else
+constexpr bool is_small_gemm = NV * NH * sizeof(T) <= 128 * 1024;
+#endif
+
+namespace detail {
+
+/*!
+ * \brief The number of columns of a block: the accumulators of four rows
+ * fit in the 16 vector registers of AVX
+ */
+template <typename T>
+constexpr size_t small_gemm_columns = 2 * 32 / sizeof(T);
+
+/*!
+ * \brief Compute a block of R rows and N columns of C, starting at column j
+ */
+template <size_t R, size_t N, size_t NV, size_t NH, typename T>
+void small_gemm_block(T* c, const T* a, const T* w, size_t j) {
+    T acc[R][N] = {};
+
+    for (size_t k = 0; k < NV; ++k) {
+        const T* wk = w + k * NH + j;
+
+        for (size_t r = 0; r < R; ++r) {
+            const T x = a[r * NV + k];
+
+            for (size_t n = 0; n < N; ++n) {
+                acc[r][n] += x * wk[n];
+            }
+        }
+    }
+
+    for (size_t r = 0; r < R; ++r) {
+        for (size_t n = 0; n < N; ++n) {
+            c[r * NH + j + n] = acc[r][n];
+        }
+    }
+}
+
+/*!
+ * \brief Compute R rows of C
+ */
+template <size_t R, size_t NV, size_t NH, typename T>
+void small_gemm_rows(T* c, const T* a, const T* w) {
+    constexpr size_t J = small_gemm_columns<T>;
+
+    for (size_t j = 0; j + J <= NH; j += J) {
+        small_gemm_block<R, J, NV, NH>(c, a, w, j);
+    }
+
+    if constexpr (NH % J) {
+        small_gemm_block<R, NH % J, NV, NH>(c, a, w, NH - NH % J);
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute C [M, NH] = A [M, NV] * W [NV, NH] for a small number of
+ * rows
+ * \param c The output
+ * \param a The input
+ * \param w The weights
+ * \param M The number of rows
+ */
+template <size_t NV, size_t NH, typename T>
+DLL_MULTI_ISA_KERNEL void small_gemm(T* c, const T* a, const T* w, size_t M) {
+    size_t m = 0;
+
+    for (; m + 4 <= M; m += 4) {
+        detail::small_gemm_rows<4, NV, NH>(c + m * NH, a + m * NV, w);
+    }
+
+    switch (M - m) {
+        case 3:
+            detail::small_gemm_rows<3, NV, NH>(c + m * NH, a + m * NV, w);
+            break;
+        case 2:
+            detail::small_gemm_rows<2, NV, NH>(c + m * NH, a + m * NV, w);
+            break;
+        case 1:
+            detail::small_gemm_rows<1, NV, NH>(c + m * NH, a + m * NV, w);
+            break;
+        default:
+            break;
+    }
+}
+
+} //end of dll namespace
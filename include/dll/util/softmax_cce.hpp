@@ -0,0 +1,176 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file softmax_cce.hpp
+ * \brief Fused softmax and categorical cross-entropy output stage
+ *
+ * During training, a softmax last layer only computes its logits. The
+ * softmax, the errors of the last layer, the loss and the classification
+ * error are then computed together, row by row, while each row of logits
+ * is still in cache. The loss is computed from the log-softmax of the
+ * logits, which is numerically stable and never needs to take the log of
+ * a (possibly zero) probability.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/util/fusion.hpp"
+#include "dll/util/column_shards.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer can give its logits instead of its
+ * softmax output.
+ *
+ * Column-sharded layers compute their softmax in parallel and are not fused.
+ */
+template <typename L, bool = has_activation_forward<L>>
+struct has_softmax_logits_impl : std::false_type {};
+
+/*!
+ * \copydoc has_softmax_logits_impl
+ */
+template <typename L>
+struct has_softmax_logits_impl<L, true> : std::bool_constant<L::activation_function == function::SOFTMAX && !is_column_sharded<L>> {};
+
+/*!
+ * \brief Compute the softmax, the errors and the metrics of a batch of
+ * logits on raw memory.
+ *
+ * The output can be the same memory as the logits.
+ *
+ * \param out The softmax output [B, N]
+ * \param errors The errors of the last layer [B, N]
+ * \param logits The logits [B, N]
+ * \param labels The labels [B, N]
+ *
+ * \return The sum of the classification errors and the sum of the losses
+ */
+template <typename T, typename L>
+std::pair<double, double> softmax_cce(T* out, T* errors, const T* logits, const L* labels, size_t B, size_t N) {
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t b = 0; b < B; ++b) {
+        const T* z = logits + b * N;
+        const L* y = labels + b * N;
+        T* p       = out + b * N;
+        T* e       = errors + b * N;
+
+        // First pass: maximum and argmax of the logits and of the labels
+
+        T z_max      = z[0];
+        size_t z_arg = 0;
+        L y_max      = y[0];
+        size_t y_arg = 0;
+
+        double yz = 0.0;
+        double ys = 0.0;
+
+        for (size_t j = 0; j < N; ++j) {
+            if (z[j] > z_max) {
+                z_max = z[j];
+                z_arg = j;
+            }
+
+            if (y[j] > y_max) {
+                y_max = y[j];
+                y_arg = j;
+            }
+
+            yz += double(y[j]) * double(z[j]);
+            ys += double(y[j]);
+        }
+
+        // Second pass: the shifted exponentials
+
+        T sum(0);
+
+        for (size_t j = 0; j < N; ++j) {
+            p[j] = std::exp(z[j] - z_max);
+            sum += p[j];
+        }
+
+        // Third pass: normalization and errors
+
+        const T inv_sum = T(1) / sum;
+
+        for (size_t j = 0; j < N; ++j) {
+            p[j] *= inv_sum;
+            e[j] = T(y[j]) - p[j];
+        }
+
+        // -sum(y * log_softmax(z)), with log_softmax(z) = z - max - log(sum)
+        loss += (double(z_max) + std::log(double(sum))) * ys - yz;
+        error += z_arg == y_arg ? 0.0 : 1.0;
+    }
+
+    return {error, loss};
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can give its logits instead of its
+ * softmax output, for the fused output stage.
+ */
+template <typename L>
+constexpr bool has_softmax_logits = detail::has_softmax_logits_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Compute, in place, the softmax of the logits of the first samples
+ * of a batch, together with the errors of the last layer and the
+ * categorical cross-entropy metrics.
+ *
+ * Only the first n = dim<0>(labels) samples are processed.
+ *
+ * \param output The logits, replaced by the softmax output [B, N]
+ * \param errors The errors of the last layer, labels - output [B, N]
+ * \param labels The labels [n, N] (or any view of the same size)
+ *
+ * \return The sum of the classification errors and the sum of the losses
+ * over the n samples
+ */
+template <typename O, typename E, typename Labels>
+std::pair<double, double> softmax_cce(O& output, E& errors, const Labels& labels) {
+    if constexpr (!etl::is_dma<Labels>) {
+        auto labels_t = etl::force_temporary(labels);
+        return softmax_cce(output, errors, labels_t);
+    } else {
+        const size_t n = etl::dim<0>(labels);
+
+        if (!n) {
+            return {0.0, 0.0};
+        }
+
+        const size_t N = etl::size(labels) / n;
+
+        output.ensure_cpu_up_to_date();
+        errors.ensure_cpu_up_to_date();
+        labels.ensure_cpu_up_to_date();
+
+        auto metrics = detail::softmax_cce(output.memory_start(), errors.memory_start(), output.memory_start(), labels.memory_start(), n, N);
+
+        output.invalidate_gpu();
+        errors.invalidate_gpu();
+
+        return metrics;
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,612 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sparse.hpp
+ * \brief Magnitude pruning and blocked-CSR storage of pruned weights, CSR and
+ * CSC storage of sparse input batches
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A matrix stored in blocked CSR format.
+ *
+ * Each row is split into blocks of BS consecutive columns and only the
+ * blocks containing at least one non-zero are stored. The multiplication
+ * then works on full blocks, which can be vectorized, instead of single
+ * scattered values.
+ */
+template <typename T, size_t BS = 8>
+struct bcsr_matrix {
+    static constexpr size_t block_size = BS; ///< The number of columns of a block
+
+    size_t rows = 0;                 ///< The number of rows
+    size_t cols = 0;                 ///< The number of columns
+    std::vector<size_t> row_ptr;     ///< The first block of each row (rows + 1)
+    std::vector<uint32_t> block_col; ///< The first column of each block
+    std::vector<T> values;           ///< The values of the blocks (BS per block)
+
+    /*!
+     * \brief Build the matrix from the given dense row-major matrix
+     */
+    void build(const T* dense, size_t rows, size_t cols) {
+        this->rows = rows;
+        this->cols = cols;
+
+        row_ptr.assign(rows + 1, 0);
+        block_col.clear();
+        values.clear();
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* row = dense + r * cols;
+
+            for (size_t c = 0; c < cols; c += BS) {
+                const size_t w = std::min(BS, cols - c);
+
+                if (std::any_of(row + c, row + c + w, [](T v) { return v != T(0); })) {
+                    block_col.push_back(uint32_t(c));
+
+                    for (size_t j = 0; j < BS; ++j) {
+                        values.push_back(j < w ? row[c + j] : T(0));
+                    }
+                }
+            }
+
+            row_ptr[r + 1] = block_col.size();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of stored blocks
+     */
+    size_t blocks() const noexcept {
+        return block_col.size();
+    }
+
+    /*!
+     * \brief Returns the fraction of the matrix that is stored
+     */
+    double density() const noexcept {
+        return rows * cols ? double(blocks() * BS) / double(rows * cols) : 0.0;
+    }
+
+    /*!
+     * \brief Compute out = in * M on raw memory
+     * \param out The output [B, cols]
+     * \param in The input [B, rows]
+     * \param B The number of samples
+     */
+    void multiply(T* out, const T* in, size_t B) const {
+        std::fill_n(out, B * cols, T(0));
+
+        for (size_t b = 0; b < B; ++b) {
+            const T* x = in + b * rows;
+            T* y       = out + b * cols;
+
+            for (size_t r = 0; r < rows; ++r) {
+                const T xr = x[r];
+
+                // The inputs are often sparse too (after rectifiers)
+                if (xr == T(0)) {
+                    continue;
+                }
+
+                for (size_t k = row_ptr[r]; k < row_ptr[r + 1]; ++k) {
+                    const size_t c = block_col[k];
+                    const T* v     = values.data() + k * BS;
+
+                    if (c + BS <= cols) {
+                        for (size_t j = 0; j < BS; ++j) {
+                            y[c + j] += xr * v[j];
+                        }
+                    } else {
+                        for (size_t j = 0; j < cols - c; ++j) {
+                            y[c + j] += xr * v[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute output = input * M
+     * \param output The output [B, cols]
+     * \param input The input [B, rows] (or any view of the same size)
+     */
+    template <typename O, typename I>
+    void multiply(O&& output, const I& input) const {
+        if constexpr (!etl::is_dma<I>) {
+            auto input_t = etl::force_temporary(input);
+            multiply(output, input_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+            auto output_t = etl::force_temporary(output);
+            multiply(output_t, input);
+            output = output_t;
+        } else {
+            input.ensure_cpu_up_to_date();
+
+            multiply(output.memory_start(), input.memory_start(), etl::dim<0>(input));
+
+            output.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Release the storage of the matrix
+     */
+    void clear() {
+        rows = 0;
+        cols = 0;
+
+        row_ptr.clear();
+        row_ptr.shrink_to_fit();
+        block_col.clear();
+        block_col.shrink_to_fit();
+        values.clear();
+        values.shrink_to_fit();
+    }
+};
+
+/*!
+ * \brief A batch of sparse samples stored in CSR format.
+ *
+ * The matrix is rebuilt from each dense batch, which is a single pass over
+ * the inputs, much cheaper than the dense products it replaces. The
+ * products then only touch the rows of the weights of the non-zero inputs.
+ */
+template <typename T>
+struct csr_batch {
+    size_t rows = 0;               ///< The number of samples
+    size_t cols = 0;               ///< The number of inputs of each sample
+    std::vector<size_t> row_ptr;   ///< The first non-zero of each sample (rows + 1)
+    std::vector<uint32_t> col_ind; ///< The input of each non-zero
+    std::vector<T> values;         ///< The value of each non-zero
+
+    /*!
+     * \brief Build the batch from the given dense row-major batch
+     */
+    void build(const T* dense, size_t rows, size_t cols) {
+        this->rows = rows;
+        this->cols = cols;
+
+        row_ptr.resize(rows + 1);
+        col_ind.clear();
+        values.clear();
+
+        row_ptr[0] = 0;
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* row = dense + r * cols;
+
+            for (size_t c = 0; c < cols; ++c) {
+                if (row[c] != T(0)) {
+                    col_ind.push_back(uint32_t(c));
+                    values.push_back(row[c]);
+                }
+            }
+
+            row_ptr[r + 1] = values.size();
+        }
+    }
+
+    /*!
+     * \brief Build the batch from the given dense batch [B, N]
+     */
+    template <typename I>
+    void build(const I& input) {
+        if constexpr (!etl::is_dma<I>) {
+            auto input_t = etl::force_temporary(input);
+            build(input_t);
+        } else {
+            input.ensure_cpu_up_to_date();
+
+            build(input.memory_start(), etl::dim<0>(input), etl::size(input) / etl::dim<0>(input));
+        }
+    }
+
+    /*!
+     * \brief Returns the number of non-zeros
+     */
+    size_t non_zeros() const noexcept {
+        return values.size();
+    }
+
+    /*!
+     * \brief Returns the fraction of the batch that is non-zero
+     */
+    double density() const noexcept {
+        return rows * cols ? double(non_zeros()) / double(rows * cols) : 0.0;
+    }
+
+    /*!
+     * \brief Compute out = X * w on raw memory
+     * \param out The output [rows, H]
+     * \param w The weights [cols, H]
+     * \param H The number of outputs
+     */
+    void multiply(T* out, const T* w, size_t H) const {
+        std::fill_n(out, rows * H, T(0));
+
+        for (size_t r = 0; r < rows; ++r) {
+            T* y = out + r * H;
+
+            for (size_t k = row_ptr[r]; k < row_ptr[r + 1]; ++k) {
+                const T x    = values[k];
+                const T* w_c = w + col_ind[k] * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    y[j] += x * w_c[j];
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute grad = transpose(X) * h on raw memory, the sum over the
+     * samples of the outer products of the inputs and h
+     * \param grad The output [cols, H]
+     * \param h The right-hand side [rows, H]
+     * \param H The number of columns of h
+     */
+    void outer(T* grad, const T* h, size_t H) const {
+        std::fill_n(grad, cols * H, T(0));
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* h_r = h + r * H;
+
+            for (size_t k = row_ptr[r]; k < row_ptr[r + 1]; ++k) {
+                const T x = values[k];
+                T* g      = grad + col_ind[k] * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    g[j] += x * h_r[j];
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute output = X * w
+     * \param output The output [B, H]
+     * \param w The weights [N, H]
+     */
+    template <typename O, typename W>
+    void multiply(O&& output, const W& w) const {
+        if constexpr (!etl::is_dma<W>) {
+            auto w_t = etl::force_temporary(w);
+            multiply(output, w_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+            auto output_t = etl::force_temporary(output);
+            multiply(output_t, w);
+            output = output_t;
+        } else {
+            cpp_assert(etl::dim<0>(output) == rows && etl::size(w) == cols * etl::dim<1>(output), "Invalid sizes for csr_batch::multiply");
+
+            w.ensure_cpu_up_to_date();
+
+            multiply(output.memory_start(), w.memory_start(), etl::dim<1>(output));
+
+            output.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Compute grad = transpose(X) * h, the sparse equivalent of
+     * batch_outer(X, h)
+     * \param grad The output [N, H]
+     * \param h The right-hand side [B, H]
+     */
+    template <typename G, typename H>
+    void outer(G&& grad, const H& h) const {
+        if constexpr (!etl::is_dma<H>) {
+            auto h_t = etl::force_temporary(h);
+            outer(grad, h_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<G>>) {
+            auto grad_t = etl::force_temporary(grad);
+            outer(grad_t, h);
+            grad = grad_t;
+        } else {
+            cpp_assert(etl::dim<0>(h) == rows && etl::size(grad) == cols * etl::dim<1>(h), "Invalid sizes for csr_batch::outer");
+
+            h.ensure_cpu_up_to_date();
+
+            outer(grad.memory_start(), h.memory_start(), etl::dim<1>(h));
+
+            grad.invalidate_gpu();
+        }
+    }
+};
+
+/*!
+ * \brief A batch of sparse samples stored in CSC format.
+ *
+ * The non-zeros are gathered by input, so that each row of the weights is
+ * read a single time for the whole batch and the inputs that are zero for
+ * every sample (dead rectifiers for instance) are skipped entirely. This
+ * suits the activations of a previous layer, whose density changes from
+ * batch to batch, better than csr_batch.
+ */
+template <typename T>
+struct csc_batch {
+    static constexpr size_t tile = 256; ///< The number of outputs computed at once by multiply
+
+    size_t rows = 0;               ///< The number of samples
+    size_t cols = 0;               ///< The number of inputs of each sample
+    std::vector<size_t> col_ptr;   ///< The first non-zero of each input (cols + 1)
+    std::vector<uint32_t> row_ind; ///< The sample of each non-zero
+    std::vector<T> values;         ///< The value of each non-zero
+
+    /*!
+     * \brief Build the batch from the given dense row-major batch, if it is
+     * sparse enough.
+     *
+     * The non-zeros are counted first, the batch is only gathered when its
+     * density is at most max_density.
+     *
+     * \return true if the batch was built, false if it is too dense
+     */
+    bool build(const T* dense, size_t rows, size_t cols, double max_density = 1.0) {
+        this->rows = rows;
+        this->cols = cols;
+
+        col_ptr.assign(cols + 1, 0);
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* row = dense + r * cols;
+
+            for (size_t c = 0; c < cols; ++c) {
+                col_ptr[c + 1] += row[c] != T(0);
+            }
+        }
+
+        for (size_t c = 0; c < cols; ++c) {
+            col_ptr[c + 1] += col_ptr[c];
+        }
+
+        const size_t nnz = col_ptr[cols];
+
+        if (rows * cols && double(nnz) > max_density * double(rows * cols)) {
+            row_ind.clear();
+            values.clear();
+            return false;
+        }
+
+        row_ind.resize(nnz);
+        values.resize(nnz);
+
+        // The samples are visited in order, keeping them sorted in each input
+        std::vector<size_t> next(col_ptr.begin(), col_ptr.end() - 1);
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* row = dense + r * cols;
+
+            for (size_t c = 0; c < cols; ++c) {
+                if (row[c] != T(0)) {
+                    const size_t k = next[c]++;
+
+                    row_ind[k] = uint32_t(r);
+                    values[k]  = row[c];
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Returns the number of non-zeros
+     */
+    size_t non_zeros() const noexcept {
+        return values.size();
+    }
+
+    /*!
+     * \brief Returns the fraction of the batch that is non-zero
+     */
+    double density() const noexcept {
+        return rows * cols ? double(non_zeros()) / double(rows * cols) : 0.0;
+    }
+
+    /*!
+     * \brief Compute out = X * w on raw memory
+     *
+     * The outputs are computed by tiles, so that the touched part of the
+     * output stays in cache while the rows of the weights are streamed.
+     *
+     * \param out The output [rows, H]
+     * \param w The weights [cols, H]
+     * \param H The number of outputs
+     */
+    void multiply(T* out, const T* w, size_t H) const {
+        std::fill_n(out, rows * H, T(0));
+
+        for (size_t j0 = 0; j0 < H; j0 += tile) {
+            const size_t jn = std::min(tile, H - j0);
+
+            for (size_t c = 0; c < cols; ++c) {
+                const T* w_c = w + c * H + j0;
+
+                for (size_t k = col_ptr[c]; k < col_ptr[c + 1]; ++k) {
+                    const T x = values[k];
+                    T* y      = out + row_ind[k] * H + j0;
+
+                    for (size_t j = 0; j < jn; ++j) {
+                        y[j] += x * w_c[j];
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute grad = transpose(X) * h on raw memory, the sum over the
+     * samples of the outer products of the inputs and h
+     *
+     * Each row of the gradients is written a single time.
+     *
+     * \param grad The output [cols, H]
+     * \param h The right-hand side [rows, H]
+     * \param H The number of columns of h
+     */
+    void outer(T* grad, const T* h, size_t H) const {
+        for (size_t c = 0; c < cols; ++c) {
+            T* g = grad + c * H;
+
+            std::fill_n(g, H, T(0));
+
+            for (size_t k = col_ptr[c]; k < col_ptr[c + 1]; ++k) {
+                const T x    = values[k];
+                const T* h_r = h + row_ind[k] * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    g[j] += x * h_r[j];
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute output = X * w
+     * \param output The output [B, H]
+     * \param w The weights [N, H]
+     */
+    template <typename O, typename W>
+    void multiply(O&& output, const W& w) const {
+        if constexpr (!etl::is_dma<W>) {
+            auto w_t = etl::force_temporary(w);
+            multiply(output, w_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<O>>) {
+            auto output_t = etl::force_temporary(output);
+            multiply(output_t, w);
+            output = output_t;
+        } else {
+            cpp_assert(etl::dim<0>(output) == rows && etl::size(w) == cols * etl::dim<1>(output), "Invalid sizes for csc_batch::multiply");
+
+            w.ensure_cpu_up_to_date();
+
+            multiply(output.memory_start(), w.memory_start(), etl::dim<1>(output));
+
+            output.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Compute grad = transpose(X) * h, the sparse equivalent of
+     * batch_outer(X, h)
+     * \param grad The output [N, H]
+     * \param h The right-hand side [B, H]
+     */
+    template <typename G, typename H>
+    void outer(G&& grad, const H& h) const {
+        if constexpr (!etl::is_dma<H>) {
+            auto h_t = etl::force_temporary(h);
+            outer(grad, h_t);
+        } else if constexpr (!etl::is_dma<std::decay_t<G>>) {
+            auto grad_t = etl::force_temporary(grad);
+            outer(grad_t, h);
+            grad = grad_t;
+        } else {
+            cpp_assert(etl::dim<0>(h) == rows && etl::size(grad) == cols * etl::dim<1>(h), "Invalid sizes for csc_batch::outer");
+
+            h.ensure_cpu_up_to_date();
+
+            outer(grad.memory_start(), h.memory_start(), etl::dim<1>(h));
+
+            grad.invalidate_gpu();
+        }
+    }
+};
+
+/*!
+ * \brief The CSC copy of the input batch of a layer with sparse inputs,
+ * built by the forward pass and reused for the gradients.
+ */
+template <typename T>
+struct sparse_input_workspace {
+    csc_batch<T> input;    ///< The CSC copy of the input batch
+    bool measured = false; ///< Indicates if the current batch was measured by the forward pass
+    bool sparse   = false; ///< Indicates if the current batch is sparse enough (and in input)
+};
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer can be pruned
+ */
+template <typename L, typename Enable = void>
+struct is_prunable_impl : std::false_type {};
+
+/*!
+ * \copydoc is_prunable_impl
+ */
+template <typename L>
+struct is_prunable_impl<L, std::void_t<decltype(std::declval<L&>().mask)>> : std::true_type {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can be pruned
+ */
+template <typename L>
+constexpr bool is_prunable = detail::is_prunable_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Prune the weights of smallest magnitude.
+ *
+ * The mask is set to one for the kept weights and to zero for the pruned
+ * weights, which are set to zero.
+ *
+ * \param w The weights to prune
+ * \param mask The mask to fill, of the same size as the weights
+ * \param sparsity The fraction of the weights to prune, in [0, 1]
+ *
+ * \return The number of pruned weights
+ */
+template <typename W, typename M>
+size_t prune_magnitude(W& w, M& mask, double sparsity) {
+    using T = etl::value_t<W>;
+
+    const size_t n = etl::size(w);
+    const size_t p = std::min(n, size_t(std::llround(std::max(0.0, sparsity) * double(n))));
+
+    mask = T(1);
+
+    if (p == 0) {
+        return 0;
+    }
+
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+
+    // Exactly p weights are pruned, even with ties
+    std::nth_element(order.begin(), order.begin() + (p - 1), order.end(), [&w](size_t a, size_t b) {
+        return std::abs(w[a]) < std::abs(w[b]);
+    });
+
+    for (size_t i = 0; i < p; ++i) {
+        mask[order[i]] = T(0);
+        w[order[i]]    = T(0);
+    }
+
+    return p;
+}
+
+} //end of dll namespace
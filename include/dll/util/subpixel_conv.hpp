@@ -0,0 +1,346 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file subpixel_conv.hpp
+ * \brief Direct kernels of a same convolution applied on a nearest-neighbour
+ * upsampled input, without the upsampled input
+ *
+ * The input is upsampled by (U1, U2) and convolved by a same convolution
+ * (stride 1, padding P1, P2). Each output pixel (U1 * y + p, U2 * x + q)
+ * only reads low-resolution pixels, the taps of the filters reading the same
+ * low-resolution pixel being summed. For each phase (p, q), the operation is
+ * therefore a small convolution of the low-resolution input by reindexed
+ * filters of T1 x T2 taps (sub-pixel convolution). The upsampled input is
+ * never computed and each low-resolution output pixel only needs
+ * U1 * U2 * T1 * T2 multiplications (instead of U1 * U2 * NW1 * NW2).
+ *
+ * The gradients of the input are the exact gradients of the upsampling
+ * followed by the convolution, i.e. the sum of the gradients of each block
+ * of the upsampled input.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/isa.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Return the floor of the division of a by b (b > 0)
+ */
+inline std::ptrdiff_t subpixel_floor_div(std::ptrdiff_t a, std::ptrdiff_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/*!
+ * \brief The dimensions of a convolution of an upsampled input
+ */
+struct subpixel_conv_dims {
+    size_t B;   ///< The number of samples
+    size_t NC;  ///< The number of input channels
+    size_t NV1; ///< The first dimension of the input, before upsampling
+    size_t NV2; ///< The second dimension of the input, before upsampling
+    size_t K;   ///< The number of filters
+    size_t NW1; ///< The first dimension of the filters
+    size_t NW2; ///< The second dimension of the filters
+    size_t U1;  ///< The first upsampling factor
+    size_t U2;  ///< The second upsampling factor
+    size_t P1;  ///< The first padding
+    size_t P2;  ///< The second padding
+
+    size_t NH1() const { return U1 * NV1; } ///< The first dimension of the output
+    size_t NH2() const { return U2 * NV2; } ///< The second dimension of the output
+
+    /*!
+     * \brief Return the offset of the first low-resolution row read by the phase p
+     */
+    std::ptrdiff_t R0(size_t p) const {
+        return subpixel_floor_div(std::ptrdiff_t(p) - std::ptrdiff_t(P1), U1);
+    }
+
+    /*!
+     * \brief Return the offset of the first low-resolution column read by the phase q
+     */
+    std::ptrdiff_t C0(size_t q) const {
+        return subpixel_floor_div(std::ptrdiff_t(q) - std::ptrdiff_t(P2), U2);
+    }
+
+    /*!
+     * \brief Return the first dimension of the reindexed filters
+     */
+    size_t T1() const {
+        size_t t = 0;
+
+        for (size_t p = 0; p < U1; ++p) {
+            t = std::max(t, size_t(subpixel_floor_div(std::ptrdiff_t(p + NW1 - 1) - std::ptrdiff_t(P1), U1) - R0(p) + 1));
+        }
+
+        return t;
+    }
+
+    /*!
+     * \brief Return the second dimension of the reindexed filters
+     */
+    size_t T2() const {
+        size_t t = 0;
+
+        for (size_t q = 0; q < U2; ++q) {
+            t = std::max(t, size_t(subpixel_floor_div(std::ptrdiff_t(q + NW2 - 1) - std::ptrdiff_t(P2), U2) - C0(q) + 1));
+        }
+
+        return t;
+    }
+
+    /*!
+     * \brief Return the number of elements of the reindexed filters of all the phases
+     */
+    size_t phase_size() const {
+        return U1 * U2 * K * NC * T1() * T2();
+    }
+};
+
+/*!
+ * \brief Iterate over all the (original tap, reindexed tap) pairs of the
+ * sub-pixel convolution.
+ *
+ * The functor is called with the index of the element in the filters
+ * [K, NC, NW1, NW2] and with its index in the reindexed filters
+ * [U1, U2, K, NC, T1, T2].
+ */
+template <typename Functor>
+void subpixel_taps(const subpixel_conv_dims& d, Functor&& functor) {
+    const size_t T1 = d.T1();
+    const size_t T2 = d.T2();
+
+    for (size_t p = 0; p < d.U1; ++p) {
+        for (size_t q = 0; q < d.U2; ++q) {
+            for (size_t k = 0; k < d.K; ++k) {
+                for (size_t c = 0; c < d.NC; ++c) {
+                    for (size_t a = 0; a < d.NW1; ++a) {
+                        const size_t t = subpixel_floor_div(std::ptrdiff_t(p + a) - std::ptrdiff_t(d.P1), d.U1) - d.R0(p);
+
+                        for (size_t b = 0; b < d.NW2; ++b) {
+                            const size_t u = subpixel_floor_div(std::ptrdiff_t(q + b) - std::ptrdiff_t(d.P2), d.U2) - d.C0(q);
+
+                            functor(((k * d.NC + c) * d.NW1 + a) * d.NW2 + b, ((((p * d.U2 + q) * d.K + k) * d.NC + c) * T1 + t) * T2 + u);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Iterate over all the (reindexed tap, low-resolution row) pairs of
+ * the sub-pixel convolution that touch the input.
+ *
+ * For each of them, the functor is called with the indices of the input
+ * row (sample, channel, row), of the reindexed filter element, of the
+ * output row, the first low-resolution column x0 reading inside the input,
+ * the output column of x0, the input column read by x0 and the number of
+ * columns reading inside the input. The output columns are strided by U2.
+ */
+template <typename Functor>
+void subpixel_conv_loop(const subpixel_conv_dims& d, Functor&& functor) {
+    const size_t T1 = d.T1();
+    const size_t T2 = d.T2();
+
+    for (size_t b = 0; b < d.B; ++b) {
+        for (size_t p = 0; p < d.U1; ++p) {
+            for (size_t q = 0; q < d.U2; ++q) {
+                for (size_t k = 0; k < d.K; ++k) {
+                    for (size_t c = 0; c < d.NC; ++c) {
+                        for (size_t t = 0; t < T1; ++t) {
+                            const std::ptrdiff_t dy = d.R0(p) + std::ptrdiff_t(t);
+
+                            const size_t y0 = dy < 0 ? size_t(-dy) : 0;
+                            const size_t y1 = std::ptrdiff_t(d.NV1) - dy > 0 ? std::min(d.NV1, size_t(std::ptrdiff_t(d.NV1) - dy)) : 0;
+
+                            for (size_t u = 0; u < T2; ++u) {
+                                const std::ptrdiff_t dx = d.C0(q) + std::ptrdiff_t(u);
+
+                                const size_t x0 = dx < 0 ? size_t(-dx) : 0;
+                                const size_t x1 = std::ptrdiff_t(d.NV2) - dx > 0 ? std::min(d.NV2, size_t(std::ptrdiff_t(d.NV2) - dx)) : 0;
+
+                                if (x0 >= x1) {
+                                    continue;
+                                }
+
+                                const size_t f = ((((p * d.U2 + q) * d.K + k) * d.NC + c) * T1 + t) * T2 + u;
+
+                                for (size_t y = y0; y < y1; ++y) {
+                                    functor(b, c, size_t(std::ptrdiff_t(y) + dy), f, k, d.U1 * y + p, d.U2 * x0 + q, size_t(std::ptrdiff_t(x0) + dx), x1 - x0);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the reindexed filters of all the phases
+ * \param w_p The reindexed filters [U1, U2, K, NC, T1, T2]
+ * \param w The filters [K, NC, NW1, NW2]
+ */
+template <typename T>
+void subpixel_filters(T* w_p, const T* w, const subpixel_conv_dims& d) {
+    std::fill_n(w_p, d.phase_size(), T(0));
+
+    subpixel_taps(d, [&](size_t i, size_t j) { w_p[j] += w[i]; });
+}
+
+/*!
+ * \brief Compute the forward convolution of the upsampled input on raw memory
+ * \param out The output [B, K, U1 * NV1, U2 * NV2]
+ * \param in The input [B, NC, NV1, NV2]
+ * \param w_p The reindexed filters [U1, U2, K, NC, T1, T2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void subpixel_conv_forward(T* out, const T* in, const T* w_p, const subpixel_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    std::fill_n(out, d.B * d.K * NH1 * NH2, T(0));
+
+    subpixel_conv_loop(d, [&](size_t b, size_t c, size_t r, size_t f, size_t k, size_t i, size_t j0, size_t x0, size_t n) {
+        const T* x_row = in + ((b * d.NC + c) * d.NV1 + r) * d.NV2 + x0;
+        T* o_row       = out + ((b * d.K + k) * NH1 + i) * NH2 + j0;
+
+        grouped_conv_axpy_strided(o_row, x_row, w_p[f], n, d.U2);
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the input (before upsampling) on raw memory
+ * \param d_in The gradients of the input [B, NC, NV1, NV2]
+ * \param d_out The gradients of the output [B, K, U1 * NV1, U2 * NV2]
+ * \param w_p The reindexed filters [U1, U2, K, NC, T1, T2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void subpixel_conv_backward(T* d_in, const T* d_out, const T* w_p, const subpixel_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    std::fill_n(d_in, d.B * d.NC * d.NV1 * d.NV2, T(0));
+
+    subpixel_conv_loop(d, [&](size_t b, size_t c, size_t r, size_t f, size_t k, size_t i, size_t j0, size_t x0, size_t n) {
+        T* x_row       = d_in + ((b * d.NC + c) * d.NV1 + r) * d.NV2 + x0;
+        const T* e_row = d_out + ((b * d.K + k) * NH1 + i) * NH2 + j0;
+
+        grouped_conv_axpy(x_row, e_row, w_p[f], n, d.U2);
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the reindexed filters on raw memory
+ * \param d_w_p The gradients of the reindexed filters [U1, U2, K, NC, T1, T2]
+ * \param in The input [B, NC, NV1, NV2]
+ * \param d_out The gradients of the output [B, K, U1 * NV1, U2 * NV2]
+ */
+template <typename T>
+DLL_MULTI_ISA_KERNEL void subpixel_conv_backward_filter(T* d_w_p, const T* in, const T* d_out, const subpixel_conv_dims& d) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    std::fill_n(d_w_p, d.phase_size(), T(0));
+
+    subpixel_conv_loop(d, [&](size_t b, size_t c, size_t r, size_t f, size_t k, size_t i, size_t j0, size_t x0, size_t n) {
+        const T* x_row = in + ((b * d.NC + c) * d.NV1 + r) * d.NV2 + x0;
+        const T* e_row = d_out + ((b * d.K + k) * NH1 + i) * NH2 + j0;
+
+        d_w_p[f] += grouped_conv_dot(e_row, x_row, n, d.U2);
+    });
+}
+
+/*!
+ * \brief Return the reindexed filters buffer of the current thread
+ */
+template <typename T>
+std::vector<T>& subpixel_buffer(const subpixel_conv_dims& d) {
+    thread_local std::vector<T> buffer;
+
+    buffer.resize(d.phase_size());
+
+    return buffer;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Compute the same convolution of the nearest-neighbour upsampled input
+ * \param out The output [B, K, U1 * NV1, U2 * NV2]
+ * \param in The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param w The filters [K, NC, NW1, NW2]
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename I, typename W>
+void subpixel_conv_forward(O&& out, const I& in, const W& w, const detail::subpixel_conv_dims& d) {
+    detail::grouped_conv_apply([&d](auto* o, const auto* x, const auto* f) {
+        auto& w_p = detail::subpixel_buffer<std::decay_t<decltype(*f)>>(d);
+
+        detail::subpixel_filters(w_p.data(), f, d);
+        detail::subpixel_conv_forward(o, x, w_p.data(), d);
+    }, out, in, w);
+}
+
+/*!
+ * \brief Compute the gradients of the input of the upsampling followed by
+ * the same convolution
+ * \param d_in The gradients of the input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param d_out The gradients of the output [B, K, U1 * NV1, U2 * NV2]
+ * \param w The filters [K, NC, NW1, NW2]
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename E, typename W>
+void subpixel_conv_backward(O&& d_in, const E& d_out, const W& w, const detail::subpixel_conv_dims& d) {
+    detail::grouped_conv_apply([&d](auto* x, const auto* e, const auto* f) {
+        auto& w_p = detail::subpixel_buffer<std::decay_t<decltype(*f)>>(d);
+
+        detail::subpixel_filters(w_p.data(), f, d);
+        detail::subpixel_conv_backward(x, e, w_p.data(), d);
+    }, d_in, d_out, w);
+}
+
+/*!
+ * \brief Compute the gradients of the filters of the same convolution of
+ * the upsampled input
+ * \param d_w The gradients of the filters [K, NC, NW1, NW2]
+ * \param in The input [B, NC, NV1, NV2] (or any view of the same size)
+ * \param d_out The gradients of the output [B, K, U1 * NV1, U2 * NV2]
+ * \param d The dimensions of the convolution
+ */
+template <typename O, typename I, typename E>
+void subpixel_conv_backward_filter(O&& d_w, const I& in, const E& d_out, const detail::subpixel_conv_dims& d) {
+    detail::grouped_conv_apply([&d](auto* f, const auto* x, const auto* e) {
+        using T = std::decay_t<decltype(*f)>;
+
+        auto& d_w_p = detail::subpixel_buffer<T>(d);
+
+        detail::subpixel_conv_backward_filter(d_w_p.data(), x, e, d);
+
+        // Each tap of the filters has been used in every phase
+        std::fill_n(f, d.K * d.NC * d.NW1 * d.NW2, T(0));
+
+        detail::subpixel_taps(d, [&](size_t i, size_t j) { f[i] += d_w_p[j]; });
+    }, d_w, in, d_out);
+}
+
+} //end of dll namespace
@@ -0,0 +1,317 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file throughput.hpp
+ * \brief Throughput of the training, reported by a background thread
+ *
+ * The training thread pushes a record per batch and per epoch into a
+ * bounded lock-free queue and never waits for the reporting: when the
+ * queue is full, the record is dropped and counted. A reporter thread
+ * drains the queue, sums the batches of each epoch and writes one line per
+ * epoch on a stream and, optionally, in a CSV file that an external
+ * collector can follow.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/util/batch_phases.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A bounded lock-free queue between one producer and one consumer.
+ *
+ * The producer only writes the tail and the consumer only writes the
+ * head, so that each side publishes its progress with a release store.
+ *
+ * \tparam T The type of the values
+ * \tparam N The capacity of the queue (a power of two)
+ */
+template <typename T, size_t N>
+struct spsc_queue {
+    static_assert(N && (N & (N - 1)) == 0, "The capacity of spsc_queue must be a power of two");
+
+    /*!
+     * \brief Push a value. Only called by the producer.
+     * \return true if the value was pushed, false if the queue is full
+     */
+    bool push(const T& value) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+
+        if (t - head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+
+        values[t % N] = value;
+        tail.store(t + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /*!
+     * \brief Pop a value. Only called by the consumer.
+     * \return true if a value was popped, false if the queue is empty
+     */
+    bool pop(T& value) {
+        const size_t h = head.load(std::memory_order_relaxed);
+
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = values[h % N];
+        head.store(h + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    std::array<T, N> values;                 ///< The storage of the values
+    alignas(64) std::atomic<size_t> head{0}; ///< The number of popped values
+    alignas(64) std::atomic<size_t> tail{0}; ///< The number of pushed values
+};
+
+/*!
+ * \brief A record of the training, for a batch or for the end of an epoch
+ */
+struct throughput_record {
+    bool end_of_epoch = false; ///< Indicates if the record ends an epoch
+    size_t epoch      = 0;     ///< The epoch
+    size_t samples    = 0;     ///< The samples of the batch
+    batch_phases phases;       ///< The phases of the batch
+    double error = 0.0;        ///< The error of the epoch
+    double loss  = 0.0;        ///< The loss of the epoch
+};
+
+/*!
+ * \brief The throughput of one epoch
+ */
+struct epoch_throughput {
+    size_t epoch   = 0;  ///< The epoch
+    size_t batches = 0;  ///< The number of batches
+    size_t samples = 0;  ///< The number of samples
+    batch_phases phases; ///< The sum of the phases of the batches
+    double error = 0.0;  ///< The error of the epoch
+    double loss  = 0.0;  ///< The loss of the epoch
+
+    /*!
+     * \brief Returns the time of the batches, waits included (seconds)
+     */
+    double seconds() const {
+        return phases.wait + phases.compute;
+    }
+
+    /*!
+     * \brief Returns the number of samples trained per second
+     */
+    double samples_per_second() const {
+        return seconds() > 0.0 ? samples / seconds() : 0.0;
+    }
+
+    /*!
+     * \brief Returns the given time as a percentage of the time of the batches
+     */
+    double percent(double time) const {
+        return seconds() > 0.0 ? 100.0 * time / seconds() : 0.0;
+    }
+};
+
+/*!
+ * \brief Sums the records of the training in a background thread and
+ * reports the throughput of each epoch.
+ */
+struct throughput_reporter {
+    static constexpr size_t capacity = 4096; ///< The capacity of the queue
+
+    std::ostream* out = &std::cout; ///< The stream of the report (none if nullptr)
+    std::string csv_file;           ///< The CSV file of the report (none if empty)
+
+    throughput_reporter() = default;
+
+    throughput_reporter(const throughput_reporter& rhs) = delete;
+    throughput_reporter& operator=(const throughput_reporter& rhs) = delete;
+
+    /*!
+     * \brief Stop the reporting thread, if necessary
+     */
+    ~throughput_reporter() {
+        stop();
+    }
+
+    /*!
+     * \brief Start the reporting thread
+     */
+    void start() {
+        stop();
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            epochs.clear();
+        }
+
+        current = epoch_throughput();
+        dropped = 0;
+        done    = false;
+
+        if (!csv_file.empty()) {
+            csv.open(csv_file);
+            csv << "epoch,batches,samples,samples_per_second,wait,forward,backward,update,compute,error,loss\n";
+        }
+
+        thread = std::thread([this] { run(); });
+    }
+
+    /*!
+     * \brief Push a record, without waiting. Only called by the training thread.
+     */
+    void push(const throughput_record& record) {
+        if (!queue.push(record)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+     * \brief Report the remaining records and stop the reporting thread
+     */
+    void stop() {
+        if (thread.joinable()) {
+            done = true;
+            thread.join();
+        }
+
+        if (csv.is_open()) {
+            csv.close();
+        }
+    }
+
+    /*!
+     * \brief Returns the throughput of the reported epochs
+     */
+    std::vector<epoch_throughput> history() const {
+        std::lock_guard<std::mutex> l(lock);
+        return epochs;
+    }
+
+    /*!
+     * \brief Returns the number of records that were dropped because the
+     * queue was full
+     */
+    size_t dropped_records() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    /*!
+     * \brief Drain the queue until the reporter is stopped
+     */
+    void run() {
+        throughput_record record;
+
+        while (true) {
+            // The flag must be read before the last drain
+            const bool last = done.load(std::memory_order_acquire);
+
+            while (queue.pop(record)) {
+                consume(record);
+            }
+
+            if (last) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /*!
+     * \brief Add a record to the current epoch, reporting it at its end
+     */
+    void consume(const throughput_record& record) {
+        if (!record.end_of_epoch) {
+            current.epoch = record.epoch;
+            ++current.batches;
+            current.samples += record.samples;
+            current.phases.wait += record.phases.wait;
+            current.phases.forward += record.phases.forward;
+            current.phases.backward += record.phases.backward;
+            current.phases.update += record.phases.update;
+            current.phases.compute += record.phases.compute;
+
+            return;
+        }
+
+        current.epoch = record.epoch;
+        current.error = record.error;
+        current.loss  = record.loss;
+
+        report(current);
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            epochs.push_back(current);
+        }
+
+        current = epoch_throughput();
+    }
+
+    /*!
+     * \brief Report the throughput of one epoch
+     */
+    void report(const epoch_throughput& e) {
+        auto& p = e.phases;
+
+        if (out) {
+            char buffer[512];
+
+            // The trend is relative to the previous epoch
+            double trend = 0.0;
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                if (!epochs.empty() && epochs.back().samples_per_second() > 0.0) {
+                    trend = 100.0 * (e.samples_per_second() / epochs.back().samples_per_second() - 1.0);
+                }
+            }
+
+            snprintf(buffer, sizeof(buffer),
+                     "epoch %3zu - %10.1f samples/s (%+6.1f%%) - wait %5.1f%% forward %5.1f%% backward %5.1f%% update %5.1f%% - error: %.5f loss: %.5f",
+                     e.epoch, e.samples_per_second(), trend, e.percent(p.wait), e.percent(p.forward), e.percent(p.backward), e.percent(p.update), e.error, e.loss);
+
+            *out << buffer << std::endl;
+        }
+
+        if (csv.is_open()) {
+            csv << e.epoch << ',' << e.batches << ',' << e.samples << ',' << e.samples_per_second() << ','
+                << p.wait << ',' << p.forward << ',' << p.backward << ',' << p.update << ',' << p.compute << ','
+                << e.error << ',' << e.loss << std::endl;
+        }
+    }
+
+    spsc_queue<throughput_record, capacity> queue; ///< The queue of the records
+    std::thread thread;                            ///< The reporting thread
+    std::atomic<bool> done{false};                 ///< Indicates that the reporting must stop
+    std::atomic<size_t> dropped{0};                ///< The number of dropped records
+    epoch_throughput current;                      ///< The current epoch (reporting thread)
+    std::vector<epoch_throughput> epochs;          ///< The reported epochs
+    std::ofstream csv;                             ///< The CSV output
+    mutable std::mutex lock;                       ///< The lock of the reported epochs
+};
+
+} //end of dll namespace
@@ -0,0 +1,207 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file throughput_tuner.hpp
+ * \brief Tuning of the batch size and of the number of compute threads
+ *
+ * The best batch size and number of threads for the training throughput
+ * depend on the network and on the machine. The tuner runs short timed
+ * bursts of training for each candidate batch size and number of
+ * threads, skipping the batch sizes whose predicted memory (see
+ * memory_report.hpp) exceeds a limit, and keeps the setting with the most
+ * samples per second.
+ *
+ * The batch size is part of the type of a network: the candidates are the
+ * instantiations of a network template for each batch size, and the best
+ * one is reported as a descriptor option. The number of threads is the
+ * number of active workers of the scheduler, which can be applied
+ * directly.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/memory_report.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The throughput of one setting of the tuning
+ */
+struct tuning_point {
+    size_t batch_size         = 0;     ///< The batch size
+    size_t threads            = 0;     ///< The number of compute threads
+    size_t memory             = 0;     ///< The predicted memory of the training, in bytes
+    bool fits                 = false; ///< Indicates if the memory is within the limit
+    double samples_per_second = 0.0;   ///< The measured throughput (0 if not measured)
+};
+
+/*!
+ * \brief The results of a tuning
+ */
+struct tuning_results {
+    std::vector<tuning_point> points; ///< All the settings
+    tuning_point best;                ///< The setting with the best throughput
+
+    /*!
+     * \brief Returns the descriptor option of the best batch size (empty if
+     * no candidate fits in memory)
+     */
+    std::string descriptor() const {
+        if (!best.batch_size) {
+            return {};
+        }
+
+        return "dll::batch_size<" + std::to_string(best.batch_size) + ">";
+    }
+
+    /*!
+     * \brief Use the best number of threads for the next trainings
+     */
+    void apply() const {
+        if (best.threads) {
+            scheduler::instance().set_active_workers(best.threads - 1);
+        }
+    }
+
+    /*!
+     * \brief Print the results on the given stream
+     */
+    void print(std::ostream& os = std::cout) const {
+        for (auto& point : points) {
+            os << "batch_size=" << point.batch_size << " threads=" << point.threads << " memory=" << memory_usage::memory_str(point.memory);
+
+            if (point.fits) {
+                os << " samples/s=" << point.samples_per_second << '\n';
+            } else {
+                os << " (over the memory limit)\n";
+            }
+        }
+
+        os << "Best: " << descriptor() << " with DLL_COMPUTE_THREADS=" << best.threads << " (" << best.samples_per_second << " samples/s)" << std::endl;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Measure the training throughput of a new network of the given
+ * type, for each number of threads.
+ */
+template <typename DBN, typename Inputs, typename Labels>
+void tune_network(tuning_results& results, const Inputs& inputs, const Labels& labels, const std::vector<size_t>& threads, size_t memory_limit, double seconds) {
+    using dbn_t     = DBN;
+    using trainer_t = typename dbn_t::desc::template trainer_t<dbn_t>;
+
+    constexpr size_t B = dbn_t::batch_size;
+
+    cpp_assert(B <= etl::dim<0>(inputs), "The tuning needs at least one batch of each candidate size");
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    const size_t memory = dbn->memory_report().total();
+    const bool fits     = !memory_limit || memory <= memory_limit;
+
+    if (!fits) {
+        for (size_t t : threads) {
+            results.points.push_back({B, t, memory, false, 0.0});
+        }
+
+        return;
+    }
+
+    auto batch_inputs = etl::slice(inputs, 0, B);
+    auto batch_labels = etl::slice(labels, 0, B);
+
+    trainer_t trainer(*dbn);
+    trainer.init_training(B);
+
+    // The first batch allocates and warms up the contexts
+    trainer.train_batch(0, batch_inputs, batch_labels);
+
+    auto& s = scheduler::instance();
+
+    for (size_t t : threads) {
+        s.set_active_workers(t ? t - 1 : 0);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        size_t batches = 0;
+        double elapsed = 0.0;
+
+        while (batches < 2 || elapsed < seconds) {
+            trainer.train_batch(0, batch_inputs, batch_labels);
+
+            ++batches;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        const double throughput = batches * B / elapsed;
+
+        results.points.push_back({B, t, memory, true, throughput});
+
+        if (throughput > results.best.samples_per_second) {
+            results.best = results.points.back();
+        }
+    }
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Find the batch size and the number of compute threads giving the
+ * best training throughput.
+ *
+ * The weights of the networks created for the tuning are discarded. The
+ * number of active workers of the scheduler is restored at the end, the
+ * best setting can then be applied with tuning_results::apply().
+ *
+ * \tparam Network The network template, for a batch size
+ * \tparam B The candidate batch sizes
+ * \param inputs A batch of training inputs, of at least the largest candidate batch size
+ * \param labels The labels of the inputs
+ * \param threads The candidate numbers of compute threads (all the compute threads if empty)
+ * \param memory_limit The maximum predicted memory of the training, in bytes (0 for no limit)
+ * \param seconds The duration of each burst of training
+ *
+ * \return the throughput of each setting and the best one
+ */
+template <template <size_t> typename Network, size_t... B, typename Inputs, typename Labels>
+tuning_results tune_throughput(const Inputs& inputs, const Labels& labels, std::vector<size_t> threads = {}, size_t memory_limit = 0, double seconds = 0.5) {
+    static_assert(sizeof...(B) > 0, "At least one batch size must be tuned");
+
+    static dll::timer_id timer_handle("net:tune_throughput");
+    dll::auto_timer timer(timer_handle);
+
+    auto& s = scheduler::instance();
+
+    const size_t active = s.active_workers();
+
+    if (threads.empty()) {
+        threads.push_back(s.workers() + 1);
+    }
+
+    tuning_results results;
+
+    (detail::tune_network<Network<B>>(results, inputs, labels, threads, memory_limit, seconds), ...);
+
+    s.set_active_workers(active);
+
+    return results;
+}
+
+} //end of dll namespace
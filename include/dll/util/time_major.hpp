@@ -0,0 +1,262 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file time_major.hpp
+ * \brief Conversions between the batches of sequences and the per-step
+ * caches of the recurrent layers
+ *
+ * The recurrent layers compute on caches holding one matrix per time step,
+ * with the samples sorted by decreasing length (see sequence_mask). A batch
+ * of sequences is normally batch-major: sample b, step t is at (b, t). A
+ * time-major batch keeps the same shape, but its memory holds the steps one
+ * after the other, each with the samples in the order of the mask, i.e.
+ * the layout of the caches with exactly Batch rows per step. Converting a
+ * time-major batch is a contiguous copy per step instead of a gather of
+ * every (sample, step) row, and consecutive recurrent layers can exchange
+ * time-major batches (time_major_input / time_major_output) so that only
+ * the boundaries of the recurrent stack rearrange the samples.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/sequence_mask.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Copy a batch of sequences into a per-step cache.
+ *
+ * Only the steps of the active samples are copied.
+ *
+ * \tparam TimeMajor Indicates if the batch is time-major
+ * \param x_t The cache (time_steps x rows x features, with rows >= Batch)
+ * \param x The batch (Batch x time_steps x features)
+ * \param mask The mask of the batch, prepared
+ * \param time_steps The number of time steps
+ */
+template <bool TimeMajor, typename T, typename X>
+void to_time_steps(T& x_t, const X& x, const sequence_mask& mask, size_t time_steps) {
+    const size_t Batch = etl::dim<0>(x);
+
+    if constexpr (TimeMajor) {
+        if (!Batch) {
+            return;
+        }
+
+        const size_t features = etl::size(x) / (Batch * time_steps);
+        const size_t rows     = etl::dim<1>(x_t);
+
+        x.ensure_cpu_up_to_date();
+        x_t.ensure_cpu_up_to_date();
+
+        for (size_t t = 0; t < time_steps && mask.active[t]; ++t) {
+            std::copy_n(x.memory_start() + t * Batch * features, mask.active[t] * features, x_t.memory_start() + t * rows * features);
+        }
+
+        x_t.invalidate_gpu();
+    } else {
+        for (size_t r = 0; r < Batch; ++r) {
+            const size_t bb     = mask.order[r];
+            const size_t length = mask.length(bb, time_steps);
+
+            for (size_t t = 0; t < length; ++t) {
+                x_t(t)(r) = x(bb)(t);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Copy a per-step cache into a batch of sequences.
+ *
+ * The padding steps of the batch are set to zero.
+ *
+ * \tparam TimeMajor Indicates if the batch is time-major
+ * \param y The batch (Batch x time_steps x features)
+ * \param x_t The cache (time_steps x rows x features, with rows >= Batch)
+ * \param mask The mask of the batch, prepared
+ * \param time_steps The number of time steps
+ */
+template <bool TimeMajor, typename Y, typename T>
+void from_time_steps(Y&& y, const T& x_t, const sequence_mask& mask, size_t time_steps) {
+    const size_t Batch = etl::dim<0>(y);
+
+    if constexpr (TimeMajor) {
+        if (!Batch) {
+            return;
+        }
+
+        const size_t features = etl::size(y) / (Batch * time_steps);
+        const size_t rows     = etl::dim<1>(x_t);
+
+        x_t.ensure_cpu_up_to_date();
+
+        auto* out = y.memory_start();
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            const size_t n = mask.active[t];
+
+            std::copy_n(x_t.memory_start() + t * rows * features, n * features, out + t * Batch * features);
+            std::fill_n(out + (t * Batch + n) * features, (Batch - n) * features, 0);
+        }
+
+        y.invalidate_gpu();
+    } else {
+        for (size_t r = 0; r < Batch; ++r) {
+            const size_t bb     = mask.order[r];
+            const size_t length = mask.length(bb, time_steps);
+
+            for (size_t t = 0; t < length; ++t) {
+                y(bb)(t) = x_t(t)(r);
+            }
+
+            for (size_t t = length; t < time_steps; ++t) {
+                y(bb)(t) = 0;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Copy one time step of a batch of full-length sequences.
+ *
+ * \tparam TimeMajor Indicates if the batch is time-major
+ * \param frame The inputs of the step (Batch x features)
+ * \param x The batch (Batch x time_steps x features)
+ * \param t The time step to copy
+ * \param time_steps The number of time steps
+ */
+template <bool TimeMajor, typename F, typename X>
+void copy_time_step(F& frame, const X& x, size_t t, size_t time_steps) {
+    const size_t Batch = etl::dim<0>(x);
+
+    if constexpr (TimeMajor) {
+        if (!Batch) {
+            return;
+        }
+
+        const size_t features = etl::size(x) / (Batch * time_steps);
+
+        x.ensure_cpu_up_to_date();
+
+        std::copy_n(x.memory_start() + t * Batch * features, Batch * features, frame.memory_start());
+
+        frame.invalidate_gpu();
+    } else {
+        for (size_t b = 0; b < Batch; ++b) {
+            frame(b) = x(b)(t);
+        }
+    }
+}
+
+/*!
+ * \brief Select the last true step of each sample of a batch of sequences.
+ *
+ * The empty samples select zero.
+ *
+ * \tparam TimeMajor Indicates if the batch is time-major
+ * \param y The selected steps (Batch x features)
+ * \param x The batch (Batch x time_steps x features)
+ * \param mask The mask of the batch, prepared if the batch is time-major
+ * \param time_steps The number of time steps
+ */
+template <bool TimeMajor, typename Y, typename X>
+void select_last_steps(Y&& y, const X& x, const sequence_mask& mask, size_t time_steps) {
+    const size_t Batch = etl::dim<0>(x);
+
+    if constexpr (TimeMajor) {
+        if (!Batch) {
+            return;
+        }
+
+        const size_t features = etl::size(y) / Batch;
+
+        x.ensure_cpu_up_to_date();
+
+        auto* out = y.memory_start();
+
+        for (size_t r = 0; r < Batch; ++r) {
+            const size_t bb     = mask.order[r];
+            const size_t length = mask.length(bb, time_steps);
+
+            if (length) {
+                std::copy_n(x.memory_start() + ((length - 1) * Batch + r) * features, features, out + bb * features);
+            } else {
+                std::fill_n(out + bb * features, features, 0);
+            }
+        }
+
+        y.invalidate_gpu();
+    } else {
+        for (size_t b = 0; b < Batch; ++b) {
+            const size_t length = mask.length(b, time_steps);
+
+            if (length) {
+                y(b) = x(b)(length - 1);
+            } else {
+                y(b) = 0;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Place the errors of the last true step of each sample into a
+ * batch of sequences, the other steps are set to zero.
+ *
+ * \tparam TimeMajor Indicates if the batch is time-major
+ * \param y The batch (Batch x time_steps x features)
+ * \param errors The errors of the last steps (Batch x features)
+ * \param mask The mask of the batch, prepared if the batch is time-major
+ * \param time_steps The number of time steps
+ */
+template <bool TimeMajor, typename Y, typename E>
+void expand_last_steps(Y&& y, const E& errors, const sequence_mask& mask, size_t time_steps) {
+    const size_t Batch = etl::dim<0>(y);
+
+    if constexpr (TimeMajor) {
+        if (!Batch) {
+            return;
+        }
+
+        const size_t features = etl::size(errors) / Batch;
+
+        errors.ensure_cpu_up_to_date();
+
+        auto* out = y.memory_start();
+
+        std::fill_n(out, etl::size(y), 0);
+
+        for (size_t r = 0; r < Batch; ++r) {
+            const size_t bb     = mask.order[r];
+            const size_t length = mask.length(bb, time_steps);
+
+            if (length) {
+                std::copy_n(errors.memory_start() + bb * features, features, out + ((length - 1) * Batch + r) * features);
+            }
+        }
+
+        y.invalidate_gpu();
+    } else {
+        y = 0;
+
+        for (size_t b = 0; b < Batch; ++b) {
+            const size_t length = mask.length(b, time_steps);
+
+            if (length) {
+                y(b)(length - 1) = errors(b);
+            }
+        }
+    }
+}
+
+} //end of dll namespace
@@ -11,9 +11,23 @@
 
 #ifndef DLL_NO_TIMERS
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <iosfwd>
 #include <iomanip>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <vector>
+
+#include "dll/util/trace.hpp"
+
+#ifdef DLL_PERF_COUNTERS
+#include "dll/util/perf_counters.hpp"
+#endif
 
 #endif
 
@@ -70,88 +84,228 @@ inline void dump_timers_pretty() {
     std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
 }
 
+/*!
+ * \brief Set the sampling period of the timers.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void set_timer_sampling(size_t /*period*/) {}
+
+/*!
+ * \brief Returns the sampling period of the timers
+ */
+inline size_t timer_sampling() {
+    return 1;
+}
+
+struct timer_id {
+    explicit constexpr timer_id(const char* /*name*/) {}
+};
+
 struct auto_timer {
+    auto_timer(const timer_id& /*handle*/) {}
     auto_timer(const char* /*name*/) {}
 };
 
-struct unsafe_auto_timer {
-    unsafe_auto_timer(const char* /*name*/) {}
-};
+using unsafe_auto_timer = auto_timer;
 
 #else
 
 constexpr size_t max_timers = 128; ///< The maximum number of timers
 
 /*!
- * \brief A timer
+ * \brief The handle of a timer, resolved once per call site.
+ *
+ * A call site keeps its handle in a static local variable, so that its
+ * timer is registered on the first execution and never looked up again:
+ *
+ *     static dll::timer_id timer_id("layer:forward_batch");
+ *     dll::auto_timer timer(timer_id);
  */
-struct timer_t {
-    const char* name;             ///< The name of the timer
-    std::atomic<size_t> count;    ///< The number of times it was incremented
-    std::atomic<size_t> duration; ///< The total duration
+struct timer_id {
+    size_t id; ///< The index of the timer, max_timers if it could not be registered
 
     /*!
-     * \brief Initialize an empty counter
+     * \brief Register (or find) the timer with the given name
      */
-    timer_t()
-            : name(nullptr), count(0), duration(0) {}
+    explicit timer_id(const char* name);
+};
+
+/*!
+ * \brief The value of a timer, aggregated over all the threads
+ */
+struct timer_t {
+    const char* name = nullptr; ///< The name of the timer
+    size_t count     = 0;       ///< The number of times it was incremented
+    size_t duration  = 0;       ///< The total duration
+
+#ifdef DLL_PERF_COUNTERS
+    size_t counters[perf_events] = {}; ///< The total of each hardware counter
+#endif
+};
+
+/*!
+ * \brief The counters of the timers for one thread.
+ *
+ * Only the owner thread writes a shard, so the counters are updated without
+ * any atomic read-modify-write. They are only atomic so that they can be
+ * read while the owner is running.
+ */
+struct timer_shard {
+    std::array<std::atomic<size_t>, max_timers> count    = {}; ///< The number of increments of each timer
+    std::array<std::atomic<size_t>, max_timers> duration = {}; ///< The total duration of each timer
+    std::array<size_t, max_timers> calls                 = {}; ///< The number of invocations of each timer, for sampling
+    std::atomic<bool> used{true};                             ///< Indicates if a thread owns the shard
+
+#ifdef DLL_PERF_COUNTERS
+    std::array<std::array<std::atomic<size_t>, perf_events>, max_timers> counters = {}; ///< The hardware counters of each timer
+#endif
 
     /*!
-     * \brief Copy a timer
+     * \brief Add a duration to the given timer, standing for scale invocations
      */
-    timer_t(const timer_t& rhs)
-            : name(rhs.name), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    void add(size_t id, size_t d, size_t scale = 1) {
+        count[id].store(count[id].load(std::memory_order_relaxed) + scale, std::memory_order_relaxed);
+        duration[id].store(duration[id].load(std::memory_order_relaxed) + d * scale, std::memory_order_relaxed);
+    }
 
+#ifdef DLL_PERF_COUNTERS
     /*!
-     * \brief Copy assign a timer
+     * \brief Add the hardware counts to the given timer
      */
-    timer_t& operator=(const timer_t& rhs) {
-        if (&rhs != this) {
-            name     = rhs.name;
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    void add_counters(size_t id, const uint64_t* counts, size_t scale = 1) {
+        for (size_t e = 0; e < perf_events; ++e) {
+            counters[id][e].store(counters[id][e].load(std::memory_order_relaxed) + counts[e] * scale, std::memory_order_relaxed);
         }
+    }
+#endif
+};
 
-        return *this;
+/*!
+ * \brief The structure holding all the timers
+ *
+ * The names are stored in an open-addressing table indexed by their hash
+ * and inserted without lock. The counters are sharded by thread and only
+ * summed when they are dumped. The shards of the finished threads are
+ * reused by the next threads, since the thread pools are often recreated.
+ *
+ * With a sampling period of N (DLL_TIMER_SAMPLING or set_timer_sampling),
+ * only one invocation over N of each call site is timed, by each thread,
+ * and stands for N invocations: the counts and the durations are
+ * estimates, scaled by N.
+ */
+struct timers_t {
+    std::array<std::atomic<const char*>, max_timers> names = {}; ///< The names of the timers
+    std::vector<std::unique_ptr<timer_shard>> shards;           ///< The counters of all the threads
+    std::mutex lock;                                           ///< The lock to protect the list of shards
+    std::atomic<size_t> period{1};                             ///< The sampling period of the timers
+
+    timers_t() {
+        if (auto* env = std::getenv("DLL_TIMER_SAMPLING")) {
+            period = std::max<size_t>(std::strtoul(env, nullptr, 10), 1);
+        }
     }
 
     /*!
-     * \brief Move construct a timer
+     * \brief Returns the index of the timer with the given name, registering
+     * it if necessary, or max_timers if there are no more timers
      */
-    timer_t(timer_t&& rhs)
-            : name(std::move(rhs.name)), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    size_t find(const char* name) {
+        // FNV-1a hash of the name, the same name in two translation units is the same timer
+        size_t hash = 14695981039346656037ULL;
+
+        for (const char* c = name; *c; ++c) {
+            hash = (hash ^ size_t(static_cast<unsigned char>(*c))) * 1099511628211ULL;
+        }
+
+        for (size_t probe = 0; probe < max_timers; ++probe) {
+            const size_t i = (hash + probe) % max_timers;
+
+            const char* current = names[i].load(std::memory_order_acquire);
+
+            if (!current && names[i].compare_exchange_strong(current, name, std::memory_order_acq_rel)) {
+                return i;
+            }
+
+            if (current == name || !std::strcmp(current, name)) {
+                return i;
+            }
+        }
+
+        std::cerr << "Unable to register timer " << name << std::endl;
+
+        return max_timers;
+    }
 
     /*!
-     * \brief Move assign a timer
+     * \brief Returns a free shard for a new thread
      */
-    timer_t& operator=(timer_t&& rhs) {
-        if (&rhs != this) {
-            name     = std::move(rhs.name);
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    timer_shard* acquire() {
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& shard : shards) {
+            bool used = false;
+
+            if (shard->used.compare_exchange_strong(used, true)) {
+                return shard.get();
+            }
         }
 
-        return *this;
+        shards.emplace_back(std::make_unique<timer_shard>());
+
+        return shards.back().get();
     }
-};
 
-/*!
- * \brief The structure holding all the timers
- */
-struct timers_t {
-    std::array<timer_t, max_timers> timers; ///< The timers
-    std::mutex lock; ///< The lock to protect the timers
+    /*!
+     * \brief Returns the value of the used timers, summed over all the threads
+     */
+    std::vector<timer_t> collect() {
+        std::vector<timer_t> timers;
+
+        std::lock_guard<std::mutex> l(lock);
+
+        for (size_t i = 0; i < max_timers; ++i) {
+            timer_t timer;
+            timer.name = names[i].load(std::memory_order_acquire);
+
+            for (auto& shard : shards) {
+                timer.count += shard->count[i].load(std::memory_order_relaxed);
+                timer.duration += shard->duration[i].load(std::memory_order_relaxed);
+
+#ifdef DLL_PERF_COUNTERS
+                for (size_t e = 0; e < perf_events; ++e) {
+                    timer.counters[e] += shard->counters[i][e].load(std::memory_order_relaxed);
+                }
+#endif
+            }
+
+            if (timer.name && timer.count) {
+                timers.push_back(timer);
+            }
+        }
+
+        return timers;
+    }
 
     /*!
      * \brief Reset the status of the timers
+     *
+     * The names are kept since the call sites keep their handles.
      */
     void reset(){
         std::lock_guard<std::mutex> l(lock);
 
-        for(auto& timer : timers){
-            timer.name = nullptr;
-            timer.duration = 0;
-            timer.count = 0;
+        for (auto& shard : shards) {
+            for (size_t i = 0; i < max_timers; ++i) {
+                shard->count[i]    = 0;
+                shard->duration[i] = 0;
+
+#ifdef DLL_PERF_COUNTERS
+                for (auto& counter : shard->counters[i]) {
+                    counter = 0;
+                }
+#endif
+            }
         }
     }
 };
@@ -164,6 +318,45 @@ inline timers_t& get_timers() {
     return timers;
 }
 
+inline timer_id::timer_id(const char* name) : id(get_timers().find(name)) {}
+
+/*!
+ * \brief Set the sampling period of the timers: only one invocation over
+ * period of each call site is timed (1 to time all the invocations).
+ */
+inline void set_timer_sampling(size_t period) {
+    get_timers().period.store(std::max<size_t>(period, 1), std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the sampling period of the timers
+ */
+inline size_t timer_sampling() {
+    return get_timers().period.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief The owner of the shard of the current thread, that releases it
+ * when the thread ends
+ */
+struct timer_shard_owner {
+    timer_shard* shard; ///< The shard of the thread
+
+    timer_shard_owner() : shard(get_timers().acquire()) {}
+
+    ~timer_shard_owner() {
+        shard->used = false;
+    }
+};
+
+/*!
+ * \brief Get the shard of the current thread
+ */
+inline timer_shard& local_timer_shard() {
+    static thread_local timer_shard_owner owner;
+    return *owner.shard;
+}
+
 inline std::string to_string_precision(double duration, int precision = 6) {
     std::ostringstream out;
     out << std::setprecision(precision) << duration;
@@ -196,7 +389,7 @@ inline void reset_timers() {
  * This has no effect if the timers were disabled.
  */
 inline void dump_timers() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().collect();
 
     //Sort the timers by duration (DESC)
     std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
@@ -222,7 +415,7 @@ inline void dump_timers() {
  * The total is the counter with the maximum total time
  */
 inline void dump_timers_one() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().collect();
 
     if(timers.empty()){
         return;
@@ -233,7 +426,7 @@ inline void dump_timers_one() {
         return left.duration > right.duration;
     });
 
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
     // Print all the used timers
     for (decltype(auto) timer : timers) {
@@ -247,11 +440,56 @@ inline void dump_timers_one() {
     }
 }
 
+#ifdef DLL_PERF_COUNTERS
+
+/*!
+ * \brief Returns a short human readable string for the given count
+ */
+inline std::string count_str(double count) {
+    if (count > 1e9) {
+        return to_string_precision(count / 1e9, 4) + "G";
+    } else if (count > 1e6) {
+        return to_string_precision(count / 1e6, 4) + "M";
+    } else if (count > 1e3) {
+        return to_string_precision(count / 1e3, 4) + "K";
+    } else {
+        return to_string_precision(count, 4);
+    }
+}
+
+/*!
+ * \brief Returns the hardware counter columns of the given timer: cycles,
+ * instructions per cycle, last level cache misses per thousand
+ * instructions and vector floating point instructions
+ */
+inline std::array<std::string, 4> counter_columns(const timer_t& timer) {
+    auto& counters = local_perf_counters();
+
+    const double cycles       = timer.counters[size_t(perf_event::CYCLES)];
+    const double instructions = timer.counters[size_t(perf_event::INSTRUCTIONS)];
+    const double misses       = timer.counters[size_t(perf_event::LLC_MISSES)];
+    const double vector       = timer.counters[size_t(perf_event::VECTOR_FP)];
+
+    const bool has_cycles       = counters.available(perf_event::CYCLES) && cycles > 0.0;
+    const bool has_instructions = counters.available(perf_event::INSTRUCTIONS) && instructions > 0.0;
+
+    return {
+        has_cycles ? count_str(cycles) : "-",
+        has_cycles && has_instructions ? to_string_precision(instructions / cycles, 3) : "-",
+        has_instructions && counters.available(perf_event::LLC_MISSES) ? to_string_precision(1000.0 * misses / instructions, 3) : "-",
+        counters.available(perf_event::VECTOR_FP) ? count_str(vector) : "-"};
+}
+
+#endif
+
 /*!
  * \brief Dump all timers values to the console in the form of a nice table.
+ *
+ * If DLL_PERF_COUNTERS is defined, the hardware counters of each timer
+ * are shown as well.
  */
 inline void dump_timers_pretty() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().collect();
 
     if(timers.empty()){
         std::cout << "No timers have been recorded!" << std::endl;
@@ -265,9 +503,13 @@ inline void dump_timers_pretty() {
         return left.duration > right.duration;
     });
 
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
+#ifdef DLL_PERF_COUNTERS
+    constexpr size_t columns = 9;
+#else
     constexpr size_t columns = 5;
+#endif
 
     std::string column_name[columns];
     column_name[0] = "%";
@@ -276,23 +518,47 @@ inline void dump_timers_pretty() {
     column_name[3] = "Total";
     column_name[4] = "Average";
 
-    size_t column_length[columns];
-    column_length[0] = 8;
-    column_length[1] = column_name[1].size();
-    column_length[2] = column_name[2].size();
-    column_length[3] = column_name[3].size();
-    column_length[4] = column_name[4].size();
+#ifdef DLL_PERF_COUNTERS
+    column_name[5] = "Cycles";
+    column_name[6] = "IPC";
+    column_name[7] = "LLC MPKI";
+    column_name[8] = "Vector FP";
+#endif
+
+    // The content of the columns of each timer
+    std::vector<std::array<std::string, columns>> rows;
 
-    // Compute the width of each column
     for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+
+        std::array<std::string, columns> row;
+
+        row[1] = timer.name;
+        row[2] = std::to_string(count);
+        row[3] = duration_str(duration);
+        row[4] = duration_str(duration / count);
+
+#ifdef DLL_PERF_COUNTERS
+        auto counters = counter_columns(timer);
+        std::copy(counters.begin(), counters.end(), row.begin() + 5);
+#endif
+
+        rows.push_back(row);
+    }
 
-            column_length[1] = std::max(column_length[1], std::string(timer.name).size());
-            column_length[2] = std::max(column_length[2], std::to_string(count).size());
-            column_length[3] = std::max(column_length[3], duration_str(duration).size());
-            column_length[4] = std::max(column_length[4], duration_str(duration / count).size());
+    // Compute the width of each column
+    size_t column_length[columns];
+
+    for (size_t c = 0; c < columns; ++c) {
+        column_length[c] = column_name[c].size();
+    }
+
+    column_length[0] = 8;
+
+    for (auto& row : rows) {
+        for (size_t c = 1; c < columns; ++c) {
+            column_length[c] = std::max(column_length[c], row[c].size());
         }
     }
 
@@ -300,28 +566,27 @@ inline void dump_timers_pretty() {
 
     std::cout << " " << std::string(line_length, '-') << '\n';
 
-    printf(" | %-*s | %-*s | %-*s | %-*s | %-*s |\n",
-        int(column_length[0]), column_name[0].c_str(),
-        int(column_length[1]), column_name[1].c_str(),
-        int(column_length[2]), column_name[2].c_str(),
-        int(column_length[3]), column_name[3].c_str(),
-        int(column_length[4]), column_name[4].c_str());
+    std::cout << " |";
+
+    for (size_t c = 0; c < columns; ++c) {
+        printf(" %-*s |", int(column_length[c]), column_name[c].c_str());
+    }
+
+    std::cout << '\n';
 
     std::cout << " " << std::string(line_length, '-') << '\n';
 
     // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        auto& row = rows[i];
+
+        printf(" | %*.3f%% |", int(column_length[0] - 1), 100.0 * (timers[i].duration / double(total_duration)));
 
-            printf(" | %*.3f%% | %-*s | %-*s | %-*s | %-*s |\n",
-                int(column_length[0] - 1), 100.0 * (duration / double(total_duration)),
-                int(column_length[1]), timer.name,
-                int(column_length[2]), std::to_string(count).c_str(),
-                int(column_length[3]), duration_str(duration).c_str(),
-                int(column_length[4]), duration_str(duration / count).c_str());
+        for (size_t c = 1; c < columns; ++c) {
+            printf(" %-*s |", int(column_length[c]), row[c].c_str());
         }
+
+        printf("\n");
     }
 
     std::cout << " " << std::string(line_length, '-') << '\n';
@@ -329,125 +594,108 @@ inline void dump_timers_pretty() {
 
 /*!
  * \brief Automatic timer with RAII.
+ *
+ * When the timers are sampled, the invocations that are not timed do not
+ * read the clock.
  */
 struct auto_timer {
-    const char* name;                               ///< The name of the timer
+    size_t id;                                                ///< The index of the timer
+    size_t scale;                                             ///< The number of invocations this one stands for (0 if not timed)
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
-    std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
+
+#ifdef DLL_PERF_COUNTERS
+    perf_sample counters_start; ///< The hardware counters at the start
+    bool counting;              ///< Indicates if the hardware counters were read at the start
+#endif
+
+    /*!
+     * \brief Create an auto_timer for the given handle
+     * \param handle The handle of the timer
+     */
+    auto_timer(const timer_id& handle) : id(handle.id), scale(sample(id)) {
+        if (scale) {
+            start_counters();
+            start = std::chrono::steady_clock::now();
+        }
+    }
 
     /*!
      * \brief Create an auto_timer witht the given name
+     *
+     * The name is looked up in the registry, a timer_id should be preferred
+     * on hot paths.
+     *
      * \param name The name of the timer
      */
-    auto_timer(const char* name) : name(name) {
-        start = std::chrono::steady_clock::now();
+    auto_timer(const char* name) : id(get_timers().find(name)), scale(sample(id)) {
+        if (scale) {
+            start_counters();
+            start = std::chrono::steady_clock::now();
+        }
     }
 
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
     ~auto_timer() {
-        end           = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if (scale) {
+            auto end      = std::chrono::steady_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
+            local_timer_shard().add(id, duration, scale);
 
-        // Try to increment without the lock
+#ifdef DLL_PERF_COUNTERS
+            perf_sample counters_end;
 
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
-
-                return;
+            if (counting && local_perf_counters().read(counters_end)) {
+                uint64_t counts[perf_events];
+                perf_counters::difference(counters_start, counters_end, counts);
+                local_timer_shard().add_counters(id, counts, scale);
             }
-        }
-
-        {
-            std::lock_guard<std::mutex> lock(timers.lock);
-
-            // Retry again to increment with lock
-
-            for (decltype(auto) timer : timers.timers) {
-                if (timer.name == name) {
-                    timer.duration += duration;
-                    ++timer.count;
-
-                    return;
-                }
-            }
-
-            // At this point the timer does not exist, create it
-
-            for (decltype(auto) timer : timers.timers) {
-                if (!timer.name) {
-                    timer.name     = name;
-                    timer.duration = duration;
-                    timer.count    = 1;
+#endif
 
-                    return;
-                }
+            if (tracing()) {
+                trace_complete(get_timers().names[id].load(std::memory_order_relaxed), "timer", start, end);
             }
         }
-
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
-    }
-};
-
-/*!
- * \brief Automatic timer with RAII, without synchronization.
- */
-struct unsafe_auto_timer {
-    const char* name;                                         ///< The name of the timer
-    std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
-    std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
-
-    /*!
-     * \brief Create an unsafe_auto_timer witht the given name
-     * \param name The name of the timer
-     */
-    unsafe_auto_timer(const char* name) : name(name) {
-        start = std::chrono::steady_clock::now();
     }
 
+private:
     /*!
-     * \brief Destructs the timer, effectively incrementing the timer.
+     * \brief Returns the number of invocations the current invocation of the
+     * given timer stands for, 0 if it must not be timed
      */
-    ~unsafe_auto_timer() {
-        end           = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-
-        decltype(auto) timers = get_timers();
-
-        // Increment the timer if it exists
-
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
-
-                return;
-            }
+    static size_t sample(size_t id) {
+        if (id >= max_timers) {
+            return 0;
         }
 
-        // At this point the timer does not exist, create it
-
-        for (decltype(auto) timer : timers.timers) {
-            if (!timer.name) {
-                timer.name     = name;
-                timer.duration = duration;
-                timer.count    = 1;
+        const size_t period = timer_sampling();
 
-                return;
-            }
+        if (period == 1) {
+            return 1;
         }
 
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
+        return local_timer_shard().calls[id]++ % period == 0 ? period : 0;
+    }
+
+    /*!
+     * \brief Read the hardware counters at the start of the timer, if enabled
+     */
+    void start_counters() {
+#ifdef DLL_PERF_COUNTERS
+        counting = local_perf_counters().read(counters_start);
+#endif
     }
 };
 
+/*!
+ * \brief Automatic timer with RAII.
+ *
+ * Since the counters are sharded by thread, this is the same as auto_timer.
+ */
+using unsafe_auto_timer = auto_timer;
+
 #endif
 
 } //end of namespace dll
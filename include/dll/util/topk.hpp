@@ -0,0 +1,119 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file topk.hpp
+ * \brief Selection of the best classes of batches of outputs
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The k best classes of a set of samples, with their scores, in
+ * two compact row-major arrays.
+ */
+template <typename T>
+struct topk_result {
+    size_t k = 0;                ///< The number of classes per sample
+    std::vector<size_t> indices; ///< The classes, k per sample, best first
+    std::vector<T> scores;       ///< The scores of the classes
+
+    /*!
+     * \brief Returns the number of samples
+     */
+    size_t size() const {
+        return k ? indices.size() / k : 0;
+    }
+
+    /*!
+     * \brief Returns the j-th best class of the i-th sample
+     */
+    size_t index(size_t i, size_t j) const {
+        return indices[i * k + j];
+    }
+
+    /*!
+     * \brief Returns the score of the j-th best class of the i-th sample
+     */
+    T score(size_t i, size_t j) const {
+        return scores[i * k + j];
+    }
+};
+
+/*!
+ * \brief Returns the index of the largest value of each of the n first rows
+ * of the given output, appended to the given labels.
+ */
+template <typename Output>
+void argmax_rows(const Output& output, size_t n, std::vector<size_t>& labels) {
+    output.ensure_cpu_up_to_date();
+
+    const size_t c  = etl::size(output) / etl::dim<0>(output);
+    const auto* out = output.memory_start();
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto* row = out + i * c;
+
+        labels.push_back(std::distance(row, std::max_element(row, row + c)));
+    }
+}
+
+/*!
+ * \brief Select the k largest values of each of the n first rows of the
+ * given output, appended to the given result.
+ *
+ * The classes of a row are partitioned around the k-th largest value,
+ * after which only the k best are sorted.
+ *
+ * \param output The batch of outputs
+ * \param n The number of valid rows
+ * \param result The result to append to (result.k must be set)
+ * \param order A buffer for the classes of a row
+ */
+template <typename Output, typename T>
+void topk_rows(const Output& output, size_t n, topk_result<T>& result, std::vector<size_t>& order) {
+    output.ensure_cpu_up_to_date();
+
+    const size_t c  = etl::size(output) / etl::dim<0>(output);
+    const size_t k  = result.k;
+    const auto* out = output.memory_start();
+
+    if (!k) {
+        return;
+    }
+
+    order.resize(c);
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto* row = out + i * c;
+
+        auto better = [row](size_t a, size_t b) { return row[a] > row[b] || (row[a] == row[b] && a < b); };
+
+        std::iota(order.begin(), order.end(), 0);
+
+        if (k < c) {
+            std::nth_element(order.begin(), order.begin() + k - 1, order.end(), better);
+        }
+
+        std::sort(order.begin(), order.begin() + k, better);
+
+        for (size_t j = 0; j < k; ++j) {
+            result.indices.push_back(order[j]);
+            result.scores.push_back(row[order[j]]);
+        }
+    }
+}
+
+} //end of dll namespace
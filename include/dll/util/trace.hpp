@@ -0,0 +1,330 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file trace.hpp
+ * \brief Timeline of the execution, exported as a Chrome trace
+ *
+ * While tracing is active, the timers, the batches of the generator
+ * threads, the tasks of the thread pools and the watcher events are
+ * recorded as complete events in a buffer per thread. Only the owner thread
+ * writes its buffer and publishes each event with a release store, so
+ * recording takes no lock.
+ *
+ * The trace is exported as Chrome trace JSON with export_trace(), which
+ * can be opened in chrome://tracing or Perfetto. The events of a thread
+ * are nested by their times. If the DLL_TRACE environment variable is
+ * set, tracing starts on the first event and the trace is written to the
+ * file it names at exit.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief One event of the trace
+ */
+struct trace_event {
+    const char* name;     ///< The name of the event
+    const char* category; ///< The category of the event
+    size_t start;         ///< The start of the event (ns since the start of the trace clock)
+    size_t duration;      ///< The duration of the event (ns)
+};
+
+/*!
+ * \brief The events recorded by one thread.
+ *
+ * The events are stored in chunks that are never moved, so that the trace
+ * can be exported while the thread is still recording.
+ */
+struct trace_buffer {
+    static constexpr size_t chunk_size = 4096; ///< The number of events per chunk
+    static constexpr size_t max_chunks = 1024; ///< The maximum number of chunks
+
+    using chunk_t = std::array<trace_event, chunk_size>;
+
+    std::array<std::atomic<chunk_t*>, max_chunks> chunks = {}; ///< The chunks of events
+    std::atomic<size_t> size{0};                             ///< The number of published events
+    std::atomic<bool> used{true};                            ///< Indicates if a thread owns the buffer
+    size_t tid;                                              ///< The index of the thread in the trace
+
+    /*!
+     * \brief Create an empty buffer for the given thread index
+     */
+    explicit trace_buffer(size_t tid) : tid(tid) {}
+
+    trace_buffer(const trace_buffer& rhs) = delete;
+    trace_buffer& operator=(const trace_buffer& rhs) = delete;
+
+    /*!
+     * \brief Destroy the buffer and its chunks
+     */
+    ~trace_buffer() {
+        for (auto& chunk : chunks) {
+            delete chunk.load();
+        }
+    }
+
+    /*!
+     * \brief Record an event. Only called by the owner thread.
+     */
+    void push(const trace_event& event) {
+        const size_t n = size.load(std::memory_order_relaxed);
+        const size_t c = n / chunk_size;
+
+        if (c >= max_chunks) {
+            return;
+        }
+
+        chunk_t* chunk = chunks[c].load(std::memory_order_relaxed);
+
+        if (!chunk) {
+            chunk = new chunk_t;
+            chunks[c].store(chunk, std::memory_order_release);
+        }
+
+        (*chunk)[n % chunk_size] = event;
+
+        size.store(n + 1, std::memory_order_release);
+    }
+
+    /*!
+     * \brief Returns the published event i
+     */
+    const trace_event& operator[](size_t i) const {
+        return (*chunks[i / chunk_size].load(std::memory_order_acquire))[i % chunk_size];
+    }
+};
+
+/*!
+ * \brief The buffers of all the threads
+ */
+struct tracer_t {
+    std::vector<std::unique_ptr<trace_buffer>> buffers; ///< The buffers of all the threads
+    std::mutex lock;                                    ///< The lock to protect the list of buffers
+    std::atomic<bool> active{false};                    ///< Indicates if the events are recorded
+    std::string exit_file;                              ///< The file written at exit (DLL_TRACE)
+
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now(); ///< The origin of the times
+
+    tracer_t() {
+        if (auto* file = std::getenv("DLL_TRACE")) {
+            exit_file = file;
+            active    = true;
+        }
+    }
+
+    ~tracer_t();
+
+    /*!
+     * \brief Returns the given time in nanoseconds since the origin
+     */
+    size_t ns(std::chrono::steady_clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - origin).count();
+    }
+
+    /*!
+     * \brief Returns a free buffer for a new thread.
+     *
+     * The buffers of the finished threads are reused, with their events, by
+     * the next threads: their events never overlap in time.
+     */
+    trace_buffer* acquire() {
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& buffer : buffers) {
+            bool used = false;
+
+            if (buffer->used.compare_exchange_strong(used, true)) {
+                return buffer.get();
+            }
+        }
+
+        buffers.emplace_back(std::make_unique<trace_buffer>(buffers.size()));
+
+        return buffers.back().get();
+    }
+
+    /*!
+     * \brief Write the trace as Chrome trace JSON into the given file
+     * \return true if the file was written, false otherwise
+     */
+    bool write(const std::string& file) {
+        std::ofstream out(file);
+
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+        bool first = true;
+
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& buffer : buffers) {
+            const size_t n = buffer->size.load(std::memory_order_acquire);
+
+            for (size_t i = 0; i < n; ++i) {
+                auto& event = (*buffer)[i];
+
+                out << (first ? "\n" : ",\n")
+                    << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+                    << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << buffer->tid
+                    << ", \"ts\": " << event.start / 1000 << "." << (event.start % 1000) / 100 << (event.start % 100) / 10 << event.start % 10
+                    << ", \"dur\": " << event.duration / 1000 << "." << (event.duration % 1000) / 100 << (event.duration % 100) / 10 << event.duration % 10
+                    << "}";
+
+                first = false;
+            }
+        }
+
+        out << "\n]}\n";
+
+        return bool(out);
+    }
+
+    /*!
+     * \brief Remove all the recorded events
+     *
+     * This must not be called while events are recorded.
+     */
+    void clear() {
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& buffer : buffers) {
+            buffer->size = 0;
+        }
+    }
+};
+
+/*!
+ * \brief Get a reference to the tracer
+ */
+inline tracer_t& get_tracer() {
+    static tracer_t tracer;
+    return tracer;
+}
+
+inline tracer_t::~tracer_t() {
+    if (!exit_file.empty()) {
+        write(exit_file);
+    }
+}
+
+/*!
+ * \brief The owner of the buffer of the current thread, that releases it
+ * when the thread ends
+ */
+struct trace_buffer_owner {
+    trace_buffer* buffer; ///< The buffer of the thread
+
+    trace_buffer_owner() : buffer(get_tracer().acquire()) {}
+
+    ~trace_buffer_owner() {
+        buffer->used = false;
+    }
+};
+
+/*!
+ * \brief Get the buffer of the current thread
+ */
+inline trace_buffer& local_trace_buffer() {
+    static thread_local trace_buffer_owner owner;
+    return *owner.buffer;
+}
+
+/*!
+ * \brief Indicates if the events are recorded
+ */
+inline bool tracing() {
+    return get_tracer().active.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Start recording the events
+ */
+inline void start_tracing() {
+    get_tracer().active = true;
+}
+
+/*!
+ * \brief Stop recording the events
+ */
+inline void stop_tracing() {
+    get_tracer().active = false;
+}
+
+/*!
+ * \brief Remove all the recorded events
+ */
+inline void clear_trace() {
+    get_tracer().clear();
+}
+
+/*!
+ * \brief Export the recorded events as Chrome trace JSON into the given file
+ * \return true if the file was written, false otherwise
+ */
+inline bool export_trace(const std::string& file) {
+    return get_tracer().write(file);
+}
+
+/*!
+ * \brief Record a complete event between the given times, if tracing is active
+ * \param name The name of the event (must outlive the trace)
+ * \param category The category of the event (must outlive the trace)
+ */
+inline void trace_complete(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    if (tracing()) {
+        auto& tracer = get_tracer();
+
+        local_trace_buffer().push({name, category, tracer.ns(start), size_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())});
+    }
+}
+
+/*!
+ * \brief RAII event of the trace
+ */
+struct trace_scope {
+    const char* name;                                         ///< The name of the event
+    const char* category;                                     ///< The category of the event
+    bool active;                                              ///< Indicates if tracing was active at the start
+    std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
+
+    /*!
+     * \brief Start an event with the given name and category
+     * \param name The name of the event (must outlive the trace)
+     * \param category The category of the event (must outlive the trace)
+     */
+    trace_scope(const char* name, const char* category) : name(name), category(category), active(tracing()) {
+        if (active) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    trace_scope(const trace_scope& rhs) = delete;
+    trace_scope& operator=(const trace_scope& rhs) = delete;
+
+    /*!
+     * \brief Record the event
+     */
+    ~trace_scope() {
+        if (active) {
+            trace_complete(name, category, start, std::chrono::steady_clock::now());
+        }
+    }
+};
+
+} //end of dll namespace
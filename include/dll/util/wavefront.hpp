@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file wavefront.hpp
+ * \brief Compile-time detection of the stacks of recurrent layers
+ *
+ * Adjacent RNN layers are forwarded together for inference (see
+ * rnn_wavefront_forward): the states are passed directly between their
+ * per-step caches and, when the branches are run in parallel, the steps of
+ * the layers are computed as a wavefront on the shared scheduler.
+ *
+ * A recurrent layer followed by a recurrent_last_layer only computes its
+ * last time step for inference (see forward_last_batch).
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "dll/layer_fwd.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer can be part of a recurrent stack
+ */
+template <typename L>
+struct is_wavefront_layer_impl : std::false_type {};
+
+/*!
+ * \copydoc is_wavefront_layer_impl
+ */
+template <typename Desc>
+struct is_wavefront_layer_impl<rnn_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_wavefront_layer_impl
+ */
+template <typename Desc>
+struct is_wavefront_layer_impl<dyn_rnn_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can compute only its last time step
+ */
+template <typename L>
+struct is_last_step_layer_impl : is_wavefront_layer_impl<L> {};
+
+/*!
+ * \copydoc is_last_step_layer_impl
+ */
+template <typename Desc>
+struct is_last_step_layer_impl<lstm_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_last_step_layer_impl
+ */
+template <typename Desc>
+struct is_last_step_layer_impl<dyn_lstm_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer only keeps the last time step of its input
+ */
+template <typename L>
+struct is_recurrent_last_impl : std::false_type {};
+
+/*!
+ * \copydoc is_recurrent_last_impl
+ */
+template <typename Desc>
+struct is_recurrent_last_impl<recurrent_last_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \copydoc is_recurrent_last_impl
+ */
+template <typename Desc>
+struct is_recurrent_last_impl<dyn_recurrent_last_layer_impl<Desc>> : std::true_type {};
+
+} // end of namespace detail
+
+/*!
+ * \brief Indicates if the given layer can be part of a recurrent stack
+ */
+template <typename L>
+constexpr bool is_wavefront_layer = detail::is_wavefront_layer_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the two given adjacent layers form a recurrent stack
+ */
+template <typename L1, typename L2>
+constexpr bool is_wavefront_pair = is_wavefront_layer<L1> && is_wavefront_layer<L2>;
+
+/*!
+ * \brief Indicates if the given layer only keeps the last time step of its input
+ */
+template <typename L>
+constexpr bool is_recurrent_last = detail::is_recurrent_last_impl<std::decay_t<L>>::value;
+
+/*!
+ * \brief Indicates if the first of the two given adjacent layers only
+ * needs to compute its last time step
+ */
+template <typename L1, typename L2>
+constexpr bool is_last_step_pair = detail::is_last_step_layer_impl<std::decay_t<L1>>::value && is_recurrent_last<L2>;
+
+} //end of dll namespace
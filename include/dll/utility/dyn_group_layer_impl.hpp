@@ -238,6 +238,17 @@ struct dyn_group_layer_impl<dyn_group_layer_desc<Layers...>> final : layer<dyn_g
         });
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        cpp::for_each(layers, [](auto& layer){
+            if constexpr (decay_layer_traits<decltype(layer)>::is_trained()) {
+                layer.release_backup();
+            }
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
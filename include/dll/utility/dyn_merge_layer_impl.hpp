@@ -9,7 +9,8 @@
 
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/parallel.hpp" // for for_each_branch
+#include "dll/util/timers.hpp"   // for auto_timer
 
 namespace dll {
 
@@ -139,10 +140,14 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.test_forward_batch(input);
+        for_each_branch(n_layers, [this, &input, &output](size_t b){
+            cpp::for_each_i(layers, [&input, &output, b](size_t i, auto& layer){
+                if (i == b) {
+                    auto sub_output = layer.test_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                    etl::batch_merge(output, sub_output, i);
+                }
+            });
         });
     }
 
@@ -154,10 +159,14 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void train_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.train_forward_batch(input);
+        for_each_branch(n_layers, [this, &input, &output](size_t b){
+            cpp::for_each_i(layers, [&input, &output, b](size_t i, auto& layer){
+                if (i == b) {
+                    auto sub_output = layer.train_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                    etl::batch_merge(output, sub_output, i);
+                }
+            });
         });
     }
 
@@ -169,10 +178,14 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.forward_batch(input);
+        for_each_branch(n_layers, [this, &input, &output](size_t b){
+            cpp::for_each_i(layers, [&input, &output, b](size_t i, auto& layer){
+                if (i == b) {
+                    auto sub_output = layer.forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                    etl::batch_merge(output, sub_output, i);
+                }
+            });
         });
     }
 
@@ -250,6 +263,15 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
         });
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        cpp::for_each(layers, [](auto& layer) {
+            layer.release_backup();
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
@@ -225,6 +225,17 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
         });
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        cpp::for_each(layers, [](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_trained()) {
+                layer.release_backup();
+            }
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
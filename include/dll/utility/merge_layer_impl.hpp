@@ -9,7 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/concat.hpp"   // for concat_slice
+#include "dll/util/parallel.hpp" // for for_each_branch
+#include "dll/util/timers.hpp"   // for auto_timer
 
 namespace dll {
 
@@ -128,6 +130,22 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
         return output;
     }
 
+    /*!
+     * \brief Return the position of the given branch along the merge
+     * dimension of the output
+     */
+    static constexpr size_t merge_offset(size_t i) noexcept {
+        constexpr size_t sizes[] = {etl::decay_traits<typename Layers::output_one_t>::template dim<D>()...};
+
+        size_t offset = 0;
+
+        for (size_t j = 0; j < i; ++j) {
+            offset += sizes[j];
+        }
+
+        return offset;
+    }
+
     using base_type::forward_batch;
     using base_type::train_forward_batch;
     using base_type::test_forward_batch;
@@ -140,11 +158,17 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.test_forward_batch(input);
-
-            etl::batch_merge(output, sub_output, i);
+        for_each_branch(n_layers, [this, &input, &output](size_t b){
+            cpp::for_each_i(layers, [&input, &output, b](size_t i, auto& layer){
+                if (i == b) {
+                    auto sub_output = layer.test_forward_batch(input);
+
+                    concat_slice(output, sub_output, D + 1, merge_offset(i));
+                }
+            });
         });
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -155,11 +179,17 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
      */
     template <typename H1, typename V>
     void train_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.train_forward_batch(input);
-
-            etl::batch_merge(output, sub_output, i);
+        for_each_branch(n_layers, [this, &input, &output](size_t b){
+            cpp::for_each_i(layers, [&input, &output, b](size_t i, auto& layer){
+                if (i == b) {
+                    auto sub_output = layer.train_forward_batch(input);
+
+                    concat_slice(output, sub_output, D + 1, merge_offset(i));
+                }
+            });
         });
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -170,11 +200,17 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.forward_batch(input);
-
-            etl::batch_merge(output, sub_output, i);
+        for_each_branch(n_layers, [this, &input, &output](size_t b){
+            cpp::for_each_i(layers, [&input, &output, b](size_t i, auto& layer){
+                if (i == b) {
+                    auto sub_output = layer.forward_batch(input);
+
+                    concat_slice(output, sub_output, D + 1, merge_offset(i));
+                }
+            });
         });
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -230,6 +266,15 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
         });
     }
 
+    /*!
+     * \brief Release the secondary weights matrix
+     */
+    void release_backup() {
+        cpp::for_each(layers, [](auto& layer) {
+            layer.release_backup();
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
@@ -14,6 +14,8 @@
 
 #include "cpp_utils/stop_watch.hpp"
 
+#include "dll/util/batch_ring.hpp" // For prefetch_stats
+
 #include "trainer/rbm_training_context.hpp"
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
@@ -222,11 +224,16 @@ struct default_dbn_watcher {
             std::cout << "        momentum=" << dbn.momentum << std::endl;
         }
 
+        if (UT == updater_type::LARS) {
+            std::cout << "        momentum=" << dbn.momentum << std::endl;
+            std::cout << "      lars_trust=" << dbn.lars_trust << std::endl;
+        }
+
         if (UT == updater_type::ADADELTA) {
             std::cout << "            beta=" << dbn.adadelta_beta << std::endl;
         }
 
-        if (UT == updater_type::ADAM || UT == updater_type::ADAM_CORRECT || UT == updater_type::ADAMAX || UT == updater_type::NADAM) {
+        if (UT == updater_type::ADAM || UT == updater_type::ADAM_CORRECT || UT == updater_type::ADAMAX || UT == updater_type::NADAM || UT == updater_type::LAMB) {
             std::cout << "           beta1=" << dbn.adam_beta1 << std::endl;
             std::cout << "           beta2=" << dbn.adam_beta2 << std::endl;
         }
@@ -327,6 +334,27 @@ struct default_dbn_watcher {
         std::cout.flush();
     }
 
+    size_t last_prefetch_depth = 0; ///< The last reported prefetching depth
+
+    /*!
+     * \brief Indicates the prefetching statistics of the training generator
+     * after a fine-tuning epoch
+     * \param stats The prefetching statistics
+     * \param dbn The network being trained
+     */
+    void ft_prefetch(const prefetch_stats& stats, const DBN& dbn) {
+        cpp_unused(dbn);
+
+        // Only report when the generator did not keep up or changed its depth
+        if (stats.stall_ms || stats.depth != last_prefetch_depth) {
+            char buffer[128];
+            snprintf(buffer, 128, "prefetch depth %ld/%ld - stall %ldms", stats.depth, stats.slots, stats.stall_ms);
+            std::cout << buffer << std::endl;
+        }
+
+        last_prefetch_depth = stats.depth;
+    }
+
     /*!
      * \brief Indicates the beginning of a fine-tuning batch
      * \param epoch The current epoch
@@ -503,6 +531,17 @@ struct mute_dbn_watcher {
         cpp_unused(dbn);
     }
 
+    /*!
+     * \brief Indicates the prefetching statistics of the training generator
+     * after a fine-tuning epoch
+     * \param stats The prefetching statistics
+     * \param dbn The network being trained
+     */
+    void ft_prefetch(const prefetch_stats& stats, const DBN& dbn) {
+        cpp_unused(stats);
+        cpp_unused(dbn);
+    }
+
     /*!
      * \brief Indicates the beginning of a fine-tuning batch
      * \param epoch The current epoch
@@ -0,0 +1,13 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// The definitions of the instantiations declared extern when
+// DLL_EXTERN_TEMPLATES is defined (see dll/extern_templates.hpp)
+
+#include "dll/extern_templates.hpp"
+
+DLL_COMMON_INSTANTIATIONS()
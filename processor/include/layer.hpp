@@ -73,7 +73,28 @@ struct layer {
 
     virtual bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) = 0;
 
-    virtual void set(std::ostream& /*out*/, const std::string& /*lhs*/) const {/* Nothing */};
+    /*!
+     * \brief Print the code setting the runtime parameters of the layer to
+     * the given stream and store their values in the given parameters.
+     *
+     * \param out The stream to print to
+     * \param lhs The expression of the layer in the generated code
+     * \param key The prefix of the keys of the parameters of the layer
+     * \param params The runtime parameters
+     */
+    virtual void set(std::ostream& /*out*/, const std::string& /*lhs*/, const std::string& /*key*/, dll::processor::parameters& /*params*/) const {/* Nothing */};
+
+    /*!
+     * \brief Store the description of the layer for the interpreter in the
+     * given parameters.
+     *
+     * \param params The runtime parameters
+     * \param key The prefix of the keys of the layer
+     * \return false if the layer cannot be interpreted
+     */
+    virtual bool interpret(dll::processor::parameters& /*params*/, const std::string& /*key*/) const {
+        return false;
+    }
 };
 
 enum class parse_result {
@@ -116,7 +137,7 @@ struct base_rbm_layer : layer {
     bool shuffle       = false; ///< Indicates if the RBM is trained with shuffle
 
     void print(std::ostream& out) const override;
-    void set(std::ostream& out, const std::string& lhs) const override;
+    void set(std::ostream& out, const std::string& lhs, const std::string& key, dll::processor::parameters& params) const override;
 
     parse_result base_parse(const std::vector<std::string>& lines, size_t& i);
 };
@@ -176,6 +197,7 @@ struct dense_layer : layer {
 
     void print(std::ostream& out) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
+    bool interpret(dll::processor::parameters& params, const std::string& key) const override;
 
     size_t hidden_get() const override;
 };
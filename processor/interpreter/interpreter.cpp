@@ -0,0 +1,21 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+
+#include "dll/processor/interpreter.hpp"
+
+int main(int argc, char* argv[]) {
+    dll::processor::parameters params;
+
+    if (argc < 2 || !params.load(argv[1])) {
+        std::cout << "Usage: dllp_interpreter parameters_file" << std::endl;
+        return 1;
+    }
+
+    return dll::processor::interpreter::interpret(params) ? 0 : 1;
+}
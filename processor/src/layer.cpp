@@ -73,34 +73,39 @@ dllp::parse_result dllp::base_rbm_layer::base_parse(const std::vector<std::strin
     return parse_result::NOT_PARSED;
 }
 
-void dllp::base_rbm_layer::set(std::ostream& out, const std::string& lhs) const {
+void dllp::base_rbm_layer::set(std::ostream& out, const std::string& lhs, const std::string& key, dll::processor::parameters& params) const {
+    auto bind = [&](const std::string& name, const std::string& field, double value) {
+        out << "   params.apply(\"" << key << "." << name << "\", " << lhs << "." << field << ");\n";
+        params.set(key + "." + name, value);
+    };
+
     if (learning_rate != dll::processor::stupid_default) {
-        out << lhs << ".learning_rate = " << learning_rate << ";\n";
+        bind("learning_rate", "learning_rate", learning_rate);
     }
 
     if (momentum != dll::processor::stupid_default) {
-        out << lhs << ".initial_momentum = " << momentum << ";\n";
-        out << lhs << ".final_momentum = " << momentum << ";\n";
+        bind("momentum", "initial_momentum", momentum);
+        bind("momentum", "final_momentum", momentum);
     }
 
     if (l1_weight_cost != dll::processor::stupid_default) {
-        out << lhs << ".l1_weight_cost = " << l1_weight_cost << ";\n";
+        bind("l1_weight_cost", "l1_weight_cost", l1_weight_cost);
     }
 
     if (l2_weight_cost != dll::processor::stupid_default) {
-        out << lhs << ".l2_weight_cost = " << l2_weight_cost << ";\n";
+        bind("l2_weight_cost", "l2_weight_cost", l2_weight_cost);
     }
 
     if (sparsity_target != dll::processor::stupid_default) {
-        out << lhs << ".sparsity_target = " << sparsity_target << ";\n";
+        bind("sparsity_target", "sparsity_target", sparsity_target);
     }
 
     if (pbias != dll::processor::stupid_default) {
-        out << lhs << ".pbias = " << pbias << ";\n";
+        bind("pbias", "pbias", pbias);
     }
 
     if (pbias_lambda != dll::processor::stupid_default) {
-        out << lhs << ".pbias_lambda = " << pbias_lambda << ";\n";
+        bind("pbias_lambda", "pbias_lambda", pbias_lambda);
     }
 }
 
@@ -388,6 +393,15 @@ void dllp::dense_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+bool dllp::dense_layer::interpret(dll::processor::parameters& params, const std::string& key) const {
+    params.set(key + ".type", std::string("dense"));
+    params.set(key + ".visible", visible);
+    params.set(key + ".hidden", hidden);
+    params.set(key + ".activation", activation.empty() ? std::string("sigmoid") : activation);
+
+    return true;
+}
+
 bool dllp::dense_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -19,10 +19,14 @@
 
 #include "dll/processor/processor.hpp"
 
+#include "parse_utils.hpp"
+
 namespace {
 
 void print_usage() {
-    std::cout << "Usage: dllp conf_file action" << std::endl;
+    std::cout << "Usage: dllp [--mkl] [--cublas] [--cufft] [--cache] [--cache-dir dir] [--interpret] [--profile profile] [--jobs n] [--threads n] conf_file action" << std::endl;
+    std::cout << "       dllp [options] conf_file sweep grid_file [action]" << std::endl;
+    std::cout << "       dllp [options] conf_file load serve (samples from the standard input or the socket of the serving options)" << std::endl;
 }
 
 void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::string& source_file) {
@@ -41,6 +45,22 @@ void parse_options(int argc, char* argv[], dll::processor::options& opt, std::ve
         } else if (std::string(argv[i]) == "--cache") {
             opt.cache = true;
             ++i;
+        } else if (std::string(argv[i]) == "--profile" && i + 1 < size_t(argc)) {
+            opt.profile = argv[i + 1];
+            i += 2;
+        } else if (std::string(argv[i]) == "--jobs" && i + 1 < size_t(argc)) {
+            opt.jobs = std::stol(argv[i + 1]);
+            i += 2;
+        } else if (std::string(argv[i]) == "--threads" && i + 1 < size_t(argc)) {
+            opt.threads = std::stol(argv[i + 1]);
+            i += 2;
+        } else if (std::string(argv[i]) == "--interpret") {
+            opt.interpret = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--cache-dir" && i + 1 < size_t(argc)) {
+            opt.cache     = true;
+            opt.cache_dir = argv[i + 1];
+            i += 2;
         } else {
             break;
         }
@@ -79,6 +99,31 @@ int main(int argc, char* argv[]) {
 
     parse_options(argc, argv, opt, actions, source_file);
 
+    if (!opt.profile.empty() && !dllp::valid_profile(opt.profile)) {
+        std::cout << "dllp: invalid profile must be one of [debug, release_debug, release, release_native]" << std::endl;
+        return 1;
+    }
+
+    //Run all the configurations of a grid
+
+    if (!actions.empty() && actions.front() == "sweep") {
+        if (actions.size() < 2) {
+            std::cout << "dllp: sweep needs a grid file" << std::endl;
+            print_usage();
+            return 1;
+        }
+
+        std::string grid_file = actions[1];
+
+        actions.erase(actions.begin(), actions.begin() + 2);
+
+        if (actions.empty()) {
+            actions.push_back("auto");
+        }
+
+        return dll::processor::process_sweep(opt, actions, source_file, grid_file);
+    }
+
     //Process the file
 
     return dll::processor::process_file(opt, actions, source_file);
@@ -11,9 +11,19 @@
 #include <fstream>
 #include <memory>
 #include <cstdlib>
-
+#include <cerrno>
+#include <cstdio>
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "cpp_utils/string.hpp"
 
@@ -21,6 +31,7 @@
 #include "layer.hpp"
 
 #include "dll/processor/processor.hpp"
+#include "dll/processor/interpreter.hpp"
 
 namespace dllp {
 
@@ -115,8 +126,9 @@ void parse_datasource_pack(dll::processor::datasource_pack& pack, const std::vec
     pack.labels.limit  = limit;
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions);
-bool compile(const options& opt);
+std::string generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, dll::processor::parameters& params);
+bool compile_flags(const options& opt, const std::string& profile, std::string& flags);
+bool compile(const options& opt, const std::string& flags, const std::string& source, const std::string& output);
 
 void process_includes(std::vector<std::string>& lines){
     for (size_t i = 0; i < lines.size();) {
@@ -184,6 +196,18 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                     ++i;
                 } else if (dllp::starts_with(lines[i], "big_batch: ")) {
                     t.general_desc.big_batch = std::stol(dllp::extract_value(lines[i], "big_batch: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "threaded: ")) {
+                    t.general_desc.threaded = dllp::extract_value(lines[i], "threaded: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "profile: ")) {
+                    t.general_desc.profile = dllp::extract_value(lines[i], "profile: ");
+
+                    if (!dllp::valid_profile(t.general_desc.profile)) {
+                        std::cout << "dllp: error: invalid profile must be one of [debug, release_debug, release, release_native]" << std::endl;
+                        return false;
+                    }
+
                     ++i;
                 } else {
                     break;
@@ -241,6 +265,46 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                     break;
                 }
             }
+        } else if (lines[i] == "profiling:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "warmup:")) {
+                    t.prof_desc.warmup = std::stol(dllp::extract_value(lines[i], "warmup: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "batches:")) {
+                    t.prof_desc.batches = std::stol(dllp::extract_value(lines[i], "batches: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "json:")) {
+                    t.prof_desc.json = dllp::extract_value(lines[i], "json: ");
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+        } else if (lines[i] == "serving:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "socket:")) {
+                    t.serve_desc.socket = dllp::extract_value(lines[i], "socket: ");
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "output:")) {
+                    t.serve_desc.output = dllp::extract_value(lines[i], "output: ");
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "max_batch:")) {
+                    t.serve_desc.max_batch = std::stol(dllp::extract_value(lines[i], "max_batch: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "deadline:")) {
+                    t.serve_desc.deadline = std::stol(dllp::extract_value(lines[i], "deadline: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "workers:")) {
+                    t.serve_desc.workers = std::stol(dllp::extract_value(lines[i], "workers: "));
+                    ++i;
+                } else {
+                    break;
+                }
+            }
         } else {
             break;
         }
@@ -391,126 +455,296 @@ bool parse_file(const std::string& source_file, dll::processor::task& t, std::ve
     return true;
 }
 
-bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers) {
-    bool process = true;
+/*!
+ * \brief Returns the directory of the compiled networks
+ */
+std::string cache_directory(const dllp::options& opt) {
+    if (!opt.cache_dir.empty()) {
+        return opt.cache_dir;
+    }
+
+    if (const auto* env = std::getenv("DLLP_CACHE")) {
+        return env;
+    }
 
-    if (opt.cache) {
-        struct stat attr_conf;
-        struct stat attr_exec;
+    const auto* home = std::getenv("HOME");
 
-        if (!stat(source_file.c_str(), &attr_conf)) {
-            if (!stat("./.dbn.out", &attr_exec)) {
-                auto mtime_conf = attr_conf.st_mtime;
-                auto mtime_exec = attr_exec.st_mtime;
+    return std::string(home ? home : ".") + "/.cache/dllp";
+}
 
-                if (mtime_exec > mtime_conf) {
-                    if (!opt.quiet) {
-                        std::cout << "Skip compilation" << std::endl;
-                    }
-                    process = false;
-                }
+/*!
+ * \brief Create the given directory and its parents, if necessary
+ */
+bool make_directories(const std::string& path) {
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == '/') {
+            auto dir = path.substr(0, i);
+
+            if (mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+                return false;
             }
         }
     }
 
-    if (process) {
-        //Generate the CPP file
-        dllp::generate(layers, t, actions);
+    return true;
+}
+
+/*!
+ * \brief Indicates if the given directory contains a profile (GCC .gcda files)
+ */
+bool has_profile(const std::string& path) {
+    bool found = false;
+
+    if (auto* dir = opendir(path.c_str())) {
+        while (auto* entry = readdir(dir)) {
+            std::string name(entry->d_name);
+            found = found || (name.size() > 5 && name.compare(name.size() - 5, 5, ".gcda") == 0);
+        }
+
+        closedir(dir);
+    }
+
+    return found;
+}
+
+bool write_file(const std::string& path, const std::string& content) {
+    std::ofstream stream(path);
+    stream << content;
+    return bool(stream);
+}
+
+/*!
+ * \brief Generate the program of the network and compile it, if necessary.
+ *
+ * The runtime parameters are written into params_file and the program to
+ * run with them is set in program.
+ *
+ * With the cache, the program is compiled in the cache directory, under
+ * the hash of its preprocessed source, of the compiler and of the flags.
+ * Since the runtime parameters are not part of the source, the binary is
+ * reused by all the configurations of the same network, from any
+ * directory.
+ */
+bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers, const std::string& params_file, std::string& program) {
+    auto final_actions = actions;
+
+    if (std::find(actions.begin(), actions.end(), "auto") != actions.end()) {
+        final_actions = t.default_actions;
+    }
+
+    dll::processor::parameters params;
+
+    auto source = dllp::generate(layers, t, params);
+
+    dll::processor::store_task(params, t, final_actions);
+
+    if (!params.store(params_file)) {
+        std::cout << "dllp: error: Impossible to write the runtime parameters" << std::endl;
+        return false;
+    }
+
+    std::string flags;
 
-        //Compile the generate file
-        if (!dllp::compile(opt)) {
+    const auto& profile = opt.profile.empty() ? t.general_desc.profile : opt.profile;
+
+    if (!dllp::compile_flags(opt, profile, flags)) {
+        return false;
+    }
+
+    if (!opt.cache) {
+        if (!write_file(".dbn.cpp", source)) {
+            std::cout << "dllp: error: Impossible to write the generated file" << std::endl;
             return false;
         }
+
+        program = "./.dbn.out";
+
+        return dllp::compile(opt, flags, ".dbn.cpp", ".dbn.out");
+    }
+
+    const auto dir = cache_directory(opt);
+
+    if (!make_directories(dir)) {
+        std::cout << "dllp: error: Impossible to create the cache directory " << dir << std::endl;
+        return false;
+    }
+
+    const auto cxx     = std::string(std::getenv("CXX"));
+    const auto pending = dir + "/pending-" + std::to_string(getpid());
+
+    if (!write_file(pending + ".cpp", source)) {
+        std::cout << "dllp: error: Impossible to write the generated file" << std::endl;
+        return false;
+    }
+
+    // The headers are part of the key, through the preprocessed source
+    dll::cache::key key;
+    key.add(command_result(cxx + " " + flags + " -E -P " + pending + ".cpp 2> /dev/null"));
+    key.add(command_result(cxx + " --version"));
+    key.add(flags);
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key.value));
+
+    const auto base   = dir + "/dbn-" + hex;
+    const auto binary = base + ".out";
+
+    program = binary;
+
+    if (dll::cache::exists(binary)) {
+        std::remove((pending + ".cpp").c_str());
+
+        if (!opt.quiet) {
+            std::cout << "Skip compilation" << std::endl;
+        }
+
+        return true;
+    }
+
+    std::rename((pending + ".cpp").c_str(), (base + ".cpp").c_str());
+
+    auto stage_flags = flags;
+    auto output      = binary;
+
+    // The first run collects the profile, the next compilation uses it
+    if (profile == "release_native") {
+        const auto profile_dir = base + ".profile";
+
+        if (has_profile(profile_dir)) {
+            stage_flags += " -fprofile-use=" + profile_dir + " -fprofile-correction ";
+        } else {
+            stage_flags += " -fprofile-generate=" + profile_dir + " ";
+
+            output  = base + ".instrumented";
+            program = output;
+
+            if (dll::cache::exists(output)) {
+                if (!opt.quiet) {
+                    std::cout << "Skip compilation (collecting the profile)" << std::endl;
+                }
+
+                return true;
+            }
+        }
+    }
+
+    // Renamed once complete, another dllp may compile the same network
+    if (!dllp::compile(opt, stage_flags, base + ".cpp", pending + ".out")) {
+        std::remove((pending + ".out").c_str());
+        return false;
+    }
+
+    if (output == binary) {
+        std::remove((base + ".instrumented").c_str());
+    }
+
+    if (std::rename((pending + ".out").c_str(), output.c_str())) {
+        std::cout << "dllp: error: Impossible to store the compiled program in the cache" << std::endl;
+        return false;
     }
 
     return true;
 }
 
-std::string datasource_to_string(const std::string& lhs, const dll::processor::datasource& ds) {
-    std::string result;
+/*!
+ * \brief Indicates if one of the datasources of the task is streamed
+ */
+bool streamed(const dll::processor::task& t) {
+    using dll::processor::is_streamed;
 
-    result += lhs + ".source_file = \"" + ds.source_file + "\";\n";
-    result += lhs + ".reader = \"" + ds.reader + "\";\n";
-    result += lhs + ".binarize = " + (ds.binarize ? "true" : "false") + ";\n";
-    result += lhs + ".normalize = " + (ds.normalize ? "true" : "false") + ";\n";
-    result += lhs + ".scale = " + (ds.scale ? "true" : "false") + ";\n";
-    result += lhs + ".scale_d = " + std::to_string(ds.scale_d) + ";\n";
-    result += lhs + ".normal_noise = " + (ds.normal_noise ? "true" : "false") + ";\n";
-    result += lhs + ".normal_noise_d = " + std::to_string(ds.normal_noise_d) + ";\n";
-    result += lhs + ".limit = " + std::to_string(ds.limit) + ";\n";
-
-    return result;
+    return is_streamed(t.pretraining.samples) || is_streamed(t.training.samples) || is_streamed(t.testing.samples);
 }
 
-std::string pt_desc_to_string(const std::string& lhs, const dll::processor::pretraining_desc& desc) {
-    std::string result;
+/*!
+ * \brief Returns the interpreter program
+ */
+std::string interpreter_program(const dllp::options& opt) {
+    if (!opt.interpreter.empty()) {
+        return opt.interpreter;
+    }
 
-    result += lhs + ".epochs = " + std::to_string(desc.epochs) + ";";
+    if (const auto* env = std::getenv("DLLP_INTERPRETER")) {
+        return env;
+    }
 
-    return result;
+    return "dllp_interpreter";
 }
 
-std::string ft_desc_to_string(const std::string& lhs, const dll::processor::training_desc& desc) {
-    std::string result;
+/*!
+ * \brief Prepare the network to be run by the interpreter, if it is one of
+ * the interpreted networks.
+ *
+ * The description of the network is written with the runtime parameters
+ * into params_file and the interpreter program is set in program.
+ *
+ * \return true if the network can be interpreted, false otherwise
+ */
+bool interpret_exe(const dllp::options& opt, const std::vector<std::string>& actions, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers, const std::string& params_file, std::string& program) {
+    // These options are part of the type of the network
+    if ((t.ft_desc.trainer != "sgd" && t.ft_desc.trainer != "none") || t.ft_desc.decay != "none" || t.ft_desc.verbose || t.general_desc.batch_mode || t.general_desc.threaded
+        || (streamed(t) && t.general_desc.big_batch > 1)) {
+        return false;
+    }
 
-    result += lhs + ".epochs = " + std::to_string(desc.epochs) + ";";
+    dll::processor::parameters params;
 
-    return result;
-}
+    for (size_t i = 0; i < layers.size(); ++i) {
+        if (!layers[i]->interpret(params, "network.layer." + std::to_string(i))) {
+            return false;
+        }
+    }
 
-std::string w_desc_to_string(const std::string& lhs, const dll::processor::weights_desc& desc) {
-    std::string result;
+    params.set("network.layers", layers.size());
+    params.set("network.batch", t.ft_desc.batch_size ? t.ft_desc.batch_size : 1);
 
-    result += lhs + ".file = \"" + desc.file + "\";";
+    std::vector<dll::processor::interpreter::dense_spec> specs;
+    size_t batch = 0;
 
-    return result;
-}
+    if (!dll::processor::interpreter::read_network(params, specs, batch) || !dll::processor::interpreter::supported(specs, batch)) {
+        return false;
+    }
 
-std::string task_to_string(const std::string& name, const dll::processor::task& t) {
-    std::string result;
-
-    result += "   dll::processor::task ";
-    result += name;
-    result += ";\n\n";
-    result += datasource_to_string("   " + name + ".pretraining.samples", t.pretraining.samples);
-    result += "\n";
-    result += datasource_to_string("   " + name + ".pretraining_clean.samples", t.pretraining_clean.samples);
-    result += "\n";
-    result += datasource_to_string("   " + name + ".training.samples", t.training.samples);
-    result += "\n";
-    result += datasource_to_string("   " + name + ".training.labels", t.training.labels);
-    result += "\n";
-    result += datasource_to_string("   " + name + ".testing.samples", t.testing.samples);
-    result += "\n";
-    result += datasource_to_string("   " + name + ".testing.labels", t.testing.labels);
-    result += "\n";
-    result += pt_desc_to_string("   " + name + ".pt_desc", t.pt_desc);
-    result += "\n";
-    result += ft_desc_to_string("   " + name + ".ft_desc", t.ft_desc);
-    result += "\n";
-    result += w_desc_to_string("   " + name + ".w_desc", t.w_desc);
-    result += "\n";
+    if (t.ft_desc.learning_rate != dll::processor::stupid_default) {
+        params.set("learning_rate", t.ft_desc.learning_rate);
+    }
 
-    return result;
+    // Without momentum, the interpreted networks only use SGD
+    params.set("momentum", t.ft_desc.momentum != dll::processor::stupid_default ? t.ft_desc.momentum : 0.0);
+
+    auto final_actions = actions;
+
+    if (std::find(actions.begin(), actions.end(), "auto") != actions.end()) {
+        final_actions = t.default_actions;
+    }
+
+    dll::processor::store_task(params, t, final_actions);
+
+    if (!params.store(params_file)) {
+        std::cout << "dllp: error: Impossible to write the runtime parameters" << std::endl;
+        return false;
+    }
+
+    program = interpreter_program(opt);
+
+    return true;
 }
 
-std::string vector_to_string(const std::string& name, const std::vector<std::string>& vec) {
-    std::string result;
+/*!
+ * \brief Prepare the program running the network, either with the
+ * interpreter or with a compiled program
+ */
+bool prepare_exe(const dllp::options& opt, const std::vector<std::string>& actions, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers, const std::string& params_file, std::string& program) {
+    if (opt.interpret) {
+        if (interpret_exe(opt, actions, t, layers, params_file, program)) {
+            return true;
+        }
 
-    result += "   std::vector<std::string> ";
-    result += name;
-    result += "{";
-    std::string comma = "";
-    for (auto& value : vec) {
-        result += comma;
-        result += "\"";
-        result += value;
-        result += "\"";
-        comma = ", ";
+        if (!opt.quiet) {
+            std::cout << "The network cannot be interpreted, it is compiled" << std::endl;
+        }
     }
-    result += "};";
 
-    return result;
+    return compile_exe(opt, actions, t, layers, params_file, program);
 }
 
 std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t){
@@ -534,7 +768,7 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
         } else {
             return "etl::fast_dyn_vector<float, 784>";
         }
-    } else if(reader == "text"){
+    } else if(reader == "text" || reader == "binary"){
         if(layers.front()->is_conv()){
             return "etl::dyn_matrix<float, 3>";
         } else {
@@ -546,8 +780,14 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
     }
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions) {
-    std::ofstream out_stream(".dbn.cpp");
+/*!
+ * \brief Generate the source of the program of the network.
+ *
+ * Only the type of the network and the keys of its runtime parameters are
+ * generated in the source, the values are stored in params.
+ */
+std::string generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, dll::processor::parameters& params) {
+    std::ostringstream out_stream;
 
     out_stream << "#include <memory>\n";
 
@@ -594,10 +834,11 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
 
     if (t.general_desc.batch_mode) {
         out_stream << ", dll::batch_mode\n";
+    }
 
-        if (t.general_desc.big_batch > 0) {
-            out_stream << ", dll::big_batch_size<" << t.general_desc.big_batch << ">\n";
-        }
+    // The streamed datasources are cached by big batches too
+    if ((t.general_desc.batch_mode || streamed(t)) && t.general_desc.big_batch > 0) {
+        out_stream << ", dll::big_batch_size<" << t.general_desc.big_batch << ">\n";
     }
 
     out_stream << ", dll::weight_decay<dll::decay_type::" << decay_to_str(t.ft_desc.decay) << ">\n";
@@ -605,43 +846,50 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
     out_stream << ">::dbn_t;\n\n";
 
     out_stream << "int main(int argc, char* argv[]){\n";
+    out_stream << "   dll::processor::parameters params;\n";
+    out_stream << "   if (argc < 2 || !params.load(argv[1])) {\n";
+    out_stream << "      std::cout << \"dllp: error: Impossible to read the runtime parameters\" << std::endl;\n";
+    out_stream << "      return 1;\n";
+    out_stream << "   }\n";
     out_stream << "   auto dbn = std::make_unique<dbn_t>();\n";
 
     if (t.ft_desc.learning_rate != dll::processor::stupid_default) {
-        out_stream << "   dbn->learning_rate = " << t.ft_desc.learning_rate << ";\n";
+        out_stream << "   params.apply(\"learning_rate\", dbn->learning_rate);\n";
+        params.set("learning_rate", t.ft_desc.learning_rate);
     }
 
     if (t.ft_desc.momentum != dll::processor::stupid_default) {
-        out_stream << "   dbn->initial_momentum = " << t.ft_desc.momentum << ";\n";
-        out_stream << "   dbn->final_momentum = " << t.ft_desc.momentum << ";\n";
+        out_stream << "   params.apply(\"momentum\", dbn->initial_momentum);\n";
+        out_stream << "   params.apply(\"momentum\", dbn->final_momentum);\n";
+        params.set("momentum", t.ft_desc.momentum);
     }
 
     if (t.ft_desc.l1_weight_cost != dll::processor::stupid_default) {
-        out_stream << "   dbn->l1_weight_cost = " << t.ft_desc.l1_weight_cost << ";\n";
+        out_stream << "   params.apply(\"l1_weight_cost\", dbn->l1_weight_cost);\n";
+        params.set("l1_weight_cost", t.ft_desc.l1_weight_cost);
     }
 
     if (t.ft_desc.l2_weight_cost != dll::processor::stupid_default) {
-        out_stream << "   dbn->l2_weight_cost = " << t.ft_desc.l2_weight_cost << ";\n";
+        out_stream << "   params.apply(\"l2_weight_cost\", dbn->l2_weight_cost);\n";
+        params.set("l2_weight_cost", t.ft_desc.l2_weight_cost);
     }
 
     for (size_t i = 0; i < layers.size(); ++i) {
         auto& layer = layers[i];
 
-        layer->set(out_stream, "   dbn->layer_get<" + std::to_string(i) + ">()");
+        layer->set(out_stream, "dbn->layer_get<" + std::to_string(i) + ">()", "layer." + std::to_string(i), params);
     }
 
-    auto final_actions = actions;
-
-    if(std::find(actions.begin(), actions.end(), "auto") != actions.end()){
-        final_actions = t.default_actions;
-    }
-
-    out_stream << task_to_string("t", t) << "\n";
-    out_stream << vector_to_string("actions", final_actions) << "\n";
+    out_stream << "   dll::processor::task t;\n";
+    out_stream << "   std::vector<std::string> actions;\n";
+    out_stream << "   dll::processor::load_task(params, t, actions);\n";
     out_stream << "   using data_type = " << get_data_type(layers, t) << ";\n";
     out_stream << "   static constexpr bool three = " << layers.front()->is_conv() << ";\n";
-    out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
+    out_stream << "   static constexpr bool threaded = " << t.general_desc.threaded << ";\n";
+    out_stream << "   dll::processor::execute<data_type, three, threaded>(*dbn, t, actions);\n";
     out_stream << "}\n";
+
+    return out_stream.str();
 }
 
 bool append_pkg_flags(std::string& flags, const std::string& pkg) {
@@ -667,46 +915,75 @@ bool append_pkg_flags(std::string& flags, const std::string& pkg) {
     return true;
 }
 
-bool compile(const options& opt) {
-    if (!opt.quiet) {
-        std::cout << "Compiling the program..." << std::endl;
+/*!
+ * \brief Compute the compilation flags of the generated programs
+ */
+bool compile_flags(const options& opt, const std::string& profile, std::string& flags) {
+    if (profile == "debug") {
+        flags += " -g -O0 ";
+    } else if (profile == "release_debug") {
+        flags += " -g -O2 ";
+    } else if (profile == "release" || profile == "release_native") {
+        flags += " -O3 -DNDEBUG -flto -DETL_PARALLEL ";
+
+        if (profile == "release_native") {
+            flags += " -march=native ";
+        }
+    } else {
+        std::cout << "dllp: error: invalid profile must be one of [debug, release_debug, release, release_native]" << std::endl;
+        return false;
     }
 
-    const auto* cxx = std::getenv("CXX");
-
-    std::string compile_command(cxx);
-
-    compile_command += " -o .dbn.out ";
-    compile_command += " -g ";
-    compile_command += " -O2 -DETL_VECTORIZE_FULL ";
-    compile_command += " -std=c++1z ";
-    compile_command += " -pthread ";
-    compile_command += " .dbn.cpp ";
+    flags += " -DETL_VECTORIZE_FULL ";
+    flags += " -std=c++1z ";
+    flags += " -pthread ";
 
     if (opt.mkl) {
-        compile_command += " -DETL_MKL_MODE ";
+        flags += " -DETL_MKL_MODE ";
 
-        if (!append_pkg_flags(compile_command, "mkl")) {
+        if (!append_pkg_flags(flags, "mkl")) {
             return false;
         }
     }
 
     if (opt.cublas) {
-        compile_command += " -DETL_CUBLAS_MODE ";
+        flags += " -DETL_CUBLAS_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cublas")) {
+        if (!append_pkg_flags(flags, "cublas")) {
             return false;
         }
     }
 
     if (opt.cufft) {
-        compile_command += " -DETL_CUFFT_MODE ";
+        flags += " -DETL_CUFFT_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cufft")) {
+        if (!append_pkg_flags(flags, "cufft")) {
             return false;
         }
     }
 
+    // The directory of a dll/pch.hpp precompiled with the flags of the profile
+    // (a precompiled header built with other flags is ignored by the compiler)
+    if (const auto* pch = std::getenv("DLLP_PCH")) {
+        flags += " -I" + std::string(pch) + " -include dll/pch.hpp ";
+    }
+
+    return true;
+}
+
+bool compile(const options& opt, const std::string& flags, const std::string& source, const std::string& output) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the program..." << std::endl;
+    }
+
+    const auto* cxx = std::getenv("CXX");
+
+    std::string compile_command(cxx);
+
+    compile_command += " -o " + output + " ";
+    compile_command += " " + source + " ";
+    compile_command += flags;
+
     int compile_result = system(compile_command.c_str());
 
     if (compile_result) {
@@ -721,6 +998,150 @@ bool compile(const options& opt) {
     return true;
 }
 
+
+/*!
+ * \brief A swept runtime parameter and its values
+ */
+struct sweep_axis {
+    std::string key;                 ///< The runtime parameter
+    std::vector<std::string> values; ///< The values of the parameter
+};
+
+/*!
+ * \brief Parse a sweep grid, one parameter per line: "key: value, value, ..."
+ */
+bool parse_grid(const std::string& grid_file, std::vector<sweep_axis>& axes) {
+    auto lines = read_lines(grid_file);
+
+    if (lines.empty()) {
+        std::cout << "dllp: error: the grid file does not exist or is empty" << std::endl;
+        return false;
+    }
+
+    for (auto& line : lines) {
+        if (line[0] == '#') {
+            continue;
+        }
+
+        auto colon = line.find(':');
+
+        if (colon == std::string::npos) {
+            std::cout << "dllp: error: invalid grid line: " << line << std::endl;
+            return false;
+        }
+
+        sweep_axis axis;
+        axis.key = cpp::trim(line.substr(0, colon));
+
+        std::istringstream stream(line.substr(colon + 1));
+        std::string value;
+
+        while (std::getline(stream, value, ',')) {
+            value = cpp::trim(value);
+
+            if (!value.empty()) {
+                axis.values.push_back(value);
+            }
+        }
+
+        if (axis.values.empty()) {
+            std::cout << "dllp: error: no value for the grid parameter " << axis.key << std::endl;
+            return false;
+        }
+
+        axes.push_back(std::move(axis));
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Run the program with the given parameters in a child process
+ * restricted to the given cores, with its output into log.
+ *
+ * Everything is prepared before the fork, the other threads of dllp may
+ * hold the locks of the allocator.
+ *
+ * \return The exit status of the program
+ */
+int run_trial(const std::string& program, const std::string& params_file, const std::string& log, size_t first_core, size_t cores) {
+    const size_t total = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (size_t c = 0; c < cores; ++c) {
+        CPU_SET((first_core + c) % total, &set);
+    }
+
+    // The BLAS libraries size their thread pools from the environment
+    std::vector<std::string> environment{"OMP_NUM_THREADS=" + std::to_string(cores), "MKL_NUM_THREADS=" + std::to_string(cores)};
+
+    for (char** env = environ; *env; ++env) {
+        if (!starts_with(*env, "OMP_NUM_THREADS=") && !starts_with(*env, "MKL_NUM_THREADS=")) {
+            environment.emplace_back(*env);
+        }
+    }
+
+    std::vector<char*> envp;
+
+    for (auto& env : environment) {
+        envp.push_back(&env[0]);
+    }
+
+    envp.push_back(nullptr);
+
+    std::string program_arg(program);
+    std::string params_arg(params_file);
+
+    char* argv[] = {&program_arg[0], &params_arg[0], nullptr};
+
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        sched_setaffinity(0, sizeof(set), &set);
+
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+
+        execvpe(argv[0], argv, envp.data());
+        _exit(127);
+    }
+
+    close(fd);
+
+    int status = 0;
+
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*!
+ * \brief Returns the value following the last line of the log starting
+ * with the given prefix, or "-" if there is none
+ */
+std::string log_value(const std::string& log, const std::string& prefix) {
+    std::string value = "-";
+
+    for (auto& line : read_lines(log)) {
+        if (starts_with(line, prefix)) {
+            value = cpp::trim(line.substr(prefix.size()));
+        }
+    }
+
+    return value;
+}
+
 } //end of namespace dllp
 
 int dll::processor::process_file(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file) {
@@ -733,19 +1154,30 @@ int dll::processor::process_file(const dllp::options& opt, const std::vector<std
         return 1;
     }
 
+    // The standard output only carries the responses of the server
+    const bool automatic = std::find(actions.begin(), actions.end(), "auto") != actions.end();
+
+    if (dll::processor::serves_standard_output(t.serve_desc, automatic ? t.default_actions : actions)) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     //2. Generate the executable
 
-    if (!dllp::compile_exe(opt, actions, source_file, t, layers)) {
+    std::string program;
+
+    if (!dllp::prepare_exe(opt, actions, t, layers, ".dbn.params", program)) {
         return 1;
     }
 
+    auto command = program + " .dbn.params";
+
     //3. Run the generated program
 
     if (!opt.quiet) {
         std::cout << "Executing the program" << std::endl;
     }
 
-    auto exec_result = system("./.dbn.out");
+    auto exec_result = system(command.c_str());
 
     if (exec_result) {
         std::cout << "Impossible to execute the generated file" << std::endl;
@@ -767,11 +1199,179 @@ std::string dll::processor::process_file_result(const dllp::options& opt, const
 
     //2. Generate the executable
 
-    if (!dllp::compile_exe(opt, actions, source_file, t, layers)) {
+    std::string program;
+
+    if (!dllp::prepare_exe(opt, actions, t, layers, ".dbn.params", program)) {
         return "";
     }
 
+    auto command = program + " .dbn.params";
+
     //3. Execute and return the result directly
 
-    return dllp::command_result("./.dbn.out");
+    return dllp::command_result(command);
+}
+
+int dll::processor::process_sweep(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file, const std::string& grid_file) {
+    //1. Parse the configuration file and the grid
+
+    dll::processor::task t;
+    std::vector<std::unique_ptr<dllp::layer>> layers;
+
+    if (!dllp::parse_file(source_file, t, layers)) {
+        return 1;
+    }
+
+    std::vector<dllp::sweep_axis> axes;
+
+    if (!dllp::parse_grid(grid_file, axes)) {
+        return 1;
+    }
+
+    //2. Generate the executable, once for all the trials
+
+    const std::string dir = ".dbn.sweep";
+
+    if (!dllp::make_directories(dir)) {
+        std::cout << "dllp: error: Impossible to create the sweep directory " << dir << std::endl;
+        return 1;
+    }
+
+    std::string program;
+
+    if (!dllp::prepare_exe(opt, actions, t, layers, dir + "/base.params", program)) {
+        return 1;
+    }
+
+    dll::processor::parameters base;
+
+    if (!base.load(dir + "/base.params")) {
+        std::cout << "dllp: error: Impossible to read the runtime parameters" << std::endl;
+        return 1;
+    }
+
+    // The other parameters are part of the type of the network
+    for (auto& axis : axes) {
+        if (!base.values.count(axis.key)) {
+            std::cout << "dllp: error: " << axis.key << " is not a runtime parameter of the network (it must be set in the configuration)" << std::endl;
+            return 1;
+        }
+    }
+
+    //3. Read and preprocess the samples once, into the dataset cache
+
+    if (dll::cache::directory().empty()) {
+        const auto datasets = dllp::cache_directory(opt) + "/datasets";
+
+        if (!dllp::make_directories(datasets)) {
+            std::cout << "dllp: error: Impossible to create the dataset cache " << datasets << std::endl;
+            return 1;
+        }
+
+        setenv("DLL_DATASET_CACHE", datasets.c_str(), 1);
+    }
+
+    auto prepare = base;
+    prepare.set("actions", "prepare");
+
+    if (!prepare.store(dir + "/prepare.params") || dllp::run_trial(program, dir + "/prepare.params", dir + "/prepare.log", 0, std::max<size_t>(1, std::thread::hardware_concurrency()))) {
+        std::cout << "dllp: error: Impossible to prepare the samples, see " << dir << "/prepare.log" << std::endl;
+        return 1;
+    }
+
+    //4. Write the parameters of the trials
+
+    size_t trials = 1;
+
+    for (auto& axis : axes) {
+        trials *= axis.values.size();
+    }
+
+    std::vector<std::vector<std::string>> values(trials);
+
+    for (size_t k = 0; k < trials; ++k) {
+        auto params = base;
+
+        for (size_t a = 0, rest = k; a < axes.size(); ++a) {
+            values[k].push_back(axes[a].values[rest % axes[a].values.size()]);
+            params.set(axes[a].key, values[k].back());
+            rest /= axes[a].values.size();
+        }
+
+        if (!params.store(dir + "/trial-" + std::to_string(k) + ".params")) {
+            std::cout << "dllp: error: Impossible to write the runtime parameters" << std::endl;
+            return 1;
+        }
+    }
+
+    //5. Run the trials concurrently, each on its own cores
+
+    const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    size_t jobs    = opt.jobs;
+    size_t threads = opt.threads;
+
+    if (!jobs) {
+        jobs = threads ? std::max<size_t>(1, cores / threads) : cores;
+    }
+
+    jobs = std::min(jobs, trials);
+
+    if (!threads) {
+        threads = std::max<size_t>(1, cores / jobs);
+    }
+
+    if (!opt.quiet) {
+        std::cout << "Running " << trials << " trials, " << jobs << " at a time on " << threads << " cores each" << std::endl;
+    }
+
+    std::vector<int> status(trials, 0);
+    std::atomic<size_t> next(0);
+
+    std::vector<std::thread> workers;
+
+    for (size_t j = 0; j < jobs; ++j) {
+        workers.emplace_back([&, j] {
+            for (size_t k = next++; k < trials; k = next++) {
+                const auto name = dir + "/trial-" + std::to_string(k);
+                status[k]       = dllp::run_trial(program, name + ".params", name + ".log", j * threads, threads);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    //6. Report the results
+
+    std::cout << "trial";
+
+    for (auto& axis : axes) {
+        std::cout << " | " << axis.key;
+    }
+
+    std::cout << " | status | train error | test error" << std::endl;
+
+    int result = 0;
+
+    for (size_t k = 0; k < trials; ++k) {
+        const auto log = dir + "/trial-" + std::to_string(k) + ".log";
+
+        std::cout << k;
+
+        for (auto& value : values[k]) {
+            std::cout << " | " << value;
+        }
+
+        std::cout << " | " << status[k]
+                  << " | " << dllp::log_value(log, "Train Classification Error:")
+                  << " | " << dllp::log_value(log, "Error rate:") << std::endl;
+
+        if (status[k]) {
+            result = 1;
+        }
+    }
+
+    return result;
 }
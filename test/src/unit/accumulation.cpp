@@ -0,0 +1,77 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Test Sigmoid -> Sigmoid network with gradient accumulation
+TEST_CASE("unit/accumulation/1", "[unit][accumulation][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 10>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<5>, dll::gradient_accumulation<2>, dll::normalize_pre>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->accumulation_steps == 2);
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// The incomplete group at the end of an epoch is applied within the epoch
+TEST_CASE("unit/accumulation/2", "[unit][accumulation][dbn][mnist][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 50>::layer_t,
+        dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>;
+
+    // Two mini-batches of 5 by epoch, in groups of 3
+    using accumulated_t = dll::dbn_desc<layers_t, dll::batch_size<5>, dll::gradient_accumulation<3>>::dbn_t;
+    using full_t        = dll::dbn_desc<layers_t, dll::batch_size<10>>::dbn_t;
+
+    auto accumulated_dataset = dll::make_mnist_dataset_sub(0, 10, dll::normalize_pre{}, dll::batch_size<5>{});
+    auto full_dataset        = dll::make_mnist_dataset_sub(0, 10, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto accumulated = std::make_unique<accumulated_t>();
+    auto full        = std::make_unique<full_t>();
+
+    auto copy = [](auto& to, const auto& from) {
+        to.w = from.w;
+        to.b = from.b;
+    };
+
+    copy(full->layer_get<0>(), accumulated->layer_get<0>());
+    copy(full->layer_get<1>(), accumulated->layer_get<1>());
+
+    // Each epoch applies the gradients of its 10 samples, once
+    accumulated->fine_tune(accumulated_dataset.train(), 3);
+    full->fine_tune(full_dataset.train(), 3);
+
+    for (size_t i = 0; i < etl::size(full->layer_get<0>().w); ++i) {
+        REQUIRE(accumulated->layer_get<0>().w[i] == Approx(full->layer_get<0>().w[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(full->layer_get<1>().w); ++i) {
+        REQUIRE(accumulated->layer_get<1>().w[i] == Approx(full->layer_get<1>().w[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(full->layer_get<1>().b); ++i) {
+        REQUIRE(accumulated->layer_get<1>().b[i] == Approx(full->layer_get<1>().b[i]));
+    }
+}
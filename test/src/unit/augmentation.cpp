@@ -11,12 +11,14 @@
  */
 
 #include <deque>
+#include <numeric>
 
 #include "dll_test.hpp"
 
 #include "dll/dbn.hpp"
 #include "dll/rbm/rbm.hpp"
 #include "dll/neural/dense_layer.hpp"
+#include "dll/datasets.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -328,3 +330,619 @@ TEST_CASE("unit/augment/mnist/8", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.3);
 }
+
+// Use an in-memory generator with several augmentation threads
+TEST_CASE("unit/augment/mnist/9", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_size<8>, dll::augmentation_workers<4>,
+        dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an out-memory generator with several augmentation threads
+TEST_CASE("unit/augment/mnist/10", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::outmemory_data_generator_desc<
+        dll::batch_size<25>, dll::big_batch_size<8>, dll::augmentation_workers<4>,
+        dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// The ring must hand the batches in order to the consumer, across resets
+TEST_CASE("unit/augment/ring/1", "[unit]") {
+    constexpr size_t B = 4;
+    constexpr size_t N = 37;
+
+    dll::batch_ring<B> ring(N);
+
+    std::vector<size_t> slots(B, 0);
+    std::vector<std::thread> producers;
+
+    for (size_t w = 0; w < 3; ++w) {
+        producers.emplace_back([&ring, &slots] {
+            size_t batch = 0;
+
+            while (ring.acquire(batch)) {
+                slots[ring.slot(batch)] = batch + 1;
+                ring.publish(batch);
+            }
+        });
+    }
+
+    bool ordered = true;
+
+    for (size_t epoch = 0; epoch < 100; ++epoch) {
+        // Some epochs are reset before their end
+        const size_t n = epoch % 3 ? N : epoch % N;
+
+        for (size_t b = 0; b < n; ++b) {
+            ring.wait_ready(b);
+            ordered = ordered && slots[ring.slot(b)] == b + 1;
+            ring.release();
+        }
+
+        ring.reset();
+    }
+
+    ring.stop();
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    REQUIRE(ordered);
+}
+
+// The ring must prefetch more batches when the producers are too slow
+TEST_CASE("unit/augment/ring/2", "[unit]") {
+    constexpr size_t B = 8;
+    constexpr size_t N = 20;
+
+    dll::batch_ring<B> ring(N, 2);
+
+    REQUIRE(ring.stats().depth == 2);
+
+    std::vector<std::thread> producers;
+
+    for (size_t w = 0; w < 2; ++w) {
+        producers.emplace_back([&ring] {
+            size_t batch = 0;
+
+            while (ring.acquire(batch)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                ring.publish(batch);
+            }
+        });
+    }
+
+    for (size_t epoch = 0; epoch < 5; ++epoch) {
+        for (size_t b = 0; b < N; ++b) {
+            ring.wait_ready(b);
+            ring.release();
+        }
+
+        ring.reset();
+    }
+
+    ring.stop();
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    REQUIRE(ring.stats().depth == B);
+    REQUIRE(ring.stats().slots == B);
+}
+
+// The ring must count the time the producers spent filling the batches
+TEST_CASE("unit/augment/ring/3", "[unit]") {
+    constexpr size_t B = 4;
+    constexpr size_t N = 20;
+
+    dll::batch_ring<B> ring(N);
+
+    std::vector<std::thread> producers;
+
+    for (size_t w = 0; w < 2; ++w) {
+        producers.emplace_back([&ring] {
+            size_t batch = 0;
+
+            while (ring.acquire(batch)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                ring.publish(batch);
+            }
+        });
+    }
+
+    for (size_t b = 0; b < N; ++b) {
+        ring.wait_ready(b);
+        ring.release();
+    }
+
+    REQUIRE(ring.stats().busy_ms >= N);
+
+    // The busy time is counted since the last reset
+    ring.reset();
+
+    REQUIRE(ring.stats().busy_ms < N);
+
+    ring.stop();
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+}
+
+// The shuffled samples must stay with their labels
+TEST_CASE("unit/augment/shuffle/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    // The label of each sample is its index
+    std::vector<size_t> indices(dataset.training_images.size());
+    std::iota(indices.begin(), indices.end(), 0);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::big_batch_size<3>, dll::noise<20>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, indices,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    // No noise is applied in test mode
+    generator->set_test();
+
+    for (size_t epoch = 0; epoch < 2; ++epoch) {
+        generator->reset_shuffle();
+
+        size_t samples  = 0;
+        bool consistent = true;
+
+        while (generator->has_next_batch()) {
+            auto data   = generator->data_batch();
+            auto labels = generator->label_batch();
+
+            for (size_t i = 0; i < etl::dim<0>(data); ++i) {
+                const auto& image = dataset.training_images[size_t(labels[i])];
+
+                for (size_t j = 0; j < etl::size(image); ++j) {
+                    consistent = consistent && data(i, j) == image[j];
+                }
+            }
+
+            samples += etl::dim<0>(data);
+
+            generator->next_batch();
+        }
+
+        REQUIRE(consistent);
+        REQUIRE(samples == dataset.training_images.size());
+    }
+}
+
+// Use an in-memory generator storing the samples as bytes
+TEST_CASE("unit/augment/mnist/11", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_size<4>, dll::compact_storage<uint8_t>,
+        dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    REQUIRE(sizeof(etl::value_t<decltype(train_generator->input_cache)>) == 1);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Round-trip a generator through a sharded binary dataset
+TEST_CASE("unit/binary/mnist/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto source = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        dll::inmemory_data_generator_desc<dll::batch_size<25>>{});
+
+    auto paths = dll::write_binary_dataset<uint8_t>(*source, "/tmp/dll_binary_mnist", 100);
+    REQUIRE(paths.size() == 3);
+
+    auto generator = dll::make_binary_generator<float, 1>(paths, 10,
+        dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<3>, dll::categorical>{});
+
+    REQUIRE(generator->size() == dataset.training_images.size());
+
+    for (size_t epoch = 0; epoch < 2; ++epoch) {
+        generator->reset();
+
+        size_t samples  = 0;
+        bool consistent = true;
+
+        while (generator->has_next_batch()) {
+            auto data   = generator->data_batch();
+            auto labels = generator->label_batch();
+
+            for (size_t i = 0; i < etl::dim<0>(data); ++i) {
+                const auto& image = dataset.training_images[samples + i];
+
+                for (size_t j = 0; j < etl::size(image); ++j) {
+                    consistent = consistent && data(i, j) == image[j];
+                }
+
+                consistent = consistent && labels(i, dataset.training_labels[samples + i]) == 1.0f;
+            }
+
+            samples += etl::dim<0>(data);
+
+            generator->next_batch();
+        }
+
+        REQUIRE(consistent);
+        REQUIRE(samples == dataset.training_images.size());
+    }
+}
+
+// The batch mirroring must match the mirroring of each sample
+TEST_CASE("unit/augment/batch/1", "[unit]") {
+    using desc = dll::inmemory_data_generator_desc<dll::horizontal_mirroring, dll::vertical_mirroring>;
+
+    etl::dyn_matrix<float, 4> batch(16, 3, 7, 5);
+    batch = etl::sequence_generator(1.0);
+
+    etl::dyn_matrix<float, 4> expected(batch);
+
+    dll::random_mirrorer<desc> mirrorer(batch(0));
+
+    dll::random_engine g1(42);
+    dll::random_engine g2(42);
+
+    for (size_t i = 0; i < 12; ++i) {
+        mirrorer.transform(expected(i), g1);
+    }
+
+    mirrorer.transform_batch(batch, 12, g2);
+
+    REQUIRE(etl::sum(etl::abs(batch - expected)) == 0.0f);
+}
+
+// The batch noise must corrupt the expected ratio of values
+TEST_CASE("unit/augment/batch/2", "[unit]") {
+    using desc = dll::inmemory_data_generator_desc<dll::noise<30>>;
+
+    etl::dyn_matrix<float, 2> batch(64, 1000);
+    batch = 1.0f;
+
+    dll::random_noise<desc> noiser(batch(0));
+
+    dll::random_engine g(42);
+    noiser.transform_batch(batch, 32, g);
+
+    // Only the first samples are noised
+    REQUIRE(etl::sum(etl::slice(batch, 32, 64)) == 32000.0f);
+
+    const float ratio = 1.0f - etl::sum(etl::slice(batch, 0, 32)) / 32000.0f;
+
+    REQUIRE(ratio > 0.28f);
+    REQUIRE(ratio < 0.32f);
+}
+
+// The elastic distortion must keep a constant image constant
+TEST_CASE("unit/augment/elastic/1", "[unit]") {
+    using desc = dll::inmemory_data_generator_desc<dll::elastic_distortion<3>>;
+
+    etl::dyn_matrix<float, 4> batch(8, 2, 12, 10);
+    batch = 3.0f;
+
+    dll::elastic_distorter<desc> distorter(batch(0));
+
+    dll::random_engine g(42);
+    distorter.transform_batch(batch, 8, g);
+
+    REQUIRE(etl::max(etl::abs(batch - 3.0f)) < 1e-5f);
+}
+
+// Fine-tune directly on a tensor, without copying the samples
+TEST_CASE("unit/view/mnist/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    const size_t n = dataset.training_images.size();
+
+    etl::dyn_matrix<float, 2> samples(n, 28 * 28);
+
+    for (size_t i = 0; i < n; ++i) {
+        samples(i) = dataset.training_images[i] / 255.0f;
+    }
+
+    std::vector<size_t> labels(dataset.training_labels.begin(), dataset.training_labels.end());
+
+    auto generator = dll::make_generator(samples, labels, 10, dll::view_data_generator_desc<dll::batch_size<20>, dll::categorical>{});
+
+    // The batches are views of the tensor
+    generator->reset_shuffle();
+    REQUIRE(generator->data_batch().memory_start() >= samples.memory_start());
+    REQUIRE(generator->data_batch().memory_start() < samples.memory_start() + etl::size(samples));
+
+    const size_t first = (generator->data_batch().memory_start() - samples.memory_start()) / (28 * 28);
+    REQUIRE(generator->label_batch()(0, labels[first]) == 1.0f);
+    REQUIRE(etl::sum(generator->label_batch()) == 20.0f);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(samples, labels, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// The categorical labels are stored as classes and expanded in the batches
+TEST_CASE("unit/generator/sparse/1", "[unit]") {
+    std::vector<etl::dyn_matrix<float, 1>> samples(10, etl::dyn_matrix<float, 1>(5));
+    std::vector<size_t> labels{0, 1, 2, 3, 4, 0, 1, 2, 3, 4};
+
+    auto generator = dll::make_generator(samples, labels, 5, dll::inmemory_data_generator_desc<dll::batch_size<4>, dll::categorical>{});
+
+    REQUIRE(etl::dimensions(generator->label_cache) == 1);
+    REQUIRE(etl::size(generator->label_cache) == 10);
+
+    generator->reset();
+    generator->next_batch();
+
+    auto batch = generator->label_batch();
+
+    REQUIRE(etl::dim<0>(batch) == 4);
+    REQUIRE(etl::dim<1>(batch) == 5);
+    REQUIRE(etl::sum(batch) == 4.0f);
+
+    for (size_t i = 0; i < 4; ++i) {
+        REQUIRE(batch(i, labels[4 + i]) == 1.0f);
+    }
+
+    // One-hot labels are stored back as classes
+    etl::dyn_matrix<float, 2> one_hot(2, 5);
+    one_hot       = 0.0f;
+    one_hot(0, 3) = 1.0f;
+    one_hot(1, 1) = 1.0f;
+
+    generator->set_label_batch(8, one_hot);
+
+    REQUIRE(generator->label_cache[8] == 3.0f);
+    REQUIRE(generator->label_cache[9] == 1.0f);
+}
+
+// The preprocessed dataset must be the same when read from the cache
+TEST_CASE("unit/cache/mnist/1", "[unit]") {
+    REQUIRE(system("rm -rf /tmp/dll_dataset_cache && mkdir -p /tmp/dll_dataset_cache") == 0);
+
+    auto previous = dll::cache::directory();
+    dll::cache::directory() = "/tmp/dll_dataset_cache";
+
+    auto first  = dll::make_mnist_dataset_sub(0, 300, dll::batch_size<25>{}, dll::scale_pre<255>{});
+    auto second = dll::make_mnist_dataset_sub(0, 300, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    dll::cache::directory() = previous;
+
+    REQUIRE(first.train().size() == 300);
+    REQUIRE(second.train().size() == 300);
+
+    REQUIRE(etl::max(first.train().input_cache) <= 1.0f);
+    REQUIRE(etl::sum(etl::abs(first.train().input_cache - second.train().input_cache)) == 0.0f);
+    REQUIRE(etl::sum(etl::abs(first.train().label_cache - second.train().label_cache)) == 0.0f);
+}
+
+TEST_CASE("unit/mapped/mnist/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(300);
+
+    REQUIRE(dataset.training_images.size() == 300);
+
+    auto generator = dll::make_mnist_generator_train(100, 200, dll::batch_size<25>{});
+
+    REQUIRE(generator->size() == 200);
+
+    for (size_t i = 0; i < 200; ++i) {
+        REQUIRE(etl::sum(etl::abs(generator->input_cache(i) - dataset.training_images[100 + i])) == 0.0f);
+        REQUIRE(size_t(generator->label_cache[i]) == size_t(dataset.training_labels[100 + i]));
+    }
+}
+
+TEST_CASE("unit/generator/shard/1", "[unit]") {
+    std::vector<etl::fast_dyn_matrix<float, 3>> samples(103);
+    std::vector<size_t> labels(103);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = float(i);
+        labels[i]  = i % 3;
+    }
+
+    std::vector<size_t> seen(103, 0);
+
+    for (size_t rank = 0; rank < 4; ++rank) {
+        auto generator = dll::make_generator(samples, labels, 3, dll::shard(rank, 4, 42), dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::categorical>{});
+
+        // All the shards have the same number of batches
+        REQUIRE(generator->size() == 25);
+        REQUIRE(generator->batches() == 3);
+
+        for (size_t i = 0; i < generator->size(); ++i) {
+            ++seen[size_t(generator->input_cache(i)(0))];
+        }
+    }
+
+    REQUIRE(std::count(seen.begin(), seen.end(), 1) == 100);
+    REQUIRE(std::count(seen.begin(), seen.end(), 0) == 3);
+}
+
+TEST_CASE("unit/generator/shard/2", "[unit]") {
+    std::vector<etl::fast_dyn_matrix<float, 3>> samples(10);
+    std::vector<size_t> labels(10);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = float(i);
+        labels[i]  = i % 3;
+    }
+
+    auto generator = dll::make_generator(samples.cbegin(), labels.cbegin(), 10, 3, dll::shard(1, 3), dll::outmemory_data_generator_desc<dll::batch_size<2>, dll::big_batch_size<2>, dll::categorical>{});
+
+    REQUIRE(generator->size() == 3);
+    REQUIRE(generator->batches() == 2);
+
+    REQUIRE(generator->data_batch()(0)(0) == 1.0f);
+    REQUIRE(generator->data_batch()(1)(0) == 4.0f);
+
+    generator->next_batch();
+
+    REQUIRE(generator->data_batch()(0)(0) == 7.0f);
+}
+
+// The placement of the caches (NUMA nodes and huge pages) does not change the batches
+TEST_CASE("unit/generator/placement/1", "[unit]") {
+    // Large enough to span several huge pages
+    std::vector<etl::fast_dyn_matrix<float, 784>> samples(1000);
+    std::vector<size_t> labels(1000);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::uniform_generator(-1.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    const auto previous_numa = dll::placement::numa();
+    const auto previous_huge = dll::placement::huge_pages();
+
+    auto batches = [&](auto&& generator) {
+        std::vector<float> values;
+
+        generator->reset();
+
+        while (generator->has_next_batch()) {
+            auto data  = generator->data_batch();
+            auto label = generator->label_batch();
+
+            for (size_t i = 0; i < etl::size(data); ++i) {
+                values.push_back(data[i]);
+            }
+
+            for (size_t i = 0; i < etl::size(label); ++i) {
+                values.push_back(label[i]);
+            }
+
+            generator->next_batch();
+        }
+
+        return values;
+    };
+
+    auto in_batches = [&]() {
+        return batches(dll::make_generator(samples, labels, samples.size(), 10, dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>{}));
+    };
+
+    auto out_batches = [&]() {
+        return batches(dll::make_generator(samples.cbegin(), labels.cbegin(), samples.size(), 10, dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::categorical>{}));
+    };
+
+    // First-touch placement, without huge pages
+    dll::placement::numa()       = dll::placement::numa_policy::DEFAULT;
+    dll::placement::huge_pages() = false;
+
+    const auto in_reference  = in_batches();
+    const auto out_reference = out_batches();
+
+    REQUIRE(in_reference.size() == 1000 * (784 + 10));
+    REQUIRE(out_reference.size() == 1000 * (784 + 10));
+
+    for (auto policy : {dll::placement::numa_policy::DEFAULT, dll::placement::numa_policy::INTERLEAVE, dll::placement::numa_policy::LOCAL}) {
+        for (bool huge : {false, true}) {
+            dll::placement::numa()       = policy;
+            dll::placement::huge_pages() = huge;
+
+            REQUIRE(in_batches() == in_reference);
+            REQUIRE(out_batches() == out_reference);
+        }
+    }
+
+    dll::placement::numa()       = previous_numa;
+    dll::placement::huge_pages() = previous_huge;
+}
@@ -0,0 +1,52 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/binary_dense_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// The packed XNOR/popcount inference computes the same outputs as the training forward
+TEST_CASE("unit/binary/1", "[unit][binary][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::binary_dense_layer_desc<28 * 28, 200, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::binarize_pre<30>{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.01;
+
+    FT_CHECK_DATASET(25, 0.3);
+    TEST_CHECK_DATASET(0.4);
+
+    auto& layer = dbn->template layer_get<0>();
+
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    for (auto& v : batch) {
+        v = v > 0.5f ? 1.0f : 0.0f;
+    }
+
+    etl::fast_dyn_matrix<float, 20, 200> train_output;
+    etl::fast_dyn_matrix<float, 20, 200> test_output;
+
+    layer.forward_batch(train_output, batch);
+    layer.test_forward_batch(test_output, batch);
+
+    REQUIRE(etl::max(etl::abs(train_output - test_output)) < 1e-2);
+
+    // One bit per weight
+    REQUIRE(layer.packed_memory() == 200 * 13 * 8 + 200 * sizeof(float));
+}
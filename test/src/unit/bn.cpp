@@ -5,7 +5,10 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cmath>
+#include <cstdio>
 #include <deque>
+#include <sstream>
 
 #include "dll_test.hpp"
 
@@ -204,3 +207,292 @@ TEST_CASE("unit/bn/5", "[unit][bn]") {
     FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
     TEST_CHECK_2(net, dataset, 0.25);
 }
+
+// Folding of BN into the previous layers for inference
+TEST_CASE("unit/bn/6", "[unit][bn]") {
+    constexpr size_t K = 6;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, K, 5, 5, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<K, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::mp_2d_layer_desc<K, 24, 24, 2, 2>::layer_t,
+
+            dll::dense_layer_desc<K * 12 * 12, 200, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<200, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::early_training, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    std::stringstream stream;
+    net->store(stream);
+
+    auto folded = std::make_unique<network_t>();
+    folded->load(stream);
+
+    REQUIRE(folded->fold_batch_normalization() == 2);
+    REQUIRE(folded->evaluate_error(dataset.test()) == Approx(test_error).epsilon(1e-2));
+
+    // A stored folded network does not normalize twice once loaded
+    std::stringstream folded_stream;
+    folded->store(folded_stream);
+
+    auto reloaded = std::make_unique<network_t>();
+    reloaded->load(folded_stream);
+
+    REQUIRE(reloaded->evaluate_error(dataset.test()) == Approx(test_error).epsilon(1e-2));
+
+    etl::fast_dyn_matrix<float, 25, 1, 28, 28> batch;
+
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto a = etl::force_temporary(folded->forward_batch(batch));
+    auto b = etl::force_temporary(reloaded->forward_batch(batch));
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(b[i] == Approx(a[i]).epsilon(1e-4));
+    }
+}
+
+// Checkpoints hold the statistics of the normalizations
+TEST_CASE("unit/bn/7", "[unit][bn]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<100>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 10, 0.2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    net->store_checkpoint("unit_bn_7.dllc");
+
+    dll::checkpoint_file checkpoint("unit_bn_7.dllc");
+
+    REQUIRE(checkpoint.valid());
+    REQUIRE(checkpoint.tensors() == 8);
+
+    for (size_t t = 0; t < checkpoint.tensors(); ++t) {
+        REQUIRE(checkpoint.tensor(t).offset % 64 == 0);
+    }
+
+    REQUIRE(checkpoint.tensor(0).dims[0] == 28 * 28);
+    REQUIRE(checkpoint.tensor(0).dims[1] == 100);
+    REQUIRE(checkpoint.data<float>(0)[0] == net->layer_get<0>().w(0, 0));
+
+    auto loaded = std::make_unique<network_t>();
+
+    REQUIRE(loaded->load_checkpoint("unit_bn_7.dllc"));
+    REQUIRE(loaded->evaluate_error(dataset.test()) == Approx(test_error));
+
+    // A checkpoint of another network is refused
+    using other_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 50, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<50>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    auto other = std::make_unique<other_t>();
+
+    REQUIRE(!other->load_checkpoint("unit_bn_7.dllc"));
+
+    std::remove("unit_bn_7.dllc");
+}
+
+// The shards of data-parallel training normalize their own mini-batches
+TEST_CASE("unit/bn/8", "[unit][bn][parallel]") {
+    using layers_t = dll::network_layers<
+        dll::dense_layer_desc<28 * 28, 50, dll::no_activation>::layer_t,
+        dll::batch_normalization_2d_layer_desc<50>::layer_t,
+        dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+        dll::dense_layer_desc<50, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>;
+
+    // Four shards of five samples
+    using parallel_t = dll::network_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>, dll::data_parallel<4>>::network_t;
+
+    // The same mini-batches of five samples, one after the other
+    using serial_t = dll::network_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<5>, dll::gradient_accumulation<4>>::network_t;
+
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(80);
+    std::vector<size_t> labels(samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    auto parallel = std::make_unique<parallel_t>();
+    auto serial   = std::make_unique<serial_t>();
+
+    std::stringstream weights;
+    serial->store(weights);
+    parallel->load(weights);
+
+    serial->fine_tune(samples, labels, 3);
+    parallel->fine_tune(samples, labels, 3);
+
+    auto& a = serial->template layer_get<0>().w;
+    auto& b = parallel->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(b[i] == Approx(a[i]).epsilon(1e-4));
+    }
+
+    auto& gamma_a = serial->template layer_get<1>().gamma;
+    auto& gamma_b = parallel->template layer_get<1>().gamma;
+
+    for (size_t i = 0; i < etl::size(gamma_a); ++i) {
+        REQUIRE(gamma_b[i] == Approx(gamma_a[i]).epsilon(1e-4));
+    }
+}
+
+namespace {
+
+// Check the inference of a 2D normalization against the normalization
+// computed from its current statistics and parameters
+template <typename Layer, typename Input>
+void check_bn_2d(const Layer& layer, const Input& input) {
+    Input output;
+    layer.test_forward_batch(output, input);
+
+    for (size_t b = 0; b < etl::dim<0>(input); ++b) {
+        for (size_t i = 0; i < etl::dim<1>(input); ++i) {
+            auto ref = layer.gamma(i) * (input(b, i) - layer.mean(i)) / std::sqrt(layer.var(i) + Layer::e) + layer.beta(i);
+            REQUIRE(output(b, i) == Approx(ref).epsilon(1e-4).margin(1e-5));
+        }
+    }
+}
+
+// Check the inference of a 4D normalization against the normalization
+// computed from its current statistics and parameters
+template <typename Layer, typename Input>
+void check_bn_4d(const Layer& layer, const Input& input) {
+    Input output;
+    layer.test_forward_batch(output, input);
+
+    for (size_t b = 0; b < etl::dim<0>(input); ++b) {
+        for (size_t k = 0; k < etl::dim<1>(input); ++k) {
+            for (size_t i = 0; i < etl::dim<2>(input); ++i) {
+                for (size_t j = 0; j < etl::dim<3>(input); ++j) {
+                    auto ref = layer.gamma(k) * (input(b, k, i, j) - layer.mean(k)) / std::sqrt(layer.var(k) + Layer::e) + layer.beta(k);
+                    REQUIRE(output(b, k, i, j) == Approx(ref).epsilon(1e-4).margin(1e-5));
+                }
+            }
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+// The cached scale and shift follow the changes of the statistics
+TEST_CASE("unit/bn/9", "[unit][bn]") {
+    using layer_t = dll::batch_normalization_2d_layer_desc<20>::layer_t;
+
+    layer_t layer;
+
+    layer.gamma = etl::normal_generator(1.0, 0.5);
+    layer.beta  = etl::normal_generator(0.0, 0.5);
+    layer.mean  = etl::normal_generator(0.0, 1.0);
+    layer.var   = etl::uniform_generator(0.5, 2.0);
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::normal_generator(0.0, 2.0);
+
+    check_bn_2d(layer, input);
+
+    // Cached
+    check_bn_2d(layer, input);
+
+    // A training step changes the statistics and then the parameters
+    etl::fast_dyn_matrix<float, 8, 20> output;
+    layer_t::workspace_t workspace;
+
+    layer.forward_batch(output, input, workspace);
+
+    layer.gamma = etl::normal_generator(1.0, 0.5);
+    layer.beta  = etl::normal_generator(0.0, 0.5);
+
+    check_bn_2d(layer, input);
+
+    // Loaded statistics and parameters
+    layer_t other;
+
+    other.gamma = etl::normal_generator(1.0, 0.5);
+    other.beta  = etl::normal_generator(0.0, 0.5);
+    other.mean  = etl::normal_generator(0.0, 1.0);
+    other.var   = etl::uniform_generator(0.5, 2.0);
+
+    std::stringstream stream;
+    other.store(stream);
+    layer.load(stream);
+
+    check_bn_2d(layer, input);
+
+    // Restored parameters
+    layer.backup_weights();
+
+    layer.gamma = etl::normal_generator(1.0, 0.5);
+    layer.forward_batch(output, input, workspace);
+    check_bn_2d(layer, input);
+
+    layer.restore_weights();
+    check_bn_2d(layer, input);
+}
+
+// The cached scale and shift of the 4D normalization, after training
+TEST_CASE("unit/bn/10", "[unit][bn]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 4, 5, 5, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<4, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<4 * 24 * 24, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    auto& layer = net->template layer_get<1>();
+
+    etl::fast_dyn_matrix<float, 5, 4, 24, 24> input;
+    input = etl::normal_generator(0.0, 1.0);
+
+    check_bn_4d(layer, input);
+
+    net->fine_tune(dataset.train(), 2);
+
+    check_bn_4d(layer, input);
+
+    // Another epoch changes the statistics again
+    net->fine_tune(dataset.train(), 1);
+
+    check_bn_4d(layer, input);
+}
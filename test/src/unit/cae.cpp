@@ -15,10 +15,74 @@
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/pooling/upsample_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/util/deconv_gemm.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
 
+// The GEMM passes compute the same results as the ETL convolutions
+TEST_CASE("conv/ae/deconv/gemm", "[unit][deconv]") {
+    etl::fast_dyn_matrix<float, 3, 2, 5, 4> v;
+    etl::fast_dyn_matrix<float, 2, 3, 3, 2> w;
+    etl::fast_dyn_matrix<float, 3, 3, 7, 5> errors;
+
+    v      = etl::normal_generator(0.0, 1.0);
+    w      = etl::normal_generator(0.0, 1.0);
+    errors = etl::normal_generator(0.0, 1.0);
+
+    const dll::detail::deconv_dims dims{3, 2, 5, 4, 3, 3, 2};
+
+    etl::fast_dyn_matrix<float, 3, 3, 7, 5> out;
+    etl::fast_dyn_matrix<float, 3, 3, 7, 5> out_gemm;
+
+    out = etl::conv_4d_full_flipped(v, w);
+    dll::deconv_gemm_forward(out_gemm, v, w, dims);
+
+    for (size_t i = 0; i < etl::size(out); ++i) {
+        REQUIRE(out_gemm[i] == Approx(out[i]).epsilon(1e-4));
+    }
+
+    etl::fast_dyn_matrix<float, 3, 2, 5, 4> d_v;
+    etl::fast_dyn_matrix<float, 3, 2, 5, 4> d_v_gemm;
+
+    d_v = etl::conv_4d_valid_flipped(errors, w);
+    dll::deconv_gemm_backward(d_v_gemm, errors, w, dims);
+
+    for (size_t i = 0; i < etl::size(d_v); ++i) {
+        REQUIRE(d_v_gemm[i] == Approx(d_v[i]).epsilon(1e-4));
+    }
+
+    etl::fast_dyn_matrix<float, 2, 3, 3, 2> d_w;
+    etl::fast_dyn_matrix<float, 2, 3, 3, 2> d_w_gemm;
+
+    d_w = etl::conv_4d_valid_filter_flipped(errors, v);
+    dll::deconv_gemm_backward_filter(d_w_gemm, errors, v, dims);
+
+    for (size_t i = 0; i < etl::size(d_w); ++i) {
+        REQUIRE(d_w_gemm[i] == Approx(d_w[i]).epsilon(1e-4));
+    }
+}
+
+// The biases are added with the activation, in place
+TEST_CASE("conv/ae/deconv/bias", "[unit][deconv]") {
+    dll::deconv_layer_desc<2, 5, 4, 3, 3, 2, dll::activation<dll::function::SIGMOID>>::layer_t layer;
+
+    layer.b = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 2, 5, 4> v;
+    v = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 3, 7, 5> output;
+    layer.forward_batch(output, v);
+
+    etl::fast_dyn_matrix<float, 3, 3, 7, 5> ref;
+    ref = etl::sigmoid(etl::rep_l<3>(etl::rep<7, 5>(layer.b)) + etl::conv_4d_full_flipped(v, layer.w));
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(output[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+}
+
 // With deconv
 TEST_CASE("conv/ae/deconv/1", "[dense][dbn][mnist][sgd][ae]") {
     typedef dll::dbn_desc<
@@ -0,0 +1,135 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// Checkpoints written in the background during fine-tuning
+TEST_CASE("unit/checkpoint/1", "[unit][checkpoint][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate      = 0.03;
+    dbn->checkpoint_prefix  = "unit_checkpoint";
+    dbn->checkpoint_epochs  = 2;
+    dbn->checkpoint_batches = 25;
+    dbn->checkpoint_keep    = 2;
+
+    dbn->fine_tune(dataset.train(), 6);
+
+    // Written in order: epoch2, batch25, epoch4, batch50, epoch6
+    REQUIRE(!std::ifstream("unit_checkpoint.epoch2.dllc"));
+    REQUIRE(!std::ifstream("unit_checkpoint.batch25.dllc"));
+    REQUIRE(!std::ifstream("unit_checkpoint.epoch4.dllc"));
+    REQUIRE(std::ifstream("unit_checkpoint.batch50.dllc"));
+    REQUIRE(std::ifstream("unit_checkpoint.epoch6.dllc"));
+    REQUIRE(!std::ifstream("unit_checkpoint.epoch6.dllc.tmp"));
+
+    auto loaded = std::make_unique<dbn_t>();
+
+    REQUIRE(loaded->load_checkpoint("unit_checkpoint.batch50.dllc"));
+    REQUIRE(loaded->load_checkpoint("unit_checkpoint.epoch6.dllc"));
+
+    std::remove("unit_checkpoint.batch50.dllc");
+    std::remove("unit_checkpoint.epoch6.dllc");
+}
+
+// Checkpoints stored in reduced precision
+TEST_CASE("unit/checkpoint/2", "[unit][checkpoint][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    const dll::checkpoint_precision precisions[] = {dll::checkpoint_precision::FP16, dll::checkpoint_precision::BF16, dll::checkpoint_precision::INT8};
+    const double tolerances[]                    = {1e-3, 1e-2, 2e-2};
+
+    std::stringstream native;
+    dll::store_checkpoint(*dbn, native);
+
+    for (size_t p = 0; p < 3; ++p) {
+        dbn->store_checkpoint("unit_checkpoint_1.dllc", precisions[p]);
+
+        dll::checkpoint_file checkpoint("unit_checkpoint_1.dllc");
+
+        REQUIRE(checkpoint.valid());
+        REQUIRE(checkpoint.precision() == precisions[p]);
+        REQUIRE(checkpoint.header().dtype == (p < 2 ? 2 : 1));
+        REQUIRE(checkpoint.header().length < native.str().size() / 1.9);
+
+        auto loaded = std::make_unique<dbn_t>();
+
+        REQUIRE(loaded->load_checkpoint("unit_checkpoint_1.dllc"));
+
+        auto& w = dbn->layer_get<0>().w;
+        auto& l = loaded->layer_get<0>().w;
+
+        const double max = etl::max(etl::abs(w));
+
+        for (size_t i = 0; i < etl::size(w); ++i) {
+            REQUIRE(std::abs(l[i] - w[i]) <= tolerances[p] * max);
+        }
+    }
+
+    std::remove("unit_checkpoint_1.dllc");
+}
+
+// Networks created from a checkpoint, without initialization
+TEST_CASE("unit/checkpoint/3", "[unit][checkpoint][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->store_checkpoint("unit_checkpoint_2.dllc");
+    dbn->store("unit_checkpoint_2.dat");
+
+    // The random engine is not used by the uninitialized layers
+    auto state = dll::rand_engine();
+
+    auto loaded = dbn_t::from_checkpoint("unit_checkpoint_2.dllc");
+    auto stored = dbn_t::from_file("unit_checkpoint_2.dat");
+
+    REQUIRE(dll::rand_engine() == state);
+
+    REQUIRE(loaded);
+    REQUIRE(stored);
+
+    for (size_t i = 0; i < etl::size(dbn->layer_get<0>().w); ++i) {
+        REQUIRE(loaded->layer_get<0>().w[i] == dbn->layer_get<0>().w[i]);
+        REQUIRE(stored->layer_get<0>().w[i] == dbn->layer_get<0>().w[i]);
+    }
+
+    REQUIRE(!dbn_t::from_checkpoint("unit_checkpoint_2.missing"));
+    REQUIRE(!dbn_t::from_file("unit_checkpoint_2.missing"));
+
+    std::remove("unit_checkpoint_2.dllc");
+    std::remove("unit_checkpoint_2.dat");
+}
@@ -14,6 +14,7 @@
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/pooling/avgp_layer.hpp"
+#include "dll/pooling/global_avgp_layer.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -92,3 +93,66 @@ TEST_CASE("unit/conv/sgd/8", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.25);
 }
+
+TEST_CASE("unit/conv/sgd/9", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer<1, 28, 28, 16, 5, 5, dll::relu>,
+            dll::mp_3d_layer<16, 24, 24, 1, 2, 2>,
+            dll::conv_layer<16, 12, 12, 32, 3, 3, dll::relu>,
+            dll::global_avgp_layer<32, 10, 10>,
+            dll::dense_layer<32, 10, dll::softmax>
+        >,
+        dll::updater<dll::updater_type::ADAM>,
+        dll::batch_size<20>
+    >::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(2000);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->display();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(50, 0.2);
+    TEST_CHECK(0.4);
+}
+
+// The global average pooling is an average pooling over the full feature maps
+TEST_CASE("unit/conv/global_avgp/1", "[unit][conv][pooling]") {
+    dll::avgp_3d_layer<6, 10, 10, 1, 10, 10> avgp;
+    dll::global_avgp_layer<6, 10, 10> gavgp;
+
+    etl::fast_dyn_matrix<float, 4, 6, 10, 10> input;
+    input = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4, 6, 1, 1> a_output;
+    etl::fast_dyn_matrix<float, 4, 6> g_output;
+
+    avgp.test_forward_batch(a_output, input);
+    gavgp.test_forward_batch(g_output, input);
+
+    for (size_t i = 0; i < etl::size(g_output); ++i) {
+        REQUIRE(g_output[i] == Approx(a_output[i]).epsilon(1e-5));
+    }
+
+    etl::fast_dyn_matrix<float, 4, 6, 1, 1> a_errors;
+    a_errors = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4, 6> g_errors;
+    g_errors = etl::reshape<4, 6>(a_errors);
+
+    etl::fast_dyn_matrix<float, 4, 6, 10, 10> a_back;
+    etl::fast_dyn_matrix<float, 4, 6, 10, 10> g_back;
+
+    a_back = etl::ml::avg_pool_3d_backward<1, 10, 10>(input, a_output, a_errors);
+    dll::global_avg_pool_backward(g_back, g_errors);
+
+    for (size_t i = 0; i < etl::size(g_back); ++i) {
+        REQUIRE(g_back[i] == Approx(a_back[i]).epsilon(1e-5));
+    }
+}
@@ -12,6 +12,8 @@
 #include "dll/neural/conv_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
+#include "dll/neural/batch_normalization_layer.hpp"
+#include "dll/rbm/conv_rbm.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/pooling/avgp_layer.hpp"
@@ -70,3 +72,122 @@ TEST_CASE("unit/conv/sgd/10", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.22);
 }
+
+// Sliding-window inference over an image larger than the patches
+TEST_CASE("unit/conv/sliding/0", "[unit][conv][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 12, 12, 4, 5, 5, dll::activation<dll::function::RELU>>::layer_t,
+            dll::conv_layer_desc<4, 8, 8, 6, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::activation_layer_desc<dll::function::TANH>::layer_t,
+            dll::dense_layer_desc<6 * 6 * 6, 20, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<20, 10, dll::softmax>::layer_t
+        >, dll::batch_size<16>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 1, 20, 20> image;
+    etl::fast_dyn_matrix<float, 1, 12, 12> patch;
+
+    image = etl::normal_generator(0.0, 1.0);
+
+    auto output = dbn->forward_sliding_window(image);
+
+    REQUIRE(etl::dim<0>(output) == 10);
+    REQUIRE(etl::dim<1>(output) == 9);
+    REQUIRE(etl::dim<2>(output) == 9);
+
+    for (size_t y = 0; y < 9; ++y) {
+        for (size_t x = 0; x < 9; ++x) {
+            for (size_t i = 0; i < 12; ++i) {
+                for (size_t j = 0; j < 12; ++j) {
+                    patch(0, i, j) = image(0, y + i, x + j);
+                }
+            }
+
+            auto expected = dbn->forward_one(patch);
+
+            for (size_t o = 0; o < 10; ++o) {
+                REQUIRE(output(o, y, x) == Approx(expected[o]).epsilon(1e-4));
+            }
+        }
+    }
+}
+
+// Sliding-window inference of a CRBM stack, without dense head
+TEST_CASE("unit/conv/sliding/1", "[unit][crbm][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_rbm_desc<1, 10, 10, 3, 3, 3, dll::batch_size<10>>::layer_t,
+            dll::conv_rbm_desc<3, 8, 8, 4, 3, 3, dll::hidden<dll::unit_type::RELU>, dll::batch_size<10>>::layer_t
+        >, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 1, 16, 16> image;
+    etl::fast_dyn_matrix<float, 1, 10, 10> patch;
+
+    image = etl::uniform_generator(0.0, 1.0);
+
+    auto output = dbn->forward_sliding_window(image);
+
+    REQUIRE(etl::dim<0>(output) == 4);
+    REQUIRE(etl::dim<1>(output) == 12);
+    REQUIRE(etl::dim<2>(output) == 12);
+
+    // The output of each patch is a window of the feature maps of the image
+    for (size_t y = 0; y < 7; y += 3) {
+        for (size_t x = 0; x < 7; x += 2) {
+            for (size_t i = 0; i < 10; ++i) {
+                for (size_t j = 0; j < 10; ++j) {
+                    patch(0, i, j) = image(0, y + i, x + j);
+                }
+            }
+
+            auto expected = dbn->forward_one(patch);
+
+            for (size_t k = 0; k < 4; ++k) {
+                for (size_t i = 0; i < 6; ++i) {
+                    for (size_t j = 0; j < 6; ++j) {
+                        REQUIRE(output(k, y + i, x + j) == Approx(expected(k, i, j)).epsilon(1e-4));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The inference of a convolutional network, for any number of samples
+TEST_CASE("unit/conv/inference/0", "[unit][conv][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 12, 12, 4, 3, 3, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<4, 10, 10>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::mp_2d_layer_desc<4, 10, 10, 2, 2>::layer_t,
+            dll::dense_layer_desc<4 * 5 * 5, 10, dll::softmax>::layer_t
+        >, dll::batch_size<16>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 16, 1, 12, 12> batch;
+    etl::fast_dyn_matrix<float, 1, 12, 12> sample;
+
+    batch = etl::normal_generator(0.0, 1.0);
+
+    auto expected = etl::force_temporary(dbn->forward_batch(batch));
+
+    auto context = dbn->make_inference_context(sample);
+
+    for (size_t n : {1UL, 7UL, 16UL, 3UL}) {
+        auto& output = dbn->forward_batch(context, etl::slice(batch, 0, n));
+
+        for (size_t i = 0; i < n * 10; ++i) {
+            REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+        }
+
+        for (size_t i = n * 10; i < 16 * 10; ++i) {
+            REQUIRE(output[i] == 0.0f);
+        }
+    }
+}
@@ -58,3 +58,44 @@ TEST_CASE("unit/conv/same/2", "[conv][dbn][mnist][sgd]") {
     FT_CHECK(100, 5e-2);
     TEST_CHECK(0.2);
 }
+
+TEST_CASE("unit/conv/same/3", "[conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_same_desc<1, 28, 28, 6, 3, 3, dll::dilation<2>, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<6 * 28 * 28, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->display();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+TEST_CASE("unit/conv/same/4", "[conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_same_desc<1, 28, 28, 6, 3, 3, dll::stride<2>, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::conv_layer_desc<6, 14, 14, 8, 4, 4, dll::stride<2>, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<8 * 6 * 6, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->display();
+
+    FT_CHECK(100, 5e-2);
+    TEST_CHECK(0.25);
+}
@@ -0,0 +1,159 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/util/conv_tuner.hpp"
+
+// The passes run through the tuner compute the same results as ETL
+TEST_CASE("unit/conv_tuner/1", "[unit][conv]") {
+    constexpr size_t batch = 5;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<2, 10, 10, 4, 3, 3, dll::no_activation>::layer_t,
+            dll::dense_layer_desc<4 * 8 * 8, 10, dll::softmax>::layer_t
+        >,
+        dll::batch_size<batch>>::network_t;
+
+    using layer_t = network_t::layer_type<0>;
+
+    auto net = std::make_unique<network_t>();
+
+    auto& layer = net->template layer_get<0>();
+
+    layer.b = etl::normal_generator(0.0, 1.0);
+
+    dll::full_sgd_context<network_t, layer_t, 0> context(layer);
+
+    context.input  = etl::normal_generator(0.0, 1.0);
+    context.errors = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, batch, 4, 8, 8> ref_output;
+    etl::fast_dyn_matrix<float, batch, 2, 10, 10> ref_errors;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> ref_grad;
+
+    ref_output = etl::ml::convolution_forward(context.input, layer.w);
+    ref_errors = etl::ml::convolution_backward(context.errors, layer.w);
+    ref_grad   = etl::ml::convolution_backward_filter(context.input, context.errors);
+
+    for (size_t b = 0; b < batch; ++b) {
+        for (size_t k = 0; k < 4; ++k) {
+            ref_output(b)(k) += layer.b(k);
+        }
+    }
+
+    dll::conv_tuner::instance().clear();
+
+    etl::fast_dyn_matrix<float, batch, 2, 10, 10> errors;
+
+    // The first run tunes the passes, the second one uses the tuned implementations
+    for (size_t run = 0; run < 2; ++run) {
+        context.output = 0;
+        errors         = 0;
+
+        layer.forward_batch(context.output, context.input);
+        layer.backward_batch(errors, context);
+        layer.compute_gradients(context);
+
+        for (size_t i = 0; i < etl::size(ref_output); ++i) {
+            REQUIRE(context.output[i] == Approx(ref_output[i]).epsilon(1e-4).margin(1e-4));
+        }
+
+        for (size_t i = 0; i < etl::size(ref_errors); ++i) {
+            REQUIRE(errors[i] == Approx(ref_errors[i]).epsilon(1e-4).margin(1e-4));
+        }
+
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        for (size_t i = 0; i < etl::size(ref_grad); ++i) {
+            REQUIRE(grad[i] == Approx(ref_grad[i]).epsilon(1e-4).margin(1e-4));
+        }
+
+#ifdef ETL_MANUAL_SELECT
+        REQUIRE(dll::conv_tuner::instance().size() == 3);
+#endif
+    }
+
+    dll::conv_tuner::instance().clear();
+}
+
+// A pass with a GEMM implementation is tuned once, the tuned
+// implementation is kept in the stored file
+TEST_CASE("unit/conv_tuner/2", "[unit][conv]") {
+    auto& tuner = dll::conv_tuner::instance();
+
+    tuner.clear();
+
+    etl::fast_matrix<float, 12, 12> a;
+    etl::fast_matrix<float, 3, 3> k;
+    etl::fast_matrix<float, 14, 14> c;
+
+    a = etl::normal_generator(0.0, 1.0);
+    k = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_matrix<float, 14, 14> ref;
+    ref = etl::conv_2d_full(a, k);
+
+    size_t calls = 0;
+
+    auto direct = [&] {
+        ++calls;
+        c = etl::conv_2d_full(a, k);
+    };
+
+    auto gemm = [&] {
+        ++calls;
+
+        c = 0;
+
+        for (size_t i = 0; i < 12; ++i) {
+            for (size_t j = 0; j < 12; ++j) {
+                for (size_t m = 0; m < 3; ++m) {
+                    for (size_t n = 0; n < 3; ++n) {
+                        c(i + m, j + n) += a(i, j) * k(m, n);
+                    }
+                }
+            }
+        }
+    };
+
+    tuner.run(dll::conv_pass::DECONV_FORWARD, {1, 1, 12, 12, 1, 3, 3}, direct, gemm);
+
+    // Both implementations have been benchmarked
+    REQUIRE(calls > 2);
+    REQUIRE(tuner.size() == 1);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(c[i] == Approx(ref[i]).epsilon(1e-4).margin(1e-4));
+    }
+
+    REQUIRE(tuner.store("unit_conv_tuner.txt"));
+
+    tuner.clear();
+
+    REQUIRE(tuner.size() == 0);
+    REQUIRE(tuner.load("unit_conv_tuner.txt"));
+    REQUIRE(tuner.size() == 1);
+
+    // The loaded shape is not benchmarked again
+    calls = 0;
+    c     = 0;
+
+    tuner.run(dll::conv_pass::DECONV_FORWARD, {1, 1, 12, 12, 1, 3, 3}, direct, gemm);
+
+    REQUIRE(calls == 1);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(c[i] == Approx(ref[i]).epsilon(1e-4).margin(1e-4));
+    }
+
+    tuner.clear();
+}
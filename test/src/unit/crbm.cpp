@@ -160,3 +160,184 @@ TEST_CASE("unit/crbm/mnist/7", "[crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 7e-2);
 }
+
+TEST_CASE("unit/crbm/mnist/8", "[crbm][parallel][unit]") {
+    dll::conv_rbm_square_desc<
+        1, 28, 20, 17,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::weight_decay<dll::decay_type::L2_FULL>,
+        dll::data_parallel<2>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 25);
+    REQUIRE(error < 5e-2);
+}
+
+// The FFT convolutions give the same activations as the direct ones
+TEST_CASE("unit/crbm/fft/1", "[crbm][unit]") {
+    dll::conv_rbm_square_desc<
+        2, 28, 8, 17,
+        dll::batch_size<4>>::layer_t rbm;
+
+    REQUIRE(dll::conv_fft_plan<float>::pays_off(8, 2, 28, 28, 17, 17));
+
+    rbm.w = etl::normal_generator(0.0, 0.1);
+
+    etl::fast_dyn_matrix<float, 4, 2, 28, 28> v;
+    etl::fast_dyn_matrix<float, 4, 8, 12, 12> h;
+    v = etl::uniform_generator(0.0, 1.0);
+    h = etl::uniform_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4, 8, 12, 12> h_direct;
+    etl::fast_dyn_matrix<float, 4, 2, 28, 28> v_direct;
+    rbm.batch_conv_hidden(h_direct, v);
+    rbm.batch_conv_visible(v_direct, h);
+
+    rbm.fft.prepare(rbm.w, 28, 28);
+    REQUIRE(rbm.fft.ready());
+
+    etl::fast_dyn_matrix<float, 4, 8, 12, 12> h_fft;
+    etl::fast_dyn_matrix<float, 4, 2, 28, 28> v_fft;
+    rbm.batch_conv_hidden(h_fft, v);
+    rbm.batch_conv_visible(v_fft, h);
+
+    for (size_t i = 0; i < etl::size(h_fft); ++i) {
+        REQUIRE(h_fft[i] == Approx(h_direct[i]).epsilon(1e-3));
+    }
+
+    for (size_t i = 0; i < etl::size(v_fft); ++i) {
+        REQUIRE(v_fft[i] == Approx(v_direct[i]).epsilon(1e-3));
+    }
+
+    rbm.fft.invalidate();
+    REQUIRE(!rbm.fft.ready());
+}
+
+// The biases added in place give the same results as the replicated biases
+TEST_CASE("unit/crbm/bias/1", "[crbm][unit]") {
+    dll::conv_rbm_square_desc<
+        2, 10, 4, 7,
+        dll::batch_size<3>>::layer_t rbm;
+
+    rbm.w = etl::normal_generator(0.0, 0.1);
+    rbm.b = etl::normal_generator(0.0, 1.0);
+    rbm.c = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 2, 10, 10> v;
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> h;
+    v = etl::uniform_generator(0.0, 1.0);
+    h = etl::uniform_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> h_a;
+    etl::fast_dyn_matrix<float, 3, 2, 10, 10> v_a;
+    rbm.batch_activate_hidden<true, false>(h_a, h_a, v, v);
+    rbm.batch_activate_visible<true, false>(h, h, v_a, v_a);
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> h_ref;
+    etl::fast_dyn_matrix<float, 3, 2, 10, 10> v_ref;
+    h_ref = etl::sigmoid(etl::rep_l<3>(etl::rep<7, 7>(rbm.b)) + etl::conv_4d_valid_flipped(v, rbm.w));
+    v_ref = etl::sigmoid(etl::rep_l<3>(etl::rep<10, 10>(rbm.c)) + etl::conv_4d_full(h, rbm.w));
+
+    for (size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_a[i] == Approx(h_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(v_a); ++i) {
+        REQUIRE(v_a[i] == Approx(v_ref[i]).epsilon(1e-4));
+    }
+
+    // The single-sample activation uses the same biases
+    etl::fast_dyn_matrix<float, 4, 7, 7> h_one;
+    rbm.activate_hidden<true, false>(h_one, h_one, v(1), v(1));
+
+    for (size_t i = 0; i < etl::size(h_one); ++i) {
+        REQUIRE(h_one[i] == Approx(h_ref(1)[i]).epsilon(1e-4));
+    }
+
+    // The energies from the replicated biases
+    etl::fast_dyn_matrix<float, 4, 7, 7> x;
+    x = etl::rep<7, 7>(rbm.b) + etl::conv_4d_valid_flipped(etl::reshape<1, 2, 10, 10>(v(0)), rbm.w)(0);
+
+    double free_energy = -etl::sum(rbm.c >> etl::sum_r(v(0))) - etl::sum(etl::log(1.0 + etl::exp(x)));
+
+    REQUIRE(rbm.free_energy(v(0)) == Approx(free_energy).epsilon(1e-4));
+
+    dll::conv_rbm_square_desc<
+        2, 10, 4, 7,
+        dll::batch_size<3>,
+        dll::visible<dll::unit_type::GAUSSIAN>>::layer_t gaussian;
+
+    gaussian.w = rbm.w;
+    gaussian.b = rbm.b;
+    gaussian.c = rbm.c;
+
+    double visible_energy = etl::sum(etl::pow(v(0) - etl::rep<10, 10>(rbm.c), 2) / 2.0);
+
+    REQUIRE(gaussian.free_energy(v(0)) == Approx(-visible_energy - etl::sum(etl::log(1.0 + etl::exp(x)))).epsilon(1e-4));
+
+    x = etl::conv_4d_valid_flipped(etl::reshape<1, 2, 10, 10>(v(0)), rbm.w)(0);
+
+    double energy = -visible_energy - etl::sum(rbm.b >> etl::sum_r(h(0))) - etl::sum(h(0) >> x);
+
+    REQUIRE(gaussian.energy(v(0), h(0)) == Approx(energy).epsilon(1e-4));
+}
+
+// The fused pass computes the statistics of the separate passes
+TEST_CASE("unit/crbm/sparsity/1", "[crbm][unit]") {
+    using rbm_t = dll::conv_rbm_square_desc<2, 9, 4, 5, dll::batch_size<3>>::layer_t;
+
+    etl::fast_matrix<float, 3, 4, 5, 5> h1;
+    etl::fast_matrix<float, 3, 4, 5, 5> h2;
+
+    h1 = etl::uniform_generator(0.0, 1.0);
+    h2 = etl::uniform_generator(0.0, 1.0);
+
+    etl::fast_vector<float, 4> b_grad;
+    etl::fast_matrix<float, 4, 5, 5> h_sum;
+
+    dll::hidden_statistics(h1, h2, b_grad, h_sum);
+
+    etl::fast_vector<float, 4> b_ref;
+    etl::fast_vector<float, 4> b_bias_ref;
+
+    b_ref      = etl::mean_r(etl::sum_l(h1 - h2));
+    b_bias_ref = etl::mean_r(etl::mean_l(h2));
+
+    etl::fast_vector<float, 4> b_bias;
+    b_bias = etl::mean_r(h_sum) / 3.0f;
+
+    for (size_t k = 0; k < 4; ++k) {
+        REQUIRE(b_grad[k] == Approx(b_ref[k]).epsilon(1e-5).margin(1e-5));
+        REQUIRE(b_bias[k] == Approx(b_bias_ref[k]).epsilon(1e-5));
+    }
+
+    REQUIRE(etl::sum(h_sum) / (3 * etl::size(h_sum)) == Approx(etl::mean(h2)).epsilon(1e-5));
+
+    // The local penalty of a filter applies to all its weights
+    rbm_t rbm;
+    dll::base_trainer<rbm_t> trainer;
+
+    etl::fast_matrix<float, 4, 2, 5, 5> w_grad;
+    etl::fast_vector<float, 4> penalty;
+
+    w_grad  = etl::normal_generator(0.0, 1.0);
+    penalty = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_matrix<float, 4, 2, 5, 5> w_ref;
+    w_ref = w_grad;
+
+    for (size_t k = 0; k < 4; ++k) {
+        w_ref(k) = w_ref(k) - penalty(k);
+    }
+
+    trainer.update_grad<dll::decay_type::NONE>(w_grad, rbm.w, rbm, etl::rep_r(penalty, 2, 5, 5));
+
+    for (size_t i = 0; i < etl::size(w_grad); ++i) {
+        REQUIRE(w_grad[i] == Approx(w_ref[i]).epsilon(1e-5).margin(1e-5));
+    }
+}
@@ -157,3 +157,52 @@ TEST_CASE("unit/crbm_mp/mnist/7", "[crbm_mp][lee][gaussian][unit]") {
     auto error = rbm.train(dataset.training_images, 30);
     REQUIRE(error < 0.1);
 }
+
+// The fused probabilistic max pooling gives the same probabilities as ETL
+TEST_CASE("unit/crbm_mp/pmp/1", "[crbm_mp][unit]") {
+    dll::conv_rbm_mp_desc_square<
+        1, 28, 5, 17, 2,
+        dll::batch_size<4>>::layer_t rbm;
+
+    rbm.w = etl::normal_generator(0.0, 0.1);
+    rbm.b = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4, 1, 28, 28> v;
+    v = etl::uniform_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4, 5, 12, 12> h_a;
+    etl::fast_dyn_matrix<float, 4, 5, 12, 12> h_s;
+    etl::fast_dyn_matrix<float, 4, 5, 6, 6> p_a;
+    etl::fast_dyn_matrix<float, 4, 5, 6, 6> p_s;
+
+    rbm.batch_activate_hidden<true, true>(h_a, h_s, v, v);
+    rbm.batch_activate_pooling<true, true>(p_a, p_s, v, v);
+
+    auto x = etl::force_temporary(etl::rep_l<4>(etl::rep<12, 12>(rbm.b)) + etl::conv_4d_valid_flipped(v, rbm.w));
+
+    etl::fast_dyn_matrix<float, 4, 5, 12, 12> ref_h;
+    etl::fast_dyn_matrix<float, 4, 5, 6, 6> ref_p;
+    ref_h = etl::p_max_pool_h(x, 2, 2);
+    ref_p = etl::p_max_pool_p(x, 2, 2);
+
+    for (size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_a[i] == Approx(ref_h[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(p_a); ++i) {
+        REQUIRE(p_a[i] == Approx(ref_p[i]).epsilon(1e-4));
+    }
+
+    // At most one unit is on in each block
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t k = 0; k < 5; ++k) {
+            for (size_t i = 0; i < 6; ++i) {
+                for (size_t j = 0; j < 6; ++j) {
+                    auto on = h_s(b, k, 2 * i, 2 * j) + h_s(b, k, 2 * i + 1, 2 * j) + h_s(b, k, 2 * i, 2 * j + 1) + h_s(b, k, 2 * i + 1, 2 * j + 1);
+                    REQUIRE(on <= 1.0f);
+                    REQUIRE((p_s(b, k, i, j) == 0.0f || p_s(b, k, i, j) == 1.0f));
+                }
+            }
+        }
+    }
+}
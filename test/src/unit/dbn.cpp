@@ -5,13 +5,23 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
 #include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 #include "dll_test.hpp"
 
 #define DLL_SVM_SUPPORT
 
 #include "dll/dbn.hpp"
+#include "dll/generators/async_source.hpp"
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/dyn_rbm.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
@@ -220,6 +230,198 @@ TEST_CASE("unit/dbn/mnist/7", "[dbn][svm][unit]") {
     REQUIRE(test_error < 0.2);
 }
 
+// The SVM model is stored in memory with the network
+TEST_CASE("unit/dbn/mnist/16", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels));
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+
+    std::stringstream stream;
+    dbn->store(stream);
+
+    auto loaded = std::make_unique<dbn_t>();
+    loaded->load(stream);
+
+    REQUIRE(loaded->svm_loaded);
+    REQUIRE(dll::test_set(loaded, dataset.training_images, dataset.training_labels, dll::svm_predictor()) == Approx(test_error));
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(loaded->svm_predict(dataset.training_images[i]) == dbn->svm_predict(dataset.training_images[i]));
+    }
+
+    // The previous versions stored the libsvm text format after the layers
+    std::stringstream legacy;
+
+    dbn->template layer_get<0>().store(legacy);
+    dbn->template layer_get<1>().store(legacy);
+
+    cpp::binary_write(legacy, true);
+
+    svm::save(dbn->svm_model, "unit_dbn_mnist_16.svm");
+
+    {
+        std::ifstream svm_is("unit_dbn_mnist_16.svm", std::ios::binary);
+        legacy << svm_is.rdbuf();
+    }
+
+    std::remove("unit_dbn_mnist_16.svm");
+
+    auto legacy_loaded = std::make_unique<dbn_t>();
+    legacy_loaded->load(legacy);
+
+    REQUIRE(legacy_loaded->svm_loaded);
+    REQUIRE(!legacy_loaded->linear_model.trained());
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(legacy_loaded->svm_predict(dataset.training_images[i]) == dbn->svm_predict(dataset.training_images[i]));
+    }
+}
+
+// The SVM problem only stores the non-zero features
+TEST_CASE("unit/dbn/mnist/17", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::RELU>>::layer_t>,
+        dll::batch_size<25>, dll::svm_concatenate>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels));
+
+    // The nodes are ordered and the zero features are skipped
+    for (size_t i = 0; i < 10; ++i) {
+        auto features = dbn->full_activation_probabilities(dataset.training_images[i]);
+
+        auto* nodes = dbn->problem.sample(i);
+
+        size_t k = 0;
+
+        for (size_t j = 0; j < etl::size(features); ++j) {
+            if (features[j] != 0.0f) {
+                REQUIRE(nodes[k].index == int(j + 1));
+                REQUIRE(nodes[k].value == Approx(features[j]));
+                ++k;
+            }
+        }
+
+        REQUIRE(nodes[k].index == -1);
+    }
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+}
+
+// Linear SVM on the concatenated features
+TEST_CASE("unit/dbn/mnist/19", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>, dll::svm_concatenate>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+    REQUIRE(dbn->linear_svm_train(dataset.training_images, dataset.training_labels));
+
+    REQUIRE(dbn->linear_model.classes() == 10);
+    REQUIRE(dbn->linear_model.features() == 100 + 200);
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::linear_svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+
+    // The batched prediction is the same as the prediction of each sample
+    auto labels = dbn->linear_svm_predict_batch(dataset.training_images);
+
+    REQUIRE(labels.size() == dataset.training_images.size());
+
+    for (size_t i = 0; i < 20; ++i) {
+        REQUIRE(labels[i] == dbn->linear_svm_predict(dataset.training_images[i]));
+    }
+
+    // The linear model is stored with the network
+    std::stringstream stream;
+    dbn->store(stream);
+
+    auto dbn2 = std::make_unique<dbn_t>();
+    dbn2->load(stream);
+
+    REQUIRE(dbn2->linear_model.classes() == 10);
+
+    for (size_t i = 0; i < 20; ++i) {
+        REQUIRE(dbn2->linear_svm_predict(dataset.training_images[i]) == labels[i]);
+    }
+}
+
+// Parallel grid search with successive halving
+TEST_CASE("unit/dbn/mnist/18", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(300);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    dll::svm_rbf_grid grid;
+    grid.c_steps     = 3;
+    grid.gamma_steps = 3;
+    grid.halving     = 3;
+
+    auto parameters = dll::default_svm_parameters();
+
+    REQUIRE(dbn->svm_grid_search(dataset.training_images, dataset.training_labels, parameters, grid, 3));
+
+    REQUIRE(parameters.C >= grid.c_first);
+    REQUIRE(parameters.C <= grid.c_last);
+    REQUIRE(parameters.gamma >= grid.gamma_first);
+    REQUIRE(parameters.gamma <= grid.gamma_last);
+
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels, parameters));
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+}
+
 // Pretrain with binarize layer
 TEST_CASE("unit/dbn/mnist/8", "[dbn][unit]") {
     typedef dll::dbn_desc<
@@ -431,3 +633,484 @@ TEST_CASE("unit/dbn/mnist/12", "[dbn][unit]") {
 
     dll::dump_timers();
 }
+
+TEST_CASE("unit/dbn/mnist/13", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::pretrain_cache<4>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->learning_rate = 0.05;
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+// The corruption of the denoising pretraining is generated for each batch
+TEST_CASE("unit/dbn/mnist/14", "[dbn][denoising][unit]") {
+    using dbn_t =
+        dll::dbn_desc<
+            dll::dbn_layers<
+                dll::rbm_desc<
+                    28 * 28, 200,
+                    dll::batch_size<25>,
+                    dll::momentum,
+                    dll::visible<dll::unit_type::GAUSSIAN>>::layer_t,
+                dll::rbm_desc<
+                    200, 200,
+                    dll::batch_size<25>,
+                    dll::momentum>::layer_t>,
+            dll::noise<20>, dll::noise_model<dll::noise_type::GAUSSIAN>, dll::trainer<dll::cg_trainer>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    dbn->pretrain_denoising(dataset.training_images, 20);
+}
+
+TEST_CASE("unit/dbn/mnist/15", "[dbn][denoising][unit]") {
+    using dbn_t =
+        dll::dbn_desc<
+            dll::dbn_layers<
+                dll::rbm_desc<
+                    28 * 28, 200,
+                    dll::batch_size<25>,
+                    dll::momentum>::layer_t,
+                dll::rbm_desc<
+                    200, 200,
+                    dll::batch_size<25>,
+                    dll::momentum>::layer_t>,
+            dll::binarize_pre<30>, dll::noise<10>, dll::noise_model<dll::noise_type::SALT_PEPPER>, dll::trainer<dll::cg_trainer>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    dbn->pretrain_denoising(dataset.training_images, 20);
+}
+
+// The shuffled pretraining in batch mode reads the blocks in a random order
+TEST_CASE("unit/dbn/mnist/16", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::shuffle_pre, dll::big_batch_size<3>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(260);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->learning_rate = 0.05;
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+TEST_CASE("unit/dbn/shuffle_pre/1", "[dbn][unit]") {
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < 23; ++i) {
+        samples.emplace_back(1, float(i));
+        labels.push_back(i % 10);
+    }
+
+    auto generator = dll::make_generator(samples, labels, samples.size(), 10, dll::outmemory_data_generator_desc<dll::batch_size<4>, dll::big_batch_size<2>, dll::categorical>{});
+
+    for (size_t epoch = 0; epoch < 3; ++epoch) {
+        generator->reset_shuffle();
+
+        std::vector<size_t> seen;
+
+        while (generator->has_next_batch()) {
+            auto batch  = generator->data_batch();
+            auto lbatch = generator->label_batch();
+
+            for (size_t i = 0; i < etl::dim<0>(batch); ++i) {
+                const size_t s = size_t(batch(i, 0));
+
+                REQUIRE(lbatch(i, s % 10) == 1.0f);
+
+                seen.push_back(s);
+            }
+
+            generator->next_batch();
+        }
+
+        REQUIRE(seen.size() == 23);
+
+        // The incomplete block is always read last
+        for (size_t i = 16; i < 23; ++i) {
+            REQUIRE(seen[i] >= 16);
+        }
+
+        std::sort(seen.begin(), seen.end());
+
+        for (size_t i = 0; i < 23; ++i) {
+            REQUIRE(seen[i] == i);
+        }
+    }
+}
+
+namespace {
+
+// A source completing its reads from two I/O threads
+struct test_async_source {
+    using value_type = etl::dyn_vector<float>;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::pair<size_t, std::function<void(value_type)>>> reads;
+    std::vector<std::thread> threads;
+    bool stop = false;
+
+    test_async_source() {
+        for (size_t t = 0; t < 2; ++t) {
+            threads.emplace_back([this] {
+                while (true) {
+                    std::unique_lock<std::mutex> l(lock);
+                    cv.wait(l, [this] { return stop || !reads.empty(); });
+
+                    if (reads.empty()) {
+                        return;
+                    }
+
+                    auto read = std::move(reads.front());
+                    reads.pop_front();
+                    l.unlock();
+
+                    read.second(value_type(1, float(read.first)));
+                }
+            });
+        }
+    }
+
+    ~test_async_source() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        cv.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    size_t size() const {
+        return 23;
+    }
+
+    template <typename Done>
+    void read(size_t index, Done done) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            reads.emplace_back(index, done);
+        }
+
+        cv.notify_one();
+    }
+};
+
+} // end of anonymous namespace
+
+TEST_CASE("unit/dbn/async_source/1", "[dbn][unit]") {
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < 23; ++i) {
+        labels.push_back(i % 10);
+    }
+
+    auto source = std::make_unique<test_async_source>();
+
+    struct source_ref {
+        using value_type = test_async_source::value_type;
+
+        test_async_source* source;
+
+        size_t size() const {
+            return source->size();
+        }
+
+        template <typename Done>
+        void read(size_t index, Done done) {
+            source->read(index, done);
+        }
+    };
+
+    auto [first, last] = dll::make_async_source<8>(source_ref{source.get()});
+
+    auto generator = dll::make_generator(first, last, labels.begin(), labels.end(), labels.size(), 10, dll::outmemory_data_generator_desc<dll::batch_size<4>, dll::big_batch_size<2>, dll::categorical>{});
+
+    for (size_t epoch = 0; epoch < 3; ++epoch) {
+        generator->reset();
+
+        size_t seen = 0;
+
+        while (generator->has_next_batch()) {
+            auto batch  = generator->data_batch();
+            auto lbatch = generator->label_batch();
+
+            for (size_t i = 0; i < etl::dim<0>(batch); ++i) {
+                REQUIRE(size_t(batch(i, 0)) == seen);
+                REQUIRE(lbatch(i, seen % 10) == 1.0f);
+
+                ++seen;
+            }
+
+            generator->next_batch();
+        }
+
+        REQUIRE(seen == 23);
+    }
+}
+
+// The labels are predicted by batches
+TEST_CASE("unit/dbn/labels/1", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using dbn_simple_t = dll::dbn_desc<
+        dll::dbn_label_layers<
+            dll::rbm_desc<28 * 28, 200, dll::batch_size<25>, dll::init_weights, dll::momentum>::layer_t,
+            dll::rbm_desc<200, 300, dll::batch_size<25>, dll::momentum>::layer_t,
+            dll::rbm_desc<310, 500, dll::batch_size<25>, dll::momentum>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_simple_t>();
+
+    dbn->train_with_labels(dataset.training_images, dataset.training_labels, 10, 20);
+
+    // The last batch is incomplete
+    auto predicted = dbn->predict_labels_batch(dataset.training_images, 10);
+
+    REQUIRE(predicted.size() == dataset.training_images.size());
+
+    size_t errors = 0;
+
+    for (size_t i = 0; i < predicted.size(); ++i) {
+        REQUIRE(predicted[i] < 10);
+
+        errors += predicted[i] != size_t(dataset.training_labels[i]);
+    }
+
+    REQUIRE(errors / double(predicted.size()) < 0.3);
+
+    std::vector<size_t> labels(dataset.training_labels.begin(), dataset.training_labels.end());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<16>, dll::categorical>;
+
+    auto generator = dll::make_generator(dataset.training_images, labels, dataset.training_images.size(), 10, generator_t{});
+
+    auto generated = dbn->predict_labels_batch(*generator, 10);
+
+    REQUIRE(generated.size() == predicted.size());
+
+    size_t generated_errors = 0;
+
+    for (size_t i = 0; i < generated.size(); ++i) {
+        generated_errors += generated[i] != labels[i];
+    }
+
+    REQUIRE(generated_errors / double(generated.size()) < 0.3);
+}
+
+// The RBMs are pretrained concurrently, the next one starting after the first epochs of the previous one
+TEST_CASE("unit/dbn/pipelined_pretrain/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<10>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 250, dll::momentum, dll::batch_size<10>>::layer_t,
+            dll::rbm_desc<250, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::binarize_pre<30>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pipelined_pretraining   = true;
+    dbn->pipeline_warmup_epochs  = 3;
+    dbn->pipeline_refresh_epochs = 2;
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+    std::cout << "error:" << error << std::endl;
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.3);
+}
+
+// The batched gradient of CG is the sum of the gradients of the samples
+TEST_CASE("unit/dbn/cg/1", "[dbn][cg][unit]") {
+    constexpr size_t n = 10;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<20, 15, dll::batch_size<n>>::layer_t,
+            dll::rbm_desc<15, 5, dll::batch_size<n>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<n>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto& r1 = dbn->template layer_get<0>();
+    auto& r2 = dbn->template layer_get<1>();
+
+    r1.w = etl::normal_generator(0.0, 0.5);
+    r1.b = etl::normal_generator(0.0, 0.5);
+    r2.w = etl::normal_generator(0.0, 0.5);
+    r2.b = etl::normal_generator(0.0, 0.5);
+
+    etl::dyn_matrix<float, 2> inputs(n, 20);
+    etl::dyn_matrix<float, 2> targets(n, 5);
+
+    inputs  = etl::uniform_generator(0.0, 1.0);
+    targets = 0.0;
+
+    for (size_t s = 0; s < n; ++s) {
+        targets(s, s % 5) = 1.0;
+    }
+
+    dll::cg_trainer<dbn_t> trainer(*dbn);
+
+    trainer.init_training(n);
+
+    dll::gradient_context<float> context(inputs, targets, 0);
+
+    float cost = 0.0;
+    trainer.template gradient<false>(context, cost);
+
+    // The gradient computed one sample at a time
+
+    etl::dyn_matrix<double, 2> w1_incs(20, 15);
+    etl::dyn_matrix<double, 1> b1_incs(15);
+    etl::dyn_matrix<double, 2> w2_incs(15, 5);
+    etl::dyn_matrix<double, 1> b2_incs(5);
+
+    w1_incs = 0.0;
+    b1_incs = 0.0;
+    w2_incs = 0.0;
+    b2_incs = 0.0;
+
+    double ref_cost = 0.0;
+
+    for (size_t s = 0; s < n; ++s) {
+        std::vector<double> h1(15);
+        std::vector<double> h2(5);
+        std::vector<double> d1(15);
+        std::vector<double> d2(5);
+
+        for (size_t j = 0; j < 15; ++j) {
+            double z = r1.b(j);
+
+            for (size_t i = 0; i < 20; ++i) {
+                z += inputs(s, i) * r1.w(i, j);
+            }
+
+            h1[j] = 1.0 / (1.0 + std::exp(-z));
+        }
+
+        double sum = 0.0;
+
+        for (size_t j = 0; j < 5; ++j) {
+            double z = r2.b(j);
+
+            for (size_t i = 0; i < 15; ++i) {
+                z += h1[i] * r2.w(i, j);
+            }
+
+            h2[j] = std::exp(z);
+            sum += h2[j];
+        }
+
+        for (size_t j = 0; j < 5; ++j) {
+            h2[j] /= sum;
+            d2[j] = h2[j] - targets(s, j);
+
+            ref_cost -= targets(s, j) * std::log(h2[j]);
+
+            b2_incs(j) += d2[j];
+
+            for (size_t i = 0; i < 15; ++i) {
+                w2_incs(i, j) += h1[i] * d2[j];
+            }
+        }
+
+        for (size_t i = 0; i < 15; ++i) {
+            double d = 0.0;
+
+            for (size_t j = 0; j < 5; ++j) {
+                d += d2[j] * r2.w(i, j);
+            }
+
+            d1[i] = d * h1[i] * (1.0 - h1[i]);
+
+            b1_incs(i) += d1[i];
+
+            for (size_t k = 0; k < 20; ++k) {
+                w1_incs(k, i) += inputs(s, k) * d1[i];
+            }
+        }
+    }
+
+    REQUIRE(cost == Approx(ref_cost).epsilon(1e-4));
+
+    auto check = [](const auto& x, const auto& y) {
+        REQUIRE(etl::size(x) == etl::size(y));
+
+        for (size_t i = 0; i < etl::size(x); ++i) {
+            REQUIRE(x[i] == Approx(y[i]).epsilon(1e-4).margin(1e-5));
+        }
+    };
+
+    check(r1.get_cg_context().gr_w_incs, w1_incs);
+    check(r1.get_cg_context().gr_b_incs, b1_incs);
+    check(r2.get_cg_context().gr_w_incs, w2_incs);
+    check(r2.get_cg_context().gr_b_incs, b2_incs);
+}
@@ -13,6 +13,8 @@
 
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/dyn_rbm.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/tied_dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/transform/binarize_layer.hpp"
@@ -49,3 +51,93 @@ TEST_CASE("dbn/ae/1", "[unit][rbm][dbn][mnist][sgd][ae]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+// Dense auto-encoder with a decoder tied to the encoder
+TEST_CASE("dbn/ae/2", "[unit][dense][dbn][mnist][sgd][ae]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::tied_dense_layer_desc<0>::layer_t
+        >, dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->display();
+
+    auto& decoder = dbn->layer_get<1>();
+
+    REQUIRE(decoder.input_size() == 100);
+    REQUIRE(decoder.output_size() == 28 * 28);
+
+    // Only the biases of the decoder are parameters
+    REQUIRE(decoder.parameters() == 28 * 28);
+
+    dbn->learning_rate = 0.1;
+
+    auto ft_error = dbn->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 0.1);
+
+    // The decoder uses the trained weights of the encoder in place
+    auto& w = dbn->layer_get<0>().w;
+    auto tied = decoder.weights();
+
+    REQUIRE(tied(3, 7) == w(3, 7));
+
+    auto test_error = dll::test_set_ae(*dbn, dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.1);
+}
+
+// The labels of an autoencoder generator are its inputs
+TEST_CASE("dbn/ae/3", "[unit][ae]") {
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<etl::dyn_vector<float>> outputs;
+
+    for (size_t i = 0; i < 10; ++i) {
+        samples.emplace_back(3, float(2 * i));
+        outputs.emplace_back(3, float(i));
+    }
+
+    using desc = dll::inmemory_data_generator_desc<dll::batch_size<4>, dll::autoencoder, dll::scale_pre<2>>;
+
+    auto generator = dll::make_generator(samples, samples, samples.size(), 3, desc{});
+
+    REQUIRE(generator->aliased);
+    REQUIRE(etl::size(generator->label_cache) == 0);
+
+    generator->reset_shuffle();
+
+    size_t seen = 0;
+
+    while (generator->has_next_batch()) {
+        auto batch  = generator->data_batch();
+        auto lbatch = generator->label_batch();
+
+        REQUIRE(etl::dim<0>(lbatch) == etl::dim<0>(batch));
+
+        for (size_t i = 0; i < etl::size(batch); ++i) {
+            REQUIRE(lbatch[i] == batch[i]);
+            REQUIRE(batch[i] == float(size_t(batch[i])));
+        }
+
+        seen += etl::dim<0>(batch);
+
+        generator->next_batch();
+    }
+
+    REQUIRE(seen == 10);
+
+    // Different labels are still copied
+    auto reg_generator = dll::make_generator(samples, outputs, samples.size(), 3, desc{});
+
+    REQUIRE(!reg_generator->aliased);
+    REQUIRE(etl::size(reg_generator->label_cache) == 30);
+    REQUIRE(reg_generator->label_batch()(1, 0) == 0.5f);
+}
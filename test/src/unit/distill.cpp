@@ -0,0 +1,77 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <vector>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// Distillation of a larger network into a smaller one
+TEST_CASE("unit/distill/1", "[unit][distill][dbn][mnist][sgd]") {
+    using teacher_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    using student_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 30>::layer_t,
+            dll::dense_layer_desc<30, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::dbn_t;
+
+    REQUIRE(dll::sgd_trainer<student_t>::has_soft_targets);
+
+    // The soft targets at temperature 1 are the outputs
+    std::vector<float> probs{0.7f, 0.2f, 0.1f};
+    std::vector<float> soft(3);
+
+    dll::teacher_soft_targets(soft.data(), probs.data(), 1, 3, 1.0f);
+
+    for (size_t j = 0; j < 3; ++j) {
+        REQUIRE(soft[j] == Approx(probs[j]));
+    }
+
+    // Higher temperatures flatten them
+    dll::teacher_soft_targets(soft.data(), probs.data(), 1, 3, 4.0f);
+
+    REQUIRE(soft[0] < probs[0]);
+    REQUIRE(soft[2] > probs[2]);
+    REQUIRE(soft[0] + soft[1] + soft[2] == Approx(1.0f));
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto teacher = std::make_unique<teacher_t>();
+
+    teacher->learning_rate = 0.05;
+
+    REQUIRE(teacher->fine_tune(dataset.train(), 25) < 0.1);
+
+    // With the soft targets cached for the training set
+    auto dbn = std::make_unique<student_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto ft_error = dbn->distill(*teacher, dataset.train(), 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+    CHECK(ft_error < 0.15);
+
+    // With the teacher running on each batch
+    auto student = std::make_unique<student_t>();
+
+    student->learning_rate         = 0.05;
+    student->cache_teacher_outputs = false;
+
+    ft_error = student->distill(*teacher, dataset.train(), 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+    CHECK(ft_error < 0.15);
+}
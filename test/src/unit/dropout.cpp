@@ -0,0 +1,90 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Dropout with regenerated masks
+TEST_CASE("unit/dropout/1", "[unit][dropout][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dropout_layer_desc<20>::layer_t,
+            dll::dense_layer_desc<150, 10>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// The backward pass regenerates the mask of the forward pass
+TEST_CASE("unit/dropout/2", "[unit][dropout]") {
+    using layer_t = dll::dropout_layer_desc<20>::layer_t;
+
+    // The part of the training context used by the layer
+    struct context_t {
+        etl::fast_dyn_matrix<float, 10, 150> errors;
+        dll::dropout_workspace workspace;
+    };
+
+    layer_t layer;
+    context_t context;
+
+    etl::fast_dyn_matrix<float, 10, 150> input;
+    etl::fast_dyn_matrix<float, 10, 150> output;
+    etl::fast_dyn_matrix<float, 10, 150> input_errors;
+
+    input = etl::uniform_generator(1.0, 2.0);
+
+    layer.forward_batch(output, input, context.workspace);
+
+    context.errors = 1.0;
+
+    layer.backward_batch(input_errors, context);
+
+    size_t dropped = 0;
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        if (output[i] == 0.0f) {
+            REQUIRE(input_errors[i] == 0.0f);
+            ++dropped;
+        } else {
+            REQUIRE(output[i] == Approx(input[i] / 0.8f));
+            REQUIRE(input_errors[i] == Approx(1.0f / 0.8f));
+        }
+    }
+
+    REQUIRE(dropped > 200);
+    REQUIRE(dropped < 400);
+
+    // Each forward pass draws a new mask
+    dll::dropout_workspace next;
+    etl::fast_dyn_matrix<float, 10, 150> next_output;
+
+    layer.forward_batch(next_output, input, next);
+
+    REQUIRE(next.offset != context.workspace.offset);
+    REQUIRE(etl::sum(etl::abs(next_output - output)) > 0.0f);
+
+    // The inference is the identity
+    layer.test_forward_batch(next_output, input);
+
+    REQUIRE(etl::sum(etl::abs(next_output - input)) == 0.0f);
+}
@@ -77,3 +77,46 @@ TEST_CASE("unit/dyn_crbm/mnist/4", "[dyn_crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 25);
     REQUIRE(error < 5e-2);
 }
+
+// The convolutions of a registered shape use the static dimensions
+TEST_CASE("unit/dyn_crbm/static/1", "[dyn_crbm][unit]") {
+    using shapes = dll::static_shapes<dll::static_shape<1, 28, 28, 20, 5, 5>, dll::static_shape<1, 28, 28, 10, 9, 9>>;
+
+    dll::dyn_conv_rbm_desc<dll::batch_size<10>, shapes>::layer_t a;
+    dll::dyn_conv_rbm_desc<dll::batch_size<10>>::layer_t b;
+
+    a.init_layer(1, 28, 28, 10, 9, 9);
+    b.init_layer(1, 28, 28, 10, 9, 9);
+
+    REQUIRE(a.shape_index == 1);
+    REQUIRE(b.shape_index == 0);
+
+    b.w = a.w;
+
+    etl::dyn_matrix<float, 4> v(10, 1, 28, 28);
+    etl::dyn_matrix<float, 4> h(10, 10, 20, 20);
+    v = etl::uniform_generator(0.0, 1.0);
+    h = etl::uniform_generator(0.0, 1.0);
+
+    etl::dyn_matrix<float, 4> h_a(10, 10, 20, 20);
+    etl::dyn_matrix<float, 4> h_b(10, 10, 20, 20);
+    a.batch_conv_hidden(h_a, v);
+    b.batch_conv_hidden(h_b, v);
+
+    for (size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_a[i] == Approx(h_b[i]));
+    }
+
+    etl::dyn_matrix<float, 4> v_a(10, 1, 28, 28);
+    etl::dyn_matrix<float, 4> v_b(10, 1, 28, 28);
+    a.batch_conv_visible(v_a, h);
+    b.batch_conv_visible(v_b, h);
+
+    for (size_t i = 0; i < etl::size(v_a); ++i) {
+        REQUIRE(v_a[i] == Approx(v_b[i]));
+    }
+
+    // Any other shape uses the dynamic convolutions
+    a.init_layer(1, 28, 28, 10, 7, 7);
+    REQUIRE(a.shape_index == 2);
+}
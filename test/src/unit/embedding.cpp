@@ -76,6 +76,48 @@ auto generate_samples(std::vector<size_t>& labels){
     return samples;
 }
 
+// Trains the same embedding network with the sparse updates and with the dense reference
+template <dll::updater_type UT>
+void check_dense_updates() {
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using layers_t = dll::network_layers<
+        dll::embedding_layer<30, length, embedding>,
+        dll::conv_layer<1, length, embedding, 16, 3, embedding>,
+        dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>,
+        dll::dense_layer<16, 10, dll::softmax>>;
+
+    using sparse_t = typename dll::network_desc<layers_t, dll::updater<UT>, dll::batch_size<10>>::network_t;
+    using dense_t  = typename dll::network_desc<layers_t, dll::updater<UT>, dll::batch_size<10>, dll::unfused_updates>::network_t;
+
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    samples.resize(50);
+    labels.resize(50);
+
+    auto sparse = std::make_unique<sparse_t>();
+    auto dense  = std::make_unique<dense_t>();
+
+    dense->template layer_get<0>().w = sparse->template layer_get<0>().w;
+    dense->template layer_get<1>().w = sparse->template layer_get<1>().w;
+    dense->template layer_get<1>().b = sparse->template layer_get<1>().b;
+    dense->template layer_get<3>().w = sparse->template layer_get<3>().w;
+    dense->template layer_get<3>().b = sparse->template layer_get<3>().b;
+
+    sparse->learning_rate = 0.05;
+    dense->learning_rate  = 0.05;
+
+    sparse->fine_tune(samples, labels, 2);
+    dense->fine_tune(samples, labels, 2);
+
+    // The rows 26 to 29 are never touched, but still count in the norms of the trust ratio
+    REQUIRE(etl::max(etl::abs(sparse->template layer_get<0>().w - dense->template layer_get<0>().w)) < 1e-4f);
+    REQUIRE(etl::max(etl::abs(sparse->template layer_get<1>().w - dense->template layer_get<1>().w)) < 1e-4f);
+    REQUIRE(etl::max(etl::abs(sparse->template layer_get<3>().w - dense->template layer_get<3>().w)) < 1e-4f);
+}
+
 } // end of anonymous namespace
 
 // Simple embedding with one CNN
@@ -142,3 +184,328 @@ TEST_CASE("unit/embedding/2", "[unit][embedding]") {
     REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
     REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
 }
+
+// Three group CNN with concurrently run branches
+TEST_CASE("unit/embedding/3", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
+                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
+                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    dll::set_branch_mode(dll::branch_mode::PARALLEL);
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
+
+    dll::set_branch_mode(dll::branch_mode::SERIAL);
+}
+
+// Three group CNN with branches of different sizes
+TEST_CASE("unit/embedding/4", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 8, 4, embedding>
+                    , dll::mp_2d_layer<8, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 24, 5, embedding>
+                    , dll::mp_2d_layer<24, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
+}
+
+// Asynchronous (Hogwild) data-parallel training with lazy sparse updates
+TEST_CASE("unit/embedding/5", "[unit][embedding][parallel]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::MOMENTUM>  // Momentum, private to each shard
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::data_parallel<5>                      // Five shards of ten samples
+        , dll::hogwild                               // Updates applied by each shard
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    net->learning_rate = 0.05;
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 0.1);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// Lookups from the copies of the table in reduced precision
+TEST_CASE("unit/embedding/6", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+
+    auto& layer = net->template layer_get<0>();
+
+    etl::fast_dyn_matrix<float, 2, length> v;
+
+    for (size_t i = 0; i < etl::size(v); ++i) {
+        v[i] = float((i * 7) % 26);
+    }
+
+    etl::fast_dyn_matrix<float, 2, length, embedding> full;
+    etl::fast_dyn_matrix<float, 2, length, embedding> reduced;
+
+    layer.forward_batch(full, v);
+
+    for (auto precision : {dll::embedding_precision::FP16, dll::embedding_precision::BF16, dll::embedding_precision::INT8}) {
+        layer.set_lookup_precision(precision);
+
+        REQUIRE(layer.lookup_precision() == precision);
+
+        layer.forward_batch(reduced, v);
+
+        for (size_t i = 0; i < etl::size(full); ++i) {
+            REQUIRE(reduced[i] == Approx(full[i]).epsilon(0.02).margin(0.02));
+        }
+
+        REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+    }
+
+    // The copy follows the changes of the weights
+    layer.w(size_t(v(0, 0))) = 0.5;
+    layer.weights_changed();
+
+    layer.forward_batch(reduced, v);
+
+    for (size_t k = 0; k < embedding; ++k) {
+        REQUIRE(reduced(0, 0, k) == Approx(0.5).epsilon(0.02));
+    }
+
+    layer.set_lookup_precision(dll::embedding_precision::FULL);
+}
+
+// The gradients of the touched rows are the same as the full gradients
+TEST_CASE("unit/embedding/7", "[unit][embedding]") {
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::network_desc<
+        dll::network_layers<
+            dll::embedding_layer<30, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::MOMENTUM>
+        , dll::batch_size<10>
+    >::network_t;
+
+    using layer_t = embedding_network_t::layer_type<0>;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    auto& layer = net->template layer_get<0>();
+
+    dll::full_sgd_context<embedding_network_t, layer_t, 0> context(layer);
+
+    auto& grad = std::get<0>(context.up.context)->grad;
+
+    // The second batch does not touch the rows of the first one, which must be cleared
+    for (size_t batch = 0; batch < 2; ++batch) {
+        for (size_t i = 0; i < etl::size(context.input); ++i) {
+            context.input[i] = float(batch * 15 + (i * 7) % 15);
+        }
+
+        context.errors = etl::normal_generator(0.0, 1.0);
+
+        layer.compute_gradients(context);
+
+        etl::fast_matrix<float, 30, embedding> full;
+        full = etl::batch_embedding_gradients(context.input, context.errors, layer.w);
+
+        REQUIRE(!context.stale_grad);
+        REQUIRE(context.rows.size() == 15);
+        REQUIRE(context.rows.front() == batch * 15);
+        REQUIRE(context.rows.back() == batch * 15 + 14);
+
+        for (size_t i = 0; i < etl::size(full); ++i) {
+            REQUIRE(grad[i] == Approx(full[i]).margin(1e-5));
+        }
+    }
+
+    // The rows never seen in training are never updated
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    etl::fast_matrix<float, 4, embedding> unused;
+    for (size_t i = 0; i < etl::size(unused); ++i) {
+        unused[i] = layer.w[26 * embedding + i];
+    }
+
+    net->learning_rate = 0.05;
+    net->fine_tune(samples, labels, 5);
+
+    for (size_t i = 0; i < etl::size(unused); ++i) {
+        REQUIRE(layer.w[26 * embedding + i] == unused[i]);
+    }
+}
+
+// LARS with sparse inputs, the trust ratio is computed from the full weights
+TEST_CASE("unit/embedding/8", "[unit][embedding]") {
+    check_dense_updates<dll::updater_type::LARS>();
+}
+
+// LAMB with sparse inputs, the trust ratio is computed from the full weights
+TEST_CASE("unit/embedding/9", "[unit][embedding]") {
+    check_dense_updates<dll::updater_type::LAMB>();
+}
+
+// The errors of a merge layer are the sum of the errors backpropagated by each branch
+TEST_CASE("unit/embedding/10", "[unit][embedding]") {
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
+                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
+                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 10, dll::softmax>
+        >
+        , dll::batch_size<10>
+    >::network_t;
+
+    using trainer_t = dll::sgd_trainer<embedding_network_t>;
+    using merge_t   = embedding_network_t::layer_type<1>;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    auto& layer = net->template layer_get<1>();
+
+    dll::full_sgd_context<embedding_network_t, merge_t, 1> context(layer);
+
+    auto inputs = context.input;
+    inputs = etl::normal_generator(0.0, 1.0);
+
+    for (auto mode : {dll::branch_mode::SERIAL, dll::branch_mode::PARALLEL}) {
+        dll::set_branch_mode(mode);
+
+        trainer_t::forward_layer<true>(layer, inputs, context);
+
+        context.errors = etl::normal_generator(0.0, 1.0);
+
+        auto errors = inputs;
+
+        bool last = true;
+        trainer_t::backward_layer(layer, context, errors, last);
+
+        // Each branch backpropagates again its errors in its own copy
+        auto reference = inputs;
+        reference = 0;
+
+        cpp::for_each_i(layer.layers, context.sub_contexts, [&reference](size_t /*i*/, auto& sub_layer, auto& sub_context) {
+            auto back_errors = reference;
+
+            bool sub_last = true;
+            trainer_t::backward_layer(sub_layer, sub_context, back_errors, sub_last);
+
+            reference += back_errors;
+        });
+
+        for (size_t i = 0; i < etl::size(reference); ++i) {
+            REQUIRE(errors[i] == Approx(reference[i]).margin(1e-5));
+        }
+    }
+
+    dll::set_branch_mode(dll::branch_mode::SERIAL);
+}
@@ -0,0 +1,79 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cmath>
+#include <limits>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// The activation functions can be approximated
+TEST_CASE("unit/fast_math/1", "[unit][fast_math][dbn][mnist][sgd]") {
+    using exact_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::updater<dll::updater_type::MOMENTUM>
+    >::dbn_t;
+
+    using fast_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::TANH>, dll::activation_precision<dll::function_precision::FAST>>::layer_t,
+            dll::dense_layer_desc<100, 50, dll::activation_precision<dll::function_precision::FAST>>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax, dll::activation_precision<dll::function_precision::FAST>>::layer_t>,
+        dll::batch_size<20>, dll::updater<dll::updater_type::MOMENTUM>
+    >::dbn_t;
+
+    // The error of the approximations is bounded
+    for (float x = -20.0f; x < 20.0f; x += 0.01f) {
+        REQUIRE(dll::fast_exp(x) == Approx(std::exp(x)).epsilon(1e-6));
+        REQUIRE(std::abs(dll::fast_sigmoid(x) - 1.0f / (1.0f + std::exp(-x))) < 1e-6f);
+        REQUIRE(std::abs(dll::fast_tanh(x) - std::tanh(x)) < 1e-6f);
+    }
+
+    // Saturation without infinities, but the NaN are kept
+    REQUIRE(std::isfinite(dll::fast_exp(1000.0f)));
+    REQUIRE(dll::fast_exp(-1000.0f) >= 0.0f);
+    REQUIRE(dll::fast_sigmoid(-1000.0f) == Approx(0.0f));
+    REQUIRE(dll::fast_tanh(1000.0f) == Approx(1.0f));
+    REQUIRE(std::isnan(dll::fast_exp(std::numeric_limits<float>::quiet_NaN())));
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto exact = std::make_unique<exact_t>();
+    auto fast  = std::make_unique<fast_t>();
+
+    auto copy = [](auto& to, const auto& from) {
+        to.w = from.w;
+        to.b = from.b;
+    };
+
+    copy(fast->layer_get<0>(), exact->layer_get<0>());
+    copy(fast->layer_get<1>(), exact->layer_get<1>());
+    copy(fast->layer_get<2>(), exact->layer_get<2>());
+
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::normal_generator(0.0, 1.0);
+
+    auto expected = etl::force_temporary(exact->forward_batch(batch));
+    auto output   = etl::force_temporary(fast->forward_batch(batch));
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).margin(1e-5));
+    }
+
+    // The training is not disturbed by the approximations
+    auto ft_error = fast->fine_tune(dataset.train(), 25);
+    CHECK(ft_error < 5e-2);
+
+    auto test_error = fast->evaluate_error(dataset.test());
+    REQUIRE(test_error < 0.3);
+}
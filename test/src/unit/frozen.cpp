@@ -0,0 +1,60 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+// The layers after a frozen prefix are trained the same way from the cached outputs of the prefix
+TEST_CASE("unit/frozen/1", "[unit][frozen][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>, dll::frozen_prefix<1>
+    >::dbn_t;
+
+    REQUIRE(dll::sgd_trainer<dbn_t>::has_frozen_cache);
+
+    // Four full batches and an incomplete one
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(70);
+    std::vector<size_t> labels(samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    auto cached   = std::make_unique<dbn_t>();
+    auto uncached = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    cached->store(weights);
+    uncached->load(weights);
+
+    uncached->cache_frozen_features = false;
+
+    etl::fast_matrix<float, 28 * 28, 100> frozen_w;
+    frozen_w = cached->template layer_get<0>().w;
+
+    cached->fine_tune(samples, labels, 3);
+    uncached->fine_tune(samples, labels, 3);
+
+    // The frozen layer is not trained
+    REQUIRE(etl::max(etl::abs(cached->template layer_get<0>().w - frozen_w)) == 0.0f);
+    REQUIRE(etl::max(etl::abs(uncached->template layer_get<0>().w - frozen_w)) == 0.0f);
+
+    auto& a = cached->template layer_get<1>().w;
+    auto& b = uncached->template layer_get<1>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+}
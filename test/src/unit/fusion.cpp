@@ -0,0 +1,435 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <deque>
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/activation_layer.hpp"
+#include "dll/neural/batch_normalization_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_same_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/upsample_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Dense -> Activation is fused for inference
+TEST_CASE("unit/fusion/1", "[unit][fusion]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::batch_size<8>>::network_t;
+
+    REQUIRE(dll::is_fusable_activation<network_t::layer_type<0>, network_t::layer_type<1>>);
+    REQUIRE(!dll::is_fusable_activation<network_t::layer_type<1>, network_t::layer_type<2>>);
+
+    auto net = std::make_unique<network_t>();
+
+    etl::fast_dyn_matrix<float, 8, 28 * 28> input;
+    input = etl::normal_generator(0.0, 1.0);
+
+    auto fused = net->forward_batch(input);
+
+    // Layer by layer
+    auto a = net->template layer_get<0>().test_forward_batch(input);
+    auto b = net->template layer_get<1>().test_forward_batch(a);
+    auto c = net->template layer_get<2>().test_forward_batch(b);
+
+    REQUIRE(etl::size(fused) == etl::size(c));
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(fused[i] == Approx(c[i]).epsilon(1e-5));
+    }
+}
+
+// Conv -> Activation -> MP and Dense -> BN -> Activation are fused for
+// training and inference
+TEST_CASE("unit/fusion/2", "[unit][fusion]") {
+    constexpr size_t K = 6;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, K, 5, 5, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::mp_2d_layer_desc<K, 24, 24, 2, 2>::layer_t,
+
+            dll::dense_layer_desc<K * 12 * 12, 200, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<200, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    REQUIRE(dll::is_fusable_activation<network_t::layer_type<0>, network_t::layer_type<1>>);
+    REQUIRE(dll::is_fusable_normalization_activation<network_t::layer_type<3>, network_t::layer_type<4>, network_t::layer_type<5>>);
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    REQUIRE(test_error < 0.25);
+
+    // Once folded, the normalization is skipped
+    REQUIRE(net->fold_batch_normalization() == 1);
+    REQUIRE(net->evaluate_error(dataset.test()) == Approx(test_error).epsilon(1e-2));
+}
+
+// Freezing folds the normalization and skips the dropout
+TEST_CASE("unit/fusion/3", "[unit][fusion]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<100>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dropout_layer_desc<50>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 10, 0.2);
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto expected = net->forward_batch(batch);
+
+    auto frozen = dll::freeze(std::move(net), sample);
+
+    // The normalization is fused with the dense layer and the dropout is skipped
+    REQUIRE(frozen->plan.layout.folded_fusion[0]);
+    REQUIRE(frozen->plan.layout.skipped[3]);
+
+    auto& output = frozen->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+
+    // The blob does not hold the folded normalization
+    std::stringstream full;
+    frozen->dbn().store(full);
+
+    REQUIRE(frozen->weights().size() < full.str().size());
+
+    std::stringstream stream;
+    frozen->store(stream);
+
+    auto loaded = dll::freeze(std::make_unique<network_t>(), sample);
+
+    REQUIRE(loaded->load(stream));
+
+    auto& loaded_output = loaded->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(loaded_output[i] == Approx(output[i]));
+    }
+}
+
+// Upsample -> Conv (same) is fused into a sub-pixel convolution for training
+// and inference
+TEST_CASE("unit/fusion/4", "[unit][fusion]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_same_layer_desc<1, 28, 28, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_2d_layer_desc<4, 28, 28, 2, 2>::layer_t,
+            dll::upsample_3d_layer_desc<4, 14, 14, 1, 2, 2>::layer_t,
+            dll::conv_same_layer_desc<4, 28, 28, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<4 * 28 * 28, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    REQUIRE(dll::is_subpixel_pair<network_t::layer_type<2>, network_t::layer_type<3>>);
+    REQUIRE(!dll::is_subpixel_pair<network_t::layer_type<1>, network_t::layer_type<2>>);
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 10, 0.2);
+
+    etl::fast_dyn_matrix<float, 25, 1, 28, 28> input;
+    input = etl::uniform_generator(0.0, 1.0);
+
+    auto fused = net->forward_batch(input);
+
+    // Layer by layer
+    auto a = net->template layer_get<0>().test_forward_batch(input);
+    auto b = net->template layer_get<1>().test_forward_batch(a);
+    auto c = net->template layer_get<2>().test_forward_batch(b);
+    auto d = net->template layer_get<3>().test_forward_batch(c);
+    auto e = net->template layer_get<4>().test_forward_batch(d);
+
+    REQUIRE(etl::size(fused) == etl::size(e));
+
+    for (size_t i = 0; i < etl::size(e); ++i) {
+        REQUIRE(fused[i] == Approx(e[i]).epsilon(1e-4));
+    }
+}
+
+// The convolutions of a frozen network run in the NCHWc layout
+TEST_CASE("unit/fusion/5", "[unit][fusion]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::mp_2d_layer_desc<6, 24, 24, 2, 2>::layer_t,
+            dll::conv_layer_desc<6, 12, 12, 10, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<10 * 10 * 10, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>, dll::blocked_inference>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    FT_CHECK_2_VAL(net, dataset, 10, 0.2);
+
+    etl::fast_dyn_matrix<float, 25, 1, 28, 28> batch;
+    etl::fast_dyn_matrix<float, 1, 28, 28> sample;
+
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto expected = net->forward_batch(batch);
+
+    auto frozen = dll::freeze(std::move(net), sample);
+
+    // The convolutions and the pooling are blocked, the dense layer is not
+    REQUIRE(frozen->plan.layout.blocked[0]);
+    REQUIRE(frozen->plan.layout.blocked[2]);
+    REQUIRE(frozen->plan.layout.blocked[3]);
+    REQUIRE(!frozen->plan.layout.blocked[4]);
+
+    auto& output = frozen->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+
+    // The filters are packed again once loaded
+    std::stringstream stream;
+    frozen->store(stream);
+
+    auto loaded = dll::freeze(std::make_unique<network_t>(), sample);
+
+    REQUIRE(loaded->load(stream));
+
+    auto& loaded_output = loaded->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(loaded_output[i] == Approx(output[i]));
+    }
+}
+
+namespace {
+
+/*!
+ * \brief The errors of a layer in a training context without fusion
+ */
+template <typename E>
+struct unfused_context {
+    E errors;
+};
+
+/*!
+ * \brief The errors of a convolution in a training context fused with the
+ * previous upsampling by (2, 2)
+ */
+template <typename E>
+struct subpixel_context {
+    static constexpr bool subpixel = true;
+    static constexpr size_t U1     = 2;
+    static constexpr size_t U2     = 2;
+
+    E errors;
+};
+
+} // end of anonymous namespace
+
+// The sub-pixel convolution has the same gradients as the upsampling
+// followed by the convolution
+TEST_CASE("unit/fusion/6", "[unit][fusion]") {
+    constexpr size_t B = 4;
+
+    using up_t   = dll::upsample_3d_layer_desc<2, 7, 7, 1, 2, 2>::layer_t;
+    using conv_t = dll::conv_same_layer_desc<2, 14, 14, 3, 3, 3, dll::no_activation>::layer_t;
+
+    REQUIRE(dll::is_subpixel_pair<up_t, conv_t>);
+
+    up_t up;
+    conv_t conv;
+
+    etl::fast_dyn_matrix<float, B, 2, 7, 7> input;
+    etl::fast_dyn_matrix<float, B, 2, 14, 14> upsampled;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    up.forward_batch(upsampled, input);
+
+    unfused_context<etl::fast_dyn_matrix<float, B, 3, 14, 14>> conv_ctx;
+    subpixel_context<etl::fast_dyn_matrix<float, B, 3, 14, 14>> fused_ctx;
+
+    conv_ctx.errors  = etl::uniform_generator(-1.0, 1.0);
+    fused_ctx.errors = conv_ctx.errors;
+
+    // Unfused: through the convolution, then through the upsampling
+
+    unfused_context<etl::fast_dyn_matrix<float, B, 2, 14, 14>> up_ctx;
+
+    conv.backward_batch(up_ctx.errors, conv_ctx);
+
+    etl::fast_dyn_matrix<float, B, 2, 7, 7> unfused;
+
+    up.backward_batch(unfused, up_ctx);
+
+    // Fused: directly through both
+
+    etl::fast_dyn_matrix<float, B, 2, 7, 7> fused;
+
+    conv.backward_batch(fused, fused_ctx);
+
+    for (size_t i = 0; i < etl::size(fused); ++i) {
+        REQUIRE(fused[i] == Approx(unfused[i]).epsilon(1e-4).margin(1e-5));
+    }
+
+    // The gradients of the filters
+
+    etl::fast_dyn_matrix<float, 3, 2, 3, 3> unfused_w;
+    etl::fast_dyn_matrix<float, 3, 2, 3, 3> fused_w;
+
+    unfused_w = etl::ml::convolution_backward_filter<1, 1, 1, 1>(upsampled, conv_ctx.errors);
+
+    dll::detail::subpixel_conv_dims d{B, 2, 7, 7, 3, 3, 3, 2, 2, 1, 1};
+    dll::subpixel_conv_backward_filter(fused_w, input, fused_ctx.errors, d);
+
+    for (size_t i = 0; i < etl::size(fused_w); ++i) {
+        REQUIRE(fused_w[i] == Approx(unfused_w[i]).epsilon(1e-4).margin(1e-5));
+    }
+}
+
+namespace {
+
+// Compare the fused bias and activation with the bias and the activation
+// applied one after the other
+template <dll::function F, dll::function_precision P = dll::function_precision::EXACT>
+void check_bias_activate(double epsilon) {
+    etl::fast_dyn_matrix<float, 6, 20> x2;
+    etl::fast_dyn_matrix<float, 20> b2;
+
+    x2 = etl::normal_generator(0.0, 2.0);
+    b2 = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 6, 20> ref2;
+    ref2 = etl::bias_add_2d(x2, b2);
+    ref2 = dll::f_activate<F>(ref2);
+
+    dll::f_bias_activate_2d<F, true, P>(x2, b2);
+
+    for (size_t i = 0; i < etl::size(x2); ++i) {
+        REQUIRE(x2[i] == Approx(ref2[i]).epsilon(epsilon).margin(epsilon));
+    }
+
+    etl::fast_dyn_matrix<float, 3, 4, 5, 6> x4;
+    etl::fast_dyn_matrix<float, 4> b4;
+
+    x4 = etl::normal_generator(0.0, 2.0);
+    b4 = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 4, 5, 6> ref4;
+    ref4 = etl::bias_add_4d(x4, b4);
+    ref4 = dll::f_activate<F>(ref4);
+
+    dll::f_bias_activate_4d<F, true, P>(x4, b4);
+
+    for (size_t i = 0; i < etl::size(x4); ++i) {
+        REQUIRE(x4[i] == Approx(ref4[i]).epsilon(epsilon).margin(epsilon));
+    }
+}
+
+} // end of anonymous namespace
+
+// The fused bias and activation give the results of the two passes
+TEST_CASE("unit/fusion/7", "[unit][fusion]") {
+    check_bias_activate<dll::function::IDENTITY>(1e-5);
+    check_bias_activate<dll::function::SIGMOID>(1e-5);
+    check_bias_activate<dll::function::TANH>(1e-5);
+    check_bias_activate<dll::function::RELU>(1e-5);
+    check_bias_activate<dll::function::SOFTMAX>(1e-5);
+
+    // The fast approximations only approach the exact functions
+    check_bias_activate<dll::function::SIGMOID, dll::function_precision::FAST>(1e-3);
+    check_bias_activate<dll::function::TANH, dll::function_precision::FAST>(1e-3);
+}
+
+// The dense and conv layers compute their output with the fused bias and
+// activation
+TEST_CASE("unit/fusion/8", "[unit][fusion]") {
+    using dense_t = dll::dense_layer_desc<30, 20, dll::activation<dll::function::TANH>>::layer_t;
+    using conv_t  = dll::conv_layer_desc<2, 8, 8, 4, 3, 3, dll::activation<dll::function::SIGMOID>>::layer_t;
+
+    dense_t dense;
+    conv_t conv;
+
+    dense.b = etl::normal_generator(0.0, 1.0);
+    conv.b  = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 5, 30> dense_input;
+    etl::fast_dyn_matrix<float, 5, 20> dense_output;
+    etl::fast_dyn_matrix<float, 5, 20> dense_ref;
+
+    dense_input = etl::normal_generator(0.0, 1.0);
+
+    dense.forward_batch(dense_output, dense_input);
+
+    dense_ref = etl::bias_add_2d(dense_input * dense.w, dense.b);
+    dense_ref = etl::tanh(dense_ref);
+
+    for (size_t i = 0; i < etl::size(dense_ref); ++i) {
+        REQUIRE(dense_output[i] == Approx(dense_ref[i]).epsilon(1e-4).margin(1e-5));
+    }
+
+    etl::fast_dyn_matrix<float, 5, 2, 8, 8> conv_input;
+    etl::fast_dyn_matrix<float, 5, 4, 6, 6> conv_output;
+    etl::fast_dyn_matrix<float, 5, 4, 6, 6> conv_ref;
+
+    conv_input = etl::normal_generator(0.0, 1.0);
+
+    conv.forward_batch(conv_output, conv_input);
+
+    conv_ref = etl::bias_add_4d(etl::ml::convolution_forward(conv_input, conv.w), conv.b);
+    conv_ref = etl::sigmoid(conv_ref);
+
+    for (size_t i = 0; i < etl::size(conv_ref); ++i) {
+        REQUIRE(conv_output[i] == Approx(conv_ref[i]).epsilon(1e-4).margin(1e-5));
+    }
+}
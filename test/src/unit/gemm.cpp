@@ -0,0 +1,184 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// The weights are kept packed between the batches
+TEST_CASE("unit/gemm/1", "[unit][gemm][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu, dll::packed_weights>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax, dll::packed_weights>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    using plain_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 0.1);
+
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto plain = std::make_unique<plain_dbn_t>();
+
+    auto check = [&]() {
+        std::stringstream stream;
+        dbn->store(stream);
+        plain->load(stream);
+
+        auto output   = dbn->forward_batch(batch);
+        auto expected = plain->forward_batch(batch);
+
+        for (size_t i = 0; i < etl::size(expected); ++i) {
+            REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+        }
+    };
+
+    // The weights are packed after the training
+    check();
+
+    // The panels are packed again once others weights are loaded
+    std::stringstream stream;
+    std::make_unique<dbn_t>()->store(stream);
+    dbn->load(stream);
+
+    check();
+}
+
+// The small batches of compact layers use the register-blocked kernels
+TEST_CASE("unit/gemm/2", "[unit][gemm][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 30, dll::relu>::layer_t,
+            dll::dense_layer_desc<30, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    REQUIRE(dll::is_small_gemm<float, 28 * 28, 30>);
+    REQUIRE(dll::is_small_gemm<float, 30, 10>);
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 0.1);
+
+    // The large batch goes through the standard product
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto expected = dbn->forward_batch(batch);
+
+    etl::fast_dyn_matrix<float, 5, 28 * 28> small_batch;
+    small_batch = etl::slice(batch, 0, 5);
+
+    auto small = dbn->forward_batch(small_batch);
+
+    for (size_t i = 0; i < 5; ++i) {
+        etl::fast_dyn_matrix<float, 28 * 28> sample;
+        sample = batch(i);
+
+        auto one = dbn->forward_one(sample);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(small(i, j) == Approx(expected(i, j)).epsilon(1e-4));
+            REQUIRE(one[j] == Approx(expected(i, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// The rectified activations are gathered in sparse products
+TEST_CASE("unit/gemm/3", "[unit][gemm][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax, dll::sparse_input>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    using plain_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    // The CSC products are the dense products
+    etl::fast_dyn_matrix<float, 20, 100> x;
+    etl::fast_dyn_matrix<float, 100, 10> w;
+    etl::fast_dyn_matrix<float, 20, 10> h;
+
+    x = etl::relu(etl::normal_generator(-0.5, 1.0));
+    w = etl::normal_generator(0.0, 1.0);
+    h = etl::normal_generator(0.0, 1.0);
+
+    dll::csc_batch<float> sparse;
+
+    REQUIRE(!sparse.build(x.memory_start(), 20, 100, 0.0));
+    REQUIRE(sparse.build(x.memory_start(), 20, 100));
+    REQUIRE(sparse.density() < 0.5);
+
+    etl::fast_dyn_matrix<float, 20, 10> y;
+    etl::fast_dyn_matrix<float, 100, 10> grad;
+
+    sparse.multiply(y, w);
+    sparse.outer(grad, h);
+
+    auto y_expected    = etl::force_temporary(x * w);
+    auto grad_expected = etl::force_temporary(etl::batch_outer(x, h));
+
+    for (size_t i = 0; i < etl::size(y); ++i) {
+        REQUIRE(y[i] == Approx(y_expected[i]).margin(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(grad); ++i) {
+        REQUIRE(grad[i] == Approx(grad_expected[i]).margin(1e-4));
+    }
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 0.1);
+
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto plain = std::make_unique<plain_dbn_t>();
+
+    std::stringstream stream;
+    dbn->store(stream);
+    plain->load(stream);
+
+    auto output   = etl::force_temporary(dbn->forward_batch(batch));
+    auto expected = etl::force_temporary(plain->forward_batch(batch));
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).margin(1e-5));
+    }
+}
@@ -0,0 +1,110 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <deque>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/grouped_conv_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// A grouped convolution with a single group is a standard convolution
+TEST_CASE("unit/grouped_conv/1", "[unit][conv]") {
+    dll::conv_layer_desc<2, 8, 8, 3, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t conv;
+    dll::grouped_conv_layer_desc<2, 8, 8, 3, 3, 3, 1, dll::activation<dll::function::IDENTITY>>::layer_t grouped;
+
+    grouped.w = conv.w;
+    grouped.b = conv.b;
+
+    etl::fast_dyn_matrix<float, 4, 2, 8, 8> input;
+    input = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4, 3, 6, 6> a;
+    etl::fast_dyn_matrix<float, 4, 3, 6, 6> b;
+
+    conv.forward_batch(a, input);
+    grouped.forward_batch(b, input);
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(b[i] == Approx(a[i]).epsilon(1e-4));
+    }
+}
+
+// Each group only sees its own channels
+TEST_CASE("unit/grouped_conv/2", "[unit][conv]") {
+    dll::depthwise_conv_layer_desc<2, 4, 4, 3, 3, dll::activation<dll::function::IDENTITY>, dll::no_bias>::layer_t layer;
+
+    layer.w(0) = 1.0;
+    layer.w(1) = 2.0;
+
+    etl::fast_dyn_matrix<float, 1, 2, 4, 4> input;
+    input(0)(0) = 1.0;
+    input(0)(1) = 3.0;
+
+    etl::fast_dyn_matrix<float, 1, 2, 2, 2> output;
+
+    layer.forward_batch(output, input);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 2; ++j) {
+            REQUIRE(output(0, 0, i, j) == Approx(9.0f));
+            REQUIRE(output(0, 1, i, j) == Approx(54.0f));
+        }
+    }
+}
+
+// Depthwise-separable network
+TEST_CASE("unit/grouped_conv/3", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::depthwise_conv_layer_desc<6, 26, 26, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::conv_layer_desc<6, 24, 24, 8, 1, 1, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<8 * 24 * 24, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->display();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+// Dynamic grouped convolution
+TEST_CASE("unit/grouped_conv/4", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_grouped_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_3d<std::vector, etl::dyn_matrix<float, 3>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template init_layer<0>(1, 28, 28, 4, 3, 3);
+    dbn->template init_layer<1>(4, 26, 26, 8, 3, 3, 2);
+    dbn->template init_layer<2>(8 * 24 * 24, 10);
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
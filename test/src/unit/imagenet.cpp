@@ -0,0 +1,160 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+
+#include <sys/stat.h>
+
+#include "dll_test.hpp"
+
+#include "dll/datasets.hpp"
+#include "dll/datasets/imagenet.hpp"
+
+namespace {
+
+// The images of the fake dataset, as (label, image) pairs
+const std::vector<std::pair<size_t, size_t>> fake_files{{1440764, 10}, {1440764, 11}, {1443537, 7}, {1484850, 3}, {1484850, 4}};
+
+std::string label_dir(size_t label) {
+    return "n0" + std::to_string(label);
+}
+
+// Creates a fake ImageNet tree in a temporary directory, with random images
+std::string make_fake_imagenet() {
+    char path[] = "/tmp/dll_imagenet_XXXXXX";
+    REQUIRE(mkdtemp(path) != nullptr);
+
+    const std::string folder(path);
+
+    mkdir((folder + "/train").c_str(), 0700);
+
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<int> dist(0, 255);
+
+    for (auto& file : fake_files) {
+        mkdir((folder + "/train/" + label_dir(file.first)).c_str(), 0700);
+
+        cv::Mat mat(256, 256, CV_8UC3);
+
+        for (int y = 0; y < 256; ++y) {
+            for (int x = 0; x < 256; ++x) {
+                mat.at<cv::Vec3b>(y, x) = cv::Vec3b(dist(engine), dist(engine), dist(engine));
+            }
+        }
+
+        REQUIRE(cv::imwrite(dll::imagenet::image_path(folder, file), mat));
+    }
+
+    return folder;
+}
+
+void remove_fake_imagenet(const std::string& folder) {
+    for (auto& file : fake_files) {
+        std::remove(dll::imagenet::image_path(folder, file).c_str());
+        std::remove((folder + "/train/" + label_dir(file.first)).c_str());
+    }
+
+    std::remove((folder + "/train.index").c_str());
+    std::remove((folder + "/train").c_str());
+    std::remove(folder.c_str());
+}
+
+// Decodes an image pixel by pixel, as the reader used to
+void reference_decode(const std::string& image_path, dll::imagenet::image_type& image) {
+    auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+
+    for (size_t x = 0; x < 256; ++x) {
+        for (size_t y = 0; y < 256; ++y) {
+            auto pixel = mat.at<cv::Vec3b>(y, x);
+
+            image(0, x, y) = pixel.val[0];
+            image(1, x, y) = pixel.val[1];
+            image(2, x, y) = pixel.val[2];
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+// The index of the files gives the same files and labels as the scan of the tree
+TEST_CASE("unit/imagenet/1", "[unit][imagenet]") {
+    auto folder = make_fake_imagenet();
+
+    std::vector<std::pair<size_t, size_t>> scan_files;
+    std::unordered_map<size_t, float> scan_labels;
+
+    dll::imagenet::scan_files(scan_files, scan_labels, folder + "/train");
+
+    REQUIRE(scan_files.size() == fake_files.size());
+    REQUIRE(scan_labels.size() == 3);
+
+    // The first read scans the tree and writes the index, the second reads the index
+    for (size_t run = 0; run < 2; ++run) {
+        std::vector<std::pair<size_t, size_t>> files;
+        std::unordered_map<size_t, float> labels;
+
+        dll::imagenet::read_files(files, labels, folder + "/train");
+
+        REQUIRE(std::ifstream(folder + "/train.index").good());
+
+        REQUIRE(files == scan_files);
+        REQUIRE(labels == scan_labels);
+    }
+
+    // An invalid index is ignored
+    std::ofstream(folder + "/train.index") << "invalid\n";
+
+    std::vector<std::pair<size_t, size_t>> files;
+    std::unordered_map<size_t, float> labels;
+
+    dll::imagenet::read_files(files, labels, folder + "/train");
+
+    REQUIRE(files == scan_files);
+    REQUIRE(labels == scan_labels);
+
+    remove_fake_imagenet(folder);
+}
+
+// The planes decoded by OpenCV and the images of the decoder are the same as the pixel by pixel decoding
+TEST_CASE("unit/imagenet/2", "[unit][imagenet]") {
+    auto folder = make_fake_imagenet();
+
+    auto files = std::make_shared<std::vector<std::pair<size_t, size_t>>>(fake_files);
+
+    std::vector<dll::imagenet::image_type> references(files->size());
+
+    for (size_t i = 0; i < files->size(); ++i) {
+        auto path = dll::imagenet::image_path(folder, (*files)[i]);
+
+        dll::imagenet::image_type image;
+        dll::imagenet::decode_image(path, image);
+
+        reference_decode(path, references[i]);
+
+        for (size_t j = 0; j < etl::size(image); ++j) {
+            REQUIRE(image[j] == references[i][j]);
+        }
+    }
+
+    {
+        dll::imagenet::decoder decoder(folder, files, 2);
+
+        // In order, twice the same image, then a rewind
+        for (size_t i : {0, 1, 2, 2, 3, 4, 1, 2}) {
+            auto image = decoder.get(i);
+
+            for (size_t j = 0; j < etl::size(image); ++j) {
+                REQUIRE(image[j] == references[i][j]);
+            }
+        }
+    }
+
+    remove_fake_imagenet(folder);
+}
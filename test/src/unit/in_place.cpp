@@ -0,0 +1,219 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithm>
+#include <deque>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/activation_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
+#include "dll/transform/rectifier_layer.hpp"
+#include "dll/transform/scale_layer.hpp"
+#include "dll/transform/shape_1d_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+#include "dll/util/arena.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// The transform layers are applied in place for inference
+TEST_CASE("unit/in_place/1", "[unit][in_place]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::tanh>::layer_t,
+            dll::scale_layer_desc<1, 2>::layer_t,
+            dll::rectifier_layer_desc<>::layer_t,
+            dll::dropout_layer_desc<50>::layer_t,
+            dll::shape_1d_layer_desc<100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::batch_size<8>>::network_t;
+
+    using batch_t = etl::fast_dyn_matrix<float, 8, 100>;
+
+    REQUIRE(dll::is_in_place<true, network_t::layer_type<1>, batch_t>);
+    REQUIRE(dll::is_in_place<true, network_t::layer_type<2>, batch_t>);
+    REQUIRE(!dll::is_in_place<true, network_t::layer_type<3>, batch_t>);
+    REQUIRE(dll::is_in_place<false, network_t::layer_type<3>, batch_t>);
+    REQUIRE(dll::is_in_place<true, network_t::layer_type<4>, batch_t>);
+    REQUIRE(!dll::is_in_place<false, network_t::layer_type<5>, batch_t>);
+
+    // A reshape is only in place when the batch has the output shape
+    REQUIRE(!dll::is_in_place<false, network_t::layer_type<4>, etl::fast_dyn_matrix<float, 8, 1, 10, 10>>);
+
+    auto net = std::make_unique<network_t>();
+
+    etl::fast_dyn_matrix<float, 8, 28 * 28> input;
+    input = etl::normal_generator(0.0, 1.0);
+
+    auto in_place = net->forward_batch(input);
+
+    // Layer by layer
+    auto a = net->template layer_get<0>().test_forward_batch(input);
+    auto b = net->template layer_get<1>().test_forward_batch(a);
+    auto c = net->template layer_get<2>().test_forward_batch(b);
+    auto d = net->template layer_get<3>().test_forward_batch(c);
+    auto e = net->template layer_get<4>().test_forward_batch(d);
+    auto f = net->template layer_get<5>().test_forward_batch(e);
+
+    REQUIRE(etl::size(in_place) == etl::size(f));
+
+    for (size_t i = 0; i < etl::size(f); ++i) {
+        REQUIRE(in_place[i] == Approx(f[i]).epsilon(1e-5));
+    }
+
+    // The representation of an intermediate layer is also the same
+    auto features = net->template forward_batch<2>(input);
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(features[i] == Approx(c[i]).epsilon(1e-5));
+    }
+
+    // The input given by the user is never modified
+    etl::fast_dyn_matrix<float, 8, 100> scaled;
+    scaled = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 8, 100> copy(scaled);
+
+    net->template forward_batch<2, 1>(scaled);
+
+    REQUIRE(scaled == copy);
+}
+
+// A first reshape is applied in place on the inputs of the context
+TEST_CASE("unit/in_place/2", "[unit][in_place]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::shape_1d_layer_desc<28 * 28>::layer_t,
+            dll::dense_layer_desc<28 * 28, 100, dll::sigmoid>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::batch_size<25>>::network_t;
+
+    using context_t = decltype(std::declval<dll::sgd_context<network_t, network_t::layer_type<0>, 0>>().input);
+
+    REQUIRE(dll::is_in_place<true, network_t::layer_type<0>, context_t>);
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.1;
+
+    FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
+
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
+
+// The layers forwarded without a copy of their input train like the
+// layers keeping their input
+TEST_CASE("unit/in_place/3", "[unit][in_place][sgd]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::shape_1d_layer_desc<100>::layer_t,
+            dll::activation_layer_desc<dll::function::TANH>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::network_t;
+
+    using reference_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::tanh>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::network_t;
+
+    REQUIRE(dll::sgd_keeps_input_v<dll::sgd_context<network_t, network_t::layer_type<0>, 0>>);
+    REQUIRE(!dll::sgd_keeps_input_v<dll::sgd_context<network_t, network_t::layer_type<1>, 1>>);
+    REQUIRE(!dll::sgd_keeps_input_v<dll::sgd_context<network_t, network_t::layer_type<2>, 2>>);
+    REQUIRE(dll::sgd_keeps_input_v<dll::sgd_context<network_t, network_t::layer_type<3>, 3>>);
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto net       = std::make_unique<network_t>();
+    auto reference = std::make_unique<reference_t>();
+
+    auto copy = [](auto& to, const auto& from) {
+        to.w = from.w;
+        to.b = from.b;
+    };
+
+    copy(reference->layer_get<0>(), net->layer_get<0>());
+    copy(reference->layer_get<1>(), net->layer_get<3>());
+
+    // The reshape and the activation read the output of the previous layer
+    // directly, the gradients must not change
+    auto error           = net->fine_tune(dataset.train(), 5);
+    auto reference_error = reference->fine_tune(dataset.train(), 5);
+
+    REQUIRE(error == Approx(reference_error));
+
+    for (size_t i = 0; i < etl::size(net->layer_get<0>().w); ++i) {
+        REQUIRE(net->layer_get<0>().w[i] == Approx(reference->layer_get<0>().w[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(net->layer_get<3>().w); ++i) {
+        REQUIRE(net->layer_get<3>().w[i] == Approx(reference->layer_get<1>().w[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/in_place/arena", "[unit][in_place]") {
+    auto& arena = dll::thread_arena();
+
+    etl::dyn_matrix<float, 2> a(7, 5);
+    a = etl::sequence_generator(-10.0);
+
+    {
+        dll::arena_scope scope;
+
+        auto clipped = dll::arena_temporary(etl::clip(a, -2.0f, 3.0f));
+
+        REQUIRE(etl::dim<0>(clipped) == 7);
+        REQUIRE(etl::dim<1>(clipped) == 5);
+        REQUIRE(reinterpret_cast<size_t>(clipped.memory_start()) % dll::arena::alignment == 0);
+
+        for (size_t i = 0; i < etl::size(a); ++i) {
+            REQUIRE(clipped[i] == Approx(std::min(std::max(a[i], -2.0f), 3.0f)));
+        }
+
+        {
+            dll::arena_scope inner;
+
+            auto twice = dll::arena_temporary(2.0f * a);
+
+            REQUIRE(twice.memory_start() != clipped.memory_start());
+            REQUIRE(twice(6, 4) == Approx(2.0f * a(6, 4)));
+        }
+
+        // The inner temporary is released, not the outer one
+        REQUIRE(clipped(0, 0) == Approx(-2.0f));
+        REQUIRE(arena.mark() > 0);
+    }
+
+    REQUIRE(arena.mark() == 0);
+
+    // The arena has grown to the peak, the next scopes do not overflow
+    const size_t size = arena.size();
+
+    REQUIRE(size >= 2 * etl::size(a) * sizeof(float));
+
+    {
+        dll::arena_scope scope;
+
+        auto clipped = dll::arena_temporary(etl::clip(a, -2.0f, 3.0f));
+        auto twice   = dll::arena_temporary(2.0f * a);
+
+        REQUIRE(clipped(6, 4) == Approx(3.0f));
+        REQUIRE(twice(0, 0) == Approx(-20.0f));
+    }
+
+    REQUIRE(arena.size() == size);
+}
@@ -0,0 +1,470 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/activation_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// Concurrent inference with one context per thread
+TEST_CASE("unit/inference/1", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 16, 28 * 28> batch;
+    etl::fast_dyn_matrix<float, 5, 28 * 28> small;
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    batch = etl::normal_generator(0.0, 1.0);
+    small = etl::normal_generator(0.0, 1.0);
+
+    auto expected       = dbn->forward_batch(batch);
+    auto expected_small = dbn->forward_batch(small);
+
+    const dbn_t& net = *dbn;
+
+    std::vector<std::thread> threads;
+    std::vector<size_t> errors(4, 0);
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&net, &sample, &batch, &small, &expected, &expected_small, &errors, t]() {
+            auto context = net.make_inference_context(sample);
+
+            for (size_t r = 0; r < 10; ++r) {
+                auto& output = net.forward_batch(context, batch);
+
+                for (size_t i = 0; i < etl::size(expected); ++i) {
+                    errors[t] += std::abs(output[i] - expected[i]) > 1e-5f;
+                }
+
+                auto& output_small = net.forward_batch(context, small);
+
+                for (size_t i = 0; i < etl::size(expected_small); ++i) {
+                    errors[t] += std::abs(output_small[i] - expected_small[i]) > 1e-5f;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < 4; ++t) {
+        REQUIRE(errors[t] == 0);
+    }
+}
+
+// Micro-batching of single-sample requests
+TEST_CASE("unit/inference/2", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(50);
+
+    for (auto& sample : samples) {
+        sample = etl::normal_generator(0.0, 1.0);
+    }
+
+    auto executor = dbn->make_batching_executor(samples[0], 16, std::chrono::microseconds(5000), 2);
+
+    std::vector<decltype(executor->submit(samples[0]))> futures;
+
+    for (auto& sample : samples) {
+        futures.push_back(executor->submit(sample));
+    }
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        auto output   = futures[i].get();
+        auto expected = dbn->forward_one(samples[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output[j] == Approx(expected[j]).epsilon(1e-5));
+        }
+    }
+
+    auto stats = executor->stats();
+
+    REQUIRE(stats.requests == 50);
+    REQUIRE(stats.batches <= 50);
+    REQUIRE(stats.mean_batch_size >= 1.0);
+    REQUIRE(stats.max_latency >= stats.mean_latency);
+}
+
+// Inference with the activations in a single arena
+TEST_CASE("unit/inference/3", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<100, 50, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 16, 28 * 28> batch;
+    etl::fast_dyn_matrix<float, 5, 28 * 28> small;
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    batch = etl::normal_generator(0.0, 1.0);
+    small = etl::normal_generator(0.0, 1.0);
+
+    auto expected       = dbn->forward_batch(batch);
+    auto expected_small = dbn->forward_batch(small);
+
+    auto plan = dbn->make_inference_plan(sample);
+
+    // The fused activation layer shares the buffer of the dense layer
+    REQUIRE(plan->layout.slots[0] == plan->layout.slots[1]);
+    REQUIRE(plan->layout.slots[2] != plan->layout.slots[1]);
+    REQUIRE(plan->layout.slots[3] != plan->layout.slots[2]);
+
+    for (size_t r = 0; r < 2; ++r) {
+        auto& output = dbn->forward_batch(*plan, batch);
+
+        for (size_t i = 0; i < etl::size(expected); ++i) {
+            REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-5));
+        }
+
+        auto& output_small = dbn->forward_batch(*plan, small);
+
+        for (size_t i = 0; i < etl::size(expected_small); ++i) {
+            REQUIRE(output_small[i] == Approx(expected_small[i]).epsilon(1e-5));
+        }
+    }
+}
+
+// Batch prediction of the labels and of the best labels
+TEST_CASE("unit/inference/4", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Four full batches and an incomplete one
+    etl::fast_dyn_matrix<float, 70, 28 * 28> batch;
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(70);
+    std::vector<size_t> labels(70, 0);
+
+    batch = etl::normal_generator(0.0, 1.0);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = batch(i);
+    }
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<16>, dll::categorical>;
+
+    auto generator = dll::make_generator(samples, labels, samples.size(), 10, generator_t{});
+
+    auto predicted = dbn->predict_batch(batch);
+    auto generated = dbn->predict_batch(*generator);
+    auto best      = dbn->predict_topk_batch(batch, 3);
+    auto all       = dbn->predict_topk_batch(*generator, 20);
+
+    REQUIRE(predicted.size() == 70);
+    REQUIRE(generated.size() == 70);
+    REQUIRE(best.size() == 70);
+    REQUIRE(all.size() == 70);
+    REQUIRE(best.k == 3);
+    REQUIRE(all.k == 10);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        auto output = dbn->forward_one(samples[i]);
+
+        REQUIRE(predicted[i] == dbn->predict(samples[i]));
+        REQUIRE(generated[i] == predicted[i]);
+        REQUIRE(best.index(i, 0) == predicted[i]);
+
+        for (size_t j = 0; j < best.k; ++j) {
+            REQUIRE(best.index(i, j) == all.index(i, j));
+            REQUIRE(best.score(i, j) == Approx(output[best.index(i, j)]).epsilon(1e-5));
+        }
+
+        for (size_t j = 1; j < all.k; ++j) {
+            REQUIRE(all.score(i, j - 1) >= all.score(i, j));
+        }
+    }
+}
+
+// Batch computation of the features of all the layers
+TEST_CASE("unit/inference/5", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Four full tiles and an incomplete one
+    etl::fast_dyn_matrix<float, 70, 28 * 28> batch;
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    batch = etl::normal_generator(0.0, 1.0);
+
+    auto features = dbn->full_activation_probabilities_batch(batch);
+
+    REQUIRE(etl::dim<0>(features) == 70);
+    REQUIRE(etl::dim<1>(features) == dbn->full_output_size());
+
+    for (size_t i = 0; i < 70; ++i) {
+        sample = batch(i);
+
+        auto expected = dbn->full_activation_probabilities(sample);
+
+        for (size_t j = 0; j < etl::size(expected); ++j) {
+            REQUIRE(features(i, j) == Approx(expected[j]).epsilon(1e-5));
+        }
+    }
+}
+
+// The collections are forwarded by tiles of batch_size samples
+TEST_CASE("unit/inference/6", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::tanh>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Four full tiles and an incomplete one
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(70);
+
+    for (auto& sample : samples) {
+        sample = etl::normal_generator(0.0, 1.0);
+    }
+
+    auto outputs    = dbn->forward_many(samples);
+    auto it_outputs = dbn->forward_many(samples.begin(), samples.end());
+    auto features   = dbn->template forward_many<0>(samples);
+
+    REQUIRE(outputs.size() == samples.size());
+    REQUIRE(it_outputs.size() == samples.size());
+    REQUIRE(features.size() == samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        auto output  = dbn->forward_one(samples[i]);
+        auto feature = dbn->template forward_one<0>(samples[i]);
+
+        for (size_t j = 0; j < etl::size(output); ++j) {
+            REQUIRE(outputs[i][j] == Approx(output[j]).epsilon(1e-5));
+            REQUIRE(it_outputs[i][j] == Approx(output[j]).epsilon(1e-5));
+        }
+
+        for (size_t j = 0; j < etl::size(feature); ++j) {
+            REQUIRE(features[i][j] == Approx(feature[j]).epsilon(1e-5));
+        }
+    }
+
+    // The layers also forward their collections by tiles
+    auto layer_outputs = dbn->template layer_get<0>().template prepare_output<etl::fast_dyn_matrix<float, 28 * 28>>(samples.size());
+
+    dbn->template layer_get<0>().test_forward_many(layer_outputs, samples);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        for (size_t j = 0; j < etl::size(features[i]); ++j) {
+            REQUIRE(layer_outputs[i][j] == Approx(features[i][j]).epsilon(1e-5));
+        }
+    }
+
+    REQUIRE(dbn->forward_many(std::vector<etl::fast_dyn_matrix<float, 28 * 28>>{}).empty());
+}
+
+// The contiguous user containers are forwarded without copy
+TEST_CASE("unit/inference/7", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    sample = etl::normal_generator(0.0, 1.0);
+
+    std::vector<float> values(sample.begin(), sample.end());
+    std::vector<double> doubles(sample.begin(), sample.end());
+
+    auto expected = dbn->forward_one(sample);
+
+    auto from_vector  = dbn->forward_one(values);
+    auto from_doubles = dbn->forward_one(doubles);
+    auto from_memory  = dbn->forward_one(dll::input_view<28 * 28>(values.data()));
+    auto from_shape   = dbn->forward_one(dll::input_view(values.data(), 28 * 28));
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(from_vector[i] == Approx(expected[i]));
+        REQUIRE(from_doubles[i] == Approx(expected[i]));
+        REQUIRE(from_memory[i] == Approx(expected[i]));
+        REQUIRE(from_shape[i] == Approx(expected[i]));
+    }
+
+    REQUIRE(dbn->predict(values) == dbn->predict(sample));
+}
+
+// Early-exit inference with an auxiliary classifier
+TEST_CASE("unit/inference/8", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<100, 50, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    using head_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    auto dbn  = std::make_unique<dbn_t>();
+    auto head = std::make_unique<head_t>();
+
+    etl::fast_dyn_matrix<float, 16, 28 * 28> batch;
+
+    batch = etl::normal_generator(0.0, 1.0);
+
+    auto expected      = dbn->forward_batch(batch);
+    auto expected_head = head->forward_batch(dbn->template forward_batch<0>(batch));
+
+    // With a threshold of 0, all the samples exit at the head
+
+    auto all = dbn->make_cascade(dll::exit_head<0>(*head, 0.0));
+
+    auto all_output = all.forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected_head); ++i) {
+        REQUIRE(all_output[i] == Approx(expected_head[i]).epsilon(1e-5));
+    }
+
+    REQUIRE(all.stats().exits[0] == 16);
+    REQUIRE(all.stats().mean_depth == Approx(1.0));
+
+    // With a threshold above 1, no sample exits
+
+    auto none = dbn->make_cascade(dll::exit_head<0>(*head, 1.1));
+
+    auto none_output = none.forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(none_output[i] == Approx(expected[i]).epsilon(1e-5));
+    }
+
+    REQUIRE(none.stats().exits[1] == 16);
+    REQUIRE(none.stats().mean_depth == Approx(3.0));
+
+    // In between, each sample is computed by its exit
+
+    auto cascade = dbn->make_cascade(dll::exit_head<0>(*head, 0.15));
+
+    std::vector<size_t> depths;
+    auto output = cascade.forward_batch(batch, depths);
+
+    for (size_t i = 0; i < 16; ++i) {
+        const bool easy = etl::max(expected_head(i)) >= 0.15;
+
+        REQUIRE(depths[i] == (easy ? 0 : 1));
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(i, j) == Approx(easy ? expected_head(i, j) : expected(i, j)).epsilon(1e-5));
+        }
+    }
+
+    auto stats = cascade.stats();
+
+    REQUIRE(stats.samples == 16);
+    REQUIRE(stats.exits[0] + stats.exits[1] == 16);
+    REQUIRE(cascade.predict_batch(batch).size() == 16);
+    REQUIRE(cascade.stats().samples == 32);
+}
+
+// Ensembles, with and without stacking of the first layers
+TEST_CASE("unit/inference/9", "[unit][inference][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    std::vector<std::unique_ptr<dbn_t>> members;
+
+    for (size_t m = 0; m < 3; ++m) {
+        members.push_back(std::make_unique<dbn_t>());
+    }
+
+    etl::fast_dyn_matrix<float, 16, 28 * 28> batch;
+    etl::fast_dyn_matrix<float, 5, 28 * 28> small;
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    batch = etl::normal_generator(0.0, 1.0);
+    small = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 16, 10> expected(0.0);
+    etl::fast_dyn_matrix<float, 5, 10> expected_small(0.0);
+
+    for (auto& member : members) {
+        expected += member->forward_batch(batch);
+        expected_small += member->forward_batch(small);
+    }
+
+    expected /= 3.0;
+    expected_small /= 3.0;
+
+    for (bool stack : {true, false}) {
+        auto ensemble = dll::make_ensemble(members, sample, stack);
+
+        REQUIRE(ensemble->size() == 3);
+        REQUIRE(ensemble->is_stacked() == stack);
+
+        for (size_t r = 0; r < 2; ++r) {
+            auto& output = ensemble->forward_batch(batch);
+
+            for (size_t i = 0; i < etl::size(expected); ++i) {
+                REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-5));
+            }
+
+            auto& output_small = ensemble->forward_batch(small);
+
+            for (size_t i = 0; i < etl::size(expected_small); ++i) {
+                REQUIRE(output_small[i] == Approx(expected_small[i]).epsilon(1e-5));
+            }
+        }
+    }
+}
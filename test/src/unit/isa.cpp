@@ -0,0 +1,399 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "dll_test.hpp"
+
+#include "dll/util/isa.hpp"
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/nchwc.hpp"
+#include "dll/util/quantize.hpp"
+#include "dll/util/small_gemm.hpp"
+#include "dll/util/subpixel_conv.hpp"
+#include "dll/dbn.hpp"
+
+namespace {
+
+// Return n random values
+etl::dyn_vector<float> random_values(size_t n) {
+    etl::dyn_vector<float> v(n);
+    v = etl::normal_generator(0.0, 1.0);
+    return v;
+}
+
+// Call the functor with the indices of the output, of the input and of the
+// filter of each product of a grouped convolution, from its definition
+template <typename Functor>
+void reference_taps(const dll::detail::grouped_conv_dims& d, Functor&& functor) {
+    const size_t NH1 = d.NH1();
+    const size_t NH2 = d.NH2();
+
+    for (size_t b = 0; b < d.B; ++b) {
+        for (size_t k = 0; k < d.K; ++k) {
+            for (size_t i = 0; i < NH1; ++i) {
+                for (size_t j = 0; j < NH2; ++j) {
+                    for (size_t c = 0; c < d.NCg(); ++c) {
+                        const size_t ch = (k / d.Kg()) * d.NCg() + c;
+
+                        for (size_t p = 0; p < d.NW1; ++p) {
+                            for (size_t q = 0; q < d.NW2; ++q) {
+                                const std::ptrdiff_t r = std::ptrdiff_t(i * d.S1 + p * d.D1) - std::ptrdiff_t(d.P1);
+                                const std::ptrdiff_t s = std::ptrdiff_t(j * d.S2 + q * d.D2) - std::ptrdiff_t(d.P2);
+
+                                if (r >= 0 && r < std::ptrdiff_t(d.NV1) && s >= 0 && s < std::ptrdiff_t(d.NV2)) {
+                                    functor(((b * d.K + k) * NH1 + i) * NH2 + j,
+                                            ((b * d.NC + ch) * d.NV1 + size_t(r)) * d.NV2 + size_t(s),
+                                            ((k * d.NCg() + c) * d.NW1 + p) * d.NW2 + q);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Check that two buffers have the same values
+template <typename A, typename B>
+void check_values(const A& a, const B& b, size_t n, double epsilon = 1e-4) {
+    for (size_t i = 0; i < n; ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(epsilon).margin(epsilon));
+    }
+}
+
+} // end of anonymous namespace
+
+// The version of the raw kernels selected with DLL_MULTI_ISA follows the
+// instruction sets of the CPU
+TEST_CASE("unit/isa/1", "[unit][isa]") {
+    const std::string isa = dll::kernel_isa();
+
+    REQUIRE((isa == "avx512" || isa == "avx2" || isa == "default"));
+
+#ifdef DLL_MULTI_ISA_ENABLED
+    __builtin_cpu_init();
+
+    REQUIRE((isa == "avx512") == bool(__builtin_cpu_supports("avx512f")));
+    REQUIRE((isa == "avx2") == (!__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")));
+#else
+    REQUIRE(isa == "default");
+#endif
+}
+
+// The small products compute the same results as the naive product
+TEST_CASE("unit/isa/2", "[unit][isa]") {
+    constexpr size_t NV = 21;
+    constexpr size_t NH = 37;
+    constexpr size_t M  = 7;
+
+    auto a = random_values(M * NV);
+    auto w = random_values(NV * NH);
+
+    std::vector<float> c(M * NH);
+    dll::small_gemm<NV, NH>(c.data(), a.memory_start(), w.memory_start(), M);
+
+    std::vector<float> ref(M * NH, 0.0f);
+
+    for (size_t m = 0; m < M; ++m) {
+        for (size_t k = 0; k < NV; ++k) {
+            for (size_t n = 0; n < NH; ++n) {
+                ref[m * NH + n] += a[m * NV + k] * w[k * NH + n];
+            }
+        }
+    }
+
+    check_values(c, ref, M * NH);
+}
+
+// The grouped convolutions compute the same results as their definition
+TEST_CASE("unit/isa/3", "[unit][isa]") {
+    dll::detail::grouped_conv_dims d{2, 4, 9, 8, 6, 3, 3};
+    d.G  = 2;
+    d.S1 = 2;
+    d.S2 = 2;
+    d.P1 = 1;
+    d.P2 = 1;
+
+    const size_t in_size  = d.B * d.NC * d.NV1 * d.NV2;
+    const size_t out_size = d.B * d.K * d.NH1() * d.NH2();
+    const size_t w_size   = d.K * d.NCg() * d.NW1 * d.NW2;
+
+    auto in    = random_values(in_size);
+    auto w     = random_values(w_size);
+    auto d_out = random_values(out_size);
+
+    std::vector<float> out(out_size);
+    std::vector<float> d_in(in_size);
+    std::vector<float> d_w(w_size);
+
+    dll::detail::grouped_conv_forward(out.data(), in.memory_start(), w.memory_start(), d);
+    dll::detail::grouped_conv_backward(d_in.data(), d_out.memory_start(), w.memory_start(), d);
+    dll::detail::grouped_conv_backward_filter(d_w.data(), in.memory_start(), d_out.memory_start(), d);
+
+    std::vector<double> out_ref(out_size, 0.0);
+    std::vector<double> d_in_ref(in_size, 0.0);
+    std::vector<double> d_w_ref(w_size, 0.0);
+
+    reference_taps(d, [&](size_t o, size_t i, size_t f) {
+        out_ref[o] += in[i] * w[f];
+        d_in_ref[i] += d_out[o] * w[f];
+        d_w_ref[f] += in[i] * d_out[o];
+    });
+
+    check_values(out, out_ref, out_size);
+    check_values(d_in, d_in_ref, in_size);
+    check_values(d_w, d_w_ref, w_size);
+}
+
+// The blocked convolution and pooling compute the same results as the
+// convolution and pooling of the plain layout
+TEST_CASE("unit/isa/4", "[unit][isa]") {
+    constexpr size_t c = dll::nchwc_width<float>;
+
+    // The channels do not fill the last blocks
+    dll::detail::grouped_conv_dims d{2, c + 3, 8, 8, c + 5, 3, 3};
+    d.P1 = 1;
+    d.P2 = 1;
+
+    const size_t NH = d.NH1() * d.NH2();
+
+    auto in   = random_values(d.B * d.NC * d.NV1 * d.NV2);
+    auto w    = random_values(d.K * d.NC * d.NW1 * d.NW2);
+    auto bias = random_values(d.K);
+
+    std::vector<float> in_c(dll::nchwc_size<float>(d.B, d.NC, d.NV1 * d.NV2));
+    std::vector<float> w_c(dll::nchwc_filters_size<float>(d.K, d.NC, d.NW1, d.NW2));
+    std::vector<float> out_c(dll::nchwc_size<float>(d.B, d.K, NH));
+
+    dll::nchwc_pack(in_c.data(), in.memory_start(), d.B, d.NC, d.NV1 * d.NV2);
+    dll::nchwc_pack_filters(w_c.data(), w.memory_start(), d.K, d.NC, d.NW1, d.NW2);
+    dll::nchwc_conv_forward(out_c.data(), in_c.data(), w_c.data(), bias.memory_start(), d);
+
+    std::vector<float> out(d.B * d.K * NH);
+    dll::nchwc_unpack(out.data(), out_c.data(), d.B, d.K, NH);
+
+    std::vector<float> ref(d.B * d.K * NH);
+    dll::detail::grouped_conv_forward(ref.data(), in.memory_start(), w.memory_start(), d);
+
+    for (size_t i = 0; i < ref.size(); ++i) {
+        ref[i] += bias[(i / NH) % d.K];
+    }
+
+    check_values(out, ref, ref.size());
+
+    // 2x2 max pooling of the blocked output
+    std::vector<float> pool_c(dll::nchwc_size<float>(d.B, d.K, NH / 4));
+    dll::nchwc_pool<true>(pool_c.data(), out_c.data(), d.B, d.K, d.NH1(), d.NH2(), 2, 2);
+
+    std::vector<float> pool(d.B * d.K * NH / 4);
+    dll::nchwc_unpack(pool.data(), pool_c.data(), d.B, d.K, NH / 4);
+
+    const size_t PH1 = d.NH1() / 2;
+    const size_t PH2 = d.NH2() / 2;
+
+    for (size_t bk = 0; bk < d.B * d.K; ++bk) {
+        for (size_t i = 0; i < PH1; ++i) {
+            for (size_t j = 0; j < PH2; ++j) {
+                const float* map = ref.data() + bk * NH;
+
+                float max = map[(2 * i) * d.NH2() + 2 * j];
+                max       = std::max(max, map[(2 * i) * d.NH2() + 2 * j + 1]);
+                max       = std::max(max, map[(2 * i + 1) * d.NH2() + 2 * j]);
+                max       = std::max(max, map[(2 * i + 1) * d.NH2() + 2 * j + 1]);
+
+                REQUIRE(pool[(bk * PH1 + i) * PH2 + j] == Approx(max).epsilon(1e-4).margin(1e-4));
+            }
+        }
+    }
+}
+
+// The sub-pixel convolutions compute the same results as the convolutions
+// of the upsampled input
+TEST_CASE("unit/isa/5", "[unit][isa]") {
+    dll::detail::subpixel_conv_dims d{2, 3, 5, 4, 4, 3, 3, 2, 2, 1, 1};
+
+    dll::detail::grouped_conv_dims up{d.B, d.NC, d.NH1(), d.NH2(), d.K, d.NW1, d.NW2};
+    up.P1 = d.P1;
+    up.P2 = d.P2;
+
+    const size_t in_size  = d.B * d.NC * d.NV1 * d.NV2;
+    const size_t up_size  = d.B * d.NC * d.NH1() * d.NH2();
+    const size_t out_size = d.B * d.K * d.NH1() * d.NH2();
+    const size_t w_size   = d.K * d.NC * d.NW1 * d.NW2;
+
+    REQUIRE(up.NH1() == d.NH1());
+    REQUIRE(up.NH2() == d.NH2());
+
+    auto in    = random_values(in_size);
+    auto w     = random_values(w_size);
+    auto d_out = random_values(out_size);
+
+    std::vector<float> w_p(d.phase_size());
+    dll::detail::subpixel_filters(w_p.data(), w.memory_start(), d);
+
+    std::vector<float> out(out_size);
+    std::vector<float> d_in(in_size);
+    std::vector<float> d_w_p(d.phase_size());
+
+    dll::detail::subpixel_conv_forward(out.data(), in.memory_start(), w_p.data(), d);
+    dll::detail::subpixel_conv_backward(d_in.data(), d_out.memory_start(), w_p.data(), d);
+    dll::detail::subpixel_conv_backward_filter(d_w_p.data(), in.memory_start(), d_out.memory_start(), d);
+
+    std::vector<float> d_w(w_size, 0.0f);
+    dll::detail::subpixel_taps(d, [&](size_t i, size_t j) { d_w[i] += d_w_p[j]; });
+
+    // The nearest-neighbour upsampling of the input
+
+    std::vector<float> in_up(up_size);
+
+    for (size_t bc = 0; bc < d.B * d.NC; ++bc) {
+        for (size_t i = 0; i < d.NH1(); ++i) {
+            for (size_t j = 0; j < d.NH2(); ++j) {
+                in_up[(bc * d.NH1() + i) * d.NH2() + j] = in[(bc * d.NV1 + i / d.U1) * d.NV2 + j / d.U2];
+            }
+        }
+    }
+
+    std::vector<float> out_ref(out_size);
+    std::vector<float> d_up(up_size);
+    std::vector<float> d_w_ref(w_size);
+
+    dll::detail::grouped_conv_forward(out_ref.data(), in_up.data(), w.memory_start(), up);
+    dll::detail::grouped_conv_backward(d_up.data(), d_out.memory_start(), w.memory_start(), up);
+    dll::detail::grouped_conv_backward_filter(d_w_ref.data(), in_up.data(), d_out.memory_start(), up);
+
+    // The gradients of the upsampled input are summed over the copies
+    std::vector<float> d_in_ref(in_size, 0.0f);
+
+    for (size_t bc = 0; bc < d.B * d.NC; ++bc) {
+        for (size_t i = 0; i < d.NH1(); ++i) {
+            for (size_t j = 0; j < d.NH2(); ++j) {
+                d_in_ref[(bc * d.NV1 + i / d.U1) * d.NV2 + j / d.U2] += d_up[(bc * d.NH1() + i) * d.NH2() + j];
+            }
+        }
+    }
+
+    check_values(out, out_ref, out_size);
+    check_values(d_in, d_in_ref, in_size);
+    check_values(d_w, d_w_ref, w_size);
+}
+
+// The INT8 products compute the products of the quantized values
+TEST_CASE("unit/isa/6", "[unit][isa]") {
+    constexpr size_t B = 3;
+    constexpr size_t K = 45;
+    constexpr size_t N = 11;
+
+    etl::dyn_matrix<float, 2> in(B, K);
+    etl::dyn_matrix<float, 2> w(N, K);
+
+    in = etl::normal_generator(0.0, 1.0);
+    w  = etl::normal_generator(0.0, 1.0);
+
+    dll::int8_quantization q;
+    q.calibrate(in);
+
+    REQUIRE(q.quantize(w, N, K, false));
+
+    std::vector<float> out(B * N);
+    dll::detail::int8_dense_forward(out.data(), in.memory_start(), q, B, K, N);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t o = 0; o < N; ++o) {
+            int32_t acc = 0;
+
+            for (size_t k = 0; k < K; ++k) {
+                acc += int32_t(dll::int8_quantization::quantize_one(in(b, k), 1.0f / q.input_scale)) * int32_t(q.weights[o * K + k]);
+            }
+
+            REQUIRE(out[b * N + o] == Approx(float(acc) * q.scales[o]).epsilon(1e-5));
+        }
+    }
+
+    // The convolution of the quantized values, with the padding at zero
+
+    dll::detail::grouped_conv_dims d{2, 3, 7, 6, 5, 3, 3};
+    d.P1 = 1;
+    d.P2 = 1;
+
+    const size_t P = d.NC * d.NW1 * d.NW2;
+
+    etl::dyn_matrix<float, 4> c_in(d.B, d.NC, d.NV1, d.NV2);
+    etl::dyn_matrix<float, 4> c_w(d.K, d.NC, d.NW1, d.NW2);
+
+    c_in = etl::normal_generator(0.0, 1.0);
+    c_w  = etl::normal_generator(0.0, 1.0);
+
+    dll::int8_quantization c_q;
+    c_q.calibrate(c_in);
+
+    REQUIRE(c_q.quantize(c_w, d.K, P, false));
+
+    const size_t out_size = d.B * d.K * d.NH1() * d.NH2();
+
+    std::vector<float> c_out(out_size);
+    dll::detail::int8_conv_forward(c_out.data(), c_in.memory_start(), c_q, d);
+
+    std::vector<int32_t> acc(out_size, 0);
+
+    reference_taps(d, [&](size_t o, size_t i, size_t f) {
+        acc[o] += int32_t(dll::int8_quantization::quantize_one(c_in[i], 1.0f / c_q.input_scale)) * int32_t(c_q.weights[f]);
+    });
+
+    for (size_t o = 0; o < out_size; ++o) {
+        const size_t k = (o / (d.NH1() * d.NH2())) % d.K;
+
+        REQUIRE(c_out[o] == Approx(float(acc[o]) * c_q.scales[k]).epsilon(1e-5));
+    }
+}
+
+// The fused update loops apply the functor on each element (or on each
+// element of the given rows)
+TEST_CASE("unit/isa/7", "[unit][isa]") {
+    etl::dyn_matrix<float, 2> w(6, 5);
+    etl::dyn_matrix<float, 2> grad(6, 5);
+    etl::dyn_matrix<float, 2> inc(6, 5);
+
+    w    = etl::normal_generator(0.0, 1.0);
+    grad = etl::normal_generator(0.0, 1.0);
+    inc  = etl::normal_generator(0.0, 1.0);
+
+    etl::dyn_matrix<float, 2> w_ref(6, 5);
+    etl::dyn_matrix<float, 2> inc_ref(6, 5);
+
+    inc_ref = 0.9 * inc + 0.1 * grad;
+    w_ref   = w + inc_ref;
+
+    auto momentum = [](float& x, float g, float& v) {
+        v = 0.9f * v + 0.1f * g;
+        x += v;
+    };
+
+    auto w_rows   = w;
+    auto inc_rows = inc;
+
+    dll::fused_update_loop(momentum, w, grad, inc);
+
+    check_values(w, w_ref, etl::size(w));
+    check_values(inc, inc_ref, etl::size(inc));
+
+    const std::vector<size_t> rows{1, 4};
+
+    dll::fused_update_rows(momentum, rows, w_rows, grad, inc_rows);
+
+    for (size_t i = 0; i < etl::dim<0>(w); ++i) {
+        const bool updated = i == 1 || i == 4;
+
+        for (size_t j = 0; j < etl::dim<1>(w); ++j) {
+            REQUIRE(w_rows(i, j) == Approx(updated ? w_ref(i, j) : w_ref(i, j) - inc_ref(i, j)).epsilon(1e-4).margin(1e-4));
+        }
+    }
+}
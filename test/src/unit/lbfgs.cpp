@@ -0,0 +1,113 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <sstream>
+#include <tuple>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/activation_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// Test L-BFGS on a Dense -> Softmax network
+TEST_CASE("unit/lbfgs/1", "[unit][lbfgs][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::lbfgs_trainer>,
+        dll::batch_size<250>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<250>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn_t::desc::template trainer_t<dbn_t>::name() == "L-BFGS");
+
+    FT_CHECK_DATASET(20, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The line search only accepts the steps that decrease the loss of the batch
+    auto batch = dll::make_mnist_dataset_sub(0, 250, dll::normalize_pre{}, dll::batch_size<250>{});
+
+    auto net = std::make_unique<dbn_t>();
+
+    double loss = std::get<1>(net->evaluate_metrics(batch.train()));
+
+    for (size_t epoch = 0; epoch < 3; ++epoch) {
+        net->fine_tune(batch.train(), 1);
+
+        const double new_loss = std::get<1>(net->evaluate_metrics(batch.train()));
+
+        if (epoch == 0) {
+            REQUIRE(new_loss < loss);
+        } else {
+            REQUIRE(new_loss <= loss);
+        }
+
+        loss = new_loss;
+    }
+}
+
+// Test data-parallel L-BFGS on a Dense -> Sigmoid -> Dense -> Softmax network
+TEST_CASE("unit/lbfgs/2", "[unit][lbfgs][dbn][mnist][parallel]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::lbfgs_trainer>,
+        dll::batch_size<200>,
+        dll::data_parallel<4>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<200>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->lbfgs_history    = 5;
+    dbn->lbfgs_iterations = 10;
+
+    FT_CHECK_DATASET(20, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The gradients of the shards are the gradients of the whole batch
+    using serial_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::lbfgs_trainer>,
+        dll::batch_size<200>
+    >::dbn_t;
+
+    auto batch = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<200>{});
+
+    auto serial   = std::make_unique<serial_dbn_t>();
+    auto parallel = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    serial->store(weights);
+    parallel->load(weights);
+
+    serial->lbfgs_iterations   = 3;
+    parallel->lbfgs_iterations = 3;
+
+    auto serial_error   = serial->fine_tune(batch.train(), 1);
+    auto parallel_error = parallel->fine_tune(batch.train(), 1);
+
+    REQUIRE(parallel_error == Approx(serial_error));
+
+    auto& a = serial->template layer_get<0>().w;
+    auto& b = parallel->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-3));
+    }
+}
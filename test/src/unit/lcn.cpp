@@ -5,6 +5,9 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
+#include <cmath>
+
 #include "dll_test.hpp"
 
 #define DLL_SVM_SUPPORT
@@ -260,3 +263,90 @@ TEST_CASE("unit/cdbn/lcn/mnist/8", "[cdbn][lcn][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+namespace {
+
+// The LCN computed with the full 2D filter for each pixel
+template <typename Input, typename Output, typename W>
+void reference_lcn(Output& y, const Input& x, const W& w, size_t K, size_t Mid) {
+    const long N1 = etl::dim<1>(x);
+    const long N2 = etl::dim<2>(x);
+
+    etl::dyn_matrix<double, 2> v(N1, N2);
+    etl::dyn_matrix<double, 2> o(N1, N2);
+
+    for (size_t c = 0; c < etl::dim<0>(x); ++c) {
+        for (long j = 0; j < N1; ++j) {
+            for (long k = 0; k < N2; ++k) {
+                double sum    = 0.0;
+                double sum_sq = 0.0;
+
+                for (long p = 0; p < long(K); ++p) {
+                    for (long q = 0; q < long(K); ++q) {
+                        const long jj = j + p - long(Mid);
+                        const long kk = k + q - long(Mid);
+
+                        if (jj >= 0 && jj < N1 && kk >= 0 && kk < N2) {
+                            sum += w(p, q) * x(c, jj, kk);
+                            sum_sq += w(p, q) * x(c, jj, kk) * x(c, jj, kk);
+                        }
+                    }
+                }
+
+                v(j, k) = x(c, j, k) - sum;
+                o(j, k) = std::sqrt(sum_sq);
+            }
+        }
+
+        const double cst = etl::mean(o);
+
+        for (long j = 0; j < N1; ++j) {
+            for (long k = 0; k < N2; ++k) {
+                y(c, j, k) = v(j, k) / std::max(o(j, k), cst);
+            }
+        }
+    }
+}
+
+// Compare the separable LCN with the LCN with the full 2D filter
+void check_lcn(size_t K, double sigma) {
+    const size_t Mid = K / 2;
+
+    etl::fast_dyn_matrix<float, 3, 12, 10> x;
+    etl::fast_dyn_matrix<float, 3, 12, 10> y;
+    etl::fast_dyn_matrix<double, 3, 12, 10> ref;
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    etl::dyn_matrix<float, 1> w1(K);
+    etl::dyn_matrix<double, 2> w2(K, K);
+
+    dll::lcn_filter_1d(w1, K, Mid, sigma);
+    dll::lcn_filter(w2, K, Mid, sigma);
+
+    // The 2D filter is the outer product of the 1D filter
+    for (size_t p = 0; p < K; ++p) {
+        for (size_t q = 0; q < K; ++q) {
+            REQUIRE(w1(p) * w1(q) == Approx(w2(p, q)).epsilon(1e-4));
+        }
+    }
+
+    dll::lcn_compute(y, x, w1, K, Mid);
+    reference_lcn(ref, x, w2, K, Mid);
+
+    for (size_t i = 0; i < etl::size(y); ++i) {
+        REQUIRE(y[i] == Approx(ref[i]).epsilon(1e-3).margin(1e-4));
+    }
+}
+
+} // end of anonymous namespace
+
+// The separable filtering gives the results of the full 2D filter
+TEST_CASE("unit/lcn/1", "[unit][lcn]") {
+    check_lcn(3, 2.0);
+    check_lcn(5, 2.0);
+    check_lcn(9, 2.0);
+
+    // The filter is larger than a dimension of the input
+    check_lcn(11, 3.0);
+}
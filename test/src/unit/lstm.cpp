@@ -5,6 +5,10 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cmath>
+#include <utility>
+#include <vector>
+
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
@@ -13,6 +17,82 @@
 #include "dll/network.hpp"
 #include "dll/datasets.hpp"
 
+namespace {
+
+float sigmoid(float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+// The forward pass of the LSTM computed gate by gate, one sample at a time
+template <typename Layer, typename X, typename H>
+void reference_forward(const Layer& layer, const X& x, H& h) {
+    constexpr size_t T = Layer::time_steps;
+    constexpr size_t S = Layer::sequence_length;
+    constexpr size_t N = Layer::hidden_units;
+
+    for (size_t b = 0; b < etl::dim<0>(x); ++b) {
+        std::vector<float> s_prev(N, 0.0f);
+        std::vector<float> h_prev(N, 0.0f);
+        std::vector<float> s_t(N);
+
+        for (size_t t = 0; t < T; ++t) {
+            for (size_t j = 0; j < N; ++j) {
+                float z_g = layer.b_g(j);
+                float z_i = layer.b_i(j);
+                float z_f = layer.b_f(j);
+                float z_o = layer.b_o(j);
+
+                for (size_t k = 0; k < S; ++k) {
+                    z_g += x(b, t, k) * layer.u_g(k, j);
+                    z_i += x(b, t, k) * layer.u_i(k, j);
+                    z_f += x(b, t, k) * layer.u_f(k, j);
+                    z_o += x(b, t, k) * layer.u_o(k, j);
+                }
+
+                for (size_t k = 0; k < N; ++k) {
+                    z_g += h_prev[k] * layer.w_g(k, j);
+                    z_i += h_prev[k] * layer.w_i(k, j);
+                    z_f += h_prev[k] * layer.w_f(k, j);
+                    z_o += h_prev[k] * layer.w_o(k, j);
+                }
+
+                const float g = std::tanh(z_g);
+                const float i = sigmoid(z_i);
+                const float f = sigmoid(z_f);
+                const float o = sigmoid(z_o);
+
+                if (t == 0) {
+                    s_t[j]     = g * i;
+                    h(b, t, j) = std::tanh(s_t[j]) * o;
+                } else {
+                    s_t[j]     = std::tanh(g * i + s_prev[j] * f);
+                    h(b, t, j) = s_t[j] * o;
+                }
+            }
+
+            s_prev = s_t;
+
+            for (size_t j = 0; j < N; ++j) {
+                h_prev[j] = h(b, t, j);
+            }
+        }
+    }
+}
+
+// Check that the gradients of two contexts are the same
+template <typename A, typename B, size_t... I>
+void check_gradients(const A& a, const B& b, std::index_sequence<I...> /*seq*/) {
+    auto check = [](const auto& x, const auto& y) {
+        for (size_t i = 0; i < etl::size(x); ++i) {
+            REQUIRE(x[i] == Approx(y[i]));
+        }
+    };
+
+    (check(std::get<I>(a.up.context)->grad, std::get<I>(b.up.context)->grad), ...);
+}
+
+} // end of anonymous namespace
+
 // Simple LSTM
 TEST_CASE("unit/lstm/1", "[unit][lstm]") {
     auto dataset = dll::make_mnist_dataset_nc_sub(0, 2000, dll::batch_size<100>{}, dll::scale_pre<255>{});
@@ -85,3 +165,304 @@ TEST_CASE("unit/lstm/3", "[unit][lstm]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Streaming inference, one time step at a time
+TEST_CASE("unit/lstm/4", "[unit][lstm][stream]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 9;
+    constexpr size_t streams         = 3;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::dyn_matrix<float, 3> x(streams, time_steps, sequence_length);
+    etl::dyn_matrix<float, 3> y(streams, time_steps, hidden_units);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    layer.forward_batch(y, x);
+
+    auto state = layer.make_stream_state(streams);
+
+    etl::dyn_matrix<float, 2> frame(streams, sequence_length);
+    etl::dyn_matrix<float, 2> out(streams, hidden_units);
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        for (size_t k = 0; k < streams; ++k) {
+            frame(k) = x(k)(t);
+        }
+
+        layer.step_batch(out, frame, state);
+
+        for (size_t k = 0; k < streams; ++k) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                REQUIRE(out(k, j) == Approx(y(k, t, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    // A reset stream starts again from the first time step
+    state.reset(1);
+
+    frame(1) = x(1)(0);
+
+    layer.step_batch(out, frame, state);
+
+    for (size_t j = 0; j < hidden_units; ++j) {
+        REQUIRE(out(1, j) == Approx(y(1, 0, j)).epsilon(1e-4));
+    }
+}
+
+// Variable-length sequences
+TEST_CASE("unit/lstm/5", "[unit][lstm][mask]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 5;
+    constexpr size_t batch           = 4;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+    dll::recurrent_last_layer<time_steps, hidden_units> last;
+
+    etl::dyn_matrix<float, 3> x(batch, time_steps, sequence_length);
+    etl::dyn_matrix<float, 3> y(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 3> y_masked(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 2> y_last(batch, hidden_units);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    layer.forward_batch(y, x);
+
+    dll::lstm_forward_workspace<float> ws;
+    ws.mask.lengths = {3, 6, 1, 4};
+
+    layer.forward_batch(y_masked, x, ws);
+
+    dll::sequence_workspace last_ws;
+    last_ws.mask.lengths = ws.mask.lengths;
+
+    last.forward_batch(y_last, y_masked, last_ws);
+
+    for (size_t b = 0; b < batch; ++b) {
+        const size_t length = ws.mask.lengths[b];
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                if (t < length) {
+                    REQUIRE(y_masked(b, t, j) == Approx(y(b, t, j)).epsilon(1e-4));
+                } else {
+                    REQUIRE(y_masked(b, t, j) == 0.0f);
+                }
+            }
+        }
+
+        for (size_t j = 0; j < hidden_units; ++j) {
+            REQUIRE(y_last(b, j) == Approx(y(b, length - 1, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// Inference of only the last time step
+TEST_CASE("unit/lstm/6", "[unit][lstm]") {
+    constexpr size_t time_steps      = 7;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 6;
+    constexpr size_t batch           = 5;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 3, dll::softmax>
+        >
+        , dll::batch_size<batch>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> x;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h;
+    etl::fast_dyn_matrix<float, batch, hidden_units> last;
+    etl::fast_dyn_matrix<float, batch, 3> y;
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    // With all the time steps
+    net->template layer_get<0>().test_forward_batch(h, x);
+    net->template layer_get<1>().test_forward_batch(last, h);
+    net->template layer_get<2>().test_forward_batch(y, last);
+
+    auto features = net->template forward_batch<1>(x);
+    auto output   = net->forward_batch(x);
+
+    for (size_t b = 0; b < batch; ++b) {
+        for (size_t j = 0; j < hidden_units; ++j) {
+            REQUIRE(features(b, j) == Approx(last(b, j)).epsilon(1e-4));
+        }
+
+        for (size_t j = 0; j < 3; ++j) {
+            REQUIRE(output(b, j) == Approx(y(b, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// The packed gates compute the same output as the gates computed one by one
+TEST_CASE("unit/lstm/7", "[unit][lstm]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 5;
+    constexpr size_t hidden_units    = 4;
+    constexpr size_t batch           = 3;
+
+    using layer_t = dll::lstm_layer<time_steps, sequence_length, hidden_units>;
+
+    layer_t layer;
+
+    layer.b_i = etl::normal_generator(0.0, 0.5);
+    layer.b_g = etl::normal_generator(0.0, 0.5);
+    layer.b_o = etl::normal_generator(0.0, 0.5);
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> x;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> ref;
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    layer.test_forward_batch(h, x);
+    reference_forward(layer, x, ref);
+
+    for (size_t i = 0; i < etl::size(h); ++i) {
+        REQUIRE(h[i] == Approx(ref[i]).epsilon(1e-4).margin(1e-5));
+    }
+}
+
+// The packed gradients are the gradients of the loss, checked with finite differences
+TEST_CASE("unit/lstm/8", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 3;
+    constexpr size_t batch           = 2;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 3, dll::softmax>
+        >
+        , dll::batch_size<batch>
+    >::network_t;
+
+    using layer_t = network_t::layer_type<0>;
+
+    auto net = std::make_unique<network_t>();
+
+    auto& layer = net->template layer_get<0>();
+
+    dll::full_sgd_context<network_t, layer_t, 0> context(layer);
+
+    context.input  = etl::normal_generator(0.0, 1.0);
+    context.errors = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> input_errors;
+
+    layer.forward_batch(context.output, context.input, context.workspace);
+    layer.backward_pass(input_errors, context, true);
+
+    // The loss is the sum of the outputs weighted by the errors
+    auto loss = [&]() {
+        etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h;
+        layer.test_forward_batch(h, context.input);
+        return double(etl::sum(h >> context.errors));
+    };
+
+    auto check = [&](auto& value, const auto& grad) {
+        const float eps = 1e-2;
+
+        for (size_t i = 0; i < etl::size(value); ++i) {
+            const float v = value[i];
+
+            value[i] = v + eps;
+            auto plus = loss();
+
+            value[i] = v - eps;
+            auto minus = loss();
+
+            value[i] = v;
+
+            REQUIRE(grad[i] == Approx((plus - minus) / (2.0 * eps)).epsilon(2e-2).margin(2e-3));
+        }
+    };
+
+    check(layer.w_i, std::get<0>(context.up.context)->grad);
+    check(layer.u_i, std::get<1>(context.up.context)->grad);
+    check(layer.b_i, std::get<2>(context.up.context)->grad);
+    check(layer.w_g, std::get<3>(context.up.context)->grad);
+    check(layer.u_g, std::get<4>(context.up.context)->grad);
+    check(layer.b_g, std::get<5>(context.up.context)->grad);
+    check(layer.w_f, std::get<6>(context.up.context)->grad);
+    check(layer.u_f, std::get<7>(context.up.context)->grad);
+    check(layer.b_f, std::get<8>(context.up.context)->grad);
+    check(layer.w_o, std::get<9>(context.up.context)->grad);
+    check(layer.u_o, std::get<10>(context.up.context)->grad);
+    check(layer.b_o, std::get<11>(context.up.context)->grad);
+    check(context.input, input_errors);
+}
+
+// Each training context has its own caches
+TEST_CASE("unit/lstm/9", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 3;
+    constexpr size_t batch           = 4;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 3, dll::softmax>
+        >
+        , dll::batch_size<batch>
+    >::network_t;
+
+    using layer_t   = network_t::layer_type<0>;
+    using context_t = dll::full_sgd_context<network_t, layer_t, 0>;
+
+    auto net = std::make_unique<network_t>();
+
+    auto& layer = net->template layer_get<0>();
+
+    context_t a(layer);
+    context_t b(layer);
+    context_t ref(layer);
+
+    a.input  = etl::normal_generator(0.0, 1.0);
+    a.errors = etl::normal_generator(0.0, 1.0);
+    b.input  = etl::normal_generator(0.0, 1.0);
+
+    ref.input  = a.input;
+    ref.errors = a.errors;
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> a_errors;
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> ref_errors;
+
+    layer.forward_batch(ref.output, ref.input, ref.workspace);
+    layer.backward_batch(ref_errors, ref);
+
+    // Another context and the inference are forwarded in between
+    layer.forward_batch(a.output, a.input, a.workspace);
+    layer.forward_batch(b.output, b.input, b.workspace);
+
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h;
+    layer.test_forward_batch(h, b.input);
+
+    layer.backward_batch(a_errors, a);
+
+    for (size_t i = 0; i < etl::size(a.output); ++i) {
+        REQUIRE(a.output[i] == Approx(ref.output[i]));
+        REQUIRE(b.output[i] == Approx(h[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(a_errors); ++i) {
+        REQUIRE(a_errors[i] == Approx(ref_errors[i]));
+    }
+
+    check_gradients(a, ref, std::make_index_sequence<12>());
+}
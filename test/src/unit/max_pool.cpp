@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/util/max_pool.hpp"
+
+// Without ties, the recorded maxima give the same results as the ETL kernels
+TEST_CASE("unit/max_pool/1", "[unit][pooling]") {
+    etl::fast_matrix<float, 2, 3, 6, 4> input;
+    etl::fast_matrix<float, 2, 3, 3, 2> output;
+    etl::fast_matrix<float, 2, 3, 3, 2> errors;
+    etl::fast_matrix<float, 2, 3, 6, 4> input_errors;
+
+    input  = etl::normal_generator(0.0, 1.0);
+    errors = etl::normal_generator(0.0, 1.0);
+
+    dll::max_pool_workspace<uint8_t> workspace;
+    dll::detail::max_pool_dims dims{2, 3, 6, 4, 1, 2, 2};
+
+    dll::max_pool_forward(output, input, workspace, dims);
+    dll::max_pool_backward(input_errors, errors, workspace, dims);
+
+    etl::fast_matrix<float, 2, 3, 3, 2> ref_output       = etl::ml::max_pool_forward<2, 2>(input);
+    etl::fast_matrix<float, 2, 3, 6, 4> ref_input_errors = etl::ml::max_pool_backward<2, 2>(input, ref_output, errors);
+
+    REQUIRE(workspace.argmax.size() == etl::size(output));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(ref_output[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(input_errors); ++i) {
+        REQUIRE(input_errors[i] == Approx(ref_input_errors[i]));
+    }
+}
+
+// With ties, the whole error of a window goes to its first maximum
+TEST_CASE("unit/max_pool/2", "[unit][pooling]") {
+    etl::fast_matrix<float, 1, 1, 2, 4> input;
+    etl::fast_matrix<float, 1, 1, 1, 2> output;
+    etl::fast_matrix<float, 1, 1, 1, 2> errors;
+    etl::fast_matrix<float, 1, 1, 2, 4> input_errors;
+
+    // The first window is constant, the second one has two maxima
+    input(0, 0, 0, 0) = 1.0;
+    input(0, 0, 0, 1) = 1.0;
+    input(0, 0, 1, 0) = 1.0;
+    input(0, 0, 1, 1) = 1.0;
+
+    input(0, 0, 0, 2) = 2.0;
+    input(0, 0, 0, 3) = 5.0;
+    input(0, 0, 1, 2) = 5.0;
+    input(0, 0, 1, 3) = -1.0;
+
+    errors(0, 0, 0, 0) = 3.0;
+    errors(0, 0, 0, 1) = 7.0;
+
+    dll::max_pool_workspace<uint8_t> workspace;
+    dll::detail::max_pool_dims dims{1, 1, 2, 4, 1, 2, 2};
+
+    dll::max_pool_forward(output, input, workspace, dims);
+    dll::max_pool_backward(input_errors, errors, workspace, dims);
+
+    REQUIRE(output(0, 0, 0, 0) == Approx(1.0));
+    REQUIRE(output(0, 0, 0, 1) == Approx(5.0));
+
+    REQUIRE(workspace.argmax[0] == 0);
+    REQUIRE(workspace.argmax[1] == 1);
+
+    REQUIRE(input_errors(0, 0, 0, 0) == Approx(3.0));
+    REQUIRE(input_errors(0, 0, 0, 1) == Approx(0.0));
+    REQUIRE(input_errors(0, 0, 1, 0) == Approx(0.0));
+    REQUIRE(input_errors(0, 0, 1, 1) == Approx(0.0));
+
+    REQUIRE(input_errors(0, 0, 0, 2) == Approx(0.0));
+    REQUIRE(input_errors(0, 0, 0, 3) == Approx(7.0));
+    REQUIRE(input_errors(0, 0, 1, 2) == Approx(0.0));
+    REQUIRE(input_errors(0, 0, 1, 3) == Approx(0.0));
+
+    // The total error is preserved, not duplicated on the ties
+    REQUIRE(etl::sum(input_errors) == Approx(etl::sum(errors)));
+}
+
+// The 3D pooling records the offsets in the whole 3D window
+TEST_CASE("unit/max_pool/3", "[unit][pooling]") {
+    etl::fast_matrix<float, 2, 4, 4, 6> input;
+    etl::fast_matrix<float, 2, 2, 2, 3> output;
+    etl::fast_matrix<float, 2, 2, 2, 3> errors;
+    etl::fast_matrix<float, 2, 4, 4, 6> input_errors;
+
+    input  = etl::normal_generator(0.0, 1.0);
+    errors = etl::normal_generator(0.0, 1.0);
+
+    dll::max_pool_workspace<uint8_t> workspace;
+    dll::detail::max_pool_dims dims{2, 4, 4, 6, 2, 2, 2};
+
+    dll::max_pool_forward(output, input, workspace, dims);
+    dll::max_pool_backward(input_errors, errors, workspace, dims);
+
+    etl::fast_matrix<float, 2, 2, 2, 3> ref_output       = etl::ml::max_pool_3d_forward<2, 2, 2>(input);
+    etl::fast_matrix<float, 2, 4, 4, 6> ref_input_errors = etl::ml::max_pool_3d_backward<2, 2, 2>(input, ref_output, errors);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(ref_output[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(input_errors); ++i) {
+        REQUIRE(input_errors[i] == Approx(ref_input_errors[i]));
+    }
+}
@@ -0,0 +1,334 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithm>
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/activation_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Test data-parallel Dense -> Sigmoid -> Dense -> Softmax network
+TEST_CASE("unit/parallel/1", "[unit][parallel][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::data_parallel<4>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+
+    // The shards compute the same updates as the serial training
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t serial_dbn_t;
+
+    // Three full batches and an incomplete one, over two shards
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(70);
+    std::vector<size_t> labels(samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    auto serial   = std::make_unique<serial_dbn_t>();
+    auto parallel = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    serial->store(weights);
+    parallel->load(weights);
+
+    serial->learning_rate   = 0.05;
+    parallel->learning_rate = 0.05;
+
+    auto serial_error   = serial->fine_tune(samples, labels, 3);
+    auto parallel_error = parallel->fine_tune(samples, labels, 3);
+
+    REQUIRE(parallel_error == Approx(serial_error));
+
+    auto& a = serial->template layer_get<0>().w;
+    auto& b = parallel->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+
+    auto& c = serial->template layer_get<2>().w;
+    auto& d = parallel->template layer_get<2>().w;
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(c[i] == Approx(d[i]).epsilon(1e-4));
+    }
+}
+
+namespace {
+
+// Simulate two processes training on the same data
+struct twin_communicator final : dll::communicator {
+    size_t rank() const override { return 0; }
+    size_t size() const override { return 2; }
+
+    void all_reduce(float* data, size_t n) override { scale(data, n); }
+    void all_reduce(double* data, size_t n) override { scale(data, n); }
+
+    void broadcast(float*, size_t, size_t) override {}
+    void broadcast(double*, size_t, size_t) override {}
+
+    template <typename T>
+    static void scale(T* data, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            data[i] *= 2;
+        }
+    }
+};
+
+} // end of anonymous namespace
+
+// Distributed training
+TEST_CASE("unit/parallel/2", "[unit][parallel][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 10>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->comm = std::make_shared<twin_communicator>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+
+    // The gradients and the samples of the two processes are reduced, the
+    // updates are the ones of a single process
+    auto twin   = std::make_unique<dbn_t>();
+    auto single = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    single->store(weights);
+    twin->load(weights);
+
+    twin->comm = std::make_shared<twin_communicator>();
+
+    twin->learning_rate   = 0.03;
+    single->learning_rate = 0.03;
+
+    auto twin_error   = twin->fine_tune(dataset.training_images, dataset.training_labels, 3);
+    auto single_error = single->fine_tune(dataset.training_images, dataset.training_labels, 3);
+
+    REQUIRE(twin_error == Approx(single_error));
+
+    auto& a = single->template layer_get<0>().w;
+    auto& b = twin->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+
+    auto& c = single->template layer_get<1>().w;
+    auto& d = twin->template layer_get<1>().w;
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(c[i] == Approx(d[i]).epsilon(1e-4));
+    }
+}
+
+// The pipeline-parallel training trains the same batches as the serial training
+TEST_CASE("unit/parallel/3", "[unit][parallel][dbn][sgd]") {
+    using serial_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 50, dll::tanh>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    // Three stages of four micro-batches, the first dense layer and its
+    // activation are in the same stage
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 50, dll::tanh>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>, dll::pipeline_parallel<3>, dll::micro_batches<4>
+    >::dbn_t;
+
+    REQUIRE(dll::sgd_trainer<dbn_t>::stage_begin(1) == 2);
+    REQUIRE(dll::sgd_trainer<dbn_t>::stage_begin(2) == 3);
+
+    // Four full batches and an incomplete one
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(70);
+    std::vector<size_t> labels(samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    auto serial   = std::make_unique<serial_dbn_t>();
+    auto pipeline = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    serial->store(weights);
+    pipeline->load(weights);
+
+    serial->fine_tune(samples, labels, 3);
+    pipeline->fine_tune(samples, labels, 3);
+
+    auto& a = serial->template layer_get<0>().w;
+    auto& b = pipeline->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+
+    auto& c = serial->template layer_get<3>().w;
+    auto& d = pipeline->template layer_get<3>().w;
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(c[i] == Approx(d[i]).epsilon(1e-4));
+    }
+}
+
+// The columns of the dense layers are split in shards, with the same results
+TEST_CASE("unit/parallel/4", "[unit][parallel][dbn][sgd]") {
+    using serial_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 1000, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    // Uneven shards of the columns, with a sharded softmax
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu, dll::column_shards<3>>::layer_t,
+            dll::dense_layer_desc<100, 1000, dll::softmax, dll::column_shards<7>>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    REQUIRE(dll::column_shard_bounds(1000, 7, 0) == std::make_pair(size_t(0), size_t(144)));
+    REQUIRE(dll::column_shard_bounds(1000, 7, 6) == std::make_pair(size_t(864), size_t(1000)));
+
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(48);
+    std::vector<size_t> labels(samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = (i * 37) % 1000;
+    }
+
+    auto serial  = std::make_unique<serial_dbn_t>();
+    auto sharded = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    serial->store(weights);
+    sharded->load(weights);
+
+    etl::fast_dyn_matrix<float, 16, 28 * 28> batch;
+    batch = etl::normal_generator(0.0, 1.0);
+
+    auto output   = sharded->forward_batch(batch);
+    auto expected = serial->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+
+    serial->fine_tune(samples, labels, 3);
+    sharded->fine_tune(samples, labels, 3);
+
+    auto& a = serial->template layer_get<0>().w;
+    auto& b = sharded->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+
+    auto& c = serial->template layer_get<1>().w;
+    auto& d = sharded->template layer_get<1>().w;
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(c[i] == Approx(d[i]).epsilon(1e-4));
+    }
+}
+
+// Replicas trained in one process, each on its own shard
+TEST_CASE("unit/parallel/5", "[unit][parallel][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::updater<dll::updater_type::MOMENTUM>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(800);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto factory = [] {
+        auto dbn = std::make_unique<dbn_t>();
+        dbn->learning_rate = 0.05;
+        return dbn;
+    };
+
+    auto generators = [&dataset](const dll::shard& part) {
+        return dll::make_generator(dataset.training_images, dataset.training_labels, 10, part, dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical>{});
+    };
+
+    auto dbn = dll::replicated_fine_tune(factory, generators, 2, 25);
+
+    REQUIRE(!dbn->comm);
+
+    TEST_CHECK(0.3);
+
+    // Each sample is in the shard of exactly one replica
+    auto first  = dll::shard(0, 2).indices(800);
+    auto second = dll::shard(1, 2).indices(800);
+
+    REQUIRE(first.size() == 400);
+    REQUIRE(second.size() == 400);
+
+    std::vector<size_t> all(first);
+    all.insert(all.end(), second.begin(), second.end());
+    std::sort(all.begin(), all.end());
+
+    for (size_t i = 0; i < all.size(); ++i) {
+        REQUIRE(all[i] == i);
+    }
+}
@@ -5,8 +5,12 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdio>
 #include <deque>
 
+#include <dirent.h>
+#include <unistd.h>
+
 #include "cpp_utils/string.hpp"
 
 #include "dll_test.hpp"
@@ -204,6 +208,277 @@ TEST_CASE("unit/processor/dense/sgd/1", "[unit][dense][dbn][mnist][sgd][proc]")
     TEST_ERROR_BELOW(0.3);
 }
 
+// The cached binary is reused with other runtime parameters
+TEST_CASE("unit/processor/dense/sgd/cache", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt      = default_options();
+    opt.cache     = true;
+    opt.cache_dir = "/tmp/dllp_test_cache_" + std::to_string(getpid());
+
+    auto lines = get_result(opt, {"auto"}, "dense_sgd_cache.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(0.2);
+
+    // Only the epochs and the learning rate are different
+    lines = get_result(opt, {"auto"}, "dense_sgd_1.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+
+    // Both configurations used the same binary
+    size_t binaries = 0;
+
+    if (auto* dir = opendir(opt.cache_dir.c_str())) {
+        while (auto* entry = readdir(dir)) {
+            std::string name(entry->d_name);
+            binaries += name.size() > 4 && name.compare(name.size() - 4, 4, ".out") == 0;
+        }
+
+        closedir(dir);
+    }
+
+    REQUIRE(binaries == 1);
+}
+
+// Compiled with the release profile of the configuration
+TEST_CASE("unit/processor/dense/sgd/release", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"auto"}, "dense_sgd_release.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+// The dense network is run by the interpreter, without compilation
+TEST_CASE("unit/processor/dense/sgd/interpret", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt      = default_options();
+    opt.interpret = true;
+
+    for (auto* mode : {"release_debug", "release", "debug"}) {
+        auto program = std::string(mode) + "/bin/dllp_interpreter";
+
+        if (dll::cache::exists(program)) {
+            opt.interpreter = program;
+            break;
+        }
+    }
+
+    REQUIRE(!opt.interpreter.empty());
+
+    auto lines = get_result(opt, {"auto"}, "dense_sgd_1.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+// All the trials of the grid share the same program and the same samples
+TEST_CASE("unit/processor/dense/sgd/sweep", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt = default_options();
+    opt.jobs = 2;
+
+    REQUIRE(dll::processor::process_sweep(opt, {"auto"}, "test/processor/dense_sgd_1.conf", "test/processor/dense_sgd_sweep.grid") == 0);
+
+    for (size_t k = 0; k < 2; ++k) {
+        std::ifstream log(".dbn.sweep/trial-" + std::to_string(k) + ".log");
+
+        std::vector<std::string> lines;
+        std::string line;
+
+        while (std::getline(log, line)) {
+            lines.emplace_back(cpp::trim(line));
+        }
+
+        FT_ERROR_BELOW(5e-2);
+        TEST_ERROR_BELOW(0.3);
+    }
+}
+
+// The datasources are streamed from sharded binary datasets
+TEST_CASE("unit/processor/dense/sgd/binary", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_each(dataset.training_images);
+    mnist::normalize_each(dataset.test_images);
+
+    auto train = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        dll::inmemory_data_generator_desc<dll::batch_size<25>>{});
+
+    auto test = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        dll::inmemory_data_generator_desc<dll::batch_size<25>>{});
+
+    REQUIRE(dll::write_binary_dataset(*train, "/tmp/dllp_binary_train", 175).size() == 2);
+    REQUIRE(dll::write_binary_dataset(*test, "/tmp/dllp_binary_test").size() == 1);
+
+    auto lines = get_result(default_options(), {"auto"}, "dense_sgd_binary.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+// The profile reports the three phases of each layer
+TEST_CASE("unit/processor/dense/sgd/profile", "[unit][dense][dbn][mnist][sgd][proc]") {
+    std::remove("/tmp/dllp_profile.json");
+
+    auto lines = get_result(default_options(), {"auto"}, "dense_sgd_profile.conf");
+    REQUIRE(!lines.empty());
+
+    REQUIRE(std::find_if(lines.begin(), lines.end(), [](auto& line) { return starts_with(line, "Batch time (ms):"); }) != lines.end());
+
+    std::ifstream json("/tmp/dllp_profile.json");
+    REQUIRE(json.good());
+
+    std::string content((std::istreambuf_iterator<char>(json)), std::istreambuf_iterator<char>());
+
+    REQUIRE(content.find("\"batches\": 10") != std::string::npos);
+    REQUIRE(content.find("\"index\": 1") != std::string::npos);
+    REQUIRE(content.find("\"update\"") != std::string::npos);
+}
+
+// The requests of a stream are answered in order by the server
+TEST_CASE("unit/processor/serve/1", "[unit][dense][dbn][proc]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50, dll::relu>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(5);
+
+    for (auto& sample : samples) {
+        sample = etl::normal_generator(0.0, 1.0);
+    }
+
+    for (bool features : {false, true}) {
+        int requests[2];
+        int responses[2];
+
+        REQUIRE(pipe(requests) == 0);
+        REQUIRE(pipe(responses) == 0);
+
+        const uint32_t size = 28 * 28;
+
+        for (auto& sample : samples) {
+            REQUIRE(write(requests[1], &size, sizeof(size)) == sizeof(size));
+            REQUIRE(write(requests[1], sample.memory_start(), size * sizeof(float)) == ssize_t(size * sizeof(float)));
+        }
+
+        // An invalid request closes the stream
+        const uint32_t invalid = 12;
+        REQUIRE(write(requests[1], &invalid, sizeof(invalid)) == sizeof(invalid));
+
+        close(requests[1]);
+
+        auto executor = dbn->make_batching_executor(samples[0], 4);
+
+        REQUIRE(dll::processor::serve_stream(*executor, samples[0], requests[0], responses[1], features) == samples.size());
+
+        close(requests[0]);
+        close(responses[1]);
+
+        for (auto& sample : samples) {
+            uint32_t value;
+            REQUIRE(read(responses[0], &value, sizeof(value)) == sizeof(value));
+
+            if (features) {
+                REQUIRE(value == 10);
+
+                auto expected = dbn->forward_one(sample);
+
+                float output[10];
+                REQUIRE(read(responses[0], output, sizeof(output)) == sizeof(output));
+
+                for (size_t i = 0; i < 10; ++i) {
+                    REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+                }
+            } else {
+                REQUIRE(value == dbn->predict(sample));
+            }
+        }
+
+        uint32_t error;
+        REQUIRE(read(responses[0], &error, sizeof(error)) == sizeof(error));
+        REQUIRE(error == dll::processor::serve_error);
+
+        close(responses[0]);
+    }
+}
+
+// The fused preprocessing must match the steps applied one after another
+TEST_CASE("unit/processor/preprocess/1", "[unit][proc]") {
+    std::vector<etl::dyn_vector<float>> samples;
+
+    for (size_t i = 0; i < 50; ++i) {
+        samples.emplace_back(28 * 28);
+        samples.back() = etl::uniform_generator(0.0, 255.0);
+    }
+
+    auto expected = samples;
+
+    mnist::binarize_each(expected);
+    mnist::normalize_each(expected);
+
+    for (auto& vec : expected) {
+        for (auto& v : vec) {
+            v = (v + 0.5f) * 2.0f;
+        }
+    }
+
+    dll::processor::preprocessing steps;
+    steps.binarize  = true;
+    steps.normalize = true;
+    steps.shift     = 0.5f;
+    steps.scale     = 2.0f;
+
+    dll::processor::preprocess(samples, steps);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        for (size_t j = 0; j < etl::size(samples[i]); ++j) {
+            REQUIRE(samples[i][j] == Approx(expected[i][j]).epsilon(1e-4));
+        }
+    }
+}
+
+// The noise of a sample does not depend on the thread processing it
+TEST_CASE("unit/processor/preprocess/2", "[unit][proc]") {
+    std::vector<etl::dyn_vector<float>> samples;
+
+    for (size_t i = 0; i < 50; ++i) {
+        samples.emplace_back(28 * 28);
+        samples.back() = etl::uniform_generator(0.0, 255.0);
+    }
+
+    auto copy = samples;
+
+    dll::processor::preprocessing steps;
+    steps.noise        = true;
+    steps.noise_stddev = 0.1f;
+    steps.noise_key    = 42;
+
+    dll::processor::preprocess(samples, steps);
+
+    for (size_t i = 0; i < copy.size(); ++i) {
+        std::vector<float> noise;
+        dll::processor::preprocess_sample(copy[i].memory_start(), etl::size(copy[i]), steps, i, noise);
+
+        REQUIRE(etl::mean(samples[i]) == Approx(0.0).margin(1e-4));
+
+        for (size_t j = 0; j < etl::size(samples[i]); ++j) {
+            REQUIRE(samples[i][j] == copy[i][j]);
+        }
+    }
+}
+
 TEST_CASE("unit/processor/dense/sgd/2", "[unit][dense][dbn][mnist][sgd][proc]") {
     auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_2.conf");
     REQUIRE(!lines.empty());
@@ -0,0 +1,498 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+#include "dll/perf_watcher.hpp"
+#include "dll/util/health.hpp"
+#include "dll/util/roofline.hpp"
+#include "dll/util/trace.hpp"
+#include "dll/util/perf_counters.hpp"
+#include "dll/util/timers.hpp"
+
+// The timeline of the training nests the timers of the batches
+TEST_CASE("unit/profiling/1", "[unit][profiling][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dll::clear_trace();
+    dll::start_tracing();
+
+    dbn->fine_tune(dataset.train(), 2);
+
+    dll::stop_tracing();
+
+    REQUIRE(dll::export_trace("unit_profiling_trace.json"));
+
+    std::ifstream stream("unit_profiling_trace.json");
+    std::string trace((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    REQUIRE(trace.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(trace.find("\"name\": \"watcher:ft_epoch_end\"") != std::string::npos);
+
+#ifndef DLL_NO_TIMERS
+    REQUIRE(trace.find("\"name\": \"sgd::forward\"") != std::string::npos);
+
+    // Each forward pass is inside a training batch of the same thread
+    auto& buffer = dll::local_trace_buffer();
+
+    size_t forwards = 0;
+
+    for (size_t i = 0; i < buffer.size; ++i) {
+        if (std::string(buffer[i].name) == "sgd::forward") {
+            bool nested = false;
+
+            for (size_t j = 0; j < buffer.size; ++j) {
+                if (std::string(buffer[j].name) == "sgd::train_batch") {
+                    nested |= buffer[j].start <= buffer[i].start && buffer[i].start + buffer[i].duration <= buffer[j].start + buffer[j].duration;
+                }
+            }
+
+            REQUIRE(nested);
+            ++forwards;
+        }
+    }
+
+    REQUIRE(forwards > 0);
+#endif
+
+    dll::clear_trace();
+
+    std::remove("unit_profiling_trace.json");
+}
+
+// The sampled timers only time one invocation over the period
+TEST_CASE("unit/profiling/2", "[unit][profiling][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dll::reset_timers();
+    dll::set_timer_sampling(4);
+
+    dbn->fine_tune(dataset.train(), 4);
+
+#ifndef DLL_NO_TIMERS
+    REQUIRE(dll::timer_sampling() == 4);
+
+    // The 100 invocations of a call site are estimated from 25 timed ones
+    static dll::timer_id timer_handle("test:sampled");
+
+    for (size_t i = 0; i < 100; ++i) {
+        dll::auto_timer timer(timer_handle);
+    }
+
+    size_t batches = 0;
+
+    for (auto& timer : dll::get_timers().collect()) {
+        if (std::string(timer.name) == "test:sampled") {
+            REQUIRE(timer.count == 100);
+        }
+
+        if (std::string(timer.name) == "sgd::train_batch") {
+            batches = timer.count;
+        }
+    }
+
+    REQUIRE(batches == 40);
+#endif
+
+    dll::set_timer_sampling(1);
+    dll::reset_timers();
+
+    REQUIRE(dll::timer_sampling() == 1);
+}
+
+// The throughput of each epoch is split between the phases of the batches
+TEST_CASE("unit/profiling/3", "[unit][profiling][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::watcher<dll::perf_dbn_watcher>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(dataset.train(), 3);
+
+    auto& history = dll::perf_history();
+
+    REQUIRE(history.size() == 3);
+
+    for (size_t i = 0; i < history.size(); ++i) {
+        auto& epoch  = history[i];
+        auto& phases = epoch.phases;
+
+        REQUIRE(epoch.epoch == i);
+        REQUIRE(epoch.batches == 10);
+        REQUIRE(epoch.samples == 200);
+        REQUIRE(epoch.samples_per_second() > 0.0);
+
+        // The passes are measured inside the time of the trainer
+        REQUIRE(phases.forward > 0.0);
+        REQUIRE(phases.backward > 0.0);
+        REQUIRE(phases.update > 0.0);
+        REQUIRE(phases.forward + phases.backward + phases.update <= phases.compute * 1.0001);
+    }
+}
+
+// The health of the layers is sampled during the training
+TEST_CASE("unit/profiling/4", "[unit][profiling][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::updater<dll::updater_type::MOMENTUM>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dll::health_monitor monitor(2, 16);
+    dll::set_health_monitor(&monitor);
+
+    dbn->fine_tune(dataset.train(), 2);
+
+    dll::set_health_monitor(nullptr);
+
+    // 10 batches by epoch, one over two is checked
+    REQUIRE(monitor.batches == 20);
+    REQUIRE(monitor.layers.size() == 2);
+    REQUIRE(monitor.layers[0].checks == 10);
+    REQUIRE(monitor.layers[1].checks == 10);
+    REQUIRE(monitor.healthy());
+
+    REQUIRE(monitor.layers[0].activation_norm > 0.0);
+    REQUIRE(monitor.layers[0].gradient_norm > 0.0);
+    REQUIRE(monitor.layers[1].activation_norm > 0.0);
+
+    // A complete scan finds all the non-finite values
+    etl::fast_dyn_matrix<float, 4, 8> values(1.0f);
+    values(1, 3) = std::numeric_limits<float>::quiet_NaN();
+    values(2, 5) = std::numeric_limits<float>::infinity();
+
+    auto stats = dll::sample_stats(values, 1);
+
+    REQUIRE(stats.size == 32);
+    REQUIRE(stats.samples == 32);
+    REQUIRE(stats.nans == 1);
+    REQUIRE(stats.infs == 1);
+    REQUIRE(stats.norm() == Approx(std::sqrt(30.0)));
+    REQUIRE(!dll::sampled_finite(values, 1));
+
+    // The offset of the samples rotates until all the elements are read
+    size_t failures = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        auto sampled = dll::sample_stats(values, 16);
+        failures += sampled.nans + sampled.infs;
+    }
+
+    REQUIRE(failures == 2);
+}
+
+// The costs of the layers follow their shapes
+TEST_CASE("unit/profiling/5", "[unit][profiling][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto costs = dll::network_costs(*dbn);
+
+    REQUIRE(costs.size() == 2);
+
+    REQUIRE(costs[0].inputs == 28 * 28);
+    REQUIRE(costs[0].outputs == 100);
+    REQUIRE(costs[0].flops[0] == Approx(2.0 * 20 * 28 * 28 * 100));
+    REQUIRE(costs[0].bytes[0] == Approx(sizeof(float) * (20.0 * (28 * 28 + 100) + 28 * 28 * 100 + 100)));
+
+    REQUIRE(costs[1].inputs == 100);
+    REQUIRE(costs[1].flops[2] == Approx(2.0 * 20 * 100 * 10));
+
+    // The dense layers are compute bound on any machine with a ridge below one FLOP/byte
+    REQUIRE(costs[0].intensity(dll::profile_phase::FORWARD) > 1.0);
+}
+
+// The memory of the training is known before the training
+TEST_CASE("unit/profiling/6", "[unit][profiling][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    const size_t parameters = (28 * 28 * 100 + 100 + 100 * 10 + 10) * sizeof(float);
+    const size_t batches    = 20 * (28 * 28 + 3 * 100 + 2 * 10) * sizeof(float);
+
+    auto predicted = dbn->memory_report();
+
+    // Weights, gradients and increments of the momentum
+    REQUIRE(predicted.total() == 3 * parameters + batches);
+
+    // With Adam, the two moments replace the increments
+    REQUIRE(dbn->memory_report(20, dll::updater_type::ADAM).total() == 4 * parameters + batches);
+
+    // The contexts of the trainer hold everything but the weights
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    REQUIRE(trainer.memory_report().total() == predicted.total() - parameters);
+
+    auto generator = dll::generator_memory_report(dataset.train());
+
+    REQUIRE(generator.total() >= 200 * 28 * 28 * sizeof(float));
+}
+
+namespace {
+
+template <size_t B>
+using tuned_dbn_t = dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 50>::layer_t,
+        dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+    dll::batch_size<B>
+>::dbn_t;
+
+} // end of anonymous namespace
+
+// Tuning of the batch size and of the number of threads
+TEST_CASE("unit/profiling/7", "[unit][profiling][dbn][sgd]") {
+    etl::dyn_matrix<float, 2> inputs(64, 28 * 28);
+    etl::dyn_matrix<float, 2> labels(64, 10);
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 64; ++i) {
+        labels(i, i % 10) = 1.0;
+    }
+
+    auto results = dll::tune_throughput<tuned_dbn_t, 16, 32, 64>(inputs, labels, {1, 2}, 0, 0.02);
+
+    REQUIRE(results.points.size() == 6);
+    REQUIRE(results.best.fits);
+    REQUIRE(results.best.samples_per_second > 0.0);
+    REQUIRE(results.descriptor() == "dll::batch_size<" + std::to_string(results.best.batch_size) + ">");
+
+    // The batch sizes over the memory limit are not measured
+    const size_t limit = std::make_unique<tuned_dbn_t<16>>()->memory_report().total();
+
+    auto limited = dll::tune_throughput<tuned_dbn_t, 16, 64>(inputs, labels, {1}, limit, 0.02);
+
+    REQUIRE(limited.points.size() == 2);
+    REQUIRE(limited.points[0].fits);
+    REQUIRE(!limited.points[1].fits);
+    REQUIRE(limited.best.batch_size == 16);
+}
+
+#ifndef DLL_NO_TIMERS
+
+namespace {
+
+// Returns the collected value of the timer with the given name
+dll::timer_t collected_timer(const char* name) {
+    for (auto& timer : dll::get_timers().collect()) {
+        if (!std::strcmp(timer.name, name)) {
+            return timer;
+        }
+    }
+
+    return {};
+}
+
+} // end of anonymous namespace
+
+// The timers of the call sites and of the names, sharded by thread, count all the invocations
+TEST_CASE("unit/profiling/8", "[unit][profiling]") {
+    const size_t previous_period = dll::timer_sampling();
+    dll::set_timer_sampling(1);
+
+    static dll::timer_id handle("unit:profiling:8");
+
+    // The same name is the same timer, for the handles and for the names
+    REQUIRE(handle.id < dll::max_timers);
+    REQUIRE(dll::timer_id("unit:profiling:8").id == handle.id);
+    REQUIRE(dll::get_timers().find(std::string("unit:profiling:8").c_str()) == handle.id);
+
+    dll::reset_timers();
+
+    constexpr size_t threads     = 4;
+    constexpr size_t invocations = 1000;
+
+    auto run = [&]() {
+        std::vector<std::thread> workers;
+
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([t]() {
+                for (size_t i = 0; i < invocations; ++i) {
+                    if (t % 2) {
+                        dll::auto_timer timer(handle);
+                    } else {
+                        dll::auto_timer timer("unit:profiling:8");
+                    }
+                }
+            });
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    };
+
+    run();
+
+    // As many increments as with the former locked counters
+    auto timer = collected_timer("unit:profiling:8");
+
+    REQUIRE(timer.count == threads * invocations);
+    REQUIRE(timer.duration > 0);
+
+    // The shards of the finished threads are reused by the next ones
+    const size_t shards = dll::get_timers().shards.size();
+
+    run();
+
+    REQUIRE(dll::get_timers().shards.size() == shards);
+    REQUIRE(collected_timer("unit:profiling:8").count == 2 * threads * invocations);
+
+    // The reset clears the counters, but keeps the names of the handles
+    dll::reset_timers();
+
+    REQUIRE(collected_timer("unit:profiling:8").count == 0);
+    REQUIRE(dll::timer_id("unit:profiling:8").id == handle.id);
+
+    dll::set_timer_sampling(previous_period);
+}
+
+#endif
+
+namespace {
+
+// Returns the instructions retired by a loop of n iterations, measured with the given counters
+uint64_t loop_instructions(const dll::perf_counters& counters, size_t n) {
+    dll::perf_sample start;
+    dll::perf_sample end;
+
+    volatile size_t sink = 0;
+
+    counters.read(start);
+
+    for (size_t i = 0; i < n; ++i) {
+        sink = sink + i;
+    }
+
+    counters.read(end);
+
+    uint64_t counts[dll::perf_events];
+    dll::perf_counters::difference(start, end, counts);
+
+    return counts[size_t(dll::perf_event::INSTRUCTIONS)];
+}
+
+} // end of anonymous namespace
+
+// The hardware counters of the timers, scaled when the counters are multiplexed
+TEST_CASE("unit/profiling/9", "[unit][profiling]") {
+    dll::perf_sample start;
+    dll::perf_sample end;
+
+    start.values[0] = 100;
+    start.values[1] = 200;
+    start.values[2] = 10;
+    start.values[3] = 5;
+    start.enabled   = 1000;
+    start.running   = 1000;
+
+    end.values[0] = 1100;
+    end.values[1] = 2200;
+    end.values[2] = 20;
+    end.values[3] = 5;
+    end.enabled   = 3000;
+    end.running   = 3000;
+
+    uint64_t counts[dll::perf_events];
+
+    // Always counting, the counts are the differences
+    dll::perf_counters::difference(start, end, counts);
+
+    REQUIRE(counts[0] == 1000);
+    REQUIRE(counts[1] == 2000);
+    REQUIRE(counts[2] == 10);
+    REQUIRE(counts[3] == 0);
+
+    // Counting half of the time, the counts are extrapolated
+    end.running = 2000;
+
+    dll::perf_counters::difference(start, end, counts);
+
+    REQUIRE(counts[0] == 2000);
+    REQUIRE(counts[1] == 4000);
+    REQUIRE(counts[2] == 20);
+    REQUIRE(counts[3] == 0);
+
+    // The counters are often not allowed in containers
+    auto& counters = dll::local_perf_counters();
+
+    if (counters.available(dll::perf_event::INSTRUCTIONS)) {
+        // The instructions follow the work
+        REQUIRE(loop_instructions(counters, 400000) > 2 * loop_instructions(counters, 100000));
+
+#if !defined(DLL_NO_TIMERS) && defined(DLL_PERF_COUNTERS)
+        dll::reset_timers();
+        dll::set_timer_sampling(1);
+
+        {
+            dll::auto_timer timer("unit:profiling:9");
+            loop_instructions(counters, 100000);
+        }
+
+        REQUIRE(collected_timer("unit:profiling:9").counters[size_t(dll::perf_event::INSTRUCTIONS)] >= 100000);
+#endif
+    }
+}
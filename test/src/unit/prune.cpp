@@ -0,0 +1,40 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// Magnitude pruning and fine-tuning of the pruned network
+TEST_CASE("unit/prune/1", "[unit][prune][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200, dll::relu>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET(25, 5e-2);
+
+    REQUIRE(dbn->prune(0.9) == 2);
+
+    FT_CHECK_DATASET(10, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The pruned weights must have stayed to zero
+    auto& first = dbn->template layer_get<0>();
+    REQUIRE(etl::sum(*first.mask) == Approx(std::round(0.1 * 28 * 28 * 200)));
+    REQUIRE(etl::sum(etl::abs(first.w >> (1.0f - *first.mask))) == 0.0f);
+}
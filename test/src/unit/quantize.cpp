@@ -0,0 +1,71 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <deque>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// INT8 quantization of dense layers
+TEST_CASE("unit/quantize/1", "[unit][quantize]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 200, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.05;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    REQUIRE(net->quantize(dataset.train()) == 2);
+    REQUIRE(std::abs(net->evaluate_error(dataset.test()) - test_error) < 0.02);
+
+    net->clear_quantization();
+
+    REQUIRE(net->evaluate_error(dataset.test()) == Approx(test_error));
+}
+
+// INT8 quantization of convolutional and dense layers
+TEST_CASE("unit/quantize/2", "[unit][quantize]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 5, 5, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::mp_2d_layer_desc<8, 24, 24, 2, 2>::layer_t,
+            dll::conv_layer_desc<8, 12, 12, 8, 3, 3, dll::stride<2>, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<8 * 5 * 5, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.05;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    REQUIRE(net->quantize(dataset.train()) == 3);
+    REQUIRE(std::abs(net->evaluate_error(dataset.test()) - test_error) < 0.02);
+}
@@ -13,6 +13,7 @@
 #include "dll/rbm/conv_rbm.hpp"
 #include "dll/dbn.hpp"
 #include "dll/transform/random_layer.hpp"
+#include "dll/util/random_stream.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -73,3 +74,79 @@ TEST_CASE("unit/cdbn/random/mnist/2", "[cdbn][rectifier][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 1.0);
 }
+
+TEST_CASE("unit/random/stream/1", "[random][unit]") {
+    // The same key always generates the same numbers
+    dll::random_stream a(dll::stream_key(3));
+    dll::random_stream b(dll::stream_key(3));
+    dll::random_stream c(dll::stream_key(4));
+
+    etl::dyn_vector<float> x(1001);
+    etl::dyn_vector<float> y(1001);
+    etl::dyn_vector<float> z(1001);
+
+    dll::uniform_fill(x, a);
+    dll::uniform_fill(y, b);
+    dll::uniform_fill(z, c);
+
+    REQUIRE(etl::sum(etl::abs(x - y)) == 0.0f);
+    REQUIRE(etl::sum(etl::abs(x - z)) > 0.0f);
+
+    // A fill only depends on its position in the stream
+    dll::random_stream d(dll::stream_key(3));
+
+    auto first = d.reserve(1001);
+    dll::random_stream e(dll::stream_key(3), first + 100);
+
+    etl::dyn_vector<float> w(601);
+    dll::uniform_fill(w, e);
+
+    for (size_t i = 0; i < 601; ++i) {
+        REQUIRE(w[i] == x[400 + i]);
+    }
+}
+
+TEST_CASE("unit/random/stream/2", "[random][unit]") {
+    dll::random_stream stream(dll::stream_key(5));
+
+    etl::dyn_vector<float> u(10000);
+    etl::dyn_vector<float> n(10001);
+    etl::dyn_vector<float> b(10000);
+
+    dll::uniform_fill(u, stream, -1.0f, 1.0f);
+    dll::normal_fill(n, stream, 2.0f, 0.5f);
+    dll::bernoulli_fill(b, stream, 0.25f);
+
+    REQUIRE(etl::min(u) >= -1.0f);
+    REQUIRE(etl::max(u) < 1.0f);
+    REQUIRE(etl::mean(u) == Approx(0.0f).margin(0.05f));
+
+    REQUIRE(etl::mean(n) == Approx(2.0f).margin(0.05f));
+    REQUIRE(etl::stddev(n) == Approx(0.5f).margin(0.05f));
+
+    REQUIRE(etl::sum(b) == Approx(2500.0f).margin(200.0f));
+    REQUIRE(etl::sum(b * (1.0f - b)) == 0.0f);
+}
+
+TEST_CASE("unit/random/stream/3", "[random][unit]") {
+    // The parallel fills generate the numbers of the serial fills
+    const size_t n = 3 * dll::detail::fill_chunk + 1001;
+
+    etl::dyn_vector<float> x(n);
+    etl::dyn_vector<float> y(n);
+
+    dll::random_stream a(dll::stream_key(6));
+    dll::normal_fill(x, a, 1.0f, 0.1f);
+    dll::parallel_normal_fill(y.memory_start(), n, dll::stream_key(6), 1.0f, 0.1f);
+
+    REQUIRE(etl::sum(etl::abs(x - y)) == 0.0f);
+    REQUIRE(etl::mean(y) == Approx(1.0f).margin(0.01f));
+
+    dll::random_stream b(dll::stream_key(7));
+    dll::uniform_fill(x, b, -0.5f, 0.5f);
+    dll::parallel_uniform_fill(y.memory_start(), n, dll::stream_key(7), -0.5f, 0.5f);
+
+    REQUIRE(etl::sum(etl::abs(x - y)) == 0.0f);
+    REQUIRE(etl::min(y) >= -0.5f);
+    REQUIRE(etl::max(y) < 0.5f);
+}
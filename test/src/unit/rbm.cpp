@@ -212,3 +212,243 @@ TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+TEST_CASE("unit/rbm/mnist/11", "[rbm][parallel][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<20>,
+        dll::momentum,
+        dll::data_parallel<4>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/12", "[rbm][pcd][parallel][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::data_parallel<2>,
+        dll::trainer_rbm<dll::pcd1_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/13", "[rbm][pt][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::trainer_rbm<dll::pt_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+// The fused activation and sampling pass
+TEST_CASE("unit/rbm/gibbs/1", "[rbm][unit]") {
+    etl::fast_matrix<float, 200, 4, 3, 3> a;
+    etl::fast_matrix<float, 200, 4, 3, 3> s;
+    etl::fast_vector<float, 4> b({-2.0f, -0.5f, 0.5f, 2.0f});
+
+    a = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_matrix<float, 200, 4, 3, 3> x(a);
+
+    dll::sigmoid_bernoulli(a, s, b);
+
+    for (size_t i = 0; i < 200; ++i) {
+        for (size_t k = 0; k < 4; ++k) {
+            for (size_t j = 0; j < 9; ++j) {
+                const float p = 1.0f / (1.0f + std::exp(-(x(i, k)[j] + b[k])));
+
+                REQUIRE(a(i, k)[j] == Approx(p).epsilon(1e-5));
+                REQUIRE((s(i, k)[j] == 0.0f || s(i, k)[j] == 1.0f));
+            }
+        }
+    }
+
+    // The samples follow the probabilities
+    REQUIRE(etl::mean(s) == Approx(etl::mean(a)).epsilon(0.05));
+
+    // Each pass uses a new random stream
+    etl::fast_matrix<float, 200, 4, 3, 3> s2;
+    dll::bernoulli_sample(s2, a);
+
+    REQUIRE(s2 != s);
+}
+
+TEST_CASE("unit/rbm/mnist/14", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::monitor_every<3>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error > 0.0);
+    REQUIRE(error < 1e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/15", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::sparse_input>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/16", "[rbm][unit]") {
+    dll::dyn_rbm_desc<
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::sparse_input>::layer_t rbm(28 * 28, 100);
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+}
+
+// The last batch is incomplete, only its samples are trained
+TEST_CASE("unit/rbm/mnist/17", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<16>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(105);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+
+    auto rec_error = rbm.reconstruction_error(dataset.training_images[104]);
+
+    REQUIRE(rec_error < 5e-2);
+}
+
+// The sigmoid of the binary units is approximated
+TEST_CASE("unit/rbm/mnist/18", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::activation_precision<dll::function_precision::FAST>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+}
+
+// The fused pass computes the statistics of the separate passes
+TEST_CASE("unit/rbm/sparsity/1", "[rbm][unit]") {
+    using rbm_t = dll::rbm_desc<9, 12, dll::batch_size<7>>::layer_t;
+
+    etl::fast_matrix<float, 7, 12> h1;
+    etl::fast_matrix<float, 7, 12> h2;
+
+    h1 = etl::uniform_generator(0.0, 1.0);
+    h2 = etl::uniform_generator(0.0, 1.0);
+
+    etl::fast_vector<float, 12> b_grad;
+    etl::fast_vector<float, 12> h_sum;
+
+    // An incomplete batch
+    for (size_t n : {7UL, 5UL}) {
+        auto a1 = etl::slice(h1, 0, n);
+        auto a2 = etl::slice(h2, 0, n);
+
+        dll::hidden_statistics(a1, a2, b_grad, h_sum);
+
+        etl::fast_vector<float, 12> b_ref;
+        etl::fast_vector<float, 12> q_local_ref;
+
+        b_ref       = etl::sum_l(a1 - a2);
+        q_local_ref = etl::mean_l(a2);
+
+        for (size_t i = 0; i < 12; ++i) {
+            REQUIRE(b_grad[i] == Approx(b_ref[i]).epsilon(1e-5).margin(1e-5));
+            REQUIRE(h_sum[i] / float(n) == Approx(q_local_ref[i]).epsilon(1e-5));
+        }
+
+        REQUIRE(etl::sum(h_sum) / (n * etl::size(h_sum)) == Approx(etl::mean(a2)).epsilon(1e-5));
+    }
+
+    // The local penalty of a hidden unit applies to all its weights
+    rbm_t rbm;
+    dll::base_trainer<rbm_t> trainer;
+
+    etl::fast_matrix<float, 9, 12> w_grad;
+    etl::fast_vector<float, 12> penalty;
+
+    w_grad  = etl::normal_generator(0.0, 1.0);
+    penalty = etl::normal_generator(0.0, 1.0);
+    rbm.w   = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_matrix<float, 9, 12> w_ref;
+    w_ref = w_grad - rbm.l2_weight_cost * rbm.w;
+
+    for (size_t i = 0; i < 12; ++i) {
+        for (size_t j = 0; j < 9; ++j) {
+            w_ref(j, i) -= penalty(i);
+        }
+    }
+
+    trainer.update_grad<dll::decay_type::L2>(w_grad, rbm.w, rbm, etl::rep_l(penalty, 9));
+
+    for (size_t i = 0; i < etl::size(w_grad); ++i) {
+        REQUIRE(w_grad[i] == Approx(w_ref[i]).epsilon(1e-5).margin(1e-5));
+    }
+}
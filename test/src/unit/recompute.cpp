@@ -0,0 +1,171 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/activation_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+// Copy the weights of every layer of a network into another one
+template <typename To, typename From, size_t... I>
+void copy_weights(To& to, const From& from, std::index_sequence<I...> /*seq*/) {
+    ((to.template layer_get<I>().w = from.template layer_get<I>().w, to.template layer_get<I>().b = from.template layer_get<I>().b), ...);
+}
+
+// Check that every weight of two networks is the same
+template <typename A, typename B, size_t... I>
+void check_weights(const A& a, const B& b, std::index_sequence<I...> /*seq*/) {
+    auto check = [](const auto& x, const auto& y) {
+        for (size_t i = 0; i < etl::size(x); ++i) {
+            REQUIRE(x[i] == Approx(y[i]).epsilon(1e-4));
+        }
+    };
+
+    ((check(a.template layer_get<I>().w, b.template layer_get<I>().w), check(a.template layer_get<I>().b, b.template layer_get<I>().b)), ...);
+}
+
+} // end of anonymous namespace
+
+// The activations of a dense chain are recomputed between the checkpoints
+TEST_CASE("unit/recompute/1", "[unit][recompute][dbn][mnist][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 100>::layer_t,
+        dll::dense_layer_desc<100, 100>::layer_t,
+        dll::dense_layer_desc<100, 100>::layer_t,
+        dll::dense_layer_desc<100, 100>::layer_t,
+        dll::dense_layer_desc<100, 50>::layer_t,
+        dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>;
+
+    using plain_t     = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t;
+    using recompute_t = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>, dll::recompute_activations<3>>::dbn_t;
+
+    // The checkpoints are the layers 0, 2 and 5
+    REQUIRE(!dll::sgd_is_recomputed<recompute_t, 0>());
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 1>());
+    REQUIRE(!dll::sgd_is_recomputed<recompute_t, 2>());
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 3>());
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 4>());
+    REQUIRE(!dll::sgd_is_recomputed<recompute_t, 5>());
+
+    // Only the first segment is recomputed, the last one is still intact
+    REQUIRE(dll::sgd_recomputes_segment<recompute_t, 2>());
+    REQUIRE(!dll::sgd_recomputes_segment<recompute_t, 5>());
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 250, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto plain     = std::make_unique<plain_t>();
+    auto recompute = std::make_unique<recompute_t>();
+
+    copy_weights(*recompute, *plain, std::make_index_sequence<6>());
+
+    // The layers 1 and 4 share 200 values by sample, the layer 3 has its own 200 values
+    REQUIRE(dll::sgd_trainer<recompute_t>(*recompute).memory_report().total() == dll::sgd_trainer<plain_t>(*plain).memory_report().total() - 20 * 150 * sizeof(float));
+
+    // The gradients are the same, computed from the recomputed activations
+    auto plain_error     = plain->fine_tune(dataset.train(), 5);
+    auto recompute_error = recompute->fine_tune(dataset.train(), 5);
+
+    REQUIRE(recompute_error == Approx(plain_error));
+
+    check_weights(*recompute, *plain, std::make_index_sequence<6>());
+}
+
+// The activations of a convolutional chain are recomputed between the checkpoints
+TEST_CASE("unit/recompute/2", "[unit][recompute][dbn][mnist][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::conv_layer_desc<1, 28, 28, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+        dll::conv_layer_desc<4, 26, 26, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+        dll::conv_layer_desc<4, 24, 24, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+        dll::conv_layer_desc<4, 22, 22, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+        dll::conv_layer_desc<4, 20, 20, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+        dll::conv_layer_desc<4, 18, 18, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+        dll::dense_layer_desc<4 * 16 * 16, 10, dll::softmax>::layer_t>;
+
+    using plain_t     = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t;
+    using recompute_t = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>, dll::recompute_activations<2>>::dbn_t;
+
+    // The checkpoints are the layers 0, 1, 3, 5 and 6
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 2>());
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 4>());
+    REQUIRE(!dll::sgd_is_recomputed<recompute_t, 3>());
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 100, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto plain     = std::make_unique<plain_t>();
+    auto recompute = std::make_unique<recompute_t>();
+
+    plain->learning_rate     = 0.05;
+    recompute->learning_rate = 0.05;
+
+    copy_weights(*recompute, *plain, std::make_index_sequence<7>());
+
+    // The layer 4 reuses the memory of the layer 2
+    REQUIRE(dll::sgd_trainer<recompute_t>(*recompute).memory_report().total() == dll::sgd_trainer<plain_t>(*plain).memory_report().total() - 10 * 4 * (20 * 20 + 18 * 18) * sizeof(float));
+
+    auto plain_error     = plain->fine_tune(dataset.train(), 3);
+    auto recompute_error = recompute->fine_tune(dataset.train(), 3);
+
+    REQUIRE(recompute_error == Approx(plain_error));
+
+    check_weights(*recompute, *plain, std::make_index_sequence<7>());
+}
+
+// A dense layer fused with its activation layer is recomputed without the
+// fusion, the activation layer being a checkpoint
+TEST_CASE("unit/recompute/3", "[unit][recompute][dbn][mnist][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+        dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+        dll::dense_layer_desc<100, 100, dll::no_activation>::layer_t,
+        dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+        dll::dense_layer_desc<100, 100>::layer_t,
+        dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>;
+
+    using plain_t     = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t;
+    using recompute_t = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>, dll::recompute_activations<2>>::dbn_t;
+
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 2>());
+    REQUIRE(!dll::sgd_is_recomputed<recompute_t, 3>());
+    REQUIRE(dll::sgd_is_recomputed<recompute_t, 4>());
+    REQUIRE(dll::sgd_recomputes_segment<recompute_t, 3>());
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto plain     = std::make_unique<plain_t>();
+    auto recompute = std::make_unique<recompute_t>();
+
+    auto copy = [](auto& to, const auto& from) {
+        to.w = from.w;
+        to.b = from.b;
+    };
+
+    copy(recompute->layer_get<0>(), plain->layer_get<0>());
+    copy(recompute->layer_get<2>(), plain->layer_get<2>());
+    copy(recompute->layer_get<4>(), plain->layer_get<4>());
+    copy(recompute->layer_get<5>(), plain->layer_get<5>());
+
+    auto plain_error     = plain->fine_tune(dataset.train(), 5);
+    auto recompute_error = recompute->fine_tune(dataset.train(), 5);
+
+    REQUIRE(recompute_error == Approx(plain_error));
+
+    for (size_t i = 0; i < etl::size(plain->layer_get<2>().w); ++i) {
+        REQUIRE(recompute->layer_get<2>().w[i] == Approx(plain->layer_get<2>().w[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(plain->layer_get<4>().w); ++i) {
+        REQUIRE(recompute->layer_get<4>().w[i] == Approx(plain->layer_get<4>().w[i]).epsilon(1e-4));
+    }
+}
@@ -5,6 +5,10 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cmath>
+#include <thread>
+#include <vector>
+
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
@@ -12,6 +16,160 @@
 #include "dll/neural/recurrent_last_layer.hpp"
 #include "dll/network.hpp"
 #include "dll/datasets.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace {
+
+// Compare the fused BPTT with the previous BPTT, one step at a time, which
+// recomputes the errors of the states for each truncated window
+template <typename Layer>
+void check_bptt() {
+    constexpr size_t T = Layer::time_steps;
+    constexpr size_t S = Layer::sequence_length;
+    constexpr size_t H = Layer::hidden_units;
+    constexpr size_t B = 4;
+
+    constexpr size_t last_step = Layer::bptt_steps < T ? T - Layer::bptt_steps : 0;
+    constexpr bool last_only   = Layer::desc::parameters::template contains<dll::last_only>();
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            Layer,
+            dll::recurrent_last_layer<T, H>,
+            dll::dense_layer<H, 3, dll::softmax>
+        >
+        , dll::batch_size<B>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    auto& layer = net->template layer_get<0>();
+
+    dll::full_sgd_context<network_t, Layer, 0> context(layer);
+
+    context.input  = etl::normal_generator(0.0, 1.0);
+    context.errors = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, B, T, S> input_errors;
+
+    layer.forward_batch(context.output, context.input, context.workspace);
+    layer.backward_batch(input_errors, context);
+
+    // The reference forward pass
+
+    etl::dyn_matrix<double, 3> s(T, B, H);
+
+    for (size_t t = 0; t < T; ++t) {
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t j = 0; j < H; ++j) {
+                double z = layer.b(j);
+
+                for (size_t k = 0; k < S; ++k) {
+                    z += context.input(b, t, k) * layer.u(k, j);
+                }
+
+                for (size_t k = 0; t > 0 && k < H; ++k) {
+                    z += s(t - 1, b, k) * layer.w(k, j);
+                }
+
+                s(t, b, j) = std::tanh(z);
+
+                REQUIRE(context.output(b, t, j) == Approx(s(t, b, j)).epsilon(1e-4).margin(1e-5));
+            }
+        }
+    }
+
+    // The reference backward pass
+
+    etl::dyn_matrix<double, 3> d_h(T, B, H);
+    etl::dyn_matrix<double, 3> d_x(T, B, S);
+    etl::dyn_matrix<double, 2> w_grad(H, H);
+    etl::dyn_matrix<double, 2> u_grad(S, H);
+    etl::dyn_matrix<double, 1> b_grad(H);
+
+    d_h    = 0.0;
+    d_x    = 0.0;
+    w_grad = 0.0;
+    u_grad = 0.0;
+    b_grad = 0.0;
+
+    size_t ttt = T - 1;
+
+    do {
+        for (size_t tt = ttt + 1; tt > last_step; --tt) {
+            const size_t t = tt - 1;
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t j = 0; j < H; ++j) {
+                    double e = context.errors(b, t, j);
+
+                    if (t < T - 1) {
+                        e += d_h(t + 1, b, j);
+                    }
+
+                    d_h(t, b, j) = e * (1.0 - s(t, b, j) * s(t, b, j));
+                }
+
+                for (size_t j = 0; j < H; ++j) {
+                    b_grad(j) += d_h(t, b, j);
+
+                    for (size_t k = 0; k < S; ++k) {
+                        u_grad(k, j) += context.input(b, t, k) * d_h(t, b, j);
+                    }
+
+                    for (size_t k = 0; t > 0 && k < H; ++k) {
+                        w_grad(k, j) += s(t - 1, b, k) * d_h(t, b, j);
+                    }
+                }
+
+                for (size_t k = 0; k < S; ++k) {
+                    double e = 0.0;
+
+                    for (size_t j = 0; j < H; ++j) {
+                        e += d_h(t, b, j) * layer.u(k, j);
+                    }
+
+                    d_x(t, b, k) = e;
+                }
+
+                // Update for the next steps
+                std::vector<double> next(H, 0.0);
+
+                for (size_t k = 0; k < H; ++k) {
+                    for (size_t j = 0; j < H; ++j) {
+                        next[k] += d_h(t, b, j) * layer.w(k, j);
+                    }
+                }
+
+                for (size_t k = 0; k < H; ++k) {
+                    d_h(t, b, k) = next[k];
+                }
+            }
+        }
+
+        --ttt;
+    } while (!last_only && ttt != 0);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t t = 0; t < T; ++t) {
+            for (size_t k = 0; k < S; ++k) {
+                REQUIRE(input_errors(b, t, k) == Approx(d_x(t, b, k)).epsilon(1e-3).margin(1e-4));
+            }
+        }
+    }
+
+    auto check = [](const auto& x, const auto& y) {
+        for (size_t i = 0; i < etl::size(x); ++i) {
+            REQUIRE(x[i] == Approx(y[i]).epsilon(1e-3).margin(1e-4));
+        }
+    };
+
+    check(std::get<0>(context.up.context)->grad, w_grad);
+    check(std::get<1>(context.up.context)->grad, u_grad);
+    check(std::get<2>(context.up.context)->grad, b_grad);
+}
+
+} // end of anonymous namespace
 
 // Simple RNN
 TEST_CASE("unit/rnn/1", "[unit][rnn]") {
@@ -85,3 +243,423 @@ TEST_CASE("unit/rnn/3", "[unit][rnn]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Streaming inference, one time step at a time
+TEST_CASE("unit/rnn/4", "[unit][rnn][stream]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 9;
+    constexpr size_t streams         = 3;
+
+    dll::rnn_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::dyn_matrix<float, 3> x(streams, time_steps, sequence_length);
+    etl::dyn_matrix<float, 3> y(streams, time_steps, hidden_units);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    layer.forward_batch(y, x);
+
+    auto state = layer.make_stream_state(streams);
+
+    etl::dyn_matrix<float, 2> frame(streams, sequence_length);
+    etl::dyn_matrix<float, 2> out(streams, hidden_units);
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        for (size_t k = 0; k < streams; ++k) {
+            frame(k) = x(k)(t);
+        }
+
+        layer.step_batch(out, frame, state);
+
+        for (size_t k = 0; k < streams; ++k) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                REQUIRE(out(k, j) == Approx(y(k, t, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    // A reset stream starts again from the first time step
+    state.reset(1);
+
+    frame(1) = x(1)(0);
+
+    layer.step_batch(out, frame, state);
+
+    for (size_t j = 0; j < hidden_units; ++j) {
+        REQUIRE(out(1, j) == Approx(y(1, 0, j)).epsilon(1e-4));
+    }
+}
+
+// Variable-length sequences
+TEST_CASE("unit/rnn/5", "[unit][rnn][mask]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 5;
+    constexpr size_t batch           = 4;
+
+    dll::rnn_layer<time_steps, sequence_length, hidden_units> layer;
+    dll::recurrent_last_layer<time_steps, hidden_units> last;
+
+    etl::dyn_matrix<float, 3> x(batch, time_steps, sequence_length);
+    etl::dyn_matrix<float, 3> y(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 3> y_masked(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 2> y_last(batch, hidden_units);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    layer.forward_batch(y, x);
+
+    dll::rnn_forward_workspace<float> ws;
+    ws.mask.lengths = {3, 6, 1, 4};
+
+    layer.forward_batch(y_masked, x, ws);
+
+    dll::sequence_workspace last_ws;
+    last_ws.mask.lengths = ws.mask.lengths;
+
+    last.forward_batch(y_last, y_masked, last_ws);
+
+    for (size_t b = 0; b < batch; ++b) {
+        const size_t length = ws.mask.lengths[b];
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                if (t < length) {
+                    REQUIRE(y_masked(b, t, j) == Approx(y(b, t, j)).epsilon(1e-4));
+                } else {
+                    REQUIRE(y_masked(b, t, j) == 0.0f);
+                }
+            }
+        }
+
+        for (size_t j = 0; j < hidden_units; ++j) {
+            REQUIRE(y_last(b, j) == Approx(y(b, length - 1, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// Time-major stack of RNN layers
+TEST_CASE("unit/rnn/6", "[unit][rnn][mask]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 5;
+    constexpr size_t batch           = 4;
+
+    dll::rnn_layer<time_steps, sequence_length, hidden_units> first;
+    dll::rnn_layer<time_steps, hidden_units, hidden_units> second;
+    dll::recurrent_last_layer<time_steps, hidden_units> last;
+
+    dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::time_major_output> tm_first;
+    dll::rnn_layer<time_steps, hidden_units, hidden_units, dll::time_major_input, dll::time_major_output> tm_second;
+    dll::recurrent_last_layer<time_steps, hidden_units, dll::time_major_input> tm_last;
+
+    tm_first.w  = first.w;
+    tm_first.u  = first.u;
+    tm_first.b  = first.b;
+    tm_second.w = second.w;
+    tm_second.u = second.u;
+    tm_second.b = second.b;
+
+    etl::dyn_matrix<float, 3> x(batch, time_steps, sequence_length);
+    etl::dyn_matrix<float, 3> h1(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 3> h2(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 2> y(batch, hidden_units);
+    etl::dyn_matrix<float, 3> tm_h1(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 3> tm_h2(batch, time_steps, hidden_units);
+    etl::dyn_matrix<float, 2> tm_y(batch, hidden_units);
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    const std::vector<size_t> lengths = {3, 6, 1, 4};
+
+    dll::rnn_forward_workspace<float> ws1;
+    dll::rnn_forward_workspace<float> ws2;
+    dll::sequence_workspace last_ws;
+
+    ws1.mask.lengths     = lengths;
+    ws2.mask.lengths     = lengths;
+    last_ws.mask.lengths = lengths;
+
+    first.forward_batch(h1, x, ws1);
+    second.forward_batch(h2, h1, ws2);
+    last.forward_batch(y, h2, last_ws);
+
+    dll::rnn_forward_workspace<float> tm_ws1;
+    dll::rnn_forward_workspace<float> tm_ws2;
+    dll::sequence_workspace tm_last_ws;
+
+    tm_ws1.mask.lengths     = lengths;
+    tm_ws2.mask.lengths     = lengths;
+    tm_last_ws.mask.lengths = lengths;
+
+    tm_first.forward_batch(tm_h1, x, tm_ws1);
+    tm_second.forward_batch(tm_h2, tm_h1, tm_ws2);
+    tm_last.forward_batch(tm_y, tm_h2, tm_last_ws);
+
+    // Each step holds the samples sorted by decreasing length
+    const std::vector<size_t> order = {1, 3, 0, 2};
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        for (size_t r = 0; r < batch; ++r) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                const float value = tm_h2.memory_start()[(t * batch + r) * hidden_units + j];
+
+                if (t < lengths[order[r]]) {
+                    REQUIRE(value == Approx(h2(order[r], t, j)).epsilon(1e-4));
+                } else {
+                    REQUIRE(value == 0.0f);
+                }
+            }
+        }
+    }
+
+    for (size_t b = 0; b < batch; ++b) {
+        for (size_t j = 0; j < hidden_units; ++j) {
+            REQUIRE(tm_y(b, j) == Approx(y(b, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// Stacked RNN exchanging time-major batches
+TEST_CASE("unit/rnn/7", "[unit][rnn]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 2000, dll::batch_size<100>{}, dll::scale_pre<255>{});
+
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 75;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::time_major_output>,
+            dll::rnn_layer<time_steps, hidden_units, hidden_units, dll::last_only, dll::time_major_input, dll::time_major_output>,
+            dll::recurrent_last_layer<time_steps, hidden_units, dll::time_major_input>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<100>                       // The mini-batch size
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(dataset.train(), 30) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
+
+// Wavefront inference of stacked RNN layers
+TEST_CASE("unit/rnn/8", "[unit][rnn]") {
+    constexpr size_t time_steps      = 7;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 6;
+    constexpr size_t batch           = 5;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units>,
+            dll::rnn_layer<time_steps, hidden_units, hidden_units>,
+            dll::rnn_layer<time_steps, hidden_units, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>
+        >
+        , dll::batch_size<batch>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> x;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h1;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h2;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h3;
+    etl::fast_dyn_matrix<float, batch, hidden_units> y;
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    // One layer after the other
+    net->template layer_get<0>().test_forward_batch(h1, x);
+    net->template layer_get<1>().test_forward_batch(h2, h1);
+    net->template layer_get<2>().test_forward_batch(h3, h2);
+    net->template layer_get<3>().test_forward_batch(y, h3);
+
+    auto mode = dll::get_branch_mode();
+
+    dll::set_branch_mode(dll::branch_mode::SERIAL);
+
+    auto serial = net->forward_batch(x);
+
+    dll::set_branch_mode(dll::branch_mode::PARALLEL);
+
+    auto parallel = net->forward_batch(x);
+
+    dll::set_branch_mode(mode);
+
+    for (size_t b = 0; b < batch; ++b) {
+        for (size_t j = 0; j < hidden_units; ++j) {
+            REQUIRE(serial(b, j) == Approx(y(b, j)).epsilon(1e-4));
+            REQUIRE(parallel(b, j) == Approx(y(b, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// Inference of only the last time step
+TEST_CASE("unit/rnn/9", "[unit][rnn]") {
+    constexpr size_t time_steps      = 7;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 6;
+    constexpr size_t batch           = 5;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 3, dll::softmax>
+        >
+        , dll::batch_size<batch>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> x;
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h;
+    etl::fast_dyn_matrix<float, batch, hidden_units> last;
+    etl::fast_dyn_matrix<float, batch, 3> y;
+
+    x = etl::normal_generator(0.0, 1.0);
+
+    // With all the time steps
+    net->template layer_get<0>().test_forward_batch(h, x);
+    net->template layer_get<1>().test_forward_batch(last, h);
+    net->template layer_get<2>().test_forward_batch(y, last);
+
+    auto features = net->template forward_batch<1>(x);
+    auto output   = net->forward_batch(x);
+
+    for (size_t b = 0; b < batch; ++b) {
+        for (size_t j = 0; j < hidden_units; ++j) {
+            REQUIRE(features(b, j) == Approx(last(b, j)).epsilon(1e-4));
+        }
+
+        for (size_t j = 0; j < 3; ++j) {
+            REQUIRE(output(b, j) == Approx(y(b, j)).epsilon(1e-4));
+        }
+    }
+}
+
+// Each training context has its own caches, the forward passes of other
+// contexts and of inference between the forward and backward passes of a
+// context do not change its gradients
+TEST_CASE("unit/rnn/10", "[unit][rnn]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 3;
+    constexpr size_t batch           = 4;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 3, dll::softmax>
+        >
+        , dll::batch_size<batch>
+    >::network_t;
+
+    using layer_t   = network_t::layer_type<0>;
+    using context_t = dll::full_sgd_context<network_t, layer_t, 0>;
+
+    auto net = std::make_unique<network_t>();
+
+    auto& layer = net->template layer_get<0>();
+
+    context_t a(layer);
+    context_t b(layer);
+    context_t ref(layer);
+
+    a.input  = etl::normal_generator(0.0, 1.0);
+    a.errors = etl::normal_generator(0.0, 1.0);
+    b.input  = etl::normal_generator(0.0, 1.0);
+
+    ref.input  = a.input;
+    ref.errors = a.errors;
+
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> a_errors;
+    etl::fast_dyn_matrix<float, batch, time_steps, sequence_length> ref_errors;
+
+    // The reference is forwarded and backwarded alone
+    layer.forward_batch(ref.output, ref.input, ref.workspace);
+    layer.backward_batch(ref_errors, ref);
+
+    layer.forward_batch(a.output, a.input, a.workspace);
+    layer.forward_batch(b.output, b.input, b.workspace);
+
+    etl::fast_dyn_matrix<float, batch, time_steps, hidden_units> h;
+    layer.test_forward_batch(h, b.input);
+
+    layer.backward_batch(a_errors, a);
+
+    for (size_t i = 0; i < etl::size(a.output); ++i) {
+        REQUIRE(a.output[i] == Approx(ref.output[i]));
+        REQUIRE(b.output[i] == Approx(h[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(a_errors); ++i) {
+        REQUIRE(a_errors[i] == Approx(ref_errors[i]));
+    }
+
+    auto check = [](const auto& x, const auto& y) {
+        for (size_t i = 0; i < etl::size(x); ++i) {
+            REQUIRE(x[i] == Approx(y[i]));
+        }
+    };
+
+    check(std::get<0>(a.up.context)->grad, std::get<0>(ref.up.context)->grad);
+    check(std::get<1>(a.up.context)->grad, std::get<1>(ref.up.context)->grad);
+    check(std::get<2>(a.up.context)->grad, std::get<2>(ref.up.context)->grad);
+}
+
+// Concurrent inference on the same layer
+TEST_CASE("unit/rnn/11", "[unit][rnn]") {
+    constexpr size_t time_steps      = 7;
+    constexpr size_t sequence_length = 4;
+    constexpr size_t hidden_units    = 6;
+    constexpr size_t batch           = 5;
+    constexpr size_t threads         = 4;
+
+    using layer_t = dll::rnn_layer<time_steps, sequence_length, hidden_units>;
+
+    layer_t layer;
+
+    std::vector<etl::fast_dyn_matrix<float, batch, time_steps, sequence_length>> x(threads);
+    std::vector<etl::fast_dyn_matrix<float, batch, time_steps, hidden_units>> serial(threads);
+    std::vector<etl::fast_dyn_matrix<float, batch, time_steps, hidden_units>> concurrent(threads);
+
+    for (size_t t = 0; t < threads; ++t) {
+        x[t] = etl::normal_generator(0.0, 1.0);
+        layer.test_forward_batch(serial[t], x[t]);
+    }
+
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for (size_t i = 0; i < 20; ++i) {
+                layer.test_forward_batch(concurrent[t], x[t]);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t t = 0; t < threads; ++t) {
+        for (size_t i = 0; i < etl::size(serial[t]); ++i) {
+            REQUIRE(concurrent[t][i] == Approx(serial[t][i]));
+        }
+    }
+}
+
+// The fused recurrence computes the gradients of the step by step BPTT
+TEST_CASE("unit/rnn/12", "[unit][rnn]") {
+    check_bptt<dll::rnn_layer<5, 4, 3>>();
+    check_bptt<dll::rnn_layer<5, 4, 3, dll::last_only>>();
+    check_bptt<dll::rnn_layer<6, 4, 3, dll::truncate<3>>>();
+    check_bptt<dll::rnn_layer<6, 4, 3, dll::last_only, dll::truncate<3>>>();
+}
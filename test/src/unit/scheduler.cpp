@@ -0,0 +1,100 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <atomic>
+
+#include "dll_test.hpp"
+
+#include "dll/util/scheduler.hpp"
+#include "dll/util/parallel.hpp"
+
+TEST_CASE("unit/scheduler/cpus", "[scheduler][unit]") {
+    auto cpus = dll::detail::parse_cpu_list("0,2,4-6,x,8");
+
+    REQUIRE(cpus.size() == 6);
+    REQUIRE(cpus[0] == 0);
+    REQUIRE(cpus[1] == 2);
+    REQUIRE(cpus[2] == 4);
+    REQUIRE(cpus[4] == 6);
+    REQUIRE(cpus[5] == 8);
+
+    REQUIRE(dll::detail::parse_cpu_list("").empty());
+}
+
+TEST_CASE("unit/scheduler/group/1", "[scheduler][unit]") {
+    std::atomic<size_t> sum{0};
+
+    dll::task_group group;
+
+    for (size_t i = 0; i < 100; ++i) {
+        group.do_task([&sum, i] { sum += i; });
+    }
+
+    group.wait();
+
+    REQUIRE(sum == 4950);
+
+    // The group can be reused after a wait
+    for (size_t i = 0; i < 10; ++i) {
+        group.do_task([&sum] { ++sum; });
+    }
+
+    group.wait();
+
+    REQUIRE(sum == 4960);
+}
+
+TEST_CASE("unit/scheduler/group/2", "[scheduler][unit]") {
+    std::atomic<size_t> sum{0};
+
+    // Nested groups must not deadlock, whatever the number of workers
+    dll::task_group outer;
+
+    for (size_t i = 0; i < 32; ++i) {
+        outer.do_task([&sum] {
+            dll::task_group inner;
+
+            for (size_t j = 0; j < 32; ++j) {
+                inner.do_task([&sum] { ++sum; });
+            }
+
+            inner.wait();
+        });
+    }
+
+    outer.wait();
+
+    REQUIRE(sum == 32 * 32);
+}
+
+TEST_CASE("unit/scheduler/branches", "[scheduler][unit]") {
+    auto mode = dll::get_branch_mode();
+
+    dll::set_branch_mode(dll::branch_mode::PARALLEL);
+
+    std::vector<size_t> values(8, 0);
+
+    dll::for_each_branch(values.size(), [&values](size_t i) { values[i] = i + 1; });
+
+    dll::set_branch_mode(mode);
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == i + 1);
+    }
+}
+
+TEST_CASE("unit/scheduler/data", "[scheduler][unit]") {
+    auto budget = dll::get_thread_budget();
+
+    REQUIRE(budget.compute >= 1);
+
+    if (budget.data) {
+        REQUIRE(dll::data_threads(budget.data + 3) == budget.data);
+    } else {
+        REQUIRE(dll::data_threads(5) == 5);
+    }
+}
@@ -0,0 +1,56 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// The errors of the non-adjacent layers share their memory
+TEST_CASE("unit/shared_errors/1", "[unit][shared_errors][dbn][mnist][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 100>::layer_t,
+        dll::dense_layer_desc<100, 100>::layer_t,
+        dll::dense_layer_desc<100, 50>::layer_t,
+        dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>;
+
+    using plain_t  = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t;
+    using shared_t = dll::dbn_desc<layers_t, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>, dll::shared_errors>::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 250, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto plain  = std::make_unique<plain_t>();
+    auto shared = std::make_unique<shared_t>();
+
+    auto copy = [](auto& to, const auto& from) {
+        to.w = from.w;
+        to.b = from.b;
+    };
+
+    copy(shared->layer_get<0>(), plain->layer_get<0>());
+    copy(shared->layer_get<1>(), plain->layer_get<1>());
+    copy(shared->layer_get<2>(), plain->layer_get<2>());
+    copy(shared->layer_get<3>(), plain->layer_get<3>());
+
+    // The even layers share 100 errors by sample instead of 150, the odd layers 100 instead of 110
+    REQUIRE(dll::sgd_trainer<shared_t>(*shared).memory_report().total() == dll::sgd_trainer<plain_t>(*plain).memory_report().total() - 20 * 60 * sizeof(float));
+
+    // The gradients are the same, only computed earlier
+    auto plain_error  = plain->fine_tune(dataset.train(), 5);
+    auto shared_error = shared->fine_tune(dataset.train(), 5);
+
+    REQUIRE(shared_error == Approx(plain_error));
+
+    for (size_t i = 0; i < etl::size(plain->layer_get<1>().w); ++i) {
+        REQUIRE(shared->layer_get<1>().w[i] == Approx(plain->layer_get<1>().w[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(plain->layer_get<3>().b); ++i) {
+        REQUIRE(shared->layer_get<3>().b[i] == Approx(plain->layer_get<3>().b[i]));
+    }
+}
@@ -0,0 +1,104 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cmath>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/sampled_softmax_layer.hpp"
+#include "dll/neural/hierarchical_softmax_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// The softmax is fused with the categorical cross-entropy during training
+TEST_CASE("unit/softmax/1", "[unit][softmax][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::tanh>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<30>
+    >::dbn_t;
+
+    // The softmax is fused with the cross-entropy during training, unless the
+    // training is resident on the GPU (gpu_resident)
+    REQUIRE(dll::sgd_trainer<dbn_t>::fused_softmax_cce);
+
+    // The last batch of each epoch is incomplete
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<30>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(30, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    auto [error, loss] = dbn->evaluate_metrics(dataset.train());
+
+    REQUIRE(error < 5e-2);
+    REQUIRE(std::isfinite(loss));
+}
+
+// Sampled softmax, the full softmax is used for evaluation
+TEST_CASE("unit/softmax/2", "[unit][softmax][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::sampled_softmax_layer_desc<100, 10, dll::negative_samples<4>, dll::negative_sampler<dll::uniform_sampler>>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 0.2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The outputs are the full softmax
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto output = dbn->forward_batch(batch);
+
+    for (size_t i = 0; i < 20; ++i) {
+        REQUIRE(etl::sum(output(i)) == Approx(1.0).epsilon(1e-4));
+    }
+}
+
+// Hierarchical softmax over a tree of 10 classes
+TEST_CASE("unit/softmax/3", "[unit][softmax][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::hierarchical_softmax_layer_desc<100, 10>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    REQUIRE(dll::hsoftmax_depth(10) == 4);
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 0.2);
+    TEST_CHECK_DATASET(0.3);
+
+    etl::fast_dyn_matrix<float, 20, 28 * 28> batch;
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    auto output = dbn->forward_batch(batch);
+
+    for (size_t i = 0; i < 20; ++i) {
+        REQUIRE(etl::sum(output(i)) == Approx(1.0).epsilon(1e-4));
+    }
+}
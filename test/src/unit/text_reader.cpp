@@ -5,9 +5,47 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
 #include "dll_test.hpp"
 
 #include "dll/text_reader.hpp"
+#include "dll/tabular_reader.hpp"
+
+namespace {
+
+// Parses a text image with streams, as the reader used to
+std::vector<double> reference_values(const std::string& path, size_t& lines, size_t& columns){
+    std::vector<double> values;
+
+    std::ifstream file(path);
+
+    lines   = 0;
+    columns = 0;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream ss(line);
+        std::string value;
+
+        while (std::getline(ss, value, ';')) {
+            values.push_back(std::atof(value.c_str()));
+
+            if(lines == 0){
+                ++columns;
+            }
+        }
+
+        ++lines;
+    }
+
+    return values;
+}
+
+} // end of anonymous namespace
 
 TEST_CASE("unit/text_reader/labels/1", "[unit][reader]") {
     auto labels = dll::text::read_labels<std::vector, uint8_t>("test/text_db/labels", 20);
@@ -124,3 +162,128 @@ TEST_CASE("unit/text_reader/images/5", "[unit][reader]") {
     REQUIRE(samples[7](0, 17, 16) == 9);
     REQUIRE(samples[8](0, 17, 15) == 253);
 }
+
+// The memory-mapped parser reads the same values as the stream parser
+TEST_CASE("unit/text_reader/images/6", "[unit][reader]") {
+    char path[] = "/tmp/dll_text_db_XXXXXX";
+    REQUIRE(mkdtemp(path) != nullptr);
+
+    const std::string folder(path);
+
+    // Spaces, signs, exponents, invalid values, trailing separators and new lines
+    const std::vector<std::string> texts{
+        "1.5;-2;+3; 4e1;abc;6\n7;8;9;10;11;12\n",
+        "0.25;0.5;\n1;2;\n-1;-2;\n",
+        "1;2;3\n4;5;6",
+        "1;2\r\n3;4\r\n"};
+
+    for(size_t i = 0; i < texts.size(); ++i){
+        std::ofstream(folder + "/" + std::to_string(i + 1) + ".dat") << texts[i];
+    }
+
+    std::vector<etl::dyn_matrix<float, 3>> samples;
+    dll::text::read_images_direct<true>(samples, folder, 0);
+
+    std::vector<etl::dyn_matrix<float, 3>> db_samples;
+    dll::text::read_images_direct<true>(db_samples, "test/text_db/images", 0);
+
+    REQUIRE(samples.size() == texts.size());
+    REQUIRE(db_samples.size() == 9);
+
+    auto check = [](auto& sample, const std::string& file){
+        size_t lines;
+        size_t columns;
+        auto values = reference_values(file, lines, columns);
+
+        REQUIRE(sample.dim(0) == 1);
+        REQUIRE(sample.dim(1) == lines);
+        REQUIRE(sample.dim(2) == columns);
+        REQUIRE(values.size() == sample.size());
+
+        for(size_t j = 0; j < values.size(); ++j){
+            REQUIRE(sample[j] == Approx(float(values[j])));
+        }
+    };
+
+    for(size_t i = 0; i < samples.size(); ++i){
+        check(samples[i], folder + "/" + std::to_string(i + 1) + ".dat");
+    }
+
+    for(size_t i = 0; i < db_samples.size(); ++i){
+        check(db_samples[i], "test/text_db/images/" + std::to_string(i + 1) + ".dat");
+    }
+
+    for(size_t i = 0; i < texts.size(); ++i){
+        std::remove((folder + "/" + std::to_string(i + 1) + ".dat").c_str());
+    }
+
+    std::remove(folder.c_str());
+}
+
+TEST_CASE("unit/tabular_reader/csv/1", "[unit][reader]") {
+    std::vector<etl::dyn_matrix<float, 1>> samples;
+    dll::tabular::read_samples(samples, "test/tabular_db/samples.csv", dll::tabular::format::CSV, 0, [](size_t n) { return etl::dyn_matrix<float, 1>(n); });
+
+    std::vector<uint8_t> labels;
+    dll::tabular::read_labels(labels, "test/tabular_db/samples.csv", dll::tabular::format::CSV, 3);
+
+    REQUIRE(samples.size() == 4);
+    REQUIRE(labels.size() == 3);
+
+    REQUIRE(samples[0].size() == 3);
+    REQUIRE(samples[0][0] == 0.5f);
+    REQUIRE(samples[1][1] == 1.5f);
+    REQUIRE(samples[2][2] == 3.25f);
+    REQUIRE(samples[3][0] == 4.0f);
+
+    REQUIRE(labels[0] == 1);
+    REQUIRE(labels[1] == 0);
+    REQUIRE(labels[2] == 2);
+}
+
+TEST_CASE("unit/tabular_reader/libsvm/1", "[unit][reader]") {
+    auto source = dll::tabular::open("test/tabular_db/samples.libsvm", dll::tabular::format::LIBSVM);
+
+    REQUIRE(source->samples == 4);
+    REQUIRE(source->features == 3);
+
+    dll::tabular::sample_iterator<float> it(source, 0);
+    dll::tabular::label_iterator<size_t> lit(source, 0);
+
+    REQUIRE(etl::sum(*it) == 2.5f);
+    REQUIRE((*it)[2] == 2.0f);
+    REQUIRE(*lit == 1);
+
+    ++it;
+    ++lit;
+
+    REQUIRE((*it)[0] == 1.0f);
+    REQUIRE((*it)[1] == 1.5f);
+    REQUIRE((*it)[2] == 0.0f);
+    REQUIRE(*lit == 0);
+
+    // A copy restarts at the position of the copied iterator
+    dll::tabular::sample_iterator<float> copy(it);
+    ++copy;
+
+    REQUIRE((*copy)[2] == 3.25f);
+    REQUIRE((*it)[1] == 1.5f);
+}
+
+TEST_CASE("unit/tabular_reader/generator/1", "[unit][reader]") {
+    auto generator = dll::tabular::make_generator("test/tabular_db/samples.libsvm", dll::tabular::format::LIBSVM, 3, 0,
+                                                  dll::outmemory_data_generator_desc<dll::batch_size<2>, dll::big_batch_size<1>, dll::categorical>{});
+
+    REQUIRE(generator->size() == 4);
+    REQUIRE(generator->batches() == 2);
+
+    REQUIRE(generator->has_next_batch());
+    REQUIRE(generator->data_batch()(0, 0) == 0.5f);
+    REQUIRE(generator->label_batch()(0, 1) == 1.0f);
+
+    generator->next_batch();
+
+    REQUIRE(generator->has_next_batch());
+    REQUIRE(generator->data_batch()(1, 0) == 4.0f);
+    REQUIRE(generator->label_batch()(0, 2) == 1.0f);
+}
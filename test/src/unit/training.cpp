@@ -0,0 +1,463 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cmath>
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+// Trains a small network with and without pipelining and checks its weights
+// against plain mini-batch SGD, computed in double precision
+template <typename dbn_t>
+void check_plain_sgd() {
+    using trainer_t = dll::sgd_trainer<dbn_t>;
+
+    constexpr size_t N = 64;
+    constexpr size_t B = 16;
+
+    std::vector<etl::fast_dyn_matrix<float, 20>> samples(N);
+    std::vector<size_t> labels(N);
+
+    for (size_t i = 0; i < N; ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = i % 5;
+    }
+
+    auto serial    = std::make_unique<dbn_t>();
+    auto pipelined = std::make_unique<dbn_t>();
+
+    serial->template layer_get<0>().b = etl::normal_generator(0.0, 0.1);
+    serial->template layer_get<1>().b = etl::normal_generator(0.0, 0.1);
+
+    std::stringstream weights;
+    serial->store(weights);
+    pipelined->load(weights);
+
+    serial->learning_rate    = 0.05;
+    pipelined->learning_rate = 0.05;
+
+    serial->pipelined_training    = false;
+    pipelined->pipelined_training = true;
+
+    // The reference, in double precision
+
+    const auto& l1 = serial->template layer_get<0>();
+    const auto& l2 = serial->template layer_get<1>();
+
+    etl::dyn_matrix<double, 2> w1(20, 12);
+    etl::dyn_matrix<double, 2> w2(12, 5);
+    etl::dyn_vector<double> b1(12);
+    etl::dyn_vector<double> b2(5);
+
+    auto copy = [](auto& to, const auto& from) {
+        for (size_t i = 0; i < etl::size(from); ++i) {
+            to[i] = from[i];
+        }
+    };
+
+    copy(w1, l1.w);
+    copy(w2, l2.w);
+    copy(b1, l1.b);
+    copy(b2, l2.b);
+
+    // Uploading the weights does not change them
+    trainer_t(*serial).init_training(B);
+
+    for (size_t i = 0; i < etl::size(w1); ++i) {
+        REQUIRE(l1.w[i] == Approx(w1[i]));
+    }
+
+    constexpr size_t epochs = 3;
+
+    for (size_t epoch = 0; epoch < epochs; ++epoch) {
+        for (size_t first = 0; first < N; first += B) {
+            etl::dyn_matrix<double, 2> h(B, 12);
+            etl::dyn_matrix<double, 2> e2(B, 5);
+            etl::dyn_matrix<double, 2> e1(B, 12);
+
+            for (size_t s = 0; s < B; ++s) {
+                const auto& x = samples[first + s];
+
+                for (size_t j = 0; j < 12; ++j) {
+                    double z = b1(j);
+
+                    for (size_t k = 0; k < 20; ++k) {
+                        z += x(k) * w1(k, j);
+                    }
+
+                    h(s, j) = std::tanh(z);
+                }
+
+                double o[5];
+                double sum = 0.0;
+
+                for (size_t j = 0; j < 5; ++j) {
+                    o[j] = b2(j);
+
+                    for (size_t k = 0; k < 12; ++k) {
+                        o[j] += h(s, k) * w2(k, j);
+                    }
+
+                    o[j] = std::exp(o[j]);
+                    sum += o[j];
+                }
+
+                // The errors of the softmax with the categorical cross-entropy
+                for (size_t j = 0; j < 5; ++j) {
+                    e2(s, j) = (labels[first + s] == j ? 1.0 : 0.0) - o[j] / sum;
+                }
+
+                for (size_t k = 0; k < 12; ++k) {
+                    double e = 0.0;
+
+                    for (size_t j = 0; j < 5; ++j) {
+                        e += e2(s, j) * w2(k, j);
+                    }
+
+                    e1(s, k) = e * (1.0 - h(s, k) * h(s, k));
+                }
+            }
+
+            const double f = 0.05 / B;
+
+            for (size_t s = 0; s < B; ++s) {
+                const auto& x = samples[first + s];
+
+                for (size_t j = 0; j < 5; ++j) {
+                    b2(j) += f * e2(s, j);
+
+                    for (size_t k = 0; k < 12; ++k) {
+                        w2(k, j) += f * h(s, k) * e2(s, j);
+                    }
+                }
+
+                for (size_t j = 0; j < 12; ++j) {
+                    b1(j) += f * e1(s, j);
+
+                    for (size_t k = 0; k < 20; ++k) {
+                        w1(k, j) += f * x(k) * e1(s, j);
+                    }
+                }
+            }
+        }
+    }
+
+    serial->fine_tune(samples, labels, epochs);
+    pipelined->fine_tune(samples, labels, epochs);
+
+    auto check = [](const auto& a, const auto& b) {
+        for (size_t i = 0; i < etl::size(b); ++i) {
+            REQUIRE(a[i] == Approx(b[i]).epsilon(1e-3).margin(1e-4));
+        }
+    };
+
+    for (auto* dbn : {serial.get(), pipelined.get()}) {
+        check(dbn->template layer_get<0>().w, w1);
+        check(dbn->template layer_get<0>().b, b1);
+        check(dbn->template layer_get<1>().w, w2);
+        check(dbn->template layer_get<1>().b, b2);
+    }
+}
+
+} // end of anonymous namespace
+
+// Test Sigmoid -> Sigmoid network with full epoch error
+TEST_CASE("unit/training/1", "[unit][training][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 10>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre, dll::full_epoch_error>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    auto ft_error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 50);
+    std::cout << "ft_error:" << ft_error << std::endl;
+    CHECK(ft_error < 5e-2);
+
+    // The error of the last epoch is the error of the final weights on the whole training set
+    REQUIRE(ft_error == Approx(dbn->evaluate_error(dataset.training_images, dataset.training_labels)).epsilon(1e-5));
+
+    TEST_CHECK(0.3);
+}
+
+// The last batch of each epoch is incomplete, only its samples are computed
+TEST_CASE("unit/training/2", "[unit][training][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<32>
+    >::dbn_t;
+
+    // 1010 samples, the last batch holds 18 samples
+    auto dataset = dll::make_mnist_dataset_sub(0, 1010, dll::normalize_pre{}, dll::batch_size<32>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The incomplete batches of the inference only compute their samples
+    etl::fast_dyn_matrix<float, 32, 28 * 28> batch;
+    etl::fast_dyn_matrix<float, 28 * 28> sample;
+
+    batch = etl::normal_generator(0.0, 1.0);
+
+    auto expected = etl::force_temporary(dbn->forward_batch(batch));
+
+    auto context = dbn->make_inference_context(sample);
+
+    auto& output = dbn->forward_batch(context, etl::slice(batch, 0, 7));
+
+    for (size_t i = 0; i < 7 * 10; ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 7 * 10; i < 32 * 10; ++i) {
+        REQUIRE(output[i] == 0.0f);
+    }
+}
+
+// The pipelined training loop trains the same batches as the serial loop
+TEST_CASE("unit/training/3", "[unit][training][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::tanh>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<16>
+    >::dbn_t;
+
+    // Four full batches and an incomplete one
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(70);
+    std::vector<size_t> labels(samples.size());
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::normal_generator(0.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    auto serial    = std::make_unique<dbn_t>();
+    auto pipelined = std::make_unique<dbn_t>();
+
+    std::stringstream weights;
+    serial->store(weights);
+    pipelined->load(weights);
+
+    serial->pipelined_training    = false;
+    pipelined->pipelined_training = true;
+
+    serial->fine_tune(samples, labels, 3);
+    pipelined->fine_tune(samples, labels, 3);
+
+    auto& a = serial->template layer_get<1>().w;
+    auto& b = pipelined->template layer_get<1>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-5));
+    }
+}
+
+// Training with loss-based importance sampling of the samples
+TEST_CASE("unit/training/4", "[unit][training][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    REQUIRE(dll::sgd_trainer<dbn_t>::has_sample_weights);
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate       = 0.05;
+    dbn->importance_sampling = true;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+
+    // The weights of the drawn samples are unbiased
+    dll::importance_sampler sampler;
+    sampler.reset(100);
+
+    std::vector<size_t> order(100);
+    std::vector<float> losses(100);
+
+    for (size_t i = 0; i < 100; ++i) {
+        order[i]  = i;
+        losses[i] = i < 10 ? 1.0f : 0.01f;
+    }
+
+    sampler.update(order.data(), losses.data(), 100);
+
+    std::vector<float> weights;
+    sampler.draw(order, weights, 100000, dll::rand_engine());
+
+    size_t high = 0;
+    double sum  = 0.0;
+
+    for (size_t j = 0; j < order.size(); ++j) {
+        high += order[j] < 10;
+        sum += weights[j];
+    }
+
+    REQUIRE(high > order.size() / 2);
+    REQUIRE(sum / order.size() == Approx(1.0).epsilon(0.05));
+}
+
+// Incremental training, by batches and sample by sample, with replay
+TEST_CASE("unit/training/5", "[unit][training][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto online = dbn->make_online_trainer(100, 2);
+
+    etl::dyn_matrix<float, 2> batch(8, 28 * 28);
+    std::vector<size_t> batch_labels(8);
+
+    for (size_t epoch = 0; epoch < 30; ++epoch) {
+        // The first half arrives by batches, the second sample by sample
+        for (size_t i = 0; i + 8 <= 175; i += 8) {
+            for (size_t k = 0; k < 8; ++k) {
+                batch(k)        = dataset.training_images[i + k];
+                batch_labels[k] = dataset.training_labels[i + k];
+            }
+
+            online->train_batch(batch, batch_labels);
+        }
+
+        for (size_t i = 175; i < dataset.training_images.size(); ++i) {
+            online->push(dataset.training_images[i], dataset.training_labels[i]);
+        }
+
+        online->flush();
+
+        ++online->epoch;
+    }
+
+    REQUIRE(online->replay_size() == 100);
+    REQUIRE(online->samples == 30 * (168 + 175));
+
+    TEST_CHECK(0.3);
+}
+
+// Several networks trained from the same pass over the generator
+TEST_CASE("unit/training/6", "[unit][training][dbn][mnist][sgd]") {
+    using small_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    using large_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::updater<dll::updater_type::MOMENTUM>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto small     = std::make_unique<small_t>();
+    auto large     = std::make_unique<large_t>();
+    auto small_ref = std::make_unique<small_t>();
+    auto large_ref = std::make_unique<large_t>();
+
+    std::stringstream small_weights;
+    small->store(small_weights);
+    small_ref->load(small_weights);
+
+    std::stringstream large_weights;
+    large->store(large_weights);
+    large_ref->load(large_weights);
+
+    auto errors = dll::multi_fine_tune(dataset.train(), 3, *small, *large);
+
+    // The same training as one network after the other
+    auto small_error = small_ref->fine_tune(dataset.train(), 3);
+    auto large_error = large_ref->fine_tune(dataset.train(), 3);
+
+    REQUIRE(errors[0] == Approx(small_error));
+    REQUIRE(errors[1] == Approx(large_error));
+
+    auto& a = small->template layer_get<1>().w;
+    auto& b = small_ref->template layer_get<1>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+
+    auto& c = large->template layer_get<1>().w;
+    auto& d = large_ref->template layer_get<1>().w;
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(c[i] == Approx(d[i]).epsilon(1e-4));
+    }
+}
+
+// The training resident on the GPU (gpu_resident with ETL_GPU) and the
+// training on the CPU compute the same updates as plain mini-batch SGD
+TEST_CASE("unit/training/7", "[unit][training][dbn][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<20, 12, dll::tanh>::layer_t,
+        dll::dense_layer_desc<12, 5, dll::softmax>::layer_t>;
+
+    using dbn_t      = dll::dbn_desc<layers_t, dll::batch_size<16>>::dbn_t;
+    using resident_t = dll::dbn_desc<layers_t, dll::batch_size<16>, dll::gpu_resident>::dbn_t;
+
+    // Without the option, the training keeps the fused passes on the CPU, even with ETL_GPU
+    REQUIRE(!dll::sgd_trainer<dbn_t>::gpu_resident);
+    REQUIRE(dll::sgd_trainer<dbn_t>::fused_updates);
+    REQUIRE(dll::sgd_trainer<dbn_t>::fused_softmax_cce);
+
+#ifdef ETL_GPU
+    REQUIRE(dll::sgd_trainer<resident_t>::gpu_resident);
+#else
+    REQUIRE(!dll::sgd_trainer<resident_t>::gpu_resident);
+#endif
+
+    // On the GPU, the updates and the errors of the softmax are ETL expressions
+    REQUIRE(dll::sgd_trainer<resident_t>::fused_updates == !dll::sgd_trainer<resident_t>::gpu_resident);
+    REQUIRE(dll::sgd_trainer<resident_t>::fused_softmax_cce == !dll::sgd_trainer<resident_t>::gpu_resident);
+
+    check_plain_sgd<dbn_t>();
+    check_plain_sgd<resident_t>();
+}
@@ -0,0 +1,165 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cmath>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+namespace {
+
+// Trains the same network with the fused and the unfused updates
+template <dll::updater_type UT>
+void check_fused_updates() {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 30, dll::relu>::layer_t,
+        dll::dense_layer_desc<30, 10, dll::softmax>::layer_t>;
+
+    using fused_t   = typename dll::dbn_desc<layers_t, dll::updater<UT>, dll::weight_decay<dll::decay_type::L2>, dll::batch_size<20>>::dbn_t;
+    using unfused_t = typename dll::dbn_desc<layers_t, dll::updater<UT>, dll::weight_decay<dll::decay_type::L2>, dll::batch_size<20>, dll::unfused_updates>::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 100, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto fused   = std::make_unique<fused_t>();
+    auto unfused = std::make_unique<unfused_t>();
+
+    auto copy = [](auto& to, const auto& from) {
+        to.w = from.w;
+        to.b = from.b;
+    };
+
+    copy(unfused->template layer_get<0>(), fused->template layer_get<0>());
+    copy(unfused->template layer_get<1>(), fused->template layer_get<1>());
+
+    fused->learning_rate   = 0.01;
+    unfused->learning_rate = 0.01;
+
+    fused->fine_tune(dataset.train(), 3);
+    unfused->fine_tune(dataset.train(), 3);
+
+    REQUIRE(etl::max(etl::abs(fused->template layer_get<0>().w - unfused->template layer_get<0>().w)) < 1e-4f);
+    REQUIRE(etl::max(etl::abs(fused->template layer_get<0>().b - unfused->template layer_get<0>().b)) < 1e-4f);
+    REQUIRE(etl::max(etl::abs(fused->template layer_get<1>().w - unfused->template layer_get<1>().w)) < 1e-4f);
+    REQUIRE(etl::max(etl::abs(fused->template layer_get<1>().b - unfused->template layer_get<1>().b)) < 1e-4f);
+}
+
+} // end of anonymous namespace
+
+// Dynamic loss scaling, the steps with overflowing gradients are skipped
+TEST_CASE("unit/updater/1", "[unit][updater][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate     = 0.03;
+    dbn->loss_scale        = 1e38;
+    dbn->loss_scale_window = 20;
+
+    FT_CHECK_DATASET(25, 0.1);
+
+    // The initial scale overflows and was reduced
+    REQUIRE(dbn->loss_scale > 0.0f);
+    REQUIRE(dbn->loss_scale < 1e38f);
+
+    for (auto w : dbn->layer_get<0>().w) {
+        REQUIRE(std::isfinite(w));
+    }
+}
+
+// LARS, the learning rate of the weights is adapted per layer
+TEST_CASE("unit/updater/2", "[unit][updater][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::LARS>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 1.0;
+
+    FT_CHECK_DATASET(25, 0.1);
+
+    // The first step of each layer is lars_trust * ||w|| long, whatever the norm of the gradients
+    auto batch = dll::make_mnist_dataset_sub(0, 20, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto net = std::make_unique<dbn_t>();
+
+    net->learning_rate = 1.0;
+
+    etl::fast_matrix<float, 28 * 28, 100> w0 = net->layer_get<0>().w;
+    etl::fast_matrix<float, 100, 10> w1      = net->layer_get<1>().w;
+
+    net->fine_tune(batch.train(), 1);
+
+    auto& v0 = net->layer_get<0>().w;
+    auto& v1 = net->layer_get<1>().w;
+
+    REQUIRE(std::sqrt(etl::sum((v0 - w0) >> (v0 - w0))) == Approx(net->lars_trust * std::sqrt(etl::sum(w0 >> w0))).epsilon(1e-3));
+    REQUIRE(std::sqrt(etl::sum((v1 - w1) >> (v1 - w1))) == Approx(net->lars_trust * std::sqrt(etl::sum(w1 >> w1))).epsilon(1e-3));
+}
+
+// LAMB, the learning rate of the weights is adapted per layer
+TEST_CASE("unit/updater/3", "[unit][updater][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::LAMB>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK_DATASET(25, 0.1);
+
+    // The first step of each layer is learning_rate * ||w|| long, whatever the norm of the gradients
+    auto batch = dll::make_mnist_dataset_sub(0, 20, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto net = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 28 * 28, 100> w0 = net->layer_get<0>().w;
+    etl::fast_matrix<float, 100, 10> w1      = net->layer_get<1>().w;
+
+    net->fine_tune(batch.train(), 1);
+
+    auto& v0 = net->layer_get<0>().w;
+    auto& v1 = net->layer_get<1>().w;
+
+    REQUIRE(std::sqrt(etl::sum((v0 - w0) >> (v0 - w0))) == Approx(net->learning_rate * std::sqrt(etl::sum(w0 >> w0))).epsilon(1e-3));
+    REQUIRE(std::sqrt(etl::sum((v1 - w1) >> (v1 - w1))) == Approx(net->learning_rate * std::sqrt(etl::sum(w1 >> w1))).epsilon(1e-3));
+}
+
+// The fused updates train the same weights as the unfused ones, for each updater
+TEST_CASE("unit/updater/4", "[unit][updater][dbn][mnist][sgd]") {
+    check_fused_updates<dll::updater_type::SGD>();
+    check_fused_updates<dll::updater_type::MOMENTUM>();
+    check_fused_updates<dll::updater_type::NESTEROV>();
+    check_fused_updates<dll::updater_type::ADAGRAD>();
+    check_fused_updates<dll::updater_type::RMSPROP>();
+    check_fused_updates<dll::updater_type::ADAM>();
+    check_fused_updates<dll::updater_type::ADAM_CORRECT>();
+    check_fused_updates<dll::updater_type::ADAMAX>();
+    check_fused_updates<dll::updater_type::NADAM>();
+    check_fused_updates<dll::updater_type::ADADELTA>();
+    check_fused_updates<dll::updater_type::LARS>();
+    check_fused_updates<dll::updater_type::LAMB>();
+}
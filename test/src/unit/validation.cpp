@@ -0,0 +1,258 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cmath>
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+
+// The validation set is evaluated concurrently with the next epoch
+TEST_CASE("unit/validation/1", "[unit][validation][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::overlapped_validation
+    >::dbn_t;
+
+    using serial_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn    = std::make_unique<dbn_t>();
+    auto serial = std::make_unique<serial_dbn_t>();
+
+    std::stringstream weights;
+    dbn->store(weights);
+    serial->load(weights);
+
+    dbn->learning_rate    = 0.03;
+    serial->learning_rate = 0.03;
+
+    FT_CHECK_DATASET_VAL(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // Only the validation is delayed, the epochs train the same weights
+    serial->fine_tune_val(dataset.train(), dataset.val(), 25);
+
+    REQUIRE(dbn->evaluate_error(dataset.val()) == Approx(serial->evaluate_error(dataset.val())));
+
+    auto& a = serial->template layer_get<0>().w;
+    auto& b = dbn->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == Approx(b[i]).epsilon(1e-4));
+    }
+}
+
+// Early stopping on a stratified subset of the validation set
+TEST_CASE("unit/validation/2", "[unit][validation][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::early_stopping<dll::strategy::ERROR_BEST>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate         = 0.03;
+    dbn->patience              = 5;
+    dbn->validation_budget     = 200;
+    dbn->stratified_validation = true;
+
+    auto trainer  = dbn->get_trainer();
+    auto ft_error = trainer.train(*dbn, dataset.train(), dataset.val(), 25);
+
+    CHECK(ft_error < 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The final weights have been evaluated on the complete validation set
+    auto [error, loss] = dbn->evaluate_metrics(dataset.val());
+
+    REQUIRE(error == Approx(trainer.current_val_error).epsilon(1e-3));
+    REQUIRE(loss == Approx(trainer.current_val_loss).epsilon(1e-3));
+}
+
+// The batches are evaluated concurrently, with the same result
+TEST_CASE("unit/validation/3", "[unit][validation][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    // 1010 validation samples, the last batch is incomplete
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2010, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET_VAL(10, 0.1);
+
+    auto [error, loss] = dbn->evaluate_metrics(dataset.val());
+
+    dbn->parallel_evaluation = false;
+
+    auto [serial_error, serial_loss] = dbn->evaluate_metrics(dataset.val());
+
+    REQUIRE(error == Approx(serial_error).epsilon(1e-5));
+    REQUIRE(loss == Approx(serial_loss).epsilon(1e-5));
+}
+
+// The best weights are saved in the background, or in the foreground
+TEST_CASE("unit/validation/4", "[unit][validation][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::early_stopping<dll::strategy::ERROR_BEST>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 1500, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto initial = std::make_unique<dbn_t>();
+
+    std::vector<std::unique_ptr<dbn_t>> trained;
+
+    for (bool background : {true, false}) {
+        auto dbn = std::make_unique<dbn_t>();
+
+        std::stringstream weights;
+        initial->store(weights);
+        dbn->load(weights);
+
+        dbn->learning_rate     = 0.03;
+        dbn->background_backup = background;
+
+        FT_CHECK_DATASET_VAL(15, 5e-2);
+        TEST_CHECK_DATASET(0.3);
+
+        // The restored weights are the best ones
+        auto [error, loss] = dbn->evaluate_metrics(dataset.val());
+
+        CHECK(std::isfinite(loss));
+        CHECK(error < 0.3);
+
+        trained.push_back(std::move(dbn));
+    }
+
+    // The background copy saves the same weights as the synchronous one
+    auto& a = trained[0]->template layer_get<0>().w;
+    auto& b = trained[1]->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == b[i]);
+    }
+
+    auto& c = trained[0]->template layer_get<1>().b;
+    auto& d = trained[1]->template layer_get<1>().b;
+
+    for (size_t i = 0; i < etl::size(c); ++i) {
+        REQUIRE(c[i] == d[i]);
+    }
+}
+
+// The loss, the error, the top-k accuracy and the confusion matrix in one pass
+TEST_CASE("unit/validation/5", "[unit][validation][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    // 1010 validation samples, the last batch is incomplete
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2010, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET_VAL(10, 0.1);
+
+    auto [error, loss] = dbn->evaluate_metrics(dataset.val());
+
+    auto report = dbn->evaluate_classification(dataset.val(), 3);
+
+    REQUIRE(report.samples == 1010);
+    REQUIRE(report.error() == Approx(error).epsilon(1e-5));
+    REQUIRE(report.mean_loss() == Approx(loss).epsilon(1e-5));
+    REQUIRE(report.top_k_accuracy() >= 1.0 - report.error());
+
+    size_t total   = 0;
+    size_t correct = 0;
+
+    for (size_t i = 0; i < 10; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            total += report.count(i, j);
+        }
+
+        correct += report.count(i, i);
+
+        REQUIRE(report.class_accuracy(i) <= 1.0);
+    }
+
+    REQUIRE(total == 1010);
+    REQUIRE(correct == 1010 - report.errors);
+
+    // The batches evaluated concurrently give the same report
+    dbn->parallel_evaluation = false;
+
+    auto serial = dbn->evaluate_classification(dataset.val(), 3);
+
+    REQUIRE(serial.errors == report.errors);
+    REQUIRE(serial.top_k == report.top_k);
+    REQUIRE(serial.confusion == report.confusion);
+    REQUIRE(serial.loss == Approx(report.loss).epsilon(1e-5));
+}
+
+// k-fold cross-validation over the cache of one generator
+TEST_CASE("unit/validation/6", "[unit][validation][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::updater<dll::updater_type::MOMENTUM>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 400, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto factory = [] {
+        auto dbn = std::make_unique<dbn_t>();
+        dbn->learning_rate = 0.05;
+        return dbn;
+    };
+
+    for (bool parallel : {false, true}) {
+        auto results = dll::cross_validate(factory, dataset.train(), 4, 20, parallel);
+
+        REQUIRE(results.errors.size() == 4);
+        REQUIRE(results.losses.size() == 4);
+
+        for (auto error : results.errors) {
+            REQUIRE(error >= 0.0);
+            REQUIRE(error <= 1.0);
+        }
+
+        REQUIRE(results.mean_error < 0.4);
+        REQUIRE(results.stddev_error >= 0.0);
+    }
+}
@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/rbm/rbm.hpp"
+#include "dll/ocv_visualizer.hpp"
+
+// The mosaic of the weights is the same with the scale computed once per drawing
+TEST_CASE("unit/visualizer/1", "[unit][visualizer]") {
+    using rbm_t        = dll::rbm_desc<16, 9>::layer_t;
+    using visualizer_t = dll::opencv_rbm_visualizer<rbm_t>;
+
+    rbm_t rbm;
+    rbm.w = etl::normal_generator(0.0, 1.0);
+
+    visualizer_t visualizer;
+
+    visualizer.buffer_image = cv::Scalar(255);
+    visualizer.draw_weights(rbm);
+
+    // The former drawing, with the scale computed for each hidden unit
+    cv::Mat reference(visualizer.buffer_image.size(), CV_8UC1, cv::Scalar(255));
+
+    constexpr auto filter_shape = visualizer_t::filter_shape;
+    constexpr auto tile_shape   = visualizer_t::tile_shape;
+    constexpr auto padding      = visualizer_t::padding;
+
+    for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+        for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+            auto real_h = hi * tile_shape.height + hj;
+
+            if (real_h >= rbm_t::num_hidden) {
+                break;
+            }
+
+            float min = etl::min(rbm.w);
+            float max = etl::max(rbm.w);
+
+            for (size_t i = 0; i < filter_shape.width; ++i) {
+                for (size_t j = 0; j < filter_shape.height; ++j) {
+                    auto real_v = i * filter_shape.height + j;
+
+                    if (real_v >= rbm_t::num_visible) {
+                        break;
+                    }
+
+                    auto value = rbm.w(real_v, real_h);
+
+                    value -= min;
+                    value *= 1.0 / (max + 1e-8);
+
+                    reference.at<uint8_t>(
+                        padding + 1 + hi * (filter_shape.height + 1) + i,
+                        padding + 1 + hj * (filter_shape.width + 1) + j) = value * 255;
+                }
+            }
+        }
+    }
+
+    REQUIRE(cv::countNonZero(visualizer.buffer_image != reference) == 0);
+}
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+#=======================================================================
+# Copyright (c) 2014-2017 Baptiste Wicht
+# Distributed under the terms of the MIT License.
+# (See accompanying file LICENSE or copy at
+#  http://opensource.org/licenses/MIT)
+#=======================================================================
+
+"""Compare the results of dll_layer_bench against a baseline.
+
+Usage: bench_compare.py BASELINE CURRENT [--threshold PERCENT] [--metric median|p95|min]
+
+The metric of each phase of each benchmark present in both files is
+compared. The script exits with 1 if any phase is slower than the baseline
+by more than the threshold (10% by default), 0 otherwise. Phases shorter
+than one microsecond in the baseline are too noisy and only reported.
+"""
+
+import argparse
+import json
+import sys
+
+PHASES = ("forward", "backward", "gradients")
+
+
+def load(path):
+    with open(path) as f:
+        return {result["name"]: result for result in json.load(f)["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare dll_layer_bench results against a baseline")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0, help="maximum slowdown in percent")
+    parser.add_argument("--metric", choices=("median", "p95", "min"), default="median")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+
+    print(" | %-36s | %-9s | %12s | %12s | %8s |" % ("Benchmark (us)", "Phase", "Baseline", "Current", "Change"))
+
+    for name in sorted(set(baseline) & set(current)):
+        for phase in PHASES:
+            before = baseline[name][phase][args.metric]
+            after = current[name][phase][args.metric]
+
+            if before <= 0.0 and after <= 0.0:
+                continue
+
+            change = 100.0 * (after / before - 1.0) if before > 0.0 else float("inf")
+
+            status = ""
+
+            if change > args.threshold:
+                if before >= 1.0:
+                    status = " REGRESSION"
+                    regressions += 1
+                else:
+                    status = " (noise)"
+            elif change < -args.threshold:
+                status = " improvement"
+
+            print(" | %-36s | %-9s | %12.2f | %12.2f | %+7.1f%% |%s" % (name, phase, before, after, change, status))
+
+    for name in sorted(set(baseline) - set(current)):
+        print("missing in current: " + name)
+
+    for name in sorted(set(current) - set(baseline)):
+        print("new benchmark: " + name)
+
+    if regressions:
+        print("%d phases regressed by more than %.1f%%" % (regressions, args.threshold))
+        return 1
+
+    print("No regression above %.1f%%" % args.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,597 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Throughput of the training and of the inference of the example networks.
+ *
+ * The networks of examples/src are trained and forwarded for a fixed
+ * number of batches of random data, without any dataset I/O. Each thread
+ * count T is measured with T threads working at the same time:
+ *
+ *  - train: T replicas of the network, each trained on its own thread.
+ *  - infer: one shared network, forwarded by T threads with their own
+ *    inference contexts.
+ *
+ * The threads run serial ETL kernels so that they do not oversubscribe the
+ * cores. The scaling efficiency is the throughput divided by T times the
+ * throughput of one thread. The training with the parallel ETL kernels on
+ * a single network is reported as the "etl" thread count.
+ *
+ * Usage: dll_example_bench [--warmup N] [--batches N] [--threads 1,2,4] [--json FILE] [--filter TEXT]
+ *
+ * imagenet_cnn is only run when it is selected with --filter, since its
+ * replicas need several gigabytes of memory.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_same_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
+#include "dll/neural/embedding_layer.hpp"
+#include "dll/neural/lstm_layer.hpp"
+#include "dll/neural/recurrent_last_layer.hpp"
+#include "dll/neural/rnn_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/utility/group_layer.hpp"
+#include "dll/utility/merge_layer.hpp"
+#include "dll/network.hpp"
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+/*!
+ * \brief The options of the benchmarks
+ */
+struct bench_options {
+    size_t warmup   = 3;                    ///< The number of batches before the measures
+    size_t batches  = 20;                   ///< The number of measured batches per thread
+    std::string json = "example_bench.json"; ///< The output file
+    std::string filter;                     ///< Only run the networks containing this text
+    std::vector<size_t> threads;            ///< The thread counts
+};
+
+/*!
+ * \brief The throughput of one network, in one mode, at one thread count
+ */
+struct bench_result {
+    std::string network;      ///< The example network
+    std::string mode;         ///< train or infer
+    std::string threads;      ///< The number of threads ("etl" for the parallel kernels)
+    size_t batch;             ///< The batch size
+    double images_per_second; ///< The throughput
+    double efficiency;        ///< The scaling efficiency against one thread
+};
+
+/*!
+ * \brief Fill the given batches with random data
+ * \param inputs The batch of inputs
+ * \param labels The batch of labels
+ * \param classes The number of classes, 0 for an auto-encoder
+ * \param indices The number of different values of the inputs, 0 for continuous inputs
+ */
+template <typename Inputs, typename Labels>
+void fill_batch(Inputs& inputs, Labels& labels, size_t classes, size_t indices) {
+    if (indices) {
+        inputs = etl::uniform_generator(0.0, double(indices));
+
+        for (auto& value : inputs) {
+            value = std::min<size_t>(indices - 1, size_t(value));
+        }
+    } else {
+        inputs = etl::uniform_generator(0.0, 1.0);
+    }
+
+    if (classes) {
+        labels = 0;
+
+        for (size_t i = 0; i < etl::dim<0>(labels); ++i) {
+            labels(i, i % classes) = 1.0;
+        }
+    } else {
+        labels = inputs;
+    }
+}
+
+/*!
+ * \brief Run the given functor on T threads at the same time (ETL kernels
+ * are serial in the threads) and return the time between the first start
+ * and the last end of the measured part
+ *
+ * \param functor Called with the thread index and a function to call when
+ * the measured part starts
+ */
+template <typename Functor>
+double run_threads(size_t T, Functor&& functor) {
+    std::atomic<size_t> ready{0};
+
+    std::vector<bench_clock::time_point> starts(T);
+    std::vector<bench_clock::time_point> ends(T);
+
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < T; ++t) {
+        workers.emplace_back([&, t] {
+            SERIAL_SECTION {
+                functor(t, [&] {
+                    // All the threads start the measured part together
+                    ready.fetch_add(1);
+
+                    while (ready.load() < T) {
+                        std::this_thread::yield();
+                    }
+
+                    starts[t] = bench_clock::now();
+                });
+
+                ends[t] = bench_clock::now();
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    auto start = *std::min_element(starts.begin(), starts.end());
+    auto end   = *std::max_element(ends.begin(), ends.end());
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/*!
+ * \brief Train one replica of the network for the given number of batches
+ * \param started Called when the measured batches start
+ */
+template <typename Network, typename Inputs, typename Labels, typename Started>
+void train_replica(const bench_options& options, size_t classes, size_t indices, Started&& started) {
+    using trainer_t = typename Network::desc::template trainer_t<Network>;
+
+    auto net    = std::make_unique<Network>();
+    auto inputs = std::make_unique<Inputs>();
+    auto labels = std::make_unique<Labels>();
+
+    fill_batch(*inputs, *labels, classes, indices);
+
+    net->momentum = net->initial_momentum;
+
+    auto trainer = std::make_unique<trainer_t>(*net);
+    trainer->init_training(Network::batch_size);
+
+    for (size_t b = 0; b < options.warmup; ++b) {
+        trainer->train_batch(0, *inputs, *labels);
+    }
+
+    started();
+
+    for (size_t b = 0; b < options.batches; ++b) {
+        trainer->train_batch(0, *inputs, *labels);
+    }
+}
+
+/*!
+ * \brief Measure the training and the inference throughput of the given
+ * network at all the thread counts
+ *
+ * \tparam Sample The type of one input sample
+ * \tparam Inputs The type of a batch of inputs
+ * \tparam Labels The type of a batch of labels
+ * \param classes The number of classes, 0 for an auto-encoder
+ * \param indices The number of different values of the inputs, 0 for continuous inputs
+ */
+template <typename Network, typename Sample, typename Inputs, typename Labels>
+void bench_example(const std::string& name, size_t classes, size_t indices, const bench_options& options, std::vector<bench_result>& results) {
+    constexpr size_t B = Network::batch_size;
+
+    auto report = [&](const std::string& mode, const std::string& threads, double seconds, size_t images, double single) {
+        bench_result result;
+
+        result.network           = name;
+        result.mode              = mode;
+        result.threads           = threads;
+        result.batch             = B;
+        result.images_per_second = seconds > 0.0 ? images / seconds : 0.0;
+        result.efficiency        = 0.0;
+
+        if (threads != "etl" && single > 0.0) {
+            result.efficiency = result.images_per_second / (std::stoul(threads) * single);
+        }
+
+        printf(" | %-14s | %-5s | %7s | %5zu | %14.1f | %10s |\n", name.c_str(), mode.c_str(), threads.c_str(), B, result.images_per_second,
+               threads == "etl" ? "-" : (std::to_string(int(100.0 * result.efficiency + 0.5)) + "%").c_str());
+
+        results.push_back(result);
+
+        return result.images_per_second;
+    };
+
+    const size_t images = options.batches * B;
+
+    // Training
+
+    double single = 0.0;
+
+    for (size_t T : options.threads) {
+        const double seconds = run_threads(T, [&](size_t /*t*/, auto&& started) {
+            train_replica<Network, Inputs, Labels>(options, classes, indices, started);
+        });
+
+        const double ips = report("train", std::to_string(T), seconds, T * images, single);
+
+        if (T == 1) {
+            single = ips;
+        }
+    }
+
+    {
+        auto start = bench_clock::now();
+
+        train_replica<Network, Inputs, Labels>(options, classes, indices, [&start] { start = bench_clock::now(); });
+
+        report("train", "etl", std::chrono::duration<double>(bench_clock::now() - start).count(), images, 0.0);
+    }
+
+    // Inference
+
+    auto net    = std::make_unique<Network>();
+    auto inputs = std::make_unique<Inputs>();
+    auto labels = std::make_unique<Labels>();
+
+    fill_batch(*inputs, *labels, classes, indices);
+
+    Sample sample;
+
+    single = 0.0;
+
+    for (size_t T : options.threads) {
+        const double seconds = run_threads(T, [&](size_t /*t*/, auto&& started) {
+            auto context = std::make_unique<dll::inference_context<Network, Sample, B>>(*net, sample);
+
+            for (size_t b = 0; b < options.warmup; ++b) {
+                net->forward_batch(*context, *inputs);
+            }
+
+            started();
+
+            for (size_t b = 0; b < options.batches; ++b) {
+                net->forward_batch(*context, *inputs);
+            }
+        });
+
+        const double ips = report("infer", std::to_string(T), seconds, T * images, single);
+
+        if (T == 1) {
+            single = ips;
+        }
+    }
+}
+
+bool selected(const bench_options& options, const std::string& name, bool heavy = false) {
+    return options.filter.empty() ? !heavy : name.find(options.filter) != std::string::npos;
+}
+
+void bench_mnist_mlp(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::dense_layer<28 * 28, 500>,
+            dll::dropout_layer<50>,
+            dll::dense_layer<500, 250>,
+            dll::dropout_layer<50>,
+            dll::dense_layer<250, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<100>
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 28 * 28>, etl::fast_dyn_matrix<float, 100, 28 * 28>, etl::fast_dyn_matrix<float, 100, 10>>(
+        "mnist_mlp", 10, 0, options, results);
+}
+
+void bench_mnist_cnn(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::conv_layer<1, 28, 28, 8, 5, 5>,
+            dll::mp_2d_layer<8, 24, 24, 2, 2>,
+            dll::conv_layer<8, 12, 12, 8, 5, 5>,
+            dll::mp_2d_layer<8, 8, 8, 2, 2>,
+            dll::dense_layer<8 * 4 * 4, 150>,
+            dll::dense_layer<150, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<100>
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 1, 28, 28>, etl::fast_dyn_matrix<float, 100, 1, 28, 28>, etl::fast_dyn_matrix<float, 100, 10>>(
+        "mnist_cnn", 10, 0, options, results);
+}
+
+void bench_mnist_lstm(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::lstm_layer<28, 28, 100, dll::last_only>,
+            dll::recurrent_last_layer<28, 100>,
+            dll::dense_layer<100, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>
+        , dll::batch_size<100>
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 28, 28>, etl::fast_dyn_matrix<float, 100, 28, 28>, etl::fast_dyn_matrix<float, 100, 10>>(
+        "mnist_lstm", 10, 0, options, results);
+}
+
+void bench_mnist_rnn(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<28, 28, 100, dll::last_only>,
+            dll::recurrent_last_layer<28, 100>,
+            dll::dense_layer<100, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>
+        , dll::batch_size<100>
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 28, 28>, etl::fast_dyn_matrix<float, 100, 28, 28>, etl::fast_dyn_matrix<float, 100, 10>>(
+        "mnist_rnn", 10, 0, options, results);
+}
+
+void bench_char_cnn(const bench_options& options, std::vector<bench_result>& results) {
+    constexpr size_t embedding = 16;
+    constexpr size_t length    = 15;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
+                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
+                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<50>
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, length>, etl::fast_dyn_matrix<float, 50, length>, etl::fast_dyn_matrix<float, 50, 10>>(
+        "char_cnn", 10, 26, options, results);
+}
+
+void bench_imagenet_cnn(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::dbn_layers<
+            dll::conv_same_layer<3, 256, 256, 16, 3, 3, dll::relu>,
+            dll::mp_3d_layer<16, 256, 256, 1, 2, 2>,
+            dll::conv_same_layer<16, 128, 128, 16, 3, 3, dll::relu>,
+            dll::mp_3d_layer<16, 128, 128, 1, 2, 2>,
+            dll::conv_same_layer<16, 64, 64, 32, 3, 3, dll::relu>,
+            dll::mp_3d_layer<32, 64, 64, 1, 2, 2>,
+            dll::conv_same_layer<32, 32, 32, 32, 3, 3, dll::relu>,
+            dll::mp_3d_layer<32, 32, 32, 1, 2, 2>,
+            dll::conv_same_layer<32, 16, 16, 32, 3, 3, dll::relu>,
+            dll::mp_3d_layer<32, 16, 16, 1, 2, 2>,
+            dll::dense_layer<2048, 2048, dll::relu>,
+            dll::dense_layer<2048, 1000, dll::softmax>
+        >,
+        dll::batch_size<128>,
+        dll::updater<dll::updater_type::MOMENTUM>>::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 3, 256, 256>, etl::fast_dyn_matrix<float, 128, 3, 256, 256>, etl::fast_dyn_matrix<float, 128, 1000>>(
+        "imagenet_cnn", 1000, 0, options, results);
+}
+
+void bench_mnist_dbn(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::rbm<28 * 28, 500, dll::batch_size<50>, dll::momentum>,
+            dll::rbm<500, 250, dll::batch_size<50>, dll::momentum>,
+            dll::rbm<250, 10, dll::batch_size<50>, dll::hidden<dll::unit_type::SOFTMAX>>
+        >
+        , dll::batch_size<50>
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 28 * 28>, etl::fast_dyn_matrix<float, 50, 28 * 28>, etl::fast_dyn_matrix<float, 50, 10>>(
+        "mnist_dbn", 10, 0, options, results);
+}
+
+void bench_mnist_ae(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::dense_layer<28 * 28, 32, dll::relu>,
+            dll::dense_layer<32, 28 * 28, dll::sigmoid>
+        >
+        , dll::batch_size<256>
+        , dll::binary_cross_entropy
+        , dll::adadelta
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 28 * 28>, etl::fast_dyn_matrix<float, 256, 28 * 28>, etl::fast_dyn_matrix<float, 256, 28 * 28>>(
+        "mnist_ae", 0, 0, options, results);
+}
+
+void bench_mnist_deep_ae(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<784, 128, dll::relu>::layer_t,
+            dll::dense_layer_desc<128, 64 , dll::relu>::layer_t,
+            dll::dense_layer_desc<64 , 32 , dll::relu>::layer_t,
+            dll::dense_layer_desc<32 , 64 , dll::relu>::layer_t,
+            dll::dense_layer_desc<64 , 128, dll::relu>::layer_t,
+            dll::dense_layer_desc<128, 784, dll::sigmoid>::layer_t
+        >
+        , dll::batch_size<256>
+        , dll::binary_cross_entropy
+        , dll::adadelta
+    >::network_t;
+
+    bench_example<network_t, etl::fast_dyn_matrix<float, 28 * 28>, etl::fast_dyn_matrix<float, 256, 28 * 28>, etl::fast_dyn_matrix<float, 256, 28 * 28>>(
+        "mnist_deep_ae", 0, 0, options, results);
+}
+
+/*!
+ * \brief Write the results in the given JSON file
+ */
+bool write_json(const std::string& file, const bench_options& options, const std::vector<bench_result>& results) {
+    std::ofstream out(file);
+
+    out << "{\n";
+    out << "  \"warmup\": " << options.warmup << ",\n";
+    out << "  \"batches\": " << options.batches << ",\n";
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& result = results[i];
+
+        out << (i ? ",\n" : "\n");
+        out << "    {\"network\": \"" << result.network << "\", \"mode\": \"" << result.mode << "\", \"threads\": \"" << result.threads
+            << "\", \"batch\": " << result.batch << ", \"images_per_second\": " << result.images_per_second
+            << ", \"efficiency\": " << result.efficiency << "}";
+    }
+
+    out << "\n  ]\n}\n";
+
+    return bool(out);
+}
+
+/*!
+ * \brief Parse a comma-separated list of thread counts
+ */
+std::vector<size_t> parse_threads(const std::string& list) {
+    std::vector<size_t> threads;
+
+    std::stringstream stream(list);
+    std::string value;
+
+    while (std::getline(stream, value, ',')) {
+        if (!value.empty()) {
+            threads.push_back(std::max<size_t>(1, std::stoul(value)));
+        }
+    }
+
+    return threads;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    bench_options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (i + 1 == argc) {
+            std::cout << "dll_example_bench: error: missing value for " << arg << std::endl;
+            return 1;
+        }
+
+        if (arg == "--warmup") {
+            options.warmup = std::stoul(argv[++i]);
+        } else if (arg == "--batches") {
+            options.batches = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--threads") {
+            options.threads = parse_threads(argv[++i]);
+        } else if (arg == "--json") {
+            options.json = argv[++i];
+        } else if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else {
+            std::cout << "dll_example_bench: error: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // By default, the powers of two up to the number of hardware threads, and this number
+    if (options.threads.empty()) {
+        const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+
+        for (size_t T = 1; T < hardware; T *= 2) {
+            options.threads.push_back(T);
+        }
+
+        options.threads.push_back(hardware);
+    }
+
+    // The efficiency is relative to one thread
+    if (std::find(options.threads.begin(), options.threads.end(), 1) == options.threads.end()) {
+        options.threads.insert(options.threads.begin(), 1);
+    }
+
+    std::sort(options.threads.begin(), options.threads.end());
+
+    std::vector<bench_result> results;
+
+    printf(" | %-14s | %-5s | %7s | %5s | %14s | %10s |\n", "Network", "Mode", "Threads", "Batch", "Images/s", "Efficiency");
+
+    if (selected(options, "mnist_mlp")) {
+        bench_mnist_mlp(options, results);
+    }
+
+    if (selected(options, "mnist_cnn")) {
+        bench_mnist_cnn(options, results);
+    }
+
+    if (selected(options, "mnist_lstm")) {
+        bench_mnist_lstm(options, results);
+    }
+
+    if (selected(options, "mnist_rnn")) {
+        bench_mnist_rnn(options, results);
+    }
+
+    if (selected(options, "char_cnn")) {
+        bench_char_cnn(options, results);
+    }
+
+    if (selected(options, "imagenet_cnn", true)) {
+        bench_imagenet_cnn(options, results);
+    }
+
+    if (selected(options, "mnist_dbn")) {
+        bench_mnist_dbn(options, results);
+    }
+
+    if (selected(options, "mnist_ae")) {
+        bench_mnist_ae(options, results);
+    }
+
+    if (selected(options, "mnist_deep_ae")) {
+        bench_mnist_deep_ae(options, results);
+    }
+
+    if (!write_json(options.json, options, results)) {
+        std::cout << "dll_example_bench: error: unable to write " << options.json << std::endl;
+        return 1;
+    }
+
+    std::cout << results.size() << " results written to " << options.json << std::endl;
+
+    return 0;
+}
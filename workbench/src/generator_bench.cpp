@@ -0,0 +1,311 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Throughput of the data generators, without any network.
+ *
+ * The in-memory and out-of-memory generators are drained on random RGB
+ * images as fast as possible, for each augmentation (none, crop, mirror,
+ * elastic distortion, noise and all of them) and for several numbers of
+ * augmentation threads. For each configuration, the batches per second and
+ * the utilisation of the producer threads (the time they spent filling
+ * batches over their lifetime during the measure) are reported.
+ *
+ * The training step rate of a small CNN, on batches of the same size, is
+ * measured as well: a generator with a lower batch rate than the network
+ * would starve the training.
+ *
+ * Usage: dll_generator_bench [--samples N] [--epochs N] [--steps N] [--json FILE] [--filter TEXT]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/generators.hpp"
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+constexpr size_t B = 64; ///< The batch size of the generators and of the network
+
+using image_t = etl::fast_dyn_matrix<float, 3, 36, 36>;
+
+/*!
+ * \brief The options of the benchmarks
+ */
+struct bench_options {
+    size_t samples   = 2048;                   ///< The number of images
+    size_t epochs    = 3;                      ///< The number of measured epochs per configuration
+    size_t steps     = 20;                     ///< The number of measured training steps of the network
+    std::string json = "generator_bench.json"; ///< The output file
+    std::string filter;                        ///< Only run the configurations containing this text
+};
+
+/*!
+ * \brief The throughput of one configuration of generator
+ */
+struct bench_result {
+    std::string name;          ///< The unique name of the configuration
+    size_t workers;            ///< The number of augmentation threads (0 if the batches are produced by the consumer)
+    double batches_per_second; ///< The throughput of the generator
+    double utilisation;        ///< The fraction of time the producers were filling batches
+};
+
+/*!
+ * \brief Traits to test if a generator has prefetching statistics
+ */
+template <typename G, typename Enable = int>
+struct has_prefetch : std::false_type {};
+
+template <typename G>
+struct has_prefetch<G, decltype((void)std::declval<const G&>().prefetch(), 0)> : std::true_type {};
+
+/*!
+ * \brief Drain a generator for several epochs
+ * \tparam Desc The descriptor of the generator
+ */
+template <typename Desc>
+void bench_generator(const std::string& storage, const std::string& augmentation, size_t workers, const std::vector<image_t>& images,
+                     const std::vector<size_t>& labels, const bench_options& options, std::vector<bench_result>& results) {
+    bench_result result;
+
+    result.name = storage + "/" + augmentation + "/w" + std::to_string(workers);
+
+    if (!options.filter.empty() && result.name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    auto generator = dll::make_generator(images, labels, images.size(), 10, Desc{});
+
+    using generator_t = std::decay_t<decltype(*generator)>;
+
+    // Without threads, the number of workers is meaningless
+    if (!has_prefetch<generator_t>::value && workers > 1) {
+        return;
+    }
+
+    generator->set_train();
+
+    // The first epoch fills the caches and starts the threads
+    generator->reset();
+
+    while (generator->has_next_batch()) {
+        generator->data_batch();
+        generator->next_batch();
+    }
+
+    volatile double sink = 0.0;
+
+    size_t batches = 0;
+    size_t busy_ms = 0;
+
+    const auto start = bench_clock::now();
+
+    for (size_t epoch = 0; epoch < options.epochs; ++epoch) {
+        generator->reset();
+
+        while (generator->has_next_batch()) {
+            auto data  = generator->data_batch();
+            auto label = generator->label_batch();
+
+            sink = sink + data[0] + label[0];
+
+            generator->next_batch();
+            ++batches;
+        }
+
+        // The statistics are counted since the last reset
+        if constexpr (has_prefetch<generator_t>::value) {
+            busy_ms += generator->prefetch().busy_ms;
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    result.workers            = has_prefetch<generator_t>::value ? dll::data_threads(generator_t::workers) : 0;
+    result.batches_per_second = batches / seconds;
+    result.utilisation        = result.workers ? busy_ms / (1000.0 * seconds * result.workers) : 0.0;
+
+    printf(" | %-24s | %7zu | %10.1f | %11s |\n", result.name.c_str(), result.workers, result.batches_per_second,
+           result.workers ? (std::to_string(int(100.0 * result.utilisation + 0.5)) + "%").c_str() : "-");
+
+    results.push_back(result);
+}
+
+/*!
+ * \brief Run one augmentation on both generators, for several numbers of threads
+ */
+template <typename... Augmentation>
+void bench_augmentation(const std::string& augmentation, const std::vector<image_t>& images, const std::vector<size_t>& labels,
+                        const bench_options& options, std::vector<bench_result>& results) {
+    using namespace dll;
+
+    bench_generator<inmemory_data_generator_desc<batch_size<B>, big_batch_size<8>, categorical, augmentation_workers<1>, Augmentation...>>(
+        "inmemory", augmentation, 1, images, labels, options, results);
+    bench_generator<inmemory_data_generator_desc<batch_size<B>, big_batch_size<8>, categorical, augmentation_workers<2>, Augmentation...>>(
+        "inmemory", augmentation, 2, images, labels, options, results);
+    bench_generator<inmemory_data_generator_desc<batch_size<B>, big_batch_size<8>, categorical, augmentation_workers<4>, Augmentation...>>(
+        "inmemory", augmentation, 4, images, labels, options, results);
+
+    bench_generator<outmemory_data_generator_desc<batch_size<B>, big_batch_size<8>, categorical, threaded, augmentation_workers<1>, Augmentation...>>(
+        "outmemory", augmentation, 1, images, labels, options, results);
+    bench_generator<outmemory_data_generator_desc<batch_size<B>, big_batch_size<8>, categorical, threaded, augmentation_workers<4>, Augmentation...>>(
+        "outmemory", augmentation, 4, images, labels, options, results);
+}
+
+/*!
+ * \brief Measure the training steps per second of a small CNN
+ */
+double bench_network(const bench_options& options) {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer<3, 32, 32, 16, 5, 5>,
+            dll::mp_2d_layer<16, 28, 28, 2, 2>,
+            dll::conv_layer<16, 14, 14, 16, 3, 3>,
+            dll::mp_2d_layer<16, 12, 12, 2, 2>,
+            dll::dense_layer<16 * 6 * 6, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<B>
+    >::network_t;
+
+    using trainer_t = typename network_t::desc::template trainer_t<network_t>;
+
+    auto net    = std::make_unique<network_t>();
+    auto inputs = std::make_unique<etl::fast_dyn_matrix<float, B, 3, 32, 32>>();
+    auto labels = std::make_unique<etl::fast_dyn_matrix<float, B, 10>>();
+
+    *inputs = etl::uniform_generator(0.0, 1.0);
+    *labels = 0.0;
+
+    for (size_t i = 0; i < B; ++i) {
+        (*labels)(i, i % 10) = 1.0;
+    }
+
+    auto trainer = std::make_unique<trainer_t>(*net);
+    trainer->init_training(B);
+
+    for (size_t s = 0; s < 3; ++s) {
+        trainer->train_batch(0, *inputs, *labels);
+    }
+
+    const auto start = bench_clock::now();
+
+    for (size_t s = 0; s < options.steps; ++s) {
+        trainer->train_batch(0, *inputs, *labels);
+    }
+
+    return options.steps / std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/*!
+ * \brief Write the results in the given JSON file
+ */
+bool write_json(const std::string& file, const bench_options& options, double network_rate, const std::vector<bench_result>& results) {
+    std::ofstream out(file);
+
+    out << "{\n";
+    out << "  \"samples\": " << options.samples << ",\n";
+    out << "  \"epochs\": " << options.epochs << ",\n";
+    out << "  \"batch\": " << B << ",\n";
+    out << "  \"network_steps_per_second\": " << network_rate << ",\n";
+    out << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& result = results[i];
+
+        out << (i ? ",\n" : "\n");
+        out << "    {\"name\": \"" << result.name << "\", \"workers\": " << result.workers << ", \"batches_per_second\": " << result.batches_per_second
+            << ", \"utilisation\": " << result.utilisation << ", \"network_ratio\": " << (network_rate > 0.0 ? result.batches_per_second / network_rate : 0.0) << "}";
+    }
+
+    out << "\n  ]\n}\n";
+
+    return bool(out);
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    bench_options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (i + 1 == argc) {
+            std::cout << "dll_generator_bench: error: missing value for " << arg << std::endl;
+            return 1;
+        }
+
+        if (arg == "--samples") {
+            options.samples = std::max<size_t>(B, std::stoul(argv[++i]));
+        } else if (arg == "--epochs") {
+            options.epochs = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--steps") {
+            options.steps = std::stoul(argv[++i]);
+        } else if (arg == "--json") {
+            options.json = argv[++i];
+        } else if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else {
+            std::cout << "dll_generator_bench: error: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<image_t> images(options.samples);
+    std::vector<size_t> labels(options.samples);
+
+    for (size_t i = 0; i < options.samples; ++i) {
+        images[i] = etl::uniform_generator(0.0, 255.0);
+        labels[i] = i % 10;
+    }
+
+    std::vector<bench_result> results;
+
+    printf(" | %-24s | %7s | %10s | %11s |\n", "Generator", "Threads", "Batches/s", "Utilisation");
+
+    bench_augmentation<>("none", images, labels, options, results);
+    bench_augmentation<dll::random_crop<32, 32>>("crop", images, labels, options, results);
+    bench_augmentation<dll::horizontal_mirroring>("mirror", images, labels, options, results);
+    bench_augmentation<dll::elastic_distortion<9>>("elastic", images, labels, options, results);
+    bench_augmentation<dll::noise<20>>("noise", images, labels, options, results);
+    bench_augmentation<dll::random_crop<32, 32>, dll::horizontal_mirroring, dll::elastic_distortion<9>, dll::noise<20>>("all", images, labels, options, results);
+
+    double network_rate = 0.0;
+
+    if (options.steps) {
+        network_rate = bench_network(options);
+
+        printf("\nNetwork: %.1f training steps/s (batch %zu)\n", network_rate, B);
+
+        for (auto& result : results) {
+            if (result.batches_per_second < network_rate) {
+                printf("  %s would starve the training (%.0f%% of the step rate)\n", result.name.c_str(), 100.0 * result.batches_per_second / network_rate);
+            }
+        }
+    }
+
+    if (!write_json(options.json, options, network_rate, results)) {
+        std::cout << "dll_generator_bench: error: unable to write " << options.json << std::endl;
+        return 1;
+    }
+
+    std::cout << results.size() << " results written to " << options.json << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,396 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Latency of the inference of single requests.
+ *
+ * Several clients send requests of one sample to a network, either as
+ * fast as possible (each client waits for its previous request) or at a
+ * fixed total arrival rate. With an arrival rate, the latency of a request
+ * is measured from its scheduled arrival, so that the time a late request
+ * waited for the previous one is not hidden. The requests are served by:
+ *
+ *  - one: dbn::forward_one
+ *  - batch: dbn::forward_batch, with an inference context per client
+ *  - batching: the micro-batching executor
+ *
+ * The percentiles of the latency and the throughput are printed and
+ * written in a JSON file. The time of each layer is measured on one
+ * request out of --sample: in the batch mode with the context of the
+ * client, in the other modes by forwarding the sampled requests again,
+ * after the run, through a timed context.
+ *
+ * The network is a MLP for MNIST, with random weights or loaded from a
+ * file written by dbn::store.
+ *
+ * Usage: dll_latency_bench [--network FILE] [--mode one|batch|batching] [--clients N] [--rate R]
+ *                          [--requests N] [--warmup N] [--sample N] [--max-batch N] [--deadline US]
+ *                          [--workers N] [--json FILE]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/util/batching.hpp"
+#include "dll/util/inference.hpp"
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+using network_t = dll::network_desc<
+    dll::network_layers<
+        dll::dense_layer<28 * 28, 500>,
+        dll::dense_layer<500, 250>,
+        dll::dense_layer<250, 10, dll::softmax>
+    >
+    , dll::batch_size<64>
+>::network_t;
+
+using sample_t  = etl::fast_dyn_matrix<float, 28 * 28>;
+using context_t = dll::inference_context<network_t, sample_t, 1>;
+
+/*!
+ * \brief The options of the benchmark
+ */
+struct bench_options {
+    std::string network;                       ///< The stored network (random weights if empty)
+    std::string mode  = "batch";               ///< The serving mode (one, batch or batching)
+    size_t clients    = 1;                     ///< The number of concurrent clients
+    double rate       = 0.0;                   ///< The total arrival rate (requests/s), 0 for closed loop
+    size_t requests   = 2000;                  ///< The number of measured requests per client
+    size_t warmup     = 100;                   ///< The number of requests per client before the measures
+    size_t sample     = 100;                   ///< One request out of sample has its layers timed
+    size_t max_batch  = network_t::batch_size; ///< The maximum batch of the executor
+    size_t deadline   = 2000;                  ///< The deadline of the executor (us)
+    size_t workers    = 1;                     ///< The number of workers of the executor
+    std::string json  = "latency_bench.json";  ///< The output file
+};
+
+/*!
+ * \brief The measures of one client
+ */
+struct client_results {
+    std::vector<double> latencies;              ///< The latency of each measured request (us)
+    std::vector<size_t> sampled;                ///< The indices of the sampled requests
+    double layer_times[network_t::layers] = {}; ///< The time of each layer on the sampled requests (seconds)
+    size_t timed                          = 0;  ///< The number of requests whose layers were timed
+};
+
+/*!
+ * \brief Returns the given percentile of the sorted latencies (nearest rank)
+ */
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+
+    const size_t n    = sorted.size();
+    const size_t rank = size_t(std::ceil(p / 100.0 * n));
+
+    return sorted[std::min(n - 1, rank ? rank - 1 : 0)];
+}
+
+/*!
+ * \brief Run the clients and return the time between the first arrival
+ * and the last completion (seconds)
+ *
+ * \param serve Serves one request, called with the client, the sample and
+ * whether the layers must be timed
+ */
+template <typename Serve>
+double run_clients(const bench_options& options, const std::vector<sample_t>& samples, std::vector<client_results>& results, Serve&& serve) {
+    // Each client has its share of the arrival rate
+    const auto interval = options.rate > 0.0
+                              ? std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(options.clients / options.rate))
+                              : bench_clock::duration::zero();
+
+    std::vector<bench_clock::time_point> ends(options.clients);
+
+    // The measures start when all the clients are warm
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    bench_clock::time_point start;
+
+    std::vector<std::thread> threads;
+
+    for (size_t c = 0; c < options.clients; ++c) {
+        threads.emplace_back([&, c] {
+            auto& result = results[c];
+
+            result.latencies.reserve(options.requests);
+
+            for (size_t w = 0; w < options.warmup; ++w) {
+                serve(c, samples[(c + w) % samples.size()], false);
+            }
+
+            ready.fetch_add(1);
+
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            // Spread the arrivals of the clients
+            const auto first = start + (interval / options.clients) * c;
+
+            std::this_thread::sleep_until(first);
+
+            for (size_t r = 0; r < options.requests; ++r) {
+                auto arrival = bench_clock::now();
+
+                if (options.rate > 0.0) {
+                    const auto scheduled = first + interval * r;
+
+                    std::this_thread::sleep_until(scheduled);
+
+                    arrival = scheduled;
+                }
+
+                const size_t index = (c * options.requests + r) % samples.size();
+                const bool timed   = r % options.sample == 0;
+
+                serve(c, samples[index], timed);
+
+                result.latencies.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - arrival).count());
+
+                if (timed) {
+                    result.sampled.push_back(index);
+                }
+            }
+
+            ends[c] = bench_clock::now();
+        });
+    }
+
+    while (ready.load() < options.clients) {
+        std::this_thread::yield();
+    }
+
+    start = bench_clock::now();
+    go.store(true, std::memory_order_release);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return std::chrono::duration<double>(*std::max_element(ends.begin(), ends.end()) - start).count();
+}
+
+/*!
+ * \brief Time the layers of the sampled requests with a dedicated context
+ */
+void replay_sampled(const network_t& net, const std::vector<sample_t>& samples, std::vector<client_results>& results) {
+    context_t context(net, samples.front());
+
+    auto batch = dll::batch_make<1>(samples.front());
+
+    for (auto& result : results) {
+        for (auto index : result.sampled) {
+            batch(0) = samples[index];
+
+            context.layer_times = result.layer_times;
+            context.forward_batch(batch);
+            context.layer_times = nullptr;
+
+            ++result.timed;
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    bench_options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (i + 1 == argc) {
+            std::cout << "dll_latency_bench: error: missing value for " << arg << std::endl;
+            return 1;
+        }
+
+        if (arg == "--network") {
+            options.network = argv[++i];
+        } else if (arg == "--mode") {
+            options.mode = argv[++i];
+        } else if (arg == "--clients") {
+            options.clients = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--rate") {
+            options.rate = std::stod(argv[++i]);
+        } else if (arg == "--requests") {
+            options.requests = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--warmup") {
+            options.warmup = std::stoul(argv[++i]);
+        } else if (arg == "--sample") {
+            options.sample = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--max-batch") {
+            options.max_batch = std::max<size_t>(1, std::min<size_t>(network_t::batch_size, std::stoul(argv[++i])));
+        } else if (arg == "--deadline") {
+            options.deadline = std::stoul(argv[++i]);
+        } else if (arg == "--workers") {
+            options.workers = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--json") {
+            options.json = argv[++i];
+        } else {
+            std::cout << "dll_latency_bench: error: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.mode != "one" && options.mode != "batch" && options.mode != "batching") {
+        std::cout << "dll_latency_bench: error: unknown mode " << options.mode << std::endl;
+        return 1;
+    }
+
+    auto net = std::make_unique<network_t>();
+
+    if (!options.network.empty()) {
+        net->load(options.network);
+    }
+
+    std::vector<sample_t> samples(256);
+
+    for (auto& sample : samples) {
+        sample = etl::uniform_generator(0.0, 1.0);
+    }
+
+    std::vector<client_results> results(options.clients);
+
+    double seconds = 0.0;
+
+    if (options.mode == "one") {
+        std::vector<double> sinks(options.clients);
+
+        seconds = run_clients(options, samples, results, [&](size_t c, const sample_t& sample, bool /*timed*/) {
+            auto output = net->forward_one(sample);
+            sinks[c] += output[0];
+        });
+
+        replay_sampled(*net, samples, results);
+    } else if (options.mode == "batch") {
+        std::vector<std::unique_ptr<context_t>> contexts;
+        std::vector<typename context_t::input_t> batches;
+
+        for (size_t c = 0; c < options.clients; ++c) {
+            contexts.push_back(std::make_unique<context_t>(*net, samples.front()));
+            batches.push_back(dll::batch_make<1>(samples.front()));
+        }
+
+        seconds = run_clients(options, samples, results, [&](size_t c, const sample_t& sample, bool timed) {
+            auto& context = *contexts[c];
+
+            batches[c](0) = sample;
+
+            if (timed) {
+                context.layer_times = results[c].layer_times;
+                ++results[c].timed;
+            }
+
+            context.forward_batch(batches[c]);
+
+            context.layer_times = nullptr;
+        });
+    } else {
+        dll::batching_executor<network_t, sample_t> executor(*net, samples.front(), options.max_batch, std::chrono::microseconds(options.deadline), options.workers);
+
+        seconds = run_clients(options, samples, results, [&](size_t /*c*/, const sample_t& sample, bool /*timed*/) {
+            executor.submit(sample).get();
+        });
+
+        auto stats = executor.stats();
+
+        std::cout << "Executor: " << stats.batches << " batches of " << stats.mean_batch_size << " requests on average" << std::endl;
+
+        replay_sampled(*net, samples, results);
+    }
+
+    // Merge the clients
+
+    std::vector<double> latencies;
+    double layer_times[network_t::layers] = {};
+    size_t timed = 0;
+
+    for (auto& result : results) {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+
+        for (size_t l = 0; l < network_t::layers; ++l) {
+            layer_times[l] += result.layer_times[l];
+        }
+
+        timed += result.timed;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    const double throughput = seconds > 0.0 ? latencies.size() / seconds : 0.0;
+
+    const double p50  = percentile(latencies, 50.0);
+    const double p90  = percentile(latencies, 90.0);
+    const double p99  = percentile(latencies, 99.0);
+    const double p999 = percentile(latencies, 99.9);
+
+    printf("Mode: %s, clients: %zu, rate: %s, requests: %zu\n", options.mode.c_str(), options.clients,
+           options.rate > 0.0 ? (std::to_string(size_t(options.rate)) + "/s").c_str() : "closed loop", latencies.size());
+    printf("Throughput: %.1f requests/s\n", throughput);
+    printf("Latency (us): p50 %.1f p90 %.1f p99 %.1f p999 %.1f max %.1f\n", p50, p90, p99, p999, latencies.back());
+
+    double total_layers = 0.0;
+
+    for (auto time : layer_times) {
+        total_layers += time;
+    }
+
+    std::vector<std::string> layer_names;
+
+    net->for_each_layer_i([&](size_t /*I*/, auto& layer) {
+        layer_names.push_back(layer.to_short_string(""));
+    });
+
+    printf("\nLayers (%zu sampled requests%s):\n", timed, options.mode == "batch" ? "" : ", replayed");
+
+    for (size_t l = 0; l < network_t::layers; ++l) {
+        printf(" | %2zu | %-40s | %10.2f us | %5.1f%% |\n", l, layer_names[l].c_str(), timed ? 1e6 * layer_times[l] / timed : 0.0,
+               total_layers > 0.0 ? 100.0 * layer_times[l] / total_layers : 0.0);
+    }
+
+    std::ofstream out(options.json);
+
+    out << "{\n";
+    out << "  \"mode\": \"" << options.mode << "\",\n";
+    out << "  \"clients\": " << options.clients << ",\n";
+    out << "  \"rate\": " << options.rate << ",\n";
+    out << "  \"requests\": " << latencies.size() << ",\n";
+    out << "  \"throughput\": " << throughput << ",\n";
+    out << "  \"latency_us\": {\"p50\": " << p50 << ", \"p90\": " << p90 << ", \"p99\": " << p99 << ", \"p999\": " << p999 << ", \"max\": " << latencies.back() << "},\n";
+    out << "  \"sampled\": " << timed << ",\n";
+    out << "  \"layers_us\": [";
+
+    for (size_t l = 0; l < network_t::layers; ++l) {
+        out << (l ? ", " : "") << (timed ? 1e6 * layer_times[l] / timed : 0.0);
+    }
+
+    out << "]\n}\n";
+
+    if (!out) {
+        std::cout << "dll_latency_bench: error: unable to write " << options.json << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
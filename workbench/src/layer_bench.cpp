@@ -0,0 +1,301 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Microbenchmarks of the kernels of the layers.
+ *
+ * Each benchmark trains a network made of a reshape and of the measured
+ * layer on random batches. The layer_profiler measures the forward pass,
+ * the backward pass and the gradients of the layer on each repetition,
+ * after some warmup batches. The median, the 95th percentile and the
+ * minimum of each phase are printed and written in a JSON file that
+ * tools/bench_compare.py compares against a baseline.
+ *
+ * Usage: dll_layer_bench [--warmup N] [--repetitions N] [--json FILE] [--filter TEXT]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/transform/shape_1d_layer.hpp"
+#include "dll/transform/shape_3d_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/util/layer_profiler.hpp"
+
+namespace {
+
+/*!
+ * \brief The options of the benchmarks
+ */
+struct bench_options {
+    size_t warmup      = 5;                  ///< The number of batches before the measures
+    size_t repetitions = 30;                 ///< The number of measured batches
+    std::string json   = "layer_bench.json"; ///< The output file
+    std::string filter;                      ///< Only run the benchmarks containing this text
+};
+
+/*!
+ * \brief The statistics of one phase (microseconds)
+ */
+struct phase_stats {
+    double median = 0.0; ///< The median
+    double p95    = 0.0; ///< The 95th percentile
+    double min    = 0.0; ///< The minimum
+};
+
+/*!
+ * \brief The result of one benchmark
+ */
+struct bench_result {
+    std::string name;   ///< The unique name of the benchmark
+    std::string layer;  ///< The kind of layer
+    std::string shape;  ///< The shape of the layer
+    std::string dtype;  ///< The type of the values
+    size_t batch;       ///< The batch size
+    phase_stats phases[dll::profile_phases]; ///< The statistics of each phase
+};
+
+constexpr const char* phase_names[dll::profile_phases] = {"forward", "backward", "gradients"};
+
+/*!
+ * \brief Compute the statistics of the given samples
+ */
+phase_stats statistics(std::vector<double> samples) {
+    phase_stats stats;
+
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    const size_t n = samples.size();
+
+    stats.min    = samples.front();
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+
+    // Nearest rank
+    stats.p95 = samples[std::min(n - 1, (95 * n + 99) / 100 - 1)];
+
+    return stats;
+}
+
+template <typename T>
+const char* dtype_name() {
+    return std::is_same<T, float>::value ? "float" : "double";
+}
+
+/*!
+ * \brief Measure the phases of the second layer of the given network
+ * \tparam Network The network (a reshape followed by the measured layer)
+ * \tparam Input The type of a batch of inputs
+ * \tparam Output The type of a batch of outputs of the layer
+ */
+template <typename Network, typename Input, typename Output>
+void bench_network(const std::string& layer, const std::string& shape, const bench_options& options, std::vector<bench_result>& results) {
+    using weight = typename Network::weight;
+
+    bench_result result;
+
+    result.layer = layer;
+    result.shape = shape;
+    result.dtype = dtype_name<weight>();
+    result.batch = Network::batch_size;
+    result.name  = layer + "/" + shape + "/b" + std::to_string(result.batch) + "/" + result.dtype;
+
+    if (!options.filter.empty() && result.name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    auto net = std::make_unique<Network>();
+
+    auto inputs = std::make_unique<Input>();
+    auto labels = std::make_unique<Output>();
+
+    *inputs = etl::normal_generator<weight>(0.0, 1.0);
+    *labels = etl::uniform_generator<weight>(0.0, 1.0);
+
+    dll::sgd_trainer<Network> trainer(*net);
+    trainer.init_training(Network::batch_size);
+
+    for (size_t i = 0; i < options.warmup; ++i) {
+        trainer.train_batch(0, *inputs, *labels);
+    }
+
+    dll::layer_profiler profiler;
+    profiler.add(net->template layer_get<1>());
+
+    dll::set_layer_profiler(&profiler);
+
+    std::vector<double> samples[dll::profile_phases];
+
+    for (size_t i = 0; i < options.repetitions; ++i) {
+        profiler.reset();
+
+        trainer.train_batch(0, *inputs, *labels);
+
+        for (size_t p = 0; p < dll::profile_phases; ++p) {
+            samples[p].push_back(profiler.layers[0]->total(dll::profile_phase(p)) / 1000.0);
+        }
+    }
+
+    dll::set_layer_profiler(nullptr);
+
+    for (size_t p = 0; p < dll::profile_phases; ++p) {
+        result.phases[p] = statistics(samples[p]);
+    }
+
+    printf(" | %-36s | %12.2f | %12.2f | %12.2f | %12.2f | %12.2f | %12.2f |\n", result.name.c_str(),
+           result.phases[0].median, result.phases[0].p95,
+           result.phases[1].median, result.phases[1].p95,
+           result.phases[2].median, result.phases[2].p95);
+
+    results.push_back(result);
+}
+
+template <typename T, size_t B, size_t In, size_t Out>
+void bench_dense(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = typename dll::network_desc<
+        dll::network_layers<
+            typename dll::shape_1d_layer_desc<In, dll::weight_type<T>>::layer_t,
+            typename dll::dense_layer_desc<In, Out, dll::relu, dll::weight_type<T>>::layer_t>,
+        dll::mean_squared_error, dll::batch_size<B>>::network_t;
+
+    bench_network<network_t, etl::fast_dyn_matrix<T, B, In>, etl::fast_dyn_matrix<T, B, Out>>(
+        "dense", std::to_string(In) + "x" + std::to_string(Out), options, results);
+}
+
+template <typename T, size_t B, size_t C, size_t N, size_t K, size_t F>
+void bench_conv(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = typename dll::network_desc<
+        dll::network_layers<
+            typename dll::shape_3d_layer_desc<C, N, N, dll::weight_type<T>>::layer_t,
+            typename dll::conv_layer_desc<C, N, N, K, F, F, dll::relu, dll::weight_type<T>>::layer_t>,
+        dll::mean_squared_error, dll::batch_size<B>>::network_t;
+
+    constexpr size_t M = N - F + 1;
+
+    bench_network<network_t, etl::fast_dyn_matrix<T, B, C, N, N>, etl::fast_dyn_matrix<T, B, K, M, M>>(
+        "conv", std::to_string(C) + "x" + std::to_string(N) + "x" + std::to_string(N) + "-" + std::to_string(K) + "x" + std::to_string(F) + "x" + std::to_string(F),
+        options, results);
+}
+
+template <typename T, size_t B, size_t C, size_t N, size_t P>
+void bench_mp(const bench_options& options, std::vector<bench_result>& results) {
+    using network_t = typename dll::network_desc<
+        dll::network_layers<
+            typename dll::shape_3d_layer_desc<C, N, N, dll::weight_type<T>>::layer_t,
+            typename dll::mp_3d_layer_desc<C, N, N, 1, P, P, dll::weight_type<T>>::layer_t>,
+        dll::mean_squared_error, dll::batch_size<B>>::network_t;
+
+    bench_network<network_t, etl::fast_dyn_matrix<T, B, C, N, N>, etl::fast_dyn_matrix<T, B, C, N / P, N / P>>(
+        "mp", std::to_string(C) + "x" + std::to_string(N) + "x" + std::to_string(N) + "-" + std::to_string(P) + "x" + std::to_string(P),
+        options, results);
+}
+
+/*!
+ * \brief Run the benchmarks of one type and one batch size
+ */
+template <typename T, size_t B>
+void bench_all(const bench_options& options, std::vector<bench_result>& results) {
+    bench_dense<T, B, 784, 500>(options, results);
+    bench_dense<T, B, 500, 250>(options, results);
+    bench_dense<T, B, 1024, 1024>(options, results);
+
+    bench_conv<T, B, 1, 28, 8, 5>(options, results);
+    bench_conv<T, B, 8, 24, 16, 3>(options, results);
+    bench_conv<T, B, 16, 16, 32, 3>(options, results);
+
+    bench_mp<T, B, 16, 24, 2>(options, results);
+}
+
+/*!
+ * \brief Write the results in the given JSON file
+ */
+bool write_json(const std::string& file, const bench_options& options, const std::vector<bench_result>& results) {
+    std::ofstream out(file);
+
+    out << "{\n";
+    out << "  \"warmup\": " << options.warmup << ",\n";
+    out << "  \"repetitions\": " << options.repetitions << ",\n";
+    out << "  \"unit\": \"us\",\n";
+    out << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& result = results[i];
+
+        out << (i ? ",\n" : "\n");
+        out << "    {\"name\": \"" << result.name << "\", \"layer\": \"" << result.layer << "\", \"shape\": \"" << result.shape
+            << "\", \"dtype\": \"" << result.dtype << "\", \"batch\": " << result.batch;
+
+        for (size_t p = 0; p < dll::profile_phases; ++p) {
+            auto& stats = result.phases[p];
+
+            out << ", \"" << phase_names[p] << "\": {\"median\": " << stats.median << ", \"p95\": " << stats.p95 << ", \"min\": " << stats.min << "}";
+        }
+
+        out << "}";
+    }
+
+    out << "\n  ]\n}\n";
+
+    return bool(out);
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    bench_options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (i + 1 == argc) {
+            std::cout << "dll_layer_bench: error: missing value for " << arg << std::endl;
+            return 1;
+        }
+
+        if (arg == "--warmup") {
+            options.warmup = std::stoul(argv[++i]);
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--json") {
+            options.json = argv[++i];
+        } else if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else {
+            std::cout << "dll_layer_bench: error: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<bench_result> results;
+
+    printf(" | %-36s | %12s | %12s | %12s | %12s | %12s | %12s |\n", "Benchmark (us)", "fwd median", "fwd p95", "bwd median", "bwd p95", "grad median", "grad p95");
+
+    bench_all<float, 32>(options, results);
+    bench_all<float, 128>(options, results);
+    bench_all<double, 32>(options, results);
+    bench_all<double, 128>(options, results);
+
+    if (!write_json(options.json, options, results)) {
+        std::cout << "dll_layer_bench: error: unable to write " << options.json << std::endl;
+        return 1;
+    }
+
+    std::cout << results.size() << " benchmarks written to " << options.json << std::endl;
+
+    return 0;
+}